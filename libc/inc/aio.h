@@ -0,0 +1,143 @@
+/// @file aio.h
+/// @brief Asynchronous input and output.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// A request is described by a control block, which must stay untouched
+/// until the request is completed. The reads of the files whose filesystem
+/// knows how are split into block requests, queued on the device, and the
+/// process goes on while the device serves them: many reads can thus be in
+/// flight at the same time. The other requests, and the writes, which land in
+/// the buffer cache, are served when they are submitted. The data read is
+/// placed in the buffer of the process, and the control block is updated,
+/// when the completion is checked with aio_error(), aio_return(), or
+/// aio_suspend(). Requests belong to the thread which submitted them, and are
+/// not notified with signals.
+
+#pragma once
+
+#include "stddef.h"
+#include "time.h"
+
+/// The largest number of requests of a process in flight at the same time.
+#define AIO_MAX 64
+/// The largest number of requests of a single lio_listio or aio_suspend.
+#define AIO_LISTIO_MAX 64
+/// The largest number of bytes moved by a single request.
+#define AIO_MAX_BYTES (1U << 20)
+
+/// @defgroup aio_opcodes Operations of the control blocks
+/// @{
+#define LIO_READ  0 ///< Reads aio_nbytes from the file, at aio_offset.
+#define LIO_WRITE 1 ///< Writes aio_nbytes to the file, at aio_offset.
+#define LIO_NOP   2 ///< The entry of lio_listio is ignored.
+/// @}
+
+/// @defgroup lio_modes Modes of lio_listio
+/// @{
+#define LIO_WAIT   0 ///< lio_listio returns once all the requests are completed.
+#define LIO_NOWAIT 1 ///< lio_listio returns once all the requests are submitted.
+/// @}
+
+/// @defgroup aio_cancel_results Results of aio_cancel
+/// @{
+#define AIO_CANCELED    0 ///< All the requests have been canceled.
+#define AIO_NOTCANCELED 1 ///< Some of the requests are still in flight.
+#define AIO_ALLDONE     2 ///< All the requests were already completed.
+/// @}
+
+/// @brief The control block of an asynchronous request.
+struct aiocb {
+    /// The file descriptor.
+    int aio_fildes;
+    /// The position inside the file.
+    off_t aio_offset;
+    /// The buffer.
+    volatile void *aio_buf;
+    /// The number of bytes.
+    size_t aio_nbytes;
+    /// Ignored, the requests have no priority.
+    int aio_reqprio;
+    /// The operation, used by lio_listio (LIO_READ, LIO_WRITE, LIO_NOP).
+    int aio_lio_opcode;
+    /// The error of the request, EINPROGRESS until it is completed, updated
+    /// by the kernel.
+    int __error;
+    /// The value returned by the request, updated by the kernel.
+    ssize_t __return;
+};
+
+#ifndef __KERNEL__
+
+/// @brief Starts an asynchronous read.
+/// @param aiocbp the control block.
+/// @return 0 if the request was submitted, -1 on failure and errno is set to
+/// indicate the error.
+int aio_read(struct aiocb *aiocbp);
+
+/// @brief Starts an asynchronous write.
+/// @param aiocbp the control block.
+/// @return 0 if the request was submitted, -1 on failure and errno is set to
+/// indicate the error.
+int aio_write(struct aiocb *aiocbp);
+
+/// @brief Returns the error of a request.
+/// @param aiocbp the control block.
+/// @return EINPROGRESS if the request is in flight, 0 if it succeeded, the
+/// error number otherwise.
+int aio_error(const struct aiocb *aiocbp);
+
+/// @brief Returns the value returned by a completed request.
+/// @param aiocbp the control block.
+/// @return the value returned by the read or write, -1 on failure and errno
+/// is set to indicate the error.
+ssize_t aio_return(struct aiocb *aiocbp);
+
+/// @brief Waits until at least one of the requests is completed.
+/// @param list the control blocks, the NULL entries are ignored.
+/// @param nent the number of entries of the list.
+/// @param timeout the longest time to wait, NULL to wait forever.
+/// @return 0 if a request is completed, -1 on failure and errno is set to
+/// indicate the error (EAGAIN if the time expired).
+int aio_suspend(const struct aiocb *const list[], int nent, const struct timespec *timeout);
+
+/// @brief Tries to cancel the requests on a file.
+/// @param fildes the file descriptor.
+/// @param aiocbp the request to cancel, NULL for all those on the file.
+/// @return AIO_CANCELED, AIO_NOTCANCELED, or AIO_ALLDONE, -1 on failure and
+/// errno is set to indicate the error.
+/// @details The requests queued on a device are never withdrawn.
+int aio_cancel(int fildes, struct aiocb *aiocbp);
+
+/// @brief Submits a list of requests.
+/// @param mode LIO_WAIT or LIO_NOWAIT.
+/// @param list the control blocks, the NULL entries are ignored.
+/// @param nent the number of entries of the list.
+/// @param sig must be NULL, the completions are not notified.
+/// @return 0 on success, -1 on failure and errno is set to indicate the error
+/// (EIO if some of the requests failed).
+int lio_listio(int mode, struct aiocb *const list[], int nent, void *sig);
+
+#else
+
+/// @brief Submits an asynchronous request of the calling thread.
+/// @param aiocbp the control block, in the memory of the process.
+/// @return 0 on success, -errno on failure.
+int sys_aio_submit(struct aiocb *aiocbp);
+
+/// @brief Updates the control blocks of the completed requests, and puts the
+/// calling thread to sleep if none of them is completed.
+/// @param list the control blocks.
+/// @param nent the number of entries of the list.
+/// @param timeout the longest time to wait, NULL to wait forever.
+/// @return 0 if a request is completed, -EAGAIN if the time expired,
+/// -ERESTARTSYS if the thread sleeps, -errno on failure.
+int sys_aio_suspend(const struct aiocb *const list[], int nent, const struct timespec *timeout);
+
+/// @brief Tries to cancel the requests of the calling thread on a file.
+/// @param fildes the file descriptor.
+/// @param aiocbp the request to cancel, NULL for all those on the file.
+/// @return AIO_NOTCANCELED or AIO_ALLDONE, -errno on failure.
+int sys_aio_cancel(int fildes, struct aiocb *aiocbp);
+
+#endif
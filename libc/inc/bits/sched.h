@@ -0,0 +1,23 @@
+/// @file sched.h
+/// @brief Flags of the clone system call.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#pragma once
+
+#if !defined(__SCHED_H) && !defined(__KERNEL__)
+#error "Never include <bits/sched.h> directly; use <sched.h> instead."
+#endif
+
+/// @defgroup clone_flags Flags of the clone system call
+/// @{
+#define CSIGNAL              0x000000FF ///< Signal sent to the parent when the child exits.
+#define CLONE_VM             0x00000100 ///< The child shares the memory of the parent.
+#define CLONE_FILES          0x00000400 ///< The child shares the table of the open files.
+#define CLONE_SIGHAND        0x00000800 ///< The child shares the signal handlers, requires CLONE_VM.
+#define CLONE_THREAD         0x00010000 ///< The child is in the same thread group (not supported).
+#define CLONE_SETTLS         0x00080000 ///< The child gets a thread-local storage segment in gs.
+#define CLONE_PARENT_SETTID  0x00100000 ///< The pid of the child is stored in the memory of the parent.
+#define CLONE_CHILD_CLEARTID 0x00200000 ///< The pid is cleared, and woken up as a futex, when the child exits.
+#define CLONE_CHILD_SETTID   0x01000000 ///< The pid of the child is stored in the memory of the child.
+/// @}
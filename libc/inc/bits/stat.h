@@ -33,3 +33,21 @@ typedef struct stat_t {
     /// Time of last status change.
     time_t st_ctime;
 } stat_t;
+
+/// @defgroup StatxMask Fields of statx
+/// @brief The fields of stat_t requested from statx, the others may be left
+/// zeroed when the filesystem can skip computing them.
+/// @{
+
+#define STATX_TYPE        0x0001U ///< The file type in st_mode.
+#define STATX_MODE        0x0002U ///< The permissions in st_mode.
+#define STATX_UID         0x0008U ///< st_uid.
+#define STATX_GID         0x0010U ///< st_gid.
+#define STATX_ATIME       0x0020U ///< st_atime.
+#define STATX_MTIME       0x0040U ///< st_mtime.
+#define STATX_CTIME       0x0080U ///< st_ctime.
+#define STATX_INO         0x0100U ///< st_ino.
+#define STATX_SIZE        0x0200U ///< st_size.
+#define STATX_BASIC_STATS 0x07FFU ///< All the fields.
+
+/// @}
@@ -42,5 +42,17 @@ typedef struct termios {
 #define ECHOKE  0x00000001 ///< If ICANON is set, KILL is echoed by erasing each character on the line.
 #define IEXTEN  0x00000400 ///< Enables implementation-defined input processing.
 
+// Indices of the control characters inside c_cc.
+
+#define VINTR  0  ///< Sends SIGINT, if ISIG is set.
+#define VQUIT  1  ///< Sends SIGQUIT, if ISIG is set.
+#define VERASE 2  ///< If ICANON is set, erases the preceding character.
+#define VKILL  3  ///< If ICANON is set, erases the current line.
+#define VEOF   4  ///< If ICANON is set, ends the line without a newline.
+#define VTIME  5  ///< If ICANON is not set, timeout of reads in tenths of a second.
+#define VMIN   6  ///< If ICANON is not set, minimum number of characters of reads.
+#define VSUSP  10 ///< Stops the process, if ISIG is set.
+#define VEOL   11 ///< If ICANON is set, an additional end-of-line character.
+
 /// @brief Mask for extracting control values.
 #define CTRL(x) ((x) & 037)
@@ -0,0 +1,52 @@
+/// @file dirent.h
+/// @brief Directory streams, which read the entries of a directory in batches.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#pragma once
+
+#include "sys/dirent.h"
+
+/// The number of entries read by each getdents of a directory stream.
+#define DIR_BATCH 16
+
+/// @brief An open directory, see opendir.
+typedef struct DIR {
+    /// The file descriptor of the directory.
+    int fd;
+    /// The entry which readdir returns next.
+    size_t next;
+    /// The number of entries in the buffer.
+    size_t count;
+    /// The entries read by the last getdents.
+    dirent_t entries[DIR_BATCH];
+} DIR;
+
+/// @brief Opens a directory stream.
+/// @param path the path of the directory.
+/// @return the stream, or NULL on failure with errno set.
+DIR *opendir(const char *path);
+
+/// @brief Opens a directory stream on an open directory.
+/// @param fd the file descriptor of the directory, owned by the stream.
+/// @return the stream, or NULL on failure with errno set.
+DIR *fdopendir(int fd);
+
+/// @brief Returns the next entry of a directory stream.
+/// @param dir the stream.
+/// @return the entry, valid until the next call, or NULL at the end.
+dirent_t *readdir(DIR *dir);
+
+/// @brief Moves a directory stream back to the first entry.
+/// @param dir the stream.
+void rewinddir(DIR *dir);
+
+/// @brief Returns the file descriptor of a directory stream.
+/// @param dir the stream.
+/// @return the file descriptor.
+int dirfd(DIR *dir);
+
+/// @brief Closes a directory stream, and its file descriptor.
+/// @param dir the stream.
+/// @return 0 on success, -1 on failure with errno set.
+int closedir(DIR *dir);
@@ -5,6 +5,8 @@
 
 #pragma once
 
+#include "stddef.h"
+
 #define O_ACCMODE   0003      ///< Bits defining the open mode
 #define O_RDONLY    00000000U ///< Open for reading only.
 #define O_WRONLY    00000001U ///< Open for writing only.
@@ -14,7 +16,24 @@
 #define O_TRUNC     00001000U ///< Truncate to zero length.
 #define O_APPEND    00002000U ///< Set append mode.
 #define O_NONBLOCK  00004000U ///< No delay.
+#define O_DIRECT    00040000U ///< Transfer the data without going through the caches.
 #define O_DIRECTORY 00200000U ///< If file exists has no effect. Otherwise, the file is created.
+#define O_CLOEXEC   02000000U ///< Close the file descriptor when executing a new program.
+
+#define AT_FDCWD (-100) ///< Resolves the relative paths from the working directory.
+
+/// @defgroup FileAdvice Advice on the use of the file data
+/// @brief Values accepted by posix_fadvise.
+/// @{
+
+#define POSIX_FADV_NORMAL     0 ///< No advice, the default behaviour.
+#define POSIX_FADV_RANDOM     1 ///< The data is accessed randomly, do not read ahead.
+#define POSIX_FADV_SEQUENTIAL 2 ///< The data is accessed sequentially, read ahead aggressively.
+#define POSIX_FADV_WILLNEED   3 ///< The data will be accessed soon, start reading it.
+#define POSIX_FADV_DONTNEED   4 ///< The data will not be accessed soon, drop it from the caches.
+#define POSIX_FADV_NOREUSE    5 ///< The data will be accessed once, do not keep it cached.
+
+/// @}
 
 /// @defgroup ModeBitsAccessPermission Mode Bits for Access Permission
 /// @brief The file modes.
@@ -45,3 +64,15 @@
 #define S_ISSOCK(m) (((m)&0170000) == 0140000) ///< socket
 
 /// @}
+
+#ifndef __KERNEL__
+
+/// @brief Tells the kernel how the data of the file is going to be accessed.
+/// @param fd the file descriptor.
+/// @param offset the start of the range the advice applies to.
+/// @param len the length of the range, 0 for up to the end of the file.
+/// @param advice the advice (POSIX_FADV_*).
+/// @return 0 on success, the error number on failure (errno is not set).
+int posix_fadvise(int fd, off_t offset, off_t len, int advice);
+
+#endif
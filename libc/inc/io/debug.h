@@ -46,6 +46,19 @@ void dbg_puts(const char *s);
 /// @param ... the list of arguments.
 void dbg_printf(const char *file, const char *fun, int line, char *header, short log_level, const char *format, ...);
 
+#ifdef __KERNEL__
+/// @brief Writes a stored message on the debug output, called by the drain
+/// of the kernel messages (see printk.h).
+/// @param file the name of the file.
+/// @param line the line inside the file.
+/// @param header the header to print.
+/// @param log_level the log level.
+/// @param text the message.
+/// @param new_line if the message starts a line, and needs the header.
+/// @return 1 if the message ends the line, 0 otherwise.
+int dbg_write_message(const char *file, int line, const char *header, short log_level, const char *text, int new_line);
+#endif
+
 /// @brief Transforms the given amount of bytes to a readable string.
 /// @param bytes The bytes to turn to string.
 /// @return String representing the bytes in human readable form.
@@ -61,3 +61,6 @@
 
 /// Maximum number of links to follow during resolving a path
 #define SYMLOOP_MAX 8
+
+/// Maximum number of bytes written atomically on a pipe.
+#define PIPE_BUF 4096
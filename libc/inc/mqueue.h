@@ -0,0 +1,165 @@
+/// @file mqueue.h
+/// @brief POSIX message queues.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// A queue is named by a string starting with a slash, and is opened as a
+/// descriptor. Its messages are received the highest priority first, and in
+/// the order they were sent among those of the same priority. The room of the
+/// messages is allocated when the queue is created, as mq_maxmsg slots of
+/// mq_msgsize bytes, so sending and receiving never allocate memory.
+
+#pragma once
+
+#include "fcntl.h"
+#include "stddef.h"
+
+#ifndef __KERNEL__
+#include "signal.h"
+#else
+#include "system/signal.h"
+#endif
+
+/// The number of priorities, from 0 to MQ_PRIO_MAX - 1.
+#define MQ_PRIO_MAX 32768
+/// The number of messages of a queue created without attributes.
+#define MQ_MAXMSG_DEFAULT 10
+/// The size of the messages of a queue created without attributes.
+#define MQ_MSGSIZE_DEFAULT 8192
+/// The largest number of messages of a queue.
+#define MQ_MAXMSG_MAX 1024
+/// The largest size of the messages of a queue.
+#define MQ_MSGSIZE_MAX 65536
+/// The largest room of the messages of a queue, in bytes.
+#define MQ_BYTES_MAX (1024 * 1024)
+
+/// @brief The descriptor of a message queue.
+typedef int mqd_t;
+
+/// @brief The attributes of a message queue.
+struct mq_attr {
+    /// The flags of the descriptor, 0 or O_NONBLOCK.
+    long mq_flags;
+    /// The largest number of messages in the queue.
+    long mq_maxmsg;
+    /// The largest size of a message.
+    long mq_msgsize;
+    /// The number of messages in the queue.
+    long mq_curmsgs;
+};
+
+#ifndef __KERNEL__
+
+/// @brief Opens a message queue, creating it if asked.
+/// @param name  The name of the queue, starting with a slash.
+/// @param oflag O_RDONLY, O_WRONLY or O_RDWR, with O_CREAT, O_EXCL and
+/// O_NONBLOCK.
+/// @param ...   With O_CREAT, the mode of the queue (mode_t), and its
+/// attributes (struct mq_attr *), NULL for the default ones.
+/// @return The descriptor, -1 on failure and errno is set to indicate the error.
+mqd_t mq_open(const char *name, int oflag, ...);
+
+/// @brief Closes the descriptor of a message queue.
+/// @param mqdes The descriptor.
+/// @return 0 on success, -1 on failure and errno is set to indicate the error.
+int mq_close(mqd_t mqdes);
+
+/// @brief Removes the name of a message queue, which is destroyed once all
+/// its descriptors are closed.
+/// @param name The name of the queue.
+/// @return 0 on success, -1 on failure and errno is set to indicate the error.
+int mq_unlink(const char *name);
+
+/// @brief Sends a message, waiting for room unless the descriptor is
+/// non-blocking.
+/// @param mqdes    The descriptor.
+/// @param msg_ptr  The message.
+/// @param msg_len  The size of the message, up to mq_msgsize.
+/// @param msg_prio The priority of the message, below MQ_PRIO_MAX.
+/// @return 0 on success, -1 on failure and errno is set to indicate the error
+/// (EAGAIN if the queue is full and the descriptor is non-blocking).
+int mq_send(mqd_t mqdes, const char *msg_ptr, size_t msg_len, unsigned int msg_prio);
+
+/// @brief Receives the oldest message of the highest priority, waiting for
+/// one unless the descriptor is non-blocking.
+/// @param mqdes    The descriptor.
+/// @param msg_ptr  Where the message is stored.
+/// @param msg_len  The size of the buffer, at least mq_msgsize.
+/// @param msg_prio Where the priority of the message is stored, can be NULL.
+/// @return The size of the message, -1 on failure and errno is set to indicate
+/// the error (EAGAIN if the queue is empty and the descriptor is non-blocking).
+ssize_t mq_receive(mqd_t mqdes, char *msg_ptr, size_t msg_len, unsigned int *msg_prio);
+
+/// @brief Asks to be notified when a message arrives on the empty queue, and
+/// no process is waiting to receive it. The notification happens once, then
+/// the registration is removed.
+/// @param mqdes        The descriptor.
+/// @param notification How to notify (SIGEV_SIGNAL, SIGEV_NONE), NULL to
+/// remove the registration of the calling process.
+/// @return 0 on success, -1 on failure and errno is set to indicate the error
+/// (EBUSY if another process is registered).
+int mq_notify(mqd_t mqdes, const struct sigevent *notification);
+
+/// @brief Returns the attributes of a message queue.
+/// @param mqdes   The descriptor.
+/// @param mqstat  Where the attributes are stored.
+/// @return 0 on success, -1 on failure and errno is set to indicate the error.
+int mq_getattr(mqd_t mqdes, struct mq_attr *mqstat);
+
+/// @brief Sets the flags of the descriptor of a message queue, only
+/// O_NONBLOCK can be changed.
+/// @param mqdes      The descriptor.
+/// @param mqstat     The new flags, in mq_flags.
+/// @param omqstat    Where the previous attributes are stored, can be NULL.
+/// @return 0 on success, -1 on failure and errno is set to indicate the error.
+int mq_setattr(mqd_t mqdes, const struct mq_attr *mqstat, struct mq_attr *omqstat);
+
+#else
+
+/// @brief Opens a message queue, creating it if asked.
+/// @param name  The name of the queue, starting with a slash.
+/// @param oflag The access mode, with O_CREAT, O_EXCL and O_NONBLOCK.
+/// @param mode  The mode of a queue which is created.
+/// @param attr  The attributes of a queue which is created, NULL for the
+/// default ones.
+/// @return The descriptor, -errno on failure.
+int sys_mq_open(const char *name, int oflag, mode_t mode, struct mq_attr *attr);
+
+/// @brief Removes the name of a message queue.
+/// @param name The name of the queue.
+/// @return 0 on success, -errno on failure.
+int sys_mq_unlink(const char *name);
+
+/// @brief Sends a message.
+/// @param mqdes    The descriptor.
+/// @param msg_ptr  The message.
+/// @param msg_len  The size of the message.
+/// @param msg_prio The priority of the message.
+/// @return 0 on success, -EAGAIN, -ERESTARTSYS if the process sleeps, -errno
+/// on failure.
+int sys_mq_send(mqd_t mqdes, const char *msg_ptr, size_t msg_len, unsigned int msg_prio);
+
+/// @brief Receives the oldest message of the highest priority.
+/// @param mqdes    The descriptor.
+/// @param msg_ptr  Where the message is stored.
+/// @param msg_len  The size of the buffer.
+/// @param msg_prio Where the priority of the message is stored, can be NULL.
+/// @return The size of the message, -EAGAIN, -ERESTARTSYS if the process
+/// sleeps, -errno on failure.
+ssize_t sys_mq_receive(mqd_t mqdes, char *msg_ptr, size_t msg_len, unsigned int *msg_prio);
+
+/// @brief Registers, or removes, the notification of the calling process.
+/// @param mqdes        The descriptor.
+/// @param notification How to notify, NULL to remove the registration.
+/// @return 0 on success, -errno on failure.
+int sys_mq_notify(mqd_t mqdes, const struct sigevent *notification);
+
+/// @brief Returns the attributes of a message queue, and sets the flags of
+/// the descriptor.
+/// @param mqdes   The descriptor.
+/// @param mqstat  The new flags, NULL to leave them untouched.
+/// @param omqstat Where the attributes are stored, can be NULL.
+/// @return 0 on success, -errno on failure.
+int sys_mq_getsetattr(mqd_t mqdes, const struct mq_attr *mqstat, struct mq_attr *omqstat);
+
+#endif
@@ -0,0 +1,55 @@
+/// @file poll.h
+/// @brief Waiting for events on a set of file descriptors.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#pragma once
+
+/// @defgroup poll_events Events of the file descriptors
+/// @{
+#define POLLIN     0x0001 ///< There is data to read.
+#define POLLPRI    0x0002 ///< There is urgent data to read.
+#define POLLOUT    0x0004 ///< Writing does not block.
+#define POLLERR    0x0008 ///< An error occurred, always reported.
+#define POLLHUP    0x0010 ///< The other end was closed, always reported.
+#define POLLNVAL   0x0020 ///< The descriptor is not open, always reported.
+#define POLLRDNORM 0x0040 ///< There is normal data to read.
+#define POLLWRNORM 0x0100 ///< Writing normal data does not block.
+/// @}
+
+/// The type of the number of file descriptors.
+typedef unsigned int nfds_t;
+
+/// @brief A file descriptor, and the events we wait for.
+struct pollfd {
+    /// The file descriptor, negative ones are ignored.
+    int fd;
+    /// The events we wait for.
+    short events;
+    /// The events which occurred, set by poll.
+    short revents;
+};
+
+#ifndef __KERNEL__
+
+/// @brief Waits for one of the file descriptors to be ready.
+/// @param fds The file descriptors, and their events.
+/// @param nfds The number of file descriptors.
+/// @param timeout The longest time to wait, in milliseconds, negative to wait
+/// forever, zero not to wait at all.
+/// @return The number of descriptors with events, 0 if the time expired, -1
+/// on failure and errno is set to indicate the error.
+int poll(struct pollfd *fds, nfds_t nfds, int timeout);
+
+#else
+
+/// @brief Waits for one of the file descriptors to be ready.
+/// @param fds The file descriptors, and their events.
+/// @param nfds The number of file descriptors.
+/// @param timeout The longest time to wait, in milliseconds, negative to wait
+/// forever, zero not to wait at all.
+/// @return The number of descriptors with events, 0 if the time expired,
+/// -errno on failure.
+int sys_poll(struct pollfd *fds, nfds_t nfds, int timeout);
+
+#endif
@@ -0,0 +1,128 @@
+/// @file pthread.h
+/// @brief Minimal POSIX threads, built on clone and futexes.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// Each thread is a process created with clone, which shares the memory, the
+/// open files and the signal handlers of its creator, and reaches its
+/// descriptor through the thread-local storage segment in gs. Nobody is
+/// signaled when a thread exits: the kernel frees it, and clears its tid to
+/// wake up pthread_join.
+
+#pragma once
+
+#include "stddef.h"
+#include "sys/futex.h"
+#include "sys/types.h"
+
+/// The default size of the stack of a thread.
+#define PTHREAD_STACK_DEFAULT (64 * 1024)
+/// The smallest size of the stack of a thread.
+#define PTHREAD_STACK_MIN (16 * 1024)
+
+/// @brief The descriptor of a thread, at the top of its stack.
+typedef struct pthread_desc_t {
+    /// The descriptor itself, read through gs.
+    struct pthread_desc_t *self;
+    /// The pid of the thread, cleared by the kernel when it exits.
+    volatile pid_t tid;
+    /// The function executed by the thread.
+    void *(*start_routine)(void *);
+    /// The argument of the function.
+    void *arg;
+    /// The value the thread exited with.
+    void *retval;
+    /// The memory holding the stack and the descriptor.
+    void *stack;
+    /// The size of the memory holding the stack and the descriptor.
+    size_t stack_size;
+} pthread_desc_t;
+
+/// @brief Identifies a thread.
+typedef pthread_desc_t *pthread_t;
+
+/// @brief The attributes of a new thread.
+typedef struct pthread_attr_t {
+    /// The size of the stack.
+    size_t stacksize;
+} pthread_attr_t;
+
+/// @brief A lock which can sleep.
+typedef struct pthread_mutex_t {
+    /// The futex of the lock.
+    futex_mutex_t lock;
+} pthread_mutex_t;
+
+/// @brief The attributes of a lock, none is supported.
+typedef struct pthread_mutexattr_t {
+    /// Unused.
+    int unused;
+} pthread_mutexattr_t;
+
+/// @brief Initializer of a free lock.
+#define PTHREAD_MUTEX_INITIALIZER { FUTEX_MUTEX_INIT }
+
+/// @brief Initializes the attributes with the default values.
+/// @param attr the attributes.
+/// @return 0.
+int pthread_attr_init(pthread_attr_t *attr);
+
+/// @brief Sets the size of the stack.
+/// @param attr the attributes.
+/// @param stacksize the size of the stack.
+/// @return 0 on success, EINVAL if the size is below PTHREAD_STACK_MIN.
+int pthread_attr_setstacksize(pthread_attr_t *attr, size_t stacksize);
+
+/// @brief Creates a thread, which executes start_routine(arg).
+/// @param thread where the identifier of the thread is stored.
+/// @param attr the attributes of the thread, NULL for the default ones.
+/// @param start_routine the function executed by the thread.
+/// @param arg the argument of the function.
+/// @return 0 on success, the error number on failure.
+int pthread_create(pthread_t *thread, const pthread_attr_t *attr, void *(*start_routine)(void *), void *arg);
+
+/// @brief Waits for a thread to exit, and frees its stack.
+/// @param thread the thread.
+/// @param retval where the value it exited with is stored, can be NULL.
+/// @return 0 on success, the error number on failure.
+int pthread_join(pthread_t thread, void **retval);
+
+/// @brief Terminates the calling thread.
+/// @param retval the value returned to pthread_join.
+void pthread_exit(void *retval) __attribute__((noreturn));
+
+/// @brief Returns the identifier of the calling thread.
+/// @return the identifier.
+pthread_t pthread_self(void);
+
+/// @brief Compares two thread identifiers.
+/// @param t1 the first identifier.
+/// @param t2 the second identifier.
+/// @return non-zero if they are equal, 0 otherwise.
+int pthread_equal(pthread_t t1, pthread_t t2);
+
+/// @brief Initializes a lock, which is free.
+/// @param mutex the lock.
+/// @param attr the attributes, ignored.
+/// @return 0.
+int pthread_mutex_init(pthread_mutex_t *mutex, const pthread_mutexattr_t *attr);
+
+/// @brief Destroys a lock.
+/// @param mutex the lock.
+/// @return 0 on success, EBUSY if it is taken.
+int pthread_mutex_destroy(pthread_mutex_t *mutex);
+
+/// @brief Takes a lock, sleeping while somebody else holds it.
+/// @param mutex the lock.
+/// @return 0.
+int pthread_mutex_lock(pthread_mutex_t *mutex);
+
+/// @brief Takes a lock, if it is free.
+/// @param mutex the lock.
+/// @return 0 on success, EBUSY if it is taken.
+int pthread_mutex_trylock(pthread_mutex_t *mutex);
+
+/// @brief Releases a lock.
+/// @param mutex the lock.
+/// @return 0.
+int pthread_mutex_unlock(pthread_mutex_t *mutex);
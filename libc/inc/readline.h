@@ -1,14 +1,64 @@
 /// @file readline.h
-/// @brief
+/// @brief Buffered line reader, and files kept in memory as lines.
 /// @copyright (c) 2014-2024 This file is distributed under the MIT License.
 /// See LICENSE.md for details.
 
+#pragma once
+
 #include "stddef.h"
+#include "time.h"
+
+/// @brief Reads a file a line at a time, keeping the bytes read past the end
+/// of a line for the next one, so that nothing is read twice.
+typedef struct readline_t {
+    /// The file descriptor.
+    int fd;
+    /// The first byte of the buffer not returned yet.
+    size_t pos;
+    /// The number of bytes inside the buffer.
+    size_t len;
+    /// The bytes read from the file.
+    char buffer[BUFSIZ];
+} readline_t;
+
+/// @brief The lines of a file, kept in memory until the file changes.
+typedef struct file_lines_t {
+    /// The content of the file, each line terminated by a NUL.
+    char *data;
+    /// The lines, pointing inside data.
+    char **lines;
+    /// The number of lines.
+    size_t count;
+    /// The inode of the file when it was read.
+    ino_t ino;
+    /// The size of the file when it was read.
+    off_t size;
+    /// The last modification time of the file when it was read.
+    time_t mtime;
+} file_lines_t;
+
+/// @brief Starts reading the lines of a file.
+/// @param reader the reader.
+/// @param fd the file descriptor, read from its current position.
+void readline_init(readline_t *reader, int fd);
 
 /// @brief Reads a line from the file.
-/// @param fd the file descriptor.
-/// @param buffer the buffer where we place the line.
+/// @param reader the reader.
+/// @param buffer the buffer where we place the line, without the newline.
 /// @param buflen the length of the buffer.
-/// @param readlen the amount we read, if negative, we did not encounter a newline.
+/// @param read_len the length of the line, can be NULL.
 /// @return 0 if we are done reading, 1 if we encountered a newline, -1 if otherwise.
-int readline(int fd, char *buffer, size_t buflen, ssize_t *read_len);
+/// @details A line longer than the buffer is truncated, the rest is skipped.
+int readline(readline_t *reader, char *buffer, size_t buflen, ssize_t *read_len);
+
+/// @brief Brings the lines of a file up to date, reading it again only when
+/// its inode, size or modification time changed.
+/// @param path the path of the file.
+/// @param cache the lines, empty the first time.
+/// @return 1 if the file was read, 0 if the lines were up to date, -1 on
+/// failure and errno is set, the lines are then dropped.
+int readlines_cached(const char *path, file_lines_t *cache);
+
+/// @brief Drops the lines of a file.
+/// @param cache the lines.
+void readlines_free(file_lines_t *cache);
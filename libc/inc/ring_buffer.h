@@ -69,6 +69,59 @@
         return rb->buffer[(rb->write > 0) ? rb->write - 1 : rb->size - 1];           \
     }
 
+/// @brief Declares a fixed-size, lock-free ring-buffer, for a single producer
+/// and a single consumer which can interrupt each other (e.g., an interrupt
+/// handler and a task). The length must be a power of two; the indices run
+/// freely, and only the producer moves `head`, only the consumer `tail`. When
+/// the buffer is full, the new items are dropped.
+#define DECLARE_SPSC_RING_BUFFER(type, name, length)                                                    \
+    typedef char spsc_rb_##name##_power_of_two[((length) & ((length) - 1)) ? -1 : 1];                   \
+    typedef struct spsc_rb_##name##_t {                                                                 \
+        volatile unsigned head, tail;                                                                   \
+        type buffer[length];                                                                            \
+    } spsc_rb_##name##_t;                                                                               \
+    static inline void spsc_rb_##name##_init(spsc_rb_##name##_t *rb)                                    \
+    {                                                                                                   \
+        rb->head = rb->tail = 0;                                                                        \
+    }                                                                                                   \
+    static inline unsigned spsc_rb_##name##_count(spsc_rb_##name##_t *rb)                               \
+    {                                                                                                   \
+        return rb->head - rb->tail;                                                                     \
+    }                                                                                                   \
+    static inline int spsc_rb_##name##_push(spsc_rb_##name##_t *rb, type item)                          \
+    {                                                                                                   \
+        unsigned head = rb->head;                                                                       \
+        if (head - rb->tail == (length))                                                                \
+            return 0;                                                                                   \
+        rb->buffer[head & ((length) - 1)] = item;                                                       \
+        /* The item must be there before the consumer sees the new head. */                             \
+        __asm__ __volatile__("" : : : "memory");                                                        \
+        rb->head = head + 1;                                                                            \
+        return 1;                                                                                       \
+    }                                                                                                   \
+    static inline unsigned spsc_rb_##name##_pop_bulk(spsc_rb_##name##_t *rb, type *items, unsigned max) \
+    {                                                                                                   \
+        unsigned tail = rb->tail, count = rb->head - tail;                                              \
+        if (count > max)                                                                                \
+            count = max;                                                                                \
+        __asm__ __volatile__("" : : : "memory");                                                        \
+        for (unsigned i = 0; i < count; ++i)                                                            \
+            items[i] = rb->buffer[(tail + i) & ((length) - 1)];                                         \
+        /* The items must be copied before the producer can reuse the slots. */                         \
+        __asm__ __volatile__("" : : : "memory");                                                        \
+        rb->tail = tail + count;                                                                        \
+        return count;                                                                                   \
+    }                                                                                                   \
+    static inline int spsc_rb_##name##_peek(spsc_rb_##name##_t *rb, unsigned index, type *item)         \
+    {                                                                                                   \
+        unsigned tail = rb->tail;                                                                       \
+        if (index >= rb->head - tail)                                                                   \
+            return 0;                                                                                   \
+        __asm__ __volatile__("" : : : "memory");                                                        \
+        *item = rb->buffer[(tail + index) & ((length) - 1)];                                            \
+        return 1;                                                                                       \
+    }
+
 #ifdef __KERNEL__
 /// Function for allocating memory for the ring buffer.
 #define RING_BUFFER_ALLOC kmalloc
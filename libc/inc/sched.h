@@ -3,10 +3,25 @@
 /// @copyright (c) 2014-2024 This file is distributed under the MIT License.
 /// See LICENSE.md for details.
 
+#pragma once
+
+/// Allows the inclusion of bits/sched.h.
+#define __SCHED_H
+
+#include "bits/sched.h"
 #include "sys/types.h"
 #include "time.h"
 #include "stdbool.h"
 
+/// @brief Fair scheduling of the processes, weighted by their nice value.
+#define SCHED_OTHER 0
+/// @brief Round-Robin among the processes with the highest priority.
+#define SCHED_RR 2
+/// @brief The process runs only when no other process is ready.
+#define SCHED_IDLE 5
+/// @brief Periodic process, scheduled by deadline or by period.
+#define SCHED_DEADLINE 6
+
 /// @brief Structure that describes scheduling parameters.
 typedef struct sched_param_t {
     /// Static execution priority.
@@ -21,6 +36,53 @@ typedef struct sched_param_t {
     bool_t is_periodic;
 } sched_param_t;
 
+/// @brief The number of CPUs a cpu_set_t can hold.
+#define CPU_SETSIZE 32
+
+/// @brief A set of CPUs.
+typedef struct cpu_set_t {
+    /// One bit for each CPU.
+    unsigned int __bits;
+} cpu_set_t;
+
+/// @brief Empties the set.
+#define CPU_ZERO(set) ((set)->__bits = 0)
+/// @brief Adds a CPU to the set.
+#define CPU_SET(cpu, set) ((set)->__bits |= (1U << (cpu)))
+/// @brief Removes a CPU from the set.
+#define CPU_CLR(cpu, set) ((set)->__bits &= ~(1U << (cpu)))
+/// @brief Checks if a CPU is inside the set.
+#define CPU_ISSET(cpu, set) (((set)->__bits >> (cpu)) & 1U)
+/// @brief Counts the CPUs inside the set.
+#define CPU_COUNT(set) (__cpu_count((set)->__bits))
+
+/// @brief Counts the bits set in a mask, without the helpers of libgcc.
+/// @param bits the mask.
+/// @return the number of bits set.
+static inline int __cpu_count(unsigned int bits)
+{
+    int count = 0;
+    while (bits) {
+        bits &= bits - 1;
+        ++count;
+    }
+    return count;
+}
+
+/// @brief Sets the CPUs a process can run on.
+/// @param pid the process, 0 for the caller.
+/// @param cpusetsize the size of the set.
+/// @param mask the set.
+/// @return 0 on success, -1 on failure and errno is set to indicate the error.
+int sched_setaffinity(pid_t pid, size_t cpusetsize, const cpu_set_t *mask);
+
+/// @brief Gets the CPUs a process can run on.
+/// @param pid the process, 0 for the caller.
+/// @param cpusetsize the size of the set.
+/// @param mask where to store the set.
+/// @return 0 on success, -1 on failure and errno is set to indicate the error.
+int sched_getaffinity(pid_t pid, size_t cpusetsize, cpu_set_t *mask);
+
 /// @brief Sets scheduling parameters.
 /// @param pid pid of the process we want to change the parameters. If zero,
 /// then the parameters of the calling process are set.
@@ -37,7 +99,49 @@ int sched_setparam(pid_t pid, const sched_param_t *param);
 /// @return 0 on success, -1 on failure and errno is set to indicate the error.
 int sched_getparam(pid_t pid, sched_param_t *param);
 
+/// @brief Sets the scheduling policy and parameters.
+/// @param pid pid of the process we want to change the policy. If zero, then
+/// the policy of the calling process is set.
+/// @param policy The new policy (SCHED_OTHER, SCHED_RR, SCHED_IDLE, SCHED_DEADLINE).
+/// @param param The new parameters, sched_priority must be a valid static
+/// priority (see nice).
+/// @return 0 on success, -1 on failure and errno is set to indicate the error.
+int sched_setscheduler(pid_t pid, int policy, const sched_param_t *param);
+
+/// @brief Gets the scheduling policy.
+/// @param pid pid of the process we want to retrieve the policy. If zero, then
+/// the policy of the calling process is returned.
+/// @return the policy on success, -1 on failure and errno is set to indicate the error.
+int sched_getscheduler(pid_t pid);
+
+/// @brief Gives the CPU to the other ready processes, the caller goes behind
+/// the ones with the same policy.
+/// @return 0 on success, -1 on failure and errno is set to indicate the error.
+int sched_yield(void);
+
+/// @brief Gives the rest of the time slice of the caller to the given process
+/// (a directed yield), which runs next if it is ready on the same CPU and
+/// has the same policy; otherwise, it is the same as sched_yield.
+/// @param pid the process.
+/// @return 0 on success, -1 on failure and errno is set to indicate the error.
+int sched_yield_to(pid_t pid);
+
 /// @brief Placed at the end of an infinite while loop, stops the process until,
 /// its next period starts. The calling process must be a periodic one.
 /// @return 0 on success, -1 on failure and errno is set to indicate the error.
 int waitperiod(void);
+
+/// @brief Creates a child process, which shares with the caller the
+/// resources selected by flags, and starts executing fn(arg) on the given
+/// stack, exiting with the value it returns.
+/// @param fn the function executed by the child.
+/// @param stack the top of the stack of the child.
+/// @param flags a combination of CLONE_*, or-ed with the signal sent to the
+/// parent when the child exits, 0 if the child is not waited for.
+/// @param arg the argument of fn.
+/// @param ptid where the pid of the child is stored, with CLONE_PARENT_SETTID.
+/// @param tls where the thread-local storage starts, with CLONE_SETTLS.
+/// @param ctid where the pid of the child is stored, with CLONE_CHILD_SETTID,
+/// and cleared when it exits, with CLONE_CHILD_CLEARTID.
+/// @return the pid of the child, -1 on failure and errno is set to indicate the error.
+int clone(int (*fn)(void *), void *stack, int flags, void *arg, pid_t *ptid, void *tls, pid_t *ctid);
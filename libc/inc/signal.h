@@ -185,6 +185,22 @@ typedef union sigval {
     void *sival_ptr; ///< Pointer value.
 } sigval_t;
 
+/// @defgroup sigev_notify How an asynchronous event is notified
+/// @{
+#define SIGEV_SIGNAL 0 ///< A signal is sent to the process.
+#define SIGEV_NONE   1 ///< Nothing is notified.
+/// @}
+
+/// @brief Describes how an asynchronous event is notified.
+struct sigevent {
+    /// How the event is notified (SIGEV_SIGNAL, SIGEV_NONE).
+    int sigev_notify;
+    /// The signal sent with SIGEV_SIGNAL.
+    int sigev_signo;
+    /// The value sent with the signal.
+    sigval_t sigev_value;
+};
+
 /// @brief Stores information about an occurrence of a specific signal.
 typedef struct siginfo_t {
     /// The signal number.
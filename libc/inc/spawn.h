@@ -0,0 +1,169 @@
+/// @file spawn.h
+/// @brief Functions used to create a new process running a given program.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#pragma once
+
+#include "stddef.h"
+#include "sys/types.h"
+#ifdef __KERNEL__
+#include "system/signal.h"
+#else
+#include "signal.h"
+#endif
+
+/// @brief The effective ids of the child are reset to the real ids of the parent.
+#define POSIX_SPAWN_RESETIDS 0x01
+/// @brief The child is placed in the process group given by the attributes.
+#define POSIX_SPAWN_SETPGROUP 0x02
+/// @brief The child starts with the signal mask given by the attributes.
+#define POSIX_SPAWN_SETSIGMASK 0x04
+
+/// @brief The maximum number of file actions performed when spawning a process.
+#define POSIX_SPAWN_MAX_ACTIONS 8
+
+/// @brief The kind of operations performed on the file descriptors of the child.
+typedef enum {
+    POSIX_SPAWN_ACTION_OPEN,  ///< Opens a file on the given file descriptor.
+    POSIX_SPAWN_ACTION_CLOSE, ///< Closes the given file descriptor.
+    POSIX_SPAWN_ACTION_DUP2,  ///< Duplicates a file descriptor on another one.
+} posix_spawn_action_type_t;
+
+/// @brief An operation performed on the file descriptors of the child.
+typedef struct posix_spawn_file_action_t {
+    /// The kind of operation.
+    posix_spawn_action_type_t type;
+    /// The file descriptor affected by the operation.
+    int fd;
+    /// The file descriptor to duplicate (POSIX_SPAWN_ACTION_DUP2).
+    int oldfd;
+    /// The flags used to open the file (POSIX_SPAWN_ACTION_OPEN).
+    int oflag;
+    /// The mode used to create the file (POSIX_SPAWN_ACTION_OPEN).
+    mode_t mode;
+    /// The path of the file (POSIX_SPAWN_ACTION_OPEN).
+    char *path;
+} posix_spawn_file_action_t;
+
+/// @brief The list of operations performed, in order, on the file descriptors
+/// of the child before running the program.
+typedef struct posix_spawn_file_actions_t {
+    /// The number of actions.
+    int count;
+    /// The actions.
+    posix_spawn_file_action_t actions[POSIX_SPAWN_MAX_ACTIONS];
+} posix_spawn_file_actions_t;
+
+/// @brief The attributes of the child.
+typedef struct posix_spawnattr_t {
+    /// Which attributes are applied (POSIX_SPAWN_*).
+    short flags;
+    /// The process group of the child, 0 to make it the leader of a new group.
+    pid_t pgroup;
+    /// The signal mask of the child.
+    sigset_t sigmask;
+} posix_spawnattr_t;
+
+/// @brief Creates a new process running the program at the given path.
+/// @param pid where the id of the new process is stored, if not NULL.
+/// @param path the path of the program.
+/// @param file_actions the operations performed on the file descriptors of the child, can be NULL.
+/// @param attrp the attributes of the child, can be NULL.
+/// @param argv the arguments of the program.
+/// @param envp the environment of the program.
+/// @return 0 on success, the error number on failure.
+/// @details Unlike fork followed by exec, the memory of the caller is never
+/// copied: the kernel builds the image of the new process directly.
+int posix_spawn(pid_t *pid, const char *path, const posix_spawn_file_actions_t *file_actions,
+                const posix_spawnattr_t *attrp, char *const argv[], char *const envp[]);
+
+/// @brief Like posix_spawn, but the program is searched inside the paths
+/// specified by the PATH environmental variable.
+/// @param pid where the id of the new process is stored, if not NULL.
+/// @param file the name of the program.
+/// @param file_actions the operations performed on the file descriptors of the child, can be NULL.
+/// @param attrp the attributes of the child, can be NULL.
+/// @param argv the arguments of the program.
+/// @param envp the environment of the program.
+/// @return 0 on success, the error number on failure.
+int posix_spawnp(pid_t *pid, const char *file, const posix_spawn_file_actions_t *file_actions,
+                 const posix_spawnattr_t *attrp, char *const argv[], char *const envp[]);
+
+/// @brief Initializes an empty list of file actions.
+/// @param file_actions the list.
+/// @return 0 on success, the error number on failure.
+int posix_spawn_file_actions_init(posix_spawn_file_actions_t *file_actions);
+
+/// @brief Releases the resources held by a list of file actions.
+/// @param file_actions the list.
+/// @return 0 on success, the error number on failure.
+int posix_spawn_file_actions_destroy(posix_spawn_file_actions_t *file_actions);
+
+/// @brief Adds the opening of a file on the given file descriptor.
+/// @param file_actions the list.
+/// @param fd the file descriptor, closed first if it is open.
+/// @param path the path of the file, it is copied.
+/// @param oflag the flags used to open the file.
+/// @param mode the mode used to create the file.
+/// @return 0 on success, the error number on failure.
+int posix_spawn_file_actions_addopen(posix_spawn_file_actions_t *file_actions, int fd, const char *path, int oflag, mode_t mode);
+
+/// @brief Adds the closing of the given file descriptor.
+/// @param file_actions the list.
+/// @param fd the file descriptor.
+/// @return 0 on success, the error number on failure.
+int posix_spawn_file_actions_addclose(posix_spawn_file_actions_t *file_actions, int fd);
+
+/// @brief Adds the duplication of a file descriptor on another one.
+/// @param file_actions the list.
+/// @param fd the file descriptor to duplicate.
+/// @param newfd the file descriptor which will refer to the same file.
+/// @return 0 on success, the error number on failure.
+int posix_spawn_file_actions_adddup2(posix_spawn_file_actions_t *file_actions, int fd, int newfd);
+
+/// @brief Initializes the attributes with the default values.
+/// @param attrp the attributes.
+/// @return 0 on success, the error number on failure.
+int posix_spawnattr_init(posix_spawnattr_t *attrp);
+
+/// @brief Releases the resources held by the attributes.
+/// @param attrp the attributes.
+/// @return 0 on success, the error number on failure.
+int posix_spawnattr_destroy(posix_spawnattr_t *attrp);
+
+/// @brief Sets which attributes are applied to the child.
+/// @param attrp the attributes.
+/// @param flags a combination of POSIX_SPAWN_* flags.
+/// @return 0 on success, the error number on failure.
+int posix_spawnattr_setflags(posix_spawnattr_t *attrp, short flags);
+
+/// @brief Gets which attributes are applied to the child.
+/// @param attrp the attributes.
+/// @param flags where the flags are stored.
+/// @return 0 on success, the error number on failure.
+int posix_spawnattr_getflags(const posix_spawnattr_t *attrp, short *flags);
+
+/// @brief Sets the process group of the child (POSIX_SPAWN_SETPGROUP).
+/// @param attrp the attributes.
+/// @param pgroup the process group, 0 to make the child the leader of a new group.
+/// @return 0 on success, the error number on failure.
+int posix_spawnattr_setpgroup(posix_spawnattr_t *attrp, pid_t pgroup);
+
+/// @brief Gets the process group of the child.
+/// @param attrp the attributes.
+/// @param pgroup where the process group is stored.
+/// @return 0 on success, the error number on failure.
+int posix_spawnattr_getpgroup(const posix_spawnattr_t *attrp, pid_t *pgroup);
+
+/// @brief Sets the signal mask of the child (POSIX_SPAWN_SETSIGMASK).
+/// @param attrp the attributes.
+/// @param sigmask the signal mask.
+/// @return 0 on success, the error number on failure.
+int posix_spawnattr_setsigmask(posix_spawnattr_t *attrp, const sigset_t *sigmask);
+
+/// @brief Gets the signal mask of the child.
+/// @param attrp the attributes.
+/// @param sigmask where the signal mask is stored.
+/// @return 0 on success, the error number on failure.
+int posix_spawnattr_getsigmask(const posix_spawnattr_t *attrp, sigset_t *sigmask);
@@ -29,8 +29,16 @@ typedef char int8_t;
 /// @brief Define the unsigned 8-bit integer.
 typedef unsigned char uint8_t;
 
+#ifdef __x86_64__
+/// @brief Define the signed integer as wide as a pointer.
+typedef long intptr_t;
+
+/// @brief Define the unsigned integer as wide as a pointer.
+typedef unsigned long uintptr_t;
+#else
 /// @brief Define the signed 32-bit pointer.
 typedef signed intptr_t;
 
 /// @brief Define the unsigned 32-bit pointer.
 typedef unsigned uintptr_t;
+#endif
@@ -23,6 +23,132 @@
 #define SEEK_END 2 ///< The file offset is set to the size of the file plus offset bytes.
 
 #ifndef __KERNEL__
+#define _IOFBF 0 ///< Fully buffered: the buffer is written when it is full.
+#define _IOLBF 1 ///< Line buffered: the buffer is written at each newline, too.
+#define _IONBF 2 ///< Unbuffered: each operation goes straight to the file.
+
+/// @brief A buffered stream, see fopen.
+typedef struct FILE {
+    /// The file descriptor.
+    int fd;
+    /// The state of the stream, see the __SF* flags in stdio.c.
+    int flags;
+    /// The buffering mode, _IOFBF, _IOLBF or _IONBF.
+    int mode;
+    /// The buffer, allocated at the first operation if not given by setvbuf.
+    char *buf;
+    /// The size of the buffer.
+    size_t size;
+    /// When reading, the next byte of the buffer to return.
+    size_t pos;
+    /// When reading, the bytes of the buffer read from the file; when
+    /// writing, the bytes of the buffer not yet written.
+    size_t len;
+    /// The buffer of the unbuffered streams.
+    char ch;
+    /// The next open stream.
+    struct FILE *next;
+} FILE;
+
+extern FILE *stdin;  ///< The standard input, unbuffered.
+extern FILE *stdout; ///< The standard output, line buffered.
+extern FILE *stderr; ///< The standard error output, unbuffered.
+
+/// @brief Opens the file whose name is the string pointed to by path, and
+///        associates a stream with it.
+/// @param path The file.
+/// @param mode "r", "w", "a", "r+", "w+" or "a+", optionally followed by "b".
+/// @return The stream, or NULL with errno set.
+FILE *fopen(const char *path, const char *mode);
+
+/// @brief Associates a stream with an open file descriptor.
+/// @param fd The file descriptor.
+/// @param mode The same as fopen, but the file is neither created nor truncated.
+/// @return The stream, or NULL with errno set.
+FILE *fdopen(int fd, const char *mode);
+
+/// @brief Flushes the stream and closes its file descriptor.
+/// @param stream The stream.
+/// @return 0 on success, EOF on failure.
+int fclose(FILE *stream);
+
+/// @brief Reads nmemb items of size bytes each from the stream.
+/// @param ptr Where the items are stored.
+/// @param size The size of an item.
+/// @param nmemb The number of items.
+/// @param stream The stream.
+/// @return The number of items read, less than nmemb at end-of-file or on error.
+size_t fread(void *ptr, size_t size, size_t nmemb, FILE *stream);
+
+/// @brief Writes nmemb items of size bytes each to the stream.
+/// @param ptr The items.
+/// @param size The size of an item.
+/// @param nmemb The number of items.
+/// @param stream The stream.
+/// @return The number of items written, less than nmemb on error.
+size_t fwrite(const void *ptr, size_t size, size_t nmemb, FILE *stream);
+
+/// @brief Writes the buffered data of the stream to its file.
+/// @param stream The stream, or NULL to flush all the open streams.
+/// @return 0 on success, EOF on failure.
+int fflush(FILE *stream);
+
+/// @brief Sets the buffering of the stream, before any other operation on it.
+/// @param stream The stream.
+/// @param buf The buffer to use, or NULL to allocate one.
+/// @param mode _IOFBF, _IOLBF or _IONBF.
+/// @param size The size of the buffer.
+/// @return 0 on success, EOF on failure.
+int setvbuf(FILE *stream, char *buf, int mode, size_t size);
+
+/// @brief Sets a buffer of BUFSIZ bytes, or disables buffering if buf is NULL.
+/// @param stream The stream.
+/// @param buf The buffer.
+void setbuf(FILE *stream, char *buf);
+
+/// @brief Moves the position of the stream, discarding the buffered input.
+/// @param stream The stream.
+/// @param offset The offset, relative to whence.
+/// @param whence SEEK_SET, SEEK_CUR or SEEK_END.
+/// @return 0 on success, -1 on failure.
+int fseek(FILE *stream, long offset, int whence);
+
+/// @brief Returns the position of the stream.
+/// @param stream The stream.
+/// @return The position, or -1 on failure.
+long ftell(FILE *stream);
+
+/// @brief Checks the end-of-file indicator of the stream.
+/// @param stream The stream.
+/// @return Non-zero if it is set.
+int feof(FILE *stream);
+
+/// @brief Checks the error indicator of the stream.
+/// @param stream The stream.
+/// @return Non-zero if it is set.
+int ferror(FILE *stream);
+
+/// @brief Clears the end-of-file and error indicators of the stream.
+/// @param stream The stream.
+void clearerr(FILE *stream);
+
+/// @brief Returns the file descriptor of the stream.
+/// @param stream The stream.
+/// @return The file descriptor.
+int fileno(FILE *stream);
+
+/// @brief Writes a character to the stream.
+/// @param c The character.
+/// @param stream The stream.
+/// @return The character, or EOF on failure.
+int fputc(int c, FILE *stream);
+
+/// @brief Writes a string, without its terminator, to the stream.
+/// @param str The string.
+/// @param stream The stream.
+/// @return A non-negative number on success, EOF on failure.
+int fputs(const char *str, FILE *stream);
+
 /// @brief Writes the given character to the standard output (stdout).
 /// @param character The character to send to stdout.
 void putchar(int character);
@@ -41,17 +167,17 @@ int getchar(void);
 /// @return The string received from standard input.
 char *gets(char *str);
 
-/// @brief Same as getchar but reads from the given file descriptor.
-/// @param fd The file descriptor from which it reads.
-/// @return The read character.
-int fgetc(int fd);
+/// @brief Reads the next character from the stream.
+/// @param stream The stream.
+/// @return The character, or EOF at end-of-file or on error.
+int fgetc(FILE *stream);
 
-/// @brief Same as gets but reads from the given file descriptor.
+/// @brief Reads a line from the stream, up to n - 1 characters.
 /// @param buf The buffer where the string should be placed.
-/// @param n   The amount of characters to read.
-/// @param fd  The file descriptor from which it reads.
-/// @return The read string.
-char *fgets(char *buf, int n, int fd);
+/// @param n   The size of the buffer.
+/// @param stream The stream.
+/// @return buf, or NULL if nothing was read.
+char *fgets(char *buf, int n, FILE *stream);
 #endif
 
 /// @brief Convert the given string to an integer.
@@ -83,21 +209,28 @@ int printf(const char *fmt, ...);
 int sprintf(char *str, const char *fmt, ...);
 
 #ifndef __KERNEL__
-/// @brief Write formatted output to a file.
-/// @param fd  The file descriptor associated with the file.
+/// @brief Write formatted output to a stream.
+/// @param stream The stream.
 /// @param fmt  Format string, following the same specifications as printf.
 /// @param ... The list of arguments.
 /// @return On success, the total number of characters written is returned.
 ///         On failure, a negative number is returned.
-int fprintf(int fd, const char *fmt, ...);
+int fprintf(FILE *stream, const char *fmt, ...);
 
-/// @brief Write formatted data from variable argument list to a file.
-/// @param fd  The file descriptor associated with the file.
+/// @brief Write formatted data from variable argument list to a stream.
+/// @param stream The stream.
 /// @param fmt  Format string, following the same specifications as printf.
 /// @param args A variable arguments list.
 /// @return On success, the total number of characters written is returned.
 ///         On failure, a negative number is returned.
-int vfprintf(int fd, const char *fmt, va_list args);
+int vfprintf(FILE *stream, const char *fmt, va_list args);
+
+/// @brief Write formatted data from variable argument list to stdout.
+/// @param fmt  Format string, following the same specifications as printf.
+/// @param args A variable arguments list.
+/// @return On success, the total number of characters written is returned.
+///         On failure, a negative number is returned.
+int vprintf(const char *fmt, va_list args);
 #endif
 
 /// @brief Write formatted data from variable argument list to string.
@@ -108,6 +241,42 @@ int vfprintf(int fd, const char *fmt, va_list args);
 ///         On failure, a negative number is returned.
 int vsprintf(char *str, const char *fmt, va_list args);
 
+/// @brief Write formatted data from variable argument list to a buffer of
+/// limited size.
+/// @param str  The buffer, always terminated if size is not zero.
+/// @param size The size of the buffer.
+/// @param fmt  Format string, following the same specifications as printf.
+/// @param args A variable arguments list.
+/// @return The number of characters the whole output has, which is size or
+///         more if it was truncated.
+int vsnprintf(char *str, size_t size, const char *fmt, va_list args);
+
+/// @brief Write formatted output to a buffer of limited size.
+/// @param str  The buffer, always terminated if size is not zero.
+/// @param size The size of the buffer.
+/// @param fmt  Format string, following the same specifications as printf.
+/// @param ... The list of arguments.
+/// @return The number of characters the whole output has, which is size or
+///         more if it was truncated.
+int snprintf(char *str, size_t size, const char *fmt, ...);
+
+/// @brief Receives the output of vcbprintf, a chunk at a time.
+/// @param data The argument given to vcbprintf.
+/// @param chunk The characters, not terminated.
+/// @param length The number of characters.
+/// @return 0 on success, a negative number on failure.
+typedef int (*printf_write_t)(void *data, const char *chunk, size_t length);
+
+/// @brief Write formatted data from variable argument list to a callback,
+/// through a small buffer, so that the output can have any length.
+/// @param callback The callback.
+/// @param data The argument of the callback.
+/// @param fmt  Format string, following the same specifications as printf.
+/// @param args A variable arguments list.
+/// @return On success, the total number of characters written is returned.
+///         If the callback fails, a negative number is returned.
+int vcbprintf(printf_write_t callback, void *data, const char *fmt, va_list args);
+
 #ifndef __KERNEL__
 /// @brief Read formatted input from stdin.
 /// @param fmt  Format string, following the same specifications as printf.
@@ -124,13 +293,13 @@ int scanf(const char *fmt, ...);
 ///         argument list successfully filled. EOF otherwise.
 int sscanf(const char *str, const char *fmt, ...);
 
-/// @brief The same as sscanf but the source is a file.
-/// @param fd  The file descriptor associated with the file.
+/// @brief The same as sscanf but the source is a line of a stream.
+/// @param stream The stream.
 /// @param fmt  Format string, following the same specifications as printf.
 /// @param ... The list of arguments where the values are stored.
 /// @return On success, the function returns the number of items of the
 ///         argument list successfully filled. EOF otherwise.
-int fscanf(int fd, const char *fmt, ...);
+int fscanf(FILE *stream, const char *fmt, ...);
 #endif
 
 /// @brief Prints a system error message.
@@ -0,0 +1,111 @@
+/// @file epoll.h
+/// @brief Scalable notification of the events on a set of file descriptors.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#pragma once
+
+#include "stdint.h"
+
+/// @defgroup epoll_events Events of the watched file descriptors
+/// @{
+#define EPOLLIN      0x0001u     ///< There is data to read.
+#define EPOLLPRI     0x0002u     ///< There is urgent data to read.
+#define EPOLLOUT     0x0004u     ///< Writing does not block.
+#define EPOLLERR     0x0008u     ///< An error occurred, always reported.
+#define EPOLLHUP     0x0010u     ///< The other end was closed, always reported.
+#define EPOLLRDNORM  0x0040u     ///< There is normal data to read.
+#define EPOLLWRNORM  0x0100u     ///< Writing normal data does not block.
+#define EPOLLONESHOT (1u << 30u) ///< Report the events once, until EPOLL_CTL_MOD.
+#define EPOLLET      (1u << 31u) ///< Report only the changes, edge-triggered.
+/// @}
+
+/// @defgroup epoll_ctl_ops Operations of epoll_ctl
+/// @{
+#define EPOLL_CTL_ADD 1 ///< Watches a new file descriptor.
+#define EPOLL_CTL_DEL 2 ///< Stops watching a file descriptor.
+#define EPOLL_CTL_MOD 3 ///< Changes the events of a watched file descriptor.
+/// @}
+
+/// @brief The data returned together with the events of a descriptor.
+typedef union epoll_data {
+    /// A pointer.
+    void *ptr;
+    /// A file descriptor.
+    int fd;
+    /// A 32-bit value.
+    uint32_t u32;
+    /// A 64-bit value.
+    uint64_t u64;
+} epoll_data_t;
+
+/// @brief The events of a file descriptor.
+struct epoll_event {
+    /// The events waited for, or those which occurred.
+    uint32_t events;
+    /// Given by the process, returned untouched.
+    epoll_data_t data;
+};
+
+#ifndef __KERNEL__
+
+/// @brief Creates an epoll instance.
+/// @param size Ignored, but it must be greater than zero.
+/// @return The file descriptor of the instance, -1 on failure and errno is
+/// set to indicate the error.
+int epoll_create(int size);
+
+/// @brief Creates an epoll instance.
+/// @param flags Must be zero.
+/// @return The file descriptor of the instance, -1 on failure and errno is
+/// set to indicate the error.
+int epoll_create1(int flags);
+
+/// @brief Adds, changes or removes a file descriptor watched by an instance.
+/// @param epfd  The file descriptor of the instance.
+/// @param op    One of the EPOLL_CTL_* operations.
+/// @param fd    The watched file descriptor.
+/// @param event The events to watch and their data, ignored by EPOLL_CTL_DEL.
+/// @return 0 on success, -1 on failure and errno is set to indicate the error.
+int epoll_ctl(int epfd, int op, int fd, struct epoll_event *event);
+
+/// @brief Waits for the events of the descriptors watched by an instance.
+/// @param epfd      The file descriptor of the instance.
+/// @param events    Where the events are stored.
+/// @param maxevents The maximum number of events returned, greater than zero.
+/// @param timeout   The longest time to wait, in milliseconds, negative to
+/// wait forever, zero not to wait at all.
+/// @return The number of events, 0 if the time expired, -1 on failure and
+/// errno is set to indicate the error.
+int epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout);
+
+#else
+
+/// @brief Creates an epoll instance.
+/// @param size Ignored, but it must be greater than zero.
+/// @return The file descriptor of the instance, -errno on failure.
+int sys_epoll_create(int size);
+
+/// @brief Creates an epoll instance.
+/// @param flags Must be zero.
+/// @return The file descriptor of the instance, -errno on failure.
+int sys_epoll_create1(int flags);
+
+/// @brief Adds, changes or removes a file descriptor watched by an instance.
+/// @param epfd  The file descriptor of the instance.
+/// @param op    One of the EPOLL_CTL_* operations.
+/// @param fd    The watched file descriptor.
+/// @param event The events to watch and their data, ignored by EPOLL_CTL_DEL.
+/// @return 0 on success, -errno on failure.
+int sys_epoll_ctl(int epfd, int op, int fd, struct epoll_event *event);
+
+/// @brief Waits for the events of the descriptors watched by an instance.
+/// @param epfd      The file descriptor of the instance.
+/// @param events    Where the events are stored.
+/// @param maxevents The maximum number of events returned, greater than zero.
+/// @param timeout   The longest time to wait, in milliseconds, negative to
+/// wait forever, zero not to wait at all.
+/// @return The number of events, 0 if the time expired, -errno on failure.
+int sys_epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout);
+
+#endif
@@ -0,0 +1,115 @@
+/// @file futex.h
+/// @brief Fast userspace locks, which enter the kernel only to sleep.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// A futex is an aligned int in the memory of the process, usually shared
+/// with other processes. The processes change it with atomic instructions,
+/// and ask the kernel to sleep on it, or to wake up who sleeps on it, only
+/// when they see contention. The kernel identifies a futex by its physical
+/// address, thus the processes can map it anywhere.
+
+#pragma once
+
+#include "time.h"
+
+/// @defgroup futex_ops Operations of the futex system call
+/// @{
+#define FUTEX_WAIT    0 ///< Sleeps if the futex holds the given value.
+#define FUTEX_WAKE    1 ///< Wakes up to the given number of waiters.
+#define FUTEX_REQUEUE 3 ///< Wakes some waiters, and moves others on a second futex.
+/// @}
+
+#ifndef __KERNEL__
+
+/// @brief Sleeps on a futex, or wakes up who sleeps on it.
+/// @param uaddr the futex.
+/// @param op one of FUTEX_*.
+/// @param val for FUTEX_WAIT, the value the futex must hold for the process
+/// to sleep; for the others, the number of waiters to wake up.
+/// @param timeout for FUTEX_WAIT, the longest time to sleep, NULL to sleep
+/// until woken up; for FUTEX_REQUEUE, the number of waiters to move, cast to
+/// a pointer.
+/// @param uaddr2 for FUTEX_REQUEUE, the futex where the waiters are moved.
+/// @return for FUTEX_WAIT, 0 once woken up; for the others, the number of
+/// waiters woken up, plus those moved. -1 on failure, and errno is set to
+/// indicate the error: EAGAIN if the futex did not hold the value, ETIMEDOUT
+/// if the time expired.
+int futex(int *uaddr, int op, int val, const struct timespec *timeout, int *uaddr2);
+
+/// @brief A lock which can sleep, built on a futex.
+typedef struct futex_mutex_t {
+    /// 0 if it is free, 1 if it is taken, 2 if someone might sleep on it.
+    volatile int state;
+} futex_mutex_t;
+
+/// @brief Initializer of a free lock.
+#define FUTEX_MUTEX_INIT { 0 }
+
+/// @brief A condition variable, built on a futex.
+typedef struct futex_cond_t {
+    /// Incremented at each signal, waiters sleep on it.
+    volatile int seq;
+} futex_cond_t;
+
+/// @brief Initializer of a condition variable.
+#define FUTEX_COND_INIT { 0 }
+
+/// @brief Initializes a lock, which is free.
+/// @param mutex the lock.
+void futex_mutex_init(futex_mutex_t *mutex);
+
+/// @brief Takes a lock, sleeping while somebody else holds it.
+/// @param mutex the lock.
+void futex_mutex_lock(futex_mutex_t *mutex);
+
+/// @brief Takes a lock, if it is free.
+/// @param mutex the lock.
+/// @return 1 if the lock was taken, 0 otherwise.
+int futex_mutex_trylock(futex_mutex_t *mutex);
+
+/// @brief Releases a lock, entering the kernel only if somebody sleeps on it.
+/// @param mutex the lock.
+void futex_mutex_unlock(futex_mutex_t *mutex);
+
+/// @brief Initializes a condition variable.
+/// @param cond the condition variable.
+void futex_cond_init(futex_cond_t *cond);
+
+/// @brief Releases the lock, sleeps until signaled, and takes the lock again.
+/// @param cond the condition variable.
+/// @param mutex the lock, held by the caller.
+void futex_cond_wait(futex_cond_t *cond, futex_mutex_t *mutex);
+
+/// @brief Wakes up one of the waiters of a condition variable.
+/// @param cond the condition variable.
+void futex_cond_signal(futex_cond_t *cond);
+
+/// @brief Wakes up all the waiters of a condition variable.
+/// @param cond the condition variable.
+/// @param mutex the lock the waiters take again, the waiters beyond the
+/// first are moved on it, instead of all racing for it.
+void futex_cond_broadcast(futex_cond_t *cond, futex_mutex_t *mutex);
+
+#else
+
+/// @brief Initializes the tables of the futexes.
+/// @return 0 on success, 1 on failure.
+int futex_init(void);
+
+/// @brief Checks if someone sleeps on a futex inside the given page, which
+/// must then stay where it is, since the futexes are keyed by physical address.
+/// @param phy_page the physical address of the page.
+/// @return 1 if there are waiters, 0 otherwise.
+int futex_page_has_waiters(uint32_t phy_page);
+
+/// @brief Sleeps on a futex, or wakes up who sleeps on it.
+/// @param uaddr the futex, in the memory of the calling process.
+/// @param op one of FUTEX_*.
+/// @param val the value, or the number of waiters to wake up.
+/// @param timeout the timeout, or the number of waiters to move.
+/// @param uaddr2 the futex where the waiters are moved.
+/// @return the result of the operation, -errno on failure.
+long sys_futex(int *uaddr, int op, int val, const struct timespec *timeout, int *uaddr2);
+
+#endif
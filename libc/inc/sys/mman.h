@@ -12,8 +12,21 @@
 #define PROT_WRITE 0x2 ///< Page can be written.
 #define PROT_EXEC  0x4 ///< Page can be executed.
 
-#define MAP_SHARED  0x01 ///< The memory is shared.
-#define MAP_PRIVATE 0x02 ///< The memory is private.
+#define MAP_SHARED    0x01 ///< The memory is shared.
+#define MAP_PRIVATE   0x02 ///< The memory is private.
+#define MAP_ANONYMOUS 0x20   ///< The memory is not backed by a file.
+#define MAP_POPULATE  0x8000 ///< The pages are mapped right away, instead of on first access.
+
+#define MADV_NORMAL     0 ///< No special treatment.
+#define MADV_RANDOM     1 ///< The pages are accessed in random order, do not map ahead.
+#define MADV_SEQUENTIAL 2 ///< The pages are accessed in sequential order, map further ahead.
+#define MADV_WILLNEED   3 ///< The pages are needed soon, read them ahead.
+#define MADV_DONTNEED   4 ///< The pages are not needed anymore, give them back.
+
+#define MCL_CURRENT 1 ///< Lock the pages currently mapped.
+#define MCL_FUTURE  2 ///< Lock the pages mapped from now on.
+
+#define MFD_CLOEXEC 1 ///< The descriptor of the memfd is closed on exec.
 
 #ifndef __KERNEL__
 
@@ -21,10 +34,93 @@ void *mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset)
 
 int munmap(void *addr, size_t length);
 
+/// @brief Gives advice about the use of the memory inside the given range.
+/// @param addr The start of the range, aligned to a page.
+/// @param length The length of the range.
+/// @param advice The advice (MADV_*).
+/// @return 0 on success, -1 on failure and errno is set to indicate the error.
+int madvise(void *addr, size_t length, int advice);
+
+/// @brief Maps the pages inside the given range, and keeps them in memory.
+/// @param addr The start of the range.
+/// @param length The length of the range.
+/// @return 0 on success, -1 on failure and errno is set to indicate the error.
+int mlock(const void *addr, size_t length);
+
+/// @brief Allows the pages inside the given range to be swapped out again.
+/// @param addr The start of the range.
+/// @param length The length of the range.
+/// @return 0 on success, -1 on failure and errno is set to indicate the error.
+int munlock(const void *addr, size_t length);
+
+/// @brief Locks all the pages of the process in memory.
+/// @param flags MCL_CURRENT, MCL_FUTURE, or both.
+/// @return 0 on success, -1 on failure and errno is set to indicate the error.
+int mlockall(int flags);
+
+/// @brief Allows all the pages of the process to be swapped out again.
+/// @return 0 on success, -1 on failure and errno is set to indicate the error.
+int munlockall(void);
+
+/// @brief Creates an anonymous file living in memory, which can be mapped,
+/// and passed to other processes by descriptor.
+/// @param name The name of the file, shown only for debugging.
+/// @param flags Zero, or MFD_CLOEXEC.
+/// @return The descriptor, -1 on failure and errno is set to indicate the error.
+int memfd_create(const char *name, unsigned int flags);
+
+/// @brief Opens, or creates, a POSIX shared memory object.
+/// @param name The name of the object, a slash followed by up to NAME_MAX
+/// characters which are not slashes.
+/// @param oflag O_RDONLY or O_RDWR, optionally with O_CREAT, O_EXCL and O_TRUNC.
+/// @param mode The permissions of the object, if it is created.
+/// @return The descriptor, -1 on failure and errno is set to indicate the error.
+int shm_open(const char *name, int oflag, mode_t mode);
+
+/// @brief Removes a POSIX shared memory object, which goes away once
+/// nobody has it open or mapped.
+/// @param name The name of the object.
+/// @return 0 on success, -1 on failure and errno is set to indicate the error.
+int shm_unlink(const char *name);
+
 #else
 
 void *sys_mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset);
 
 int sys_munmap(void *addr, size_t length);
 
+/// @brief Gives advice about the use of the memory inside the given range.
+/// @param addr The start of the range, aligned to a page.
+/// @param length The length of the range.
+/// @param advice The advice (MADV_*).
+/// @return 0 on success, -errno on failure.
+int sys_madvise(void *addr, size_t length, int advice);
+
+/// @brief Maps the pages inside the given range, and keeps them in memory.
+/// @param addr The start of the range.
+/// @param length The length of the range.
+/// @return 0 on success, -errno on failure.
+int sys_mlock(const void *addr, size_t length);
+
+/// @brief Allows the pages inside the given range to be swapped out again.
+/// @param addr The start of the range.
+/// @param length The length of the range.
+/// @return 0 on success, -errno on failure.
+int sys_munlock(const void *addr, size_t length);
+
+/// @brief Locks all the pages of the process in memory.
+/// @param flags MCL_CURRENT, MCL_FUTURE, or both.
+/// @return 0 on success, -errno on failure.
+int sys_mlockall(int flags);
+
+/// @brief Allows all the pages of the process to be swapped out again.
+/// @return 0 on success, -errno on failure.
+int sys_munlockall(void);
+
+/// @brief Creates an anonymous file living in memory, on tmpfs.
+/// @param name The name of the file, shown only for debugging.
+/// @param flags Zero, or MFD_CLOEXEC.
+/// @return The descriptor, -errno on failure.
+int sys_memfd_create(const char *name, unsigned int flags);
+
 #endif
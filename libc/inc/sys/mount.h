@@ -0,0 +1,32 @@
+/// @file mount.h
+/// @brief Mounting of filesystems.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#pragma once
+
+#ifndef __KERNEL__
+
+/// @brief Attaches the filesystem found on the source to the target directory.
+/// @param source The device holding the filesystem (e.g., "/dev/ram0"),
+/// ignored by the filesystems living in memory.
+/// @param target The directory where the filesystem is attached.
+/// @param filesystemtype The type of the filesystem (e.g., "ext2", "tmpfs").
+/// @param mountflags Currently ignored.
+/// @param data Currently ignored.
+/// @return 0 on success, -1 on failure and errno is set to indicate the error.
+int mount(const char *source, const char *target, const char *filesystemtype, unsigned long mountflags, const void *data);
+
+#else
+
+/// @brief Attaches the filesystem found on the source to the target directory.
+/// @param source The device holding the filesystem (e.g., "/dev/ram0"),
+/// ignored by the filesystems living in memory.
+/// @param target The directory where the filesystem is attached.
+/// @param filesystemtype The type of the filesystem (e.g., "ext2", "tmpfs").
+/// @param mountflags Currently ignored.
+/// @param data Currently ignored.
+/// @return 0 on success, -errno on failure.
+int sys_mount(const char *source, const char *target, const char *filesystemtype, unsigned long mountflags, const void *data);
+
+#endif
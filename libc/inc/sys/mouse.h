@@ -0,0 +1,30 @@
+/// @file mouse.h
+/// @brief The events read from the mouse device.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#pragma once
+
+#include "stdint.h"
+
+/// The device delivering the events of the mouse.
+#define MOUSE_DEVICE "/dev/input/mouse"
+
+#define MOUSE_BUTTON_LEFT   (1U << 0U) ///< The left button is held.
+#define MOUSE_BUTTON_RIGHT  (1U << 1U) ///< The right button is held.
+#define MOUSE_BUTTON_MIDDLE (1U << 2U) ///< The middle button is held.
+
+/// @brief An event of the mouse, a read returns as many as fit the buffer.
+/// @details The motion is summed up until it is read, a new event starts only
+/// when the buttons change, so that a slow reader gets few events, and misses
+/// no clicks.
+typedef struct mouse_event_t {
+    /// The horizontal motion since the previous event, positive to the right.
+    int32_t dx;
+    /// The vertical motion since the previous event, positive upwards.
+    int32_t dy;
+    /// The buttons held, a combination of MOUSE_BUTTON_*.
+    uint32_t buttons;
+    /// When the last motion was received, in milliseconds since boot.
+    uint32_t time;
+} mouse_event_t;
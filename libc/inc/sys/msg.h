@@ -29,18 +29,6 @@ struct msgbuf {
     char mtext[1];
 };
 
-/// Keeps track of a stored message.
-struct msg {
-    /// Pointer to the next message on queue.
-    struct msg *msg_next;
-    /// The type of message.
-    long msg_type;
-    /// Pointer to the beginning of the message.
-    char *msg_ptr;
-    /// The length of the message.
-    size_t msg_size;
-};
-
 /// @brief Message queue data structure.
 struct msqid_ds {
     /// Ownership and permissions.
@@ -0,0 +1,34 @@
+/// @file prctl.h
+/// @brief Operations on the calling process.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#pragma once
+
+/// Sets the slack of the timers of the calling process, in nanoseconds, 0
+/// for the default one.
+#define PR_SET_TIMERSLACK 29
+/// Returns the slack of the timers of the calling process, in nanoseconds.
+#define PR_GET_TIMERSLACK 30
+
+#ifndef __KERNEL__
+
+/// @brief Operates on the calling process.
+/// @param option the operation (e.g., PR_SET_TIMERSLACK).
+/// @param ... the argument of the operation, an unsigned long.
+/// @return the result of the operation, -1 on failure and errno is set to
+/// indicate the error.
+/// @details The slack, of 50 microseconds by default, is how late the
+/// timeouts of sleeps, polls and futexes can expire, so that those expiring
+/// close to each other wake up the CPU once. Child processes inherit it.
+int prctl(int option, ...);
+
+#else
+
+/// @brief Operates on the calling process.
+/// @param option the operation (e.g., PR_SET_TIMERSLACK).
+/// @param arg2 the argument of the operation.
+/// @return the result of the operation, -errno on failure.
+int sys_prctl(int option, unsigned long arg2);
+
+#endif
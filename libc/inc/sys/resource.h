@@ -0,0 +1,53 @@
+/// @file resource.h
+/// @brief Resources used by the processes.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#pragma once
+
+#include "time.h"
+
+/// The resources used by the calling process.
+#define RUSAGE_SELF 0
+/// The resources used by the children of the calling process, which were waited for.
+#define RUSAGE_CHILDREN (-1)
+
+/// @brief The resources used by a process.
+struct rusage {
+    timeval ru_utime; ///< Time spent running in user mode.
+    timeval ru_stime; ///< Time spent running in kernel mode.
+    long ru_maxrss;   ///< Resident set size, in kilobytes, when the usage was read.
+    long ru_ixrss;    ///< Integral shared memory size, unused.
+    long ru_idrss;    ///< Integral unshared data size, unused.
+    long ru_isrss;    ///< Integral unshared stack size, unused.
+    long ru_minflt;   ///< Page faults served without reading from a file.
+    long ru_majflt;   ///< Page faults which read a page of a file.
+    long ru_nswap;    ///< Swaps, unused.
+    long ru_inblock;  ///< Block input operations, unused.
+    long ru_oublock;  ///< Block output operations, unused.
+    long ru_msgsnd;   ///< IPC messages sent, unused.
+    long ru_msgrcv;   ///< IPC messages received, unused.
+    long ru_nsignals; ///< Signals received, unused.
+    long ru_nvcsw;    ///< Times the process gave up the CPU, to sleep.
+    long ru_nivcsw;   ///< Times the process was preempted.
+};
+
+#ifndef __KERNEL__
+
+/// @brief Returns the resources used by the calling process, or by its
+/// children which were waited for.
+/// @param who RUSAGE_SELF, or RUSAGE_CHILDREN.
+/// @param usage where the resources are stored.
+/// @return 0 on success, -1 on failure and errno is set to indicate the error.
+int getrusage(int who, struct rusage *usage);
+
+#else
+
+/// @brief Returns the resources used by the calling process, or by its
+/// children which were waited for.
+/// @param who RUSAGE_SELF, or RUSAGE_CHILDREN.
+/// @param usage where the resources are stored.
+/// @return 0 on success, -errno on failure.
+int sys_getrusage(int who, struct rusage *usage);
+
+#endif
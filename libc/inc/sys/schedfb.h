@@ -0,0 +1,25 @@
+/// @file schedfb.h
+/// @brief Layout of the records of `/proc/feedback`.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// When the kernel is built with `ENABLE_SCHEDULER_FEEDBACK`, at the end of
+/// each interval the scheduler records how many times each task was picked.
+/// Reading `/proc/feedback` from offset zero consumes the records, from the
+/// oldest to the newest; the records of an interval share the same time.
+
+#pragma once
+
+#include "stdint.h"
+
+/// @brief The share of the CPU of a task during an interval.
+typedef struct schedfb_record_t {
+    /// When the interval ended, in ticks since boot.
+    uint32_t time;
+    /// The pid of the task.
+    int32_t pid;
+    /// The times the task was picked during the interval.
+    uint32_t occur;
+    /// The times any task was picked during the interval.
+    uint32_t total;
+} schedfb_record_t;
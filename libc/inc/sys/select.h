@@ -0,0 +1,60 @@
+/// @file select.h
+/// @brief Waiting for a set of file descriptors to be ready.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#pragma once
+
+#include "time.h"
+
+/// The number of file descriptors held by a set.
+#define FD_SETSIZE 64
+
+/// The number of descriptors held by each word of a set.
+#define NFDBITS (8 * sizeof(unsigned long))
+
+/// @brief A set of file descriptors.
+typedef struct fd_set {
+    /// A bit for each file descriptor.
+    unsigned long fds_bits[FD_SETSIZE / NFDBITS];
+} fd_set;
+
+/// @brief Removes a file descriptor from a set.
+#define FD_CLR(fd, set) ((set)->fds_bits[(fd) / NFDBITS] &= ~(1UL << ((fd) % NFDBITS)))
+/// @brief Adds a file descriptor to a set.
+#define FD_SET(fd, set) ((set)->fds_bits[(fd) / NFDBITS] |= (1UL << ((fd) % NFDBITS)))
+/// @brief Checks if a file descriptor is in a set.
+#define FD_ISSET(fd, set) (((set)->fds_bits[(fd) / NFDBITS] >> ((fd) % NFDBITS)) & 1UL)
+/// @brief Empties a set.
+#define FD_ZERO(set)                                                               \
+    do {                                                                           \
+        for (unsigned int __i = 0; __i < FD_SETSIZE / NFDBITS; ++__i) {            \
+            (set)->fds_bits[__i] = 0;                                              \
+        }                                                                          \
+    } while (0)
+
+#ifndef __KERNEL__
+
+/// @brief Waits for some of the file descriptors to be ready.
+/// @param nfds The highest file descriptor in the sets, plus one.
+/// @param readfds The descriptors checked for reading, NULL for none.
+/// @param writefds The descriptors checked for writing, NULL for none.
+/// @param exceptfds The descriptors checked for urgent data, NULL for none.
+/// @param timeout The longest time to wait, NULL to wait forever.
+/// @return The number of descriptors ready, left inside the sets, 0 if the
+/// time expired, -1 on failure and errno is set to indicate the error.
+int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, timeval *timeout);
+
+#else
+
+/// @brief Waits for some of the file descriptors to be ready.
+/// @param nfds The highest file descriptor in the sets, plus one.
+/// @param readfds The descriptors checked for reading, NULL for none.
+/// @param writefds The descriptors checked for writing, NULL for none.
+/// @param exceptfds The descriptors checked for urgent data, NULL for none.
+/// @param timeout The longest time to wait, NULL to wait forever.
+/// @return The number of descriptors ready, left inside the sets, 0 if the
+/// time expired, -errno on failure.
+int sys_select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, timeval *timeout);
+
+#endif
@@ -30,6 +30,9 @@
 
 #define SEM_SET_MAX 256
 
+#define SEMVMX 32767 ///< Maximum value of a semaphore.
+#define SEMOPM 32    ///< Maximum number of operations of a semop call.
+
 /// @brief Optional argument for semctl() function
 union semun {
     /// @brief Value for SETVAL.
@@ -82,6 +85,10 @@ struct sembuf {
 /// @return 0 on success, 1 on failure.
 int sem_init(void);
 
+/// @brief Undoes the operations done with SEM_UNDO by an exiting process.
+/// @param pid the process.
+void sem_exit(pid_t pid);
+
 /// @brief Get a System V semaphore set identifier.
 /// @param key can be used either to obtain the identifier of a previously
 /// created semaphore set, or to create a new set.
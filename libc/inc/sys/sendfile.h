@@ -0,0 +1,35 @@
+/// @file sendfile.h
+/// @brief Transfer of data between file descriptors.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#pragma once
+
+#include "stddef.h"
+
+#ifndef __KERNEL__
+
+/// @brief Copies data from one file descriptor to another, inside the kernel.
+/// @param out_fd The file descriptor open for writing.
+/// @param in_fd  The file descriptor open for reading.
+/// @param offset If not NULL, the position inside the input file where the
+/// read starts, updated with the position following the last byte read; the
+/// offset of in_fd is then left untouched.
+/// @param count  The number of bytes to copy.
+/// @return The number of bytes written to out_fd, -1 on failure and errno is
+/// set to indicate the error.
+ssize_t sendfile(int out_fd, int in_fd, off_t *offset, size_t count);
+
+#else
+
+/// @brief Copies data from one file descriptor to another, inside the kernel.
+/// @param out_fd The file descriptor open for writing.
+/// @param in_fd  The file descriptor open for reading.
+/// @param offset If not NULL, the position inside the input file where the
+/// read starts, updated with the position following the last byte read; the
+/// offset of in_fd is then left untouched.
+/// @param count  The number of bytes to copy.
+/// @return The number of bytes written to out_fd, -errno on failure.
+ssize_t sys_sendfile(int out_fd, int in_fd, off_t *offset, size_t count);
+
+#endif
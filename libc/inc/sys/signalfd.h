@@ -0,0 +1,57 @@
+/// @file signalfd.h
+/// @brief Signals received by reading a file descriptor.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#pragma once
+
+#include "fcntl.h"
+#include "stddef.h"
+#include "stdint.h"
+
+#ifndef __KERNEL__
+#include "signal.h"
+#else
+#include "system/signal.h"
+#endif
+
+/// Creates the descriptor in non-blocking mode.
+#define SFD_NONBLOCK O_NONBLOCK
+
+/// @brief A signal read from a signalfd, 128 bytes long.
+struct signalfd_siginfo {
+    uint32_t ssi_signo;   ///< The signal number.
+    int32_t ssi_errno;    ///< The error number, unused.
+    int32_t ssi_code;     ///< Who raised the signal (see signal_sender_code_t).
+    uint32_t ssi_pid;     ///< Process ID of the sender.
+    uint32_t ssi_uid;     ///< Real user ID of the sender.
+    int32_t ssi_status;   ///< Exit value or signal, for SIGCHLD.
+    int32_t ssi_int;      ///< Integer value sent with the signal.
+    uint32_t ssi_ptr;     ///< Pointer value sent with the signal.
+    uint32_t ssi_addr;    ///< Address at which the fault occurred.
+    int32_t ssi_band;     ///< Band event, for SIGPOLL.
+    uint8_t __pad[88];    ///< Room for future fields.
+};
+
+#ifndef __KERNEL__
+
+/// @brief Creates a descriptor from which the given signals are read, or
+/// changes the signals of an existing one.
+/// @param fd    -1 to create a new descriptor, or an existing signalfd.
+/// @param mask  The signals to read, which should be blocked with sigprocmask,
+/// so that they are not delivered as usual.
+/// @param flags Zero, or SFD_NONBLOCK.
+/// @return The descriptor, -1 on failure and errno is set to indicate the error.
+int signalfd(int fd, const sigset_t *mask, int flags);
+
+#else
+
+/// @brief Creates a descriptor from which the given signals are read, or
+/// changes the signals of an existing one.
+/// @param fd    -1 to create a new descriptor, or an existing signalfd.
+/// @param mask  The signals to read.
+/// @param flags Zero, or SFD_NONBLOCK.
+/// @return The descriptor, -errno on failure.
+int sys_signalfd(int fd, const sigset_t *mask, int flags);
+
+#endif
@@ -0,0 +1,65 @@
+/// @file splice.h
+/// @brief Transfer of data between pipes and files, inside the kernel.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#pragma once
+
+#include "stddef.h"
+
+/// @defgroup splice_flags Flags of splice and tee
+/// @{
+#define SPLICE_F_MOVE     0x01 ///< A hint, the data is always copied.
+#define SPLICE_F_NONBLOCK 0x02 ///< Do not sleep on the pipes.
+#define SPLICE_F_MORE     0x04 ///< A hint, more data is coming.
+/// @}
+
+#ifndef __KERNEL__
+
+/// @brief Moves data between a pipe and a file descriptor, or between two
+/// pipes, without copying it through the memory of the process.
+/// @param fd_in  The file descriptor open for reading.
+/// @param off_in If fd_in is not a pipe and this is not NULL, the position
+/// where the read starts, updated with the position following the last byte
+/// read; the offset of fd_in is then left untouched. NULL for pipes.
+/// @param fd_out The file descriptor open for writing.
+/// @param off_out The same as off_in, for fd_out.
+/// @param len    The maximum number of bytes to move.
+/// @param flags  A mask of SPLICE_F_* flags.
+/// @return The number of bytes moved, 0 at the end of the input, -1 on
+/// failure and errno is set to indicate the error.
+ssize_t splice(int fd_in, off_t *off_in, int fd_out, off_t *off_out, size_t len, unsigned int flags);
+
+/// @brief Copies data from a pipe to another, leaving it in the first one.
+/// @param fd_in  The read end of the first pipe.
+/// @param fd_out The write end of the second pipe.
+/// @param len    The maximum number of bytes to copy.
+/// @param flags  A mask of SPLICE_F_* flags.
+/// @return The number of bytes copied, 0 at the end of the input, -1 on
+/// failure and errno is set to indicate the error.
+ssize_t tee(int fd_in, int fd_out, size_t len, unsigned int flags);
+
+#else
+
+/// @brief Moves data between a pipe and a file descriptor, or between two
+/// pipes, without copying it through the memory of the process.
+/// @param fd_in  The file descriptor open for reading.
+/// @param off_in If fd_in is not a pipe and this is not NULL, the position
+/// where the read starts, updated with the position following the last byte
+/// read; the offset of fd_in is then left untouched. NULL for pipes.
+/// @param fd_out The file descriptor open for writing.
+/// @param off_out The same as off_in, for fd_out.
+/// @param len    The maximum number of bytes to move.
+/// @param flags  A mask of SPLICE_F_* flags.
+/// @return The number of bytes moved, -errno on failure.
+ssize_t sys_splice(int fd_in, off_t *off_in, int fd_out, off_t *off_out, size_t len, unsigned int flags);
+
+/// @brief Copies data from a pipe to another, leaving it in the first one.
+/// @param fd_in  The read end of the first pipe.
+/// @param fd_out The write end of the second pipe.
+/// @param len    The maximum number of bytes to copy.
+/// @param flags  A mask of SPLICE_F_* flags.
+/// @return The number of bytes copied, -errno on failure.
+ssize_t sys_tee(int fd_in, int fd_out, size_t len, unsigned int flags);
+
+#endif
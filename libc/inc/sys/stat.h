@@ -22,6 +22,23 @@ int stat(const char *path, stat_t *buf);
 /// @return Returns a negative value on failure.
 int fstat(int fd, stat_t *buf);
 
+/// @brief Retrieves information about the file at the given location.
+/// @param dirfd The directory from which a relative path is resolved, or AT_FDCWD.
+/// @param path  The path to the file that is being inquired.
+/// @param buf   A structure where data about the file will be stored.
+/// @param flags Must be 0.
+/// @return Returns a negative value on failure.
+int fstatat(int dirfd, const char *path, stat_t *buf, int flags);
+
+/// @brief Retrieves the requested information about the file at the given location.
+/// @param dirfd The directory from which a relative path is resolved, or AT_FDCWD.
+/// @param path  The path to the file that is being inquired.
+/// @param flags Must be 0.
+/// @param mask  The STATX_* fields needed, the others may be left zeroed.
+/// @param buf   A structure where data about the file will be stored.
+/// @return Returns a negative value on failure.
+int statx(int dirfd, const char *path, int flags, unsigned int mask, stat_t *buf);
+
 /// @brief Creates a new directory at the given path.
 /// @param path The path of the new directory.
 /// @param mode The permission of the new directory.
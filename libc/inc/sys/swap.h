@@ -0,0 +1,34 @@
+/// @file swap.h
+/// @brief Enabling and disabling the swap areas.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#pragma once
+
+#ifndef __KERNEL__
+
+/// @brief Starts swapping to the given area, prepared with `mkswap`.
+/// @param path The block device (e.g., "/dev/hdb"), or the regular file.
+/// @param swapflags Currently ignored.
+/// @return 0 on success, -1 on failure and errno is set to indicate the error.
+int swapon(const char *path, int swapflags);
+
+/// @brief Stops swapping to the given area, bringing its pages back in memory.
+/// @param path The block device, or the regular file.
+/// @return 0 on success, -1 on failure and errno is set to indicate the error.
+int swapoff(const char *path);
+
+#else
+
+/// @brief Starts swapping to the given area, prepared with `mkswap`.
+/// @param path The block device (e.g., "/dev/hdb"), or the regular file.
+/// @param swapflags Currently ignored.
+/// @return 0 on success, -errno on failure.
+int sys_swapon(const char *path, int swapflags);
+
+/// @brief Stops swapping to the given area, bringing its pages back in memory.
+/// @param path The block device, or the regular file.
+/// @return 0 on success, -errno on failure.
+int sys_swapoff(const char *path);
+
+#endif
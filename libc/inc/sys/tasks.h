@@ -0,0 +1,51 @@
+/// @file tasks.h
+/// @brief Layout of the records of `/proc/tasks`.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// Reading `/proc/tasks` returns an array of task_record_t, one for each task,
+/// all taken at the same instant. The array is generated when the file is read
+/// from offset zero, the following reads continue through the same snapshot.
+
+#pragma once
+
+#include "stdint.h"
+
+/// Length of the name inside a task record, including the terminator.
+#define TASK_RECORD_NAME_MAX 32
+
+/// @brief The state of a task, inside `/proc/tasks`.
+typedef struct task_record_t {
+    /// The pid of the task.
+    int32_t pid;
+    /// The pid of the parent, 0 if it has none.
+    int32_t ppid;
+    /// The process group.
+    int32_t pgid;
+    /// The session.
+    int32_t sid;
+    /// The effective user.
+    uint32_t uid;
+    /// The state, with the letters of `/proc/<pid>/stat` (R, S, D, T, t, Z, X).
+    char state;
+    /// Padding, always zero.
+    char __pad[3];
+    /// The static priority.
+    int32_t prio;
+    /// The CPU whose runqueue holds the task.
+    uint32_t cpu;
+    /// The weighted execution time, used by the fair scheduler.
+    uint32_t vruntime;
+    /// The overall execution time, user and kernel, in ticks.
+    uint32_t runtime;
+    /// The time spent running in user mode, in ticks.
+    uint32_t utime;
+    /// The time spent running in kernel mode, in ticks.
+    uint32_t stime;
+    /// When the task started, in ticks since boot.
+    uint32_t start_time;
+    /// The number of pages mapped by the task, 0 for kernel threads.
+    uint32_t vm_pages;
+    /// The basename of the task, possibly truncated.
+    char name[TASK_RECORD_NAME_MAX];
+} task_record_t;
@@ -0,0 +1,61 @@
+/// @file timerfd.h
+/// @brief Timers whose expirations are read from a file descriptor.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#pragma once
+
+#include "fcntl.h"
+#include "time.h"
+
+/// Creates the descriptor in non-blocking mode.
+#define TFD_NONBLOCK O_NONBLOCK
+/// The expiration given to timerfd_settime is an absolute time of the clock.
+#define TFD_TIMER_ABSTIME 1
+
+#ifndef __KERNEL__
+
+/// @brief Creates a timer, whose expirations are read from a descriptor as
+/// an 8-byte counter.
+/// @param clockid CLOCK_REALTIME or CLOCK_MONOTONIC.
+/// @param flags   Zero, or TFD_NONBLOCK.
+/// @return The descriptor, -1 on failure and errno is set to indicate the error.
+int timerfd_create(clockid_t clockid, int flags);
+
+/// @brief Arms, or disarms, a timer.
+/// @param fd        The descriptor of the timer.
+/// @param flags     Zero, or TFD_TIMER_ABSTIME.
+/// @param new_value The first expiration, zero to disarm, and the period.
+/// @param old_value Where the previous setting is stored, can be NULL.
+/// @return 0 on success, -1 on failure and errno is set to indicate the error.
+int timerfd_settime(int fd, int flags, const itimerspec *new_value, itimerspec *old_value);
+
+/// @brief Returns the time until the next expiration of a timer, and its period.
+/// @param fd        The descriptor of the timer.
+/// @param curr_value Where the setting is stored.
+/// @return 0 on success, -1 on failure and errno is set to indicate the error.
+int timerfd_gettime(int fd, itimerspec *curr_value);
+
+#else
+
+/// @brief Creates a timer, whose expirations are read from a descriptor.
+/// @param clockid CLOCK_REALTIME or CLOCK_MONOTONIC.
+/// @param flags   Zero, or TFD_NONBLOCK.
+/// @return The descriptor, -errno on failure.
+int sys_timerfd_create(clockid_t clockid, int flags);
+
+/// @brief Arms, or disarms, a timer.
+/// @param fd        The descriptor of the timer.
+/// @param flags     Zero, or TFD_TIMER_ABSTIME.
+/// @param new_value The first expiration, zero to disarm, and the period.
+/// @param old_value Where the previous setting is stored, can be NULL.
+/// @return 0 on success, -errno on failure.
+int sys_timerfd_settime(int fd, int flags, const itimerspec *new_value, itimerspec *old_value);
+
+/// @brief Returns the time until the next expiration of a timer, and its period.
+/// @param fd        The descriptor of the timer.
+/// @param curr_value Where the setting is stored.
+/// @return 0 on success, -errno on failure.
+int sys_timerfd_gettime(int fd, itimerspec *curr_value);
+
+#endif
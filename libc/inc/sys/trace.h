@@ -0,0 +1,41 @@
+/// @file trace.h
+/// @brief Layout of the records of `/proc/trace`.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// The events named in `/proc/trace_events` are recorded into a ring buffer
+/// for each CPU. Reading `/proc/trace` from offset zero consumes the records
+/// of all the buffers, CPU after CPU, each one from the oldest record to the
+/// newest: the records of different CPUs are ordered by their timestamps.
+
+#pragma once
+
+#include "stdint.h"
+
+/// @brief The traced events, and the meaning of their arguments.
+typedef enum trace_event_t {
+    TRACE_SCHED_SWITCH,   ///< Previous pid, next pid, previous state.
+    TRACE_PAGE_FAULT,     ///< Faulting address, error code, instruction.
+    TRACE_KMALLOC,        ///< Address, size, caller.
+    TRACE_KFREE,          ///< Address, caller.
+    TRACE_BLOCK_ISSUE,    ///< Device, first sector, sectors, 1 for writes.
+    TRACE_BLOCK_COMPLETE, ///< Device, first sector, sectors, 0 on success.
+    TRACE_SYSCALL_ENTER,  ///< Number, first three arguments.
+    TRACE_SYSCALL_EXIT,   ///< Number, result.
+    TRACE_EVENT_NUM       ///< The number of events.
+} trace_event_t;
+
+/// @brief A traced event, inside `/proc/trace`.
+typedef struct trace_record_t {
+    /// When the event happened, in cycles of the time stamp counter, or in
+    /// ticks on CPUs without one.
+    unsigned long long timestamp;
+    /// The event, a trace_event_t.
+    uint16_t event;
+    /// The CPU where it happened.
+    uint16_t cpu;
+    /// The running task, 0 if none.
+    int32_t pid;
+    /// The arguments of the event.
+    uint32_t args[4];
+} trace_record_t;
@@ -0,0 +1,55 @@
+/// @file uio.h
+/// @brief Vectored input/output operations.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#pragma once
+
+#include "stddef.h"
+
+/// @brief Describes one of the buffers of a vectored operation.
+struct iovec {
+    /// Starting address of the buffer.
+    void *iov_base;
+    /// Number of bytes to transfer to, or from, the buffer.
+    size_t iov_len;
+};
+
+/// @brief Maximum number of buffers accepted by a single vectored operation.
+#define IOV_MAX 1024
+
+#ifndef __KERNEL__
+
+/// @brief Reads from the file descriptor into several buffers, in order.
+/// @param fd     The file descriptor.
+/// @param iov    The buffers to fill.
+/// @param iovcnt The number of buffers.
+/// @return The number of bytes read, -1 on failure and errno is set to
+/// indicate the error.
+ssize_t readv(int fd, const struct iovec *iov, int iovcnt);
+
+/// @brief Writes the content of several buffers to the file descriptor, in order.
+/// @param fd     The file descriptor.
+/// @param iov    The buffers to write.
+/// @param iovcnt The number of buffers.
+/// @return The number of bytes written, -1 on failure and errno is set to
+/// indicate the error.
+ssize_t writev(int fd, const struct iovec *iov, int iovcnt);
+
+#else
+
+/// @brief Reads from the file descriptor into several buffers, in order.
+/// @param fd     The file descriptor.
+/// @param iov    The buffers to fill.
+/// @param iovcnt The number of buffers.
+/// @return The number of bytes read, -errno on failure.
+ssize_t sys_readv(int fd, const struct iovec *iov, int iovcnt);
+
+/// @brief Writes the content of several buffers to the file descriptor, in order.
+/// @param fd     The file descriptor.
+/// @param iov    The buffers to write.
+/// @param iovcnt The number of buffers.
+/// @return The number of bytes written, -errno on failure.
+ssize_t sys_writev(int fd, const struct iovec *iov, int iovcnt);
+
+#endif
@@ -27,6 +27,24 @@ ssize_t read(int fd, void *buf, size_t nbytes);
 /// @return       The number of written bytes.
 ssize_t write(int fd, const void *buf, size_t nbytes);
 
+/// @brief        Read data from a file descriptor, at the given offset.
+/// @param fd     The file descriptor.
+/// @param buf    The buffer.
+/// @param nbytes The number of bytes to read.
+/// @param offset The position inside the file where the read starts.
+/// @return       The number of read characters.
+/// @details The file offset is not changed.
+ssize_t pread(int fd, void *buf, size_t nbytes, off_t offset);
+
+/// @brief        Write data into a file descriptor, at the given offset.
+/// @param fd     The file descriptor.
+/// @param buf    The buffer collecting data to written.
+/// @param nbytes The number of bytes to write.
+/// @param offset The position inside the file where the write starts.
+/// @return       The number of written bytes.
+/// @details The file offset is not changed.
+ssize_t pwrite(int fd, const void *buf, size_t nbytes, off_t offset);
+
 /// @brief Opens the file specified by pathname.
 /// @param pathname A pathname for a file.
 /// @param flags file status flags and file access modes of the open file description.
@@ -39,6 +57,14 @@ int open(const char *pathname, int flags, mode_t mode);
 /// @return The result of the operation.
 int close(int fd);
 
+/// @brief Commits the modified filesystem data to the disks.
+void sync(void);
+
+/// @brief Commits the modified data of the file to the disk.
+/// @param fd The file descriptor.
+/// @return 0 on success, -1 on failure and errno is set to indicate the error.
+int fsync(int fd);
+
 /// @brief Repositions the file offset inside a file.
 /// @param fd     The file descriptor of the file.
 /// @param offset The offest to use for the operation.
@@ -152,12 +178,20 @@ extern int setreuid(uid_t ruid, uid_t euid);
 /// @return pid_t parent process identifier.
 extern pid_t getppid(void);
 
+/// @brief Creates a new process, which is a copy of the calling process.
+/// @return Return -1 for errors, 0 to the new process, and the process ID of
+///         the new process to the old process.
+extern pid_t fork(void);
+
 /// @brief Clone the calling process, but without copying the whole address space.
 ///        The calling process is suspended until the new process exits or is
 ///        replaced by a call to `execve'.
 /// @return Return -1 for errors, 0 to the new process, and the process ID of
 ///         the new process to the old process.
-extern pid_t fork(void);
+/// @details The new process runs on the memory of the caller, it must not
+///          return from the function which called vfork, and it must only
+///          call execve or exit.
+extern pid_t vfork(void);
 
 /// @brief Replaces the current process image with a new process image (argument list).
 /// @param path The absolute path to the binary file to execute.
@@ -281,6 +315,28 @@ ssize_t getdents(int fd, dirent_t *dirp, unsigned int count);
 ///         On error, -1 is returned, and errno is set appropriately.
 int dup(int fd);
 
+/// @brief Makes a file descriptor refer to the same file of another.
+/// @param oldfd The fd pointing to the opened file.
+/// @param newfd The fd to use, closed first if it is open.
+/// @return On success, newfd is returned.
+///         On error, -1 is returned, and errno is set appropriately.
+int dup2(int oldfd, int newfd);
+
+/// @brief Creates a pipe, a stream of bytes between file descriptors.
+/// @param fds Where the descriptors are stored, fds[0] reads what is written
+///            on fds[1].
+/// @return On success, 0 is returned.
+///         On error, -1 is returned, and errno is set appropriately.
+int pipe(int fds[2]);
+
+/// @brief Creates a pipe, with the given flags on its descriptors.
+/// @param fds Where the descriptors are stored, fds[0] reads what is written
+///            on fds[1].
+/// @param flags Either 0 or O_NONBLOCK.
+/// @return On success, 0 is returned.
+///         On error, -1 is returned, and errno is set appropriately.
+int pipe2(int fds[2], int flags);
+
 /// @brief Send signal to calling thread after desired seconds.
 /// @param seconds the amount of seconds.
 /// @return If there is a previous alarm() request with time remaining, alarm()
@@ -326,3 +382,19 @@ int fchown(int fd, uid_t owner, gid_t group);
 /// @return On success, 0 is returned.
 ///         On error, -1 is returned, and errno is set appropriately.
 int lchown(const char *pathname, uid_t owner, gid_t group);
+
+/// @brief Changes the size of a file, the data past the new size is lost and
+/// the extension reads as zeros.
+/// @param path The pathname of the file, which must be writable.
+/// @param length The new size.
+/// @return On success, 0 is returned.
+///         On error, -1 is returned, and errno is set appropriately.
+int truncate(const char *path, off_t length);
+
+/// @brief Changes the size of a file, the data past the new size is lost and
+/// the extension reads as zeros.
+/// @param fd The fd pointing to the file, which must be open for writing.
+/// @param length The new size.
+/// @return On success, 0 is returned.
+///         On error, -1 is returned, and errno is set appropriately.
+int ftruncate(int fd, off_t length);
@@ -0,0 +1,128 @@
+/// @file uring.h
+/// @brief Rings of system calls, submitted in batches.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// A ring lives in the memory of the process, and is shared with the kernel.
+/// The process writes its requests in the submission queue, and advances
+/// sq_tail. A single uring_enter() makes the kernel execute all of them, in
+/// order, and post their results in the completion queue, advancing cq_tail.
+/// The process reads the results, and advances cq_head. The heads and the
+/// tails run freely, the slot of a position is given by masking it with
+/// (entries - 1). Both queues have the same number of entries, thus a request
+/// is taken only if there is room for its completion.
+
+#pragma once
+
+#include "stddef.h"
+
+/// The maximum number of entries of a ring.
+#define URING_MAX_ENTRIES 256
+
+/// @defgroup uring_ops Operations of the submission queue entries
+/// @{
+#define URING_OP_NOP   0 ///< Does nothing, completes with 0.
+#define URING_OP_READ  1 ///< read(fd, addr, len).
+#define URING_OP_WRITE 2 ///< write(fd, addr, len).
+#define URING_OP_OPEN  3 ///< open(addr, len, arg), len holds the flags, arg the mode.
+#define URING_OP_CLOSE 4 ///< close(fd).
+#define URING_OP_STAT  5 ///< stat(addr, arg), arg points to the stat_t.
+/// @}
+
+/// @brief A request, in the submission queue.
+typedef struct uring_sqe_t {
+    /// The operation, one of URING_OP_*.
+    unsigned int opcode;
+    /// The file descriptor.
+    int fd;
+    /// The buffer, or the path.
+    unsigned long addr;
+    /// The length of the buffer, or the flags.
+    unsigned long len;
+    /// The extra argument of the operation.
+    unsigned long arg;
+    /// Copied, untouched, in the completion.
+    unsigned long user_data;
+} uring_sqe_t;
+
+/// @brief A result, in the completion queue.
+typedef struct uring_cqe_t {
+    /// The user_data of the request.
+    unsigned long user_data;
+    /// The value returned by the operation, -errno on failure.
+    long res;
+} uring_cqe_t;
+
+/// @brief The header of a ring, followed by the submission queue and then by
+/// the completion queue.
+typedef struct uring_t {
+    /// The next request the kernel takes, advanced by the kernel.
+    volatile unsigned int sq_head;
+    /// The position after the last request, advanced by the process.
+    volatile unsigned int sq_tail;
+    /// The next completion the process reads, advanced by the process.
+    volatile unsigned int cq_head;
+    /// The position after the last completion, advanced by the kernel.
+    volatile unsigned int cq_tail;
+    /// The number of entries of each queue, a power of two.
+    unsigned int entries;
+} uring_t;
+
+/// @brief Returns the submission queue of a ring.
+/// @param ring the ring.
+/// @return the first entry of the queue.
+#define URING_SQES(ring) ((uring_sqe_t *)((ring) + 1))
+
+/// @brief Returns the completion queue of a ring.
+/// @param ring the ring.
+/// @return the first entry of the queue.
+#define URING_CQES(ring) ((uring_cqe_t *)(URING_SQES(ring) + (ring)->entries))
+
+/// @brief Returns the size of a ring.
+/// @param entries the number of entries of each queue.
+/// @return the size in bytes.
+#define URING_SIZE(entries) (sizeof(uring_t) + (entries) * (sizeof(uring_sqe_t) + sizeof(uring_cqe_t)))
+
+#ifndef __KERNEL__
+
+/// @brief Creates a ring in the memory of the process.
+/// @param entries the number of entries of each queue, rounded up to a power
+/// of two, at most URING_MAX_ENTRIES.
+/// @return the ring, NULL on failure and errno is set to indicate the error.
+uring_t *uring_setup(unsigned int entries);
+
+/// @brief Makes the kernel execute the requests of the submission queue.
+/// @param ring the ring.
+/// @return the number of requests executed, -1 on failure and errno is set
+/// to indicate the error.
+int uring_enter(uring_t *ring);
+
+/// @brief Returns the next free entry of the submission queue, which is
+/// added to the queue by uring_submit.
+/// @param ring the ring.
+/// @return the entry, NULL if the queue is full.
+uring_sqe_t *uring_get_sqe(uring_t *ring);
+
+/// @brief Adds the entry returned by uring_get_sqe to the submission queue.
+/// @param ring the ring.
+void uring_submit(uring_t *ring);
+
+/// @brief Takes the next completion.
+/// @param ring the ring.
+/// @param cqe where the completion is copied.
+/// @return 1 if there was a completion, 0 otherwise.
+int uring_peek_cqe(uring_t *ring, uring_cqe_t *cqe);
+
+#else
+
+/// @brief Creates a ring in the memory of the calling process.
+/// @param entries the number of entries of each queue.
+/// @return the address of the ring, -errno on failure.
+long sys_uring_setup(unsigned int entries);
+
+/// @brief Executes the requests of the submission queue of a ring.
+/// @param ring the ring, in the memory of the calling process.
+/// @return the number of requests executed, -errno on failure.
+long sys_uring_enter(uring_t *ring);
+
+#endif
@@ -0,0 +1,80 @@
+/// @file vdso.h
+/// @brief The page the kernel maps, read-only, in every process.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// The page holds code provided by the kernel, which the C library calls
+/// instead of trapping into the kernel, such as the fast system call entry,
+/// and data the kernel updates, such as the clock, which the C library reads
+/// instead of asking for it.
+
+#pragma once
+
+/// @brief The virtual address of the page, right below the stack of the
+/// process (which is 1 MB long, and ends at 0xC0000000).
+#define VDSO_ADDRESS 0xBFEFF000
+
+/// @brief The offset, inside the page, of the system call entry, which uses
+/// SYSENTER. It takes the same registers as `int $0x80`, and preserves them
+/// all but eax.
+#define VDSO_SYSCALL_OFFSET 0x0
+
+/// @brief The offset, inside the page, of the data updated by the kernel,
+/// vdso_data_t.
+#define VDSO_DATA_OFFSET 0x800
+
+/// @brief The clock, as the kernel updates it at every tick.
+/// @details The data is protected by a sequence counter: the kernel makes it
+/// odd before changing the data, and even again after, so that a reader
+/// trusts what it read only if the counter was even, and did not change
+/// meanwhile.
+typedef struct vdso_data_t {
+    /// The sequence counter, 0 until the kernel fills the data.
+    unsigned int seq;
+    /// The number of ticks since boot.
+    unsigned long ticks;
+    /// The number of ticks in a second.
+    unsigned long ticks_per_second;
+    /// The seconds since the Epoch, at boot.
+    unsigned int boot_time;
+    /// The seconds since boot, at the last update.
+    unsigned int uptime_sec;
+    /// The nanoseconds of the last second, at the last update.
+    unsigned int uptime_nsec;
+    /// The value of the TSC at the last update, 0 if the clock does not use it.
+    unsigned long long tsc;
+    /// The nanoseconds per TSC cycle, with tsc_shift fractional bits.
+    unsigned int tsc_mult;
+    /// The fractional bits of tsc_mult.
+    unsigned int tsc_shift;
+    /// The system call entry inside the page, the SYSENTER one when the CPU
+    /// supports it, one using `int $0x80` otherwise. It is found at the fixed
+    /// VDSO_SYSCALL_ENTRY_ADDRESS.
+    unsigned int syscall_entry;
+} vdso_data_t;
+
+/// @brief The address of vdso_data_t::syscall_entry, which the shared C
+/// library calls through, since its code cannot refer to __syscall_entry
+/// without being relocated.
+#define VDSO_SYSCALL_ENTRY_ADDRESS 0xBFEFF828
+
+#ifndef __KERNEL__
+
+/// @brief The function entering the kernel for the system calls, either the
+/// one of the vDSO or one using `int $0x80`.
+extern void (*__syscall_entry)(void);
+
+/// @brief Chooses how to enter the kernel, called at the start of the program.
+/// @details The vDSO entry is used only if the CPU supports SYSENTER.
+void __vdso_init(void);
+
+struct timespec;
+
+/// @brief Reads the clock of the vDSO, without entering the kernel.
+/// @param uptime where the time since boot is stored.
+/// @param boot_time where the seconds since the Epoch at boot are stored,
+/// if not NULL.
+/// @return 0 on success, -1 if the kernel does not provide the clock.
+int __vdso_uptime(struct timespec *uptime, unsigned int *boot_time);
+
+#endif
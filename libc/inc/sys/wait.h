@@ -74,3 +74,16 @@ extern pid_t wait(int *status);
 ///        > 0    meaning wait for the child whose process ID is equal to the
 ///               value of pid.
 extern pid_t waitpid(pid_t pid, int *status, int options);
+
+/// Forward declaration of the resources used by a process.
+struct rusage;
+
+/// @brief Waits like waitpid, and returns the resources used by the child.
+/// @param pid     The children to wait for, as for waitpid.
+/// @param status  Variable where the new status of the child is stored.
+/// @param options Waitpid options.
+/// @param rusage  If not NULL, where the resources used by the child, and by
+///                its waited-for children, are stored.
+/// @return On error, -1 is returned, otherwise it returns the pid of the
+///         child that has unlocked the wait.
+extern pid_t wait4(pid_t pid, int *status, int options, struct rusage *rusage);
@@ -193,7 +193,40 @@
 #define __NR_shmctl                 197 ///<  System-call number for `shmctl`
 #define __NR_shmdt                  198 ///<  System-call number for `shmdt`
 #define __NR_shmget                 199 ///<  System-call number for `shmget`
-#define SYSCALL_NUMBER              200 ///< The total number of system-calls.
+#define __NR_vfork                  200 ///<  System-call number for `vfork`
+#define __NR_posix_spawn            201 ///<  System-call number for `posix_spawn`
+#define __NR_uring_setup            202 ///<  System-call number for `uring_setup`
+#define __NR_uring_enter            203 ///<  System-call number for `uring_enter`
+#define __NR_futex                  204 ///<  System-call number for `futex`
+#define __NR_pipe2                  205 ///<  System-call number for `pipe2`
+#define __NR_splice                 206 ///<  System-call number for `splice`
+#define __NR_tee                    207 ///<  System-call number for `tee`
+#define __NR_epoll_create           208 ///<  System-call number for `epoll_create`
+#define __NR_epoll_create1          209 ///<  System-call number for `epoll_create1`
+#define __NR_epoll_ctl              210 ///<  System-call number for `epoll_ctl`
+#define __NR_epoll_wait             211 ///<  System-call number for `epoll_wait`
+#define __NR_signalfd               212 ///<  System-call number for `signalfd`
+#define __NR_timerfd_create         213 ///<  System-call number for `timerfd_create`
+#define __NR_timerfd_settime        214 ///<  System-call number for `timerfd_settime`
+#define __NR_timerfd_gettime        215 ///<  System-call number for `timerfd_gettime`
+#define __NR_statx                  216 ///<  System-call number for `statx`
+#define __NR_clock_gettime          217 ///<  System-call number for `clock_gettime`
+#define __NR_madvise                218 ///<  System-call number for `madvise`
+#define __NR_memfd_create           219 ///<  System-call number for `memfd_create`
+#define __NR_sched_yield_to         220 ///<  System-call number for `sched_yield_to`
+#define __NR_sched_setaffinity      221 ///<  System-call number for `sched_setaffinity`
+#define __NR_sched_getaffinity      222 ///<  System-call number for `sched_getaffinity`
+#define __NR_fadvise64              223 ///<  System-call number for `fadvise64`
+#define __NR_aio_submit             224 ///<  System-call number for `aio_submit`
+#define __NR_aio_suspend            225 ///<  System-call number for `aio_suspend`
+#define __NR_aio_cancel             226 ///<  System-call number for `aio_cancel`
+#define __NR_mq_open                227 ///<  System-call number for `mq_open`
+#define __NR_mq_unlink              228 ///<  System-call number for `mq_unlink`
+#define __NR_mq_send                229 ///<  System-call number for `mq_send`
+#define __NR_mq_receive             230 ///<  System-call number for `mq_receive`
+#define __NR_mq_notify              231 ///<  System-call number for `mq_notify`
+#define __NR_mq_getsetattr          232 ///<  System-call number for `mq_getsetattr`
+#define SYSCALL_NUMBER              233 ///< The total number of system-calls.
 
 /// @brief Handle the value returned from a system call.
 /// @param type Specifies the type of the returned value.
@@ -216,38 +249,57 @@
 // 2. Using "0" here specifies that the input is read from a variable which also
 //    serves as an output, the 0-th output variable in this case.
 //
+// 3. The kernel is entered through __syscall_entry (see `sys/vdso.h`), which
+//    uses SYSENTER when the CPU supports it, and `int $0x80` otherwise. It
+//    preserves every register but eax, like the interrupt. The shared C
+//    library, built position independent, calls the entry the kernel
+//    publishes inside the vDSO instead, at a fixed address, so that its code
+//    needs no relocation and is shared by every process.
 //
 
+#ifdef __PIC__
+#include "sys/vdso.h"
+/// @brief The instruction entering the kernel.
+#define __SYSCALL_ENTER "call *" __SYSCALL_STR(VDSO_SYSCALL_ENTRY_ADDRESS)
+#else
+/// @brief The instruction entering the kernel.
+#define __SYSCALL_ENTER "call *__syscall_entry"
+#endif
+/// @brief Turns the expansion of a macro into a string.
+#define __SYSCALL_STR(x) __SYSCALL_STR2(x)
+/// @brief Turns the argument into a string.
+#define __SYSCALL_STR2(x) #x
+
 /// @brief Heart of the code that calls a system call with 0 parameters.
-#define __inline_syscall0(res, name) \
-    __asm__ __volatile__("int $0x80" \
-                         : "=a"(res) \
+#define __inline_syscall0(res, name)     \
+    __asm__ __volatile__(__SYSCALL_ENTER \
+                         : "=a"(res)     \
                          : "0"(__NR_##name))
 
 /// @brief Heart of the code that calls a system call with 1 parameter.
-#define __inline_syscall1(res, name, arg1)                                 \
-    __asm__ __volatile__("push %%ebx; movl %2,%%ebx; int $0x80; pop %%ebx" \
-                         : "=a"(res)                                       \
-                         : "0"(__NR_##name), "ri"(arg1)                    \
+#define __inline_syscall1(res, name, arg1)                                           \
+    __asm__ __volatile__("push %%ebx; movl %2,%%ebx; " __SYSCALL_ENTER "; pop %%ebx" \
+                         : "=a"(res)                                                 \
+                         : "0"(__NR_##name), "ri"(arg1)                              \
                          : "memory");
 
 /// @brief Heart of the code that calls a system call with 2 parameters.
-#define __inline_syscall2(res, name, arg1, arg2)                           \
-    __asm__ __volatile__("push %%ebx; movl %2,%%ebx; int $0x80; pop %%ebx" \
-                         : "=a"(res)                                       \
-                         : "0"(__NR_##name), "ri"(arg1), "c"(arg2)         \
+#define __inline_syscall2(res, name, arg1, arg2)                                     \
+    __asm__ __volatile__("push %%ebx; movl %2,%%ebx; " __SYSCALL_ENTER "; pop %%ebx" \
+                         : "=a"(res)                                                 \
+                         : "0"(__NR_##name), "ri"(arg1), "c"(arg2)                   \
                          : "memory");
 
 /// @brief Heart of the code that calls a system call with 3 parameters.
-#define __inline_syscall3(res, name, arg1, arg2, arg3)                        \
-    __asm__ __volatile__("push %%ebx; movl %2,%%ebx; int $0x80; pop %%ebx"    \
-                         : "=a"(res)                                          \
-                         : "0"(__NR_##name), "ri"(arg1), "c"(arg2), "d"(arg3) \
+#define __inline_syscall3(res, name, arg1, arg2, arg3)                               \
+    __asm__ __volatile__("push %%ebx; movl %2,%%ebx; " __SYSCALL_ENTER "; pop %%ebx" \
+                         : "=a"(res)                                                 \
+                         : "0"(__NR_##name), "ri"(arg1), "c"(arg2), "d"(arg3)        \
                          : "memory");
 
 /// @brief Heart of the code that calls a system call with 4 parameters.
 #define __inline_syscall4(res, name, arg1, arg2, arg3, arg4)                             \
-    __asm__ __volatile__("push %%ebx; movl %2,%%ebx; int $0x80; pop %%ebx"               \
+    __asm__ __volatile__("push %%ebx; movl %2,%%ebx; " __SYSCALL_ENTER "; pop %%ebx"     \
                          : "=a"(res)                                                     \
                          : "0"(__NR_##name), "ri"(arg1), "c"(arg2), "d"(arg3), "S"(arg4) \
                          : "memory");
@@ -255,7 +307,7 @@
 /// @brief Heart of the code that calls a system call with 5 parameters.
 #define __inline_syscall5(res, name, arg1, arg2, arg3, arg4, arg5)                                  \
     __asm__ __volatile__("push %%ebx; movl %2,%%ebx; movl %1,%%eax; "                               \
-                         "int $0x80; pop %%ebx"                                                     \
+                         __SYSCALL_ENTER "; pop %%ebx"                                              \
                          : "=a"(res)                                                                \
                          : "i"(__NR_##name), "ri"(arg1), "c"(arg2), "d"(arg3), "S"(arg4), "D"(arg5) \
                          : "memory");
@@ -61,11 +61,37 @@ typedef struct timespec {
     long tv_nsec;  ///< Nanoseconds.
 } timespec;
 
+/// @brief An interval timer, with nanosecond precision.
+typedef struct itimerspec {
+    timespec it_interval; ///< The period, zero for a single expiration.
+    timespec it_value;    ///< Time until the next expiration, zero if disarmed.
+} itimerspec;
+
+/// @brief Identifies a clock.
+typedef int clockid_t;
+
+#define CLOCK_REALTIME  0 ///< The wall-clock time, which might jump.
+#define CLOCK_MONOTONIC 1 ///< The time since boot, which never jumps.
+
 /// @brief Returns the current time.
 /// @param t Where the time should be stored.
 /// @return The current time.
 time_t time(time_t *t);
 
+/// @brief Returns the current time, with a microsecond resolution.
+/// @param tv where the time is stored.
+/// @param tz the timezone, which is ignored.
+/// @return 0 on success, -1 on failure and errno is set to indicate the error.
+/// @details The time is read from the vDSO, without entering the kernel.
+int gettimeofday(timeval *tv, void *tz);
+
+/// @brief Returns the time of a clock, with a nanosecond resolution.
+/// @param clockid CLOCK_REALTIME, or CLOCK_MONOTONIC for the time since boot.
+/// @param tp where the time is stored.
+/// @return 0 on success, -1 on failure and errno is set to indicate the error.
+/// @details The time is read from the vDSO, without entering the kernel.
+int clock_gettime(clockid_t clockid, timespec *tp);
+
 /// @brief Return the difference between the two time values.
 /// @param time1 The first time value.
 /// @param time2 The second time value.
@@ -0,0 +1,102 @@
+/// @file aio.c
+/// @brief Asynchronous input and output.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include "aio.h"
+#include "sys/errno.h"
+#include "system/syscall_types.h"
+
+/// @brief Submits a request.
+/// @param aiocbp the control block.
+/// @param opcode the operation (LIO_READ or LIO_WRITE).
+/// @return 0 on success, -1 on failure and errno is set to indicate the error.
+static inline int __aio_submit(struct aiocb *aiocbp, int opcode)
+{
+    long __res;
+    aiocbp->aio_lio_opcode = opcode;
+    __inline_syscall1(__res, aio_submit, aiocbp);
+    __syscall_return(int, __res);
+}
+
+int aio_read(struct aiocb *aiocbp)
+{
+    return __aio_submit(aiocbp, LIO_READ);
+}
+
+int aio_write(struct aiocb *aiocbp)
+{
+    return __aio_submit(aiocbp, LIO_WRITE);
+}
+
+int aio_error(const struct aiocb *aiocbp)
+{
+    if (aiocbp->__error == EINPROGRESS) {
+        // Let the kernel update the control block, if the request is completed.
+        const struct aiocb *list[1] = { aiocbp };
+        struct timespec now         = { 0, 0 };
+        long __res;
+        __inline_syscall3(__res, aio_suspend, list, 1, &now);
+        (void)__res;
+    }
+    return aiocbp->__error;
+}
+
+ssize_t aio_return(struct aiocb *aiocbp)
+{
+    if (aio_error(aiocbp) == EINPROGRESS) {
+        errno = EINVAL;
+        return -1;
+    }
+    return aiocbp->__return;
+}
+
+int aio_suspend(const struct aiocb *const list[], int nent, const struct timespec *timeout)
+{
+    long __res;
+    __inline_syscall3(__res, aio_suspend, list, nent, timeout);
+    __syscall_return(int, __res);
+}
+
+int aio_cancel(int fildes, struct aiocb *aiocbp)
+{
+    long __res;
+    __inline_syscall2(__res, aio_cancel, fildes, aiocbp);
+    __syscall_return(int, __res);
+}
+
+int lio_listio(int mode, struct aiocb *const list[], int nent, void *sig)
+{
+    int failed = 0;
+    if (((mode != LIO_WAIT) && (mode != LIO_NOWAIT)) || (nent < 0) || (nent > AIO_LISTIO_MAX) || sig) {
+        errno = EINVAL;
+        return -1;
+    }
+    for (int i = 0; i < nent; ++i) {
+        if ((list[i] == NULL) || (list[i]->aio_lio_opcode == LIO_NOP)) {
+            continue;
+        }
+        if (__aio_submit(list[i], list[i]->aio_lio_opcode) < 0) {
+            list[i]->__error  = errno;
+            list[i]->__return = -1;
+            failed            = 1;
+        }
+    }
+    if (mode == LIO_WAIT) {
+        for (int i = 0; i < nent; ++i) {
+            if ((list[i] == NULL) || (list[i]->aio_lio_opcode == LIO_NOP)) {
+                continue;
+            }
+            while (aio_error(list[i]) == EINPROGRESS) {
+                const struct aiocb *entry[1] = { list[i] };
+                aio_suspend(entry, 1, NULL);
+            }
+            failed |= (list[i]->__error != 0);
+        }
+    }
+    if (failed) {
+        errno = EIO;
+        return -1;
+    }
+    return 0;
+}
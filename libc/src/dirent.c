@@ -0,0 +1,68 @@
+/// @file dirent.c
+/// @brief Directory streams.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include "dirent.h"
+#include "fcntl.h"
+#include "stdio.h"
+#include "stdlib.h"
+#include "sys/errno.h"
+#include "sys/unistd.h"
+
+DIR *opendir(const char *path)
+{
+    int fd = open(path, O_RDONLY | O_DIRECTORY, 0);
+    if (fd < 0) {
+        return NULL;
+    }
+    DIR *dir = fdopendir(fd);
+    if (dir == NULL) {
+        close(fd);
+    }
+    return dir;
+}
+
+DIR *fdopendir(int fd)
+{
+    DIR *dir = (DIR *)malloc(sizeof(DIR));
+    if (dir == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    dir->fd    = fd;
+    dir->next  = 0;
+    dir->count = 0;
+    return dir;
+}
+
+dirent_t *readdir(DIR *dir)
+{
+    while (dir->next == dir->count) {
+        ssize_t ret = getdents(dir->fd, dir->entries, sizeof(dir->entries));
+        if (ret <= 0) {
+            return NULL;
+        }
+        dir->next  = 0;
+        dir->count = ret / sizeof(dirent_t);
+    }
+    return &dir->entries[dir->next++];
+}
+
+void rewinddir(DIR *dir)
+{
+    lseek(dir->fd, 0, SEEK_SET);
+    dir->next = dir->count = 0;
+}
+
+int dirfd(DIR *dir)
+{
+    return dir->fd;
+}
+
+int closedir(DIR *dir)
+{
+    int ret = close(dir->fd);
+    free(dir);
+    return ret;
+}
@@ -11,8 +11,8 @@
 void verr(int status, const char *fmt, va_list ap)
 {
 	if (fmt) {
-		vfprintf(STDERR_FILENO, fmt, ap);
-		fprintf(STDERR_FILENO, ": ");
+		vfprintf(stderr, fmt, ap);
+		fprintf(stderr, ": ");
 	}
 	perror(0);
 	exit(status);
@@ -20,8 +20,8 @@ void verr(int status, const char *fmt, va_list ap)
 
 void verrx(int status, const char *fmt, va_list ap)
 {
-	if (fmt) vfprintf(STDERR_FILENO, fmt, ap);
-	fprintf(STDERR_FILENO, "\n");
+	if (fmt) vfprintf(stderr, fmt, ap);
+	fprintf(stderr, "\n");
 	exit(status);
 }
 
@@ -5,15 +5,22 @@
 
 #include "grp.h"
 #include "assert.h"
-#include "fcntl.h"
 #include "io/debug.h"
+#include "math.h"
+#include "readline.h"
 #include "stdio.h"
+#include "stdlib.h"
 #include "string.h"
 #include "sys/errno.h"
-#include "sys/unistd.h"
 
-/// Holds the file descriptor while we are working with `/etc/group`.
-static int __fd = -1;
+/// The lines of `/etc/group`, read again only when the file changes.
+static file_lines_t __group_lines;
+/// The entries parsed from the lines, their strings point inside the lines.
+static group_t *__group_entries;
+/// The number of entries.
+static size_t __group_count;
+/// The next entry returned by getgrent.
+static size_t __group_next;
 
 /// @brief It parses the line (as string) and saves its content inside the
 /// group_t structure.
@@ -39,75 +46,111 @@ static inline void __parse_line(group_t *grp, char *buf)
         grp->gr_gid = atoi(token);
     }
     size_t found_users = 0;
-    while ((token = strtok(NULL, ",\n\0")) != NULL && found_users < MAX_MEMBERS_PER_GROUP) {
+    while ((found_users < MAX_MEMBERS_PER_GROUP) && (token = strtok(NULL, ",")) != NULL) {
         grp->gr_mem[found_users] = token;
         found_users += 1;
     }
     // Null terminate array
-    grp->gr_mem[found_users] = "\0";
+    grp->gr_mem[found_users] = NULL;
 }
 
-/// @brief Searches an entry in `/etc/group`.
-/// @param fd the file descriptor pointing to `/etc/group`.
-/// @param buf the buffer we are going to use to search the entry.
-/// @param buflen the length of the buffer.
-/// @param name the name we are looking for.
-/// @param gid the group id we must match.
-/// @return 1 on success, 0 on failure.
-static inline int __search_entry(int fd, char *buf, size_t buflen, const char *name, gid_t gid)
+/// @brief Brings the entries up to date with `/etc/group`.
+/// @return 0 on success, -1 on failure.
+static inline int __load_entries(void)
 {
-    int ret;
-    char c;
-    int pos = 0;
-    while ((ret = read(fd, &c, 1U))) {
-        // Skip carriage return.
-        if (c == '\r') {
+    int ret = readlines_cached("/etc/group", &__group_lines);
+    if (ret == 0) {
+        return 0;
+    }
+    free(__group_entries);
+    __group_entries = NULL;
+    __group_count   = 0;
+    __group_next    = 0;
+    if (ret < 0) {
+        errno = ENOENT;
+        return -1;
+    }
+    __group_entries = malloc(max(__group_lines.count, 1U) * sizeof(group_t));
+    if (__group_entries == NULL) {
+        readlines_free(&__group_lines);
+        errno = ENOMEM;
+        return -1;
+    }
+    for (size_t i = 0; i < __group_lines.count; ++i) {
+        // Skip the lines which are not entries.
+        if (strchr(__group_lines.lines[i], ':') == NULL) {
             continue;
         }
-        if (pos >= buflen) {
-            errno = ERANGE;
+        memset(&__group_entries[__group_count], 0, sizeof(group_t));
+        __parse_line(&__group_entries[__group_count++], __group_lines.lines[i]);
+    }
+    return 0;
+}
+
+/// @brief Searches an entry of `/etc/group`.
+/// @param name the name we are looking for, NULL to search by gid.
+/// @param gid the group id we must match.
+/// @return the entry if we have found it, NULL otherwise.
+static inline group_t *__search_entry(const char *name, gid_t gid)
+{
+    if (__load_entries() < 0) {
+        return NULL;
+    }
+    for (size_t i = 0; i < __group_count; ++i) {
+        group_t *entry = &__group_entries[i];
+        if (name ? (entry->gr_name && !strcmp(entry->gr_name, name)) : (entry->gr_gid == gid)) {
+            return entry;
+        }
+    }
+    errno = ENOENT;
+    return NULL;
+}
+
+/// @brief Copies a string inside the buffer.
+/// @param string the string, can be NULL.
+/// @param buf the buffer, moved past the copy.
+/// @param buflen the space left inside the buffer, updated.
+/// @param copy where the copy is stored.
+/// @return 1 on success, 0 if the buffer is too small.
+static inline int __copy_string(const char *string, char **buf, size_t *buflen, char **copy)
+{
+    *copy = NULL;
+    if (string == NULL) {
+        return 1;
+    }
+    size_t length = strlen(string) + 1;
+    if (length > *buflen) {
+        errno = ERANGE;
+        return 0;
+    }
+    *copy = strcpy(*buf, string);
+    *buf += length;
+    *buflen -= length;
+    return 1;
+}
+
+/// @brief Copies an entry, placing its strings inside the given buffer.
+/// @param group the structure we need to fill.
+/// @param entry the entry.
+/// @param buf the buffer where the strings are stored.
+/// @param buflen the length of the buffer.
+/// @return 1 on success, 0 if the buffer is too small.
+static inline int __copy_entry(group_t *group, const group_t *entry, char *buf, size_t buflen)
+{
+    if (!__copy_string(entry->gr_name, &buf, &buflen, &group->gr_name) ||
+        !__copy_string(entry->gr_passwd, &buf, &buflen, &group->gr_passwd)) {
+        return 0;
+    }
+    group->gr_gid = entry->gr_gid;
+    for (size_t i = 0; i <= MAX_MEMBERS_PER_GROUP; ++i) {
+        if (!__copy_string(entry->gr_mem[i], &buf, &buflen, &group->gr_mem[i])) {
             return 0;
         }
-        // If we have found a newline or the EOF, parse the entry.
-        if ((c == '\n') || (ret == EOF)) {
-            // Close the buffer.
-            buf[pos] = 0;
-            // Check the entry.
-            if (name) {
-                if (strncmp(buf, name, strlen(name)) == 0) {
-                    return 1;
-                }
-            } else {
-                int gid_start = -1, col_count = 0;
-                for (int i = 0; i < pos; ++i) {
-                    if (buf[i] == ':') {
-                        if (++col_count == 2) {
-                            gid_start = i + 1;
-                            break;
-                        }
-                    }
-                }
-                if ((gid_start != -1) && (gid_start < pos)) {
-                    // Parse the gid.
-                    int found_gid = atoi(&buf[gid_start]);
-                    // Check the gid.
-                    if (found_gid == gid) {
-                        return 1;
-                    }
-                }
-            }
-            // Reset the index.
-            pos = 0;
-            // If we have reached the EOF stop.
-            if (ret == EOF) {
-                break;
-            }
-        } else {
-            buf[pos++] = c;
+        if (entry->gr_mem[i] == NULL) {
+            break;
         }
     }
-    errno = ENOENT;
-    return 0;
+    return 1;
 }
 
 group_t *getgrgid(gid_t gid)
@@ -142,116 +185,51 @@ group_t *getgrnam(const char *name)
 
 int getgrgid_r(gid_t gid, group_t *group, char *buf, size_t buflen, group_t **result)
 {
-    int fd = open("/etc/group", O_RDONLY, 0);
-    if (fd == -1) {
-        errno   = ENOENT;
-        *result = NULL;
+    *result        = NULL;
+    group_t *entry = __search_entry(NULL, gid);
+    if ((entry == NULL) || !__copy_entry(group, entry, buf, buflen)) {
         return 0;
     }
-
-    if (__search_entry(fd, buf, buflen, NULL, gid)) {
-        // Close the file.
-        close(fd);
-        // Parse the line.
-        __parse_line(group, buf);
-        // Return success.
-        return 1;
-    }
-
-    // Close the file.
-    close(fd);
-    // Return fail.
-    return 0;
+    *result = group;
+    return 1;
 }
 
 int getgrnam_r(const char *name, group_t *group, char *buf, size_t buflen, group_t **result)
 {
-    int fd = open("/etc/group", O_RDONLY, 0);
-    if (fd == -1) {
-        errno   = ENOENT;
-        *result = NULL;
+    *result = NULL;
+    if (name == NULL) {
         return 0;
     }
-
-    if (__search_entry(fd, buf, buflen, name, 0)) {
-        // Close the file.
-        close(fd);
-        // Parse the line.
-        __parse_line(group, buf);
-        // Return success.
-        return 1;
+    group_t *entry = __search_entry(name, 0);
+    if ((entry == NULL) || !__copy_entry(group, entry, buf, buflen)) {
+        return 0;
     }
-
-    // Close the file.
-    close(fd);
-    // Return fail.
-    return 0;
+    *result = group;
+    return 1;
 }
 
 group_t *getgrent(void)
 {
     static group_t result;
 
-    if (__fd == -1) {
-        //pr_debug("Opening group file\n");
-        __fd = open("/etc/group", O_RDONLY, 0);
-        if (__fd == -1) {
-            errno = ENOENT;
-            return 0;
-        }
+    // The first call, or a changed file, starts again from the first entry.
+    if (__load_entries() < 0) {
+        return NULL;
     }
-
-    int ret;
-    char c;
-    int pos = 0;
-
-    static char buffer[BUFSIZ];
-    while ((ret = read(__fd, &c, 1U))) {
-        // Skip carriage return.
-        if (c == '\r') {
-            continue;
-        }
-
-        if (pos >= BUFSIZ) {
-            errno = ERANGE;
-            return NULL;
-        }
-
-        // If we have found a newline or the EOF, parse the entry.
-        if ((c == '\n') || (ret == EOF)) {
-            // Close the buffer.
-            buffer[pos] = 0;
-
-            // Check the entry.
-            if (strlen(buffer) != 0) {
-                //pr_debug("Found entry in group file: %s\n", buffer);
-                __parse_line(&result, buffer);
-                return &result;
-            }
-
-            // If we have reached the EOF stop.
-            if (ret == EOF) {
-                break;
-            }
-
-        } else {
-            buffer[pos++] = c;
-        }
+    if (__group_next >= __group_count) {
+        errno = ENOENT;
+        return NULL;
     }
-
-    errno = ENOENT;
-    return NULL;
+    result = __group_entries[__group_next++];
+    return &result;
 }
 
 void endgrent(void)
 {
-    //pr_debug("Closing group file\n");
-    close(__fd);
-    __fd = -1;
+    __group_next = 0;
 }
 
 void setgrent(void)
 {
-    //pr_debug("Resetting pointer to beginning of group file\n");
-    lseek(__fd, 0, SEEK_SET);
+    __group_next = 0;
 }
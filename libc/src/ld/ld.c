@@ -0,0 +1,528 @@
+/// @file ld.c
+/// @brief The dynamic loader, which links the executables with the shared
+/// libraries they need before they start.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// The kernel loads the executable and the loader (the interpreter named by
+/// PT_INTERP), and starts the loader with the executable's stack. The loader
+/// relocates itself, maps the libraries named by DT_NEEDED from LD_LIBRARY_DIR
+/// through the page cache, so that their code is shared by every process, and
+/// resolves all the relocations before jumping to the executable: there is no
+/// lazy binding.
+///
+/// The loader is built position independent, with hidden symbols, and uses
+/// neither the C library nor any global data before relocating itself.
+
+#include "fcntl.h"
+#include "stddef.h"
+#include "stdint.h"
+#include "sys/mman.h"
+#include "system/syscall_types.h"
+
+/// The directory holding the shared libraries.
+#define LD_LIBRARY_DIR "/lib/"
+/// The number of shared objects, the executable included, the loader handles.
+#define LD_MAX_OBJECTS 16
+/// The size of a page.
+#define LD_PAGE_SIZE 4096U
+
+#define PT_LOAD    1 ///< A loadable segment.
+#define PT_DYNAMIC 2 ///< The dynamic section.
+#define PT_PHDR    6 ///< The program headers themselves.
+
+#define AT_NULL  0 ///< End of the auxiliary vector.
+#define AT_PHDR  3 ///< The program headers of the executable.
+#define AT_PHNUM 5 ///< The number of program headers of the executable.
+#define AT_BASE  7 ///< Where the loader has been loaded.
+#define AT_ENTRY 9 ///< The entry of the executable.
+
+#define DT_NULL     0  ///< End of the dynamic section.
+#define DT_NEEDED   1  ///< The name of a needed library.
+#define DT_PLTRELSZ 2  ///< The size of the PLT relocations.
+#define DT_HASH     4  ///< The symbol hash table.
+#define DT_STRTAB   5  ///< The string table.
+#define DT_SYMTAB   6  ///< The symbol table.
+#define DT_REL      17 ///< The relocations.
+#define DT_RELSZ    18 ///< The size of the relocations.
+#define DT_JMPREL   23 ///< The PLT relocations.
+
+#define R_386_NONE     0 ///< Nothing to do.
+#define R_386_32       1 ///< Symbol plus addend.
+#define R_386_PC32     2 ///< Symbol plus addend, minus the place.
+#define R_386_COPY     5 ///< Copy the symbol into the executable.
+#define R_386_GLOB_DAT 6 ///< Symbol, inside the GOT.
+#define R_386_JMP_SLOT 7 ///< Symbol, inside the PLT GOT.
+#define R_386_RELATIVE 8 ///< Base plus addend.
+
+#define SHN_UNDEF 0 ///< The symbol is not defined by the object.
+#define STB_WEAK  2 ///< The symbol is weak.
+
+/// @brief The ELF header.
+typedef struct elf_header_t {
+    uint8_t ident[16];  ///< The identification bytes.
+    uint16_t type;      ///< The type of the file.
+    uint16_t machine;   ///< The architecture.
+    uint32_t version;   ///< The version.
+    uint32_t entry;     ///< The entry point.
+    uint32_t phoff;     ///< The offset of the program headers.
+    uint32_t shoff;     ///< The offset of the section headers.
+    uint32_t flags;     ///< Architecture flags.
+    uint16_t ehsize;    ///< The size of this header.
+    uint16_t phentsize; ///< The size of a program header.
+    uint16_t phnum;     ///< The number of program headers.
+    uint16_t shentsize; ///< The size of a section header.
+    uint16_t shnum;     ///< The number of section headers.
+    uint16_t shstrndx;  ///< The section holding the section names.
+} elf_header_t;
+
+/// @brief A program header.
+typedef struct elf_program_header_t {
+    uint32_t type;   ///< The type of the segment.
+    uint32_t offset; ///< The offset of the segment in the file.
+    uint32_t vaddr;  ///< The address of the segment.
+    uint32_t paddr;  ///< Unused.
+    uint32_t filesz; ///< The size of the segment in the file.
+    uint32_t memsz;  ///< The size of the segment in memory.
+    uint32_t flags;  ///< The permissions of the segment.
+    uint32_t align;  ///< The alignment of the segment.
+} elf_program_header_t;
+
+/// @brief An entry of the dynamic section.
+typedef struct elf_dyn_t {
+    int32_t tag;  ///< The type of the entry.
+    uint32_t val; ///< The value, or the address, of the entry.
+} elf_dyn_t;
+
+/// @brief A symbol.
+typedef struct elf_symbol_t {
+    uint32_t name;  ///< The offset of the name inside the string table.
+    uint32_t value; ///< The value of the symbol.
+    uint32_t size;  ///< The size of the symbol.
+    uint8_t info;   ///< The type and the binding.
+    uint8_t other;  ///< The visibility.
+    uint16_t ndx;   ///< The section of the symbol.
+} elf_symbol_t;
+
+/// @brief A relocation without addend.
+typedef struct elf_rel_t {
+    uint32_t offset; ///< Where the relocation applies.
+    uint32_t info;   ///< The type and the symbol.
+} elf_rel_t;
+
+/// @brief An object linked by the loader.
+typedef struct ld_object_t {
+    /// The name of the object, as DT_NEEDED names it.
+    const char *name;
+    /// The offset added to the addresses of the object.
+    uint32_t base;
+    /// The dynamic section.
+    const elf_dyn_t *dynamic;
+    /// The symbol table.
+    const elf_symbol_t *symtab;
+    /// The string table.
+    const char *strtab;
+    /// The symbol hash table.
+    const uint32_t *hash;
+} ld_object_t;
+
+/// The dynamic section of the loader, defined by the linker, hidden so that
+/// it is reached relative to the code before any relocation.
+extern const elf_dyn_t _DYNAMIC[] __attribute__((visibility("hidden")));
+
+/// The objects, the executable first, in the order symbols are looked up.
+static ld_object_t objects[LD_MAX_OBJECTS];
+/// The number of objects.
+static unsigned objects_count;
+
+/// @brief Writes a message on the standard error.
+/// @param str the message.
+static void __ld_print(const char *str)
+{
+    long __res;
+    size_t length = 0;
+    while (str[length]) {
+        ++length;
+    }
+    __inline_syscall3(__res, write, 2, str, length);
+    (void)__res;
+}
+
+/// @brief Tells what went wrong, and terminates the process.
+/// @param what the message.
+/// @param name the object or the symbol involved.
+static void __ld_fail(const char *what, const char *name)
+{
+    long __res;
+    __ld_print("ld.so: ");
+    __ld_print(what);
+    __ld_print(name);
+    __ld_print("\n");
+    __inline_syscall1(__res, exit, 127);
+    (void)__res;
+    while (1) {}
+}
+
+/// @brief Copies memory, the compiler might emit calls to it.
+/// @param dst the destination.
+/// @param src the source.
+/// @param n the number of bytes.
+/// @return the destination.
+void *memcpy(void *dst, const void *src, size_t n)
+{
+    char *d = dst;
+    const char *s = src;
+    while (n--) {
+        *d++ = *s++;
+    }
+    return dst;
+}
+
+/// @brief Fills memory, the compiler might emit calls to it.
+/// @param ptr the memory.
+/// @param value the byte.
+/// @param n the number of bytes.
+/// @return the memory.
+void *memset(void *ptr, int value, size_t n)
+{
+    char *p = ptr;
+    while (n--) {
+        *p++ = (char)value;
+    }
+    return ptr;
+}
+
+/// @brief Compares two strings.
+/// @param a the first string.
+/// @param b the second string.
+/// @return 1 if they are equal, 0 otherwise.
+static int __ld_streq(const char *a, const char *b)
+{
+    while (*a && (*a == *b)) {
+        ++a, ++b;
+    }
+    return *a == *b;
+}
+
+/// @brief Applies the relative relocations of the loader itself.
+/// @param base where the loader has been loaded.
+/// @details Runs before anything else, it must not use global data.
+static void __ld_relocate_self(uint32_t base)
+{
+    const elf_rel_t *rel = NULL;
+    uint32_t relsz       = 0;
+    for (const elf_dyn_t *dyn = _DYNAMIC; dyn->tag != DT_NULL; ++dyn) {
+        if (dyn->tag == DT_REL) {
+            rel = (const elf_rel_t *)(base + dyn->val);
+        } else if (dyn->tag == DT_RELSZ) {
+            relsz = dyn->val;
+        }
+    }
+    for (uint32_t i = 0; rel && (i < relsz / sizeof(elf_rel_t)); ++i) {
+        if ((rel[i].info & 0xFFU) == R_386_RELATIVE) {
+            *(uint32_t *)(base + rel[i].offset) += base;
+        }
+    }
+}
+
+/// @brief Adds an object, and finds its tables.
+/// @param base the offset added to the addresses of the object.
+/// @param dynamic the dynamic section of the object.
+/// @param name the name of the object, which must stay valid.
+/// @return the object.
+static ld_object_t *__ld_add_object(uint32_t base, const elf_dyn_t *dynamic, const char *name)
+{
+    if (objects_count == LD_MAX_OBJECTS) {
+        __ld_fail("too many shared objects, loading ", name);
+    }
+    ld_object_t *object = &objects[objects_count++];
+    object->name        = name;
+    object->base        = base;
+    object->dynamic     = dynamic;
+    for (const elf_dyn_t *dyn = dynamic; dyn && (dyn->tag != DT_NULL); ++dyn) {
+        if (dyn->tag == DT_SYMTAB) {
+            object->symtab = (const elf_symbol_t *)(base + dyn->val);
+        } else if (dyn->tag == DT_STRTAB) {
+            object->strtab = (const char *)(base + dyn->val);
+        } else if (dyn->tag == DT_HASH) {
+            object->hash = (const uint32_t *)(base + dyn->val);
+        }
+    }
+    return object;
+}
+
+/// @brief Maps a shared library from LD_LIBRARY_DIR.
+/// @param name the name of the library.
+/// @return the object of the library.
+static ld_object_t *__ld_load_library(const char *name)
+{
+    char path[256] = LD_LIBRARY_DIR;
+    size_t length  = sizeof(LD_LIBRARY_DIR) - 1;
+    for (const char *it = name; *it; ++it) {
+        if (length == sizeof(path) - 1) {
+            __ld_fail("name too long: ", name);
+        }
+        path[length++] = *it;
+    }
+    path[length] = 0;
+    long fd, ret;
+    __inline_syscall3(fd, open, path, O_RDONLY, 0);
+    if (fd < 0) {
+        __ld_fail("cannot open ", path);
+    }
+    // The headers are at the start of the file, read them together.
+    char buffer[1024];
+    __inline_syscall3(ret, read, fd, buffer, sizeof(buffer));
+    const elf_header_t *header = (const elf_header_t *)buffer;
+    if ((ret < (long)sizeof(elf_header_t)) || (header->ident[0] != 0x7F) || (header->ident[1] != 'E') ||
+        (header->ident[2] != 'L') || (header->ident[3] != 'F') || (header->type != 3 /* ET_DYN */) ||
+        (header->phentsize != sizeof(elf_program_header_t)) ||
+        (header->phoff + header->phnum * sizeof(elf_program_header_t) > (unsigned long)ret)) {
+        __ld_fail("not a shared library: ", path);
+    }
+    const elf_program_header_t *phdrs = (const elf_program_header_t *)(buffer + header->phoff);
+    // Reserve the whole span, the segments keep their distance.
+    uint32_t start = ~0U, end = 0, dynamic = 0;
+    for (unsigned i = 0; i < header->phnum; ++i) {
+        if (phdrs[i].type == PT_LOAD) {
+            uint32_t seg_start = phdrs[i].vaddr & ~(LD_PAGE_SIZE - 1);
+            uint32_t seg_end   = (phdrs[i].vaddr + phdrs[i].memsz + LD_PAGE_SIZE - 1) & ~(LD_PAGE_SIZE - 1);
+            start              = (seg_start < start) ? seg_start : start;
+            end                = (seg_end > end) ? seg_end : end;
+        } else if (phdrs[i].type == PT_DYNAMIC) {
+            dynamic = phdrs[i].vaddr;
+        }
+    }
+    if ((start >= end) || !dynamic) {
+        __ld_fail("no loadable segments in ", path);
+    }
+    unsigned args[6] = { 0, end - start, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, (unsigned)-1, 0 };
+    long area;
+    __inline_syscall1(area, mmap, args);
+    if (area == 0) {
+        __ld_fail("out of memory, loading ", path);
+    }
+    __inline_syscall2(ret, munmap, area, end - start);
+    uint32_t base = (uint32_t)area - start;
+    // Map the segments from the file, the code is shared through the page
+    // cache, the data is copied on write.
+    for (unsigned i = 0; i < header->phnum; ++i) {
+        if (phdrs[i].type != PT_LOAD) {
+            continue;
+        }
+        uint32_t vaddr     = base + phdrs[i].vaddr;
+        uint32_t seg_start = vaddr & ~(LD_PAGE_SIZE - 1);
+        uint32_t file_end  = (vaddr + phdrs[i].filesz + LD_PAGE_SIZE - 1) & ~(LD_PAGE_SIZE - 1);
+        uint32_t mem_end   = (vaddr + phdrs[i].memsz + LD_PAGE_SIZE - 1) & ~(LD_PAGE_SIZE - 1);
+        int prot           = PROT_READ | ((phdrs[i].flags & 0x2U) ? PROT_WRITE : 0) | ((phdrs[i].flags & 0x1U) ? PROT_EXEC : 0);
+        if (file_end > seg_start) {
+            args[0] = seg_start;
+            args[1] = file_end - seg_start;
+            args[2] = prot;
+            args[3] = MAP_PRIVATE;
+            args[4] = fd;
+            args[5] = phdrs[i].offset - (vaddr - seg_start);
+            __inline_syscall1(area, mmap, args);
+            if ((uint32_t)area != seg_start) {
+                __ld_fail("cannot map ", path);
+            }
+        }
+        if (phdrs[i].memsz > phdrs[i].filesz) {
+            // The bss starts inside the last page of the file, and continues
+            // with anonymous pages.
+            memset((void *)(vaddr + phdrs[i].filesz), 0, file_end - (vaddr + phdrs[i].filesz));
+            if (mem_end > file_end) {
+                args[0] = file_end;
+                args[1] = mem_end - file_end;
+                args[2] = prot;
+                args[3] = MAP_PRIVATE | MAP_ANONYMOUS;
+                args[4] = (unsigned)-1;
+                args[5] = 0;
+                __inline_syscall1(area, mmap, args);
+                if ((uint32_t)area != file_end) {
+                    __ld_fail("cannot map the bss of ", path);
+                }
+            }
+        }
+    }
+    // The mappings keep the file open.
+    __inline_syscall1(ret, close, fd);
+    return __ld_add_object(base, (const elf_dyn_t *)(base + dynamic), name);
+}
+
+/// @brief Computes the hash of a symbol name, as in DT_HASH.
+/// @param name the name.
+/// @return the hash.
+static uint32_t __ld_elf_hash(const char *name)
+{
+    uint32_t h = 0, g;
+    while (*name) {
+        h = (h << 4) + (uint8_t)*name++;
+        if ((g = h & 0xF0000000U)) {
+            h ^= g >> 24;
+        }
+        h &= ~g;
+    }
+    return h;
+}
+
+/// @brief Looks up a symbol defined by the objects.
+/// @param name the name of the symbol.
+/// @param first the first object searched, 1 to skip the executable.
+/// @param size where the size of the symbol is stored, if not NULL.
+/// @return the address of the symbol, 0 if it is not defined.
+static uint32_t __ld_lookup(const char *name, unsigned first, uint32_t *size)
+{
+    uint32_t hash = __ld_elf_hash(name);
+    for (unsigned i = first; i < objects_count; ++i) {
+        const ld_object_t *object = &objects[i];
+        if (!object->hash || !object->symtab || !object->strtab) {
+            continue;
+        }
+        uint32_t nbucket      = object->hash[0];
+        const uint32_t *chain = object->hash + 2 + nbucket;
+        for (uint32_t index = object->hash[2 + (hash % nbucket)]; index; index = chain[index]) {
+            const elf_symbol_t *symbol = &object->symtab[index];
+            if ((symbol->ndx != SHN_UNDEF) && __ld_streq(object->strtab + symbol->name, name)) {
+                if (size) {
+                    *size = symbol->size;
+                }
+                return object->base + symbol->value;
+            }
+        }
+    }
+    return 0;
+}
+
+/// @brief Applies a table of relocations of an object.
+/// @param object the object.
+/// @param rel the relocations.
+/// @param relsz the size of the table.
+static void __ld_relocate_table(const ld_object_t *object, const elf_rel_t *rel, uint32_t relsz)
+{
+    for (uint32_t i = 0; i < relsz / sizeof(elf_rel_t); ++i) {
+        uint32_t type = rel[i].info & 0xFFU, index = rel[i].info >> 8U, value = 0, size = 0;
+        uint32_t *where = (uint32_t *)(object->base + rel[i].offset);
+        if (type == R_386_RELATIVE) {
+            *where += object->base;
+            continue;
+        }
+        if ((type == R_386_NONE) || (index == 0)) {
+            continue;
+        }
+        const elf_symbol_t *symbol = &object->symtab[index];
+        const char *name           = object->strtab + symbol->name;
+        // The executable has the copies of the data of the libraries, which
+        // the libraries use too, the copy itself comes from the libraries.
+        value = __ld_lookup(name, (type == R_386_COPY) ? 1 : 0, &size);
+        if (!value && ((symbol->info >> 4U) != STB_WEAK)) {
+            __ld_fail("undefined symbol: ", name);
+        }
+        switch (type) {
+        case R_386_32:
+            *where += value;
+            break;
+        case R_386_PC32:
+            *where += value - (uint32_t)where;
+            break;
+        case R_386_GLOB_DAT:
+        case R_386_JMP_SLOT:
+            *where = value;
+            break;
+        case R_386_COPY:
+            memcpy(where, (const void *)value, (size < symbol->size) ? size : symbol->size);
+            break;
+        default:
+            __ld_fail("unsupported relocation for ", name);
+        }
+    }
+}
+
+/// @brief Applies the relocations of an object.
+/// @param object the object.
+static void __ld_relocate(const ld_object_t *object)
+{
+    const elf_rel_t *rel = NULL, *jmprel = NULL;
+    uint32_t relsz = 0, pltrelsz = 0;
+    for (const elf_dyn_t *dyn = object->dynamic; dyn && (dyn->tag != DT_NULL); ++dyn) {
+        if (dyn->tag == DT_REL) {
+            rel = (const elf_rel_t *)(object->base + dyn->val);
+        } else if (dyn->tag == DT_RELSZ) {
+            relsz = dyn->val;
+        } else if (dyn->tag == DT_JMPREL) {
+            jmprel = (const elf_rel_t *)(object->base + dyn->val);
+        } else if (dyn->tag == DT_PLTRELSZ) {
+            pltrelsz = dyn->val;
+        }
+    }
+    if (rel) {
+        __ld_relocate_table(object, rel, relsz);
+    }
+    if (jmprel) {
+        __ld_relocate_table(object, jmprel, pltrelsz);
+    }
+}
+
+/// @brief Links the executable, called by _start.
+/// @param frame the stack built by the kernel: argc, argv, envp, auxv.
+/// @return the entry of the executable.
+uint32_t __ld_main(uint32_t *frame)
+{
+    const uint32_t *auxv = (const uint32_t *)frame[3];
+    uint32_t phdr = 0, phnum = 0, base = 0, entry = 0;
+    for (; auxv[0] != AT_NULL; auxv += 2) {
+        if (auxv[0] == AT_PHDR) {
+            phdr = auxv[1];
+        } else if (auxv[0] == AT_PHNUM) {
+            phnum = auxv[1];
+        } else if (auxv[0] == AT_BASE) {
+            base = auxv[1];
+        } else if (auxv[0] == AT_ENTRY) {
+            entry = auxv[1];
+        }
+    }
+    __ld_relocate_self(base);
+    if (!phdr || !entry) {
+        __ld_fail("the kernel did not describe the executable", "");
+    }
+    // The executable is position independent if it was moved from where
+    // its program headers say they are.
+    const elf_program_header_t *phdrs = (const elf_program_header_t *)phdr;
+    uint32_t exec_base = 0, dynamic = 0;
+    for (uint32_t i = 0; i < phnum; ++i) {
+        if (phdrs[i].type == PT_PHDR) {
+            exec_base = phdr - phdrs[i].vaddr;
+        }
+    }
+    for (uint32_t i = 0; i < phnum; ++i) {
+        if (phdrs[i].type == PT_DYNAMIC) {
+            dynamic = exec_base + phdrs[i].vaddr;
+        }
+    }
+    if (!dynamic) {
+        return entry;
+    }
+    __ld_add_object(exec_base, (const elf_dyn_t *)dynamic, "the executable");
+    // Load the needed libraries, and the ones they need, breadth first.
+    for (unsigned i = 0; i < objects_count; ++i) {
+        for (const elf_dyn_t *dyn = objects[i].dynamic; dyn->tag != DT_NULL; ++dyn) {
+            if (dyn->tag != DT_NEEDED) {
+                continue;
+            }
+            const char *name = objects[i].strtab + dyn->val;
+            int loaded       = 0;
+            for (unsigned j = 1; (j < objects_count) && !loaded; ++j) {
+                loaded = __ld_streq(objects[j].name, name);
+            }
+            if (!loaded) {
+                __ld_load_library(name);
+            }
+        }
+    }
+    // The libraries first, the copies inside the executable take the values
+    // the libraries have once relocated.
+    for (unsigned i = objects_count; i > 0; --i) {
+        __ld_relocate(&objects[i - 1]);
+    }
+    return entry;
+}
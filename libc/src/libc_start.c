@@ -5,9 +5,11 @@
 
 #include "sys/unistd.h"
 #include "assert.h"
+#include "stdio.h"
 #include "stdlib.h"
 #include "string.h"
 #include "sys/errno.h"
+#include "sys/vdso.h"
 #include "system/syscall_types.h"
 
 /// @brief Reference to the `environ` variable in `setenv.c`.
@@ -23,6 +25,8 @@ int __libc_start_main(int (*main)(int, char **, char **), int argc, char *argv[]
 {
     //dbg_print("== START %-30s =======================================\n", argv[0]);
     //dbg_print("__libc_start_main(%p, %d, %p, %p)\n", main, argc, argv, envp);
+    // Use the fastest way to enter the kernel.
+    __vdso_init();
     assert(main && "There is no `main` function.");
     assert(argv && "There is no `argv` array.");
     assert(envp && "There is no `envp` array.");
@@ -31,6 +35,8 @@ int __libc_start_main(int (*main)(int, char **, char **), int argc, char *argv[]
     environ = envp;
     // Call the main function.
     int result = main(argc, argv, envp);
+    // Write the output still buffered by the streams.
+    fflush(NULL);
     // Free the environ.
     //dbg_print("== END   %-30s =======================================\n", argv[0]);
     return result;
@@ -0,0 +1,54 @@
+/// @file mqueue.c
+/// @brief POSIX message queues.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include "mqueue.h"
+#include "stdarg.h"
+#include "sys/errno.h"
+#include "sys/unistd.h"
+#include "system/syscall_types.h"
+
+mqd_t mq_open(const char *name, int oflag, ...)
+{
+    mode_t mode          = 0;
+    struct mq_attr *attr = NULL;
+    long __res;
+    // The mode and the attributes are only passed when creating the queue.
+    if (oflag & O_CREAT) {
+        va_list ap;
+        va_start(ap, oflag);
+        mode = va_arg(ap, mode_t);
+        attr = va_arg(ap, struct mq_attr *);
+        va_end(ap);
+    }
+    __inline_syscall4(__res, mq_open, name, oflag, mode, attr);
+    __syscall_return(mqd_t, __res);
+}
+
+int mq_close(mqd_t mqdes)
+{
+    return close(mqdes);
+}
+
+_syscall1(int, mq_unlink, const char *, name)
+
+_syscall4(int, mq_send, mqd_t, mqdes, const char *, msg_ptr, size_t, msg_len, unsigned int, msg_prio)
+
+_syscall4(ssize_t, mq_receive, mqd_t, mqdes, char *, msg_ptr, size_t, msg_len, unsigned int *, msg_prio)
+
+_syscall2(int, mq_notify, mqd_t, mqdes, const struct sigevent *, notification)
+
+int mq_getattr(mqd_t mqdes, struct mq_attr *mqstat)
+{
+    long __res;
+    __inline_syscall3(__res, mq_getsetattr, mqdes, NULL, mqstat);
+    __syscall_return(int, __res);
+}
+
+int mq_setattr(mqd_t mqdes, const struct mq_attr *mqstat, struct mq_attr *omqstat)
+{
+    long __res;
+    __inline_syscall3(__res, mq_getsetattr, mqdes, mqstat, omqstat);
+    __syscall_return(int, __res);
+}
@@ -0,0 +1,143 @@
+/// @file pthread.c
+/// @brief Minimal POSIX threads, built on clone and futexes.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include "pthread.h"
+#include "sched.h"
+#include "string.h"
+#include "sys/errno.h"
+#include "sys/mman.h"
+#include "sys/unistd.h"
+
+/// The resources shared by the threads, and the signal sent when they exit,
+/// none since the kernel frees them.
+#define PTHREAD_CLONE_FLAGS                                             \
+    (CLONE_VM | CLONE_FILES | CLONE_SIGHAND | CLONE_SETTLS |            \
+     CLONE_PARENT_SETTID | CLONE_CHILD_CLEARTID)
+
+/// The descriptor of the main thread, which has no thread-local storage.
+static pthread_desc_t pthread_main = { .self = &pthread_main };
+
+/// @brief The first function executed by a thread.
+/// @param arg the descriptor of the thread.
+/// @return never returns.
+static int __pthread_start(void *arg)
+{
+    pthread_desc_t *desc = (pthread_desc_t *)arg;
+    pthread_exit(desc->start_routine(desc->arg));
+}
+
+int pthread_attr_init(pthread_attr_t *attr)
+{
+    attr->stacksize = PTHREAD_STACK_DEFAULT;
+    return 0;
+}
+
+int pthread_attr_setstacksize(pthread_attr_t *attr, size_t stacksize)
+{
+    if (stacksize < PTHREAD_STACK_MIN) {
+        return EINVAL;
+    }
+    attr->stacksize = stacksize;
+    return 0;
+}
+
+int pthread_create(pthread_t *thread, const pthread_attr_t *attr, void *(*start_routine)(void *), void *arg)
+{
+    size_t stack_size = attr ? attr->stacksize : PTHREAD_STACK_DEFAULT;
+    // The stack is not taken from the heap, malloc is not thread-safe.
+    char *stack = mmap(NULL, stack_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (stack == NULL) {
+        return EAGAIN;
+    }
+    // The descriptor sits at the top of the stack, which grows below it.
+    pthread_desc_t *desc = (pthread_desc_t *)(stack + stack_size - sizeof(pthread_desc_t));
+    memset(desc, 0, sizeof(pthread_desc_t));
+    desc->self          = desc;
+    desc->start_routine = start_routine;
+    desc->arg           = arg;
+    desc->stack         = stack;
+    desc->stack_size    = stack_size;
+    // The kernel stores the tid before we return, and clears it when the
+    // thread exits.
+    if (clone(__pthread_start, desc, PTHREAD_CLONE_FLAGS, desc, (pid_t *)&desc->tid, desc, (pid_t *)&desc->tid) < 0) {
+        int error = errno;
+        munmap(stack, stack_size);
+        return error;
+    }
+    *thread = desc;
+    return 0;
+}
+
+int pthread_join(pthread_t thread, void **retval)
+{
+    pid_t tid;
+    if ((thread == pthread_self()) || (thread == &pthread_main)) {
+        return EDEADLK;
+    }
+    // Sleep until the kernel clears the tid.
+    while ((tid = thread->tid) != 0) {
+        futex((int *)&thread->tid, FUTEX_WAIT, tid, NULL, NULL);
+    }
+    if (retval) {
+        *retval = thread->retval;
+    }
+    // The descriptor is inside the stack, which goes away.
+    munmap(thread->stack, thread->stack_size);
+    return 0;
+}
+
+void pthread_exit(void *retval)
+{
+    pthread_self()->retval = retval;
+    exit(0);
+    for (;;) {}
+}
+
+pthread_t pthread_self(void)
+{
+    unsigned short gs, ds;
+    pthread_t self;
+    __asm__ __volatile__("mov %%gs, %0" : "=r"(gs));
+    __asm__ __volatile__("mov %%ds, %0" : "=r"(ds));
+    // Without a segment of its own, this is the main thread.
+    if (gs == ds) {
+        return &pthread_main;
+    }
+    __asm__ __volatile__("movl %%gs:0, %0" : "=r"(self));
+    return self;
+}
+
+int pthread_equal(pthread_t t1, pthread_t t2)
+{
+    return t1 == t2;
+}
+
+int pthread_mutex_init(pthread_mutex_t *mutex, const pthread_mutexattr_t *attr)
+{
+    futex_mutex_init(&mutex->lock);
+    return 0;
+}
+
+int pthread_mutex_destroy(pthread_mutex_t *mutex)
+{
+    return mutex->lock.state ? EBUSY : 0;
+}
+
+int pthread_mutex_lock(pthread_mutex_t *mutex)
+{
+    futex_mutex_lock(&mutex->lock);
+    return 0;
+}
+
+int pthread_mutex_trylock(pthread_mutex_t *mutex)
+{
+    return futex_mutex_trylock(&mutex->lock) ? 0 : EBUSY;
+}
+
+int pthread_mutex_unlock(pthread_mutex_t *mutex)
+{
+    futex_mutex_unlock(&mutex->lock);
+    return 0;
+}
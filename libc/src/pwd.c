@@ -5,13 +5,20 @@
 
 #include "pwd.h"
 #include "assert.h"
-#include "fcntl.h"
 #include "io/debug.h"
+#include "math.h"
 #include "readline.h"
 #include "stdio.h"
+#include "stdlib.h"
 #include "string.h"
 #include "sys/errno.h"
-#include "sys/unistd.h"
+
+/// The lines of `/etc/passwd`, read again only when the file changes.
+static file_lines_t __passwd_lines;
+/// The entries parsed from the lines, their strings point inside the lines.
+static passwd_t *__passwd_entries;
+/// The number of entries.
+static size_t __passwd_count;
 
 /// @brief Parses the input buffer and fills pwd with its details.
 /// @param pwd the structure we need to fill.
@@ -19,7 +26,7 @@
 static inline void __parse_line(passwd_t *pwd, char *buf)
 {
     assert(pwd && "Received null pwd!");
-    char *token, *ch;
+    char *token;
     // Parse the username.
     if ((token = strtok(buf, ":")) != NULL) {
         pwd->pw_name = token;
@@ -47,66 +54,89 @@ static inline void __parse_line(passwd_t *pwd, char *buf)
     // Parse the shell.
     if ((token = strtok(NULL, ":")) != NULL) {
         pwd->pw_shell = token;
-        // Find carriege return.
-        if ((ch = strchr(pwd->pw_shell, '\r'))) {
-            *ch = 0;
-        }
-        // Find newline.
-        if ((ch = strchr(pwd->pw_shell, '\n'))) {
-            *ch = 0;
+    }
+}
+
+/// @brief Brings the entries up to date with `/etc/passwd`.
+/// @return 0 on success, -1 on failure.
+static inline int __load_entries(void)
+{
+    int ret = readlines_cached("/etc/passwd", &__passwd_lines);
+    if (ret == 0) {
+        return 0;
+    }
+    free(__passwd_entries);
+    __passwd_entries = NULL;
+    __passwd_count   = 0;
+    if (ret < 0) {
+        pr_debug("Cannot open `/etc/passwd`\n");
+        return -1;
+    }
+    __passwd_entries = malloc(max(__passwd_lines.count, 1U) * sizeof(passwd_t));
+    if (__passwd_entries == NULL) {
+        readlines_free(&__passwd_lines);
+        errno = ENOMEM;
+        return -1;
+    }
+    for (size_t i = 0; i < __passwd_lines.count; ++i) {
+        // Skip the lines which are not entries.
+        if (strchr(__passwd_lines.lines[i], ':') == NULL) {
+            continue;
         }
+        memset(&__passwd_entries[__passwd_count], 0, sizeof(passwd_t));
+        __parse_line(&__passwd_entries[__passwd_count++], __passwd_lines.lines[i]);
     }
+    return 0;
 }
 
-/// @brief Searches for the given entry inside the buffer.
-/// @param fd the file descriptor of the file.
-/// @param buffer the support buffer we use to read the file.
-/// @param buflen the length of the support buffer.
-/// @param name the username we are looking for.
+/// @brief Searches for the given entry.
+/// @param name the username we are looking for, NULL to search by uid.
 /// @param uid the user-id of the user we are looking for.
-/// @return the buffer itself if we have found the entry, NULL otherwise.
-static inline char *__search_entry(int fd, char *buffer, int buflen, const char *name, uid_t uid)
+/// @return the entry if we have found it, NULL otherwise.
+static inline passwd_t *__search_entry(const char *name, uid_t uid)
 {
-    while (readline(fd, buffer, buflen, NULL) != 0) {
-        if (name != NULL) {
-            char *name_end = strchr(buffer, ':');
-            if (name_end) {
-                *name_end = '\0';
-                if (strncmp(buffer, name, strlen(name)) == 0) {
-                    *name_end = ':';
-                    return buffer;
-                }
-            }
-        } else {
-            // Name
-            char *ptr = strchr(buffer, ':');
-            if (ptr == NULL) {
-                continue;
-            }
-            // Password
-            ++ptr;
-            char *uid_start = strchr(ptr, ':');
-            if (uid_start == NULL) {
-                continue;
-            }
-            ++uid_start;
-            ptr = strchr(uid_start, ':');
-            if (ptr == NULL) {
-                continue;
-            }
-            *ptr = '\0';
-            // Parse the uid.
-            int found_uid = atoi(uid_start);
-            // Check the uid.
-            if (found_uid == uid) {
-                *ptr = ':';
-                return buffer;
-            }
+    if (__load_entries() < 0) {
+        return NULL;
+    }
+    for (size_t i = 0; i < __passwd_count; ++i) {
+        passwd_t *entry = &__passwd_entries[i];
+        if (name ? (entry->pw_name && !strcmp(entry->pw_name, name)) : (entry->pw_uid == uid)) {
+            return entry;
         }
     }
+    errno = ENOENT;
     return NULL;
 }
 
+/// @brief Copies an entry, placing its strings inside the given buffer.
+/// @param pwd the structure we need to fill.
+/// @param entry the entry.
+/// @param buf the buffer where the strings are stored.
+/// @param buflen the length of the buffer.
+/// @return 1 on success, 0 if the buffer is too small.
+static inline int __copy_entry(passwd_t *pwd, const passwd_t *entry, char *buf, size_t buflen)
+{
+    char *const sources[] = { entry->pw_name, entry->pw_passwd, entry->pw_gecos, entry->pw_dir, entry->pw_shell };
+    char **targets[]      = { &pwd->pw_name, &pwd->pw_passwd, &pwd->pw_gecos, &pwd->pw_dir, &pwd->pw_shell };
+    for (size_t i = 0; i < count_of(sources); ++i) {
+        *targets[i] = NULL;
+        if (sources[i] == NULL) {
+            continue;
+        }
+        size_t length = strlen(sources[i]) + 1;
+        if (length > buflen) {
+            errno = ERANGE;
+            return 0;
+        }
+        *targets[i] = strcpy(buf, sources[i]);
+        buf += length;
+        buflen -= length;
+    }
+    pwd->pw_uid = entry->pw_uid;
+    pwd->pw_gid = entry->pw_gid;
+    return 1;
+}
+
 passwd_t *getpwnam(const char *name)
 {
     if (name == NULL) {
@@ -134,52 +164,25 @@ passwd_t *getpwuid(uid_t uid)
 
 int getpwnam_r(const char *name, passwd_t *pwd, char *buf, size_t buflen, passwd_t **result)
 {
+    *result = NULL;
     if (name == NULL) {
         return 0;
     }
-    int fd = open("/etc/passwd", O_RDONLY, 0);
-    if (fd == -1) {
-        pr_debug("Cannot open `/etc/passwd`\n");
-        errno   = ENOENT;
-        *result = NULL;
+    passwd_t *entry = __search_entry(name, 0);
+    if ((entry == NULL) || !__copy_entry(pwd, entry, buf, buflen)) {
         return 0;
     }
-    char *entry = __search_entry(fd, buf, buflen, name, 0);
-    if (entry != NULL) {
-        // Close the file.
-        close(fd);
-        // Parse the line.
-        __parse_line(pwd, entry);
-        // Return success.
-        return 1;
-    }
-    errno = ENOENT;
-    // Close the file.
-    close(fd);
-    // Return fail.
-    return 0;
+    *result = pwd;
+    return 1;
 }
 
 int getpwuid_r(uid_t uid, passwd_t *pwd, char *buf, size_t buflen, passwd_t **result)
 {
-    int fd = open("/etc/passwd", O_RDONLY, 0);
-    if (fd == -1) {
-        pr_debug("Cannot open `/etc/passwd`\n");
-        errno   = ENOENT;
-        *result = NULL;
+    *result         = NULL;
+    passwd_t *entry = __search_entry(NULL, uid);
+    if ((entry == NULL) || !__copy_entry(pwd, entry, buf, buflen)) {
         return 0;
     }
-    char *entry = __search_entry(fd, buf, buflen, NULL, uid);
-    if (entry != NULL) {
-        // Close the file.
-        close(fd);
-        // Parse the line.
-        __parse_line(pwd, entry);
-        // Return success.
-        return 1;
-    }
-    // Close the file.
-    close(fd);
-    // Return fail.
-    return 0;
+    *result = pwd;
+    return 1;
 }
@@ -9,49 +9,127 @@
 
 #include "readline.h"
 
+#include "fcntl.h"
+#include "math.h"
 #include "stdio.h"
+#include "stdlib.h"
 #include "string.h"
+#include "sys/errno.h"
+#include "sys/stat.h"
 #include "sys/unistd.h"
 
-int readline(int fd, char *buffer, size_t buflen, ssize_t *read_len)
+void readline_init(readline_t *reader, int fd)
 {
-    ssize_t length, rollback, num_read;
-    memset(buffer, 0, buflen);
-    unsigned char found_newline = 1;
-    // Read from the file.
-    num_read = read(fd, buffer, buflen);
-    if (num_read == 0) {
-        return 0;
-    }
-    // Search for termination character.
-    char *newline = strchr(buffer, '\n');
-    if (newline == NULL) {
-        found_newline = 0;
-        newline       = strchr(buffer, EOF);
-        if (newline == NULL) {
-            newline = strchr(buffer, 0);
-            if (newline == NULL) {
-                return 0;
-            }
+    reader->fd  = fd;
+    reader->pos = 0;
+    reader->len = 0;
+}
+
+/// @brief Refills the buffer of the reader, once it has returned everything.
+/// @param reader the reader.
+/// @return the number of bytes read, 0 at the end of the file or on failure.
+static inline size_t __readline_fill(readline_t *reader)
+{
+    ssize_t num_read = read(reader->fd, reader->buffer, BUFSIZ);
+    reader->pos      = 0;
+    reader->len      = (num_read > 0) ? num_read : 0;
+    return reader->len;
+}
+
+int readline(readline_t *reader, char *buffer, size_t buflen, ssize_t *read_len)
+{
+    size_t length = 0;
+    int found_newline = 0, found_any = 0;
+    while ((reader->pos < reader->len) || __readline_fill(reader)) {
+        found_any     = 1;
+        char *start   = reader->buffer + reader->pos;
+        size_t count  = reader->len - reader->pos;
+        char *newline = memchr(start, '\n', count);
+        if (newline) {
+            count = newline - start;
+        }
+        // Keep what fits, the rest of a long line is skipped.
+        size_t copy = min(count, buflen - 1 - length);
+        memcpy(buffer + length, start, copy);
+        length += copy;
+        reader->pos += count;
+        if (newline) {
+            ++reader->pos;
+            found_newline = 1;
+            break;
         }
     }
-    // Compute the length of the string.
-    length = (newline - buffer);
-    if (length <= 0) {
+    if (!found_any) {
         return 0;
     }
-    // Close the string.
     buffer[length] = 0;
-    // Compute how much we need to rollback.
-    rollback = length - num_read + 1;
-    if (rollback > 1) {
-        return 0;
+    // Drop the carriage return of DOS line endings.
+    if ((length > 0) && (buffer[length - 1] == '\r')) {
+        buffer[--length] = 0;
     }
-    // Rollback the reading position in the file.
-    lseek(fd, rollback, SEEK_CUR);
     // Set how much we were able to read from the file.
     if (read_len) {
         *read_len = length;
     }
     return (found_newline) ? 1 : -1;
 }
+
+void readlines_free(file_lines_t *cache)
+{
+    free(cache->data);
+    free(cache->lines);
+    memset(cache, 0, sizeof(file_lines_t));
+}
+
+int readlines_cached(const char *path, file_lines_t *cache)
+{
+    stat_t st;
+    if (stat(path, &st) < 0) {
+        readlines_free(cache);
+        return -1;
+    }
+    if (cache->data && (cache->ino == st.st_ino) && (cache->size == st.st_size) && (cache->mtime == st.st_mtime)) {
+        return 0;
+    }
+    readlines_free(cache);
+    int fd = open(path, O_RDONLY, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    // The lines are never longer than the file, which might grow meanwhile.
+    size_t capacity = st.st_size + 1, used = 0, max_lines = 0;
+    char *data      = malloc(capacity);
+    readline_t *reader = malloc(sizeof(readline_t));
+    if ((data == NULL) || (reader == NULL)) {
+        errno = ENOMEM;
+        goto failure;
+    }
+    readline_init(reader, fd);
+    ssize_t length;
+    while ((used < capacity) && readline(reader, data + used, capacity - used, &length)) {
+        if (cache->count == max_lines) {
+            max_lines  = max_lines ? (max_lines * 2) : 16;
+            char **lines = realloc(cache->lines, max_lines * sizeof(char *));
+            if (lines == NULL) {
+                errno = ENOMEM;
+                goto failure;
+            }
+            cache->lines = lines;
+        }
+        cache->lines[cache->count++] = data + used;
+        used += length + 1;
+    }
+    free(reader);
+    close(fd);
+    cache->data  = data;
+    cache->ino   = st.st_ino;
+    cache->size  = st.st_size;
+    cache->mtime = st.st_mtime;
+    return 1;
+failure:
+    free(reader);
+    free(data);
+    readlines_free(cache);
+    close(fd);
+    return -1;
+}
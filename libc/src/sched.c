@@ -11,4 +11,35 @@ _syscall2(int, sched_setparam, pid_t, pid, const sched_param_t *, param)
 
 _syscall2(int, sched_getparam, pid_t, pid, sched_param_t *, param)
 
+_syscall3(int, sched_setscheduler, pid_t, pid, int, policy, const sched_param_t *, param)
+
+_syscall1(int, sched_getscheduler, pid_t, pid)
+
+_syscall0(int, sched_yield)
+
+_syscall1(int, sched_yield_to, pid_t, pid)
+
 _syscall0(int, waitperiod)
+
+_syscall3(int, sched_setaffinity, pid_t, pid, size_t, cpusetsize, const cpu_set_t *, mask)
+
+int sched_getaffinity(pid_t pid, size_t cpusetsize, cpu_set_t *mask)
+{
+    long __res;
+    __inline_syscall3(__res, sched_getaffinity, pid, cpusetsize, mask);
+    // The system call returns the size of the set it stored.
+    if (__res >= 0) {
+        return 0;
+    }
+    __syscall_return(int, __res);
+}
+
+/// @brief Enters the clone system call, see clone.S.
+/// @return the result of the system call.
+extern long __clone(int (*fn)(void *), void *stack, int flags, void *arg, pid_t *ptid, void *tls, pid_t *ctid);
+
+int clone(int (*fn)(void *), void *stack, int flags, void *arg, pid_t *ptid, void *tls, pid_t *ctid)
+{
+    long __res = __clone(fn, stack, flags, arg, ptid, tls, ctid);
+    __syscall_return(int, __res);
+}
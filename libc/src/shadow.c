@@ -57,7 +57,7 @@ int getspnam_r(const char *name, struct spwd *sp, char *buf, size_t size, struct
 {
 	char path[20+NAME_MAX];
 	int rv = 0;
-	int fd;
+	FILE *file;
 	size_t k, l = strlen(name);
 	int skip = 0;
 	int cs;
@@ -73,12 +73,12 @@ int getspnam_r(const char *name, struct spwd *sp, char *buf, size_t size, struct
 	if (size < l+100)
 		return errno = ERANGE;
 
-	fd = open(SHADOW, O_RDONLY, 0);
-	if (fd < 0) {
+	file = fopen(SHADOW, "r");
+	if (file == NULL) {
 		return errno;
 	}
 
-	while (fgets(buf, size, fd) && (k=strlen(buf))>0) {
+	while (fgets(buf, size, file) && (k=strlen(buf))>0) {
 		if (skip || strncmp(name, buf, l) || buf[l]!=':') {
 			skip = buf[k-1] != '\n';
 			continue;
@@ -92,6 +92,7 @@ int getspnam_r(const char *name, struct spwd *sp, char *buf, size_t size, struct
 		*res = sp;
 		break;
 	}
+	fclose(file);
 	errno = rv ? rv : orig_errno;
 	return rv;
 }
@@ -0,0 +1,157 @@
+/// @file spawn.c
+/// @brief Functions used to create a new process running a given program.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include "spawn.h"
+#include "stdlib.h"
+#include "string.h"
+#include "sys/errno.h"
+#include "system/syscall_types.h"
+
+int posix_spawn(pid_t *pid, const char *path, const posix_spawn_file_actions_t *file_actions,
+                const posix_spawnattr_t *attrp, char *const argv[], char *const envp[])
+{
+    long __res;
+    __inline_syscall5(__res, posix_spawn, path, argv, envp, file_actions, attrp);
+    // Unlike the other system calls, the error is returned and errno is left untouched.
+    if ((unsigned int)(__res) >= (unsigned int)(-125)) {
+        return -__res;
+    }
+    if (pid) {
+        *pid = __res;
+    }
+    return 0;
+}
+
+int posix_spawn_file_actions_init(posix_spawn_file_actions_t *file_actions)
+{
+    file_actions->count = 0;
+    return 0;
+}
+
+int posix_spawn_file_actions_destroy(posix_spawn_file_actions_t *file_actions)
+{
+    for (int i = 0; i < file_actions->count; ++i) {
+        if (file_actions->actions[i].type == POSIX_SPAWN_ACTION_OPEN) {
+            free(file_actions->actions[i].path);
+        }
+    }
+    file_actions->count = 0;
+    return 0;
+}
+
+/// @brief Reserves the next action of the list.
+/// @param file_actions the list.
+/// @param type the kind of action.
+/// @param fd the file descriptor affected by the action.
+/// @return the action, NULL if the list is full.
+static inline posix_spawn_file_action_t *__add_action(posix_spawn_file_actions_t *file_actions,
+                                                      posix_spawn_action_type_t type, int fd)
+{
+    if (file_actions->count >= POSIX_SPAWN_MAX_ACTIONS) {
+        return NULL;
+    }
+    posix_spawn_file_action_t *action = &file_actions->actions[file_actions->count];
+    memset(action, 0, sizeof(posix_spawn_file_action_t));
+    action->type = type;
+    action->fd   = fd;
+    return action;
+}
+
+int posix_spawn_file_actions_addopen(posix_spawn_file_actions_t *file_actions, int fd, const char *path, int oflag, mode_t mode)
+{
+    if ((fd < 0) || (path == NULL)) {
+        return EBADF;
+    }
+    posix_spawn_file_action_t *action = __add_action(file_actions, POSIX_SPAWN_ACTION_OPEN, fd);
+    if (action == NULL) {
+        return ENOMEM;
+    }
+    if ((action->path = strdup(path)) == NULL) {
+        return ENOMEM;
+    }
+    action->oflag = oflag;
+    action->mode  = mode;
+    ++file_actions->count;
+    return 0;
+}
+
+int posix_spawn_file_actions_addclose(posix_spawn_file_actions_t *file_actions, int fd)
+{
+    if (fd < 0) {
+        return EBADF;
+    }
+    if (__add_action(file_actions, POSIX_SPAWN_ACTION_CLOSE, fd) == NULL) {
+        return ENOMEM;
+    }
+    ++file_actions->count;
+    return 0;
+}
+
+int posix_spawn_file_actions_adddup2(posix_spawn_file_actions_t *file_actions, int fd, int newfd)
+{
+    if ((fd < 0) || (newfd < 0)) {
+        return EBADF;
+    }
+    posix_spawn_file_action_t *action = __add_action(file_actions, POSIX_SPAWN_ACTION_DUP2, newfd);
+    if (action == NULL) {
+        return ENOMEM;
+    }
+    action->oldfd = fd;
+    ++file_actions->count;
+    return 0;
+}
+
+int posix_spawnattr_init(posix_spawnattr_t *attrp)
+{
+    memset(attrp, 0, sizeof(posix_spawnattr_t));
+    return 0;
+}
+
+int posix_spawnattr_destroy(posix_spawnattr_t *attrp)
+{
+    return 0;
+}
+
+int posix_spawnattr_setflags(posix_spawnattr_t *attrp, short flags)
+{
+    if (flags & ~(POSIX_SPAWN_RESETIDS | POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK)) {
+        return EINVAL;
+    }
+    attrp->flags = flags;
+    return 0;
+}
+
+int posix_spawnattr_getflags(const posix_spawnattr_t *attrp, short *flags)
+{
+    *flags = attrp->flags;
+    return 0;
+}
+
+int posix_spawnattr_setpgroup(posix_spawnattr_t *attrp, pid_t pgroup)
+{
+    if (pgroup < 0) {
+        return EINVAL;
+    }
+    attrp->pgroup = pgroup;
+    return 0;
+}
+
+int posix_spawnattr_getpgroup(const posix_spawnattr_t *attrp, pid_t *pgroup)
+{
+    *pgroup = attrp->pgroup;
+    return 0;
+}
+
+int posix_spawnattr_setsigmask(posix_spawnattr_t *attrp, const sigset_t *sigmask)
+{
+    attrp->sigmask = *sigmask;
+    return 0;
+}
+
+int posix_spawnattr_getsigmask(const posix_spawnattr_t *attrp, sigset_t *sigmask)
+{
+    *sigmask = attrp->sigmask;
+    return 0;
+}
@@ -5,29 +5,456 @@
 
 #include "sys/errno.h"
 #include "ctype.h"
+#include "fcntl.h"
+#include "math.h"
 #include "stdbool.h"
 #include "stdio.h"
+#include "stdlib.h"
 #include "strerror.h"
 #include "string.h"
 #include "sys/unistd.h"
 
+/// @defgroup stream_flags Stream flags
+/// @brief The state of a stream, inside FILE.flags.
+/// @{
+#define __SFRD      0x01 ///< The stream can be read.
+#define __SFWR      0x02 ///< The stream can be written.
+#define __SFEOF     0x04 ///< The end of the file was reached.
+#define __SFERR     0x08 ///< An operation failed.
+#define __SFMBF     0x10 ///< The buffer was allocated by the stream.
+#define __SFREADING 0x20 ///< The buffer holds data read from the file.
+#define __SFWRITING 0x40 ///< The buffer holds data to write to the file.
+#define __SFSTATIC  0x80 ///< The FILE is not allocated, and is never freed.
+/// @}
+
+/// The buffer of the standard output.
+static char stdout_buffer[BUFSIZ];
+
+/// @brief The standard error output.
+static FILE __stderr = {
+    .fd    = STDERR_FILENO,
+    .flags = __SFWR | __SFSTATIC,
+    .mode  = _IONBF,
+};
+
+/// @brief The standard output, line buffered so that prompts and lines show
+/// up as soon as they are complete.
+static FILE __stdout = {
+    .fd    = STDOUT_FILENO,
+    .flags = __SFWR | __SFSTATIC,
+    .mode  = _IOLBF,
+    .buf   = stdout_buffer,
+    .size  = BUFSIZ,
+    .next  = &__stderr,
+};
+
+/// @brief The standard input, unbuffered: the interactive programs switch the
+/// terminal mode while reading it, and must not see keys read in advance.
+static FILE __stdin = {
+    .fd    = STDIN_FILENO,
+    .flags = __SFRD | __SFSTATIC,
+    .mode  = _IONBF,
+    .next  = &__stdout,
+};
+
+FILE *stdin  = &__stdin;
+FILE *stdout = &__stdout;
+FILE *stderr = &__stderr;
+
+/// The list of the open streams.
+static FILE *streams = &__stdin;
+
+/// @brief Sets up the buffer of the stream, if it has none yet.
+/// @param stream The stream.
+static inline void __stream_setup(FILE *stream)
+{
+    if (stream->buf) {
+        return;
+    }
+    if (stream->mode != _IONBF) {
+        stream->buf = malloc(BUFSIZ);
+        if (stream->buf) {
+            stream->size = BUFSIZ;
+            stream->flags |= __SFMBF;
+            return;
+        }
+        // Without memory, work unbuffered.
+        stream->mode = _IONBF;
+    }
+    stream->buf  = &stream->ch;
+    stream->size = 1;
+}
+
+/// @brief Writes all the given bytes to the file of the stream.
+/// @param stream The stream.
+/// @param data The bytes.
+/// @param count The number of bytes.
+/// @return 0 on success, EOF on failure.
+static int __stream_write(FILE *stream, const char *data, size_t count)
+{
+    while (count > 0) {
+        ssize_t written = write(stream->fd, data, count);
+        if (written <= 0) {
+            stream->flags |= __SFERR;
+            return EOF;
+        }
+        data += written;
+        count -= written;
+    }
+    return 0;
+}
+
+/// @brief Writes the pending output of the stream.
+/// @param stream The stream.
+/// @return 0 on success, EOF on failure.
+static int __stream_flush(FILE *stream)
+{
+    if (!(stream->flags & __SFWRITING)) {
+        return 0;
+    }
+    int ret = __stream_write(stream, stream->buf, stream->len);
+    stream->len = 0;
+    stream->flags &= ~__SFWRITING;
+    return ret;
+}
+
+/// @brief Drops the input read in advance, moving the file back to the
+/// position of the stream.
+/// @param stream The stream.
+static void __stream_unread(FILE *stream)
+{
+    if (!(stream->flags & __SFREADING)) {
+        return;
+    }
+    if (stream->len > stream->pos) {
+        lseek(stream->fd, -(off_t)(stream->len - stream->pos), SEEK_CUR);
+    }
+    stream->pos = stream->len = 0;
+    stream->flags &= ~__SFREADING;
+}
+
+/// @brief Prepares the stream for reading.
+/// @param stream The stream.
+/// @return 0 on success, EOF if it cannot be read.
+static inline int __stream_to_read(FILE *stream)
+{
+    if (!(stream->flags & __SFRD)) {
+        stream->flags |= __SFERR;
+        errno = EBADF;
+        return EOF;
+    }
+    if (stream->flags & __SFWRITING) {
+        if (__stream_flush(stream) == EOF) {
+            return EOF;
+        }
+    }
+    __stream_setup(stream);
+    stream->flags |= __SFREADING;
+    return 0;
+}
+
+/// @brief Prepares the stream for writing.
+/// @param stream The stream.
+/// @return 0 on success, EOF if it cannot be written.
+static inline int __stream_to_write(FILE *stream)
+{
+    if (!(stream->flags & __SFWR)) {
+        stream->flags |= __SFERR;
+        errno = EBADF;
+        return EOF;
+    }
+    __stream_unread(stream);
+    __stream_setup(stream);
+    stream->flags |= __SFWRITING;
+    return 0;
+}
+
+/// @brief Refills the buffer of the stream from its file.
+/// @param stream The stream.
+/// @return The number of bytes now in the buffer, 0 at end-of-file or on error.
+static size_t __stream_fill(FILE *stream)
+{
+    // Whoever waits for input should see the prompt first.
+    if ((stream->mode != _IOFBF) && (stream != stdout)) {
+        __stream_flush(stdout);
+    }
+    ssize_t count = read(stream->fd, stream->buf, stream->size);
+    stream->pos   = 0;
+    stream->len   = (count > 0) ? count : 0;
+    if (count == 0) {
+        stream->flags |= __SFEOF;
+    } else if (count < 0) {
+        stream->flags |= __SFERR;
+    }
+    return stream->len;
+}
+
+/// @brief Parses the mode of fopen and fdopen.
+/// @param mode The mode.
+/// @param oflags Where the flags of open are stored.
+/// @return The stream flags, 0 if the mode is invalid.
+static int __stream_parse_mode(const char *mode, int *oflags)
+{
+    int update = (strchr(mode, '+') != NULL);
+    switch (mode[0]) {
+    case 'r':
+        *oflags = update ? O_RDWR : O_RDONLY;
+        return update ? (__SFRD | __SFWR) : __SFRD;
+    case 'w':
+        *oflags = (update ? O_RDWR : O_WRONLY) | O_CREAT | O_TRUNC;
+        return update ? (__SFRD | __SFWR) : __SFWR;
+    case 'a':
+        *oflags = (update ? O_RDWR : O_WRONLY) | O_CREAT | O_APPEND;
+        return update ? (__SFRD | __SFWR) : __SFWR;
+    default:
+        return 0;
+    }
+}
+
+FILE *fdopen(int fd, const char *mode)
+{
+    int oflags, flags = __stream_parse_mode(mode, &oflags);
+    if (!flags) {
+        errno = EINVAL;
+        return NULL;
+    }
+    FILE *stream = malloc(sizeof(FILE));
+    if (!stream) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    memset(stream, 0, sizeof(FILE));
+    stream->fd    = fd;
+    stream->flags = flags;
+    stream->mode  = _IOFBF;
+    stream->next  = streams;
+    streams       = stream;
+    return stream;
+}
+
+FILE *fopen(const char *path, const char *mode)
+{
+    int oflags;
+    if (!__stream_parse_mode(mode, &oflags)) {
+        errno = EINVAL;
+        return NULL;
+    }
+    int fd = open(path, oflags, 0666);
+    if (fd < 0) {
+        return NULL;
+    }
+    FILE *stream = fdopen(fd, mode);
+    if (!stream) {
+        close(fd);
+    }
+    return stream;
+}
+
+int fclose(FILE *stream)
+{
+    int ret = __stream_flush(stream);
+    if (close(stream->fd) < 0) {
+        ret = EOF;
+    }
+    // Remove it from the list of the open streams.
+    for (FILE **it = &streams; *it; it = &(*it)->next) {
+        if (*it == stream) {
+            *it = stream->next;
+            break;
+        }
+    }
+    if (stream->flags & __SFMBF) {
+        free(stream->buf);
+    }
+    if (!(stream->flags & __SFSTATIC)) {
+        free(stream);
+    }
+    return ret;
+}
+
+int fflush(FILE *stream)
+{
+    if (stream) {
+        return __stream_flush(stream);
+    }
+    int ret = 0;
+    for (FILE *it = streams; it; it = it->next) {
+        if (__stream_flush(it) == EOF) {
+            ret = EOF;
+        }
+    }
+    return ret;
+}
+
+int setvbuf(FILE *stream, char *buf, int mode, size_t size)
+{
+    if ((mode != _IOFBF) && (mode != _IOLBF) && (mode != _IONBF)) {
+        errno = EINVAL;
+        return EOF;
+    }
+    if (__stream_flush(stream) == EOF) {
+        return EOF;
+    }
+    __stream_unread(stream);
+    if (stream->flags & __SFMBF) {
+        free(stream->buf);
+        stream->flags &= ~__SFMBF;
+    }
+    stream->mode = mode;
+    stream->buf  = NULL;
+    stream->size = 0;
+    if ((mode != _IONBF) && buf && size) {
+        stream->buf  = buf;
+        stream->size = size;
+    }
+    return 0;
+}
+
+void setbuf(FILE *stream, char *buf)
+{
+    setvbuf(stream, buf, buf ? _IOFBF : _IONBF, BUFSIZ);
+}
+
+size_t fread(void *ptr, size_t size, size_t nmemb, FILE *stream)
+{
+    size_t total = size * nmemb, done = 0;
+    if (!total || (__stream_to_read(stream) == EOF)) {
+        return 0;
+    }
+    while (done < total) {
+        // Take what is buffered first.
+        if (stream->pos < stream->len) {
+            size_t chunk = min(stream->len - stream->pos, total - done);
+            memcpy((char *)ptr + done, stream->buf + stream->pos, chunk);
+            stream->pos += chunk;
+            done += chunk;
+            continue;
+        }
+        // Large reads go straight to the destination.
+        if ((total - done) >= stream->size) {
+            ssize_t count = read(stream->fd, (char *)ptr + done, total - done);
+            if (count <= 0) {
+                stream->flags |= (count == 0) ? __SFEOF : __SFERR;
+                break;
+            }
+            done += count;
+            continue;
+        }
+        if (__stream_fill(stream) == 0) {
+            break;
+        }
+    }
+    return done / size;
+}
+
+size_t fwrite(const void *ptr, size_t size, size_t nmemb, FILE *stream)
+{
+    size_t total = size * nmemb;
+    const char *data = (const char *)ptr;
+    if (!total || (__stream_to_write(stream) == EOF)) {
+        return 0;
+    }
+    if (stream->mode == _IONBF) {
+        stream->flags &= ~__SFWRITING;
+        return (__stream_write(stream, data, total) == EOF) ? 0 : nmemb;
+    }
+    // Data which does not fit the buffer goes straight to the file.
+    if (stream->len + total > stream->size) {
+        if ((__stream_flush(stream) == EOF) ||
+            ((total >= stream->size) && (__stream_write(stream, data, total) == EOF))) {
+            return 0;
+        }
+        if (total >= stream->size) {
+            return nmemb;
+        }
+        stream->flags |= __SFWRITING;
+    }
+    memcpy(stream->buf + stream->len, data, total);
+    stream->len += total;
+    // A line buffered stream writes its buffer at each newline.
+    if ((stream->mode == _IOLBF) && memchr(data, '\n', total)) {
+        if (__stream_flush(stream) == EOF) {
+            return 0;
+        }
+    }
+    return nmemb;
+}
+
+int fseek(FILE *stream, long offset, int whence)
+{
+    if (__stream_flush(stream) == EOF) {
+        return -1;
+    }
+    // The kernel offset is ahead of the stream by the unread bytes.
+    if ((whence == SEEK_CUR) && (stream->flags & __SFREADING)) {
+        offset -= (long)(stream->len - stream->pos);
+    }
+    stream->pos = stream->len = 0;
+    stream->flags &= ~(__SFREADING | __SFEOF);
+    return (lseek(stream->fd, offset, whence) < 0) ? -1 : 0;
+}
+
+long ftell(FILE *stream)
+{
+    off_t position = lseek(stream->fd, 0, SEEK_CUR);
+    if (position < 0) {
+        return -1;
+    }
+    if (stream->flags & __SFREADING) {
+        return position - (long)(stream->len - stream->pos);
+    }
+    if (stream->flags & __SFWRITING) {
+        return position + (long)stream->len;
+    }
+    return position;
+}
+
+int feof(FILE *stream)
+{
+    return (stream->flags & __SFEOF) != 0;
+}
+
+int ferror(FILE *stream)
+{
+    return (stream->flags & __SFERR) != 0;
+}
+
+void clearerr(FILE *stream)
+{
+    stream->flags &= ~(__SFEOF | __SFERR);
+}
+
+int fileno(FILE *stream)
+{
+    return stream->fd;
+}
+
+int fputc(int c, FILE *stream)
+{
+    char character = (char)c;
+    return (fwrite(&character, 1, 1, stream) == 1) ? (unsigned char)c : EOF;
+}
+
+int fputs(const char *str, FILE *stream)
+{
+    size_t length = strlen(str);
+    return (fwrite(str, 1, length, stream) == length) ? 0 : EOF;
+}
+
 void putchar(int character)
 {
-    write(STDOUT_FILENO, &character, 1);
+    fputc(character, stdout);
 }
 
 void puts(const char *str)
 {
-    write(STDOUT_FILENO, str, strlen(str));
+    fputs(str, stdout);
 }
 
 int getchar(void)
 {
-    char c;
-    while (read(STDIN_FILENO, &c, 1) == 0) {
-        continue;
-    }
-    return c;
+    // The terminal blocks until a character is typed, EOF means end-of-file.
+    return fgetc(stdin);
 }
 
 char *gets(char *str)
@@ -186,46 +613,53 @@ long strtol(const char *str, char **endptr, int base)
     return (acc);
 }
 
-int fgetc(int fd)
+int fgetc(FILE *stream)
 {
-    unsigned char c;
-    if (read(fd, &c, 1) <= 0) {
+    if (__stream_to_read(stream) == EOF) {
         return EOF;
     }
-    return c;
+    if ((stream->pos >= stream->len) && (__stream_fill(stream) == 0)) {
+        return EOF;
+    }
+    return (unsigned char)stream->buf[stream->pos++];
 }
 
-char *fgets(char *buf, int n, int fd)
+char *fgets(char *buf, int n, FILE *stream)
 {
-    int c;
-    char *p;
-
-    /* get max bytes or upto a newline */
-    for (p = buf, n--; n > 0; n--) {
-        // Get the character.
-        c = fgetc(fd);
-        if (c == EOF) {
+    char *p = buf;
+    if ((n <= 0) || (__stream_to_read(stream) == EOF)) {
+        return NULL;
+    }
+    // Copy up to a newline, a buffer at a time.
+    for (--n; n > 0;) {
+        if ((stream->pos >= stream->len) && (__stream_fill(stream) == 0)) {
             break;
         }
-        *p++ = (char)c;
-        if (c == '\n') {
+        size_t count  = min((size_t)n, stream->len - stream->pos);
+        char *newline = memchr(stream->buf + stream->pos, '\n', count);
+        if (newline) {
+            count = newline - (stream->buf + stream->pos) + 1;
+        }
+        memcpy(p, stream->buf + stream->pos, count);
+        stream->pos += count;
+        p += count;
+        n -= count;
+        if (newline) {
             break;
         }
     }
     *p = 0;
-    if (p == buf || c == EOF) {
-        return NULL;
-    }
-    return (p);
+    return (p == buf) ? NULL : buf;
 }
 
 void perror(const char *s)
 {
+    // Keep the messages after the output written so far.
+    fflush(stdout);
     if (s) {
-        puts(s);
-        putchar(':');
-        putchar(' ');
+        fputs(s, stderr);
+        fputs(": ", stderr);
     }
-    puts(strerror(errno));
-    putchar('\n');
+    fputs(strerror(errno), stderr);
+    fputc('\n', stderr);
 }
@@ -4,25 +4,108 @@
 /// See LICENSE.md for details.
 
 #include "stddef.h"
+#include "stdint.h"
 #include "assert.h"
 #include "stdlib.h"
 #include "string.h"
+#include "sys/list_head.h"
 #include "system/syscall_types.h"
 
-/// @brief Number which identifies a memory area allocated through a call to
-/// malloc(), calloc() or realloc().
-#define MALLOC_MAGIC_NUMBER 0x600DC0DE
-
-/// @brief A structure that holds the information about an allocated chunk of
-/// memory through malloc.
-typedef struct {
-    /// @brief A magic number that is used to check if the passed pointer is
-    /// actually a malloc allocated memory.
-    unsigned magic;
-    /// @brief The size of the allocated memory, useful when doing a realloc.
+/// @brief Flag of malloc_header_t.size, set while the chunk is in use.
+#define MALLOC_INUSE 1U
+/// @brief Alignment of the chunks, and of the memory they provide.
+#define MALLOC_ALIGN 8U
+/// @brief Size of the regions requested to the kernel.
+#define MALLOC_REGION_SIZE (64U * 1024U)
+/// @brief Largest chunk kept by the small bins, one bin for each size.
+#define MALLOC_SMALL_MAX 512U
+/// @brief Number of small bins, for chunks from 16 to MALLOC_SMALL_MAX bytes.
+#define MALLOC_SMALL_BINS (MALLOC_SMALL_MAX / MALLOC_ALIGN - 1)
+/// @brief Number of large bins, each one covers a power of two of sizes.
+#define MALLOC_LARGE_BINS 22
+/// @brief Largest chunk which goes into the cache of recently freed chunks.
+#define MALLOC_TCACHE_MAX 256U
+/// @brief Maximum number of chunks of the same size kept by the cache.
+#define MALLOC_TCACHE_COUNT 8
+
+/// @brief The header placed before the memory provided by malloc.
+typedef struct malloc_header_t {
+    /// @brief The size of the previous chunk, 0 if this is the first of its region.
+    size_t prev_size;
+    /// @brief The size of this chunk, header included, with the MALLOC_INUSE flag.
     size_t size;
 } malloc_header_t;
 
+/// @brief A free chunk, linked inside its bin.
+typedef struct malloc_chunk_t {
+    /// @brief The header of the chunk.
+    malloc_header_t header;
+    /// @brief Position inside the bin.
+    list_head free;
+} malloc_chunk_t;
+
+/// @brief A chunk kept by the cache of recently freed chunks.
+typedef struct malloc_tcache_entry_t {
+    /// @brief The header of the chunk, still marked as in use.
+    malloc_header_t header;
+    /// @brief The next chunk of the same size.
+    struct malloc_tcache_entry_t *next;
+} malloc_tcache_entry_t;
+
+/// @brief A block of memory obtained from the kernel, split into chunks.
+typedef struct malloc_region_t {
+    /// @brief The address returned by the kernel.
+    void *base;
+    /// @brief Padding, keeps the first chunk aligned.
+    size_t unused;
+} malloc_region_t;
+
+/// @brief The smallest chunk, it must be able to hold the bin links.
+#define MALLOC_MIN_CHUNK ((sizeof(malloc_chunk_t) + MALLOC_ALIGN - 1) & ~(size_t)(MALLOC_ALIGN - 1))
+
+/// @brief Bins of free chunks, the small ones hold chunks of a single size.
+static list_head malloc_bins[MALLOC_SMALL_BINS + MALLOC_LARGE_BINS];
+/// @brief Recently freed small chunks, reused without touching the bins.
+static malloc_tcache_entry_t *malloc_tcache[MALLOC_TCACHE_MAX / MALLOC_ALIGN - 1];
+/// @brief Number of chunks inside each list of the cache.
+static unsigned char malloc_tcache_count[MALLOC_TCACHE_MAX / MALLOC_ALIGN - 1];
+/// @brief Number of regions obtained from the kernel.
+static unsigned malloc_regions = 0;
+
+/// @brief Returns the size of the chunk, header included.
+/// @param header the header of the chunk.
+/// @return the size of the chunk.
+static inline size_t __chunk_size(malloc_header_t *header)
+{
+    return header->size & ~MALLOC_INUSE;
+}
+
+/// @brief Returns the chunk following the given one.
+/// @param header the header of the chunk.
+/// @return the next chunk, the last one of a region has size 0.
+static inline malloc_header_t *__chunk_next(malloc_header_t *header)
+{
+    return (malloc_header_t *)((char *)header + __chunk_size(header));
+}
+
+/// @brief Returns the chunk preceding the given one.
+/// @param header the header of the chunk, which must not be the first.
+/// @return the previous chunk.
+static inline malloc_header_t *__chunk_prev(malloc_header_t *header)
+{
+    return (malloc_header_t *)((char *)header - header->prev_size);
+}
+
+/// @brief Sets the size of the chunk, keeping the next chunk in sync.
+/// @param header the header of the chunk.
+/// @param size the size of the chunk.
+/// @param inuse if the chunk is in use.
+static inline void __chunk_set(malloc_header_t *header, size_t size, int inuse)
+{
+    header->size = size | (inuse ? MALLOC_INUSE : 0);
+    __chunk_next(header)->prev_size = size;
+}
+
 /// @brief Extract the actual pointer to the allocated memory from the malloc header.
 /// @param header the header we are using.
 /// @return a pointer to the allocated memory.
@@ -39,28 +122,222 @@ static inline malloc_header_t *ptr_to_malloc_header(void *ptr)
     return (malloc_header_t *)((char *)ptr - sizeof(malloc_header_t));
 }
 
+/// @brief Returns the size of the chunk needed to provide the given amount of memory.
+/// @param size the amount of memory.
+/// @return the size of the chunk, 0 if too big.
+static inline size_t __chunk_size_for(size_t size)
+{
+    if (size > (size_t)-1 - MALLOC_REGION_SIZE) {
+        return 0;
+    }
+    size = (size + sizeof(malloc_header_t) + MALLOC_ALIGN - 1) & ~(size_t)(MALLOC_ALIGN - 1);
+    return (size < MALLOC_MIN_CHUNK) ? MALLOC_MIN_CHUNK : size;
+}
+
+/// @brief Returns the bin holding chunks of the given size.
+/// @param size the size of the chunk.
+/// @return the index of the bin.
+static inline unsigned __bin_index(size_t size)
+{
+    if (size <= MALLOC_SMALL_MAX) {
+        return size / MALLOC_ALIGN - 2;
+    }
+    // Sizes from 2^k to 2^(k+1) - 1 share a bin, starting from k = 9.
+    unsigned index = MALLOC_SMALL_BINS + (31 - __builtin_clz(size)) - 9;
+    return (index < count_of(malloc_bins)) ? index : count_of(malloc_bins) - 1;
+}
+
+/// @brief Inserts the free chunk inside its bin.
+/// @param header the header of the chunk.
+static inline void __bin_insert(malloc_header_t *header)
+{
+    list_head *bin = &malloc_bins[__bin_index(__chunk_size(header))];
+    if (bin->next == NULL) {
+        list_head_init(bin);
+    }
+    list_head_insert_after(&((malloc_chunk_t *)header)->free, bin);
+}
+
+/// @brief Removes the free chunk from its bin.
+/// @param header the header of the chunk.
+static inline void __bin_remove(malloc_header_t *header)
+{
+    list_head_remove(&((malloc_chunk_t *)header)->free);
+}
+
+/// @brief Obtains a new region from the kernel, holding a free chunk of at
+/// least the given size.
+/// @param size the size of the chunk.
+/// @return the free chunk, already inside its bin, NULL on failure.
+static malloc_header_t *__region_alloc(size_t size)
+{
+    // Room for the region descriptor, the alignment, and the final chunk.
+    size_t overhead    = sizeof(malloc_region_t) + MALLOC_ALIGN + sizeof(malloc_header_t);
+    size_t region_size = (size + overhead > MALLOC_REGION_SIZE) ? size + overhead : MALLOC_REGION_SIZE;
+    void *base;
+    __inline_syscall1(base, brk, region_size);
+    if (base == NULL) {
+        return NULL;
+    }
+    ++malloc_regions;
+    // Place the region descriptor.
+    malloc_region_t *region = (malloc_region_t *)(((uintptr_t)base + MALLOC_ALIGN - 1) & ~(uintptr_t)(MALLOC_ALIGN - 1));
+    region->base            = base;
+    // A single free chunk spans the whole region.
+    malloc_header_t *header = (malloc_header_t *)(region + 1);
+    size_t chunk_size       = ((uintptr_t)base + region_size - sizeof(malloc_header_t) - (uintptr_t)header) & ~(uintptr_t)(MALLOC_ALIGN - 1);
+    header->prev_size       = 0;
+    // The final chunk is always in use, so that it is never merged.
+    malloc_header_t *fence = (malloc_header_t *)((char *)header + chunk_size);
+    fence->size            = MALLOC_INUSE;
+    __chunk_set(header, chunk_size, 0);
+    __bin_insert(header);
+    return header;
+}
+
+/// @brief Returns the region to the kernel, if the chunk spans all of it.
+/// @param header the free chunk, not inside any bin.
+/// @return 1 if the region has been released, 0 otherwise.
+static int __region_release(malloc_header_t *header)
+{
+    // Keep at least one region around.
+    if ((malloc_regions == 1) || (header->prev_size != 0) || (__chunk_size(__chunk_next(header)) != 0)) {
+        return 0;
+    }
+    malloc_region_t *region = (malloc_region_t *)header - 1;
+    int _res;
+    __inline_syscall1(_res, brk, (char *)region->base);
+    --malloc_regions;
+    return 1;
+}
+
+/// @brief Splits the chunk, putting what exceeds the given size in a bin.
+/// @param header the header of the chunk, not inside any bin.
+/// @param size the size the chunk must keep.
+static void __chunk_split(malloc_header_t *header, size_t size)
+{
+    size_t total = __chunk_size(header);
+    if (total - size < MALLOC_MIN_CHUNK) {
+        return;
+    }
+    size_t rest_size = total - size;
+    // The rest might be followed by a free chunk, when a chunk shrinks.
+    malloc_header_t *after = (malloc_header_t *)((char *)header + total);
+    if (!(after->size & MALLOC_INUSE)) {
+        __bin_remove(after);
+        rest_size += __chunk_size(after);
+    }
+    __chunk_set(header, size, header->size & MALLOC_INUSE);
+    malloc_header_t *rest = __chunk_next(header);
+    __chunk_set(rest, rest_size, 0);
+    __bin_insert(rest);
+}
+
+/// @brief Searches the bins for a free chunk of at least the given size.
+/// @param size the size of the chunk.
+/// @return the chunk, removed from its bin, NULL if there is none.
+static malloc_header_t *__bin_find(size_t size)
+{
+    for (unsigned index = __bin_index(size); index < count_of(malloc_bins); ++index) {
+        list_head *bin = &malloc_bins[index];
+        if ((bin->next == NULL) || list_head_empty(bin)) {
+            continue;
+        }
+        // Small bins hold chunks of a single size, take the first one.
+        list_for_each_decl(it, bin)
+        {
+            malloc_header_t *header = &list_entry(it, malloc_chunk_t, free)->header;
+            if (__chunk_size(header) >= size) {
+                __bin_remove(header);
+                return header;
+            }
+        }
+    }
+    return NULL;
+}
+
+/// @brief Gives a chunk back, merging it with the free chunks next to it.
+/// @param header the header of the chunk.
+static void __chunk_free(malloc_header_t *header)
+{
+    size_t size = __chunk_size(header);
+    // Merge with the following chunk.
+    malloc_header_t *next = __chunk_next(header);
+    if (!(next->size & MALLOC_INUSE)) {
+        __bin_remove(next);
+        size += __chunk_size(next);
+    }
+    // Merge with the preceding chunk.
+    if (header->prev_size != 0) {
+        malloc_header_t *prev = __chunk_prev(header);
+        if (!(prev->size & MALLOC_INUSE)) {
+            __bin_remove(prev);
+            size += __chunk_size(prev);
+            header = prev;
+        }
+    }
+    __chunk_set(header, size, 0);
+    if (!__region_release(header)) {
+        __bin_insert(header);
+    }
+}
+
+/// @brief Gives back to the bins all the chunks kept by the cache.
+static void __tcache_flush(void)
+{
+    for (unsigned index = 0; index < count_of(malloc_tcache); ++index) {
+        while (malloc_tcache[index]) {
+            malloc_tcache_entry_t *entry = malloc_tcache[index];
+            malloc_tcache[index]         = entry->next;
+            __chunk_free(&entry->header);
+        }
+        malloc_tcache_count[index] = 0;
+    }
+}
+
 void *malloc(unsigned int size)
 {
     if (size == 0) {
         return NULL;
     }
-    void *ptr;
-    // Allocate the memory.
-    __inline_syscall1(ptr, brk, size + sizeof(malloc_header_t));
-    // Check for errors from the brk.
-    if (ptr == 0) {
+    size_t chunk_size = __chunk_size_for(size);
+    if (chunk_size == 0) {
         return NULL;
     }
-    // Initialize the malloc header.
-    malloc_header_t *header = (malloc_header_t *)ptr;
-    header->magic           = MALLOC_MAGIC_NUMBER;
-    header->size            = size;
-    // Return the allocated memory.
+    malloc_header_t *header;
+    // Reuse a recently freed chunk of the same size.
+    if (chunk_size <= MALLOC_TCACHE_MAX) {
+        unsigned index = chunk_size / MALLOC_ALIGN - 2;
+        if (malloc_tcache[index]) {
+            malloc_tcache_entry_t *entry = malloc_tcache[index];
+            malloc_tcache[index]         = entry->next;
+            --malloc_tcache_count[index];
+            return malloc_header_to_ptr(&entry->header);
+        }
+    }
+    // Search the bins, and ask the kernel for more memory if needed.
+    header = __bin_find(chunk_size);
+    if (header == NULL) {
+        // The cached chunks might merge into a large enough one.
+        __tcache_flush();
+        header = __bin_find(chunk_size);
+    }
+    if (header == NULL) {
+        if (__region_alloc(chunk_size) == NULL) {
+            return NULL;
+        }
+        header = __bin_find(chunk_size);
+    }
+    header->size |= MALLOC_INUSE;
+    __chunk_split(header, chunk_size);
     return malloc_header_to_ptr(header);
 }
 
 void *calloc(size_t num, size_t size)
 {
+    if (size && (num > (size_t)-1 / size)) {
+        return NULL;
+    }
     void *ptr = malloc(num * size);
     if (ptr) {
         memset(ptr, 0, num * size);
@@ -68,6 +345,18 @@ void *calloc(size_t num, size_t size)
     return ptr;
 }
 
+size_t malloc_usable_size(void *ptr)
+{
+    if (ptr == NULL) {
+        return 0;
+    }
+    malloc_header_t *header = ptr_to_malloc_header(ptr);
+    if (!(header->size & MALLOC_INUSE)) {
+        return 0;
+    }
+    return __chunk_size(header) - sizeof(malloc_header_t);
+}
+
 void *realloc(void *ptr, size_t size)
 {
     // C standard implementation: When NULL is passed to realloc,
@@ -84,27 +373,57 @@ void *realloc(void *ptr, size_t size)
     // Get the malloc header.
     malloc_header_t *header = ptr_to_malloc_header(ptr);
     // Check the header.
-    assert(header->magic == MALLOC_MAGIC_NUMBER && "This is not a valid pointer.");
+    assert((header->size & MALLOC_INUSE) && "This is not a valid pointer.");
     // Get the old size.
-    size_t old_size = header->size;
-    // Create the new pointer.
-    void *newp = malloc(size);
-    memset(newp, 0, size);
-    memcpy(newp, ptr, old_size);
-    free(ptr);
-    return newp;
+    size_t old_size   = __chunk_size(header) - sizeof(malloc_header_t);
+    size_t chunk_size = __chunk_size_for(size);
+    if (chunk_size == 0) {
+        return NULL;
+    }
+    // Grow in place, taking the following chunk if it is free.
+    malloc_header_t *next = __chunk_next(header);
+    if ((chunk_size > __chunk_size(header)) && !(next->size & MALLOC_INUSE) &&
+        (__chunk_size(header) + __chunk_size(next) >= chunk_size)) {
+        __bin_remove(next);
+        __chunk_set(header, __chunk_size(header) + __chunk_size(next), 1);
+    }
+    if (chunk_size <= __chunk_size(header)) {
+        __chunk_split(header, chunk_size);
+    } else {
+        // Create the new pointer.
+        void *newp = malloc(size);
+        if (newp == NULL) {
+            return NULL;
+        }
+        memcpy(newp, ptr, old_size);
+        free(ptr);
+        ptr = newp;
+    }
+    return ptr;
 }
 
 void free(void *ptr)
 {
+    if (ptr == NULL) {
+        return;
+    }
     // Get the malloc header.
     malloc_header_t *header = ptr_to_malloc_header(ptr);
     // Check the header.
-    assert(header->magic == MALLOC_MAGIC_NUMBER && "This is not a valid pointer.");
-    ptr = (char *)ptr - sizeof(malloc_header_t);
-    // Call the free.
-    int _res;
-    __inline_syscall1(_res, brk, (char *)header);
+    assert((header->size & MALLOC_INUSE) && "This is not a valid pointer.");
+    size_t size = __chunk_size(header);
+    // Keep small chunks at hand, they are likely to be requested again.
+    if (size <= MALLOC_TCACHE_MAX) {
+        unsigned index = size / MALLOC_ALIGN - 2;
+        if (malloc_tcache_count[index] < MALLOC_TCACHE_COUNT) {
+            malloc_tcache_entry_t *entry = (malloc_tcache_entry_t *)header;
+            entry->next                  = malloc_tcache[index];
+            malloc_tcache[index]         = entry;
+            ++malloc_tcache_count[index];
+            return;
+        }
+    }
+    __chunk_free(header);
 }
 
 /// Seed used to generate random numbers.
@@ -13,6 +13,62 @@
 #include "mem/kheap.h"
 #endif
 
+/// Copies and fillings at least this long align the destination first.
+#define MEM_ALIGN_THRESHOLD 64
+
+/// @brief A word which may alias any other type, to compare memory by words.
+typedef unsigned long mem_word_t __attribute__((__may_alias__));
+
+/// A word with each byte set to 1.
+#define WORD_ONES (~0UL / 0xFF)
+/// A word with the top bit of each byte set.
+#define WORD_HIGHS (WORD_ONES * 0x80)
+
+/// @brief Tells if a word contains a zero byte, without looking at each byte.
+/// @param word the word.
+/// @return non-zero if one of its bytes is zero.
+static inline mem_word_t __word_has_zero(mem_word_t word)
+{
+    return (word - WORD_ONES) & ~word & WORD_HIGHS;
+}
+
+/// @brief Tells if a pointer is aligned to a word. Aligned words never cross
+/// a page, so they can be read past the end of a string.
+/// @param ptr the pointer.
+/// @return non-zero if it is aligned.
+static inline int __word_aligned(const void *ptr)
+{
+    return ((unsigned long)ptr & (sizeof(mem_word_t) - 1)) == 0;
+}
+
+/// @brief Copies memory from lower to higher addresses, by words with the
+/// string instructions, then the last bytes.
+/// @param dst the destination.
+/// @param src the source.
+/// @param num the number of bytes.
+static inline void __memcpy_forward(void *dst, const void *src, size_t num)
+{
+    int d0, d1, d2;
+    // Long copies first align the destination, stores which cross a word
+    // boundary cost more than loads.
+    if (num >= MEM_ALIGN_THRESHOLD) {
+        size_t head = (-(unsigned long)dst) & 3;
+        __asm__ __volatile__("rep movsb"
+                             : "=&c"(d0), "=&D"(d1), "=&S"(d2)
+                             : "0"(head), "1"(dst), "2"(src)
+                             : "memory");
+        dst = (char *)dst + head;
+        src = (const char *)src + head;
+        num -= head;
+    }
+    __asm__ __volatile__("rep movsl\n\t"
+                         "movl %6, %%ecx\n\t"
+                         "rep movsb"
+                         : "=&c"(d0), "=&D"(d1), "=&S"(d2)
+                         : "0"(num >> 2), "1"(dst), "2"(src), "g"(num & 3)
+                         : "memory");
+}
+
 char *strncpy(char *destination, const char *source, size_t num)
 {
     // Check if we have a valid number.
@@ -74,15 +130,23 @@ int strnicmp(const char *s1, const char *s2, size_t n)
 
 char *strchr(const char *s, int ch)
 {
-    while (*s && *s != (char)ch) {
-        s++;
-    }
-    if (*s == (char)ch) {
-        return (char *)s;
+    // Reach a word boundary.
+    for (; !__word_aligned(s); ++s) {
+        if (*s == (char)ch) {
+            return (char *)s;
+        }
+        if (!*s) {
+            return NULL;
+        }
     }
-    {
-        return NULL;
+    // Skip the words without the character and without the terminator.
+    mem_word_t pattern = WORD_ONES * (unsigned char)ch;
+    const mem_word_t *word = (const mem_word_t *)s;
+    while (!__word_has_zero(*word) && !__word_has_zero(*word ^ pattern)) {
+        ++word;
     }
+    for (s = (const char *)word; *s && *s != (char)ch; ++s) {}
+    return (*s == (char)ch) ? (char *)s : NULL;
 }
 
 char *strrchr(const char *s, int ch)
@@ -102,26 +166,16 @@ char *strrchr(const char *s, int ch)
 
 char *strstr(const char *str1, const char *str2)
 {
-    char *cp = (char *)str1;
-    char *s1, *s2;
-
-    if (!*str2) {
+    size_t length = strlen(str2);
+    if (!length) {
         return (char *)str1;
     }
-
-    while (*cp) {
-        s1 = cp;
-        s2 = (char *)str2;
-
-        while (*s1 && *s2 && !(*s1 - *s2)) {
-            s1++, s2++;
-        }
-        if (!*s2) {
-            return cp;
+    // Jump between the occurrences of the first character.
+    for (const char *cp = str1; (cp = strchr(cp, *str2)) != NULL; ++cp) {
+        if (!strncmp(cp, str2, length)) {
+            return (char *)cp;
         }
-        cp++;
     }
-
     return NULL;
 }
 
@@ -249,40 +303,48 @@ int tokenize(const char *string, char *separators, size_t *offset, char *buffer,
 
 void *memmove(void *dst, const void *src, size_t n)
 {
-    void *ret = dst;
-
+    int d0, d1, d2;
     if (dst <= src || (char *)dst >= ((char *)src + n)) {
-        /* Non-overlapping buffers; copy from lower addresses to higher
-         * addresses.
-         */
-        while (n--) {
-            *(char *)dst = *(char *)src;
-            dst          = (char *)dst + 1;
-            src          = (char *)src + 1;
-        }
+        // Copying from lower to higher addresses never reads a byte which was
+        // already overwritten.
+        __memcpy_forward(dst, src, n);
     } else {
-        // Overlapping buffers; copy from higher addresses to lower addresses.
-        dst = (char *)dst + n - 1;
-        src = (char *)src + n - 1;
-
-        while (n--) {
-            *(char *)dst = *(char *)src;
-            dst          = (char *)dst - 1;
-            src          = (char *)src - 1;
-        }
+        // Overlapping buffers; copy from higher addresses to lower addresses:
+        // the last bytes, then the words before them.
+        __asm__ __volatile__("std\n\t"
+                             "rep movsb\n\t"
+                             "subl $3, %%esi\n\t"
+                             "subl $3, %%edi\n\t"
+                             "movl %6, %%ecx\n\t"
+                             "rep movsl\n\t"
+                             "cld"
+                             : "=&c"(d0), "=&D"(d1), "=&S"(d2)
+                             : "0"(n & 3), "1"((char *)dst + n - 1), "2"((const char *)src + n - 1), "g"(n >> 2)
+                             : "memory");
     }
-
-    return ret;
+    return dst;
 }
 
 void *memchr(const void *ptr, int ch, size_t n)
 {
-    while (n && (*(unsigned char *)ptr != (unsigned char)ch)) {
-        ptr = (unsigned char *)ptr + 1;
-        n--;
+    const unsigned char *it = (const unsigned char *)ptr;
+    // Reach a word boundary.
+    for (; n && !__word_aligned(it); --n, ++it) {
+        if (*it == (unsigned char)ch) {
+            return (void *)it;
+        }
     }
-
-    return (n ? (void *)ptr : NULL);
+    // Skip the words without the character.
+    mem_word_t pattern = WORD_ONES * (unsigned char)ch;
+    for (; (n >= sizeof(mem_word_t)) && !__word_has_zero(*(const mem_word_t *)it ^ pattern); n -= sizeof(mem_word_t)) {
+        it += sizeof(mem_word_t);
+    }
+    for (; n; --n, ++it) {
+        if (*it == (unsigned char)ch) {
+            return (void *)it;
+        }
+    }
+    return NULL;
 }
 
 char *strlwr(char *s)
@@ -432,41 +494,56 @@ char *strtok_r(char *str, const char *delim, char **saveptr)
 
 void *memset(void *ptr, int value, size_t num)
 {
-    // Turn the pointer into a char * pointer. Here, we use the volatile keyword
-    // to prevent the compiler from optimizing away the operations involving the
-    // pointer.
-    unsigned char volatile *dst = (unsigned char volatile *)ptr;
-    // Initialize the content of the memory.
-    while (num--) *dst++ = (unsigned char)value;
-    // Return the pointer.
+    // Repeat the byte in every byte of a word.
+    unsigned long word = 0x01010101UL * (unsigned char)value;
+    int d0, d1;
+    // Align the destination first, then store words, then the last bytes.
+    if (num >= MEM_ALIGN_THRESHOLD) {
+        size_t head = (-(unsigned long)ptr) & 3;
+        __asm__ __volatile__("rep stosb"
+                             : "=&c"(d0), "=&D"(d1)
+                             : "0"(head), "1"(ptr), "a"(word)
+                             : "memory");
+        __asm__ __volatile__("rep stosl\n\t"
+                             "movl %4, %%ecx\n\t"
+                             "rep stosb"
+                             : "=&c"(d0), "=&D"(d1)
+                             : "0"((num - head) >> 2), "1"((char *)ptr + head), "g"((num - head) & 3), "a"(word)
+                             : "memory");
+    } else {
+        __asm__ __volatile__("rep stosl\n\t"
+                             "movl %4, %%ecx\n\t"
+                             "rep stosb"
+                             : "=&c"(d0), "=&D"(d1)
+                             : "0"(num >> 2), "1"(ptr), "g"(num & 3), "a"(word)
+                             : "memory");
+    }
     return ptr;
 }
 
 int memcmp(const void *dst, const void *src, size_t n)
 {
-    if (!n) {
-        return 0;
-    }
-
-    while (--n && *(char *)dst == *(char *)src) {
-        dst = (char *)dst + 1;
-        src = (char *)src + 1;
+    const unsigned char *s1 = (const unsigned char *)dst;
+    const unsigned char *s2 = (const unsigned char *)src;
+    // Skip the equal words, the CPU handles the misaligned loads.
+    while ((n >= sizeof(mem_word_t)) && (*(const mem_word_t *)s1 == *(const mem_word_t *)s2)) {
+        s1 += sizeof(mem_word_t);
+        s2 += sizeof(mem_word_t);
+        n -= sizeof(mem_word_t);
+    }
+    // Find the first different byte.
+    for (; n; --n, ++s1, ++s2) {
+        if (*s1 != *s2) {
+            return *s1 - *s2;
+        }
     }
-
-    return *((unsigned char *)dst) - *((unsigned char *)src);
+    return 0;
 }
 
 void *memcpy(void *dst, const void *src, size_t num)
 {
-    // Turn the pointer into a char * pointer. Here, we use the volatile keyword
-    // to prevent the compiler from optimizing away the operations involving the
-    // pointer.
-    unsigned char volatile *_dst       = (unsigned char volatile *)dst;
-    const unsigned char volatile *_src = (const unsigned char volatile *)src;
-    // Initialize the content of the memory.
-    while (num--) *_dst++ = *_src++;
-    // Return the pointer.
-    return (void *)dst;
+    __memcpy_forward(dst, src, num);
+    return dst;
 }
 
 void *memccpy(void *dst, const void *src, int c, size_t n)
@@ -489,7 +566,18 @@ char *strcpy(char *dst, const char *src)
 size_t strlen(const char *s)
 {
     const char *it = s;
-    for (; *it; it++);
+    // Reach a word boundary.
+    for (; !__word_aligned(it); it++) {
+        if (!*it) {
+            return (size_t)(it - s);
+        }
+    }
+    // Skip the words without the terminator.
+    const mem_word_t *word = (const mem_word_t *)it;
+    while (!__word_has_zero(*word)) {
+        ++word;
+    }
+    for (it = (const char *)word; *it; it++) {}
     return (size_t)(it - s);
 }
 
@@ -501,6 +589,20 @@ size_t strnlen(const char *s, size_t count)
 
 int strcmp(const char *s1, const char *s2)
 {
+    // Strings with the same alignment are compared a word at a time, until
+    // the words differ or one contains the terminator.
+    if (((unsigned long)s1 & (sizeof(mem_word_t) - 1)) == ((unsigned long)s2 & (sizeof(mem_word_t) - 1))) {
+        for (; !__word_aligned(s1); s1++, s2++) {
+            if (!*s1 || (*s1 != *s2)) {
+                return *s1 - *s2;
+            }
+        }
+        const mem_word_t *w1 = (const mem_word_t *)s1, *w2 = (const mem_word_t *)s2;
+        while ((*w1 == *w2) && !__word_has_zero(*w1)) {
+            ++w1, ++w2;
+        }
+        s1 = (const char *)w1, s2 = (const char *)w2;
+    }
     while (*s1 && *s2) {
         if (*s1 < *s2) break;
         if (*s1 > *s2) break;
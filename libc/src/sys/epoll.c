@@ -0,0 +1,17 @@
+/// @file epoll.c
+/// @brief Scalable notification of the events on a set of file descriptors.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include "sys/epoll.h"
+#include "sys/errno.h"
+#include "sys/unistd.h"
+#include "system/syscall_types.h"
+
+_syscall1(int, epoll_create, int, size)
+
+_syscall1(int, epoll_create1, int, flags)
+
+_syscall4(int, epoll_ctl, int, epfd, int, op, int, fd, struct epoll_event *, event)
+
+_syscall4(int, epoll_wait, int, epfd, struct epoll_event *, events, int, maxevents, int, timeout)
@@ -0,0 +1,80 @@
+/// @file futex.c
+/// @brief Fast userspace locks, which enter the kernel only to sleep.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include "sys/futex.h"
+#include "limits.h"
+#include "sys/errno.h"
+#include "system/syscall_types.h"
+
+_syscall5(int, futex, int *, uaddr, int, op, int, val, const struct timespec *, timeout, int *, uaddr2)
+
+void futex_mutex_init(futex_mutex_t *mutex)
+{
+    mutex->state = 0;
+}
+
+void futex_mutex_lock(futex_mutex_t *mutex)
+{
+    // Fast path, the lock is free.
+    int state = __sync_val_compare_and_swap(&mutex->state, 0, 1);
+    if (state == 0) {
+        return;
+    }
+    // Tell the owner that we sleep, unless it already knows, and sleep until
+    // we find the lock free.
+    if (state != 2) {
+        state = __sync_lock_test_and_set(&mutex->state, 2);
+    }
+    while (state != 0) {
+        futex((int *)&mutex->state, FUTEX_WAIT, 2, NULL, NULL);
+        state = __sync_lock_test_and_set(&mutex->state, 2);
+    }
+}
+
+int futex_mutex_trylock(futex_mutex_t *mutex)
+{
+    return __sync_val_compare_and_swap(&mutex->state, 0, 1) == 0;
+}
+
+void futex_mutex_unlock(futex_mutex_t *mutex)
+{
+    // Nobody sleeps on it, unless it was marked as contended.
+    if (__sync_fetch_and_sub(&mutex->state, 1) != 1) {
+        mutex->state = 0;
+        futex((int *)&mutex->state, FUTEX_WAKE, 1, NULL, NULL);
+    }
+}
+
+void futex_cond_init(futex_cond_t *cond)
+{
+    cond->seq = 0;
+}
+
+void futex_cond_wait(futex_cond_t *cond, futex_mutex_t *mutex)
+{
+    // A signal issued after we release the lock changes the sequence, and we
+    // do not sleep.
+    int seq = cond->seq;
+    futex_mutex_unlock(mutex);
+    futex((int *)&cond->seq, FUTEX_WAIT, seq, NULL, NULL);
+    // We might have been moved on the lock, with others, thus mark it as
+    // contended when we take it.
+    while (__sync_lock_test_and_set(&mutex->state, 2) != 0) {
+        futex((int *)&mutex->state, FUTEX_WAIT, 2, NULL, NULL);
+    }
+}
+
+void futex_cond_signal(futex_cond_t *cond)
+{
+    __sync_fetch_and_add(&cond->seq, 1);
+    futex((int *)&cond->seq, FUTEX_WAKE, 1, NULL, NULL);
+}
+
+void futex_cond_broadcast(futex_cond_t *cond, futex_mutex_t *mutex)
+{
+    __sync_fetch_and_add(&cond->seq, 1);
+    // Wake up one, the others sleep on the lock until it is released.
+    futex((int *)&cond->seq, FUTEX_REQUEUE, 1, (const struct timespec *)INT_MAX, (int *)&mutex->state);
+}
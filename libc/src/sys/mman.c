@@ -5,10 +5,66 @@
 /// See LICENSE.md for details.
 
 #include "sys/mman.h"
+#include "fcntl.h"
+#include "limits.h"
+#include "stdio.h"
+#include "string.h"
 #include "sys/errno.h"
 #include "sys/unistd.h"
 #include "system/syscall_types.h"
 
+/// The directory where tmpfs keeps the POSIX shared memory objects.
+#define SHM_DIR "/dev/shm"
+
 _syscall6(void *, mmap, void *, addr, size_t, length, int, prot, int, flags, int, fd, off_t, offset)
 
 _syscall2(int, munmap, void *, addr, size_t, length)
+
+_syscall3(int, madvise, void *, addr, size_t, length, int, advice)
+
+_syscall2(int, mlock, const void *, addr, size_t, length)
+
+_syscall2(int, munlock, const void *, addr, size_t, length)
+
+_syscall1(int, mlockall, int, flags)
+
+_syscall0(int, munlockall)
+
+_syscall2(int, memfd_create, const char *, name, unsigned int, flags)
+
+/// @brief Builds the path of a POSIX shared memory object.
+/// @param name The name of the object.
+/// @param path Where the path is stored, PATH_MAX bytes long.
+/// @return 0 on success, -1 if the name is not valid and errno is set.
+static inline int __shm_path(const char *name, char *path)
+{
+    // The name is a slash, followed by a name without slashes.
+    if ((name == NULL) || (*name != '/') || (name[1] == 0) || strchr(name + 1, '/')) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (strlen(name + 1) > NAME_MAX) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    snprintf(path, PATH_MAX, SHM_DIR "%s", name);
+    return 0;
+}
+
+int shm_open(const char *name, int oflag, mode_t mode)
+{
+    char path[PATH_MAX];
+    if (__shm_path(name, path) < 0) {
+        return -1;
+    }
+    return open(path, oflag | O_CLOEXEC, mode);
+}
+
+int shm_unlink(const char *name)
+{
+    char path[PATH_MAX];
+    if (__shm_path(name, path) < 0) {
+        return -1;
+    }
+    return unlink(path);
+}
@@ -0,0 +1,10 @@
+/// @file mount.c
+/// @brief Mounting of filesystems.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include "sys/mount.h"
+#include "sys/errno.h"
+#include "system/syscall_types.h"
+
+_syscall5(int, mount, const char *, source, const char *, target, const char *, filesystemtype, unsigned long, mountflags, const void *, data)
@@ -0,0 +1,20 @@
+/// @file prctl.c
+/// @brief Operations on the calling process.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include "sys/prctl.h"
+#include "stdarg.h"
+#include "sys/errno.h"
+#include "system/syscall_types.h"
+
+int prctl(int option, ...)
+{
+    long __res;
+    va_list args;
+    va_start(args, option);
+    unsigned long arg2 = va_arg(args, unsigned long);
+    va_end(args);
+    __inline_syscall2(__res, prctl, option, arg2);
+    __syscall_return(int, __res);
+}
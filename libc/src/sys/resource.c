@@ -0,0 +1,11 @@
+/// @file resource.c
+/// @brief Resources used by the processes.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include "sys/resource.h"
+#include "sys/errno.h"
+#include "sys/unistd.h"
+#include "system/syscall_types.h"
+
+_syscall2(int, getrusage, int, who, struct rusage *, usage)
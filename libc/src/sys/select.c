@@ -0,0 +1,14 @@
+/// @file select.c
+/// @brief Waiting for a set of file descriptors to be ready.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include "poll.h"
+#include "sys/errno.h"
+#include "sys/select.h"
+#include "sys/unistd.h"
+#include "system/syscall_types.h"
+
+_syscall3(int, poll, struct pollfd *, fds, nfds_t, nfds, int, timeout)
+
+_syscall5(int, select, int, nfds, fd_set *, readfds, fd_set *, writefds, fd_set *, exceptfds, timeval *, timeout)
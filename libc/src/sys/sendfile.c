@@ -0,0 +1,11 @@
+/// @file sendfile.c
+/// @brief Transfer of data between file descriptors.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include "sys/sendfile.h"
+#include "sys/errno.h"
+#include "sys/unistd.h"
+#include "system/syscall_types.h"
+
+_syscall4(ssize_t, sendfile, int, out_fd, int, in_fd, off_t *, offset, size_t, count)
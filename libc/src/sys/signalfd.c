@@ -0,0 +1,11 @@
+/// @file signalfd.c
+/// @brief Signals received by reading a file descriptor.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include "sys/signalfd.h"
+#include "sys/errno.h"
+#include "sys/unistd.h"
+#include "system/syscall_types.h"
+
+_syscall3(int, signalfd, int, fd, const sigset_t *, mask, int, flags)
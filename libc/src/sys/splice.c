@@ -0,0 +1,13 @@
+/// @file splice.c
+/// @brief Transfer of data between pipes and files, inside the kernel.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include "sys/splice.h"
+#include "sys/errno.h"
+#include "sys/unistd.h"
+#include "system/syscall_types.h"
+
+_syscall6(ssize_t, splice, int, fd_in, off_t *, off_in, int, fd_out, off_t *, off_out, size_t, len, unsigned int, flags)
+
+_syscall4(ssize_t, tee, int, fd_in, int, fd_out, size_t, len, unsigned int, flags)
@@ -0,0 +1,12 @@
+/// @file swap.c
+/// @brief Enabling and disabling the swap areas.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include "sys/swap.h"
+#include "sys/errno.h"
+#include "system/syscall_types.h"
+
+_syscall2(int, swapon, const char *, path, int, swapflags)
+
+_syscall1(int, swapoff, const char *, path)
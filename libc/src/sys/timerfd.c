@@ -0,0 +1,15 @@
+/// @file timerfd.c
+/// @brief Timers whose expirations are read from a file descriptor.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include "sys/timerfd.h"
+#include "sys/errno.h"
+#include "sys/unistd.h"
+#include "system/syscall_types.h"
+
+_syscall2(int, timerfd_create, clockid_t, clockid, int, flags)
+
+_syscall4(int, timerfd_settime, int, fd, int, flags, const itimerspec *, new_value, itimerspec *, old_value)
+
+_syscall2(int, timerfd_gettime, int, fd, itimerspec *, curr_value)
@@ -0,0 +1,13 @@
+/// @file uio.c
+/// @brief Vectored input/output operations.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include "sys/uio.h"
+#include "sys/errno.h"
+#include "sys/unistd.h"
+#include "system/syscall_types.h"
+
+_syscall3(ssize_t, readv, int, fd, const struct iovec *, iov, int, iovcnt)
+
+_syscall3(ssize_t, writev, int, fd, const struct iovec *, iov, int, iovcnt)
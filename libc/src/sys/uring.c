@@ -0,0 +1,53 @@
+/// @file uring.c
+/// @brief Rings of system calls, submitted in batches.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include "sys/uring.h"
+#include "sys/errno.h"
+#include "system/syscall_types.h"
+
+/// @brief Prevents the compiler from moving the accesses to the ring across it,
+/// the CPU keeps the stores in order on its own.
+#define __uring_barrier() __asm__ __volatile__("" ::: "memory")
+
+uring_t *uring_setup(unsigned int entries)
+{
+    long __res;
+    __inline_syscall1(__res, uring_setup, entries);
+    if ((unsigned int)(__res) >= (unsigned int)(-125)) {
+        errno = -__res;
+        return NULL;
+    }
+    return (uring_t *)__res;
+}
+
+_syscall1(int, uring_enter, uring_t *, ring)
+
+uring_sqe_t *uring_get_sqe(uring_t *ring)
+{
+    if (ring->sq_tail - ring->sq_head >= ring->entries) {
+        return NULL;
+    }
+    return &URING_SQES(ring)[ring->sq_tail & (ring->entries - 1)];
+}
+
+void uring_submit(uring_t *ring)
+{
+    // The entry must be written before the kernel can see it.
+    __uring_barrier();
+    ++ring->sq_tail;
+}
+
+int uring_peek_cqe(uring_t *ring, uring_cqe_t *cqe)
+{
+    if (ring->cq_head == ring->cq_tail) {
+        return 0;
+    }
+    __uring_barrier();
+    *cqe = URING_CQES(ring)[ring->cq_head & (ring->entries - 1)];
+    // The entry must be read before the kernel can reuse it.
+    __uring_barrier();
+    ++ring->cq_head;
+    return 1;
+}
@@ -0,0 +1,88 @@
+/// @file vdso.c
+/// @brief Access to the page the kernel maps in every process.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include "sys/vdso.h"
+#include "stddef.h"
+#include "stdint.h"
+#include "time.h"
+
+/// The bit of the features reported by cpuid, in edx, telling that the CPU
+/// supports SYSENTER and SYSEXIT.
+#define CPUID_EDX_SEP (1U << 11U)
+
+/// Nanoseconds in a second.
+#define NSEC_PER_SEC 1000000000U
+
+/// The TSC cycles after which the clock of the kernel is considered stale,
+/// they would take seconds, while it is updated at every tick.
+#define VDSO_MAX_CYCLES (1ULL << 31U)
+
+/// @brief Enters the kernel with the software interrupt, which every CPU has.
+extern void __syscall_int80(void);
+
+__asm__(".globl __syscall_int80\n"
+        ".type __syscall_int80, @function\n"
+        "__syscall_int80:\n"
+        "    int $0x80\n"
+        "    ret\n"
+        ".size __syscall_int80, .-__syscall_int80\n");
+
+void (*__syscall_entry)(void) = __syscall_int80;
+
+void __vdso_init(void)
+{
+    uint32_t eax = 1, ebx, ecx = 0, edx;
+    __asm__ __volatile__("cpuid"
+                         : "+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx));
+    if (!(edx & CPUID_EDX_SEP)) {
+        return;
+    }
+    // The first Pentium Pro report the feature, without supporting it.
+    uint32_t family = (eax >> 8U) & 0xFU, model = (eax >> 4U) & 0xFU, stepping = eax & 0xFU;
+    if ((family == 6) && (model < 3) && (stepping < 3)) {
+        return;
+    }
+    __syscall_entry = (void (*)(void))(VDSO_ADDRESS + VDSO_SYSCALL_OFFSET);
+}
+
+int __vdso_uptime(struct timespec *uptime, unsigned int *boot_time)
+{
+    const volatile vdso_data_t *data = (const volatile vdso_data_t *)(VDSO_ADDRESS + VDSO_DATA_OFFSET);
+    unsigned int seq, sec, nsec, boot, mult, shift;
+    unsigned long long tsc, now, delta;
+    do {
+        // Wait for the kernel to finish the update.
+        while ((seq = data->seq) & 1U) {
+            __asm__ __volatile__("pause");
+        }
+        if (seq == 0) {
+            return -1;
+        }
+        sec   = data->uptime_sec;
+        nsec  = data->uptime_nsec;
+        boot  = data->boot_time;
+        tsc   = data->tsc;
+        mult  = data->tsc_mult;
+        shift = data->tsc_shift;
+        __asm__ __volatile__("rdtsc"
+                             : "=A"(now));
+        // Read again if the kernel updated the data meanwhile.
+    } while (data->seq != seq);
+    // Add the time passed since the update, if the clock uses the TSC.
+    if (mult && ((delta = now - tsc) < VDSO_MAX_CYCLES)) {
+        unsigned long long ns = nsec + ((delta * mult) >> shift);
+        while (ns >= NSEC_PER_SEC) {
+            ns -= NSEC_PER_SEC;
+            ++sec;
+        }
+        nsec = (unsigned int)ns;
+    }
+    uptime->tv_sec  = sec;
+    uptime->tv_nsec = (long)nsec;
+    if (boot_time) {
+        *boot_time = boot;
+    }
+    return 0;
+}
@@ -7,6 +7,7 @@
 #include "stdio.h"
 #include "string.h"
 #include "sys/errno.h"
+#include "sys/vdso.h"
 #include "system/syscall_types.h"
 
 /// @brief List of week days name.
@@ -20,10 +21,61 @@ static const char *months[] = {
     "July", "August", "September", "October", "November", "December"
 };
 
-/// @brief Time function.
-_syscall1(time_t, time, time_t *, t)
+time_t time(time_t *t)
+{
+    timespec uptime;
+    unsigned int boot_time;
+    long __res;
+    // Read the clock of the vDSO, and ask the kernel only if it is not there.
+    if (__vdso_uptime(&uptime, &boot_time) == 0) {
+        __res = (long)(boot_time + uptime.tv_sec);
+        if (t) {
+            *t = (time_t)__res;
+        }
+        return (time_t)__res;
+    }
+    __inline_syscall1(__res, time, t);
+    __syscall_return(time_t, __res);
+}
+
+int gettimeofday(timeval *tv, void *tz)
+{
+    timespec uptime;
+    unsigned int boot_time;
+    (void)tz;
+    if (tv == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (__vdso_uptime(&uptime, &boot_time) < 0) {
+        errno = ENOSYS;
+        return -1;
+    }
+    tv->tv_sec  = boot_time + uptime.tv_sec;
+    tv->tv_usec = (time_t)uptime.tv_nsec / 1000U;
+    return 0;
+}
+
+int clock_gettime(clockid_t clockid, timespec *tp)
+{
+    timespec uptime;
+    unsigned int boot_time;
+    long __res;
+    if ((tp == NULL) || ((clockid != CLOCK_REALTIME) && (clockid != CLOCK_MONOTONIC))) {
+        errno = (tp == NULL) ? EFAULT : EINVAL;
+        return -1;
+    }
+    // Read the clock of the vDSO, and ask the kernel only if it is not there.
+    if (__vdso_uptime(&uptime, &boot_time) == 0) {
+        tp->tv_sec  = uptime.tv_sec + ((clockid == CLOCK_REALTIME) ? boot_time : 0);
+        tp->tv_nsec = uptime.tv_nsec;
+        return 0;
+    }
+    __inline_syscall2(__res, clock_gettime, clockid, tp);
+    __syscall_return(int, __res);
+}
 
-    time_t difftime(time_t time1, time_t time2)
+time_t difftime(time_t time1, time_t time2)
 {
     return time1 - time2;
 }
@@ -386,7 +438,8 @@ _syscall2(int, nanosleep, const timespec *, req, timespec *, rem)
     unsigned int sleep(unsigned int seconds)
 {
     timespec req, rem;
-    req.tv_sec = seconds;
+    req.tv_sec  = seconds;
+    req.tv_nsec = 0;
     // Call the nanosleep.
     int __ret = nanosleep(&req, &rem);
     // If the call to the nanosleep is interrupted by a signal handler,
@@ -8,3 +8,5 @@
 #include "sys/errno.h"
 
 _syscall1(int, dup, int, fd)
+
+_syscall2(int, dup2, int, oldfd, int, newfd)
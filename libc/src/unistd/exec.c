@@ -6,7 +6,9 @@
 #include "sys/unistd.h"
 #include "fcntl.h"
 #include "io/debug.h"
+#include "spawn.h"
 #include "stdarg.h"
+#include "stdio.h"
 #include "stdlib.h"
 #include "string.h"
 #include "sys/errno.h"
@@ -61,6 +63,8 @@ static inline int __find_in_path(const char *file, char *buf, size_t buf_len)
 int execve(const char *path, char *const argv[], char *const envp[])
 {
     long __res;
+    // The new image starts with empty buffers, write what is left.
+    fflush(NULL);
     __inline_syscall3(__res, execve, path, argv, envp);
     __syscall_return(int, __res);
 }
@@ -94,6 +98,24 @@ int execvpe(const char *file, char *const argv[], char *const envp[])
     return -1;
 }
 
+int posix_spawnp(pid_t *pid, const char *file, const posix_spawn_file_actions_t *file_actions,
+                 const posix_spawnattr_t *attrp, char *const argv[], char *const envp[])
+{
+    if (!file || !argv || !envp) {
+        return ENOENT;
+    }
+    if (strchr(file, '/')) {
+        return posix_spawn(pid, file, file_actions, attrp, argv, envp);
+    }
+    // Prepare a buffer for the absolute path.
+    char absolute_path[PATH_MAX];
+    // Find the file inside the entries of the PATH variable.
+    if (__find_in_path(file, absolute_path, PATH_MAX) == 0) {
+        return posix_spawn(pid, absolute_path, file_actions, attrp, argv, envp);
+    }
+    return ENOENT;
+}
+
 int execl(const char *path, const char *arg, ...)
 {
     va_list ap;
@@ -4,11 +4,14 @@
 /// See LICENSE.md for details.
 
 #include "sys/unistd.h"
+#include "stdio.h"
 #include "system/syscall_types.h"
 
 void exit(int status)
 {
     long __res;
+    // Write the output still buffered by the streams.
+    fflush(NULL);
     __inline_syscall1(__res, exit, status);
     // The process never returns from this system call!
 }
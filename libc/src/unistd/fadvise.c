@@ -0,0 +1,19 @@
+/// @file fadvise.c
+/// @brief Advice on the use of the file data.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include "fcntl.h"
+#include "sys/errno.h"
+#include "system/syscall_types.h"
+
+int posix_fadvise(int fd, off_t offset, off_t len, int advice)
+{
+    long __res;
+    __inline_syscall4(__res, fadvise64, fd, offset, len, advice);
+    // Unlike the other system calls, the error is returned and errno is left untouched.
+    if ((unsigned int)(__res) >= (unsigned int)(-125)) {
+        return -__res;
+    }
+    return 0;
+}
@@ -5,6 +5,14 @@
 
 #include "sys/unistd.h"
 #include "sys/errno.h"
+#include "stdio.h"
 #include "system/syscall_types.h"
 
-_syscall0(pid_t, fork)
+pid_t fork(void)
+{
+    long __res;
+    // Otherwise, the output still buffered would be written by both processes.
+    fflush(NULL);
+    __inline_syscall0(__res, fork);
+    __syscall_return(pid_t, __res);
+}
@@ -0,0 +1,22 @@
+/// @file pipe.c
+/// @brief
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include "sys/unistd.h"
+#include "system/syscall_types.h"
+#include "sys/errno.h"
+
+int pipe(int fds[2])
+{
+    long __res;
+    __inline_syscall1(__res, pipe, fds);
+    __syscall_return(int, __res);
+}
+
+int pipe2(int fds[2], int flags)
+{
+    long __res;
+    __inline_syscall2(__res, pipe2, fds, flags);
+    __syscall_return(int, __res);
+}
@@ -0,0 +1,10 @@
+/// @file pwrite.c
+/// @brief
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include "sys/unistd.h"
+#include "sys/errno.h"
+#include "system/syscall_types.h"
+
+_syscall4(ssize_t, pwrite, int, fd, const void *, buf, size_t, nbytes, off_t, offset)
@@ -12,3 +12,10 @@
 _syscall2(int, stat, const char *, path, stat_t *, buf)
 
 _syscall2(int, fstat, int, fd, stat_t *, buf)
+
+_syscall5(int, statx, int, dirfd, const char *, path, int, flags, unsigned int, mask, stat_t *, buf)
+
+int fstatat(int dirfd, const char *path, stat_t *buf, int flags)
+{
+    return statx(dirfd, path, flags, STATX_BASIC_STATS, buf);
+}
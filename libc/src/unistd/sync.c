@@ -0,0 +1,17 @@
+/// @file sync.c
+/// @brief Functions used to write back the modified filesystem data.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include "sys/unistd.h"
+#include "sys/errno.h"
+#include "system/syscall_types.h"
+
+void sync(void)
+{
+    long __res;
+    __inline_syscall0(__res, sync);
+    (void)__res;
+}
+
+_syscall1(int, fsync, int, fd)
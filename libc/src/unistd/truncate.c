@@ -0,0 +1,12 @@
+/// @file truncate.c
+/// @brief Functions used to change the size of a file.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include "sys/unistd.h"
+#include "sys/errno.h"
+#include "system/syscall_types.h"
+
+_syscall2(int, truncate, const char *, path, off_t, length)
+
+_syscall2(int, ftruncate, int, fd, off_t, length)
@@ -0,0 +1,45 @@
+/// @file vfork.c
+/// @brief
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include "sys/unistd.h"
+#include "sys/errno.h"
+#include "system/syscall_types.h"
+
+/// @brief Turns its argument into a string, after expanding it.
+#define __VFORK_STR(x) __VFORK_STR2(x)
+/// @brief Turns its argument into a string.
+#define __VFORK_STR2(x) #x
+
+/// @brief Sets errno with the error returned by the system call.
+/// @param error the error returned by the kernel, negated.
+/// @return always -1.
+__attribute__((used)) static pid_t __vfork_error(int error)
+{
+    errno = error;
+    return -1;
+}
+
+// The child runs on the stack of the parent until it calls execve or exit, and
+// overwrites whatever lies below the frame of the caller of vfork. Thus, vfork
+// must not keep anything on the stack across the system call: the return
+// address is popped inside a register, which is restored for both processes,
+// and pushed back by each of them once the system call returns.
+__asm__(".globl vfork\n"
+        ".type vfork, @function\n"
+        "vfork:\n"
+        "    popl %ecx\n"
+        "    movl $" __VFORK_STR(__NR_vfork) ", %eax\n"
+        "    int $0x80\n"
+        "    pushl %ecx\n"
+        "    cmpl $-125, %eax\n"
+        "    jae 1f\n"
+        "    ret\n"
+        "1:\n"
+        "    negl %eax\n"
+        "    pushl %eax\n"
+        "    call __vfork_error\n"
+        "    addl $4, %esp\n"
+        "    ret\n"
+        ".size vfork, .-vfork\n");
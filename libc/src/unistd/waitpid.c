@@ -6,28 +6,34 @@
 #include "sys/unistd.h"
 #include "sys/errno.h"
 #include "sys/wait.h"
-#include "system/syscall_types.h"
-
-#include "sys/errno.h"
-#include "sys/unistd.h"
+#include "sys/resource.h"
 #include "system/syscall_types.h"
 
 pid_t waitpid(pid_t pid, int *status, int options)
 {
     pid_t __res;
     int __status = 0;
-    do {
-        __inline_syscall3(__res, waitpid, pid, &__status, options);
-        if (__res != 0) {
-            break;
+    // The kernel puts us to sleep until a child exits, unless WNOHANG is set.
+    __inline_syscall3(__res, waitpid, pid, &__status, options);
+    if (status && (__res > 0)) {
+        *status = __status;
+    }
+    __syscall_return(pid_t, __res);
+}
+
+pid_t wait4(pid_t pid, int *status, int options, struct rusage *rusage)
+{
+    pid_t __res;
+    int __status = 0;
+    struct rusage __rusage;
+    __inline_syscall4(__res, wait4, pid, &__status, options, rusage ? &__rusage : NULL);
+    if (__res > 0) {
+        if (status) {
+            *status = __status;
         }
-        if (options && WNOHANG) {
-            break;
+        if (rusage) {
+            *rusage = __rusage;
         }
-    } while (1);
-
-    if (status) {
-        *status = __status;
     }
     __syscall_return(pid_t, __res);
 }
@@ -109,18 +109,18 @@ static int __vsscanf(const char *buf, const char *s, va_list ap)
     return (count);
 }
 
-/// @brief Read formatted data from file.
-/// @param fd the file descriptor associated with the file.
+/// @brief Read formatted data from a line of a stream.
+/// @param stream the stream.
 /// @param fmt format string, following the same specifications as printf.
 /// @param ap the list of arguments where the values are stored.
 /// @return On success, the function returns the number of items of the
 ///         argument list successfully filled. EOF otherwise.
-static int __vfscanf(int fd, const char *fmt, va_list ap)
+static int __vfscanf(FILE *stream, const char *fmt, va_list ap)
 {
     int count;
     char buf[BUFSIZ + 1];
 
-    if (fgets(buf, BUFSIZ, fd) == 0) {
+    if (fgets(buf, BUFSIZ, stream) == 0) {
         return (-1);
     }
     count = __vsscanf(buf, fmt, ap);
@@ -133,18 +133,18 @@ int scanf(const char *fmt, ...)
     va_list ap;
 
     va_start(ap, fmt);
-    count = __vfscanf(STDIN_FILENO, fmt, ap);
+    count = __vfscanf(stdin, fmt, ap);
     va_end(ap);
     return (count);
 }
 
-int fscanf(int fd, const char *fmt, ...)
+int fscanf(FILE *stream, const char *fmt, ...)
 {
     int count;
     va_list ap;
 
     va_start(ap, fmt);
-    count = __vfscanf(fd, fmt, ap);
+    count = __vfscanf(stream, fmt, ap);
     va_end(ap);
     return (count);
 }
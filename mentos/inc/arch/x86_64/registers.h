@@ -0,0 +1,80 @@
+/// @file registers.h
+/// @brief Registers of the CPU in long mode.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#pragma once
+
+#include "stdint.h"
+
+/// @defgroup x86_64_msr Model-specific registers of long mode.
+/// @{
+#define MSR_EFER           0xC0000080 ///< Extended features.
+#define MSR_STAR           0xC0000081 ///< Segments of syscall and sysret.
+#define MSR_LSTAR          0xC0000082 ///< Entry point of syscall.
+#define MSR_FMASK          0xC0000084 ///< RFLAGS cleared by syscall.
+#define MSR_FS_BASE        0xC0000100 ///< Base of FS.
+#define MSR_GS_BASE        0xC0000101 ///< Base of GS.
+#define MSR_KERNEL_GS_BASE 0xC0000102 ///< Base of GS swapped in by swapgs.
+/// @}
+
+/// @defgroup x86_64_efer Bits of the EFER register.
+/// @{
+#define EFER_SCE (1U << 0)  ///< System call extensions.
+#define EFER_LME (1U << 8)  ///< Long mode enable.
+#define EFER_LMA (1U << 10) ///< Long mode active.
+#define EFER_NXE (1U << 11) ///< No-execute enable.
+/// @}
+
+/// @brief Interrupt stack frame in long mode.
+/// @details
+/// The CPU always pushes ss and rsp, also without a change of privilege, so
+/// the frame has the same layout for the kernel and for the programs. The
+/// entry code pushes the error code when the CPU does not, then the number of
+/// the interrupt and the general purpose registers.
+typedef struct pt_regs {
+    /// General purpose register.
+    unsigned long r15;
+    /// General purpose register.
+    unsigned long r14;
+    /// General purpose register.
+    unsigned long r13;
+    /// General purpose register.
+    unsigned long r12;
+    /// Base pointer register.
+    unsigned long rbp;
+    /// Base register.
+    unsigned long rbx;
+    /// General purpose register.
+    unsigned long r11;
+    /// General purpose register.
+    unsigned long r10;
+    /// Fifth argument of the System V ABI.
+    unsigned long r9;
+    /// Sixth argument of the System V ABI.
+    unsigned long r8;
+    /// Accumulator register, and number of the system call.
+    unsigned long rax;
+    /// Counter register, the return address after syscall.
+    unsigned long rcx;
+    /// Data register, third argument.
+    unsigned long rdx;
+    /// Source register, second argument.
+    unsigned long rsi;
+    /// Destination register, first argument.
+    unsigned long rdi;
+    /// Interrupt number.
+    unsigned long int_no;
+    /// Error code.
+    unsigned long err_code;
+    /// Instruction Pointer Register.
+    unsigned long rip;
+    /// Code Segment.
+    unsigned long cs;
+    /// 64-bit flag register.
+    unsigned long rflags;
+    /// Stack pointer at the time of the interrupt.
+    unsigned long rsp;
+    /// Stack Segment.
+    unsigned long ss;
+} pt_regs;
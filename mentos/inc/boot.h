@@ -78,4 +78,8 @@ typedef struct boot_info_t {
 
     /// stack suggested start address (also set by the bootloader)
     unsigned int stack_base;
+
+    /// physical address of the ELF image of the kernel, with its symbol
+    /// table, valid until paging is initialized
+    unsigned int kernel_elf_phy;
 } boot_info_t;
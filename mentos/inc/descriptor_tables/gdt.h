@@ -120,6 +120,13 @@ typedef struct gdt_descriptor_t {
     uint8_t base_high;
 } __attribute__((packed)) gdt_descriptor_t;
 
+/// @brief Index of the TSS of the first CPU, the one of each CPU follows.
+#define GDT_TSS_INDEX 5
+
+/// @brief Number of segments for the thread-local storage of user threads,
+/// which follow the TSSs.
+#define GDT_TLS_ENTRIES 64
+
 /// @brief Data structure used to load the GDT into the GDTR.
 typedef struct gdt_pointer_t {
     /// The size of the GDT (entry number).
@@ -136,6 +143,10 @@ typedef struct gdt_pointer_t {
 ///          new segment registers.
 void init_gdt(void);
 
+/// @brief Loads the GDT, and the TSS of the given CPU, on the calling CPU.
+/// @param cpu the index of the calling CPU.
+void gdt_load(unsigned cpu);
+
 /// @brief          Sets the value of one GDT entry.
 /// @param index    The index inside the GDT.
 /// @param base     Memory address where the segment we are defining starts.
@@ -144,5 +155,15 @@ void init_gdt(void);
 /// @param granul  SegLimit_hi(4 bit) AVL(1 bit) L(1 bit) D/B(1 bit) G(1bit).
 void gdt_set_gate(uint8_t index, uint32_t base, uint32_t limit, uint8_t access, uint8_t granul);
 
+/// @brief Allocates a user data segment, which a thread uses to reach its
+/// thread-local storage through gs.
+/// @param base where the segment starts.
+/// @return the selector of the segment, 0 if they are all in use.
+uint16_t gdt_tls_alloc(uint32_t base);
+
+/// @brief Frees a segment allocated with gdt_tls_alloc.
+/// @param selector the selector of the segment.
+void gdt_tls_free(uint16_t selector);
+
 /// @}
 /// @}
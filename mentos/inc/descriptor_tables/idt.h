@@ -68,5 +68,8 @@ typedef struct idt_pointer_t {
 /// @brief Initialise the interrupt descriptor table.
 void init_idt(void);
 
+/// @brief Loads the IDT on the calling CPU.
+void idt_load(void);
+
 /// @}
 /// @}
@@ -60,6 +60,17 @@ int irq_install_handler(unsigned i, interrupt_handler_t handler, char *descripti
 /// @return 0 on success, -1 otherwise.
 int irq_uninstall_handler(unsigned i, interrupt_handler_t handler);
 
+/// @brief Allocates a vector for a message signalled interrupt (MSI), which
+/// devices deliver straight to the local APIC, bypassing the PIC.
+/// @param handler interrupt handler.
+/// @param description interrupt description.
+/// @return the vector on success, -ENOSPC if all are in use.
+int irq_alloc_msi_vector(interrupt_handler_t handler, char *description);
+
+/// @brief Releases a vector allocated with irq_alloc_msi_vector.
+/// @param vector the vector.
+void irq_free_msi_vector(unsigned vector);
+
 /// @brief Method called by CPU to handle interrupts.
 /// @param f The interrupt stack frame.
 extern void irq_handler(pt_regs *f);
@@ -94,6 +105,9 @@ extern void isq_handler(pt_regs *f);
 #define SECURITY_EXC 30 ///< Security Exception.
 #define TRIPLE_FAULT 31 ///< Triple Fault
 #define SYSTEM_CALL  80 ///< System call interrupt.
+
+#define MSI_VECTOR_BASE 48 ///< The first vector of the message signalled interrupts.
+#define MSI_VECTOR_NUM  16 ///< The number of vectors of the message signalled interrupts.
                         //==============================================================================
 
 /// @}
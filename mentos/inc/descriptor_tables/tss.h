@@ -11,6 +11,7 @@
 
 #pragma once
 
+#include "descriptor_tables/gdt.h"
 #include "stdint.h"
 
 /// @brief Task state segment entry.
@@ -44,17 +45,23 @@ typedef struct tss_entry {
     uint16_t iomap;    ///< TODO: Comment.
 } tss_entry_t;
 
-/// @brief Flushes the Task State Segment.
-extern void tss_flush(void);
+/// @brief The selector of the TSS of a CPU.
+/// @param cpu the index of the CPU.
+#define TSS_SELECTOR(cpu) ((GDT_TSS_INDEX + (cpu)) * 8u)
+
+/// @brief Loads the Task State Segment.
+/// @param selector the selector of the TSS.
+extern void tss_flush(uint32_t selector);
 
 /// @brief We don't need tss to assist task switching, but it's required to
 ///        have one tss for switching back to kernel mode(system call for
 ///        example).
-/// @param idx Index.
+/// @param cpu The index of the CPU owning the TSS.
 /// @param ss0 Kernel data segment.
-void tss_init(uint8_t idx, uint32_t ss0);
+void tss_init(unsigned cpu, uint32_t ss0);
 
-/// @brief This function is used to set the esp the kernel should be using.
+/// @brief This function is used to set the esp the kernel should be using,
+///        on the calling CPU.
 /// @param kss  Kernel data segment.
 /// @param kesp Kernel stack address.
 void tss_set_stack(uint32_t kss, uint32_t kesp);
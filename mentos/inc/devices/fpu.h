@@ -117,13 +117,28 @@ typedef union savefpu {
     savexmm sv_xmm;
 } savefpu;
 
-/// @brief Called during a context switch to save the FPU registers status
-/// of the currently running thread.
+struct task_struct;
+struct pt_regs;
+
+/// @brief Called when entering the kernel, makes the FPU trap if it still
+/// holds the registers of a task, so that the kernel saves them before using
+/// it.
 void switch_fpu(void);
 
-/// @brief Called during a context switch to load the FPU registers status
-/// of the currently running thread inside the FPU.
-void unswitch_fpu(void);
+/// @brief Called when leaving the kernel, if it returns to user mode lets the
+/// task use the FPU right away only if it holds its registers, otherwise the
+/// FPU traps and loads them on the first FPU instruction (lazy FPU switching).
+/// @param f the registers of the context we return to.
+void unswitch_fpu(struct pt_regs *f);
+
+/// @brief Writes the FPU registers of the task in its storage, if they are
+/// loaded, so that they can be copied.
+/// @param task the task.
+void fpu_save_task(struct task_struct *task);
+
+/// @brief Drops the FPU registers of a task, which starts over, or exits.
+/// @param task the task.
+void fpu_release_task(struct task_struct *task);
 
 /// @brief Enable the FPU context handling.
 /// @return 0 if fails, 1 if succeed.
@@ -10,6 +10,7 @@
 
 #pragma once
 
+#include "descriptor_tables/isr.h"
 #include "stdint.h"
 
 /// @brief Types of PCI commands.
@@ -215,6 +216,21 @@ typedef enum {
 
 /// @}
 
+/// @name PCI Base Address fields
+/// @brief The low bits of a base address describe the region.
+/// @{
+#define PCI_BAR_IO       0x01 ///< The region is in I/O space, not in memory.
+#define PCI_BAR_TYPE_64  0x04 ///< The memory address takes this register and the next.
+#define PCI_BAR_MEM_MASK 0xFFFFFFF0u ///< The bits of a memory address.
+/// @}
+
+/// @name PCI Capabilities
+/// @brief Identifiers of the entries of the capabilities list.
+/// @{
+#define PCI_CAP_ID_MSI  0x05 ///< Message Signalled Interrupts.
+#define PCI_CAP_ID_MSIX 0x11 ///< Extended Message Signalled Interrupts.
+/// @}
+
 #define PCI_PRIMARY_BUS   0x18 ///< Primary bus number.
 #define PCI_SECONDARY_BUS 0x19 ///< Secondary bus number.
 
@@ -224,6 +240,7 @@ typedef enum {
 
 #define PCI_TYPE_BRIDGE 0x060400 ///< TODO: Document.
 #define PCI_TYPE_SATA   0x010600 ///< TODO: Document.
+#define PCI_TYPE_AHCI   0x010601 ///< SATA controller with the AHCI programming interface.
 
 #define PCI_ADDRESS_PORT 0xCF8  ///< TODO: Document.
 #define PCI_VALUE_PORT   0xCFC  ///< TODO: Document.
@@ -282,6 +299,40 @@ void pci_remap(void);
 /// @return interrupt number.
 int pci_get_interrupt(uint32_t device);
 
+/// @brief Finds an entry of the capabilities list of the given device.
+/// @param device the device.
+/// @param id the identifier of the capability (e.g., PCI_CAP_ID_MSI).
+/// @return the offset of the entry in the configuration space, 0 if the
+/// device does not have it.
+uint8_t pci_find_capability(uint32_t device, uint8_t id);
+
+/// @brief Maps the memory region described by a base address of the device.
+/// @param device the device.
+/// @param bar the index of the base address, from 0 to 5.
+/// @param size where the size of the region is stored, if not NULL.
+/// @return the virtual address of the region, NULL if the base address is
+/// unused, in I/O space, above 4GB, or cannot be mapped.
+void *pci_map_bar(uint32_t device, unsigned bar, uint32_t *size);
+
+/// @brief Unmaps a region mapped with pci_map_bar.
+/// @param address the virtual address of the region.
+void pci_unmap_bar(void *address);
+
+/// @brief Makes the device signal its interrupts with messages to the local
+/// APIC of the calling CPU, instead of the shared INTx line. MSI-X is
+/// preferred to MSI, and only its first entry is used.
+/// @param device the device.
+/// @param handler the interrupt handler.
+/// @param description the description of the handler.
+/// @return the vector of the interrupt on success, -ENODEV if the device or
+/// the CPU lack the support, -ENOSPC if there are no free vectors.
+int pci_enable_msi(uint32_t device, interrupt_handler_t handler, char *description);
+
+/// @brief Makes the device use the INTx line again, and frees the vector.
+/// @param device the device.
+/// @param vector the vector returned by pci_enable_msi.
+void pci_disable_msi(uint32_t device, int vector);
+
 /// @brief Dumps on DEBUG, the information about the given device.
 /// @param device the device.
 /// @param vendorid the ID of the vendor.
@@ -0,0 +1,41 @@
+/// @file ahci.h
+/// @brief Driver for the Serial ATA disks behind an Advanced Host Controller
+/// Interface (AHCI) controller.
+/// @details
+/// Each port of the controller has a list of 32 command slots, which the
+/// controller fetches from memory. When both the controller and the disk
+/// support Native Command Queuing (NCQ), up to 32 commands are outstanding on
+/// the same disk, which completes them in the order it prefers.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @addtogroup drivers Device Drivers
+/// @{
+/// @addtogroup ahci Advanced Host Controller Interface (AHCI)
+/// @brief Driver for the Serial ATA disks behind an AHCI controller.
+/// @{
+
+#pragma once
+
+#include "drivers/ata/ata.h"
+
+/// @brief Submits a request to an AHCI disk.
+/// @param file the VFS file associated with the disk.
+/// @param request the request, it must stay valid until it is completed. Its
+/// buffer must be in kernel memory and aligned to two bytes, and it must
+/// describe at most 256 sectors.
+/// @return 0 if the request was queued, -EINVAL if it is malformed.
+/// @details The request is started as soon as a command slot is free, its
+/// end_request is called by the bottom half of the interrupt.
+int ahci_submit_request(vfs_file_t *file, ata_request_t *request);
+
+/// @brief Initializes the AHCI driver, and the disks attached to the
+/// controller.
+/// @return 0 on success, or if there is no controller, 1 on error.
+int ahci_initialize(void);
+
+/// @brief De-initializes the AHCI driver.
+/// @return 0 on success, 1 on error.
+int ahci_finalize(void);
+
+/// @}
+/// @}
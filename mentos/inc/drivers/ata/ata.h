@@ -17,6 +17,71 @@
 
 #pragma once
 
+#include "fs/vfs_types.h"
+#include "hardware/hrtimer.h"
+#include "sys/list_head.h"
+
+/// @brief The direction of a block request.
+typedef enum {
+    ata_request_read,  ///< Moves sectors from the disk to memory.
+    ata_request_write, ///< Moves sectors from memory to the disk.
+} ata_request_dir_t;
+
+/// @brief A block I/O request submitted to the queue of an ATA device.
+typedef struct ata_request_t {
+    /// Direction of the transfer.
+    ata_request_dir_t direction;
+    /// The first sector of the transfer.
+    uint32_t lba_sector;
+    /// The number of sectors (1 to 256).
+    uint32_t count;
+    /// The buffer from which we write, or where we store what we read.
+    uint8_t *buffer;
+    /// The page frames from which we write, or where we store what we read,
+    /// used instead of the buffer when not NULL. The data starts at the offset
+    /// inside the first one, and goes on at the beginning of the next ones.
+    struct page_t **pages;
+    /// Where the data starts inside the first page frame.
+    uint32_t offset;
+    /// Completion status, 0 on success, -errno on failure.
+    int status;
+    /// Called when the request has been completed, it can be NULL. It must not
+    /// perform synchronous I/O on the same device.
+    void (*end_request)(struct ata_request_t *request);
+    /// Data owned by whoever submitted the request.
+    void *private_data;
+    /// Timer tick after which the elevator must serve the request.
+    unsigned long deadline;
+    /// When the request entered the queue, in nanoseconds.
+    ktime_t queued;
+    /// Position inside the queue of pending requests sorted by sector.
+    list_head sort_list;
+    /// Position inside the queue of pending requests sorted by submission.
+    list_head fifo_list;
+} ata_request_t;
+
+/// @brief Microseconds added to every command sent to the ATA devices, set
+/// with `ata_delay_us=` on the command line to emulate a slower disk.
+extern unsigned ata_request_delay_us;
+
+/// @brief Submits a request to the queue of the ATA device.
+/// @param file the VFS file associated with the ATA device.
+/// @param request the request, it must stay valid until it is completed.
+/// @return 0 if the request was queued, -errno on failure.
+/// @details If the queue is not plugged the request is dispatched, together
+/// with all the other pending ones, before returning.
+int ata_submit_request(vfs_file_t *file, ata_request_t *request);
+
+/// @brief Plugs the queue of the ATA device, requests submitted from now on
+/// are held back so that the elevator can sort and merge them.
+/// @param file the VFS file associated with the ATA device.
+void ata_queue_plug(vfs_file_t *file);
+
+/// @brief Unplugs the queue of the ATA device, when the last plug is removed
+/// all the pending requests are dispatched.
+/// @param file the VFS file associated with the ATA device.
+void ata_queue_unplug(vfs_file_t *file);
+
 /// @brief Initializes the ATA drivers.
 /// @return 0 on success, 1 on error.
 int ata_initialize(void);
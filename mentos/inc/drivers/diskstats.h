@@ -0,0 +1,79 @@
+/// @file diskstats.h
+/// @brief I/O statistics of the block devices.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// A block device registers its statistics, and accounts each request when
+/// it is queued and when it completes, with the time it waited inside the
+/// queue and the time it spent on the device. The devices are listed by
+/// `/proc/diskstats`, and the latency histograms of each one are in
+/// `/proc/<device>/latency`.
+
+#pragma once
+
+#include "hardware/hrtimer.h"
+#include "sys/list_head.h"
+
+/// Number of buckets of the latency histograms, the first one counts the
+/// requests completed within 2^DISK_STAT_MIN_SHIFT microseconds, each next
+/// one doubles the bound, the last one counts all the slower ones.
+#define DISK_STAT_BUCKETS 16
+/// The bound of the first bucket, as a power of two of microseconds.
+#define DISK_STAT_MIN_SHIFT 4
+
+/// @brief The direction of the accounted requests.
+typedef enum {
+    DISK_STAT_READ,  ///< Reads.
+    DISK_STAT_WRITE, ///< Writes.
+    DISK_STAT_DIRS   ///< Number of directions.
+} disk_stat_dir_t;
+
+/// @brief The statistics of a block device.
+typedef struct disk_stats_t {
+    /// The name of the device.
+    const char *name;
+    /// The requests completed.
+    unsigned long ios[DISK_STAT_DIRS];
+    /// The requests moved together with the previous one, by a single command.
+    unsigned long merges[DISK_STAT_DIRS];
+    /// The sectors moved.
+    unsigned long sectors[DISK_STAT_DIRS];
+    /// Nanoseconds the completed requests waited inside the queue.
+    ktime_t queue_ns[DISK_STAT_DIRS];
+    /// Nanoseconds the completed requests spent on the device.
+    ktime_t device_ns[DISK_STAT_DIRS];
+    /// The requests queued, and not completed yet.
+    unsigned long in_flight;
+    /// The latency of the completed requests, from queue to completion.
+    unsigned long hist[DISK_STAT_DIRS][DISK_STAT_BUCKETS];
+    /// Position inside the list of devices.
+    list_head list;
+} disk_stats_t;
+
+/// @brief Adds the statistics of a device to the list of devices.
+/// @param stats the statistics, which must live as long as the device.
+/// @param name the name of the device.
+void disk_stats_register(disk_stats_t *stats, const char *name);
+
+/// @brief Accounts a request entering the queue of the device.
+/// @param stats the statistics of the device.
+static inline void disk_stats_queued(disk_stats_t *stats)
+{
+    ++stats->in_flight;
+}
+
+/// @brief Accounts a completed request.
+/// @param stats the statistics of the device.
+/// @param dir the direction of the request.
+/// @param sectors the number of sectors moved.
+/// @param merged if it was moved together with the previous one.
+/// @param queued when the request entered the queue.
+/// @param started when the device started moving it.
+/// @param completed when the device completed it.
+void disk_stats_complete(disk_stats_t *stats, disk_stat_dir_t dir, unsigned sectors, int merged,
+                         ktime_t queued, ktime_t started, ktime_t completed);
+
+/// @brief Calls a function on the statistics of each device.
+/// @param fn the function.
+/// @param data custom data passed to the function.
+void disk_stats_for_each(void (*fn)(disk_stats_t *stats, void *data), void *data);
@@ -12,9 +12,18 @@
 
 #include "ring_buffer.h"
 #include "kernel.h"
+#include "process/wait.h"
 
 DECLARE_FIXED_SIZE_RING_BUFFER(int, scancode, 256, -1)
 
+#ifndef KEYBOARD_RING_SIZE
+/// The number of scancodes, and of decoded characters, the keyboard buffers
+/// hold (a power of two), set with the KEYBOARD_RING_SIZE cmake variable.
+#define KEYBOARD_RING_SIZE 1024
+#endif
+
+DECLARE_SPSC_RING_BUFFER(int, keyboard, KEYBOARD_RING_SIZE)
+
 /// @brief The interrupt service routine of the keyboard.
 /// @param f The interrupt stack frame.
 void keyboard_isr(pt_regs *f);
@@ -29,18 +38,39 @@ void keyboard_disable(void);
 void keyboard_update_leds(void);
 
 /// @brief Gets and removes a char from the back of the buffer.
-/// @return The extracted character.
+/// @return The extracted character, -1 if there is none.
 int keyboard_pop_back(void);
 
+/// @brief Gets and removes the oldest characters of the buffer at once.
+/// @param buffer where the characters are stored.
+/// @param count the maximum number of characters.
+/// @return The number of characters extracted.
+/// @details There must be a single consumer, the terminal.
+unsigned keyboard_drain(int *buffer, unsigned count);
+
 /// @brief Gets a char from the back of the buffer.
 /// @return The read character.
 int keyboard_back(void);
 
+/// @brief Returns the queue woken up whenever new characters are decoded.
+/// @return The queue.
+wait_queue_head_t *keyboard_get_wait_queue(void);
+
+/// @brief Queues a character received from another console device, as if it
+/// was typed, and wakes up the readers.
+/// @param c the character.
+void keyboard_push_input(int c);
+
 /// @brief Gets a char from the front of the buffer.
 /// @return The read character.
 int keyboard_front(void);
 
-/// @brief Initializes the keyboard drivers.
+/// @brief Initializes the buffers, the locks and the keymaps of the keyboard,
+/// which the terminal uses even before the keyboard is there.
+void keyboard_initialize_buffers(void);
+
+/// @brief Initializes the keyboard drivers, installing its IRQ; the buffers
+/// must have been initialized with keyboard_initialize_buffers.
 /// @return 0 on success, 1 on error.
 int keyboard_initialize(void);
 
@@ -10,9 +10,18 @@
 
 #pragma once
 
-/// @brief Initializes the memory devices.
+#include "stddef.h"
+
+/// @brief Initializes the memory devices (/dev/null, /dev/zero, /dev/full and
+/// /dev/urandom), seeding the random number generator.
 /// @return 0 on success, 1 on error.
 int mem_devs_initialize(void);
 
+/// @brief Fills a buffer with the output of the random number generator
+/// behind /dev/urandom.
+/// @param buffer the buffer.
+/// @param size the size of the buffer.
+void get_random_bytes(void *buffer, size_t size);
+
 /// @}
 /// @}
@@ -11,11 +11,13 @@
 #pragma once
 
 /* The mouse starts sending automatic packets when the mouse moves or is
- * clicked.
+ * clicked. The packets are merged into the events of sys/mouse.h, which are
+ * read from MOUSE_DEVICE: the motion is summed up until it is read, and a new
+ * event starts only when the buttons change.
  */
 #include "kernel.h"
 
-/// @brief Initializes the mouse.
+/// @brief Initializes the mouse, and creates its device.
 /// @return 0 on success, 1 on error.
 int mouse_initialize(void);
 
@@ -0,0 +1,22 @@
+/// @file ramdisk.h
+/// @brief Block devices backed by memory.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @addtogroup drivers Device Drivers
+/// @{
+/// @addtogroup ramdisk RAM disks
+/// @brief Block devices backed by memory.
+/// @{
+
+#pragma once
+
+/// @brief Creates the RAM disks /dev/ram0 to /dev/ram3.
+/// @return 0 on success, 1 on error.
+int ramdisk_initialize(void);
+
+/// @brief Removes the RAM disks.
+/// @return 0 on success, 1 on error.
+int ramdisk_finalize(void);
+
+/// @}
+/// @}
@@ -13,11 +13,18 @@
 
 #include "time.h"
 
-/// @brief Copies the global time inside the provided variable.
-/// @param time Pointer where we store the global time.
-extern void gettime(tm_t *time);
+/// @brief Returns the seconds since the Epoch at boot, the wall clock is
+/// this plus the time since boot.
+/// @return the boot time.
+time_t rtc_get_boot_time(void);
 
-/// @brief Initializes the Real Time Clock (RTC).
+/// @brief Compares the wall clock with the RTC, and corrects the boot time if
+/// they drifted apart.
+/// @details The RTC is read at most every few minutes, and only if it is not
+/// updating, never waiting for it.
+void rtc_resync(void);
+
+/// @brief Initializes the Real Time Clock (RTC), reading the date once.
 /// @return 0 on success, 1 on error.
 int rtc_initialize(void);
 
@@ -0,0 +1,58 @@
+/// @file serial.h
+/// @brief Driver for the 16550 UART serial ports.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @addtogroup drivers Device Drivers
+/// @{
+/// @addtogroup serial Serial Ports
+/// @brief Buffered, interrupt-driven serial ports.
+/// @{
+
+#pragma once
+
+#include "stddef.h"
+#include "stdint.h"
+
+/// The I/O port of the first serial port, the one of the kernel log.
+#define SERIAL_COM1 0x03F8
+/// The I/O port of the second serial port.
+#define SERIAL_COM2 0x02F8
+/// The baud rate set when the ports are initialized.
+#define SERIAL_DEFAULT_BAUD_RATE 115200
+
+/// @brief Detects the serial ports, enables their FIFOs and interrupts.
+/// @return 0 on success, 1 on failure.
+/// @details Before this call, and for the ports which are missing, the
+/// output is written synchronously.
+int serial_initialize(void);
+
+/// @brief Creates the /dev/ttyS devices of the ports found.
+/// @return 0 on success, 1 on failure.
+int serial_devices_initialize(void);
+
+/// @brief Writes a character on the first serial port.
+/// @param c the character.
+/// @details The character is queued and sent by the interrupt handler, the
+/// caller waits only when the queue is full, or the interrupts are disabled.
+void serial_putc(char c);
+
+/// @brief Writes a buffer on a serial port.
+/// @param index the index of the port, 0 for COM1.
+/// @param buffer the characters.
+/// @param size the number of characters.
+/// @return the number of characters written, -ENODEV if the port is missing.
+ssize_t serial_write(unsigned index, const char *buffer, size_t size);
+
+/// @brief Sends everything queued on a serial port, waiting on the port.
+/// @param index the index of the port, 0 for COM1.
+void serial_flush(unsigned index);
+
+/// @brief Sets the speed of a serial port.
+/// @param index the index of the port, 0 for COM1.
+/// @param baud_rate the speed, which must divide 115200.
+/// @return 0 on success, -EINVAL if the speed is not supported, -ENODEV if
+/// the port is missing.
+int serial_set_baud_rate(unsigned index, uint32_t baud_rate);
+
+/// @}
+/// @}
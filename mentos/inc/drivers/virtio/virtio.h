@@ -0,0 +1,217 @@
+/// @file virtio.h
+/// @brief Legacy PCI transport and split virtqueues of the virtio devices.
+/// @details
+/// A virtqueue is made of three rings shared with the host: the descriptors
+/// of the buffers, the available ring, where the driver publishes the chains
+/// of descriptors, and the used ring, where the device returns them. With
+/// VIRTIO_RING_F_EVENT_IDX each side tells the other at which index it wants to
+/// be notified, so that a batch of buffers costs one notification.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @addtogroup drivers Device Drivers
+/// @{
+/// @addtogroup virtio Virtual I/O devices
+/// @brief Legacy PCI transport and split virtqueues of the virtio devices.
+/// @{
+
+#pragma once
+
+#include "descriptor_tables/isr.h"
+#include "mem/zone_allocator.h"
+#include "stdbool.h"
+#include "stdint.h"
+
+#define VIRTIO_PCI_VENDOR 0x1AF4 ///< Vendor of all the virtio devices.
+
+/// @name Device status.
+/// @{
+#define VIRTIO_STATUS_ACKNOWLEDGE 1   ///< The guest has noticed the device.
+#define VIRTIO_STATUS_DRIVER      2   ///< The guest has a driver for the device.
+#define VIRTIO_STATUS_DRIVER_OK   4   ///< The driver is ready.
+#define VIRTIO_STATUS_FAILED      128 ///< The driver gave up on the device.
+/// @}
+
+/// @name Features of the rings.
+/// @{
+#define VIRTIO_RING_F_INDIRECT_DESC (1U << 28) ///< Descriptors can point to a table of descriptors.
+#define VIRTIO_RING_F_EVENT_IDX     (1U << 29) ///< Notifications are suppressed with event indices.
+/// @}
+
+/// @name Flags of the descriptors.
+/// @{
+#define VRING_DESC_F_NEXT     1 ///< The chain continues with the descriptor in next.
+#define VRING_DESC_F_WRITE    2 ///< The device writes the buffer.
+#define VRING_DESC_F_INDIRECT 4 ///< The buffer is a table of descriptors.
+/// @}
+
+#define VRING_AVAIL_F_NO_INTERRUPT 1 ///< The driver does not want interrupts.
+#define VRING_USED_F_NO_NOTIFY     1 ///< The device does not want notifications.
+
+/// @brief A descriptor of a buffer.
+typedef struct vring_desc_t {
+    uint32_t addr;    ///< Physical address of the buffer.
+    uint32_t addr_hi; ///< Physical address of the buffer, upper 32 bits.
+    uint32_t len;     ///< Length of the buffer.
+    uint16_t flags;   ///< Flags (e.g., VRING_DESC_F_NEXT).
+    uint16_t next;    ///< The next descriptor of the chain.
+} vring_desc_t;
+
+/// @brief The ring where the driver publishes the chains of descriptors.
+typedef struct vring_avail_t {
+    uint16_t flags;  ///< Flags (e.g., VRING_AVAIL_F_NO_INTERRUPT).
+    uint16_t idx;    ///< Where the driver puts the next chain.
+    uint16_t ring[]; ///< The heads of the chains, followed by used_event.
+} vring_avail_t;
+
+/// @brief An element of the used ring.
+typedef struct vring_used_elem_t {
+    uint32_t id;  ///< The head of the chain.
+    uint32_t len; ///< The bytes written by the device.
+} vring_used_elem_t;
+
+/// @brief The ring where the device returns the chains of descriptors.
+typedef struct vring_used_t {
+    uint16_t flags;                ///< Flags (e.g., VRING_USED_F_NO_NOTIFY).
+    uint16_t idx;                  ///< Where the device puts the next chain.
+    vring_used_elem_t ring[];      ///< The chains, followed by avail_event.
+} vring_used_t;
+
+/// @brief A virtio device, seen through the legacy PCI transport.
+typedef struct virtio_device_t {
+    /// The PCI address of the device.
+    uint32_t pci;
+    /// The base of the I/O ports of the device.
+    uint16_t io_base;
+    /// The offset of the configuration of the device inside the I/O ports.
+    uint16_t config;
+    /// The features both the device and the driver support.
+    uint32_t features;
+    /// The vector of the message signalled interrupts, -1 if the device uses
+    /// the INTx line.
+    int vector;
+    /// The INTx line, -1 if the device uses message signalled interrupts.
+    int irq;
+} virtio_device_t;
+
+/// @brief A segment of a buffer, for virtqueue_add.
+typedef struct virtio_sg_t {
+    uint32_t addr; ///< Physical address of the segment.
+    uint32_t len;  ///< Length of the segment.
+} virtio_sg_t;
+
+/// @brief A table of indirect descriptors owned by the caller of
+/// virtqueue_add, it must stay untouched until the buffer is used.
+typedef struct virtio_indirect_t {
+    vring_desc_t *desc; ///< The table.
+    uint32_t phys;      ///< The physical address of the table.
+    unsigned size;      ///< The number of descriptors of the table.
+} virtio_indirect_t;
+
+/// @brief A split virtqueue.
+typedef struct virtqueue_t {
+    /// The device.
+    virtio_device_t *dev;
+    /// The index of the queue.
+    uint16_t index;
+    /// The number of descriptors.
+    uint16_t size;
+    /// The descriptors.
+    vring_desc_t *desc;
+    /// The available ring.
+    vring_avail_t *avail;
+    /// The used ring.
+    vring_used_t *used;
+    /// The pages of the rings.
+    page_t *pages;
+    /// The first free descriptor, the free ones are linked through next.
+    uint16_t free_head;
+    /// The number of free descriptors.
+    uint16_t num_free;
+    /// The next element of the used ring we will look at.
+    uint16_t last_used;
+    /// The index of the available ring at the last notification.
+    uint16_t last_kick;
+    /// The token associated with each chain, indexed by its head.
+    void **tokens;
+} virtqueue_t;
+
+/// @brief Resets the device, and negotiates its features.
+/// @param dev the device, whose pci field is set.
+/// @param features the features the driver supports.
+/// @return 0 on success, -ENODEV if the device has no I/O ports.
+int virtio_pci_init(virtio_device_t *dev, uint32_t features);
+
+/// @brief Installs the interrupt handler of the device, preferring MSI-X.
+/// @param dev the device.
+/// @param handler the handler.
+/// @param description the description of the handler.
+/// @details Must be called before virtio_find_vq, since MSI-X moves the
+/// configuration of the device.
+void virtio_setup_irq(virtio_device_t *dev, interrupt_handler_t handler, char *description);
+
+/// @brief Allocates and activates a virtqueue of the device.
+/// @param dev the device.
+/// @param index the index of the queue.
+/// @return the queue, NULL on failure.
+virtqueue_t *virtio_find_vq(virtio_device_t *dev, uint16_t index);
+
+/// @brief Tells the device that the driver is ready.
+/// @param dev the device.
+void virtio_driver_ok(virtio_device_t *dev);
+
+/// @brief Reads and acknowledges the interrupt status of the device.
+/// @param dev the device.
+/// @return the status, bit 0 for the queues, bit 1 for the configuration.
+/// With MSI-X the status is always 1.
+uint8_t virtio_isr(virtio_device_t *dev);
+
+/// @brief Reads 8 bits of the configuration of the device.
+/// @param dev the device.
+/// @param offset the offset inside the configuration.
+/// @return the value.
+uint8_t virtio_config_read_8(virtio_device_t *dev, unsigned offset);
+
+/// @brief Reads 16 bits of the configuration of the device.
+/// @param dev the device.
+/// @param offset the offset inside the configuration.
+/// @return the value.
+uint16_t virtio_config_read_16(virtio_device_t *dev, unsigned offset);
+
+/// @brief Reads 32 bits of the configuration of the device.
+/// @param dev the device.
+/// @param offset the offset inside the configuration.
+/// @return the value.
+uint32_t virtio_config_read_32(virtio_device_t *dev, unsigned offset);
+
+/// @brief Publishes a buffer made of segments read by the device, followed by
+/// segments written by the device.
+/// @param vq the queue.
+/// @param sg the segments.
+/// @param out the number of segments read by the device.
+/// @param in the number of segments written by the device.
+/// @param indirect a table for the descriptors, used if the device supports
+/// it, or NULL.
+/// @param token returned by virtqueue_get_buf once the buffer is used.
+/// @return 0 on success, -ENOSPC if there are not enough free descriptors.
+/// @details The device is not notified, see virtqueue_kick.
+int virtqueue_add(virtqueue_t *vq, const virtio_sg_t *sg, unsigned out, unsigned in, virtio_indirect_t *indirect, void *token);
+
+/// @brief Notifies the device of the buffers published since the last
+/// notification, unless it asked not to be.
+/// @param vq the queue.
+void virtqueue_kick(virtqueue_t *vq);
+
+/// @brief Returns the next buffer used by the device.
+/// @param vq the queue.
+/// @param len where the bytes written by the device are stored, if not NULL.
+/// @return the token of the buffer, NULL if there are no used buffers.
+void *virtqueue_get_buf(virtqueue_t *vq, uint32_t *len);
+
+/// @brief Asks the device to interrupt us when it uses the next buffer.
+/// @param vq the queue.
+/// @return true if buffers were used in the meanwhile, so that the caller
+/// must call virtqueue_get_buf again.
+bool_t virtqueue_enable_cb(virtqueue_t *vq);
+
+/// @}
+/// @}
@@ -0,0 +1,30 @@
+/// @file virtio_blk.h
+/// @brief Driver for the virtio block devices.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @addtogroup virtio
+/// @{
+
+#pragma once
+
+#include "drivers/ata/ata.h"
+
+/// @brief Submits a request to a virtio block device.
+/// @param file the VFS file associated with the device.
+/// @param request the request, it must stay valid until it is completed. Its
+/// buffer must be in kernel memory, and it must describe at most 256 sectors.
+/// @return 0 if the request was queued, -EINVAL if it is malformed, -EROFS if
+/// it writes on a read-only device.
+/// @details Requests are published on the virtqueue as soon as there is room,
+/// their end_request is called by the bottom half of the interrupt.
+int virtio_blk_submit_request(vfs_file_t *file, ata_request_t *request);
+
+/// @brief Initializes the virtio block devices.
+/// @return 0 on success, or if there are no devices, 1 on error.
+int virtio_blk_initialize(void);
+
+/// @brief De-initializes the virtio block devices.
+/// @return 0 on success, 1 on error.
+int virtio_blk_finalize(void);
+
+/// @}
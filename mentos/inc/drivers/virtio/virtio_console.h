@@ -0,0 +1,28 @@
+/// @file virtio_console.h
+/// @brief Driver for the virtio console.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @addtogroup virtio
+/// @{
+
+#pragma once
+
+#include "stddef.h"
+
+/// @brief Writes on the virtio console.
+/// @param buffer the characters.
+/// @param size the number of characters.
+/// @details The characters are queued, and sent by the interrupt handler; the
+/// caller waits only when the queue is full. Without the device, or before
+/// it is initialized, they are dropped.
+void virtio_console_write(const char *buffer, size_t size);
+
+/// @brief Initializes the first virtio console, hvc0.
+/// @return 0 on success, or if there is no device, 1 on error.
+int virtio_console_initialize(void);
+
+/// @brief De-initializes the virtio console.
+/// @return 0 on success, 1 on error.
+int virtio_console_finalize(void);
+
+/// @}
@@ -62,6 +62,34 @@
 
 /// @}
 
+/// @defgroup header_segment_flags Program Header Segment Flags
+/// @brief Permissions of the segments.
+/// @{
+
+/// @brief The segment is executable.
+#define PF_X 0x1
+/// @brief The segment is writable.
+#define PF_W 0x2
+/// @brief The segment is readable.
+#define PF_R 0x4
+
+/// @}
+
+/// @defgroup auxiliary_vector Auxiliary Vector
+/// @brief Types of the entries of the auxiliary vector, which the kernel
+/// places above the arguments of a new program, for the dynamic loader.
+/// @{
+
+#define AT_NULL   0 ///< End of the vector.
+#define AT_PHDR   3 ///< The address of the program headers of the executable.
+#define AT_PHENT  4 ///< The size of a program header.
+#define AT_PHNUM  5 ///< The number of program headers.
+#define AT_PAGESZ 6 ///< The size of a page.
+#define AT_BASE   7 ///< Where the interpreter has been loaded.
+#define AT_ENTRY  9 ///< The entry of the executable.
+
+/// @}
+
 /// Elf header ident size.
 #define EI_NIDENT 16
 
@@ -203,7 +231,8 @@ enum Elf_Ident {
 typedef enum Elf_Type {
     ET_NONE = 0, ///< Unkown Type
     ET_REL  = 1, ///< Relocatable File
-    ET_EXEC = 2  ///< Executable File
+    ET_EXEC = 2, ///< Executable File
+    ET_DYN  = 3  ///< Shared Object File, or Position Independent Executable
 } Elf_Type;
 
 #define EM_386     3 ///< x86 Machine Type.
@@ -247,12 +276,47 @@ enum StT_Types {
     STT_FUNC   = 2  ///< Methods or functions
 };
 
+/// Where position independent executables are loaded, below the lowest
+/// address used by the programs linked at a fixed one.
+#define ELF_ET_DYN_BASE 0x08000000U
+
+/// @brief Where an executable, and its interpreter, have been loaded.
+typedef struct elf_image_t {
+    /// Where the process starts, the entry of the interpreter if there is one.
+    uint32_t entry;
+    /// The entry of the executable.
+    uint32_t exec_entry;
+    /// The address of the program headers of the executable, 0 if they are
+    /// not inside a loaded segment.
+    uint32_t phdr;
+    /// The number of program headers of the executable.
+    uint32_t phnum;
+    /// Where the interpreter has been loaded, 0 if there is none.
+    uint32_t interp_base;
+} elf_image_t;
+
 /// @brief Loads an ELF file into the memory of task.
 /// @param task  The task for which we load the ELF.
 /// @param file  The ELF file.
-/// @param entry The ELF binary entry.
+/// @param image Where the executable has been loaded.
 /// @return 0 if fails, 1 if succeed.
-int elf_load_file(task_struct *task, vfs_file_t *file, uint32_t *entry);
+/// @details Executables linked at a fixed address (ET_EXEC) and position
+/// independent ones (ET_DYN) are accepted. When the executable names an
+/// interpreter (PT_INTERP), the interpreter is loaded too, and the process
+/// starts from its entry, it finds the executable through the auxiliary vector.
+int elf_load_file(task_struct *task, vfs_file_t *file, elf_image_t *image);
+
+/// @brief Checks if the file is an ELF executable which can be loaded.
+/// @param file The file to check.
+/// @return 0 if fails, 1 if succeed.
+/// @details The validated headers are kept in a small cache, keyed by inode,
+/// so that executing the same file again reads nothing; files which do not
+/// start with the ELF magic number are rejected without complaining.
+int elf_check_executable(vfs_file_t *file);
+
+/// @brief Forgets the cached headers of a file, because it has been modified.
+/// @param file The file.
+void elf_cache_invalidate(vfs_file_t *file);
 
 /// @brief Checks if the file is a valid ELF.
 /// @param file The file to check.
@@ -270,6 +334,20 @@ int elf_check_file_header(elf_header_t *hdr);
 /// @return 0 if fails, 1 if succeed.
 int elf_check_magic_number(elf_header_t *hdr);
 
+/// @brief Copies the names and addresses of the functions of the kernel, to
+/// symbolize its addresses.
+/// @param header The ELF image of the kernel, with its symbol table.
+/// @return 0 on success, -errno on failure.
+int elf_load_kernel_symbols(elf_header_t *header);
+
+/// @brief Finds the function of the kernel containing the given address.
+/// @param address The address.
+/// @param offset Where the offset of the address inside the function is
+/// stored, it can be NULL.
+/// @return The name of the function, NULL if unknown or if the symbols were
+/// not loaded.
+const char *elf_kernel_symbol(uint32_t address, uint32_t *offset);
+
 /// @brief Transforms the passed ELF type to string.
 /// @param type The integer representing the ELF type.
 /// @return The string representing the ELF type.
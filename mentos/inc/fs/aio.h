@@ -0,0 +1,40 @@
+/// @file aio.h
+/// @brief Asynchronous requests of the processes, served by the block devices.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#pragma once
+
+#include "fs/vfs_types.h"
+#include "process/process.h"
+
+/// @brief An asynchronous request of a thread.
+typedef struct kiocb_t kiocb_t;
+
+/// @brief Initializes the asynchronous requests.
+void aio_init(void);
+
+/// @brief Allocates the kernel buffer where an asynchronous read lands,
+/// called by the aio_read_f callbacks.
+/// @param iocb the request.
+/// @param size the size of the buffer.
+/// @param skip where the data asked by the process starts, inside the buffer.
+/// @return the buffer, NULL if there is no memory.
+void *aio_alloc_buffer(kiocb_t *iocb, size_t size, size_t skip);
+
+/// @brief Queues the reads of a range of sectors on the device, on behalf of
+/// a request, called by the aio_read_f callbacks.
+/// @param iocb the request.
+/// @param device the block device.
+/// @param buffer where the sectors land, inside the buffer of the request.
+/// @param sector the first sector.
+/// @param count the number of sectors.
+/// @return 0 on success, -errno on failure.
+/// @details The request is completed once all the sectors have been read.
+/// If the device refuses to queue them, they are read right away.
+int aio_submit_sectors(kiocb_t *iocb, vfs_file_t *device, void *buffer, uint32_t sector, uint32_t count);
+
+/// @brief Abandons the requests of a thread which exits, or executes
+/// another program. Those still in flight are freed once completed.
+/// @param task the thread.
+void aio_exit(task_struct *task);
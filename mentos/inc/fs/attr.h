@@ -14,3 +14,15 @@ int sys_fchown(int fd, uid_t owner, gid_t group);
 int sys_chmod(const char* path, mode_t mode);
 
 int sys_fchmod(int fd, mode_t mode);
+
+/// @brief Changes the size of the file at the given path.
+/// @param path the path of the file.
+/// @param length the new size.
+/// @return 0 on success, -errno on failure.
+int sys_truncate(const char *path, off_t length);
+
+/// @brief Changes the size of an open file.
+/// @param fd the file descriptor, open for writing.
+/// @param length the new size.
+/// @return 0 on success, -errno on failure.
+int sys_ftruncate(int fd, off_t length);
@@ -0,0 +1,28 @@
+/// @file bio.h
+/// @brief Transfers between the block devices and page frames.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#pragma once
+
+#include "fs/vfs_types.h"
+#include "mem/zone_allocator.h"
+
+/// The size of a sector.
+#define BIO_SECTOR_SIZE 512U
+
+/// @brief Moves consecutive sectors between the device and page frames,
+/// without going through the buffer cache.
+/// @param device the block device.
+/// @param write if the sectors are written, or read.
+/// @param sector the first sector.
+/// @param pages the page frames, the data goes on at the beginning of each
+/// one after the first.
+/// @param offset where the data starts inside the first page frame, a
+/// multiple of the sector size.
+/// @param size the number of bytes, a multiple of the sector size.
+/// @return 0 on success, -errno on failure.
+/// @details When the device queues requests, they are all in flight at the
+/// same time and the device moves the data straight from or to the page
+/// frames. Otherwise, the page frames are mapped and moved one at a time.
+int bio_transfer_pages(vfs_file_t *device, int write, uint32_t sector, page_t **pages, size_t offset, size_t size);
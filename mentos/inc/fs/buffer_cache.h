@@ -0,0 +1,140 @@
+/// @file buffer_cache.h
+/// @brief Cache of the blocks read from, and written to, block devices.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#pragma once
+
+#include "fs/vfs_types.h"
+#include "sys/list_head.h"
+
+/// @brief Maximum number of buffers kept in memory, unless changed with
+/// `bcache_buffers=` on the command line.
+#define BUFFER_CACHE_DEFAULT_MAX_BUFFERS 512
+
+/// @brief Maximum number of buffers kept in memory.
+extern unsigned buffer_cache_max_buffers;
+
+/// @brief Hundredths of a second between two write-backs, by default.
+#define BUFFER_DEFAULT_WRITEBACK_CENTISECS 500
+/// @brief Percentage of dirty buffers which starts the write-back, by default.
+#define BUFFER_DEFAULT_DIRTY_RATIO 50
+
+/// @brief Hundredths of a second between two write-backs of the dirty buffers.
+extern unsigned buffer_dirty_writeback_centisecs;
+/// @brief Percentage of the cache which can be dirty before the write-back
+/// starts, without waiting for the next one.
+extern unsigned buffer_dirty_ratio;
+
+/// @brief The content of the buffer matches the one on the device.
+#define BUFFER_UPTODATE (1U << 0)
+/// @brief The content of the buffer must be written back to the device.
+#define BUFFER_DIRTY (1U << 1)
+/// @brief The buffer belongs to a journal transaction, and must not reach its
+/// place on the device until the transaction is committed.
+#define BUFFER_PINNED (1U << 2)
+
+/// @brief Key used to identify a block inside the cache.
+typedef struct buffer_key_t {
+    /// The block device.
+    vfs_file_t *device;
+    /// The index of the block on the device.
+    uint32_t block;
+} buffer_key_t;
+
+/// @brief A block of a block device, cached in memory.
+typedef struct buffer_head_t {
+    /// The key identifying the block.
+    buffer_key_t key;
+    /// The size of the block.
+    size_t size;
+    /// The content of the block.
+    uint8_t *data;
+    /// Buffer state (BUFFER_UPTODATE, BUFFER_DIRTY, BUFFER_PINNED).
+    unsigned int flags;
+    /// Number of users currently holding the buffer.
+    unsigned int count;
+    /// Position inside the LRU list, the least recently used comes first.
+    list_head lru;
+    /// Position inside the list of dirty buffers, sorted by device and block.
+    list_head dirty;
+} buffer_head_t;
+
+/// @brief Initializes the buffer cache.
+void buffer_cache_init(void);
+
+/// @brief Returns the buffer associated with the block, without reading it.
+/// @param device the block device.
+/// @param block the index of the block.
+/// @param size the size of the block.
+/// @return the buffer, with its reference count increased, NULL on failure.
+/// @details Use it when the whole block is going to be overwritten.
+buffer_head_t *buffer_get(vfs_file_t *device, uint32_t block, size_t size);
+
+/// @brief Returns the buffer associated with the block, reading it from the
+/// device if it is not already cached.
+/// @param device the block device.
+/// @param block the index of the block.
+/// @param size the size of the block.
+/// @return the buffer, with its reference count increased, NULL on failure.
+buffer_head_t *buffer_read(vfs_file_t *device, uint32_t block, size_t size);
+
+/// @brief Reads the consecutive blocks which are not cached yet, moving each
+/// run of missing blocks with a single request.
+/// @param device the block device.
+/// @param block the index of the first block.
+/// @param count the number of blocks.
+/// @param size the size of a block.
+/// @details The blocks are left in the cache, unreferenced.
+void buffer_read_ahead(vfs_file_t *device, uint32_t block, uint32_t count, size_t size);
+
+/// @brief Releases a buffer obtained with buffer_get or buffer_read.
+/// @param buffer the buffer.
+void buffer_release(buffer_head_t *buffer);
+
+/// @brief Marks the buffer as modified, it will be written back later.
+/// @param buffer the buffer.
+void buffer_mark_dirty(buffer_head_t *buffer);
+
+/// @brief Writes the buffer back to the device, if it is dirty.
+/// @param buffer the buffer.
+/// @return 0 on success, -errno on failure.
+/// @details Pinned buffers are left alone, they are written by their journal.
+int buffer_write(buffer_head_t *buffer);
+
+/// @brief Keeps the buffer in memory, and away from the device, until it is
+/// unpinned.
+/// @param buffer the buffer, which gains a reference.
+void buffer_pin(buffer_head_t *buffer);
+
+/// @brief Lets the buffer be written back and evicted again.
+/// @param buffer the buffer, which loses the reference taken by buffer_pin.
+void buffer_unpin(buffer_head_t *buffer);
+
+/// @brief Writes back all the dirty buffers of the device.
+/// @param device the block device, NULL to write back all the devices.
+/// @return 0 on success, -errno if some buffer could not be written.
+/// @details Buffers of consecutive blocks are written with a single request,
+/// pinned buffers are skipped.
+int buffer_sync(vfs_file_t *device);
+
+/// @brief Starts the flusher kernel thread, which writes back the dirty
+/// buffers periodically.
+/// @return 1 on success, 0 on failure.
+/// @details The flusher timer runs in interrupt context, where we cannot wait
+/// for the disk, so it only wakes the thread up.
+int buffer_cache_start_flusher(void);
+
+/// @brief Writes back and drops all the unused buffers of the device.
+/// @param device the block device.
+void buffer_invalidate(vfs_file_t *device);
+
+/// @brief Drops the unused buffers of a range of blocks.
+/// @param device the block device.
+/// @param block the index of the first block.
+/// @param count the number of blocks.
+/// @param discard if set, the dirty buffers are dropped without being written
+/// back, because the blocks are about to be overwritten on the device.
+/// @details Used by the transfers which bypass the cache, and by the hints
+/// telling that the blocks are not going to be used again.
+void buffer_drop_range(vfs_file_t *device, uint32_t block, uint32_t count, int discard);
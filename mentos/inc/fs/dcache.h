@@ -0,0 +1,71 @@
+/// @file dcache.h
+/// @brief Cache of the directory entries resolved by the filesystems.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#pragma once
+
+#include "stddef.h"
+#include "sys/list_head.h"
+
+/// Maximum length of the names kept in the cache, longer ones are not cached.
+#define DCACHE_NAME_LEN 63
+
+/// @brief Key used to identify a directory entry inside the cache.
+typedef struct dentry_key_t {
+    /// The filesystem instance the directory belongs to.
+    const void *owner;
+    /// The inode of the parent directory.
+    ino_t parent;
+    /// The name of the entry.
+    const char *name;
+} dentry_key_t;
+
+/// @brief A directory entry, cached in memory.
+typedef struct dentry_t {
+    /// The key identifying the entry.
+    dentry_key_t key;
+    /// The inode the name resolves to, 0 if the name does not exist.
+    ino_t ino;
+    /// The type of the entry, as stored by the filesystem.
+    int type;
+    /// Position inside the LRU list, the least recently used comes first.
+    list_head lru;
+    /// The name of the entry.
+    char name[DCACHE_NAME_LEN + 1];
+} dentry_t;
+
+/// @brief Initializes the dentry cache.
+void dcache_init(void);
+
+/// @brief Searches the name inside the directory.
+/// @param owner the filesystem instance.
+/// @param parent the inode of the directory.
+/// @param name the name of the entry.
+/// @return the cached entry, whose `ino` is 0 for a name known not to
+/// exist, NULL if the name is not cached.
+/// @details The entry belongs to the cache, copy what you need right away.
+dentry_t *dcache_lookup(const void *owner, ino_t parent, const char *name);
+
+/// @brief Adds, or updates, an entry of the cache.
+/// @param owner the filesystem instance.
+/// @param parent the inode of the directory.
+/// @param name the name of the entry.
+/// @param ino the inode the name resolves to, 0 for a negative entry.
+/// @param type the type of the entry.
+void dcache_add(const void *owner, ino_t parent, const char *name, ino_t ino, int type);
+
+/// @brief Removes the entry from the cache.
+/// @param owner the filesystem instance.
+/// @param parent the inode of the directory.
+/// @param name the name of the entry.
+void dcache_remove(const void *owner, ino_t parent, const char *name);
+
+/// @brief Removes all the entries of the directory.
+/// @param owner the filesystem instance.
+/// @param parent the inode of the directory.
+void dcache_remove_directory(const void *owner, ino_t parent);
+
+/// @brief Removes all the entries of the filesystem instance.
+/// @param owner the filesystem instance.
+void dcache_invalidate(const void *owner);
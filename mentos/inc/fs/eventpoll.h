@@ -0,0 +1,13 @@
+/// @file eventpoll.h
+/// @brief Scalable notification of the events on a set of files.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#pragma once
+
+#include "fs/vfs_types.h"
+
+/// @brief Removes a file from every epoll instance watching it, called once
+/// its last reference is closed.
+/// @param file the file.
+void eventpoll_release(vfs_file_t *file);
@@ -5,6 +5,10 @@
 
 #pragma once
 
+/// @brief Maximum read-ahead window of the sequential reads, in blocks, 0
+/// disables the read-ahead.
+extern unsigned ext2_read_ahead_max;
+
 /// @brief Initializes the EXT2 drivers.
 /// @return 0 on success, 1 on error.
 int ext2_initialize(void);
@@ -0,0 +1,22 @@
+/// @file initramfs.h
+/// @brief Unpacks the initramfs, passed as a multiboot module, into tmpfs.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// The initramfs is a `cpio` archive in the `newc` format (as produced by
+/// `find . | cpio -o -H newc`), loaded by the boot loader as a multiboot
+/// module (e.g., `qemu -initrd`). It is unpacked into a tmpfs mounted on `/`,
+/// so that init and the early programs are read from memory; the root
+/// filesystem on disk, mounted later on `/`, hides it.
+
+#pragma once
+
+#include "stdbool.h"
+
+/// @brief Checks if one of the multiboot modules is an initramfs.
+/// @return true if there is an initramfs, false otherwise.
+bool_t initramfs_available(void);
+
+/// @brief Mounts a tmpfs on `/`, and unpacks the initramfs into it.
+/// @return 0 on success, or if there is no initramfs, -errno on failure.
+int initramfs_mount(void);
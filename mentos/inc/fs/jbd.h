@@ -0,0 +1,59 @@
+/// @file jbd.h
+/// @brief Journal of the metadata blocks, in the on-disk format of JBD2.
+/// @details The journal works in ordered mode: the metadata blocks modified
+/// by the filesystem are pinned in the buffer cache, and gathered into the
+/// running transaction. A commit first writes back the dirty data blocks and
+/// the blocks of the previous transaction (the checkpoint), then copies the
+/// metadata blocks to the log, followed by a commit block. The pinned blocks
+/// reach their place on the device only with the next checkpoint, so that a
+/// block modified by many transactions in a row is written once. After a
+/// crash, the committed transactions found inside the log are replayed when
+/// the filesystem is mounted again.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#pragma once
+
+#include "fs/buffer_cache.h"
+#include "fs/vfs_types.h"
+
+/// @brief A journal, stored inside the blocks of its filesystem.
+typedef struct journal_t journal_t;
+
+/// @brief Loads the journal, checking its superblock.
+/// @param device the block device of the filesystem.
+/// @param block_size the size of a block of the filesystem.
+/// @param map the device block holding each block of the journal, the
+/// journal keeps it once loaded.
+/// @param length the number of blocks of the journal.
+/// @return the journal, NULL on failure.
+journal_t *journal_load(vfs_file_t *device, uint32_t block_size, uint32_t *map, uint32_t length);
+
+/// @brief Replays the committed transactions left inside the log, and
+/// empties it.
+/// @param journal the journal.
+/// @return the number of transactions replayed, -errno on failure.
+int journal_recover(journal_t *journal);
+
+/// @brief Adds a metadata block to the running transaction, before it is
+/// modified.
+/// @param journal the journal.
+/// @param buffer the buffer of the block, which stays pinned until its
+/// transaction is checkpointed.
+/// @details A full transaction is committed first.
+void journal_get_write_access(journal_t *journal, buffer_head_t *buffer);
+
+/// @brief Tells the journal that a block has been freed, and can be used
+/// again for any purpose.
+/// @param journal the journal.
+/// @param block the index of the block on the device.
+void journal_forget(journal_t *journal, uint32_t block);
+
+/// @brief Commits the running transaction.
+/// @param journal the journal.
+/// @return 0 on success, -errno on failure.
+int journal_commit(journal_t *journal);
+
+/// @brief Commits and checkpoints the last transactions, then frees the journal.
+/// @param journal the journal.
+void journal_destroy(journal_t *journal);
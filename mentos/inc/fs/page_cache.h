@@ -0,0 +1,87 @@
+/// @file page_cache.h
+/// @brief Cache of the pages of regular files, used by file mappings.
+/// @details Pages are indexed by inode, so they outlive the processes
+/// mapping them: a program started again finds its text already in memory.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#pragma once
+
+#include "fs/vfs_types.h"
+#include "klib/radix_tree.h"
+#include "mem/zone_allocator.h"
+#include "sys/list_head.h"
+
+/// @brief Key used to identify a page of a file inside the cache.
+typedef struct page_cache_key_t {
+    /// The filesystem instance the inode belongs to.
+    const void *owner;
+    /// The inode of the file.
+    uint32_t ino;
+    /// The index of the page inside the file.
+    uint32_t index;
+} page_cache_key_t;
+
+/// @brief A page of a file, cached in memory.
+typedef struct page_cache_entry_t {
+    /// The key identifying the page.
+    page_cache_key_t key;
+    /// The physical page holding the content.
+    page_t *page;
+    /// The open file used to write the page back, NULL once it is closed.
+    vfs_file_t *file;
+    /// The pages of the same inode, where the entry is tagged dirty once its
+    /// content is modified through a shared mapping.
+    struct page_cache_mapping_t *mapping;
+    /// Position inside the LRU list, the least recently used comes first.
+    list_head lru;
+} page_cache_entry_t;
+
+/// @brief Initializes the page cache.
+void page_cache_init(void);
+
+/// @brief Returns the page of the file, reading it if it is not cached yet.
+/// @param file the file.
+/// @param index the index of the page inside the file.
+/// @return the page, with its reference count increased, NULL on failure.
+/// @details The reference must be dropped with page_cache_put.
+page_t *page_cache_get(vfs_file_t *file, uint32_t index);
+
+/// @brief Checks if a page of a file is cached, without reading it.
+/// @param file the file.
+/// @param index the index of the page inside the file.
+/// @return 1 if the page is cached, 0 otherwise.
+int page_cache_contains(vfs_file_t *file, uint32_t index);
+
+/// @brief Drops a reference to a page, freeing it when it was the last one.
+/// @param page the page.
+void page_cache_put(page_t *page);
+
+/// @brief Marks the cached page as modified, it will be written back later.
+/// @param file the file.
+/// @param index the index of the page inside the file.
+void page_cache_mark_dirty(vfs_file_t *file, uint32_t index);
+
+/// @brief Copies the data written to the file inside the pages already cached.
+/// @param file the file.
+/// @param buffer the data written to the file.
+/// @param offset the offset where the data has been written.
+/// @param nbytes the amount of data written.
+void page_cache_update(vfs_file_t *file, const void *buffer, size_t offset, size_t nbytes);
+
+/// @brief Writes back the modified pages of the file.
+/// @param file the file.
+/// @return 0 on success, -errno if some page could not be written.
+int page_cache_sync(vfs_file_t *file);
+
+/// @brief Writes back the pages of the file, which is being closed for the
+/// last time. Clean pages stay cached, until memory is needed.
+/// @param file the file.
+void page_cache_release(vfs_file_t *file);
+
+/// @brief Drops all the pages of the inode, because its content changed
+/// behind the cache, or because the inode is gone.
+/// @param owner the filesystem instance the inode belongs to.
+/// @param ino the inode.
+/// @details Pages still mapped by processes are freed by their last user.
+void page_cache_invalidate(const void *owner, uint32_t ino);
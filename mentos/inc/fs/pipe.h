@@ -0,0 +1,24 @@
+/// @file pipe.h
+/// @brief Pipes, streaming data between processes through a kernel buffer.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#pragma once
+
+/// The buffer of a pipe spans 2^PIPE_BUFFER_ORDER pages.
+#define PIPE_BUFFER_ORDER 2
+/// The size of the buffer of a pipe.
+#define PIPE_BUFFER_SIZE (PAGE_SIZE << PIPE_BUFFER_ORDER)
+
+/// @brief Creates a pipe.
+/// @param fds where the descriptors are stored, the read end in fds[0] and
+/// the write end in fds[1].
+/// @return 0 on success, -errno on failure.
+int sys_pipe(int fds[2]);
+
+/// @brief Creates a pipe, with the given flags on both its descriptors.
+/// @param fds where the descriptors are stored, the read end in fds[0] and
+/// the write end in fds[1].
+/// @param flags either 0 or O_NONBLOCK.
+/// @return 0 on success, -errno on failure.
+int sys_pipe2(int fds[2], int flags);
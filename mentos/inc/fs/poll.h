@@ -0,0 +1,58 @@
+/// @file poll.h
+/// @brief Waiting for events on a set of files.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#pragma once
+
+#include "fs/vfs_types.h"
+#include "process/wait.h"
+
+struct poll_table_t;
+struct pollfd;
+
+/// @brief Queues a waiter on one of the queues of a file.
+typedef void (*poll_queue_proc)(vfs_file_t *file, wait_queue_head_t *head, struct poll_table_t *table);
+
+/// @brief Tells the poll_f callbacks how to queue the waiter.
+typedef struct poll_table_t {
+    /// Queues the waiter, NULL if it is not going to sleep.
+    poll_queue_proc queue;
+} poll_table_t;
+
+/// @brief Queues the waiter polling a file on one of the queues of the file,
+/// called by the poll_f callbacks.
+/// @param file the file.
+/// @param head the queue, woken up when the events of the file change.
+/// @param table the table of the waiter, NULL if it is not going to sleep.
+static inline void poll_wait(vfs_file_t *file, wait_queue_head_t *head, poll_table_t *table)
+{
+    if (table && table->queue) {
+        table->queue(file, head, table);
+    }
+}
+
+/// @brief Checks a set of descriptors of the calling process, and puts it to
+/// sleep if none is ready.
+/// @param fds the descriptors, whose revents are set.
+/// @param nfds the number of descriptors.
+/// @param timeout the longest time to wait, in milliseconds, negative to wait
+/// forever.
+/// @return the number of descriptors ready, 0 if the time expired,
+/// -ERESTARTSYS if the process sleeps, -errno on failure.
+int do_poll(struct pollfd *fds, unsigned int nfds, int timeout);
+
+/// @brief Checks a file on behalf of the calling process, and puts it to
+/// sleep if none of the events is ready, as do_poll.
+/// @param file the file.
+/// @param events the events we are waiting for.
+/// @param timeout the longest time to wait, in milliseconds, negative to wait
+/// forever.
+/// @return 1 if the events are ready, 0 if the time expired, -ERESTARTSYS if
+/// the process sleeps, -errno on failure.
+/// @details Used by the files which block inside their read_f or write_f.
+int do_poll_file(vfs_file_t *file, short events, int timeout);
+
+/// @brief Releases the queues of a process leaving poll or select.
+/// @param task the process.
+void poll_release(struct task_struct *task);
@@ -19,6 +19,29 @@ typedef struct proc_dir_entry_t {
     const char *name;
 } proc_dir_entry_t;
 
+/// @brief Returns the character identifying the process state.
+/// @details
+///     R  Running
+///     S  Sleeping in an interruptible wait
+///     D  Waiting in uninterruptible disk sleep
+///     Z  Zombie
+///     T  Stopped
+///     t  Tracing stop
+///     X  Dead
+/// @param state the state of the task.
+/// @return the character.
+static inline char proc_task_state_char(int state)
+{
+    if (state == 0x00) { return 'R'; }     // TASK_RUNNING
+    if (state == (1 << 0)) { return 'S'; } // TASK_INTERRUPTIBLE
+    if (state == (1 << 1)) { return 'D'; } // TASK_UNINTERRUPTIBLE
+    if (state == (1 << 2)) { return 'T'; } // TASK_STOPPED
+    if (state == (1 << 3)) { return 't'; } // TASK_TRACED
+    if (state == (1 << 4)) { return 'Z'; } // EXIT_ZOMBIE
+    if (state == (1 << 5)) { return 'X'; } // EXIT_DEAD
+    return '?';
+}
+
 /// @brief Initialize the procfs filesystem.
 /// @return 0 if fails, 1 if succeed.
 int procfs_module_init(void);
@@ -0,0 +1,85 @@
+/// @file seq_file.h
+/// @brief Sequential files, whose contents are generated one record at a time.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#pragma once
+
+#include "fs/vfs_types.h"
+#include "stdarg.h"
+
+struct seq_file_t;
+
+/// @brief Iterates over the records of a sequential file.
+typedef struct seq_operations_t {
+    /// Returns the record at the given position, NULL past the last one.
+    void *(*start)(struct seq_file_t *m, size_t *pos);
+    /// Advances the position, and returns the following record, or NULL.
+    void *(*next)(struct seq_file_t *m, void *v, size_t *pos);
+    /// Ends the iteration, v is the record which was not shown, or NULL.
+    void (*stop)(struct seq_file_t *m, void *v);
+    /// Writes a record into the output, with seq_printf and seq_puts.
+    int (*show)(struct seq_file_t *m, void *v);
+} seq_operations_t;
+
+/// @brief The state of an open sequential file.
+typedef struct seq_file_t {
+    /// The text generated so far, from the first record.
+    char *buf;
+    /// The size of the buffer.
+    size_t size;
+    /// The number of bytes of text in the buffer.
+    size_t count;
+    /// The position of the next record to generate.
+    size_t index;
+    /// Set when the last record was generated.
+    int done;
+    /// Set when the buffer could not be enlarged.
+    int overflow;
+    /// The iterator over the records.
+    const seq_operations_t *op;
+    /// Data of the file, for the iterator.
+    void *private;
+} seq_file_t;
+
+/// @brief Attaches a sequential file to an open file, as its private data.
+/// @param file the open file.
+/// @param op the iterator over the records.
+/// @param private data passed to the iterator.
+/// @return 0 on success, -ENOMEM on failure.
+int seq_open(vfs_file_t *file, const seq_operations_t *op, void *private);
+
+/// @brief Reads a sequential file, generating only the records needed to
+/// reach the end of the requested range. Reading from offset zero starts a
+/// new pass, later offsets resume from the records already generated.
+/// @param file the open file.
+/// @param buffer where the text is copied.
+/// @param offset the offset of the text.
+/// @param nbyte the number of bytes to read.
+/// @return the number of bytes read, or -errno.
+ssize_t seq_read(vfs_file_t *file, char *buffer, off_t offset, size_t nbyte);
+
+/// @brief Releases the sequential file attached to an open file.
+/// @param file the open file, which is not freed.
+/// @return 0.
+int seq_release(vfs_file_t *file);
+
+/// @brief Appends formatted text to the output of a sequential file.
+/// @param m the sequential file.
+/// @param fmt the format.
+/// @param ... the arguments of the format.
+/// @return the number of bytes written, or -ENOMEM.
+int seq_printf(seq_file_t *m, const char *fmt, ...);
+
+/// @brief Appends a string to the output of a sequential file.
+/// @param m the sequential file.
+/// @param s the string.
+/// @return the number of bytes written, or -ENOMEM.
+int seq_puts(seq_file_t *m, const char *s);
+
+/// @brief Appends raw bytes to the output of a sequential file.
+/// @param m the sequential file.
+/// @param data the bytes.
+/// @param len the number of bytes.
+/// @return the number of bytes written, or -ENOMEM.
+int seq_write(seq_file_t *m, const void *data, size_t len);
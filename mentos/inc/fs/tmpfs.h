@@ -0,0 +1,14 @@
+/// @file tmpfs.h
+/// @brief Memory-backed file system.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#pragma once
+
+/// @brief Registers the tmpfs filesystem.
+/// @return 0 on success, 1 on failure.
+int tmpfs_module_init(void);
+
+/// @brief Unregisters the tmpfs filesystem.
+/// @return 0 on success, 1 on failure.
+int tmpfs_cleanup_module(void);
@@ -8,7 +8,8 @@
 #include "fs/vfs_types.h"
 #include "mem/slab.h"
 
-#define MAX_OPEN_FD 16 ///< Maximum number of opened file.
+#define NR_OPEN_DEFAULT 16   ///< Initial size of the file descriptor list.
+#define MAX_OPEN_FD     1024 ///< Maximum number of opened file.
 
 #define STDIN_FILENO  0 ///< Standard input.
 #define STDOUT_FILENO 1 ///< Standard output.
@@ -73,6 +74,23 @@ ssize_t vfs_read(vfs_file_t *file, void *buf, size_t offset, size_t nbytes);
 /// @return The number of written characters.
 ssize_t vfs_write(vfs_file_t *file, const void *buf, size_t offset, size_t nbytes);
 
+/// @brief        Reads or writes a file without going through the caches.
+/// @param file   The file structure used to reference a file.
+/// @param write  If the data is written to the file, or read from it.
+/// @param buf    The buffer, which the filesystem may require to be aligned.
+/// @param offset The offset from which the transfer starts.
+/// @param nbytes The number of bytes to transfer.
+/// @return The number of bytes transferred, -errno on failure.
+ssize_t vfs_direct_io(vfs_file_t *file, int write, void *buf, size_t offset, size_t nbytes);
+
+/// @brief        Records how the data of a file is going to be accessed.
+/// @param file   The file structure used to reference a file.
+/// @param offset The start of the range the advice applies to.
+/// @param len    The length of the range, 0 for up to the end of the file.
+/// @param advice The advice (POSIX_FADV_*).
+/// @return 0 on success, -errno on failure.
+int vfs_fadvise(vfs_file_t *file, off_t offset, off_t len, int advice);
+
 /// @brief Repositions the file offset inside a file.
 /// @param file   The file for which we reposition the offest.
 /// @param offset The offest to use for the operation.
@@ -101,6 +119,15 @@ ssize_t vfs_getdents(vfs_file_t *file, dirent_t *dirp, off_t off, size_t count);
 /// @return Return value depends on REQUEST. Usually -1 indicates error.
 int vfs_ioctl(vfs_file_t *file, int request, void *data);
 
+/// @brief Writes back the modified data of the file to the underlying device.
+/// @param file The file we want to synchronize.
+/// @return 0 on success, -errno on failure.
+int vfs_fsync(vfs_file_t *file);
+
+/// @brief Writes back the modified data of all the mounted filesystems.
+/// @return 0 on success, -errno if some data could not be written.
+int vfs_sync(void);
+
 /// @brief Delete a name and possibly the file it refers to.
 /// @param path The path to the file.
 /// @return On success, zero is returned. On error, -1 is returned, and
@@ -151,6 +178,15 @@ int vfs_stat(const char *path, stat_t *buf);
 /// @return 0 on success, -errno on failure.
 int vfs_fstat(vfs_file_t *file, stat_t *buf);
 
+/// @brief Stat the file at a path relative to a directory, without walking
+/// the path from the root.
+/// @param directory The directory from which the path is resolved.
+/// @param path      The relative path.
+/// @param buf       Buffer where we are storing the statistics.
+/// @param mask      The STATX_* fields needed, the others may be left zeroed.
+/// @return 0 on success, -errno on failure.
+int vfs_statat(vfs_file_t *directory, const char *path, stat_t *buf, unsigned int mask);
+
 /// @brief Mount a file system to the specified path.
 /// @param path    Path where we want to map the filesystem.
 /// @param fs_root Root node of the filesystem.
@@ -190,19 +226,54 @@ int vfs_init_task(struct task_struct *task);
 /// @return 0 on fail, 1 on success.
 int vfs_dup_task(struct task_struct *new_task, struct task_struct *old_task);
 
+/// @brief Makes new_task share the file descriptor list of old_task.
+/// @param new_task The task which uses the list of old_task.
+/// @param old_task The task owning the file descriptor list.
+/// @return 0 on fail, 1 on success.
+int vfs_share_task(struct task_struct *new_task, struct task_struct *old_task);
+
+/// @brief Releases the file descriptor list of the given task, closing its
+/// files if no other task shares it.
+/// @param task The task, which is left without a file descriptor list.
+void vfs_close_task_files(struct task_struct *task);
+
 /// @brief Destroy the file descriptor list for the given task.
 /// @param task The task for which we destroy the file descriptor list.
 /// @return 0 on fail, 1 on success.
 int vfs_destroy_task(struct task_struct *task);
 
-/// @brief Find the smallest available fd.
+/// @brief Find the smallest available fd, extending the list if it is full.
 /// @return -errno on fail, fd on success.
+/// @details The descriptor is not reserved, until vfs_install_fd is called.
 int get_unused_fd(void);
 
+/// @brief Makes a file descriptor refer to the given file.
+/// @param files The table of the open files.
+/// @param fd The descriptor, which must be free.
+/// @param file The file, whose reference passes to the table.
+/// @param flags The flags of the descriptor, O_CLOEXEC marks it to be closed by execve.
+void vfs_install_fd(files_struct_t *files, int fd, vfs_file_t *file, int flags);
+
+/// @brief Frees a file descriptor, without closing its file.
+/// @param files The table of the open files.
+/// @param fd The descriptor.
+/// @return the file the descriptor referred to, whose reference passes to the caller.
+vfs_file_t *vfs_release_fd(files_struct_t *files, int fd);
+
+/// @brief Closes the file descriptors marked with O_CLOEXEC.
+/// @param files The table of the open files.
+void vfs_close_on_exec(files_struct_t *files);
+
 /// @brief Return new smallest available file desriptor.
 /// @return -errno on fail, fd on success.
 int sys_dup(int fd);
 
+/// @brief Makes a file descriptor refer to the same file of another.
+/// @param oldfd the file descriptor to duplicate.
+/// @param newfd the file descriptor to use, closed first if it is open.
+/// @return newfd on success, -errno on failure.
+int sys_dup2(int oldfd, int newfd);
+
 /// @brief Check if the requested open flags against the file mask
 /// @param flags The requested open flags.
 /// @param mode The permissions of the file.
@@ -5,6 +5,7 @@
 
 #pragma once
 
+#include "klib/stdatomic.h"
 #include "sys/list_head.h"
 #include "sys/dirent.h"
 #include "bits/stat.h"
@@ -20,6 +21,16 @@ typedef struct vfs_file_t vfs_file_t;
 
 /// Forward declaration of the inode attributes.
 struct iattr;
+/// Forward declaration of the table given to the poll_f callbacks.
+struct poll_table_t;
+/// Forward declaration of the memory areas given to the mmap_f callbacks.
+struct vm_area_struct_t;
+/// Forward declaration of the block requests given to the submit_f callbacks.
+struct ata_request_t;
+/// Forward declaration of the asynchronous requests given to the aio_read_f callbacks.
+struct kiocb_t;
+/// Forward declaration of the page frames given to the page callbacks.
+struct page_t;
 
 /// Function used to create a directory.
 typedef int (*vfs_mkdir_callback)(const char *, mode_t);
@@ -45,8 +56,14 @@ typedef off_t (*vfs_lseek_callback)(vfs_file_t *, off_t, int);
 typedef int (*vfs_stat_callback)(const char *, stat_t *);
 /// Function used to stat files.
 typedef int (*vfs_fstat_callback)(vfs_file_t *, stat_t *);
+/// Function used to stat the fs entries at a path relative to a directory,
+/// filling at least the STATX_* fields of the mask.
+typedef int (*vfs_statat_callback)(vfs_file_t *, const char *, stat_t *, unsigned int);
 /// Function used to perform ioctl on files.
 typedef int (*vfs_ioctl_callback)(vfs_file_t *, int, void *);
+/// Function used to map the pages of a file directly, instead of through the
+/// page cache, it sets up the operations of the area.
+typedef int (*vfs_mmap_callback)(vfs_file_t *, struct vm_area_struct_t *);
 /// Function for creating symbolic links.
 typedef int (*vfs_symlink_callback)(const char *, const char *);
 /// Function that reads the symbolic link data associated with a file.
@@ -55,6 +72,31 @@ typedef ssize_t (*vfs_readlink_callback)(vfs_file_t *, char *, size_t);
 typedef int (*vfs_setattr_callback)(const char *, struct iattr *);
 /// Function used to modify the attributes of a file.
 typedef int (*vfs_fsetattr_callback)(vfs_file_t *, struct iattr *);
+/// Function used to write back the modified data of a file.
+typedef int (*vfs_fsync_callback)(vfs_file_t *);
+/// Function returning the events ready on a file, which also queues the
+/// process on the file, if the table is not NULL.
+typedef unsigned int (*vfs_poll_callback)(vfs_file_t *, struct poll_table_t *);
+/// Function used to read (0) or write (1) a file without going through the
+/// caches, for the descriptors opened with O_DIRECT.
+typedef ssize_t (*vfs_direct_io_callback)(vfs_file_t *, int, void *, off_t, size_t);
+/// Function used to act on an advice about a range of a file (POSIX_FADV_*).
+typedef int (*vfs_fadvise_callback)(vfs_file_t *, off_t, off_t, int);
+/// Function used to queue a request on a block device, the request is
+/// completed later through its end_request.
+typedef int (*vfs_submit_callback)(vfs_file_t *, struct ata_request_t *);
+/// Function used to start an asynchronous read of a file, whose data lands
+/// in the buffer of the request.
+typedef ssize_t (*vfs_aio_read_callback)(vfs_file_t *, struct kiocb_t *, off_t, size_t);
+/// Function used to fill a page frame with a page of a file, given its index.
+/// The part past the end of the file, and the holes, read as zeros.
+typedef int (*vfs_readpage_callback)(vfs_file_t *, struct page_t *, uint32_t);
+/// Function used to fill page frames with pages of a file, given their
+/// indices in increasing order, with as few requests as possible.
+typedef int (*vfs_readpages_callback)(vfs_file_t *, struct page_t **, const uint32_t *, unsigned);
+/// Function used to write page frames back to the pages of a file, given
+/// their indices in increasing order. The file does not grow.
+typedef int (*vfs_writepages_callback)(vfs_file_t *, struct page_t **, const uint32_t *, unsigned);
 
 /// @brief Filesystem information.
 typedef struct file_system_type {
@@ -64,6 +106,8 @@ typedef struct file_system_type {
     int fs_flags;
     /// Mount function.
     vfs_file_t *(*mount)(const char *, const char *);
+    /// Writes back the data the filesystem keeps in memory (optional).
+    int (*sync_fs)(vfs_file_t *);
 } file_system_type;
 
 /// @brief Set of functions used to perform operations on filesystem.
@@ -106,6 +150,34 @@ typedef struct vfs_file_operations_t {
     vfs_readlink_callback readlink_f;
     /// Modifies the attributes of a file.
     vfs_fsetattr_callback setattr_f;
+    /// Writes back the modified data of a file.
+    vfs_fsync_callback fsync_f;
+    /// Returns the events ready on the file (optional, always ready otherwise).
+    vfs_poll_callback poll_f;
+    /// Stat an entry at a path relative to the directory (optional).
+    vfs_statat_callback statat_f;
+    /// Map the file shared with MAP_SHARED (optional, through the page cache
+    /// otherwise).
+    vfs_mmap_callback mmap_f;
+    /// Transfer the data bypassing the caches (optional, O_DIRECT is refused
+    /// otherwise).
+    vfs_direct_io_callback direct_io_f;
+    /// Act on an advice about a range of the file (optional, the advice is
+    /// only recorded otherwise).
+    vfs_fadvise_callback fadvise_f;
+    /// Queue a block request (optional, block devices whose requests are
+    /// completed asynchronously).
+    vfs_submit_callback submit_f;
+    /// Start an asynchronous read (optional, the reads of the asynchronous
+    /// requests are served when they are submitted otherwise).
+    vfs_aio_read_callback aio_read_f;
+    /// Read a page into a page frame (optional, through read_f otherwise).
+    vfs_readpage_callback readpage_f;
+    /// Read many pages at once (optional, one by one otherwise).
+    vfs_readpages_callback readpages_f;
+    /// Write back many pages at once (optional, one by one through write_f
+    /// otherwise).
+    vfs_writepages_callback writepages_f;
 } vfs_file_operations_t;
 
 /// @brief Data structure that contains information about the mounted filesystems.
@@ -114,6 +186,8 @@ struct vfs_file_t {
     char name[NAME_MAX];
     /// Device object (optional).
     void *device;
+    /// Data of the open file, private to its filesystem (optional).
+    void *private_data;
     /// The permissions mask.
     uint32_t mask;
     /// The owning user.
@@ -146,6 +220,16 @@ struct vfs_file_t {
     size_t f_pos;
     /// The number of links.
     uint32_t nlink;
+    /// The block following the last one read, used to detect sequential reads.
+    uint32_t ra_next;
+    /// Number of blocks we are reading ahead of sequential reads.
+    uint32_t ra_window;
+    /// How the data is going to be accessed, as advised by posix_fadvise.
+    int advice;
+    /// The directory offset at which the last getdents stopped.
+    off_t dir_off;
+    /// The position, inside the directory, of the entry found at dir_off.
+    uint32_t dir_pos;
     /// List to hold all active files associated with a specific entry in a filesystem.
     list_head siblings;
     /// TODO: Comment.
@@ -174,6 +258,22 @@ typedef struct vfs_file_descriptor_t {
     int flags_mask;
 } vfs_file_descriptor_t;
 
+/// @brief The table of the open files, shared by the tasks created with CLONE_FILES.
+typedef struct files_struct_t {
+    /// The current opened file descriptors.
+    vfs_file_descriptor_t *fd_list;
+    /// The maximum supported number of file descriptors.
+    int max_fd;
+    /// The descriptors in use, one bit each.
+    unsigned long *open_fds;
+    /// The descriptors closed by execve, one bit each.
+    unsigned long *close_on_exec;
+    /// The lowest descriptor which might be free, all the ones below are open.
+    int next_fd;
+    /// Number of tasks sharing the table.
+    atomic_t count;
+} files_struct_t;
+
 /// @brief Data structure containing attributes of a file.
 struct iattr {
     unsigned int ia_valid;
@@ -183,6 +283,7 @@ struct iattr {
     uint32_t ia_atime;
     uint32_t ia_mtime;
     uint32_t ia_ctime;
+    off_t ia_size;
 };
 
 #define ATTR_MODE  (1 << 0)
@@ -191,6 +292,7 @@ struct iattr {
 #define ATTR_ATIME (1 << 3)
 #define ATTR_MTIME (1 << 4)
 #define ATTR_CTIME (1 << 5)
+#define ATTR_SIZE  (1 << 6)
 
 #define IATTR_CHOWN(user, group)       \
     { .ia_valid = ATTR_UID | ATTR_GID, \
@@ -41,6 +41,18 @@ typedef struct cpuinfo_t {
     char *brand_string;
 } cpuinfo_t;
 
+/// @brief The architectural performance monitoring of the CPU, CPUID leaf 0xA.
+typedef struct cpuid_perfmon_t {
+    /// The version of the performance monitoring, 0 if there is none.
+    uint32_t version;
+    /// The number of general-purpose counters.
+    uint32_t counters;
+    /// The width of the counters, in bits.
+    uint32_t width;
+    /// The architectural events which are NOT available, one bit each.
+    uint32_t unavailable;
+} cpuid_perfmon_t;
+
 /// This will be populated with the information concerning the CPU.
 cpuinfo_t sinfo;
 
@@ -48,6 +60,19 @@ cpuinfo_t sinfo;
 /// @param cpuinfo Structure to fill with CPUID information.
 void get_cpuid(cpuinfo_t *cpuinfo);
 
+/// @brief Detects the architectural performance monitoring.
+/// @param perfmon Structure to fill, all zeros when the CPU has none.
+void cpuid_get_perfmon(cpuid_perfmon_t *perfmon);
+
+/// @brief Checks if the CPU can wait for a write to memory, with MONITOR and
+/// MWAIT.
+/// @return 1 if it can, 0 otherwise.
+int cpuid_has_monitor(void);
+
+/// @brief Checks if the CPU has a random number generator, read with RDRAND.
+/// @return 1 if it has, 0 otherwise.
+int cpuid_has_rdrand(void);
+
 /// @brief Actual CPUID call.
 /// @param registers The registers to fill with the result of the call.
 void call_cpuid(pt_regs *registers);
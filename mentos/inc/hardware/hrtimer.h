@@ -0,0 +1,124 @@
+/// @file hrtimer.h
+/// @brief High-resolution timers, driven by a clock source calibrated on the TSC.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#pragma once
+
+#include "stdbool.h"
+#include "stdint.h"
+
+/// @brief A time, or a duration, in nanoseconds.
+/// @details stdint.h provides a 32-bit uint64_t, a nanoseconds counter needs
+/// the real 64 bits, which wrap after centuries.
+typedef unsigned long long ktime_t;
+
+/// Number of nanoseconds in a second.
+#define NSEC_PER_SEC 1000000000ULL
+/// Number of nanoseconds in a millisecond.
+#define NSEC_PER_MSEC 1000000ULL
+/// Number of nanoseconds in a microsecond.
+#define NSEC_PER_USEC 1000ULL
+/// @brief Fractional bits of the nanoseconds-per-cycle multiplier of the TSC.
+#define TSC_SHIFT 24u
+/// @brief The slack of the timers of a process, unless changed with
+/// prctl(PR_SET_TIMERSLACK).
+#define HRTIMER_DEFAULT_SLACK (50 * NSEC_PER_USEC)
+
+/// @brief A request to execute a function at an absolute time, with a
+/// nanosecond resolution.
+typedef struct hrtimer_t {
+    /// Time, in nanoseconds since boot, when the timer has to expire.
+    ktime_t expires;
+    /// Function executed when the timer expires, with interrupts disabled.
+    void (*function)(struct hrtimer_t *timer);
+    /// Custom data which can be used by the function.
+    unsigned long data;
+    /// If the timer is waiting to expire.
+    bool_t queued;
+} hrtimer_t;
+
+/// @brief Divides a 64-bit value by a 32-bit one, without the help of libgcc,
+/// which the kernel is not linked with.
+/// @param n the dividend, replaced by the quotient.
+/// @param base the divisor.
+/// @return the remainder.
+static inline uint32_t div64_32(ktime_t *n, uint32_t base)
+{
+    uint32_t high = (uint32_t)(*n >> 32), low = (uint32_t)*n, rem = 0, quot_high = 0;
+    // Step 1: divide the upper half, so that the second division fits 32 bits.
+    if (high >= base) {
+        quot_high = high / base;
+        high      = high % base;
+    }
+    // Step 2: divide the remainder of the upper half, joined to the lower half.
+    __asm__("divl %4" : "=a"(low), "=d"(rem) : "a"(low), "d"(high), "rm"(base));
+    *n = ((ktime_t)quot_high << 32) | low;
+    return rem;
+}
+
+/// @brief Reads the Time Stamp Counter.
+/// @return the number of cycles since reset.
+/// @details Only if the CPU has it, see hrtimer_tsc_available.
+static inline ktime_t rdtsc(void)
+{
+    // The "A" constraint is edx:eax only in 32-bit mode, name both halves.
+    uint32_t low, high;
+    __asm__ __volatile__("rdtsc" : "=a"(low), "=d"(high));
+    return ((ktime_t)high << 32) | low;
+}
+
+/// @brief Calibrates the clock source and initializes the queue of timers.
+void hrtimer_install(void);
+
+/// @brief Checks if the clock source is the TSC.
+/// @return true if the CPU has a TSC, and it was calibrated.
+bool_t hrtimer_tsc_available(void);
+
+/// @brief Returns the time elapsed since boot.
+/// @return the time in nanoseconds.
+/// @details Uses the TSC when the CPU has one, the ticks otherwise.
+ktime_t hrtimer_get_time(void);
+
+/// @brief Returns the time elapsed since boot, and how to extend it with the
+/// TSC, for those reading the TSC on their own (e.g., the vDSO).
+/// @param tsc where the value of the TSC matching the time is stored, 0 if
+/// the clock does not use the TSC.
+/// @param mult where the nanoseconds per cycle are stored, with TSC_SHIFT
+/// fractional bits, 0 if the clock does not use the TSC.
+/// @return the time in nanoseconds.
+ktime_t hrtimer_get_clock(ktime_t *tsc, uint32_t *mult);
+
+/// @brief Initializes a timer.
+/// @param timer the timer.
+/// @param function the function executed when the timer expires.
+/// @param data custom data which can be used by the function.
+void hrtimer_init(hrtimer_t *timer, void (*function)(hrtimer_t *), unsigned long data);
+
+/// @brief Starts a timer, restarting it if it is already queued.
+/// @param timer the timer.
+/// @param expires the time, in nanoseconds since boot, when the timer expires.
+void hrtimer_start(hrtimer_t *timer, ktime_t expires);
+
+/// @brief Starts a timer which can expire up to slack nanoseconds late,
+/// restarting it if it is already queued.
+/// @param timer the timer.
+/// @param expires the time, in nanoseconds since boot, when the timer expires.
+/// @param slack how late the timer can expire.
+/// @details The expiry is moved, within the slack, to the coarsest time it
+/// can, so that timers which expire close to each other expire together, and
+/// wake up the CPU once.
+void hrtimer_start_range(hrtimer_t *timer, ktime_t expires, ktime_t slack);
+
+/// @brief Stops a timer.
+/// @param timer the timer.
+/// @return 1 if the timer was queued, 0 otherwise.
+int hrtimer_cancel(hrtimer_t *timer);
+
+/// @brief Executes the functions of the expired timers.
+void hrtimer_run_queues(void);
+
+/// @brief Returns when the first queued timer expires.
+/// @param expires where the time, in nanoseconds since boot, is stored.
+/// @return 1 if there is a queued timer, 0 otherwise.
+int hrtimer_get_next_expiry(ktime_t *expires);
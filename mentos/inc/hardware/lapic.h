@@ -0,0 +1,54 @@
+/// @file lapic.h
+/// @brief Local APIC, the interrupt controller private to each CPU.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#pragma once
+
+#include "stdint.h"
+
+/// @brief The vector of the spurious interrupts of the local APIC, whose low
+/// four bits must be set on older CPUs.
+#define LAPIC_SPURIOUS_VECTOR 0xFF
+
+/// @brief Maps the registers of the local APIC, and enables the one of the
+/// calling CPU.
+/// @param phy_address the physical address of the registers, which is the
+/// same for every CPU.
+/// @return 0 on success, -1 on failure.
+int lapic_install(uint32_t phy_address);
+
+/// @brief Maps the registers of the local APIC at the address reported by the
+/// CPU itself, for machines which do not describe it in the MP tables.
+/// @return 0 on success, or if they are already mapped, -1 on failure.
+int lapic_install_default(void);
+
+/// @brief Enables the local APIC of the calling CPU.
+void lapic_enable(void);
+
+/// @brief Checks if the registers of the local APIC are mapped.
+/// @return 1 if they are, 0 otherwise.
+int lapic_available(void);
+
+/// @brief Returns the ID of the local APIC of the calling CPU.
+/// @return the ID.
+uint8_t lapic_get_id(void);
+
+/// @brief Sends an INIT inter-processor interrupt, which resets a CPU.
+/// @param apic_id the ID of the local APIC of the target CPU.
+void lapic_send_init(uint8_t apic_id);
+
+/// @brief Sends a STARTUP inter-processor interrupt, which starts a CPU in
+/// real mode at a given page.
+/// @param apic_id the ID of the local APIC of the target CPU.
+/// @param page the physical page where the CPU starts executing (address >> 12).
+void lapic_send_startup(uint8_t apic_id, uint8_t page);
+
+/// @brief Delivers the overflows of the performance counters of the calling
+/// CPU as non-maskable interrupts. The CPU masks the entry at each delivery, so
+/// the handler calls this again to receive the next one.
+void lapic_set_perf_nmi(void);
+
+/// @brief Signals the end of the interrupt being served to the local APIC of
+/// the calling CPU, needed by the interrupts it delivers (e.g., MSI).
+void lapic_eoi(void);
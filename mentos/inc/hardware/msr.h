@@ -0,0 +1,30 @@
+/// @file msr.h
+/// @brief Access to the model-specific registers.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#pragma once
+
+#include "stdint.h"
+
+/// The base of the local APIC, and its global enable bit.
+#define MSR_APIC_BASE 0x01B
+
+/// @brief Reads a model-specific register.
+/// @param msr the register.
+/// @return the value, with the high half from edx.
+static inline unsigned long long rdmsr(uint32_t msr)
+{
+    // The "A" constraint is edx:eax only in 32-bit mode, name both halves.
+    uint32_t low, high;
+    __asm__ __volatile__("rdmsr" : "=a"(low), "=d"(high) : "c"(msr));
+    return ((unsigned long long)high << 32) | low;
+}
+
+/// @brief Writes a model-specific register.
+/// @param msr the register.
+/// @param value the value, whose high half goes in edx.
+static inline void wrmsr(uint32_t msr, unsigned long long value)
+{
+    __asm__ __volatile__("wrmsr" : : "c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)));
+}
@@ -0,0 +1,77 @@
+/// @file pmu.h
+/// @brief Architectural performance counters, and the sampling profiler.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#pragma once
+
+#include "stddef.h"
+#include "stdint.h"
+#include "sys/types.h"
+
+/// @brief The events counted for each task.
+typedef enum pmu_event_t {
+    PMU_CYCLES,       ///< Unhalted core cycles.
+    PMU_INSTRUCTIONS, ///< Retired instructions.
+    PMU_LLC_MISSES,   ///< Misses of the last level cache.
+    PMU_EVENT_NUM     ///< The number of events.
+} pmu_event_t;
+
+/// The number of samples kept by the profiler, the oldest are overwritten.
+#define PMU_PROFILE_SAMPLES 4096
+
+/// The shortest sampling period, in cycles, which keeps the machine usable.
+#define PMU_PROFILE_MIN_PERIOD 10000
+
+/// @brief A sample of the profiler.
+typedef struct pmu_sample_t {
+    /// The instruction which was interrupted.
+    uint32_t eip;
+    /// The task which was running, 0 if none.
+    pid_t pid;
+    /// Set if the instruction belongs to user mode.
+    int user;
+} pmu_sample_t;
+
+struct task_struct;
+
+/// @brief Detects and programs the performance counters of the calling CPU.
+/// @return 0 on success, -1 if the CPU has no architectural counters.
+int pmu_init(void);
+
+/// @brief Checks if an event is counted.
+/// @param event the event.
+/// @return 1 if it is, 0 otherwise.
+int pmu_event_available(pmu_event_t event);
+
+/// @brief Charges the events counted since the last switch to the task which
+/// is leaving the CPU.
+/// @param prev the task which was running.
+void pmu_switch(struct task_struct *prev);
+
+/// @brief Returns the events counted for a task, including the ones of the
+/// current run if the task is running.
+/// @param task the task.
+/// @param event the event.
+/// @return the count.
+unsigned long long pmu_task_count(struct task_struct *task, pmu_event_t event);
+
+/// @brief Starts sampling, discarding the previous samples.
+/// @param period the number of cycles between two samples.
+/// @return 0 on success, -ENODEV without the counter or the local APIC,
+/// -EINVAL if the period is out of range.
+int pmu_profile_start(uint32_t period);
+
+/// @brief Stops sampling, the samples are kept.
+void pmu_profile_stop(void);
+
+/// @brief Returns the sampling period.
+/// @return the period in cycles, 0 if the profiler is stopped.
+uint32_t pmu_profile_period(void);
+
+/// @brief Copies the samples, from the oldest to the newest.
+/// @param samples where they are copied, PMU_PROFILE_SAMPLES at most.
+/// @param total where the number of samples taken since the start is stored,
+/// which exceeds the copied ones when the oldest were overwritten.
+/// @return the number of samples copied.
+size_t pmu_profile_snapshot(pmu_sample_t *samples, unsigned long *total);
@@ -0,0 +1,83 @@
+/// @file smp.h
+/// @brief Symmetric multiprocessing: discovery and start-up of the CPUs, and
+/// per-CPU data.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// The CPUs are listed by the MultiProcessor table of the firmware. The
+/// bootstrap processor (BSP) wakes the application processors (APs) up with
+/// an INIT and two STARTUP inter-processor interrupts, which start them in
+/// real mode on a trampoline copied in low memory. The index of the calling
+/// CPU is given by the TSS it has loaded, every CPU has its own.
+///
+/// This is the bring-up of the APs only: once online, they park with the
+/// interrupts disabled, and every task runs on the BSP. Running tasks on them
+/// needs a tick of their local APIC, an idle loop calling scheduler_run, and
+/// locking safe on more than one CPU, which the kernel does not have yet.
+
+#pragma once
+
+#include "descriptor_tables/gdt.h"
+#include "kernel.h"
+#include "stdbool.h"
+#include "stdint.h"
+
+/// The maximum number of CPUs.
+#define SMP_MAX_CPUS 8
+
+/// The dimension of the kernel stack of each application processor.
+#define SMP_STACK_SIZE (16 * K)
+
+/// @brief The data private to each CPU.
+typedef struct cpu_t {
+    /// The index of the CPU, used to access the per-CPU data.
+    unsigned id;
+    /// The ID of its local APIC.
+    uint8_t apic_id;
+    /// If the CPU is up and running.
+    volatile bool_t online;
+    /// The top of the kernel stack used when entering the kernel from user mode.
+    uintptr_t kernel_stack;
+    /// Number of spinlocks held, and of preempt_disable(), on the CPU: while
+    /// it is not zero, the running task must not give the CPU away.
+    volatile int preempt_count;
+    /// Ticks spent running processes in user mode, the niced ones apart.
+    unsigned long user_ticks;
+    /// Ticks spent running niced processes in user mode.
+    unsigned long nice_ticks;
+    /// Ticks spent inside the kernel.
+    unsigned long system_ticks;
+    /// Ticks spent with nothing to run.
+    unsigned long idle_ticks;
+} cpu_t;
+
+/// The per-CPU data.
+extern cpu_t cpus[SMP_MAX_CPUS];
+
+/// The number of CPUs listed by the firmware, which are online if they
+/// started correctly.
+extern unsigned smp_num_cpus;
+
+/// @brief Returns the index of the calling CPU.
+/// @return the index, 0 for the bootstrap processor.
+static inline unsigned smp_processor_id(void)
+{
+    uint16_t selector;
+    // The task register holds the selector of the TSS of the CPU, it is zero
+    // before the first TSS is loaded, during the boot of the BSP.
+    __asm__ __volatile__("str %0" : "=r"(selector));
+    return selector ? (selector / 8u) - GDT_TSS_INDEX : 0;
+}
+
+/// @brief Returns the data private to the calling CPU.
+/// @return a pointer to the data.
+static inline cpu_t *this_cpu(void)
+{
+    return &cpus[smp_processor_id()];
+}
+
+/// @brief Initializes the data of the bootstrap processor, discovers the
+/// other CPUs and starts them.
+/// @details Needs the timer, to wait between the start-up interrupts, and the
+/// dynamic memory, for the stacks.
+void smp_init(void);
@@ -29,8 +29,14 @@
 /// time consumed by the process.
 #define ITIMER_PROF 2
 
+/// Number of ticks per seconds, unless changed with `hz=` on the command line.
+#define TIMER_DEFAULT_HZ 1193
+
+/// Number of ticks per seconds, chosen at boot.
+extern uint32_t timer_hz;
+
 /// Number of ticks per seconds.
-#define TICKS_PER_SECOND 1193
+#define TICKS_PER_SECOND timer_hz
 
 /// @brief   Handles the timer.
 /// @param f The interrupt stack frame.
@@ -56,6 +62,15 @@ unsigned long timer_get_ticks(void);
 /// @param hz The frequency to set.
 void timer_phase(const uint32_t hz);
 
+#ifdef ENABLE_DYNTICKS
+/// @brief Brings the next timer interrupt forward, if a timer, or the
+/// time-sharing between ready processes, needs it before the one currently
+/// programmed.
+/// @details With ENABLE_DYNTICKS, the PIT is programmed one-shot for the next
+/// event, instead of interrupting at every tick.
+void timer_dynticks_kick(void);
+#endif
+
 // ===============================================================================
 // Per-CPU timer vectors
 
@@ -121,13 +136,32 @@ struct timer_list {
     void (*function)(unsigned long);
     /// Custom data to be passed to the timer function
     unsigned long data;
+    /// How many ticks late the timer can expire, TIMER_SLACK_DEFAULT for
+    /// 1/256 of its delay.
+    long slack;
     /// Pointer to the structure containing all the other related timers.
     tvec_base_t *base;
 };
 
+/// The slack of a timer is 1/256 of its delay, that is about 0.4%.
+#define TIMER_SLACK_DEFAULT (-1)
+
 /// @brief Initialize dynamic timer system
 void dynamic_timers_install(void);
 
+/// @brief Allocates a timer, from the cache of timers.
+/// @return the timer, with the default slack, NULL if there is no memory.
+/// @details Once added, the timer is freed after it expires.
+struct timer_list *timer_list_alloc(void);
+
+/// @brief Sets how late a timer can expire.
+/// @param timer the timer, not yet added.
+/// @param slack the slack in ticks, 0 for none, or TIMER_SLACK_DEFAULT.
+/// @details When a timer is added, its expiry is moved within the slack to
+/// the coarsest tick it can, so that timers which expire close to each other
+/// expire on the same tick.
+void set_timer_slack(struct timer_list *timer, long slack);
+
 /// @brief Initializes a new timer struct.
 /// @param timer The timer to initialize.
 void init_timer(struct timer_list *timer);
@@ -136,7 +170,7 @@ void init_timer(struct timer_list *timer);
 void run_timer_softirq(void);
 
 /// @brief Add a new timer to the current CPU.
-/// @param timer The timer to add.
+/// @param timer The timer to add, allocated with timer_list_alloc.
 void add_timer(struct timer_list *timer);
 
 /// @brief Removes a timer from the current CPU.
@@ -193,6 +227,14 @@ int sys_getitimer(int which, struct itimerval *curr_value);
 /// @return Zero on success, or a negative value indicating the error.
 int sys_setitimer(int which, const struct itimerval *new_value, struct itimerval *old_value);
 
+/// Forward declaration of the resources returned by getrusage.
+struct rusage;
+
+/// @brief Converts the resources used by a task to the format of getrusage.
+/// @param usage where the resources are stored.
+/// @param rusage the resources used by the task.
+void timer_rusage_to_user(struct rusage *usage, const task_rusage_t *rusage);
+
 /// @brief Update the profiling timer and generate SIGPROF if it has expired.
 /// @param proc The process for which we must update the profiling.
 void update_process_profiling_timer(task_struct *proc);
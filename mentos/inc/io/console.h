@@ -0,0 +1,51 @@
+/// @file console.h
+/// @brief The console, where the kernel and the terminal write.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#pragma once
+
+#include "stddef.h"
+
+#define CONSOLE_VGA     (1U << 0) ///< The VGA screen, with the keyboard.
+#define CONSOLE_SERIAL0 (1U << 1) ///< The first serial port, /dev/ttyS0.
+#define CONSOLE_SERIAL1 (1U << 2) ///< The second serial port, /dev/ttyS1.
+#define CONSOLE_VIRTIO  (1U << 3) ///< The virtio console, hvc0.
+
+/// @brief Selects the console from the kernel command line.
+/// @param cmdline the command line, NULL if there is none.
+/// @details The option is `console=` followed by a list of devices separated
+/// by commas, among `tty0` (or `vga`), `ttyS0`, `ttyS1` and `hvc0`, e.g.,
+/// `console=tty0,ttyS0` mirrors the screen on the serial port. Without it,
+/// the console is the screen.
+void console_setup(const char *cmdline);
+
+/// @brief Returns the devices of the console.
+/// @return a mask of CONSOLE_VGA, CONSOLE_SERIAL0, etc.
+unsigned console_get_devices(void);
+
+/// @brief Writes a character on the console.
+/// @param c the character.
+void console_putc(int c);
+
+/// @brief Writes a string on the console.
+/// @param str the string.
+void console_puts(const char *str);
+
+/// @brief Writes a buffer on the console.
+/// @param buffer the characters.
+/// @param count the number of characters.
+void console_write(const char *buffer, size_t count);
+
+/// @brief Ends a line of the boot log with the result of a step, e.g.,
+/// `[OK]`, which on the screen is aligned to the right edge.
+/// @param status the result.
+void console_print_result(const char *status);
+
+/// @brief Delivers a character received by a remote console device to the
+/// terminal, as if it was typed on the keyboard.
+/// @param device the device which received it, e.g., CONSOLE_SERIAL0.
+/// @param c the character.
+/// @return 1 if the device is part of the console, 0 if the character is
+/// left to the device.
+int console_input(unsigned device, int c);
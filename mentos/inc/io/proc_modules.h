@@ -19,6 +19,38 @@ int procs_module_init(void);
 /// @return 0 on success, 1 on failure.
 int procfb_module_init(void);
 
+/// @brief Initializes the statistics of the system calls.
+/// @return 0 on success, 1 on failure.
+int procsc_module_init(void);
+
+/// @brief Initializes the contention statistics of the locks.
+/// @return 0 on success, 1 on failure.
+int proclock_module_init(void);
+
+/// @brief Initializes the I/O statistics of the block devices.
+/// @return 0 on success, 1 on failure.
+int procdisk_module_init(void);
+
+/// @brief Initializes the files of the latency tracer.
+/// @return 0 on success, 1 on failure.
+int proclat_module_init(void);
+
+/// @brief Initializes the file of the function profile.
+/// @return 0 on success, 1 on failure.
+int procfunc_module_init(void);
+
+/// @brief Initializes the file of the sampling profiler.
+/// @return 0 on success, 1 on failure.
+int procprof_module_init(void);
+
+/// @brief Initializes the files of the tracepoints.
+/// @return 0 on success, 1 on failure.
+int proctrace_module_init(void);
+
 /// @brief Initializes the IPC information system.
 /// @return 0 on success, 1 on failure.
 int procipc_module_init(void);
+
+/// @brief Initializes the tunables under `/proc/sys`.
+/// @return 0 on success, 1 on failure.
+int procsysctl_module_init(void);
@@ -11,9 +11,16 @@ void vga_initialize(void);
 /// @brief Finalizes the VGA.
 void vga_finalize(void);
 
-/// @brief Updates the graphic elements.
+/// @brief Updates the graphic elements (the blink of the cursor), and copies
+/// them to the video memory.
 void vga_update(void);
 
+/// @brief Copies what was drawn since the last call to the video memory.
+/// @details The drawing functions write into a back buffer, one byte for each
+/// pixel, and only the area they changed is converted to the format of the
+/// video memory.
+void vga_flush(void);
+
 /// @brief Checks if the VGA is enabled.
 /// @return 1 if enabled, 0 otherwise.
 int vga_is_enabled(void);
@@ -71,6 +78,14 @@ void vga_draw_line(int x0, int y0, int x1, int y1, unsigned char color);
 /// @param color color of the rectangle.
 void vga_draw_rectangle(int sx, int sy, int w, int h, unsigned char color);
 
+/// @brief Fills a rectangle provided the position of the top-left corner and its size.
+/// @param sx top-left corner x-axis position.
+/// @param sy top-left corner y-axis position.
+/// @param w width.
+/// @param h height.
+/// @param color color of the rectangle.
+void vga_fill_rectangle(int sx, int sy, int w, int h, unsigned char color);
+
 /// @brief Draws a circle provided the position of the center and the radius.
 /// @param xc x-axis position.
 /// @param yc y-axis position.
@@ -5,13 +5,21 @@
 
 #pragma once
 
+#include "stddef.h"
 #include "stdint.h"
 #include "io/ansi_colors.h"
 
 /// @brief Initialize the video.
 void video_init(void);
 
-/// @brief Updates the video.
+/// @brief Starts the timer which periodically asks for a refresh of the screen.
+/// @details Called once the timers are installed.
+void video_start_refresh(void);
+
+/// @brief Refreshes the screen, if the refresh timer asked for it.
+/// @details The refresh is deferred to this function, which is called on the
+/// way back from system calls and while the CPU is idle, so that it does not
+/// add to the latency of the timer interrupt.
 void video_update(void);
 
 /// @brief Print the given character on the screen.
@@ -22,6 +30,14 @@ void video_putc(int c);
 /// @param str The string to print.
 void video_puts(const char *str);
 
+/// @brief Prints the given characters on the screen, updating the video
+/// memory and the hardware cursor once at the end.
+/// @details Runs of printable characters are drawn in a single pass, only
+/// escape sequences and control characters are parsed one by one.
+/// @param buffer The characters to print.
+/// @param count The number of characters.
+void video_write(const char *buffer, size_t count);
+
 /// @brief When something is written in another position, update the cursor.
 void video_set_cursor_auto(void);
 
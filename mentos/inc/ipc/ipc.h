@@ -5,12 +5,55 @@
 
 #pragma once
 
+#include "klib/hashmap.h"
 #include "sys/ipc.h"
 
 #ifndef __KERNEL__
 #error "How did you include this file... include `libc/inc/sys/ipc.h` instead!"
 #endif
 
+/// The number of buckets of the tables indexing the IPC instances.
+#define IPC_IDS_BUCKETS 256
+
+/// @brief Indexes the instances of an IPC kind, by id and by key.
+typedef struct ipc_ids_t {
+    /// The instances, by id. Ids are handed out sequentially, thus they fill
+    /// the buckets evenly.
+    hashmap_t *by_id;
+    /// The instances, by key.
+    hashmap_t *by_key;
+} ipc_ids_t;
+
+/// @brief Initializes the tables.
+/// @param ids the tables.
+/// @return 0 on success, -1 on failure.
+int ipc_ids_init(ipc_ids_t *ids);
+
+/// @brief Adds an instance to the tables.
+/// @param ids the tables.
+/// @param id the id of the instance.
+/// @param key the key of the instance.
+/// @param entry the instance.
+void ipc_ids_add(ipc_ids_t *ids, int id, key_t key, void *entry);
+
+/// @brief Removes an instance from the tables.
+/// @param ids the tables.
+/// @param id the id of the instance.
+/// @param key the key of the instance.
+void ipc_ids_remove(ipc_ids_t *ids, int id, key_t key);
+
+/// @brief Searches for the instance with the given id.
+/// @param ids the tables.
+/// @param id the id.
+/// @return the instance, NULL if there is none.
+void *ipc_ids_find_by_id(ipc_ids_t *ids, int id);
+
+/// @brief Searches for the instance with the given key.
+/// @param ids the tables.
+/// @param key the key.
+/// @return the instance, NULL if there is none.
+void *ipc_ids_find_by_key(ipc_ids_t *ids, key_t key);
+
 int ipc_valid_permissions(int flags, struct ipc_perm *perm);
 
 struct ipc_perm register_ipc(key_t key, mode_t mode);
@@ -10,6 +10,9 @@
 /// @brief The initial stack pointer.
 extern uintptr_t initial_esp;
 
+/// @brief Number of processors for which per-CPU data is kept.
+#define NR_CPUS 1
+
 /// Kilobytes.
 #define K 1024
 /// Megabytes.
@@ -5,8 +5,6 @@
 
 #pragma once
 
-#include "klib/list.h"
-
 // == OPAQUE TYPES ============================================================
 /// @brief Stores information of an entry of the hashmap.
 typedef struct hashmap_entry_t hashmap_entry_t;
@@ -35,7 +33,7 @@ unsigned int hashmap_int_hash(const void *key);
 /// @return Result of the comparison.
 int hashmap_int_comp(const void *a, const void *b);
 
-/// @brief Transforms a string key into a hash key.
+/// @brief Transforms a string key into a hash key, with FNV-1a.
 /// @param key The string key.
 /// @return The resulting hash key.
 unsigned int hashmap_str_hash(const void *key);
@@ -57,7 +55,7 @@ void hashmap_do_not_free(void *value);
 
 // == HASHMAP CREATION AND DESTRUCTION ========================================
 /// @brief User-defined hashmap.
-/// @param size Dimension of the hashmap.
+/// @param size The number of entries expected, the hashmap grows past it.
 /// @param hash_fun     The hashing function.
 /// @param comp_fun     The hash compare function.
 /// @param dupe_fun     The key duplication function.
@@ -74,7 +72,7 @@ hashmap_t *hashmap_create(
     hashmap_free_t key_free_fun);
 
 /// @brief Standard hashmap with keys of type (char *).
-/// @param size Dimension of the hashmap.
+/// @param size The number of entries expected, the hashmap grows past it.
 /// @return A pointer to the hashmap.
 /// @details
 ///     (key_free_fun) : Standard `free` function.
@@ -82,7 +80,7 @@ hashmap_t *hashmap_create(
 hashmap_t *hashmap_create_str(unsigned int size);
 
 /// @brief Standard hashmap with keys of type (char *).
-/// @param size Dimension of the hashmap.
+/// @param size The number of entries expected, the hashmap grows past it.
 /// @return A pointer to the hashmap.
 /// @details
 ///     (key_free_fun) : No free function.
@@ -124,12 +122,27 @@ int hashmap_is_empty(hashmap_t *map);
 /// @return 1 if the entry is present, 0 otherwise.
 int hashmap_has(hashmap_t *map, const void *key);
 
-/// @brief Provides access to all the keys.
-/// @param map The hashmap.
-/// @return A list with all the keys, remember to destroy the list.
-list_t *hashmap_keys(hashmap_t *map);
-
-/// @brief Provides access to all the values.
+// == HASHMAP ITERATION =======================================================
+/// @brief Walks over the entries of a hashmap, without allocating.
+/// @details The hashmap must not be changed while it is walked, since the
+/// updates move its entries.
+typedef struct hashmap_iter_t {
+    /// The hashmap.
+    hashmap_t *map;
+    /// The next slot to visit.
+    unsigned int index;
+    /// 1 once the old table, left by a growth, is being visited.
+    int old;
+} hashmap_iter_t;
+
+/// @brief Starts walking over the entries of a hashmap.
+/// @param it The iterator.
 /// @param map The hashmap.
-/// @return A list with all the values, remember to destroy the list.
-list_t *hashmap_values(hashmap_t *map);
+void hashmap_iter_init(hashmap_iter_t *it, hashmap_t *map);
+
+/// @brief Moves to the next entry.
+/// @param it The iterator.
+/// @param key Where the key is stored, can be NULL.
+/// @param value Where the value is stored, can be NULL.
+/// @return 1 if there was another entry, 0 at the end.
+int hashmap_iter_next(hashmap_iter_t *it, void **key, void **value);
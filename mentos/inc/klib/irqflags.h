@@ -8,12 +8,13 @@
 #include "proc_access.h"
 #include "stddef.h"
 #include "stdint.h"
+#include "system/latency_trace.h"
 
 /// @brief   Enable IRQs (nested).
 /// @details If called after calling irq_disable, this function will not
 /// activate IRQs if they were not active before.
 /// @param flags the flags to control this behaviour.
-inline static void irq_enable(uint8_t flags)
+inline static void __irq_enable(uint8_t flags)
 {
     if (flags) {
         sti();
@@ -26,7 +27,7 @@ inline static void irq_enable(uint8_t flags)
 /// shouldn't be activated if they were not activated before calling this
 /// function.
 /// @return 1 if the IRQ is enable for the CPU.
-inline static uint8_t irq_disable(void)
+inline static uint8_t __irq_disable(void)
 {
     size_t flags;
     // We are pushing the entire contents of the EFLAGS register onto the stack,
@@ -39,6 +40,45 @@ inline static uint8_t irq_disable(void)
     return flags & (1 << 9);
 }
 
+#ifdef ENABLE_LATENCY_TRACE
+
+/// @brief Enable IRQs (nested), ending the section traced since they were
+/// disabled. Never inlined, so that its return address tells the caller.
+/// @param flags the value returned by irq_disable.
+static void __attribute__((noinline)) __irq_enable_traced(uint8_t flags)
+{
+    if (flags) {
+        latency_irqs_on((unsigned long)__builtin_return_address(0));
+    }
+    __irq_enable(flags);
+}
+
+/// @brief Disable IRQs (nested), starting a traced section if they were
+/// enabled. Never inlined, so that its return address tells the caller.
+/// @return 1 if the IRQ is enable for the CPU.
+static uint8_t __attribute__((noinline)) __irq_disable_traced(void)
+{
+    uint8_t flags = __irq_disable();
+    if (flags) {
+        latency_irqs_off((unsigned long)__builtin_return_address(0));
+    }
+    return flags;
+}
+
+/// @brief Enable IRQs (nested), see __irq_enable.
+#define irq_enable(flags) __irq_enable_traced(flags)
+/// @brief Disable IRQs (nested), see __irq_disable.
+#define irq_disable() __irq_disable_traced()
+
+#else
+
+/// @brief Enable IRQs (nested), see __irq_enable.
+#define irq_enable(flags) __irq_enable(flags)
+/// @brief Disable IRQs (nested), see __irq_disable.
+#define irq_disable() __irq_disable()
+
+#endif
+
 /// @brief Determines, if the interrupt flags (IF) is set.
 /// @return 1 if the IRQ is enable for the CPU.
 inline static uint8_t is_irq_enabled(void)
@@ -0,0 +1,86 @@
+/// @file lock_stat.h
+/// @brief Contention statistics of the spinlocks and of the mutexes.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// With ENABLE_LOCK_STAT, spinlock_init and mutex_init declare a static
+/// lock class at each place they are called, named after their argument, so
+/// that all the locks initialized by the same line share their statistics,
+/// as the locks of the objects which get freed cannot keep their own. The
+/// waits and the holds are measured in TSC cycles, and the counters are kept
+/// per CPU, thus they are updated without atomic operations. The classes are
+/// listed by `/proc/lock_stat`, sorted by contention.
+
+#pragma once
+
+#ifdef ENABLE_LOCK_STAT
+
+#include "hardware/hrtimer.h"
+#include "hardware/smp.h"
+#include "klib/stdatomic.h"
+
+/// @brief The statistics of a class of locks, gathered by one CPU.
+typedef struct lock_stat_t {
+    /// Number of times a lock was taken.
+    unsigned long acquired;
+    /// Number of times a lock was taken after waiting for it.
+    unsigned long contended;
+    /// Total cycles spent waiting for the locks.
+    ktime_t wait_total;
+    /// Longest wait, in cycles.
+    ktime_t wait_max;
+    /// Total cycles the locks were held.
+    ktime_t hold_total;
+    /// Longest hold, in cycles.
+    ktime_t hold_max;
+} lock_stat_t;
+
+/// @brief The locks initialized by the same line of code.
+typedef struct lock_class_t {
+    /// The expression naming the lock, where it is initialized.
+    const char *name;
+    /// The type of lock, `spin` or `mutex`.
+    const char *type;
+    /// Set once the class is in the list of classes.
+    atomic_t registered;
+    /// The next class in the list.
+    struct lock_class_t *next;
+    /// The statistics gathered by each CPU.
+    lock_stat_t stat[SMP_MAX_CPUS];
+} lock_class_t;
+
+/// @brief Declares the lock class of an initialization site.
+/// @param var the name of the variable.
+/// @param lock the expression naming the lock.
+/// @param kind the type of lock, `spin` or `mutex`.
+#define LOCK_CLASS_DECLARE(var, lock, kind) \
+    static lock_class_t var = { .name = #lock, .type = kind }
+
+/// @brief Adds the class to the list of classes, the first time it is used.
+/// @param class the class.
+void lock_stat_register(lock_class_t *class);
+
+/// @brief Accounts a lock taken by the calling CPU.
+/// @param class the class of the lock, or NULL.
+/// @param wait the cycles spent waiting for it, 0 if it was free.
+void lock_stat_acquired(lock_class_t *class, ktime_t wait);
+
+/// @brief Accounts a lock released by the calling CPU.
+/// @param class the class of the lock, or NULL.
+/// @param hold the cycles it was held.
+void lock_stat_released(lock_class_t *class, ktime_t hold);
+
+/// @brief Sums the statistics gathered by all the CPUs.
+/// @param class the class.
+/// @param total where the sum is stored.
+void lock_stat_sum(const lock_class_t *class, lock_stat_t *total);
+
+/// @brief Calls a function on each class.
+/// @param fn the function.
+/// @param data custom data passed to the function.
+void lock_stat_for_each(void (*fn)(lock_class_t *class, void *data), void *data);
+
+/// @brief Clears the statistics of all the classes.
+void lock_stat_reset(void);
+
+#endif
@@ -1,25 +1,75 @@
 /// @file mutex.h
-/// @brief
+/// @brief Sleeping mutex.
 /// @copyright (c) 2014-2024 This file is distributed under the MIT License.
 /// See LICENSE.md for details.
+/// @details
+/// Taking a free mutex, and releasing one nobody waits for, is a single
+/// atomic instruction. The tasks finding it locked sleep on its wait queue,
+/// and the unlock wakes them up only if some of them are waiting.
 
 #pragma once
 
-#include "stdint.h"
+#include "klib/lock_stat.h"
+#include "klib/stdatomic.h"
+#include "process/wait.h"
 
 /// @brief Structure of a mutex.
 typedef struct mutex_t {
-    /// The state of the mutex.
-    uint8_t state;
-    /// The owner of the mutex.
-    uint32_t owner;
+    /// 0 if it is free, 1 if it is locked, 2 if it is locked and some task
+    /// might be waiting for it.
+    atomic_t state;
+    /// The task holding the mutex.
+    struct task_struct *owner;
+    /// The tasks waiting for the mutex.
+    wait_queue_head_t wait;
+#ifdef ENABLE_LOCK_STAT
+    /// The class gathering the statistics, NULL if not initialized by mutex_init.
+    lock_class_t *class;
+    /// The TSC when the mutex was taken.
+    ktime_t hold_start;
+#endif
 } mutex_t;
 
-/// @brief       Allows to lock a mutex.
+/// @brief Initializer of a free mutex, for the statically allocated ones.
+/// @param name The name of the mutex being initialized.
+#define MUTEX_INIT(name)                                                           \
+    {                                                                              \
+        .state = 0, .owner = NULL,                                                 \
+        .wait  = {.task_list = { &(name).wait.task_list, &(name).wait.task_list } } \
+    }
+
+#ifdef ENABLE_LOCK_STAT
+
+/// @brief       Initializes the mutex, as free, with the class of the caller.
+/// @param mutex The mutex to initialize.
+/// @param class The class gathering its statistics.
+void __mutex_init(mutex_t *mutex, lock_class_t *class);
+
+/// @brief       Initializes the mutex, as free, accounting it to the class of this line.
+/// @param mutex The mutex to initialize.
+#define mutex_init(mutex)                                          \
+    do {                                                           \
+        LOCK_CLASS_DECLARE(__mutex_class, mutex, "mutex");         \
+        __mutex_init((mutex), &__mutex_class);                     \
+    } while (0)
+
+#else
+
+/// @brief       Initializes the mutex, as free.
+/// @param mutex The mutex to initialize.
+void mutex_init(mutex_t *mutex);
+
+#endif
+
+/// @brief       Locks the mutex, sleeping until it is free.
+/// @param mutex The mutex to lock.
+void mutex_lock(mutex_t *mutex);
+
+/// @brief       Tries to lock the mutex, without waiting.
 /// @param mutex The mutex to lock.
-/// @param owner The one who request the lock.
-void mutex_lock(mutex_t *mutex, uint32_t owner);
+/// @return 1 if it was locked, 0 if it is held by someone else.
+int mutex_trylock(mutex_t *mutex);
 
-/// @brief       Unlocks the mutex.
+/// @brief       Unlocks the mutex, waking up the tasks waiting for it.
 /// @param mutex The mutex to unlock.
 void mutex_unlock(mutex_t *mutex);
@@ -0,0 +1,115 @@
+/// @file radix_tree.h
+/// @brief Radix tree, mapping sparse integer indices to pointers.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// Each node has 64 slots, so a 32-bit index is found in at most six steps,
+/// and the tree is only as tall as its largest index needs. Every slot also
+/// has a bit for each tag: a node has the bit of a tag set for a child if
+/// some item below the child has the tag, so the tagged items can be found
+/// without visiting the others.
+
+#pragma once
+
+#include "stdint.h"
+
+/// The number of index bits consumed by each level.
+#define RADIX_TREE_MAP_SHIFT 6
+/// The number of slots of a node.
+#define RADIX_TREE_MAP_SIZE (1UL << RADIX_TREE_MAP_SHIFT)
+/// The number of tags of each item.
+#define RADIX_TREE_MAX_TAGS 2
+
+/// @brief The tags of the items.
+typedef enum radix_tree_tag_t {
+    RADIX_TREE_TAG_DIRTY     = 0, ///< The item has been modified.
+    RADIX_TREE_TAG_WRITEBACK = 1, ///< The item is being written back.
+} radix_tree_tag_t;
+
+/// @brief Node of the tree.
+typedef struct radix_tree_node_t radix_tree_node_t;
+
+/// @brief The tree itself, usually embedded in its owner.
+typedef struct radix_tree_t {
+    /// The root node, NULL when the tree is empty.
+    radix_tree_node_t *rnode;
+    /// The number of levels below the root, included.
+    unsigned int height;
+    /// The number of items.
+    unsigned int count;
+} radix_tree_t;
+
+/// @brief Initializes an empty tree.
+/// @param tree the tree.
+void radix_tree_init(radix_tree_t *tree);
+
+/// @brief Frees all the nodes of the tree, leaving it empty.
+/// @param tree the tree.
+/// @details The items are not touched.
+void radix_tree_destroy(radix_tree_t *tree);
+
+/// @brief Inserts an item.
+/// @param tree the tree.
+/// @param index the index of the item.
+/// @param item the item, which must not be NULL.
+/// @return 0 on success, -EEXIST if the index is taken, -ENOMEM if a node
+/// could not be allocated, -EINVAL if the item is NULL.
+int radix_tree_insert(radix_tree_t *tree, unsigned long index, void *item);
+
+/// @brief Searches an item.
+/// @param tree the tree.
+/// @param index the index of the item.
+/// @return the item, or NULL if there is none at the index.
+void *radix_tree_lookup(radix_tree_t *tree, unsigned long index);
+
+/// @brief Removes an item, with its tags.
+/// @param tree the tree.
+/// @param index the index of the item.
+/// @return the item, or NULL if there was none at the index.
+void *radix_tree_delete(radix_tree_t *tree, unsigned long index);
+
+/// @brief Sets a tag of an item.
+/// @param tree the tree.
+/// @param index the index of the item.
+/// @param tag the tag.
+/// @return 0 on success, -ENOENT if there is no item at the index.
+int radix_tree_tag_set(radix_tree_t *tree, unsigned long index, radix_tree_tag_t tag);
+
+/// @brief Clears a tag of an item.
+/// @param tree the tree.
+/// @param index the index of the item.
+/// @param tag the tag.
+void radix_tree_tag_clear(radix_tree_t *tree, unsigned long index, radix_tree_tag_t tag);
+
+/// @brief Checks a tag of an item.
+/// @param tree the tree.
+/// @param index the index of the item.
+/// @param tag the tag.
+/// @return 1 if the item exists and has the tag, 0 otherwise.
+int radix_tree_tag_get(radix_tree_t *tree, unsigned long index, radix_tree_tag_t tag);
+
+/// @brief Checks if any item has a tag.
+/// @param tree the tree.
+/// @param tag the tag.
+/// @return 1 if some item has the tag, 0 otherwise.
+int radix_tree_tagged(radix_tree_t *tree, radix_tree_tag_t tag);
+
+/// @brief Collects the items from an index on, in increasing order.
+/// @param tree the tree.
+/// @param results where the items are stored.
+/// @param indices where their indices are stored, can be NULL.
+/// @param first the smallest index to collect.
+/// @param max the size of the arrays.
+/// @return the number of items collected; less than max at the end.
+unsigned int radix_tree_gang_lookup(radix_tree_t *tree, void **results, unsigned long *indices, unsigned long first, unsigned int max);
+
+/// @brief Collects the items with a tag from an index on, in increasing
+/// order.
+/// @param tree the tree.
+/// @param results where the items are stored.
+/// @param indices where their indices are stored, can be NULL.
+/// @param first the smallest index to collect.
+/// @param max the size of the arrays.
+/// @param tag the tag.
+/// @return the number of items collected; less than max at the end.
+unsigned int radix_tree_gang_lookup_tag(radix_tree_t *tree, void **results, unsigned long *indices, unsigned long first, unsigned int max, radix_tree_tag_t tag);
@@ -56,6 +56,12 @@ void *rbtree_node_get_value(rbtree_node_t *node);
 /// @param node The node to destroy.
 void rbtree_node_dealloc(rbtree_node_t *node);
 
+/// @brief Provides access to the children of a node.
+/// @param node The node itself.
+/// @param dir  The child to return, left (0) or right (1).
+/// @return The child, NULL if there is none.
+rbtree_node_t *rbtree_node_get_link(rbtree_node_t *node, int dir);
+
 // ============================================================================
 // Tree management functions.
 
@@ -74,6 +80,22 @@ rbtree_t *rbtree_tree_create(rbtree_tree_node_cmp_f cmp);
 /// @return Pointer to tree itself.
 rbtree_t *rbtree_tree_init(rbtree_t *tree, rbtree_tree_node_cmp_f cmp);
 
+/// @brief Sets the function which updates the data a node keeps about its subtree.
+/// @param tree    The tree.
+/// @param augment Called on a node after its children have been updated, it
+/// is called whenever the subtree of the node changes.
+void rbtree_tree_set_augment(rbtree_t *tree, rbtree_tree_node_f augment);
+
+/// @brief Provides access to the root of the tree.
+/// @param tree The tree.
+/// @return The root of the tree, NULL if the tree is empty.
+rbtree_node_t *rbtree_tree_get_root(rbtree_t *tree);
+
+/// @brief Updates the subtree data of the node holding the value, and of its ancestors.
+/// @param tree  The tree.
+/// @param value The value whose associated data has changed.
+void rbtree_tree_update(rbtree_t *tree, void *value);
+
 /// @brief Deallocate a node.
 /// @param tree    The tree to destroy.
 /// @param node_cb The function called on each element of the tree before destroying the tree.
@@ -0,0 +1,75 @@
+/// @file rcu.h
+/// @brief Read-copy-update, for data read much more often than written.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// Readers take no lock: they only mark the section in which they follow the
+/// pointers. A writer publishes a new version with rcu_assign_pointer, and
+/// frees the old one only after a grace period, once every CPU which runs
+/// tasks went through a quiescent state. The kernel never switches task in
+/// the middle of a read-side section, so the context switches, noted by
+/// scheduler_run, are the quiescent states.
+
+#pragma once
+
+#include "hardware/smp.h"
+#include "klib/compiler.h"
+
+/// @brief The link of an object freed after a grace period, usually embedded
+/// in the object.
+typedef struct rcu_head_t {
+    /// The next callback waiting for the same grace period.
+    struct rcu_head_t *next;
+    /// The function called after the grace period.
+    void (*func)(struct rcu_head_t *head);
+} rcu_head_t;
+
+/// The depth of the read-side sections of each CPU.
+extern volatile unsigned rcu_nesting[SMP_MAX_CPUS];
+
+/// @brief Starts a read-side section, which can be nested.
+/// @details The section must not sleep, nor yield the CPU.
+static inline void rcu_read_lock(void)
+{
+    ++rcu_nesting[smp_processor_id()];
+    __asm__ __volatile__("" : : : "memory");
+}
+
+/// @brief Ends a read-side section.
+static inline void rcu_read_unlock(void)
+{
+    __asm__ __volatile__("" : : : "memory");
+    --rcu_nesting[smp_processor_id()];
+}
+
+/// @brief Checks if the calling CPU is inside a read-side section.
+/// @return 1 if it is, 0 otherwise.
+static inline int rcu_read_lock_held(void)
+{
+    return rcu_nesting[smp_processor_id()] != 0;
+}
+
+/// @brief Reads a pointer protected by RCU, inside a read-side section.
+#define rcu_dereference(p) READ_ONCE(p)
+
+/// @brief Publishes a pointer protected by RCU, after the object it points to
+/// has been initialized.
+#define rcu_assign_pointer(p, v)                         \
+    do {                                                 \
+        __asm__ __volatile__("" : : : "memory");         \
+        WRITE_ONCE(p, v);                                \
+    } while (0)
+
+/// @brief Calls a function once the current readers are done.
+/// @param head the link, inside the object the function frees.
+/// @param func the function, called from a tasklet.
+void call_rcu(rcu_head_t *head, void (*func)(rcu_head_t *head));
+
+/// @brief Waits for the current readers to be done.
+/// @details Only kernel threads can wait inside the kernel, the other callers
+/// must use call_rcu.
+void synchronize_rcu(void);
+
+/// @brief Notes that the calling CPU is in a quiescent state, called by the
+/// scheduler, with the interrupts disabled.
+void rcu_note_context_switch(void);
@@ -1,33 +1,109 @@
 /// @file spinlock.h
-/// @brief
+/// @brief Ticket spinlocks and MCS queued locks.
 /// @copyright (c) 2014-2024 This file is distributed under the MIT License.
 /// See LICENSE.md for details.
+/// @details
+/// A spinlock_t is a ticket lock: each CPU takes the next ticket, and waits
+/// for its turn, so that the lock is handed out in the order it was asked
+/// for. Every waiter spins on the same word, which is fine for the short
+/// critical sections of the kernel. For the contended locks, the MCS lock
+/// lets each waiter spin on its own node, and the unlock touches only the
+/// cache line of the next waiter.
 
 #pragma once
 
+#include "klib/irqflags.h"
+#include "klib/lock_stat.h"
 #include "klib/stdatomic.h"
 
-/// Determines if the spinlock is free.
-#define SPINLOCK_FREE 0
-/// Determines if the spinlock is busy.
-#define SPINLOCK_BUSY 1
-
 /// @brief Spinlock structure.
-typedef atomic_t spinlock_t;
+typedef struct spinlock_t {
+    /// The ticket being served in the low half, the next ticket to hand out
+    /// in the high half. The lock is free when they are equal.
+    atomic_t tickets;
+#ifdef ENABLE_LOCK_STAT
+    /// The class gathering the statistics, NULL if not initialized by spinlock_init.
+    lock_class_t *class;
+    /// The TSC when the lock was taken.
+    ktime_t hold_start;
+#endif
+} spinlock_t;
+
+#ifdef ENABLE_LOCK_STAT
+
+/// @brief Initialize the spinlock, with the class of the caller.
+/// @param spinlock The spinlock we initialize.
+/// @param class The class gathering its statistics.
+void __spinlock_init(spinlock_t *spinlock, lock_class_t *class);
+
+/// @brief Initialize the spinlock, accounting it to the class of this line.
+/// @param spinlock The spinlock we initialize.
+#define spinlock_init(spinlock)                                      \
+    do {                                                             \
+        LOCK_CLASS_DECLARE(__spinlock_class, spinlock, "spin");      \
+        __spinlock_init((spinlock), &__spinlock_class);              \
+    } while (0)
+
+#else
 
 /// @brief Initialize the spinlock.
 /// @param spinlock The spinlock we initialize.
 void spinlock_init(spinlock_t *spinlock);
 
-/// @brief Try to lock the spinlock.
+#endif
+
+/// @brief Lock the spinlock, waiting for the CPUs which asked for it before.
 /// @param spinlock The spinlock we lock.
 void spinlock_lock(spinlock_t *spinlock);
 
-/// @brief Try to unlock the spinlock.
+/// @brief Unlock the spinlock, handing it to the next waiting CPU.
 /// @param spinlock The spinlock we unlock.
 void spinlock_unlock(spinlock_t *spinlock);
 
-/// @brief Try to unlock the spinlock.
+/// @brief Try to lock the spinlock, without waiting.
 /// @param spinlock The spinlock we try to block.
 /// @return 1 if succeeded, 0 otherwise.
 int spinlock_trylock(spinlock_t *spinlock);
+
+/// @brief Checks if the spinlock is held.
+/// @param spinlock The spinlock.
+/// @return 1 if it is held, 0 otherwise.
+int spinlock_is_locked(spinlock_t *spinlock);
+
+/// @brief Disables the interrupts, and locks the spinlock.
+/// @param spinlock The spinlock we lock.
+/// @return the previous state of the interrupts, for spinlock_unlock_irqrestore.
+uint8_t spinlock_lock_irqsave(spinlock_t *spinlock);
+
+/// @brief Unlocks the spinlock, and restores the interrupts.
+/// @param spinlock The spinlock we unlock.
+/// @param flags The value returned by spinlock_lock_irqsave.
+void spinlock_unlock_irqrestore(spinlock_t *spinlock, uint8_t flags);
+
+/// @brief The node with which a CPU waits for an MCS lock, usually on its stack.
+typedef struct mcs_node_t {
+    /// The CPU waiting after this one.
+    struct mcs_node_t *volatile next;
+    /// Set by the previous owner when it hands the lock over.
+    volatile int locked;
+} mcs_node_t;
+
+/// @brief MCS lock, a queue of the waiting CPUs.
+typedef struct mcs_lock_t {
+    /// The last node of the queue, NULL if the lock is free.
+    mcs_node_t *volatile tail;
+} mcs_lock_t;
+
+/// @brief Initialize the MCS lock.
+/// @param lock The lock we initialize.
+void mcs_lock_init(mcs_lock_t *lock);
+
+/// @brief Lock the MCS lock, spinning on our own node.
+/// @param lock The lock we lock.
+/// @param node The node of the caller, which must live until the unlock.
+void mcs_lock(mcs_lock_t *lock, mcs_node_t *node);
+
+/// @brief Unlock the MCS lock, handing it to the next node in the queue.
+/// @param lock The lock we unlock.
+/// @param node The node used to lock it.
+void mcs_unlock(mcs_lock_t *lock, mcs_node_t *node);
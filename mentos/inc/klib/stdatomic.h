@@ -72,6 +72,22 @@ inline static int atomic_add(atomic_t *ptr, int value)
     return value;
 }
 
+/// @brief Atomically sets `value` at `ptr`, only if it holds `expected`.
+/// @param ptr the pointer we are working with.
+/// @param expected the value the variable must hold.
+/// @param value the value to set.
+/// @return the value held before the operation, equal to `expected` on success.
+inline static int atomic_cmpxchg(atomic_t *ptr, int expected, int value)
+{
+    // The compared value goes in eax, which receives the previous one.
+    __asm__ __volatile__(LOCK_PREFIX                  // Lock
+                         "cmpxchgl %2, %1"            // Instruction
+                         : "+a"(expected), "+m"(*ptr) // Input + Output
+                         : "r"(value)                 // Input
+                         : "memory");                 // Side effects
+    return expected;
+}
+
 /// @brief Atomically subtract `value` from the value pointed by `ptr`.
 /// @param ptr the pointer we are working with.
 /// @param value the value we need to subtract.
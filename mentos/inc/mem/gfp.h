@@ -92,6 +92,16 @@ typedef unsigned int gfp_t;
 
 /// @}
 
+/// @defgroup ActionModifiers Action Modifiers
+/// @brief Change the content of the allocated memory.
+/// @{
+
+/// @brief Returns zeroed pages. Single pages are taken, when possible, from a
+/// pool of pages zeroed in background.
+#define __GFP_ZERO ___GFP_ZERO
+
+/// @}
+
 /// @defgroup gfp_flag_combinations Flag Combinations
 /// @brief Useful GFP flag combinations.
 /// @details
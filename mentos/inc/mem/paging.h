@@ -5,6 +5,8 @@
 
 #pragma once
 
+#include "klib/rbtree.h"
+#include "klib/stdatomic.h"
 #include "mem/zone_allocator.h"
 #include "proc_access.h"
 #include "kernel.h"
@@ -14,6 +16,8 @@
 
 /// Size of a page.
 #define PAGE_SIZE 4096U
+/// Size of a large page, mapped by a single page directory entry (PSE).
+#define LARGE_PAGE_SIZE (1024U * PAGE_SIZE)
 /// The start of the process area.
 #define PROCAREA_START_ADDR 0x00000000
 /// The end of the process area (and start of the kernel area).
@@ -28,7 +32,7 @@ typedef struct page_dir_entry_t {
     unsigned int cache : 1;     ///< TODO: Comment.
     unsigned int accessed : 1;  ///< TODO: Comment.
     unsigned int reserved : 1;  ///< TODO: Comment.
-    unsigned int page_size : 1; ///< TODO: Comment.
+    unsigned int page_size : 1; ///< Maps a large page instead of a page table.
     unsigned int global : 1;    ///< TODO: Comment.
     unsigned int available : 3; ///< TODO: Comment.
     unsigned int frame : 20;    ///< TODO: Comment.
@@ -59,6 +63,14 @@ enum MEMMAP_FLAGS {
     // Kernel flags
     MM_COW     = 0x10, ///< Area is copy on write.
     MM_UPDADDR = 0x20, ///< Check?
+    MM_LARGE   = 0x40, ///< Use large pages where possible, only for kernel mappings.
+};
+
+/// @brief The hints about the use of a memory area, given with madvise and mlock.
+enum VM_HINTS {
+    VM_LOCKED    = 0x1, ///< The pages are mapped, and never go to the swap.
+    VM_SEQ_READ  = 0x2, ///< The pages are read in order, map further ahead.
+    VM_RAND_READ = 0x4, ///< The pages are read in random order, do not map ahead.
 };
 
 /// @brief A page table.
@@ -76,6 +88,20 @@ typedef struct page_directory_t {
     page_dir_entry_t entries[1024];
 } __attribute__((aligned(PAGE_SIZE))) page_directory_t;
 
+struct vm_area_struct_t;
+
+/// @brief Operations of the areas whose pages belong to a kernel object (e.g.,
+/// a shared memory segment), instead of a file or of the process itself.
+typedef struct vm_operations_t {
+    /// Called when the area is duplicated by fork.
+    void (*open)(struct vm_area_struct_t *area);
+    /// Called when the area is destroyed, after its pages have been unmapped.
+    void (*close)(struct vm_area_struct_t *area);
+    /// Returns the page of the object at the given index, with a reference
+    /// taken for the mapping, NULL if the access is not allowed.
+    page_t *(*fault)(struct vm_area_struct_t *area, uint32_t index);
+} vm_operations_t;
+
 /// @brief Virtual Memory Area, used to store details of a process segment.
 typedef struct vm_area_struct_t {
     /// Memory descriptor associated.
@@ -90,16 +116,31 @@ typedef struct vm_area_struct_t {
     pgprot_t vm_page_prot;
     /// Flags.
     unsigned short vm_flags;
-    /// rbtree node.
-    // struct rb_node vm_rb;
+    /// Hints about the use of the area (VM_LOCKED, VM_SEQ_READ, VM_RAND_READ).
+    unsigned short vm_hints;
+    /// The mapped file, NULL for anonymous memory.
+    struct vfs_file_t *vm_file;
+    /// The page of the file mapped at the start of the area.
+    uint32_t vm_pgoff;
+    /// End of the part backed by the file, the rest of the area reads as zeros.
+    uint32_t vm_file_end;
+    /// The operations of the object owning the pages, NULL for files and
+    /// anonymous memory.
+    const vm_operations_t *vm_ops;
+    /// The object owning the pages.
+    void *vm_private_data;
+    /// Free space between the end of the previous area and the start of this one.
+    uint32_t vm_gap;
+    /// Largest vm_gap of the areas inside the subtree rooted at this area.
+    uint32_t vm_gap_max;
 } vm_area_struct_t;
 
 /// @brief Memory Descriptor, used to store details about the memory of a user process.
 typedef struct mm_struct_t {
     /// List of memory area (vm_area_struct reference).
     list_head mmap_list;
-    // /// rbtree of memory area.
-    // struct rb_root mm_rb;
+    /// Tree of the memory areas, sorted by start address.
+    rbtree_t *mm_rb;
     /// Last memory area used.
     vm_area_struct_t *mmap_cache;
     /// Process page directory.
@@ -132,22 +173,19 @@ typedef struct mm_struct_t {
     uint32_t env_end;
     /// Number of mapped pages.
     unsigned int total_vm;
+    /// Number of tasks using the memory descriptor, threads share it.
+    atomic_t mm_users;
+    /// Hints given to the areas created from now on (VM_LOCKED, after
+    /// mlockall(MCL_FUTURE)).
+    unsigned short def_hints;
+    /// The page directory entries of the user space which areas have
+    /// covered, the only ones which can point to page tables of the process.
+    uint32_t pgt_map[PROCAREA_END_ADDR / LARGE_PAGE_SIZE / 32];
 } mm_struct_t;
 
 /// @brief Cache used to store page tables.
 extern kmem_cache_t *pgtbl_cache;
 
-/// @brief Comparison function between virtual memory areas.
-/// @param vma0 the first vm_area.
-/// @param vma1 the second vm_area.
-/// @return true if vma0 is after vma1.
-static inline int vm_area_compare(const list_head *vma0, const list_head *vma1)
-{
-    vm_area_struct_t *_vma0 = list_entry(vma0, vm_area_struct_t, vm_list);
-    vm_area_struct_t *_vma1 = list_entry(vma1, vm_area_struct_t, vm_list);
-    return _vma0->vm_start > _vma1->vm_end;
-}
-
 /// @brief Initializes paging
 /// @param info Information coming from bootloader.
 void paging_init(boot_info_t *info);
@@ -178,13 +216,29 @@ void paging_switch_directory_va(page_directory_t *dir);
 /// @param addr The address of the page table.
 void paging_flush_tlb_single(unsigned long addr);
 
+/// @brief Invalidates the whole TLB, including the global entries.
+void paging_flush_tlb_all(void);
+
+/// @brief Invalidates the TLB entries of a range of addresses, whose mappings
+/// inside the given page directory have changed.
+/// @param pgd   The page directory.
+/// @param start The first address of the range.
+/// @param end   The end of the range, exclusive.
+/// @details Only the user mappings of the current page directory, and the
+/// kernel mappings shared by all of them, can be cached inside the TLB. Large
+/// ranges flush the whole TLB instead of invalidating each page.
+void paging_flush_tlb_range(page_directory_t *pgd, uint32_t start, uint32_t end);
+
 /// @brief Enables paging.
 static inline void paging_enable(void)
 {
-    // Clear the PSE bit from cr4.
-    set_cr4(bitmask_clear(get_cr4(), CR4_PSE));
-    // Set the PG bit in cr0.
-    set_cr0(bitmask_set(get_cr0(), CR0_PG));
+    // Set the PSE bit in cr4, so that the kernel memory can be mapped with
+    // large pages, and the PGE bit, so that the kernel mappings marked as
+    // global survive the switches of page directory.
+    set_cr4(bitmask_set(get_cr4(), CR4_PSE | CR4_PGE));
+    // Set the PG bit in cr0, and the WP bit so that the kernel writing into
+    // a copy-on-write page of a process triggers a page fault.
+    set_cr0(bitmask_set(get_cr0(), CR0_PG | CR0_WP));
 }
 
 /// @brief Returns if paging is enabled.
@@ -205,12 +259,46 @@ void page_fault_handler(pt_regs *f);
 /// @return Pointer to the page.
 page_t *mem_virtual_to_page(page_directory_t *pgdir, uint32_t virt_start, size_t *size);
 
+/// @brief Counts the pages of the areas of a process which are present in
+/// memory, i.e., its resident set.
+/// @param mm The memory descriptor of the process.
+/// @return The number of resident pages.
+unsigned int mem_count_resident_pages(mm_struct_t *mm);
+
+/// @brief The pages of a memory area present in memory, by kind.
+typedef struct vm_area_usage_t {
+    /// The pages present in memory.
+    unsigned int resident;
+    /// The pages mapped by other processes too, not written.
+    unsigned int shared_clean;
+    /// The pages mapped by other processes too, written.
+    unsigned int shared_dirty;
+    /// The pages mapped only by this process, not written.
+    unsigned int private_clean;
+    /// The pages mapped only by this process, written.
+    unsigned int private_dirty;
+    /// The shared pages write-protected, which are copied on the next write.
+    unsigned int cow;
+    /// The pages inside the swap.
+    unsigned int swap;
+} vm_area_usage_t;
+
+/// @brief Counts the pages of a memory area present in memory, telling apart
+/// the ones shared with other processes, through the reference counter of
+/// the page or of the page table holding it, and the written ones.
+/// @param area The memory area.
+/// @param usage Where the counts are stored.
+void mem_vm_area_usage(vm_area_struct_t *area, vm_area_usage_t *usage);
+
 /// @brief Creates a virtual to physical mapping, incrementing pages usage counters.
 /// @param pgd        The target page directory.
 /// @param virt_start The virtual address to map to.
 /// @param phy_start  The physical address to map.
 /// @param size       The size of the segment.
 /// @param flags      The flags for the memory range.
+/// @details With MM_LARGE and MM_UPDADDR, the part of the range covering whole
+/// page directory entries is mapped with large pages, when the virtual and the
+/// physical addresses have the same offset inside a large page.
 void mem_upd_vm_area(page_directory_t *pgd, uint32_t virt_start, uint32_t phy_start, size_t size, uint32_t flags);
 
 /// @brief Clones a range of pages between two distinct page tables
@@ -227,6 +315,30 @@ void mem_clone_vm_area(page_directory_t *src_pgd,
                        size_t size,
                        uint32_t flags);
 
+/// @brief Moves the pages mapped by processes out of a block of page frames.
+/// @param first The first page of the block.
+/// @param order The logarithm of the size of the block.
+/// @return 0 if every used page of the block has been moved, -1 otherwise.
+/// @details Only the anonymous pages, allocated one at a time and mapped by
+/// just one process, can be moved. Each one is copied into a page outside of
+/// the block, and the page table entry is updated to point to the copy.
+int mem_evacuate_pages(page_t *first, unsigned int order);
+
+/// @brief Sends to the swap the anonymous pages the processes used least
+/// recently, going round them like the hand of a clock.
+/// @param zone the zone which needs memory.
+/// @param nr_pages the number of pages to free.
+/// @return the number of pages freed.
+/// @details A page whose accessed bit is set gets a second chance: the bit
+/// is cleared, and the page is sent to the swap only if it is still clear
+/// when the hand comes back. Only the pages mapped by just one process are
+/// sent to the swap.
+unsigned long mem_swap_out(zone_t *zone, unsigned long nr_pages);
+
+/// @brief Brings back from the swap all the pages of the processes.
+/// @return 0 on success, -ENOMEM if there is not enough memory.
+int mem_swap_in_all(void);
+
 /// @brief Create a virtual memory area.
 /// @param mm         The memory descriptor which will contain the new segment.
 /// @param virt_start The virtual address to map to.
@@ -240,10 +352,32 @@ vm_area_struct_t *create_vm_area(mm_struct_t *mm,
                                  uint32_t pgflags,
                                  uint32_t gfpflags);
 
+/// @brief Create a virtual memory area backed by a file, whose pages are read
+/// from the page cache on demand.
+/// @param mm         The memory descriptor which will contain the new segment.
+/// @param virt_start The virtual address to map to, aligned to a page.
+/// @param size       The size of the segment.
+/// @param file       The file.
+/// @param pgoff      The page of the file mapped at virt_start.
+/// @param file_size  The amount of bytes coming from the file, the rest reads as zeros.
+/// @param prot       The protection of the pages (PROT_READ, PROT_WRITE).
+/// @param flags      The kind of mapping (MAP_SHARED, MAP_PRIVATE).
+/// @return The newly created virtual memory area descriptor, which holds a
+/// reference to the file.
+vm_area_struct_t *create_file_vm_area(mm_struct_t *mm,
+                                      uint32_t virt_start,
+                                      size_t size,
+                                      struct vfs_file_t *file,
+                                      uint32_t pgoff,
+                                      uint32_t file_size,
+                                      int prot,
+                                      int flags);
+
 /// @brief Clone a virtual memory area, using copy on write if specified
 /// @param mm the memory descriptor which will contain the new segment.
 /// @param area the area to clone
-/// @param cow whether to use copy-on-write or just copy everything.
+/// @param cow whether to share the pages copy-on-write, or to copy them
+/// right away. Private file pages are always shared copy-on-write.
 /// @param gfpflags the Get Free Pages flags.
 /// @return Zero on success.
 uint32_t clone_vm_area(mm_struct_t *mm,
@@ -257,6 +391,38 @@ uint32_t clone_vm_area(mm_struct_t *mm,
 /// @return 0 if the area was destroyed, or 1 if the operation failed.
 int destroy_vm_area(mm_struct_t *mm, vm_area_struct_t *area);
 
+/// @brief Moves up the end of an anonymous area, the new pages are allocated
+/// on demand.
+/// @param mm the memory descriptor of the area.
+/// @param area the area.
+/// @param vm_end the new end of the area, exclusive.
+/// @return 0 on success, -EINVAL if the area maps a file or would shrink,
+/// -ENOMEM if the range above the area is already in use.
+int expand_vm_area(mm_struct_t *mm, vm_area_struct_t *area, uint32_t vm_end);
+
+/// @brief Gives back the pages of an area inside the given range. The pages
+/// of anonymous areas read as zeros the next time they are touched, those of
+/// file mappings are read again from the page cache.
+/// @param mm the memory descriptor of the area.
+/// @param area the area.
+/// @param start the start of the range, aligned to a page.
+/// @param end the end of the range, exclusive, aligned to a page.
+/// @return the number of pages given back, -EINVAL if the area does not
+/// contain the range.
+int mem_discard_range(mm_struct_t *mm, vm_area_struct_t *area, uint32_t start, uint32_t end);
+
+/// @brief Maps right away the pages of an area inside the given range, so
+/// that touching them causes no page fault.
+/// @param mm the memory descriptor of the area.
+/// @param area the area.
+/// @param start the start of the range, aligned to a page.
+/// @param end the end of the range, exclusive, aligned to a page.
+/// @param write if the pages are going to be written, the pages shared
+/// copy-on-write with other processes are copied too.
+/// @return 0 on success, -ENOMEM if some pages could not be mapped, -EINVAL
+/// if the area does not contain the range.
+int mem_populate_range(mm_struct_t *mm, vm_area_struct_t *area, uint32_t start, uint32_t end, int write);
+
 /// @brief Searches for the virtual memory area at the given address.
 /// @param mm the memory descriptor which should contain the area.
 /// @param vm_start the starting address of the area we are looking for.
@@ -290,3 +456,19 @@ mm_struct_t *clone_process_image(mm_struct_t *mmp);
 /// @brief Free Memory Descriptor with all the memory segment contained.
 /// @param mm The Memory Descriptor to free.
 void destroy_process_image(mm_struct_t *mm);
+
+/// @brief Takes a reference to a Memory Descriptor, for a task which shares it.
+/// @param mm The Memory Descriptor.
+/// @return The Memory Descriptor.
+mm_struct_t *share_process_image(mm_struct_t *mm);
+
+/// @brief Drops a reference to a Memory Descriptor, and frees it with the last one.
+/// @param mm The Memory Descriptor.
+/// @details Once the reaper runs, the last reference only switches away from
+/// the page directory, the memory is freed by the reaper.
+void release_process_image(mm_struct_t *mm);
+
+/// @brief Starts the kernel thread which destroys the released process
+/// images, so that exit and exec do not wait for the teardown.
+/// @return 1 on success, 0 on failure.
+int mm_reaper_start(void);
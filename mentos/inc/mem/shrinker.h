@@ -0,0 +1,57 @@
+/// @file shrinker.h
+/// @brief Reclaim of the memory held by the caches, under memory pressure.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// The caches (page cache, buffer cache, dentries, ...) register a shrinker,
+/// which drops their least recently used objects on request. When a zone goes
+/// below its low watermark, the `kswapd` kernel thread shrinks the caches
+/// until the zone is back above its high watermark; when an allocation fails,
+/// the caches are shrunk right away (direct reclaim). In both cases, the
+/// empty slabs are finally given back to the zones. When the caches are not
+/// enough, `kswapd` sends the idle pages of the processes to the swap.
+
+#pragma once
+
+#include "mem/gfp.h"
+#include "mem/zone_allocator.h"
+#include "sys/list_head.h"
+
+/// @brief A cache which can give back memory.
+typedef struct shrinker_t {
+    /// The name of the cache.
+    const char *name;
+    /// Returns the number of objects which could be freed.
+    unsigned long (*count_objects)(void);
+    /// Frees up to the given number of objects, the least recently used
+    /// first, and returns how many were freed. It must not sleep, nor wait
+    /// for locks, since it can run inside an allocation.
+    unsigned long (*scan_objects)(unsigned long nr_to_scan);
+    /// Link inside the list of shrinkers.
+    list_head list;
+} shrinker_t;
+
+/// @brief Registers a shrinker.
+/// @param shrinker the shrinker, which must stay valid until unregistered.
+void register_shrinker(shrinker_t *shrinker);
+
+/// @brief Unregisters a shrinker.
+/// @param shrinker the shrinker.
+void unregister_shrinker(shrinker_t *shrinker);
+
+/// @brief Shrinks the caches until the zone gains the given number of pages,
+/// or until they have nothing left to give.
+/// @param zone the zone which needs memory.
+/// @param nr_pages the number of pages.
+/// @return the number of pages the zone gained.
+unsigned long shrink_caches(zone_t *zone, unsigned long nr_pages);
+
+/// @brief Asks `kswapd` to reclaim memory, because a zone went below its low
+/// watermark.
+/// @param gfp_mask the flags of the allocation, nothing is done unless they
+/// contain __GFP_KSWAPD_RECLAIM.
+void kswapd_wakeup(gfp_t gfp_mask);
+
+/// @brief Starts the `kswapd` kernel thread.
+/// @return 1 on success, 0 on failure.
+int kswapd_start(void);
@@ -7,6 +7,7 @@
 
 #include "sys/list_head.h"
 #include "stddef.h"
+#include "kernel.h"
 #include "mem/gfp.h"
 
 /// @brief Type for slab flags.
@@ -23,6 +24,26 @@ typedef void (*kmem_fun_t)(void *);
 #define KMEM_CREATE_CTOR(objtype, ctor) \
     kmem_cache_create(#objtype, sizeof(objtype), alignof(objtype), GFP_KERNEL, (kmem_fun_t)(ctor), NULL)
 
+/// @brief Maximum number of free objects kept by each magazine.
+#define KMEM_MAGAZINE_SIZE 32
+
+/// @brief Number of free objects kept by each magazine, unless changed with
+/// `slab_magazine=` on the command line.
+#define KMEM_MAGAZINE_DEFAULT 16
+
+/// @brief Number of free objects kept by each magazine, at most KMEM_MAGAZINE_SIZE.
+extern unsigned kmem_magazine_limit;
+
+/// @brief A small stack of free objects of a cache, owned by one processor.
+/// @details Objects are pushed when freed and popped when allocated, without
+/// touching the slab lists. When full, half of it goes back to the slabs.
+typedef struct kmem_magazine_t {
+    /// Number of objects inside the magazine.
+    unsigned int count;
+    /// The free objects.
+    void *objects[KMEM_MAGAZINE_SIZE];
+} kmem_magazine_t;
+
 /// @brief Stores the information of a cache.
 typedef struct kmem_cache_t {
     /// Handler for placing it inside a lists of caches.
@@ -35,14 +56,30 @@ typedef struct kmem_cache_t {
     unsigned int object_size;
     /// Alignment requirement of the type of objects.
     unsigned int align;
-    /// The total number of slabs.
+    /// The total number of objects, in all the slabs.
     unsigned int total_num;
-    /// The number of free slabs.
+    /// The number of free objects inside the slabs, not in the magazines.
     unsigned int free_num;
+    /// The number of slabs with all their objects allocated.
+    unsigned int slabs_full_num;
+    /// The number of slabs with some of their objects allocated.
+    unsigned int slabs_partial_num;
+    /// The number of slabs with all their objects free.
+    unsigned int slabs_free_num;
+    /// The number of objects allocated since the cache was created.
+    unsigned long alloc_count;
+    /// The number of objects freed since the cache was created.
+    unsigned long free_count;
     /// The Get Free Pages (GFP) flags.
     slab_flags_t flags;
     /// The order for getting free pages.
     unsigned int gfp_order;
+    /// Distance between two consecutive colors, in bytes.
+    unsigned int color_off;
+    /// Number of different offsets at which the objects of a slab can start.
+    unsigned int colors;
+    /// The color of the next slab.
+    unsigned int color_next;
     /// Constructor for the elements.
     kmem_fun_t ctor;
     /// Destructor for the elements.
@@ -53,6 +90,8 @@ typedef struct kmem_cache_t {
     list_head slabs_partial;
     /// Handler for the free slabs list.
     list_head slabs_free;
+    /// Free objects ready to be allocated, one magazine for each processor.
+    kmem_magazine_t magazine[NR_CPUS];
 } kmem_cache_t;
 
 /// Initialize the slab system
@@ -78,6 +117,25 @@ kmem_cache_t *kmem_cache_create(
 /// @param cachep Pointer to the cache.
 void kmem_cache_destroy(kmem_cache_t *cachep);
 
+/// @brief Calls a function on each cache.
+/// @param fn the function, which must not create or destroy caches.
+/// @param data custom data passed to the function.
+void kmem_cache_for_each(void (*fn)(kmem_cache_t *cachep, void *data), void *data);
+
+/// @brief Returns the number of objects of a cache in use.
+/// @param cachep the cache.
+/// @return the number of objects, neither in the slabs nor in the magazines.
+unsigned int kmem_cache_active_objects(kmem_cache_t *cachep);
+
+/// @brief Returns the number of pages held by the slabs of all the caches.
+/// @return the number of pages.
+unsigned long kmem_cache_total_pages(void);
+
+/// @brief Gives back to the zones the slabs which are completely free, after
+/// emptying the magazines of all the caches.
+/// @return the number of pages given back.
+unsigned long kmem_cache_reap(void);
+
 #ifdef ENABLE_CACHE_TRACE
 
 /// @brief Allocs a new object using the provided cache.
@@ -150,3 +208,39 @@ void *kmalloc(unsigned int size);
 void kfree(void *ptr);
 
 #endif
+
+#if defined(ENABLE_ALLOC_TRACE) || defined(ENABLE_CACHE_TRACE)
+
+/// @brief The memory allocated by a line of code, and not freed yet.
+typedef struct alloc_site_t {
+    /// File where the objects are allocated.
+    const char *file;
+    /// Function where the objects are allocated.
+    const char *fun;
+    /// Line inside the file.
+    int line;
+    /// The number of bytes allocated and not freed.
+    unsigned long live_bytes;
+    /// The number of objects allocated and not freed.
+    unsigned long live_objects;
+    /// The number of allocations since the last reset.
+    unsigned long allocs;
+    /// The highest value of live_bytes since the last reset.
+    unsigned long peak_bytes;
+} alloc_site_t;
+
+/// @brief Calls a function on each call site which allocated memory.
+/// @param fn the function, if it allocates memory the new call sites may be skipped.
+/// @param data custom data passed to the function.
+void alloc_site_for_each(void (*fn)(const alloc_site_t *site, void *data), void *data);
+
+/// @brief Returns the number of allocations which could not be accounted to
+/// their call site, because the tables were full.
+/// @return the number of allocations.
+unsigned long alloc_site_dropped(void);
+
+/// @brief Restarts the counts of the allocations and the peaks, the live
+/// objects are kept.
+void alloc_site_reset(void);
+
+#endif
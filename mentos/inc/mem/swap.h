@@ -0,0 +1,52 @@
+/// @file swap.h
+/// @brief Swapping of the anonymous pages of the processes to a swap area.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// The swap area is a block device, or a regular file, prepared with
+/// `mkswap` (the Linux format, version 1). Its pages are the slots: slot 0
+/// holds the header, each one of the others can hold the content of a page.
+/// When a page goes to the swap, its page table entry is left not present,
+/// with the index of the slot where the frame used to be, and the fault
+/// handler brings the page back when the process touches it again. A slot is
+/// freed when the last entry pointing to it goes away, entries are shared by
+/// fork until each process swaps the page in.
+
+#pragma once
+
+#include "mem/paging.h"
+
+/// @brief The `available` bits of an entry whose page is inside the swap.
+#define PTE_SWAPPED 2U
+
+/// @brief Checks if the page of an entry is inside the swap.
+/// @param entry the page table entry.
+/// @return 1 if the frame of the entry is a slot of the swap, 0 otherwise.
+static inline int pte_is_swapped(const page_table_entry_t *entry)
+{
+    return !entry->present && (entry->available == PTE_SWAPPED);
+}
+
+/// @brief Checks if there is a swap area with free slots.
+/// @return 1 if pages can be swapped out, 0 otherwise.
+int swap_available(void);
+
+/// @brief Writes a page into a free slot of the swap.
+/// @param page the page.
+/// @return the slot, -ENOSPC if the swap is full, -EIO on failure.
+int swap_store(page_t *page);
+
+/// @brief Reads the content of a slot into a page.
+/// @param slot the slot.
+/// @param page the page.
+/// @return 0 on success, -EIO on failure.
+int swap_load(uint32_t slot, page_t *page);
+
+/// @brief Adds a reference to a slot, for an entry copied by fork.
+/// @param slot the slot.
+/// @return 0 on success, -ENOMEM if the slot has too many references.
+int swap_get(uint32_t slot);
+
+/// @brief Drops a reference to a slot, freeing it with the last one.
+/// @param slot the slot.
+void swap_put(uint32_t slot);
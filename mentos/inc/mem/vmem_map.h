@@ -33,6 +33,30 @@ void virt_init(void);
 /// @return The virtual address of the mapping
 uint32_t virt_map_physical_pages(page_t *page, int pfn_count);
 
+/// @brief Maps the registers of a device, which are not backed by a page_t.
+/// @param phy_address The physical address of the registers.
+/// @param pfn_count The number of pages to map.
+/// @return The virtual address matching phy_address, 0 on failure.
+uint32_t virt_map_io(uint32_t phy_address, int pfn_count);
+
+/// @brief Temporarily maps a single page, using one of the kmap slots.
+/// @param page The page to map.
+/// @return The virtual address of the mapping.
+/// @details The slots are a fixed window of preallocated entries, so mapping a
+/// page costs at most one TLB invalidation. When all the slots are in use, the
+/// page is mapped with virt_map_physical_pages.
+uint32_t virt_kmap(page_t *page);
+
+/// @brief Releases a mapping done with virt_kmap.
+/// @param addr The virtual address returned by virt_kmap.
+void virt_kunmap(uint32_t addr);
+
+/// @brief Copies the content of consecutive page frames into other ones.
+/// @param dst The first destination page.
+/// @param src The first source page.
+/// @param count The number of pages.
+void virt_copy_pages(page_t *dst, page_t *src, uint32_t count);
+
 /// @brief Allocate a virtual page range of the specified size.
 /// @param size The required amount.
 /// @return Pointer to the allocated memory.
@@ -12,6 +12,7 @@
 #include "sys/bitops.h"
 #include "klib/stdatomic.h"
 #include "boot.h"
+#include "kernel.h"
 #include "mem/buddysystem.h"
 #include "mem/slab.h"
 
@@ -73,6 +74,39 @@ enum zone_type {
     __MAX_NR_ZONES
 };
 
+/// @brief Number of pages moved at once between a page frame cache and the
+/// buddy system.
+#define PCP_BATCH 16
+/// @brief Number of pages above which a page frame cache is drained.
+#define PCP_HIGH (4 * PCP_BATCH)
+
+/// @brief Cache of single free page frames, owned by one processor.
+/// @details Recently freed pages, likely still in the processor cache, are
+/// kept at the head of the list (hot), while the pages obtained from the buddy
+/// system are appended at its tail (cold).
+typedef struct per_cpu_pages_t {
+    /// Number of pages inside the list.
+    unsigned int count;
+    /// When count goes above this value, a batch of pages is drained.
+    unsigned int high;
+    /// Number of pages moved at once from, or to, the buddy system.
+    unsigned int batch;
+    /// The list of pages, linked through bbpage.location.cache.
+    list_head list;
+} per_cpu_pages_t;
+
+/// @brief Number of pages above which a page frame cache is drained, see
+/// zone_set_pcp_watermarks.
+extern unsigned int zone_pcp_high;
+/// @brief Number of pages moved at once between a page frame cache and the
+/// buddy system, see zone_set_pcp_watermarks.
+extern unsigned int zone_pcp_batch;
+
+/// @brief Number of zeroed pages kept ready by a zone.
+#define ZERO_POOL_HIGH (4 * PCP_BATCH)
+/// @brief Number of pages zeroed at once, in background.
+#define ZERO_POOL_BATCH 4
+
 /// @brief Data structure to differentiate memory zone.
 typedef struct zone_t {
     /// Number of free pages in the zone.
@@ -87,6 +121,16 @@ typedef struct zone_t {
     char *name;
     /// Zone's size in number of pages.
     unsigned long size;
+    /// Single page frame caches, one for each processor.
+    per_cpu_pages_t pageset[NR_CPUS];
+    /// Number of pages inside the list of zeroed pages.
+    unsigned int zeroed_count;
+    /// Free pages already zeroed, linked through bbpage.location.cache.
+    list_head zeroed_list;
+    /// Below this number of free pages, kswapd starts shrinking the caches.
+    unsigned long watermark_low;
+    /// Number of free pages kswapd brings the zone back to.
+    unsigned long watermark_high;
 } zone_t;
 
 /// @brief Data structure to rapresent a memory node. In Uniform memory access
@@ -135,6 +179,12 @@ page_t *alloc_page_cached(gfp_t gfp_mask);
 /// @param page Pointer to the page to free.
 void free_page_cached(page_t *page);
 
+/// @brief Zeroes, in background, a batch of free pages of the high memory,
+/// which are used to serve the __GFP_ZERO requests of the processes.
+/// @details It is called periodically, and does nothing when enough zeroed
+/// pages are ready.
+void zone_refill_zeroed_pages(void);
+
 /// @brief Find the first free page frame, set it allocated and return the
 /// memory address of the page frame.
 /// @param gfp_mask GFP_FLAGS to decide the zone allocation.
@@ -154,11 +204,23 @@ uint32_t __alloc_pages_lowmem(gfp_t gfp_mask, uint32_t order);
 
 /// @brief Find the first free 2^order amount of page frames, set it allocated
 /// and return the memory address of the first page frame allocated.
-/// @param gfp_mask GFP_FLAGS to decide the zone allocation.
+/// @param gfp_mask GFP_FLAGS to decide the zone allocation, with __GFP_ZERO
+/// the page frames are zeroed.
 /// @param order    The logarithm of the size of the page frame.
 /// @return Memory address of the first free page frame allocated.
 page_t *_alloc_pages(gfp_t gfp_mask, uint32_t order);
 
+/// @brief Allocates many single page frames at once, updating the counters of
+/// the zone once for all of them.
+/// @param gfp_mask GFP_FLAGS to decide the zone allocation, with __GFP_ZERO
+/// the page frames are zeroed.
+/// @param nr_pages The number of page frames.
+/// @param pages The list receiving the page frames, linked through
+/// `bbpage.location.cache`.
+/// @return The number of page frames allocated, which is lower than nr_pages
+/// when the memory runs out.
+unsigned int alloc_pages_bulk(gfp_t gfp_mask, unsigned int nr_pages, list_head *pages);
+
 /// @brief Get the start address of the corresponding page.
 /// @param page A page structure.
 /// @return The address that corresponds to the page.
@@ -189,11 +251,23 @@ void free_pages_lowmem(uint32_t addr);
 /// @param page The page.
 void __free_pages(page_t *page);
 
+/// @brief Frees a list of pages at once, the batch of a teardown.
+/// @param pages the pages, linked through `bbpage.location.cache`, the list
+/// is empty on return.
+void free_page_list(list_head *pages);
+
 /// @brief Returns the total space for the given zone.
 /// @param gfp_mask GFP_FLAGS to decide the zone.
 /// @return Total space of the given zone.
 unsigned long get_zone_total_space(gfp_t gfp_mask);
 
+/// @brief Changes the watermarks of the page frame caches of every zone. The
+/// caches above the new high watermark shrink on their next frees.
+/// @param high number of pages above which a cache is drained.
+/// @param batch number of pages moved at once, at most high.
+/// @return 0 on success, -EINVAL if batch is zero or larger than high.
+int zone_set_pcp_watermarks(unsigned int high, unsigned int batch);
+
 /// @brief Returns the total free space for the given zone.
 /// @param gfp_mask GFP_FLAGS to decide the zone.
 /// @return Total free space of the given zone.
@@ -204,14 +278,28 @@ unsigned long get_zone_free_space(gfp_t gfp_mask);
 /// @return Total cached space of the given zone.
 unsigned long get_zone_cached_space(gfp_t gfp_mask);
 
+/// @brief Returns the number of free blocks of the given order in the zone.
+/// @param gfp_mask GFP_FLAGS to decide the zone.
+/// @param order    The logarithm of the size of the blocks.
+/// @return the number of blocks, kept up to date by the buddy system.
+unsigned long get_zone_free_blocks(gfp_t gfp_mask, unsigned int order);
+
+/// @brief Returns the fragmentation index of the zone, for the given order.
+/// @param gfp_mask GFP_FLAGS to decide the zone.
+/// @param order    The logarithm of the size of the requested block.
+/// @return -1000 if a block of the given order is free, otherwise a value in
+/// thousandths, tending to 0 if a failure would be caused by the lack of
+/// memory, and to 1000 if it would be caused by fragmentation.
+int get_zone_fragmentation_index(gfp_t gfp_mask, unsigned int order);
+
 /// @brief Checks if the specified address points to a page_t (or field) that
 /// belongs to lowmem.
 /// @param addr The address to check.
 /// @return 1 if it belongs to lowmem, 0 otherwise.
 static inline int is_lowmem_page_struct(void *addr)
 {
-    uint32_t start_lowm_map  = (uint32_t)contig_page_data->node_zones[ZONE_NORMAL].zone_mem_map;
+    uintptr_t start_lowm_map = (uintptr_t)contig_page_data->node_zones[ZONE_NORMAL].zone_mem_map;
     uint32_t lowmem_map_size = sizeof(page_t) * contig_page_data->node_zones[ZONE_NORMAL].size;
-    uint32_t map_index       = (uint32_t)addr - start_lowm_map;
+    uintptr_t map_index      = (uintptr_t)addr - start_lowm_map;
     return map_index < lowmem_map_size;
 }
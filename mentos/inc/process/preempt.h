@@ -0,0 +1,49 @@
+/// @file preempt.h
+/// @brief Voluntary preemption points, inside the long operations of the kernel.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// The kernel is not preemptible: the processes share the kernel stack of the
+/// CPU, and are switched only on their way back to user mode, while kernel
+/// threads are switched only when they yield. A long operation (e.g., a large
+/// write, or the teardown of a process image) calls cond_resched() between
+/// its steps: pending interrupts are served there, and a kernel thread gives
+/// the CPU away if a more urgent task is waiting, so that the scheduling
+/// latency is bounded by the length of a step. The points are skipped while
+/// the CPU holds a spinlock, or the task holds a mutex.
+
+#pragma once
+
+#include "hardware/smp.h"
+
+/// @brief Forbids the task running on the CPU from giving the CPU away at the
+/// preemption points, until preempt_enable() is called.
+static inline void preempt_disable(void)
+{
+    ++this_cpu()->preempt_count;
+    __asm__ __volatile__("" ::: "memory");
+}
+
+/// @brief Allows again the task running on the CPU to give the CPU away.
+static inline void preempt_enable(void)
+{
+    __asm__ __volatile__("" ::: "memory");
+    --this_cpu()->preempt_count;
+}
+
+/// @brief Checks if the running task can give the CPU away at a preemption point.
+/// @return 1 if it holds neither spinlocks nor mutexes, 0 otherwise.
+int preemptible(void);
+
+/// @brief Asks the running task to give the CPU away at the next chance.
+void set_need_resched(void);
+
+/// @brief Checks if the running task should give the CPU away.
+/// @return 1 if a more urgent task is waiting, 0 otherwise.
+int need_resched(void);
+
+/// @brief A preemption point: serves the pending interrupts, and gives the CPU
+/// to a more urgent task, if any, when allowed.
+/// @details Processes cannot be switched inside the kernel, they give the CPU
+/// away as soon as they return to user mode.
+void cond_resched(void);
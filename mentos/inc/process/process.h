@@ -9,6 +9,8 @@
 #include "bits/termios-struct.h"
 #include "system/signal.h"
 #include "devices/fpu.h"
+#include "hardware/hrtimer.h"
+#include "hardware/pmu.h"
 #include "mem/paging.h"
 #include "stdbool.h"
 
@@ -18,6 +20,9 @@
 /// The default dimension of the stack of a process (1 MByte).
 #define DEFAULT_STACK_SIZE (1 * M)
 
+/// The dimension of the kernel stack of a kernel thread.
+#define KTHREAD_STACK_SIZE (8 * K)
+
 /// @brief This structure is used to track the statistics of a process.
 /// @details
 /// While the other variables also play a role in
@@ -32,6 +37,12 @@
 typedef struct sched_entity_t {
     /// Static execution priority.
     int prio;
+    /// The scheduling policy (SCHED_OTHER, SCHED_RR, ...).
+    int policy;
+    /// The scheduling class holding the task while it is ready, NULL otherwise.
+    const struct sched_class_t *sched_class;
+    /// The CPU whose runqueue holds the task.
+    unsigned cpu;
 
     /// Start execution time.
     time_t start_runtime;
@@ -43,6 +54,10 @@ typedef struct sched_entity_t {
     time_t sum_exec_runtime;
     /// Weighted execution time.
     time_t vruntime;
+    /// Determines if the task is inside the CFS timeline.
+    bool_t on_timeline;
+    /// The queue of periodic tasks holding the task, if any.
+    struct rbtree_t *rt_queue;
 
     /// Expected period of the task
     time_t period;
@@ -62,8 +77,26 @@ typedef struct sched_entity_t {
     time_t worst_case_exec;
     /// Processor utilization factor
     double utilization_factor;
+    /// Worst case response time, computed by the response time analysis.
+    time_t response_time;
 } sched_entity_t;
 
+/// @brief The resources used by a task.
+typedef struct task_rusage_t {
+    /// Ticks spent running in user mode.
+    unsigned long utime;
+    /// Ticks spent running in kernel mode.
+    unsigned long stime;
+    /// Times the task gave up the CPU, because it went to sleep.
+    unsigned long nvcsw;
+    /// Times the task was preempted while it could still run.
+    unsigned long nivcsw;
+    /// Page faults served without reading from a file.
+    unsigned long minflt;
+    /// Page faults which read a page of a file.
+    unsigned long majflt;
+} task_rusage_t;
+
 /// @brief Stores the status of CPU and FPU registers.
 typedef struct thread_struct_t {
     /// Stored status of registers.
@@ -74,6 +107,21 @@ typedef struct thread_struct_t {
     bool_t fpu_enabled;
     /// Data structure used to save FPU registers.
     savefpu fpu_register;
+    /// The kernel stack owned by a kernel thread, NULL for the processes,
+    /// which share the kernel stack.
+    void *kstack;
+    /// Where the interrupt frame of a kernel thread lives on its own stack,
+    /// while the thread is not running.
+    pt_regs *kframe;
+    /// The function executed by a kernel thread.
+    int (*kthread_fn)(void *data);
+    /// The data passed to the function of a kernel thread.
+    void *kthread_data;
+    /// The segment of the thread-local storage, loaded in gs, 0 if the task
+    /// has none.
+    uint16_t tls_selector;
+    /// Where the thread-local storage starts.
+    uint32_t tls_base;
 } thread_struct_t;
 
 /// @brief this is our task object. Every process in the system has this, and
@@ -97,28 +145,58 @@ typedef struct task_struct {
     // -1 unrunnable, 0 runnable, >0 stopped.
     /// The current state of the process:
     __volatile__ long state;
-    /// The current opened file descriptors
-    vfs_file_descriptor_t *fd_list;
-    /// The maximum supported number of file descriptors
-    int max_fd;
+    /// The table of the open files, NULL once the task exited.
+    files_struct_t *files;
     /// Pointer to process's parent.
     struct task_struct *parent;
     /// List head for scheduling purposes.
     list_head run_list;
+    /// List head for the processes ready to run, of the same priority (SCHED_RR
+    /// and SCHED_IDLE).
+    list_head ready_list;
     /// List of children traced by the process.
     list_head children;
     /// List of siblings, namely processes created by parent process.
     list_head sibling;
+    /// List of children which exited, waiting to be reaped, linked through
+    /// their sibling field like the others.
+    list_head zombies;
+    /// Where the process sleeps inside waitpid, woken up by its children.
+    wait_queue_head_t wait_chldexit;
+    /// Links the process to the other ones of its process group.
+    list_head pgrp_link;
+    /// Links the process to the other ones of its session.
+    list_head session_link;
     /// The context of the processors.
     thread_struct_t thread;
+    /// Number of mutexes held by the task: the processes waiting for them
+    /// cannot sleep, so the task must not give the CPU away meanwhile, unless
+    /// it has to wait.
+    int lock_depth;
+    /// The CPUs the task can run on, one bit each.
+    uint32_t cpus_allowed;
     /// For scheduling algorithms.
     sched_entity_t se;
+#ifdef ENABLE_LATENCY_TRACE
+    /// The TSC when the task became ready to run, 0 once it ran.
+    ktime_t wakeup_stamp;
+#endif
     /// Exit code of the process. (parameter of _exit() system call).
     int exit_code;
+    /// The signal sent to the parent when the task exits, 0 if nobody waits
+    /// for it and it is freed as soon as it exits.
+    int exit_signal;
+    /// Cleared, and woken up as a futex, when the task exits (CLONE_CHILD_CLEARTID).
+    pid_t *clear_child_tid;
     /// The name of the task (Added for debug purpose).
     char name[TASK_NAME_MAX_LENGTH];
     /// Task's segments.
     mm_struct_t *mm;
+    /// The parent sleeping until the task gives back the `mm` it borrowed with
+    /// vfork, NULL if the task owns its `mm`.
+    struct wait_queue_entry_t *vfork_wait;
+    /// Where the process waits in poll or select, NULL otherwise.
+    struct poll_wqueues_t *poll_wqueues;
     /// Task's specific error number.
     int error_no;
     /// The current working directory.
@@ -126,8 +204,9 @@ typedef struct task_struct {
 
     /// Address of the LIBC sigreturn function.
     uint32_t sigreturn_addr;
-    /// Pointer to the process’s signal handler descriptor
-    sighand_t sighand;
+    /// Pointer to the process’s signal handler descriptor, shared by the
+    /// tasks created with CLONE_SIGHAND.
+    sighand_t *sighand;
     /// Mask of blocked signals.
     sigset_t blocked;
     /// Temporary mask of blocked signals (used by the rt_sigtimedwait() system call)
@@ -136,14 +215,21 @@ typedef struct task_struct {
     sigset_t saved_sigmask;
     /// Data structure storing the private pending signals
     sigpending_t pending;
+    /// Set when one of the pending signals is not blocked, do_signal is
+    /// skipped while it is clear.
+    volatile int sigpending;
 
-    /// Timer for alarm syscall.
-    struct timer_list *real_timer;
+    /// Timer for the alarm syscall, and for the real timer (ITIMER_REAL).
+    hrtimer_t real_timer;
+    /// Timer which wakes up the process from nanosleep, reused by each call.
+    hrtimer_t sleep_timer;
+    /// How late the timeouts of the process can expire, in nanoseconds.
+    ktime_t timer_slack_ns;
 
-    /// Next value for the real timer (ITIMER_REAL).
-    unsigned long it_real_incr;
-    /// Current value for the real timer (ITIMER_REAL).
-    unsigned long it_real_value;
+    /// Next value for the real timer (ITIMER_REAL), in nanoseconds.
+    ktime_t it_real_incr;
+    /// Current value for the real timer (ITIMER_REAL), in nanoseconds.
+    ktime_t it_real_value;
     /// Next value for the virtual timer (ITIMER_VIRTUAL).
     unsigned long it_virt_incr;
     /// Current value for the virtual timer (ITIMER_VIRTUAL).
@@ -152,6 +238,12 @@ typedef struct task_struct {
     unsigned long it_prof_incr;
     /// Current value for the profiling timer (ITIMER_PROF).
     unsigned long it_prof_value;
+    /// The resources used by the task.
+    task_rusage_t rusage;
+    /// The resources used by the children which were waited for.
+    task_rusage_t crusage;
+    /// The events counted by the performance counters while the task ran.
+    unsigned long long pmu_count[PMU_EVENT_NUM];
 
     /// Process-wise terminal options.
     termios_t termios;
@@ -175,3 +267,70 @@ int init_tasking(void);
 /// @param path Path of the `init` program.
 /// @return Pointer to init process.
 task_struct *process_create_init(const char *path);
+
+/// @brief Creates a kernel thread, ready to run.
+/// @param threadfn the function executed by the thread, which exits with the
+/// returned value.
+/// @param data the data passed to the function.
+/// @param name the name of the thread.
+/// @return the thread, NULL on failure.
+/// @details A kernel thread runs in kernel mode on its own stack, and has no
+/// user memory. It is never preempted: it runs until it sleeps, yields with
+/// kthread_yield(), or exits; thus it can take the same locks as the rest of
+/// the kernel.
+task_struct *kthread_create(int (*threadfn)(void *data), void *data, const char *name);
+
+/// @brief Creates a kernel thread, without making it ready to run.
+/// @param threadfn the function executed by the thread.
+/// @param data the data passed to the function.
+/// @param name the name of the thread.
+/// @return the thread, NULL on failure.
+/// @details The caller decides when, and where, the thread runs (e.g., the
+/// idle tasks, which run only when nothing else can).
+task_struct *kthread_alloc(int (*threadfn)(void *data), void *data, const char *name);
+
+/// @brief Gives the CPU to the other ready tasks, it must be called by a
+/// kernel thread.
+/// @details If the thread is not TASK_RUNNING anymore, it sleeps until it is
+/// woken up.
+void kthread_yield(void);
+
+/// @brief Terminates the calling kernel thread.
+/// @param exit_code the exit code.
+void kthread_exit(int exit_code) __attribute__((noreturn));
+
+/// @brief Checks if the task is a kernel thread.
+/// @param task the task.
+/// @return true if it is a kernel thread, false otherwise.
+static inline bool_t is_kthread(task_struct *task)
+{
+    return task->thread.kstack != NULL;
+}
+
+/// @brief Checks, without locking, if the task has signals to handle.
+/// @param task the task.
+/// @return true if do_signal has something to deliver, false otherwise.
+static inline bool_t signal_pending(task_struct *task)
+{
+    return task->sigpending != 0;
+}
+
+/// @brief Gives the `mm` borrowed by a vfork child back to its parent, and
+/// wakes the parent up.
+/// @param task the child.
+/// @return 1 if the `mm` was borrowed, 0 otherwise.
+int process_release_vfork_mm(task_struct *task);
+
+/// @brief Clears the pid set with CLONE_CHILD_CLEARTID, and wakes up who
+/// sleeps on it as a futex, before the task leaves its memory.
+/// @param task the running task.
+void process_clear_child_tid(task_struct *task);
+
+/// @brief Frees a task which has been reaped, with the resources it still
+/// holds (files, signal handlers, thread-local storage segment, stack of a
+/// kernel thread).
+/// @param task the task, which is no longer scheduled.
+/// @details A few exited tasks are kept with their signal handlers and their
+/// reserve of signal queue entries, and a few stacks of kernel threads, so
+/// that the next fork, or kernel thread, does not have to allocate them.
+void process_free_task(task_struct *task);
@@ -6,21 +6,152 @@
 #pragma once
 
 #include "sys/list_head.h"
+#include "klib/rbtree.h"
+#include "klib/spinlock.h"
+#include "process/prio.h"
 #include "process/process.h"
 #include "stddef.h"
 
+/// @brief Fair scheduling of the processes, weighted by their nice value (CFS).
+#define SCHED_OTHER 0
+/// @brief Round-Robin among the processes with the highest priority.
+#define SCHED_RR 2
+/// @brief The process runs only when no other process is ready.
+#define SCHED_IDLE 5
+/// @brief Periodic process, scheduled by deadline (EDF, AEDF) or by period (RM).
+#define SCHED_DEADLINE 6
+
+/// @brief The policy given to the first process, and inherited by the others,
+/// which depends on the scheduler chosen at build time, unless changed with
+/// `sched_policy=` on the command line.
+#ifdef SCHEDULER_CFS
+#define SCHED_DEFAULT_POLICY SCHED_OTHER
+#else
+#define SCHED_DEFAULT_POLICY SCHED_RR
+#endif
+
+/// @brief The policy given to the first process, and inherited by the others.
+extern int sched_default_policy;
+
+/// @brief Ticks a task runs before the scheduler picks again, by default.
+#define SCHED_DEFAULT_TIMESLICE 1
+/// @brief Default of sched_latency.
+#define SCHED_DEFAULT_LATENCY 8
+/// @brief Default of sched_min_granularity.
+#define SCHED_DEFAULT_MIN_GRANULARITY 1
+/// @brief Default of sched_wakeup_granularity.
+#define SCHED_DEFAULT_WAKEUP_GRANULARITY 1
+
+/// @brief Ticks a SCHED_RR task runs before the timer lets the scheduler pick
+/// again; blocking, and the system calls, still reschedule right away.
+extern unsigned sched_rr_timeslice;
+/// @brief Ticks within which every ready SCHED_OTHER task should run once:
+/// each gets a share of them proportional to its weight.
+extern unsigned sched_latency;
+/// @brief Ticks a SCHED_OTHER task runs at least, before the timer lets the
+/// scheduler pick again, however many tasks share the CPU.
+extern unsigned sched_min_granularity;
+/// @brief Ticks of vruntime a waking SCHED_OTHER task must be behind the
+/// current one, to take the CPU away from it.
+extern unsigned sched_wakeup_granularity;
+
+/// @brief Number of words of the bitmap of non-empty priority levels.
+#define RUNQUEUE_BITMAP_SIZE ((MAX_PRIO + 31) / 32)
+
 /// @brief Structure that contains information about live processes.
 typedef struct runqueue_t {
     /// Number of queued processes.
     size_t num_active;
     /// Number of queued periodic processes.
     size_t num_periodic;
+    /// Sum of the utilization factors of the queued periodic processes.
+    double utilization;
     /// Queue of processes.
     list_head queue;
     /// The current running process.
     task_struct *curr;
+    /// Number of processes in state TASK_RUNNING.
+    size_t num_ready;
+    /// Processes in state TASK_RUNNING with the SCHED_RR policy, one list for
+    /// each priority level, linked through ready_list.
+    list_head ready[MAX_PRIO];
+    /// Bitmap of the priority levels whose list is not empty.
+    uint32_t ready_bitmap[RUNQUEUE_BITMAP_SIZE];
+    /// Processes in state TASK_RUNNING with the SCHED_IDLE policy, linked
+    /// through ready_list.
+    list_head idle;
+    /// The ready tasks, except the current one, ordered by vruntime (CFS).
+    rbtree_t *timeline;
+    /// The task of the timeline with the smallest vruntime.
+    task_struct *leftmost;
+    /// Never decreasing lower bound of the vruntime of the ready tasks.
+    time_t min_vruntime;
+    /// Sum of the weights of the ready SCHED_OTHER tasks, current included.
+    unsigned long fair_load;
+    /// The ready periodic tasks which can execute in their current period,
+    /// ordered by absolute deadline (EDF, AEDF) or by period (RM).
+    rbtree_t *rt_ready;
+    /// The ready periodic tasks which executed in their current period,
+    /// ordered by the start of their next period.
+    rbtree_t *rt_waiting;
+    /// Taken by the load balancer, which moves tasks between two runqueues.
+    spinlock_t lock;
+    /// The tick of the next periodic balancing.
+    unsigned long next_balance;
+    /// Set when the current task should give the CPU away at the next chance,
+    /// cleared once the scheduler has picked the next task.
+    bool_t need_resched;
+    /// The kernel thread running when no task is ready, which halts the CPU.
+    /// It is not part of the runqueue.
+    task_struct *idle_task;
+    /// The task the current one gave its time slice to, picked next if it is
+    /// still ready, 0 for none.
+    pid_t yield_to;
 } runqueue_t;
 
+/// @brief A scheduling class, which keeps track of the ready processes of some
+/// policies, and decides which of them should run. The classes are chained by
+/// precedence, and a class runs its processes only when the classes before it
+/// in the chain have no process to run.
+typedef struct sched_class_t {
+    /// The name of the class.
+    const char *name;
+    /// The class which comes next in the chain, NULL for the last one.
+    const struct sched_class_t *next;
+    /// Initializes the structures of the class inside the runqueue.
+    void (*initialize)(runqueue_t *runqueue);
+    /// Adds a process which became ready to run.
+    void (*enqueue_task)(runqueue_t *runqueue, task_struct *process);
+    /// Removes a process which is no longer ready to run.
+    void (*dequeue_task)(runqueue_t *runqueue, task_struct *process);
+    /// Tells that a ready process stops running, can be NULL.
+    void (*put_prev_task)(runqueue_t *runqueue, task_struct *process);
+    /// Tells that a ready process starts running, can be NULL.
+    void (*set_next_task)(runqueue_t *runqueue, task_struct *process);
+    /// Returns the process which should run next, NULL if the class has none.
+    task_struct *(*pick_next_task)(runqueue_t *runqueue);
+    /// Tells if a process of the class which became ready should take the CPU
+    /// away from the current one, of the same class, can be NULL.
+    bool_t (*check_preempt_curr)(runqueue_t *runqueue, task_struct *process);
+    /// Moves the current process behind the other ready ones of the class,
+    /// can be NULL if the class already lets them take turns.
+    void (*yield_task)(runqueue_t *runqueue);
+} sched_class_t;
+
+/// @brief Periodic processes (SCHED_DEADLINE).
+extern const sched_class_t dl_sched_class;
+/// @brief Round-Robin among priority levels (SCHED_RR).
+extern const sched_class_t rr_sched_class;
+/// @brief Completely fair scheduler (SCHED_OTHER).
+extern const sched_class_t fair_sched_class;
+/// @brief Processes running only when nothing else can (SCHED_IDLE).
+extern const sched_class_t idle_sched_class;
+
+/// @brief Returns the scheduling class which handles the given process.
+/// @param process The process.
+/// @return The class matching its policy.
+const sched_class_t *scheduler_get_class(task_struct *process);
+
 /// @brief Structure that describes scheduling parameters.
 typedef struct sched_param_t {
     /// Static execution priority.
@@ -50,15 +181,58 @@ task_struct *scheduler_get_current_process(void);
 /// @return A maximum vruntime value.
 time_t scheduler_get_maximum_vruntime(void);
 
+/// @brief Tells if the periodic tick is needed, to share the CPU among the
+/// ready processes or to follow the periods of the periodic ones.
+/// @return true if the tick is needed, false if the timer can sleep until its
+/// next expiring timer.
+bool_t scheduler_needs_tick(void);
+
+/// @brief Creates the idle task of each CPU.
+/// @return 1 on success, 0 on failure.
+int scheduler_start_idle(void);
+
+/// @brief Checks if the calling CPU has nothing to run.
+/// @return 1 if it is running its idle task, or waiting for a task to become
+/// ready, 0 otherwise.
+int scheduler_cpu_idle(void);
+
+/// @brief Balances the load of the CPUs, by pulling ready tasks from the
+/// busiest runqueue into the one of the calling CPU.
+/// @details Inert for now: the application processors are parked once they
+/// are online, so only the runqueue of the bootstrap processor holds tasks,
+/// and there is never anything to pull. tests/host/sched_host.c fills a
+/// second runqueue by hand to check it.
+/// @param idle true if the calling CPU has nothing to run, in which case it
+/// balances right away, otherwise only once every BALANCE_INTERVAL ticks.
+/// @return the number of tasks pulled.
+int scheduler_load_balance(bool_t idle);
+
 /// @brief Returns the number of active processes.
 /// @return Number of processes.
 size_t scheduler_get_active_processes(void);
 
 /// @brief Returns a pointer to the process with the given pid.
 /// @param pid The pid of the process we are looking for.
-/// @return Pointer to the process, or NULL if we cannot find it.
+/// @return Pointer to the process, or NULL if we cannot find it, or if it exited.
 task_struct *scheduler_get_running_process(pid_t pid);
 
+/// @brief Removes a task from the tables indexing it by pid, process group
+/// and session, once it is freed.
+/// @param process The task.
+void scheduler_unhash_task(task_struct *process);
+
+/// @brief Calls a function on every task of every runqueue, all at the same
+/// instant: the runqueues are locked, with the interrupts disabled, thus the
+/// function must not sleep.
+/// @param fn The function, receiving the task and the data.
+/// @param data The data passed to the function.
+/// @return The number of tasks visited.
+size_t scheduler_for_each_task(void (*fn)(task_struct *process, void *data), void *data);
+
+/// @brief Returns the list of the processes which can run.
+/// @return The head of the list, whose entries are linked through run_list.
+list_head *scheduler_get_runqueue(void);
+
 /// @brief Activate the given process.
 /// @param process Process that has to be activated.
 void scheduler_enqueue_task(task_struct *process);
@@ -67,6 +241,18 @@ void scheduler_enqueue_task(task_struct *process);
 /// @param process Process that has to be activated.
 void scheduler_dequeue_task(task_struct *process);
 
+/// @brief Changes the state of a process, moving it in, or out of, the lists
+/// of processes ready to run.
+/// @param process The process.
+/// @param state The new state (TASK_RUNNING, TASK_UNINTERRUPTIBLE, ...).
+void scheduler_set_task_state(task_struct *process, long state);
+
+/// @brief Changes the priority of a process, keeping it in the right list of
+/// processes ready to run.
+/// @param process The process.
+/// @param prio The new priority.
+void scheduler_set_task_prio(task_struct *process, int prio);
+
 /// @brief The RR implementation of the scheduler.
 /// @param f The context of the process.
 void scheduler_run(pt_regs *f);
@@ -94,15 +280,58 @@ task_struct *scheduler_pick_next_task(runqueue_t *runqueue);
 /// @brief Set new scheduling settings for the given process.
 /// @param pid   ID of the process we are manipulating.
 /// @param param New parameters.
-/// @return 1 on success, -1 on error.
+/// @return 1 on success, a negative value on error.
+/// @details Setting the process as periodic gives it the SCHED_DEADLINE policy,
+/// while setting it back as aperiodic gives it the default policy.
 int sys_sched_setparam(pid_t pid, const sched_param_t *param);
 
+/// @brief Sets the scheduling policy, and the parameters, of the given process.
+/// @param pid    ID of the process we are manipulating, 0 for the current one.
+/// @param policy The new policy (SCHED_OTHER, SCHED_RR, SCHED_IDLE, SCHED_DEADLINE).
+/// @param param  New parameters.
+/// @return 0 on success, a negative value on error.
+int sys_sched_setscheduler(pid_t pid, int policy, const sched_param_t *param);
+
+/// @brief Returns the scheduling policy of the given process.
+/// @param pid ID of the process, 0 for the current one.
+/// @return The policy on success, a negative value on error.
+int sys_sched_getscheduler(pid_t pid);
+
 /// @brief Gets the scheduling settings for the given process.
 /// @param pid   ID of the process we are manipulating.
 /// @param param Where we store the parameters.
 /// @return 1 on success, -1 on error.
 int sys_sched_getparam(pid_t pid, sched_param_t *param);
 
+/// @brief Gives the CPU to the other ready tasks: the caller goes behind the
+/// ready tasks of its class.
+/// @return 0, the switch happens on the way out of the system call.
+int sys_sched_yield(void);
+
+/// @brief Sets the CPUs a task can run on.
+/// @param pid the task, 0 for the caller.
+/// @param len the size of the mask.
+/// @param mask the mask, one bit for each CPU.
+/// @return 0 on success, -ESRCH if there is no such task, -EINVAL if the
+/// mask has no CPU which runs tasks, -EFAULT if the mask is not valid.
+/// @details A task which is running moves to one of the CPUs the next time it
+/// wakes up.
+int sys_sched_setaffinity(pid_t pid, size_t len, const uint32_t *mask);
+
+/// @brief Gets the CPUs a task can run on.
+/// @param pid the task, 0 for the caller.
+/// @param len the size of the mask.
+/// @param mask where to store the mask, one bit for each CPU.
+/// @return the size of the mask stored on success, -ESRCH if there is no such
+/// task, -EINVAL if the mask is too small, -EFAULT if it is not valid.
+int sys_sched_getaffinity(pid_t pid, size_t len, uint32_t *mask);
+
+/// @brief Gives the rest of the time slice to the given task, and yields.
+/// @param pid the task, which runs next if it is ready on the same CPU, and
+/// of the same class of the caller; otherwise, this is a plain yield.
+/// @return 0 on success, -ESRCH if there is no such task.
+int sys_sched_yield_to(pid_t pid);
+
 /// @brief Puts the process on wait until its next period starts.
 /// @return 0 on success, a negative value on failure.
 int sys_waitperiod(void);
@@ -4,9 +4,13 @@
 
 #pragma once
 
+#include "sys/schedfb.h"
 #include "sys/types.h"
 #include "process/process.h"
 
+/// The number of records kept by the feedback system.
+#define SCHEDFB_RECORDS 1024
+
 /// @brief Initialize the scheduler feedback system.
 /// @return 1 on success, 0 on failure.
 int scheduler_feedback_init(void);
@@ -23,6 +27,12 @@ void scheduler_feedback_task_remove(pid_t pid);
 /// @param task the task for which we update the statistics.
 void scheduler_feedback_task_update(task_struct *task);
 
-/// @brief Updates the scheduling statistics for the given task.
-/// @param task the task for which we update the statistics.
+/// @brief Records the statistics of the tasks, when an interval ends.
 void scheduler_feedback_update(void);
+
+/// @brief Moves the recorded statistics out of the ring buffer.
+/// @param records where the records are copied, at least SCHEDFB_RECORDS.
+/// @param lost incremented by the number of records overwritten before being
+/// consumed.
+/// @return the number of records copied.
+size_t scheduler_feedback_consume(schedfb_record_t *records, unsigned long *lost);
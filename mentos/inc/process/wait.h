@@ -49,8 +49,10 @@
 /// @defgroup WaitQueueFlags Wait Queue Flags
 /// @{
 
-/// @brief When an entry has this flag is added to the end of the wait queue.
-///        Entries without that flag are, instead, added to the beginning.
+/// @brief When an entry has this flag is added to the end of the wait queue,
+///        and a wake up wakes only one of them, in FIFO order. Entries without
+///        that flag are, instead, added before the exclusive ones, and they
+///        are all woken up.
 #define WQ_FLAG_EXCLUSIVE 0x01
 //#define WQ_FLAG_WOKEN     0x02
 //#define WQ_FLAG_BOOKMARK  0x04
@@ -88,21 +90,51 @@ wait_queue_entry_t * wait_queue_entry_alloc();
 /// @param wait_queue_entry pointer to the wait_queue_entry.
 void wait_queue_entry_dealloc(wait_queue_entry_t * wait_queue_entry);
 
+/// @brief Initialize the head of a waiting queue.
+/// @param head The head of the waiting queue.
+void init_waitqueue_head(wait_queue_head_t *head);
+
 /// @brief Initialize the waiting queue entry.
 /// @param wq   The entry we initialize.
 /// @param task The task associated with the entry.
 void init_waitqueue_entry(wait_queue_entry_t *wq, struct task_struct *task);
 
-/// @brief Adds the element to the waiting queue.
+/// @brief Adds the element to the waiting queue, every wake up wakes it.
 /// @param head The head of the waiting queue.
 /// @param wq   The entry we insert inside the waiting queue.
 void add_wait_queue(wait_queue_head_t *head, wait_queue_entry_t *wq);
 
+/// @brief Adds the element to the end of the waiting queue, as an exclusive
+/// waiter, which is woken up only when it is the first in line.
+/// @param head The head of the waiting queue.
+/// @param wq   The entry we insert inside the waiting queue.
+void add_wait_queue_exclusive(wait_queue_head_t *head, wait_queue_entry_t *wq);
+
 /// @brief Removes the element from the waiting queue.
 /// @param head The head of the waiting queue.
 /// @param wq   The entry we remove from the waiting queue.
 void remove_wait_queue(wait_queue_head_t *head, wait_queue_entry_t *wq);
 
+/// @brief Wakes up the tasks sleeping inside the waiting queue, all the
+/// non-exclusive ones, and the first exclusive one.
+/// @param head The head of the waiting queue.
+/// @details The entries are not removed from the queue, whoever went to sleep
+/// is in charge of removing its own entry once it is awake, unless its wake
+/// function does it.
+void wake_up(wait_queue_head_t *head);
+
+/// @brief Wakes up all the non-exclusive tasks sleeping inside the waiting
+/// queue, and up to the given number of exclusive ones, in FIFO order.
+/// @param head The head of the waiting queue.
+/// @param nr_exclusive The number of exclusive tasks, 0 wakes them all.
+/// @return The number of tasks woken up.
+int wake_up_nr(wait_queue_head_t *head, int nr_exclusive);
+
+/// @brief Wakes up all the tasks sleeping inside the waiting queue, exclusive
+/// or not (e.g., because what they are waiting for is gone).
+/// @param head The head of the waiting queue.
+void wake_up_all(wait_queue_head_t *head);
+
 /// @brief The default wake function, a wrapper for try_to_wake_up.
 /// @param wait The pointer to the wait queue.
 /// @param mode The type of wait (TASK_INTERRUPTIBLE or TASK_UNINTERRUPTIBLE).
@@ -110,6 +142,14 @@ void remove_wait_queue(wait_queue_head_t *head, wait_queue_entry_t *wq);
 /// @return 1 on success, 0 on failure.
 int default_wake_function(wait_queue_entry_t *wait, unsigned mode, int sync);
 
+/// @brief Wakes up the task, then removes the entry from its queue and frees
+/// it, for the entries allocated by sleep_on.
+/// @param wait The pointer to the wait queue.
+/// @param mode The type of wait (TASK_INTERRUPTIBLE or TASK_UNINTERRUPTIBLE).
+/// @param sync Specifies if the wakeup should be synchronous.
+/// @return 1 on success, 0 on failure.
+int autoremove_wake_function(wait_queue_entry_t *wait, unsigned mode, int sync);
+
 /// @brief Sets the state of the current process to TASK_UNINTERRUPTIBLE 
 ///        and inserts it into the specified wait queue.
 /// 
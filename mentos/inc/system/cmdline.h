@@ -0,0 +1,52 @@
+/// @file cmdline.h
+/// @brief Parses the kernel command line into the boot-time tunables.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// The command line given by the boot loader is a list of options separated
+/// by spaces, each either `name=value`, or a bare `name` which turns on a
+/// boolean option, e.g., `hz=1000 sched_policy=cfs runtests`.
+
+#pragma once
+
+#include "stddef.h"
+
+/// @brief The kind of value held by a kernel parameter.
+typedef enum {
+    KPARAM_UINT,   ///< An unsigned number, inside [min, max].
+    KPARAM_BOOL,   ///< A boolean, `0`, `1`, or the bare name for `1`.
+    KPARAM_STRING, ///< A string, of at most max - 1 characters.
+    KPARAM_CUSTOM, ///< A value handled by the subsystem, through its own function.
+} kernel_param_type_t;
+
+/// @brief A tunable set from the kernel command line.
+typedef struct kernel_param_t {
+    /// The name of the option.
+    const char *name;
+    /// The kind of value.
+    kernel_param_type_t type;
+    /// Where the value is stored, unused by KPARAM_CUSTOM.
+    void *value;
+    /// The minimum value of KPARAM_UINT.
+    unsigned min;
+    /// The maximum value of KPARAM_UINT, or the size of the KPARAM_STRING buffer.
+    unsigned max;
+    /// Sets a KPARAM_CUSTOM, returns 0 on success, -errno on failure; NULL if
+    /// the subsystem reads the command line by itself.
+    int (*set)(const char *value);
+    /// A short description of the option.
+    const char *description;
+} kernel_param_t;
+
+/// @brief The program started as first process, unless changed with `init=`.
+extern char cmdline_init[];
+
+/// @brief Parses the kernel command line, and sets the tunables it contains.
+/// @param cmdline the command line, NULL if there is none.
+/// @details It must run before the subsystems using the tunables are
+/// initialized. Unknown options, and invalid values, are reported and ignored.
+void cmdline_parse(const char *cmdline);
+
+/// @brief Returns the kernel command line.
+/// @return the command line, an empty string if there is none.
+const char *cmdline_get(void);
@@ -0,0 +1,48 @@
+/// @file func_profile.h
+/// @brief Flat profile of the functions of the kernel, built with
+/// `-finstrument-functions`.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// Every function of the kernel calls a hook when it is entered and when it
+/// returns, which accounts its calls and its TSC cycles: inclusive of the
+/// functions it called, and exclusive of them. The profile is listed by
+/// `/proc/func_profile`, the most expensive functions first.
+
+#pragma once
+
+#ifdef ENABLE_FUNC_PROFILE
+
+#include "hardware/hrtimer.h"
+
+/// The number of functions the profile can hold, a power of two.
+#define FUNC_PROFILE_SIZE 4096
+/// The deepest nesting of calls accounted on each CPU.
+#define FUNC_PROFILE_DEPTH 128
+
+/// @brief The profile of a function.
+typedef struct func_profile_entry_t {
+    /// The address of the function, 0 for an empty slot.
+    uint32_t function;
+    /// The number of calls.
+    unsigned long calls;
+    /// The cycles spent inside the function, and the ones it called.
+    ktime_t inclusive;
+    /// The cycles spent inside the function alone.
+    ktime_t exclusive;
+} func_profile_entry_t;
+
+/// @brief Copies the profile of the functions which were called.
+/// @param entries where the entries are copied, NULL to count them.
+/// @param size the room in the entries.
+/// @return the number of functions called.
+unsigned func_profile_snapshot(func_profile_entry_t *entries, unsigned size);
+
+/// @brief Returns the number of functions left out because the table was full.
+/// @return the number of functions.
+unsigned long func_profile_dropped(void);
+
+/// @brief Clears the profile.
+void func_profile_reset(void);
+
+#endif
@@ -0,0 +1,60 @@
+/// @file initcall.h
+/// @brief Initializers of the kernel subsystems, run by level at boot.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// The initializers run level after level, in the order of the table inside
+/// each level, and the time each one takes is logged. Those marked as
+/// deferrable, which init does not need to start, are left to the `kinitd`
+/// kernel thread, which runs them once init is there.
+
+#pragma once
+
+#include "stdbool.h"
+#include "stddef.h"
+
+/// @brief The initializer can run after init started, from `kinitd`.
+#define INITCALL_DEFERRED (1U << 0)
+/// @brief The failure of the initializer does not stop the boot.
+#define INITCALL_OPTIONAL (1U << 1)
+/// @brief Init needs the initializer only if it is loaded from the disk, i.e.,
+/// it is deferrable when there is an initramfs.
+#define INITCALL_DISK (1U << 2)
+
+/// @brief The levels of the initializers, in the order they run.
+typedef enum {
+    INIT_LEVEL_CORE,    ///< The services used by the drivers, e.g., the VFS.
+    INIT_LEVEL_DEVICES, ///< The drivers of the devices.
+    INIT_LEVEL_FS,      ///< The filesystems, the root one and the device files.
+    INIT_LEVEL_PROCFS,  ///< The files under `/proc`.
+    INIT_LEVEL_IPC,     ///< The inter-process communication.
+    INIT_LEVEL_INPUT,   ///< The input devices.
+    INIT_LEVEL_NUM,     ///< The number of levels.
+} init_level_t;
+
+/// @brief An initializer of a subsystem.
+typedef struct initcall_t {
+    /// The name, printed at boot.
+    const char *name;
+    /// The function, which returns 0 on success.
+    int (*fn)(void);
+    /// The level.
+    init_level_t level;
+    /// The name of the initializer which must succeed before this one, NULL
+    /// if there is none; it must come first, at the same or a lower level.
+    const char *depends;
+    /// The flags (INITCALL_DEFERRED, INITCALL_OPTIONAL, INITCALL_DISK).
+    unsigned flags;
+} initcall_t;
+
+/// @brief Runs the initializers, leaving the deferrable ones to `kinitd`.
+/// @param calls the initializers.
+/// @param count the number of initializers.
+/// @param defer the initializers with any of these flags are deferred, if 0
+/// all of them run right away.
+/// @return 0 on success, -1 if a required initializer failed.
+int initcall_run(const initcall_t *calls, size_t count, unsigned defer);
+
+/// @brief Starts `kinitd`, which runs the deferred initializers.
+/// @return 0 on success, -1 if the thread could not be created.
+int initcall_start_deferred(void);
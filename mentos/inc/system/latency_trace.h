@@ -0,0 +1,99 @@
+/// @file latency_trace.h
+/// @brief Tracer of the sections with interrupts disabled, and of the delays
+/// between the wake up of a task and the moment it runs.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// The sections are timed with the TSC, each CPU keeps its worst ones without
+/// locks, since it updates them with interrupts disabled. They are listed by
+/// `/proc/latency/irqsoff` and `/proc/latency/wakeup`.
+
+#pragma once
+
+#ifdef ENABLE_LATENCY_TRACE
+
+#include "hardware/hrtimer.h"
+#include "sys/types.h"
+
+/// The number of worst sections kept by each CPU, for each tracer.
+#define LATENCY_WORST 8
+
+/// @brief A section with interrupts disabled.
+typedef struct irqsoff_record_t {
+    /// The duration, in TSC cycles.
+    ktime_t cycles;
+    /// Where the interrupts were disabled.
+    unsigned long start;
+    /// Where the interrupts were enabled again.
+    unsigned long end;
+    /// The interrupt which opened the section, -1 if it was irq_disable.
+    int vector;
+} irqsoff_record_t;
+
+/// @brief The delay between the wake up of a task and the moment it ran.
+typedef struct wakeup_record_t {
+    /// The duration, in TSC cycles.
+    ktime_t cycles;
+    /// The pid of the task.
+    pid_t pid;
+    /// The scheduling policy of the task.
+    int policy;
+    /// The name of the task.
+    char name[16];
+} wakeup_record_t;
+
+/// @brief The worst sections of a CPU.
+typedef struct latency_stat_t {
+    /// Number of sections with interrupts disabled.
+    unsigned long irqsoff_count;
+    /// The worst sections with interrupts disabled, the worst first.
+    irqsoff_record_t irqsoff[LATENCY_WORST];
+    /// Number of wake ups.
+    unsigned long wakeup_count;
+    /// The worst wake ups, the worst first.
+    wakeup_record_t wakeup[LATENCY_WORST];
+} latency_stat_t;
+
+struct pt_regs;
+struct task_struct;
+
+/// @brief Starts a section with interrupts disabled.
+/// @param ip where the interrupts were disabled.
+void latency_irqs_off(unsigned long ip);
+
+/// @brief Ends the section with interrupts disabled, if one was started.
+/// @param ip where the interrupts are being enabled.
+void latency_irqs_on(unsigned long ip);
+
+/// @brief Starts a section at the entry of an interrupt, if the interrupted
+/// code had interrupts enabled.
+/// @param f the frame of the interrupt.
+void latency_irq_enter(struct pt_regs *f);
+
+/// @brief Ends the section at the exit of an interrupt, if the frame we return
+/// to has interrupts enabled. The section ends where this is called from.
+/// @param f the frame of the interrupt.
+void latency_irq_exit(struct pt_regs *f);
+
+/// @brief Stamps a task which became ready to run.
+/// @param task the task.
+void latency_task_woken(struct task_struct *task);
+
+/// @brief Accounts the delay of a task which is about to run, if it was woken.
+/// @param task the task.
+void latency_task_running(struct task_struct *task);
+
+/// @brief Copies the worst sections of a CPU.
+/// @param cpu the CPU.
+/// @param stat where the sections are copied.
+void latency_stat_get(unsigned cpu, latency_stat_t *stat);
+
+/// @brief Converts TSC cycles to nanoseconds.
+/// @param cycles the cycles.
+/// @return the nanoseconds, 0 without a calibrated TSC.
+ktime_t latency_cycles_to_ns(ktime_t cycles);
+
+/// @brief Clears the worst sections of all the CPUs.
+void latency_reset(void);
+
+#endif
@@ -2,11 +2,57 @@
 /// @brief Functions for managing the kernel messages.
 /// @copyright (c) 2014-2024 This file is distributed under the MIT License.
 /// See LICENSE.md for details.
+/// @details
+/// The messages of the kernel (see the pr_* macros) are stored as records in
+/// a ring of the CPU which logs them, without locks, and written on the
+/// serial port later, by the klogd kernel thread. The CPU reserves a slot,
+/// fills it, and commits it by setting its sequence number, so that the
+/// thread does not read half-written records, while an interrupt logging on
+/// the same CPU takes the next slot. If a ring is full, the new messages are
+/// dropped and counted. Before klogd starts, and for the critical messages,
+/// the rings are drained right away by the caller.
 
 #pragma once
 
+#include "stddef.h"
+#include "sys/types.h"
+
+/// The number of records of the ring of each CPU, a power of two.
+#define LOG_RING_SIZE 128
+/// The text held by a record, longer messages take consecutive records.
+#define LOG_TEXT_SIZE 96
+/// The size of the history of the messages, read through /proc/kmsg.
+#define LOG_HISTORY_SIZE (16 * 1024)
+
 /// @brief Write formatted output to stdout.
 /// @param format Output formatted as for printf.
 /// @param ... List of arguments.
 /// @return The number of bytes written in syslog.
 int sys_syslog(const char *format, ...);
+
+/// @brief Stores a message in the ring of the calling CPU.
+/// @param file the file which logs the message, a string which is never freed.
+/// @param line the line which logs the message.
+/// @param header the header of the file, a string which is never freed, or NULL.
+/// @param level the log level.
+/// @param text the message, terminated.
+/// @param length the length of the message.
+void printk_store(const char *file, int line, const char *header, short level, const char *text, size_t length);
+
+/// @brief Writes the stored messages on the serial port, unless someone else
+/// is doing it.
+void printk_flush(void);
+
+/// @brief Wakes up klogd if there are messages to write, called at every tick.
+void printk_kick(void);
+
+/// @brief Starts klogd, from now on the messages are written asynchronously.
+/// @return 0 on success, -1 on failure.
+int printk_start_daemon(void);
+
+/// @brief Copies part of the history of the messages.
+/// @param buffer where the messages are copied.
+/// @param offset the position inside the history.
+/// @param nbyte the maximum number of bytes to copy.
+/// @return the number of bytes copied.
+ssize_t printk_read_history(char *buffer, off_t offset, size_t nbyte);
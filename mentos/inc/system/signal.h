@@ -7,6 +7,7 @@
 
 #include "klib/stdatomic.h"
 #include "klib/spinlock.h"
+#include "process/wait.h"
 #include "sys/list_head.h"
 #include "system/syscall.h"
 
@@ -190,6 +191,8 @@ typedef struct sighand_t {
     sigaction_t action[NSIG];
     /// Spinlock protecting both the signal descriptor and the signal handler descriptor.
     spinlock_t siglock;
+    /// The processes reading, or polling, a signalfd, woken up by each signal.
+    wait_queue_head_t signalfd_wqh;
 } sighand_t;
 
 /// @brief Data passed with signal info.
@@ -198,6 +201,22 @@ typedef union sigval {
     void *sival_ptr; ///< Pointer value.
 } sigval_t;
 
+/// @defgroup sigev_notify How an asynchronous event is notified
+/// @{
+#define SIGEV_SIGNAL 0 ///< A signal is sent to the process.
+#define SIGEV_NONE   1 ///< Nothing is notified.
+/// @}
+
+/// @brief Describes how an asynchronous event is notified.
+struct sigevent {
+    /// How the event is notified (SIGEV_SIGNAL, SIGEV_NONE).
+    int sigev_notify;
+    /// The signal sent with SIGEV_SIGNAL.
+    int sigev_signo;
+    /// The value sent with the signal.
+    sigval_t sigev_value;
+};
+
 /// @brief Stores information about an occurrence of a specific signal.
 typedef struct siginfo_t {
     /// The signal number.
@@ -232,12 +251,19 @@ typedef struct sigqueue_t {
     //struct user_struct *user;
 } sigqueue_t;
 
+/// Number of signal queue entries each task keeps preallocated.
+#define SIGQUEUE_RESERVE 4
+
 /// @brief Keeps information of pending signals.
 typedef struct sigpending_t {
     /// Head of the list of pending signals.
     list_head list;
     /// The mask which can be queried to know which signals are pending.
     sigset_t signal;
+    /// Free entries, used before asking the cache for new ones.
+    list_head reserve;
+    /// Number of entries inside the reserve.
+    int reserve_count;
 } sigpending_t;
 
 /// These can be the second arg to send_sig_info/send_group_sig_info.
@@ -259,6 +285,37 @@ int do_signal(struct pt_regs *f);
 /// @return 1 on success, 0 on failure.
 int signals_init(void);
 
+/// @brief Initializes the pending signals of a task, and fills its reserve
+/// of queue entries.
+/// @param pending the pending signals.
+void sigpending_init(sigpending_t *pending);
+
+/// @brief Frees the queue entries of a task, pending or in its reserve.
+/// @param pending the pending signals.
+void sigpending_release(sigpending_t *pending);
+
+/// @brief Discards the pending signals of a task, keeping its reserve of
+/// queue entries, for a task which is kept for reuse.
+/// @param pending the pending signals.
+void sigpending_flush(sigpending_t *pending);
+
+/// @brief Takes the lowest pending signal of a task among the given ones,
+/// whether it is blocked or not, as the readers of a signalfd do.
+/// @param t the task.
+/// @param mask the signals which can be taken.
+/// @param info where the details of the signal are stored.
+/// @param nonblock if the task must not sleep when none is pending.
+/// @return the signal, -EAGAIN, or -ERESTARTSYS if the task is going to
+/// sleep on the signalfd queue of its handlers.
+int dequeue_signal(struct task_struct *t, sigset_t *mask, siginfo_t *info, int nonblock);
+
+/// @brief Sends a signal, with its information, to a process.
+/// @param sig the signal.
+/// @param info the information of the signal.
+/// @param p the process.
+/// @return 0 on success, -EINVAL if the signal is not valid.
+int __send_sig_info(int sig, siginfo_t *info, struct task_struct *p);
+
 /// @brief Send signal to one specific process.
 /// @param pid The PID of the process.
 /// @param sig The signal to be sent.
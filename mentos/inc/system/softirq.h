@@ -0,0 +1,58 @@
+/// @file softirq.h
+/// @brief Deferred interrupt work (softirqs and tasklets).
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// An interrupt handler (top half) only talks to its device, and raises a
+/// softirq, or schedules a tasklet, for the rest of the work (bottom half).
+/// The bottom halves run with interrupts enabled, once the end-of-interrupt
+/// has been sent, on the way out of interrupts and system calls.
+
+#pragma once
+
+#include "stdbool.h"
+
+/// @brief The softirq vectors, in order of priority.
+typedef enum {
+    SOFTIRQ_TIMER,   ///< Runs the expired dynamic and high-resolution timers.
+    SOFTIRQ_TASKLET, ///< Runs the scheduled tasklets.
+    SOFTIRQ_NUM      ///< The number of vectors.
+} softirq_nr_t;
+
+/// @brief A function executed as bottom half, which can be scheduled from
+/// interrupt handlers.
+typedef struct tasklet_t {
+    /// The function to execute.
+    void (*function)(unsigned long data);
+    /// Custom data passed to the function.
+    unsigned long data;
+    /// If the tasklet is waiting to run.
+    bool_t scheduled;
+    /// The next scheduled tasklet.
+    struct tasklet_t *next;
+} tasklet_t;
+
+/// @brief Initializes a tasklet, in a way usable for static tasklets.
+/// @param func the function.
+/// @param arg the data passed to the function.
+#define TASKLET_INIT(func, arg) { .function = (func), .data = (arg), .scheduled = false, .next = NULL }
+
+/// @brief Sets the function executed for a softirq vector.
+/// @param nr the vector.
+/// @param action the function.
+void softirq_install(softirq_nr_t nr, void (*action)(void));
+
+/// @brief Marks a softirq vector as pending, it can be called from interrupt
+/// handlers.
+/// @param nr the vector.
+void softirq_raise(softirq_nr_t nr);
+
+/// @brief Runs the pending softirqs, with interrupts enabled.
+/// @details Does nothing if called while softirqs are already running, the
+/// ones raised meanwhile are handled by the outer call.
+void softirq_run(void);
+
+/// @brief Schedules a tasklet, it can be called from interrupt handlers.
+/// @param tasklet the tasklet, which runs once even if scheduled many times
+/// before running.
+void tasklet_schedule(tasklet_t *tasklet);
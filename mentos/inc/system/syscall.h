@@ -11,9 +11,21 @@
 #include "sys/dirent.h"
 #include "sys/types.h"
 
+/// Returned by a system call which put the process to sleep, which executes
+/// the call again once woken up. Never seen by the processes.
+#define ERESTARTSYS 512
+
+struct posix_spawn_file_actions_t;
+struct posix_spawnattr_t;
+
 /// @brief Initialize the system calls.
 void syscall_init(void);
 
+/// @brief Configures the SYSENTER entry of the calling CPU, if it has one.
+/// @details Needs the kernel stack of the CPU.
+/// @return 0 on success, -1 if the CPU does not support SYSENTER.
+int syscall_sysenter_init(void);
+
 /// @brief Handler for the system calls.
 /// @param f The interrupt stack frame.
 void syscall_handler(pt_regs *f);
@@ -22,6 +34,29 @@ void syscall_handler(pt_regs *f);
 /// @return Pointer to the stack frame.
 pt_regs *get_current_interrupt_stack_frame(void);
 
+#ifdef ENABLE_SYSCALL_STAT
+/// The number of buckets of the latency histograms.
+#define SYSCALL_STAT_BUCKETS 16
+/// The first bucket counts the calls shorter than 2^SYSCALL_STAT_MIN_SHIFT
+/// cycles, each following one doubles the bound, the last counts the rest.
+#define SYSCALL_STAT_MIN_SHIFT 8
+
+/// @brief The statistics of a system call.
+typedef struct syscall_stat_t {
+    /// The number of calls.
+    unsigned long count;
+    /// The total TSC cycles spent inside the calls.
+    unsigned long long cycles;
+    /// How many calls took each power of two of cycles.
+    unsigned long hist[SYSCALL_STAT_BUCKETS];
+} syscall_stat_t;
+
+/// @brief Sums the statistics of a system call, collected by each CPU.
+/// @param nr the number of the system call.
+/// @param stat where the statistics are stored.
+void syscall_stat_get(unsigned int nr, syscall_stat_t *stat);
+#endif
+
 /// The exit() function causes normal process termination.
 /// @param exit_code The exit code.
 void sys_exit(int exit_code);
@@ -40,6 +75,32 @@ ssize_t sys_read(int fd, void *buf, size_t nbytes);
 /// @return The number of written bytes.
 ssize_t sys_write(int fd, const void *buf, size_t nbytes);
 
+/// @brief Read data from a file descriptor, at the given offset.
+/// @param fd     The file descriptor.
+/// @param buf    The buffer.
+/// @param nbytes The number of bytes to read.
+/// @param offset The position inside the file where the read starts.
+/// @return The number of read characters.
+/// @details The file offset is not changed.
+ssize_t sys_pread(int fd, void *buf, size_t nbytes, off_t offset);
+
+/// @brief Write data into a file descriptor, at the given offset.
+/// @param fd     The file descriptor.
+/// @param buf    The buffer collecting data to written.
+/// @param nbytes The number of bytes to write.
+/// @param offset The position inside the file where the write starts.
+/// @return The number of written bytes.
+/// @details The file offset is not changed.
+ssize_t sys_pwrite(int fd, const void *buf, size_t nbytes, off_t offset);
+
+/// @brief Tells how the data of a file is going to be accessed.
+/// @param fd     The file descriptor.
+/// @param offset The start of the range the advice applies to.
+/// @param len    The length of the range, 0 for up to the end of the file.
+/// @param advice The advice (POSIX_FADV_*).
+/// @return 0 on success, -errno on failure.
+int sys_fadvise64(int fd, off_t offset, off_t len, int advice);
+
 /// @brief Repositions the file offset inside a file.
 /// @param fd     The file descriptor of the file.
 /// @param offset The offest to use for the operation.
@@ -81,6 +142,18 @@ int sys_unlink(const char *path);
 ///         child; on error, -1 is returned.
 pid_t sys_waitpid(pid_t pid, int *status, int options);
 
+/// Forward declaration of the resources used by a process.
+struct rusage;
+
+/// @brief Waits like waitpid, and returns the resources used by the child.
+/// @param pid     The pid to wait.
+/// @param status  If not NULL, store status information here.
+/// @param options Determines the wait behaviour.
+/// @param usage   If not NULL, where the resources used by the child, and by
+///                its waited-for children, are stored.
+/// @return the pid of the child, 0 with WNOHANG if none exited, -errno on failure.
+pid_t sys_wait4(pid_t pid, int *status, int options, struct rusage *usage);
+
 /// @brief Replaces the current process image with a new process image.
 /// @param f CPU registers whe calling this function.
 /// @return 0 on success, -1 on error.
@@ -200,13 +273,39 @@ int sys_reboot(int magic1, int magic2, unsigned int cmd, void *arg);
 ///         On failure, returnr NULL, and errno is set to indicate the error.
 char *sys_getcwd(char *buf, size_t size);
 
+/// @brief Creates a new process, which is a copy of the calling process.
+/// @param f CPU registers whe calling this function.
+/// @return Return -1 for errors, 0 to the new process, and the process ID of
+///         the new process to the old process.
+pid_t sys_fork(pt_regs *f);
+
 /// @brief Clone the calling process, but without copying the whole address space.
 ///        The calling process is suspended until the new process exits or is
 ///        replaced by a call to `execve'.
 /// @param f CPU registers whe calling this function.
 /// @return Return -1 for errors, 0 to the new process, and the process ID of
 ///         the new process to the old process.
-pid_t sys_fork(pt_regs *f);
+pid_t sys_vfork(pt_regs *f);
+
+/// @brief Creates a new process, which shares with the caller the resources
+///        selected by the flags (memory, open files, signal handlers).
+/// @param f CPU registers when calling this function, holding the flags, the
+///        stack of the child, where to store its pid in the parent, its
+///        thread-local storage, and where to store its pid in the child.
+/// @return Return -errno for errors, 0 to the new process, and the process ID
+///         of the new process to the old process.
+pid_t sys_clone(pt_regs *f);
+
+/// @brief Creates a new process running the program at the given path,
+///        building its image directly instead of copying the caller.
+/// @param path the path of the program.
+/// @param argv the arguments of the program.
+/// @param envp the environment of the program.
+/// @param file_actions the operations performed on the file descriptors of the child, can be NULL.
+/// @param attrp the attributes of the child, can be NULL.
+/// @return the process ID of the new process, -errno on failure.
+pid_t sys_posix_spawn(const char *path, char *argv[], char *envp[],
+                      const struct posix_spawn_file_actions_t *file_actions, const struct posix_spawnattr_t *attrp);
 
 /// @brief Stat the file at the given path.
 /// @param path Path to the file for which we are retrieving the statistics.
@@ -220,6 +319,15 @@ int sys_stat(const char *path, stat_t *buf);
 /// @return Returns a negative value on failure.
 int sys_fstat(int fd, stat_t *buf);
 
+/// @brief Retrieves the requested information about the file at the given location.
+/// @param dirfd The directory from which a relative path is resolved, or AT_FDCWD.
+/// @param path  The path to the file that is being inquired.
+/// @param flags Must be 0.
+/// @param mask  The STATX_* fields needed, the others may be left zeroed.
+/// @param buf   A structure where data about the file will be stored.
+/// @return 0 on success, -errno on failure.
+int sys_statx(int dirfd, const char *path, int flags, unsigned int mask, stat_t *buf);
+
 /// @brief Creates a new directory at the given path.
 /// @param path The path of the new directory.
 /// @param mode The permission of the new directory.
@@ -231,6 +339,15 @@ int sys_mkdir(const char *path, mode_t mode);
 /// @return Returns a negative value on failure.
 int sys_rmdir(const char *path);
 
+/// @brief Writes back all the modified filesystem data to the disks.
+/// @return Always 0.
+int sys_sync(void);
+
+/// @brief Writes back the modified data of the file to the disk.
+/// @param fd The file descriptor.
+/// @return 0 on success, a negative value on failure.
+int sys_fsync(int fd);
+
 /// @brief Creates a new file or rewrite an existing one.
 /// @param path path to the file.
 /// @param mode mode for file creation.
@@ -266,3 +383,9 @@ ssize_t sys_getdents(int fd, dirent_t *dirp, unsigned int count);
 /// @param time Where the time should be stored.
 /// @return The current time.
 time_t sys_time(time_t *time);
+
+/// @brief Returns the time of a clock, with a nanosecond resolution.
+/// @param clockid CLOCK_REALTIME or CLOCK_MONOTONIC.
+/// @param tp where the time is stored.
+/// @return 0 on success, -EINVAL for an unknown clock, -EFAULT if tp is NULL.
+int sys_clock_gettime(clockid_t clockid, timespec *tp);
@@ -0,0 +1,60 @@
+/// @file trace.h
+/// @brief Static tracepoints, recorded into per-CPU binary ring buffers.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#pragma once
+
+#include "stddef.h"
+#include "sys/trace.h"
+
+/// The number of records kept for each CPU, the oldest are overwritten.
+#define TRACE_BUFFER_RECORDS 2048
+
+/// The enabled events, one bit each.
+extern volatile uint32_t trace_mask;
+
+/// @brief Converts an argument of trace_event, pointers included, to a word
+/// of the record.
+#define __trace_arg(a) ((uint32_t)(uintptr_t)(a))
+
+/// @brief Records an event if it is enabled. When it is not, the cost is a
+/// load and a branch, so tracepoints stay in the hot paths.
+/// @param event the trace_event_t.
+/// @param a0 the first argument.
+/// @param a1 the second argument.
+/// @param a2 the third argument.
+/// @param a3 the fourth argument.
+#define trace_event(event, a0, a1, a2, a3)                                                                  \
+    do {                                                                                                    \
+        if (__builtin_expect(trace_mask & (1u << (event)), 0)) {                                            \
+            trace_record((event), __trace_arg(a0), __trace_arg(a1), __trace_arg(a2), __trace_arg(a3));     \
+        }                                                                                                   \
+    } while (0)
+
+/// @brief Records an event, use trace_event instead.
+/// @param event the event.
+/// @param a0 the first argument.
+/// @param a1 the second argument.
+/// @param a2 the third argument.
+/// @param a3 the fourth argument.
+void trace_record(trace_event_t event, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3);
+
+/// @brief Returns the name of an event, as written in `/proc/trace_events`.
+/// @param event the event.
+/// @return the name, or NULL for an invalid event.
+const char *trace_event_name(trace_event_t event);
+
+/// @brief Enables exactly the given events, allocating the buffers the first
+/// time an event is enabled.
+/// @param mask the events, one bit each.
+/// @return 0 on success, -ENOMEM if the buffers could not be allocated.
+int trace_set_mask(uint32_t mask);
+
+/// @brief Moves the records of a CPU out of its buffer.
+/// @param cpu the CPU.
+/// @param records where they are copied, TRACE_BUFFER_RECORDS at most.
+/// @param lost where the number of records overwritten before being read is
+/// added.
+/// @return the number of records copied.
+size_t trace_consume(unsigned cpu, trace_record_t *records, unsigned long *lost);
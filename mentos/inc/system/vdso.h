@@ -0,0 +1,35 @@
+/// @file vdso.h
+/// @brief The page mapped by the kernel, read-only, in every process.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// There is a single physical page, shared by all the processes, filled at
+/// boot with the code of vdso_entry.S, and holding the clock, updated at
+/// every tick. Its layout is in `sys/vdso.h`, which is shared with the C
+/// library.
+
+#pragma once
+
+#include "mem/paging.h"
+#include "sys/vdso.h"
+
+/// The address, inside the vDSO, where SYSEXIT returns to the processes.
+extern uint32_t vdso_sysenter_return;
+
+/// @brief Allocates the vDSO page, and copies its code inside it.
+/// @details Needs the RTC, for the time at boot.
+/// @return 0 on success, -1 on failure.
+int vdso_init(void);
+
+/// @brief Maps the vDSO page in the memory of a process, at VDSO_ADDRESS.
+/// @param mm the memory descriptor of the process.
+/// @return 0 on success, -1 on failure.
+int vdso_map(mm_struct_t *mm);
+
+/// @brief Publishes the SYSENTER entry as the one to use, once the CPU has
+/// been set up for it.
+void vdso_enable_sysenter(void);
+
+/// @brief Updates the clock inside the vDSO page, called at every tick.
+/// @details The timer handler is the only writer.
+void vdso_update(void);
@@ -0,0 +1,72 @@
+/// @file entry.c
+/// @brief Skeleton of the kernel in long mode.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// Only compiled with -DARCH=x86_64, to check the flags of the build: there
+/// is no long-mode boot code yet, so nothing calls kmain64 (see
+/// doc/x86_64.md).
+
+#include "arch/x86_64/registers.h"
+#include "drivers/serial.h"
+#include "hardware/msr.h"
+#include "io/port_io.h"
+#include "stddef.h"
+
+/// The Line Status Register of the UART.
+#define UART_LSR 5
+/// The transmitter holding register of the UART is empty.
+#define UART_LSR_THRE 0x20
+
+/// @brief Writes a string on the first serial port, without interrupts.
+/// @param str the string.
+static void x86_64_serial_puts(const char *str)
+{
+    for (; *str; ++str) {
+        while (!(inportb(SERIAL_COM1 + UART_LSR) & UART_LSR_THRE)) {
+        }
+        outportb(SERIAL_COM1, *str);
+    }
+}
+
+/// @brief Writes a number on the first serial port, in hexadecimal.
+/// @param value the number.
+static void x86_64_serial_puthex(unsigned long value)
+{
+    char buffer[2 + 2 * sizeof(unsigned long) + 1];
+    size_t it = sizeof(buffer) - 1;
+    buffer[it] = 0;
+    do {
+        buffer[--it] = "0123456789abcdef"[value & 0xF];
+        value >>= 4;
+    } while (value && (it > 2));
+    buffer[--it] = 'x';
+    buffer[--it] = '0';
+    x86_64_serial_puts(buffer + it);
+}
+
+/// @brief Stops the CPU forever.
+static void x86_64_halt(void)
+{
+    for (;;) {
+        __asm__ __volatile__("cli; hlt");
+    }
+}
+
+/// @brief Reports on the first serial port whether the CPU is in long mode,
+/// and halts. Not called yet.
+/// @param magic the magic number left by the bootloader.
+/// @param info the information left by the bootloader.
+void kmain64(uint32_t magic, uintptr_t info)
+{
+    x86_64_serial_puts("MentOS x86_64: magic ");
+    x86_64_serial_puthex(magic);
+    x86_64_serial_puts(", info ");
+    x86_64_serial_puthex(info);
+    if (rdmsr(MSR_EFER) & EFER_LMA) {
+        x86_64_serial_puts(", long mode active.\n");
+    } else {
+        x86_64_serial_puts(", long mode NOT active.\n");
+    }
+    x86_64_halt();
+}
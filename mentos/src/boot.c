@@ -23,6 +23,12 @@ extern void boot_kernel(uint32_t stack_pointer, uint32_t entry, struct boot_info
 /// @brief Size of the kernel's stack.
 #define KERNEL_STACK_SIZE 0x100000
 
+/// @brief The most physical memory mapped in the kernel address space (lowmem).
+#define LOWMEM_MAX (896U * 1024U * 1024U)
+
+/// @brief The granularity of the lowmem, mapped with large pages.
+#define LOWMEM_ALIGN (4U * 1024U * 1024U)
+
 /// Serial port for QEMU.
 #define SERIAL_COM1 (0x03F8)
 
@@ -109,7 +115,7 @@ static void __setup_pages(uint32_t pfn_virt_start, uint32_t pfn_phys_start, uint
         boot_pgdir.entries[i].rw        = 1;
         boot_pgdir.entries[i].present   = 1;
         boot_pgdir.entries[i].available = 1;
-        boot_pgdir.entries[i].frame     = ((uint32_t)table) >> 12u;
+        boot_pgdir.entries[i].frame     = ((uintptr_t)table) >> 12u;
     }
 }
 
@@ -139,7 +145,7 @@ static void __get_kernel_low_high(elf_header_t *elf_hdr, uint32_t *virt_low, uin
     // Prepare a pointer to a program header.
     elf_program_header_t *program_header;
     // Compute the offset for accessing the program headers.
-    uint32_t offset = (uint32_t)elf_hdr + elf_hdr->phoff;
+    uintptr_t offset = (uintptr_t)elf_hdr + elf_hdr->phoff;
     // In this two variables we will store the start and end addresses of the segment.
     uint32_t segment_start, segment_end;
     // Iterate for each program header.
@@ -172,6 +178,41 @@ static inline uint32_t __get_address_after_modules(multiboot_info_t *header)
     return addr;
 }
 
+/// @brief Returns the end of the RAM starting at 1 MB, the only memory the
+/// kernel manages: below 4 GB, and without holes.
+/// @param header The multiboot info structure from which we extract the info.
+/// @return The first address after the RAM.
+static inline uint32_t __get_memory_end(multiboot_info_t *header)
+{
+    // The upper memory starts at 1 MB, and ends at the first hole.
+    uint32_t end = 0x100000U + min(header->mem_upper, 0x3FFC00U) * 1024U;
+    if (!(header->flags & MULTIBOOT_FLAG_MMAP)) {
+        return end;
+    }
+    // With a memory map, follow the available regions from 1 MB, which might
+    // be split, and not sorted.
+    uint32_t mmap_end = 0x100000U;
+    for (bool_t grown = true; grown;) {
+        grown = false;
+        uintptr_t it = header->mmap_addr;
+        while (it < (header->mmap_addr + header->mmap_length)) {
+            multiboot_memory_map_t *entry = (multiboot_memory_map_t *)it;
+            it += entry->size + sizeof(entry->size);
+            if ((entry->type != MULTIBOOT_MEMORY_AVAILABLE) || entry->base_addr_high) {
+                continue;
+            }
+            // Stop at 4 GB, the highest address we can map.
+            uint32_t base  = entry->base_addr_low;
+            uint32_t limit = (entry->length_high || (entry->length_low > (0xFFFFF000U - base))) ? 0xFFFFF000U : base + entry->length_low;
+            if ((base <= mmap_end) && (limit > mmap_end)) {
+                mmap_end = limit & 0xFFFFF000U;
+                grown    = true;
+            }
+        }
+    }
+    return (mmap_end > 0x100000U) ? mmap_end : end;
+}
+
 /// @brief Relocate the kernel image.
 /// @param elf_hdr The elf header of the kernel.
 static inline void __relocate_kernel_image(elf_header_t *elf_hdr)
@@ -184,7 +225,7 @@ static inline void __relocate_kernel_image(elf_header_t *elf_hdr)
     // Get the elf file starting address.
     kernel_start = (char *)elf_hdr;
     // Compute the offset for accessing the program headers.
-    offset = (uint32_t)kernel_start + elf_hdr->phoff;
+    offset = (uintptr_t)kernel_start + elf_hdr->phoff;
     // Iterate over the program headers.
     for (int i = 0; i < elf_hdr->phnum; i++) {
         // Get the program header.
@@ -220,8 +261,8 @@ void boot_main(uint32_t magic, multiboot_info_t *header, uint32_t esp)
     elf_header_t *elf_hdr = (elf_header_t *)LDVAR(kernel_bin);
 
     // Get the physical addresses of where the kernel starts and ends.
-    uint32_t boot_start = (uint32_t)_bootloader_start;
-    uint32_t boot_end   = (uint32_t)_bootloader_end;
+    uintptr_t boot_start = (uintptr_t)_bootloader_start;
+    uintptr_t boot_end   = (uintptr_t)_bootloader_end;
 
     // Extract the lowest and highest address of the kernel.
     uint32_t kernel_virt_low  = 0xFFFFFFFF;
@@ -237,6 +278,7 @@ void boot_main(uint32_t magic, multiboot_info_t *header, uint32_t esp)
     boot_info.kernel_end           = kernel_virt_high;
     boot_info.kernel_size          = kernel_virt_high - kernel_virt_low;
     boot_info.multiboot_header     = header;
+    boot_info.kernel_elf_phy       = (uintptr_t)elf_hdr;
 
     // Get the address after the modules.
     boot_info.module_end = __get_address_after_modules(header);
@@ -245,6 +287,10 @@ void boot_main(uint32_t magic, multiboot_info_t *header, uint32_t esp)
     uint32_t kernel_phy_page_start = __align_rup(boot_info.module_end, PAGE_SIZE);
     // Get the starting address of the virtual pages.
     uint32_t kernel_virt_page_start = __align_rdown(kernel_virt_low, PAGE_SIZE);
+    // Move the physical pages forward, so that they have the same offset of the
+    // virtual ones inside a large page, and the kernel can map the lowmem with
+    // large pages. This leaves unused less than a large page of memory.
+    kernel_phy_page_start += (kernel_virt_page_start - kernel_phy_page_start) & (LARGE_PAGE_SIZE - 1);
 
     // Compute the absolute offset of the first virtual page, by subtracting
     // the starting address of the virtual pages and the lowest virtual address
@@ -258,8 +304,12 @@ void boot_main(uint32_t magic, multiboot_info_t *header, uint32_t esp)
     // size of the kernel (virt_high - virt_low).
     boot_info.kernel_phy_end = boot_info.kernel_phy_start + boot_info.kernel_size;
 
+    // The lowmem is at most 896 MB, but with less memory an eighth of it is
+    // left to the highmem, where the pages of the processes come from.
+    uint32_t memory_end = __get_memory_end(header);
+
     boot_info.lowmem_phy_start = __align_rup(boot_info.kernel_phy_end, PAGE_SIZE);
-    boot_info.lowmem_phy_end   = 896 * 1024 * 1024; // 896 MB of low memory max
+    boot_info.lowmem_phy_end   = __align_rdown(min(LOWMEM_MAX, memory_end - memory_end / 8), LOWMEM_ALIGN);
 
     uint32_t lowmem_size = boot_info.lowmem_phy_end - boot_info.lowmem_phy_start;
 
@@ -267,7 +317,7 @@ void boot_main(uint32_t magic, multiboot_info_t *header, uint32_t esp)
     boot_info.lowmem_end   = boot_info.lowmem_start + lowmem_size;
 
     boot_info.highmem_phy_start = boot_info.lowmem_phy_end;
-    boot_info.highmem_phy_end   = header->mem_upper * 1024;
+    boot_info.highmem_phy_end   = memory_end;
     boot_info.stack_end         = boot_info.lowmem_end;
 
     // Setup the page directory and page tables for the boot.
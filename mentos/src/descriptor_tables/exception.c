@@ -12,6 +12,7 @@
 #include "system/panic.h"
 #include "descriptor_tables/isr.h"
 #include "descriptor_tables/idt.h"
+#include "system/latency_trace.h"
 #include "stdio.h"
 
 /// @brief Default error messages for exceptions.
@@ -77,12 +78,18 @@ static inline void default_isr_handler(pt_regs *f)
 void isr_handler(pt_regs *f)
 {
     uint32_t isr_number = f->int_no;
+#ifdef ENABLE_LATENCY_TRACE
+    latency_irq_enter(f);
+#endif
     if (isr_number != 80) {
         //		pr_default("calling ISR %d\n", isr_number);
     }
     //    pr_default("calling ISR %d\n", isr_number);
     isr_routines[isr_number](f);
     //    pr_default("end calling ISR %d\n", isr_number);
+#ifdef ENABLE_LATENCY_TRACE
+    latency_irq_exit(f);
+#endif
 }
 
 void isrs_init(void)
@@ -11,9 +11,14 @@
 
 #include "descriptor_tables/gdt.h"
 #include "descriptor_tables/tss.h"
+#include "hardware/smp.h"
+#include "klib/spinlock.h"
 
-/// The maximum dimension of the GDT.
-#define GDT_SIZE 10
+/// Index of the first segment of the thread-local storage.
+#define GDT_TLS_INDEX (GDT_TSS_INDEX + SMP_MAX_CPUS)
+/// The maximum dimension of the GDT, the segments followed by a TSS for each
+/// CPU, and by the segments of the thread-local storage.
+#define GDT_SIZE (GDT_TLS_INDEX + GDT_TLS_ENTRIES)
 
 /// @brief This will be a function in gdt.s. We use this to properly
 ///        reload the new segment registers
@@ -25,6 +30,8 @@ gdt_descriptor_t gdt[GDT_SIZE];
 
 /// Pointer structure to give to the CPU.
 gdt_pointer_t gdt_pointer;
+/// Protects the allocation of the segments of the thread-local storage.
+static spinlock_t gdt_tls_lock;
 
 void init_gdt(void)
 {
@@ -48,8 +55,8 @@ void init_gdt(void)
     //  - And one for the TSS (task state segment).
     // The limit is the last valid byte from the start of the GDT.
     // i.e. the size of the GDT - 1.
-    gdt_pointer.limit = sizeof(gdt_descriptor_t) * 6 - 1;
-    gdt_pointer.base  = (uint32_t)&gdt;
+    gdt_pointer.limit = sizeof(gdt_descriptor_t) * GDT_SIZE - 1;
+    gdt_pointer.base  = (uintptr_t)&gdt;
 
     // ------------------------------------------------------------------------
     // NULL
@@ -100,14 +107,23 @@ void init_gdt(void)
         GDT_PRESENT | GDT_USER | GDT_DATA,
         GDT_GRANULARITY | GDT_OPERAND_SIZE);
 
-    // Initialize the TSS
-    tss_init(5, 0x10);
+    // Initialize the TSS of each CPU.
+    for (unsigned cpu = 0; cpu < SMP_MAX_CPUS; ++cpu) {
+        tss_init(cpu, 0x10);
+    }
+
+    spinlock_init(&gdt_tls_lock);
+
+    gdt_load(0);
+}
 
+void gdt_load(unsigned cpu)
+{
     // Inform the CPU about the changes on the GDT.
-    gdt_flush((uint32_t)&gdt_pointer);
+    gdt_flush((uintptr_t)&gdt_pointer);
 
     // Inform the CPU about the changes on the TSS.
-    tss_flush();
+    tss_flush(TSS_SELECTOR(cpu));
 }
 
 void gdt_set_gate(uint8_t index, uint32_t base, uint32_t limit, uint8_t access, uint8_t granul)
@@ -130,6 +146,41 @@ void gdt_set_gate(uint8_t index, uint32_t base, uint32_t limit, uint8_t access,
         gdt[index].base_high, gdt[index].access, gdt[index].granularity);
 }
 
+uint16_t gdt_tls_alloc(uint32_t base)
+{
+    uint16_t selector = 0;
+    spinlock_lock(&gdt_tls_lock);
+    for (uint8_t index = GDT_TLS_INDEX; index < GDT_SIZE; ++index) {
+        // A free segment is not present.
+        if (!(gdt[index].access & GDT_PRESENT)) {
+            // Same as the user data segment, but starting at base.
+            gdt_set_gate(
+                index,
+                base,
+                0xFFFFFFFF,
+                GDT_PRESENT | GDT_USER | GDT_DATA,
+                GDT_GRANULARITY | GDT_OPERAND_SIZE);
+            // The selector of the segment, with the user privilege level.
+            selector = (uint16_t)((index << 3U) | 3U);
+            break;
+        }
+    }
+    spinlock_unlock(&gdt_tls_lock);
+    return selector;
+}
+
+void gdt_tls_free(uint16_t selector)
+{
+    uint16_t index = selector >> 3U;
+    if ((index < GDT_TLS_INDEX) || (index >= GDT_SIZE)) {
+        pr_err("Selector 0x%x is not a thread-local storage segment.\n", selector);
+        return;
+    }
+    spinlock_lock(&gdt_tls_lock);
+    gdt_set_gate((uint8_t)index, 0, 0, 0, 0);
+    spinlock_unlock(&gdt_tls_lock);
+}
+
 //
 // == VIRTUAL MEMORY SCHEMES ==================================================
 // x86 supports two virtual memory schemes:
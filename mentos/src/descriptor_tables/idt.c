@@ -12,6 +12,7 @@
 #include "descriptor_tables/idt.h"
 #include "descriptor_tables/gdt.h"
 #include "descriptor_tables/isr.h"
+#include "hardware/lapic.h"
 
 /// @brief Interrupt Service Routine (ISR) for exception handling.
 extern void INT_0(pt_regs *);
@@ -112,6 +113,42 @@ extern void IRQ_14(pt_regs *);
 /// @brief Interrupt Request (IRQ) coming from the PIC.
 extern void IRQ_15(pt_regs *);
 
+/// @brief Message signalled interrupt, delivered by the local APIC.
+extern void IRQ_MSI_0(pt_regs *);
+/// @brief Message signalled interrupt, delivered by the local APIC.
+extern void IRQ_MSI_1(pt_regs *);
+/// @brief Message signalled interrupt, delivered by the local APIC.
+extern void IRQ_MSI_2(pt_regs *);
+/// @brief Message signalled interrupt, delivered by the local APIC.
+extern void IRQ_MSI_3(pt_regs *);
+/// @brief Message signalled interrupt, delivered by the local APIC.
+extern void IRQ_MSI_4(pt_regs *);
+/// @brief Message signalled interrupt, delivered by the local APIC.
+extern void IRQ_MSI_5(pt_regs *);
+/// @brief Message signalled interrupt, delivered by the local APIC.
+extern void IRQ_MSI_6(pt_regs *);
+/// @brief Message signalled interrupt, delivered by the local APIC.
+extern void IRQ_MSI_7(pt_regs *);
+/// @brief Message signalled interrupt, delivered by the local APIC.
+extern void IRQ_MSI_8(pt_regs *);
+/// @brief Message signalled interrupt, delivered by the local APIC.
+extern void IRQ_MSI_9(pt_regs *);
+/// @brief Message signalled interrupt, delivered by the local APIC.
+extern void IRQ_MSI_10(pt_regs *);
+/// @brief Message signalled interrupt, delivered by the local APIC.
+extern void IRQ_MSI_11(pt_regs *);
+/// @brief Message signalled interrupt, delivered by the local APIC.
+extern void IRQ_MSI_12(pt_regs *);
+/// @brief Message signalled interrupt, delivered by the local APIC.
+extern void IRQ_MSI_13(pt_regs *);
+/// @brief Message signalled interrupt, delivered by the local APIC.
+extern void IRQ_MSI_14(pt_regs *);
+/// @brief Message signalled interrupt, delivered by the local APIC.
+extern void IRQ_MSI_15(pt_regs *);
+
+/// @brief Spurious interrupt of the local APIC.
+extern void IRQ_SPURIOUS(pt_regs *);
+
 /// @brief This function is in idt.asm.
 /// @param idt_pointer Address of the idt.
 extern void idt_flush(uint32_t idt_pointer);
@@ -153,7 +190,7 @@ void init_idt(void)
     // Just like the GDT, the IDT has a "limit" field that is set to the last
     // valid byte in the IDT, after adding in the start position (i.e. size-1).
     idt_pointer.limit = sizeof(idt_descriptor_t) * IDT_SIZE - 1;
-    idt_pointer.base  = (uint32_t)&idt_table;
+    idt_pointer.base  = (uintptr_t)&idt_table;
 
     // Initialize ISR for CPU execptions.
     isrs_init();
@@ -219,9 +256,35 @@ void init_idt(void)
     __idt_set_gate(46, IRQ_14, GDT_PRESENT | GDT_KERNEL, 0x8);
     __idt_set_gate(47, IRQ_15, GDT_PRESENT | GDT_KERNEL, 0x8);
 
+    // Message signalled interrupts.
+    __idt_set_gate(48, IRQ_MSI_0, GDT_PRESENT | GDT_KERNEL, 0x8);
+    __idt_set_gate(49, IRQ_MSI_1, GDT_PRESENT | GDT_KERNEL, 0x8);
+    __idt_set_gate(50, IRQ_MSI_2, GDT_PRESENT | GDT_KERNEL, 0x8);
+    __idt_set_gate(51, IRQ_MSI_3, GDT_PRESENT | GDT_KERNEL, 0x8);
+    __idt_set_gate(52, IRQ_MSI_4, GDT_PRESENT | GDT_KERNEL, 0x8);
+    __idt_set_gate(53, IRQ_MSI_5, GDT_PRESENT | GDT_KERNEL, 0x8);
+    __idt_set_gate(54, IRQ_MSI_6, GDT_PRESENT | GDT_KERNEL, 0x8);
+    __idt_set_gate(55, IRQ_MSI_7, GDT_PRESENT | GDT_KERNEL, 0x8);
+    __idt_set_gate(56, IRQ_MSI_8, GDT_PRESENT | GDT_KERNEL, 0x8);
+    __idt_set_gate(57, IRQ_MSI_9, GDT_PRESENT | GDT_KERNEL, 0x8);
+    __idt_set_gate(58, IRQ_MSI_10, GDT_PRESENT | GDT_KERNEL, 0x8);
+    __idt_set_gate(59, IRQ_MSI_11, GDT_PRESENT | GDT_KERNEL, 0x8);
+    __idt_set_gate(60, IRQ_MSI_12, GDT_PRESENT | GDT_KERNEL, 0x8);
+    __idt_set_gate(61, IRQ_MSI_13, GDT_PRESENT | GDT_KERNEL, 0x8);
+    __idt_set_gate(62, IRQ_MSI_14, GDT_PRESENT | GDT_KERNEL, 0x8);
+    __idt_set_gate(63, IRQ_MSI_15, GDT_PRESENT | GDT_KERNEL, 0x8);
+
     // System call!
     __idt_set_gate(128, INT_80, GDT_PRESENT | GDT_USER, 0x8);
 
+    // Spurious interrupts of the local APIC.
+    __idt_set_gate(LAPIC_SPURIOUS_VECTOR, IRQ_SPURIOUS, GDT_PRESENT | GDT_KERNEL, 0x8);
+
+    idt_load();
+}
+
+void idt_load(void)
+{
     // Points the processor's internal register to the new IDT.
-    idt_flush((uint32_t)&idt_pointer);
+    idt_flush((uintptr_t)&idt_pointer);
 }
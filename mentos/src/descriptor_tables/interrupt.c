@@ -11,11 +11,15 @@
 
 #include "descriptor_tables/isr.h"
 #include "process/scheduler.h"
+#include "hardware/lapic.h"
 #include "hardware/pic8259.h"
+#include "system/latency_trace.h"
 #include "system/printk.h"
+#include "system/softirq.h"
 #include "assert.h"
 #include "stdio.h"
 #include "descriptor_tables/idt.h"
+#include "sys/errno.h"
 
 /// @brief Shared interrupt handlers, stored into a double-linked list.
 typedef struct irq_struct_t {
@@ -32,6 +36,18 @@ static list_head shared_interrupt_handlers[IRQ_NUM];
 /// Cache where we will store the data regarding an irq service.
 static kmem_cache_t *irq_cache;
 
+/// @brief The handler of a message signalled interrupt, which has its own
+/// vector and is never shared.
+typedef struct msi_struct_t {
+    /// Pointer to the handler, NULL if the vector is free.
+    interrupt_handler_t handler;
+    /// Pointer to the description of the handler.
+    char *description;
+} msi_struct_t;
+
+/// The handlers of the message signalled interrupts, by vector.
+static msi_struct_t msi_handlers[MSI_VECTOR_NUM];
+
 /// @brief Creates a new irq structure.
 /// @return a pointer to the newly created irq structure.
 static inline irq_struct_t *__irq_struct_alloc(void)
@@ -108,8 +124,46 @@ int irq_uninstall_handler(unsigned i, interrupt_handler_t handler)
     return 0;
 }
 
+int irq_alloc_msi_vector(interrupt_handler_t handler, char *description)
+{
+    for (unsigned i = 0; i < MSI_VECTOR_NUM; ++i) {
+        if (msi_handlers[i].handler == NULL) {
+            msi_handlers[i].description = description;
+            msi_handlers[i].handler     = handler;
+            return MSI_VECTOR_BASE + i;
+        }
+    }
+    pr_err("There are no free vectors for `%s`.\n", description);
+    return -ENOSPC;
+}
+
+void irq_free_msi_vector(unsigned vector)
+{
+    if ((vector >= MSI_VECTOR_BASE) && (vector < MSI_VECTOR_BASE + MSI_VECTOR_NUM)) {
+        msi_handlers[vector - MSI_VECTOR_BASE].handler = NULL;
+    }
+}
+
 void irq_handler(pt_regs *f)
 {
+#ifdef ENABLE_LATENCY_TRACE
+    latency_irq_enter(f);
+#endif
+    // Message signalled interrupts come from the local APIC.
+    if (f->int_no >= MSI_VECTOR_BASE) {
+        msi_struct_t *msi = &msi_handlers[f->int_no - MSI_VECTOR_BASE];
+        if (msi->handler) {
+            msi->handler(f);
+        } else {
+            pr_err("There are no handler for vector `%d`\n", f->int_no);
+        }
+        lapic_eoi();
+        softirq_run();
+#ifdef ENABLE_LATENCY_TRACE
+        latency_irq_exit(f);
+#endif
+        return;
+    }
     // Keep in mind,
     // because of irq mapping, the first PIC's irq line is shifted by 32.
     unsigned irq_line = f->int_no - 32;
@@ -132,4 +186,9 @@ void irq_handler(pt_regs *f)
     }
     // Send the end-of-interrupt to PIC.
     pic8259_send_eoi(irq_line);
+    // Run the bottom halves the handlers left behind, with interrupts enabled.
+    softirq_run();
+#ifdef ENABLE_LATENCY_TRACE
+    latency_irq_exit(f);
+#endif
 }
@@ -12,15 +12,18 @@
 #include "descriptor_tables/tss.h"
 #include "string.h"
 #include "descriptor_tables/gdt.h"
+#include "hardware/smp.h"
 
-/// @brief The kernel 
-/// 
-static tss_entry_t kernel_tss;
+/// @brief The TSS of each CPU, which holds the stack used when entering the
+/// kernel from user mode.
+static tss_entry_t kernel_tss[SMP_MAX_CPUS];
 
-void tss_init(uint8_t idx, uint32_t ss0)
+void tss_init(unsigned cpu, uint32_t ss0)
 {
-    uint32_t base  = (uint32_t)&kernel_tss;
-    uint32_t limit = base + sizeof(tss_entry_t);
+    tss_entry_t *tss = &kernel_tss[cpu];
+    uint8_t idx      = GDT_TSS_INDEX + cpu;
+    uintptr_t base   = (uintptr_t)tss;
+    uint32_t limit   = base + sizeof(tss_entry_t);
 
     // Add the TSS descriptor to the GDT.
     // Kernel tss, access(E9 = 1 11 0 1 0 0 1)
@@ -38,22 +41,23 @@ void tss_init(uint8_t idx, uint32_t ss0)
     // because the CPU needs to know what esp to use when usermode app is
     // calling a kernel function(aka system call), that's why we have a
     // function below called tss_set_stack.
-    memset(&kernel_tss, 0x0, sizeof(tss_entry_t));
-    kernel_tss.ss0   = ss0;
-    kernel_tss.esp0  = 0x0;
-    kernel_tss.cs    = 0x0b;
-    kernel_tss.ds    = 0x13;
-    kernel_tss.es    = 0x13;
-    kernel_tss.fs    = 0x13;
-    kernel_tss.gs    = 0x13;
-    kernel_tss.ss    = 0x13;
-    kernel_tss.iomap = sizeof(tss_entry_t);
+    memset(tss, 0x0, sizeof(tss_entry_t));
+    tss->ss0   = ss0;
+    tss->esp0  = 0x0;
+    tss->cs    = 0x0b;
+    tss->ds    = 0x13;
+    tss->es    = 0x13;
+    tss->fs    = 0x13;
+    tss->gs    = 0x13;
+    tss->ss    = 0x13;
+    tss->iomap = sizeof(tss_entry_t);
 }
 
 void tss_set_stack(uint32_t kss, uint32_t kesp)
 {
+    tss_entry_t *tss = &kernel_tss[smp_processor_id()];
     // Kernel data segment.
-    kernel_tss.ss0 = kss;
+    tss->ss0 = kss;
     // Kernel stack address.
-    kernel_tss.esp0 = kesp;
+    tss->esp0 = kesp;
 }
@@ -18,10 +18,9 @@
 #include "string.h"
 #include "system/signal.h"
 
-/// Pointerst to the current thread using the FPU.
+/// @brief The task whose FPU state is loaded inside the registers, NULL if
+/// they hold no state worth saving (e.g., after the kernel used them).
 task_struct *thread_using_fpu = NULL;
-/// Temporary aligned buffer for copying around FPU contexts.
-uint8_t saves[512] __attribute__((aligned(16)));
 
 /// @brief Set the FPU control word.
 /// @param cw What to set the control word to.
@@ -59,15 +58,38 @@ static inline void __disable_fpu(void)
     __asm__ __volatile__("mov %0, %%cr0" ::"r"(t));
 }
 
+/// @brief Checks if the FPU instructions trap, because CR0.TS is set.
+/// @return 1 if they trap, 0 otherwise.
+static inline int __fpu_traps(void)
+{
+    size_t t;
+    __asm__ __volatile__("mov %%cr0, %0"
+                         : "=r"(t));
+    return (t & (1U << 3U)) != 0;
+}
+
+/// @brief Makes the FPU instructions trap, or not, writing CR0 only when needed.
+/// @param trap 1 to make them trap, 0 otherwise.
+static inline void __fpu_set_trap(int trap)
+{
+    if (__fpu_traps() == trap) {
+        return;
+    }
+    if (trap) {
+        __disable_fpu();
+    } else {
+        __asm__ __volatile__("clts");
+    }
+}
+
 /// @brief Restore the FPU for a process.
 /// @param proc the process for which we are restoring the FPU registers.
 static inline void __restore_fpu(task_struct *proc)
 {
     assert(proc && "Trying to restore FPU of NULL process.");
-
-    memcpy(&saves, (uint8_t *)&proc->thread.fpu_register, 512);
-
-    __asm__ __volatile__("fxrstor (%0)" ::"r"(saves));
+    // The storage is aligned to 16 bytes, as fxrstor wants, together with
+    // the task_struct holding it.
+    __asm__ __volatile__("fxrstor %0" ::"m"(proc->thread.fpu_register));
 }
 
 /// @brief Save the FPU for a process.
@@ -75,10 +97,8 @@ static inline void __restore_fpu(task_struct *proc)
 static inline void __save_fpu(task_struct *proc)
 {
     assert(proc && "Trying to save FPU of NULL process.");
-
-    __asm__ __volatile__("fxsave (%0)" ::"r"(saves));
-
-    memcpy((uint8_t *)&proc->thread.fpu_register, &saves, 512);
+    __asm__ __volatile__("fxsave %0"
+                         : "=m"(proc->thread.fpu_register));
 }
 
 /// Initialize the FPU.
@@ -92,9 +112,21 @@ static inline void __init_fpu(void)
 static inline void __invalid_op(pt_regs *f)
 {
     pr_debug("__invalid_op(%p)\n", f);
+    task_struct *task = scheduler_get_current_process();
     // First, turn the FPU on.
-    __enable_fpu();
-    if (thread_using_fpu == scheduler_get_current_process()) {
+    __asm__ __volatile__("clts");
+    if ((f->cs & 3) != 3) {
+        // The kernel wants the registers, kernel threads included, which use
+        // them only in between their switches: put the state of their owner
+        // away, it is restored when the owner uses the FPU again.
+        if (thread_using_fpu) {
+            __save_fpu(thread_using_fpu);
+            thread_using_fpu = NULL;
+        }
+        __init_fpu();
+        return;
+    }
+    if (thread_using_fpu == task) {
         // If this is the thread that last used the FPU, do nothing.
         return;
     }
@@ -102,18 +134,16 @@ static inline void __invalid_op(pt_regs *f)
         // If there is a thread that was using the FPU, save its state.
         __save_fpu(thread_using_fpu);
     }
-    thread_using_fpu = scheduler_get_current_process();
-    if (!thread_using_fpu->thread.fpu_enabled) {
-        /*
-         * If the FPU has not been used in this thread previously,
-         * we need to initialize it.
-         */
+    thread_using_fpu = task;
+    if (!task->thread.fpu_enabled) {
+        // If the FPU has not been used in this thread previously, we need
+        // to initialize it.
         __init_fpu();
-        thread_using_fpu->thread.fpu_enabled = true;
+        task->thread.fpu_enabled = true;
         return;
     }
     // Otherwise we restore the context for this thread.
-    __restore_fpu(thread_using_fpu);
+    __restore_fpu(task);
 }
 
 /// Kernel trap for various integer and floating-point errors
@@ -159,19 +189,47 @@ static int __fpu_test(void)
 
 void switch_fpu(void)
 {
-    __save_fpu(scheduler_get_current_process());
+    // The registers of the owner are live: make the kernel trap if it uses
+    // them, so that they are saved first.
+    if (thread_using_fpu) {
+        __fpu_set_trap(1);
+    }
 }
 
-void unswitch_fpu(void)
+void unswitch_fpu(pt_regs *f)
 {
-    __restore_fpu(scheduler_get_current_process());
+    // The kernel, and its threads, use the registers as scratch, which are
+    // never live across a switch, thus leave them as they are.
+    if ((f->cs & 3) != 3) {
+        return;
+    }
+    // If the task returning to user mode still owns the registers, nobody
+    // touched them, otherwise its first FPU instruction loads its state.
+    __fpu_set_trap(thread_using_fpu != scheduler_get_current_process());
+}
+
+void fpu_save_task(task_struct *task)
+{
+    if (thread_using_fpu == task) {
+        int trap = __fpu_traps();
+        __fpu_set_trap(0);
+        __save_fpu(task);
+        __fpu_set_trap(trap);
+    }
+}
+
+void fpu_release_task(task_struct *task)
+{
+    if (thread_using_fpu == task) {
+        thread_using_fpu = NULL;
+    }
+    task->thread.fpu_enabled = false;
 }
 
 int fpu_install(void)
 {
     __enable_fpu();
     __init_fpu();
-    __save_fpu(scheduler_get_current_process());
 
     // Install the handler for device missing
     isr_install_handler(DEV_NOT_AVL, &__invalid_op, "fpu: device missing");
@@ -184,5 +242,10 @@ int fpu_install(void)
     // NB: The exceptions bolow don't seems to ever trigger
     //isr_install_handler(OVERFLOW,           &__sigfpe_handler, "overflow");
 
-    return __fpu_test();
+    int ret = __fpu_test();
+    // From now on, the FPU is handed to the tasks on demand, the first FPU
+    // instruction of each task traps.
+    thread_using_fpu = NULL;
+    __fpu_set_trap(1);
+    return ret;
 }
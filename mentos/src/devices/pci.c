@@ -11,8 +11,11 @@
 #include "io/debug.h"                    // Include debugging functions.
 
 #include "devices/pci.h"
+#include "hardware/lapic.h"
 #include "io/port_io.h"
+#include "mem/vmem_map.h"
 #include "string.h"
+#include "sys/errno.h"
 
 /// The configuration bit in I/O location CF8h[31] must be set to 1b.
 #define PCI_ADDR_ENABLE 0x80000000
@@ -492,6 +495,186 @@ int pci_get_interrupt(uint32_t device)
     return pci_remaps[pirq];
 }
 
+/// @name MSI registers
+/// @brief Offsets from the capability entry, and their fields.
+/// @{
+#define MSI_CONTROL         0x02    ///< Message control, for both MSI and MSI-X.
+#define MSI_ADDRESS_LO      0x04    ///< Message address, low half.
+#define MSI_ADDRESS_HI      0x08    ///< Message address, high half, if 64-bit capable.
+#define MSI_DATA_32         0x08    ///< Message data, after a 32-bit address.
+#define MSI_DATA_64         0x0C    ///< Message data, after a 64-bit address.
+#define MSIX_TABLE          0x04    ///< Offset and base address index of the MSI-X table.
+#define MSI_CONTROL_ENABLE  0x0001u ///< Enables MSI.
+#define MSI_CONTROL_MME     0x0070u ///< Number of messages enabled, zero for one.
+#define MSI_CONTROL_64      0x0080u ///< The address has a high half.
+#define MSIX_CONTROL_MASK   0x4000u ///< Masks all the MSI-X vectors of the function.
+#define MSIX_CONTROL_ENABLE 0x8000u ///< Enables MSI-X.
+#define MSIX_TABLE_BIR      0x7u    ///< Index of the base address containing the table.
+/// @}
+
+/// The address of the local APICs as seen by the messages, the destination
+/// APIC ID goes in bits 19:12.
+#define MSI_ADDRESS_BASE 0xFEE00000u
+
+uint8_t pci_find_capability(uint32_t device, uint8_t id)
+{
+    if (!(pci_read_16(device, PCI_STATUS) & (1u << pci_status_capabilities_list))) {
+        return 0;
+    }
+    uint8_t offset = pci_read_8(device, PCI_CAPABILITY_LIST) & 0xFC;
+    // The entries live in the 192 bytes after the header, bound the walk in
+    // case a broken device links them in a loop.
+    for (int count = 0; offset && (count < 48); ++count) {
+        if (pci_read_8(device, offset) == id) {
+            return offset;
+        }
+        offset = pci_read_8(device, offset + 1) & 0xFC;
+    }
+    return 0;
+}
+
+void *pci_map_bar(uint32_t device, unsigned bar, uint32_t *size)
+{
+    if (bar > 5) {
+        return NULL;
+    }
+    int field      = PCI_BASE_ADDRESS_0 + bar * 4;
+    uint32_t value = pci_read_32(device, field);
+    if (value & PCI_BAR_IO) {
+        return NULL;
+    }
+    // The kernel can only reach the regions below 4GB.
+    if ((value & PCI_BAR_TYPE_64) && ((bar == 5) || pci_read_32(device, field + 4))) {
+        pr_warning("The base address %u of %x is above 4GB.\n", bar, device);
+        return NULL;
+    }
+    // The size is given by the address bits which stay zero when writing
+    // ones. Decoding is off meanwhile, so that the device does not answer at
+    // the bogus address, and on afterwards, as the caller wants the region.
+    uint16_t command = pci_read_16(device, PCI_COMMAND);
+    pci_write_16(device, PCI_COMMAND, command & ~(1u << pci_command_memory_space));
+    pci_write_32(device, field, 0xFFFFFFFF);
+    uint32_t length = ~(pci_read_32(device, field) & PCI_BAR_MEM_MASK) + 1;
+    pci_write_32(device, field, value);
+    pci_write_16(device, PCI_COMMAND, command | (1u << pci_command_memory_space));
+    uint32_t base = value & PCI_BAR_MEM_MASK;
+    if (!base || !length) {
+        return NULL;
+    }
+    uint32_t pages   = ((base & (PAGE_SIZE - 1)) + length + PAGE_SIZE - 1) / PAGE_SIZE;
+    uint32_t address = virt_map_io(base, pages);
+    if (!address) {
+        pr_err("Failed to map the base address %u of %x (0x%p, %u bytes).\n", bar, device, base, length);
+        return NULL;
+    }
+    if (size) {
+        *size = length;
+    }
+    return (void *)address;
+}
+
+void pci_unmap_bar(void *address)
+{
+    virt_unmap((uintptr_t)address);
+}
+
+/// @brief Programs the MSI capability of a device to send the given vector.
+/// @param device the device.
+/// @param cap the offset of the MSI capability.
+/// @param vector the vector.
+/// @return 0.
+static int __pci_enable_msi(uint32_t device, uint8_t cap, int vector)
+{
+    uint16_t control = pci_read_16(device, cap + MSI_CONTROL);
+    pci_write_32(device, cap + MSI_ADDRESS_LO, MSI_ADDRESS_BASE | ((uint32_t)lapic_get_id() << 12u));
+    if (control & MSI_CONTROL_64) {
+        pci_write_32(device, cap + MSI_ADDRESS_HI, 0);
+        pci_write_16(device, cap + MSI_DATA_64, vector);
+    } else {
+        pci_write_16(device, cap + MSI_DATA_32, vector);
+    }
+    // A single message, edge triggered.
+    pci_write_16(device, cap + MSI_CONTROL, (control & ~MSI_CONTROL_MME) | MSI_CONTROL_ENABLE);
+    return 0;
+}
+
+/// @brief Programs the first entry of the MSI-X table of a device to send the
+/// given vector, the others stay masked.
+/// @param device the device.
+/// @param cap the offset of the MSI-X capability.
+/// @param vector the vector.
+/// @return 0 on success, -ENODEV if the table cannot be mapped.
+static int __pci_enable_msix(uint32_t device, uint8_t cap, int vector)
+{
+    uint32_t table = pci_read_32(device, cap + MSIX_TABLE);
+    uint32_t size  = 0;
+    uint8_t *base  = pci_map_bar(device, table & MSIX_TABLE_BIR, &size);
+    if (base == NULL) {
+        return -ENODEV;
+    }
+    if ((table & ~MSIX_TABLE_BIR) + 16 > size) {
+        pci_unmap_bar(base);
+        return -ENODEV;
+    }
+    // Each entry holds the address, its high half, the data, and the mask.
+    volatile uint32_t *entry = (volatile uint32_t *)(base + (table & ~MSIX_TABLE_BIR));
+    // Mask the whole function while the entry changes.
+    uint16_t control = pci_read_16(device, cap + MSI_CONTROL);
+    pci_write_16(device, cap + MSI_CONTROL, control | MSIX_CONTROL_ENABLE | MSIX_CONTROL_MASK);
+    entry[0] = MSI_ADDRESS_BASE | ((uint32_t)lapic_get_id() << 12u);
+    entry[1] = 0;
+    entry[2] = vector;
+    entry[3] = 0;
+    pci_write_16(device, cap + MSI_CONTROL, (control | MSIX_CONTROL_ENABLE) & ~MSIX_CONTROL_MASK);
+    pci_unmap_bar(base);
+    return 0;
+}
+
+int pci_enable_msi(uint32_t device, interrupt_handler_t handler, char *description)
+{
+    uint8_t msix = pci_find_capability(device, PCI_CAP_ID_MSIX);
+    uint8_t msi  = pci_find_capability(device, PCI_CAP_ID_MSI);
+    // The messages are delivered to the local APIC.
+    if ((!msix && !msi) || (lapic_install_default() < 0)) {
+        return -ENODEV;
+    }
+    int vector = irq_alloc_msi_vector(handler, description);
+    if (vector < 0) {
+        return vector;
+    }
+    int ret = -ENODEV;
+    if (msix) {
+        ret = __pci_enable_msix(device, msix, vector);
+    }
+    if ((ret < 0) && msi) {
+        ret = __pci_enable_msi(device, msi, vector);
+    }
+    if (ret < 0) {
+        irq_free_msi_vector(vector);
+        return ret;
+    }
+    // The messages are memory writes, which need bus mastering, and they
+    // replace the INTx line, which is silenced.
+    uint16_t command = pci_read_16(device, PCI_COMMAND);
+    command |= (1u << pci_command_bus_master) | (1u << pci_command_interrupt_disable);
+    pci_write_16(device, PCI_COMMAND, command);
+    pr_debug("Device %x signals vector %d through %s.\n", device, vector, (msix && (ret == 0)) ? "MSI-X" : "MSI");
+    return vector;
+}
+
+void pci_disable_msi(uint32_t device, int vector)
+{
+    uint8_t cap;
+    if ((cap = pci_find_capability(device, PCI_CAP_ID_MSIX)) != 0) {
+        pci_write_16(device, cap + MSI_CONTROL, pci_read_16(device, cap + MSI_CONTROL) & ~MSIX_CONTROL_ENABLE);
+    }
+    if ((cap = pci_find_capability(device, PCI_CAP_ID_MSI)) != 0) {
+        pci_write_16(device, cap + MSI_CONTROL, pci_read_16(device, cap + MSI_CONTROL) & ~MSI_CONTROL_ENABLE);
+    }
+    pci_write_16(device, PCI_COMMAND, pci_read_16(device, PCI_COMMAND) & ~(1u << pci_command_interrupt_disable));
+    irq_free_msi_vector(vector);
+}
+
 void pci_dump_device_data(uint32_t device, uint16_t vendorid, uint16_t deviceid)
 {
     uint8_t bus = PCI_GET_BUS(device), slot = PCI_GET_SLOT(device), func = PCI_GET_FUNC(device);
@@ -0,0 +1,1172 @@
+/// @file ahci.c
+/// @brief Driver for the Serial ATA disks behind an Advanced Host Controller
+/// Interface (AHCI) controller.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @addtogroup ahci
+/// @{
+
+// Setup the logging for this file (do this before any other include).
+#include "sys/kernel_levels.h"           // Include kernel log levels.
+#define __DEBUG_HEADER__ "[AHCI  ]"      ///< Change header.
+#define __DEBUG_LEVEL__  LOGLEVEL_NOTICE ///< Set log level.
+#include "io/debug.h"                    // Include debugging functions.
+
+#include "drivers/ata/ahci.h"
+
+#include "descriptor_tables/isr.h"
+#include "devices/pci.h"
+#include "fs/buffer_cache.h"
+#include "fs/vfs.h"
+#include "hardware/pic8259.h"
+#include "hardware/timer.h"
+#include "klib/irqflags.h"
+#include "math.h"
+#include "mem/kheap.h"
+#include "mem/paging.h"
+#include "mem/zone_allocator.h"
+#include "process/scheduler.h"
+#include "process/wait.h"
+#include "stddef.h"
+#include "stdio.h"
+#include "string.h"
+#include "sys/errno.h"
+#include "system/panic.h"
+#include "system/softirq.h"
+#include "system/syscall.h"
+#include "system/trace.h"
+
+#define AHCI_ABAR                5                                               ///< The base address of the registers of the controller.
+#define AHCI_MAX_PORTS           32                                              ///< Maximum number of ports of a controller.
+#define AHCI_MAX_SLOTS           32                                              ///< Maximum number of command slots of a port.
+#define AHCI_SECTOR_SIZE         512                                             ///< The sector size.
+#define AHCI_MAX_SECTORS         256                                             ///< Maximum number of sectors moved by a single command.
+#define AHCI_PRDT_ENTRIES        ((AHCI_MAX_SECTORS * AHCI_SECTOR_SIZE / PAGE_SIZE) + 1) ///< One PRD per page, one more for an unaligned buffer.
+#define AHCI_PRD_MAX_SIZE        0x400000                                        ///< Maximum number of bytes described by a single PRD (4 MiB).
+#define AHCI_BOUNCE_SECTORS      (AHCI_MAX_SECTORS * 2)                          ///< Sectors of the buffer used for the transfers from and to user memory.
+#define AHCI_MAX_DISK_SECTORS    (0xFFFFFFFFU / AHCI_SECTOR_SIZE)                ///< Sectors we can address with a 32-bit offset.
+#define AHCI_IRQ_TIMEOUT_SECONDS 5                                               ///< Seconds we wait for the completion of a command before giving up.
+#define AHCI_SPIN_LIMIT          1000000                                         ///< Reads of a register before giving up on a state change.
+#define AHCI_EXEC_SPIN_LIMIT     100000000                                       ///< Reads of a register before giving up on a polled command.
+
+/// @name Generic host control.
+/// @{
+#define AHCI_CAP_NCS(cap) ((((cap) >> 8) & 0x1F) + 1) ///< Number of command slots.
+#define AHCI_CAP_SNCQ     (1U << 30)                 ///< Supports native command queuing.
+#define AHCI_GHC_HR       (1U << 0)                  ///< HBA reset.
+#define AHCI_GHC_IE       (1U << 1)                  ///< Interrupt enable.
+#define AHCI_GHC_AE       (1U << 31)                 ///< AHCI enable.
+/// @}
+
+/// @name Port registers.
+/// @{
+#define AHCI_PXCMD_ST        (1U << 0)    ///< Start processing the command list.
+#define AHCI_PXCMD_FRE       (1U << 4)    ///< FIS receive enable.
+#define AHCI_PXCMD_FR        (1U << 14)   ///< FIS receive running.
+#define AHCI_PXCMD_CR        (1U << 15)   ///< Command list running.
+#define AHCI_PXIS_TFES       (1U << 30)   ///< Task file error status.
+#define AHCI_PXIS_ERRORS     0x7D800010U  ///< Fatal and non-fatal error bits.
+#define AHCI_PXIE_DEFAULT    0x7D80002FU  ///< Completions of every kind of FIS, and errors.
+#define AHCI_SSTS_DET(ssts)  ((ssts) & 0x0F)        ///< Device detection.
+#define AHCI_SSTS_IPM(ssts)  (((ssts) >> 8) & 0x0F) ///< Interface power management.
+#define AHCI_SSTS_DET_PRESENT 3           ///< Device present, and communication established.
+#define AHCI_SSTS_IPM_ACTIVE  1           ///< Interface in active state.
+#define AHCI_SIG_ATA          0x00000101U ///< Signature of a SATA disk.
+/// @}
+
+/// @name ATA commands.
+/// @{
+#define ATA_CMD_READ_DMA            0xC8 ///< Read with a 28-bit address.
+#define ATA_CMD_READ_DMA_EXT        0x25 ///< Read with a 48-bit address.
+#define ATA_CMD_WRITE_DMA           0xCA ///< Write with a 28-bit address.
+#define ATA_CMD_WRITE_DMA_EXT       0x35 ///< Write with a 48-bit address.
+#define ATA_CMD_READ_FPDMA_QUEUED   0x60 ///< Queued read.
+#define ATA_CMD_WRITE_FPDMA_QUEUED  0x61 ///< Queued write.
+#define ATA_CMD_FLUSH_CACHE         0xE7 ///< Writes back the cache of the disk.
+#define ATA_CMD_FLUSH_CACHE_EXT     0xEA ///< Writes back the cache of a 48-bit disk.
+#define ATA_CMD_IDENTIFY            0xEC ///< Identifies the disk.
+/// @}
+
+#define AHCI_FIS_TYPE_REG_H2D  0x27      ///< Register FIS, from the host to the device.
+#define AHCI_FIS_REG_H2D_SIZE  20        ///< Size of the register FIS.
+#define AHCI_CMD_WRITE         (1U << 6) ///< The command moves data to the device.
+
+/// @brief The registers of a port.
+typedef struct ahci_port_regs_t {
+    uint32_t clb;           ///< Command list base address.
+    uint32_t clbu;          ///< Command list base address, upper 32 bits.
+    uint32_t fb;            ///< FIS base address.
+    uint32_t fbu;           ///< FIS base address, upper 32 bits.
+    uint32_t is;            ///< Interrupt status.
+    uint32_t ie;            ///< Interrupt enable.
+    uint32_t cmd;           ///< Command and status.
+    uint32_t reserved0;     ///< Reserved.
+    uint32_t tfd;           ///< Task file data.
+    uint32_t sig;           ///< Signature of the device.
+    uint32_t ssts;          ///< SATA status.
+    uint32_t sctl;          ///< SATA control.
+    uint32_t serr;          ///< SATA error.
+    uint32_t sact;          ///< SATA active, the queued commands not yet completed.
+    uint32_t ci;            ///< Command issue.
+    uint32_t sntf;          ///< SATA notification.
+    uint32_t fbs;           ///< FIS-based switching control.
+    uint32_t reserved1[11]; ///< Reserved.
+    uint32_t vendor[4];     ///< Vendor specific.
+} ahci_port_regs_t;
+
+/// @brief The registers of the controller.
+typedef struct ahci_hba_regs_t {
+    uint32_t cap;                           ///< Host capabilities.
+    uint32_t ghc;                           ///< Global host control.
+    uint32_t is;                            ///< Interrupt status, one bit per port.
+    uint32_t pi;                            ///< Ports implemented.
+    uint32_t vs;                            ///< Version.
+    uint32_t ccc_ctl;                       ///< Command completion coalescing control.
+    uint32_t ccc_ports;                     ///< Command completion coalescing ports.
+    uint32_t em_loc;                        ///< Enclosure management location.
+    uint32_t em_ctl;                        ///< Enclosure management control.
+    uint32_t cap2;                          ///< Host capabilities extended.
+    uint32_t bohc;                          ///< BIOS/OS handoff control and status.
+    uint8_t reserved[0xA0 - 0x2C];          ///< Reserved.
+    uint8_t vendor[0x100 - 0xA0];           ///< Vendor specific.
+    ahci_port_regs_t ports[AHCI_MAX_PORTS]; ///< The ports.
+} ahci_hba_regs_t;
+
+/// @brief An entry of the command list.
+typedef struct ahci_cmd_header_t {
+    /// Length of the command FIS in dwords, and the flags (e.g., AHCI_CMD_WRITE).
+    uint16_t flags;
+    /// Number of entries of the PRDT.
+    uint16_t prdtl;
+    /// Number of bytes transferred, updated by the controller.
+    volatile uint32_t prdbc;
+    /// Physical address of the command table.
+    uint32_t ctba;
+    /// Physical address of the command table, upper 32 bits.
+    uint32_t ctbau;
+    /// Reserved.
+    uint32_t reserved[4];
+} ahci_cmd_header_t;
+
+/// @brief An entry of the Physical Region Descriptor Table.
+typedef struct ahci_prd_t {
+    uint32_t dba;      ///< Physical address of the data.
+    uint32_t dbau;     ///< Physical address of the data, upper 32 bits.
+    uint32_t reserved; ///< Reserved.
+    uint32_t dbc;      ///< Number of bytes, minus one.
+} ahci_prd_t;
+
+/// @brief The command table of a slot.
+typedef struct ahci_cmd_table_t {
+    uint8_t cfis[64];                     ///< The command FIS.
+    uint8_t acmd[16];                     ///< The ATAPI command.
+    uint8_t reserved[48];                 ///< Reserved.
+    ahci_prd_t prdt[AHCI_PRDT_ENTRIES];   ///< Where the data goes.
+} __attribute__((aligned(128))) ahci_cmd_table_t;
+
+/// @brief The memory a port shares with the controller, it starts on a page.
+typedef struct ahci_port_memory_t {
+    ahci_cmd_header_t cmd_list[AHCI_MAX_SLOTS]; ///< The command list, 1 KiB aligned.
+    uint8_t fis[256];                           ///< The received FIS, 256 bytes aligned.
+    uint8_t scratch[AHCI_SECTOR_SIZE];          ///< Sector for partial transfers and IDENTIFY.
+    uint8_t reserved[256];                      ///< Keeps the tables aligned.
+    ahci_cmd_table_t tables[AHCI_MAX_SLOTS];    ///< The command tables, 128 bytes aligned.
+} ahci_port_memory_t;
+
+/// @brief A disk attached to a port.
+typedef struct ahci_port_t {
+    /// The index of the port.
+    unsigned index;
+    /// The registers of the port.
+    volatile ahci_port_regs_t *regs;
+    /// The memory shared with the controller.
+    ahci_port_memory_t *mem;
+    /// The pages of the shared memory.
+    page_t *mem_page;
+    /// The physical address of the shared memory.
+    uint32_t mem_phys;
+    /// The request running in each slot.
+    ata_request_t *requests[AHCI_MAX_SLOTS];
+    /// The slots with a running command.
+    uint32_t issued;
+    /// The slots we are allowed to use.
+    uint32_t slot_mask;
+    /// The number of requests submitted and not yet completed.
+    volatile unsigned queued;
+    /// The disk supports native command queuing.
+    bool_t ncq;
+    /// The disk supports 48-bit addresses.
+    bool_t lba48;
+    /// A command which cannot be queued is running, on slot 0.
+    bool_t exclusive;
+    /// The number of sectors of the disk.
+    uint32_t sectors;
+    /// The requests waiting for a free slot.
+    list_head pending;
+    /// The completed requests, whose end_request has not been called yet.
+    list_head completed;
+    /// Calls the end_request of the completed requests.
+    tasklet_t tasklet;
+    /// Tasks waiting for the completion of their requests.
+    wait_queue_head_t wait_queue;
+    /// The requests of the synchronous transfers.
+    ata_request_t sync_requests[AHCI_MAX_SLOTS];
+    /// The buffer of the transfers from and to user memory, allocated on use.
+    uint8_t *bounce;
+    /// The name of the disk.
+    char name[NAME_MAX];
+    /// The path of the disk.
+    char path[PATH_MAX];
+    /// The filesystem entry of the disk.
+    vfs_file_t *fs_root;
+} ahci_port_t;
+
+/// @brief Keeps track of a synchronous transfer.
+typedef struct ahci_sync_t {
+    /// The number of requests not yet completed.
+    volatile unsigned pending;
+    /// The status of the first failed request, 0 if none failed.
+    int status;
+} ahci_sync_t;
+
+/// @brief Keeps track of the incremental letters for the disks.
+static char ahci_drive_char = 'a';
+/// @brief The PCI address of the controller.
+static uint32_t ahci_pci = 0;
+/// @brief The registers of the controller.
+static volatile ahci_hba_regs_t *ahci_hba = NULL;
+/// @brief The disks, indexed by port.
+static ahci_port_t *ahci_ports[AHCI_MAX_PORTS];
+/// @brief Set once the interrupts of the controller are enabled.
+static bool_t ahci_irq_ready = false;
+
+/// @brief Returns the identifier of the port inside the traces.
+/// @param port the port.
+/// @return the offset of the registers of the port.
+static inline uint32_t __ahci_trace_id(ahci_port_t *port)
+{
+    return 0x100 + (port->index * sizeof(ahci_port_regs_t));
+}
+
+/// @brief Returns the size of the disk in bytes.
+/// @param port the port of the disk.
+/// @return the size.
+static inline uint32_t __ahci_max_offset(ahci_port_t *port)
+{
+    return port->sectors * AHCI_SECTOR_SIZE;
+}
+
+/// @brief Checks if the controller can move data directly from and to the
+/// given buffer.
+/// @param buffer the buffer.
+/// @return true if it is in kernel memory and aligned to two bytes.
+static inline bool_t __ahci_dma_capable(const void *buffer)
+{
+    return ((uintptr_t)buffer >= PROCAREA_END_ADDR) && !((uintptr_t)buffer & 1);
+}
+
+// == COMMANDS ================================================================
+
+/// @brief Describes a kernel buffer with the PRDT of a command table.
+/// @param table the command table.
+/// @param pages the page frames of the buffer, NULL to translate its addresses.
+/// @param buffer the buffer, see __ahci_dma_capable, or the offset inside the
+/// first page frame.
+/// @param size the number of bytes.
+/// @return the number of PRDs, -EINVAL if the buffer needs too many of them.
+/// @details The pages of the buffer are not necessarily contiguous, each one
+/// is translated on its own and merged with the previous one when possible.
+static int __ahci_setup_prdt(ahci_cmd_table_t *table, page_t **pages, const void *buffer, size_t size)
+{
+    page_directory_t *pgd = paging_get_main_directory();
+    uintptr_t address     = (uintptr_t)buffer;
+    int entries           = 0;
+    while (size > 0) {
+        uint32_t offset = address & (PAGE_SIZE - 1);
+        size_t chunk    = min(PAGE_SIZE - offset, size);
+        page_t *page    = pages ? pages[address / PAGE_SIZE] : mem_virtual_to_page(pgd, address - offset, NULL);
+        uint32_t phys   = get_physical_address_from_page(page) + offset;
+        ahci_prd_t *prd = entries ? &table->prdt[entries - 1] : NULL;
+        if (prd && ((prd->dba + prd->dbc + 1) == phys) && ((prd->dbc + 1 + chunk) <= AHCI_PRD_MAX_SIZE)) {
+            prd->dbc += chunk;
+        } else {
+            if (entries == AHCI_PRDT_ENTRIES) {
+                return -EINVAL;
+            }
+            prd           = &table->prdt[entries++];
+            prd->dba      = phys;
+            prd->dbau     = 0;
+            prd->reserved = 0;
+            prd->dbc      = chunk - 1;
+        }
+        address += chunk;
+        size -= chunk;
+    }
+    return entries;
+}
+
+/// @brief Fills a register FIS, from the host to the device.
+/// @param cfis the command FIS of the command table.
+/// @param command the ATA command.
+/// @param lba the first sector.
+/// @param count the content of the count register.
+/// @param features the content of the features register.
+/// @param device the content of the device register.
+static inline void __ahci_setup_fis(uint8_t *cfis, uint8_t command, uint32_t lba, uint16_t count, uint16_t features, uint8_t device)
+{
+    memset(cfis, 0, AHCI_FIS_REG_H2D_SIZE);
+    cfis[0]  = AHCI_FIS_TYPE_REG_H2D;
+    cfis[1]  = 0x80; // It carries a command.
+    cfis[2]  = command;
+    cfis[3]  = features & 0xFF;
+    cfis[4]  = (lba >> 0) & 0xFF;
+    cfis[5]  = (lba >> 8) & 0xFF;
+    cfis[6]  = (lba >> 16) & 0xFF;
+    cfis[7]  = device;
+    cfis[8]  = (lba >> 24) & 0xFF;
+    cfis[11] = (features >> 8) & 0xFF;
+    cfis[12] = count & 0xFF;
+    cfis[13] = (count >> 8) & 0xFF;
+}
+
+/// @brief Fills the entry of the command list for the given slot.
+/// @param port the port.
+/// @param slot the slot.
+/// @param entries the number of PRDs.
+/// @param write if the command moves data to the device.
+static inline void __ahci_setup_header(ahci_port_t *port, unsigned slot, int entries, bool_t write)
+{
+    ahci_cmd_header_t *header = &port->mem->cmd_list[slot];
+    header->flags             = (AHCI_FIS_REG_H2D_SIZE / sizeof(uint32_t)) | (write ? AHCI_CMD_WRITE : 0);
+    header->prdtl             = entries;
+    header->prdbc             = 0;
+    header->ctba              = port->mem_phys + ((uintptr_t)&port->mem->tables[slot] - (uintptr_t)port->mem);
+    header->ctbau             = 0;
+}
+
+/// @brief Starts a request on the given slot.
+/// @param port the port.
+/// @param slot the free slot.
+/// @param request the request.
+/// @details A queued command carries its slot in the count register, and the
+/// number of sectors in the features register.
+static void __ahci_port_start_request(ahci_port_t *port, unsigned slot, ata_request_t *request)
+{
+    ahci_cmd_table_t *table = &port->mem->tables[slot];
+    bool_t write            = (request->direction == ata_request_write);
+    int entries             = __ahci_setup_prdt(table, request->pages, request->pages ? (void *)request->offset : request->buffer,
+                                                request->count * AHCI_SECTOR_SIZE);
+    if (port->ncq) {
+        __ahci_setup_fis(table->cfis, write ? ATA_CMD_WRITE_FPDMA_QUEUED : ATA_CMD_READ_FPDMA_QUEUED,
+                         request->lba_sector, slot << 3, request->count, 0x40);
+    } else if (port->lba48) {
+        __ahci_setup_fis(table->cfis, write ? ATA_CMD_WRITE_DMA_EXT : ATA_CMD_READ_DMA_EXT,
+                         request->lba_sector, request->count, 0, 0x40);
+    } else {
+        __ahci_setup_fis(table->cfis, write ? ATA_CMD_WRITE_DMA : ATA_CMD_READ_DMA,
+                         request->lba_sector & 0x0FFFFFFF, request->count & 0xFF, 0,
+                         0xE0 | ((request->lba_sector >> 24) & 0x0F));
+    }
+    __ahci_setup_header(port, slot, entries, write);
+    port->requests[slot] = request;
+    port->issued |= (1U << slot);
+    trace_event(TRACE_BLOCK_ISSUE, __ahci_trace_id(port), request->lba_sector, request->count, write);
+    if (port->ncq) {
+        port->regs->sact = (1U << slot);
+    }
+    port->regs->ci = (1U << slot);
+}
+
+/// @brief Starts the pending requests, as long as there are free slots.
+/// @param port the port.
+/// @details Must be called with the interrupts disabled.
+static void __ahci_port_issue(ahci_port_t *port)
+{
+    while (!port->exclusive && !list_head_empty(&port->pending)) {
+        uint32_t free = port->slot_mask & ~port->issued;
+        if (!free) {
+            break;
+        }
+        ata_request_t *request = list_entry(port->pending.next, ata_request_t, fifo_list);
+        list_head_remove(&request->fifo_list);
+        __ahci_port_start_request(port, __builtin_ctz(free), request);
+    }
+}
+
+/// @brief Moves the request of the given slot among the completed ones.
+/// @param port the port.
+/// @param slot the slot.
+/// @param status 0 on success, -errno on failure.
+static void __ahci_port_finish(ahci_port_t *port, unsigned slot, int status)
+{
+    ata_request_t *request = port->requests[slot];
+    port->requests[slot]   = NULL;
+    port->issued &= ~(1U << slot);
+    request->status = status;
+    trace_event(TRACE_BLOCK_COMPLETE, __ahci_trace_id(port), request->lba_sector, request->count, status);
+    list_head_insert_before(&request->fifo_list, &port->completed);
+    --port->queued;
+}
+
+/// @brief Stops the command engine of the port.
+/// @param regs the registers of the port.
+/// @return 0 on success, -EBUSY if the engine does not stop.
+static int __ahci_port_stop(volatile ahci_port_regs_t *regs)
+{
+    regs->cmd &= ~AHCI_PXCMD_ST;
+    for (unsigned spin = 0; regs->cmd & AHCI_PXCMD_CR; ++spin) {
+        if (spin == AHCI_SPIN_LIMIT) {
+            return -EBUSY;
+        }
+    }
+    regs->cmd &= ~AHCI_PXCMD_FRE;
+    for (unsigned spin = 0; regs->cmd & AHCI_PXCMD_FR; ++spin) {
+        if (spin == AHCI_SPIN_LIMIT) {
+            return -EBUSY;
+        }
+    }
+    return 0;
+}
+
+/// @brief Starts the command engine of the port.
+/// @param regs the registers of the port.
+static void __ahci_port_start(volatile ahci_port_regs_t *regs)
+{
+    for (unsigned spin = 0; (regs->cmd & AHCI_PXCMD_CR) && (spin < AHCI_SPIN_LIMIT); ++spin) {
+    }
+    regs->cmd |= AHCI_PXCMD_FRE;
+    regs->cmd |= AHCI_PXCMD_ST;
+}
+
+/// @brief Recovers the port from an error, failing the running requests.
+/// @param port the port.
+/// @details After an error the disk aborts all its queued commands, so we do
+/// not read its log to find the one which failed. Restarting the command
+/// engine clears the slots.
+static void __ahci_port_recover(ahci_port_t *port)
+{
+    pr_err("[%s] Error on port %u (TFD: 0x%08x, SERR: 0x%08x).\n", port->name, port->index, port->regs->tfd, port->regs->serr);
+    if (__ahci_port_stop(port->regs) < 0) {
+        pr_err("[%s] The command engine did not stop.\n", port->name);
+    }
+    port->regs->serr = 0xFFFFFFFF;
+    port->regs->is   = 0xFFFFFFFF;
+    for (uint32_t issued = port->issued; issued; issued &= issued - 1) {
+        __ahci_port_finish(port, __builtin_ctz(issued), -EIO);
+    }
+    __ahci_port_start(port->regs);
+}
+
+/// @brief Fails the requests which are still waiting for a slot.
+/// @param port the port.
+static void __ahci_port_fail_pending(ahci_port_t *port)
+{
+    while (!list_head_empty(&port->pending)) {
+        ata_request_t *request = list_entry(port->pending.next, ata_request_t, fifo_list);
+        list_head_remove(&request->fifo_list);
+        request->status = -EIO;
+        list_head_insert_before(&request->fifo_list, &port->completed);
+        --port->queued;
+    }
+}
+
+/// @brief Completes the commands the port has finished.
+/// @param port the port.
+/// @details Must be called with the interrupts disabled.
+static void __ahci_port_complete(ahci_port_t *port)
+{
+    uint32_t status = port->regs->is;
+    port->regs->is  = status;
+    if (status & AHCI_PXIS_ERRORS) {
+        __ahci_port_recover(port);
+    } else {
+        uint32_t running = port->ncq ? port->regs->sact : port->regs->ci;
+        for (uint32_t done = port->issued & ~running; done; done &= done - 1) {
+            __ahci_port_finish(port, __builtin_ctz(done), 0);
+        }
+    }
+    __ahci_port_issue(port);
+}
+
+/// @brief Calls the end_request of the completed requests.
+/// @param port the port.
+static void __ahci_port_end_requests(ahci_port_t *port)
+{
+    while (1) {
+        uint8_t flags = irq_disable();
+        if (list_head_empty(&port->completed)) {
+            irq_enable(flags);
+            break;
+        }
+        ata_request_t *request = list_entry(port->completed.next, ata_request_t, fifo_list);
+        list_head_remove(&request->fifo_list);
+        irq_enable(flags);
+        if (request->end_request) {
+            request->end_request(request);
+        }
+    }
+}
+
+/// @brief Queues a request, and starts it if there is a free slot.
+/// @param port the port.
+/// @param request the request.
+static void __ahci_port_submit(ahci_port_t *port, ata_request_t *request)
+{
+    uint8_t flags   = irq_disable();
+    request->status = 0;
+    list_head_insert_before(&request->fifo_list, &port->pending);
+    ++port->queued;
+    __ahci_port_issue(port);
+    irq_enable(flags);
+}
+
+/// @brief Checks if we can wait for the completion IRQ instead of polling.
+/// @return true if we can sleep waiting for the IRQ, false otherwise.
+/// @details Until the first system call we are still booting, there is no
+/// process whose context the nested interrupts could rely upon.
+static inline bool_t __ahci_can_sleep(void)
+{
+    return ahci_irq_ready && (get_current_interrupt_stack_frame() != NULL);
+}
+
+/// @brief Waits until the given counter drops to zero.
+/// @param port the port whose commands decrement the counter.
+/// @param pending the counter.
+/// @return 0 on success, -EIO if the disk did not answer in time.
+/// @details
+/// As in the ATA driver, the calling task does not leave the CPU, which is
+/// halted until the next interrupt. The end_request of the requests runs in
+/// the bottom half of the interrupt, before the task checks the counter again.
+static int __ahci_wait(ahci_port_t *port, volatile unsigned *pending)
+{
+    if (!__ahci_can_sleep()) {
+        while (*pending) {
+            uint8_t flags = irq_disable();
+            __ahci_port_complete(port);
+            irq_enable(flags);
+            __ahci_port_end_requests(port);
+        }
+        return 0;
+    }
+    task_struct *task   = scheduler_get_current_process();
+    unsigned long start = timer_get_ticks();
+    wait_queue_entry_t wait;
+    init_waitqueue_entry(&wait, task);
+    add_wait_queue(&port->wait_queue, &wait);
+    scheduler_set_task_state(task, TASK_UNINTERRUPTIBLE);
+    while (*pending) {
+        if ((timer_get_ticks() - start) > (AHCI_IRQ_TIMEOUT_SECONDS * TICKS_PER_SECOND)) {
+            break;
+        }
+        __asm__ __volatile__("sti; hlt; cli" ::: "memory");
+    }
+    remove_wait_queue(&port->wait_queue, &wait);
+    scheduler_set_task_state(task, TASK_RUNNING);
+    if (*pending) {
+        pr_err("[%s] Timed out waiting for the completion IRQ.\n", port->name);
+        // Fail whatever is still running, and hand it back to its owners.
+        __ahci_port_recover(port);
+        __ahci_port_fail_pending(port);
+        __ahci_port_end_requests(port);
+        return -EIO;
+    }
+    return 0;
+}
+
+/// @brief Runs a command which cannot be queued, polling for its completion.
+/// @param port the port, without running commands.
+/// @param command the ATA command.
+/// @param buffer where the data of the command is stored, or NULL.
+/// @param size the size of the data.
+/// @return 0 on success, -EIO on failure.
+static int __ahci_port_exec(ahci_port_t *port, uint8_t command, void *buffer, size_t size)
+{
+    ahci_cmd_table_t *table = &port->mem->tables[0];
+    int entries             = buffer ? __ahci_setup_prdt(table, NULL, buffer, size) : 0;
+    if (entries < 0) {
+        return entries;
+    }
+    uint8_t flags   = irq_disable();
+    port->exclusive = true;
+    __ahci_setup_fis(table->cfis, command, 0, 0, 0, 0);
+    __ahci_setup_header(port, 0, entries, false);
+    port->regs->ci = 1U;
+    int ret        = -EIO;
+    for (unsigned spin = 0; spin < AHCI_EXEC_SPIN_LIMIT; ++spin) {
+        if (port->regs->is & AHCI_PXIS_TFES) {
+            break;
+        }
+        if (!(port->regs->ci & 1U)) {
+            ret = 0;
+            break;
+        }
+    }
+    if (ret < 0) {
+        pr_err("[%s] Command 0x%02x failed (TFD: 0x%08x).\n", port->name, command, port->regs->tfd);
+        __ahci_port_stop(port->regs);
+        port->regs->serr = 0xFFFFFFFF;
+        __ahci_port_start(port->regs);
+    }
+    port->regs->is  = 0xFFFFFFFF;
+    port->exclusive = false;
+    __ahci_port_issue(port);
+    irq_enable(flags);
+    return ret;
+}
+
+// == SYNCHRONOUS TRANSFERS ===================================================
+
+/// @brief Completes a request of a synchronous transfer.
+/// @param request the request.
+static void __ahci_sync_end(ata_request_t *request)
+{
+    ahci_sync_t *sync = (ahci_sync_t *)request->private_data;
+    if (request->status && !sync->status) {
+        sync->status = request->status;
+    }
+    --sync->pending;
+}
+
+/// @brief Moves consecutive sectors between the disk and a kernel buffer.
+/// @param port the port of the disk.
+/// @param direction the direction of the transfer.
+/// @param lba_sector the first sector.
+/// @param count the number of sectors.
+/// @param buffer the buffer, see __ahci_dma_capable.
+/// @return 0 on success, -errno on failure.
+/// @details The transfer is split in commands of at most AHCI_MAX_SECTORS
+/// sectors, which are all in flight at the same time.
+static int __ahci_transfer(ahci_port_t *port, ata_request_dir_t direction, uint32_t lba_sector, uint32_t count, uint8_t *buffer)
+{
+    ahci_sync_t sync;
+    while (count > 0) {
+        sync.pending = 0;
+        sync.status  = 0;
+        for (unsigned it = 0; (it < AHCI_MAX_SLOTS) && (count > 0); ++it) {
+            uint32_t chunk         = min(count, AHCI_MAX_SECTORS);
+            ata_request_t *request = &port->sync_requests[it];
+            request->direction     = direction;
+            request->lba_sector    = lba_sector;
+            request->count         = chunk;
+            request->buffer        = buffer;
+            request->end_request   = __ahci_sync_end;
+            request->private_data  = &sync;
+            ++sync.pending;
+            __ahci_port_submit(port, request);
+            lba_sector += chunk;
+            count -= chunk;
+            buffer += chunk * AHCI_SECTOR_SIZE;
+        }
+        int ret = __ahci_wait(port, &sync.pending);
+        if (ret < 0) {
+            return ret;
+        }
+        if (sync.status) {
+            return sync.status;
+        }
+    }
+    return 0;
+}
+
+/// @brief Returns the buffer for the transfers from and to user memory.
+/// @param port the port.
+/// @return the buffer, NULL if it cannot be allocated.
+static uint8_t *__ahci_bounce(ahci_port_t *port)
+{
+    if (port->bounce == NULL) {
+        port->bounce = (uint8_t *)kmalloc(AHCI_BOUNCE_SECTORS * AHCI_SECTOR_SIZE);
+    }
+    return port->bounce;
+}
+
+// == VFS CALLBACKS ===========================================================
+
+/// @brief Implements the open function for an AHCI disk.
+/// @param path the path to the disk we want to open.
+/// @param flags we ignore these.
+/// @param mode we currently ignore this.
+/// @return the VFS file associated with the disk.
+static vfs_file_t *ahci_open(const char *path, int flags, mode_t mode)
+{
+    pr_debug("ahci_open(%s, %d, %d)\n", path, flags, mode);
+    for (unsigned index = 0; index < AHCI_MAX_PORTS; ++index) {
+        ahci_port_t *port = ahci_ports[index];
+        if (port && port->fs_root && !strcmp(path, port->path)) {
+            ++port->fs_root->count;
+            return port->fs_root;
+        }
+    }
+    return NULL;
+}
+
+/// @brief Closes an AHCI disk.
+/// @param file the VFS file associated with the disk.
+/// @return 0 on success, it panics on failure.
+static int ahci_close(vfs_file_t *file)
+{
+    pr_debug("ahci_close(%p)\n", file);
+    if (file->device == NULL) {
+        kernel_panic("Device not set.");
+    }
+    --file->count;
+    return 0;
+}
+
+/// @brief Reads from an AHCI disk.
+/// @param file the VFS file associated with the disk.
+/// @param buffer the buffer where we store what we read.
+/// @param offset the offset where we want to read.
+/// @param size the size of the buffer.
+/// @return the number of read characters, or -errno.
+/// @details Kernel buffers are read directly, user buffers go through the
+/// bounce buffer of the port.
+static ssize_t ahci_read(vfs_file_t *file, char *buffer, off_t offset, size_t size)
+{
+    ahci_port_t *port = (ahci_port_t *)file->device;
+    if (port == NULL) {
+        kernel_panic("Device not set.");
+    }
+    uint32_t lba_sector   = offset / AHCI_SECTOR_SIZE;
+    uint32_t start_offset = offset % AHCI_SECTOR_SIZE;
+    uint32_t max_offset   = __ahci_max_offset(port);
+    uint32_t x_offset     = 0;
+    uint32_t chunk, count;
+    uint8_t *data;
+
+    if (offset > max_offset) {
+        return 0;
+    }
+    if ((offset + size) > max_offset) {
+        size = max_offset - offset;
+    }
+
+    // Read the unaligned head of the request.
+    if (start_offset && size) {
+        if (__ahci_transfer(port, ata_request_read, lba_sector, 1, port->mem->scratch)) {
+            return -EIO;
+        }
+        chunk = min(AHCI_SECTOR_SIZE - start_offset, size);
+        memcpy(buffer, port->mem->scratch + start_offset, chunk);
+        x_offset += chunk;
+        ++lba_sector;
+    }
+
+    // Read the aligned body of the request.
+    while ((size - x_offset) >= AHCI_SECTOR_SIZE) {
+        count = (size - x_offset) / AHCI_SECTOR_SIZE;
+        data  = (uint8_t *)buffer + x_offset;
+        if (!__ahci_dma_capable(data)) {
+            if ((data = __ahci_bounce(port)) == NULL) {
+                return -ENOMEM;
+            }
+            count = min(count, AHCI_BOUNCE_SECTORS);
+        }
+        if (__ahci_transfer(port, ata_request_read, lba_sector, count, data)) {
+            return -EIO;
+        }
+        if (data == port->bounce) {
+            memcpy(buffer + x_offset, data, count * AHCI_SECTOR_SIZE);
+        }
+        x_offset += count * AHCI_SECTOR_SIZE;
+        lba_sector += count;
+    }
+
+    // Read the unaligned tail of the request.
+    if (x_offset < size) {
+        if (__ahci_transfer(port, ata_request_read, lba_sector, 1, port->mem->scratch)) {
+            return -EIO;
+        }
+        memcpy(buffer + x_offset, port->mem->scratch, size - x_offset);
+    }
+    return size;
+}
+
+/// @brief Writes on an AHCI disk.
+/// @param file the VFS file associated with the disk.
+/// @param buffer the buffer we use to write.
+/// @param offset the offset where we want to write.
+/// @param size the size of the buffer.
+/// @return the number of written characters, or -errno.
+/// @details Partial sectors at the edges of the request are handled with a
+/// read-modify-write.
+static ssize_t ahci_write(vfs_file_t *file, const void *buffer, off_t offset, size_t size)
+{
+    ahci_port_t *port = (ahci_port_t *)file->device;
+    if (port == NULL) {
+        kernel_panic("Device not set.");
+    }
+    uint32_t lba_sector   = offset / AHCI_SECTOR_SIZE;
+    uint32_t start_offset = offset % AHCI_SECTOR_SIZE;
+    uint32_t max_offset   = __ahci_max_offset(port);
+    uint32_t x_offset     = 0;
+    uint32_t chunk, count;
+    uint8_t *data;
+
+    if (offset > max_offset) {
+        return -ENOSPC;
+    }
+    if ((offset + size) > max_offset) {
+        size = max_offset - offset;
+    }
+
+    // Write the unaligned head of the request.
+    if (start_offset && size) {
+        if (__ahci_transfer(port, ata_request_read, lba_sector, 1, port->mem->scratch)) {
+            return -EIO;
+        }
+        chunk = min(AHCI_SECTOR_SIZE - start_offset, size);
+        memcpy(port->mem->scratch + start_offset, buffer, chunk);
+        if (__ahci_transfer(port, ata_request_write, lba_sector, 1, port->mem->scratch)) {
+            return -EIO;
+        }
+        x_offset += chunk;
+        ++lba_sector;
+    }
+
+    // Write the aligned body of the request.
+    while ((size - x_offset) >= AHCI_SECTOR_SIZE) {
+        count = (size - x_offset) / AHCI_SECTOR_SIZE;
+        data  = (uint8_t *)buffer + x_offset;
+        if (!__ahci_dma_capable(data)) {
+            if ((data = __ahci_bounce(port)) == NULL) {
+                return -ENOMEM;
+            }
+            count = min(count, AHCI_BOUNCE_SECTORS);
+            memcpy(data, (const uint8_t *)buffer + x_offset, count * AHCI_SECTOR_SIZE);
+        }
+        if (__ahci_transfer(port, ata_request_write, lba_sector, count, data)) {
+            return -EIO;
+        }
+        x_offset += count * AHCI_SECTOR_SIZE;
+        lba_sector += count;
+    }
+
+    // Write the unaligned tail of the request.
+    if (x_offset < size) {
+        if (__ahci_transfer(port, ata_request_read, lba_sector, 1, port->mem->scratch)) {
+            return -EIO;
+        }
+        memcpy(port->mem->scratch, (const uint8_t *)buffer + x_offset, size - x_offset);
+        if (__ahci_transfer(port, ata_request_write, lba_sector, 1, port->mem->scratch)) {
+            return -EIO;
+        }
+    }
+    return size;
+}
+
+/// @brief Stats an AHCI disk.
+/// @param port the port of the disk.
+/// @param stat the stat buffer.
+/// @return 0 on success.
+static int __ahci_stat(const ahci_port_t *port, stat_t *stat)
+{
+    if (port && port->fs_root) {
+        stat->st_dev   = 0;
+        stat->st_ino   = 0;
+        stat->st_mode  = 0;
+        stat->st_uid   = 0;
+        stat->st_gid   = 0;
+        stat->st_atime = sys_time(NULL);
+        stat->st_mtime = sys_time(NULL);
+        stat->st_ctime = sys_time(NULL);
+        stat->st_size  = port->fs_root->length;
+    }
+    return 0;
+}
+
+/// @brief Retrieves information concerning the file at the given position.
+/// @param file the file.
+/// @param stat the structure where the information are stored.
+/// @return 0 if success.
+static int ahci_fstat(vfs_file_t *file, stat_t *stat)
+{
+    return __ahci_stat(file->device, stat);
+}
+
+/// @brief Retrieves information concerning the file at the given position.
+/// @param path the path where the file resides.
+/// @param stat the structure where the information are stored.
+/// @return 0 if success.
+static int ahci_stat(const char *path, stat_t *stat)
+{
+    super_block_t *sb = vfs_get_superblock(path);
+    if (sb && sb->root) {
+        return __ahci_stat(sb->root->device, stat);
+    }
+    return -1;
+}
+
+/// @brief Writes back the cached blocks, and the cache of the disk.
+/// @param file the VFS file associated with the disk.
+/// @return 0 on success, -errno on failure.
+static int ahci_fsync(vfs_file_t *file)
+{
+    ahci_port_t *port = (ahci_port_t *)file->device;
+    int ret           = buffer_sync(file);
+    if (ret < 0) {
+        return ret;
+    }
+    // The flush cannot be queued, wait for the running commands.
+    if ((ret = __ahci_wait(port, &port->queued)) < 0) {
+        return ret;
+    }
+    return __ahci_port_exec(port, port->lba48 ? ATA_CMD_FLUSH_CACHE_EXT : ATA_CMD_FLUSH_CACHE, NULL, 0);
+}
+
+// == VFS ENTRY GENERATION ====================================================
+/// Filesystem general operations.
+static vfs_sys_operations_t ahci_sys_operations = {
+    .mkdir_f   = NULL,
+    .rmdir_f   = NULL,
+    .stat_f    = ahci_stat,
+    .creat_f   = NULL,
+    .symlink_f = NULL,
+};
+
+/// AHCI filesystem file operations.
+static vfs_file_operations_t ahci_fs_operations = {
+    .open_f     = ahci_open,
+    .unlink_f   = NULL,
+    .close_f    = ahci_close,
+    .read_f     = ahci_read,
+    .write_f    = ahci_write,
+    .lseek_f    = NULL,
+    .stat_f     = ahci_fstat,
+    .ioctl_f    = NULL,
+    .getdents_f = NULL,
+    .readlink_f = NULL,
+    .fsync_f    = ahci_fsync,
+    .submit_f   = ahci_submit_request,
+};
+
+/// @brief Creates a VFS file, starting from an AHCI disk.
+/// @param port the port of the disk.
+/// @return a pointer to the VFS file on success, NULL on failure.
+static vfs_file_t *ahci_device_create(ahci_port_t *port)
+{
+    vfs_file_t *file = kmem_cache_alloc(vfs_file_cache, GFP_KERNEL);
+    if (file == NULL) {
+        pr_err("Failed to create AHCI device.\n");
+        return NULL;
+    }
+    memcpy(file->name, port->name, NAME_MAX);
+    file->device         = port;
+    file->flags          = DT_BLK;
+    file->sys_operations = &ahci_sys_operations;
+    file->fs_operations  = &ahci_fs_operations;
+    return file;
+}
+
+int ahci_submit_request(vfs_file_t *file, ata_request_t *request)
+{
+    ahci_port_t *port = (ahci_port_t *)file->device;
+    if (!port || !request->count || (request->count > AHCI_MAX_SECTORS) ||
+        (request->lba_sector >= port->sectors) || (request->count > (port->sectors - request->lba_sector)) ||
+        (!request->pages && !__ahci_dma_capable(request->buffer))) {
+        return -EINVAL;
+    }
+    __ahci_port_submit(port, request);
+    return 0;
+}
+
+// == IRQ HANDLERS ============================================================
+
+/// @brief Calls the end_request of the completed requests, and wakes up the
+/// tasks waiting for them.
+/// @param data the port.
+static void ahci_irq_bottom_half(unsigned long data)
+{
+    ahci_port_t *port = (ahci_port_t *)data;
+    __ahci_port_end_requests(port);
+    wake_up(&port->wait_queue);
+}
+
+/// @brief Handles the interrupt of the controller.
+/// @param f The interrupt stack frame.
+static void ahci_irq_handler(pt_regs *f)
+{
+    uint32_t status = ahci_hba->is;
+    for (uint32_t bits = status; bits; bits &= bits - 1) {
+        ahci_port_t *port = ahci_ports[__builtin_ctz(bits)];
+        if (port) {
+            __ahci_port_complete(port);
+            tasklet_schedule(&port->tasklet);
+        } else {
+            ahci_hba->ports[__builtin_ctz(bits)].is = 0xFFFFFFFF;
+        }
+    }
+    // The bits of the ports are cleared only after those of the ports.
+    ahci_hba->is = status;
+}
+
+// == INITIALIZE/FINALIZE AHCI ================================================
+
+/// @brief Reads the identification data of the disk.
+/// @param port the port of the disk.
+/// @param slots the number of command slots of the controller.
+/// @return 0 on success, -errno on failure.
+static int __ahci_port_identify(ahci_port_t *port, unsigned slots)
+{
+    int ret = __ahci_port_exec(port, ATA_CMD_IDENTIFY, port->mem->scratch, AHCI_SECTOR_SIZE);
+    if (ret < 0) {
+        return ret;
+    }
+    uint16_t *identify = (uint16_t *)port->mem->scratch;
+    port->lba48        = (identify[83] >> 10) & 1;
+    if (port->lba48) {
+        port->sectors = (identify[102] || identify[103]) ? 0xFFFFFFFFU : (identify[100] | ((uint32_t)identify[101] << 16));
+    } else {
+        port->sectors = identify[60] | ((uint32_t)identify[61] << 16);
+    }
+    port->sectors = min(port->sectors, AHCI_MAX_DISK_SECTORS);
+    // Queued commands need both the controller and the disk.
+    unsigned depth = 1;
+    port->ncq      = (ahci_hba->cap & AHCI_CAP_SNCQ) && (identify[76] & (1U << 8));
+    if (port->ncq) {
+        depth = min((identify[75] & 0x1F) + 1U, slots);
+    }
+    port->slot_mask = (depth == 32) ? 0xFFFFFFFFU : ((1U << depth) - 1);
+    pr_notice("[%s] %u sectors, %s, %u slots.\n", port->name, port->sectors, port->ncq ? "NCQ" : "no NCQ", depth);
+    return 0;
+}
+
+/// @brief Initializes the given port, and the disk attached to it.
+/// @param index the index of the port.
+/// @param slots the number of command slots of the controller.
+/// @return 0 on success, -ENODEV if there is no disk, -errno on failure.
+static int __ahci_port_init(unsigned index, unsigned slots)
+{
+    volatile ahci_port_regs_t *regs = &ahci_hba->ports[index];
+    uint32_t ssts                   = regs->ssts;
+    if ((AHCI_SSTS_DET(ssts) != AHCI_SSTS_DET_PRESENT) || (AHCI_SSTS_IPM(ssts) != AHCI_SSTS_IPM_ACTIVE)) {
+        return -ENODEV;
+    }
+    if (regs->sig != AHCI_SIG_ATA) {
+        pr_debug("Port %u: ATAPI drives and port multipliers are not currently supported.\n", index);
+        return -ENODEV;
+    }
+    ahci_port_t *port = (ahci_port_t *)kmalloc(sizeof(ahci_port_t));
+    if (port == NULL) {
+        return -ENOMEM;
+    }
+    memset(port, 0, sizeof(ahci_port_t));
+    port->mem_page = _alloc_pages(GFP_KERNEL | __GFP_ZERO, find_nearest_order_greater(0, sizeof(ahci_port_memory_t)));
+    if (port->mem_page == NULL) {
+        kfree(port);
+        return -ENOMEM;
+    }
+    port->index    = index;
+    port->regs     = regs;
+    port->mem      = (ahci_port_memory_t *)get_lowmem_address_from_page(port->mem_page);
+    port->mem_phys = get_physical_address_from_page(port->mem_page);
+    list_head_init(&port->pending);
+    list_head_init(&port->completed);
+    init_waitqueue_head(&port->wait_queue);
+    port->tasklet = (tasklet_t)TASKLET_INIT(ahci_irq_bottom_half, (unsigned long)port);
+    sprintf(port->name, "sd%c", ahci_drive_char);
+    sprintf(port->path, "/dev/sd%c", ahci_drive_char);
+
+    // Point the port at our command list and FIS area.
+    if (__ahci_port_stop(regs) < 0) {
+        pr_err("Port %u: the command engine did not stop.\n", index);
+        goto free_port;
+    }
+    regs->clb  = port->mem_phys + offsetof(ahci_port_memory_t, cmd_list);
+    regs->clbu = 0;
+    regs->fb   = port->mem_phys + offsetof(ahci_port_memory_t, fis);
+    regs->fbu  = 0;
+    regs->serr = 0xFFFFFFFF;
+    regs->is   = 0xFFFFFFFF;
+    regs->ie   = AHCI_PXIE_DEFAULT;
+    __ahci_port_start(regs);
+
+    if (__ahci_port_identify(port, slots) < 0) {
+        goto stop_port;
+    }
+    if ((port->fs_root = ahci_device_create(port)) == NULL) {
+        goto stop_port;
+    }
+    port->fs_root->length = __ahci_max_offset(port);
+    ahci_ports[index]     = port;
+    if (!vfs_mount(port->path, port->fs_root)) {
+        pr_alert("Failed to mount AHCI device!\n");
+        ahci_ports[index] = NULL;
+        kmem_cache_free(port->fs_root);
+        goto stop_port;
+    }
+    ++ahci_drive_char;
+    return 0;
+
+stop_port:
+    __ahci_port_stop(regs);
+    regs->ie = 0;
+free_port:
+    __free_pages(port->mem_page);
+    kfree(port);
+    return -EIO;
+}
+
+/// @brief Used while scanning the PCI interface.
+/// @param device the device we want to find.
+/// @param vendorid its vendor ID.
+/// @param deviceid its device ID.
+/// @param extra the device once we find it.
+static void pci_find_ahci(uint32_t device, uint16_t vendorid, uint16_t deviceid, void *extra)
+{
+    if (*((uint32_t *)extra) == 0) {
+        *((uint32_t *)extra) = device;
+        pci_dump_device_data(device, vendorid, deviceid);
+    }
+}
+
+int ahci_initialize(void)
+{
+    pci_scan(&pci_find_ahci, PCI_TYPE_AHCI, &ahci_pci);
+    if (ahci_pci == 0) {
+        pr_debug("There is no AHCI controller.\n");
+        return 0;
+    }
+    if ((ahci_hba = (volatile ahci_hba_regs_t *)pci_map_bar(ahci_pci, AHCI_ABAR, NULL)) == NULL) {
+        pr_err("Failed to map the registers of the AHCI controller.\n");
+        return 0;
+    }
+    // Let the controller reach the memory, and access its registers.
+    pci_write_16(ahci_pci, PCI_COMMAND, pci_read_16(ahci_pci, PCI_COMMAND) | (1U << pci_command_memory_space) | (1U << pci_command_bus_master));
+
+    // Reset the controller, then switch it to AHCI mode.
+    ahci_hba->ghc |= AHCI_GHC_AE;
+    ahci_hba->ghc |= AHCI_GHC_HR;
+    for (unsigned spin = 0; ahci_hba->ghc & AHCI_GHC_HR; ++spin) {
+        if (spin == AHCI_SPIN_LIMIT) {
+            pr_err("The AHCI controller did not reset.\n");
+            return 1;
+        }
+    }
+    ahci_hba->ghc |= AHCI_GHC_AE;
+
+    // Prefer message signalled interrupts, which are never shared.
+    int vector = pci_enable_msi(ahci_pci, ahci_irq_handler, "AHCI");
+    if (vector < 0) {
+        int irq = pci_get_interrupt(ahci_pci);
+        irq_install_handler(irq, ahci_irq_handler, "AHCI");
+        pic8259_irq_enable(irq);
+    }
+
+    unsigned slots = AHCI_CAP_NCS(ahci_hba->cap);
+    for (uint32_t implemented = ahci_hba->pi; implemented; implemented &= implemented - 1) {
+        __ahci_port_init(__builtin_ctz(implemented), slots);
+    }
+
+    // From now on the completions are signalled by the controller.
+    ahci_hba->is = 0xFFFFFFFF;
+    ahci_hba->ghc |= AHCI_GHC_IE;
+    ahci_irq_ready = true;
+    return 0;
+}
+
+int ahci_finalize(void)
+{
+    return 0;
+}
+
+/// @}
@@ -14,19 +14,31 @@
 #include "drivers/ata/ata.h"
 #include "drivers/ata/ata_types.h"
 
+#include "assert.h"
 #include "descriptor_tables/isr.h"
 #include "devices/pci.h"
+#include "drivers/diskstats.h"
 #include "fcntl.h"
+#include "fs/buffer_cache.h"
 #include "fs/vfs.h"
+#include "hardware/hrtimer.h"
 #include "hardware/pic8259.h"
+#include "hardware/timer.h"
 #include "io/port_io.h"
 #include "klib/spinlock.h"
+#include "math.h"
 #include "mem/kheap.h"
+#include "mem/vmem_map.h"
+#include "process/scheduler.h"
 #include "process/wait.h"
 #include "stdio.h"
 #include "string.h"
 #include "sys/errno.h"
 #include "system/panic.h"
+#include "system/softirq.h"
+#include "system/syscall.h"
+#include "system/syscall_types.h"
+#include "system/trace.h"
 
 /// @brief IDENTIFY device data (response to 0xEC).
 typedef struct ata_identity_t {
@@ -227,7 +239,7 @@ typedef struct ata_device_t {
     } bmr;
     /// @brief Direct Memroy Access (DMA) variables.
     struct {
-        /// Pointer to the first entry of the PRDT.
+        /// Pointer to the first entry of the PRDT (ATA_DMA_PRDT_ENTRIES long).
         prdt_t *prdt;
         /// Physical address of the first entry of the PRDT.
         uintptr_t prdt_phys;
@@ -235,15 +247,55 @@ typedef struct ata_device_t {
         uint8_t *start;
         /// Physical address of the DMA memory area.
         uintptr_t start_phys;
+        /// Set while a DMA command issued on this device is pending.
+        volatile bool_t in_progress;
+        /// Set by the IRQ handler when the pending DMA command completes.
+        volatile bool_t completed;
+        /// The process sleeping until the pending DMA command completes, 0 if
+        /// the command is waited for without leaving the CPU.
+        pid_t owner;
+        /// If the pending DMA command writes on the disk.
+        bool_t write;
+        /// The first sector of the pending DMA command.
+        uint32_t lba_sector;
+        /// The number of sectors of the pending DMA command.
+        uint32_t count;
+        /// When the pending DMA command was issued, in ticks.
+        unsigned long issued;
+        /// Tasks sleeping while waiting for the completion of the DMA command.
+        wait_queue_head_t wait_queue;
+        /// Wakes up the waiting tasks, outside of the IRQ handler.
+        tasklet_t tasklet;
     } dma;
+    /// @brief Queue of the block requests waiting to be dispatched.
+    struct {
+        /// Pending requests, sorted by their first sector.
+        list_head sorted;
+        /// Pending requests, sorted by submission time.
+        list_head fifo;
+        /// The sector following the last one we transferred.
+        uint32_t head_sector;
+        /// Number of plugs currently holding back the dispatch.
+        unsigned int plug_depth;
+        /// Set while the queue is being dispatched.
+        bool_t running;
+    } queue;
+    /// I/O statistics of the device.
+    disk_stats_t stats;
     /// Device root file.
     vfs_file_t *fs_root;
     /// For device lock.
     spinlock_t lock;
 } ata_device_t;
 
-#define ATA_SECTOR_SIZE 512 ///< The sector size.
-#define ATA_DMA_SIZE    512 ///< The size of the DMA area.
+#define ATA_SECTOR_SIZE         512                                     ///< The sector size.
+#define ATA_DMA_MAX_SECTORS     256                                     ///< Maximum number of sectors moved by a single DMA command.
+#define ATA_DMA_SIZE            (ATA_SECTOR_SIZE * ATA_DMA_MAX_SECTORS) ///< The size of the DMA area.
+#define ATA_PRD_MAX_SIZE        0x10000                                 ///< Maximum number of bytes described by a single PRD (64 KiB).
+#define ATA_DMA_PRDT_ENTRIES    ((ATA_DMA_SIZE / ATA_PRD_MAX_SIZE) + 1) ///< Number of PRDs, one more to handle a 64 KiB boundary crossing.
+#define ATA_IRQ_TIMEOUT_SECONDS 5                                       ///< Seconds we wait for a completion IRQ before giving up.
+#define ATA_READ_EXPIRE         (TICKS_PER_SECOND / 2)                  ///< Ticks a read can wait before the elevator must serve it.
+#define ATA_WRITE_EXPIRE        (TICKS_PER_SECOND * 5)                  ///< Ticks a write can wait before the elevator must serve it.
 
 /// @brief Keeps track of the incremental letters for the ATA drives.
 static char ata_drive_char = 'a';
@@ -251,8 +303,12 @@ static char ata_drive_char = 'a';
 static int cdrom_number = 0;
 /// @brief We store the ATA pci address here.
 static uint32_t ata_pci = 0x00000000;
+/// @brief Set once the IRQ lines of the IDE channels are unmasked.
+static bool_t ata_irq_ready = false;
 
 /// @brief The ATA primary master control register locations.
+unsigned ata_request_delay_us = 0;
+
 static ata_device_t ata_primary_master = {
     .io_base = 0x1F0,
     .io_reg  = {
@@ -681,8 +737,44 @@ static inline void ata_dma_initialize_bus_mastering_address(ata_device_t *dev)
     }
 }
 
+/// @brief Fills the PRDT so that it describes the first `size` bytes of the DMA area.
+/// @param dev the device whose PRDT we set up.
+/// @param size the number of bytes of the transfer (at most ATA_DMA_SIZE).
+/// @details
+/// A single PRD can describe at most 64 KiB, and it cannot cross a 64 KiB
+/// physical boundary. The DMA area is physically contiguous, so we only need
+/// to split it at those boundaries. A byte count of zero means 64 KiB.
+static inline void ata_dma_setup_prdt(ata_device_t *dev, size_t size)
+{
+    uintptr_t address = dev->dma.start_phys;
+    uint32_t entry    = 0;
+    while (size > 0) {
+        // Compute how many bytes we can describe before the next boundary.
+        size_t chunk = ATA_PRD_MAX_SIZE - (address & (ATA_PRD_MAX_SIZE - 1));
+        if (chunk > size) {
+            chunk = size;
+        }
+        dev->dma.prdt[entry].physical_address = address;
+        dev->dma.prdt[entry].byte_count       = (unsigned short)(chunk & 0xFFFF);
+        dev->dma.prdt[entry].end_of_table     = 0;
+        address += chunk;
+        size -= chunk;
+        ++entry;
+    }
+    // Set the EOT on the last entry.
+    dev->dma.prdt[entry - 1].end_of_table = 0x8000;
+}
+
 // == ATA DEVICE MANAGEMENT ===================================================
 
+/// @brief Wakes up the tasks waiting for the completion of a DMA command.
+/// @param data the device.
+static void ata_irq_bottom_half(unsigned long data)
+{
+    ata_device_t *dev = (ata_device_t *)data;
+    wake_up(&dev->dma.wait_queue);
+}
+
 /// @brief Detects the type of device.
 /// @param dev the device for which we are checking the type.
 /// @return the device type.
@@ -772,15 +864,11 @@ static bool_t ata_device_init(ata_device_t *dev)
         return 1;
     }
     // Allocate the memory for the Physical Region Descriptor Table (PRDT).
-    dev->dma.prdt = (prdt_t *)ata_dma_malloc(sizeof(prdt_t), &dev->dma.prdt_phys);
+    dev->dma.prdt = (prdt_t *)ata_dma_malloc(sizeof(prdt_t) * ATA_DMA_PRDT_ENTRIES, &dev->dma.prdt_phys);
     // Allocate the memory for the Direct Memory Access (DMA).
     dev->dma.start = (uint8_t *)ata_dma_malloc(ATA_DMA_SIZE, &dev->dma.start_phys);
-    // Initialize the table, specifying the physical address of the DMA.
-    dev->dma.prdt->physical_address = dev->dma.start_phys;
-    // The size of the DMA.
-    dev->dma.prdt->byte_count = ATA_DMA_SIZE;
-    // Set the EOT to 1.
-    dev->dma.prdt->end_of_table = 0x8000;
+    // Initialize the table so that it covers a single sector.
+    ata_dma_setup_prdt(dev, ATA_SECTOR_SIZE);
     // Print the device data.
     ata_dump_device(dev);
     return 0;
@@ -788,29 +876,223 @@ static bool_t ata_device_init(ata_device_t *dev)
 
 // == ATA SECTOR READ/WRITE FUNCTIONS =========================================
 
-/// @brief Reads an ATA sector.
-/// @param dev the device on which we perform the read.
-/// @param lba_sector the sector where we write.
-/// @param buffer the buffer we are writing.
-static void ata_device_read_sector(ata_device_t *dev, uint32_t lba_sector, uint8_t *buffer)
+/// @brief Checks if we can wait for the completion IRQ instead of polling.
+/// @return true if the IRQ handler signals the completion, false otherwise.
+/// @details Until the first system call we are still booting, there is no
+/// process whose context the nested interrupts could rely upon.
+static inline bool_t ata_dma_use_irq(void)
 {
-    // Check if we are trying to perform the read on the correct drive type.
-    if ((dev->type != ata_dev_type_pata) && (dev->type != ata_dev_type_sata)) {
-        return;
+    return ata_irq_ready && (get_current_interrupt_stack_frame() != NULL);
+}
+
+/// @brief Checks if the calling process can sleep until its DMA commands
+/// complete.
+/// @param dev the device.
+/// @return true if the running system call is a read, or a write, on the
+/// device itself, false otherwise.
+/// @details A sleeping process executes its system call again once woken up.
+/// Only the transfers a process asks to the device itself can be restarted,
+/// the ones of a filesystem mounted on it cannot stop half-way.
+static inline bool_t ata_dma_can_sleep(ata_device_t *dev)
+{
+    pt_regs *f = get_current_interrupt_stack_frame();
+    if (!ata_dma_use_irq() || ((f->eax != __NR_read) && (f->eax != __NR_write))) {
+        return false;
     }
-    // pr_debug("ata_device_read_sector(dev: %p, lba_sector: %d, buffer: %p)\n", dev, lba_sector, buffer);
-    spinlock_lock(&dev->lock);
+    task_struct *task = scheduler_get_current_process();
+    if ((task == NULL) || (task->files == NULL) || (f->ebx >= (uint32_t)task->files->max_fd)) {
+        return false;
+    }
+    return task->files->fd_list[f->ebx].file_struct == dev->fs_root;
+}
+
+/// @brief Busy-waits for the completion of the DMA transfer in progress.
+/// @param dev the device on which the transfer is running.
+static inline void ata_dma_poll_completion(ata_device_t *dev)
+{
+    while (1) {
+        int status  = inportb(dev->bmr.status);
+        int dstatus = inportb(dev->io_reg.status);
+        if (!(status & 0x04)) {
+            continue;
+        }
+        if (!(dstatus & ata_status_bsy)) {
+            break;
+        }
+    }
+}
 
-    // Wait for the
+/// @brief Checks if the completion IRQ of the pending DMA command is late.
+/// @param dev the device.
+/// @return true if we waited for too long, false otherwise.
+static inline bool_t ata_dma_timed_out(ata_device_t *dev)
+{
+    return (timer_get_ticks() - dev->dma.issued) > (ATA_IRQ_TIMEOUT_SECONDS * TICKS_PER_SECOND);
+}
+
+/// @brief Queues the calling process on the device, it sleeps once it
+/// returns from the system call.
+/// @param dev the device.
+static inline void ata_dma_sleep(ata_device_t *dev)
+{
+    // The entry is removed, and freed, by whoever wakes us up.
+    sleep_on(&dev->dma.wait_queue)->func = autoremove_wake_function;
+}
+
+/// @brief Halts the CPU until the pending DMA command completes, without
+/// leaving it to the other processes.
+/// @param dev the device.
+/// @return 0 on success, 1 if the device did not raise the IRQ in time.
+static inline int ata_dma_wait_irq(ata_device_t *dev)
+{
+    while (!dev->dma.completed) {
+        // Give up if the device did not answer in time.
+        if (ata_dma_timed_out(dev)) {
+            pr_err("[%s] Timed out waiting for the DMA completion IRQ.\n", ata_get_device_settings_str(dev));
+            ata_print_status_error(dev);
+            return 1;
+        }
+        // Enable interrupts and halt until the next one. The `sti` delays the
+        // recognition of interrupts until the end of the next instruction, so
+        // the IRQ cannot sneak in between the two instructions.
+        __asm__ __volatile__("sti; hlt; cli" ::: "memory");
+    }
+    return 0;
+}
+
+/// @brief Ends the pending DMA command, and wakes up the processes waiting
+/// for the device.
+/// @param dev the device, locked.
+static inline void ata_dma_release(ata_device_t *dev)
+{
+    dev->dma.in_progress = false;
+    dev->dma.owner       = 0;
+    wake_up(&dev->dma.wait_queue);
+}
+
+/// @brief Checks the DMA command pending on the device, before issuing a new
+/// one.
+/// @param dev the device, locked.
+/// @param write if the new command writes on the disk.
+/// @param lba_sector the first sector of the new command.
+/// @param count the number of sectors of the new command.
+/// @param may_sleep if the calling process can sleep, see ata_dma_can_sleep.
+/// @return 1 if the pending command is the same one, issued by the process
+/// before sleeping, and it completed, 0 if the device is free, -ERESTARTSYS
+/// if the process is going to sleep, or -EIO.
+/// @details The command of a process which is not around anymore, or which
+/// does not need it anymore, is dropped. A caller which cannot sleep waits
+/// for the command of another process, and drops it: once woken up, that
+/// process finds its command gone, and issues it again.
+static inline int ata_dma_claim(ata_device_t *dev, bool_t write, uint32_t lba_sector, uint32_t count, bool_t may_sleep)
+{
+    if (!dev->dma.in_progress) {
+        return 0;
+    }
+    if (dev->dma.owner == scheduler_get_current_process()->pid) {
+        if (may_sleep && (dev->dma.write == write) && (dev->dma.lba_sector == lba_sector) && (dev->dma.count == count)) {
+            if (dev->dma.completed) {
+                return 1;
+            }
+            if (ata_dma_timed_out(dev)) {
+                pr_err("[%s] Timed out waiting for the DMA completion IRQ.\n", ata_get_device_settings_str(dev));
+                ata_print_status_error(dev);
+                ata_dma_release(dev);
+                return -EIO;
+            }
+            // Woken up by someone else, keep sleeping.
+            ata_dma_sleep(dev);
+            return -ERESTARTSYS;
+        }
+    } else if (dev->dma.owner && scheduler_get_running_process(dev->dma.owner)) {
+        if (may_sleep) {
+            // Wait for the owner to collect its command.
+            ata_dma_sleep(dev);
+            return -ERESTARTSYS;
+        }
+        ata_dma_wait_irq(dev);
+    }
+    ata_dma_release(dev);
+    return 0;
+}
+
+/// @brief Prepares the device for a DMA command.
+/// @param dev the device on which the transfer is going to run.
+/// @param write if the command writes on the disk.
+/// @param lba_sector the first sector of the command.
+/// @param count the number of sectors of the command.
+/// @param may_sleep if the calling process sleeps until the command
+/// completes, see ata_dma_can_sleep.
+static inline void ata_dma_begin(ata_device_t *dev, bool_t write, uint32_t lba_sector, uint32_t count, bool_t may_sleep)
+{
+    dev->dma.completed   = false;
+    dev->dma.in_progress = ata_dma_use_irq();
+    dev->dma.owner       = may_sleep ? scheduler_get_current_process()->pid : 0;
+    dev->dma.write       = write;
+    dev->dma.lba_sector  = lba_sector;
+    dev->dma.count       = count;
+    dev->dma.issued      = timer_get_ticks();
+}
+
+/// @brief Waits for the completion of the DMA transfer currently in progress.
+/// @param dev the device on which the transfer is running, locked.
+/// @return 0 on success, 1 if the device did not raise the IRQ in time, or
+/// -ERESTARTSYS if the process is going to sleep.
+/// @details
+/// A process which can sleep is queued on the device, and the call is
+/// executed again once the IRQ handler wakes it up, see ata_dma_claim. The
+/// other callers halt the CPU until the IRQ arrives, or poll the device
+/// while we are still booting.
+static inline int ata_dma_wait_completion(ata_device_t *dev)
+{
+    if (!dev->dma.in_progress) {
+        ata_dma_poll_completion(dev);
+        return 0;
+    }
+    if (dev->dma.owner) {
+        // Queue ourselves before unlocking, so that the IRQ is not missed.
+        ata_dma_sleep(dev);
+        return -ERESTARTSYS;
+    }
+    return ata_dma_wait_irq(dev);
+}
+
+/// @brief Programs the task-file registers for a 28-bit LBA DMA command.
+/// @param dev the device we are programming.
+/// @param lba_sector the first sector of the transfer.
+/// @param count the number of sectors (1 to ATA_DMA_MAX_SECTORS).
+/// @details A sector count of zero means 256 sectors.
+static inline void ata_dma_setup_task_file(ata_device_t *dev, uint32_t lba_sector, uint32_t count)
+{
+    outportb(dev->io_reg.hddevsel, 0xE0 | (dev->slave << 4) | ((lba_sector & 0x0F000000) >> 24));
+    ata_io_wait(dev);
+    outportb(dev->io_reg.feature, 0x00);
+    outportb(dev->io_reg.sector_count, count & 0xFF);
+    outportb(dev->io_reg.lba_lo, (lba_sector & 0x000000FF) >> 0);
+    outportb(dev->io_reg.lba_mid, (lba_sector & 0x0000FF00) >> 8);
+    outportb(dev->io_reg.lba_hi, (lba_sector & 0x00FF0000) >> 16);
+}
+
+/// @brief Issues a READ DMA command, and waits for its completion.
+/// @param dev the device on which we perform the read, locked.
+/// @param lba_sector the first sector we read.
+/// @param count the number of sectors we read (1 to ATA_DMA_MAX_SECTORS).
+/// @param may_sleep if the calling process can sleep, see ata_dma_can_sleep.
+/// @return 0 on success, 1 on error, -ERESTARTSYS if the process sleeps.
+static int ata_dma_read_issue(ata_device_t *dev, uint32_t lba_sector, uint32_t count, bool_t may_sleep)
+{
+    // Wait for the device to be ready.
     if (ata_status_wait_not(dev, ata_status_bsy, 100000)) {
         ata_print_status_error(dev);
-        spinlock_unlock(&dev->lock);
-        return;
+        return 1;
     }
 
     // Reset bus master register's command register.
     outportb(dev->bmr.command, 0x00);
 
+    // Describe the whole transfer inside the PRDT.
+    ata_dma_setup_prdt(dev, count * ATA_SECTOR_SIZE);
+
     // Set the PRDT.
     outportl(dev->bmr.prdt, dev->dma.prdt_phys);
 
@@ -822,72 +1104,108 @@ static void ata_device_read_sector(ata_device_t *dev, uint32_t lba_sector, uint8
 
     if (ata_status_wait_not(dev, ata_status_bsy, 100000)) {
         ata_print_status_error(dev);
-        spinlock_unlock(&dev->lock);
-        return;
+        return 1;
     }
 
     outportb(dev->io_control, 0x00);
-    outportb(dev->io_reg.hddevsel, 0xe0 | (dev->slave << 4));
-    ata_io_wait(dev);
-    outportb(dev->io_reg.feature, 0x00);
-
-    outportb(dev->io_reg.sector_count, 0);
-    outportb(dev->io_reg.lba_lo, (lba_sector & 0xff000000) >> 24);
-    outportb(dev->io_reg.lba_mid, (lba_sector & 0xff00000000) >> 32);
-    outportb(dev->io_reg.lba_hi, (lba_sector & 0xff0000000000) >> 40);
 
-    outportb(dev->io_reg.sector_count, 1);
-    outportb(dev->io_reg.lba_lo, (lba_sector & 0x000000ff) >> 0);
-    outportb(dev->io_reg.lba_mid, (lba_sector & 0x0000ff00) >> 8);
-    outportb(dev->io_reg.lba_hi, (lba_sector & 0x00ff0000) >> 16);
+    // Set sector count and LBA.
+    ata_dma_setup_task_file(dev, lba_sector, count);
 
     if (ata_status_wait_not(dev, ata_status_bsy & ~ata_status_rdy, 100000)) {
         ata_print_status_error(dev);
-        spinlock_unlock(&dev->lock);
-        return;
+        return 1;
     }
 
+    // Get ready to receive the completion IRQ.
+    ata_dma_begin(dev, false, lba_sector, count, may_sleep);
+
     // Write the READ_DMA to the command register (0xC8)
     outportb(dev->io_reg.command, ata_dma_command_read);
 
     ata_io_wait(dev);
 
+    // Start DMA reading.
     outportb(dev->bmr.command, 0x08 | 0x01);
 
-    while (1) {
-        int status  = inportb(dev->bmr.status);
-        int dstatus = inportb(dev->io_reg.status);
-        if (!(status & 0x04)) {
-            continue;
-        }
-        if (!(dstatus & ata_status_bsy)) {
-            break;
-        }
+    // Wait for the DMA read to complete.
+    int ret = ata_dma_wait_completion(dev);
+    if (ret > 0) {
+        outportb(dev->bmr.command, 0x08);
+        ata_dma_release(dev);
+    }
+    return ret;
+}
+
+/// @brief Reads consecutive ATA sectors with a single READ DMA command.
+/// @param dev the device on which we perform the read.
+/// @param lba_sector the first sector we read.
+/// @param count the number of sectors we read (1 to ATA_DMA_MAX_SECTORS).
+/// @param buffer the buffer where we store what we read, if NULL the data is
+/// left inside the DMA area.
+/// @param may_sleep if the calling process can sleep, see ata_dma_can_sleep.
+/// @return 0 on success, 1 on error, -ERESTARTSYS if the process sleeps.
+static int ata_dma_read_sectors(ata_device_t *dev, uint32_t lba_sector, uint32_t count, uint8_t *buffer, bool_t may_sleep)
+{
+    // Check if we are trying to perform the read on the correct drive type.
+    if ((dev->type != ata_dev_type_pata) && (dev->type != ata_dev_type_sata)) {
+        return 1;
     }
+    assert((count > 0) && (count <= ATA_DMA_MAX_SECTORS) && "Invalid number of sectors.");
+
+    spinlock_lock(&dev->lock);
+
+    // Collect the command we issued before sleeping, or issue a new one.
+    int ret = ata_dma_claim(dev, false, lba_sector, count, may_sleep);
+    if (ret == 0) {
+        ret = ata_dma_read_issue(dev, lba_sector, count, may_sleep);
+    } else if (ret == 1) {
+        ret = 0;
+    }
+    if (ret) {
+        spinlock_unlock(&dev->lock);
+        return (ret == -ERESTARTSYS) ? ret : 1;
+    }
+
+    // Stop the bus master.
+    outportb(dev->bmr.command, 0x08);
 
     // Copy from DMA buffer to output buffer.
-    memcpy(buffer, dev->dma.start, ATA_DMA_SIZE);
+    if (buffer) {
+        memcpy(buffer, dev->dma.start, count * ATA_SECTOR_SIZE);
+    }
 
     // Inform device we are done.
     outportb(dev->bmr.status, inportb(dev->bmr.status) | 0x04 | 0x02);
 
+    // Hand the DMA area over to the next command.
+    ata_dma_release(dev);
+
     spinlock_unlock(&dev->lock);
+    return 0;
 }
 
-/// @brief Writs an ATA sector.
-/// @param dev the device on which we perform the write.
-/// @param lba_sector the sector where we read.
-/// @param buffer the buffer where we store what we read.
-static void ata_device_write_sector(ata_device_t *dev, uint32_t lba_sector, uint8_t *buffer)
+/// @brief Issues a WRITE DMA command, and waits for its completion.
+/// @param dev the device on which we perform the write, locked.
+/// @param lba_sector the first sector we write.
+/// @param count the number of sectors we write (1 to ATA_DMA_MAX_SECTORS).
+/// @param buffer the buffer we are writing, if NULL the data must already be
+/// inside the DMA area.
+/// @param may_sleep if the calling process can sleep, see ata_dma_can_sleep.
+/// @return 0 on success, 1 on error, -ERESTARTSYS if the process sleeps.
+static int ata_dma_write_issue(ata_device_t *dev, uint32_t lba_sector, uint32_t count, const uint8_t *buffer, bool_t may_sleep)
 {
-    spinlock_lock(&dev->lock);
-
     // Copy the buffer over to the DMA area
-    memcpy(dev->dma.start, buffer, ATA_DMA_SIZE);
+    if (buffer) {
+        memcpy(dev->dma.start, buffer, count * ATA_SECTOR_SIZE);
+    }
 
     // Reset bus master register's command register
     outportb(dev->bmr.command, 0);
 
+    // Describe the whole transfer inside the PRDT.
+    ata_dma_setup_prdt(dev, count * ATA_SECTOR_SIZE);
+
     // Set prdt
     outportl(dev->bmr.prdt, dev->dma.prdt_phys);
 
@@ -897,30 +1215,19 @@ static void ata_device_write_sector(ata_device_t *dev, uint32_t lba_sector, uint
     // Select drive
     if (ata_status_wait_not(dev, ata_status_bsy, 100000)) {
         ata_print_status_error(dev);
-        spinlock_unlock(&dev->lock);
-        return;
+        return 1;
     }
 
-    outportb(dev->io_reg.hddevsel, 0xe0 | dev->slave << 4 | (lba_sector & 0x0f000000) >> 24);
+    // Set sector count and LBA.
+    ata_dma_setup_task_file(dev, lba_sector, count);
 
     if (ata_status_wait_not(dev, ata_status_bsy, 100000)) {
         ata_print_status_error(dev);
-        spinlock_unlock(&dev->lock);
-        return;
+        return 1;
     }
 
-    // Set sector counts and LBAs
-    outportb(dev->io_reg.feature, 0x00);
-    outportb(dev->io_reg.sector_count, 1);
-    outportb(dev->io_reg.lba_lo, (lba_sector & 0x000000ff) >> 0);
-    outportb(dev->io_reg.lba_mid, (lba_sector & 0x0000ff00) >> 8);
-    outportb(dev->io_reg.lba_hi, (lba_sector & 0x00ff0000) >> 16);
-
-    if (ata_status_wait_not(dev, ata_status_bsy, 100000)) {
-        ata_print_status_error(dev);
-        spinlock_unlock(&dev->lock);
-        return;
-    }
+    // Get ready to receive the completion IRQ.
+    ata_dma_begin(dev, true, lba_sector, count, may_sleep);
 
     // Notify that we are starting DMA writing.
     outportb(dev->io_reg.command, ata_dma_command_write);
@@ -929,21 +1236,390 @@ static void ata_device_write_sector(ata_device_t *dev, uint32_t lba_sector, uint
     outportb(dev->bmr.command, 0x1);
 
     // Wait for dma write to complete.
-    while (1) {
-        int status  = inportb(dev->bmr.status);
-        int dstatus = inportb(dev->io_reg.status);
-        if (!(status & 0x04)) {
-            continue;
-        }
-        if (!(dstatus & 0x80)) {
-            break;
-        }
+    int ret = ata_dma_wait_completion(dev);
+    if (ret > 0) {
+        outportb(dev->bmr.command, 0x0);
+        ata_dma_release(dev);
+    }
+    return ret;
+}
+
+/// @brief Writes consecutive ATA sectors with a single WRITE DMA command.
+/// @param dev the device on which we perform the write.
+/// @param lba_sector the first sector we write.
+/// @param count the number of sectors we write (1 to ATA_DMA_MAX_SECTORS).
+/// @param buffer the buffer we are writing, if NULL the data must already be
+/// inside the DMA area.
+/// @param may_sleep if the calling process can sleep, see ata_dma_can_sleep.
+/// @return 0 on success, 1 on error, -ERESTARTSYS if the process sleeps.
+static int ata_dma_write_sectors(ata_device_t *dev, uint32_t lba_sector, uint32_t count, const uint8_t *buffer, bool_t may_sleep)
+{
+    // Check if we are trying to perform the write on the correct drive type.
+    if ((dev->type != ata_dev_type_pata) && (dev->type != ata_dev_type_sata)) {
+        return 1;
     }
+    assert((count > 0) && (count <= ATA_DMA_MAX_SECTORS) && "Invalid number of sectors.");
+
+    spinlock_lock(&dev->lock);
+
+    // Collect the command we issued before sleeping, or issue a new one. The
+    // DMA area is filled only once the device is ours.
+    int ret = ata_dma_claim(dev, true, lba_sector, count, may_sleep);
+    if (ret == 0) {
+        ret = ata_dma_write_issue(dev, lba_sector, count, buffer, may_sleep);
+    } else if (ret == 1) {
+        ret = 0;
+    }
+    if (ret) {
+        spinlock_unlock(&dev->lock);
+        return (ret == -ERESTARTSYS) ? ret : 1;
+    }
+
+    // Stop the bus master.
+    outportb(dev->bmr.command, 0x0);
 
     // Inform device we are done.
     outportb(dev->bmr.status, inportb(dev->bmr.status) | 0x04 | 0x02);
 
+    // Hand the DMA area over to the next command.
+    ata_dma_release(dev);
+
     spinlock_unlock(&dev->lock);
+    return 0;
+}
+
+/// @brief Returns the identifier of the device inside the traces.
+/// @param dev the device.
+/// @return the I/O port base, plus one for the slave.
+static inline uint32_t ata_trace_id(ata_device_t *dev)
+{
+    return dev->io_base + (dev->slave ? 1 : 0);
+}
+
+/// @brief Reads consecutive ATA sectors, see ata_dma_read_sectors, tracing
+/// the transfer.
+/// @param dev the device on which we perform the read.
+/// @param lba_sector the first sector we read.
+/// @param count the number of sectors we read (1 to ATA_DMA_MAX_SECTORS).
+/// @param buffer the buffer where we store what we read, or NULL.
+/// @param may_sleep if the calling process can sleep, see ata_dma_can_sleep.
+/// @return 0 on success, 1 on error, -ERESTARTSYS if the process sleeps.
+static int ata_device_read_sectors(ata_device_t *dev, uint32_t lba_sector, uint32_t count, uint8_t *buffer, bool_t may_sleep)
+{
+    trace_event(TRACE_BLOCK_ISSUE, ata_trace_id(dev), lba_sector, count, 0);
+    int status = ata_dma_read_sectors(dev, lba_sector, count, buffer, may_sleep);
+    if (status != -ERESTARTSYS) {
+        trace_event(TRACE_BLOCK_COMPLETE, ata_trace_id(dev), lba_sector, count, status);
+    }
+    return status;
+}
+
+/// @brief Writes consecutive ATA sectors, see ata_dma_write_sectors, tracing
+/// the transfer.
+/// @param dev the device on which we perform the write.
+/// @param lba_sector the first sector we write.
+/// @param count the number of sectors we write (1 to ATA_DMA_MAX_SECTORS).
+/// @param buffer the buffer we are writing, or NULL.
+/// @param may_sleep if the calling process can sleep, see ata_dma_can_sleep.
+/// @return 0 on success, 1 on error, -ERESTARTSYS if the process sleeps.
+static int ata_device_write_sectors(ata_device_t *dev, uint32_t lba_sector, uint32_t count, const uint8_t *buffer, bool_t may_sleep)
+{
+    trace_event(TRACE_BLOCK_ISSUE, ata_trace_id(dev), lba_sector, count, 1);
+    int status = ata_dma_write_sectors(dev, lba_sector, count, buffer, may_sleep);
+    if (status != -ERESTARTSYS) {
+        trace_event(TRACE_BLOCK_COMPLETE, ata_trace_id(dev), lba_sector, count, status);
+    }
+    return status;
+}
+
+/// @brief Waits until the DMA area of the device is free, see ata_dma_claim.
+/// @param dev the device.
+static inline void ata_dma_drain(ata_device_t *dev)
+{
+    spinlock_lock(&dev->lock);
+    ata_dma_claim(dev, false, 0, 0, false);
+    spinlock_unlock(&dev->lock);
+}
+
+// == BLOCK REQUEST QUEUE =====================================================
+
+/// @brief Selects the next request the device should serve.
+/// @param dev the device.
+/// @return the next request, NULL if the queue is empty.
+/// @details
+/// Requests are served in C-LOOK order: the head sweeps towards higher
+/// sectors and, once there is nothing left ahead of it, jumps back to the
+/// lowest pending sector. To avoid starving requests far away from the head,
+/// a request whose deadline has expired is served first.
+static inline ata_request_t *ata_elevator_next(ata_device_t *dev)
+{
+    ata_request_t *request, *expired = NULL;
+    unsigned long now = timer_get_ticks();
+    if (list_head_empty(&dev->queue.sorted)) {
+        return NULL;
+    }
+    // Look for the request with the earliest expired deadline.
+    list_for_each_decl(it, &dev->queue.fifo)
+    {
+        request = list_entry(it, ata_request_t, fifo_list);
+        if ((long)(now - request->deadline) >= 0) {
+            if (!expired || ((long)(request->deadline - expired->deadline) < 0)) {
+                expired = request;
+            }
+        }
+    }
+    if (expired) {
+        return expired;
+    }
+    // Look for the first request ahead of the head.
+    list_for_each_decl(it, &dev->queue.sorted)
+    {
+        request = list_entry(it, ata_request_t, sort_list);
+        if (request->lba_sector >= dev->queue.head_sector) {
+            return request;
+        }
+    }
+    // Wrap around, and restart from the lowest sector.
+    return list_entry(dev->queue.sorted.next, ata_request_t, sort_list);
+}
+
+/// @brief Inserts the request inside the queue of the device.
+/// @param dev the device.
+/// @param request the request.
+static inline void ata_elevator_add(ata_device_t *dev, ata_request_t *request)
+{
+    ata_request_t *entry;
+    // Keep the queue sorted by sector.
+    list_head *location = &dev->queue.sorted;
+    list_for_each_decl(it, &dev->queue.sorted)
+    {
+        entry = list_entry(it, ata_request_t, sort_list);
+        if (entry->lba_sector > request->lba_sector) {
+            location = it;
+            break;
+        }
+    }
+    list_head_insert_before(&request->sort_list, location);
+    list_head_insert_before(&request->fifo_list, &dev->queue.fifo);
+}
+
+/// @brief Removes the request from the queue, and notifies its owner.
+/// @param dev the device.
+/// @param request the request.
+/// @param status the completion status.
+/// @param started when the device started moving the request.
+/// @param merged if the request was moved together with the previous one.
+static inline void ata_request_complete(ata_device_t *dev, ata_request_t *request, int status, ktime_t started, int merged)
+{
+    disk_stats_complete(&dev->stats, (request->direction == ata_request_read) ? DISK_STAT_READ : DISK_STAT_WRITE,
+                        request->count, merged, request->queued, started, hrtimer_get_time());
+    list_head_remove(&request->sort_list);
+    list_head_remove(&request->fifo_list);
+    request->status = status;
+    if (request->end_request) {
+        request->end_request(request);
+    }
+}
+
+/// @brief Copies the data of a request to, or from, the DMA area.
+/// @param request the request.
+/// @param dma where the data of the request starts inside the DMA area.
+/// @param to_dma if the data goes to the DMA area, or comes from it.
+/// @details The page frames of a request might be in high memory, they are
+/// mapped one at a time.
+static void ata_request_copy(ata_request_t *request, uint8_t *dma, bool_t to_dma)
+{
+    size_t size = request->count * ATA_SECTOR_SIZE;
+    if (request->pages == NULL) {
+        if (to_dma) {
+            memcpy(dma, request->buffer, size);
+        } else {
+            memcpy(request->buffer, dma, size);
+        }
+        return;
+    }
+    for (uint32_t it = 0, offset = request->offset; size > 0; ++it, offset = 0) {
+        size_t chunk   = min(PAGE_SIZE - offset, size);
+        uint32_t vaddr = virt_kmap(request->pages[it]);
+        if (to_dma) {
+            memcpy(dma, (uint8_t *)vaddr + offset, chunk);
+        } else {
+            memcpy((uint8_t *)vaddr + offset, dma, chunk);
+        }
+        virt_kunmap(vaddr);
+        dma += chunk;
+        size -= chunk;
+    }
+}
+
+/// @brief Holds back the completion of a command, by ata_request_delay_us.
+/// @param started when the command started.
+static inline void ata_inject_delay(ktime_t started)
+{
+    ktime_t until = started + ata_request_delay_us * NSEC_PER_USEC;
+    while (ata_request_delay_us && (hrtimer_get_time() < until)) {
+        cpu_relax();
+    }
+}
+
+/// @brief Dispatches the given request, merged with the pending requests that
+/// immediately follow it on the disk.
+/// @param dev the device.
+/// @param first the request selected by the elevator.
+/// @details Merged requests, and the ones moving page frames, are moved with a
+/// single DMA command through the DMA area, which is then scattered to (or
+/// gathered from) their buffers.
+static void ata_queue_dispatch(ata_device_t *dev, ata_request_t *first)
+{
+    ata_request_t *last = first, *next;
+    uint32_t base       = first->lba_sector;
+    uint32_t total      = first->count;
+    int status          = 0;
+    ktime_t started;
+    // Merge the following requests, as long as they are adjacent on disk, go
+    // in the same direction, and fit in a single DMA command.
+    while (last->sort_list.next != &dev->queue.sorted) {
+        next = list_entry(last->sort_list.next, ata_request_t, sort_list);
+        if ((next->direction != first->direction) ||
+            (next->lba_sector != (last->lba_sector + last->count)) ||
+            ((total + next->count) > ATA_DMA_MAX_SECTORS)) {
+            break;
+        }
+        total += next->count;
+        last = next;
+    }
+    started = hrtimer_get_time();
+    if ((first == last) && (first->pages == NULL)) {
+        // A single request, the transfer functions handle the copy.
+        if (first->direction == ata_request_read) {
+            status = ata_device_read_sectors(dev, first->lba_sector, first->count, first->buffer, false);
+        } else {
+            status = ata_device_write_sectors(dev, first->lba_sector, first->count, first->buffer, false);
+        }
+        dev->queue.head_sector = first->lba_sector + first->count;
+        ata_inject_delay(started);
+        ata_request_complete(dev, first, status ? -EIO : 0, started, 0);
+        return;
+    }
+    pr_debug("[%s] Dispatching requests for sectors %u-%u.\n", ata_get_device_settings_str(dev), first->lba_sector, last->lba_sector + last->count - 1);
+    // Gather the data we need to write inside the DMA area, once the command
+    // of a sleeping process is not using it anymore.
+    if (first->direction == ata_request_write) {
+        ata_dma_drain(dev);
+        for (next = first;; next = list_entry(next->sort_list.next, ata_request_t, sort_list)) {
+            ata_request_copy(next, dev->dma.start + (next->lba_sector - base) * ATA_SECTOR_SIZE, true);
+            if (next == last) {
+                break;
+            }
+        }
+        status = ata_device_write_sectors(dev, base, total, NULL, false);
+    } else {
+        status = ata_device_read_sectors(dev, base, total, NULL, false);
+    }
+    dev->queue.head_sector = base + total;
+    ata_inject_delay(started);
+    // Scatter the data we have read, and complete the requests.
+    for (ata_request_t *request = first; request;) {
+        next = (request == last) ? NULL : list_entry(request->sort_list.next, ata_request_t, sort_list);
+        if (!status && (request->direction == ata_request_read)) {
+            ata_request_copy(request, dev->dma.start + (request->lba_sector - base) * ATA_SECTOR_SIZE, false);
+        }
+        ata_request_complete(dev, request, status ? -EIO : 0, started, request != first);
+        request = next;
+    }
+}
+
+/// @brief Dispatches all the pending requests of the device.
+/// @param dev the device.
+static void ata_queue_run(ata_device_t *dev)
+{
+    ata_request_t *request;
+    // Completion callbacks might submit new requests, they will be picked up
+    // by the loop below.
+    if (dev->queue.running) {
+        return;
+    }
+    dev->queue.running = true;
+    while ((dev->queue.plug_depth == 0) && (request = ata_elevator_next(dev))) {
+        ata_queue_dispatch(dev, request);
+    }
+    dev->queue.running = false;
+}
+
+/// @brief Checks the request, and inserts it inside the queue of the device.
+/// @param dev the device.
+/// @param request the request.
+/// @return 0 on success, -errno on failure.
+static int ata_queue_add(ata_device_t *dev, ata_request_t *request)
+{
+    if ((dev == NULL) || (request == NULL)) {
+        return -EINVAL;
+    }
+    if ((dev->type != ata_dev_type_pata) && (dev->type != ata_dev_type_sata)) {
+        return -EPERM;
+    }
+    if ((request->count == 0) || (request->count > ATA_DMA_MAX_SECTORS) || ((request->buffer == NULL) && (request->pages == NULL))) {
+        return -EINVAL;
+    }
+    if ((((uint64_t)request->lba_sector + request->count) * ATA_SECTOR_SIZE) > ata_max_offset(dev)) {
+        return -EINVAL;
+    }
+    // Set the deadline, reads are usually waited for synchronously.
+    request->status   = -EINPROGRESS;
+    request->deadline = timer_get_ticks() + ((request->direction == ata_request_read) ? ATA_READ_EXPIRE : ATA_WRITE_EXPIRE);
+    list_head_init(&request->sort_list);
+    list_head_init(&request->fifo_list);
+    request->queued = hrtimer_get_time();
+    disk_stats_queued(&dev->stats);
+    ata_elevator_add(dev, request);
+    return 0;
+}
+
+/// @brief Submits the request, and dispatches the queue until it completes.
+/// @param dev the device.
+/// @param request the request.
+/// @return 0 on success, -errno on failure.
+/// @details The request is served even if the queue is plugged, together with
+/// the pending requests the elevator decides to serve before it.
+static int ata_queue_submit_sync(ata_device_t *dev, ata_request_t *request)
+{
+    ata_request_t *next;
+    int ret = ata_queue_add(dev, request);
+    if (ret < 0) {
+        return ret;
+    }
+    while ((request->status == -EINPROGRESS) && (next = ata_elevator_next(dev))) {
+        ata_queue_dispatch(dev, next);
+    }
+    return request->status;
+}
+
+int ata_submit_request(vfs_file_t *file, ata_request_t *request)
+{
+    ata_device_t *dev = (ata_device_t *)file->device;
+    int ret           = ata_queue_add(dev, request);
+    if (ret == 0) {
+        ata_queue_run(dev);
+    }
+    return ret;
+}
+
+void ata_queue_plug(vfs_file_t *file)
+{
+    ata_device_t *dev = (ata_device_t *)file->device;
+    if (dev) {
+        ++dev->queue.plug_depth;
+    }
+}
+
+void ata_queue_unplug(vfs_file_t *file)
+{
+    ata_device_t *dev = (ata_device_t *)file->device;
+    if (dev && dev->queue.plug_depth) {
+        if (--dev->queue.plug_depth == 0) {
+            ata_queue_run(dev);
+        }
+    }
 }
 
 // == VFS CALLBACKS ===========================================================
@@ -1001,6 +1677,8 @@ static int ata_close(vfs_file_t *file)
 /// @param offset the offset where we want to read.
 /// @param size the size of the buffer.
 /// @return the number of read characters.
+/// @details The sector-aligned part of the request is moved with as few DMA
+/// commands as possible, each one covering up to ATA_DMA_MAX_SECTORS sectors.
 static ssize_t ata_read(vfs_file_t *file, char *buffer, off_t offset, size_t size)
 {
     // pr_debug("ata_read(file: 0x%p, buffer: 0x%p, offest: %8d, size: %8d)\n", file, buffer, offset, size);
@@ -1014,14 +1692,13 @@ static ssize_t ata_read(vfs_file_t *file, char *buffer, off_t offset, size_t siz
     }
 
     if ((dev->type == ata_dev_type_pata) || (dev->type == ata_dev_type_sata)) {
-        uint32_t start_block  = offset / ATA_SECTOR_SIZE;
+        uint32_t lba_sector   = offset / ATA_SECTOR_SIZE;
         uint32_t start_offset = offset % ATA_SECTOR_SIZE;
-        uint32_t end_block    = (offset + size - 1) / ATA_SECTOR_SIZE;
-        uint32_t end_offset   = (offset + size - 1) % ATA_SECTOR_SIZE;
-        uint32_t prefix_size  = (ATA_SECTOR_SIZE - start_offset);
-        uint32_t postfix_size = (offset + size) % ATA_SECTOR_SIZE;
         uint32_t max_offset   = ata_max_offset(dev);
         uint32_t x_offset     = 0;
+        bool_t may_sleep      = ata_dma_can_sleep(dev);
+        uint32_t chunk, count;
+        int ret;
 
         // Check if with the offset we are exceeding the size.
         if (offset > max_offset) {
@@ -1039,23 +1716,56 @@ static ssize_t ata_read(vfs_file_t *file, char *buffer, off_t offset, size_t siz
             size = max_offset - offset;
         }
 
-        if (start_offset) {
-            ata_device_read_sector(dev, start_block, (uint8_t *)support_buffer);
-            memcpy(buffer, (void *)((uintptr_t)support_buffer + start_offset), prefix_size);
-            x_offset += prefix_size;
-            ++start_block;
+        // Read the unaligned head of the request.
+        if (start_offset && size) {
+            ret = ata_device_read_sectors(dev, lba_sector, 1, (uint8_t *)support_buffer, may_sleep);
+            if (ret) {
+                return (ret < 0) ? ret : -EIO;
+            }
+            chunk = min(ATA_SECTOR_SIZE - start_offset, size);
+            memcpy(buffer, support_buffer + start_offset, chunk);
+            // A sleeping process moves a single command for each call.
+            if (may_sleep) {
+                return chunk;
+            }
+            x_offset += chunk;
+            ++lba_sector;
         }
 
-        if (postfix_size && (start_block <= end_block)) {
-            ata_device_read_sector(dev, end_block, (uint8_t *)support_buffer);
-            memcpy((void *)((uintptr_t)buffer + size - postfix_size), support_buffer, postfix_size);
-            --end_block;
+        // Read the aligned body of the request, in multi-sector commands.
+        while ((size - x_offset) >= ATA_SECTOR_SIZE) {
+            count = min((size - x_offset) / ATA_SECTOR_SIZE, ATA_DMA_MAX_SECTORS);
+            if (may_sleep) {
+                // The restarted call collects the command, the queue cannot
+                // keep the request in the meanwhile.
+                ret = ata_device_read_sectors(dev, lba_sector, count, (uint8_t *)buffer, true);
+                if (ret) {
+                    return (ret < 0) ? ret : -EIO;
+                }
+                return count * ATA_SECTOR_SIZE;
+            }
+            ata_request_t request = {
+                .direction    = ata_request_read,
+                .lba_sector   = lba_sector,
+                .count        = count,
+                .buffer       = (uint8_t *)buffer + x_offset,
+                .end_request  = NULL,
+                .private_data = NULL,
+            };
+            if (ata_queue_submit_sync(dev, &request)) {
+                return -EIO;
+            }
+            x_offset += count * ATA_SECTOR_SIZE;
+            lba_sector += count;
         }
 
-        while (start_block <= end_block) {
-            ata_device_read_sector(dev, start_block, (uint8_t *)((uintptr_t)buffer + x_offset));
-            x_offset += ATA_SECTOR_SIZE;
-            ++start_block;
+        // Read the unaligned tail of the request.
+        if (x_offset < size) {
+            ret = ata_device_read_sectors(dev, lba_sector, 1, (uint8_t *)support_buffer, may_sleep);
+            if (ret) {
+                return (ret < 0) ? ret : -EIO;
+            }
+            memcpy(buffer + x_offset, support_buffer, size - x_offset);
         }
     } else if ((dev->type == ata_dev_type_patapi) || (dev->type == ata_dev_type_satapi)) {
         pr_warning("ATAPI and SATAPI drives are not currently supported.\n");
@@ -1070,6 +1780,10 @@ static ssize_t ata_read(vfs_file_t *file, char *buffer, off_t offset, size_t siz
 /// @param offset the offset where we want to write.
 /// @param size the size of the buffer.
 /// @return the number of written characters.
+/// @details Partial sectors at the edges of the request are handled with a
+/// read-modify-write, while the aligned part is written with multi-sector DMA
+/// commands. A process writing on the device itself sleeps until the commands
+/// of the aligned part complete, and moves a single command for each call.
 static ssize_t ata_write(vfs_file_t *file, const void *buffer, off_t offset, size_t size)
 {
     pr_debug("ata_write(%p, %p, %d, %d)\n", file, buffer, offset, size);
@@ -1083,14 +1797,13 @@ static ssize_t ata_write(vfs_file_t *file, const void *buffer, off_t offset, siz
     }
 
     if ((dev->type == ata_dev_type_pata) || (dev->type == ata_dev_type_sata)) {
-        uint32_t start_block  = offset / ATA_SECTOR_SIZE;
+        uint32_t lba_sector   = offset / ATA_SECTOR_SIZE;
         uint32_t start_offset = offset % ATA_SECTOR_SIZE;
-        uint32_t end_block    = (offset + size - 1) / ATA_SECTOR_SIZE;
-        uint32_t end_offset   = (offset + size - 1) % ATA_SECTOR_SIZE;
-        uint32_t prefix_size  = (ATA_SECTOR_SIZE - start_offset);
-        uint32_t postfix_size = (offset + size) % ATA_SECTOR_SIZE;
         uint32_t max_offset   = ata_max_offset(dev);
         uint32_t x_offset     = 0;
+        bool_t may_sleep      = ata_dma_can_sleep(dev);
+        uint32_t chunk, count;
+        int ret;
 
         // Check if with the offset we are exceeding the size.
         if (offset > max_offset) {
@@ -1101,25 +1814,61 @@ static ssize_t ata_write(vfs_file_t *file, const void *buffer, off_t offset, siz
         if (offset + size > max_offset) {
             size = max_offset - offset;
         }
-        if (start_offset) {
-            ata_device_read_sector(dev, start_block, (uint8_t *)support_buffer);
-            memcpy((void *)((uintptr_t)support_buffer + (start_offset)), buffer, prefix_size);
-            ata_device_write_sector(dev, start_block, (uint8_t *)support_buffer);
-            x_offset += prefix_size;
-            ++start_block;
+
+        // Write the unaligned head of the request.
+        if (start_offset && size) {
+            if (ata_device_read_sectors(dev, lba_sector, 1, (uint8_t *)support_buffer, false)) {
+                return -EIO;
+            }
+            chunk = min(ATA_SECTOR_SIZE - start_offset, size);
+            memcpy(support_buffer + start_offset, buffer, chunk);
+            if (ata_device_write_sectors(dev, lba_sector, 1, (uint8_t *)support_buffer, false)) {
+                return -EIO;
+            }
+            // A sleeping process moves the aligned body with the next call.
+            if (may_sleep) {
+                return chunk;
+            }
+            x_offset += chunk;
+            ++lba_sector;
         }
 
-        if (postfix_size && (start_block <= end_block)) {
-            ata_device_read_sector(dev, end_block, (uint8_t *)support_buffer);
-            memcpy(support_buffer, (void *)((uintptr_t)buffer + size - postfix_size), postfix_size);
-            ata_device_write_sector(dev, end_block, (uint8_t *)support_buffer);
-            --end_block;
+        // Write the aligned body of the request, in multi-sector commands.
+        while ((size - x_offset) >= ATA_SECTOR_SIZE) {
+            count = min((size - x_offset) / ATA_SECTOR_SIZE, ATA_DMA_MAX_SECTORS);
+            if (may_sleep) {
+                // The restarted call collects the command, the queue cannot
+                // keep the request in the meanwhile.
+                ret = ata_device_write_sectors(dev, lba_sector, count, (const uint8_t *)buffer, true);
+                if (ret) {
+                    return (ret < 0) ? ret : -EIO;
+                }
+                return count * ATA_SECTOR_SIZE;
+            }
+            ata_request_t request = {
+                .direction    = ata_request_write,
+                .lba_sector   = lba_sector,
+                .count        = count,
+                .buffer       = (uint8_t *)buffer + x_offset,
+                .end_request  = NULL,
+                .private_data = NULL,
+            };
+            if (ata_queue_submit_sync(dev, &request)) {
+                return -EIO;
+            }
+            x_offset += count * ATA_SECTOR_SIZE;
+            lba_sector += count;
         }
 
-        while (start_block <= end_block) {
-            ata_device_write_sector(dev, start_block, (uint8_t *)((uintptr_t)buffer + x_offset));
-            x_offset += ATA_SECTOR_SIZE;
-            ++start_block;
+        // Write the unaligned tail of the request.
+        if (x_offset < size) {
+            if (ata_device_read_sectors(dev, lba_sector, 1, (uint8_t *)support_buffer, false)) {
+                return -EIO;
+            }
+            memcpy(support_buffer, (const uint8_t *)buffer + x_offset, size - x_offset);
+            if (ata_device_write_sectors(dev, lba_sector, 1, (uint8_t *)support_buffer, false)) {
+                return -EIO;
+            }
         }
     } else if ((dev->type == ata_dev_type_patapi) || (dev->type == ata_dev_type_satapi)) {
         pr_warning("ATAPI and SATAPI drives are not currently supported.\n");
@@ -1171,6 +1920,14 @@ static int ata_stat(const char *path, stat_t *stat)
     return -1;
 }
 
+/// @brief Writes back the cached blocks of the ATA device.
+/// @param file the VFS file associated with the ATA device.
+/// @return 0 on success, -errno on failure.
+static int ata_fsync(vfs_file_t *file)
+{
+    return buffer_sync(file);
+}
+
 // == VFS ENTRY GENERATION ====================================================
 /// Filesystem general operations.
 static vfs_sys_operations_t ata_sys_operations = {
@@ -1193,6 +1950,8 @@ static vfs_file_operations_t ata_fs_operations = {
     .ioctl_f    = NULL,
     .getdents_f = NULL,
     .readlink_f = NULL,
+    .fsync_f    = ata_fsync,
+    .submit_f   = ata_submit_request,
 };
 
 /// @brief Creates a VFS file, starting from an ATA device.
@@ -1234,6 +1993,15 @@ static ata_device_type_t ata_device_detect(ata_device_t *dev)
         dev->type = type;
         // Initialize the spinlock.
         spinlock_init(&dev->lock);
+        // Initialize the queue of tasks waiting for DMA completions.
+        init_waitqueue_head(&dev->dma.wait_queue);
+        dev->dma.tasklet = (tasklet_t)TASKLET_INIT(ata_irq_bottom_half, (unsigned long)dev);
+        // Initialize the queue of block requests.
+        list_head_init(&dev->queue.sorted);
+        list_head_init(&dev->queue.fifo);
+        dev->queue.head_sector = 0;
+        dev->queue.plug_depth  = 0;
+        dev->queue.running     = false;
         // Set the device name.
         sprintf(dev->name, "hd%c", ata_drive_char);
         // Set the device path.
@@ -1250,6 +2018,8 @@ static ata_device_type_t ata_device_detect(ata_device_t *dev)
             pr_alert("Failed to create ata device!\n");
             return ata_dev_type_unknown;
         }
+        // Account the I/O of the drive.
+        disk_stats_register(&dev->stats, dev->name);
         // Update the filesystem entry with the length of the device.
         dev->fs_root->length = ata_max_offset(dev);
         // Try to mount the drive.
@@ -1277,23 +2047,55 @@ static ata_device_type_t ata_device_detect(ata_device_t *dev)
 }
 
 // == IRQ HANDLERS ============================================================
+
+/// @brief Completes the DMA command pending on the given device, if any.
+/// @param dev the device which might have raised the IRQ.
+/// @return 1 if the device had a completed command, 0 otherwise.
+static inline int ata_irq_complete(ata_device_t *dev)
+{
+    if ((dev->type != ata_dev_type_pata) && (dev->type != ata_dev_type_sata)) {
+        return 0;
+    }
+    if (!dev->dma.in_progress || dev->dma.completed) {
+        return 0;
+    }
+    // Check that the bus master actually raised the interrupt.
+    uint8_t bm_status = inportb(dev->bmr.status);
+    if (!(bm_status & 0x04)) {
+        return 0;
+    }
+    // Reading the status register acknowledges the interrupt on the device.
+    inportb(dev->io_reg.status);
+    // Stop the bus master, keeping the direction bit.
+    outportb(dev->bmr.command, inportb(dev->bmr.command) & ~ata_bm_start_bus_master);
+    // Clear the interrupt and error bits.
+    outportb(dev->bmr.status, bm_status | 0x04 | 0x02);
+    // Mark the command as completed, whoever is waiting for it is woken up
+    // by the bottom half.
+    dev->dma.completed = true;
+    tasklet_schedule(&dev->dma.tasklet);
+    return 1;
+}
+
+/// @brief Handles the IRQ of the primary IDE channel.
 /// @param f The interrupt stack frame.
 static void ata_irq_handler_master(pt_regs *f)
 {
-    pr_warning("ata_irq_handler_master\n");
-    inportb(ata_primary_master.io_reg.status);
-    inportb(ata_primary_master.bmr.status);
-    //outportb(ata_primary_master.bmr.command, ata_bm_stop_bus_master);
+    if (!ata_irq_complete(&ata_primary_master) && !ata_irq_complete(&ata_primary_slave)) {
+        // Nobody was waiting, still acknowledge the interrupt.
+        inportb(ata_primary_master.io_reg.status);
+    }
     pic8259_send_eoi(IRQ_FIRST_HD);
 }
 
+/// @brief Handles the IRQ of the secondary IDE channel.
 /// @param f The interrupt stack frame.
 static void ata_irq_handler_slave(pt_regs *f)
 {
-    pr_warning("ata_irq_handler_slave\n");
-    inportb(ata_secondary_master.io_reg.status);
-    inportb(ata_primary_master.bmr.status);
-    //outportb(ata_primary_master.bmr.command, ata_bm_stop_bus_master);
+    if (!ata_irq_complete(&ata_secondary_master) && !ata_irq_complete(&ata_secondary_slave)) {
+        // Nobody was waiting, still acknowledge the interrupt.
+        inportb(ata_secondary_master.io_reg.status);
+    }
     pic8259_send_eoi(IRQ_SECOND_HD);
 }
 
@@ -1331,6 +2133,12 @@ int ata_initialize(void)
     ata_device_detect(&ata_secondary_master);
     ata_device_detect(&ata_secondary_slave);
 
+    // Enable the IRQs, from now on the completion of DMA commands is
+    // signalled by the devices.
+    pic8259_irq_enable(IRQ_FIRST_HD);
+    pic8259_irq_enable(IRQ_SECOND_HD);
+    ata_irq_ready = true;
+
     return 0;
 }
 
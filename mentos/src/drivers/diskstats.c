@@ -0,0 +1,47 @@
+/// @file diskstats.c
+/// @brief I/O statistics of the block devices.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include "drivers/diskstats.h"
+#include "string.h"
+
+/// The statistics of the registered devices.
+static list_head disk_stats_list = { &disk_stats_list, &disk_stats_list };
+
+void disk_stats_register(disk_stats_t *stats, const char *name)
+{
+    memset(stats, 0, sizeof(disk_stats_t));
+    stats->name = name;
+    list_head_insert_before(&stats->list, &disk_stats_list);
+}
+
+void disk_stats_complete(disk_stats_t *stats, disk_stat_dir_t dir, unsigned sectors, int merged,
+                         ktime_t queued, ktime_t started, ktime_t completed)
+{
+    --stats->in_flight;
+    ++stats->ios[dir];
+    stats->sectors[dir] += sectors;
+    if (merged) {
+        ++stats->merges[dir];
+    }
+    stats->queue_ns[dir] += started - queued;
+    stats->device_ns[dir] += completed - started;
+    // The bucket is the position of the highest bit of the latency, in
+    // microseconds, past the bound of the first one.
+    ktime_t latency = completed - queued;
+    div64_32(&latency, NSEC_PER_USEC);
+    unsigned bucket = 0;
+    for (latency >>= DISK_STAT_MIN_SHIFT; latency && (bucket < DISK_STAT_BUCKETS - 1); latency >>= 1) {
+        ++bucket;
+    }
+    ++stats->hist[dir][bucket];
+}
+
+void disk_stats_for_each(void (*fn)(disk_stats_t *stats, void *data), void *data)
+{
+    list_for_each_decl(it, &disk_stats_list)
+    {
+        fn(list_entry(it, disk_stats_t, list), data);
+    }
+}
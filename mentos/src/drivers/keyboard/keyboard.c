@@ -19,19 +19,32 @@
 #include "hardware/pic8259.h"
 #include "io/port_io.h"
 #include "io/video.h"
+#include "klib/irqflags.h"
 #include "process/scheduler.h"
+#include "process/wait.h"
 #include "ring_buffer.h"
 #include "string.h"
 #include "sys/bitops.h"
+#include "system/softirq.h"
 
 /// Tracks the state of the leds.
 static uint8_t ledstate = 0;
 /// The flags concerning the keyboard.
 static uint32_t kflags = 0;
-/// Where we store the keypress.
-fs_rb_scancode_t scancodes;
-/// Spinlock to protect access to the scancode buffer.
-spinlock_t scancodes_lock;
+/// @brief Decodes the scancodes queued by the interrupt handler.
+/// @param data unused.
+static void __keyboard_bottom_half(unsigned long data);
+
+/// The decoded characters, pushed by the bottom halves (the keyboard one, and
+/// the ones of the other console devices), which never run concurrently, and
+/// popped by the terminal.
+static spsc_rb_keyboard_t scancodes;
+/// The scancodes read by the interrupt handler, yet to be decoded.
+static spsc_rb_keyboard_t raw_scancodes;
+/// Decodes the scancodes, outside of the interrupt handler.
+static tasklet_t keyboard_tasklet = TASKLET_INIT(__keyboard_bottom_half, 0);
+/// The processes polling the keyboard.
+static wait_queue_head_t keyboard_wait;
 
 #define KBD_LEFT_SHIFT    (1 << 0) ///< Flag which identifies the left shift.
 #define KBD_RIGHT_SHIFT   (1 << 1) ///< Flag which identifies the right shift.
@@ -60,65 +73,50 @@ static inline int get_keypad_number(unsigned int scancode)
 
 static inline void keyboard_push_front(unsigned int c)
 {
-    spinlock_lock(&scancodes_lock);
-    fs_rb_scancode_push_front(&scancodes, (int)c);
-    spinlock_unlock(&scancodes_lock);
+    if (!spsc_rb_keyboard_push(&scancodes, (int)c)) {
+        pr_debug("The keyboard buffer is full, dropping %04x.\n", c);
+    }
 }
 
 int keyboard_pop_back(void)
 {
     int c;
-    spinlock_lock(&scancodes_lock);
-    if (!fs_rb_scancode_empty(&scancodes)) {
-        c = fs_rb_scancode_pop_back(&scancodes);
-    } else {
-        c = -1;
-    }
-    spinlock_unlock(&scancodes_lock);
-    return c;
+    return spsc_rb_keyboard_pop_bulk(&scancodes, &c, 1) ? c : -1;
+}
+
+unsigned keyboard_drain(int *buffer, unsigned count)
+{
+    return spsc_rb_keyboard_pop_bulk(&scancodes, buffer, count);
 }
 
 int keyboard_back(void)
 {
     int c;
-    spinlock_lock(&scancodes_lock);
-    if (!fs_rb_scancode_empty(&scancodes)) {
-        c = fs_rb_scancode_back(&scancodes);
-    } else {
-        c = -1;
-    }
-    spinlock_unlock(&scancodes_lock);
-    return c;
+    return spsc_rb_keyboard_peek(&scancodes, 0, &c) ? c : -1;
 }
 
-int keyboard_front(void)
+void keyboard_push_input(int c)
 {
-    int c = -1;
-    spinlock_lock(&scancodes_lock);
-    if (!fs_rb_scancode_empty(&scancodes)) {
-        c = fs_rb_scancode_front(&scancodes);
-    } else {
-        c = -1;
-    }
-    spinlock_unlock(&scancodes_lock);
-    return c;
+    keyboard_push_front((unsigned int)c);
+    wake_up(&keyboard_wait);
 }
 
-void keyboard_isr(pt_regs *f)
+wait_queue_head_t *keyboard_get_wait_queue(void)
 {
-    unsigned int scancode;
-    (void)f;
-
-    if (!(inportb(0x64U) & 1U)) {
-        return;
-    }
+    return &keyboard_wait;
+}
 
-    // Take scancode from the port.
-    scancode = ps2_read();
-    if (scancode == 0xE0) {
-        scancode = (scancode << 8U) | ps2_read();
-    }
+int keyboard_front(void)
+{
+    int c;
+    unsigned count = spsc_rb_keyboard_count(&scancodes);
+    return (count && spsc_rb_keyboard_peek(&scancodes, count - 1, &c)) ? c : -1;
+}
 
+/// @brief Decodes a scancode, and queues the resulting characters.
+/// @param scancode the scancode read from the keyboard.
+static void __keyboard_handle_scancode(unsigned int scancode)
+{
     // Get the keypad number, of num-lock is disabled. Otherwise, initialize to -1;
     int keypad_fun_number = !bitmask_check(kflags, KBD_NUM_LOCK) ? get_keypad_number(scancode) : -1;
 
@@ -240,6 +238,44 @@ void keyboard_isr(pt_regs *f)
             keyboard_push_front(keymap->normal);
         }
     }
+}
+
+static void __keyboard_bottom_half(unsigned long data)
+{
+    int batch[32];
+    unsigned count, decoded = 0;
+    (void)data;
+    // The interrupt handler pushes on the other side, without locks.
+    while ((count = spsc_rb_keyboard_pop_bulk(&raw_scancodes, batch, count_of(batch))) > 0) {
+        for (unsigned i = 0; i < count; ++i) {
+            __keyboard_handle_scancode((unsigned int)batch[i]);
+        }
+        decoded += count;
+    }
+    // There might be characters, now.
+    if (decoded) {
+        wake_up(&keyboard_wait);
+    }
+}
+
+void keyboard_isr(pt_regs *f)
+{
+    unsigned int scancode;
+    (void)f;
+
+    if (!(inportb(0x64U) & 1U)) {
+        return;
+    }
+
+    // Take scancode from the port.
+    scancode = ps2_read();
+    if (scancode == 0xE0) {
+        scancode = (scancode << 8U) | ps2_read();
+    }
+    // Decode it in the bottom half, only the read needs the interrupt.
+    spsc_rb_keyboard_push(&raw_scancodes, (int)scancode);
+    tasklet_schedule(&keyboard_tasklet);
+
     pic8259_send_eoi(IRQ_KEYBOARD);
 }
 
@@ -265,14 +301,19 @@ void keyboard_disable(void)
     outportb(0x60, 0xF5);
 }
 
-int keyboard_initialize(void)
+void keyboard_initialize_buffers(void)
 {
-    // Initialize the ring-buffer for the scancodes.
-    fs_rb_scancode_init(&scancodes);
-    // Initialize the spinlock.
-    spinlock_init(&scancodes_lock);
+    // Initialize the ring-buffers for the scancodes.
+    spsc_rb_keyboard_init(&scancodes);
+    spsc_rb_keyboard_init(&raw_scancodes);
+    // Initialize the queue of the pollers.
+    init_waitqueue_head(&keyboard_wait);
     // Initialize the keymaps.
     init_keymaps();
+}
+
+int keyboard_initialize(void)
+{
     // Install the IRQ.
     irq_install_handler(IRQ_KEYBOARD, keyboard_isr, "keyboard");
     // Enable the IRQ.
@@ -2,6 +2,13 @@
 /// @brief Memory devices.
 /// @copyright (c) 2024 This file is distributed under the MIT License.
 /// See LICENSE.md for details.
+/// @details
+/// The devices which are not backed by any hardware: /dev/null swallows what
+/// is written and reads as empty, /dev/zero reads as an endless sequence of
+/// zeros and maps as anonymous memory, /dev/full reads like /dev/zero and
+/// refuses every write, /dev/urandom reads as the output of a ChaCha20
+/// generator, seeded with the random number generator of the CPU, or the
+/// Time Stamp Counter when there is none.
 
 // Include the kernel log levels.
 #include "sys/kernel_levels.h"
@@ -12,33 +19,67 @@
 
 #include "assert.h"
 #include "drivers/mem.h"
-#include "io/debug.h"
 #include "fs/vfs.h"
+#include "hardware/cpuid.h"
+#include "hardware/hrtimer.h"
+#include "io/debug.h"
+#include "klib/spinlock.h"
+#include "math.h"
+#include "mem/kheap.h"
+#include "mem/paging.h"
 #include "string.h"
+#include "sys/dirent.h"
 #include "sys/errno.h"
 #include "system/syscall.h"
 
-struct memdev;
+/// The number of 32-bit words of the state of ChaCha20.
+#define CHACHA_STATE_WORDS 16
+/// The size of a block produced by ChaCha20.
+#define CHACHA_BLOCK_SIZE (CHACHA_STATE_WORDS * sizeof(uint32_t))
+/// The number of 32-bit words of the key of ChaCha20.
+#define CHACHA_KEY_WORDS 8
+/// Times we try RDRAND before giving up on a word, as suggested by Intel.
+#define RDRAND_RETRIES 10
 
+/// @brief A memory device.
 struct memdev {
+    /// The file of the device.
     vfs_file_t *file;
+    /// The next device.
     struct memdev *next;
 };
 
+/// The list of the memory devices.
 static struct memdev *devices;
 
-static void add_device(struct memdev *device) {
-    struct memdev *dit = devices;
-    for (;dit != NULL; dit = dit->next);
-    if (dit == NULL) {
-        devices = device;
-    } else {
-        dit->next = device;
+/// @brief The generator of /dev/urandom.
+static struct {
+    /// The key, replaced after every use so that the output already given
+    /// cannot be reconstructed (fast key erasure).
+    uint32_t key[CHACHA_KEY_WORDS];
+    /// The counter of the blocks produced with the key.
+    unsigned long long counter;
+    /// Protects the generator.
+    spinlock_t lock;
+} crng;
+
+/// @brief Adds a device to the list.
+/// @param device the device.
+static void add_device(struct memdev *device)
+{
+    struct memdev **dit = &devices;
+    while (*dit != NULL) {
+        dit = &(*dit)->next;
     }
+    *dit = device;
 }
 
-static vfs_file_t* find_device_file(const char *path) {
-    for(struct memdev *dev = devices; dev != NULL; dev = dev->next) {
+/// @brief Searches a device by its path.
+/// @param path the path of the device.
+/// @return the file of the device, NULL if there is none.
+static vfs_file_t *find_device_file(const char *path)
+{
+    for (struct memdev *dev = devices; dev != NULL; dev = dev->next) {
         if (strcmp(dev->file->name, path) == 0) {
             return dev->file;
         }
@@ -46,63 +87,142 @@ static vfs_file_t* find_device_file(const char *path) {
     return NULL;
 }
 
-static int mem_stat(const char* path, stat_t *stat);
+// == CHACHA20 ================================================================
 
-static vfs_sys_operations_t mem_sys_operations = {
-    .mkdir_f = NULL,
-    .rmdir_f = NULL,
-    .stat_f  = mem_stat,
-};
+/// @brief Rotates a word to the left.
+/// @param value the word.
+/// @param shift the number of bits.
+/// @return the rotated word.
+static inline uint32_t __rotl32(uint32_t value, unsigned shift)
+{
+    return (value << shift) | (value >> (32 - shift));
+}
 
-static vfs_file_t *null_open(const char *path, int flags, mode_t mode);
-static int null_close(vfs_file_t * file);
-static ssize_t null_write(vfs_file_t * file, const void *buffer, off_t offset, size_t size);
-static ssize_t null_read(vfs_file_t * file, char *buffer, off_t offset, size_t size);
-static int null_fstat(vfs_file_t * file, stat_t *stat);
+/// @brief The quarter round of ChaCha20, on four words of the state.
+#define CHACHA_QUARTER_ROUND(x, a, b, c, d)             \
+    do {                                                \
+        x[a] += x[b], x[d] = __rotl32(x[d] ^ x[a], 16); \
+        x[c] += x[d], x[b] = __rotl32(x[b] ^ x[c], 12); \
+        x[a] += x[b], x[d] = __rotl32(x[d] ^ x[a], 8);  \
+        x[c] += x[d], x[b] = __rotl32(x[b] ^ x[c], 7);  \
+    } while (0)
 
-static vfs_file_operations_t null_fs_operations = {
-    .open_f     = null_open,
-    .unlink_f   = NULL,
-    .close_f    = null_close,
-    .read_f     = null_read,
-    .write_f    = null_write,
-    .lseek_f    = NULL,
-    .stat_f     = null_fstat,
-    .ioctl_f    = NULL,
-    .getdents_f = NULL
-};
+/// @brief Produces a block of ChaCha20.
+/// @param key the key.
+/// @param counter the counter of the block.
+/// @param nonce the nonce.
+/// @param block where the block is stored.
+static void __chacha20_block(const uint32_t key[CHACHA_KEY_WORDS], unsigned long long counter, unsigned long long nonce, uint32_t block[CHACHA_STATE_WORDS])
+{
+    uint32_t state[CHACHA_STATE_WORDS] = {
+        // "expand 32-byte k".
+        0x61707865, 0x3320646e, 0x79622d32, 0x6b206574,
+        key[0], key[1], key[2], key[3], key[4], key[5], key[6], key[7],
+        (uint32_t)counter, (uint32_t)(counter >> 32), (uint32_t)nonce, (uint32_t)(nonce >> 32)
+    };
+    memcpy(block, state, sizeof(state));
+    for (int round = 0; round < 20; round += 2) {
+        // The columns.
+        CHACHA_QUARTER_ROUND(block, 0, 4, 8, 12);
+        CHACHA_QUARTER_ROUND(block, 1, 5, 9, 13);
+        CHACHA_QUARTER_ROUND(block, 2, 6, 10, 14);
+        CHACHA_QUARTER_ROUND(block, 3, 7, 11, 15);
+        // The diagonals.
+        CHACHA_QUARTER_ROUND(block, 0, 5, 10, 15);
+        CHACHA_QUARTER_ROUND(block, 1, 6, 11, 12);
+        CHACHA_QUARTER_ROUND(block, 2, 7, 8, 13);
+        CHACHA_QUARTER_ROUND(block, 3, 4, 9, 14);
+    }
+    for (int i = 0; i < CHACHA_STATE_WORDS; ++i) {
+        block[i] += state[i];
+    }
+}
 
-static struct memdev *null_device_create(const char* name) {
-    // Create the device.
-    struct memdev *dev = kmalloc(sizeof(struct memdev));
-    dev->next = NULL;
+/// @brief Reads a word from the random number generator of the CPU.
+/// @param value where the word is stored.
+/// @return 1 on success, 0 if the generator did not answer.
+static inline int __rdrand32(uint32_t *value)
+{
+    unsigned char ok;
+    for (int i = 0; i < RDRAND_RETRIES; ++i) {
+        __asm__ __volatile__("rdrand %0; setc %1" : "=r"(*value), "=qm"(ok));
+        if (ok) {
+            return 1;
+        }
+    }
+    return 0;
+}
 
-    // Create the file.
-    vfs_file_t *file = kmem_cache_alloc(vfs_file_cache, GFP_KERNEL);
-    if (file == NULL) {
-        pr_err("Failed to create null device.\n");
-        return NULL;
+/// @brief Mixes new material into the key of the generator, and draws a
+/// new key from it.
+/// @param words the material.
+/// @param count the number of words.
+/// @details It must be called with the generator locked.
+static void __crng_mix(const uint32_t *words, size_t count)
+{
+    uint32_t block[CHACHA_STATE_WORDS];
+    for (size_t i = 0; i < count; ++i) {
+        crng.key[i % CHACHA_KEY_WORDS] ^= words[i];
+        if (((i + 1) % CHACHA_KEY_WORDS) == 0) {
+            __chacha20_block(crng.key, crng.counter++, 0, block);
+            memcpy(crng.key, block, sizeof(crng.key));
+        }
     }
-    dev->file = file;
+    __chacha20_block(crng.key, crng.counter++, 0, block);
+    memcpy(crng.key, block, sizeof(crng.key));
+    memset(block, 0, sizeof(block));
+}
 
-    // Set the device name.
-    strncpy(file->name, name, NAME_MAX);
-    file->count = 0;
-    file->uid = 0;
-    file->gid = 0;
-    file->mask = 0x2000 | 0666;
-    file->atime = sys_time(NULL);
-    file->mtime = sys_time(NULL);
-    file->ctime = sys_time(NULL);
-    file->length = 0;
-    // Set the operations.
-    file->sys_operations = &mem_sys_operations;
-    file->fs_operations  = &null_fs_operations;
-    return dev;
+/// @brief Seeds the generator.
+static void __crng_seed(void)
+{
+    uint32_t seed[CHACHA_KEY_WORDS * 2];
+    int rdrand = cpuid_has_rdrand();
+    for (size_t i = 0; i < count_of(seed); ++i) {
+        // Without RDRAND, the low bits of the TSC jitter between reads.
+        ktime_t tsc = hrtimer_tsc_available() ? rdtsc() : hrtimer_get_time();
+        seed[i]     = (uint32_t)tsc ^ __rotl32((uint32_t)(tsc >> 32), 16);
+        if (rdrand && !__rdrand32(&seed[i])) {
+            rdrand = 0;
+        }
+    }
+    seed[0] ^= (uint32_t)sys_time(NULL);
+    __crng_mix(seed, count_of(seed));
+    memset(seed, 0, sizeof(seed));
+    pr_debug("Seeded the random number generator%s.\n", rdrand ? " with RDRAND" : "");
+}
+
+void get_random_bytes(void *buffer, size_t size)
+{
+    uint32_t block[CHACHA_STATE_WORDS];
+    uint8_t *position = (uint8_t *)buffer;
+    // The TSC makes the output of two equal states differ.
+    ktime_t nonce  = hrtimer_tsc_available() ? rdtsc() : hrtimer_get_time();
+    uint8_t flags  = spinlock_lock_irqsave(&crng.lock);
+    while (size > 0) {
+        size_t chunk = min(size, CHACHA_BLOCK_SIZE);
+        __chacha20_block(crng.key, crng.counter++, nonce, block);
+        memcpy(position, block, chunk);
+        position += chunk;
+        size -= chunk;
+    }
+    // Replace the key, the blocks given away cannot be produced again.
+    __chacha20_block(crng.key, crng.counter++, nonce, block);
+    memcpy(crng.key, block, sizeof(crng.key));
+    spinlock_unlock_irqrestore(&crng.lock, flags);
+    memset(block, 0, sizeof(block));
 }
 
-static vfs_file_t* null_open(const char *path, int flags, mode_t mode) {
-    vfs_file_t* file = find_device_file(path);
+// == VFS CALLBACKS ===========================================================
+
+/// @brief Opens a memory device.
+/// @param path the path of the device.
+/// @param flags ignored.
+/// @param mode ignored.
+/// @return the file of the device, NULL if there is none.
+static vfs_file_t *mem_open(const char *path, int flags, mode_t mode)
+{
+    vfs_file_t *file = find_device_file(path);
     if (file) {
         file->count++;
     }
@@ -110,23 +230,23 @@ static vfs_file_t* null_open(const char *path, int flags, mode_t mode) {
     return file;
 }
 
-static int null_close(vfs_file_t * file) {
+/// @brief Closes a memory device.
+/// @param file the file of the device.
+/// @return 0.
+static int mem_close(vfs_file_t *file)
+{
     assert(file && "Received null file.");
     file->count--;
     return 0;
 }
 
-static ssize_t null_write(vfs_file_t * file, const void *buffer, off_t offset, size_t size) {
-    return size;
-}
-
-static ssize_t null_read(vfs_file_t * file, char *buffer, off_t offset, size_t size) {
-    return 0;
-}
-
-static int null_fstat(vfs_file_t * file, stat_t *stat)
+/// @brief Retrieves the information of a memory device.
+/// @param file the file of the device.
+/// @param stat where the information is stored.
+/// @return 0.
+static int mem_fstat(vfs_file_t *file, stat_t *stat)
 {
-    pr_debug("null_fstat(%s, %p)\n", file->name, stat);
+    pr_debug("mem_fstat(%s, %p)\n", file->name, stat);
     stat->st_dev   = 0;
     stat->st_ino   = 0;
     stat->st_mode  = file->mask;
@@ -139,29 +259,227 @@ static int null_fstat(vfs_file_t * file, stat_t *stat)
     return 0;
 }
 
-static int mem_stat(const char *path, stat_t *stat) {
-    vfs_file_t* file = find_device_file(path);
-
+/// @brief Retrieves the information of a memory device, by its path.
+/// @param path the path of the device.
+/// @param stat where the information is stored.
+/// @return 0 on success, -ENOENT if there is no such device.
+static int mem_stat(const char *path, stat_t *stat)
+{
+    vfs_file_t *file = find_device_file(path);
     if (file) {
         return file->fs_operations->stat_f(file, stat);
     }
     return -ENOENT;
 }
 
-int mem_devs_initialize(void)
+/// @brief Swallows what is written.
+/// @param file the file of the device.
+/// @param buffer the data.
+/// @param offset ignored.
+/// @param size the size of the data.
+/// @return the size of the data.
+static ssize_t null_write(vfs_file_t *file, const void *buffer, off_t offset, size_t size)
+{
+    return size;
+}
+
+/// @brief Reads the end of file.
+/// @param file the file of the device.
+/// @param buffer ignored.
+/// @param offset ignored.
+/// @param size ignored.
+/// @return 0.
+static ssize_t null_read(vfs_file_t *file, char *buffer, off_t offset, size_t size)
+{
+    return 0;
+}
+
+/// @brief Reads zeros.
+/// @param file the file of the device.
+/// @param buffer where the zeros are stored.
+/// @param offset ignored.
+/// @param size the number of zeros.
+/// @return the number of zeros.
+/// @details memset stores whole words, with `rep stosl`, once aligned.
+static ssize_t zero_read(vfs_file_t *file, char *buffer, off_t offset, size_t size)
+{
+    memset(buffer, 0, size);
+    return size;
+}
+
+/// @brief Maps the device, with anonymous memory.
+/// @param file the file of the device.
+/// @param area the area, whose pages are allocated and zeroed on demand.
+/// @return 0.
+/// @details Both shared and private mappings are left to the anonymous
+/// memory of the process, the file is not even referenced.
+static int zero_mmap(vfs_file_t *file, vm_area_struct_t *area)
+{
+    return 0;
+}
+
+/// @brief Refuses every write.
+/// @param file the file of the device.
+/// @param buffer ignored.
+/// @param offset ignored.
+/// @param size ignored.
+/// @return -ENOSPC.
+static ssize_t full_write(vfs_file_t *file, const void *buffer, off_t offset, size_t size)
+{
+    return -ENOSPC;
+}
+
+/// @brief Reads random bytes.
+/// @param file the file of the device.
+/// @param buffer where the bytes are stored.
+/// @param offset ignored.
+/// @param size the number of bytes.
+/// @return the number of bytes.
+static ssize_t urandom_read(vfs_file_t *file, char *buffer, off_t offset, size_t size)
+{
+    get_random_bytes(buffer, size);
+    return size;
+}
+
+/// @brief Mixes what is written into the generator, without trusting it.
+/// @param file the file of the device.
+/// @param buffer the data.
+/// @param offset ignored.
+/// @param size the size of the data.
+/// @return the size of the data.
+static ssize_t urandom_write(vfs_file_t *file, const void *buffer, off_t offset, size_t size)
 {
-    struct memdev *devnull = null_device_create("/dev/null");
-    if (!devnull) {
-        pr_err("Failed to create devnull");
+    uint32_t words[CHACHA_KEY_WORDS];
+    const uint8_t *position = (const uint8_t *)buffer;
+    for (size_t left = size; left > 0;) {
+        size_t chunk = min(left, sizeof(words));
+        memset(words, 0, sizeof(words));
+        memcpy(words, position, chunk);
+        uint8_t flags = spinlock_lock_irqsave(&crng.lock);
+        __crng_mix(words, count_of(words));
+        spinlock_unlock_irqrestore(&crng.lock, flags);
+        position += chunk;
+        left -= chunk;
+    }
+    return size;
+}
+
+/// Memory devices general operations.
+static vfs_sys_operations_t mem_sys_operations = {
+    .mkdir_f = NULL,
+    .rmdir_f = NULL,
+    .stat_f  = mem_stat,
+};
+
+/// Operations of /dev/null.
+static vfs_file_operations_t null_fs_operations = {
+    .open_f     = mem_open,
+    .unlink_f   = NULL,
+    .close_f    = mem_close,
+    .read_f     = null_read,
+    .write_f    = null_write,
+    .lseek_f    = NULL,
+    .stat_f     = mem_fstat,
+    .ioctl_f    = NULL,
+    .getdents_f = NULL,
+};
+
+/// Operations of /dev/zero.
+static vfs_file_operations_t zero_fs_operations = {
+    .open_f     = mem_open,
+    .unlink_f   = NULL,
+    .close_f    = mem_close,
+    .read_f     = zero_read,
+    .write_f    = null_write,
+    .lseek_f    = NULL,
+    .stat_f     = mem_fstat,
+    .ioctl_f    = NULL,
+    .getdents_f = NULL,
+    .mmap_f     = zero_mmap,
+};
+
+/// Operations of /dev/full.
+static vfs_file_operations_t full_fs_operations = {
+    .open_f     = mem_open,
+    .unlink_f   = NULL,
+    .close_f    = mem_close,
+    .read_f     = zero_read,
+    .write_f    = full_write,
+    .lseek_f    = NULL,
+    .stat_f     = mem_fstat,
+    .ioctl_f    = NULL,
+    .getdents_f = NULL,
+};
+
+/// Operations of /dev/urandom.
+static vfs_file_operations_t urandom_fs_operations = {
+    .open_f     = mem_open,
+    .unlink_f   = NULL,
+    .close_f    = mem_close,
+    .read_f     = urandom_read,
+    .write_f    = urandom_write,
+    .lseek_f    = NULL,
+    .stat_f     = mem_fstat,
+    .ioctl_f    = NULL,
+    .getdents_f = NULL,
+};
+
+// == INITIALIZATION ==========================================================
+
+/// @brief Creates a memory device, and mounts it.
+/// @param name the path of the device.
+/// @param fs_operations the operations of the device.
+/// @return 0 on success, -errno on failure.
+static int memdev_create(const char *name, vfs_file_operations_t *fs_operations)
+{
+    // Create the device.
+    struct memdev *dev = kmalloc(sizeof(struct memdev));
+    if (dev == NULL) {
+        pr_err("Failed to create %s.\n", name);
+        return -ENOMEM;
+    }
+    dev->next = NULL;
+    // Create the file.
+    vfs_file_t *file = kmem_cache_alloc(vfs_file_cache, GFP_KERNEL);
+    if (file == NULL) {
+        pr_err("Failed to create %s.\n", name);
+        kfree(dev);
+        return -ENOMEM;
+    }
+    dev->file = file;
+    // Set the device name.
+    strncpy(file->name, name, NAME_MAX);
+    file->count  = 0;
+    file->uid    = 0;
+    file->gid    = 0;
+    file->flags  = DT_CHR;
+    file->mask   = 0x2000 | 0666;
+    file->atime  = sys_time(NULL);
+    file->mtime  = sys_time(NULL);
+    file->ctime  = sys_time(NULL);
+    file->length = 0;
+    // Set the operations.
+    file->sys_operations = &mem_sys_operations;
+    file->fs_operations  = fs_operations;
+    if (!vfs_mount(name, file)) {
+        pr_err("Failed to mount %s.\n", name);
+        kmem_cache_free(file);
+        kfree(dev);
         return -ENODEV;
     }
-    
-    if (!vfs_mount("/dev/null", devnull->file)) {
-        pr_err("Failed to mount /dev/null");
+    add_device(dev);
+    return 0;
+}
+
+int mem_devs_initialize(void)
+{
+    spinlock_init(&crng.lock);
+    __crng_seed();
+    if (memdev_create("/dev/null", &null_fs_operations) ||
+        memdev_create("/dev/zero", &zero_fs_operations) ||
+        memdev_create("/dev/full", &full_fs_operations) ||
+        memdev_create("/dev/urandom", &urandom_fs_operations)) {
         return 1;
     }
-
-    add_device(devnull);
-
     return 0;
 }
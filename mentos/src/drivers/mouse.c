@@ -1,7 +1,7 @@
 /// @file mouse.c
 /// @brief  Driver for *PS2* Mouses.
 /// @copyright (c) 2014-2024 This file is distributed under the MIT License.
-/// See LICENSE.md for details.is distributed under the MIT License.
+/// See LICENSE.md for details.
 /// @addtogroup mouse
 /// @{
 
@@ -13,8 +13,22 @@
 
 #include "descriptor_tables/isr.h"
 #include "drivers/mouse.h"
+#include "fcntl.h"
+#include "fs/poll.h"
+#include "fs/vfs.h"
+#include "hardware/hrtimer.h"
 #include "hardware/pic8259.h"
 #include "io/port_io.h"
+#include "klib/irqflags.h"
+#include "poll.h"
+#include "process/scheduler.h"
+#include "ring_buffer.h"
+#include "string.h"
+#include "sys/bitops.h"
+#include "sys/errno.h"
+#include "sys/mouse.h"
+#include "system/softirq.h"
+#include "system/syscall.h"
 
 /// The mouse starts sending automatic packets.
 #define MOUSE_ENABLE_PACKET 0xF4
@@ -22,15 +36,36 @@
 #define MOUSE_DISABLE_PACKET 0xF5
 /// Disables streaming, sets the packet rate to 100 per second, and resolution to 4 pixels per mm.
 #define MOUSE_USE_DEFAULT_SETTINGS 0xF6
+/// The number of events, closed by a change of the buttons, kept until read.
+#define MOUSE_EVENTS 64
+
+DECLARE_SPSC_RING_BUFFER(uint32_t, mouse_packet, 64)
 
 /// Mouse ISR cycle.
 static uint8_t mouse_cycle = 0;
 /// Mouse communication data.
-static int8_t mouse_bytes[3];
-/// Mouse x position.
-static int32_t mouse_x = (800 / 2);
-/// Mouse y position.
-static int32_t mouse_y = (600 / 2);
+static uint8_t mouse_bytes[3];
+/// The complete packets, packed in an integer, decoded by the bottom half.
+static spsc_rb_mouse_packet_t mouse_packets;
+
+/// @brief The events waiting to be read.
+static struct {
+    /// The events closed by a change of the buttons.
+    mouse_event_t events[MOUSE_EVENTS];
+    /// The oldest event.
+    unsigned read;
+    /// The number of events.
+    unsigned count;
+    /// The event summing up the motion, with the buttons currently held.
+    mouse_event_t pending;
+    /// Set when the pending event has something to report.
+    bool_t pending_ready;
+    /// The readers waiting for events.
+    wait_queue_head_t wait;
+} mouse_queue;
+
+/// The device of the mouse.
+static vfs_file_t *mouse_device = NULL;
 
 /// @brief      Mouse wait for a command.
 /// @param type 1 for sending - 0 for receiving.
@@ -68,82 +103,236 @@ static unsigned char __mouse_read(void)
     return inportb(0x60);
 }
 
+/// @brief Checks if there are events to read.
+/// @return true if a read would not sleep.
+static inline bool_t __mouse_ready(void)
+{
+    return mouse_queue.count || mouse_queue.pending_ready;
+}
+
+/// @brief Closes the pending event, because the buttons changed.
+static inline void __mouse_close_pending(void)
+{
+    // Without space, the oldest event is lost rather than the newest.
+    if (mouse_queue.count == MOUSE_EVENTS) {
+        mouse_queue.read = (mouse_queue.read + 1) % MOUSE_EVENTS;
+        --mouse_queue.count;
+    }
+    mouse_queue.events[(mouse_queue.read + mouse_queue.count) % MOUSE_EVENTS] = mouse_queue.pending;
+    ++mouse_queue.count;
+}
+
+/// @brief Merges a packet inside the pending event.
+/// @param packet the three bytes of the packet.
+static void __mouse_handle_packet(uint32_t packet)
+{
+    uint8_t flags = packet & 0xFFU;
+    int32_t dx    = (packet >> 8U) & 0xFFU;
+    int32_t dy    = (packet >> 16U) & 0xFFU;
+    // Bits 4 and 5 are the signs of the deltas, 6 and 7 tell they overflowed.
+    if (flags & 0x10U) {
+        dx -= 0x100;
+    }
+    if (flags & 0x20U) {
+        dy -= 0x100;
+    }
+    if (flags & 0xC0U) {
+        dx = dy = 0;
+    }
+    uint32_t buttons = flags & (MOUSE_BUTTON_LEFT | MOUSE_BUTTON_RIGHT | MOUSE_BUTTON_MIDDLE);
+    if (buttons != mouse_queue.pending.buttons) {
+        if (mouse_queue.pending_ready) {
+            __mouse_close_pending();
+        }
+        mouse_queue.pending.dx      = 0;
+        mouse_queue.pending.dy      = 0;
+        mouse_queue.pending.buttons = buttons;
+    }
+    ktime_t now = hrtimer_get_time();
+    div64_32(&now, 1000000U);
+    mouse_queue.pending.dx += dx;
+    mouse_queue.pending.dy += dy;
+    mouse_queue.pending.time  = (uint32_t)now;
+    mouse_queue.pending_ready = true;
+}
+
+/// @brief Merges the packets received by the interrupt handler into the events.
+/// @param data unused.
+static void __mouse_bottom_half(unsigned long data)
+{
+    uint32_t packets[16];
+    unsigned count;
+    (void)data;
+    bool_t was_ready = __mouse_ready();
+    while ((count = spsc_rb_mouse_packet_pop_bulk(&mouse_packets, packets, count_of(packets))) > 0) {
+        for (unsigned i = 0; i < count; ++i) {
+            __mouse_handle_packet(packets[i]);
+        }
+    }
+    // The readers are woken up once, not for every packet.
+    if (!was_ready && __mouse_ready()) {
+        wake_up(&mouse_queue.wait);
+    }
+}
+
+/// Decodes the packets, outside of the interrupt handler.
+static tasklet_t mouse_tasklet = TASKLET_INIT(__mouse_bottom_half, 0);
+
 /// @brief The interrupt service routine of the mouse.
 /// @param f The interrupt stack frame.
 static void __mouse_isr(pt_regs *f)
 {
     (void)f;
     // Get the input bytes.
-    mouse_bytes[mouse_cycle++] = (char)inportb(0x60);
+    mouse_bytes[mouse_cycle] = inportb(0x60);
+    // The first byte always has bit 3 set, wait for it to get in sync again.
+    if ((mouse_cycle > 0) || (mouse_bytes[0] & 0x08U)) {
+        ++mouse_cycle;
+    }
     if (mouse_cycle == 3) {
         // Reset the mouse cycle.
         mouse_cycle = 0;
-        // ----------------------------
-        // Get the X coordinates.
-        // ----------------------------
-        if ((mouse_bytes[0] & 0x40) == 0) {
-            // Bit number 4 of the first byte (value 0x10) indicates that
-            // delta X (the 2nd byte) is a negative number, if it is set.
-            if ((mouse_bytes[0] & 0x10) == 0) {
-                mouse_x -= mouse_bytes[1];
-            } else {
-                mouse_x += mouse_bytes[1];
-            }
-        } else {
-            // Overflow.
-            mouse_x += mouse_bytes[1] / 2;
-        }
-        // ----------------------------
-        // Get the Y coordinates.
-        // ----------------------------
-        if ((mouse_bytes[0] & 0x80) == 0) {
-            // Bit number 5 of the first byte (value 0x20) indicates that
-            // delta Y (the 3rd byte) is a negative number, if it is set.
-            if ((mouse_bytes[0] & 0x20) == 0) {
-                mouse_y -= mouse_bytes[2];
-            } else {
-                mouse_y += mouse_bytes[2];
-            }
-        } else {
-            // Overflow.
-            mouse_y -= mouse_bytes[2] / 2;
-        }
-        // ----------------------------
-        // Apply cursor constraint (800x600).
-        // ----------------------------
-        if (mouse_x <= 0) {
-            mouse_x = 0;
-        } else if (mouse_x >= (800 - 16)) {
-            mouse_x = 800 - 16;
-        }
-        if (mouse_y <= 0) {
-            mouse_y = 0;
-        } else if (mouse_y >= (600 - 24)) {
-            mouse_y = 600 - 24;
-        }
-        // Print the position.
-        // pr_default("\rX: %d | Y: %d\n", mouse_x, mouse_y);
-
-        // Move the cursor.
-        // video_set_cursor(mouse_x, mouse_y);
-
-        // Here a problem is detected, if the mouse moves
-        // Pressed keys are detected.
-        // Detecting keystrokes.
-        // Center pressed.
-        if ((mouse_bytes[0] & 0x04) == 0) {
-            // pr_default(LNG_MOUSE_MID);
-        }
-        // Right pressed.
-        if ((mouse_bytes[0] & 0x02) == 0) {
-            // pr_default(LNG_MOUSE_RIGHT);
+        // Decode the packet in the bottom half.
+        spsc_rb_mouse_packet_push(&mouse_packets, mouse_bytes[0] | (mouse_bytes[1] << 8U) | (mouse_bytes[2] << 16U));
+        tasklet_schedule(&mouse_tasklet);
+    }
+    pic8259_send_eoi(IRQ_MOUSE);
+}
+
+// == VFS CALLBACKS ===========================================================
+
+/// @brief Opens the mouse device.
+/// @param path the path of the device.
+/// @param flags we ignore these.
+/// @param mode we ignore this.
+/// @return the VFS file of the device.
+static vfs_file_t *mouse_open(const char *path, int flags, mode_t mode)
+{
+    if (mouse_device && !strcmp(path, MOUSE_DEVICE)) {
+        ++mouse_device->count;
+        return mouse_device;
+    }
+    return NULL;
+}
+
+/// @brief Closes the mouse device.
+/// @param file the VFS file of the device.
+/// @return 0 on success.
+static int mouse_close(vfs_file_t *file)
+{
+    --file->count;
+    return 0;
+}
+
+/// @brief Returns the events ready on the mouse device.
+/// @param file the VFS file of the device.
+/// @param table the table of the polling process, NULL if it does not sleep.
+/// @return POLLIN if there are events.
+static unsigned int mouse_poll(vfs_file_t *file, struct poll_table_t *table)
+{
+    poll_wait(file, &mouse_queue.wait, table);
+    return __mouse_ready() ? (POLLIN | POLLRDNORM) : 0;
+}
+
+/// @brief Reads the events, sleeping until there is one.
+/// @param file the VFS file of the device.
+/// @param buffer the buffer where the events are stored.
+/// @param offset ignored.
+/// @param size the size of the buffer, at least one event.
+/// @return the size of the events read, -ERESTARTSYS if the process sleeps,
+/// -errno on failure.
+static ssize_t mouse_read(vfs_file_t *file, char *buffer, off_t offset, size_t size)
+{
+    if (size < sizeof(mouse_event_t)) {
+        return -EINVAL;
+    }
+    if (!__mouse_ready()) {
+        if (bitmask_check(file->open_flags, O_NONBLOCK)) {
+            return -EAGAIN;
         }
-        // Left pressed.
-        if ((mouse_bytes[0] & 0x01) == 0) {
-            // pr_default(LNG_MOUSE_LEFT);
+        int ret = do_poll_file(file, POLLIN, -1);
+        if (ret < 0) {
+            return ret;
         }
     }
-    pic8259_send_eoi(IRQ_MOUSE);
+    // We might have slept, leave the queue of the device.
+    poll_release(scheduler_get_current_process());
+    mouse_event_t *events = (mouse_event_t *)buffer;
+    size_t max = size / sizeof(mouse_event_t), count = 0;
+    // The bottom half adds the packets on the other side.
+    uint8_t flags = irq_disable();
+    while ((count < max) && mouse_queue.count) {
+        events[count++]  = mouse_queue.events[mouse_queue.read];
+        mouse_queue.read = (mouse_queue.read + 1) % MOUSE_EVENTS;
+        --mouse_queue.count;
+    }
+    if ((count < max) && mouse_queue.pending_ready) {
+        events[count++]           = mouse_queue.pending;
+        mouse_queue.pending.dx    = 0;
+        mouse_queue.pending.dy    = 0;
+        mouse_queue.pending_ready = false;
+    }
+    irq_enable(flags);
+    return count * sizeof(mouse_event_t);
+}
+
+/// @brief Retrieves information concerning the mouse device.
+/// @param file the VFS file of the device.
+/// @param stat the structure where the information are stored.
+/// @return 0 on success.
+static int mouse_fstat(vfs_file_t *file, stat_t *stat)
+{
+    memset(stat, 0, sizeof(stat_t));
+    stat->st_mode  = 0444;
+    stat->st_mtime = sys_time(NULL);
+    return 0;
+}
+
+/// Filesystem general operations.
+static vfs_sys_operations_t mouse_sys_operations = {
+    .mkdir_f   = NULL,
+    .rmdir_f   = NULL,
+    .stat_f    = NULL,
+    .creat_f   = NULL,
+    .symlink_f = NULL,
+};
+
+/// Mouse device file operations.
+static vfs_file_operations_t mouse_fs_operations = {
+    .open_f     = mouse_open,
+    .unlink_f   = NULL,
+    .close_f    = mouse_close,
+    .read_f     = mouse_read,
+    .write_f    = NULL,
+    .lseek_f    = NULL,
+    .stat_f     = mouse_fstat,
+    .ioctl_f    = NULL,
+    .getdents_f = NULL,
+    .readlink_f = NULL,
+    .poll_f     = mouse_poll,
+};
+
+/// @brief Creates and mounts the mouse device.
+/// @return 0 on success, 1 on failure.
+static int __mouse_device_create(void)
+{
+    vfs_file_t *file = kmem_cache_alloc(vfs_file_cache, GFP_KERNEL);
+    if (file == NULL) {
+        pr_err("Failed to create the mouse device.\n");
+        return 1;
+    }
+    memset(file, 0, sizeof(vfs_file_t));
+    strcpy(file->name, "mouse");
+    file->flags          = DT_CHR;
+    file->sys_operations = &mouse_sys_operations;
+    file->fs_operations  = &mouse_fs_operations;
+    if (!vfs_mount(MOUSE_DEVICE, file)) {
+        pr_alert("Failed to mount %s!\n", MOUSE_DEVICE);
+        kmem_cache_free(file);
+        return 1;
+    }
+    mouse_device = file;
+    return 0;
 }
 
 /// @brief Enable the mouse driver.
@@ -170,6 +359,13 @@ static void __mouse_disable(void)
 
 int mouse_initialize(void)
 {
+    spsc_rb_mouse_packet_init(&mouse_packets);
+    memset(&mouse_queue, 0, sizeof(mouse_queue));
+    init_waitqueue_head(&mouse_queue.wait);
+    if (__mouse_device_create()) {
+        return 1;
+    }
+
     // Enable the auxiliary mouse device.
     __mouse_waitcmd(1);
     outportb(0x64, 0xA8);
@@ -0,0 +1,272 @@
+/// @file ramdisk.c
+/// @brief Block devices backed by memory.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// Each disk is a sparse array of pages taken from the zone allocator when a
+/// block is first written; the blocks never written read back as zeros. The
+/// disks can hold an EXT2 image, written through the device and then mounted.
+/// @addtogroup ramdisk
+/// @{
+
+// Setup the logging for this file (do this before any other include).
+#include "sys/kernel_levels.h"           // Include kernel log levels.
+#define __DEBUG_HEADER__ "[RAMDSK]"      ///< Change header.
+#define __DEBUG_LEVEL__  LOGLEVEL_NOTICE ///< Set log level.
+#include "io/debug.h"                    // Include debugging functions.
+
+#include "drivers/ramdisk.h"
+
+#include "fs/buffer_cache.h"
+#include "fs/vfs.h"
+#include "math.h"
+#include "mem/kheap.h"
+#include "mem/zone_allocator.h"
+#include "stdio.h"
+#include "string.h"
+#include "sys/errno.h"
+#include "system/panic.h"
+#include "system/syscall.h"
+
+#define RAMDISK_COUNT 4                                 ///< Number of RAM disks.
+#define RAMDISK_SIZE  (16U * 1024U * 1024U)             ///< Size of each RAM disk.
+#define RAMDISK_PAGES (RAMDISK_SIZE / PAGE_SIZE)        ///< Pages of each RAM disk.
+
+/// @brief A RAM disk.
+typedef struct ramdisk_t {
+    /// The pages of the disk, NULL where nothing was written yet.
+    page_t **pages;
+    /// The number of pages in use.
+    uint32_t used;
+    /// The name of the device.
+    char name[NAME_MAX];
+    /// The path of the device.
+    char path[PATH_MAX];
+    /// The filesystem entry of the device.
+    vfs_file_t *fs_root;
+} ramdisk_t;
+
+/// @brief The RAM disks.
+static ramdisk_t ramdisks[RAMDISK_COUNT];
+
+// == VFS CALLBACKS ===========================================================
+
+/// @brief Implements the open function for a RAM disk.
+/// @param path the path to the device we want to open.
+/// @param flags we ignore these.
+/// @param mode we currently ignore this.
+/// @return the VFS file associated with the device.
+static vfs_file_t *ramdisk_open(const char *path, int flags, mode_t mode)
+{
+    pr_debug("ramdisk_open(%s, %d, %d)\n", path, flags, mode);
+    for (unsigned index = 0; index < RAMDISK_COUNT; ++index) {
+        ramdisk_t *disk = &ramdisks[index];
+        if (disk->fs_root && !strcmp(path, disk->path)) {
+            ++disk->fs_root->count;
+            return disk->fs_root;
+        }
+    }
+    return NULL;
+}
+
+/// @brief Closes a RAM disk.
+/// @param file the VFS file associated with the device.
+/// @return 0 on success, it panics on failure.
+static int ramdisk_close(vfs_file_t *file)
+{
+    pr_debug("ramdisk_close(%p)\n", file);
+    if (file->device == NULL) {
+        kernel_panic("Device not set.");
+    }
+    --file->count;
+    return 0;
+}
+
+/// @brief Reads from a RAM disk.
+/// @param file the VFS file associated with the device.
+/// @param buffer the buffer where we store what we read.
+/// @param offset the offset where we want to read.
+/// @param size the size of the buffer.
+/// @return the number of read characters.
+static ssize_t ramdisk_read(vfs_file_t *file, char *buffer, off_t offset, size_t size)
+{
+    ramdisk_t *disk = (ramdisk_t *)file->device;
+    if (disk == NULL) {
+        kernel_panic("Device not set.");
+    }
+    if ((offset < 0) || ((uint32_t)offset >= RAMDISK_SIZE)) {
+        return 0;
+    }
+    size = min(size, RAMDISK_SIZE - (uint32_t)offset);
+    for (size_t done = 0, chunk; done < size; done += chunk) {
+        uint32_t position = offset + done;
+        page_t *page      = disk->pages[position / PAGE_SIZE];
+        chunk             = min(PAGE_SIZE - (position % PAGE_SIZE), size - done);
+        if (page) {
+            memcpy(buffer + done, (uint8_t *)get_lowmem_address_from_page(page) + (position % PAGE_SIZE), chunk);
+        } else {
+            memset(buffer + done, 0, chunk);
+        }
+    }
+    return size;
+}
+
+/// @brief Writes on a RAM disk.
+/// @param file the VFS file associated with the device.
+/// @param buffer the buffer we use to write.
+/// @param offset the offset where we want to write.
+/// @param size the size of the buffer.
+/// @return the number of written characters, or -errno.
+static ssize_t ramdisk_write(vfs_file_t *file, const void *buffer, off_t offset, size_t size)
+{
+    ramdisk_t *disk = (ramdisk_t *)file->device;
+    if (disk == NULL) {
+        kernel_panic("Device not set.");
+    }
+    if ((offset < 0) || ((uint32_t)offset >= RAMDISK_SIZE)) {
+        return -ENOSPC;
+    }
+    size        = min(size, RAMDISK_SIZE - (uint32_t)offset);
+    size_t done = 0, chunk;
+    for (; done < size; done += chunk) {
+        uint32_t position = offset + done;
+        page_t **page     = &disk->pages[position / PAGE_SIZE];
+        chunk             = min(PAGE_SIZE - (position % PAGE_SIZE), size - done);
+        if (*page == NULL) {
+            if ((*page = _alloc_pages(GFP_KERNEL | __GFP_ZERO, 0)) == NULL) {
+                break;
+            }
+            ++disk->used;
+        }
+        memcpy((uint8_t *)get_lowmem_address_from_page(*page) + (position % PAGE_SIZE), (const uint8_t *)buffer + done, chunk);
+    }
+    return done ? (ssize_t)done : -ENOSPC;
+}
+
+/// @brief Stats a RAM disk.
+/// @param disk the device.
+/// @param stat the stat buffer.
+/// @return 0 on success.
+static int __ramdisk_stat(const ramdisk_t *disk, stat_t *stat)
+{
+    if (disk && disk->fs_root) {
+        stat->st_dev   = 0;
+        stat->st_ino   = 0;
+        stat->st_mode  = 0;
+        stat->st_uid   = 0;
+        stat->st_gid   = 0;
+        stat->st_atime = sys_time(NULL);
+        stat->st_mtime = sys_time(NULL);
+        stat->st_ctime = sys_time(NULL);
+        stat->st_size  = disk->fs_root->length;
+    }
+    return 0;
+}
+
+/// @brief Retrieves information concerning the file at the given position.
+/// @param file the file.
+/// @param stat the structure where the information are stored.
+/// @return 0 if success.
+static int ramdisk_fstat(vfs_file_t *file, stat_t *stat)
+{
+    return __ramdisk_stat(file->device, stat);
+}
+
+/// @brief Retrieves information concerning the file at the given position.
+/// @param path the path where the file resides.
+/// @param stat the structure where the information are stored.
+/// @return 0 if success.
+static int ramdisk_stat(const char *path, stat_t *stat)
+{
+    super_block_t *sb = vfs_get_superblock(path);
+    if (sb && sb->root) {
+        return __ramdisk_stat(sb->root->device, stat);
+    }
+    return -1;
+}
+
+/// @brief Writes back the cached blocks, which land in memory right away.
+/// @param file the VFS file associated with the device.
+/// @return 0 on success, -errno on failure.
+static int ramdisk_fsync(vfs_file_t *file)
+{
+    return buffer_sync(file);
+}
+
+// == VFS ENTRY GENERATION ====================================================
+/// Filesystem general operations.
+static vfs_sys_operations_t ramdisk_sys_operations = {
+    .mkdir_f   = NULL,
+    .rmdir_f   = NULL,
+    .stat_f    = ramdisk_stat,
+    .creat_f   = NULL,
+    .symlink_f = NULL,
+};
+
+/// RAM disk file operations.
+static vfs_file_operations_t ramdisk_fs_operations = {
+    .open_f     = ramdisk_open,
+    .unlink_f   = NULL,
+    .close_f    = ramdisk_close,
+    .read_f     = ramdisk_read,
+    .write_f    = ramdisk_write,
+    .lseek_f    = NULL,
+    .stat_f     = ramdisk_fstat,
+    .ioctl_f    = NULL,
+    .getdents_f = NULL,
+    .readlink_f = NULL,
+    .fsync_f    = ramdisk_fsync,
+};
+
+/// @brief Creates a VFS file, starting from a RAM disk.
+/// @param disk the device.
+/// @return a pointer to the VFS file on success, NULL on failure.
+static vfs_file_t *ramdisk_device_create(ramdisk_t *disk)
+{
+    vfs_file_t *file = kmem_cache_alloc(vfs_file_cache, GFP_KERNEL);
+    if (file == NULL) {
+        pr_err("Failed to create RAM disk device.\n");
+        return NULL;
+    }
+    memcpy(file->name, disk->name, NAME_MAX);
+    file->device         = disk;
+    file->flags          = DT_BLK;
+    file->sys_operations = &ramdisk_sys_operations;
+    file->fs_operations  = &ramdisk_fs_operations;
+    return file;
+}
+
+// == INITIALIZE/FINALIZE RAM DISKS ===========================================
+
+int ramdisk_initialize(void)
+{
+    for (unsigned index = 0; index < RAMDISK_COUNT; ++index) {
+        ramdisk_t *disk = &ramdisks[index];
+        memset(disk, 0, sizeof(ramdisk_t));
+        sprintf(disk->name, "ram%u", index);
+        sprintf(disk->path, "/dev/ram%u", index);
+        if ((disk->pages = (page_t **)kmalloc(RAMDISK_PAGES * sizeof(page_t *))) == NULL) {
+            pr_err("Failed to allocate the pages of %s.\n", disk->name);
+            return 1;
+        }
+        memset(disk->pages, 0, RAMDISK_PAGES * sizeof(page_t *));
+        if ((disk->fs_root = ramdisk_device_create(disk)) == NULL) {
+            return 1;
+        }
+        disk->fs_root->length = RAMDISK_SIZE;
+        if (!vfs_mount(disk->path, disk->fs_root)) {
+            pr_alert("Failed to mount %s!\n", disk->path);
+            kmem_cache_free(disk->fs_root);
+            disk->fs_root = NULL;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int ramdisk_finalize(void)
+{
+    return 0;
+}
+
+/// @}
@@ -11,9 +11,8 @@
 #define __DEBUG_LEVEL__  LOGLEVEL_NOTICE ///< Set log level.
 #include "io/debug.h"                    // Include debugging functions.
 
-#include "descriptor_tables/isr.h"
 #include "drivers/rtc.h"
-#include "hardware/pic8259.h"
+#include "hardware/hrtimer.h"
 #include "io/port_io.h"
 #include "kernel.h"
 #include "string.h"
@@ -21,12 +20,18 @@
 #define CMOS_ADDR 0x70 ///< Addess where we need to write the Address.
 #define CMOS_DATA 0x71 ///< Addess where we need to write the Data.
 
-/// Current global time.
-tm_t global_time;
-/// Previous global time.
-tm_t previous_global_time;
+/// How often the wall clock is compared again with the RTC.
+#define RTC_RESYNC_INTERVAL (600ULL * NSEC_PER_SEC)
+/// The seconds the wall clock can drift from the RTC before being corrected,
+/// the RTC only counts whole seconds.
+#define RTC_MAX_DRIFT 2
+
 /// Data type is BCD.
 int is_bcd;
+/// The seconds since the Epoch at boot, the wall clock adds the time since boot.
+static time_t boot_time;
+/// When the RTC was last read, in nanoseconds since boot.
+static ktime_t last_sync;
 
 static inline unsigned int rtc_are_different(tm_t *t0, tm_t *t1)
 {
@@ -65,67 +70,115 @@ static inline unsigned char bcd2bin(unsigned char bcd)
     return ((bcd >> 4u) * 10) + (bcd & 0x0Fu);
 }
 
-static inline void rtc_read_datetime(void)
+static inline void rtc_read_datetime(tm_t *time)
 {
-    if (read_register(0x0Cu) & 0x10u) {
-        if (is_bcd) {
-            global_time.tm_sec  = bcd2bin(read_register(0x00));
-            global_time.tm_min  = bcd2bin(read_register(0x02));
-            global_time.tm_hour = bcd2bin(read_register(0x04)) + 2;
-            global_time.tm_mon  = bcd2bin(read_register(0x08));
-            global_time.tm_year = bcd2bin(read_register(0x09)) + 2000;
-            global_time.tm_wday = bcd2bin(read_register(0x06));
-            global_time.tm_mday = bcd2bin(read_register(0x07));
-        } else {
-            global_time.tm_sec  = read_register(0x00);
-            global_time.tm_min  = read_register(0x02);
-            global_time.tm_hour = read_register(0x04) + 2;
-            global_time.tm_mon  = read_register(0x08);
-            global_time.tm_year = read_register(0x09) + 2000;
-            global_time.tm_wday = read_register(0x06);
-            global_time.tm_mday = read_register(0x07);
-        }
+    if (is_bcd) {
+        time->tm_sec  = bcd2bin(read_register(0x00));
+        time->tm_min  = bcd2bin(read_register(0x02));
+        time->tm_hour = bcd2bin(read_register(0x04)) + 2;
+        time->tm_mon  = bcd2bin(read_register(0x08));
+        time->tm_year = bcd2bin(read_register(0x09)) + 2000;
+        time->tm_wday = bcd2bin(read_register(0x06));
+        time->tm_mday = bcd2bin(read_register(0x07));
+    } else {
+        time->tm_sec  = read_register(0x00);
+        time->tm_min  = read_register(0x02);
+        time->tm_hour = read_register(0x04) + 2;
+        time->tm_mon  = read_register(0x08);
+        time->tm_year = read_register(0x09) + 2000;
+        time->tm_wday = read_register(0x06);
+        time->tm_mday = read_register(0x07);
     }
 }
 
-static inline void rtc_update_datetime(void)
+/// @brief Reads the date from the RTC, twice, so that an update happening in
+/// between is noticed.
+/// @param time where the date is stored.
+/// @param wait whether to wait for the update to end, or give up.
+/// @return 0 on success, -1 if the RTC was updating and we did not wait.
+static inline int rtc_update_datetime(tm_t *time, bool_t wait)
+{
+    tm_t previous;
+    do {
+        // Wait until rtc is not updating.
+        while (is_updating_rtc()) {
+            if (!wait) {
+                return -1;
+            }
+        }
+        rtc_read_datetime(&previous);
+        // Read the values.
+        rtc_read_datetime(time);
+    } while (wait && rtc_are_different(&previous, time));
+    return rtc_are_different(&previous, time) ? -1 : 0;
+}
+
+/// @brief Converts a date of the RTC to the seconds since the Epoch.
+/// @param time the date.
+/// @return the seconds since the Epoch.
+static inline time_t rtc_to_epoch(tm_t time)
 {
-    static unsigned int first_update = 1;
-    // Wait until rtc is not updating.
-    while (is_updating_rtc()) {}
-    // Read the values.
-    rtc_read_datetime();
-    if (first_update) {
-        do {
-            // Save the previous global time.
-            previous_global_time = global_time;
-            // Wait until rtc is not updating.
-            while (is_updating_rtc()) {}
-            // Read the values.
-            rtc_read_datetime();
-        } while (!rtc_are_different(&previous_global_time, &global_time));
-        first_update = 0;
+    // January and February are counted as months 13 and 14 of the previous year.
+    if (time.tm_mon <= 2) {
+        time.tm_mon += 12;
+        time.tm_year -= 1;
     }
+    time_t t;
+    // Convert years to days
+    t = (365 * time.tm_year) + (time.tm_year / 4) - (time.tm_year / 100) + (time.tm_year / 400);
+    // Convert months to days
+    t += (30 * time.tm_mon) + (3 * (time.tm_mon + 1) / 5) + time.tm_mday;
+    // Unix time starts on January 1st, 1970
+    t -= 719561;
+    // Convert days to seconds
+    t *= 86400;
+    // Add hours, minutes and seconds
+    t += (3600 * time.tm_hour) + (60 * time.tm_min) + time.tm_sec;
+    return t;
 }
 
-static inline void rtc_handler_isr(pt_regs *f)
+/// @brief Computes the boot time from the RTC, and the time since boot.
+/// @param time the date read from the RTC.
+/// @param now the time since boot, in nanoseconds.
+/// @return the seconds since the Epoch at boot.
+static inline time_t rtc_compute_boot_time(tm_t *time, ktime_t now)
 {
-    rtc_update_datetime();
+    div64_32(&now, NSEC_PER_SEC);
+    return rtc_to_epoch(*time) - (time_t)now;
 }
 
-void gettime(tm_t *time)
+time_t rtc_get_boot_time(void)
 {
-    // Copy the update time.
-    memcpy(time, &global_time, sizeof(tm_t));
+    return boot_time;
+}
+
+void rtc_resync(void)
+{
+    tm_t time;
+    ktime_t now = hrtimer_get_time();
+    if ((now - last_sync) < RTC_RESYNC_INTERVAL) {
+        return;
+    }
+    // Try again later, rather than waiting for the RTC.
+    if (rtc_update_datetime(&time, false) < 0) {
+        return;
+    }
+    last_sync       = now;
+    time_t computed = rtc_compute_boot_time(&time, now);
+    if ((computed > boot_time + RTC_MAX_DRIFT) || (computed < boot_time - RTC_MAX_DRIFT)) {
+        pr_notice("The clock drifted by %d seconds from the RTC.\n", computed - boot_time);
+        boot_time = computed;
+    }
 }
 
 int rtc_initialize(void)
 {
     unsigned char status;
+    tm_t time;
 
     status = read_register(0x0B);
     status |= 0x02u;            // 24 hour clock
-    status |= 0x10u;            // update ended interrupts
+    status &= ~0x10u;           // no update ended interrupts
     status &= ~0x20u;           // no alarm interrupts
     status &= ~0x40u;           // no periodic interrupt
     is_bcd = !(status & 0x04u); // check if data type is BCD
@@ -133,21 +186,16 @@ int rtc_initialize(void)
 
     read_register(0x0C);
 
-    // Install the IRQ.
-    irq_install_handler(IRQ_REAL_TIME_CLOCK, rtc_handler_isr, "Real Time Clock (RTC)");
-    // Enable the IRQ.
-    pic8259_irq_enable(IRQ_REAL_TIME_CLOCK);
-    // Wait until rtc is ready.
-    rtc_update_datetime();
+    // Read the date once, from then on the wall clock is carried on by the
+    // time since boot.
+    rtc_update_datetime(&time, true);
+    last_sync = hrtimer_get_time();
+    boot_time = rtc_compute_boot_time(&time, last_sync);
     return 0;
 }
 
 int rtc_finalize(void)
 {
-    // Uninstall the IRQ.
-    irq_uninstall_handler(IRQ_REAL_TIME_CLOCK, rtc_handler_isr);
-    // Disable the IRQ.
-    pic8259_irq_disable(IRQ_REAL_TIME_CLOCK);
     return 0;
 }
 
@@ -0,0 +1,569 @@
+/// @file serial.c
+/// @brief Driver for the 16550 UART serial ports.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// The characters written are queued inside a ring-buffer, and the interrupt
+/// raised when the transmitter FIFO is empty refills it, up to its 16 bytes.
+/// The writers wait on the port only when the ring-buffer is full, or when
+/// the interrupts are disabled, so that a panic still reaches the log. The
+/// characters received are queued as well, for the readers of /dev/ttyS, or
+/// for the terminal when the port is part of the console.
+/// @addtogroup serial
+/// @{
+
+// Setup the logging for this file (do this before any other include).
+#include "sys/kernel_levels.h"           // Include kernel log levels.
+#define __DEBUG_HEADER__ "[SERIAL]"      ///< Change header.
+#define __DEBUG_LEVEL__  LOGLEVEL_NOTICE ///< Set log level.
+#include "io/debug.h"                    // Include debugging functions.
+
+#include "drivers/serial.h"
+
+#include "bits/ioctls.h"
+#include "bits/termios-struct.h"
+#include "descriptor_tables/isr.h"
+#include "fcntl.h"
+#include "fs/poll.h"
+#include "fs/vfs.h"
+#include "hardware/pic8259.h"
+#include "io/console.h"
+#include "io/port_io.h"
+#include "klib/irqflags.h"
+#include "klib/stdatomic.h"
+#include "poll.h"
+#include "process/scheduler.h"
+#include "process/wait.h"
+#include "ring_buffer.h"
+#include "stdio.h"
+#include "string.h"
+#include "sys/bitops.h"
+#include "sys/errno.h"
+#include "system/softirq.h"
+#include "system/syscall.h"
+
+#define SERIAL_THR 0 ///< Transmitter holding register (write).
+#define SERIAL_RBR 0 ///< Receiver buffer register (read).
+#define SERIAL_DLL 0 ///< Divisor latch, low byte (DLAB set).
+#define SERIAL_IER 1 ///< Interrupt enable register.
+#define SERIAL_DLM 1 ///< Divisor latch, high byte (DLAB set).
+#define SERIAL_IIR 2 ///< Interrupt identification register (read).
+#define SERIAL_FCR 2 ///< FIFO control register (write).
+#define SERIAL_LCR 3 ///< Line control register.
+#define SERIAL_MCR 4 ///< Modem control register.
+#define SERIAL_LSR 5 ///< Line status register.
+#define SERIAL_MSR 6 ///< Modem status register.
+
+#define SERIAL_IER_RDA  0x01 ///< Interrupt when data is received.
+#define SERIAL_IER_THRE 0x02 ///< Interrupt when the transmitter is empty.
+
+#define SERIAL_IIR_NONE 0x01 ///< No interrupt is pending.
+#define SERIAL_IIR_ID   0x0E ///< Mask of the cause of the interrupt.
+#define SERIAL_IIR_MSR  0x00 ///< The modem status changed.
+#define SERIAL_IIR_THRE 0x02 ///< The transmitter is empty.
+#define SERIAL_IIR_RDA  0x04 ///< Data was received.
+#define SERIAL_IIR_RLS  0x06 ///< The line status changed.
+#define SERIAL_IIR_CTO  0x0C ///< Data was received, and not read in time.
+#define SERIAL_IIR_FIFO 0xC0 ///< The FIFOs are enabled and working.
+
+#define SERIAL_FCR_ENABLE 0x07 ///< Enables the FIFOs, and clears them.
+#define SERIAL_FCR_TRIG14 0xC0 ///< Interrupt once 14 bytes are received.
+
+#define SERIAL_LCR_8N1  0x03 ///< 8 data bits, no parity, one stop bit.
+#define SERIAL_LCR_DLAB 0x80 ///< Exposes the divisor latch.
+
+#define SERIAL_MCR_DTR  0x01 ///< Data terminal ready.
+#define SERIAL_MCR_RTS  0x02 ///< Request to send.
+#define SERIAL_MCR_OUT2 0x08 ///< Connects the interrupt line to the PIC.
+#define SERIAL_MCR_LOOP 0x10 ///< Loopback mode, used to detect the port.
+
+#define SERIAL_LSR_DR   0x01 ///< Data is ready to be read.
+#define SERIAL_LSR_THRE 0x20 ///< The transmitter FIFO is empty.
+
+/// The clock of the UART, divided to obtain the baud rate.
+#define SERIAL_CLOCK 115200U
+/// The size of the transmitter FIFO of the 16550.
+#define SERIAL_FIFO_SIZE 16
+/// The number of serial ports we handle.
+#define SERIAL_COUNT 2
+/// The interrupt flag, inside the flags register.
+#define SERIAL_EFLAGS_IF (1U << 9)
+
+/// The characters waiting to be sent.
+DECLARE_FIXED_SIZE_RING_BUFFER(char, serial_tx, 4096, 0)
+/// The characters received, waiting to be read.
+DECLARE_FIXED_SIZE_RING_BUFFER(char, serial_rx, 1024, 0)
+
+/// @brief A serial port.
+typedef struct serial_port_t {
+    /// The base I/O port.
+    uint16_t base;
+    /// The interrupt line.
+    unsigned irq;
+    /// If the port was found.
+    bool_t present;
+    /// If the interrupts of the port are enabled.
+    bool_t irq_ready;
+    /// If the FIFOs work, otherwise we send one character at a time.
+    bool_t fifo;
+    /// The current speed.
+    uint32_t baud_rate;
+    /// The characters to send.
+    fs_rb_serial_tx_t tx;
+    /// The characters received.
+    fs_rb_serial_rx_t rx;
+    /// The processes waiting for characters.
+    wait_queue_head_t wait;
+    /// The name of the device.
+    char name[NAME_MAX];
+    /// The path of the device.
+    char path[PATH_MAX];
+    /// The filesystem entry of the device.
+    vfs_file_t *fs_root;
+} serial_port_t;
+
+/// @brief The serial ports.
+static serial_port_t serial_ports[SERIAL_COUNT] = {
+    { .base = SERIAL_COM1, .irq = IRQ_COM1_3 },
+    { .base = SERIAL_COM2, .irq = IRQ_COM2_4 },
+};
+
+/// @brief Wakes up the readers, outside of the interrupt handler.
+/// @param data unused.
+static void __serial_bottom_half(unsigned long data);
+/// Wakes up the readers once characters are received.
+static tasklet_t serial_tasklet = TASKLET_INIT(__serial_bottom_half, 0);
+
+/// @brief Checks if the ring-buffer of the characters to send is full.
+/// @param rb the ring-buffer.
+/// @return true if it is full.
+static inline bool_t __serial_tx_full(fs_rb_serial_tx_t *rb)
+{
+    return fs_rb_serial_tx_step(rb, rb->write) == rb->read;
+}
+
+/// @brief Fills the transmitter FIFO, if it is empty.
+/// @param port the port, with interrupts disabled.
+/// @details Once the FIFO empties again, the interrupt calls us back.
+static inline void __serial_kick(serial_port_t *port)
+{
+    if (!(inportb(port->base + SERIAL_LSR) & SERIAL_LSR_THRE)) {
+        return;
+    }
+    for (int i = port->fifo ? SERIAL_FIFO_SIZE : 1; (i > 0) && !fs_rb_serial_tx_empty(&port->tx); --i) {
+        outportb(port->base + SERIAL_THR, (uint8_t)fs_rb_serial_tx_pop_back(&port->tx));
+    }
+}
+
+/// @brief Sends everything queued, waiting on the port.
+/// @param port the port, with interrupts disabled.
+static inline void __serial_drain(serial_port_t *port)
+{
+    while (!fs_rb_serial_tx_empty(&port->tx)) {
+        while (!(inportb(port->base + SERIAL_LSR) & SERIAL_LSR_THRE)) {
+            cpu_relax();
+        }
+        __serial_kick(port);
+    }
+}
+
+/// @brief Queues a character on a port.
+/// @param port the port.
+/// @param c the character.
+static void __serial_putc(serial_port_t *port, char c)
+{
+    if (!port->irq_ready) {
+        // Without interrupts, nobody would send the queue.
+        while (!(inportb(port->base + SERIAL_LSR) & SERIAL_LSR_THRE)) {
+            cpu_relax();
+        }
+        outportb(port->base + SERIAL_THR, (uint8_t)c);
+        return;
+    }
+    uint8_t flags = irq_disable();
+    if (__serial_tx_full(&port->tx)) {
+        // Do not drop the messages, make room by waiting on the port.
+        __serial_drain(port);
+    }
+    fs_rb_serial_tx_push_front(&port->tx, c);
+    __serial_kick(port);
+    // With the interrupts disabled, this might be the last message.
+    if (!(flags & SERIAL_EFLAGS_IF)) {
+        __serial_drain(port);
+    }
+    irq_enable(flags);
+}
+
+/// @brief Handles the interrupts of a port.
+/// @param port the port.
+static inline void __serial_handle(serial_port_t *port)
+{
+    bool_t received = false;
+    uint8_t iir;
+    while (!((iir = inportb(port->base + SERIAL_IIR)) & SERIAL_IIR_NONE)) {
+        switch (iir & SERIAL_IIR_ID) {
+        case SERIAL_IIR_THRE:
+            __serial_kick(port);
+            break;
+        case SERIAL_IIR_RDA:
+        case SERIAL_IIR_CTO:
+            while (inportb(port->base + SERIAL_LSR) & SERIAL_LSR_DR) {
+                fs_rb_serial_rx_push_front(&port->rx, (char)inportb(port->base + SERIAL_RBR));
+            }
+            received = true;
+            break;
+        case SERIAL_IIR_RLS:
+            inportb(port->base + SERIAL_LSR);
+            break;
+        default:
+            inportb(port->base + SERIAL_MSR);
+            break;
+        }
+    }
+    if (received) {
+        tasklet_schedule(&serial_tasklet);
+    }
+}
+
+/// @brief Interrupt handler of the serial ports.
+/// @param f the interrupt stack frame.
+static void __serial_isr(pt_regs *f)
+{
+    // Because of the mapping of the IRQs, the lines are shifted by 32.
+    unsigned irq = f->int_no - 32;
+    // COM1 and COM3, as COM2 and COM4, share the line.
+    for (unsigned index = 0; index < SERIAL_COUNT; ++index) {
+        serial_port_t *port = &serial_ports[index];
+        if (port->irq_ready && (port->irq == irq)) {
+            __serial_handle(port);
+        }
+    }
+    pic8259_send_eoi(irq);
+}
+
+static void __serial_bottom_half(unsigned long data)
+{
+    (void)data;
+    for (unsigned index = 0; index < SERIAL_COUNT; ++index) {
+        serial_port_t *port = &serial_ports[index];
+        if (!port->irq_ready || fs_rb_serial_rx_empty(&port->rx)) {
+            continue;
+        }
+        // When the port is part of the console, the terminal reads it.
+        if (console_get_devices() & (CONSOLE_SERIAL0 << index)) {
+            while (1) {
+                uint8_t flags  = irq_disable();
+                int c          = fs_rb_serial_rx_empty(&port->rx) ? -1 : (unsigned char)fs_rb_serial_rx_pop_back(&port->rx);
+                irq_enable(flags);
+                if (c < 0) {
+                    break;
+                }
+                console_input(CONSOLE_SERIAL0 << index, c);
+            }
+        } else {
+            wake_up(&port->wait);
+        }
+    }
+}
+
+/// @brief Programs the divisor of a port.
+/// @param port the port.
+/// @param baud_rate the speed.
+static inline void __serial_set_divisor(serial_port_t *port, uint32_t baud_rate)
+{
+    uint16_t divisor = (uint16_t)(SERIAL_CLOCK / baud_rate);
+    outportb(port->base + SERIAL_LCR, SERIAL_LCR_DLAB);
+    outportb(port->base + SERIAL_DLL, divisor & 0xFF);
+    outportb(port->base + SERIAL_DLM, (divisor >> 8) & 0xFF);
+    outportb(port->base + SERIAL_LCR, SERIAL_LCR_8N1);
+    port->baud_rate = baud_rate;
+}
+
+/// @brief Detects and programs a port.
+/// @param port the port.
+/// @return true if the port is present.
+static bool_t __serial_probe(serial_port_t *port)
+{
+    outportb(port->base + SERIAL_IER, 0x00);
+    __serial_set_divisor(port, SERIAL_DEFAULT_BAUD_RATE);
+    // Check that what we send comes back, in loopback mode.
+    outportb(port->base + SERIAL_MCR, SERIAL_MCR_LOOP | SERIAL_MCR_OUT2 | SERIAL_MCR_RTS | SERIAL_MCR_DTR);
+    outportb(port->base + SERIAL_THR, 0xAE);
+    if (inportb(port->base + SERIAL_RBR) != 0xAE) {
+        return false;
+    }
+    outportb(port->base + SERIAL_MCR, SERIAL_MCR_OUT2 | SERIAL_MCR_RTS | SERIAL_MCR_DTR);
+    // Enable the FIFOs, the 8250 has none.
+    outportb(port->base + SERIAL_FCR, SERIAL_FCR_ENABLE | SERIAL_FCR_TRIG14);
+    port->fifo = (inportb(port->base + SERIAL_IIR) & SERIAL_IIR_FIFO) == SERIAL_IIR_FIFO;
+    fs_rb_serial_tx_init(&port->tx);
+    fs_rb_serial_rx_init(&port->rx);
+    init_waitqueue_head(&port->wait);
+    return true;
+}
+
+// == VFS CALLBACKS ===========================================================
+
+/// @brief Implements the open function for a serial port.
+/// @param path the path to the device we want to open.
+/// @param flags we ignore these.
+/// @param mode we currently ignore this.
+/// @return the VFS file associated with the device.
+static vfs_file_t *serial_open(const char *path, int flags, mode_t mode)
+{
+    pr_debug("serial_open(%s, %d, %d)\n", path, flags, mode);
+    for (unsigned index = 0; index < SERIAL_COUNT; ++index) {
+        serial_port_t *port = &serial_ports[index];
+        if (port->fs_root && !strcmp(path, port->path)) {
+            ++port->fs_root->count;
+            return port->fs_root;
+        }
+    }
+    return NULL;
+}
+
+/// @brief Closes a serial port.
+/// @param file the VFS file associated with the device.
+/// @return 0 on success.
+static int serial_close(vfs_file_t *file)
+{
+    pr_debug("serial_close(%p)\n", file);
+    --file->count;
+    return 0;
+}
+
+/// @brief Returns the events ready on a serial port.
+/// @param file the VFS file associated with the device.
+/// @param table the table of the polling process, NULL if it does not sleep.
+/// @return the events, writing never blocks.
+static unsigned int serial_poll(vfs_file_t *file, struct poll_table_t *table)
+{
+    serial_port_t *port = (serial_port_t *)file->device;
+    unsigned int mask   = POLLOUT | POLLWRNORM;
+    poll_wait(file, &port->wait, table);
+    if (!fs_rb_serial_rx_empty(&port->rx)) {
+        mask |= POLLIN | POLLRDNORM;
+    }
+    return mask;
+}
+
+/// @brief Reads from a serial port, sleeping until a character is received.
+/// @param file the VFS file associated with the device.
+/// @param buffer the buffer where we store what we read.
+/// @param offset ignored.
+/// @param size the size of the buffer.
+/// @return the number of characters read, -ERESTARTSYS if the process
+/// sleeps, -errno on failure.
+static ssize_t serial_read(vfs_file_t *file, char *buffer, off_t offset, size_t size)
+{
+    serial_port_t *port = (serial_port_t *)file->device;
+    if (fs_rb_serial_rx_empty(&port->rx)) {
+        if (bitmask_check(file->open_flags, O_NONBLOCK)) {
+            return -EAGAIN;
+        }
+        int ret = do_poll_file(file, POLLIN, -1);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    // We might have slept, leave the queue of the port.
+    poll_release(scheduler_get_current_process());
+    uint8_t flags  = irq_disable();
+    size_t count   = 0;
+    while ((count < size) && !fs_rb_serial_rx_empty(&port->rx)) {
+        char c = fs_rb_serial_rx_pop_back(&port->rx);
+        // Terminals send a carriage return for the enter key.
+        buffer[count++] = (c == '\r') ? '\n' : c;
+    }
+    irq_enable(flags);
+    return count;
+}
+
+/// @brief Writes on a serial port.
+/// @param file the VFS file associated with the device.
+/// @param buffer the buffer we use to write.
+/// @param offset ignored.
+/// @param size the size of the buffer.
+/// @return the number of written characters.
+static ssize_t serial_fs_write(vfs_file_t *file, const void *buffer, off_t offset, size_t size)
+{
+    serial_port_t *port = (serial_port_t *)file->device;
+    return serial_write(port - serial_ports, (const char *)buffer, size);
+}
+
+/// @brief Retrieves information concerning a serial port.
+/// @param file the VFS file associated with the device.
+/// @param stat the structure where the information are stored.
+/// @return 0 on success.
+static int serial_fstat(vfs_file_t *file, stat_t *stat)
+{
+    memset(stat, 0, sizeof(stat_t));
+    stat->st_mode  = 0666;
+    stat->st_mtime = sys_time(NULL);
+    return 0;
+}
+
+/// @brief Reads or changes the settings of a serial port.
+/// @param file the VFS file associated with the device.
+/// @param request TCGETS or TCSETS.
+/// @param data the termios structure, only the speed is used.
+/// @return 0 on success, -errno on failure.
+static int serial_ioctl(vfs_file_t *file, int request, void *data)
+{
+    serial_port_t *port = (serial_port_t *)file->device;
+    termios_t *termios  = (termios_t *)data;
+    switch (request) {
+    case TCGETS:
+        memset(termios, 0, sizeof(termios_t));
+        termios->c_cc[VMIN] = 1;
+        termios->c_ispeed = termios->c_ospeed = port->baud_rate;
+        return 0;
+    case TCSETS:
+        return serial_set_baud_rate(port - serial_ports, termios->c_ospeed);
+    default:
+        return -EINVAL;
+    }
+}
+
+// == VFS ENTRY GENERATION ====================================================
+/// Filesystem general operations.
+static vfs_sys_operations_t serial_sys_operations = {
+    .mkdir_f   = NULL,
+    .rmdir_f   = NULL,
+    .stat_f    = NULL,
+    .creat_f   = NULL,
+    .symlink_f = NULL,
+};
+
+/// Serial port file operations.
+static vfs_file_operations_t serial_fs_operations = {
+    .open_f     = serial_open,
+    .unlink_f   = NULL,
+    .close_f    = serial_close,
+    .read_f     = serial_read,
+    .write_f    = serial_fs_write,
+    .lseek_f    = NULL,
+    .stat_f     = serial_fstat,
+    .ioctl_f    = serial_ioctl,
+    .getdents_f = NULL,
+    .readlink_f = NULL,
+    .poll_f     = serial_poll,
+};
+
+/// @brief Creates a VFS file, starting from a serial port.
+/// @param port the port.
+/// @return a pointer to the VFS file on success, NULL on failure.
+static vfs_file_t *serial_device_create(serial_port_t *port)
+{
+    vfs_file_t *file = kmem_cache_alloc(vfs_file_cache, GFP_KERNEL);
+    if (file == NULL) {
+        pr_err("Failed to create serial device.\n");
+        return NULL;
+    }
+    memcpy(file->name, port->name, NAME_MAX);
+    file->device         = port;
+    file->flags          = DT_CHR;
+    file->sys_operations = &serial_sys_operations;
+    file->fs_operations  = &serial_fs_operations;
+    return file;
+}
+
+// == INITIALIZE/FINALIZE SERIAL PORTS ========================================
+
+void serial_putc(char c)
+{
+    serial_port_t *port = &serial_ports[0];
+    if (!port->present) {
+        // Before the initialization, as the boot code does.
+        outportb(SERIAL_COM1, (uint8_t)c);
+        return;
+    }
+    __serial_putc(port, c);
+}
+
+ssize_t serial_write(unsigned index, const char *buffer, size_t size)
+{
+    if ((index >= SERIAL_COUNT) || !serial_ports[index].present) {
+        return -ENODEV;
+    }
+    for (size_t i = 0; i < size; ++i) {
+        // Terminals need the carriage return to start a new line.
+        if (buffer[i] == '\n') {
+            __serial_putc(&serial_ports[index], '\r');
+        }
+        __serial_putc(&serial_ports[index], buffer[i]);
+    }
+    return size;
+}
+
+void serial_flush(unsigned index)
+{
+    if ((index < SERIAL_COUNT) && serial_ports[index].present) {
+        uint8_t flags = irq_disable();
+        __serial_drain(&serial_ports[index]);
+        irq_enable(flags);
+    }
+}
+
+int serial_set_baud_rate(unsigned index, uint32_t baud_rate)
+{
+    if ((index >= SERIAL_COUNT) || !serial_ports[index].present) {
+        return -ENODEV;
+    }
+    if ((baud_rate == 0) || (baud_rate > SERIAL_CLOCK) || (SERIAL_CLOCK % baud_rate)) {
+        return -EINVAL;
+    }
+    serial_port_t *port = &serial_ports[index];
+    uint8_t flags       = irq_disable();
+    // What is queued goes out at the old speed.
+    __serial_drain(port);
+    while (!(inportb(port->base + SERIAL_LSR) & SERIAL_LSR_THRE)) {
+        cpu_relax();
+    }
+    __serial_set_divisor(port, baud_rate);
+    irq_enable(flags);
+    return 0;
+}
+
+int serial_initialize(void)
+{
+    irq_install_handler(IRQ_COM1_3, __serial_isr, "serial");
+    irq_install_handler(IRQ_COM2_4, __serial_isr, "serial");
+    for (unsigned index = 0; index < SERIAL_COUNT; ++index) {
+        serial_port_t *port = &serial_ports[index];
+        sprintf(port->name, "ttyS%u", index);
+        sprintf(port->path, "/dev/ttyS%u", index);
+        if (!__serial_probe(port)) {
+            continue;
+        }
+        port->present   = true;
+        port->irq_ready = true;
+        outportb(port->base + SERIAL_IER, SERIAL_IER_RDA | SERIAL_IER_THRE);
+        pic8259_irq_enable(port->irq);
+        pr_notice("Found %s at 0x%04x (%s FIFO), %u baud.\n", port->name, port->base,
+                  port->fifo ? "with" : "without", port->baud_rate);
+    }
+    return 0;
+}
+
+int serial_devices_initialize(void)
+{
+    for (unsigned index = 0; index < SERIAL_COUNT; ++index) {
+        serial_port_t *port = &serial_ports[index];
+        if (!port->present) {
+            continue;
+        }
+        if ((port->fs_root = serial_device_create(port)) == NULL) {
+            return 1;
+        }
+        if (!vfs_mount(port->path, port->fs_root)) {
+            pr_alert("Failed to mount %s!\n", port->path);
+            kmem_cache_free(port->fs_root);
+            port->fs_root = NULL;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/// @}
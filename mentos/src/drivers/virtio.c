@@ -0,0 +1,297 @@
+/// @file virtio.c
+/// @brief Legacy PCI transport and split virtqueues of the virtio devices.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @addtogroup virtio
+/// @{
+
+// Setup the logging for this file (do this before any other include).
+#include "sys/kernel_levels.h"           // Include kernel log levels.
+#define __DEBUG_HEADER__ "[VIRTIO]"      ///< Change header.
+#define __DEBUG_LEVEL__  LOGLEVEL_NOTICE ///< Set log level.
+#include "io/debug.h"                    // Include debugging functions.
+
+#include "drivers/virtio/virtio.h"
+
+#include "devices/pci.h"
+#include "hardware/pic8259.h"
+#include "io/port_io.h"
+#include "klib/compiler.h"
+#include "mem/kheap.h"
+#include "string.h"
+#include "sys/errno.h"
+
+/// @name Registers of the legacy interface, inside the I/O ports.
+/// @{
+#define VIRTIO_PCI_HOST_FEATURES  0x00 ///< Features of the device.
+#define VIRTIO_PCI_GUEST_FEATURES 0x04 ///< Features accepted by the driver.
+#define VIRTIO_PCI_QUEUE_PFN      0x08 ///< Page of the rings of the selected queue.
+#define VIRTIO_PCI_QUEUE_SIZE     0x0C ///< Number of descriptors of the selected queue.
+#define VIRTIO_PCI_QUEUE_SEL      0x0E ///< Selects a queue.
+#define VIRTIO_PCI_QUEUE_NOTIFY   0x10 ///< Notifies the device of new buffers in a queue.
+#define VIRTIO_PCI_STATUS         0x12 ///< Device status.
+#define VIRTIO_PCI_ISR            0x13 ///< Interrupt status, cleared when read.
+#define VIRTIO_MSI_CONFIG_VECTOR  0x14 ///< MSI-X entry of the configuration changes.
+#define VIRTIO_MSI_QUEUE_VECTOR   0x16 ///< MSI-X entry of the selected queue.
+#define VIRTIO_PCI_CONFIG         0x14 ///< Configuration of the device, without MSI-X.
+#define VIRTIO_PCI_CONFIG_MSIX    0x18 ///< Configuration of the device, with MSI-X.
+/// @}
+
+#define VIRTIO_MSI_NO_VECTOR 0xFFFF     ///< No MSI-X entry.
+#define VIRTIO_MSIX_CONTROL  0x02       ///< Message control of the MSI-X capability.
+#define VIRTIO_MSIX_ENABLE   (1U << 15) ///< MSI-X is enabled.
+#define VIRTIO_RING_ALIGN    4096       ///< Alignment of the used ring of the legacy interface.
+
+/// @brief Makes the stores before it visible before the loads after it.
+static inline void __virtio_mb(void)
+{
+    __asm__ __volatile__("lock; addl $0, (%%esp)" ::: "memory", "cc");
+}
+
+/// @brief Returns where the driver tells at which index of the used ring it
+/// wants to be interrupted.
+/// @param vq the queue.
+/// @return the pointer to the index.
+static inline uint16_t *__vring_used_event(virtqueue_t *vq)
+{
+    return &vq->avail->ring[vq->size];
+}
+
+/// @brief Returns where the device tells at which index of the available ring
+/// it wants to be notified.
+/// @param vq the queue.
+/// @return the pointer to the index.
+static inline uint16_t *__vring_avail_event(virtqueue_t *vq)
+{
+    return (uint16_t *)&vq->used->ring[vq->size];
+}
+
+int virtio_pci_init(virtio_device_t *dev, uint32_t features)
+{
+    uint32_t bar = pci_read_32(dev->pci, PCI_BASE_ADDRESS_0);
+    if (!(bar & PCI_BAR_IO)) {
+        pr_err("Device %x has no legacy interface.\n", dev->pci);
+        return -ENODEV;
+    }
+    dev->io_base = bar & 0xFFFC;
+    dev->config  = VIRTIO_PCI_CONFIG;
+    dev->vector  = -1;
+    dev->irq     = -1;
+    pci_write_16(dev->pci, PCI_COMMAND, pci_read_16(dev->pci, PCI_COMMAND) | (1U << pci_command_io_space) | (1U << pci_command_bus_master));
+    // Reset the device, then tell it we know how to drive it.
+    outportb(dev->io_base + VIRTIO_PCI_STATUS, 0);
+    outportb(dev->io_base + VIRTIO_PCI_STATUS, VIRTIO_STATUS_ACKNOWLEDGE);
+    outportb(dev->io_base + VIRTIO_PCI_STATUS, VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER);
+    dev->features = inportl(dev->io_base + VIRTIO_PCI_HOST_FEATURES) & features;
+    outportl(dev->io_base + VIRTIO_PCI_GUEST_FEATURES, dev->features);
+    return 0;
+}
+
+void virtio_setup_irq(virtio_device_t *dev, interrupt_handler_t handler, char *description)
+{
+    int vector  = pci_enable_msi(dev->pci, handler, description);
+    uint8_t cap = pci_find_capability(dev->pci, PCI_CAP_ID_MSIX);
+    if ((vector >= 0) && cap && (pci_read_16(dev->pci, cap + VIRTIO_MSIX_CONTROL) & VIRTIO_MSIX_ENABLE)) {
+        // The queues use the first entry, configuration changes are ignored.
+        dev->vector = vector;
+        dev->config = VIRTIO_PCI_CONFIG_MSIX;
+        outports(dev->io_base + VIRTIO_MSI_CONFIG_VECTOR, VIRTIO_MSI_NO_VECTOR);
+        return;
+    }
+    // The legacy interface defines only MSI-X, fall back to the INTx line.
+    if (vector >= 0) {
+        pci_disable_msi(dev->pci, vector);
+    }
+    dev->irq = pci_get_interrupt(dev->pci);
+    irq_install_handler(dev->irq, handler, description);
+    pic8259_irq_enable(dev->irq);
+}
+
+virtqueue_t *virtio_find_vq(virtio_device_t *dev, uint16_t index)
+{
+    outports(dev->io_base + VIRTIO_PCI_QUEUE_SEL, index);
+    uint16_t size = inports(dev->io_base + VIRTIO_PCI_QUEUE_SIZE);
+    if ((size == 0) || inportl(dev->io_base + VIRTIO_PCI_QUEUE_PFN)) {
+        pr_err("Queue %u of device %x is missing, or already active.\n", index, dev->pci);
+        return NULL;
+    }
+    virtqueue_t *vq = (virtqueue_t *)kmalloc(sizeof(virtqueue_t));
+    if (vq == NULL) {
+        return NULL;
+    }
+    memset(vq, 0, sizeof(virtqueue_t));
+    if ((vq->tokens = (void **)kmalloc(size * sizeof(void *))) == NULL) {
+        goto free_vq;
+    }
+    memset(vq->tokens, 0, size * sizeof(void *));
+    // The descriptors and the available ring, then the used ring on the next
+    // aligned address.
+    size_t used_offset = (size * sizeof(vring_desc_t)) + sizeof(vring_avail_t) + ((size + 1) * sizeof(uint16_t));
+    used_offset        = (used_offset + VIRTIO_RING_ALIGN - 1) & ~(VIRTIO_RING_ALIGN - 1);
+    size_t total       = used_offset + sizeof(vring_used_t) + (size * sizeof(vring_used_elem_t)) + sizeof(uint16_t);
+    if ((vq->pages = _alloc_pages(GFP_KERNEL | __GFP_ZERO, find_nearest_order_greater(0, total))) == NULL) {
+        goto free_tokens;
+    }
+    uint32_t base = get_lowmem_address_from_page(vq->pages);
+    vq->dev       = dev;
+    vq->index     = index;
+    vq->size      = size;
+    vq->desc      = (vring_desc_t *)base;
+    vq->avail     = (vring_avail_t *)(base + (size * sizeof(vring_desc_t)));
+    vq->used      = (vring_used_t *)(base + used_offset);
+    for (uint16_t it = 0; it < size; ++it) {
+        vq->desc[it].next = it + 1;
+    }
+    vq->free_head = 0;
+    vq->num_free  = size;
+    if (dev->vector >= 0) {
+        outports(dev->io_base + VIRTIO_MSI_QUEUE_VECTOR, 0);
+        if (inports(dev->io_base + VIRTIO_MSI_QUEUE_VECTOR) != 0) {
+            pr_err("Device %x refused the MSI-X entry of queue %u.\n", dev->pci, index);
+            goto free_pages;
+        }
+    }
+    outportl(dev->io_base + VIRTIO_PCI_QUEUE_PFN, get_physical_address_from_page(vq->pages) / VIRTIO_RING_ALIGN);
+    return vq;
+
+free_pages:
+    __free_pages(vq->pages);
+free_tokens:
+    kfree(vq->tokens);
+free_vq:
+    kfree(vq);
+    return NULL;
+}
+
+void virtio_driver_ok(virtio_device_t *dev)
+{
+    outportb(dev->io_base + VIRTIO_PCI_STATUS, VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER | VIRTIO_STATUS_DRIVER_OK);
+}
+
+uint8_t virtio_isr(virtio_device_t *dev)
+{
+    return (dev->vector >= 0) ? 1 : inportb(dev->io_base + VIRTIO_PCI_ISR);
+}
+
+uint8_t virtio_config_read_8(virtio_device_t *dev, unsigned offset)
+{
+    return inportb(dev->io_base + dev->config + offset);
+}
+
+uint16_t virtio_config_read_16(virtio_device_t *dev, unsigned offset)
+{
+    return inports(dev->io_base + dev->config + offset);
+}
+
+uint32_t virtio_config_read_32(virtio_device_t *dev, unsigned offset)
+{
+    return inportl(dev->io_base + dev->config + offset);
+}
+
+int virtqueue_add(virtqueue_t *vq, const virtio_sg_t *sg, unsigned out, unsigned in, virtio_indirect_t *indirect, void *token)
+{
+    unsigned total = out + in;
+    // A single descriptor of the ring can describe the whole chain.
+    bool_t use_indirect = indirect && (vq->dev->features & VIRTIO_RING_F_INDIRECT_DESC) &&
+                          (total > 1) && (total <= indirect->size);
+    unsigned needed = use_indirect ? 1 : total;
+    if ((total == 0) || (needed > vq->num_free)) {
+        return -ENOSPC;
+    }
+    uint16_t head = vq->free_head, it = head;
+    if (use_indirect) {
+        for (unsigned i = 0; i < total; ++i) {
+            indirect->desc[i].addr    = sg[i].addr;
+            indirect->desc[i].addr_hi = 0;
+            indirect->desc[i].len     = sg[i].len;
+            indirect->desc[i].flags   = ((i >= out) ? VRING_DESC_F_WRITE : 0) | ((i + 1 < total) ? VRING_DESC_F_NEXT : 0);
+            indirect->desc[i].next    = i + 1;
+        }
+        vq->desc[head].addr    = indirect->phys;
+        vq->desc[head].addr_hi = 0;
+        vq->desc[head].len     = total * sizeof(vring_desc_t);
+        vq->desc[head].flags   = VRING_DESC_F_INDIRECT;
+        it                     = vq->desc[head].next;
+    } else {
+        // The free descriptors are already linked through next.
+        for (unsigned i = 0; i < total; ++i) {
+            vq->desc[it].addr    = sg[i].addr;
+            vq->desc[it].addr_hi = 0;
+            vq->desc[it].len     = sg[i].len;
+            vq->desc[it].flags   = ((i >= out) ? VRING_DESC_F_WRITE : 0) | ((i + 1 < total) ? VRING_DESC_F_NEXT : 0);
+            it                   = vq->desc[it].next;
+        }
+    }
+    vq->free_head = it;
+    vq->num_free -= needed;
+    vq->tokens[head] = token;
+    vq->avail->ring[vq->avail->idx % vq->size] = head;
+    // The device must see the chain before the new index.
+    __asm__ __volatile__("" ::: "memory");
+    WRITE_ONCE(vq->avail->idx, (uint16_t)(vq->avail->idx + 1));
+    return 0;
+}
+
+void virtqueue_kick(virtqueue_t *vq)
+{
+    // The new index must be visible before we read what the device wants.
+    __virtio_mb();
+    uint16_t new_idx = vq->avail->idx, old_idx = vq->last_kick;
+    vq->last_kick    = new_idx;
+    bool_t notify;
+    if (vq->dev->features & VIRTIO_RING_F_EVENT_IDX) {
+        // Notify only if the device asked for an index we have just passed.
+        uint16_t event = READ_ONCE(*__vring_avail_event(vq));
+        notify         = (uint16_t)(new_idx - event - 1) < (uint16_t)(new_idx - old_idx);
+    } else {
+        notify = !(READ_ONCE(vq->used->flags) & VRING_USED_F_NO_NOTIFY);
+    }
+    if (notify) {
+        outports(vq->dev->io_base + VIRTIO_PCI_QUEUE_NOTIFY, vq->index);
+    }
+}
+
+void *virtqueue_get_buf(virtqueue_t *vq, uint32_t *len)
+{
+    if (vq->last_used == READ_ONCE(vq->used->idx)) {
+        return NULL;
+    }
+    // Read the element only after the index which published it.
+    __asm__ __volatile__("" ::: "memory");
+    vring_used_elem_t *elem = &vq->used->ring[vq->last_used % vq->size];
+    uint16_t head           = elem->id;
+    if (len) {
+        *len = elem->len;
+    }
+    ++vq->last_used;
+    // Give the chain back to the free list.
+    uint16_t it    = head;
+    unsigned count = 1;
+    while (vq->desc[it].flags & VRING_DESC_F_NEXT) {
+        it = vq->desc[it].next;
+        ++count;
+    }
+    vq->desc[it].next = vq->free_head;
+    vq->free_head     = head;
+    vq->num_free += count;
+    void *token       = vq->tokens[head];
+    vq->tokens[head]  = NULL;
+    if (vq->dev->features & VIRTIO_RING_F_EVENT_IDX) {
+        WRITE_ONCE(*__vring_used_event(vq), vq->last_used);
+    }
+    return token;
+}
+
+bool_t virtqueue_enable_cb(virtqueue_t *vq)
+{
+    if (vq->dev->features & VIRTIO_RING_F_EVENT_IDX) {
+        WRITE_ONCE(*__vring_used_event(vq), vq->last_used);
+    } else {
+        vq->avail->flags &= ~VRING_AVAIL_F_NO_INTERRUPT;
+    }
+    // The device might have used a buffer before seeing the request.
+    __virtio_mb();
+    return READ_ONCE(vq->used->idx) != vq->last_used;
+}
+
+/// @}
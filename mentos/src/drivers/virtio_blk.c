@@ -0,0 +1,886 @@
+/// @file virtio_blk.c
+/// @brief Driver for the virtio block devices.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// Each request is a chain of a header read by the device, the data, and a
+/// status byte written by the device. When the device supports indirect
+/// descriptors the chain lives in a table of the request slot, and takes a
+/// single descriptor of the ring.
+/// @addtogroup virtio
+/// @{
+
+// Setup the logging for this file (do this before any other include).
+#include "sys/kernel_levels.h"           // Include kernel log levels.
+#define __DEBUG_HEADER__ "[VBLK  ]"      ///< Change header.
+#define __DEBUG_LEVEL__  LOGLEVEL_NOTICE ///< Set log level.
+#include "io/debug.h"                    // Include debugging functions.
+
+#include "drivers/virtio/virtio_blk.h"
+#include "drivers/virtio/virtio.h"
+
+#include "devices/pci.h"
+#include "fs/buffer_cache.h"
+#include "fs/vfs.h"
+#include "hardware/timer.h"
+#include "klib/irqflags.h"
+#include "math.h"
+#include "mem/kheap.h"
+#include "mem/paging.h"
+#include "process/scheduler.h"
+#include "process/wait.h"
+#include "stdio.h"
+#include "string.h"
+#include "sys/errno.h"
+#include "system/panic.h"
+#include "system/softirq.h"
+#include "system/syscall.h"
+#include "system/trace.h"
+
+#define VBLK_MAX_DISKS           4                                               ///< Maximum number of devices.
+#define VBLK_MAX_REQUESTS        32                                              ///< Maximum number of requests in flight on a device.
+#define VBLK_SECTOR_SIZE         512                                             ///< The sector size.
+#define VBLK_MAX_SECTORS         256                                             ///< Maximum number of sectors moved by a single request.
+#define VBLK_MAX_SEGMENTS        ((VBLK_MAX_SECTORS * VBLK_SECTOR_SIZE / PAGE_SIZE) + 1) ///< One segment per page, one more for an unaligned buffer.
+#define VBLK_BOUNCE_SECTORS      (VBLK_MAX_SECTORS * 2)                          ///< Sectors of the buffer used for the transfers from and to user memory.
+#define VBLK_MAX_DISK_SECTORS    (0xFFFFFFFFU / VBLK_SECTOR_SIZE)                ///< Sectors we can address with a 32-bit offset.
+#define VBLK_IRQ_TIMEOUT_SECONDS 5                                               ///< Seconds we wait for the completion of a request before giving up.
+
+#define VIRTIO_BLK_PCI_DEVICE 0x1001 ///< Device identifier of the transitional block devices.
+
+/// @name Features of the block devices.
+/// @{
+#define VIRTIO_BLK_F_SEG_MAX (1U << 2) ///< The device has a maximum number of segments per request.
+#define VIRTIO_BLK_F_RO      (1U << 5) ///< The device is read-only.
+#define VIRTIO_BLK_F_FLUSH   (1U << 9) ///< The device has a write-back cache, and supports flushing it.
+/// @}
+
+/// @name Configuration of the block devices.
+/// @{
+#define VIRTIO_BLK_CONFIG_CAPACITY    0x00 ///< Number of sectors, 64 bits.
+#define VIRTIO_BLK_CONFIG_CAPACITY_HI 0x04 ///< Number of sectors, upper 32 bits.
+#define VIRTIO_BLK_CONFIG_SEG_MAX     0x0C ///< Maximum number of segments per request.
+/// @}
+
+/// @name Types of requests.
+/// @{
+#define VIRTIO_BLK_T_IN    0 ///< Reads from the device.
+#define VIRTIO_BLK_T_OUT   1 ///< Writes on the device.
+#define VIRTIO_BLK_T_FLUSH 4 ///< Writes back the cache of the device.
+/// @}
+
+#define VIRTIO_BLK_S_OK 0 ///< The request succeeded.
+
+/// @brief The memory of a request slot, shared with the device.
+typedef struct vblk_slot_t {
+    uint32_t type;                                  ///< The type of request.
+    uint32_t reserved;                              ///< Reserved.
+    uint32_t sector;                                ///< The first sector.
+    uint32_t sector_hi;                             ///< The first sector, upper 32 bits.
+    uint8_t status;                                 ///< Written by the device.
+    uint8_t padding[15];                            ///< Keeps the table aligned.
+    vring_desc_t indirect[VBLK_MAX_SEGMENTS + 2];   ///< The chain of the request.
+} vblk_slot_t;
+
+/// @brief The memory a device shares with us.
+typedef struct vblk_memory_t {
+    vblk_slot_t slots[VBLK_MAX_REQUESTS]; ///< The request slots.
+    uint8_t scratch[VBLK_SECTOR_SIZE];    ///< Sector for partial transfers.
+} vblk_memory_t;
+
+/// @brief A virtio block device.
+typedef struct vblk_disk_t {
+    /// The device.
+    virtio_device_t dev;
+    /// The only queue of the device.
+    virtqueue_t *vq;
+    /// The memory shared with the device.
+    vblk_memory_t *mem;
+    /// The pages of the shared memory.
+    page_t *mem_page;
+    /// The physical address of the shared memory.
+    uint32_t mem_phys;
+    /// The request of each slot.
+    ata_request_t *requests[VBLK_MAX_REQUESTS];
+    /// The slots in use.
+    uint32_t busy;
+    /// The number of requests submitted and not yet completed.
+    volatile unsigned queued;
+    /// The number of sectors of the device.
+    uint32_t sectors;
+    /// The maximum number of sectors of a request.
+    uint32_t max_sectors;
+    /// The requests waiting for a free slot.
+    list_head pending;
+    /// The completed requests, whose end_request has not been called yet.
+    list_head completed;
+    /// Calls the end_request of the completed requests.
+    tasklet_t tasklet;
+    /// Tasks waiting for the completion of their requests.
+    wait_queue_head_t wait_queue;
+    /// The requests of the synchronous transfers.
+    ata_request_t sync_requests[VBLK_MAX_REQUESTS];
+    /// The request flushing the cache of the device.
+    ata_request_t flush_request;
+    /// The buffer of the transfers from and to user memory, allocated on use.
+    uint8_t *bounce;
+    /// The name of the device.
+    char name[NAME_MAX];
+    /// The path of the device.
+    char path[PATH_MAX];
+    /// The filesystem entry of the device.
+    vfs_file_t *fs_root;
+} vblk_disk_t;
+
+/// @brief Keeps track of a synchronous transfer.
+typedef struct vblk_sync_t {
+    /// The number of requests not yet completed.
+    volatile unsigned pending;
+    /// The status of the first failed request, 0 if none failed.
+    int status;
+} vblk_sync_t;
+
+/// @brief Keeps track of the incremental letters for the devices.
+static char vblk_drive_char = 'a';
+/// @brief The PCI addresses of the devices.
+static uint32_t vblk_pci[VBLK_MAX_DISKS];
+/// @brief The devices.
+static vblk_disk_t *vblk_disks[VBLK_MAX_DISKS];
+/// @brief Set once the interrupts of the devices are enabled.
+static bool_t vblk_irq_ready = false;
+
+/// @brief Returns the identifier of the device inside the traces.
+/// @param disk the device.
+/// @return the base of its I/O ports.
+static inline uint32_t __vblk_trace_id(vblk_disk_t *disk)
+{
+    return disk->dev.io_base;
+}
+
+/// @brief Returns the size of the device in bytes.
+/// @param disk the device.
+/// @return the size.
+static inline uint32_t __vblk_max_offset(vblk_disk_t *disk)
+{
+    return disk->sectors * VBLK_SECTOR_SIZE;
+}
+
+/// @brief Checks if the device can move data directly from and to the given
+/// buffer.
+/// @param buffer the buffer.
+/// @return true if it is in kernel memory.
+static inline bool_t __vblk_dma_capable(const void *buffer)
+{
+    return (uintptr_t)buffer >= PROCAREA_END_ADDR;
+}
+
+/// @brief Returns the physical address of a field of the shared memory.
+/// @param disk the device.
+/// @param address the virtual address of the field.
+/// @return the physical address.
+static inline uint32_t __vblk_phys(vblk_disk_t *disk, const void *address)
+{
+    return disk->mem_phys + ((uintptr_t)address - (uintptr_t)disk->mem);
+}
+
+// == REQUESTS ================================================================
+
+/// @brief Describes a kernel buffer with segments.
+/// @param sg where the segments are stored.
+/// @param max the maximum number of segments.
+/// @param pages the page frames of the buffer, NULL to translate its addresses.
+/// @param buffer the buffer, see __vblk_dma_capable, or the offset inside the
+/// first page frame.
+/// @param size the number of bytes.
+/// @return the number of segments, -EINVAL if the buffer needs too many.
+static int __vblk_map_buffer(virtio_sg_t *sg, unsigned max, page_t **pages, const void *buffer, size_t size)
+{
+    page_directory_t *pgd = paging_get_main_directory();
+    uintptr_t address     = (uintptr_t)buffer;
+    int count             = 0;
+    while (size > 0) {
+        uint32_t offset = address & (PAGE_SIZE - 1);
+        size_t chunk    = min(PAGE_SIZE - offset, size);
+        page_t *page    = pages ? pages[address / PAGE_SIZE] : mem_virtual_to_page(pgd, address - offset, NULL);
+        uint32_t phys   = get_physical_address_from_page(page) + offset;
+        if (count && ((sg[count - 1].addr + sg[count - 1].len) == phys)) {
+            sg[count - 1].len += chunk;
+        } else {
+            if (count == (int)max) {
+                return -EINVAL;
+            }
+            sg[count].addr  = phys;
+            sg[count++].len = chunk;
+        }
+        address += chunk;
+        size -= chunk;
+    }
+    return count;
+}
+
+/// @brief Publishes a request on the queue.
+/// @param disk the device.
+/// @param slot the free slot.
+/// @param request the request, with count zero for a flush.
+/// @return 0 on success, -ENOSPC if the queue is full.
+static int __vblk_start_request(vblk_disk_t *disk, unsigned slot, ata_request_t *request)
+{
+    virtio_sg_t sg[VBLK_MAX_SEGMENTS + 2];
+    vblk_slot_t *memory = &disk->mem->slots[slot];
+    bool_t write        = (request->direction == ata_request_write);
+    int segments        = 0;
+    if (request->count) {
+        memory->type = write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+        segments     = __vblk_map_buffer(sg + 1, VBLK_MAX_SEGMENTS, request->pages,
+                                         request->pages ? (void *)request->offset : request->buffer,
+                                         request->count * VBLK_SECTOR_SIZE);
+    } else {
+        memory->type = VIRTIO_BLK_T_FLUSH;
+    }
+    memory->reserved  = 0;
+    memory->sector    = request->lba_sector;
+    memory->sector_hi = 0;
+    memory->status    = 0xFF;
+    sg[0].addr        = __vblk_phys(disk, memory);
+    sg[0].len         = 16;
+    sg[segments + 1].addr = __vblk_phys(disk, &memory->status);
+    sg[segments + 1].len  = 1;
+    virtio_indirect_t indirect = {
+        .desc = memory->indirect,
+        .phys = __vblk_phys(disk, memory->indirect),
+        .size = VBLK_MAX_SEGMENTS + 2,
+    };
+    // The device reads the header and the data of a write, and writes the
+    // data of a read and the status.
+    unsigned out = 1 + (write ? segments : 0);
+    int ret      = virtqueue_add(disk->vq, sg, out, segments + 2 - out, &indirect, memory);
+    if (ret < 0) {
+        return ret;
+    }
+    disk->requests[slot] = request;
+    disk->busy |= (1U << slot);
+    trace_event(TRACE_BLOCK_ISSUE, __vblk_trace_id(disk), request->lba_sector, request->count, write);
+    return 0;
+}
+
+/// @brief Publishes the pending requests, as long as there is room, and
+/// notifies the device.
+/// @param disk the device.
+/// @details Must be called with the interrupts disabled.
+static void __vblk_issue(vblk_disk_t *disk)
+{
+    bool_t added = false;
+    while (!list_head_empty(&disk->pending) && (disk->busy != 0xFFFFFFFFU)) {
+        ata_request_t *request = list_entry(disk->pending.next, ata_request_t, fifo_list);
+        if (__vblk_start_request(disk, __builtin_ctz(~disk->busy), request) < 0) {
+            break;
+        }
+        list_head_remove(&request->fifo_list);
+        added = true;
+    }
+    if (added) {
+        virtqueue_kick(disk->vq);
+    }
+}
+
+/// @brief Collects the requests used by the device.
+/// @param disk the device.
+/// @details Must be called with the interrupts disabled.
+static void __vblk_complete(vblk_disk_t *disk)
+{
+    vblk_slot_t *memory;
+    do {
+        while ((memory = (vblk_slot_t *)virtqueue_get_buf(disk->vq, NULL)) != NULL) {
+            unsigned slot          = memory - disk->mem->slots;
+            ata_request_t *request = disk->requests[slot];
+            disk->requests[slot]   = NULL;
+            disk->busy &= ~(1U << slot);
+            request->status = (memory->status == VIRTIO_BLK_S_OK) ? 0 : -EIO;
+            trace_event(TRACE_BLOCK_COMPLETE, __vblk_trace_id(disk), request->lba_sector, request->count, request->status);
+            list_head_insert_before(&request->fifo_list, &disk->completed);
+            --disk->queued;
+        }
+    } while (virtqueue_enable_cb(disk->vq));
+    __vblk_issue(disk);
+}
+
+/// @brief Calls the end_request of the completed requests.
+/// @param disk the device.
+static void __vblk_end_requests(vblk_disk_t *disk)
+{
+    while (1) {
+        uint8_t flags = irq_disable();
+        if (list_head_empty(&disk->completed)) {
+            irq_enable(flags);
+            break;
+        }
+        ata_request_t *request = list_entry(disk->completed.next, ata_request_t, fifo_list);
+        list_head_remove(&request->fifo_list);
+        irq_enable(flags);
+        if (request->end_request) {
+            request->end_request(request);
+        }
+    }
+}
+
+/// @brief Queues a request, and publishes it if there is room.
+/// @param disk the device.
+/// @param request the request.
+static void __vblk_submit(vblk_disk_t *disk, ata_request_t *request)
+{
+    uint8_t flags   = irq_disable();
+    request->status = 0;
+    list_head_insert_before(&request->fifo_list, &disk->pending);
+    ++disk->queued;
+    __vblk_issue(disk);
+    irq_enable(flags);
+}
+
+/// @brief Checks if we can wait for the completion IRQ instead of polling.
+/// @return true if we can sleep waiting for the IRQ, false otherwise.
+/// @details Until the first system call we are still booting, there is no
+/// process whose context the nested interrupts could rely upon.
+static inline bool_t __vblk_can_sleep(void)
+{
+    return vblk_irq_ready && (get_current_interrupt_stack_frame() != NULL);
+}
+
+/// @brief Waits until the given counter drops to zero.
+/// @param disk the device whose requests decrement the counter.
+/// @param pending the counter.
+/// @return 0 on success, -EIO if the device did not answer in time.
+/// @details As in the ATA driver, the calling task does not leave the CPU,
+/// which is halted until the next interrupt.
+static int __vblk_wait(vblk_disk_t *disk, volatile unsigned *pending)
+{
+    if (!__vblk_can_sleep()) {
+        while (*pending) {
+            uint8_t flags = irq_disable();
+            __vblk_complete(disk);
+            irq_enable(flags);
+            __vblk_end_requests(disk);
+        }
+        return 0;
+    }
+    task_struct *task   = scheduler_get_current_process();
+    unsigned long start = timer_get_ticks();
+    wait_queue_entry_t wait;
+    init_waitqueue_entry(&wait, task);
+    add_wait_queue(&disk->wait_queue, &wait);
+    scheduler_set_task_state(task, TASK_UNINTERRUPTIBLE);
+    while (*pending) {
+        if ((timer_get_ticks() - start) > (VBLK_IRQ_TIMEOUT_SECONDS * TICKS_PER_SECOND)) {
+            break;
+        }
+        __asm__ __volatile__("sti; hlt; cli" ::: "memory");
+    }
+    remove_wait_queue(&disk->wait_queue, &wait);
+    scheduler_set_task_state(task, TASK_RUNNING);
+    if (*pending) {
+        // The buffers are still owned by the device, we cannot give them back.
+        pr_emerg("[%s] Timed out waiting for the completion IRQ.\n", disk->name);
+        kernel_panic("The virtio block device is not answering.");
+    }
+    return 0;
+}
+
+// == SYNCHRONOUS TRANSFERS ===================================================
+
+/// @brief Completes a request of a synchronous transfer.
+/// @param request the request.
+static void __vblk_sync_end(ata_request_t *request)
+{
+    vblk_sync_t *sync = (vblk_sync_t *)request->private_data;
+    if (request->status && !sync->status) {
+        sync->status = request->status;
+    }
+    --sync->pending;
+}
+
+/// @brief Moves consecutive sectors between the device and a kernel buffer.
+/// @param disk the device.
+/// @param direction the direction of the transfer.
+/// @param lba_sector the first sector.
+/// @param count the number of sectors.
+/// @param buffer the buffer, see __vblk_dma_capable.
+/// @return 0 on success, -errno on failure.
+/// @details The transfer is split in requests of at most max_sectors
+/// sectors, which are all in flight at the same time.
+static int __vblk_transfer(vblk_disk_t *disk, ata_request_dir_t direction, uint32_t lba_sector, uint32_t count, uint8_t *buffer)
+{
+    vblk_sync_t sync;
+    while (count > 0) {
+        sync.pending = 0;
+        sync.status  = 0;
+        for (unsigned it = 0; (it < VBLK_MAX_REQUESTS) && (count > 0); ++it) {
+            uint32_t chunk         = min(count, disk->max_sectors);
+            ata_request_t *request = &disk->sync_requests[it];
+            request->direction     = direction;
+            request->lba_sector    = lba_sector;
+            request->count         = chunk;
+            request->buffer        = buffer;
+            request->end_request   = __vblk_sync_end;
+            request->private_data  = &sync;
+            ++sync.pending;
+            __vblk_submit(disk, request);
+            lba_sector += chunk;
+            count -= chunk;
+            buffer += chunk * VBLK_SECTOR_SIZE;
+        }
+        __vblk_wait(disk, &sync.pending);
+        if (sync.status) {
+            return sync.status;
+        }
+    }
+    return 0;
+}
+
+/// @brief Returns the buffer for the transfers from and to user memory.
+/// @param disk the device.
+/// @return the buffer, NULL if it cannot be allocated.
+static uint8_t *__vblk_bounce(vblk_disk_t *disk)
+{
+    if (disk->bounce == NULL) {
+        disk->bounce = (uint8_t *)kmalloc(VBLK_BOUNCE_SECTORS * VBLK_SECTOR_SIZE);
+    }
+    return disk->bounce;
+}
+
+// == VFS CALLBACKS ===========================================================
+
+/// @brief Implements the open function for a virtio block device.
+/// @param path the path to the device we want to open.
+/// @param flags we ignore these.
+/// @param mode we currently ignore this.
+/// @return the VFS file associated with the device.
+static vfs_file_t *vblk_open(const char *path, int flags, mode_t mode)
+{
+    pr_debug("vblk_open(%s, %d, %d)\n", path, flags, mode);
+    for (unsigned index = 0; index < VBLK_MAX_DISKS; ++index) {
+        vblk_disk_t *disk = vblk_disks[index];
+        if (disk && disk->fs_root && !strcmp(path, disk->path)) {
+            ++disk->fs_root->count;
+            return disk->fs_root;
+        }
+    }
+    return NULL;
+}
+
+/// @brief Closes a virtio block device.
+/// @param file the VFS file associated with the device.
+/// @return 0 on success, it panics on failure.
+static int vblk_close(vfs_file_t *file)
+{
+    pr_debug("vblk_close(%p)\n", file);
+    if (file->device == NULL) {
+        kernel_panic("Device not set.");
+    }
+    --file->count;
+    return 0;
+}
+
+/// @brief Reads from a virtio block device.
+/// @param file the VFS file associated with the device.
+/// @param buffer the buffer where we store what we read.
+/// @param offset the offset where we want to read.
+/// @param size the size of the buffer.
+/// @return the number of read characters, or -errno.
+/// @details Kernel buffers are read directly, user buffers go through the
+/// bounce buffer of the device.
+static ssize_t vblk_read(vfs_file_t *file, char *buffer, off_t offset, size_t size)
+{
+    vblk_disk_t *disk = (vblk_disk_t *)file->device;
+    if (disk == NULL) {
+        kernel_panic("Device not set.");
+    }
+    uint32_t lba_sector   = offset / VBLK_SECTOR_SIZE;
+    uint32_t start_offset = offset % VBLK_SECTOR_SIZE;
+    uint32_t max_offset   = __vblk_max_offset(disk);
+    uint32_t x_offset     = 0;
+    uint32_t chunk, count;
+    uint8_t *data;
+
+    if (offset > max_offset) {
+        return 0;
+    }
+    if ((offset + size) > max_offset) {
+        size = max_offset - offset;
+    }
+
+    // Read the unaligned head of the request.
+    if (start_offset && size) {
+        if (__vblk_transfer(disk, ata_request_read, lba_sector, 1, disk->mem->scratch)) {
+            return -EIO;
+        }
+        chunk = min(VBLK_SECTOR_SIZE - start_offset, size);
+        memcpy(buffer, disk->mem->scratch + start_offset, chunk);
+        x_offset += chunk;
+        ++lba_sector;
+    }
+
+    // Read the aligned body of the request.
+    while ((size - x_offset) >= VBLK_SECTOR_SIZE) {
+        count = (size - x_offset) / VBLK_SECTOR_SIZE;
+        data  = (uint8_t *)buffer + x_offset;
+        if (!__vblk_dma_capable(data)) {
+            if ((data = __vblk_bounce(disk)) == NULL) {
+                return -ENOMEM;
+            }
+            count = min(count, VBLK_BOUNCE_SECTORS);
+        }
+        if (__vblk_transfer(disk, ata_request_read, lba_sector, count, data)) {
+            return -EIO;
+        }
+        if (data == disk->bounce) {
+            memcpy(buffer + x_offset, data, count * VBLK_SECTOR_SIZE);
+        }
+        x_offset += count * VBLK_SECTOR_SIZE;
+        lba_sector += count;
+    }
+
+    // Read the unaligned tail of the request.
+    if (x_offset < size) {
+        if (__vblk_transfer(disk, ata_request_read, lba_sector, 1, disk->mem->scratch)) {
+            return -EIO;
+        }
+        memcpy(buffer + x_offset, disk->mem->scratch, size - x_offset);
+    }
+    return size;
+}
+
+/// @brief Writes on a virtio block device.
+/// @param file the VFS file associated with the device.
+/// @param buffer the buffer we use to write.
+/// @param offset the offset where we want to write.
+/// @param size the size of the buffer.
+/// @return the number of written characters, or -errno.
+/// @details Partial sectors at the edges of the request are handled with a
+/// read-modify-write.
+static ssize_t vblk_write(vfs_file_t *file, const void *buffer, off_t offset, size_t size)
+{
+    vblk_disk_t *disk = (vblk_disk_t *)file->device;
+    if (disk == NULL) {
+        kernel_panic("Device not set.");
+    }
+    if (disk->dev.features & VIRTIO_BLK_F_RO) {
+        return -EROFS;
+    }
+    uint32_t lba_sector   = offset / VBLK_SECTOR_SIZE;
+    uint32_t start_offset = offset % VBLK_SECTOR_SIZE;
+    uint32_t max_offset   = __vblk_max_offset(disk);
+    uint32_t x_offset     = 0;
+    uint32_t chunk, count;
+    uint8_t *data;
+
+    if (offset > max_offset) {
+        return -ENOSPC;
+    }
+    if ((offset + size) > max_offset) {
+        size = max_offset - offset;
+    }
+
+    // Write the unaligned head of the request.
+    if (start_offset && size) {
+        if (__vblk_transfer(disk, ata_request_read, lba_sector, 1, disk->mem->scratch)) {
+            return -EIO;
+        }
+        chunk = min(VBLK_SECTOR_SIZE - start_offset, size);
+        memcpy(disk->mem->scratch + start_offset, buffer, chunk);
+        if (__vblk_transfer(disk, ata_request_write, lba_sector, 1, disk->mem->scratch)) {
+            return -EIO;
+        }
+        x_offset += chunk;
+        ++lba_sector;
+    }
+
+    // Write the aligned body of the request.
+    while ((size - x_offset) >= VBLK_SECTOR_SIZE) {
+        count = (size - x_offset) / VBLK_SECTOR_SIZE;
+        data  = (uint8_t *)buffer + x_offset;
+        if (!__vblk_dma_capable(data)) {
+            if ((data = __vblk_bounce(disk)) == NULL) {
+                return -ENOMEM;
+            }
+            count = min(count, VBLK_BOUNCE_SECTORS);
+            memcpy(data, (const uint8_t *)buffer + x_offset, count * VBLK_SECTOR_SIZE);
+        }
+        if (__vblk_transfer(disk, ata_request_write, lba_sector, count, data)) {
+            return -EIO;
+        }
+        x_offset += count * VBLK_SECTOR_SIZE;
+        lba_sector += count;
+    }
+
+    // Write the unaligned tail of the request.
+    if (x_offset < size) {
+        if (__vblk_transfer(disk, ata_request_read, lba_sector, 1, disk->mem->scratch)) {
+            return -EIO;
+        }
+        memcpy(disk->mem->scratch, (const uint8_t *)buffer + x_offset, size - x_offset);
+        if (__vblk_transfer(disk, ata_request_write, lba_sector, 1, disk->mem->scratch)) {
+            return -EIO;
+        }
+    }
+    return size;
+}
+
+/// @brief Stats a virtio block device.
+/// @param disk the device.
+/// @param stat the stat buffer.
+/// @return 0 on success.
+static int __vblk_stat(const vblk_disk_t *disk, stat_t *stat)
+{
+    if (disk && disk->fs_root) {
+        stat->st_dev   = 0;
+        stat->st_ino   = 0;
+        stat->st_mode  = 0;
+        stat->st_uid   = 0;
+        stat->st_gid   = 0;
+        stat->st_atime = sys_time(NULL);
+        stat->st_mtime = sys_time(NULL);
+        stat->st_ctime = sys_time(NULL);
+        stat->st_size  = disk->fs_root->length;
+    }
+    return 0;
+}
+
+/// @brief Retrieves information concerning the file at the given position.
+/// @param file the file.
+/// @param stat the structure where the information are stored.
+/// @return 0 if success.
+static int vblk_fstat(vfs_file_t *file, stat_t *stat)
+{
+    return __vblk_stat(file->device, stat);
+}
+
+/// @brief Retrieves information concerning the file at the given position.
+/// @param path the path where the file resides.
+/// @param stat the structure where the information are stored.
+/// @return 0 if success.
+static int vblk_stat(const char *path, stat_t *stat)
+{
+    super_block_t *sb = vfs_get_superblock(path);
+    if (sb && sb->root) {
+        return __vblk_stat(sb->root->device, stat);
+    }
+    return -1;
+}
+
+/// @brief Writes back the cached blocks, and the cache of the device.
+/// @param file the VFS file associated with the device.
+/// @return 0 on success, -errno on failure.
+static int vblk_fsync(vfs_file_t *file)
+{
+    vblk_disk_t *disk = (vblk_disk_t *)file->device;
+    int ret           = buffer_sync(file);
+    if ((ret < 0) || !(disk->dev.features & VIRTIO_BLK_F_FLUSH)) {
+        return ret;
+    }
+    vblk_sync_t sync = { .pending = 1, .status = 0 };
+    // A request without sectors is a flush, it covers the writes completed
+    // before it was submitted.
+    disk->flush_request.direction    = ata_request_write;
+    disk->flush_request.lba_sector   = 0;
+    disk->flush_request.count        = 0;
+    disk->flush_request.buffer       = NULL;
+    disk->flush_request.end_request  = __vblk_sync_end;
+    disk->flush_request.private_data = &sync;
+    __vblk_submit(disk, &disk->flush_request);
+    __vblk_wait(disk, &sync.pending);
+    return sync.status;
+}
+
+// == VFS ENTRY GENERATION ====================================================
+/// Filesystem general operations.
+static vfs_sys_operations_t vblk_sys_operations = {
+    .mkdir_f   = NULL,
+    .rmdir_f   = NULL,
+    .stat_f    = vblk_stat,
+    .creat_f   = NULL,
+    .symlink_f = NULL,
+};
+
+/// Virtio block device file operations.
+static vfs_file_operations_t vblk_fs_operations = {
+    .open_f     = vblk_open,
+    .unlink_f   = NULL,
+    .close_f    = vblk_close,
+    .read_f     = vblk_read,
+    .write_f    = vblk_write,
+    .lseek_f    = NULL,
+    .stat_f     = vblk_fstat,
+    .ioctl_f    = NULL,
+    .getdents_f = NULL,
+    .readlink_f = NULL,
+    .fsync_f    = vblk_fsync,
+    .submit_f   = virtio_blk_submit_request,
+};
+
+/// @brief Creates a VFS file, starting from a virtio block device.
+/// @param disk the device.
+/// @return a pointer to the VFS file on success, NULL on failure.
+static vfs_file_t *vblk_device_create(vblk_disk_t *disk)
+{
+    vfs_file_t *file = kmem_cache_alloc(vfs_file_cache, GFP_KERNEL);
+    if (file == NULL) {
+        pr_err("Failed to create virtio block device.\n");
+        return NULL;
+    }
+    memcpy(file->name, disk->name, NAME_MAX);
+    file->device         = disk;
+    file->flags          = DT_BLK;
+    file->sys_operations = &vblk_sys_operations;
+    file->fs_operations  = &vblk_fs_operations;
+    return file;
+}
+
+int virtio_blk_submit_request(vfs_file_t *file, ata_request_t *request)
+{
+    vblk_disk_t *disk = (vblk_disk_t *)file->device;
+    if (!disk || !request->count || (request->count > disk->max_sectors) ||
+        (request->lba_sector >= disk->sectors) || (request->count > (disk->sectors - request->lba_sector)) ||
+        (!request->pages && !__vblk_dma_capable(request->buffer))) {
+        return -EINVAL;
+    }
+    if ((request->direction == ata_request_write) && (disk->dev.features & VIRTIO_BLK_F_RO)) {
+        return -EROFS;
+    }
+    __vblk_submit(disk, request);
+    return 0;
+}
+
+// == IRQ HANDLERS ============================================================
+
+/// @brief Calls the end_request of the completed requests, and wakes up the
+/// tasks waiting for them.
+/// @param data the device.
+static void vblk_irq_bottom_half(unsigned long data)
+{
+    vblk_disk_t *disk = (vblk_disk_t *)data;
+    __vblk_end_requests(disk);
+    wake_up(&disk->wait_queue);
+}
+
+/// @brief Handles the interrupts of the devices, which might share the line.
+/// @param f The interrupt stack frame.
+static void vblk_irq_handler(pt_regs *f)
+{
+    for (unsigned index = 0; index < VBLK_MAX_DISKS; ++index) {
+        vblk_disk_t *disk = vblk_disks[index];
+        // Reading the status acknowledges the interrupt.
+        if (disk && disk->vq && (virtio_isr(&disk->dev) & 1)) {
+            __vblk_complete(disk);
+            tasklet_schedule(&disk->tasklet);
+        }
+    }
+}
+
+// == INITIALIZE/FINALIZE VIRTIO-BLK ==========================================
+
+/// @brief Initializes the given device.
+/// @param index the index of the device.
+/// @return 0 on success, -errno on failure.
+static int __vblk_init(unsigned index)
+{
+    vblk_disk_t *disk = (vblk_disk_t *)kmalloc(sizeof(vblk_disk_t));
+    if (disk == NULL) {
+        return -ENOMEM;
+    }
+    memset(disk, 0, sizeof(vblk_disk_t));
+    disk->mem_page = _alloc_pages(GFP_KERNEL | __GFP_ZERO, find_nearest_order_greater(0, sizeof(vblk_memory_t)));
+    if (disk->mem_page == NULL) {
+        kfree(disk);
+        return -ENOMEM;
+    }
+    disk->mem      = (vblk_memory_t *)get_lowmem_address_from_page(disk->mem_page);
+    disk->mem_phys = get_physical_address_from_page(disk->mem_page);
+    disk->dev.pci  = vblk_pci[index];
+    list_head_init(&disk->pending);
+    list_head_init(&disk->completed);
+    init_waitqueue_head(&disk->wait_queue);
+    disk->tasklet = (tasklet_t)TASKLET_INIT(vblk_irq_bottom_half, (unsigned long)disk);
+    sprintf(disk->name, "vd%c", vblk_drive_char);
+    sprintf(disk->path, "/dev/vd%c", vblk_drive_char);
+
+    uint32_t features = VIRTIO_RING_F_INDIRECT_DESC | VIRTIO_RING_F_EVENT_IDX |
+                        VIRTIO_BLK_F_SEG_MAX | VIRTIO_BLK_F_RO | VIRTIO_BLK_F_FLUSH;
+    if (virtio_pci_init(&disk->dev, features) < 0) {
+        goto free_disk;
+    }
+    vblk_disks[index] = disk;
+    virtio_setup_irq(&disk->dev, vblk_irq_handler, "virtio-blk");
+    if ((disk->vq = virtio_find_vq(&disk->dev, 0)) == NULL) {
+        goto fail_device;
+    }
+    // Sizes above what a 32-bit offset reaches are truncated.
+    disk->sectors = virtio_config_read_32(&disk->dev, VIRTIO_BLK_CONFIG_CAPACITY);
+    if (virtio_config_read_32(&disk->dev, VIRTIO_BLK_CONFIG_CAPACITY_HI)) {
+        disk->sectors = 0xFFFFFFFFU;
+    }
+    disk->sectors     = min(disk->sectors, VBLK_MAX_DISK_SECTORS);
+    disk->max_sectors = VBLK_MAX_SECTORS;
+    if (disk->dev.features & VIRTIO_BLK_F_SEG_MAX) {
+        // In the worst case every page of the buffer is a segment.
+        uint32_t seg_max  = virtio_config_read_32(&disk->dev, VIRTIO_BLK_CONFIG_SEG_MAX);
+        uint32_t limit    = (seg_max > 1) ? ((seg_max - 1) * (PAGE_SIZE / VBLK_SECTOR_SIZE)) : 1;
+        disk->max_sectors = min(disk->max_sectors, limit);
+    }
+    virtio_driver_ok(&disk->dev);
+
+    if ((disk->fs_root = vblk_device_create(disk)) == NULL) {
+        goto fail_device;
+    }
+    disk->fs_root->length = __vblk_max_offset(disk);
+    if (!vfs_mount(disk->path, disk->fs_root)) {
+        pr_alert("Failed to mount virtio block device!\n");
+        kmem_cache_free(disk->fs_root);
+        goto fail_device;
+    }
+    pr_notice("[%s] %u sectors%s%s%s.\n", disk->name, disk->sectors,
+              (disk->dev.features & VIRTIO_RING_F_INDIRECT_DESC) ? ", indirect descriptors" : "",
+              (disk->dev.features & VIRTIO_RING_F_EVENT_IDX) ? ", event index" : "",
+              (disk->dev.features & VIRTIO_BLK_F_RO) ? ", read-only" : "");
+    ++vblk_drive_char;
+    return 0;
+
+fail_device:
+    // Resetting the device makes it forget the queue.
+    virtio_pci_init(&disk->dev, 0);
+    vblk_disks[index] = NULL;
+free_disk:
+    __free_pages(disk->mem_page);
+    kfree(disk);
+    return -EIO;
+}
+
+/// @brief Used while scanning the PCI interface.
+/// @param device the device we want to find.
+/// @param vendorid its vendor ID.
+/// @param deviceid its device ID.
+/// @param extra the number of devices found so far.
+static void pci_find_virtio_blk(uint32_t device, uint16_t vendorid, uint16_t deviceid, void *extra)
+{
+    unsigned *count = (unsigned *)extra;
+    if ((vendorid == VIRTIO_PCI_VENDOR) && (deviceid == VIRTIO_BLK_PCI_DEVICE) && (*count < VBLK_MAX_DISKS)) {
+        vblk_pci[(*count)++] = device;
+        pci_dump_device_data(device, vendorid, deviceid);
+    }
+}
+
+int virtio_blk_initialize(void)
+{
+    unsigned count = 0;
+    pci_scan(&pci_find_virtio_blk, -1, &count);
+    for (unsigned index = 0; index < count; ++index) {
+        __vblk_init(index);
+    }
+    vblk_irq_ready = true;
+    return 0;
+}
+
+int virtio_blk_finalize(void)
+{
+    return 0;
+}
+
+/// @}
@@ -0,0 +1,249 @@
+/// @file virtio_console.c
+/// @brief Driver for the virtio console.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// The characters written are queued inside a ring-buffer, and copied into
+/// the transmit slots shared with the device, a slot per buffer of the
+/// transmit queue; the interrupt frees the slots the device has used, and
+/// refills them. The receive queue always holds the receive slots, whose
+/// characters reach the terminal when hvc0 is part of the console.
+/// @addtogroup virtio
+/// @{
+
+// Setup the logging for this file (do this before any other include).
+#include "sys/kernel_levels.h"           // Include kernel log levels.
+#define __DEBUG_HEADER__ "[VCONS ]"      ///< Change header.
+#define __DEBUG_LEVEL__  LOGLEVEL_NOTICE ///< Set log level.
+#include "io/debug.h"                    // Include debugging functions.
+
+#include "drivers/virtio/virtio_console.h"
+#include "drivers/virtio/virtio.h"
+
+#include "devices/pci.h"
+#include "io/console.h"
+#include "klib/irqflags.h"
+#include "klib/stdatomic.h"
+#include "math.h"
+#include "ring_buffer.h"
+#include "string.h"
+#include "sys/errno.h"
+#include "system/softirq.h"
+
+#define VIRTIO_CONSOLE_PCI_DEVICE 0x1003 ///< Device identifier of the transitional consoles.
+
+#define VCON_RX_QUEUE     0   ///< The queue of the characters received.
+#define VCON_TX_QUEUE     1   ///< The queue of the characters sent.
+#define VCON_TX_SLOTS     8   ///< Buffers in flight on the transmit queue.
+#define VCON_TX_SLOT_SIZE 256 ///< Size of each transmit buffer.
+#define VCON_RX_SLOTS     8   ///< Buffers posted on the receive queue.
+#define VCON_RX_SLOT_SIZE 64  ///< Size of each receive buffer.
+
+/// The characters waiting for a transmit slot.
+DECLARE_FIXED_SIZE_RING_BUFFER(char, vcon_tx, 4096, 0)
+
+/// @brief The memory the device shares with us.
+typedef struct vcon_memory_t {
+    uint8_t tx[VCON_TX_SLOTS][VCON_TX_SLOT_SIZE]; ///< The transmit slots.
+    uint8_t rx[VCON_RX_SLOTS][VCON_RX_SLOT_SIZE]; ///< The receive slots.
+} vcon_memory_t;
+
+/// @brief The virtio console.
+typedef struct vcon_t {
+    /// The device.
+    virtio_device_t dev;
+    /// The receive queue.
+    virtqueue_t *rxq;
+    /// The transmit queue.
+    virtqueue_t *txq;
+    /// The memory shared with the device.
+    vcon_memory_t *mem;
+    /// The pages of the shared memory.
+    page_t *mem_page;
+    /// The physical address of the shared memory.
+    uint32_t mem_phys;
+    /// The transmit slots in use.
+    uint32_t tx_busy;
+    /// The characters waiting for a slot.
+    fs_rb_vcon_tx_t tx;
+    /// Delivers the characters received, outside of the interrupt handler.
+    tasklet_t tasklet;
+    /// If the device is ready.
+    bool_t ready;
+} vcon_t;
+
+/// The PCI address of the first console, 0 if there is none.
+static uint32_t vcon_pci = 0;
+/// The console.
+static vcon_t vcon;
+
+/// @brief Copies the queued characters into the free transmit slots.
+/// @details Must be called with the interrupts disabled.
+static void __vcon_push_tx(void)
+{
+    bool_t added = false;
+    while (!fs_rb_vcon_tx_empty(&vcon.tx) && (vcon.tx_busy != (1U << VCON_TX_SLOTS) - 1)) {
+        unsigned slot = __builtin_ctz(~vcon.tx_busy);
+        uint32_t len  = 0;
+        while ((len < VCON_TX_SLOT_SIZE) && !fs_rb_vcon_tx_empty(&vcon.tx)) {
+            vcon.mem->tx[slot][len++] = (uint8_t)fs_rb_vcon_tx_pop_back(&vcon.tx);
+        }
+        virtio_sg_t sg = { vcon.mem_phys + offsetof(vcon_memory_t, tx[slot]), len };
+        if (virtqueue_add(vcon.txq, &sg, 1, 0, NULL, vcon.mem->tx[slot]) < 0) {
+            break;
+        }
+        vcon.tx_busy |= 1U << slot;
+        added = true;
+    }
+    if (added) {
+        virtqueue_kick(vcon.txq);
+    }
+}
+
+/// @brief Frees the transmit slots used by the device.
+/// @details Must be called with the interrupts disabled.
+static void __vcon_collect_tx(void)
+{
+    uint8_t *buffer;
+    do {
+        while ((buffer = (uint8_t *)virtqueue_get_buf(vcon.txq, NULL)) != NULL) {
+            vcon.tx_busy &= ~(1U << ((buffer - vcon.mem->tx[0]) / VCON_TX_SLOT_SIZE));
+        }
+    } while (virtqueue_enable_cb(vcon.txq));
+    __vcon_push_tx();
+}
+
+/// @brief Posts a receive slot on the receive queue.
+/// @param slot the slot.
+/// @details Must be called with the interrupts disabled.
+static inline int __vcon_post_rx(unsigned slot)
+{
+    virtio_sg_t sg = { vcon.mem_phys + offsetof(vcon_memory_t, rx[slot]), VCON_RX_SLOT_SIZE };
+    return virtqueue_add(vcon.rxq, &sg, 0, 1, NULL, vcon.mem->rx[slot]);
+}
+
+void virtio_console_write(const char *buffer, size_t size)
+{
+    if (!vcon.ready) {
+        return;
+    }
+    uint8_t flags = irq_disable();
+    for (size_t i = 0; i < size; ++i) {
+        // Do not drop the characters, make room by waiting for the device.
+        while (fs_rb_vcon_tx_step(&vcon.tx, vcon.tx.write) == vcon.tx.read) {
+            __vcon_collect_tx();
+            cpu_relax();
+        }
+        fs_rb_vcon_tx_push_front(&vcon.tx, buffer[i]);
+    }
+    __vcon_push_tx();
+    irq_enable(flags);
+}
+
+// == IRQ HANDLERS ============================================================
+
+/// @brief Delivers the characters received to the console, and reposts the
+/// receive slots.
+/// @param data unused.
+static void vcon_irq_bottom_half(unsigned long data)
+{
+    char received[VCON_RX_SLOT_SIZE];
+    uint32_t len;
+    (void)data;
+    while (1) {
+        uint8_t flags   = irq_disable();
+        uint8_t *buffer = (uint8_t *)virtqueue_get_buf(vcon.rxq, &len);
+        if (buffer == NULL) {
+            bool_t again = virtqueue_enable_cb(vcon.rxq);
+            irq_enable(flags);
+            if (again) {
+                continue;
+            }
+            break;
+        }
+        len = min(len, VCON_RX_SLOT_SIZE);
+        memcpy(received, buffer, len);
+        __vcon_post_rx((buffer - vcon.mem->rx[0]) / VCON_RX_SLOT_SIZE);
+        virtqueue_kick(vcon.rxq);
+        irq_enable(flags);
+        // Without the console, there is nobody to read them.
+        for (uint32_t i = 0; i < len; ++i) {
+            console_input(CONSOLE_VIRTIO, (unsigned char)received[i]);
+        }
+    }
+}
+
+/// @brief Handles the interrupts of the console, which might share the line.
+/// @param f The interrupt stack frame.
+static void vcon_irq_handler(pt_regs *f)
+{
+    // Reading the status acknowledges the interrupt.
+    if (vcon.ready && (virtio_isr(&vcon.dev) & 1)) {
+        __vcon_collect_tx();
+        tasklet_schedule(&vcon.tasklet);
+    }
+}
+
+// == INITIALIZE/FINALIZE VIRTIO-CONSOLE ======================================
+
+/// @brief Used while scanning the PCI interface.
+/// @param device the device we want to find.
+/// @param vendorid its vendor ID.
+/// @param deviceid its device ID.
+/// @param extra unused.
+static void pci_find_virtio_console(uint32_t device, uint16_t vendorid, uint16_t deviceid, void *extra)
+{
+    if ((vendorid == VIRTIO_PCI_VENDOR) && (deviceid == VIRTIO_CONSOLE_PCI_DEVICE) && !vcon_pci) {
+        vcon_pci = device;
+        pci_dump_device_data(device, vendorid, deviceid);
+    }
+}
+
+int virtio_console_initialize(void)
+{
+    pci_scan(&pci_find_virtio_console, -1, NULL);
+    if (!vcon_pci) {
+        return 0;
+    }
+    memset(&vcon, 0, sizeof(vcon_t));
+    vcon.mem_page = _alloc_pages(GFP_KERNEL | __GFP_ZERO, find_nearest_order_greater(0, sizeof(vcon_memory_t)));
+    if (vcon.mem_page == NULL) {
+        return 1;
+    }
+    vcon.mem      = (vcon_memory_t *)get_lowmem_address_from_page(vcon.mem_page);
+    vcon.mem_phys = get_physical_address_from_page(vcon.mem_page);
+    vcon.dev.pci  = vcon_pci;
+    vcon.tasklet  = (tasklet_t)TASKLET_INIT(vcon_irq_bottom_half, 0);
+    fs_rb_vcon_tx_init(&vcon.tx);
+
+    if (virtio_pci_init(&vcon.dev, VIRTIO_RING_F_EVENT_IDX) < 0) {
+        goto free_memory;
+    }
+    virtio_setup_irq(&vcon.dev, vcon_irq_handler, "virtio-console");
+    if (((vcon.rxq = virtio_find_vq(&vcon.dev, VCON_RX_QUEUE)) == NULL) ||
+        ((vcon.txq = virtio_find_vq(&vcon.dev, VCON_TX_QUEUE)) == NULL)) {
+        goto fail_device;
+    }
+    for (unsigned slot = 0; slot < VCON_RX_SLOTS; ++slot) {
+        __vcon_post_rx(slot);
+    }
+    virtio_driver_ok(&vcon.dev);
+    virtqueue_kick(vcon.rxq);
+    vcon.ready = true;
+    pr_notice("[hvc0] virtio console%s.\n", (vcon.dev.features & VIRTIO_RING_F_EVENT_IDX) ? ", event index" : "");
+    return 0;
+
+fail_device:
+    // Resetting the device makes it forget the queues.
+    virtio_pci_init(&vcon.dev, 0);
+free_memory:
+    __free_pages(vcon.mem_page);
+    return 1;
+}
+
+int virtio_console_finalize(void)
+{
+    return 0;
+}
+
+/// @}
@@ -11,8 +11,12 @@
 
 #include "assert.h"
 #include "elf/elf.h"
+#include "fcntl.h"
 #include "fs/vfs.h"
+#include "limits.h"
+#include "math.h"
 #include "mem/paging.h"
+#include "mem/shrinker.h"
 #include "mem/slab.h"
 #include "mem/vmem_map.h"
 #include "process/process.h"
@@ -20,6 +24,8 @@
 #include "stddef.h"
 #include "stdio.h"
 #include "string.h"
+#include "sys/errno.h"
+#include "sys/mman.h"
 
 // ============================================================================
 // GET ELF TABLES
@@ -225,79 +231,254 @@ static inline void elf_dump_symbol_table(elf_header_t *header)
 // EXEC-RELATED FUNCTIONS
 // ============================================================================
 
-/// @brief Loads an ELF executable.
+/// @brief Loads a segment by copying its content, used when it cannot be mapped.
 /// @param task The task for which we load the ELF.
 /// @param file The ELF file.
-/// @param header  The header of the ELF file.
-/// @return The ELF entry.
-static inline int elf_load_exec(elf_header_t *header, task_struct *task)
+/// @param program_header The header of the segment.
+/// @param bias The offset added to the addresses of the segment.
+/// @return 1 on success, 0 on failure.
+static inline int elf_copy_segment(task_struct *task, vfs_file_t *file, elf_program_header_t *program_header, uint32_t bias)
 {
-    elf_program_header_t *program_header;
     vm_area_struct_t *segment;
     virt_map_page_t *vpage;
     uint32_t dst_addr, zmem_sz;
+    int ret = true;
+
+    segment = create_vm_area(
+        task->mm,
+        program_header->vaddr + bias,
+        program_header->memsz,
+        MM_USER | MM_RW | MM_COW,
+        GFP_KERNEL);
+    vpage    = virt_map_alloc(program_header->memsz);
+    dst_addr = virt_map_vaddress(task->mm, vpage, segment->vm_start, program_header->memsz);
+
+    // Load the memory area.
+    if (vfs_read(file, (void *)dst_addr, program_header->offset, program_header->filesz) != program_header->filesz) {
+        pr_err("Failed to read the segment at offset 0x%x.\n", program_header->offset);
+        ret = false;
+    }
+
+    if (program_header->memsz > program_header->filesz) {
+        zmem_sz = program_header->memsz - program_header->filesz;
+        memset((void *)(dst_addr + program_header->filesz), 0, zmem_sz);
+    }
+    virt_unmap_pg(vpage);
+    return ret;
+}
+
+/// @brief Loads an ELF executable.
+/// @param header The header of the ELF file.
+/// @param program_headers The program headers of the ELF file.
+/// @param file The ELF file.
+/// @param task The task for which we load the ELF.
+/// @param bias The offset added to the addresses of the segments.
+/// @return 1 on success, 0 on failure.
+/// @details Loadable segments are mapped from the file, and their pages are
+/// read through the page cache the first time they are touched.
+static inline int elf_load_exec(elf_header_t *header, elf_program_header_t *program_headers, vfs_file_t *file, task_struct *task, uint32_t bias)
+{
+    elf_program_header_t *program_header;
+    uint32_t vaddr, vm_start, vm_end;
 
     pr_debug(" Type      | Mem. Size | File Size | VADDR\n");
     for (unsigned i = 0; i < header->phnum; ++i) {
         // Get the header.
-        program_header = elf_get_program_header(header, i);
+        program_header = &program_headers[i];
+        vaddr          = program_header->vaddr + bias;
         // Dump the information about the header.
         pr_debug(" %-9s | %9s | %9s | 0x%08x - 0x%08x\n",
                  elf_type_to_string(program_header->type),
                  to_human_size(program_header->memsz),
                  to_human_size(program_header->filesz),
-                 program_header->vaddr,
-                 program_header->vaddr + program_header->memsz);
-        if (program_header->type == PT_LOAD) {
-            segment = create_vm_area(
-                task->mm,
-                program_header->vaddr,
-                program_header->memsz,
-                MM_USER | MM_RW | MM_COW,
-                GFP_KERNEL);
-            vpage    = virt_map_alloc(program_header->memsz);
-            dst_addr = virt_map_vaddress(task->mm, vpage, segment->vm_start, program_header->memsz);
-
-            // Load the memory area.
-            memcpy((void *)dst_addr, (void *)((uintptr_t)header + program_header->offset), program_header->filesz);
-
-            if (program_header->memsz > program_header->filesz) {
-                zmem_sz = program_header->memsz - program_header->filesz;
-                memset((void *)(dst_addr + program_header->filesz), 0, zmem_sz);
+                 vaddr,
+                 vaddr + program_header->memsz);
+        if (program_header->type != PT_LOAD) {
+            continue;
+        }
+        // The area covers whole pages.
+        vm_start = vaddr & ~(PAGE_SIZE - 1);
+        vm_end   = (vaddr + program_header->memsz + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+        // The segment can be mapped only if it is at the same offset, inside
+        // the page, in the file and in memory, and if it does not share a
+        // page with another segment.
+        if (((vaddr % PAGE_SIZE) != (program_header->offset % PAGE_SIZE)) ||
+            (is_valid_vm_area(task->mm, vm_start, vm_end) <= 0)) {
+            if (!elf_copy_segment(task, file, program_header, bias)) {
+                return false;
             }
-            virt_unmap_pg(vpage);
+            continue;
         }
+        create_file_vm_area(
+            task->mm,
+            vm_start,
+            vm_end - vm_start,
+            file,
+            (program_header->offset - (vaddr - vm_start)) / PAGE_SIZE,
+            (vaddr - vm_start) + program_header->filesz,
+            PROT_READ | ((program_header->flags & PF_W) ? PROT_WRITE : 0),
+            MAP_PRIVATE);
     }
     return true;
 }
 
-int elf_load_file(task_struct *task, vfs_file_t *file, uint32_t *entry)
+/// @brief Finds where the program headers end up in memory.
+/// @param header The header of the ELF file.
+/// @param program_headers The program headers of the ELF file.
+/// @param bias The offset added to the addresses of the segments.
+/// @return the address of the program headers, 0 if no segment loads them.
+static inline uint32_t elf_program_headers_address(elf_header_t *header, elf_program_header_t *program_headers, uint32_t bias)
 {
-    // Open the file.
-    if (file == NULL) {
-        return false;
+    for (unsigned i = 0; i < header->phnum; ++i) {
+        if (program_headers[i].type == PT_PHDR) {
+            return program_headers[i].vaddr + bias;
+        }
     }
-    // Get the size of the file.
-    stat_t stat_buf;
-    if (vfs_fstat(file, &stat_buf) < 0) {
-        pr_err("Failed to stat the file `%s`.\n", file->name);
-        return false;
+    for (unsigned i = 0; i < header->phnum; ++i) {
+        if ((program_headers[i].type == PT_LOAD) &&
+            (program_headers[i].offset <= header->phoff) &&
+            (header->phoff + header->phnum * sizeof(elf_program_header_t) <= program_headers[i].offset + program_headers[i].filesz)) {
+            return program_headers[i].vaddr + (header->phoff - program_headers[i].offset) + bias;
+        }
     }
-    // Allocate the memory for the file.
-    char *buffer = kmalloc(stat_buf.st_size);
-    if (buffer == NULL) {
-        pr_err("Failed to allocate %d bytes of memory for reading the file `%s`.\n", stat_buf.st_size, file->name);
-        return false;
+    return 0;
+}
+
+// ============================================================================
+// EXEC IMAGE CACHE
+// ============================================================================
+
+/// Number of executables whose validated headers are kept.
+#define ELF_CACHE_MAX 16
+
+/// @brief The validated headers of an executable, and its layout, kept so
+/// that executing it again reads and checks nothing.
+typedef struct elf_cache_entry_t {
+    /// The filesystem instance the inode belongs to.
+    const void *owner;
+    /// The inode of the file.
+    uint32_t ino;
+    /// The size of the file when it was cached.
+    uint32_t length;
+    /// The modification time of the file when it was cached.
+    uint32_t mtime;
+    /// The change time of the file when it was cached.
+    uint32_t ctime;
+    /// The ELF header.
+    elf_header_t header;
+    /// The program headers.
+    elf_program_header_t *program_headers;
+    /// The first page of the loadable segments, before the load bias.
+    uint32_t load_start;
+    /// The end of the loadable segments, page aligned, before the load bias.
+    uint32_t load_end;
+    /// The address of the program headers before the load bias, 0 if they
+    /// are not inside a loaded segment.
+    uint32_t phdr;
+    /// The interpreter named by PT_INTERP, NULL if there is none.
+    char *interpreter;
+    /// The number of loads using the entry.
+    int refcount;
+    /// Set when the file changed while the entry was in use.
+    bool_t stale;
+    /// Link inside the cache, the most recently used comes first.
+    list_head list;
+} elf_cache_entry_t;
+
+/// @brief The cache of the executables.
+static struct {
+    /// The entries, the most recently used comes first.
+    list_head lru;
+    /// The number of entries.
+    unsigned int size;
+    /// Set once the shrinker has been registered.
+    bool_t registered;
+} elf_cache = { .lru = { &elf_cache.lru, &elf_cache.lru } };
+
+/// @brief Frees an entry.
+/// @param entry The entry.
+static inline void __elf_cache_free(elf_cache_entry_t *entry)
+{
+    if (entry->interpreter) {
+        kfree(entry->interpreter);
+    }
+    kfree(entry->program_headers);
+    kfree(entry);
+}
+
+/// @brief Removes an entry from the cache, it is freed once not in use.
+/// @param entry The entry.
+static inline void __elf_cache_drop(elf_cache_entry_t *entry)
+{
+    list_head_remove(&entry->list);
+    --elf_cache.size;
+    if (entry->refcount) {
+        entry->stale = true;
+    } else {
+        __elf_cache_free(entry);
     }
-    // Clean the memory.
-    memset(buffer, 0, stat_buf.st_size);
-    // Read the file.
-    if (vfs_read(file, buffer, 0, stat_buf.st_size) != stat_buf.st_size) {
-        pr_err("Failed to read %d bytes from the file `%s`.\n", stat_buf.st_size, file->name);
-        goto return_error_free_buffer;
+}
+
+/// @brief Releases an entry taken with __elf_cache_get.
+/// @param entry The entry.
+static inline void __elf_cache_put(elf_cache_entry_t *entry)
+{
+    if ((--entry->refcount == 0) && entry->stale) {
+        __elf_cache_free(entry);
     }
+}
+
+/// @brief Drops the least recently used entries which are not in use.
+/// @param nr_entries The number of entries to drop.
+/// @return the number of entries dropped.
+static unsigned long __elf_cache_evict(unsigned long nr_entries)
+{
+    unsigned long dropped = 0;
+    list_head *it         = elf_cache.lru.prev;
+    while ((it != &elf_cache.lru) && (dropped < nr_entries)) {
+        elf_cache_entry_t *entry = list_entry(it, elf_cache_entry_t, list);
+        it                       = it->prev;
+        if (entry->refcount == 0) {
+            __elf_cache_drop(entry);
+            ++dropped;
+        }
+    }
+    return dropped;
+}
+
+/// @brief Returns the number of entries the shrinker can drop.
+/// @return the number of entries.
+static unsigned long __elf_cache_count_objects(void)
+{
+    return elf_cache.size;
+}
+
+/// @brief Gives the entries back under memory pressure.
+static shrinker_t elf_cache_shrinker = {
+    .name          = "elf_cache",
+    .count_objects = __elf_cache_count_objects,
+    .scan_objects  = __elf_cache_evict,
+};
+
+/// @brief Reads and checks the headers of an ELF file, and its layout.
+/// @param file The ELF file.
+/// @return a new entry, NULL if the file is not a valid ELF.
+/// @details Files which do not start with the ELF magic number are rejected
+/// silently, they might be scripts.
+static elf_cache_entry_t *__elf_cache_read(vfs_file_t *file)
+{
+    elf_cache_entry_t *entry = kmalloc(sizeof(elf_cache_entry_t));
+    if (entry == NULL) {
+        return NULL;
+    }
+    memset(entry, 0, sizeof(elf_cache_entry_t));
+    elf_header_t *header = &entry->header;
     // The first thing inside the file is the ELF header.
-    elf_header_t *header = (elf_header_t *)buffer;
+    if ((vfs_read(file, header, 0, sizeof(elf_header_t)) != sizeof(elf_header_t)) ||
+        (header->ident[EI_MAG0] != ELFMAG0) || (header->ident[EI_MAG1] != ELFMAG1) ||
+        (header->ident[EI_MAG2] != ELFMAG2) || (header->ident[EI_MAG3] != ELFMAG3)) {
+        goto free_entry;
+    }
     // Print header info.
     pr_debug("Type           : %s\n", elf_type_to_string(header->type));
     pr_debug("Version        : 0x%x\n", header->version);
@@ -306,27 +487,324 @@ int elf_load_file(task_struct *task, vfs_file_t *file, uint32_t *entry)
     pr_debug("Headers count  : %d\n", header->phnum);
     // Check the elf header.
     if (!elf_check_file_header(header)) {
-        pr_err("File %s is not a valid ELF file.\n", stat_buf.st_size, file->name);
-        goto return_error_free_buffer;
+        pr_err("File %s is not a valid ELF file.\n", file->name);
+        goto free_entry;
     }
-    // Check if the elf file is an executable.
-    if (header->type != ET_EXEC) {
-        pr_err("Elf file is not an executable.\n");
-        goto return_error_free_buffer;
+    if ((header->phnum == 0) || (header->phentsize != sizeof(elf_program_header_t))) {
+        pr_err("File %s has no valid program headers.\n", file->name);
+        goto free_entry;
     }
-    if (!elf_load_exec(header, task)) {
-        pr_err("Failed to load the executable.\n");
-        goto return_error_free_buffer;
+    // Read only the program headers, the segments are read on demand.
+    size_t size             = header->phnum * sizeof(elf_program_header_t);
+    entry->program_headers = kmalloc(size);
+    if (entry->program_headers == NULL) {
+        pr_err("Failed to allocate %d bytes of memory for the program headers of `%s`.\n", size, file->name);
+        goto free_entry;
+    }
+    if (vfs_read(file, entry->program_headers, header->phoff, size) != size) {
+        pr_err("Failed to read the program headers of the file `%s`.\n", file->name);
+        goto free_entry;
     }
+    // The segments keep their distance from each other, the span they cover
+    // is what a position independent file needs.
+    entry->load_start = ~0U;
+    for (unsigned i = 0; i < header->phnum; ++i) {
+        elf_program_header_t *program_header = &entry->program_headers[i];
+        if (program_header->type != PT_LOAD) {
+            continue;
+        }
+        if ((program_header->filesz > program_header->memsz) ||
+            (program_header->offset + program_header->filesz > file->length)) {
+            pr_err("File %s has a segment outside of the file.\n", file->name);
+            goto free_entry;
+        }
+        entry->load_start = min(entry->load_start, program_header->vaddr & ~(PAGE_SIZE - 1));
+        entry->load_end   = max(entry->load_end, (program_header->vaddr + program_header->memsz + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1));
+    }
+    if (entry->load_start >= entry->load_end) {
+        pr_err("File %s has nothing to load.\n", file->name);
+        goto free_entry;
+    }
+    entry->phdr = elf_program_headers_address(header, entry->program_headers, 0);
+    for (unsigned i = 0; i < header->phnum; ++i) {
+        elf_program_header_t *program_header = &entry->program_headers[i];
+        if (program_header->type != PT_INTERP) {
+            continue;
+        }
+        if ((program_header->filesz < 2) || (program_header->filesz > PATH_MAX) ||
+            ((entry->interpreter = kmalloc(program_header->filesz)) == NULL) ||
+            (vfs_read(file, entry->interpreter, program_header->offset, program_header->filesz) != program_header->filesz) ||
+            (entry->interpreter[program_header->filesz - 1] != 0)) {
+            pr_err("The interpreter of `%s` is not valid.\n", file->name);
+            goto free_entry;
+        }
+    }
+    return entry;
+free_entry:
+    if (entry->interpreter) {
+        kfree(entry->interpreter);
+    }
+    if (entry->program_headers) {
+        kfree(entry->program_headers);
+    }
+    kfree(entry);
+    return NULL;
+}
 
-    // Set the entry.
-    (*entry) = header->entry;
+/// @brief Returns the headers of an ELF file, read only the first time.
+/// @param file The ELF file.
+/// @return the entry, which must be released with __elf_cache_put, NULL if
+/// the file is not a valid ELF.
+static elf_cache_entry_t *__elf_cache_get(vfs_file_t *file)
+{
+    elf_cache_entry_t *entry;
+    list_for_each_decl(it, &elf_cache.lru)
+    {
+        entry = list_entry(it, elf_cache_entry_t, list);
+        if ((entry->owner != file->device) || (entry->ino != file->ino)) {
+            continue;
+        }
+        // The inode might have been replaced, or rewritten.
+        if ((entry->length != file->length) || (entry->mtime != file->mtime) || (entry->ctime != file->ctime)) {
+            __elf_cache_drop(entry);
+            break;
+        }
+        list_head_remove(&entry->list);
+        list_head_insert_after(&entry->list, &elf_cache.lru);
+        ++entry->refcount;
+        return entry;
+    }
+    if ((entry = __elf_cache_read(file)) == NULL) {
+        return NULL;
+    }
+    entry->owner    = file->device;
+    entry->ino      = file->ino;
+    entry->length   = file->length;
+    entry->mtime    = file->mtime;
+    entry->ctime    = file->ctime;
+    entry->refcount = 1;
+    list_head_insert_after(&entry->list, &elf_cache.lru);
+    if (++elf_cache.size > ELF_CACHE_MAX) {
+        __elf_cache_evict(elf_cache.size - ELF_CACHE_MAX);
+    }
+    if (!elf_cache.registered) {
+        register_shrinker(&elf_cache_shrinker);
+        elf_cache.registered = true;
+    }
+    return entry;
+}
+
+void elf_cache_invalidate(vfs_file_t *file)
+{
+    list_for_each_decl(it, &elf_cache.lru)
+    {
+        elf_cache_entry_t *entry = list_entry(it, elf_cache_entry_t, list);
+        if ((entry->owner == file->device) && (entry->ino == file->ino)) {
+            __elf_cache_drop(entry);
+            return;
+        }
+    }
+}
+
+// ============================================================================
+// KERNEL SYMBOLS
+// ============================================================================
+
+/// @brief A function of the kernel.
+typedef struct elf_kernel_symbol_t {
+    /// The address of its first instruction.
+    uint32_t address;
+    /// Its size in bytes, 0 if unknown.
+    uint32_t size;
+    /// Its name.
+    const char *name;
+} elf_kernel_symbol_t;
+
+/// The functions of the kernel, sorted by address.
+static elf_kernel_symbol_t *kernel_symbols;
+/// The number of functions of the kernel.
+static unsigned kernel_symbols_count;
+
+int elf_load_kernel_symbols(elf_header_t *header)
+{
+    if (!elf_check_magic_number(header)) {
+        return -ENOEXEC;
+    }
+    for (unsigned i = 0; i < header->shnum; ++i) {
+        elf_section_header_t *section_header = elf_get_section_header(header, i);
+        if (section_header->type != SHT_SYMTAB) {
+            continue;
+        }
+        unsigned symtab_entries = section_header->size / section_header->entsize;
+        elf_symbol_t *symtab    = (elf_symbol_t *)((uintptr_t)header + section_header->offset);
+        // Count the functions, and the room for their names.
+        unsigned count = 0;
+        size_t names   = 0;
+        for (unsigned j = 0; j < symtab_entries; ++j) {
+            const char *name = elf_get_symbol_name(header, section_header, &symtab[j]);
+            if ((ELF32_ST_TYPE(symtab[j].info) == STT_FUNC) && symtab[j].value && name) {
+                names += strlen(name) + 1;
+                ++count;
+            }
+        }
+        // The names follow the symbols, inside the same allocation.
+        kernel_symbols = (elf_kernel_symbol_t *)kmalloc(count * sizeof(elf_kernel_symbol_t) + names);
+        if (kernel_symbols == NULL) {
+            return -ENOMEM;
+        }
+        char *strings = (char *)&kernel_symbols[count];
+        for (unsigned j = 0; j < symtab_entries; ++j) {
+            const char *name = elf_get_symbol_name(header, section_header, &symtab[j]);
+            if ((ELF32_ST_TYPE(symtab[j].info) == STT_FUNC) && symtab[j].value && name) {
+                elf_kernel_symbol_t *symbol = &kernel_symbols[kernel_symbols_count++];
+                symbol->address             = symtab[j].value;
+                symbol->size                = symtab[j].size;
+                symbol->name                = strcpy(strings, name);
+                strings += strlen(name) + 1;
+            }
+        }
+        // Sort them by address, with a shell sort, there are thousands.
+        for (unsigned gap = kernel_symbols_count / 2; gap > 0; gap /= 2) {
+            for (unsigned j = gap; j < kernel_symbols_count; ++j) {
+                elf_kernel_symbol_t symbol = kernel_symbols[j];
+                unsigned k                 = j;
+                for (; (k >= gap) && (kernel_symbols[k - gap].address > symbol.address); k -= gap) {
+                    kernel_symbols[k] = kernel_symbols[k - gap];
+                }
+                kernel_symbols[k] = symbol;
+            }
+        }
+        pr_debug("Loaded %u symbols of the kernel.\n", kernel_symbols_count);
+        return 0;
+    }
+    return -ENOENT;
+}
+
+const char *elf_kernel_symbol(uint32_t address, uint32_t *offset)
+{
+    // Find the last function starting at, or before, the address.
+    unsigned low = 0, high = kernel_symbols_count;
+    while (low < high) {
+        unsigned mid = low + (high - low) / 2;
+        if (kernel_symbols[mid].address <= address) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if (low == 0) {
+        return NULL;
+    }
+    elf_kernel_symbol_t *symbol = &kernel_symbols[low - 1];
+    if (symbol->size && (address >= symbol->address + symbol->size)) {
+        return NULL;
+    }
+    if (offset) {
+        *offset = address - symbol->address;
+    }
+    return symbol->name;
+}
+
+// ============================================================================
+// LOADING
+// ============================================================================
+
+/// @brief Chooses where an ELF file is loaded.
+/// @param task The task for which we load the ELF.
+/// @param entry The headers of the ELF file.
+/// @param base Where a position independent file goes, 0 for any free spot.
+/// @param bias Where the offset added to the addresses of the segments is
+/// stored, 0 for files linked at a fixed address.
+/// @return 1 on success, 0 on failure.
+static inline int elf_load_bias(task_struct *task, elf_cache_entry_t *entry, uint32_t base, uint32_t *bias)
+{
+    *bias = 0;
+    if (entry->header.type == ET_EXEC) {
+        return true;
+    }
+    if ((base == 0) && find_free_vm_area(task->mm, entry->load_end - entry->load_start, &base)) {
+        return false;
+    }
+    *bias = base - entry->load_start;
+    return true;
+}
 
-    kfree(buffer);
+/// @brief Loads the interpreter named by an executable, the dynamic loader.
+/// @param task The task for which we load the ELF.
+/// @param path The path of the interpreter.
+/// @param image Where the entry and the address of the interpreter are stored.
+/// @return 1 on success, 0 on failure.
+static inline int elf_load_interpreter(task_struct *task, const char *path, elf_image_t *image)
+{
+    vfs_file_t *interpreter = vfs_open(path, O_RDONLY, 0);
+    if (interpreter == NULL) {
+        pr_err("Cannot find the interpreter `%s`.\n", path);
+        return false;
+    }
+    int ret                  = false;
+    elf_cache_entry_t *entry = __elf_cache_get(interpreter);
+    if (entry == NULL) {
+        goto close_interpreter;
+    }
+    // The interpreter goes wherever there is space, and has no interpreter.
+    uint32_t bias;
+    if ((entry->header.type != ET_DYN) ||
+        !elf_load_bias(task, entry, 0, &bias) ||
+        !elf_load_exec(&entry->header, entry->program_headers, interpreter, task, bias)) {
+        pr_err("Failed to load the interpreter `%s`.\n", path);
+        goto put_entry;
+    }
+    image->interp_base = bias;
+    image->entry       = entry->header.entry + bias;
+    ret                = true;
+put_entry:
+    __elf_cache_put(entry);
+close_interpreter:
+    // The segments keep the file open.
+    vfs_close(interpreter);
+    return ret;
+}
+
+int elf_load_file(task_struct *task, vfs_file_t *file, elf_image_t *image)
+{
+    // Open the file.
+    if (file == NULL) {
+        return false;
+    }
+    elf_cache_entry_t *entry = __elf_cache_get(file);
+    if (entry == NULL) {
+        return false;
+    }
+    int ret = false;
+    uint32_t bias;
+    if (!elf_load_bias(task, entry, ELF_ET_DYN_BASE, &bias) ||
+        !elf_load_exec(&entry->header, entry->program_headers, file, task, bias)) {
+        pr_err("Failed to load the executable.\n");
+        goto put_entry;
+    }
+    // Set the entry, and tell the interpreter where the executable is.
+    memset(image, 0, sizeof(elf_image_t));
+    image->exec_entry = entry->header.entry + bias;
+    image->entry      = image->exec_entry;
+    image->phdr       = entry->phdr ? (entry->phdr + bias) : 0;
+    image->phnum      = entry->header.phnum;
+    if (entry->interpreter && !elf_load_interpreter(task, entry->interpreter, image)) {
+        goto put_entry;
+    }
+    ret = true;
+put_entry:
+    __elf_cache_put(entry);
+    return ret;
+}
+
+int elf_check_executable(vfs_file_t *file)
+{
+    elf_cache_entry_t *entry = __elf_cache_get(file);
+    if (entry == NULL) {
+        return false;
+    }
+    __elf_cache_put(entry);
     return true;
-return_error_free_buffer:
-    kfree(buffer);
-    return false;
 }
 
 int elf_check_file_type(vfs_file_t *file, Elf_Type type)
@@ -375,7 +853,7 @@ int elf_check_file_header(elf_header_t *header)
         pr_err("Unsupported ELF File version.\n");
         return false;
     }
-    if (header->type != ET_EXEC) {
+    if ((header->type != ET_EXEC) && (header->type != ET_DYN)) {
         pr_err("Unsupported ELF File type.\n");
         return false;
     }
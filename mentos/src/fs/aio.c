@@ -0,0 +1,472 @@
+/// @file aio.c
+/// @brief Asynchronous requests of the processes, served by the block devices.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// The filesystem turns a read into block requests, through its aio_read_f
+/// callback, and queues them on the device with its submit_f callback: the
+/// system call returns right away, and the bottom half of the device counts
+/// the requests completed. The data lands in a kernel buffer, since the
+/// devices only move data from and to the kernel memory, and it is copied to
+/// the buffer of the process once the process checks the completion. The
+/// processes wait for their requests through the poll machinery, queued on a
+/// single wait queue woken up by every completion.
+
+// Setup the logging for this file (do this before any other include).
+#include "sys/kernel_levels.h"           // Include kernel log levels.
+#define __DEBUG_HEADER__ "[AIO   ]"      ///< Change header.
+#define __DEBUG_LEVEL__  LOGLEVEL_NOTICE ///< Set log level.
+#include "io/debug.h"                    // Include debugging functions.
+
+#include "aio.h"
+#include "drivers/ata/ata.h"
+#include "fs/aio.h"
+#include "fs/poll.h"
+#include "fs/vfs.h"
+#include "klib/spinlock.h"
+#include "math.h"
+#include "mem/kheap.h"
+#include "poll.h"
+#include "process/scheduler.h"
+#include "process/wait.h"
+#include "string.h"
+#include "sys/errno.h"
+#include "system/syscall.h"
+
+/// The largest number of sectors moved by a single block request.
+#define AIO_MAX_SECTORS 128U
+/// The size of a sector.
+#define AIO_SECTOR_SIZE 512U
+
+/// @brief A block request issued on behalf of an asynchronous request.
+typedef struct aio_chunk_t {
+    /// The request, queued on the device.
+    ata_request_t request;
+    /// Position inside the chunks of the asynchronous request.
+    list_head list;
+} aio_chunk_t;
+
+/// @brief An asynchronous request of a thread.
+struct kiocb_t {
+    /// The thread which submitted the request, NULL once it is gone.
+    task_struct *owner;
+    /// The control block, in the memory of the owner.
+    struct aiocb *aiocbp;
+    /// The file descriptor given by the owner.
+    int fildes;
+    /// The file, kept open until the request is freed.
+    vfs_file_t *file;
+    /// Where the data is copied, in the memory of the owner.
+    void *user_buffer;
+    /// The kernel buffer where the data lands.
+    uint8_t *buffer;
+    /// Where the data asked by the owner starts, inside the buffer.
+    size_t skip;
+    /// The number of bytes read.
+    ssize_t result;
+    /// The block requests in flight, plus one while the request is submitted.
+    volatile unsigned pending;
+    /// The first error of the block requests, 0 if none failed.
+    int error;
+    /// Set once the completion has been reported to the owner by poll.
+    int noticed;
+    /// The block requests.
+    list_head chunks;
+    /// Position inside the list of the requests.
+    list_head list;
+};
+
+/// @brief The asynchronous requests.
+static struct {
+    /// All the requests, of all the threads.
+    list_head requests;
+    /// Woken up by every completion.
+    wait_queue_head_t wait;
+    /// Protects the list, and the counters of the requests, which are
+    /// decremented by the bottom halves.
+    spinlock_t lock;
+} aio;
+
+/// @brief Returns the requests completed, and not yet reported, of the
+/// calling thread.
+/// @param file the file of the requests.
+/// @param table where the thread is queued, NULL not to queue it.
+/// @return POLLIN if a request was completed since the last call.
+static unsigned int __aio_poll(vfs_file_t *file, poll_table_t *table)
+{
+    task_struct *task = scheduler_get_current_process();
+    unsigned int mask = 0;
+    poll_wait(file, &aio.wait, table);
+    uint8_t flags = spinlock_lock_irqsave(&aio.lock);
+    list_for_each_decl(it, &aio.requests)
+    {
+        kiocb_t *iocb = list_entry(it, kiocb_t, list);
+        if ((iocb->owner == task) && (iocb->pending == 0) && !iocb->noticed) {
+            iocb->noticed = 1;
+            mask          = POLLIN | POLLRDNORM;
+        }
+    }
+    spinlock_unlock_irqrestore(&aio.lock, flags);
+    return mask;
+}
+
+/// The operations of the file the threads poll while waiting for their requests.
+static vfs_file_operations_t aio_fs_operations = {
+    .poll_f = __aio_poll,
+};
+
+/// The file the threads poll while waiting for their requests, never closed.
+static vfs_file_t aio_file = {
+    .name          = "aio",
+    .count         = 1,
+    .fs_operations = &aio_fs_operations,
+};
+
+/// @brief Drops one of the references of the block requests in flight,
+/// completing the request with the last one.
+/// @param iocb the request.
+/// @param status the status of the block request, 0 on success.
+static void __aio_put(kiocb_t *iocb, int status)
+{
+    uint8_t flags = spinlock_lock_irqsave(&aio.lock);
+    if ((status < 0) && (iocb->error == 0)) {
+        iocb->error = status;
+    }
+    unsigned pending = --iocb->pending;
+    spinlock_unlock_irqrestore(&aio.lock, flags);
+    if (pending == 0) {
+        wake_up(&aio.wait);
+    }
+}
+
+/// @brief Completes a block request, called by the bottom half of the device.
+/// @param request the block request.
+static void __aio_end_request(ata_request_t *request)
+{
+    __aio_put((kiocb_t *)request->private_data, request->status);
+}
+
+/// @brief Frees a completed request, which is not on the list anymore.
+/// @param iocb the request.
+static void __aio_free(kiocb_t *iocb)
+{
+    list_for_each_safe_decl(it, store, &iocb->chunks)
+    {
+        aio_chunk_t *chunk = list_entry(it, aio_chunk_t, list);
+        list_head_remove(&chunk->list);
+        kfree(chunk);
+    }
+    if (iocb->buffer) {
+        kfree(iocb->buffer);
+    }
+    vfs_close(iocb->file);
+    kfree(iocb);
+}
+
+/// @brief Frees the completed requests of the threads which are gone.
+static void __aio_reap_orphans(void)
+{
+    list_head dead;
+    list_head_init(&dead);
+    uint8_t flags = spinlock_lock_irqsave(&aio.lock);
+    list_for_each_safe_decl(it, store, &aio.requests)
+    {
+        kiocb_t *iocb = list_entry(it, kiocb_t, list);
+        if ((iocb->owner == NULL) && (iocb->pending == 0)) {
+            list_head_remove(&iocb->list);
+            list_head_insert_before(&iocb->list, &dead);
+        }
+    }
+    spinlock_unlock_irqrestore(&aio.lock, flags);
+    list_for_each_safe_decl(it, store, &dead)
+    {
+        __aio_free(list_entry(it, kiocb_t, list));
+    }
+}
+
+/// @brief Searches a request of a thread.
+/// @param task the thread.
+/// @param aiocbp the control block of the request.
+/// @return the request, NULL if the thread has no such request in flight.
+static inline kiocb_t *__aio_find(task_struct *task, const struct aiocb *aiocbp)
+{
+    kiocb_t *found = NULL;
+    uint8_t flags  = spinlock_lock_irqsave(&aio.lock);
+    list_for_each_decl(it, &aio.requests)
+    {
+        kiocb_t *iocb = list_entry(it, kiocb_t, list);
+        if ((iocb->owner == task) && (iocb->aiocbp == aiocbp)) {
+            found = iocb;
+            break;
+        }
+    }
+    spinlock_unlock_irqrestore(&aio.lock, flags);
+    return found;
+}
+
+/// @brief Counts the requests of a thread.
+/// @param task the thread.
+/// @return the number of requests, completed or not, still owned by the thread.
+static inline unsigned int __aio_count(task_struct *task)
+{
+    unsigned int count = 0;
+    uint8_t flags      = spinlock_lock_irqsave(&aio.lock);
+    list_for_each_decl(it, &aio.requests)
+    {
+        count += (list_entry(it, kiocb_t, list)->owner == task);
+    }
+    spinlock_unlock_irqrestore(&aio.lock, flags);
+    return count;
+}
+
+/// @brief Stores the result of a request in its control block.
+/// @param aiocbp the control block.
+/// @param ret the value returned by the request, -errno on failure.
+static inline void __aio_set_result(struct aiocb *aiocbp, ssize_t ret)
+{
+    aiocbp->__return = (ret < 0) ? -1 : ret;
+    aiocbp->__error  = (ret < 0) ? -ret : 0;
+}
+
+/// @brief Hands a completed request to its owner, which is the calling
+/// thread, and frees it.
+/// @param iocb the request.
+static void __aio_retire(kiocb_t *iocb)
+{
+    if (iocb->error < 0) {
+        __aio_set_result(iocb->aiocbp, iocb->error);
+    } else {
+        memcpy(iocb->user_buffer, iocb->buffer + iocb->skip, iocb->result);
+        __aio_set_result(iocb->aiocbp, iocb->result);
+    }
+    uint8_t flags = spinlock_lock_irqsave(&aio.lock);
+    list_head_remove(&iocb->list);
+    spinlock_unlock_irqrestore(&aio.lock, flags);
+    __aio_free(iocb);
+}
+
+/// @brief Hands the completed requests of a list to the calling thread.
+/// @param task the calling thread.
+/// @param list the control blocks.
+/// @param nent the number of entries of the list.
+/// @return 1 if one of the requests is completed, 0 otherwise.
+static int __aio_retire_list(task_struct *task, const struct aiocb *const list[], int nent)
+{
+    int ready = 0;
+    for (int i = 0; i < nent; ++i) {
+        if (list[i] == NULL) {
+            continue;
+        }
+        kiocb_t *iocb = __aio_find(task, list[i]);
+        if (iocb == NULL) {
+            // Served when submitted, or already handed over.
+            ready |= (list[i]->__error != EINPROGRESS);
+        } else if (iocb->pending == 0) {
+            __aio_retire(iocb);
+            ready = 1;
+        }
+    }
+    return ready;
+}
+
+/// @brief Starts an asynchronous read through the filesystem of the file.
+/// @param task the calling thread.
+/// @param aiocbp the control block.
+/// @param file the file.
+/// @return 0 on success, -EOPNOTSUPP if the read must be served right away,
+/// -errno on failure.
+static int __aio_start_read(task_struct *task, struct aiocb *aiocbp, vfs_file_t *file)
+{
+    if (__aio_count(task) >= AIO_MAX) {
+        return -EAGAIN;
+    }
+    kiocb_t *iocb = (kiocb_t *)kmalloc(sizeof(kiocb_t));
+    if (iocb == NULL) {
+        return -ENOMEM;
+    }
+    memset(iocb, 0, sizeof(kiocb_t));
+    iocb->owner       = task;
+    iocb->aiocbp      = aiocbp;
+    iocb->fildes      = aiocbp->aio_fildes;
+    iocb->file        = file;
+    iocb->user_buffer = (void *)aiocbp->aio_buf;
+    iocb->pending     = 1;
+    list_head_init(&iocb->chunks);
+    ++file->count;
+    ssize_t ret = file->fs_operations->aio_read_f(file, iocb, aiocbp->aio_offset, aiocbp->aio_nbytes);
+    if ((ret == -EOPNOTSUPP) && list_head_empty(&iocb->chunks)) {
+        __aio_free(iocb);
+        return ret;
+    }
+    aiocbp->__error  = EINPROGRESS;
+    aiocbp->__return = 0;
+    iocb->result     = max(ret, 0);
+    uint8_t flags    = spinlock_lock_irqsave(&aio.lock);
+    list_head_insert_before(&iocb->list, &aio.requests);
+    spinlock_unlock_irqrestore(&aio.lock, flags);
+    // The request completes once the blocks already queued are read.
+    __aio_put(iocb, min(ret, 0));
+    return 0;
+}
+
+void aio_init(void)
+{
+    list_head_init(&aio.requests);
+    init_waitqueue_head(&aio.wait);
+    spinlock_init(&aio.lock);
+}
+
+void *aio_alloc_buffer(kiocb_t *iocb, size_t size, size_t skip)
+{
+    iocb->buffer = (uint8_t *)kmalloc(size);
+    iocb->skip   = skip;
+    return iocb->buffer;
+}
+
+int aio_submit_sectors(kiocb_t *iocb, vfs_file_t *device, void *buffer, uint32_t sector, uint32_t count)
+{
+    uint8_t *position = (uint8_t *)buffer;
+    while (count > 0) {
+        uint32_t chunk_count = min(count, AIO_MAX_SECTORS);
+        aio_chunk_t *chunk   = (aio_chunk_t *)kmalloc(sizeof(aio_chunk_t));
+        if (chunk == NULL) {
+            return -ENOMEM;
+        }
+        memset(chunk, 0, sizeof(aio_chunk_t));
+        chunk->request.direction    = ata_request_read;
+        chunk->request.lba_sector   = sector;
+        chunk->request.count        = chunk_count;
+        chunk->request.buffer       = position;
+        chunk->request.end_request  = __aio_end_request;
+        chunk->request.private_data = iocb;
+        list_head_insert_before(&chunk->list, &iocb->chunks);
+        uint8_t flags = spinlock_lock_irqsave(&aio.lock);
+        ++iocb->pending;
+        spinlock_unlock_irqrestore(&aio.lock, flags);
+        if (!device->fs_operations->submit_f || (device->fs_operations->submit_f(device, &chunk->request) < 0)) {
+            // The device cannot queue it, read it right away.
+            size_t size = chunk_count * AIO_SECTOR_SIZE;
+            ssize_t ret = vfs_read(device, position, sector * AIO_SECTOR_SIZE, size);
+            __aio_put(iocb, (ret == (ssize_t)size) ? 0 : -EIO);
+        }
+        position += chunk_count * AIO_SECTOR_SIZE;
+        sector += chunk_count;
+        count -= chunk_count;
+    }
+    return 0;
+}
+
+void aio_exit(task_struct *task)
+{
+    list_head dead;
+    list_head_init(&dead);
+    uint8_t flags = spinlock_lock_irqsave(&aio.lock);
+    list_for_each_safe_decl(it, store, &aio.requests)
+    {
+        kiocb_t *iocb = list_entry(it, kiocb_t, list);
+        if (iocb->owner != task) {
+            continue;
+        }
+        // The devices still own the buffers of those in flight.
+        iocb->owner = NULL;
+        if (iocb->pending == 0) {
+            list_head_remove(&iocb->list);
+            list_head_insert_before(&iocb->list, &dead);
+        }
+    }
+    spinlock_unlock_irqrestore(&aio.lock, flags);
+    list_for_each_safe_decl(it, store, &dead)
+    {
+        __aio_free(list_entry(it, kiocb_t, list));
+    }
+}
+
+int sys_aio_submit(struct aiocb *aiocbp)
+{
+    task_struct *task = scheduler_get_current_process();
+    if (aiocbp == NULL) {
+        return -EFAULT;
+    }
+    if (((aiocbp->aio_lio_opcode != LIO_READ) && (aiocbp->aio_lio_opcode != LIO_WRITE)) ||
+        (aiocbp->aio_offset < 0) || (aiocbp->aio_nbytes > AIO_MAX_BYTES)) {
+        return -EINVAL;
+    }
+    int fd = aiocbp->aio_fildes;
+    if ((fd < 0) || (fd >= task->files->max_fd) || (task->files->fd_list[fd].file_struct == NULL)) {
+        return -EBADF;
+    }
+    __aio_reap_orphans();
+    vfs_file_t *file = task->files->fd_list[fd].file_struct;
+    if ((aiocbp->aio_lio_opcode == LIO_READ) && (aiocbp->aio_nbytes > 0) && file->fs_operations->aio_read_f) {
+        int ret = __aio_start_read(task, aiocbp, file);
+        if (ret != -EOPNOTSUPP) {
+            return ret;
+        }
+    }
+    // Serve the request right away, the writes only reach the buffer cache.
+    ssize_t ret;
+    if (aiocbp->aio_lio_opcode == LIO_WRITE) {
+        ret = sys_pwrite(fd, (const void *)aiocbp->aio_buf, aiocbp->aio_nbytes, aiocbp->aio_offset);
+    } else {
+        ret = sys_pread(fd, (void *)aiocbp->aio_buf, aiocbp->aio_nbytes, aiocbp->aio_offset);
+    }
+    if (ret == -ERESTARTSYS) {
+        // The thread sleeps, and submits the request again once woken up.
+        return ret;
+    }
+    __aio_set_result(aiocbp, ret);
+    return 0;
+}
+
+int sys_aio_suspend(const struct aiocb *const list[], int nent, const struct timespec *timeout)
+{
+    task_struct *task = scheduler_get_current_process();
+    if ((nent < 0) || (nent > AIO_LISTIO_MAX)) {
+        return -EINVAL;
+    }
+    if ((list == NULL) && (nent > 0)) {
+        return -EFAULT;
+    }
+    int msec = -1;
+    if (timeout) {
+        if ((timeout->tv_sec < 0) || (timeout->tv_nsec < 0) || (timeout->tv_nsec >= 1000000000L)) {
+            return -EINVAL;
+        }
+        msec = (int)(timeout->tv_sec * 1000 + timeout->tv_nsec / 1000000);
+    }
+    while (true) {
+        if (__aio_retire_list(task, list, nent)) {
+            // We might have slept before getting here.
+            poll_release(task);
+            return 0;
+        }
+        // Any completion of the thread wakes it up, check the list again.
+        int ret = do_poll_file(&aio_file, POLLIN, msec);
+        if (ret <= 0) {
+            return ret ? ret : -EAGAIN;
+        }
+    }
+}
+
+int sys_aio_cancel(int fildes, struct aiocb *aiocbp)
+{
+    task_struct *task = scheduler_get_current_process();
+    if ((fildes < 0) || (fildes >= task->files->max_fd) || (task->files->fd_list[fildes].file_struct == NULL)) {
+        return -EBADF;
+    }
+    if (aiocbp && (aiocbp->aio_fildes != fildes)) {
+        return -EINVAL;
+    }
+    // The block requests cannot be taken back from the devices.
+    int ret       = AIO_ALLDONE;
+    uint8_t flags = spinlock_lock_irqsave(&aio.lock);
+    list_for_each_decl(it, &aio.requests)
+    {
+        kiocb_t *iocb = list_entry(it, kiocb_t, list);
+        if ((iocb->owner == task) && (iocb->fildes == fildes) && (!aiocbp || (iocb->aiocbp == aiocbp)) && iocb->pending) {
+            ret = AIO_NOTCANCELED;
+        }
+    }
+    spinlock_unlock_irqrestore(&aio.lock, flags);
+    return ret;
+}
@@ -72,12 +72,12 @@ int sys_fchown(int fd, uid_t owner, gid_t group) {
     task_struct *task = scheduler_get_current_process();
 
     // Check the current FD.
-    if (fd < 0 || fd >= task->max_fd) {
+    if (fd < 0 || fd >= task->files->max_fd) {
         return -EBADF;
     }
 
     // Get the file.
-    vfs_file_t *file = task->fd_list[fd].file_struct;
+    vfs_file_t *file = task->files->fd_list[fd].file_struct;
     if (file == NULL) {
         return -EBADF;
     }
@@ -112,12 +112,12 @@ int sys_fchmod(int fd, mode_t mode) {
     task_struct *task = scheduler_get_current_process();
 
     // Check the current FD.
-    if (fd < 0 || fd >= task->max_fd) {
+    if (fd < 0 || fd >= task->files->max_fd) {
         return -EBADF;
     }
 
     // Get the file.
-    vfs_file_t *file = task->fd_list[fd].file_struct;
+    vfs_file_t *file = task->files->fd_list[fd].file_struct;
     if (file == NULL) {
         return -EBADF;
     }
@@ -135,3 +135,44 @@ int sys_fchmod(int fd, mode_t mode) {
     struct iattr attr = IATTR_CHMOD(mode);
     return file->fs_operations->setattr_f(file, &attr);
 }
+
+int sys_truncate(const char *path, off_t length)
+{
+    if (length < 0) {
+        return -EINVAL;
+    }
+    struct iattr attr = { .ia_valid = ATTR_SIZE, .ia_size = length };
+    return __setattr(path, &attr, true);
+}
+
+int sys_ftruncate(int fd, off_t length)
+{
+    task_struct *task = scheduler_get_current_process();
+
+    // Check the current FD.
+    if (fd < 0 || fd >= task->files->max_fd) {
+        return -EBADF;
+    }
+
+    // Get the file.
+    vfs_file_t *file = task->files->fd_list[fd].file_struct;
+    if (file == NULL) {
+        return -EBADF;
+    }
+
+    // The file must be open for writing.
+    int accmode = task->files->fd_list[fd].flags_mask & O_ACCMODE;
+    if ((accmode != O_WRONLY) && (accmode != O_RDWR)) {
+        return -EINVAL;
+    }
+    if (length < 0) {
+        return -EINVAL;
+    }
+
+    if (file->fs_operations->setattr_f == NULL) {
+        pr_err("No setattr function found for the current filesystem.\n");
+        return -ENOSYS;
+    }
+    struct iattr attr = { .ia_valid = ATTR_SIZE, .ia_size = length };
+    return file->fs_operations->setattr_f(file, &attr);
+}
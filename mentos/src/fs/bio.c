@@ -0,0 +1,137 @@
+/// @file bio.c
+/// @brief Transfers between the block devices and page frames.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+// Setup the logging for this file (do this before any other include).
+#include "sys/kernel_levels.h"           // Include kernel log levels.
+#define __DEBUG_HEADER__ "[BIO   ]"      ///< Change header.
+#define __DEBUG_LEVEL__  LOGLEVEL_NOTICE ///< Set log level.
+#include "io/debug.h"                    // Include debugging functions.
+
+#include "fs/bio.h"
+
+#include "drivers/ata/ata.h"
+#include "fs/vfs.h"
+#include "klib/irqflags.h"
+#include "klib/stdatomic.h"
+#include "math.h"
+#include "mem/vmem_map.h"
+#include "string.h"
+#include "sys/errno.h"
+
+/// The largest number of sectors moved by a single block request, a whole
+/// number of pages.
+#define BIO_MAX_SECTORS 128U
+/// The largest number of block requests in flight at the same time.
+#define BIO_MAX_REQUESTS 8U
+
+/// @brief The block requests of a transfer, in flight at the same time.
+typedef struct bio_sync_t {
+    /// The requests not completed yet.
+    atomic_t pending;
+    /// The status of the first request which failed, 0 otherwise.
+    int status;
+} bio_sync_t;
+
+/// @brief Completes a block request, called by the device.
+/// @param request the block request.
+static void __bio_end_request(ata_request_t *request)
+{
+    bio_sync_t *sync = (bio_sync_t *)request->private_data;
+    if (request->status && !sync->status) {
+        sync->status = request->status;
+    }
+    atomic_dec(&sync->pending);
+}
+
+/// @brief Waits for the block requests in flight.
+/// @param sync the requests.
+/// @details The requests are completed by the interrupts of the device, or
+/// right away by the devices which serve them synchronously.
+static void __bio_wait(bio_sync_t *sync)
+{
+    uint8_t flags = irq_disable();
+    while (atomic_read(&sync->pending)) {
+        __asm__ __volatile__("sti; hlt; cli" ::: "memory");
+    }
+    irq_enable(flags);
+}
+
+/// @brief Moves the sectors mapping the page frames one at a time.
+/// @param device the block device.
+/// @param write if the sectors are written, or read.
+/// @param sector the first sector.
+/// @param pages the page frames.
+/// @param offset where the data starts inside the first page frame.
+/// @param size the number of bytes.
+/// @return 0 on success, -EIO on failure.
+static int __bio_copy_pages(vfs_file_t *device, int write, uint32_t sector, page_t **pages, size_t offset, size_t size)
+{
+    for (; size > 0; ++pages, offset = 0) {
+        size_t chunk   = min(PAGE_SIZE - offset, size);
+        uint32_t vaddr = virt_kmap(*pages);
+        ssize_t done;
+        if (write) {
+            done = vfs_write(device, (char *)vaddr + offset, sector * BIO_SECTOR_SIZE, chunk);
+        } else {
+            done = vfs_read(device, (char *)vaddr + offset, sector * BIO_SECTOR_SIZE, chunk);
+        }
+        virt_kunmap(vaddr);
+        if (done != (ssize_t)chunk) {
+            return -EIO;
+        }
+        sector += chunk / BIO_SECTOR_SIZE;
+        size -= chunk;
+    }
+    return 0;
+}
+
+int bio_transfer_pages(vfs_file_t *device, int write, uint32_t sector, page_t **pages, size_t offset, size_t size)
+{
+    ata_request_t requests[BIO_MAX_REQUESTS];
+    bio_sync_t sync;
+    if ((offset % BIO_SECTOR_SIZE) || (size % BIO_SECTOR_SIZE)) {
+        return -EINVAL;
+    }
+    pages += offset / PAGE_SIZE;
+    offset %= PAGE_SIZE;
+    if (device->fs_operations->submit_f == NULL) {
+        return __bio_copy_pages(device, write, sector, pages, offset, size);
+    }
+    while (size > 0) {
+        atomic_set(&sync.pending, 0);
+        sync.status = 0;
+        for (unsigned it = 0; (it < BIO_MAX_REQUESTS) && (size > 0); ++it) {
+            // Only the first request starts inside a page frame.
+            size_t chunk           = min(size, BIO_MAX_SECTORS * BIO_SECTOR_SIZE - offset);
+            ata_request_t *request = &requests[it];
+            memset(request, 0, sizeof(ata_request_t));
+            request->direction    = write ? ata_request_write : ata_request_read;
+            request->lba_sector   = sector;
+            request->count        = chunk / BIO_SECTOR_SIZE;
+            request->pages        = pages;
+            request->offset       = offset;
+            request->end_request  = __bio_end_request;
+            request->private_data = &sync;
+            atomic_inc(&sync.pending);
+            if (device->fs_operations->submit_f(device, request) < 0) {
+                // The device cannot queue it, move it right away.
+                atomic_dec(&sync.pending);
+                if (__bio_copy_pages(device, write, sector, pages, offset, chunk) < 0) {
+                    sync.status = -EIO;
+                }
+            }
+            pages += (offset + chunk) / PAGE_SIZE;
+            offset = 0;
+            sector += request->count;
+            size -= chunk;
+        }
+        __bio_wait(&sync);
+        if (sync.status) {
+            pr_err("Failed to %s sectors of `%s`.\n", write ? "write" : "read", device->name);
+            return sync.status;
+        }
+    }
+    return 0;
+}
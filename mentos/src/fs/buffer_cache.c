@@ -0,0 +1,566 @@
+/// @file buffer_cache.c
+/// @brief Cache of the blocks read from, and written to, block devices.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+// Setup the logging for this file (do this before any other include).
+#include "sys/kernel_levels.h"           // Include kernel log levels.
+#define __DEBUG_HEADER__ "[BCACHE]"      ///< Change header.
+#define __DEBUG_LEVEL__  LOGLEVEL_NOTICE ///< Set log level.
+#include "io/debug.h"                    // Include debugging functions.
+
+#include "fs/buffer_cache.h"
+
+#include "assert.h"
+#include "fs/vfs.h"
+#include "hardware/timer.h"
+#include "klib/hashmap.h"
+#include "klib/irqflags.h"
+#include "klib/spinlock.h"
+#include "math.h"
+#include "mem/kheap.h"
+#include "mem/shrinker.h"
+#include "mem/slab.h"
+#include "process/scheduler.h"
+#include "process/wait.h"
+#include "string.h"
+#include "sys/errno.h"
+
+/// Number of buckets of the hashmap.
+#define BUFFER_CACHE_BUCKETS 257
+/// Maximum number of bytes moved with a single request.
+#define BUFFER_MAX_RUN 65536
+
+/// @brief The buffer cache.
+static struct {
+    /// Maps (device, block) to the buffer.
+    hashmap_t *map;
+    /// All the buffers, the least recently used comes first.
+    list_head lru;
+    /// Dirty buffers, sorted by device and block.
+    list_head dirty;
+    /// Set by the flusher timer when the dirty buffers must be written back.
+    volatile bool_t flush_pending;
+    /// Where the flusher thread sleeps, waiting for the timer.
+    wait_queue_head_t flush_wait;
+    /// Number of buffers currently allocated.
+    unsigned int size;
+    /// Number of dirty buffers.
+    unsigned int ndirty;
+    /// Cache for the buffer heads.
+    kmem_cache_t *head_cache;
+    /// Protects the cache.
+    spinlock_t lock;
+} buffer_cache;
+
+/// Maximum number of buffers kept in memory.
+unsigned buffer_cache_max_buffers = BUFFER_CACHE_DEFAULT_MAX_BUFFERS;
+/// Hundredths of a second between two runs of the flusher.
+unsigned buffer_dirty_writeback_centisecs = BUFFER_DEFAULT_WRITEBACK_CENTISECS;
+/// Percentage of the cache which can be dirty before the flusher is woken up.
+unsigned buffer_dirty_ratio = BUFFER_DEFAULT_DIRTY_RATIO;
+
+/// Support buffer used to move runs of consecutive blocks with a single request.
+static uint8_t run_buffer[BUFFER_MAX_RUN];
+
+/// @brief Hashes a buffer key.
+/// @param key pointer to the buffer_key_t.
+/// @return the hash key.
+static unsigned int buffer_key_hash(const void *key)
+{
+    const buffer_key_t *bkey = (const buffer_key_t *)key;
+    return ((uintptr_t)bkey->device * 31U) ^ bkey->block;
+}
+
+/// @brief Compares two buffer keys.
+/// @param a the first buffer_key_t.
+/// @param b the second buffer_key_t.
+/// @return 1 if they are equal, 0 otherwise.
+static int buffer_key_comp(const void *a, const void *b)
+{
+    const buffer_key_t *ka = (const buffer_key_t *)a, *kb = (const buffer_key_t *)b;
+    return (ka->device == kb->device) && (ka->block == kb->block);
+}
+
+/// @brief Writes the content of the buffer on the device.
+/// @param buffer the buffer.
+/// @return 0 on success, -errno on failure.
+static int __buffer_write(buffer_head_t *buffer)
+{
+    ssize_t written = vfs_write(buffer->key.device, buffer->data, buffer->key.block * buffer->size, buffer->size);
+    if (written != (ssize_t)buffer->size) {
+        pr_err("Failed to write back block %u.\n", buffer->key.block);
+        return (written < 0) ? written : -EIO;
+    }
+    buffer->flags &= ~BUFFER_DIRTY;
+    list_head_remove(&buffer->dirty);
+    --buffer_cache.ndirty;
+    return 0;
+}
+
+/// @brief Checks if the buffer comes right after the other one on the device.
+/// @param prev the first buffer.
+/// @param next the second buffer.
+/// @return 1 if they are consecutive, 0 otherwise.
+static inline int __buffer_consecutive(buffer_head_t *prev, buffer_head_t *next)
+{
+    return (prev->key.device == next->key.device) &&
+           (prev->size == next->size) &&
+           ((prev->key.block + 1) == next->key.block);
+}
+
+/// @brief Writes back the dirty buffers of the device, merging consecutive
+/// blocks into a single request.
+/// @param device the block device, NULL for all the devices.
+/// @return 0 on success, -errno if some buffer could not be written.
+static int __buffer_sync(vfs_file_t *device)
+{
+    buffer_head_t *first, *last, *next;
+    size_t length;
+    ssize_t written;
+    int ret = 0;
+    list_for_each_safe_decl(it, store, &buffer_cache.dirty)
+    {
+        first = list_entry(it, buffer_head_t, dirty);
+        if (((device != NULL) && (first->key.device != device)) || (first->flags & BUFFER_PINNED)) {
+            continue;
+        }
+        // Find the run of consecutive dirty blocks.
+        last   = first;
+        length = first->size;
+        while (last->dirty.next != &buffer_cache.dirty) {
+            next = list_entry(last->dirty.next, buffer_head_t, dirty);
+            if (!__buffer_consecutive(last, next) || (next->flags & BUFFER_PINNED) || ((length + next->size) > BUFFER_MAX_RUN)) {
+                break;
+            }
+            length += next->size;
+            last = next;
+        }
+        if (first == last) {
+            if (__buffer_write(first)) {
+                ret = -EIO;
+            }
+            continue;
+        }
+        // Gather the run, and write it with a single request.
+        length = 0;
+        for (next = first;; next = list_entry(next->dirty.next, buffer_head_t, dirty)) {
+            memcpy(run_buffer + length, next->data, next->size);
+            length += next->size;
+            if (next == last) {
+                break;
+            }
+        }
+        // Resume the visit from the buffer following the run.
+        store   = last->dirty.next;
+        written = vfs_write(first->key.device, run_buffer, first->key.block * first->size, length);
+        if (written != (ssize_t)length) {
+            pr_err("Failed to write back blocks %u-%u.\n", first->key.block, last->key.block);
+            ret = -EIO;
+            continue;
+        }
+        pr_debug("Wrote back blocks %u-%u.\n", first->key.block, last->key.block);
+        for (next = first; next;) {
+            buffer_head_t *following = (next == last) ? NULL : list_entry(next->dirty.next, buffer_head_t, dirty);
+            next->flags &= ~BUFFER_DIRTY;
+            list_head_remove(&next->dirty);
+            --buffer_cache.ndirty;
+            next = following;
+        }
+    }
+    return ret;
+}
+
+/// @brief Periodically asks for the write-back of the dirty buffers.
+/// @param data unused.
+static void buffer_flush_timeout(unsigned long data)
+{
+    (void)data;
+    buffer_cache.flush_pending = true;
+    wake_up(&buffer_cache.flush_wait);
+    // The timer is freed once it expires, arm a new one.
+    struct timer_list *timer = timer_list_alloc();
+    if (timer == NULL) {
+        pr_err("Failed to allocate the flusher timer.\n");
+        return;
+    }
+    timer->expires  = timer_get_ticks() + max(1U, (buffer_dirty_writeback_centisecs * TICKS_PER_SECOND) / 100U);
+    timer->function = &buffer_flush_timeout;
+    timer->data     = 0;
+    add_timer(timer);
+}
+
+/// @brief Removes the buffer from the cache and frees it.
+/// @param buffer the buffer, it must not be in use.
+static void __buffer_destroy(buffer_head_t *buffer)
+{
+    hashmap_remove(buffer_cache.map, &buffer->key);
+    list_head_remove(&buffer->lru);
+    if (buffer->flags & BUFFER_DIRTY) {
+        list_head_remove(&buffer->dirty);
+        --buffer_cache.ndirty;
+    }
+    kfree(buffer->data);
+    kmem_cache_free(buffer);
+    --buffer_cache.size;
+}
+
+/// @brief Frees the least recently used buffer that is not in use.
+/// @return 1 if we freed a buffer, 0 otherwise.
+static int __buffer_evict(void)
+{
+    buffer_head_t *buffer;
+    list_for_each_decl(it, &buffer_cache.lru)
+    {
+        buffer = list_entry(it, buffer_head_t, lru);
+        if (buffer->count) {
+            continue;
+        }
+        // Do not lose the modifications.
+        if ((buffer->flags & BUFFER_DIRTY) && __buffer_write(buffer)) {
+            continue;
+        }
+        __buffer_destroy(buffer);
+        return 1;
+    }
+    return 0;
+}
+
+/// @brief Returns the number of buffers the shrinker could free.
+/// @return the number of cached buffers.
+static unsigned long __buffer_count_objects(void)
+{
+    return buffer_cache.size;
+}
+
+/// @brief Frees the least recently used buffers which are clean and not in
+/// use, to give memory back under pressure.
+/// @param nr_to_scan the number of buffers to free.
+/// @return the number of buffers freed.
+static unsigned long __buffer_scan_objects(unsigned long nr_to_scan)
+{
+    unsigned long freed = 0;
+    // The cache might be allocating memory itself.
+    if (!spinlock_trylock(&buffer_cache.lock)) {
+        return 0;
+    }
+    list_for_each_safe_decl(it, store, &buffer_cache.lru)
+    {
+        if (freed >= nr_to_scan) {
+            break;
+        }
+        buffer_head_t *buffer = list_entry(it, buffer_head_t, lru);
+        // Writing back the dirty ones is left to the flusher.
+        if ((buffer->count == 0) && !(buffer->flags & BUFFER_DIRTY)) {
+            __buffer_destroy(buffer);
+            ++freed;
+        }
+    }
+    spinlock_unlock(&buffer_cache.lock);
+    return freed;
+}
+
+/// The shrinker of the buffer cache.
+static shrinker_t buffer_cache_shrinker = {
+    .name          = "buffer cache",
+    .count_objects = __buffer_count_objects,
+    .scan_objects  = __buffer_scan_objects,
+};
+
+/// @brief Searches the buffer inside the cache, and allocates it if missing.
+/// @param device the block device.
+/// @param block the index of the block.
+/// @param size the size of the block.
+/// @return the buffer, with its reference count increased, NULL on failure.
+static buffer_head_t *__buffer_lookup(vfs_file_t *device, uint32_t block, size_t size)
+{
+    buffer_key_t key      = { .device = device, .block = block };
+    buffer_head_t *buffer = hashmap_get(buffer_cache.map, &key);
+    if (buffer) {
+        // The filesystem changed its block size, drop the old buffer.
+        if ((buffer->size != size) && (buffer->count == 0)) {
+            if (buffer->flags & BUFFER_DIRTY) {
+                __buffer_write(buffer);
+            }
+            __buffer_destroy(buffer);
+            buffer = NULL;
+        } else {
+            // Move the buffer to the most recently used position.
+            list_head_remove(&buffer->lru);
+            list_head_insert_before(&buffer->lru, &buffer_cache.lru);
+            ++buffer->count;
+            return buffer;
+        }
+    }
+    // Make room for the new buffer.
+    if (buffer_cache.size >= buffer_cache_max_buffers) {
+        __buffer_evict();
+    }
+    buffer = kmem_cache_alloc(buffer_cache.head_cache, GFP_KERNEL);
+    if (buffer == NULL) {
+        pr_err("Failed to allocate a buffer head.\n");
+        return NULL;
+    }
+    buffer->data = kmalloc(size);
+    if (buffer->data == NULL) {
+        pr_err("Failed to allocate the content of a buffer.\n");
+        kmem_cache_free(buffer);
+        return NULL;
+    }
+    buffer->key   = key;
+    buffer->size  = size;
+    buffer->flags = 0;
+    buffer->count = 1;
+    list_head_init(&buffer->lru);
+    list_head_init(&buffer->dirty);
+    list_head_insert_before(&buffer->lru, &buffer_cache.lru);
+    hashmap_set(buffer_cache.map, &buffer->key, buffer);
+    ++buffer_cache.size;
+    return buffer;
+}
+
+void buffer_cache_init(void)
+{
+    buffer_cache.map = hashmap_create(
+        BUFFER_CACHE_BUCKETS,
+        buffer_key_hash,
+        buffer_key_comp,
+        hashmap_do_not_duplicate,
+        hashmap_do_not_free);
+    list_head_init(&buffer_cache.lru);
+    list_head_init(&buffer_cache.dirty);
+    buffer_cache.flush_pending = false;
+    init_waitqueue_head(&buffer_cache.flush_wait);
+    buffer_cache.size          = 0;
+    buffer_cache.ndirty        = 0;
+    buffer_cache.head_cache    = KMEM_CREATE(buffer_head_t);
+    spinlock_init(&buffer_cache.lock);
+    register_shrinker(&buffer_cache_shrinker);
+    // Start the periodic flusher.
+    buffer_flush_timeout(0);
+    buffer_cache.flush_pending = false;
+}
+
+buffer_head_t *buffer_get(vfs_file_t *device, uint32_t block, size_t size)
+{
+    assert(device && "Received a NULL device.");
+    spinlock_lock(&buffer_cache.lock);
+    buffer_head_t *buffer = __buffer_lookup(device, block, size);
+    spinlock_unlock(&buffer_cache.lock);
+    return buffer;
+}
+
+buffer_head_t *buffer_read(vfs_file_t *device, uint32_t block, size_t size)
+{
+    assert(device && "Received a NULL device.");
+    spinlock_lock(&buffer_cache.lock);
+    buffer_head_t *buffer = __buffer_lookup(device, block, size);
+    if (buffer && !(buffer->flags & BUFFER_UPTODATE)) {
+        if (vfs_read(device, buffer->data, block * size, size) != (ssize_t)size) {
+            pr_err("Failed to read block %u.\n", block);
+            --buffer->count;
+            __buffer_destroy(buffer);
+            buffer = NULL;
+        } else {
+            buffer->flags |= BUFFER_UPTODATE;
+        }
+    }
+    spinlock_unlock(&buffer_cache.lock);
+    return buffer;
+}
+
+void buffer_read_ahead(vfs_file_t *device, uint32_t block, uint32_t count, size_t size)
+{
+    buffer_head_t *buffer;
+    buffer_key_t key = { .device = device };
+    uint32_t first, last, end = block + count;
+    if ((size == 0) || (size > BUFFER_MAX_RUN)) {
+        return;
+    }
+    spinlock_lock(&buffer_cache.lock);
+    for (first = block; first < end; first = last) {
+        // Skip the blocks we already have.
+        key.block = first;
+        if (hashmap_get(buffer_cache.map, &key)) {
+            last = first + 1;
+            continue;
+        }
+        // Find the run of missing blocks, as long as it fits a single request.
+        for (last = first + 1; (last < end) && (((last - first + 1) * size) <= BUFFER_MAX_RUN); ++last) {
+            key.block = last;
+            if (hashmap_get(buffer_cache.map, &key)) {
+                break;
+            }
+        }
+        if (vfs_read(device, run_buffer, first * size, (last - first) * size) != (ssize_t)((last - first) * size)) {
+            pr_err("Failed to read ahead blocks %u-%u.\n", first, last - 1);
+            break;
+        }
+        pr_debug("Read ahead blocks %u-%u.\n", first, last - 1);
+        // Spread the run among the buffers.
+        for (uint32_t index = first; index < last; ++index) {
+            buffer = __buffer_lookup(device, index, size);
+            if (buffer == NULL) {
+                break;
+            }
+            if (!(buffer->flags & BUFFER_UPTODATE)) {
+                memcpy(buffer->data, run_buffer + (index - first) * size, size);
+                buffer->flags |= BUFFER_UPTODATE;
+            }
+            --buffer->count;
+        }
+    }
+    spinlock_unlock(&buffer_cache.lock);
+}
+
+void buffer_release(buffer_head_t *buffer)
+{
+    if (buffer) {
+        spinlock_lock(&buffer_cache.lock);
+        assert(buffer->count && "Releasing a buffer which is not in use.");
+        --buffer->count;
+        spinlock_unlock(&buffer_cache.lock);
+    }
+}
+
+void buffer_mark_dirty(buffer_head_t *buffer)
+{
+    buffer_head_t *entry;
+    bool_t wake = false;
+    spinlock_lock(&buffer_cache.lock);
+    if (!(buffer->flags & BUFFER_DIRTY)) {
+        // Keep the dirty list sorted, so that the flusher can merge writes.
+        list_head *location = &buffer_cache.dirty;
+        list_for_each_decl(it, &buffer_cache.dirty)
+        {
+            entry = list_entry(it, buffer_head_t, dirty);
+            if ((entry->key.device > buffer->key.device) ||
+                ((entry->key.device == buffer->key.device) && (entry->key.block > buffer->key.block))) {
+                location = it;
+                break;
+            }
+        }
+        list_head_insert_before(&buffer->dirty, location);
+        // Too many dirty buffers, start the write-back before the timer.
+        if ((++buffer_cache.ndirty * 100U >= buffer_dirty_ratio * buffer_cache_max_buffers) && !buffer_cache.flush_pending) {
+            buffer_cache.flush_pending = true;
+            wake                       = true;
+        }
+    }
+    // Whoever dirties the buffer has written its whole content.
+    buffer->flags |= BUFFER_UPTODATE | BUFFER_DIRTY;
+    spinlock_unlock(&buffer_cache.lock);
+    if (wake) {
+        wake_up(&buffer_cache.flush_wait);
+    }
+}
+
+int buffer_write(buffer_head_t *buffer)
+{
+    int ret = 0;
+    spinlock_lock(&buffer_cache.lock);
+    if ((buffer->flags & BUFFER_DIRTY) && !(buffer->flags & BUFFER_PINNED)) {
+        ret = __buffer_write(buffer);
+    }
+    spinlock_unlock(&buffer_cache.lock);
+    return ret;
+}
+
+void buffer_pin(buffer_head_t *buffer)
+{
+    spinlock_lock(&buffer_cache.lock);
+    if (!(buffer->flags & BUFFER_PINNED)) {
+        // The reference keeps the buffer away from eviction and the shrinker.
+        buffer->flags |= BUFFER_PINNED;
+        ++buffer->count;
+    }
+    spinlock_unlock(&buffer_cache.lock);
+}
+
+void buffer_unpin(buffer_head_t *buffer)
+{
+    spinlock_lock(&buffer_cache.lock);
+    if (buffer->flags & BUFFER_PINNED) {
+        buffer->flags &= ~BUFFER_PINNED;
+        --buffer->count;
+    }
+    spinlock_unlock(&buffer_cache.lock);
+}
+
+int buffer_sync(vfs_file_t *device)
+{
+    spinlock_lock(&buffer_cache.lock);
+    int ret = __buffer_sync(device);
+    spinlock_unlock(&buffer_cache.lock);
+    return ret;
+}
+
+/// @brief The flusher thread, which writes back the dirty buffers every time
+/// the flusher timer asks for it.
+/// @param data unused.
+/// @return never returns.
+static int __buffer_flusher(void *data)
+{
+    (void)data;
+    task_struct *task = scheduler_get_current_process();
+    wait_queue_entry_t wait;
+    init_waitqueue_entry(&wait, task);
+    while (true) {
+        // Sleep until the timer asks for a flush, with interrupts disabled so
+        // that its wake up cannot get lost.
+        uint8_t flags = irq_disable();
+        while (!buffer_cache.flush_pending) {
+            add_wait_queue(&buffer_cache.flush_wait, &wait);
+            scheduler_set_task_state(task, TASK_UNINTERRUPTIBLE);
+            kthread_yield();
+            remove_wait_queue(&buffer_cache.flush_wait, &wait);
+        }
+        buffer_cache.flush_pending = false;
+        irq_enable(flags);
+        // Go through the VFS, so that filesystems can write back their
+        // in-memory metadata before the blocks are flushed.
+        vfs_sync();
+    }
+    return 0;
+}
+
+int buffer_cache_start_flusher(void)
+{
+    return kthread_create(__buffer_flusher, NULL, "kflushd") != NULL;
+}
+
+void buffer_invalidate(vfs_file_t *device)
+{
+    buffer_head_t *buffer;
+    spinlock_lock(&buffer_cache.lock);
+    list_for_each_safe_decl(it, store, &buffer_cache.lru)
+    {
+        buffer = list_entry(it, buffer_head_t, lru);
+        if ((buffer->key.device == device) && (buffer->count == 0)) {
+            if (buffer->flags & BUFFER_DIRTY) {
+                __buffer_write(buffer);
+            }
+            __buffer_destroy(buffer);
+        }
+    }
+    spinlock_unlock(&buffer_cache.lock);
+}
+
+void buffer_drop_range(vfs_file_t *device, uint32_t block, uint32_t count, int discard)
+{
+    buffer_head_t *buffer;
+    buffer_key_t key = { .device = device };
+    spinlock_lock(&buffer_cache.lock);
+    for (uint32_t i = 0; i < count; ++i) {
+        key.block = block + i;
+        buffer    = hashmap_get(buffer_cache.map, &key);
+        if ((buffer == NULL) || buffer->count) {
+            continue;
+        }
+        if ((buffer->flags & BUFFER_DIRTY) && !discard && __buffer_write(buffer)) {
+            continue;
+        }
+        __buffer_destroy(buffer);
+    }
+    spinlock_unlock(&buffer_cache.lock);
+}
@@ -0,0 +1,218 @@
+/// @file dcache.c
+/// @brief Cache of the directory entries resolved by the filesystems.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+// Setup the logging for this file (do this before any other include).
+#include "sys/kernel_levels.h"           // Include kernel log levels.
+#define __DEBUG_HEADER__ "[DCACHE]"      ///< Change header.
+#define __DEBUG_LEVEL__  LOGLEVEL_NOTICE ///< Set log level.
+#include "io/debug.h"                    // Include debugging functions.
+
+#include "fs/dcache.h"
+
+#include "klib/hashmap.h"
+#include "klib/spinlock.h"
+#include "mem/shrinker.h"
+#include "mem/slab.h"
+#include "string.h"
+
+/// Number of buckets of the hashmap.
+#define DCACHE_BUCKETS 257
+/// Maximum number of entries kept in memory.
+#define DCACHE_MAX_ENTRIES 512
+
+/// @brief The dentry cache.
+static struct {
+    /// Maps (owner, parent, name) to the entry.
+    hashmap_t *map;
+    /// All the entries, the least recently used comes first.
+    list_head lru;
+    /// Number of entries currently allocated.
+    unsigned int size;
+    /// Cache for the entries.
+    kmem_cache_t *dentry_cache;
+    /// Protects the cache.
+    spinlock_t lock;
+} dcache;
+
+/// @brief Hashes a dentry key.
+/// @param key pointer to the dentry_key_t.
+/// @return the hash key.
+static unsigned int dentry_key_hash(const void *key)
+{
+    const dentry_key_t *dkey = (const dentry_key_t *)key;
+    unsigned int hash        = ((uintptr_t)dkey->owner * 31U) ^ (unsigned int)dkey->parent;
+    for (const char *c = dkey->name; *c; ++c) {
+        hash = (hash * 31U) + (unsigned char)*c;
+    }
+    return hash;
+}
+
+/// @brief Compares two dentry keys.
+/// @param a the first dentry_key_t.
+/// @param b the second dentry_key_t.
+/// @return 1 if they are equal, 0 otherwise.
+static int dentry_key_comp(const void *a, const void *b)
+{
+    const dentry_key_t *ka = (const dentry_key_t *)a, *kb = (const dentry_key_t *)b;
+    return (ka->owner == kb->owner) && (ka->parent == kb->parent) && (strcmp(ka->name, kb->name) == 0);
+}
+
+/// @brief Removes the entry from the cache and frees it.
+/// @param dentry the entry.
+static void __dentry_destroy(dentry_t *dentry)
+{
+    hashmap_remove(dcache.map, &dentry->key);
+    list_head_remove(&dentry->lru);
+    kmem_cache_free(dentry);
+    --dcache.size;
+}
+
+/// @brief Searches the entry inside the cache.
+/// @param owner the filesystem instance.
+/// @param parent the inode of the directory.
+/// @param name the name of the entry.
+/// @return the entry, NULL if not cached.
+static inline dentry_t *__dentry_lookup(const void *owner, ino_t parent, const char *name)
+{
+    dentry_key_t key = { .owner = owner, .parent = parent, .name = name };
+    return hashmap_get(dcache.map, &key);
+}
+
+/// @brief Returns the number of entries the shrinker could free.
+/// @return the number of cached entries.
+static unsigned long __dcache_count_objects(void)
+{
+    return dcache.size;
+}
+
+/// @brief Frees the least recently used entries, to give memory back under
+/// pressure.
+/// @param nr_to_scan the number of entries to free.
+/// @return the number of entries freed.
+static unsigned long __dcache_scan_objects(unsigned long nr_to_scan)
+{
+    unsigned long freed = 0;
+    // The cache might be allocating memory itself.
+    if (!spinlock_trylock(&dcache.lock)) {
+        return 0;
+    }
+    while ((freed < nr_to_scan) && !list_head_empty(&dcache.lru)) {
+        __dentry_destroy(list_entry(dcache.lru.next, dentry_t, lru));
+        ++freed;
+    }
+    spinlock_unlock(&dcache.lock);
+    return freed;
+}
+
+/// The shrinker of the dentry cache.
+static shrinker_t dcache_shrinker = {
+    .name          = "dentry cache",
+    .count_objects = __dcache_count_objects,
+    .scan_objects  = __dcache_scan_objects,
+};
+
+void dcache_init(void)
+{
+    dcache.map = hashmap_create(
+        DCACHE_BUCKETS,
+        dentry_key_hash,
+        dentry_key_comp,
+        hashmap_do_not_duplicate,
+        hashmap_do_not_free);
+    list_head_init(&dcache.lru);
+    dcache.size         = 0;
+    dcache.dentry_cache = KMEM_CREATE(dentry_t);
+    spinlock_init(&dcache.lock);
+    register_shrinker(&dcache_shrinker);
+}
+
+dentry_t *dcache_lookup(const void *owner, ino_t parent, const char *name)
+{
+    if (strlen(name) > DCACHE_NAME_LEN) {
+        return NULL;
+    }
+    spinlock_lock(&dcache.lock);
+    dentry_t *dentry = __dentry_lookup(owner, parent, name);
+    if (dentry) {
+        // Move the entry to the most recently used position.
+        list_head_remove(&dentry->lru);
+        list_head_insert_before(&dentry->lru, &dcache.lru);
+    }
+    spinlock_unlock(&dcache.lock);
+    return dentry;
+}
+
+void dcache_add(const void *owner, ino_t parent, const char *name, ino_t ino, int type)
+{
+    if (strlen(name) > DCACHE_NAME_LEN) {
+        return;
+    }
+    spinlock_lock(&dcache.lock);
+    dentry_t *dentry = __dentry_lookup(owner, parent, name);
+    if (dentry == NULL) {
+        // Make room for the new entry, dropping the least recently used.
+        if (dcache.size >= DCACHE_MAX_ENTRIES) {
+            __dentry_destroy(list_entry(dcache.lru.next, dentry_t, lru));
+        }
+        dentry = kmem_cache_alloc(dcache.dentry_cache, GFP_KERNEL);
+        if (dentry == NULL) {
+            pr_err("Failed to allocate a dentry.\n");
+            spinlock_unlock(&dcache.lock);
+            return;
+        }
+        strcpy(dentry->name, name);
+        dentry->key.owner  = owner;
+        dentry->key.parent = parent;
+        dentry->key.name   = dentry->name;
+        list_head_init(&dentry->lru);
+        hashmap_set(dcache.map, &dentry->key, dentry);
+        ++dcache.size;
+    } else {
+        list_head_remove(&dentry->lru);
+    }
+    dentry->ino  = ino;
+    dentry->type = type;
+    list_head_insert_before(&dentry->lru, &dcache.lru);
+    spinlock_unlock(&dcache.lock);
+}
+
+void dcache_remove(const void *owner, ino_t parent, const char *name)
+{
+    if (strlen(name) > DCACHE_NAME_LEN) {
+        return;
+    }
+    spinlock_lock(&dcache.lock);
+    dentry_t *dentry = __dentry_lookup(owner, parent, name);
+    if (dentry) {
+        __dentry_destroy(dentry);
+    }
+    spinlock_unlock(&dcache.lock);
+}
+
+void dcache_remove_directory(const void *owner, ino_t parent)
+{
+    spinlock_lock(&dcache.lock);
+    list_for_each_safe_decl(it, store, &dcache.lru)
+    {
+        dentry_t *dentry = list_entry(it, dentry_t, lru);
+        if ((dentry->key.owner == owner) && (dentry->key.parent == parent)) {
+            __dentry_destroy(dentry);
+        }
+    }
+    spinlock_unlock(&dcache.lock);
+}
+
+void dcache_invalidate(const void *owner)
+{
+    spinlock_lock(&dcache.lock);
+    list_for_each_safe_decl(it, store, &dcache.lru)
+    {
+        dentry_t *dentry = list_entry(it, dentry_t, lru);
+        if (dentry->key.owner == owner) {
+            __dentry_destroy(dentry);
+        }
+    }
+    spinlock_unlock(&dcache.lock);
+}
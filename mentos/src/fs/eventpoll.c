@@ -0,0 +1,594 @@
+/// @file eventpoll.c
+/// @brief Scalable notification of the events on a set of files.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// An epoll instance is a file holding the descriptors it watches inside a
+/// red/black tree, ordered by file and descriptor. Each watched file gets,
+/// through its poll_f callback, an entry on its queues whose wake function
+/// moves the descriptor on the ready list of the instance: epoll_wait only
+/// polls again the descriptors on that list, thus its cost depends on the
+/// number of ready descriptors, not on the watched ones.
+///
+/// Level-triggered descriptors go back on the ready list once reported, and
+/// leave it only when they are found not ready; edge-triggered ones are put
+/// back only by the next wake up. The processes cannot sleep inside the
+/// kernel, thus epoll_wait sleeps through do_poll, on the instance itself.
+
+// Setup the logging for this file (do this before any other include).
+#include "sys/kernel_levels.h"           // Include kernel log levels.
+#define __DEBUG_HEADER__ "[EPOLL ]"      ///< Change header.
+#define __DEBUG_LEVEL__  LOGLEVEL_NOTICE ///< Set log level.
+#include "io/debug.h"                    // Include debugging functions.
+
+#include "fcntl.h"
+#include "fs/eventpoll.h"
+#include "fs/poll.h"
+#include "fs/vfs.h"
+#include "klib/irqflags.h"
+#include "klib/rbtree.h"
+#include "klib/spinlock.h"
+#include "mem/kheap.h"
+#include "mem/slab.h"
+#include "poll.h"
+#include "process/scheduler.h"
+#include "stdio.h"
+#include "string.h"
+#include "sys/epoll.h"
+#include "sys/errno.h"
+
+/// The events which are always reported.
+#define EP_ALWAYS (EPOLLERR | EPOLLHUP)
+/// The flags which are not events.
+#define EP_PRIVATE_BITS (EPOLLONESHOT | EPOLLET)
+
+/// @brief An epoll instance.
+typedef struct eventpoll_t {
+    /// The watched descriptors, ordered by file and descriptor.
+    rbtree_t *rbr;
+    /// The descriptors which might be ready.
+    list_head rdllist;
+    /// The processes waiting on the instance, woken up when a descriptor
+    /// becomes ready.
+    wait_queue_head_t wq;
+    /// Protects the ready list, taken by the wake functions.
+    spinlock_t lock;
+    /// Reference inside the list of instances.
+    list_head list;
+} eventpoll_t;
+
+/// @brief A descriptor watched by an instance.
+typedef struct epitem_t {
+    /// The file.
+    vfs_file_t *file;
+    /// The descriptor.
+    int fd;
+    /// The events watched, and the data returned with them.
+    struct epoll_event event;
+    /// The instance.
+    eventpoll_t *ep;
+    /// Reference inside the ready list, empty if the item is not there.
+    list_head rdllink;
+    /// The entries on the queues of the file.
+    list_head pwqlist;
+} epitem_t;
+
+/// @brief The entry of a watched descriptor on a queue of its file.
+typedef struct eppoll_entry_t {
+    /// The entry inside the queue.
+    wait_queue_entry_t wait;
+    /// The queue.
+    wait_queue_head_t *head;
+    /// The descriptor.
+    epitem_t *item;
+    /// Reference inside the entries of the descriptor.
+    list_head list;
+} eppoll_entry_t;
+
+/// @brief The table given to the file of a descriptor being added.
+typedef struct ep_pqueue_t {
+    /// The table given to the file.
+    poll_table_t pt;
+    /// The descriptor.
+    epitem_t *item;
+    /// Set if an entry could not be allocated.
+    int failed;
+} ep_pqueue_t;
+
+/// The list of instances.
+static list_head eventpoll_list = { &eventpoll_list, &eventpoll_list };
+/// Protects the list of instances, and their trees.
+static spinlock_t eventpoll_lock;
+
+/// @brief Locks the ready list of an instance, with the interrupts disabled,
+/// since the wake functions run in the bottom halves too.
+/// @param ep the instance.
+/// @return the previous state of the interrupts.
+static inline uint8_t __ep_lock(eventpoll_t *ep)
+{
+    uint8_t flags = irq_disable();
+    spinlock_lock(&ep->lock);
+    return flags;
+}
+
+/// @brief Unlocks the ready list of an instance.
+/// @param ep the instance.
+/// @param flags the previous state of the interrupts.
+static inline void __ep_unlock(eventpoll_t *ep, uint8_t flags)
+{
+    spinlock_unlock(&ep->lock);
+    irq_enable(flags);
+}
+
+/// @brief Puts a descriptor on the ready list, unless it is already there.
+/// @param ep the instance, whose ready list is locked.
+/// @param epi the descriptor.
+static inline void __ep_set_ready(eventpoll_t *ep, epitem_t *epi)
+{
+    if (list_head_empty(&epi->rdllink)) {
+        list_head_insert_before(&epi->rdllink, &ep->rdllist);
+    }
+}
+
+/// @brief Compares two descriptors, by file and then by descriptor.
+/// @param tree the tree.
+/// @param a the first node.
+/// @param b the second node.
+/// @return negative, zero or positive if the first one is smaller, equal or greater.
+static int __ep_node_compare(rbtree_t *tree, rbtree_node_t *a, rbtree_node_t *b)
+{
+    (void)tree;
+    epitem_t *epa = rbtree_node_get_value(a), *epb = rbtree_node_get_value(b);
+    if (epa->file != epb->file) {
+        return (epa->file > epb->file) ? 1 : -1;
+    }
+    return (epa->fd > epb->fd) - (epa->fd < epb->fd);
+}
+
+/// @brief Compares a descriptor with a file.
+/// @param tree the tree.
+/// @param node the node of the descriptor.
+/// @param arg the file.
+/// @return negative, zero or positive if the file of the descriptor is
+/// smaller, equal or greater.
+static int __ep_file_compare(rbtree_t *tree, rbtree_node_t *node, void *arg)
+{
+    (void)tree;
+    epitem_t *epi = rbtree_node_get_value(node);
+    return ((void *)epi->file > arg) - ((void *)epi->file < arg);
+}
+
+/// @brief Searches a descriptor watched by an instance.
+/// @param ep the instance.
+/// @param file the file.
+/// @param fd the descriptor.
+/// @return the descriptor, NULL if it is not watched.
+static inline epitem_t *__ep_find(eventpoll_t *ep, vfs_file_t *file, int fd)
+{
+    epitem_t key = { .file = file, .fd = fd };
+    return (epitem_t *)rbtree_tree_find(ep->rbr, &key);
+}
+
+/// @brief Wakes up the instance of a descriptor, once its file changes.
+/// @param wait the entry of the descriptor.
+/// @param mode the type of wait.
+/// @param sync if the wakeup should be synchronous.
+/// @return 1, always.
+static int __ep_poll_callback(wait_queue_entry_t *wait, unsigned mode, int sync)
+{
+    eppoll_entry_t *pwq = container_of(wait, eppoll_entry_t, wait);
+    epitem_t *epi       = pwq->item;
+    eventpoll_t *ep     = epi->ep;
+    (void)mode, (void)sync;
+    uint8_t flags = __ep_lock(ep);
+    // A one-shot descriptor which fired is disabled until it is modified.
+    if (epi->event.events & ~EP_PRIVATE_BITS) {
+        __ep_set_ready(ep, epi);
+    }
+    __ep_unlock(ep, flags);
+    // The queue of the file is locked, but the one of the instance is another.
+    wake_up(&ep->wq);
+    return 1;
+}
+
+/// @brief Queues a descriptor being added on a queue of its file.
+/// @param file the file.
+/// @param head the queue.
+/// @param table the table, inside the ep_pqueue_t.
+static void __ep_ptable_queue_proc(vfs_file_t *file, wait_queue_head_t *head, poll_table_t *table)
+{
+    ep_pqueue_t *epq    = container_of(table, ep_pqueue_t, pt);
+    eppoll_entry_t *pwq = (eppoll_entry_t *)kmalloc(sizeof(eppoll_entry_t));
+    if (pwq == NULL) {
+        pr_warning("Cannot watch `%s`.\n", file->name);
+        epq->failed = 1;
+        return;
+    }
+    init_waitqueue_entry(&pwq->wait, NULL);
+    pwq->wait.func = __ep_poll_callback;
+    pwq->head      = head;
+    pwq->item      = epq->item;
+    list_head_insert_before(&pwq->list, &epq->item->pwqlist);
+    add_wait_queue(head, &pwq->wait);
+}
+
+/// @brief Removes a descriptor from the queues of its file, and from the
+/// ready list, then frees it.
+/// @param epi the descriptor, already out of the tree.
+static void __ep_free_item(epitem_t *epi)
+{
+    list_for_each_safe_decl(it, store, &epi->pwqlist)
+    {
+        eppoll_entry_t *pwq = list_entry(it, eppoll_entry_t, list);
+        remove_wait_queue(pwq->head, &pwq->wait);
+        list_head_remove(&pwq->list);
+        kfree(pwq);
+    }
+    uint8_t flags = __ep_lock(epi->ep);
+    list_head_remove(&epi->rdllink);
+    __ep_unlock(epi->ep, flags);
+    kfree(epi);
+}
+
+/// @brief Frees the descriptor of a node, when the tree is destroyed.
+/// @param tree the tree.
+/// @param node the node.
+static void __ep_free_node(rbtree_t *tree, rbtree_node_t *node)
+{
+    (void)tree;
+    __ep_free_item((epitem_t *)rbtree_node_get_value(node));
+}
+
+/// @brief Removes a descriptor from its instance.
+/// @param ep the instance, whose tree is locked.
+/// @param epi the descriptor.
+static inline void __ep_remove(eventpoll_t *ep, epitem_t *epi)
+{
+    rbtree_tree_remove(ep->rbr, epi);
+    __ep_free_item(epi);
+}
+
+static int __ep_close(vfs_file_t *file)
+{
+    eventpoll_t *ep = (eventpoll_t *)file->device;
+    spinlock_lock(&eventpoll_lock);
+    list_head_remove(&ep->list);
+    rbtree_tree_dealloc(ep->rbr, __ep_free_node);
+    spinlock_unlock(&eventpoll_lock);
+    pr_debug("Freeing epoll instance 0x%p.\n", ep);
+    kfree(ep);
+    kmem_cache_free(file);
+    return 0;
+}
+
+/// @brief Returns the events ready on an instance, which is readable when
+/// some of its descriptors might be ready.
+/// @param file the instance.
+/// @param table the table of the polling process, NULL if it does not sleep.
+/// @return the events.
+static unsigned int __ep_poll(vfs_file_t *file, poll_table_t *table)
+{
+    eventpoll_t *ep = (eventpoll_t *)file->device;
+    poll_wait(file, &ep->wq, table);
+    uint8_t flags = __ep_lock(ep);
+    int ready     = !list_head_empty(&ep->rdllist);
+    __ep_unlock(ep, flags);
+    return ready ? (POLLIN | POLLRDNORM) : 0;
+}
+
+/// Filesystem general operations.
+static vfs_sys_operations_t eventpoll_sys_operations = {
+    .mkdir_f   = NULL,
+    .rmdir_f   = NULL,
+    .stat_f    = NULL,
+    .creat_f   = NULL,
+    .symlink_f = NULL,
+};
+
+/// Filesystem file operations.
+static vfs_file_operations_t eventpoll_fs_operations = {
+    .open_f     = NULL,
+    .unlink_f   = NULL,
+    .close_f    = __ep_close,
+    .read_f     = NULL,
+    .write_f    = NULL,
+    .lseek_f    = NULL,
+    .stat_f     = NULL,
+    .ioctl_f    = NULL,
+    .getdents_f = NULL,
+    .readlink_f = NULL,
+    .poll_f     = __ep_poll,
+};
+
+/// @brief Checks if a file is an epoll instance.
+/// @param file the file.
+/// @return 1 if it is, 0 otherwise.
+static inline int __is_eventpoll(vfs_file_t *file)
+{
+    return file->fs_operations == &eventpoll_fs_operations;
+}
+
+/// @brief Returns the file of a descriptor of the calling process.
+/// @param fd the descriptor.
+/// @return the file, NULL if the descriptor is not open.
+static inline vfs_file_t *__ep_get_file(int fd)
+{
+    task_struct *task = scheduler_get_current_process();
+    if ((fd < 0) || (fd >= task->files->max_fd)) {
+        return NULL;
+    }
+    return task->files->fd_list[fd].file_struct;
+}
+
+void eventpoll_release(vfs_file_t *file)
+{
+    // Nothing to do, in the common case.
+    if (list_head_empty(&eventpoll_list) || __is_eventpoll(file)) {
+        return;
+    }
+    spinlock_lock(&eventpoll_lock);
+    list_for_each_decl(it, &eventpoll_list)
+    {
+        eventpoll_t *ep = list_entry(it, eventpoll_t, list);
+        epitem_t *epi;
+        // The same file might be watched through several descriptors.
+        while ((epi = rbtree_tree_find_by_value(ep->rbr, __ep_file_compare, file))) {
+            __ep_remove(ep, epi);
+        }
+    }
+    spinlock_unlock(&eventpoll_lock);
+}
+
+int sys_epoll_create1(int flags)
+{
+    task_struct *task = scheduler_get_current_process();
+    if (flags) {
+        return -EINVAL;
+    }
+    eventpoll_t *ep = (eventpoll_t *)kmalloc(sizeof(eventpoll_t));
+    if (!ep) {
+        return -ENOMEM;
+    }
+    memset(ep, 0, sizeof(eventpoll_t));
+    if (!(ep->rbr = rbtree_tree_create(__ep_node_compare))) {
+        kfree(ep);
+        return -ENOMEM;
+    }
+    vfs_file_t *file = kmem_cache_alloc(vfs_file_cache, GFP_KERNEL);
+    if (!file) {
+        rbtree_tree_dealloc(ep->rbr, NULL);
+        kfree(ep);
+        return -ENOMEM;
+    }
+    list_head_init(&ep->rdllist);
+    init_waitqueue_head(&ep->wq);
+    spinlock_init(&ep->lock);
+    memset(file, 0, sizeof(vfs_file_t));
+    strcpy(file->name, "anon_inode:[eventpoll]");
+    file->device         = ep;
+    file->uid            = task->uid;
+    file->gid            = task->gid;
+    file->mask           = S_IRUSR | S_IWUSR;
+    file->open_flags     = O_RDONLY;
+    file->count          = 1;
+    file->nlink          = 1;
+    file->sys_operations = &eventpoll_sys_operations;
+    file->fs_operations  = &eventpoll_fs_operations;
+    list_head_init(&file->siblings);
+    int fd = get_unused_fd();
+    if (fd < 0) {
+        rbtree_tree_dealloc(ep->rbr, NULL);
+        kfree(ep);
+        kmem_cache_free(file);
+        return fd;
+    }
+    vfs_install_fd(task->files, fd, file, O_RDONLY);
+    spinlock_lock(&eventpoll_lock);
+    list_head_insert_before(&ep->list, &eventpoll_list);
+    spinlock_unlock(&eventpoll_lock);
+    pr_debug("Created epoll instance %d for process %d.\n", fd, task->pid);
+    return fd;
+}
+
+int sys_epoll_create(int size)
+{
+    if (size <= 0) {
+        return -EINVAL;
+    }
+    return sys_epoll_create1(0);
+}
+
+/// @brief Starts watching a descriptor.
+/// @param ep the instance, whose tree is locked.
+/// @param file the file.
+/// @param fd the descriptor.
+/// @param event the events, and their data.
+/// @return 0 on success, -errno on failure.
+static int __ep_insert(eventpoll_t *ep, vfs_file_t *file, int fd, struct epoll_event *event)
+{
+    epitem_t *epi = (epitem_t *)kmalloc(sizeof(epitem_t));
+    if (!epi) {
+        return -ENOMEM;
+    }
+    epi->file  = file;
+    epi->fd    = fd;
+    epi->event = *event;
+    epi->event.events |= EP_ALWAYS;
+    epi->ep = ep;
+    list_head_init(&epi->rdllink);
+    list_head_init(&epi->pwqlist);
+    if (!rbtree_tree_insert(ep->rbr, epi)) {
+        kfree(epi);
+        return -ENOMEM;
+    }
+    // Queue the descriptor on the file, and check it straight away, an event
+    // before it was queued would be missed otherwise.
+    ep_pqueue_t epq      = { .pt.queue = __ep_ptable_queue_proc, .item = epi, .failed = 0 };
+    unsigned int revents = file->fs_operations->poll_f(file, &epq.pt) & epi->event.events;
+    if (epq.failed) {
+        __ep_remove(ep, epi);
+        return -ENOMEM;
+    }
+    if (revents) {
+        uint8_t flags = __ep_lock(ep);
+        __ep_set_ready(ep, epi);
+        __ep_unlock(ep, flags);
+        wake_up(&ep->wq);
+    }
+    return 0;
+}
+
+/// @brief Changes the events of a watched descriptor.
+/// @param ep the instance, whose tree is locked.
+/// @param epi the descriptor.
+/// @param event the events, and their data.
+static void __ep_modify(eventpoll_t *ep, epitem_t *epi, struct epoll_event *event)
+{
+    uint8_t flags = __ep_lock(ep);
+    epi->event    = *event;
+    epi->event.events |= EP_ALWAYS;
+    __ep_unlock(ep, flags);
+    // It might be ready for the new events, or re-enabled after a one-shot.
+    if (epi->file->fs_operations->poll_f(epi->file, NULL) & epi->event.events) {
+        flags = __ep_lock(ep);
+        __ep_set_ready(ep, epi);
+        __ep_unlock(ep, flags);
+        wake_up(&ep->wq);
+    }
+}
+
+int sys_epoll_ctl(int epfd, int op, int fd, struct epoll_event *event)
+{
+    vfs_file_t *epfile = __ep_get_file(epfd), *file = __ep_get_file(fd);
+    if (!epfile || !file) {
+        return -EBADF;
+    }
+    // The instances cannot watch each other, nor themselves.
+    if (!__is_eventpoll(epfile) || __is_eventpoll(file)) {
+        return -EINVAL;
+    }
+    // The files which cannot tell when they are ready cannot be watched.
+    if (file->fs_operations->poll_f == NULL) {
+        return -EPERM;
+    }
+    if ((op != EPOLL_CTL_DEL) && (event == NULL)) {
+        return -EFAULT;
+    }
+    eventpoll_t *ep = (eventpoll_t *)epfile->device;
+    int ret         = 0;
+    spinlock_lock(&eventpoll_lock);
+    epitem_t *epi = __ep_find(ep, file, fd);
+    switch (op) {
+    case EPOLL_CTL_ADD:
+        ret = epi ? -EEXIST : __ep_insert(ep, file, fd, event);
+        break;
+    case EPOLL_CTL_DEL:
+        if (epi) {
+            __ep_remove(ep, epi);
+        } else {
+            ret = -ENOENT;
+        }
+        break;
+    case EPOLL_CTL_MOD:
+        if (epi) {
+            __ep_modify(ep, epi, event);
+        } else {
+            ret = -ENOENT;
+        }
+        break;
+    default:
+        ret = -EINVAL;
+        break;
+    }
+    spinlock_unlock(&eventpoll_lock);
+    return ret;
+}
+
+/// @brief Reports the events of the descriptors on the ready list.
+/// @param ep the instance, whose tree is locked.
+/// @param events where the events are stored.
+/// @param maxevents the maximum number of events.
+/// @return the number of events.
+static int __ep_send_events(eventpoll_t *ep, struct epoll_event *events, int maxevents)
+{
+    list_head txlist, *it;
+    int count = 0;
+    list_head_init(&txlist);
+    // Take the whole ready list, the wake functions start a new one.
+    uint8_t flags = __ep_lock(ep);
+    while ((it = list_head_pop(&ep->rdllist))) {
+        list_head_insert_before(it, &txlist);
+    }
+    __ep_unlock(ep, flags);
+    while (count < maxevents) {
+        flags = __ep_lock(ep);
+        it    = list_head_pop(&txlist);
+        __ep_unlock(ep, flags);
+        if (it == NULL) {
+            break;
+        }
+        epitem_t *epi = list_entry(it, epitem_t, rdllink);
+        // The descriptors which are not ready anymore leave the list.
+        unsigned int revents = epi->file->fs_operations->poll_f(epi->file, NULL) & epi->event.events;
+        if (revents == 0) {
+            continue;
+        }
+        events[count].events = revents;
+        events[count].data   = epi->event.data;
+        ++count;
+        flags = __ep_lock(ep);
+        if (epi->event.events & EPOLLONESHOT) {
+            epi->event.events &= EP_PRIVATE_BITS;
+        } else if (!(epi->event.events & EPOLLET)) {
+            // Level-triggered ones are checked again by the next call.
+            __ep_set_ready(ep, epi);
+        }
+        __ep_unlock(ep, flags);
+    }
+    // Those not reported go back in front of the list.
+    flags = __ep_lock(ep);
+    while ((it = list_head_pop(&ep->rdllist))) {
+        list_head_insert_before(it, &txlist);
+    }
+    while ((it = list_head_pop(&txlist))) {
+        list_head_insert_before(it, &ep->rdllist);
+    }
+    __ep_unlock(ep, flags);
+    return count;
+}
+
+int sys_epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout)
+{
+    task_struct *task = scheduler_get_current_process();
+    vfs_file_t *file  = __ep_get_file(epfd);
+    int ret;
+    if (!file) {
+        poll_release(task);
+        return -EBADF;
+    }
+    if (!__is_eventpoll(file) || (maxevents <= 0)) {
+        poll_release(task);
+        return -EINVAL;
+    }
+    if (events == NULL) {
+        poll_release(task);
+        return -EFAULT;
+    }
+    eventpoll_t *ep     = (eventpoll_t *)file->device;
+    struct pollfd epfds = { .fd = epfd, .events = POLLIN, .revents = 0 };
+    while (1) {
+        spinlock_lock(&eventpoll_lock);
+        ret = __ep_send_events(ep, events, maxevents);
+        spinlock_unlock(&eventpoll_lock);
+        if (ret > 0) {
+            // We might have slept, leave the queue of the instance.
+            poll_release(task);
+            return ret;
+        }
+        // Sleep on the instance, until a descriptor might be ready, and
+        // check again if it is.
+        if ((ret = do_poll(&epfds, 1, timeout)) <= 0) {
+            return ret;
+        }
+    }
+}
@@ -11,11 +11,20 @@
 
 #include "assert.h"
 #include "fcntl.h"
+#include "fs/aio.h"
+#include "fs/bio.h"
+#include "fs/buffer_cache.h"
+#include "fs/dcache.h"
 #include "fs/ext2.h"
+#include "fs/jbd.h"
+#include "fs/page_cache.h"
 #include "fs/vfs.h"
 #include "fs/vfs_types.h"
-#include "klib/spinlock.h"
+#include "klib/hashmap.h"
+#include "klib/mutex.h"
 #include "libgen.h"
+#include "mem/vmem_map.h"
+#include "process/preempt.h"
 #include "process/process.h"
 #include "process/scheduler.h"
 #include "stdio.h"
@@ -27,6 +36,16 @@
 #define EXT2_PATH_MAX          4096   ///< Maximum length of a pathname.
 #define EXT2_MAX_SYMLINK_COUNT 8      ///< Maximum nesting of symlinks, used to prevent a loop.
 #define EXT2_NAME_LEN          255    ///< The lenght of names inside directory entries.
+#define EXT2_READ_AHEAD_MIN    4      ///< Initial read-ahead window, in blocks.
+#define EXT2_DIRECT_IO_ALIGN   512    ///< Alignment of the buffers of O_DIRECT transfers.
+#define EXT2_READ_AHEAD_MAX    32     ///< Maximum read-ahead window, in blocks.
+#define EXT2_BLOCK_MAP_SIZE    1024   ///< Number of cached indirect block mappings (power of 2).
+#define EXT2_ICACHE_BUCKETS    127    ///< Number of buckets of the inode cache.
+#define EXT2_ICACHE_MAX        256    ///< Maximum number of inodes kept in memory.
+#define EXT2_CLOSED_FILES_MAX  32     ///< Maximum number of closed files kept in memory.
+#define EXT2_RESERVATION_MAX   32     ///< Number of block reservation windows.
+#define EXT2_RESERVATION_SIZE  8      ///< Blocks reserved for a file on each new window.
+#define EXT2_ALLOCATE_BATCH    64     ///< Maximum number of blocks allocated with a single metadata update.
 
 // File types.
 #define EXT2_S_IFMT   0xF000 ///< Format mask
@@ -55,6 +74,28 @@
 #define EXT2_S_IWOTH 0x0002 ///< --------w- : Others can write
 #define EXT2_S_IXOTH 0x0001 ///< ---------x : Others can execute
 
+// Directory indexing.
+#define EXT2_INDEX_FL                 0x00001000U ///< The directory is indexed with an HTree.
+#define EXT2_FEATURE_COMPAT_DIR_INDEX 0x00000020U ///< The filesystem can use indexed directories.
+#define EXT2_FLAGS_UNSIGNED_HASH      0x00000002U ///< Names are hashed as unsigned characters.
+#define EXT2_HTREE_LEGACY             0           ///< Legacy hash.
+#define EXT2_HTREE_HALF_MD4           1           ///< Half MD4 hash.
+#define EXT2_HTREE_TEA                2           ///< Tiny Encryption Algorithm hash.
+#define EXT2_HTREE_EOF                0x7FFFFFFFU ///< Hash reserved to mark the end of the directory.
+#define EXT2_HTREE_MAX_DEPTH          2           ///< The root, plus one level of index nodes.
+#define EXT2_HTREE_BLOCK_MASK         0x0FFFFFFFU ///< Bits of an index entry holding the block.
+#define EXT2_HTREE_ROOT_INFO_OFFSET   24          ///< Offset of the root info, after `.` and `..`.
+
+// Extents.
+#define EXT4_EXTENTS_FL               0x00080000U ///< The blocks of the inode are mapped by an extent tree.
+#define EXT4_FEATURE_INCOMPAT_EXTENTS 0x00000040U ///< The filesystem can use extent trees.
+#define EXT4_EXT_MAGIC                0xF30AU     ///< Magic number of the nodes of an extent tree.
+#define EXT4_EXT_INIT_MAX_LEN         32768U      ///< Longer extents are not initialized, and read as zeros.
+#define EXT4_EXT_MAX_DEPTH            1           ///< The root, plus one level of leaves.
+
+// Journal.
+#define EXT3_FEATURE_COMPAT_HAS_JOURNAL 0x00000004U ///< The filesystem has a journal.
+
 // ============================================================================
 // Data Structures
 // ============================================================================
@@ -190,17 +231,33 @@ typedef struct ext2_superblock_t {
     /// @brief Ddefault hash version to use.
     uint8_t def_hash_version;
     /// @brief Padding.
-    uint16_t padding1;
+    uint8_t padding1;
     /// @brief Padding.
-    uint8_t padding2;
+    uint16_t padding2;
 
     // == Other Options =======================================================
     /// @brief The default mount options for the file system.
     uint32_t default_mount_options;
     /// @brief The ID of the first meta block group.
     uint32_t first_meta_block_group_id;
+    /// @brief When the filesystem was created.
+    uint32_t mkfs_time;
+    /// @brief Backup of the journal inode blocks.
+    uint32_t journal_blocks[17];
+    /// @brief High 32 bits of the total number of blocks (unused).
+    uint32_t blocks_count_hi;
+    /// @brief High 32 bits of the number of reserved blocks (unused).
+    uint32_t r_blocks_count_hi;
+    /// @brief High 32 bits of the number of free blocks (unused).
+    uint32_t free_blocks_count_hi;
+    /// @brief Minimum extra size of the inodes.
+    uint16_t min_extra_isize;
+    /// @brief Desired extra size of the inodes.
+    uint16_t want_extra_isize;
+    /// @brief Miscellaneous flags (e.g., EXT2_FLAGS_UNSIGNED_HASH).
+    uint32_t flags;
     /// @brief Reserved.
-    uint8_t reserved[760];
+    uint8_t reserved[668];
 } ext2_superblock_t;
 
 /// @brief Entry of the Block Group Descriptor Table (BGDT).
@@ -291,6 +348,150 @@ typedef struct ext2_dirent_t {
     char name[];
 } ext2_dirent_t;
 
+/// @brief A cached mapping from a block of an inode to the real block.
+typedef struct ext2_block_map_entry_t {
+    /// The root of the indirect tree the mapping comes from (0 if unused).
+    uint32_t root;
+    /// The index of the block within the inode.
+    uint32_t block_index;
+    /// The real block number.
+    uint32_t real_index;
+} ext2_block_map_entry_t;
+
+/// @brief An inode kept in memory.
+typedef struct ext2_icache_entry_t {
+    /// The index of the inode.
+    uint32_t inode_index;
+    /// The content of the inode.
+    ext2_inode_t inode;
+    /// The inode has been modified, and must be written back.
+    int dirty;
+    /// Position inside the LRU list, the least recently used comes first.
+    list_head lru;
+} ext2_icache_entry_t;
+
+/// @brief Information stored in the root of an HTree, after the `.` and `..`
+/// directory entries.
+typedef struct ext2_dx_root_info_t {
+    /// Must be zero.
+    uint32_t reserved_zero;
+    /// The hash used to index the names.
+    uint8_t hash_version;
+    /// Length of this structure.
+    uint8_t info_length;
+    /// Number of levels of index nodes below the root.
+    uint8_t indirect_levels;
+    /// Unused.
+    uint8_t unused_flags;
+} ext2_dx_root_info_t;
+
+/// @brief An entry of an HTree index block.
+typedef struct ext2_dx_entry_t {
+    /// The lowest hash of the names reachable through the entry. The first
+    /// entry has an implicit hash, its place is taken by ext2_dx_countlimit_t.
+    uint32_t hash;
+    /// The block, inside the directory, the entry points to.
+    uint32_t block;
+} ext2_dx_entry_t;
+
+/// @brief Limit and count of the entries of an index block.
+typedef struct ext2_dx_countlimit_t {
+    /// Maximum number of entries.
+    uint16_t limit;
+    /// Number of entries.
+    uint16_t count;
+} ext2_dx_countlimit_t;
+
+/// @brief An index block visited while walking an HTree.
+typedef struct ext2_dx_frame_t {
+    /// The block, inside the directory.
+    uint32_t block;
+    /// The content of the block.
+    uint8_t *buffer;
+    /// The entries of the block.
+    ext2_dx_entry_t *entries;
+    /// The entry we followed.
+    ext2_dx_entry_t *at;
+} ext2_dx_frame_t;
+
+/// @brief The path from the root of an HTree to the leaf of a hash.
+typedef struct ext2_dx_path_t {
+    /// The index blocks, starting from the root.
+    ext2_dx_frame_t frames[EXT2_HTREE_MAX_DEPTH];
+    /// Number of index blocks.
+    int depth;
+    /// The hash version of the tree.
+    uint8_t hash_version;
+    /// The hash we are looking for.
+    uint32_t hash;
+} ext2_dx_path_t;
+
+/// @brief The header of a node of an extent tree. The root lives inside the
+/// inode, in place of the block pointers.
+typedef struct ext2_extent_header_t {
+    /// Must be EXT4_EXT_MAGIC.
+    uint16_t magic;
+    /// Number of entries following the header.
+    uint16_t entries;
+    /// Maximum number of entries following the header.
+    uint16_t max;
+    /// Number of levels of nodes below this one, 0 for a leaf.
+    uint16_t depth;
+    /// Unused.
+    uint32_t generation;
+} ext2_extent_header_t;
+
+/// @brief An entry of an internal node of an extent tree.
+typedef struct ext2_extent_idx_t {
+    /// The first block, inside the file, covered by the child.
+    uint32_t block;
+    /// The block holding the child, low 32 bits.
+    uint32_t leaf_lo;
+    /// The block holding the child, high 16 bits.
+    uint16_t leaf_hi;
+    /// Unused.
+    uint16_t unused;
+} ext2_extent_idx_t;
+
+/// @brief An entry of a leaf of an extent tree: a run of contiguous blocks.
+typedef struct ext2_extent_t {
+    /// The first block, inside the file, covered by the extent.
+    uint32_t block;
+    /// Number of blocks, above EXT4_EXT_INIT_MAX_LEN for extents which are
+    /// not initialized.
+    uint16_t len;
+    /// The first real block, high 16 bits.
+    uint16_t start_hi;
+    /// The first real block, low 32 bits.
+    uint32_t start_lo;
+} ext2_extent_t;
+
+/// @brief In-memory state of a block group.
+typedef struct ext2_group_info_t {
+    /// The block bitmap, pinned in memory.
+    uint32_t *block_bitmap;
+    /// The inode bitmap, pinned in memory.
+    uint32_t *inode_bitmap;
+    /// Where the search for a free block starts, right after the last one allocated.
+    uint32_t block_goal;
+    /// Where the search for a free inode starts, right after the last one allocated.
+    uint32_t inode_goal;
+    /// The block bitmap has been modified and must be written back.
+    int block_bitmap_dirty;
+} ext2_group_info_t;
+
+/// @brief A window of free blocks reserved for the future writes of an inode.
+/// @details Reservations only live in memory, the blocks stay free on disk
+/// until they are actually allocated.
+typedef struct ext2_reservation_t {
+    /// The inode owning the window, 0 if the slot is unused.
+    uint32_t inode_index;
+    /// The first block of the window.
+    uint32_t start;
+    /// The block right after the window.
+    uint32_t end;
+} ext2_reservation_t;
+
 /// @brief The details regarding the filesystem.
 typedef struct ext2_filesystem_t {
     /// Pointer to the block device.
@@ -299,12 +500,26 @@ typedef struct ext2_filesystem_t {
     ext2_superblock_t superblock;
     /// Block Group Descriptor / Block groups.
     ext2_group_descriptor_t *block_groups;
+    /// In-memory state of the block groups.
+    ext2_group_info_t *group_info;
+    /// The group of the last allocated block.
+    uint32_t last_block_group;
+    /// Windows of blocks reserved for the inodes being written.
+    ext2_reservation_t reservations[EXT2_RESERVATION_MAX];
+    /// The next slot to recycle when all the reservations are in use.
+    uint32_t reservation_next;
     /// EXT2 memory cache for buffers.
     kmem_cache_t *ext2_buffer_cache;
+    /// The journal of the metadata, NULL if the filesystem has none.
+    journal_t *journal;
     /// Root FS node (attached to mountpoint).
     vfs_file_t *root;
-    /// List of opened files.
-    list_head opened_files;
+    /// The files in memory, open or recently closed, indexed by inode number.
+    hashmap_t *files;
+    /// The recently closed files, the least recently closed comes first.
+    list_head closed_files;
+    /// Number of recently closed files.
+    uint32_t closed_count;
 
     /// Size of one block.
     uint32_t block_size;
@@ -323,9 +538,19 @@ typedef struct ext2_filesystem_t {
     uint32_t bgdt_end_block;
     /// The number of blocks containing the BGDT
     uint32_t bgdt_length;
-
-    /// Spinlock for protecting filesystem operations.
-    spinlock_t spinlock;
+    /// Cache of the mappings resolved through indirect blocks. Indirect blocks
+    /// belong to a single inode, so the root of the tree identifies the inode.
+    ext2_block_map_entry_t block_map[EXT2_BLOCK_MAP_SIZE];
+    /// Inodes kept in memory, indexed by inode number.
+    hashmap_t *icache;
+    /// The inodes kept in memory, the least recently used comes first.
+    list_head icache_lru;
+    /// Number of inodes kept in memory.
+    uint32_t icache_count;
+
+    /// Mutex protecting the allocation of inodes and blocks, which sleeps
+    /// while the bitmaps are written back.
+    mutex_t lock;
 } ext2_filesystem_t;
 
 /// @brief Structure used when searching for a directory entry.
@@ -351,6 +576,9 @@ typedef struct ext2_direntry_search_t {
     } direntry;
 } ext2_direntry_search_t;
 
+/// Maximum read-ahead window, in blocks.
+unsigned ext2_read_ahead_max = EXT2_READ_AHEAD_MAX;
+
 // ============================================================================
 // Forward Declaration of Functions
 // ============================================================================
@@ -375,10 +603,18 @@ static ssize_t ext2_read(vfs_file_t *file, char *buffer, off_t offset, size_t nb
 static ssize_t ext2_write(vfs_file_t *file, const void *buffer, off_t offset, size_t nbyte);
 static off_t ext2_lseek(vfs_file_t *file, off_t offset, int whence);
 static int ext2_fstat(vfs_file_t *file, stat_t *stat);
+static int ext2_statat(vfs_file_t *directory, const char *path, stat_t *stat, unsigned int mask);
 static int ext2_ioctl(vfs_file_t *file, int request, void *data);
 static ssize_t ext2_getdents(vfs_file_t *file, dirent_t *dirp, off_t doff, size_t count);
 static ssize_t ext2_readlink(vfs_file_t *file, char *buffer, size_t bufsize);
 static int ext2_fsetattr(vfs_file_t *file, struct iattr *attr);
+static int ext2_fsync(vfs_file_t *file);
+static ssize_t ext2_direct_io(vfs_file_t *file, int write, void *buffer, off_t offset, size_t nbyte);
+static int ext2_fadvise(vfs_file_t *file, off_t offset, off_t len, int advice);
+static ssize_t ext2_aio_read(vfs_file_t *file, kiocb_t *iocb, off_t offset, size_t nbyte);
+static int ext2_readpage(vfs_file_t *file, page_t *page, uint32_t index);
+static int ext2_readpages(vfs_file_t *file, page_t **pages, const uint32_t *indices, unsigned count);
+static int ext2_writepages(vfs_file_t *file, page_t **pages, const uint32_t *indices, unsigned count);
 
 static int ext2_mkdir(const char *path, mode_t mode);
 static int ext2_rmdir(const char *path);
@@ -389,6 +625,9 @@ static vfs_file_t *ext2_mount(vfs_file_t *block_device, const char *path);
 
 static uint32_t ext2_get_real_block_index(ext2_filesystem_t *fs, ext2_inode_t *inode, uint32_t block_index);
 
+/// Cache for the inodes kept in memory.
+static kmem_cache_t *ext2_icache_entry_cache;
+
 // ============================================================================
 // Virtual FileSystem (VFS) Operaions
 // ============================================================================
@@ -405,17 +644,25 @@ static vfs_sys_operations_t ext2_sys_operations = {
 
 /// Filesystem file operations.
 static vfs_file_operations_t ext2_fs_operations = {
-    .open_f     = ext2_open,
-    .unlink_f   = ext2_unlink,
-    .close_f    = ext2_close,
-    .read_f     = ext2_read,
-    .write_f    = ext2_write,
-    .lseek_f    = ext2_lseek,
-    .stat_f     = ext2_fstat,
-    .ioctl_f    = ext2_ioctl,
-    .getdents_f = ext2_getdents,
-    .readlink_f = ext2_readlink,
-    .setattr_f  = ext2_fsetattr,
+    .open_f       = ext2_open,
+    .unlink_f     = ext2_unlink,
+    .close_f      = ext2_close,
+    .read_f       = ext2_read,
+    .write_f      = ext2_write,
+    .lseek_f      = ext2_lseek,
+    .stat_f       = ext2_fstat,
+    .ioctl_f      = ext2_ioctl,
+    .getdents_f   = ext2_getdents,
+    .readlink_f   = ext2_readlink,
+    .setattr_f    = ext2_fsetattr,
+    .fsync_f      = ext2_fsync,
+    .statat_f     = ext2_statat,
+    .direct_io_f  = ext2_direct_io,
+    .fadvise_f    = ext2_fadvise,
+    .aio_read_f   = ext2_aio_read,
+    .readpage_f   = ext2_readpage,
+    .readpages_f  = ext2_readpages,
+    .writepages_f = ext2_writepages,
 };
 
 // ============================================================================
@@ -727,7 +974,7 @@ static uint32_t ext2_inode_index_to_block_index(ext2_filesystem_t *fs, uint32_t
 /// @return the block group index.
 static uint32_t ext2_block_index_to_group_index(ext2_filesystem_t *fs, uint32_t block_index)
 {
-    return block_index / fs->superblock.blocks_per_group;
+    return (block_index - fs->superblock.first_data_block) / fs->superblock.blocks_per_group;
 }
 
 /// @brief Determining the offest of the block inside the block group.
@@ -736,7 +983,7 @@ static uint32_t ext2_block_index_to_group_index(ext2_filesystem_t *fs, uint32_t
 /// @return the offset of the block inside the group.
 static uint32_t ext2_block_index_to_group_offset(ext2_filesystem_t *fs, uint32_t block_index)
 {
-    return block_index % fs->superblock.blocks_per_group;
+    return (block_index - fs->superblock.first_data_block) % fs->superblock.blocks_per_group;
 }
 
 /// @brief Checks if the task has x-permission for a given inode
@@ -762,66 +1009,96 @@ static int __valid_x_permission(task_struct *task, ext2_inode_t *inode)
     return inode->mode & S_IXOTH;
 }
 
-/// @brief Searches for a free inode inside the group data loaded inside the cache.
+/// @brief Finds the first zero bit inside the range, one word at a time.
+/// @param bitmap the bitmap.
+/// @param start the first bit of the range.
+/// @param end the bit right after the range.
+/// @return the index of the bit, -1 if all the bits are set.
+static inline int ext2_bitmap_find_zero(const uint32_t *bitmap, uint32_t start, uint32_t end)
+{
+    uint32_t index = start, word;
+    while (index < end) {
+        // Consider the bits before the start of the range as set.
+        word = bitmap[index / 32] | ((1U << (index % 32)) - 1U);
+        if (word != 0xFFFFFFFFU) {
+            index = (index & ~31U) + __builtin_ctz(~word);
+            return (index < end) ? (int)index : -1;
+        }
+        index = (index & ~31U) + 32;
+    }
+    return -1;
+}
+
+/// @brief Finds a zero bit inside the range, starting from the goal and
+/// wrapping around.
+/// @param bitmap the bitmap.
+/// @param goal the bit where we start the search.
+/// @param start the first bit of the range.
+/// @param end the bit right after the range.
+/// @return the index of the bit, -1 if all the bits are set.
+static inline int ext2_bitmap_search(const uint32_t *bitmap, uint32_t goal, uint32_t start, uint32_t end)
+{
+    int index = -1;
+    if ((goal >= start) && (goal < end)) {
+        index = ext2_bitmap_find_zero(bitmap, goal, end);
+        end   = goal;
+    }
+    if (index < 0) {
+        index = ext2_bitmap_find_zero(bitmap, start, end);
+    }
+    return index;
+}
+
+/// @brief Returns the number of blocks of the group, the last one can be smaller.
+/// @param fs the ext2 filesystem structure.
+/// @param group_index the group index.
+/// @return the number of blocks.
+static inline uint32_t ext2_group_blocks_count(ext2_filesystem_t *fs, uint32_t group_index)
+{
+    uint32_t first = fs->superblock.first_data_block + (group_index * fs->superblock.blocks_per_group);
+    return min(fs->superblock.blocks_per_group, fs->superblock.blocks_count - first);
+}
+
+/// @brief Searches for a free inode inside the pinned bitmap of the group.
 /// @param fs the ext2 filesystem structure.
-/// @param cache the cache from which we read the bgdt data.
+/// @param group_index the group index.
 /// @param group_offset the output variable where we store the linear indes to the free inode.
 /// @return 1 if we found a free inode, 0 otherwise.
-static inline int ext2_find_free_inode_in_group(
-    ext2_filesystem_t *fs,
-    uint8_t *cache,
-    uint32_t *group_offset,
-    int skip_reserved)
+static inline int ext2_find_free_inode_in_group(ext2_filesystem_t *fs, uint32_t group_index, uint32_t *group_offset)
 {
-    for ((*group_offset) = 0; (*group_offset) < fs->superblock.inodes_per_group; ++(*group_offset)) {
-        // If we need to skip the reserved inodes, we skip the round if the
-        // index is that of a reserved inode (superblock.first_ino).
-        if (skip_reserved && ((*group_offset) < fs->superblock.first_ino)) {
-            continue;
-        }
-        // Check if the entry is free.
-        if (!ext2_bitmap_check(cache, *group_offset)) {
-            return 1;
-        }
+    ext2_group_info_t *info = &fs->group_info[group_index];
+    // Skip the reserved inodes (those before superblock.first_ino), which
+    // live in group 0.
+    uint32_t start = (group_index == 0) ? (fs->superblock.first_ino - 1) : 0;
+    int index      = ext2_bitmap_search(info->inode_bitmap, info->inode_goal, start, fs->superblock.inodes_per_group);
+    if (index < 0) {
+        return 0;
     }
-    return 0;
+    *group_offset = index;
+    return 1;
 }
 
 /// @brief Searches for a free inode inside the Block Group Descriptor Table (BGDT).
 /// @param fs the ext2 filesystem structure.
-/// @param cache the cache from which we read the bgdt data.
 /// @param group_index the output variable where we store the group index.
 /// @param group_offset the output variable where we store the linear indes to the free inode.
+/// @param preferred_group the group we try first.
 /// @return 1 if we found a free inode, 0 otherwise.
 static inline int ext2_find_free_inode(
     ext2_filesystem_t *fs,
-    uint8_t *cache,
     uint32_t *group_index,
     uint32_t *group_offset,
     uint32_t preferred_group)
 {
-    // If we received a preference, try to find a free inode in that specific group.
-    if (preferred_group != 0) {
-        // Set the group index to the preferred group.
-        (*group_index) = preferred_group;
-        // Find the first free inode. We need to ask to skip reserved inodes,
-        // only if we are in group 0.
-        if (ext2_find_free_inode_in_group(fs, cache, group_offset, (*group_index) == 0)) {
-            return 1;
-        }
+    // Start from the preferred group, and try the others in order.
+    if (preferred_group >= fs->block_groups_count) {
+        preferred_group = 0;
     }
-    // Get the group and bit index of the first free block.
-    for ((*group_index) = 0; (*group_index) < fs->block_groups_count; ++(*group_index)) {
+    for (uint32_t i = 0; i < fs->block_groups_count; ++i) {
+        (*group_index) = (preferred_group + i) % fs->block_groups_count;
         // Check if there are free inodes in this block group.
         if (fs->block_groups[(*group_index)].free_inodes_count > 0) {
-            // Read the block bitmap.
-            if (ext2_read_block(fs, fs->block_groups[(*group_index)].inode_bitmap, cache) < 0) {
-                pr_err("Failed to read the inode bitmap for group `%d`.\n", (*group_index));
-                return 0;
-            }
-            // Find the first free inode. We need to ask to skip reserved
-            // inodes, only if we are in group 0.
-            if (ext2_find_free_inode_in_group(fs, cache, group_offset, (*group_index) == 0)) {
+            if (ext2_find_free_inode_in_group(fs, (*group_index), group_offset)) {
                 return 1;
             }
         }
@@ -829,45 +1106,132 @@ static inline int ext2_find_free_inode(
     return 0;
 }
 
-/// @brief Searches for a free block inside the group data loaded inside the cache.
+/// @brief Returns the reservation window of the inode.
 /// @param fs the ext2 filesystem structure.
-/// @param cache the cache from which we read the bgdt data.
-/// @param group_index the output variable where we store the group index.
+/// @param inode_index the index of the inode.
+/// @return the reservation, NULL if the inode has none.
+static inline ext2_reservation_t *ext2_reservation_get(ext2_filesystem_t *fs, uint32_t inode_index)
+{
+    for (uint32_t i = 0; i < EXT2_RESERVATION_MAX; ++i) {
+        if (fs->reservations[i].inode_index == inode_index) {
+            return &fs->reservations[i];
+        }
+    }
+    return NULL;
+}
+
+/// @brief Returns the reservation window, not owned by the inode, containing the block.
+/// @param fs the ext2 filesystem structure.
+/// @param block_index the index of the block.
+/// @param inode_index the inode allowed to use the block, 0 if none.
+/// @return the reservation, NULL if the block is not reserved for someone else.
+static inline ext2_reservation_t *ext2_reservation_of_block(ext2_filesystem_t *fs, uint32_t block_index, uint32_t inode_index)
+{
+    for (uint32_t i = 0; i < EXT2_RESERVATION_MAX; ++i) {
+        ext2_reservation_t *reservation = &fs->reservations[i];
+        if (reservation->inode_index && (reservation->inode_index != inode_index) &&
+            (block_index >= reservation->start) && (block_index < reservation->end)) {
+            return reservation;
+        }
+    }
+    return NULL;
+}
+
+/// @brief Drops the reservation window of the inode, if it has one.
+/// @param fs the ext2 filesystem structure.
+/// @param inode_index the index of the inode.
+static inline void ext2_reservation_discard(ext2_filesystem_t *fs, uint32_t inode_index)
+{
+    ext2_reservation_t *reservation = ext2_reservation_get(fs, inode_index);
+    if (reservation) {
+        reservation->inode_index = 0;
+    }
+}
+
+/// @brief Searches for a free block, which is not reserved for other inodes,
+/// within a range of the group.
+/// @param fs the ext2 filesystem structure.
+/// @param group_index the group index.
+/// @param inode_index the inode allowed to use its own reservation, 0 if none.
+/// @param start the first offset of the range.
+/// @param end the offset right after the range.
+/// @return the offset of the block inside the group, -1 if there is none.
+static inline int ext2_find_unreserved_block(ext2_filesystem_t *fs, uint32_t group_index, uint32_t inode_index, uint32_t start, uint32_t end)
+{
+    uint32_t first = fs->superblock.first_data_block + (group_index * fs->superblock.blocks_per_group);
+    ext2_reservation_t *reservation;
+    int index;
+    while ((index = ext2_bitmap_find_zero(fs->group_info[group_index].block_bitmap, start, end)) >= 0) {
+        // Skip the windows reserved for other inodes.
+        reservation = ext2_reservation_of_block(fs, first + index, inode_index);
+        if (reservation == NULL) {
+            return index;
+        }
+        start = reservation->end - first;
+    }
+    return -1;
+}
+
+/// @brief Searches for a free block inside the pinned bitmap of the group.
+/// @param fs the ext2 filesystem structure.
+/// @param group_index the group index.
+/// @param inode_index the inode allowed to use its own reservation, 0 if none.
+/// @param goal the offset where the search starts.
 /// @param block_offset the output variable where we store the linear indes to the free block.
 /// @return 1 if we found a free block, 0 otherwise.
-static inline int ext2_find_free_block_in_group(ext2_filesystem_t *fs, uint8_t *cache, uint32_t *block_offset)
+static inline int ext2_find_free_block_in_group(
+    ext2_filesystem_t *fs,
+    uint32_t group_index,
+    uint32_t inode_index,
+    uint32_t goal,
+    uint32_t *block_offset)
 {
-    for ((*block_offset) = 0; (*block_offset) < fs->superblock.blocks_per_group; ++(*block_offset)) {
-        // Check if the entry is free.
-        if (!ext2_bitmap_check(cache, *block_offset)) {
-            return 1;
-        }
+    uint32_t end = ext2_group_blocks_count(fs, group_index);
+    int index    = -1;
+    if (goal < end) {
+        index = ext2_find_unreserved_block(fs, group_index, inode_index, goal, end);
+        end   = goal;
     }
-    return 0;
+    if (index < 0) {
+        index = ext2_find_unreserved_block(fs, group_index, inode_index, 0, end);
+    }
+    if (index < 0) {
+        return 0;
+    }
+    *block_offset = index;
+    return 1;
 }
 
 /// @brief Searches for a free block.
 /// @param fs the ext2 filesystem structure.
-/// @param cache the cache from which we read the bgdt data.
+/// @param inode_index the inode allowed to use its own reservation, 0 if none.
+/// @param goal the block we would like to get, 0 to use the allocation hints.
+/// @param group_index the output variable where we store the group index.
 /// @param block_offset the output variable where we store the linear indes to the free block.
 /// @return 1 if we found a free block, 0 otherwise.
+/// @details Without a goal the search starts from the group of the last
+/// allocation, so that consecutive allocations stay close to each other.
 static inline int ext2_find_free_block(
     ext2_filesystem_t *fs,
-    uint8_t *cache,
+    uint32_t inode_index,
+    uint32_t goal,
     uint32_t *group_index,
     uint32_t *block_offset)
 {
-    // Get the group and bit index of the first free block.
-    for ((*group_index) = 0; (*group_index) < fs->block_groups_count; ++(*group_index)) {
+    uint32_t first_group = fs->last_block_group, group_goal;
+    bool_t has_goal      = (goal > fs->superblock.first_data_block) && (goal < fs->superblock.blocks_count);
+    if (has_goal) {
+        first_group = ext2_block_index_to_group_index(fs, goal);
+    }
+    for (uint32_t i = 0; i < fs->block_groups_count; ++i) {
+        (*group_index) = (first_group + i) % fs->block_groups_count;
         // Check if there are free blocks in this block group.
         if (fs->block_groups[(*group_index)].free_blocks_count > 0) {
-            // Read the block bitmap.
-            if (ext2_read_block(fs, fs->block_groups[(*group_index)].block_bitmap, cache) < 0) {
-                pr_err("Failed to read the block bitmap for group `%d`.\n", (*group_index));
-                return 0;
+            group_goal = fs->group_info[(*group_index)].block_goal;
+            if ((i == 0) && has_goal) {
+                group_goal = ext2_block_index_to_group_offset(fs, goal);
             }
-            // Find the first free block.
-            if (ext2_find_free_block_in_group(fs, cache, block_offset)) {
+            if (ext2_find_free_block_in_group(fs, (*group_index), inode_index, group_goal, block_offset)) {
                 return 1;
             }
         }
@@ -875,6 +1239,87 @@ static inline int ext2_find_free_block(
     return 0;
 }
 
+/// @brief Opens a new reservation window for the inode, as close as possible to the goal.
+/// @param fs the ext2 filesystem structure.
+/// @param inode_index the index of the inode.
+/// @param goal the block we would like the window to start from.
+/// @return the reservation, NULL if there are no free blocks.
+static ext2_reservation_t *ext2_reservation_open(ext2_filesystem_t *fs, uint32_t inode_index, uint32_t goal)
+{
+    uint32_t group_index, group_offset;
+    // Drop the old window, it is either exhausted or too far away.
+    ext2_reservation_discard(fs, inode_index);
+    // Search for the first block of the window.
+    if (!ext2_find_free_block(fs, inode_index, goal, &group_index, &group_offset)) {
+        return NULL;
+    }
+    // Pick a slot, recycling the oldest ones when they are all in use.
+    ext2_reservation_t *reservation = ext2_reservation_get(fs, 0);
+    if (reservation == NULL) {
+        reservation           = &fs->reservations[fs->reservation_next];
+        fs->reservation_next = (fs->reservation_next + 1) % EXT2_RESERVATION_MAX;
+    }
+    // The window cannot cross the end of the group, nor other windows.
+    uint32_t first       = fs->superblock.first_data_block + (group_index * fs->superblock.blocks_per_group);
+    reservation->start   = first + group_offset;
+    reservation->end     = min(reservation->start + EXT2_RESERVATION_SIZE, first + ext2_group_blocks_count(fs, group_index));
+    for (uint32_t i = 0; i < EXT2_RESERVATION_MAX; ++i) {
+        ext2_reservation_t *other = &fs->reservations[i];
+        if (other->inode_index && (other != reservation) &&
+            (other->start > reservation->start) && (other->start < reservation->end)) {
+            reservation->end = other->start;
+        }
+    }
+    reservation->inode_index = inode_index;
+    return reservation;
+}
+
+/// @brief Loads the bitmaps of all the block groups, and keeps them in memory.
+/// @param fs the ext2 filesystem structure.
+/// @return 0 on success, -1 on failure.
+static int ext2_load_bitmaps(ext2_filesystem_t *fs)
+{
+    fs->group_info = kmalloc(sizeof(ext2_group_info_t) * fs->block_groups_count);
+    if (fs->group_info == NULL) {
+        pr_err("Failed to allocate memory for the block groups.\n");
+        return -1;
+    }
+    memset(fs->group_info, 0, sizeof(ext2_group_info_t) * fs->block_groups_count);
+    for (uint32_t i = 0; i < fs->block_groups_count; ++i) {
+        ext2_group_info_t *info = &fs->group_info[i];
+        info->block_bitmap      = kmalloc(fs->block_size);
+        info->inode_bitmap      = kmalloc(fs->block_size);
+        if ((info->block_bitmap == NULL) || (info->inode_bitmap == NULL)) {
+            pr_err("Failed to allocate memory for the bitmaps of group `%d`.\n", i);
+            return -1;
+        }
+        if ((ext2_read_block(fs, fs->block_groups[i].block_bitmap, (uint8_t *)info->block_bitmap) < 0) ||
+            (ext2_read_block(fs, fs->block_groups[i].inode_bitmap, (uint8_t *)info->inode_bitmap) < 0)) {
+            pr_err("Failed to read the bitmaps of group `%d`.\n", i);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/// @brief Frees the bitmaps kept in memory.
+/// @param fs the ext2 filesystem structure.
+static void ext2_free_bitmaps(ext2_filesystem_t *fs)
+{
+    if (fs->group_info) {
+        for (uint32_t i = 0; i < fs->block_groups_count; ++i) {
+            if (fs->group_info[i].block_bitmap) {
+                kfree(fs->group_info[i].block_bitmap);
+            }
+            if (fs->group_info[i].inode_bitmap) {
+                kfree(fs->group_info[i].inode_bitmap);
+            }
+        }
+        kfree(fs->group_info);
+        fs->group_info = NULL;
+    }
+}
+
 /// @brief Reads the superblock from the block device associated with this filesystem.
 /// @param fs the ext2 filesystem structure.
 /// @return the amount of data we read, or negative value for an error.
@@ -887,10 +1332,23 @@ static int ext2_read_superblock(ext2_filesystem_t *fs)
 /// @brief Writes the superblock on the block device associated with this filesystem.
 /// @param fs the ext2 filesystem structure.
 /// @return the amount of data we wrote, or negative value for an error.
+/// @details The superblock is updated inside the cached block that contains
+/// it, so that the cache never holds a stale copy of it. The block is written
+/// back later by the flusher.
 static int ext2_write_superblock(ext2_filesystem_t *fs)
 {
     pr_debug("Write superblock for EXT2 filesystem (0x%x)\n", fs);
-    return vfs_write(fs->block_device, &fs->superblock, 1024, sizeof(ext2_superblock_t));
+    buffer_head_t *buffer = buffer_read(fs->block_device, 1024 / fs->block_size, fs->block_size);
+    if (buffer == NULL) {
+        return -1;
+    }
+    if (fs->journal) {
+        journal_get_write_access(fs->journal, buffer);
+    }
+    memcpy(buffer->data + (1024 % fs->block_size), &fs->superblock, sizeof(ext2_superblock_t));
+    buffer_mark_dirty(buffer);
+    buffer_release(buffer);
+    return sizeof(ext2_superblock_t);
 }
 
 /// @brief Read a block from the block device associated with this filesystem.
@@ -908,15 +1366,22 @@ static int ext2_read_block(ext2_filesystem_t *fs, uint32_t block_index, uint8_t
         pr_err("You are trying to read with a NULL buffer.\n");
         return -1;
     }
-    return vfs_read(fs->block_device, buffer, block_index * fs->block_size, fs->block_size);
+    buffer_head_t *bh = buffer_read(fs->block_device, block_index, fs->block_size);
+    if (bh == NULL) {
+        return -1;
+    }
+    memcpy(buffer, bh->data, fs->block_size);
+    buffer_release(bh);
+    return fs->block_size;
 }
 
 /// @brief Writes a block on the block device associated with this filesystem.
 /// @param fs the ext2 filesystem structure.
 /// @param block_index the index of the block we want to read.
 /// @param buffer the buffer where the content will be placed.
+/// @param journaled if the block goes through the journal.
 /// @return the amount of data we wrote, or negative value for an error.
-static int ext2_write_block(ext2_filesystem_t *fs, uint32_t block_index, uint8_t *buffer)
+static int __ext2_write_block(ext2_filesystem_t *fs, uint32_t block_index, uint8_t *buffer, int journaled)
 {
     if (block_index == 0) {
         pr_err("You are trying to write on an invalid block index (%d).\n", block_index);
@@ -926,7 +1391,42 @@ static int ext2_write_block(ext2_filesystem_t *fs, uint32_t block_index, uint8_t
         pr_err("You are trying to write with a NULL buffer.\n");
         return -1;
     }
-    return vfs_write(fs->block_device, buffer, block_index * fs->block_size, fs->block_size);
+    // The whole block is overwritten, there is no need to read it first.
+    buffer_head_t *bh = buffer_get(fs->block_device, block_index, fs->block_size);
+    if (bh == NULL) {
+        return -1;
+    }
+    if (journaled && fs->journal) {
+        journal_get_write_access(fs->journal, bh);
+    }
+    memcpy(bh->data, buffer, fs->block_size);
+    // The block is written back later by the flusher, or by sync/fsync.
+    buffer_mark_dirty(bh);
+    buffer_release(bh);
+    return fs->block_size;
+}
+
+/// @brief Writes a block of metadata on the block device associated with this filesystem.
+/// @param fs the ext2 filesystem structure.
+/// @param block_index the index of the block we want to read.
+/// @param buffer the buffer where the content will be placed.
+/// @return the amount of data we wrote, or negative value for an error.
+/// @details With a journal, the block is part of the running transaction.
+static int ext2_write_block(ext2_filesystem_t *fs, uint32_t block_index, uint8_t *buffer)
+{
+    return __ext2_write_block(fs, block_index, buffer, 1);
+}
+
+/// @brief Writes a block holding the content of a regular file.
+/// @param fs the ext2 filesystem structure.
+/// @param block_index the index of the block we want to read.
+/// @param buffer the buffer where the content will be placed.
+/// @return the amount of data we wrote, or negative value for an error.
+/// @details The content is not journaled, it only reaches the device before
+/// the metadata pointing to it is committed.
+static int ext2_write_data_block(ext2_filesystem_t *fs, uint32_t block_index, uint8_t *buffer)
+{
+    return __ext2_write_block(fs, block_index, buffer, 0);
 }
 
 /// @brief Reads the Block Group Descriptor Table (BGDT) from the block device associated with this filesystem.
@@ -961,16 +1461,17 @@ static int ext2_write_bgdt(ext2_filesystem_t *fs)
     return -1;
 }
 
-/// @brief Reads an inode.
+/// @brief Computes where the inode is stored inside the inode table.
 /// @param fs the filesystem.
-/// @param inode the inode which we are working with.
 /// @param inode_index The index of the inode.
+/// @param block where we store the block containing the inode.
+/// @param offset where we store the offset of the inode inside the block.
 /// @return 0 on success, -1 on failure.
-static int ext2_read_inode(ext2_filesystem_t *fs, ext2_inode_t *inode, uint32_t inode_index)
+static int ext2_inode_location(ext2_filesystem_t *fs, uint32_t inode_index, uint32_t *block, uint32_t *offset)
 {
     uint32_t group_index, block_index, group_offset;
     if (inode_index == 0) {
-        pr_err("You are trying to read an invalid inode index (%d).\n", inode_index);
+        pr_err("You are trying to access an invalid inode index (%d).\n", inode_index);
         return -1;
     }
     // Retrieve the group index.
@@ -981,7 +1482,7 @@ static int ext2_read_inode(ext2_filesystem_t *fs, ext2_inode_t *inode, uint32_t
     block_index = ext2_inode_index_to_block_index(fs, inode_index);
 
     // Log the address to the inode.
-    pr_debug("Read inode   (inode_index:%4u, group_index:%4u, group_offset:%4u, block_index:%4u)\n",
+    pr_debug("Locate inode (inode_index:%4u, group_index:%4u, group_offset:%4u, block_index:%4u)\n",
              inode_index, group_index, group_offset, block_index);
 
     // Check for error.
@@ -989,64 +1490,161 @@ static int ext2_read_inode(ext2_filesystem_t *fs, ext2_inode_t *inode, uint32_t
         pr_err("Invalid group index computed from inode index `%d`.\n", inode_index);
         return -1;
     }
-
+    // Get the block of the inode table.
+    *block = fs->block_groups[group_index].inode_table + block_index;
     // Get the real inode offset inside the block.
-    group_offset %= fs->inodes_per_block_count;
-    // Allocate the cache.
-    uint8_t *cache = kmem_cache_alloc(fs->ext2_buffer_cache, GFP_KERNEL);
-    // Clean the cache.
-    memset(cache, 0, fs->ext2_buffer_cache->size);
+    *offset = (group_offset % fs->inodes_per_block_count) * fs->superblock.inode_size;
+    return 0;
+}
+
+/// @brief Copies a cached inode to its block of the inode table.
+/// @param fs the filesystem.
+/// @param entry the cached inode.
+/// @return 0 on success, -1 on failure.
+/// @details The block is only marked dirty, the buffer cache writes it back.
+static int ext2_icache_write_back(ext2_filesystem_t *fs, ext2_icache_entry_t *entry)
+{
+    uint32_t block, offset;
+    if (ext2_inode_location(fs, entry->inode_index, &block, &offset) < 0) {
+        return -1;
+    }
     // Read the block containing the inode table.
-    ext2_read_block(fs, fs->block_groups[group_index].inode_table + block_index, cache);
-    // Save the inode content.
-    memcpy(inode, (ext2_inode_t *)((uintptr_t)cache + (group_offset * fs->superblock.inode_size)), sizeof(ext2_inode_t));
-    // Free the cache.
-    kmem_cache_free(cache);
+    buffer_head_t *bh = buffer_read(fs->block_device, block, fs->block_size);
+    if (bh == NULL) {
+        pr_err("Failed to read the inode table block of inode `%d`.\n", entry->inode_index);
+        return -1;
+    }
+    if (fs->journal) {
+        journal_get_write_access(fs->journal, bh);
+    }
+    // Write the inode.
+    memcpy(bh->data + offset, &entry->inode, sizeof(ext2_inode_t));
+    buffer_mark_dirty(bh);
+    buffer_release(bh);
+    entry->dirty = 0;
     return 0;
 }
 
-/// @brief Writes the inode.
+/// @brief Returns the cached inode, loading it if it is not in memory.
+/// @param fs the filesystem.
+/// @param inode_index The index of the inode.
+/// @param fill if the inode must be read from the disk when not cached.
+/// @return the cached inode, NULL on failure.
+/// @details When the cache is full, the least recently used inode is written
+/// back and its entry reused.
+static ext2_icache_entry_t *ext2_icache_get(ext2_filesystem_t *fs, uint32_t inode_index, int fill)
+{
+    uint32_t block, offset;
+    ext2_icache_entry_t *entry = hashmap_get(fs->icache, (void *)inode_index);
+    if (entry) {
+        // Move the inode at the end of the LRU list.
+        list_head_remove(&entry->lru);
+        list_head_insert_before(&entry->lru, &fs->icache_lru);
+        return entry;
+    }
+    if (ext2_inode_location(fs, inode_index, &block, &offset) < 0) {
+        return NULL;
+    }
+    if (fs->icache_count >= EXT2_ICACHE_MAX) {
+        // Reuse the least recently used inode.
+        entry = list_entry(fs->icache_lru.next, ext2_icache_entry_t, lru);
+        if (entry->dirty && (ext2_icache_write_back(fs, entry) < 0)) {
+            return NULL;
+        }
+        hashmap_remove(fs->icache, (void *)entry->inode_index);
+        list_head_remove(&entry->lru);
+        --fs->icache_count;
+    } else {
+        entry = kmem_cache_alloc(ext2_icache_entry_cache, GFP_KERNEL);
+        if (entry == NULL) {
+            pr_err("Failed to allocate memory for the inode cache.\n");
+            return NULL;
+        }
+    }
+    memset(entry, 0, sizeof(ext2_icache_entry_t));
+    entry->inode_index = inode_index;
+    if (fill) {
+        // Read the block containing the inode table.
+        buffer_head_t *bh = buffer_read(fs->block_device, block, fs->block_size);
+        if (bh == NULL) {
+            pr_err("Failed to read the inode table block of inode `%d`.\n", inode_index);
+            kmem_cache_free(entry);
+            return NULL;
+        }
+        memcpy(&entry->inode, bh->data + offset, sizeof(ext2_inode_t));
+        buffer_release(bh);
+    }
+    hashmap_set(fs->icache, (void *)inode_index, entry);
+    list_head_insert_before(&entry->lru, &fs->icache_lru);
+    ++fs->icache_count;
+    return entry;
+}
+
+/// @brief Writes back the modified inodes kept in memory.
+/// @param fs the filesystem.
+/// @return 0 on success, -1 if some inode could not be written back.
+static int ext2_icache_sync(ext2_filesystem_t *fs)
+{
+    int ret = 0;
+    list_for_each_decl(it, &fs->icache_lru)
+    {
+        ext2_icache_entry_t *entry = list_entry(it, ext2_icache_entry_t, lru);
+        if (entry->dirty && (ext2_icache_write_back(fs, entry) < 0)) {
+            ret = -1;
+        }
+    }
+    return ret;
+}
+
+/// @brief Drops all the inodes kept in memory, without writing them back.
+/// @param fs the filesystem.
+static void ext2_icache_destroy(ext2_filesystem_t *fs)
+{
+    list_for_each_safe_decl(it, store, &fs->icache_lru)
+    {
+        ext2_icache_entry_t *entry = list_entry(it, ext2_icache_entry_t, lru);
+        list_head_remove(&entry->lru);
+        kmem_cache_free(entry);
+    }
+    fs->icache_count = 0;
+    hashmap_free(fs->icache);
+    fs->icache = NULL;
+}
+
+/// @brief Reads an inode.
 /// @param fs the filesystem.
 /// @param inode the inode which we are working with.
 /// @param inode_index The index of the inode.
 /// @return 0 on success, -1 on failure.
-static int ext2_write_inode(ext2_filesystem_t *fs, ext2_inode_t *inode, uint32_t inode_index)
+static int ext2_read_inode(ext2_filesystem_t *fs, ext2_inode_t *inode, uint32_t inode_index)
 {
-    uint32_t group_index, block_index, group_offset;
-    if (inode_index == 0) {
-        pr_err("You are trying to read an invalid inode index (%d).\n", inode_index);
+    ext2_icache_entry_t *entry = ext2_icache_get(fs, inode_index, 1);
+    if (entry == NULL) {
+        pr_err("Failed to read inode `%d`.\n", inode_index);
         return -1;
     }
-    // Retrieve the group index.
-    group_index = ext2_inode_index_to_group_index(fs, inode_index);
-    // Get the index of the inode inside the group.
-    group_offset = ext2_inode_index_to_group_offset(fs, inode_index);
-    // Get the block offest.
-    block_index = ext2_inode_index_to_block_index(fs, inode_index);
-
-    pr_debug("Write inode  (inode_index:%4u, group_index:%4u, group_offset:%4u, block_index:%4u)\n",
-             inode_index, group_index, group_offset, block_index);
+    // Save the inode content.
+    memcpy(inode, &entry->inode, sizeof(ext2_inode_t));
+    return 0;
+}
 
-    // Check for error.
-    if (group_index > fs->block_groups_count) {
-        pr_err("Invalid group index computed from inode index `%d`.\n", inode_index);
+/// @brief Writes the inode.
+/// @param fs the filesystem.
+/// @param inode the inode which we are working with.
+/// @param inode_index The index of the inode.
+/// @return 0 on success, -1 on failure.
+/// @details The inode is updated in memory, and written back later.
+static int ext2_write_inode(ext2_filesystem_t *fs, ext2_inode_t *inode, uint32_t inode_index)
+{
+    // The whole inode is overwritten, there is no need to read it first.
+    ext2_icache_entry_t *entry = ext2_icache_get(fs, inode_index, 0);
+    if (entry == NULL) {
+        pr_err("Failed to write inode `%d`.\n", inode_index);
         return -1;
     }
-
-    // Get the real inode offset inside the block.
-    group_offset %= fs->inodes_per_block_count;
-    // Allocate the cache.
-    uint8_t *cache = kmem_cache_alloc(fs->ext2_buffer_cache, GFP_KERNEL);
-    // Clean the cache.
-    memset(cache, 0, fs->ext2_buffer_cache->size);
-    // Read the block containing the inode table.
-    ext2_read_block(fs, fs->block_groups[group_index].inode_table + block_index, cache);
     // Write the inode.
-    memcpy((ext2_inode_t *)((uintptr_t)cache + (group_offset * fs->superblock.inode_size)), inode, sizeof(ext2_inode_t));
-    // Write back the block.
-    ext2_write_block(fs, fs->block_groups[group_index].inode_table + block_index, cache);
-    // Free the cache.
-    kmem_cache_free(cache);
+    memcpy(&entry->inode, inode, sizeof(ext2_inode_t));
+    entry->dirty = 1;
     return 0;
 }
 
@@ -1063,18 +1661,12 @@ static int ext2_allocate_inode(ext2_filesystem_t *fs, unsigned preferred_group)
 {
     uint32_t group_index = 0, group_offset = 0, inode_index = 0;
     // Lock the filesystem.
-    spinlock_lock(&fs->spinlock);
-    // Allocate the cache.
-    uint8_t *cache = kmem_cache_alloc(fs->ext2_buffer_cache, GFP_KERNEL);
-    // Clean the cache.
-    memset(cache, 0, fs->ext2_buffer_cache->size);
+    mutex_lock(&fs->lock);
     // Search for a free inode.
-    if (!ext2_find_free_inode(fs, cache, &group_index, &group_offset, preferred_group)) {
+    if (!ext2_find_free_inode(fs, &group_index, &group_offset, preferred_group)) {
         pr_err("Failed to find a free inode.\n");
         // Unlock the filesystem.
-        spinlock_unlock(&fs->spinlock);
-        // Free the cache.
-        kmem_cache_free(cache);
+        mutex_unlock(&fs->lock);
         return 0;
     }
     // Compute the inode index.
@@ -1082,13 +1674,14 @@ static int ext2_allocate_inode(ext2_filesystem_t *fs, unsigned preferred_group)
     // Log the allocation of the inode.
     pr_debug("Allocate inode (inode_index:%u, group_index:%4u, group_offset:%4u)\n", inode_index, group_index, group_offset);
     // Set the inode as occupied.
-    ext2_bitmap_set(cache, group_offset);
+    ext2_group_info_t *info = &fs->group_info[group_index];
+    ext2_bitmap_set((uint8_t *)info->inode_bitmap, group_offset);
+    // The next search starts from here.
+    info->inode_goal = group_offset + 1;
     // Write back the inode bitmap.
-    if (ext2_write_block(fs, fs->block_groups[group_index].inode_bitmap, cache) < 0) {
-        pr_err("We failed to write back the block_bitmap.\n");
+    if (ext2_write_block(fs, fs->block_groups[group_index].inode_bitmap, (uint8_t *)info->inode_bitmap) < 0) {
+        pr_err("We failed to write back the inode_bitmap.\n");
     }
-    // Free the cache.
-    kmem_cache_free(cache);
     // Reduce the number of free inodes.
     fs->block_groups[group_index].free_inodes_count--;
     // Reduce the number of inodes inside the superblock.
@@ -1102,67 +1695,208 @@ static int ext2_allocate_inode(ext2_filesystem_t *fs, unsigned preferred_group)
         pr_warning("Failed to write superblock.\n");
     }
     // Unlock the filesystem.
-    spinlock_unlock(&fs->spinlock);
+    mutex_unlock(&fs->lock);
     // Return the inode.
     return inode_index;
 }
 
-/// @brief Allocates a new block.
+/// @brief Marks the block as used, inside the pinned bitmap and the counters.
 /// @param fs the filesystem.
-/// @return 0 on failure, or the index of the new block on success.
-static uint32_t ext2_allocate_block(ext2_filesystem_t *fs)
+/// @param group_index the group of the block.
+/// @param group_offset the offset of the block inside the group.
+/// @return the index of the block.
+/// @details The changes reach the disk with __ext2_commit_blocks.
+static uint32_t __ext2_take_block(ext2_filesystem_t *fs, uint32_t group_index, uint32_t group_offset)
 {
-    uint32_t group_index = 0, group_offset = 0, block_index = 0;
-    // Lock the filesystem.
-    spinlock_lock(&fs->spinlock);
-    // Allocate the cache.
-    uint8_t *cache = kmem_cache_alloc(fs->ext2_buffer_cache, GFP_KERNEL);
-    // Clean the cache.
-    memset(cache, 0, fs->ext2_buffer_cache->size);
-    // Search for a free block.
-    if (!ext2_find_free_block(fs, cache, &group_index, &group_offset)) {
-        pr_err("Failed to find a free block.\n");
-        // Unlock the filesystem.
-        spinlock_unlock(&fs->spinlock);
-        // Free the cache.
-        kmem_cache_free(cache);
-        return 0;
-    }
     // Compute the block index.
-    block_index = (group_index * fs->superblock.blocks_per_group) + group_offset;
+    uint32_t block_index = fs->superblock.first_data_block + (group_index * fs->superblock.blocks_per_group) + group_offset;
     // Log the allocation of the inode.
     pr_debug("Allocate block (block_index:%u, group_index:%4u, group_offset:%4u)\n", block_index, group_index, group_offset);
     // Set the block as occupied.
-    ext2_bitmap_set(cache, group_offset);
-    // Update the bitmap.
-    if (ext2_write_block(fs, fs->block_groups[group_index].block_bitmap, cache) < 0) {
-        pr_err("We failed to write back the block_bitmap.\n");
-    }
+    ext2_group_info_t *info = &fs->group_info[group_index];
+    ext2_bitmap_set((uint8_t *)info->block_bitmap, group_offset);
+    info->block_bitmap_dirty = 1;
+    // The next search starts from here.
+    info->block_goal     = group_offset + 1;
+    fs->last_block_group = group_index;
     // Decrease the number of free blocks inside the BGDT entry.
     fs->block_groups[group_index].free_blocks_count--;
     // Decrease the number of free blocks inside the superblock.
     fs->superblock.free_blocks_count--;
-    // Update the BGDT.
-    if (ext2_write_bgdt(fs) < 0) {
+    return block_index;
+}
+
+/// @brief Marks the block as free, inside the pinned bitmap and the counters.
+/// @param fs the filesystem.
+/// @param block_index the index of the block.
+/// @details The changes reach the disk with __ext2_commit_blocks.
+static void __ext2_put_block(ext2_filesystem_t *fs, uint32_t block_index)
+{
+    uint32_t group_index  = ext2_block_index_to_group_index(fs, block_index);
+    uint32_t group_offset = ext2_block_index_to_group_offset(fs, block_index);
+    // Log the release of the block.
+    pr_debug("Free block     (block_index:%u, group_index:%4u, group_offset:%4u)\n", block_index, group_index, group_offset);
+    // The block can be used again, even for data.
+    if (fs->journal) {
+        journal_forget(fs->journal, block_index);
+    }
+    // Set it as free.
+    ext2_group_info_t *info = &fs->group_info[group_index];
+    ext2_bitmap_clear((uint8_t *)info->block_bitmap, group_offset);
+    info->block_bitmap_dirty = 1;
+    // Increase the number of free blocks inside the BGDT entry.
+    fs->block_groups[group_index].free_blocks_count++;
+    // Increase the number of free blocks inside the superblock.
+    fs->superblock.free_blocks_count++;
+}
+
+/// @brief Writes back the bitmaps modified by __ext2_take_block and
+/// __ext2_put_block, the BGDT and the superblock.
+/// @param fs the filesystem.
+static void __ext2_commit_blocks(ext2_filesystem_t *fs)
+{
+    for (uint32_t i = 0; i < fs->block_groups_count; ++i) {
+        ext2_group_info_t *info = &fs->group_info[i];
+        if (info->block_bitmap_dirty) {
+            if (ext2_write_block(fs, fs->block_groups[i].block_bitmap, (uint8_t *)info->block_bitmap) < 0) {
+                pr_err("We failed to write back the block_bitmap.\n");
+            }
+            info->block_bitmap_dirty = 0;
+        }
+    }
+    // Update the BGDT.
+    if (ext2_write_bgdt(fs) < 0) {
         pr_warning("Failed to write BGDT.\n");
     }
     // Update the superblock.
     if (ext2_write_superblock(fs) < 0) {
         pr_warning("Failed to write superblock.\n");
     }
+}
+
+/// @brief Clears the content of the newly allocated blocks.
+/// @param fs the filesystem.
+/// @param blocks the indices of the blocks.
+/// @param count the number of blocks.
+static void __ext2_clear_blocks(ext2_filesystem_t *fs, const uint32_t *blocks, uint32_t count)
+{
+    // Allocate the cache.
+    uint8_t *cache = kmem_cache_alloc(fs->ext2_buffer_cache, GFP_KERNEL);
     // Empty out the new block content.
     memset(cache, 0, fs->ext2_buffer_cache->size);
-    // Write the empty content of the new block.
-    if (ext2_write_block(fs, block_index, cache) < 0) {
-        pr_err("We failed to clean the content of the newly allocated block.\n");
+    // Write the empty content of the new blocks.
+    for (uint32_t i = 0; i < count; ++i) {
+        if (ext2_write_data_block(fs, blocks[i], cache) < 0) {
+            pr_err("We failed to clean the content of the newly allocated block.\n");
+        }
     }
     // Free the cache.
     kmem_cache_free(cache);
-    // Unlock the spinlock.
-    spinlock_unlock(&fs->spinlock);
+}
+
+/// @brief Allocates a new block.
+/// @param fs the filesystem.
+/// @return 0 on failure, or the index of the new block on success.
+static uint32_t ext2_allocate_block(ext2_filesystem_t *fs)
+{
+    uint32_t group_index = 0, group_offset = 0, block_index = 0;
+    // Lock the filesystem.
+    mutex_lock(&fs->lock);
+    // Search for a free block, if only reserved blocks are left, take them back.
+    if (!ext2_find_free_block(fs, 0, 0, &group_index, &group_offset)) {
+        memset(fs->reservations, 0, sizeof(fs->reservations));
+        if (!ext2_find_free_block(fs, 0, 0, &group_index, &group_offset)) {
+            pr_err("Failed to find a free block.\n");
+            // Unlock the filesystem.
+            mutex_unlock(&fs->lock);
+            return 0;
+        }
+    }
+    block_index = __ext2_take_block(fs, group_index, group_offset);
+    __ext2_commit_blocks(fs);
+    __ext2_clear_blocks(fs, &block_index, 1);
+    // Unlock the filesystem.
+    mutex_unlock(&fs->lock);
     return block_index;
 }
 
+/// @brief Searches for a free block for an inode, inside its reservation window.
+/// @param fs the filesystem.
+/// @param inode_index the index of the inode.
+/// @param goal the block we would like to get.
+/// @param group_index the output variable where we store the group index.
+/// @param group_offset the output variable where we store the offset inside the group.
+/// @return 1 if we found a free block, 0 otherwise.
+/// @details When the window is exhausted, a new one is opened near the goal,
+/// so that files written a little at a time still end up being contiguous.
+static int __ext2_find_block_for_inode(ext2_filesystem_t *fs, uint32_t inode_index, uint32_t goal, uint32_t *group_index, uint32_t *group_offset)
+{
+    uint32_t start, end;
+    int index = -1;
+    // Try the current window first.
+    ext2_reservation_t *reservation = ext2_reservation_get(fs, inode_index);
+    if (reservation) {
+        *group_index = ext2_block_index_to_group_index(fs, reservation->start);
+        start        = ext2_block_index_to_group_offset(fs, reservation->start);
+        end          = start + (reservation->end - reservation->start);
+        if ((goal > reservation->start) && (goal < reservation->end)) {
+            start = ext2_block_index_to_group_offset(fs, goal);
+        }
+        index = ext2_bitmap_find_zero(fs->group_info[*group_index].block_bitmap, start, end);
+    }
+    // Otherwise, open a new window.
+    if (index < 0) {
+        reservation = ext2_reservation_open(fs, inode_index, goal);
+        if (reservation) {
+            *group_index = ext2_block_index_to_group_index(fs, reservation->start);
+            index        = ext2_block_index_to_group_offset(fs, reservation->start);
+        }
+    }
+    // If only blocks reserved by other inodes are left, take them back.
+    if (index < 0) {
+        memset(fs->reservations, 0, sizeof(fs->reservations));
+        if (ext2_find_free_block(fs, 0, goal, group_index, group_offset)) {
+            return 1;
+        }
+        return 0;
+    }
+    *group_offset = index;
+    return 1;
+}
+
+/// @brief Allocates new data blocks for an inode, from its reservation window.
+/// @param fs the filesystem.
+/// @param inode_index the index of the inode.
+/// @param goal the block we would like to get first, usually the one after
+/// the last block of the file.
+/// @param blocks the output array where we store the indices of the new blocks.
+/// @param count the number of blocks to allocate.
+/// @return the number of blocks we allocated.
+/// @details The bitmaps, the BGDT and the superblock are written back once,
+/// for all the blocks.
+static uint32_t ext2_allocate_blocks_for_inode(ext2_filesystem_t *fs, uint32_t inode_index, uint32_t goal, uint32_t *blocks, uint32_t count)
+{
+    uint32_t group_index, group_offset, allocated;
+    // Lock the filesystem.
+    mutex_lock(&fs->lock);
+    for (allocated = 0; allocated < count; ++allocated) {
+        if (!__ext2_find_block_for_inode(fs, inode_index, goal, &group_index, &group_offset)) {
+            pr_err("Failed to find a free block.\n");
+            break;
+        }
+        blocks[allocated] = __ext2_take_block(fs, group_index, group_offset);
+        // Keep the following blocks next to this one.
+        goal = blocks[allocated] + 1;
+    }
+    if (allocated > 0) {
+        __ext2_commit_blocks(fs);
+        __ext2_clear_blocks(fs, blocks, allocated);
+    }
+    // Unlock the filesystem.
+    mutex_unlock(&fs->lock);
+    return allocated;
+}
+
 /// @brief Frees a block.
 /// @param fs the filesystem.
 /// @param block_index the index of the block we are freeing.
@@ -1172,24 +1906,21 @@ static void ext2_free_block(ext2_filesystem_t *fs, uint32_t block_index)
     uint32_t group_index  = ext2_block_index_to_group_index(fs, block_index);
     uint32_t group_offset = ext2_block_index_to_group_offset(fs, block_index);
     uint32_t block_bitmap = fs->block_groups[group_index].block_bitmap;
+    uint8_t *bitmap       = (uint8_t *)fs->group_info[group_index].block_bitmap;
 
     // Log the allocation of the inode.
     pr_debug("Free block     (block_index:%u, group_index:%4u, group_offset:%4u)\n", block_index, group_index, group_offset);
+    // The block can be used again, even for data.
+    if (fs->journal) {
+        journal_forget(fs->journal, block_index);
+    }
 
-    // Allocate the cache.
-    uint8_t *cache = kmem_cache_alloc(fs->ext2_buffer_cache, GFP_KERNEL);
-    // Clean the cache.
-    memset(cache, 0, fs->ext2_buffer_cache->size);
-    // Read the bitmap.
-    ext2_read_block(fs, block_bitmap, cache);
     // Set it as free.
-    ext2_bitmap_clear(cache, group_offset);
-    // Write back the inode bitmap.
-    if (ext2_write_block(fs, block_bitmap, cache) < 0) {
+    ext2_bitmap_clear(bitmap, group_offset);
+    // Write back the block bitmap.
+    if (ext2_write_block(fs, block_bitmap, bitmap) < 0) {
         pr_err("We failed to write back the block_bitmap.\n");
     }
-    // Free the cache.
-    kmem_cache_free(cache);
 
     // Increase the number of free blocks inside the superblock.
     fs->superblock.free_blocks_count++;
@@ -1205,131 +1936,669 @@ static void ext2_free_block(ext2_filesystem_t *fs, uint32_t block_index)
     }
 }
 
-static int ext2_free_inode(ext2_filesystem_t *fs, ext2_inode_t *inode, uint32_t inode_index)
+/// @brief Checks if the blocks of the inode are mapped by an extent tree.
+/// @param inode the inode.
+/// @return 1 if they are, 0 if the inode uses block pointers.
+static inline int ext2_inode_has_extents(ext2_inode_t *inode)
 {
-    // Retrieve the group index.
-    uint32_t group_index = ext2_inode_index_to_group_index(fs, inode_index);
-    // Get the index of the inode inside the group.
-    uint32_t group_offset = ext2_inode_index_to_group_offset(fs, inode_index);
-    // Get the block bitmap index.
-    uint32_t inode_bitmap = fs->block_groups[group_index].inode_bitmap;
-    // Get the number of blocks we need to free.
-    uint32_t block_number = (inode->size / fs->block_size) + ((inode->size % fs->block_size) != 0);
+    return bitmask_check(inode->flags, EXT4_EXTENTS_FL);
+}
 
-    // Log the allocation of the inode.
-    pr_debug("Free inode     (group_index:%u, inode_index:%4u, group_offset:%4u)\n", group_index, inode_index, group_offset);
+/// @brief Returns the root of the extent tree of the inode.
+/// @param inode the inode.
+/// @return the header of the root.
+static inline ext2_extent_header_t *ext2_extent_root(ext2_inode_t *inode)
+{
+    return (ext2_extent_header_t *)&inode->data;
+}
 
-    // Free its blocks.
-    for (uint32_t block_index = 0; block_index < block_number; ++block_index) {
-        // Get the real index.
-        uint32_t real_index = ext2_get_real_block_index(fs, inode, block_index);
-        if (real_index == 0) {
-            continue;
+/// @brief Returns the entries of a leaf of an extent tree.
+/// @param header the header of the leaf.
+/// @return the first extent.
+static inline ext2_extent_t *ext2_extent_first(ext2_extent_header_t *header)
+{
+    return (ext2_extent_t *)(header + 1);
+}
+
+/// @brief Returns the entries of an internal node of an extent tree.
+/// @param header the header of the node.
+/// @return the first index entry.
+static inline ext2_extent_idx_t *ext2_extent_idx_first(ext2_extent_header_t *header)
+{
+    return (ext2_extent_idx_t *)(header + 1);
+}
+
+/// @brief Returns the number of blocks of an extent.
+/// @param extent the extent.
+/// @return the number of blocks, initialized or not.
+static inline uint32_t ext2_extent_len(ext2_extent_t *extent)
+{
+    return (extent->len > EXT4_EXT_INIT_MAX_LEN) ? (extent->len - EXT4_EXT_INIT_MAX_LEN) : extent->len;
+}
+
+/// @brief Initializes an empty extent tree inside the inode.
+/// @param inode the inode.
+static inline void ext2_extent_tree_init(ext2_inode_t *inode)
+{
+    ext2_extent_header_t *root = ext2_extent_root(inode);
+    memset(&inode->data, 0, sizeof(inode->data));
+    root->magic = EXT4_EXT_MAGIC;
+    root->max   = (sizeof(inode->data) - sizeof(ext2_extent_header_t)) / sizeof(ext2_extent_t);
+    inode->flags |= EXT4_EXTENTS_FL;
+}
+
+/// @brief Searches, among the entries of a node, the last one starting at or
+/// before the block. Entries of leaves and internal nodes have the same size.
+/// @param header the header of the node.
+/// @param block_index the block inside the file.
+/// @return the position of the entry, -1 if all of them start after the block.
+static inline int __ext2_extent_search(ext2_extent_header_t *header, uint32_t block_index)
+{
+    // Both kinds of entry start with the first block they cover.
+    ext2_extent_t *extents = ext2_extent_first(header);
+    int left = 0, right = (int)header->entries - 1, found = -1;
+    while (left <= right) {
+        int middle = (left + right) / 2;
+        if (extents[middle].block <= block_index) {
+            found = middle;
+            left  = middle + 1;
+        } else {
+            right = middle - 1;
         }
-        ext2_free_block(fs, real_index);
     }
+    return found;
+}
 
-    // Allocate the cache.
+/// @brief Walks the extent tree of the inode down to the leaf of the block.
+/// @param fs the filesystem.
+/// @param inode the inode.
+/// @param block_index the block inside the file.
+/// @param cache where the leaf is read, when it is not the root.
+/// @param leaf_block where the block holding the leaf is stored, 0 for the root.
+/// @param slot where the position of the leaf inside the root is stored.
+/// @return the header of the leaf, NULL if the tree is damaged.
+static ext2_extent_header_t *__ext2_extent_find_leaf(
+    ext2_filesystem_t *fs,
+    ext2_inode_t *inode,
+    uint32_t block_index,
+    uint8_t *cache,
+    uint32_t *leaf_block,
+    int *slot)
+{
+    ext2_extent_header_t *header = ext2_extent_root(inode);
+    *leaf_block                  = 0;
+    *slot                        = -1;
+    if ((header->magic != EXT4_EXT_MAGIC) || (header->depth > EXT4_EXT_MAX_DEPTH)) {
+        pr_err("Unsupported extent tree (magic: 0x%04x, depth: %u).\n", header->magic, header->depth);
+        return NULL;
+    }
+    if (header->depth == 0) {
+        return header;
+    }
+    if (header->entries == 0) {
+        return NULL;
+    }
+    *slot       = max(__ext2_extent_search(header, block_index), 0);
+    *leaf_block = ext2_extent_idx_first(header)[*slot].leaf_lo;
+    if (ext2_read_block(fs, *leaf_block, cache) < 0) {
+        return NULL;
+    }
+    header = (ext2_extent_header_t *)cache;
+    if ((header->magic != EXT4_EXT_MAGIC) || (header->depth != 0)) {
+        pr_err("Damaged extent leaf %u.\n", *leaf_block);
+        return NULL;
+    }
+    return header;
+}
+
+/// @brief Returns the real block mapped by the extent tree of the inode.
+/// @param fs the filesystem.
+/// @param inode the inode.
+/// @param block_index the block inside the file.
+/// @return the real block, 0 for a hole.
+static uint32_t ext2_extent_get_block(ext2_filesystem_t *fs, ext2_inode_t *inode, uint32_t block_index)
+{
+    uint32_t real_index = 0, leaf_block;
+    int slot;
+    uint8_t *cache = NULL;
+    if (ext2_extent_root(inode)->depth > 0) {
+        cache = kmem_cache_alloc(fs->ext2_buffer_cache, GFP_KERNEL);
+    }
+    ext2_extent_header_t *leaf = __ext2_extent_find_leaf(fs, inode, block_index, cache, &leaf_block, &slot);
+    if (leaf) {
+        int i = __ext2_extent_search(leaf, block_index);
+        if (i >= 0) {
+            ext2_extent_t *extent = &ext2_extent_first(leaf)[i];
+            // Extents which are not initialized read as zeros.
+            if ((block_index - extent->block < extent->len) && (extent->len <= EXT4_EXT_INIT_MAX_LEN)) {
+                real_index = extent->start_lo + (block_index - extent->block);
+            }
+        }
+    }
+    if (cache) {
+        kmem_cache_free(cache);
+    }
+    return real_index;
+}
+
+/// @brief Makes room inside a full leaf of the extent tree.
+/// @param fs the filesystem.
+/// @param inode the inode.
+/// @param leaf the full leaf.
+/// @param leaf_block the block holding the leaf, 0 if it is the root.
+/// @param slot the position of the leaf inside the root.
+/// @return 0 on success, -1 on failure.
+/// @details A full root moves its extents to a new leaf, and becomes its
+/// index; any other leaf gives half of its extents to a new leaf, next to it.
+static int __ext2_extent_split(ext2_filesystem_t *fs, ext2_inode_t *inode, ext2_extent_header_t *leaf, uint32_t leaf_block, int slot)
+{
+    ext2_extent_header_t *root = ext2_extent_root(inode);
+    if ((leaf_block != 0) && (root->entries == root->max)) {
+        pr_err("The extent tree of the inode is full.\n");
+        return -1;
+    }
+    uint32_t new_block = ext2_allocate_block(fs);
+    if (new_block == 0) {
+        return -1;
+    }
+    // The leaves are counted among the blocks of the inode.
+    inode->blocks_count += fs->blocks_per_block_count;
+    // The new block has been cleared, it just needs the header.
     uint8_t *cache = kmem_cache_alloc(fs->ext2_buffer_cache, GFP_KERNEL);
-    // Clean the cache.
     memset(cache, 0, fs->ext2_buffer_cache->size);
-    // Read the bitmap.
-    ext2_read_block(fs, inode_bitmap, cache);
-    // Set it as free.
-    ext2_bitmap_clear(cache, group_offset);
-    // Write back the inode bitmap.
-    if (ext2_write_block(fs, inode_bitmap, cache) < 0) {
-        pr_err("We failed to write back the inode_bitmap.\n");
+    ext2_extent_header_t *node = (ext2_extent_header_t *)cache;
+    node->magic                = EXT4_EXT_MAGIC;
+    node->max                  = (fs->block_size - sizeof(ext2_extent_header_t)) / sizeof(ext2_extent_t);
+    // Move the upper half of the leaf, or all the root.
+    uint16_t keep = (leaf_block != 0) ? (leaf->entries / 2) : 0;
+    node->entries = leaf->entries - keep;
+    memcpy(ext2_extent_first(node), ext2_extent_first(leaf) + keep, node->entries * sizeof(ext2_extent_t));
+    leaf->entries = keep;
+    int ret       = 0;
+    if (ext2_write_block(fs, new_block, cache) < 0) {
+        ret = -1;
+    } else if (leaf_block == 0) {
+        // The root becomes the index of its only leaf.
+        ext2_extent_idx_t *index = ext2_extent_idx_first(root);
+        memset(index, 0, sizeof(ext2_extent_idx_t));
+        index->block   = ext2_extent_first(node)->block;
+        index->leaf_lo = new_block;
+        root->entries  = 1;
+        root->depth    = 1;
+    } else if (ext2_write_block(fs, leaf_block, (uint8_t *)leaf) < 0) {
+        ret = -1;
+    } else {
+        // Add the new leaf to the root, after the one it comes from.
+        ext2_extent_idx_t *index = ext2_extent_idx_first(root);
+        memmove(index + slot + 2, index + slot + 1, (root->entries - slot - 1) * sizeof(ext2_extent_idx_t));
+        memset(index + slot + 1, 0, sizeof(ext2_extent_idx_t));
+        index[slot + 1].block   = ext2_extent_first(node)->block;
+        index[slot + 1].leaf_lo = new_block;
+        root->entries++;
     }
-    // Free the cache.
     kmem_cache_free(cache);
+    return ret;
+}
 
-    // Increase the number of inodes inside the superblock.
-    fs->superblock.free_inodes_count++;
-    // Increase the number of free inodes.
-    fs->block_groups[group_index].free_inodes_count++;
-    // Update the bgdt.
-    if (ext2_write_bgdt(fs) < 0) {
-        pr_warning("Failed to write BGDT.\n");
+/// @brief Maps a block of the file, inside the extent tree of the inode.
+/// @param fs the filesystem.
+/// @param inode the inode, written back by the caller.
+/// @param block_index the block inside the file, which must be a hole.
+/// @param real_index the real block.
+/// @return 0 on success, -1 on failure.
+/// @details The block extends the extent ending right before it, or the one
+/// starting right after it, when they are contiguous on disk too; since the
+/// blocks of a file are allocated in contiguous runs, a file written
+/// sequentially needs a handful of extents.
+static int ext2_extent_set_block(ext2_filesystem_t *fs, ext2_inode_t *inode, uint32_t block_index, uint32_t real_index)
+{
+    uint8_t *cache = kmem_cache_alloc(fs->ext2_buffer_cache, GFP_KERNEL);
+    uint32_t leaf_block;
+    int slot, ret = 0;
+    ext2_extent_header_t *leaf;
+    while (true) {
+        leaf = __ext2_extent_find_leaf(fs, inode, block_index, cache, &leaf_block, &slot);
+        if (leaf == NULL) {
+            ret = -1;
+            goto early_exit;
+        }
+        ext2_extent_t *extents = ext2_extent_first(leaf);
+        int i                  = __ext2_extent_search(leaf, block_index);
+        if ((i >= 0) && (block_index - extents[i].block < ext2_extent_len(&extents[i]))) {
+            pr_err("The block %u is already mapped by an extent.\n", block_index);
+            ret = -1;
+            goto early_exit;
+        }
+        if ((i >= 0) && (extents[i].block + extents[i].len == block_index) &&
+            (extents[i].start_lo + extents[i].len == real_index) && (extents[i].len < EXT4_EXT_INIT_MAX_LEN)) {
+            // Append the block to the previous extent.
+            extents[i].len++;
+        } else if ((i + 1 < leaf->entries) && (extents[i + 1].block == block_index + 1) &&
+                   (extents[i + 1].start_lo == real_index + 1) && (extents[i + 1].len < EXT4_EXT_INIT_MAX_LEN)) {
+            // Prepend the block to the next extent.
+            extents[i + 1].block--;
+            extents[i + 1].start_lo--;
+            extents[i + 1].len++;
+        } else if (leaf->entries == leaf->max) {
+            // Make room, and try again.
+            if (__ext2_extent_split(fs, inode, leaf, leaf_block, slot) < 0) {
+                ret = -1;
+                goto early_exit;
+            }
+            continue;
+        } else {
+            // Insert a new extent.
+            memmove(extents + i + 2, extents + i + 1, (leaf->entries - i - 1) * sizeof(ext2_extent_t));
+            memset(extents + i + 1, 0, sizeof(ext2_extent_t));
+            extents[i + 1].block    = block_index;
+            extents[i + 1].len      = 1;
+            extents[i + 1].start_lo = real_index;
+            leaf->entries++;
+        }
+        break;
     }
-    // Update the superblock.
-    if (ext2_write_superblock(fs) < 0) {
-        pr_warning("Failed to write superblock.\n");
+    if (leaf_block != 0) {
+        // Keep the index in sync with the first block of the leaf.
+        ext2_extent_idx_t *index = &ext2_extent_idx_first(ext2_extent_root(inode))[slot];
+        index->block             = min(index->block, ext2_extent_first(leaf)->block);
+        if (ext2_write_block(fs, leaf_block, cache) < 0) {
+            ret = -1;
+        }
     }
-    // Return the error code.
-    return 0;
+early_exit:
+    kmem_cache_free(cache);
+    return ret;
 }
 
-/// @brief Allocates a new block for storing block indices, for an inode.
+/// @brief Frees the blocks of a leaf of the extent tree, from the given
+/// block of the file on.
 /// @param fs the filesystem.
-/// @param current_index the current index, or if 0, where we store the new one.
-/// @return 0 on success, -1 on failure.
-static int __ext2_allocate_indexing_block_for_inode(ext2_filesystem_t *fs, uint32_t *current_index)
+/// @param leaf the header of the leaf.
+/// @param first the first block of the file to free.
+/// @param freed incremented by the number of blocks freed.
+static void __ext2_extent_truncate_leaf(ext2_filesystem_t *fs, ext2_extent_header_t *leaf, uint32_t first, uint32_t *freed)
 {
-    if (!(*current_index)) {
-        // Allocate a new block.
-        uint32_t block_index = ext2_allocate_block(fs);
-        if (block_index == 0) {
-            pr_err("We failed to allocate a new block for inode block indexing.\n");
-            return -1;
+    ext2_extent_t *extents = ext2_extent_first(leaf);
+    while (leaf->entries > 0) {
+        ext2_extent_t *extent = &extents[leaf->entries - 1];
+        uint32_t len          = ext2_extent_len(extent);
+        if (extent->block + len <= first) {
+            break;
         }
-        // Update the index.
-        *current_index = block_index;
+        // Keep the blocks before the first one.
+        uint32_t keep = (extent->block < first) ? (first - extent->block) : 0;
+        for (uint32_t i = keep; i < len; ++i) {
+            __ext2_put_block(fs, extent->start_lo + i);
+            ++(*freed);
+        }
+        if (keep == 0) {
+            leaf->entries--;
+            continue;
+        }
+        extent->len = (extent->len > EXT4_EXT_INIT_MAX_LEN) ? (keep + EXT4_EXT_INIT_MAX_LEN) : keep;
+        break;
     }
-    return 0;
 }
 
-/// @brief Allocates a new block for storing block indices, for a block containing block indices.
+/// @brief Frees the blocks mapped by the extent tree of the inode, from the
+/// given block of the file on, together with the leaves left empty.
 /// @param fs the filesystem.
-/// @param indexing_block the index of block that contains the indices.
-/// @param cache the cache were we load the block content.
-/// @param index the index inside the list of indices.
-/// @return 0 on success, -1 on failure.
-static int __ext2_read_and_allocate_indexing_block(
-    ext2_filesystem_t *fs,
-    uint32_t indexing_block,
-    uint8_t *cache,
-    uint32_t index)
+/// @param inode the inode.
+/// @param first the first block of the file to free.
+/// @param freed incremented by the number of blocks freed, leaves included.
+static void ext2_extent_truncate(ext2_filesystem_t *fs, ext2_inode_t *inode, uint32_t first, uint32_t *freed)
 {
-    // Read the doubly-indirect block (which contains pointers to indirect blocks).
-    ext2_read_block(fs, indexing_block, cache);
-    // Check if we need to allocate a new block.
-    if (!((uint32_t *)cache)[index]) {
-        // Allocate a new block.
-        uint32_t block_index = ext2_allocate_block(fs);
-        if (block_index == 0) {
-            pr_err("We failed to allocate a new block for inode block indexing.\n");
-            return -1;
+    ext2_extent_header_t *root = ext2_extent_root(inode);
+    if ((root->magic != EXT4_EXT_MAGIC) || (root->depth > EXT4_EXT_MAX_DEPTH)) {
+        pr_err("Unsupported extent tree (magic: 0x%04x, depth: %u).\n", root->magic, root->depth);
+        return;
+    }
+    if (root->depth == 0) {
+        __ext2_extent_truncate_leaf(fs, root, first, freed);
+        return;
+    }
+    uint8_t *cache           = kmem_cache_alloc(fs->ext2_buffer_cache, GFP_KERNEL);
+    ext2_extent_idx_t *index = ext2_extent_idx_first(root);
+    while (root->entries > 0) {
+        ext2_extent_idx_t *last = &index[root->entries - 1];
+        if (ext2_read_block(fs, last->leaf_lo, cache) < 0) {
+            break;
         }
-        // Update the index.
-        ((uint32_t *)cache)[index] = block_index;
-        // Write the indexing block.
-        if (ext2_write_block(fs, indexing_block, cache) < 0) {
-            pr_err("We failed to write back the indexing block, after generating a new block for inode block indexing.\n");
-            return -1;
+        ext2_extent_header_t *leaf = (ext2_extent_header_t *)cache;
+        __ext2_extent_truncate_leaf(fs, leaf, first, freed);
+        if (leaf->entries == 0) {
+            // The leaf is empty, it goes too.
+            __ext2_put_block(fs, last->leaf_lo);
+            ++(*freed);
+            root->entries--;
+            continue;
+        }
+        if (ext2_write_block(fs, last->leaf_lo, cache) < 0) {
+            pr_err("We failed to write back the extent leaf %u.\n", last->leaf_lo);
         }
+        // The previous leaves are all before the first block.
+        break;
     }
-    return 0;
+    // Without leaves, the root goes back to being one.
+    if (root->entries == 0) {
+        root->depth = 0;
+    }
+    kmem_cache_free(cache);
 }
 
-/// @brief Sets the real block index based on the block index inside an inode.
+/// @brief Returns the root of the indirect tree containing the block.
 /// @param fs the filesystem.
 /// @param inode the inode which we are working with.
+/// @param block_index the block index inside the inode, not a direct one.
+/// @return the index of the indirect, doubly or trebly indirect block.
+static inline uint32_t ext2_block_map_root(ext2_filesystem_t *fs, ext2_inode_t *inode, uint32_t block_index)
+{
+    uint32_t p     = fs->pointers_per_block;
+    uint32_t index = block_index - EXT2_DIRECT_BLOCKS;
+    if (index < p) {
+        return inode->data.blocks.indir_block;
+    }
+    index -= p;
+    if (index < (p * p)) {
+        return inode->data.blocks.doubly_indir_block;
+    }
+    return inode->data.blocks.trebly_indir_block;
+}
+
+/// @brief Returns the slot of the block map cache associated with the block.
+/// @param fs the filesystem.
+/// @param root the root of the indirect tree.
 /// @param block_index the block index inside the inode.
-/// @param real_index the real block number.
-/// @return 0 on success, a negative value on failure.
-static int ext2_set_real_block_index(
-    ext2_filesystem_t *fs,
-    ext2_inode_t *inode,
-    uint32_t inode_index,
-    uint32_t block_index,
-    uint32_t real_index)
+/// @return a pointer to the slot.
+static inline ext2_block_map_entry_t *ext2_block_map_slot(ext2_filesystem_t *fs, uint32_t root, uint32_t block_index)
 {
-    // Get the number of pointers per block.
-    unsigned int p = fs->pointers_per_block;
-    // Help compute the indices.
-    int a, b, c, d, e, f, g;
-    // We save intermediate indices here.
+    return &fs->block_map[((root * 31U) + block_index) & (EXT2_BLOCK_MAP_SIZE - 1)];
+}
+
+/// @brief Updates the cached mapping of the block, after it has been changed.
+/// @param fs the filesystem.
+/// @param inode the inode which we are working with.
+/// @param block_index the block index inside the inode.
+/// @param real_index the new real block number.
+static inline void ext2_block_map_update(ext2_filesystem_t *fs, ext2_inode_t *inode, uint32_t block_index, uint32_t real_index)
+{
+    if (block_index < EXT2_DIRECT_BLOCKS) {
+        return;
+    }
+    uint32_t root = ext2_block_map_root(fs, inode, block_index);
+    if (root) {
+        ext2_block_map_entry_t *entry = ext2_block_map_slot(fs, root, block_index);
+        entry->root                   = real_index ? root : 0;
+        entry->block_index            = block_index;
+        entry->real_index             = real_index;
+    }
+}
+
+/// @brief Drops all the cached mappings of the inode.
+/// @param fs the filesystem.
+/// @param inode the inode which we are working with.
+static inline void ext2_block_map_invalidate(ext2_filesystem_t *fs, ext2_inode_t *inode)
+{
+    // Extent trees are not cached.
+    if (ext2_inode_has_extents(inode)) {
+        return;
+    }
+    for (uint32_t i = 0; i < EXT2_BLOCK_MAP_SIZE; ++i) {
+        uint32_t root = fs->block_map[i].root;
+        if (root && ((root == inode->data.blocks.indir_block) ||
+                     (root == inode->data.blocks.doubly_indir_block) ||
+                     (root == inode->data.blocks.trebly_indir_block))) {
+            fs->block_map[i].root = 0;
+        }
+    }
+}
+
+/// @brief Frees the blocks of an indirect tree, from the given data block on.
+/// @param fs the filesystem.
+/// @param block the root of the tree.
+/// @param depth the depth of the tree: 1 for an indirect block, 2 for a doubly
+/// indirect one, 3 for a trebly indirect one.
+/// @param first the first data block to free, counted from the start of the tree.
+/// @param freed incremented by the number of blocks freed, indexing ones included.
+/// @return 1 if the root has been freed too, 0 otherwise.
+/// @details Only the indexing blocks which are kept are written back, the
+/// content of the freed blocks is never touched.
+static int __ext2_truncate_tree(ext2_filesystem_t *fs, uint32_t block, uint32_t depth, uint32_t first, uint32_t *freed)
+{
+    // Number of data blocks below each pointer of the root.
+    uint32_t span = 1;
+    for (uint32_t i = 1; i < depth; ++i) {
+        span *= fs->pointers_per_block;
+    }
+    uint32_t *cache = (uint32_t *)kmem_cache_alloc(fs->ext2_buffer_cache, GFP_KERNEL);
+    if (cache == NULL) {
+        return 0;
+    }
+    if (ext2_read_block(fs, block, (uint8_t *)cache) < 0) {
+        kmem_cache_free(cache);
+        return 0;
+    }
+    int dirty = 0;
+    for (uint32_t i = first / span; i < fs->pointers_per_block; ++i) {
+        if (cache[i] == 0) {
+            continue;
+        }
+        if (depth == 1) {
+            __ext2_put_block(fs, cache[i]);
+            ++(*freed);
+        } else if (!__ext2_truncate_tree(fs, cache[i], depth - 1, (i == first / span) ? (first % span) : 0, freed)) {
+            continue;
+        }
+        cache[i] = 0;
+        dirty    = 1;
+    }
+    if (first == 0) {
+        // Nothing is left below the root.
+        __ext2_put_block(fs, block);
+        ++(*freed);
+    } else if (dirty && (ext2_write_block(fs, block, (uint8_t *)cache) < 0)) {
+        pr_err("We failed to write back the indexing block %u.\n", block);
+    }
+    kmem_cache_free(cache);
+    return first == 0;
+}
+
+/// @brief Frees the data blocks of the inode from the given one on, together
+/// with the indexing blocks which are left empty.
+/// @param fs the filesystem.
+/// @param inode the inode, its block pointers and block count are updated.
+/// @param inode_index the index of the inode.
+/// @param first the first data block to free.
+/// @details The bitmaps, the BGDT and the superblock are written back once,
+/// for all the blocks. The inode itself is not written back.
+static void ext2_truncate_blocks(ext2_filesystem_t *fs, ext2_inode_t *inode, uint32_t inode_index, uint32_t first)
+{
+    uint32_t *roots[] = {
+        &inode->data.blocks.indir_block,
+        &inode->data.blocks.doubly_indir_block,
+        &inode->data.blocks.trebly_indir_block,
+    };
+    uint32_t freed = 0;
+    if (ext2_inode_has_extents(inode)) {
+        mutex_lock(&fs->lock);
+        ext2_extent_truncate(fs, inode, first, &freed);
+        goto commit;
+    }
+    // The roots of the trees may go away, drop their mappings first.
+    ext2_block_map_invalidate(fs, inode);
+    // Lock the filesystem.
+    mutex_lock(&fs->lock);
+    for (uint32_t i = first; i < EXT2_DIRECT_BLOCKS; ++i) {
+        if (inode->data.blocks.dir_blocks[i]) {
+            __ext2_put_block(fs, inode->data.blocks.dir_blocks[i]);
+            inode->data.blocks.dir_blocks[i] = 0;
+            ++freed;
+        }
+    }
+    // Each tree covers the blocks which follow the ones of the previous tree.
+    uint32_t start = EXT2_DIRECT_BLOCKS, span = fs->pointers_per_block;
+    for (uint32_t depth = 1; depth <= 3; ++depth) {
+        if (*roots[depth - 1] && (first < start + span)) {
+            if (__ext2_truncate_tree(fs, *roots[depth - 1], depth, (first > start) ? (first - start) : 0, &freed)) {
+                *roots[depth - 1] = 0;
+            }
+        }
+        start += span;
+        span *= fs->pointers_per_block;
+    }
+commit:
+    __ext2_commit_blocks(fs);
+    // The blocks reserved after the end of the file are not needed anymore.
+    ext2_reservation_discard(fs, inode_index);
+    // Unlock the filesystem.
+    mutex_unlock(&fs->lock);
+    // The indexing blocks are counted too, the holes are not.
+    inode->blocks_count -= min(inode->blocks_count, freed * fs->blocks_per_block_count);
+}
+
+/// @brief Frees a recently closed file.
+/// @param fs the filesystem.
+/// @param file the file, which must be among the recently closed ones.
+static void ext2_drop_closed_file(ext2_filesystem_t *fs, vfs_file_t *file)
+{
+    list_head_remove(&file->siblings);
+    --fs->closed_count;
+    hashmap_remove(fs->files, (void *)file->ino);
+    kmem_cache_free(file);
+}
+
+static int ext2_free_inode(ext2_filesystem_t *fs, ext2_inode_t *inode, uint32_t inode_index)
+{
+    // A file closed before its removal has nothing left to be reopened.
+    vfs_file_t *file = hashmap_get(fs->files, (void *)inode_index);
+    if (file && !list_head_empty(&file->siblings)) {
+        ext2_drop_closed_file(fs, file);
+    }
+    // Retrieve the group index.
+    uint32_t group_index = ext2_inode_index_to_group_index(fs, inode_index);
+    // Get the index of the inode inside the group.
+    uint32_t group_offset = ext2_inode_index_to_group_offset(fs, inode_index);
+    // Get the block bitmap index.
+    uint32_t inode_bitmap = fs->block_groups[group_index].inode_bitmap;
+
+    // Log the allocation of the inode.
+    pr_debug("Free inode     (group_index:%u, inode_index:%4u, group_offset:%4u)\n", group_index, inode_index, group_offset);
+
+    // Free its data blocks, and the indexing ones.
+    ext2_truncate_blocks(fs, inode, inode_index, 0);
+    // Drop the cached pages, the inode number is going to be reused.
+    page_cache_invalidate(fs, inode_index);
+    // Mark it as deleted on disk, it has no links and no blocks left.
+    inode->links_count = 0;
+    inode->dtime       = sys_time(NULL);
+    if (ext2_write_inode(fs, inode, inode_index) == -1) {
+        pr_err("Failed to write back the freed inode %u.\n", inode_index);
+    }
+
+    // Set it as free.
+    uint8_t *bitmap = (uint8_t *)fs->group_info[group_index].inode_bitmap;
+    ext2_bitmap_clear(bitmap, group_offset);
+    // Write back the inode bitmap.
+    if (ext2_write_block(fs, inode_bitmap, bitmap) < 0) {
+        pr_err("We failed to write back the inode_bitmap.\n");
+    }
+
+    // Increase the number of inodes inside the superblock.
+    fs->superblock.free_inodes_count++;
+    // Increase the number of free inodes.
+    fs->block_groups[group_index].free_inodes_count++;
+    // Update the bgdt.
+    if (ext2_write_bgdt(fs) < 0) {
+        pr_warning("Failed to write BGDT.\n");
+    }
+    // Update the superblock.
+    if (ext2_write_superblock(fs) < 0) {
+        pr_warning("Failed to write superblock.\n");
+    }
+    // Return the error code.
+    return 0;
+}
+
+/// @brief Allocates a new block for storing block indices, for an inode.
+/// @param fs the filesystem.
+/// @param inode the inode, whose block count includes the indexing blocks.
+/// @param current_index the current index, or if 0, where we store the new one.
+/// @return 0 on success, -1 on failure.
+static int __ext2_allocate_indexing_block_for_inode(ext2_filesystem_t *fs, ext2_inode_t *inode, uint32_t *current_index)
+{
+    if (!(*current_index)) {
+        // Allocate a new block.
+        uint32_t block_index = ext2_allocate_block(fs);
+        if (block_index == 0) {
+            pr_err("We failed to allocate a new block for inode block indexing.\n");
+            return -1;
+        }
+        // Update the index.
+        *current_index = block_index;
+        // Update the blocks count.
+        inode->blocks_count += fs->blocks_per_block_count;
+    }
+    return 0;
+}
+
+/// @brief Allocates a new block for storing block indices, for a block containing block indices.
+/// @param fs the filesystem.
+/// @param inode the inode, whose block count includes the indexing blocks.
+/// @param indexing_block the index of block that contains the indices.
+/// @param cache the cache were we load the block content.
+/// @param index the index inside the list of indices.
+/// @return 0 on success, -1 on failure.
+static int __ext2_read_and_allocate_indexing_block(
+    ext2_filesystem_t *fs,
+    ext2_inode_t *inode,
+    uint32_t indexing_block,
+    uint8_t *cache,
+    uint32_t index)
+{
+    // Read the doubly-indirect block (which contains pointers to indirect blocks).
+    ext2_read_block(fs, indexing_block, cache);
+    // Check if we need to allocate a new block.
+    if (!((uint32_t *)cache)[index]) {
+        // Allocate a new block.
+        uint32_t block_index = ext2_allocate_block(fs);
+        if (block_index == 0) {
+            pr_err("We failed to allocate a new block for inode block indexing.\n");
+            return -1;
+        }
+        // Update the index.
+        ((uint32_t *)cache)[index] = block_index;
+        // Update the blocks count.
+        inode->blocks_count += fs->blocks_per_block_count;
+        // Write the indexing block.
+        if (ext2_write_block(fs, indexing_block, cache) < 0) {
+            pr_err("We failed to write back the indexing block, after generating a new block for inode block indexing.\n");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/// @brief Sets the real block index based on the block index inside an inode.
+/// @param fs the filesystem.
+/// @param inode the inode which we are working with.
+/// @param block_index the block index inside the inode.
+/// @param real_index the real block number.
+/// @return 0 on success, a negative value on failure.
+static int ext2_set_real_block_index(
+    ext2_filesystem_t *fs,
+    ext2_inode_t *inode,
+    uint32_t inode_index,
+    uint32_t block_index,
+    uint32_t real_index)
+{
+    if (ext2_inode_has_extents(inode)) {
+        return ext2_extent_set_block(fs, inode, block_index, real_index);
+    }
+    // Get the number of pointers per block.
+    unsigned int p = fs->pointers_per_block;
+    // Help compute the indices.
+    int a, b, c, d, e, f, g;
+    // We save intermediate indices here.
     uint32_t index_save;
     // Result of the operation.
     int ret = 0;
@@ -1341,14 +2610,14 @@ static int ext2_set_real_block_index(
 
     // Are we setting a DIRECT block pointer.
     a = ((int)block_index) - EXT2_DIRECT_BLOCKS;
-    if (a <= 0) {
+    if (a < 0) {
         inode->data.blocks.dir_blocks[block_index] = real_index;
     } else {
         // Are we setting an INDIRECT block pointer.
         b = a - p;
-        if (b <= 0) {
+        if (b < 0) {
             // Check that the indirect block points to a valid block.
-            if (__ext2_allocate_indexing_block_for_inode(fs, &inode->data.blocks.indir_block)) {
+            if (__ext2_allocate_indexing_block_for_inode(fs, inode, &inode->data.blocks.indir_block)) {
                 ret = -1;
                 goto early_exit;
             }
@@ -1362,16 +2631,16 @@ static int ext2_set_real_block_index(
         } else {
             // Are we setting a DOUBLY-INDIRECT block.
             c = b - p * p;
-            if (c <= 0) {
+            if (c < 0) {
                 c = b / p;
                 d = b - c * p;
                 // Check that the indirect block points to a valid block.
-                if (__ext2_allocate_indexing_block_for_inode(fs, &inode->data.blocks.doubly_indir_block)) {
+                if (__ext2_allocate_indexing_block_for_inode(fs, inode, &inode->data.blocks.doubly_indir_block)) {
                     ret = -1;
                     goto early_exit;
                 }
                 // Read the doubly-indirect block (which contains pointers to indirect blocks).
-                if (__ext2_read_and_allocate_indexing_block(fs, inode->data.blocks.doubly_indir_block, cache, c)) {
+                if (__ext2_read_and_allocate_indexing_block(fs, inode, inode->data.blocks.doubly_indir_block, cache, c)) {
                     ret = -1;
                     goto early_exit;
                 }
@@ -1386,25 +2655,25 @@ static int ext2_set_real_block_index(
 
             } else {
                 d = c - p * p * p;
-                if (d <= 0) {
+                if (d < 0) {
                     e = c / (p * p);
                     f = (c - e * p * p) / p;
                     g = (c - e * p * p - f * p);
 
                     // Check that the indirect block points to a valid block.
-                    if (__ext2_allocate_indexing_block_for_inode(fs, &inode->data.blocks.trebly_indir_block)) {
+                    if (__ext2_allocate_indexing_block_for_inode(fs, inode, &inode->data.blocks.trebly_indir_block)) {
                         ret = -1;
                         goto early_exit;
                     }
                     // Read the doubly-indirect block (which contains pointers to indirect blocks).
-                    if (__ext2_read_and_allocate_indexing_block(fs, inode->data.blocks.trebly_indir_block, cache, e)) {
+                    if (__ext2_read_and_allocate_indexing_block(fs, inode, inode->data.blocks.trebly_indir_block, cache, e)) {
                         ret = -1;
                         goto early_exit;
                     }
                     // Save the index.
                     index_save = ((uint32_t *)cache)[e];
                     // Read the doubly-indirect block (which contains pointers to indirect blocks).
-                    if (__ext2_read_and_allocate_indexing_block(fs, index_save, cache, f)) {
+                    if (__ext2_read_and_allocate_indexing_block(fs, inode, index_save, cache, f)) {
                         ret = -1;
                         goto early_exit;
                     }
@@ -1423,6 +2692,10 @@ static int ext2_set_real_block_index(
                 }
             }
         }
+        // Keep the cached mapping up to date.
+        if (ret == 0) {
+            ext2_block_map_update(fs, inode, block_index, real_index);
+        }
     }
 early_exit:
     // Free the cache.
@@ -1430,12 +2703,12 @@ early_exit:
     return ret;
 }
 
-/// @brief Returns the real block index starting from a block index inside an inode.
+/// @brief Walks the indirect blocks of the inode, to find the real block index.
 /// @param fs the filesystem.
 /// @param inode the inode which we are working with.
 /// @param block_index the block index inside the inode.
 /// @return the real block number.
-static uint32_t ext2_get_real_block_index(ext2_filesystem_t *fs, ext2_inode_t *inode, uint32_t block_index)
+static uint32_t __ext2_read_real_block_index(ext2_filesystem_t *fs, ext2_inode_t *inode, uint32_t block_index)
 {
     // Get the number of pointers per block.
     unsigned int p = fs->pointers_per_block;
@@ -1458,9 +2731,11 @@ static uint32_t ext2_get_real_block_index(ext2_filesystem_t *fs, ext2_inode_t *i
         b = a - p;
         if (b < 0) {
             // Read the indirect block (which contains pointers to the next set of blocks).
-            ext2_read_block(fs, inode->data.blocks.indir_block, cache);
-            // Compute the index inside the final block.
-            real_index = ((uint32_t *)cache)[a];
+            if (inode->data.blocks.indir_block) {
+                ext2_read_block(fs, inode->data.blocks.indir_block, cache);
+                // Compute the index inside the final block.
+                real_index = ((uint32_t *)cache)[a];
+            }
 
         } else {
             // Check if the index is among the DOUBLY-INDIRECT blocks.
@@ -1470,11 +2745,15 @@ static uint32_t ext2_get_real_block_index(ext2_filesystem_t *fs, ext2_inode_t *i
                 c = b / p;
                 d = b - c * p;
                 // Read the doubly-indirect block (which contains pointers to indirect blocks).
-                ext2_read_block(fs, inode->data.blocks.doubly_indir_block, cache);
-                // Compute the index inside the indirect block.
-                ext2_read_block(fs, cache[c], cache);
-                // Compute the index inside the final block.
-                real_index = cache[d];
+                if (inode->data.blocks.doubly_indir_block) {
+                    ext2_read_block(fs, inode->data.blocks.doubly_indir_block, cache);
+                    // Compute the index inside the indirect block, unless it is a hole.
+                    if (((uint32_t *)cache)[c]) {
+                        ext2_read_block(fs, ((uint32_t *)cache)[c], cache);
+                        // Compute the index inside the final block.
+                        real_index = ((uint32_t *)cache)[d];
+                    }
+                }
 
             } else {
                 // Check if the index is among the TREBLY-INDIRECT blocks.
@@ -1484,13 +2763,19 @@ static uint32_t ext2_get_real_block_index(ext2_filesystem_t *fs, ext2_inode_t *i
                     f = (c - e * p * p) / p;
                     g = (c - e * p * p - f * p);
                     // Read the trebly-indirect block (which contains pointers to doubly-indirect blocks).
-                    ext2_read_block(fs, inode->data.blocks.trebly_indir_block, cache);
-                    // Read the doubly-indirect block (which contains pointers to indirect blocks).
-                    ext2_read_block(fs, cache[e], cache);
-                    // Read the indirect block (which contains pointers to the next set of blocks).
-                    ext2_read_block(fs, cache[f], cache);
-                    // Compute the index inside the final block.
-                    real_index = cache[g];
+                    if (inode->data.blocks.trebly_indir_block) {
+                        ext2_read_block(fs, inode->data.blocks.trebly_indir_block, cache);
+                        // Read the doubly-indirect block (which contains pointers to indirect blocks).
+                        if (((uint32_t *)cache)[e]) {
+                            ext2_read_block(fs, ((uint32_t *)cache)[e], cache);
+                            // Read the indirect block (which contains pointers to the next set of blocks).
+                            if (((uint32_t *)cache)[f]) {
+                                ext2_read_block(fs, ((uint32_t *)cache)[f], cache);
+                                // Compute the index inside the final block.
+                                real_index = ((uint32_t *)cache)[g];
+                            }
+                        }
+                    }
 
                 } else {
                     pr_err("We failed to retrieve the real block number of the block with index `%d`\n", block_index);
@@ -1503,36 +2788,106 @@ static uint32_t ext2_get_real_block_index(ext2_filesystem_t *fs, ext2_inode_t *i
     return real_index;
 }
 
-/// @brief Allocate a new block for an inode.
+/// @brief Returns the real block index starting from a block index inside an inode.
+/// @param fs the filesystem.
+/// @param inode the inode which we are working with.
+/// @param block_index the block index inside the inode.
+/// @return the real block number.
+/// @details Mappings resolved through indirect blocks are cached, so that
+/// only the first access to a block walks the indirect blocks.
+static uint32_t ext2_get_real_block_index(ext2_filesystem_t *fs, ext2_inode_t *inode, uint32_t block_index)
+{
+    if (ext2_inode_has_extents(inode)) {
+        return ext2_extent_get_block(fs, inode, block_index);
+    }
+    // Direct blocks are already inside the inode.
+    if (block_index < EXT2_DIRECT_BLOCKS) {
+        return inode->data.blocks.dir_blocks[block_index];
+    }
+    uint32_t root = ext2_block_map_root(fs, inode, block_index);
+    if (root == 0) {
+        return 0;
+    }
+    // Check the cache.
+    ext2_block_map_entry_t *entry = ext2_block_map_slot(fs, root, block_index);
+    if ((entry->root == root) && (entry->block_index == block_index)) {
+        return entry->real_index;
+    }
+    // Walk the indirect blocks, and cache the result.
+    uint32_t real_index = __ext2_read_real_block_index(fs, inode, block_index);
+    if (real_index) {
+        entry->root        = root;
+        entry->block_index = block_index;
+        entry->real_index  = real_index;
+    }
+    return real_index;
+}
+
+/// @brief Allocate new consecutive blocks for an inode.
 /// @param fs the filesystem.
 /// @param inode the inode which we are working with.
 /// @param inode_index The index of the inode.
-/// @param block_index The index of the block within the inode.
+/// @param block_index The index of the first block within the inode, which
+/// must be a hole together with the following ones.
+/// @param count The number of blocks.
 /// @return 0 on success, -1 on failure.
-static int ext2_allocate_inode_block(ext2_filesystem_t *fs, ext2_inode_t *inode, uint32_t inode_index, uint32_t block_index)
+/// @details Blocks are allocated in batches of EXT2_ALLOCATE_BATCH, and the
+/// inode is written back once at the end.
+static int ext2_allocate_inode_blocks(ext2_filesystem_t *fs, ext2_inode_t *inode, uint32_t inode_index, uint32_t block_index, uint32_t count)
 {
-    pr_debug("Allocating block with index `%d` for inode with index `%d`.\n", block_index, inode_index);
-    // Allocate the block.
-    int real_index = ext2_allocate_block(fs);
-    if (real_index == -1) {
-        return -1;
-    }
-    // Associate the real index and the index inside the inode.
-    if (ext2_set_real_block_index(fs, inode, inode_index, block_index, real_index) == -1) {
-        return -1;
+    uint32_t blocks[EXT2_ALLOCATE_BATCH], allocated;
+    int ret = 0;
+    pr_debug("Allocating %u blocks from index `%d` for inode with index `%d`.\n", count, block_index, inode_index);
+    // Place the blocks right after the previous one, or at the beginning of
+    // the group of the inode.
+    uint32_t goal = fs->superblock.first_data_block +
+                    (ext2_inode_index_to_group_index(fs, inode_index) * fs->superblock.blocks_per_group);
+    if (block_index > 0) {
+        uint32_t previous = ext2_get_real_block_index(fs, inode, block_index - 1);
+        if (previous != 0) {
+            goal = previous + 1;
+        }
     }
-    // Compute the new blocks count.
-    uint32_t blocks_count = (block_index + 1) * fs->blocks_per_block_count;
-    if (inode->blocks_count < blocks_count) {
-        // Set the blocks count.
-        inode->blocks_count = blocks_count;
-        pr_debug("The new block count for inode %d is %d blocks.\n", inode_index, inode->blocks_count);
+    while ((count > 0) && (ret == 0)) {
+        // Allocate the blocks.
+        allocated = ext2_allocate_blocks_for_inode(fs, inode_index, goal, blocks, min(count, EXT2_ALLOCATE_BATCH));
+        if (allocated == 0) {
+            ret = -1;
+            break;
+        }
+        for (uint32_t i = 0; i < allocated; ++i, ++block_index) {
+            // Associate the real index and the index inside the inode.
+            if (ext2_set_real_block_index(fs, inode, inode_index, block_index, blocks[i]) == -1) {
+                // Give back the blocks which are not part of the inode.
+                for (; i < allocated; ++i) {
+                    ext2_free_block(fs, blocks[i]);
+                }
+                ret = -1;
+                break;
+            }
+            // Update the blocks count, holes are not counted.
+            inode->blocks_count += fs->blocks_per_block_count;
+        }
+        goal = blocks[allocated - 1] + 1;
+        count -= allocated;
     }
+    pr_debug("The new block count for inode %d is %d blocks.\n", inode_index, inode->blocks_count);
     // Update the inode.
     if (ext2_write_inode(fs, inode, inode_index) == -1) {
         return -1;
     }
-    return 0;
+    return ret;
+}
+
+/// @brief Allocate a new block for an inode.
+/// @param fs the filesystem.
+/// @param inode the inode which we are working with.
+/// @param inode_index The index of the inode.
+/// @param block_index The index of the block within the inode.
+/// @return 0 on success, -1 on failure.
+static int ext2_allocate_inode_block(ext2_filesystem_t *fs, ext2_inode_t *inode, uint32_t inode_index, uint32_t block_index)
+{
+    return ext2_allocate_inode_blocks(fs, inode, inode_index, block_index, 1);
 }
 
 /// @brief Reads the real block starting from an inode and the block index inside the inode.
@@ -1540,12 +2895,10 @@ static int ext2_allocate_inode_block(ext2_filesystem_t *fs, ext2_inode_t *inode,
 /// @param inode the inode which we are working with.
 /// @param block_index the index of the block within the inode.
 /// @param buffer the buffer where to put the data.
-/// @return the amount of data we read, or negative value for an error.
+/// @return the amount of data we read, or negative value for an error, or
+/// for a hole.
 static ssize_t ext2_read_inode_block(ext2_filesystem_t *fs, ext2_inode_t *inode, uint32_t block_index, uint8_t *buffer)
 {
-    if (block_index >= (inode->blocks_count / fs->blocks_per_block_count)) {
-        return -1;
-    }
     // Get the real index.
     uint32_t real_index = ext2_get_real_block_index(fs, inode, block_index);
     if (real_index == 0) {
@@ -1564,78 +2917,201 @@ static ssize_t ext2_read_inode_block(ext2_filesystem_t *fs, ext2_inode_t *inode,
 /// @param block_index the index of the block within the inode.
 /// @param buffer the buffer where to put the data.
 /// @return the amount of data we wrote, or negative value for an error.
+/// @details A hole gets its block allocated, the other holes are left alone.
 static ssize_t ext2_write_inode_block(ext2_filesystem_t *fs, ext2_inode_t *inode, uint32_t inode_index, uint32_t block_index, uint8_t *buffer)
 {
-    while (block_index >= (inode->blocks_count / fs->blocks_per_block_count)) {
-        pr_debug("ext2_write_inode_block: %u >= %u (%u / %u)\n",
-                 block_index, inode->blocks_count / fs->blocks_per_block_count,
-                 inode->blocks_count, fs->blocks_per_block_count);
-        if (ext2_allocate_inode_block(fs, inode, inode_index, (inode->blocks_count / fs->blocks_per_block_count)) < 0) {
-            pr_crit("Failed to write allocate inode block\n");
-        }
-    }
     // Get the real index.
     uint32_t real_index = ext2_get_real_block_index(fs, inode, block_index);
     if (real_index == 0) {
-        return -1;
+        if (ext2_allocate_inode_block(fs, inode, inode_index, block_index) < 0) {
+            pr_crit("Failed to write allocate inode block\n");
+            return -1;
+        }
+        real_index = ext2_get_real_block_index(fs, inode, block_index);
+        if (real_index == 0) {
+            return -1;
+        }
     }
     // Log the address to the inode block.
     pr_debug("Write inode block (block_index:%4u, real_index:%4u, inode_index:%4u)\n", block_index, real_index, inode_index);
-    // Write the block.
+    // Only directories and symbolic links are journaled with the metadata.
+    if ((inode->mode & EXT2_S_IFMT) == EXT2_S_IFREG) {
+        return ext2_write_data_block(fs, real_index, buffer);
+    }
     return ext2_write_block(fs, real_index, buffer);
 }
 
-/// @brief Reads the data from the given inode.
+/// @brief Brings the blocks of a range of the inode into the buffer cache,
+/// or drops them from it.
 /// @param fs the filesystem.
-/// @param inode the inode which we are working with.
-/// @param inode_index the index of the inode.
-/// @param offset the offset from which we start reading the data.
-/// @param nbyte the number of bytes to read.
-/// @param buffer the buffer containing the data.
-/// @return the amount we read.
-static ssize_t ext2_read_inode_data(ext2_filesystem_t *fs, ext2_inode_t *inode, uint32_t inode_index, off_t offset, size_t nbyte, char *buffer)
+/// @param inode the inode.
+/// @param start_block the first block of the range.
+/// @param end_block the last block of the range.
+/// @param drop if the blocks are dropped, instead of read.
+/// @details The blocks are grouped in physically contiguous runs, each one
+/// read with a single request. Dirty blocks are written back before being
+/// dropped.
+static void ext2_cache_range(ext2_filesystem_t *fs, ext2_inode_t *inode, uint32_t start_block, uint32_t end_block, int drop)
 {
-    // Get the offset to the end of the portion we are reading.
-    uint32_t end_offset = (inode->size >= offset + nbyte) ? (offset + nbyte) : (inode->size);
-    // Convert the offset/size to some starting/end iblock numbers.
-    uint32_t start_block = offset / fs->block_size;
-    uint32_t end_block   = end_offset / fs->block_size;
-    // What's the offset into the start block.
-    uint32_t start_off = offset % fs->block_size;
+    uint32_t run_start = 0, run_length = 0, real_index;
+    for (uint32_t block_index = start_block; block_index <= end_block; ++block_index) {
+        real_index = ext2_get_real_block_index(fs, inode, block_index);
+        if (run_length && (real_index == (run_start + run_length))) {
+            ++run_length;
+            continue;
+        }
+        if (run_length && drop) {
+            buffer_drop_range(fs->block_device, run_start, run_length, 0);
+        } else if (run_length) {
+            buffer_read_ahead(fs->block_device, run_start, run_length, fs->block_size);
+        }
+        // Holes are not backed by any block.
+        run_start  = real_index;
+        run_length = (real_index != 0);
+    }
+    if (run_length && drop) {
+        buffer_drop_range(fs->block_device, run_start, run_length, 0);
+    } else if (run_length) {
+        buffer_read_ahead(fs->block_device, run_start, run_length, fs->block_size);
+    }
+}
+
+/// @brief Reads the blocks of the inode touched by a read, together with the
+/// ones that follow when the file is being read sequentially.
+/// @param fs the filesystem.
+/// @param file the file being read, which keeps the read-ahead state.
+/// @param inode the inode of the file.
+/// @param offset the offset of the read.
+/// @param nbyte the number of bytes of the read.
+/// @details The read-ahead window starts from EXT2_READ_AHEAD_MIN blocks and
+/// doubles, up to ext2_read_ahead_max, at each sequential read; it is dropped
+/// as soon as the access is not sequential anymore. Files advised as
+/// sequential always use the largest window, random ones none.
+static void ext2_read_ahead(ext2_filesystem_t *fs, vfs_file_t *file, ext2_inode_t *inode, off_t offset, size_t nbyte)
+{
+    if ((nbyte == 0) || (offset >= inode->size)) {
+        return;
+    }
+    uint32_t start_block = offset / fs->block_size;
+    uint32_t end_block   = (min(offset + nbyte, inode->size) - 1) / fs->block_size;
+    uint32_t file_blocks = (inode->size + fs->block_size - 1) / fs->block_size;
+    // Detect sequential access, reads starting from the beginning of the file
+    // are considered sequential.
+    if (file->advice == POSIX_FADV_SEQUENTIAL) {
+        file->ra_window = ext2_read_ahead_max;
+    } else if (file->advice == POSIX_FADV_RANDOM) {
+        file->ra_window = 0;
+    } else if ((offset == 0) || (start_block == file->ra_next) || ((start_block + 1) == file->ra_next)) {
+        file->ra_window = min(file->ra_window ? file->ra_window * 2 : EXT2_READ_AHEAD_MIN, ext2_read_ahead_max);
+    } else {
+        file->ra_window = 0;
+    }
+    file->ra_next = end_block + 1;
+    // Compute the last block we are going to bring in.
+    end_block = min(end_block + file->ra_window, file_blocks - 1);
+    ext2_cache_range(fs, inode, start_block, end_block, 0);
+}
+
+/// @brief Reads the data from the given inode.
+/// @param fs the filesystem.
+/// @param inode the inode which we are working with.
+/// @param inode_index the index of the inode.
+/// @param offset the offset from which we start reading the data.
+/// @param nbyte the number of bytes to read.
+/// @param buffer the buffer containing the data.
+/// @return the amount we read.
+static ssize_t ext2_read_inode_data(ext2_filesystem_t *fs, ext2_inode_t *inode, uint32_t inode_index, off_t offset, size_t nbyte, char *buffer)
+{
+    // Get the offset to the end of the portion we are reading.
+    uint32_t end_offset = (inode->size >= offset + nbyte) ? (offset + nbyte) : (inode->size);
+    // Convert the offset/size to some starting/end iblock numbers.
+    uint32_t start_block = offset / fs->block_size;
+    uint32_t end_block   = end_offset / fs->block_size;
+    // What's the offset into the start block.
+    uint32_t start_off = offset % fs->block_size;
     // How much bytes to read for the end block.
     uint32_t end_size = end_offset - end_block * fs->block_size;
 
-    // Allocate the cache.
-    uint8_t *cache = kmem_cache_alloc(fs->ext2_buffer_cache, GFP_KERNEL);
-    // Clean the cache.
-    memset(cache, 0, fs->ext2_buffer_cache->size);
+    // The cache is needed only for the partial blocks, allocated on first use.
+    uint8_t *cache = NULL;
 
-    uint32_t curr_off = 0, left, right, ret = end_offset - offset;
+    uint32_t curr_off = 0, left, right, real_index, ret = end_offset - offset;
     for (uint32_t block_index = start_block; block_index <= end_block; ++block_index) {
+        // Large reads must not keep the interrupts out for their whole length.
+        cond_resched();
         left = 0, right = fs->block_size - 1;
-        // Read the real block.
-        if (ext2_read_inode_block(fs, inode, block_index, cache) == -1) {
-            // TODO: Understand why sometimes it fails.
-            pr_warning("Failed to read the inode block %u of inode %u\n", block_index, inode_index);
-            // ret = -1;
-            // break;
-        }
         if (block_index == start_block) {
             left = start_off;
         }
         if (block_index == end_block) {
             right = end_size - 1;
         }
+        // Nothing to read from this block.
+        if ((right < left) || ((block_index == end_block) && (end_size == 0))) {
+            continue;
+        }
+        // Holes read as zeros, without any I/O.
+        real_index = ext2_get_real_block_index(fs, inode, block_index);
+        if (real_index == 0) {
+            memset(buffer + curr_off, 0, (right - left + 1));
+            curr_off += (right - left + 1);
+            continue;
+        }
+        // Full blocks are read straight into the buffer.
+        if ((left == 0) && (right == fs->block_size - 1)) {
+            if (ext2_read_block(fs, real_index, (uint8_t *)buffer + curr_off) < 0) {
+                pr_warning("Failed to read the inode block %u of inode %u\n", block_index, inode_index);
+                memset(buffer + curr_off, 0, fs->block_size);
+            }
+            curr_off += fs->block_size;
+            continue;
+        }
+        if (cache == NULL) {
+            // Allocate the cache.
+            cache = kmem_cache_alloc(fs->ext2_buffer_cache, GFP_KERNEL);
+        }
+        // Read the real block.
+        if (ext2_read_block(fs, real_index, cache) < 0) {
+            pr_warning("Failed to read the inode block %u of inode %u\n", block_index, inode_index);
+            memset(cache, 0, fs->ext2_buffer_cache->size);
+        }
         // Copy the content back to the buffer.
         memcpy(buffer + curr_off, cache + left, (right - left + 1));
         // Move the offset.
         curr_off += (right - left + 1);
     }
-    // Free the cache.
-    kmem_cache_free(cache);
+    if (cache) {
+        // Free the cache.
+        kmem_cache_free(cache);
+    }
     return ret;
 }
 
+/// @brief Allocates the holes inside a range of blocks of the inode, each
+/// run of them at once.
+/// @param fs the filesystem.
+/// @param inode the inode.
+/// @param inode_index the index of the inode.
+/// @param start_block the first block of the range.
+/// @param end_block the last block of the range.
+/// @return 0 on success, -1 on failure.
+static int ext2_allocate_holes(ext2_filesystem_t *fs, ext2_inode_t *inode, uint32_t inode_index, uint32_t start_block, uint32_t end_block)
+{
+    for (uint32_t block_index = start_block, run_start; block_index <= end_block;) {
+        if (ext2_get_real_block_index(fs, inode, block_index)) {
+            ++block_index;
+            continue;
+        }
+        run_start = block_index;
+        while ((++block_index <= end_block) && !ext2_get_real_block_index(fs, inode, block_index)) {}
+        if (ext2_allocate_inode_blocks(fs, inode, inode_index, run_start, block_index - run_start) < 0) {
+            pr_err("Failed to allocate the blocks of inode %u\n", inode_index);
+            return -1;
+        }
+    }
+    return 0;
+}
+
 /// @brief Writes the data on the given inode.
 /// @param fs the filesystem.
 /// @param inode the inode which we are working with.
@@ -1653,16 +3129,24 @@ static ssize_t ext2_write_inode_data(ext2_filesystem_t *fs, ext2_inode_t *inode,
             return -1;
         }
     }
+    if (nbyte == 0) {
+        return 0;
+    }
     // Get the offset to the end of the portion we are writing.
-    uint32_t end_offset = (inode->size >= offset + nbyte) ? (offset + nbyte) : (inode->size);
+    uint32_t end_offset = offset + nbyte;
     // Convert the offset/size to some starting/end iblock numbers.
     uint32_t start_block = offset / fs->block_size;
-    uint32_t end_block   = end_offset / fs->block_size;
+    uint32_t end_block   = (end_offset - 1) / fs->block_size;
     // What's the offset into the start block.
     uint32_t start_off = offset % fs->block_size;
-    // How much bytes to read for the end block.
+    // How much bytes to write on the end block.
     uint32_t end_size = end_offset - end_block * fs->block_size;
 
+    // Allocate the holes being written, the blocks skipped over stay holes.
+    if (ext2_allocate_holes(fs, inode, inode_index, start_block, end_block) < 0) {
+        return -1;
+    }
+
     // Allocate the cache.
     uint8_t *cache = kmem_cache_alloc(fs->ext2_buffer_cache, GFP_KERNEL);
     // Clean the cache.
@@ -1670,15 +3154,18 @@ static ssize_t ext2_write_inode_data(ext2_filesystem_t *fs, ext2_inode_t *inode,
 
     uint32_t curr_off = 0, left, right, ret = end_offset - offset;
     for (uint32_t block_index = start_block; block_index <= end_block; ++block_index) {
-        left = 0, right = fs->block_size;
-        // Read the real block. Do not check for
-        ext2_read_inode_block(fs, inode, block_index, cache);
+        cond_resched();
+        left = 0, right = fs->block_size - 1;
         if (block_index == start_block) {
             left = start_off;
         }
         if (block_index == end_block) {
             right = end_size - 1;
         }
+        // Blocks which are not fully overwritten are read first.
+        if ((left != 0) || (right != fs->block_size - 1)) {
+            ext2_read_inode_block(fs, inode, block_index, cache);
+        }
         // Copy the content back to the buffer.
         memcpy(cache + left, buffer + curr_off, (right - left + 1));
         // Move the offset.
@@ -1690,160 +3177,995 @@ static ssize_t ext2_write_inode_data(ext2_filesystem_t *fs, ext2_inode_t *inode,
             break;
         }
     }
-    // Free the cache.
-    kmem_cache_free(cache);
+    // Free the cache.
+    kmem_cache_free(cache);
+    return ret;
+}
+
+// ============================================================================
+// Directory Entry Iteration Functions
+// ============================================================================
+
+/// @brief Iterator for visiting the directory entries.
+typedef struct ext2_direntry_iterator_t {
+    ext2_filesystem_t *fs;   ///< A pointer to the filesystem.
+    uint8_t *cache;          ///< Cache used for reading.
+    ext2_inode_t *inode;     ///< A pointer to the directory inode.
+    uint32_t block_index;    ///< The current block we are reading.
+    uint32_t total_offset;   ///< The total amount of bytes we have read.
+    uint32_t block_offset;   ///< The total amount of bytes we have read inside the current block.
+    ext2_dirent_t *direntry; ///< Pointer to the directory entry.
+} ext2_direntry_iterator_t;
+
+/// @brief Returns the ext2_dirent_t pointed by the iterator.
+/// @param iterator the iterator.
+/// @return pointer to the ext2_dirent_t
+ext2_dirent_t *ext2_direntry_iterator_get(ext2_direntry_iterator_t *iterator)
+{
+    return (ext2_dirent_t *)((uintptr_t)iterator->cache + iterator->block_offset);
+}
+
+/// @brief Check if the iterator is valid.
+/// @param iterator the iterator to check.
+/// @return 1 if valid, 0 otherwise.
+int ext2_direntry_iterator_valid(ext2_direntry_iterator_t *iterator)
+{
+    return iterator->direntry != NULL;
+}
+
+/// @brief Initializes the iterator at an entry, and reads its block.
+/// @param fs pointer to the filesystem.
+/// @param cache used for reading.
+/// @param inode pointer to the directory inode.
+/// @param offset the position of the entry inside the directory.
+/// @return The initialized directory iterator, not valid past the end.
+ext2_direntry_iterator_t ext2_direntry_iterator_at(ext2_filesystem_t *fs, uint8_t *cache, ext2_inode_t *inode, uint32_t offset)
+{
+    ext2_direntry_iterator_t it = {
+        .fs           = fs,
+        .cache        = cache,
+        .inode        = inode,
+        .block_index  = offset / fs->block_size,
+        .total_offset = offset,
+        .block_offset = offset % fs->block_size,
+        .direntry     = NULL
+    };
+    if (offset >= inode->size) {
+        return it;
+    }
+    // Start by reading the block of the entry.
+    if (ext2_read_inode_block(fs, inode, it.block_index, cache) == -1) {
+        pr_err("Failed to read the inode block `%d`\n", it.block_index);
+    } else {
+        // Initialize the directory entry.
+        it.direntry = ext2_direntry_iterator_get(&it);
+    }
+    return it;
+}
+
+/// @brief Initializes the iterator and reads the first block.
+/// @param fs pointer to the filesystem.
+/// @param cache used for reading.
+/// @param inode pointer to the directory inode.
+/// @return The initialized directory iterator.
+ext2_direntry_iterator_t ext2_direntry_iterator_begin(ext2_filesystem_t *fs, uint8_t *cache, ext2_inode_t *inode)
+{
+    return ext2_direntry_iterator_at(fs, cache, inode, 0);
+}
+
+/// @brief Moves to the next direntry, and moves to the next block if necessary.
+/// @param iterator the iterator.
+void ext2_direntry_iterator_next(ext2_direntry_iterator_t *iterator)
+{
+    // Get the current rec_len.
+    uint32_t rec_len = ext2_direntry_iterator_get(iterator)->rec_len;
+    // Advance the offsets.
+    iterator->block_offset += rec_len;
+    iterator->total_offset += rec_len;
+    // If we reached the end of the inode, stop.
+    if (iterator->total_offset >= iterator->inode->size) {
+        // The iterator is not valid anymore.
+        iterator->direntry = NULL;
+        return;
+    }
+    // If we exceed the size of a block, move to the next block.
+    if (iterator->block_offset >= iterator->fs->block_size) {
+        // Increase the block index.
+        iterator->block_index += 1;
+        // Remove the exceeding size, so that we start correctly in the new block.
+        iterator->block_offset -= iterator->fs->block_size;
+        // Read the new block.
+        if (ext2_read_inode_block(iterator->fs, iterator->inode, iterator->block_index, iterator->cache) == -1) {
+            pr_err("Failed to read the inode block `%d`\n", iterator->block_index);
+            // The iterator is not valid anymore.
+            iterator->direntry = NULL;
+            return;
+        }
+    }
+    // Read the direntry.
+    iterator->direntry = ext2_direntry_iterator_get(iterator);
+}
+
+/// @brief Checks if a directory holds only `.` and `..`.
+/// @param fs the filesystem.
+/// @param cache used for reading.
+/// @param inode the inode of the directory.
+/// @return 1 if it is empty, 0 otherwise.
+static inline int ext2_directory_is_empty(ext2_filesystem_t *fs, uint8_t *cache, ext2_inode_t *inode)
+{
+    ext2_direntry_iterator_t it = ext2_direntry_iterator_begin(fs, cache, inode);
+    for (; ext2_direntry_iterator_valid(&it); ext2_direntry_iterator_next(&it)) {
+        if (it.direntry->inode == 0) {
+            continue;
+        }
+        // The names are not terminated, compare them through their length.
+        if ((it.direntry->name_len == 1) && (it.direntry->name[0] == '.')) {
+            continue;
+        }
+        if ((it.direntry->name_len == 2) && !strncmp(it.direntry->name, "..", 2)) {
+            continue;
+        }
+        return 0;
+    }
+    return 1;
+}
+
+/// @brief Changes the size of a regular file.
+/// @param fs the filesystem.
+/// @param inode the inode of the file, which is written back.
+/// @param inode_index the index of the inode.
+/// @param length the new size.
+/// @return 0 on success, -errno on failure.
+/// @details The blocks past the new end go back to the bitmaps, without
+/// writing their content; only the tail of the last block is cleared, since
+/// a later extension must read zeros there. Growing the file allocates
+/// nothing, the new blocks are allocated when written.
+static int ext2_truncate_inode(ext2_filesystem_t *fs, ext2_inode_t *inode, uint32_t inode_index, off_t length)
+{
+    // Check the type of operation.
+    if (bitmask_exact(inode->mode, EXT2_S_IFDIR)) {
+        return -EISDIR;
+    }
+    if (!bitmask_exact(inode->mode, EXT2_S_IFREG)) {
+        return -EINVAL;
+    }
+    if (length < 0) {
+        return -EINVAL;
+    }
+    if ((uint32_t)length < inode->size) {
+        // Number of blocks which keep some data.
+        uint32_t keep = (length / fs->block_size) + ((length % fs->block_size) != 0);
+        // Clear the tail of the last block.
+        uint32_t real_index = keep ? ext2_get_real_block_index(fs, inode, keep - 1) : 0;
+        if (real_index && (length % fs->block_size)) {
+            uint8_t *cache = kmem_cache_alloc(fs->ext2_buffer_cache, GFP_KERNEL);
+            if (ext2_read_block(fs, real_index, cache) < 0) {
+                kmem_cache_free(cache);
+                return -EIO;
+            }
+            memset(cache + (length % fs->block_size), 0, fs->block_size - (length % fs->block_size));
+            if (ext2_write_data_block(fs, real_index, cache) < 0) {
+                kmem_cache_free(cache);
+                return -EIO;
+            }
+            kmem_cache_free(cache);
+        }
+        ext2_truncate_blocks(fs, inode, inode_index, keep);
+    }
+    inode->size  = length;
+    inode->mtime = inode->ctime = sys_time(NULL);
+    if (ext2_write_inode(fs, inode, inode_index) < 0) {
+        return -EIO;
+    }
+    // The cached pages do not match the content anymore.
+    page_cache_invalidate(fs, inode_index);
+    // Keep the open file in sync.
+    vfs_file_t *file = hashmap_get(fs->files, (void *)inode_index);
+    if (file) {
+        file->length = inode->size;
+    }
+    return 0;
+}
+
+// ============================================================================
+// Directory Entry Management Functions
+// ============================================================================
+
+static inline uint32_t ext2_get_rec_len_from_name(const char *name)
+{
+    unsigned int rec_len = sizeof(ext2_dirent_t) + strlen(name);
+    rec_len += (rec_len % 4) ? (4 - (rec_len % 4)) : 0;
+    return rec_len;
+}
+
+static inline uint32_t ext2_get_rec_len_from_direntry(const ext2_dirent_t *direntry)
+{
+    unsigned int rec_len = sizeof(ext2_dirent_t) + direntry->name_len;
+    rec_len += (rec_len % 4) ? (4 - (rec_len % 4)) : 0;
+    return rec_len;
+}
+
+/// @brief Copies the directory entry inside the search structure.
+/// @param search the search structure.
+/// @param ino the index of the parent directory inode.
+/// @param direntry the directory entry.
+/// @param block_index the block, inside the directory, containing the entry.
+/// @param block_offset the offset of the entry inside the block.
+static inline void ext2_fill_direntry_search(
+    ext2_direntry_search_t *search,
+    ino_t ino,
+    ext2_dirent_t *direntry,
+    uint32_t block_index,
+    uint32_t block_offset)
+{
+    search->parent_inode       = ino;
+    search->direntry.inode     = direntry->inode;
+    search->direntry.rec_len   = direntry->rec_len;
+    search->direntry.name_len  = direntry->name_len;
+    search->direntry.file_type = direntry->file_type;
+    strncpy(search->direntry.name, direntry->name, direntry->name_len);
+    search->direntry.name[direntry->name_len] = 0;
+    search->block_index                       = block_index;
+    search->block_offset                      = block_offset;
+}
+
+/// @brief Adds the entry to the block of directory entries, if there is room.
+/// @param fs the filesystem.
+/// @param buffer the content of the block.
+/// @param inode_index the inode the new entry points to.
+/// @param name the name of the new entry.
+/// @param file_type the type of the new entry.
+/// @return 0 on success, -1 if there is no room.
+static int ext2_dirent_block_insert(ext2_filesystem_t *fs, uint8_t *buffer, uint32_t inode_index, const char *name, uint8_t file_type)
+{
+    uint32_t needed = ext2_get_rec_len_from_name(name), used;
+    ext2_dirent_t *direntry, *next;
+    for (uint32_t offset = 0; offset < fs->block_size; offset += direntry->rec_len) {
+        direntry = (ext2_dirent_t *)(buffer + offset);
+        if ((direntry->rec_len < sizeof(ext2_dirent_t)) || ((offset + direntry->rec_len) > fs->block_size)) {
+            pr_err("Corrupted directory entry at offset %u.\n", offset);
+            return -1;
+        }
+        used = direntry->inode ? ext2_get_rec_len_from_direntry(direntry) : 0;
+        if ((direntry->rec_len - used) >= needed) {
+            // Split the entry, the new one takes the unused space.
+            if (used) {
+                next              = (ext2_dirent_t *)(buffer + offset + used);
+                next->rec_len     = direntry->rec_len - used;
+                direntry->rec_len = used;
+                direntry          = next;
+            }
+            direntry->inode     = inode_index;
+            direntry->name_len  = strlen(name);
+            direntry->file_type = file_type;
+            memcpy(direntry->name, name, direntry->name_len);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/// @brief Rotates the word to the left.
+/// @param word the word.
+/// @param shift the amount of bits.
+/// @return the rotated word.
+static inline uint32_t ext2_rol32(uint32_t word, unsigned int shift)
+{
+    return (word << shift) | (word >> (32 - shift));
+}
+
+/// @brief Computes the legacy hash of the name.
+/// @param name the name.
+/// @param len the length of the name.
+/// @param unsigned_char if the characters are unsigned.
+/// @return the hash.
+static uint32_t ext2_dx_hack_hash(const char *name, int len, int unsigned_char)
+{
+    uint32_t hash, hash0 = 0x12A3FE2D, hash1 = 0x37ABE8F9;
+    for (int i = 0; i < len; ++i) {
+        int c = unsigned_char ? (int)(unsigned char)name[i] : (int)(signed char)name[i];
+        hash  = hash1 + (hash0 ^ (uint32_t)(c * 7152373));
+        if (hash & 0x80000000U) {
+            hash -= 0x7FFFFFFFU;
+        }
+        hash1 = hash0;
+        hash0 = hash;
+    }
+    return hash0 << 1;
+}
+
+/// @brief Packs the name into the words fed to the hash functions.
+/// @param msg the name.
+/// @param len the remaining length of the name.
+/// @param buf the output words.
+/// @param num the number of words.
+/// @param unsigned_char if the characters are unsigned.
+static void ext2_dx_str2hashbuf(const char *msg, int len, uint32_t *buf, int num, int unsigned_char)
+{
+    uint32_t pad, val;
+    pad = (uint32_t)len | ((uint32_t)len << 8);
+    pad |= pad << 16;
+    val = pad;
+    if (len > num * 4) {
+        len = num * 4;
+    }
+    for (int i = 0; i < len; ++i) {
+        int c = unsigned_char ? (int)(unsigned char)msg[i] : (int)(signed char)msg[i];
+        val   = (uint32_t)c + (val << 8);
+        if ((i % 4) == 3) {
+            *buf++ = val;
+            val    = pad;
+            --num;
+        }
+    }
+    if (--num >= 0) {
+        *buf++ = val;
+    }
+    while (--num >= 0) {
+        *buf++ = pad;
+    }
+}
+
+#define EXT2_MD4_F(x, y, z)                 ((z) ^ ((x) & ((y) ^ (z))))      ///< Round 1 function.
+#define EXT2_MD4_G(x, y, z)                 (((x) & (y)) + (((x) ^ (y)) & (z))) ///< Round 2 function.
+#define EXT2_MD4_H(x, y, z)                 ((x) ^ (y) ^ (z))                ///< Round 3 function.
+#define EXT2_MD4_ROUND(f, a, b, c, d, x, s) (a += f(b, c, d) + (x), a = ext2_rol32(a, s)) ///< MD4 step.
+
+/// @brief Mixes the words into the buffer, with a reduced MD4.
+/// @param buf the hash buffer.
+/// @param in the input words.
+static void ext2_dx_half_md4_transform(uint32_t buf[4], const uint32_t in[8])
+{
+    uint32_t a = buf[0], b = buf[1], c = buf[2], d = buf[3];
+    // Round 1.
+    EXT2_MD4_ROUND(EXT2_MD4_F, a, b, c, d, in[0], 3);
+    EXT2_MD4_ROUND(EXT2_MD4_F, d, a, b, c, in[1], 7);
+    EXT2_MD4_ROUND(EXT2_MD4_F, c, d, a, b, in[2], 11);
+    EXT2_MD4_ROUND(EXT2_MD4_F, b, c, d, a, in[3], 19);
+    EXT2_MD4_ROUND(EXT2_MD4_F, a, b, c, d, in[4], 3);
+    EXT2_MD4_ROUND(EXT2_MD4_F, d, a, b, c, in[5], 7);
+    EXT2_MD4_ROUND(EXT2_MD4_F, c, d, a, b, in[6], 11);
+    EXT2_MD4_ROUND(EXT2_MD4_F, b, c, d, a, in[7], 19);
+    // Round 2.
+    EXT2_MD4_ROUND(EXT2_MD4_G, a, b, c, d, in[1] + 0x5A827999U, 3);
+    EXT2_MD4_ROUND(EXT2_MD4_G, d, a, b, c, in[3] + 0x5A827999U, 5);
+    EXT2_MD4_ROUND(EXT2_MD4_G, c, d, a, b, in[5] + 0x5A827999U, 9);
+    EXT2_MD4_ROUND(EXT2_MD4_G, b, c, d, a, in[7] + 0x5A827999U, 13);
+    EXT2_MD4_ROUND(EXT2_MD4_G, a, b, c, d, in[0] + 0x5A827999U, 3);
+    EXT2_MD4_ROUND(EXT2_MD4_G, d, a, b, c, in[2] + 0x5A827999U, 5);
+    EXT2_MD4_ROUND(EXT2_MD4_G, c, d, a, b, in[4] + 0x5A827999U, 9);
+    EXT2_MD4_ROUND(EXT2_MD4_G, b, c, d, a, in[6] + 0x5A827999U, 13);
+    // Round 3.
+    EXT2_MD4_ROUND(EXT2_MD4_H, a, b, c, d, in[3] + 0x6ED9EBA1U, 3);
+    EXT2_MD4_ROUND(EXT2_MD4_H, d, a, b, c, in[7] + 0x6ED9EBA1U, 9);
+    EXT2_MD4_ROUND(EXT2_MD4_H, c, d, a, b, in[2] + 0x6ED9EBA1U, 11);
+    EXT2_MD4_ROUND(EXT2_MD4_H, b, c, d, a, in[6] + 0x6ED9EBA1U, 15);
+    EXT2_MD4_ROUND(EXT2_MD4_H, a, b, c, d, in[1] + 0x6ED9EBA1U, 3);
+    EXT2_MD4_ROUND(EXT2_MD4_H, d, a, b, c, in[5] + 0x6ED9EBA1U, 9);
+    EXT2_MD4_ROUND(EXT2_MD4_H, c, d, a, b, in[0] + 0x6ED9EBA1U, 11);
+    EXT2_MD4_ROUND(EXT2_MD4_H, b, c, d, a, in[4] + 0x6ED9EBA1U, 15);
+    buf[0] += a;
+    buf[1] += b;
+    buf[2] += c;
+    buf[3] += d;
+}
+
+#undef EXT2_MD4_F
+#undef EXT2_MD4_G
+#undef EXT2_MD4_H
+#undef EXT2_MD4_ROUND
+
+/// @brief Mixes the words into the buffer, with the Tiny Encryption Algorithm.
+/// @param buf the hash buffer.
+/// @param in the input words.
+static void ext2_dx_tea_transform(uint32_t buf[4], const uint32_t in[4])
+{
+    uint32_t sum = 0, b0 = buf[0], b1 = buf[1];
+    uint32_t a = in[0], b = in[1], c = in[2], d = in[3];
+    for (int n = 0; n < 16; ++n) {
+        sum += 0x9E3779B9U;
+        b0 += ((b1 << 4) + a) ^ (b1 + sum) ^ ((b1 >> 5) + b);
+        b1 += ((b0 << 4) + c) ^ (b0 + sum) ^ ((b0 >> 5) + d);
+    }
+    buf[0] += b0;
+    buf[1] += b1;
+}
+
+/// @brief Computes the hash used to index the name inside a directory.
+/// @param fs the filesystem.
+/// @param hash_version the hash function.
+/// @param name the name.
+/// @param len the length of the name.
+/// @param hash where we store the hash.
+/// @return 0 on success, -1 if the hash function is not supported.
+static int ext2_htree_hash(ext2_filesystem_t *fs, uint8_t hash_version, const char *name, int len, uint32_t *hash)
+{
+    uint32_t buf[4] = { 0x67452301U, 0xEFCDAB89U, 0x98BADCFEU, 0x10325476U }, in[8], value;
+    int unsigned_char = (fs->superblock.flags & EXT2_FLAGS_UNSIGNED_HASH) != 0;
+    // Use the seed of the filesystem, if there is one.
+    for (int i = 0; i < 4; ++i) {
+        if (fs->superblock.hash_seed[i]) {
+            memcpy(buf, fs->superblock.hash_seed, sizeof(buf));
+            break;
+        }
+    }
+    switch (hash_version) {
+    case EXT2_HTREE_LEGACY:
+        value = ext2_dx_hack_hash(name, len, unsigned_char);
+        break;
+    case EXT2_HTREE_HALF_MD4:
+        for (const char *p = name; len > 0; len -= 32, p += 32) {
+            ext2_dx_str2hashbuf(p, len, in, 8, unsigned_char);
+            ext2_dx_half_md4_transform(buf, in);
+        }
+        value = buf[1];
+        break;
+    case EXT2_HTREE_TEA:
+        for (const char *p = name; len > 0; len -= 16, p += 16) {
+            ext2_dx_str2hashbuf(p, len, in, 4, unsigned_char);
+            ext2_dx_tea_transform(buf, in);
+        }
+        value = buf[0];
+        break;
+    default:
+        return -1;
+    }
+    // The lowest bit marks hash collisions continuing in the next block.
+    value &= ~1U;
+    if (value == (EXT2_HTREE_EOF << 1)) {
+        value = (EXT2_HTREE_EOF - 1) << 1;
+    }
+    *hash = value;
+    return 0;
+}
+
+/// @brief Returns the limit and count of the entries of an index block.
+/// @param entries the entries.
+/// @return a pointer to the limit and count.
+static inline ext2_dx_countlimit_t *ext2_dx_countlimit(ext2_dx_entry_t *entries)
+{
+    return (ext2_dx_countlimit_t *)entries;
+}
+
+/// @brief Returns the maximum number of entries of the root of an HTree.
+/// @param fs the filesystem.
+/// @return the number of entries.
+static inline uint32_t ext2_dx_root_limit(ext2_filesystem_t *fs)
+{
+    return (fs->block_size - EXT2_HTREE_ROOT_INFO_OFFSET - sizeof(ext2_dx_root_info_t)) / sizeof(ext2_dx_entry_t);
+}
+
+/// @brief Returns the maximum number of entries of an index node.
+/// @param fs the filesystem.
+/// @return the number of entries.
+static inline uint32_t ext2_dx_node_limit(ext2_filesystem_t *fs)
+{
+    return (fs->block_size - sizeof(ext2_dirent_t)) / sizeof(ext2_dx_entry_t);
+}
+
+/// @brief Initializes an empty index node, which looks like an unused
+/// directory entry spanning the whole block to those not knowing HTrees.
+/// @param fs the filesystem.
+/// @param buffer the content of the block.
+/// @return the entries of the node.
+static inline ext2_dx_entry_t *ext2_dx_node_init(ext2_filesystem_t *fs, uint8_t *buffer)
+{
+    memset(buffer, 0, fs->block_size);
+    ((ext2_dirent_t *)buffer)->rec_len = fs->block_size;
+    ext2_dx_entry_t *entries           = (ext2_dx_entry_t *)(buffer + sizeof(ext2_dirent_t));
+    ext2_dx_countlimit(entries)->limit = ext2_dx_node_limit(fs);
+    return entries;
+}
+
+/// @brief Walks the HTree of the directory, down to the leaf of the name.
+/// @param fs the filesystem.
+/// @param inode the directory inode.
+/// @param name the name.
+/// @param path the path, its frames must have a buffer each.
+/// @return 0 on success, -1 if the index cannot be used.
+static int ext2_htree_probe(ext2_filesystem_t *fs, ext2_inode_t *inode, const char *name, ext2_dx_path_t *path)
+{
+    ext2_dx_frame_t *frame = &path->frames[0];
+    // Read the root.
+    frame->block = 0;
+    if (ext2_read_inode_block(fs, inode, frame->block, frame->buffer) == -1) {
+        pr_err("Failed to read the root of the directory index.\n");
+        return -1;
+    }
+    ext2_dx_root_info_t *info = (ext2_dx_root_info_t *)(frame->buffer + EXT2_HTREE_ROOT_INFO_OFFSET);
+    if ((info->reserved_zero != 0) ||
+        (info->info_length != sizeof(ext2_dx_root_info_t)) ||
+        (info->indirect_levels >= EXT2_HTREE_MAX_DEPTH)) {
+        pr_warning("Unsupported directory index (levels: %u).\n", info->indirect_levels);
+        return -1;
+    }
+    path->depth        = info->indirect_levels + 1;
+    path->hash_version = info->hash_version;
+    if (ext2_htree_hash(fs, path->hash_version, name, strlen(name), &path->hash) < 0) {
+        pr_warning("Unsupported directory index hash (%u).\n", path->hash_version);
+        return -1;
+    }
+    frame->entries = (ext2_dx_entry_t *)((uint8_t *)info + info->info_length);
+    for (int level = 0; level < path->depth; ++level) {
+        frame = &path->frames[level];
+        // Read the index node, following the entry of the level above.
+        if (level > 0) {
+            frame->block = path->frames[level - 1].at->block & EXT2_HTREE_BLOCK_MASK;
+            if (ext2_read_inode_block(fs, inode, frame->block, frame->buffer) == -1) {
+                pr_err("Failed to read the directory index block `%d`.\n", frame->block);
+                return -1;
+            }
+            frame->entries = (ext2_dx_entry_t *)(frame->buffer + sizeof(ext2_dirent_t));
+        }
+        uint32_t count = ext2_dx_countlimit(frame->entries)->count;
+        uint32_t limit = ext2_dx_countlimit(frame->entries)->limit;
+        if ((count == 0) || (count > limit) ||
+            (limit != (level ? ext2_dx_node_limit(fs) : ext2_dx_root_limit(fs)))) {
+            pr_err("Corrupted directory index block `%d`.\n", frame->block);
+            return -1;
+        }
+        // Find the last entry whose hash is not greater than ours, the first
+        // entry has an implicit hash of zero.
+        ext2_dx_entry_t *p = frame->entries + 1, *q = frame->entries + count - 1, *m;
+        while (p <= q) {
+            m = p + ((q - p) / 2);
+            if (m->hash > path->hash) {
+                q = m - 1;
+            } else {
+                p = m + 1;
+            }
+        }
+        frame->at = p - 1;
+    }
+    return 0;
+}
+
+/// @brief Moves to the next leaf, if the names with our hash continue there.
+/// @param fs the filesystem.
+/// @param inode the directory inode.
+/// @param path the path to the current leaf.
+/// @return 1 if we moved to the next leaf, 0 if there is no need, -1 on failure.
+static int ext2_htree_next_leaf(ext2_filesystem_t *fs, ext2_inode_t *inode, ext2_dx_path_t *path)
+{
+    int level = path->depth - 1;
+    // Find the lowest level which has a next entry.
+    while ((path->frames[level].at + 1) >= (path->frames[level].entries + ext2_dx_countlimit(path->frames[level].entries)->count)) {
+        if (level == 0) {
+            return 0;
+        }
+        --level;
+    }
+    path->frames[level].at += 1;
+    // A split in a sequence of equal hashes sets the lowest bit of the hash.
+    if ((path->frames[level].at->hash & ~1U) != path->hash) {
+        return 0;
+    }
+    // Go down to the first leaf below the entry.
+    for (++level; level < path->depth; ++level) {
+        ext2_dx_frame_t *frame = &path->frames[level];
+        frame->block           = path->frames[level - 1].at->block & EXT2_HTREE_BLOCK_MASK;
+        if (ext2_read_inode_block(fs, inode, frame->block, frame->buffer) == -1) {
+            pr_err("Failed to read the directory index block `%d`.\n", frame->block);
+            return -1;
+        }
+        frame->entries = (ext2_dx_entry_t *)(frame->buffer + sizeof(ext2_dirent_t));
+        frame->at      = frame->entries;
+    }
+    return 1;
+}
+
+/// @brief Searches the entry inside the directory, using its index.
+/// @param fs the filesystem.
+/// @param inode the directory inode.
+/// @param ino the index of the directory inode.
+/// @param name the name of the entry we are looking for.
+/// @param search the output variable where we save the info about the entry.
+/// @return 0 on success, -1 if the entry does not exist, 1 if the index
+/// cannot be used and the directory must be scanned linearly.
+static int ext2_htree_find(ext2_filesystem_t *fs, ext2_inode_t *inode, ino_t ino, const char *name, ext2_direntry_search_t *search)
+{
+    ext2_dx_path_t path;
+    uint32_t len = strlen(name), block;
+    int ret = 1;
+    // Allocate the buffers for the index blocks, and the leaf.
+    uint8_t *area = kmalloc(fs->block_size * (EXT2_HTREE_MAX_DEPTH + 1));
+    if (area == NULL) {
+        pr_err("Failed to allocate memory for the directory index.\n");
+        return 1;
+    }
+    for (int level = 0; level < EXT2_HTREE_MAX_DEPTH; ++level) {
+        path.frames[level].buffer = area + (fs->block_size * level);
+    }
+    uint8_t *leaf = area + (fs->block_size * EXT2_HTREE_MAX_DEPTH);
+    if (ext2_htree_probe(fs, inode, name, &path) < 0) {
+        goto free_return;
+    }
+    search->parent_inode = ino;
+    do {
+        // Read the leaf.
+        block = path.frames[path.depth - 1].at->block & EXT2_HTREE_BLOCK_MASK;
+        if (ext2_read_inode_block(fs, inode, block, leaf) == -1) {
+            pr_err("Failed to read the directory block `%d`.\n", block);
+            ret = 1;
+            goto free_return;
+        }
+        // Search the name inside the leaf.
+        ext2_dirent_t *direntry;
+        for (uint32_t offset = 0; offset < fs->block_size; offset += direntry->rec_len) {
+            direntry = (ext2_dirent_t *)(leaf + offset);
+            if ((direntry->rec_len < sizeof(ext2_dirent_t)) || ((offset + direntry->rec_len) > fs->block_size)) {
+                pr_err("Corrupted directory block `%d`.\n", block);
+                ret = 1;
+                goto free_return;
+            }
+            if (direntry->inode && (direntry->name_len == len) && !strncmp(direntry->name, name, len)) {
+                ext2_fill_direntry_search(search, ino, direntry, block, offset);
+                ret = 0;
+                goto free_return;
+            }
+        }
+    } while ((ret = ext2_htree_next_leaf(fs, inode, &path)) > 0);
+    // We did not find it, unless the index is broken.
+    ret = (ret < 0) ? 1 : -1;
+free_return:
+    kfree(area);
     return ret;
 }
 
-// ============================================================================
-// Directory Entry Iteration Functions
-// ============================================================================
-
-/// @brief Iterator for visiting the directory entries.
-typedef struct ext2_direntry_iterator_t {
-    ext2_filesystem_t *fs;   ///< A pointer to the filesystem.
-    uint8_t *cache;          ///< Cache used for reading.
-    ext2_inode_t *inode;     ///< A pointer to the directory inode.
-    uint32_t block_index;    ///< The current block we are reading.
-    uint32_t total_offset;   ///< The total amount of bytes we have read.
-    uint32_t block_offset;   ///< The total amount of bytes we have read inside the current block.
-    ext2_dirent_t *direntry; ///< Pointer to the directory entry.
-} ext2_direntry_iterator_t;
+/// @brief Entry of a leaf, with its hash, used to split the leaf.
+typedef struct ext2_dx_map_entry_t {
+    /// The hash of the name.
+    uint32_t hash;
+    /// The offset of the entry inside the leaf.
+    uint32_t offset;
+} ext2_dx_map_entry_t;
 
-/// @brief Returns the ext2_dirent_t pointed by the iterator.
-/// @param iterator the iterator.
-/// @return pointer to the ext2_dirent_t
-ext2_dirent_t *ext2_direntry_iterator_get(ext2_direntry_iterator_t *iterator)
+/// @brief Fills the block with the given entries, packed one after the other.
+/// @param fs the filesystem.
+/// @param dst the destination block.
+/// @param src the block containing the entries.
+/// @param map the entries.
+/// @param count the number of entries.
+static void ext2_dx_fill_leaf(ext2_filesystem_t *fs, uint8_t *dst, uint8_t *src, ext2_dx_map_entry_t *map, uint32_t count)
 {
-    return (ext2_dirent_t *)((uintptr_t)iterator->cache + iterator->block_offset);
+    ext2_dirent_t *direntry = NULL;
+    uint32_t offset = 0, rec_len;
+    memset(dst, 0, fs->block_size);
+    for (uint32_t i = 0; i < count; ++i) {
+        rec_len = ext2_get_rec_len_from_direntry((ext2_dirent_t *)(src + map[i].offset));
+        memcpy(dst + offset, src + map[i].offset, rec_len);
+        direntry          = (ext2_dirent_t *)(dst + offset);
+        direntry->rec_len = rec_len;
+        offset += rec_len;
+    }
+    // The last entry takes the rest of the block.
+    if (direntry) {
+        direntry->rec_len += fs->block_size - offset;
+    } else {
+        ((ext2_dirent_t *)dst)->rec_len = fs->block_size;
+    }
 }
 
-/// @brief Check if the iterator is valid.
-/// @param iterator the iterator to check.
-/// @return 1 if valid, 0 otherwise.
-int ext2_direntry_iterator_valid(ext2_direntry_iterator_t *iterator)
+/// @brief Appends a new block to the directory.
+/// @param fs the filesystem.
+/// @param inode the directory inode.
+/// @param ino the index of the directory inode.
+/// @return the index of the block inside the directory, -1 on failure.
+static int ext2_htree_append_block(ext2_filesystem_t *fs, ext2_inode_t *inode, ino_t ino)
 {
-    return iterator->direntry != NULL;
+    uint32_t block = inode->size / fs->block_size;
+    if (ext2_allocate_inode_block(fs, inode, ino, block) == -1) {
+        pr_err("Failed to allocate a new block for the directory.\n");
+        return -1;
+    }
+    inode->size += fs->block_size;
+    if (ext2_write_inode(fs, inode, ino) == -1) {
+        pr_err("Failed to update the inode of the directory.\n");
+        return -1;
+    }
+    return block;
 }
 
-/// @brief Initializes the iterator and reads the first block.
-/// @param fs pointer to the filesystem.
-/// @param cache used for reading.
-/// @param inode pointer to the directory inode.
-/// @return The initialized directory iterator.
-ext2_direntry_iterator_t ext2_direntry_iterator_begin(ext2_filesystem_t *fs, uint8_t *cache, ext2_inode_t *inode)
+/// @brief Inserts a new entry in the index block, right after the followed one.
+/// @param frame the index block.
+/// @param hash the hash of the new entry.
+/// @param block the block the new entry points to.
+static inline void ext2_dx_insert_entry(ext2_dx_frame_t *frame, uint32_t hash, uint32_t block)
 {
-    ext2_direntry_iterator_t it = {
-        .fs           = fs,
-        .cache        = cache,
-        .inode        = inode,
-        .block_index  = 0,
-        .total_offset = 0,
-        .block_offset = 0,
-        .direntry     = NULL
-    };
-    // Start by reading the first block of the inode.
-    if (ext2_read_inode_block(fs, inode, it.block_index, cache) == -1) {
-        pr_err("Failed to read the inode block `%d`\n", it.block_index);
-    } else {
-        // Initialize the directory entry.
-        it.direntry = ext2_direntry_iterator_get(&it);
-    }
-    return it;
+    ext2_dx_countlimit_t *countlimit = ext2_dx_countlimit(frame->entries);
+    ext2_dx_entry_t *next            = frame->at + 1;
+    memmove(next + 1, next, (frame->entries + countlimit->count - next) * sizeof(ext2_dx_entry_t));
+    next->hash  = hash;
+    next->block = block;
+    countlimit->count += 1;
 }
 
-/// @brief Moves to the next direntry, and moves to the next block if necessary.
-/// @param iterator the iterator.
-void ext2_direntry_iterator_next(ext2_direntry_iterator_t *iterator)
+/// @brief Makes room in the index block pointing to the leaves, either by
+/// adding a level below the root or by splitting an index node.
+/// @param fs the filesystem.
+/// @param inode the directory inode.
+/// @param ino the index of the directory inode.
+/// @param path the path to the leaf.
+/// @param scratch support buffer.
+/// @return 0 on success, -1 if the tree cannot grow anymore.
+static int ext2_htree_grow(ext2_filesystem_t *fs, ext2_inode_t *inode, ino_t ino, ext2_dx_path_t *path, uint8_t *scratch)
 {
-    // Get the current rec_len.
-    uint32_t rec_len = ext2_direntry_iterator_get(iterator)->rec_len;
-    // Advance the offsets.
-    iterator->block_offset += rec_len;
-    iterator->total_offset += rec_len;
-    // If we reached the end of the inode, stop.
-    if (iterator->total_offset >= iterator->inode->size) {
-        // The iterator is not valid anymore.
-        iterator->direntry = NULL;
-        return;
-    }
-    // If we exceed the size of a block, move to the next block.
-    if (iterator->block_offset >= iterator->fs->block_size) {
-        // Increase the block index.
-        iterator->block_index += 1;
-        // Remove the exceeding size, so that we start correctly in the new block.
-        iterator->block_offset -= iterator->fs->block_size;
-        // Read the new block.
-        if (ext2_read_inode_block(iterator->fs, iterator->inode, iterator->block_index, iterator->cache) == -1) {
-            pr_err("Failed to read the inode block `%d`\n", iterator->block_index);
-            // The iterator is not valid anymore.
-            iterator->direntry = NULL;
-            return;
+    ext2_dx_frame_t *root = &path->frames[0], *node = &path->frames[path->depth - 1];
+    int block;
+    if (path->depth == 1) {
+        // Move the entries of the root inside a new node, the only child of
+        // the root.
+        if ((block = ext2_htree_append_block(fs, inode, ino)) < 0) {
+            return -1;
+        }
+        ext2_dx_entry_t *entries = ext2_dx_node_init(fs, scratch);
+        uint16_t count           = ext2_dx_countlimit(root->entries)->count;
+        memcpy(entries + 1, root->entries + 1, (count - 1) * sizeof(ext2_dx_entry_t));
+        entries[0].block                     = root->entries[0].block;
+        ext2_dx_countlimit(entries)->count   = count;
+        ext2_dx_countlimit(root->entries)->count = 1;
+        root->entries[0].block               = block;
+        ((ext2_dx_root_info_t *)(root->buffer + EXT2_HTREE_ROOT_INFO_OFFSET))->indirect_levels = 1;
+        if (ext2_write_inode_block(fs, inode, ino, block, scratch) == -1) {
+            return -1;
         }
+        return (ext2_write_inode_block(fs, inode, ino, root->block, root->buffer) == -1) ? -1 : 0;
     }
-    // Read the direntry.
-    iterator->direntry = ext2_direntry_iterator_get(iterator);
+    // Split the index node in two, if the root has room for the new one.
+    if (ext2_dx_countlimit(root->entries)->count >= ext2_dx_countlimit(root->entries)->limit) {
+        pr_warning("The directory index is full.\n");
+        return -1;
+    }
+    if ((block = ext2_htree_append_block(fs, inode, ino)) < 0) {
+        return -1;
+    }
+    uint16_t count           = ext2_dx_countlimit(node->entries)->count, split = count / 2;
+    uint32_t hash            = node->entries[split].hash;
+    ext2_dx_entry_t *entries = ext2_dx_node_init(fs, scratch);
+    memcpy(entries + 1, node->entries + split + 1, (count - split - 1) * sizeof(ext2_dx_entry_t));
+    entries[0].block                        = node->entries[split].block;
+    ext2_dx_countlimit(entries)->count      = count - split;
+    ext2_dx_countlimit(node->entries)->count = split;
+    ext2_dx_insert_entry(root, hash, block);
+    if ((ext2_write_inode_block(fs, inode, ino, block, scratch) == -1) ||
+        (ext2_write_inode_block(fs, inode, ino, node->block, node->buffer) == -1)) {
+        return -1;
+    }
+    return (ext2_write_inode_block(fs, inode, ino, root->block, root->buffer) == -1) ? -1 : 0;
 }
 
-static inline int ext2_directory_is_empty(ext2_filesystem_t *fs, uint8_t *cache, ext2_inode_t *inode)
+/// @brief Splits the leaf in two, moving the entries with the highest hashes
+/// to a new block.
+/// @param fs the filesystem.
+/// @param inode the directory inode.
+/// @param ino the index of the directory inode.
+/// @param path the path to the leaf, the last index block must have room.
+/// @param leaf the content of the leaf.
+/// @param scratch support buffer.
+/// @return 0 on success, -1 on failure.
+static int ext2_htree_split_leaf(ext2_filesystem_t *fs, ext2_inode_t *inode, ino_t ino, ext2_dx_path_t *path, uint8_t *leaf, uint8_t *scratch)
 {
-    ext2_direntry_iterator_t it = ext2_direntry_iterator_begin(fs, cache, inode);
-    for (; ext2_direntry_iterator_valid(&it); ext2_direntry_iterator_next(&it)) {
-        if (it.direntry->inode != 0) {
-            return 0;
+    ext2_dx_frame_t *frame = &path->frames[path->depth - 1];
+    uint32_t leaf_block = frame->at->block & EXT2_HTREE_BLOCK_MASK, count = 0, offset, split, hash;
+    ext2_dirent_t *direntry;
+    int block, ret = -1;
+    // Collect the entries of the leaf, with their hashes.
+    ext2_dx_map_entry_t *map = kmalloc((fs->block_size / sizeof(ext2_dirent_t)) * sizeof(ext2_dx_map_entry_t));
+    if (map == NULL) {
+        pr_err("Failed to allocate memory to split the directory block.\n");
+        return -1;
+    }
+    for (offset = 0; offset < fs->block_size; offset += direntry->rec_len) {
+        direntry = (ext2_dirent_t *)(leaf + offset);
+        if ((direntry->rec_len < sizeof(ext2_dirent_t)) || ((offset + direntry->rec_len) > fs->block_size)) {
+            pr_err("Corrupted directory block `%d`.\n", leaf_block);
+            goto free_return;
+        }
+        if (direntry->inode) {
+            ext2_htree_hash(fs, path->hash_version, direntry->name, direntry->name_len, &hash);
+            // Keep the entries sorted by hash.
+            uint32_t i = count++;
+            for (; (i > 0) && (map[i - 1].hash > hash); --i) {
+                map[i] = map[i - 1];
+            }
+            map[i].hash   = hash;
+            map[i].offset = offset;
         }
     }
-    return 1;
+    if (count < 2) {
+        goto free_return;
+    }
+    // If the split falls inside a sequence of equal hashes, mark the new block
+    // as its continuation.
+    split = count / 2;
+    hash  = map[split].hash;
+    if (hash == map[split - 1].hash) {
+        hash |= 1U;
+    }
+    if ((block = ext2_htree_append_block(fs, inode, ino)) < 0) {
+        goto free_return;
+    }
+    // Write the entries with the highest hashes to the new block.
+    ext2_dx_fill_leaf(fs, scratch, leaf, map + split, count - split);
+    if (ext2_write_inode_block(fs, inode, ino, block, scratch) == -1) {
+        goto free_return;
+    }
+    // Pack the remaining ones inside the old block.
+    memcpy(scratch, leaf, fs->block_size);
+    ext2_dx_fill_leaf(fs, leaf, scratch, map, split);
+    if (ext2_write_inode_block(fs, inode, ino, leaf_block, leaf) == -1) {
+        goto free_return;
+    }
+    // Point to the new block from the index.
+    ext2_dx_insert_entry(frame, hash, block);
+    if (ext2_write_inode_block(fs, inode, ino, frame->block, frame->buffer) == -1) {
+        goto free_return;
+    }
+    ret = 0;
+free_return:
+    kfree(map);
+    return ret;
 }
 
-static int ext2_clean_inode_content(ext2_filesystem_t *fs, ext2_inode_t *inode, uint32_t inode_index)
+/// @brief Adds the entry to the directory, using its index.
+/// @param fs the filesystem.
+/// @param inode the directory inode.
+/// @param ino the index of the directory inode.
+/// @param inode_index the inode the new entry points to.
+/// @param name the name of the new entry.
+/// @param file_type the type of the new entry.
+/// @return 0 on success, -1 if the index cannot be used.
+static int ext2_htree_add(ext2_filesystem_t *fs, ext2_inode_t *inode, ino_t ino, uint32_t inode_index, const char *name, uint8_t file_type)
 {
-    // Check the type of operation.
-    if ((inode->mode & EXT2_S_IFREG) != EXT2_S_IFREG) {
-        pr_alert("Trying to clean the content of a non-regular file.\n");
-        return 1;
+    ext2_dx_path_t path;
+    uint32_t block;
+    int ret = -1;
+    // Allocate the buffers for the index blocks, the leaf, and a spare one.
+    uint8_t *area = kmalloc(fs->block_size * (EXT2_HTREE_MAX_DEPTH + 2));
+    if (area == NULL) {
+        pr_err("Failed to allocate memory for the directory index.\n");
+        return -1;
     }
-    // Allocate the cache.
-    uint8_t *cache = kmem_cache_alloc(fs->ext2_buffer_cache, GFP_KERNEL);
-    // Get the cache size.
-    size_t cache_size = fs->ext2_buffer_cache->size;
-    // Clean the cache.
-    memset(cache, 0, cache_size);
-    //
-    int ret = 0;
-    for (ssize_t offset = 0, to_write; offset < inode->size;) {
-        // We do not want to extend the size of the inode.
-        to_write = max(min(offset + cache_size, inode->size), 0);
-        // Override the content.
-        ssize_t written = ext2_write_inode_data(fs, inode, inode_index, offset, to_write, (char *)cache);
-        if (written < 0) {
-            pr_err("Failed to clean content of inode %d\n", inode_index);
-            ret = -1;
+    for (int level = 0; level < EXT2_HTREE_MAX_DEPTH; ++level) {
+        path.frames[level].buffer = area + (fs->block_size * level);
+    }
+    uint8_t *leaf    = area + (fs->block_size * EXT2_HTREE_MAX_DEPTH);
+    uint8_t *scratch = leaf + fs->block_size;
+    // At worst, we add a level to the tree, then split the leaf, then insert.
+    for (int attempt = 0; attempt < 3; ++attempt) {
+        if (ext2_htree_probe(fs, inode, name, &path) < 0) {
+            break;
+        }
+        block = path.frames[path.depth - 1].at->block & EXT2_HTREE_BLOCK_MASK;
+        if (ext2_read_inode_block(fs, inode, block, leaf) == -1) {
+            pr_err("Failed to read the directory block `%d`.\n", block);
+            break;
+        }
+        // Add the entry to the leaf, if there is room.
+        if (ext2_dirent_block_insert(fs, leaf, inode_index, name, file_type) == 0) {
+            ret = (ext2_write_inode_block(fs, inode, ino, block, leaf) == -1) ? -1 : 0;
+            break;
+        }
+        // Otherwise split the leaf, after making room for it in the index.
+        ext2_dx_frame_t *frame = &path.frames[path.depth - 1];
+        if (ext2_dx_countlimit(frame->entries)->count >= ext2_dx_countlimit(frame->entries)->limit) {
+            if (ext2_htree_grow(fs, inode, ino, &path, scratch) < 0) {
+                break;
+            }
+        } else if (ext2_htree_split_leaf(fs, inode, ino, &path, leaf, scratch) < 0) {
             break;
         }
-        offset += written;
     }
-    // Free the cache.
-    kmem_cache_free(cache);
+    kfree(area);
     return ret;
 }
 
-// ============================================================================
-// Directory Entry Management Functions
-// ============================================================================
-
-static inline uint32_t ext2_get_rec_len_from_name(const char *name)
+/// @brief Turns a directory made of a single full block into an indexed one.
+/// @param fs the filesystem.
+/// @param inode the directory inode.
+/// @param ino the index of the directory inode.
+/// @return 0 on success, -1 on failure.
+/// @details The entries are moved to a new block, the only leaf of the tree,
+/// while the first block becomes the root of the index.
+static int ext2_htree_create(ext2_filesystem_t *fs, ext2_inode_t *inode, ino_t ino)
 {
-    unsigned int rec_len = sizeof(ext2_dirent_t) + strlen(name) - EXT2_NAME_LEN;
-    rec_len += (rec_len % 4) ? (4 - (rec_len % 4)) : 0;
-    return rec_len;
+    uint32_t offset, count = 0, hash;
+    ext2_dirent_t *dot, *dotdot, *direntry;
+    int block, ret = -1;
+    // Check that the filesystem wants indexed directories.
+    if (!(fs->superblock.feature_compat & EXT2_FEATURE_COMPAT_DIR_INDEX) ||
+        (ext2_htree_hash(fs, fs->superblock.def_hash_version, ".", 1, &hash) < 0) ||
+        (inode->size != fs->block_size)) {
+        return -1;
+    }
+    uint8_t *root = kmalloc(fs->block_size * 2);
+    if (root == NULL) {
+        pr_err("Failed to allocate memory for the directory index.\n");
+        return -1;
+    }
+    uint8_t *leaf = root + fs->block_size;
+    if (ext2_read_inode_block(fs, inode, 0, root) == -1) {
+        goto free_return;
+    }
+    // The block must start with `.` and `..`.
+    dot    = (ext2_dirent_t *)root;
+    dotdot = (ext2_dirent_t *)(root + dot->rec_len);
+    if ((dot->rec_len >= fs->block_size) || (dot->name_len != 1) || (dot->name[0] != '.') ||
+        (dotdot->name_len != 2) || strncmp(dotdot->name, "..", 2)) {
+        goto free_return;
+    }
+    // Prepare the leaf, with all the other entries.
+    uint32_t dotdot_inode = dotdot->inode;
+    ext2_dx_map_entry_t *map = kmalloc((fs->block_size / sizeof(ext2_dirent_t)) * sizeof(ext2_dx_map_entry_t));
+    if (map == NULL) {
+        goto free_return;
+    }
+    for (offset = dot->rec_len + dotdot->rec_len; offset < fs->block_size; offset += direntry->rec_len) {
+        direntry = (ext2_dirent_t *)(root + offset);
+        if ((direntry->rec_len < sizeof(ext2_dirent_t)) || ((offset + direntry->rec_len) > fs->block_size)) {
+            break;
+        }
+        if (direntry->inode) {
+            map[count++].offset = offset;
+        }
+    }
+    ext2_dx_fill_leaf(fs, leaf, root, map, count);
+    kfree(map);
+    if ((block = ext2_htree_append_block(fs, inode, ino)) < 0) {
+        goto free_return;
+    }
+    if (ext2_write_inode_block(fs, inode, ino, block, leaf) == -1) {
+        goto free_return;
+    }
+    // Turn the first block into the root of the index.
+    memset(root, 0, fs->block_size);
+    dot            = (ext2_dirent_t *)root;
+    dot->inode     = ino;
+    dot->rec_len   = 12;
+    dot->name_len  = 1;
+    dot->file_type = ext2_file_type_directory;
+    dot->name[0]   = '.';
+    dotdot            = (ext2_dirent_t *)(root + 12);
+    dotdot->inode     = dotdot_inode;
+    dotdot->rec_len   = fs->block_size - 12;
+    dotdot->name_len  = 2;
+    dotdot->file_type = ext2_file_type_directory;
+    dotdot->name[0]   = '.';
+    dotdot->name[1]   = '.';
+    ext2_dx_root_info_t *info = (ext2_dx_root_info_t *)(root + EXT2_HTREE_ROOT_INFO_OFFSET);
+    info->hash_version        = fs->superblock.def_hash_version;
+    info->info_length         = sizeof(ext2_dx_root_info_t);
+    ext2_dx_entry_t *entries  = (ext2_dx_entry_t *)(info + 1);
+    ext2_dx_countlimit(entries)->limit = ext2_dx_root_limit(fs);
+    ext2_dx_countlimit(entries)->count = 1;
+    entries[0].block                   = block;
+    if (ext2_write_inode_block(fs, inode, ino, 0, root) == -1) {
+        goto free_return;
+    }
+    // Mark the directory as indexed.
+    inode->flags |= EXT2_INDEX_FL;
+    if (ext2_write_inode(fs, inode, ino) == -1) {
+        goto free_return;
+    }
+    ret = 0;
+free_return:
+    kfree(root);
+    return ret;
 }
 
-static inline uint32_t ext2_get_rec_len_from_direntry(const ext2_dirent_t *direntry)
+/// @brief Updates the modification time of a directory whose entries changed.
+/// @param fs the filesystem.
+/// @param ino the index of the directory inode.
+/// @return 0 on success, -1 on failure.
+static int ext2_touch_directory(ext2_filesystem_t *fs, uint32_t ino)
 {
-    unsigned int rec_len = sizeof(ext2_dirent_t) + direntry->name_len - EXT2_NAME_LEN;
-    rec_len += (rec_len % 4) ? (4 - (rec_len % 4)) : 0;
-    return rec_len;
+    ext2_inode_t inode;
+    if (ext2_read_inode(fs, &inode, ino) == -1) {
+        pr_err("Failed to read the directory inode (%d).\n", ino);
+        return -1;
+    }
+    inode.mtime = inode.ctime = sys_time(NULL);
+    return ext2_write_inode(fs, &inode, ino);
 }
 
 static int ext2_allocate_direntry(
@@ -1878,6 +4200,22 @@ static int ext2_allocate_direntry(
         return -1;
     }
     pr_debug("ext2_allocate_direntry(parent: %d, name: \"%s\", inode: %d)\n", parent_inode_index, name, inode_index);
+    // Use the index, if the directory has one.
+    if (bitmask_check(parent_inode.flags, EXT2_INDEX_FL)) {
+        if (ext2_htree_add(fs, &parent_inode, parent_inode_index, inode_index, name, file_type) == 0) {
+            dcache_add(fs, parent_inode_index, name, inode_index, file_type);
+            ext2_touch_directory(fs, parent_inode_index);
+            return 0;
+        }
+        // Drop the index we cannot update, the directory stays readable as a
+        // list of entries.
+        pr_warning("Dropping the index of directory `%d`.\n", parent_inode_index);
+        parent_inode.flags &= ~EXT2_INDEX_FL;
+        if (ext2_write_inode(fs, &parent_inode, parent_inode_index) == -1) {
+            pr_err("Failed to update the parent inode (%d).\n", parent_inode_index);
+            return -1;
+        }
+    }
     // Compute the rec_len for the name of the new direntry. Remember, the name
     // is not actually 256 chars long as specified in EXT2_NAME_LEN, that is
     // just a maximum.
@@ -1930,6 +4268,15 @@ static int ext2_allocate_direntry(
         goto free_cache_return_success;
 
     } else if ((it.block_offset + rec_len) >= fs->block_size) {
+        // A directory outgrowing its first block gets indexed, if the
+        // filesystem supports it.
+        if ((it.block_index == 0) && (ext2_htree_create(fs, &parent_inode, parent_inode_index) == 0)) {
+            if (ext2_htree_add(fs, &parent_inode, parent_inode_index, inode_index, name, file_type) == -1) {
+                pr_err("Failed to add `%s` to the new directory index.\n", name);
+                goto free_cache_return_error;
+            }
+            goto free_cache_return_success;
+        }
         it.block_index += 1;
         if (ext2_allocate_inode_block(fs, &parent_inode, parent_inode_index, it.block_index) == -1) {
             pr_err("Failed to allocate a new block for an inode.\n");
@@ -1954,6 +4301,9 @@ static int ext2_allocate_direntry(
     }
 
 free_cache_return_success:
+    // The name now exists, replace any negative entry.
+    dcache_add(fs, parent_inode_index, name, inode_index, file_type);
+    ext2_touch_directory(fs, parent_inode_index);
     // Free the cache.
     kmem_cache_free(cache);
     return 0;
@@ -1964,6 +4314,60 @@ free_cache_return_error:
     return -1;
 }
 
+/// @brief Scans the blocks of the directory, searching for the entry.
+/// @param fs the filesystem.
+/// @param inode the inode of the directory.
+/// @param ino the index of the directory inode.
+/// @param name the name of the entry we are looking for.
+/// @param search the output variable where we save the info about the entry.
+/// @return 0 on success, -1 on failure.
+static int ext2_scan_directory(ext2_filesystem_t *fs, ext2_inode_t *inode, ino_t ino, const char *name, ext2_direntry_search_t *search)
+{
+    // Use the index, if the directory has one.
+    if (bitmask_check(inode->flags, EXT2_INDEX_FL) && strcmp(name, "/")) {
+        int ret = ext2_htree_find(fs, inode, ino, name, search);
+        if (ret <= 0) {
+            return ret;
+        }
+        pr_warning("Falling back to a linear scan of directory `%d`.\n", ino);
+    }
+    // Allocate the cache.
+    uint8_t *cache = kmem_cache_alloc(fs->ext2_buffer_cache, GFP_KERNEL);
+    // Clean the cache.
+    memset(cache, 0, fs->ext2_buffer_cache->size);
+    ext2_direntry_iterator_t it = ext2_direntry_iterator_begin(fs, cache, inode);
+    for (; ext2_direntry_iterator_valid(&it); ext2_direntry_iterator_next(&it)) {
+        // Skip unused inode.
+        if (it.direntry->inode == 0) {
+            continue;
+        }
+        // Chehck the name.
+        if (!strncmp(it.direntry->name, ".", 1) && !strncmp(name, "/", 1)) {
+            break;
+        }
+        // Check if the entry has the same name.
+        if (strlen(name) == it.direntry->name_len) {
+            if (!strncmp(it.direntry->name, name, it.direntry->name_len)) {
+                break;
+            }
+        }
+    }
+    // Copy the inode of the parent, even if we did not find the entry.
+    search->parent_inode = ino;
+    // Check if we have found the entry.
+    if (it.direntry == NULL)
+        goto free_cache_return_error;
+    // Copy the direntry, with its position.
+    ext2_fill_direntry_search(search, ino, it.direntry, it.block_index, it.block_offset);
+    // Free the cache.
+    kmem_cache_free(cache);
+    return 0;
+free_cache_return_error:
+    // Free the cache.
+    kmem_cache_free(cache);
+    return -1;
+}
+
 /// @brief Finds the entry with the given `name` inside the `directory`.
 /// @param directory the directory in which we perform the search.
 /// @param name the name of the entry we are looking for.
@@ -2001,50 +4405,31 @@ static int ext2_find_direntry(ext2_filesystem_t *fs, ino_t ino, const char *name
         return -EPERM;
     }
 
-    // Allocate the cache.
-    uint8_t *cache = kmem_cache_alloc(fs->ext2_buffer_cache, GFP_KERNEL);
-    // Clean the cache.
-    memset(cache, 0, fs->ext2_buffer_cache->size);
-    ext2_direntry_iterator_t it = ext2_direntry_iterator_begin(fs, cache, &inode);
-    for (; ext2_direntry_iterator_valid(&it); ext2_direntry_iterator_next(&it)) {
-        // Skip unused inode.
-        if (it.direntry->inode == 0) {
-            continue;
-        }
-        // Chehck the name.
-        if (!strncmp(it.direntry->name, ".", 1) && !strncmp(name, "/", 1)) {
-            break;
-        }
-        // Check if the entry has the same name.
-        if (strlen(name) == it.direntry->name_len) {
-            if (!strncmp(it.direntry->name, name, it.direntry->name_len)) {
-                break;
-            }
+    // Check the dentry cache first.
+    dentry_t *dentry = dcache_lookup(fs, ino, name);
+    if (dentry) {
+        search->parent_inode = ino;
+        // The name is known not to exist.
+        if (dentry->ino == 0) {
+            return -1;
         }
+        search->direntry.inode     = dentry->ino;
+        search->direntry.rec_len   = 0;
+        search->direntry.name_len  = strlen(dentry->name);
+        search->direntry.file_type = dentry->type;
+        strcpy(search->direntry.name, dentry->name);
+        // The position is only known after a scan, see ext2_scan_directory.
+        search->block_index  = 0;
+        search->block_offset = 0;
+        return 0;
     }
-    // Copy the inode of the parent, even if we did not find the entry.
-    search->parent_inode = ino;
-    // Check if we have found the entry.
-    if (it.direntry == NULL)
-        goto free_cache_return_error;
-    // Copy the direntry.
-    search->direntry.inode     = it.direntry->inode;
-    search->direntry.rec_len   = it.direntry->rec_len;
-    search->direntry.name_len  = it.direntry->name_len;
-    search->direntry.file_type = it.direntry->file_type;
-    strncpy(search->direntry.name, it.direntry->name, it.direntry->name_len);
-    search->direntry.name[it.direntry->name_len] = 0;
-    // Copy the index of the block containing the direntry.
-    search->block_index = it.block_index;
-    // Copy the offset of the direntry inside the block.
-    search->block_offset = it.block_offset;
-    // Free the cache.
-    kmem_cache_free(cache);
+    // Scan the directory, and remember the outcome, even a negative one.
+    if (ext2_scan_directory(fs, &inode, ino, name, search) < 0) {
+        dcache_add(fs, ino, name, 0, ext2_file_type_unknown);
+        return -1;
+    }
+    dcache_add(fs, ino, name, search->direntry.inode, search->direntry.file_type);
     return 0;
-free_cache_return_error:
-    // Free the cache.
-    kmem_cache_free(cache);
-    return -1;
 }
 
 /// @brief Searches the entry specified in `path` starting from `directory`.
@@ -2184,6 +4569,13 @@ static int ext2_init_vfs_file(
     file->f_pos = 0;
     // Set the number of links.
     file->nlink = inode->links_count;
+    // Reset the read-ahead state.
+    file->ra_next   = 0;
+    file->ra_window = 0;
+    file->advice    = POSIX_FADV_NORMAL;
+    // No directory listing to continue.
+    file->dir_off = 0;
+    file->dir_pos = 0;
     // Initialize the list of siblings.
     list_head_init(&file->siblings);
     // Set the refcount to zero.
@@ -2191,20 +4583,41 @@ static int ext2_init_vfs_file(
     return 0;
 }
 
-static vfs_file_t *ext2_find_vfs_file_with_inode(ext2_filesystem_t *fs, ino_t inode)
+/// @brief Returns the file of an inode, which is shared by all its openers.
+/// @param fs the filesystem.
+/// @param inode the inode.
+/// @param inode_index the index of the inode.
+/// @param name the name of the file.
+/// @param name_len the length of the name.
+/// @return the file, NULL on failure.
+static vfs_file_t *ext2_get_vfs_file(
+    ext2_filesystem_t *fs,
+    ext2_inode_t *inode,
+    uint32_t inode_index,
+    const char *name,
+    size_t name_len)
 {
-    vfs_file_t *file = NULL;
-    if (!list_head_empty(&fs->opened_files)) {
-        list_for_each_decl(it, &fs->opened_files)
-        {
-            // Get the file structure.
-            file = list_entry(it, vfs_file_t, siblings);
-            if (file && (file->ino == inode)) {
-                return file;
-            }
+    vfs_file_t *file = hashmap_get(fs->files, (void *)inode_index);
+    if (file) {
+        // The file is open, share it.
+        if (list_head_empty(&file->siblings)) {
+            return file;
+        }
+        // The file was closed recently, take it back. The inode might have
+        // changed in the meantime, so the file is set again from it.
+        list_head_remove(&file->siblings);
+        --fs->closed_count;
+    } else {
+        // Allocate the memory for the file.
+        file = kmem_cache_alloc(vfs_file_cache, GFP_KERNEL);
+        if (file == NULL) {
+            pr_err("Failed to allocate memory for the EXT2 file.\n");
+            return NULL;
         }
+        hashmap_set(fs->files, (void *)inode_index, file);
     }
-    return NULL;
+    ext2_init_vfs_file(fs, file, inode, inode_index, name, name_len);
+    return file;
 }
 
 // ============================================================================
@@ -2278,6 +4691,10 @@ static int ext2_create_inode(
     inode->osd1 = 0;
     // Set the blocks data.
     memset(&inode->data, 0, sizeof(inode->data));
+    // Regular files map their blocks with extents, when the filesystem can.
+    if (bitmask_exact(mode, EXT2_S_IFREG) && (fs->superblock.feature_incompat & EXT4_FEATURE_INCOMPAT_EXTENTS)) {
+        ext2_extent_tree_init(inode);
+    }
     // Set the value used to indicate the file version (used by NFS).
     inode->generation = 0;
     // TODO: The value indicating the block number containing the extended attributes.
@@ -2333,20 +4750,9 @@ static vfs_file_t *ext2_creat(const char *path, mode_t mode)
             pr_err("Failed to read the inode of `%s`.\n", search.direntry.name);
             goto close_parent_return_null;
         }
-        vfs_file_t *file = ext2_find_vfs_file_with_inode(fs, search.direntry.inode);
+        vfs_file_t *file = ext2_get_vfs_file(fs, &inode, search.direntry.inode, search.direntry.name, search.direntry.name_len);
         if (file == NULL) {
-            // Allocate the memory for the file.
-            file = kmem_cache_alloc(vfs_file_cache, GFP_KERNEL);
-            if (file == NULL) {
-                pr_err("Failed to allocate memory for the EXT2 file.\n");
-                goto close_parent_return_null;
-            }
-            if (ext2_init_vfs_file(fs, file, &inode, search.direntry.inode, search.direntry.name, search.direntry.name_len) == -1) {
-                pr_err("Failed to properly set the VFS file.\n");
-                goto close_parent_return_null;
-            }
-            // Add the vfs_file to the list of associated files.
-            list_head_insert_before(&file->siblings, &fs->opened_files);
+            goto close_parent_return_null;
         }
         return file;
     }
@@ -2366,25 +4772,14 @@ static vfs_file_t *ext2_creat(const char *path, mode_t mode)
         goto close_parent_return_null;
     }
 
-    // Clean the content of the newly created file.
-    if (ext2_clean_inode_content(fs, &inode, inode_index) < 0) {
-        pr_err("Failed to clean the content of the newly created inode.\n");
-        goto close_parent_return_null;
-    }
-
     // Initialize the file.
     if (ext2_allocate_direntry(fs, parent->ino, inode_index, file_name, ext2_file_type_regular_file) == -1) {
         pr_err("Failed to allocate a new direntry for the inode.\n");
         goto close_parent_return_null;
     }
-    // Allocate the memory for the file.
-    vfs_file_t *new_file = kmem_cache_alloc(vfs_file_cache, GFP_KERNEL);
+    // Get the file, the inode may belong to a file closed before its removal.
+    vfs_file_t *new_file = ext2_get_vfs_file(fs, &inode, inode_index, file_name, strlen(file_name));
     if (new_file == NULL) {
-        pr_err("Failed to allocate memory for the EXT2 file.\n");
-        goto close_parent_return_null;
-    }
-    if (ext2_init_vfs_file(fs, new_file, &inode, inode_index, file_name, strlen(file_name)) == -1) {
-        pr_err("Failed to properly set the VFS file.\n");
         goto close_parent_return_null;
     }
     return new_file;
@@ -2457,29 +4852,16 @@ static vfs_file_t *ext2_open(const char *path, int flags, mode_t mode)
 
     // Check if the file is a regular file, and the user wants to write and truncate.
     if (bitmask_exact(inode.mode, EXT2_S_IFREG) && (bitmask_exact(flags, O_RDWR | O_TRUNC) || bitmask_exact(flags, O_RDONLY | O_TRUNC))) {
-        // Clean the content of the newly created file.
-        if (ext2_clean_inode_content(fs, &inode, search.direntry.inode) < 0) {
-            pr_err("Failed to clean the content of the newly created inode.\n");
+        // Drop the content of the file, freeing its blocks.
+        int ret = ext2_truncate_inode(fs, &inode, search.direntry.inode, 0);
+        if (ret < 0) {
+            pr_err("Failed to truncate the inode of `%s`.\n", search.direntry.name);
+            errno = -ret;
             return NULL;
         }
     }
 
-    vfs_file_t *file = ext2_find_vfs_file_with_inode(fs, search.direntry.inode);
-    if (file == NULL) {
-        // Allocate the memory for the file.
-        file = kmem_cache_alloc(vfs_file_cache, GFP_KERNEL);
-        if (file == NULL) {
-            pr_err("Failed to allocate memory for the EXT2 file.\n");
-            return NULL;
-        }
-        if (ext2_init_vfs_file(fs, file, &inode, search.direntry.inode, search.direntry.name, search.direntry.name_len) == -1) {
-            pr_err("Failed to properly set the VFS file.\n");
-            return NULL;
-        }
-        // Add the vfs_file to the list of associated files.
-        list_head_insert_before(&file->siblings, &fs->opened_files);
-    }
-    return file;
+    return ext2_get_vfs_file(fs, &inode, search.direntry.inode, search.direntry.name, search.direntry.name_len);
 }
 
 static int ext2_unlink(const char *path)
@@ -2518,6 +4900,14 @@ static int ext2_unlink(const char *path)
         pr_err("ext2_stat(%s): Failed to read the inode of parent of `%s`.\n", path, search.direntry.name);
         return -ENOENT;
     }
+    // The entry may come from the dentry cache, scan the directory to find
+    // where it is stored.
+    char entry_name[EXT2_NAME_LEN + 1];
+    strcpy(entry_name, search.direntry.name);
+    if (ext2_scan_directory(fs, &parent_inode, search.parent_inode, entry_name, &search) < 0) {
+        pr_err("Failed to find `%s` inside its parent directory.\n", entry_name);
+        return -ENOENT;
+    }
     // Allocate the cache and clean it.
     uint8_t *cache = kmem_cache_alloc(fs->ext2_buffer_cache, GFP_KERNEL);
     memset(cache, 0, fs->ext2_buffer_cache->size);
@@ -2542,6 +4932,9 @@ static int ext2_unlink(const char *path)
         pr_err("Failed to write the inode block `%d`\n", search.block_index);
         goto free_cache_return_error;
     }
+    // The name does not exist anymore.
+    dcache_remove(fs, search.parent_inode, entry_name);
+    ext2_touch_directory(fs, search.parent_inode);
     // Read the inode of the direntry we want to unlink.
     ext2_inode_t inode;
     if (ext2_read_inode(fs, &inode, search.direntry.inode) == -1) {
@@ -2583,10 +4976,16 @@ static int ext2_close(vfs_file_t *file)
         return -1;
     }
     pr_debug("ext2_close(ino: %d, file: \"%s\")\n", file->ino, file->name);
-    // Remove the file from the list of opened files.
-    list_head_remove(&file->siblings);
-    // Free the cache.
-    kmem_cache_free(file);
+    // Nobody is going to write to the file, release its reserved blocks.
+    mutex_lock(&fs->lock);
+    ext2_reservation_discard(fs, file->ino);
+    mutex_unlock(&fs->lock);
+    // Keep the file among the recently closed ones, opening it again takes it
+    // back instead of allocating a new one.
+    list_head_insert_before(&file->siblings, &fs->closed_files);
+    if (++fs->closed_count > EXT2_CLOSED_FILES_MAX) {
+        ext2_drop_closed_file(fs, list_entry(fs->closed_files.next, vfs_file_t, siblings));
+    }
     return 0;
 }
 
@@ -2616,7 +5015,14 @@ static ssize_t ext2_read(vfs_file_t *file, char *buffer, off_t offset, size_t nb
         pr_err("Reading a directory `%s` is not allowed.\n", file->name);
         return -EISDIR;
     }
-    return ext2_read_inode_data(fs, &inode, file->ino, offset, nbyte, buffer);
+    // Bring in the blocks we are about to read, and the ones that follow.
+    ext2_read_ahead(fs, file, &inode, offset, nbyte);
+    ssize_t read = ext2_read_inode_data(fs, &inode, file->ino, offset, nbyte, buffer);
+    // Data read only once must not push the rest out of the cache.
+    if ((read > 0) && (file->advice == POSIX_FADV_NOREUSE)) {
+        ext2_cache_range(fs, &inode, offset / fs->block_size, (offset + read - 1) / fs->block_size, 1);
+    }
+    return read;
 }
 
 /// @brief Writes the given content inside the file.
@@ -2746,11 +5152,432 @@ static int ext2_fstat(vfs_file_t *file, stat_t *stat)
     return __ext2_stat(&inode, stat);
 }
 
+/// @brief Retrieves information concerning the file at a path relative to a directory.
+/// @param directory The directory from which the path is resolved.
+/// @param path The relative path.
+/// @param stat The structure where the information are stored.
+/// @param mask The STATX_* fields needed.
+/// @return 0 if success, -errno on failure.
+/// @details The lookup starts from the inode of the directory, and does not
+/// cross the filesystems mounted below it. When only the type and the inode
+/// number are needed, they come from the directory entry, without reading the
+/// inode.
+static int ext2_statat(vfs_file_t *directory, const char *path, stat_t *stat, unsigned int mask)
+{
+    if (!directory || !path || !stat) {
+        pr_err("We received a NULL pointer.\n");
+        return -EFAULT;
+    }
+    // Get the filesystem.
+    ext2_filesystem_t *fs = (ext2_filesystem_t *)directory->device;
+    if (fs == NULL) {
+        pr_err("The file does not belong to an EXT2 filesystem `%s`.\n", directory->name);
+        return -EPERM;
+    }
+    // The resolution splits the path in place.
+    char relative_path[PATH_MAX];
+    if (strlen(path) >= PATH_MAX) {
+        return -ENAMETOOLONG;
+    }
+    strcpy(relative_path, path);
+    // Prepare the structure for the search.
+    ext2_direntry_search_t search;
+    memset(&search, 0, sizeof(ext2_direntry_search_t));
+    // Resolve the path.
+    if (ext2_resolve_path(directory, relative_path, &search)) {
+        return -ENOENT;
+    }
+    /// ID of device containing file.
+    stat->st_dev = fs->block_device->ino;
+    // Set the inode.
+    stat->st_ino = search.direntry.inode;
+    // The DT_* types are the type bits of the mode, shifted down.
+    int type = ext2_file_type_to_vfs_file_type(search.direntry.file_type);
+    if (((mask & ~(STATX_TYPE | STATX_INO)) == 0) && (type != DT_UNKNOWN)) {
+        stat->st_mode = type << 12;
+        return 0;
+    }
+    // Get the inode associated with the directory entry.
+    ext2_inode_t inode;
+    if (ext2_read_inode(fs, &inode, search.direntry.inode) == -1) {
+        pr_err("ext2_statat(%s): Failed to read the inode of `%s`.\n", path, search.direntry.name);
+        return -ENOENT;
+    }
+    // Set the rest of the structure.
+    return __ext2_stat(&inode, stat);
+}
+
 static int ext2_ioctl(vfs_file_t *file, int request, void *data)
 {
     return -1;
 }
 
+/// @brief Writes back the modified blocks of the filesystem the file belongs to.
+/// @param file the file.
+/// @return 0 on success, -errno on failure.
+/// @details Buffers are not tracked per inode, so we flush the whole device.
+static int ext2_fsync(vfs_file_t *file)
+{
+    // Get the filesystem.
+    ext2_filesystem_t *fs = (ext2_filesystem_t *)file->device;
+    if (fs == NULL) {
+        pr_err("The file does not belong to an EXT2 filesystem `%s`.\n", file->name);
+        return -ENOENT;
+    }
+    // Write back the inode of the file, if it has been modified.
+    ext2_icache_entry_t *entry = hashmap_get(fs->icache, (void *)file->ino);
+    if (entry && entry->dirty && (ext2_icache_write_back(fs, entry) < 0)) {
+        return -EIO;
+    }
+    // The commit writes back the data first, the metadata then lands in the log.
+    if (fs->journal) {
+        return journal_commit(fs->journal);
+    }
+    return buffer_sync(fs->block_device);
+}
+
+/// @brief Moves a physically contiguous run of blocks between the device and
+/// the buffer, without going through the buffer cache.
+/// @param fs the filesystem.
+/// @param write if the blocks are written, or read.
+/// @param buffer the buffer.
+/// @param block the first block of the run.
+/// @param count the number of blocks of the run.
+/// @return 0 on success, -EIO on failure.
+static int __ext2_direct_run(ext2_filesystem_t *fs, int write, uint8_t *buffer, uint32_t block, uint32_t count)
+{
+    size_t length = count * fs->block_size;
+    ssize_t done;
+    // Cached copies are written back before a read, and discarded before
+    // being overwritten.
+    buffer_drop_range(fs->block_device, block, count, write);
+    if (write) {
+        done = vfs_write(fs->block_device, buffer, block * fs->block_size, length);
+    } else {
+        done = vfs_read(fs->block_device, buffer, block * fs->block_size, length);
+    }
+    return (done == (ssize_t)length) ? 0 : -EIO;
+}
+
+/// @brief Reads or writes the file straight from or to the device.
+/// @param file the file.
+/// @param write if the data is written to the file, or read from it.
+/// @param buffer the buffer, aligned to EXT2_DIRECT_IO_ALIGN.
+/// @param offset the offset, multiple of the block size.
+/// @param nbyte the number of bytes, multiple of the block size.
+/// @return the number of bytes transferred, -errno on failure.
+/// @details The blocks are grouped in physically contiguous runs, each moved
+/// with a single request. Reads stop at the end of the file, but always
+/// transfer whole blocks.
+static ssize_t ext2_direct_io(vfs_file_t *file, int write, void *buffer, off_t offset, size_t nbyte)
+{
+    ext2_filesystem_t *fs = (ext2_filesystem_t *)file->device;
+    if (fs == NULL) {
+        pr_err("The file does not belong to an EXT2 filesystem `%s`.\n", file->name);
+        return -ENOENT;
+    }
+    if ((offset % fs->block_size) || (nbyte % fs->block_size) || ((uintptr_t)buffer % EXT2_DIRECT_IO_ALIGN)) {
+        return -EINVAL;
+    }
+    ext2_inode_t inode;
+    if (ext2_read_inode(fs, &inode, file->ino) == -1) {
+        return -EIO;
+    }
+    if ((inode.mode & EXT2_S_IFMT) != EXT2_S_IFREG) {
+        return -EINVAL;
+    }
+    ssize_t ret = nbyte;
+    if (!write) {
+        if ((uint32_t)offset >= inode.size) {
+            return 0;
+        }
+        ret   = min(nbyte, inode.size - offset);
+        nbyte = round_up(ret, fs->block_size);
+    }
+    if (nbyte == 0) {
+        return 0;
+    }
+    uint32_t start_block = offset / fs->block_size;
+    uint32_t end_block   = start_block + (nbyte / fs->block_size) - 1;
+    if (write && (ext2_allocate_holes(fs, &inode, file->ino, start_block, end_block) < 0)) {
+        return -ENOSPC;
+    }
+    uint8_t *run_buffer = NULL;
+    uint32_t run_start = 0, run_length = 0, real_index;
+    for (uint32_t block_index = start_block; block_index <= end_block; ++block_index) {
+        uint8_t *position = (uint8_t *)buffer + (block_index - start_block) * fs->block_size;
+        real_index        = ext2_get_real_block_index(fs, &inode, block_index);
+        if (run_length && (real_index == (run_start + run_length))) {
+            ++run_length;
+            continue;
+        }
+        if (run_length && __ext2_direct_run(fs, write, run_buffer, run_start, run_length)) {
+            return -EIO;
+        }
+        // Holes read as zeros.
+        if (real_index == 0) {
+            memset(position, 0, fs->block_size);
+        }
+        run_buffer = position;
+        run_start  = real_index;
+        run_length = (real_index != 0);
+    }
+    if (run_length && __ext2_direct_run(fs, write, run_buffer, run_start, run_length)) {
+        return -EIO;
+    }
+    if (write) {
+        inode.size  = max(inode.size, offset + nbyte);
+        inode.mtime = inode.ctime = sys_time(NULL);
+        if (ext2_write_inode(fs, &inode, file->ino) < 0) {
+            return -EIO;
+        }
+        file->length = inode.size;
+    }
+    return ret;
+}
+
+/// @brief Moves the blocks backing pages of the file between the device and
+/// the page frames.
+/// @param file the file.
+/// @param write if the pages are written to the file, or read from it.
+/// @param pages the page frames.
+/// @param indices the indices of the pages inside the file, increasing.
+/// @param count the number of pages.
+/// @return 0 on success, -errno on failure.
+/// @details The blocks are grouped in runs contiguous both on the device and
+/// in the pages, even across page frames when their indices follow each
+/// other, and each run is moved with as few requests as possible. Reads fill
+/// the holes, and the part past the end of the file, with zeros. Writes
+/// allocate the holes, and stop at the end of the file.
+static int __ext2_page_io(vfs_file_t *file, int write, page_t **pages, const uint32_t *indices, unsigned count)
+{
+    ext2_filesystem_t *fs = (ext2_filesystem_t *)file->device;
+    if (fs == NULL) {
+        pr_err("The file does not belong to an EXT2 filesystem `%s`.\n", file->name);
+        return -ENOENT;
+    }
+    if (fs->block_size > PAGE_SIZE) {
+        return -EOPNOTSUPP;
+    }
+    ext2_inode_t inode;
+    if (ext2_read_inode(fs, &inode, file->ino) == -1) {
+        return -EIO;
+    }
+    if ((inode.mode & EXT2_S_IFMT) != EXT2_S_IFREG) {
+        return -EINVAL;
+    }
+    uint32_t per_page   = PAGE_SIZE / fs->block_size;
+    uint32_t end_block  = round_up(inode.size, fs->block_size) / fs->block_size;
+    uint32_t run_start  = 0, run_length = 0, run_page = 0, run_offset = 0;
+    uint32_t real_index = 0, block_index;
+    for (unsigned it = 0; it < count; ++it) {
+        uint32_t first = indices[it] * per_page;
+        if (write && (first < end_block) &&
+            (ext2_allocate_holes(fs, &inode, file->ino, first, min(first + per_page, end_block) - 1) < 0)) {
+            return -ENOSPC;
+        }
+        for (uint32_t slot = 0; slot < per_page; ++slot) {
+            block_index = first + slot;
+            real_index  = (block_index < end_block) ? ext2_get_real_block_index(fs, &inode, block_index) : 0;
+            // The run goes on in the next page frame only if it is the next page.
+            if (run_length && (real_index == (run_start + run_length)) && (slot || (indices[it] == (indices[it - 1] + 1)))) {
+                ++run_length;
+                continue;
+            }
+            if (run_length) {
+                buffer_drop_range(fs->block_device, run_start, run_length, write);
+                if (bio_transfer_pages(fs->block_device, write, run_start * fs->blocks_per_block_count,
+                                       &pages[run_page], run_offset, run_length * fs->block_size) < 0) {
+                    return -EIO;
+                }
+            }
+            // Holes read as zeros.
+            if ((real_index == 0) && !write) {
+                uint32_t vaddr = virt_kmap(pages[it]);
+                memset((char *)vaddr + slot * fs->block_size, 0, fs->block_size);
+                virt_kunmap(vaddr);
+            }
+            run_start  = real_index;
+            run_length = (real_index != 0);
+            run_page   = it;
+            run_offset = slot * fs->block_size;
+        }
+    }
+    if (run_length) {
+        buffer_drop_range(fs->block_device, run_start, run_length, write);
+        if (bio_transfer_pages(fs->block_device, write, run_start * fs->blocks_per_block_count,
+                               &pages[run_page], run_offset, run_length * fs->block_size) < 0) {
+            return -EIO;
+        }
+    }
+    for (unsigned it = 0; !write && (it < count); ++it) {
+        // The end of the last block might hold stale data past the end of the file.
+        uint32_t start = indices[it] * PAGE_SIZE;
+        if ((inode.size > start) && (inode.size < (start + PAGE_SIZE))) {
+            uint32_t vaddr = virt_kmap(pages[it]);
+            memset((char *)vaddr + (inode.size - start), 0, PAGE_SIZE - (inode.size - start));
+            virt_kunmap(vaddr);
+        }
+    }
+    if (write) {
+        inode.mtime = inode.ctime = sys_time(NULL);
+        if (ext2_write_inode(fs, &inode, file->ino) < 0) {
+            return -EIO;
+        }
+    }
+    return 0;
+}
+
+/// @brief Reads a page of the file into a page frame.
+/// @param file the file.
+/// @param page the page frame.
+/// @param index the index of the page inside the file.
+/// @return 0 on success, -errno on failure.
+static int ext2_readpage(vfs_file_t *file, page_t *page, uint32_t index)
+{
+    return __ext2_page_io(file, 0, &page, &index, 1);
+}
+
+/// @brief Reads pages of the file into page frames.
+/// @param file the file.
+/// @param pages the page frames.
+/// @param indices the indices of the pages inside the file, increasing.
+/// @param count the number of pages.
+/// @return 0 on success, -errno on failure.
+static int ext2_readpages(vfs_file_t *file, page_t **pages, const uint32_t *indices, unsigned count)
+{
+    return __ext2_page_io(file, 0, pages, indices, count);
+}
+
+/// @brief Writes page frames back to the pages of the file.
+/// @param file the file.
+/// @param pages the page frames.
+/// @param indices the indices of the pages inside the file, increasing.
+/// @param count the number of pages.
+/// @return 0 on success, -errno on failure.
+static int ext2_writepages(vfs_file_t *file, page_t **pages, const uint32_t *indices, unsigned count)
+{
+    return __ext2_page_io(file, 1, pages, indices, count);
+}
+
+/// @brief Starts an asynchronous read of the file, queueing the reads of its
+/// blocks on the device.
+/// @param file the file.
+/// @param iocb the request.
+/// @param offset the offset.
+/// @param nbyte the number of bytes.
+/// @return the number of bytes the request reads, -EOPNOTSUPP if it must be
+/// served synchronously, -errno on failure.
+/// @details As with O_DIRECT, the dirty cached copies of the blocks are
+/// written back first, and the blocks are grouped in physically contiguous
+/// runs. The holes are filled with zeros right away.
+static ssize_t ext2_aio_read(vfs_file_t *file, kiocb_t *iocb, off_t offset, size_t nbyte)
+{
+    ext2_filesystem_t *fs = (ext2_filesystem_t *)file->device;
+    if (fs == NULL) {
+        pr_err("The file does not belong to an EXT2 filesystem `%s`.\n", file->name);
+        return -ENOENT;
+    }
+    // Without a queue there is nothing to gain.
+    if (fs->block_device->fs_operations->submit_f == NULL) {
+        return -EOPNOTSUPP;
+    }
+    ext2_inode_t inode;
+    if (ext2_read_inode(fs, &inode, file->ino) == -1) {
+        return -EIO;
+    }
+    if ((inode.mode & EXT2_S_IFMT) != EXT2_S_IFREG) {
+        return -EOPNOTSUPP;
+    }
+    if ((uint32_t)offset >= inode.size) {
+        return 0;
+    }
+    size_t length        = min(nbyte, inode.size - offset);
+    uint32_t start_block = offset / fs->block_size;
+    uint32_t end_block   = (offset + length - 1) / fs->block_size;
+    uint8_t *buffer      = aio_alloc_buffer(iocb, (end_block - start_block + 1) * fs->block_size, offset % fs->block_size);
+    if (buffer == NULL) {
+        return -ENOMEM;
+    }
+    uint8_t *run_buffer = NULL;
+    uint32_t run_start = 0, run_length = 0, real_index;
+    for (uint32_t block_index = start_block; block_index <= end_block + 1; ++block_index) {
+        // The index past the end only closes the last run.
+        real_index = (block_index <= end_block) ? ext2_get_real_block_index(fs, &inode, block_index) : 0;
+        if (run_length && (real_index == (run_start + run_length))) {
+            ++run_length;
+            continue;
+        }
+        if (run_length) {
+            buffer_drop_range(fs->block_device, run_start, run_length, 0);
+            if (aio_submit_sectors(iocb, fs->block_device, run_buffer, run_start * fs->blocks_per_block_count,
+                                   run_length * fs->blocks_per_block_count) < 0) {
+                return -ENOMEM;
+            }
+        }
+        if (block_index > end_block) {
+            break;
+        }
+        run_buffer = buffer + (block_index - start_block) * fs->block_size;
+        // Holes read as zeros.
+        if (real_index == 0) {
+            memset(run_buffer, 0, fs->block_size);
+        }
+        run_start  = real_index;
+        run_length = (real_index != 0);
+    }
+    return length;
+}
+
+/// @brief Acts on an advice about a range of the file.
+/// @param file the file.
+/// @param offset the start of the range.
+/// @param len the length of the range, 0 for up to the end of the file.
+/// @param advice the advice (POSIX_FADV_*).
+/// @return 0 on success, -errno on failure.
+/// @details The blocks needed soon are read ahead, the ones not needed
+/// anymore are written back and dropped from the buffer cache.
+static int ext2_fadvise(vfs_file_t *file, off_t offset, off_t len, int advice)
+{
+    ext2_filesystem_t *fs = (ext2_filesystem_t *)file->device;
+    if (fs == NULL) {
+        pr_err("The file does not belong to an EXT2 filesystem `%s`.\n", file->name);
+        return -ENOENT;
+    }
+    if ((advice != POSIX_FADV_WILLNEED) && (advice != POSIX_FADV_DONTNEED)) {
+        return 0;
+    }
+    ext2_inode_t inode;
+    if (ext2_read_inode(fs, &inode, file->ino) == -1) {
+        return -EIO;
+    }
+    if (((inode.mode & EXT2_S_IFMT) != EXT2_S_IFREG) || ((uint32_t)offset >= inode.size)) {
+        return 0;
+    }
+    uint32_t end = ((len == 0) || ((uint32_t)(offset + len) > inode.size)) ? inode.size : (uint32_t)(offset + len);
+    ext2_cache_range(fs, &inode, offset / fs->block_size, (end - 1) / fs->block_size, advice == POSIX_FADV_DONTNEED);
+    return 0;
+}
+
+/// @brief Writes back the inodes kept in memory by the filesystem, and
+/// commits the running transaction of the journal.
+/// @param root the root of the filesystem.
+/// @return 0 on success, -errno on failure.
+static int ext2_sync_fs(vfs_file_t *root)
+{
+    // Get the filesystem.
+    ext2_filesystem_t *fs = (ext2_filesystem_t *)root->device;
+    if (fs == NULL) {
+        pr_err("The file does not belong to an EXT2 filesystem `%s`.\n", root->name);
+        return -ENOENT;
+    }
+    if (ext2_icache_sync(fs) < 0) {
+        return -EIO;
+    }
+    // Close the running transaction, the flusher writes what is left.
+    return fs->journal ? journal_commit(fs->journal) : 0;
+}
+
 /// @brief Reads contents of the directories to a dirent buffer, updating
 ///        the offset and returning the number of written bytes in the buffer,
 ///        it assumes that all paths are well-formed.
@@ -2780,9 +5607,23 @@ static ssize_t ext2_getdents(vfs_file_t *file, dirent_t *dirp, off_t doff, size_
     uint8_t *cache = kmem_cache_alloc(fs->ext2_buffer_cache, GFP_KERNEL);
     // Clean the cache.
     memset(cache, 0, fs->ext2_buffer_cache->size);
-    // Initialize the iterator.
-    ext2_direntry_iterator_t it = ext2_direntry_iterator_begin(fs, cache, &inode);
-    for (; ext2_direntry_iterator_valid(&it) && (written < count); ext2_direntry_iterator_next(&it)) {
+    // Continue from where the previous call stopped, if the offset follows
+    // it, instead of skipping again all the entries before the offset.
+    ext2_direntry_iterator_t it;
+    if ((doff > 0) && (doff == file->dir_off)) {
+        it      = ext2_direntry_iterator_at(fs, cache, &inode, file->dir_pos);
+        current = doff;
+        // The directory changed under the position, start over.
+        if (ext2_direntry_iterator_valid(&it) &&
+            ((it.direntry->rec_len < 8) || ((it.block_offset + it.direntry->rec_len) > fs->block_size) ||
+             ((it.direntry->name_len + 8U) > it.direntry->rec_len))) {
+            it      = ext2_direntry_iterator_begin(fs, cache, &inode);
+            current = 0;
+        }
+    } else {
+        it = ext2_direntry_iterator_begin(fs, cache, &inode);
+    }
+    for (; ext2_direntry_iterator_valid(&it) && ((written + sizeof(dirent_t)) <= count); ext2_direntry_iterator_next(&it)) {
         // Skip unused inode.
         if (it.direntry->inode == 0) {
             continue;
@@ -2804,6 +5645,9 @@ static ssize_t ext2_getdents(vfs_file_t *file, dirent_t *dirp, off_t doff, size_
         // Move to next writing position.
         ++dirp;
     }
+    // The iterator stopped on the first entry which was not returned.
+    file->dir_off = doff + written;
+    file->dir_pos = ext2_direntry_iterator_valid(&it) ? it.total_offset : inode.size;
     // Free the cache.
     kmem_cache_free(cache);
     return written;
@@ -2962,6 +5806,14 @@ static int ext2_rmdir(const char *path)
         pr_err("ext2_stat(%s): Failed to read the inode of parent of `%s`.\n", path, search.direntry.name);
         return -ENOENT;
     }
+    // The entry may come from the dentry cache, scan the directory to find
+    // where it is stored.
+    char entry_name[EXT2_NAME_LEN + 1];
+    strcpy(entry_name, search.direntry.name);
+    if (ext2_scan_directory(fs, &parent_inode, search.parent_inode, entry_name, &search) < 0) {
+        pr_err("Failed to find `%s` inside its parent directory.\n", entry_name);
+        return -ENOENT;
+    }
 
     // Allocate the cache and clean it.
     uint8_t *cache = kmem_cache_alloc(fs->ext2_buffer_cache, GFP_KERNEL);
@@ -2979,16 +5831,6 @@ static int ext2_rmdir(const char *path)
         kmem_cache_free(cache);
         return -ENOTEMPTY;
     }
-    // Reduce the number of links to the inode.
-    if (inode.links_count > 0) {
-        inode.links_count--;
-        // Update the inode.
-        if (ext2_write_inode(fs, &inode, search.direntry.inode) == -1) {
-            pr_err("Failed to update the inode of `%s`.\n", search.direntry.name);
-            goto free_cache_return_error;
-        }
-    }
-
     // Read the block where the direntry resides.
     if (ext2_read_inode_block(fs, &parent_inode, search.block_index, cache) == -1) {
         pr_err("Failed to read the parent inode block `%d`\n", search.block_index);
@@ -3007,6 +5849,23 @@ static int ext2_rmdir(const char *path)
         pr_err("Failed to write the inode block `%d`\n", search.block_index);
         goto free_cache_return_error;
     }
+    // The name does not exist anymore, neither do the entries inside it.
+    dcache_remove(fs, search.parent_inode, entry_name);
+    dcache_remove_directory(fs, search.direntry.inode);
+    // Its entry and its `.` were the only links, free the directory.
+    fs->block_groups[ext2_inode_index_to_group_index(fs, search.direntry.inode)].used_dirs_count -= 1;
+    ext2_free_inode(fs, &inode, search.direntry.inode);
+    // Its `..` was a link to the parent.
+    if (ext2_read_inode(fs, &parent_inode, search.parent_inode) == -1) {
+        pr_err("Failed to read the inode of the parent of `%s`.\n", entry_name);
+        goto free_cache_return_error;
+    }
+    parent_inode.links_count--;
+    parent_inode.mtime = parent_inode.ctime = sys_time(NULL);
+    if (ext2_write_inode(fs, &parent_inode, search.parent_inode) == -1) {
+        pr_err("Failed to update the inode of the parent of `%s`.\n", entry_name);
+        goto free_cache_return_error;
+    }
 
     // Free the cache.
     kmem_cache_free(cache);
@@ -3098,7 +5957,8 @@ static int __ext2_check_setattr_permission(uid_t file_owner)
 /// @return 0 if success.
 static int ext2_fsetattr(vfs_file_t *file, struct iattr *attr)
 {
-    if (!__ext2_check_setattr_permission(file->uid)) {
+    // The size can be changed by whoever opened the file for writing.
+    if ((attr->ia_valid & ~ATTR_SIZE) && !__ext2_check_setattr_permission(file->uid)) {
         return -EPERM;
     }
     // Get the filesystem.
@@ -3113,7 +5973,12 @@ static int ext2_fsetattr(vfs_file_t *file, struct iattr *attr)
         pr_err("Failed to read the inode `%s`.\n", file->name);
         return -ENOENT;
     }
-
+    if (attr->ia_valid & ATTR_SIZE) {
+        int ret = ext2_truncate_inode(fs, &inode, file->ino, attr->ia_size);
+        if (ret < 0) {
+            return ret;
+        }
+    }
     __ext2_setattr(&inode, attr);
     return ext2_write_inode(fs, &inode, file->ino);
 }
@@ -3153,14 +6018,80 @@ static int ext2_setattr(const char *path, struct iattr *attr)
         return -ENOENT;
     }
 
-    if (!__ext2_check_setattr_permission(inode.uid)) {
+    if ((attr->ia_valid & ~ATTR_SIZE) && !__ext2_check_setattr_permission(inode.uid)) {
         return -EPERM;
     }
-
+    if (attr->ia_valid & ATTR_SIZE) {
+        // The size can be changed by whoever can write the file.
+        if (!vfs_valid_open_permissions(O_WRONLY, inode.mode, inode.uid, inode.gid)) {
+            return -EACCES;
+        }
+        int ret = ext2_truncate_inode(fs, &inode, search.direntry.inode, attr->ia_size);
+        if (ret < 0) {
+            return ret;
+        }
+    }
     __ext2_setattr(&inode, attr);
     return ext2_write_inode(fs, &inode, search.direntry.inode);
 }
 
+/// @brief Loads the journal stored inside the filesystem, and replays the
+/// transactions left by a crash.
+/// @param fs the filesystem, with its superblock and BGDT already read.
+/// @return 0 on success, -1 on failure.
+static int ext2_load_journal(ext2_filesystem_t *fs)
+{
+    ext2_inode_t inode;
+    if (fs->superblock.journal_inum == 0) {
+        pr_err("External journals are not supported.\n");
+        return -1;
+    }
+    if (ext2_read_inode(fs, &inode, fs->superblock.journal_inum) == -1) {
+        pr_err("Failed to read the inode of the journal.\n");
+        return -1;
+    }
+    // Find where each block of the journal is, once.
+    uint32_t length = inode.size / fs->block_size;
+    uint32_t *map   = kmalloc(length * sizeof(uint32_t));
+    if (map == NULL) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < length; ++i) {
+        if ((map[i] = ext2_get_real_block_index(fs, &inode, i)) == 0) {
+            pr_err("The journal has a hole at block %u.\n", i);
+            kfree(map);
+            return -1;
+        }
+    }
+    fs->journal = journal_load(fs->block_device, fs->block_size, map, length);
+    if (fs->journal == NULL) {
+        kfree(map);
+        return -1;
+    }
+    int replayed = journal_recover(fs->journal);
+    if (replayed < 0) {
+        journal_destroy(fs->journal);
+        fs->journal = NULL;
+        return -1;
+    }
+    if (replayed > 0) {
+        pr_notice("Replayed %d transactions of the journal.\n", replayed);
+        // The replay rewrote the metadata we have already read.
+        if ((ext2_read_superblock(fs) == -1) || (ext2_read_bgdt(fs) == -1)) {
+            return -1;
+        }
+        ext2_icache_destroy(fs);
+        fs->icache = hashmap_create(
+            EXT2_ICACHE_BUCKETS,
+            hashmap_int_hash,
+            hashmap_int_comp,
+            hashmap_do_not_duplicate,
+            hashmap_do_not_free);
+        memset(fs->block_map, 0, sizeof(fs->block_map));
+    }
+    return 0;
+}
+
 /// @brief Mounts the block device as an EXT2 filesystem.
 /// @param block_device the block device formatted as EXT2.
 /// @return the VFS root node of the EXT2 filesystem.
@@ -3170,10 +6101,24 @@ static vfs_file_t *ext2_mount(vfs_file_t *block_device, const char *path)
     ext2_filesystem_t *fs = kmalloc(sizeof(ext2_filesystem_t));
     // Clean the memory.
     memset(fs, 0, sizeof(ext2_filesystem_t));
-    // Initialize the filesystem spinlock.
-    spinlock_init(&fs->spinlock);
-    // Initialize the list of opened files.
-    list_head_init(&fs->opened_files);
+    // Initialize the filesystem mutex.
+    mutex_init(&fs->lock);
+    // Initialize the table of the files in memory.
+    fs->files = hashmap_create(
+        EXT2_ICACHE_BUCKETS,
+        hashmap_int_hash,
+        hashmap_int_comp,
+        hashmap_do_not_duplicate,
+        hashmap_do_not_free);
+    list_head_init(&fs->closed_files);
+    // Initialize the inode cache.
+    fs->icache = hashmap_create(
+        EXT2_ICACHE_BUCKETS,
+        hashmap_int_hash,
+        hashmap_int_comp,
+        hashmap_do_not_duplicate,
+        hashmap_do_not_free);
+    list_head_init(&fs->icache_lru);
     // Set the pointer to the block device.
     fs->block_device = block_device;
     // Read the superblock.
@@ -3252,6 +6197,18 @@ static vfs_file_t *ext2_mount(vfs_file_t *block_device, const char *path)
         // Free the block_groups and the filesystem.
         goto free_block_groups;
     }
+    // Replay the journal, before reading anything else.
+    if ((fs->superblock.feature_compat & EXT3_FEATURE_COMPAT_HAS_JOURNAL) && (ext2_load_journal(fs) < 0)) {
+        pr_err("Failed to load the journal.\n");
+        // Free the block_groups and the filesystem.
+        goto free_block_groups;
+    }
+    // Keep the bitmaps of the groups in memory.
+    if (ext2_load_bitmaps(fs) == -1) {
+        pr_err("Failed to load the bitmaps.\n");
+        // Free the bitmaps, the block_groups and the filesystem.
+        goto free_block_groups;
+    }
 
     // We need the root inode in order to set the root file.
     ext2_inode_t root_inode;
@@ -3277,8 +6234,8 @@ static vfs_file_t *ext2_mount(vfs_file_t *block_device, const char *path)
         // Free the block_buffer, the block_groups and the filesystem.
         goto free_all;
     }
-    // Add the root to the list of opened files.
-    list_head_insert_before(&fs->root->siblings, &fs->opened_files);
+    // Add the root to the files in memory.
+    hashmap_set(fs->files, (void *)fs->root->ino, fs->root);
 
     // Dump the filesystem details for debugging.
     ext2_dump_filesystem(fs);
@@ -3296,9 +6253,19 @@ free_block_buffer:
     // Free the memory occupied by the block buffer.
     kmem_cache_destroy(fs->ext2_buffer_cache);
 free_block_groups:
+    // Write back and free the journal.
+    if (fs->journal) {
+        journal_destroy(fs->journal);
+    }
+    // Free the bitmaps kept in memory.
+    ext2_free_bitmaps(fs);
     // Free the memory occupied by the block groups.
     kfree(fs->block_groups);
 free_filesystem:
+    // Free the inodes we have read.
+    ext2_icache_destroy(fs);
+    // Free the table of the files, only the root was in it.
+    hashmap_free(fs->files);
     // Free the memory occupied by the filesystem.
     kfree(fs);
     return NULL;
@@ -3338,11 +6305,14 @@ static vfs_file_t *ext2_mount_callback(const char *path, const char *device)
 static file_system_type ext2_file_system_type = {
     .name     = "ext2",
     .fs_flags = 0,
-    .mount    = ext2_mount_callback
+    .mount    = ext2_mount_callback,
+    .sync_fs  = ext2_sync_fs
 };
 
 int ext2_initialize(void)
 {
+    // Create the cache for the inodes kept in memory.
+    ext2_icache_entry_cache = KMEM_CREATE(ext2_icache_entry_t);
     // Register the filesystem.
     vfs_register_filesystem(&ext2_file_system_type);
     return 0;
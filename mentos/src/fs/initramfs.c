@@ -0,0 +1,214 @@
+/// @file initramfs.c
+/// @brief Unpacks the initramfs, passed as a multiboot module, into tmpfs.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+// Setup the logging for this file (do this before any other include).
+#include "sys/kernel_levels.h"           // Include kernel log levels.
+#define __DEBUG_HEADER__ "[INITRD]"      ///< Change header.
+#define __DEBUG_LEVEL__  LOGLEVEL_NOTICE ///< Set log level.
+#include "io/debug.h"                    // Include debugging functions.
+
+#include "fs/initramfs.h"
+
+#include "fcntl.h"
+#include "fs/attr.h"
+#include "fs/vfs.h"
+#include "limits.h"
+#include "string.h"
+#include "sys/errno.h"
+#include "sys/module.h"
+
+/// The magic number of the `newc` cpio format.
+#define CPIO_NEWC_MAGIC "070701"
+/// The name of the last entry of the archive.
+#define CPIO_TRAILER "TRAILER!!!"
+
+/// @brief The header of an entry of the archive, all fields are 8 hexadecimal
+/// digits, the name and the data follow, each aligned to 4 bytes.
+typedef struct cpio_newc_header_t {
+    char c_magic[6];     ///< The magic number, `070701`.
+    char c_ino[8];       ///< The inode number.
+    char c_mode[8];      ///< The type and the permissions.
+    char c_uid[8];       ///< The user id.
+    char c_gid[8];       ///< The group id.
+    char c_nlink[8];     ///< The number of links.
+    char c_mtime[8];     ///< The time of the last modification.
+    char c_filesize[8];  ///< The size of the data.
+    char c_devmajor[8];  ///< The major number of the device holding the file.
+    char c_devminor[8];  ///< The minor number of the device holding the file.
+    char c_rdevmajor[8]; ///< The major number, for device files.
+    char c_rdevminor[8]; ///< The minor number, for device files.
+    char c_namesize[8];  ///< The length of the name, including the terminator.
+    char c_check[8];     ///< Always zero in the `newc` format.
+} cpio_newc_header_t;
+
+/// @brief Rounds the offset up to a multiple of 4.
+#define CPIO_ALIGN(x) (((x) + 3U) & ~3U)
+
+/// @brief Parses a field of the header.
+/// @param field the 8 hexadecimal digits.
+/// @param value where the value is stored.
+/// @return 0 on success, -EINVAL if the field is not hexadecimal.
+static int __cpio_parse_hex(const char *field, uint32_t *value)
+{
+    *value = 0;
+    for (int i = 0; i < 8; ++i) {
+        char c = field[i];
+        if ((c >= '0') && (c <= '9')) {
+            *value = (*value << 4) | (c - '0');
+        } else if ((c >= 'a') && (c <= 'f')) {
+            *value = (*value << 4) | (c - 'a' + 10);
+        } else if ((c >= 'A') && (c <= 'F')) {
+            *value = (*value << 4) | (c - 'A' + 10);
+        } else {
+            return -EINVAL;
+        }
+    }
+    return 0;
+}
+
+/// @brief Finds the module holding the initramfs.
+/// @return the module, NULL if there is none.
+static multiboot_module_t *__initramfs_find(void)
+{
+    for (int i = 0; (i < MAX_MODULES) && modules[i].mod_start; ++i) {
+        if (((modules[i].mod_end - modules[i].mod_start) >= sizeof(cpio_newc_header_t)) &&
+            !strncmp((const char *)modules[i].mod_start, CPIO_NEWC_MAGIC, 6)) {
+            return &modules[i];
+        }
+    }
+    return NULL;
+}
+
+bool_t initramfs_available(void)
+{
+    return __initramfs_find() != NULL;
+}
+
+/// @brief Creates a regular file, with the given content.
+/// @param path the absolute path of the file.
+/// @param mode the permissions.
+/// @param data the content.
+/// @param size the size of the content.
+/// @return 0 on success, -errno on failure.
+static int __initramfs_create_file(const char *path, mode_t mode, const char *data, uint32_t size)
+{
+    vfs_file_t *file = vfs_open(path, O_WRONLY | O_CREAT | O_TRUNC, mode);
+    if (file == NULL) {
+        return -errno;
+    }
+    ssize_t written = size ? vfs_write(file, data, 0, size) : 0;
+    vfs_close(file);
+    if (written < 0) {
+        return (int)written;
+    }
+    return ((uint32_t)written == size) ? 0 : -ENOSPC;
+}
+
+/// @brief Creates an entry of the archive.
+/// @param path the absolute path of the entry.
+/// @param mode the type and the permissions.
+/// @param data the content.
+/// @param size the size of the content.
+/// @return 0 on success, -errno on failure.
+static int __initramfs_create(const char *path, uint32_t mode, const char *data, uint32_t size)
+{
+    char target[PATH_MAX];
+    switch (mode & 0170000) {
+    case 0040000:
+        // The root is the mount point itself.
+        if (!strcmp(path, "/")) {
+            return sys_chmod(path, mode & 07777);
+        }
+        return vfs_mkdir(path, mode & 07777);
+    case 0100000:
+        return __initramfs_create_file(path, mode & 07777, data, size);
+    case 0120000:
+        if (size >= PATH_MAX) {
+            return -ENAMETOOLONG;
+        }
+        memcpy(target, data, size);
+        target[size] = 0;
+        return vfs_symlink(target, path);
+    default:
+        // Device files, pipes and sockets are provided by the kernel.
+        return -EINVAL;
+    }
+}
+
+/// @brief Unpacks the archive.
+/// @param archive the archive.
+/// @param length the length of the archive.
+/// @return the number of entries created, -EINVAL if the archive is corrupted.
+static int __initramfs_unpack(const char *archive, uint32_t length)
+{
+    char path[PATH_MAX];
+    uint32_t offset = 0, mode, uid, gid, filesize, namesize;
+    int created     = 0;
+    while ((offset + sizeof(cpio_newc_header_t)) <= length) {
+        const cpio_newc_header_t *header = (const cpio_newc_header_t *)(archive + offset);
+        if (strncmp(header->c_magic, CPIO_NEWC_MAGIC, 6) ||
+            __cpio_parse_hex(header->c_mode, &mode) ||
+            __cpio_parse_hex(header->c_uid, &uid) ||
+            __cpio_parse_hex(header->c_gid, &gid) ||
+            __cpio_parse_hex(header->c_filesize, &filesize) ||
+            __cpio_parse_hex(header->c_namesize, &namesize) ||
+            (namesize == 0)) {
+            pr_err("Corrupted header at offset %u.\n", offset);
+            return -EINVAL;
+        }
+        const char *name = archive + offset + sizeof(cpio_newc_header_t);
+        uint32_t data    = CPIO_ALIGN(offset + sizeof(cpio_newc_header_t) + namesize);
+        if ((data > length) || (filesize > (length - data)) || (name[namesize - 1] != 0)) {
+            pr_err("Truncated entry at offset %u.\n", offset);
+            return -EINVAL;
+        }
+        if (!strcmp(name, CPIO_TRAILER)) {
+            return created;
+        }
+        // The names are relative to the root, usually starting with `./`.
+        if (!strncmp(name, "./", 2)) {
+            name += 2;
+        } else if (!strcmp(name, ".")) {
+            name += 1;
+        }
+        if ((strlen(name) + 2) > PATH_MAX) {
+            pr_warning("Skipping `%s`, the name is too long.\n", name);
+        } else {
+            path[0] = '/';
+            strcpy(path + 1, name);
+            int ret = __initramfs_create(path, mode, archive + data, filesize);
+            if (ret >= 0) {
+                ret = sys_lchown(path, uid, gid);
+            }
+            if (ret < 0) {
+                pr_warning("Cannot create `%s` (%d).\n", path, ret);
+            } else {
+                ++created;
+            }
+        }
+        offset = CPIO_ALIGN(data + filesize);
+    }
+    pr_warning("The archive has no trailer.\n");
+    return created;
+}
+
+int initramfs_mount(void)
+{
+    multiboot_module_t *module = __initramfs_find();
+    if (module == NULL) {
+        return 0;
+    }
+    int ret = do_mount("tmpfs", "/", NULL);
+    if (ret < 0) {
+        pr_err("Cannot mount tmpfs on `/`.\n");
+        return ret;
+    }
+    uint32_t length = module->mod_end - module->mod_start;
+    if ((ret = __initramfs_unpack((const char *)module->mod_start, length)) < 0) {
+        return ret;
+    }
+    pr_notice("Unpacked %d entries (%u bytes) into `/`.\n", ret, length);
+    return 0;
+}
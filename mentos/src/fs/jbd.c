@@ -0,0 +1,661 @@
+/// @file jbd.c
+/// @brief Journal of the metadata blocks, in the on-disk format of JBD2.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+// Setup the logging for this file (do this before any other include).
+#include "sys/kernel_levels.h"           // Include kernel log levels.
+#define __DEBUG_HEADER__ "[JBD2  ]"      ///< Change header.
+#define __DEBUG_LEVEL__  LOGLEVEL_NOTICE ///< Set log level.
+#include "io/debug.h"                    // Include debugging functions.
+
+#include "fs/jbd.h"
+
+#include "fs/vfs.h"
+#include "klib/hashmap.h"
+#include "klib/mutex.h"
+#include "math.h"
+#include "mem/kheap.h"
+#include "string.h"
+#include "sys/errno.h"
+
+#define JBD2_MAGIC_NUMBER     0xC03B3998U ///< Magic number of every block of the journal.
+#define JBD2_DESCRIPTOR_BLOCK 1           ///< Lists the blocks copied after it.
+#define JBD2_COMMIT_BLOCK     2           ///< Closes a transaction.
+#define JBD2_SUPERBLOCK_V1    3           ///< Superblock, without features.
+#define JBD2_SUPERBLOCK_V2    4           ///< Superblock, with features.
+#define JBD2_REVOKE_BLOCK     5           ///< Lists the blocks which must not be replayed.
+
+#define JBD2_FLAG_ESCAPE    1 ///< The block started with the magic number, which was cleared.
+#define JBD2_FLAG_SAME_UUID 2 ///< The tag is not followed by the UUID.
+#define JBD2_FLAG_DELETED   4 ///< The block was deleted by this transaction.
+#define JBD2_FLAG_LAST_TAG  8 ///< Last tag of the descriptor.
+
+#define JBD2_FEATURE_INCOMPAT_REVOKE 0x00000001U ///< The log can contain revoke blocks.
+#define JBD2_KNOWN_INCOMPAT          JBD2_FEATURE_INCOMPAT_REVOKE
+
+#define JBD2_TAG_SIZE  8  ///< Size of a tag, without 64-bit block numbers and checksums.
+#define JBD2_UUID_SIZE 16 ///< Size of the UUID following the first tag.
+
+/// Number of log blocks gathered into a single write.
+#define JOURNAL_BATCH 16
+/// Number of buckets of the tables of blocks.
+#define JOURNAL_BUCKETS 127
+
+/// @brief Header of every block of the journal, in big endian.
+typedef struct jbd2_header_t {
+    /// JBD2_MAGIC_NUMBER.
+    uint32_t magic;
+    /// The type of the block.
+    uint32_t blocktype;
+    /// The transaction the block belongs to.
+    uint32_t sequence;
+} jbd2_header_t;
+
+/// @brief Superblock of the journal, in big endian.
+typedef struct jbd2_superblock_t {
+    /// The header of the block.
+    jbd2_header_t header;
+    /// The size of a block of the journal.
+    uint32_t blocksize;
+    /// The number of blocks of the journal.
+    uint32_t maxlen;
+    /// The first block of the log.
+    uint32_t first;
+    /// The first transaction expected in the log.
+    uint32_t sequence;
+    /// The block where the log starts, 0 when it is empty.
+    uint32_t start;
+    /// The error recorded by the journal.
+    int32_t error;
+    /// Compatible features.
+    uint32_t feature_compat;
+    /// Incompatible features.
+    uint32_t feature_incompat;
+    /// Read-only compatible features.
+    uint32_t feature_ro_compat;
+    /// The UUID of the journal.
+    uint8_t uuid[JBD2_UUID_SIZE];
+} jbd2_superblock_t;
+
+/// @brief Entry of a descriptor block, in big endian.
+typedef struct jbd2_tag_t {
+    /// The block of the filesystem, copied in the log.
+    uint32_t blocknr;
+    /// Unused without checksums.
+    uint16_t checksum;
+    /// Flags (JBD2_FLAG_*).
+    uint16_t flags;
+} jbd2_tag_t;
+
+/// @brief Header of a revoke block, in big endian.
+typedef struct jbd2_revoke_header_t {
+    /// The header of the block.
+    jbd2_header_t header;
+    /// The number of bytes used, this header included.
+    uint32_t count;
+} jbd2_revoke_header_t;
+
+/// @brief The passes of the recovery.
+typedef enum journal_pass_t {
+    journal_pass_scan,   ///< Finds the last committed transaction.
+    journal_pass_revoke, ///< Collects the revoked blocks.
+    journal_pass_replay, ///< Copies the blocks to their place.
+} journal_pass_t;
+
+struct journal_t {
+    /// The block device.
+    vfs_file_t *device;
+    /// The size of a block.
+    uint32_t block_size;
+    /// The device block holding each block of the journal.
+    uint32_t *map;
+    /// The number of blocks of the journal.
+    uint32_t maxlen;
+    /// The first block of the log.
+    uint32_t first;
+    /// The superblock of the journal, as found on the device.
+    jbd2_superblock_t *sb;
+    /// The sequence number of the running transaction.
+    uint32_t sequence;
+    /// The block of the log where the running transaction will be written.
+    uint32_t head;
+    /// Set when the superblock marks the log as empty.
+    int clean;
+    /// The maximum number of blocks of a transaction.
+    uint32_t max_transaction;
+    /// The blocks modified by the running transaction.
+    buffer_head_t **running;
+    /// The number of blocks of the running transaction.
+    uint32_t nr_running;
+    /// Maps the blocks of the running transaction to their buffers.
+    hashmap_t *running_map;
+    /// The blocks of the last committed transaction, which are not checkpointed yet.
+    buffer_head_t **committed;
+    /// The number of blocks of the committed transaction.
+    uint32_t nr_committed;
+    /// Maps the blocks of the committed transaction to their buffers.
+    hashmap_t *committed_map;
+    /// Log blocks waiting to be written with a single request.
+    uint8_t *batch;
+    /// The log block of the first one in the batch.
+    uint32_t batch_start;
+    /// The number of blocks in the batch.
+    uint32_t batch_count;
+    /// Serializes the transactions.
+    mutex_t lock;
+};
+
+/// @brief Converts a 32-bit value from or to big endian.
+/// @param value the value.
+/// @return the converted value.
+static inline uint32_t be32(uint32_t value)
+{
+    return __builtin_bswap32(value);
+}
+
+/// @brief Converts a 16-bit value from or to big endian.
+/// @param value the value.
+/// @return the converted value.
+static inline uint16_t be16(uint16_t value)
+{
+    return __builtin_bswap16(value);
+}
+
+/// @brief Returns the log block following the given one, wrapping around.
+/// @param journal the journal.
+/// @param block the log block.
+/// @return the next log block.
+static inline uint32_t __journal_next(journal_t *journal, uint32_t block)
+{
+    return (++block >= journal->maxlen) ? journal->first : block;
+}
+
+/// @brief Reads a block of the journal, bypassing the buffer cache.
+/// @param journal the journal.
+/// @param block the block of the journal.
+/// @param data where the content is placed.
+/// @return 0 on success, -errno on failure.
+static int __journal_read(journal_t *journal, uint32_t block, void *data)
+{
+    ssize_t ret = vfs_read(journal->device, data, journal->map[block] * journal->block_size, journal->block_size);
+    if (ret != (ssize_t)journal->block_size) {
+        pr_err("Failed to read block %u of the journal.\n", block);
+        return -EIO;
+    }
+    return 0;
+}
+
+/// @brief Writes the batched log blocks with a single request.
+/// @param journal the journal.
+/// @return 0 on success, -errno on failure.
+static int __journal_flush_batch(journal_t *journal)
+{
+    if (journal->batch_count == 0) {
+        return 0;
+    }
+    size_t length = journal->batch_count * journal->block_size;
+    ssize_t ret   = vfs_write(journal->device, journal->batch, journal->map[journal->batch_start] * journal->block_size, length);
+    journal->batch_count = 0;
+    if (ret != (ssize_t)length) {
+        pr_err("Failed to write the log at block %u.\n", journal->batch_start);
+        return -EIO;
+    }
+    return 0;
+}
+
+/// @brief Writes a block of the log, gathering consecutive blocks.
+/// @param journal the journal.
+/// @param block the block of the journal.
+/// @param data the content of the block.
+/// @return 0 on success, -errno on failure.
+static int __journal_write(journal_t *journal, uint32_t block, const void *data)
+{
+    // Append to the batch only if the block follows the last one on the device.
+    if (journal->batch_count &&
+        ((journal->batch_count == JOURNAL_BATCH) ||
+         (journal->map[block] != journal->map[journal->batch_start] + journal->batch_count))) {
+        if (__journal_flush_batch(journal) < 0) {
+            return -EIO;
+        }
+    }
+    if (journal->batch_count == 0) {
+        journal->batch_start = block;
+    }
+    memcpy(journal->batch + journal->batch_count * journal->block_size, data, journal->block_size);
+    ++journal->batch_count;
+    return 0;
+}
+
+/// @brief Writes the superblock of the journal.
+/// @param journal the journal.
+/// @param start the block where the log starts, 0 if it is empty.
+/// @return 0 on success, -errno on failure.
+static int __journal_write_superblock(journal_t *journal, uint32_t start)
+{
+    journal->sb->sequence = be32(journal->sequence);
+    journal->sb->start    = be32(start);
+    ssize_t ret           = vfs_write(journal->device, journal->sb, journal->map[0] * journal->block_size, journal->block_size);
+    if (ret != (ssize_t)journal->block_size) {
+        pr_err("Failed to write the superblock of the journal.\n");
+        return -EIO;
+    }
+    journal->clean = (start == 0);
+    return 0;
+}
+
+/// @brief Writes back the blocks of the committed transaction, together
+/// with the data blocks.
+/// @param journal the journal.
+/// @return 0 on success, -errno on failure.
+/// @details The blocks modified again by the running transaction stay
+/// pinned, their last content is going to be in the log.
+static int __journal_checkpoint(journal_t *journal)
+{
+    for (uint32_t i = 0; i < journal->nr_committed; ++i) {
+        buffer_head_t *buffer = journal->committed[i];
+        hashmap_remove(journal->committed_map, (void *)buffer->key.block);
+        if (!hashmap_has(journal->running_map, (void *)buffer->key.block)) {
+            buffer_unpin(buffer);
+        }
+    }
+    journal->nr_committed = 0;
+    return buffer_sync(journal->device);
+}
+
+/// @brief Commits the running transaction, the journal must be locked.
+/// @param journal the journal.
+/// @return 0 on success, -errno on failure.
+static int __journal_commit(journal_t *journal)
+{
+    // The data blocks reach the device before the metadata pointing to them,
+    // and the previous transaction leaves the log.
+    int ret = __journal_checkpoint(journal);
+    if (ret < 0) {
+        return ret;
+    }
+    if (journal->nr_running == 0) {
+        return journal->clean ? 0 : __journal_write_superblock(journal, 0);
+    }
+    uint32_t block_size     = journal->block_size;
+    uint32_t tags_per_block = (block_size - sizeof(jbd2_header_t) - JBD2_UUID_SIZE) / JBD2_TAG_SIZE;
+    uint32_t descriptors    = (journal->nr_running + tags_per_block - 1) / tags_per_block;
+    // The transaction does not wrap around, the log is empty after the checkpoint.
+    if ((journal->head + descriptors + journal->nr_running + 1) > journal->maxlen) {
+        journal->head = journal->first;
+    }
+    // The log starts with this transaction, until it is checkpointed. Without
+    // the commit block, the replay ignores it.
+    if (__journal_write_superblock(journal, journal->head) < 0) {
+        return -EIO;
+    }
+    uint8_t *descriptor = kmalloc(block_size);
+    uint8_t *copy       = kmalloc(block_size);
+    if ((descriptor == NULL) || (copy == NULL)) {
+        kfree(descriptor);
+        kfree(copy);
+        return -ENOMEM;
+    }
+    uint32_t block      = journal->head;
+    jbd2_header_t *header;
+    for (uint32_t i = 0; (i < journal->nr_running) && (ret == 0); i += tags_per_block) {
+        uint32_t count = min(tags_per_block, journal->nr_running - i);
+        // Describe the blocks which follow.
+        memset(descriptor, 0, block_size);
+        header            = (jbd2_header_t *)descriptor;
+        header->magic     = be32(JBD2_MAGIC_NUMBER);
+        header->blocktype = be32(JBD2_DESCRIPTOR_BLOCK);
+        header->sequence  = be32(journal->sequence);
+        uint8_t *position = descriptor + sizeof(jbd2_header_t);
+        for (uint32_t k = 0; k < count; ++k) {
+            buffer_head_t *buffer = journal->running[i + k];
+            jbd2_tag_t *tag       = (jbd2_tag_t *)position;
+            uint16_t flags        = (k == 0) ? 0 : JBD2_FLAG_SAME_UUID;
+            if (k == (count - 1)) {
+                flags |= JBD2_FLAG_LAST_TAG;
+            }
+            // A copy starting with the magic number would look like a block
+            // of the journal.
+            if (*(uint32_t *)buffer->data == be32(JBD2_MAGIC_NUMBER)) {
+                flags |= JBD2_FLAG_ESCAPE;
+            }
+            tag->blocknr = be32(buffer->key.block);
+            tag->flags   = be16(flags);
+            position += JBD2_TAG_SIZE;
+            if (k == 0) {
+                memcpy(position, journal->sb->uuid, JBD2_UUID_SIZE);
+                position += JBD2_UUID_SIZE;
+            }
+        }
+        ret   = __journal_write(journal, block, descriptor);
+        block = __journal_next(journal, block);
+        // Copy the blocks.
+        for (uint32_t k = 0; (k < count) && (ret == 0); ++k) {
+            buffer_head_t *buffer = journal->running[i + k];
+            memcpy(copy, buffer->data, block_size);
+            if (*(uint32_t *)copy == be32(JBD2_MAGIC_NUMBER)) {
+                *(uint32_t *)copy = 0;
+            }
+            ret   = __journal_write(journal, block, copy);
+            block = __journal_next(journal, block);
+        }
+    }
+    // Close the transaction, once its blocks are in the log.
+    if ((ret == 0) && ((ret = __journal_flush_batch(journal)) == 0)) {
+        memset(descriptor, 0, block_size);
+        header            = (jbd2_header_t *)descriptor;
+        header->magic     = be32(JBD2_MAGIC_NUMBER);
+        header->blocktype = be32(JBD2_COMMIT_BLOCK);
+        header->sequence  = be32(journal->sequence);
+        if (((ret = __journal_write(journal, block, descriptor)) == 0) && ((ret = __journal_flush_batch(journal)) == 0)) {
+            block = __journal_next(journal, block);
+        }
+    }
+    journal->batch_count = 0;
+    kfree(descriptor);
+    kfree(copy);
+    if (ret < 0) {
+        pr_err("Failed to commit transaction %u.\n", journal->sequence);
+        return ret;
+    }
+    pr_debug("Committed transaction %u (%u blocks).\n", journal->sequence, journal->nr_running);
+    // The running transaction becomes the committed one, its blocks stay
+    // pinned until the next checkpoint.
+    buffer_head_t **blocks = journal->committed;
+    hashmap_t *map         = journal->committed_map;
+    journal->committed     = journal->running;
+    journal->committed_map = journal->running_map;
+    journal->nr_committed  = journal->nr_running;
+    journal->running       = blocks;
+    journal->running_map   = map;
+    journal->nr_running    = 0;
+    journal->head          = block;
+    ++journal->sequence;
+    return 0;
+}
+
+/// @brief Checks if a block must not be replayed.
+/// @param revoked maps the revoked blocks to the last transaction revoking them.
+/// @param block the block.
+/// @param sequence the transaction being replayed.
+/// @return 1 if the block has been revoked by the transaction or a later one.
+static inline int __journal_revoked(hashmap_t *revoked, uint32_t block, uint32_t sequence)
+{
+    return hashmap_has(revoked, (void *)block) && ((uintptr_t)hashmap_get(revoked, (void *)block) >= sequence);
+}
+
+/// @brief Collects the blocks listed by a revoke block.
+/// @param journal the journal.
+/// @param data the revoke block.
+/// @param sequence the transaction it belongs to.
+/// @param revoked maps the revoked blocks to the last transaction revoking them.
+static void __journal_collect_revoked(journal_t *journal, uint8_t *data, uint32_t sequence, hashmap_t *revoked)
+{
+    jbd2_revoke_header_t *header = (jbd2_revoke_header_t *)data;
+    uint32_t count               = min(be32(header->count), journal->block_size);
+    for (uint32_t offset = sizeof(jbd2_revoke_header_t); (offset + sizeof(uint32_t)) <= count; offset += sizeof(uint32_t)) {
+        uint32_t block = be32(*(uint32_t *)(data + offset));
+        if (!__journal_revoked(revoked, block, sequence)) {
+            hashmap_set(revoked, (void *)block, (void *)sequence);
+        }
+    }
+}
+
+/// @brief Walks the log, from its start to the last committed transaction.
+/// @param journal the journal.
+/// @param pass what is done with the blocks found.
+/// @param end the transaction following the last committed one, set by the scan.
+/// @param revoked maps the revoked blocks to the last transaction revoking them.
+/// @return 0 on success, -errno on failure.
+static int __journal_pass(journal_t *journal, journal_pass_t pass, uint32_t *end, hashmap_t *revoked)
+{
+    uint32_t block    = be32(journal->sb->start);
+    uint32_t sequence = be32(journal->sb->sequence);
+    uint8_t *data     = kmalloc(journal->block_size);
+    uint8_t *copy     = kmalloc(journal->block_size);
+    int ret           = 0;
+    if ((data == NULL) || (copy == NULL)) {
+        kfree(data);
+        kfree(copy);
+        return -ENOMEM;
+    }
+    // A damaged log cannot keep us walking in circles.
+    for (uint32_t steps = 0; (steps < journal->maxlen) && ((pass == journal_pass_scan) || (sequence != *end)); ++steps) {
+        if ((ret = __journal_read(journal, block, data)) < 0) {
+            break;
+        }
+        jbd2_header_t *header = (jbd2_header_t *)data;
+        // The log ends with the first block which does not follow.
+        if ((be32(header->magic) != JBD2_MAGIC_NUMBER) || (be32(header->sequence) != sequence)) {
+            break;
+        }
+        block             = __journal_next(journal, block);
+        uint32_t type     = be32(header->blocktype);
+        if (type == JBD2_COMMIT_BLOCK) {
+            ++sequence;
+        } else if (type == JBD2_REVOKE_BLOCK) {
+            if (pass == journal_pass_revoke) {
+                __journal_collect_revoked(journal, data, sequence, revoked);
+            }
+        } else if (type == JBD2_DESCRIPTOR_BLOCK) {
+            uint8_t *position = data + sizeof(jbd2_header_t);
+            while ((position + JBD2_TAG_SIZE) <= (data + journal->block_size)) {
+                jbd2_tag_t *tag = (jbd2_tag_t *)position;
+                uint16_t flags  = be16(tag->flags);
+                position += JBD2_TAG_SIZE + ((flags & JBD2_FLAG_SAME_UUID) ? 0 : JBD2_UUID_SIZE);
+                if ((pass == journal_pass_replay) && !__journal_revoked(revoked, be32(tag->blocknr), sequence)) {
+                    if ((ret = __journal_read(journal, block, copy)) < 0) {
+                        break;
+                    }
+                    if (flags & JBD2_FLAG_ESCAPE) {
+                        *(uint32_t *)copy = be32(JBD2_MAGIC_NUMBER);
+                    }
+                    buffer_head_t *buffer = buffer_get(journal->device, be32(tag->blocknr), journal->block_size);
+                    if (buffer == NULL) {
+                        ret = -ENOMEM;
+                        break;
+                    }
+                    memcpy(buffer->data, copy, journal->block_size);
+                    buffer_mark_dirty(buffer);
+                    buffer_release(buffer);
+                }
+                block = __journal_next(journal, block);
+                if (flags & JBD2_FLAG_LAST_TAG) {
+                    break;
+                }
+            }
+            if (ret < 0) {
+                break;
+            }
+        } else {
+            break;
+        }
+    }
+    if (pass == journal_pass_scan) {
+        *end = sequence;
+    } else if ((ret == 0) && (sequence != *end)) {
+        pr_err("The log changed during the recovery.\n");
+        ret = -EIO;
+    }
+    kfree(data);
+    kfree(copy);
+    return ret;
+}
+
+journal_t *journal_load(vfs_file_t *device, uint32_t block_size, uint32_t *map, uint32_t length)
+{
+    if (length < 2) {
+        pr_err("The journal is too small.\n");
+        return NULL;
+    }
+    journal_t *journal = kmalloc(sizeof(journal_t));
+    if (journal == NULL) {
+        return NULL;
+    }
+    memset(journal, 0, sizeof(journal_t));
+    journal->device     = device;
+    journal->block_size = block_size;
+    journal->map        = map;
+    journal->maxlen     = length;
+    journal->sb         = kmalloc(block_size);
+    if ((journal->sb == NULL) || (__journal_read(journal, 0, journal->sb) < 0)) {
+        goto free_journal;
+    }
+    jbd2_superblock_t *sb = journal->sb;
+    if ((be32(sb->header.magic) != JBD2_MAGIC_NUMBER) ||
+        ((be32(sb->header.blocktype) != JBD2_SUPERBLOCK_V1) && (be32(sb->header.blocktype) != JBD2_SUPERBLOCK_V2))) {
+        pr_err("The journal has no valid superblock.\n");
+        goto free_journal;
+    }
+    if (be32(sb->blocksize) != block_size) {
+        pr_err("The journal uses blocks of %u bytes, instead of %u.\n", be32(sb->blocksize), block_size);
+        goto free_journal;
+    }
+    // Checksums, 64-bit block numbers and fast commits are not supported.
+    if ((be32(sb->header.blocktype) == JBD2_SUPERBLOCK_V2) && (be32(sb->feature_incompat) & ~JBD2_KNOWN_INCOMPAT)) {
+        pr_err("The journal uses unsupported features (0x%x).\n", be32(sb->feature_incompat) & ~JBD2_KNOWN_INCOMPAT);
+        goto free_journal;
+    }
+    journal->maxlen = min(be32(sb->maxlen), length);
+    journal->first  = be32(sb->first);
+    if ((journal->first == 0) || (journal->first >= journal->maxlen)) {
+        pr_err("The log of the journal is not valid.\n");
+        goto free_journal;
+    }
+    journal->sequence = be32(sb->sequence);
+    journal->head     = journal->first;
+    journal->clean    = (sb->start == 0);
+    // A transaction, with its descriptors and commit block, fits in the log,
+    // and its pinned blocks leave room inside the buffer cache.
+    journal->max_transaction = max(1U, min((journal->maxlen - journal->first) / 2, buffer_cache_max_buffers / 2));
+    journal->running         = kmalloc(journal->max_transaction * sizeof(buffer_head_t *));
+    journal->committed       = kmalloc(journal->max_transaction * sizeof(buffer_head_t *));
+    journal->batch           = kmalloc(JOURNAL_BATCH * block_size);
+    if ((journal->running == NULL) || (journal->committed == NULL) || (journal->batch == NULL)) {
+        goto free_journal;
+    }
+    journal->running_map   = hashmap_create(JOURNAL_BUCKETS, hashmap_int_hash, hashmap_int_comp, hashmap_do_not_duplicate, hashmap_do_not_free);
+    journal->committed_map = hashmap_create(JOURNAL_BUCKETS, hashmap_int_hash, hashmap_int_comp, hashmap_do_not_duplicate, hashmap_do_not_free);
+    if ((journal->running_map == NULL) || (journal->committed_map == NULL)) {
+        goto free_journal;
+    }
+    mutex_init(&journal->lock);
+    pr_debug("Journal of %u blocks, log from block %u, transaction %u.\n", journal->maxlen, journal->first, journal->sequence);
+    return journal;
+
+free_journal:
+    if (journal->running_map) {
+        hashmap_free(journal->running_map);
+    }
+    if (journal->committed_map) {
+        hashmap_free(journal->committed_map);
+    }
+    kfree(journal->running);
+    kfree(journal->committed);
+    kfree(journal->batch);
+    kfree(journal->sb);
+    kfree(journal);
+    return NULL;
+}
+
+int journal_recover(journal_t *journal)
+{
+    if (journal->sb->start == 0) {
+        return 0;
+    }
+    uint32_t end      = 0;
+    hashmap_t *revoked = hashmap_create(JOURNAL_BUCKETS, hashmap_int_hash, hashmap_int_comp, hashmap_do_not_duplicate, hashmap_do_not_free);
+    if (revoked == NULL) {
+        return -ENOMEM;
+    }
+    int ret = __journal_pass(journal, journal_pass_scan, &end, revoked);
+    if (ret == 0) {
+        ret = __journal_pass(journal, journal_pass_revoke, &end, revoked);
+    }
+    if (ret == 0) {
+        ret = __journal_pass(journal, journal_pass_replay, &end, revoked);
+    }
+    hashmap_free(revoked);
+    // The replayed blocks must be on the device before the log is emptied.
+    if ((ret < 0) || ((ret = buffer_sync(journal->device)) < 0)) {
+        pr_err("Failed to recover the journal.\n");
+        return ret;
+    }
+    int replayed      = end - be32(journal->sb->sequence);
+    journal->sequence = end + 1;
+    if ((ret = __journal_write_superblock(journal, 0)) < 0) {
+        return ret;
+    }
+    return replayed;
+}
+
+void journal_get_write_access(journal_t *journal, buffer_head_t *buffer)
+{
+    mutex_lock(&journal->lock);
+    if (!hashmap_has(journal->running_map, (void *)buffer->key.block)) {
+        // Close the transaction before it outgrows the log.
+        if ((journal->nr_running >= journal->max_transaction) && (__journal_commit(journal) < 0)) {
+            pr_warning("Failed to commit a full transaction.\n");
+        }
+        if (journal->nr_running < journal->max_transaction) {
+            buffer_pin(buffer);
+            hashmap_set(journal->running_map, (void *)buffer->key.block, buffer);
+            journal->running[journal->nr_running++] = buffer;
+        }
+    }
+    mutex_unlock(&journal->lock);
+}
+
+void journal_forget(journal_t *journal, uint32_t block)
+{
+    mutex_lock(&journal->lock);
+    // The log holds an old copy of the block, which the replay would write
+    // over its new content: checkpoint, and empty the log.
+    if (hashmap_has(journal->committed_map, (void *)block) &&
+        ((__journal_checkpoint(journal) < 0) || (__journal_write_superblock(journal, 0) < 0))) {
+        pr_warning("Failed to checkpoint the journal, forgetting block %u.\n", block);
+    }
+    buffer_head_t *buffer = hashmap_remove(journal->running_map, (void *)block);
+    if (buffer) {
+        for (uint32_t i = 0; i < journal->nr_running; ++i) {
+            if (journal->running[i] == buffer) {
+                journal->running[i] = journal->running[--journal->nr_running];
+                break;
+            }
+        }
+        buffer_unpin(buffer);
+    }
+    mutex_unlock(&journal->lock);
+}
+
+int journal_commit(journal_t *journal)
+{
+    mutex_lock(&journal->lock);
+    int ret = __journal_commit(journal);
+    mutex_unlock(&journal->lock);
+    return ret;
+}
+
+void journal_destroy(journal_t *journal)
+{
+    mutex_lock(&journal->lock);
+    // Commit, then checkpoint with an empty transaction.
+    if ((__journal_commit(journal) < 0) || (__journal_commit(journal) < 0)) {
+        pr_warning("Failed to empty the journal.\n");
+    }
+    for (uint32_t i = 0; i < journal->nr_running; ++i) {
+        buffer_unpin(journal->running[i]);
+    }
+    for (uint32_t i = 0; i < journal->nr_committed; ++i) {
+        buffer_unpin(journal->committed[i]);
+    }
+    mutex_unlock(&journal->lock);
+    hashmap_free(journal->running_map);
+    hashmap_free(journal->committed_map);
+    kfree(journal->running);
+    kfree(journal->committed);
+    kfree(journal->batch);
+    kfree(journal->sb);
+    kfree(journal->map);
+    kfree(journal);
+}
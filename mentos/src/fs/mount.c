@@ -0,0 +1,37 @@
+/// @file mount.c
+/// @brief Mounting of filesystems.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include "fs/vfs.h"
+#include "fs/namei.h"
+#include "limits.h"
+#include "process/scheduler.h"
+#include "sys/errno.h"
+#include "sys/mount.h"
+
+int sys_mount(const char *source, const char *target, const char *filesystemtype, unsigned long mountflags, const void *data)
+{
+    // Only the superuser can change the tree of the filesystems.
+    task_struct *task = scheduler_get_current_process();
+    if (task && (task->uid != 0)) {
+        return -EPERM;
+    }
+    if (!target || !filesystemtype) {
+        return -EFAULT;
+    }
+    char absolute_path[PATH_MAX];
+    int ret = resolve_path(target, absolute_path, sizeof(absolute_path), FOLLOW_LINKS | REMOVE_TRAILING_SLASH);
+    if (ret < 0) {
+        return ret;
+    }
+    // The target must be an existing directory.
+    stat_t stat;
+    if ((ret = vfs_stat(absolute_path, &stat)) < 0) {
+        return ret;
+    }
+    if ((stat.st_mode & 0170000) != 0040000) {
+        return -ENOTDIR;
+    }
+    return do_mount(filesystemtype, absolute_path, source);
+}
@@ -31,22 +31,25 @@ int sys_open(const char *pathname, int flags, mode_t mode)
         return -errno;
     }
 
-    // Set the file descriptor id.
-    task->fd_list[fd].file_struct = file;
+    // Only some filesystems can move the data without the caches.
+    if (bitmask_check(flags, O_DIRECT) && (file->fs_operations->direct_io_f == NULL)) {
+        vfs_close(file);
+        return -EINVAL;
+    }
 
     if (!bitmask_check(flags, O_APPEND)) {
         // Reset the offset.
-        task->fd_list[fd].file_struct->f_pos = 0;
+        file->f_pos = 0;
     } else {
         stat_t stat;
         // Stat the file.
         file->fs_operations->stat_f(file, &stat);
         // Point at the last character
-        task->fd_list[fd].file_struct->f_pos = stat.st_size;
+        file->f_pos = stat.st_size;
     }
 
-    // Set the flags.
-    task->fd_list[fd].flags_mask = flags;
+    // Set the file descriptor id, and the flags.
+    vfs_install_fd(task->files, fd, file, flags);
 
     // Return the file descriptor and increment it.
     return fd;
@@ -58,18 +61,18 @@ int sys_close(int fd)
     task_struct *task = scheduler_get_current_process();
 
     // Check the current FD.
-    if (fd < 0 || fd >= task->max_fd) {
+    if (fd < 0 || fd >= task->files->max_fd) {
         return -EMFILE;
     }
 
     // Get the file.
-    vfs_file_t *file = task->fd_list[fd].file_struct;
+    vfs_file_t *file = task->files->fd_list[fd].file_struct;
     if (file == NULL) {
         return -1;
     }
 
     // Remove the reference to the file.
-    task->fd_list[fd].file_struct = NULL;
+    vfs_release_fd(task->files, fd);
 
     // Call the close function.
     return vfs_close(file);
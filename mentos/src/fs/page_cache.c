@@ -0,0 +1,521 @@
+/// @file page_cache.c
+/// @brief Cache of the pages of regular files, used by file mappings.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+// Setup the logging for this file (do this before any other include).
+#include "sys/kernel_levels.h"           // Include kernel log levels.
+#define __DEBUG_HEADER__ "[PCACHE]"      ///< Change header.
+#define __DEBUG_LEVEL__  LOGLEVEL_NOTICE ///< Set log level.
+#include "io/debug.h"                    // Include debugging functions.
+
+#include "fs/page_cache.h"
+
+#include "klib/hashmap.h"
+#include "klib/radix_tree.h"
+#include "klib/spinlock.h"
+#include "math.h"
+#include "mem/paging.h"
+#include "mem/shrinker.h"
+#include "mem/slab.h"
+#include "mem/vmem_map.h"
+#include "string.h"
+#include "sys/errno.h"
+
+/// Number of buckets of the hashmap.
+#define PAGE_CACHE_BUCKETS 257
+/// Minimum number of cached pages above which unused pages are dropped.
+#define PAGE_CACHE_MAX_PAGES 1024
+/// Number of entries collected at once when walking the pages of an inode.
+#define PAGE_CACHE_BATCH 16
+/// Number of pages read at once when a page is missing, if the filesystem
+/// can read many pages with a single call.
+#define PAGE_CACHE_READAHEAD 8
+
+/// @brief The cached pages of an inode.
+typedef struct page_cache_mapping_t {
+    /// The inode, the index is always 0.
+    page_cache_key_t key;
+    /// The entries, by index of the page.
+    radix_tree_t pages;
+} page_cache_mapping_t;
+
+/// @brief The page cache.
+static struct {
+    /// Maps (owner, ino) to the mapping of the inode.
+    hashmap_t *map;
+    /// All the cached pages, the least recently used comes first.
+    list_head lru;
+    /// Number of cached pages.
+    unsigned int size;
+    /// Cache for the entries.
+    kmem_cache_t *entry_cache;
+    /// Number of cached pages above which unused pages are dropped, below it
+    /// they are dropped by the shrinker, when memory runs low.
+    unsigned int max_pages;
+    /// Protects the cache.
+    spinlock_t lock;
+} page_cache;
+
+/// @brief Hashes a page cache key.
+/// @param key pointer to the page_cache_key_t.
+/// @return the hash key.
+static unsigned int page_cache_key_hash(const void *key)
+{
+    const page_cache_key_t *pkey = (const page_cache_key_t *)key;
+    return ((((uintptr_t)pkey->owner * 31U) ^ pkey->ino) * 31U) ^ pkey->index;
+}
+
+/// @brief Compares two page cache keys.
+/// @param a the first page_cache_key_t.
+/// @param b the second page_cache_key_t.
+/// @return 1 if they are equal, 0 otherwise.
+static int page_cache_key_comp(const void *a, const void *b)
+{
+    const page_cache_key_t *ka = (const page_cache_key_t *)a, *kb = (const page_cache_key_t *)b;
+    return (ka->owner == kb->owner) && (ka->ino == kb->ino) && (ka->index == kb->index);
+}
+
+/// @brief Searches the pages of the inode of a file.
+/// @param file the file.
+/// @param create 1 to create the mapping if the inode has no page cached.
+/// @return the mapping, NULL if not found or if it could not be created.
+static inline page_cache_mapping_t *__page_cache_mapping(vfs_file_t *file, int create)
+{
+    page_cache_key_t key          = { .owner = file->device, .ino = file->ino, .index = 0 };
+    page_cache_mapping_t *mapping = hashmap_get(page_cache.map, &key);
+    if ((mapping == NULL) && create) {
+        if ((mapping = kmalloc(sizeof(page_cache_mapping_t))) == NULL) {
+            return NULL;
+        }
+        mapping->key = key;
+        radix_tree_init(&mapping->pages);
+        hashmap_set(page_cache.map, &mapping->key, mapping);
+    }
+    return mapping;
+}
+
+/// @brief Searches the entry inside the cache.
+/// @param file the file.
+/// @param index the index of the page inside the file.
+/// @return the entry, NULL if not cached.
+static inline page_cache_entry_t *__page_cache_lookup(vfs_file_t *file, uint32_t index)
+{
+    page_cache_mapping_t *mapping = __page_cache_mapping(file, 0);
+    return mapping ? radix_tree_lookup(&mapping->pages, index) : NULL;
+}
+
+/// @brief Checks if the page has been modified since it was last written.
+/// @param entry the entry.
+/// @return 1 if it is dirty, 0 otherwise.
+static inline int __page_cache_is_dirty(page_cache_entry_t *entry)
+{
+    return radix_tree_tag_get(&entry->mapping->pages, entry->key.index, RADIX_TREE_TAG_DIRTY);
+}
+
+/// @brief Frees the mapping of an inode, once its last page is gone.
+/// @param mapping the mapping.
+static inline void __page_cache_put_mapping(page_cache_mapping_t *mapping)
+{
+    if (mapping->pages.count == 0) {
+        hashmap_remove(page_cache.map, &mapping->key);
+        radix_tree_destroy(&mapping->pages);
+        kfree(mapping);
+    }
+}
+
+/// @brief Writes the pages back to their file.
+/// @param file the file.
+/// @param entries the entries, at most PAGE_CACHE_BATCH, by increasing index.
+/// @param count the number of entries.
+/// @return 0 on success, -errno if some page could not be written.
+/// @details The filesystem writes all the pages with a single call, when it
+/// can, otherwise they are written one at a time.
+static int __page_cache_write_back(vfs_file_t *file, page_cache_entry_t **entries, unsigned int count)
+{
+    page_t *pages[PAGE_CACHE_BATCH];
+    uint32_t indices[PAGE_CACHE_BATCH];
+    int ret = 0;
+    if (count == 0) {
+        return 0;
+    }
+    if (file->fs_operations->writepages_f) {
+        for (unsigned int it = 0; it < count; ++it) {
+            pages[it]   = entries[it]->page;
+            indices[it] = entries[it]->key.index;
+        }
+        if (file->fs_operations->writepages_f(file, pages, indices, count) < 0) {
+            pr_err("Failed to write back pages %u-%u of `%s`.\n", indices[0], indices[count - 1], file->name);
+            return -EIO;
+        }
+        for (unsigned int it = 0; it < count; ++it) {
+            radix_tree_tag_clear(&entries[it]->mapping->pages, indices[it], RADIX_TREE_TAG_DIRTY);
+        }
+        return 0;
+    }
+    for (unsigned int it = 0; it < count; ++it) {
+        page_cache_entry_t *entry = entries[it];
+        size_t offset             = entry->key.index * PAGE_SIZE;
+        ssize_t written           = 0;
+        // Mappings cannot make the file grow.
+        if (offset < file->length) {
+            uint32_t vaddr = virt_kmap(entry->page);
+            // Bypass vfs_write, which would copy the data back inside the page.
+            written = file->fs_operations->write_f(file, (void *)vaddr, offset, min(PAGE_SIZE, file->length - offset));
+            virt_kunmap(vaddr);
+        }
+        if (written < 0) {
+            pr_err("Failed to write back page %u of `%s`.\n", entry->key.index, file->name);
+            ret = -EIO;
+            continue;
+        }
+        radix_tree_tag_clear(&entry->mapping->pages, entry->key.index, RADIX_TREE_TAG_DIRTY);
+    }
+    return ret;
+}
+
+/// @brief Reads pages of the file into page frames.
+/// @param file the file.
+/// @param pages the page frames.
+/// @param indices the indices of the pages, increasing.
+/// @param count the number of pages.
+/// @return 0 on success, -errno on failure.
+/// @details The filesystem reads all the pages with a single call, when it
+/// can, otherwise they are read one at a time.
+static int __page_cache_read(vfs_file_t *file, page_t **pages, const uint32_t *indices, unsigned int count)
+{
+    vfs_file_operations_t *ops = file->fs_operations;
+    if ((count > 1) && ops->readpages_f) {
+        return ops->readpages_f(file, pages, indices, count);
+    }
+    for (unsigned int it = 0; it < count; ++it) {
+        if (ops->readpage_f) {
+            int ret = ops->readpage_f(file, pages[it], indices[it]);
+            if (ret < 0) {
+                return ret;
+            }
+            continue;
+        }
+        uint32_t vaddr = virt_kmap(pages[it]);
+        // The part past the end of the file reads as zeros.
+        memset((void *)vaddr, 0, PAGE_SIZE);
+        ssize_t read = ops->read_f(file, (char *)vaddr, indices[it] * PAGE_SIZE, PAGE_SIZE);
+        virt_kunmap(vaddr);
+        if (read < 0) {
+            return -EIO;
+        }
+    }
+    return 0;
+}
+
+/// @brief Removes the entry from the cache and frees it.
+/// @param entry the entry.
+static void __page_cache_destroy(page_cache_entry_t *entry)
+{
+    radix_tree_delete(&entry->mapping->pages, entry->key.index);
+    __page_cache_put_mapping(entry->mapping);
+    list_head_remove(&entry->lru);
+    // Pages still mapped somewhere are freed by their last user.
+    page_cache_put(entry->page);
+    kmem_cache_free(entry);
+    --page_cache.size;
+}
+
+/// @brief Drops the least recently used pages which are clean and not mapped.
+/// @param nr_pages the number of pages to drop.
+/// @return the number of pages dropped.
+static unsigned long __page_cache_drop(unsigned long nr_pages)
+{
+    unsigned long dropped = 0;
+    list_for_each_safe_decl(it, store, &page_cache.lru)
+    {
+        if (dropped >= nr_pages) {
+            break;
+        }
+        page_cache_entry_t *entry = list_entry(it, page_cache_entry_t, lru);
+        // Only the cache is using the page.
+        if (!__page_cache_is_dirty(entry) && (page_count(entry->page) == 1)) {
+            __page_cache_destroy(entry);
+            ++dropped;
+        }
+    }
+    return dropped;
+}
+
+/// @brief Drops unused pages, until the cache is back under its limit.
+static inline void __page_cache_shrink(void)
+{
+    if (page_cache.size > page_cache.max_pages) {
+        __page_cache_drop(page_cache.size - page_cache.max_pages);
+    }
+}
+
+/// @brief Returns the number of pages the shrinker could drop.
+/// @return the number of cached pages.
+static unsigned long __page_cache_count_objects(void)
+{
+    return page_cache.size;
+}
+
+/// @brief Drops unused pages, to give memory back under pressure.
+/// @param nr_to_scan the number of pages to drop.
+/// @return the number of pages dropped.
+static unsigned long __page_cache_scan_objects(unsigned long nr_to_scan)
+{
+    // The cache might be allocating memory itself.
+    if (!spinlock_trylock(&page_cache.lock)) {
+        return 0;
+    }
+    unsigned long dropped = __page_cache_drop(nr_to_scan);
+    spinlock_unlock(&page_cache.lock);
+    return dropped;
+}
+
+/// The shrinker of the page cache.
+static shrinker_t page_cache_shrinker = {
+    .name          = "page cache",
+    .count_objects = __page_cache_count_objects,
+    .scan_objects  = __page_cache_scan_objects,
+};
+
+void page_cache_init(void)
+{
+    page_cache.map = hashmap_create(
+        PAGE_CACHE_BUCKETS,
+        page_cache_key_hash,
+        page_cache_key_comp,
+        hashmap_do_not_duplicate,
+        hashmap_do_not_free);
+    list_head_init(&page_cache.lru);
+    page_cache.size        = 0;
+    page_cache.entry_cache = KMEM_CREATE(page_cache_entry_t);
+    // The cache can take up to half of the high memory, the shrinker gives
+    // it back when the memory runs low.
+    page_cache.max_pages = max(PAGE_CACHE_MAX_PAGES, get_zone_total_space(GFP_HIGHUSER) / PAGE_SIZE / 2);
+    spinlock_init(&page_cache.lock);
+    register_shrinker(&page_cache_shrinker);
+}
+
+int page_cache_contains(vfs_file_t *file, uint32_t index)
+{
+    spinlock_lock(&page_cache.lock);
+    int cached = __page_cache_lookup(file, index) != NULL;
+    spinlock_unlock(&page_cache.lock);
+    return cached;
+}
+
+/// @brief Adds a page which has just been read to the cache.
+/// @param file the file.
+/// @param index the index of the page inside the file.
+/// @param page the page frame.
+/// @return the entry, NULL if the page could not be cached.
+/// @details If someone else cached the page in the meanwhile, the page frame
+/// is freed and their entry is returned.
+static page_cache_entry_t *__page_cache_insert(vfs_file_t *file, uint32_t index, page_t *page)
+{
+    page_cache_entry_t *entry = __page_cache_lookup(file, index);
+    if (entry) {
+        __free_pages(page);
+        return entry;
+    }
+    // Make room for the new page.
+    __page_cache_shrink();
+    page_cache_mapping_t *mapping = __page_cache_mapping(file, 1);
+    entry                         = mapping ? kmem_cache_alloc(page_cache.entry_cache, GFP_KERNEL) : NULL;
+    if (entry && (radix_tree_insert(&mapping->pages, index, entry) < 0)) {
+        kmem_cache_free(entry);
+        entry = NULL;
+    }
+    if (entry == NULL) {
+        if (mapping) {
+            __page_cache_put_mapping(mapping);
+        }
+        return NULL;
+    }
+    entry->key.owner = file->device;
+    entry->key.ino   = file->ino;
+    entry->key.index = index;
+    entry->page      = page;
+    entry->file      = file;
+    entry->mapping   = mapping;
+    list_head_insert_before(&entry->lru, &page_cache.lru);
+    ++page_cache.size;
+    return entry;
+}
+
+page_t *page_cache_get(vfs_file_t *file, uint32_t index)
+{
+    page_cache_entry_t *entry;
+    spinlock_lock(&page_cache.lock);
+    entry = __page_cache_lookup(file, index);
+    if (entry) {
+        page_inc(entry->page);
+        entry->file = file;
+        // Move the entry to the most recently used position.
+        list_head_remove(&entry->lru);
+        list_head_insert_before(&entry->lru, &page_cache.lru);
+        spinlock_unlock(&page_cache.lock);
+        return entry->page;
+    }
+    spinlock_unlock(&page_cache.lock);
+    if ((file->fs_operations->read_f == NULL) && (file->fs_operations->readpage_f == NULL)) {
+        return NULL;
+    }
+    // When the filesystem reads many pages at once, read the following ones
+    // too: files are mostly read in order.
+    page_t *pages[PAGE_CACHE_READAHEAD];
+    uint32_t indices[PAGE_CACHE_READAHEAD] = { index };
+    unsigned int count                     = 1;
+    while (file->fs_operations->readpages_f && (count < PAGE_CACHE_READAHEAD) &&
+           (((index + count) * PAGE_SIZE) < file->length) && !page_cache_contains(file, index + count)) {
+        indices[count] = index + count;
+        ++count;
+    }
+    for (unsigned int it = 0; it < count; ++it) {
+        if ((pages[it] = _alloc_pages(GFP_HIGHUSER, 0)) == NULL) {
+            if (it == 0) {
+                pr_err("Failed to allocate a page for `%s`.\n", file->name);
+                return NULL;
+            }
+            count = it;
+        }
+    }
+    // Read the pages, without holding the lock, the filesystem has its own.
+    if (__page_cache_read(file, pages, indices, count) < 0) {
+        pr_err("Failed to read page %u of `%s`.\n", index, file->name);
+        for (unsigned int it = 0; it < count; ++it) {
+            __free_pages(pages[it]);
+        }
+        return NULL;
+    }
+    page_t *page = pages[0];
+    spinlock_lock(&page_cache.lock);
+    for (unsigned int it = 0; it < count; ++it) {
+        // Someone else might have read the page in the meanwhile.
+        entry = __page_cache_insert(file, indices[it], pages[it]);
+        if (it == 0) {
+            if (entry) {
+                entry->file = file;
+                page        = entry->page;
+                // One reference for the cache, one for the caller.
+                page_inc(page);
+            }
+            // Otherwise, hand out the page anyway, it is just not going to be shared.
+        } else if (entry == NULL) {
+            __free_pages(pages[it]);
+        }
+    }
+    spinlock_unlock(&page_cache.lock);
+    return page;
+}
+
+void page_cache_put(page_t *page)
+{
+    if (page_count(page) > 1) {
+        page_dec(page);
+    } else {
+        __free_pages(page);
+    }
+}
+
+void page_cache_mark_dirty(vfs_file_t *file, uint32_t index)
+{
+    spinlock_lock(&page_cache.lock);
+    page_cache_entry_t *entry = __page_cache_lookup(file, index);
+    if (entry) {
+        entry->file = file;
+        radix_tree_tag_set(&entry->mapping->pages, index, RADIX_TREE_TAG_DIRTY);
+    }
+    spinlock_unlock(&page_cache.lock);
+}
+
+void page_cache_update(vfs_file_t *file, const void *buffer, size_t offset, size_t nbytes)
+{
+    page_cache_entry_t *entry;
+    size_t page_offset, size;
+    spinlock_lock(&page_cache.lock);
+    while (nbytes > 0) {
+        page_offset = offset % PAGE_SIZE;
+        size        = min(nbytes, PAGE_SIZE - page_offset);
+        entry       = __page_cache_lookup(file, offset / PAGE_SIZE);
+        if (entry) {
+            uint32_t vaddr = virt_kmap(entry->page);
+            memcpy((char *)vaddr + page_offset, buffer, size);
+            virt_kunmap(vaddr);
+        }
+        buffer = (const char *)buffer + size;
+        offset += size;
+        nbytes -= size;
+    }
+    spinlock_unlock(&page_cache.lock);
+}
+
+int page_cache_sync(vfs_file_t *file)
+{
+    page_cache_entry_t *entries[PAGE_CACHE_BATCH];
+    unsigned long indices[PAGE_CACHE_BATCH];
+    int ret = 0;
+    spinlock_lock(&page_cache.lock);
+    page_cache_mapping_t *mapping = __page_cache_mapping(file, 0);
+    unsigned long first           = 0;
+    unsigned int count            = PAGE_CACHE_BATCH;
+    // Only the dirty pages are visited, however many clean ones are cached.
+    while (mapping && (count == PAGE_CACHE_BATCH)) {
+        count = radix_tree_gang_lookup_tag(&mapping->pages, (void **)entries, indices, first, PAGE_CACHE_BATCH, RADIX_TREE_TAG_DIRTY);
+        for (unsigned int it = 0; it < count; ++it) {
+            entries[it]->file = file;
+        }
+        if (__page_cache_write_back(file, entries, count) < 0) {
+            ret = -EIO;
+        }
+        first = indices[count ? count - 1 : 0] + 1;
+    }
+    spinlock_unlock(&page_cache.lock);
+    return ret;
+}
+
+void page_cache_release(vfs_file_t *file)
+{
+    page_cache_entry_t *entries[PAGE_CACHE_BATCH], *dirty_entries[PAGE_CACHE_BATCH];
+    unsigned long indices[PAGE_CACHE_BATCH];
+    spinlock_lock(&page_cache.lock);
+    page_cache_mapping_t *mapping = __page_cache_mapping(file, 0);
+    unsigned long first           = 0;
+    unsigned int count            = PAGE_CACHE_BATCH;
+    while (mapping && (count == PAGE_CACHE_BATCH)) {
+        count = radix_tree_gang_lookup(&mapping->pages, (void **)entries, indices, first, PAGE_CACHE_BATCH);
+        unsigned int dirty = 0;
+        for (unsigned int it = 0; it < count; ++it) {
+            if (__page_cache_is_dirty(entries[it])) {
+                dirty_entries[dirty++] = entries[it];
+            }
+        }
+        __page_cache_write_back(file, dirty_entries, dirty);
+        for (unsigned int it = 0; it < count; ++it) {
+            // The file structure is about to be freed.
+            entries[it]->file = NULL;
+        }
+        first = indices[count ? count - 1 : 0] + 1;
+    }
+    spinlock_unlock(&page_cache.lock);
+}
+
+void page_cache_invalidate(const void *owner, uint32_t ino)
+{
+    page_cache_entry_t *entries[PAGE_CACHE_BATCH];
+    page_cache_key_t key = { .owner = owner, .ino = ino, .index = 0 };
+    spinlock_lock(&page_cache.lock);
+    page_cache_mapping_t *mapping = hashmap_get(page_cache.map, &key);
+    while (mapping) {
+        unsigned int count = radix_tree_gang_lookup(&mapping->pages, (void **)entries, NULL, 0, PAGE_CACHE_BATCH);
+        // Destroying the last entry frees the mapping too.
+        int last = (count == mapping->pages.count);
+        for (unsigned int it = 0; it < count; ++it) {
+            __page_cache_destroy(entries[it]);
+        }
+        if (last) {
+            break;
+        }
+    }
+    spinlock_unlock(&page_cache.lock);
+}
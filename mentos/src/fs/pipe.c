@@ -0,0 +1,631 @@
+/// @file pipe.c
+/// @brief Pipes, streaming data between processes through a kernel buffer.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// A pipe is a ring of PIPE_BUFFER_SIZE bytes, with a VFS file for each of
+/// its ends. The processes cannot sleep inside the kernel, thus a reader
+/// finding the ring empty, or a writer finding it full, is queued and put to
+/// sleep, and the system call returns -ERESTARTSYS: once woken up, the
+/// process executes it again.
+
+// Setup the logging for this file (do this before any other include).
+#include "sys/kernel_levels.h"           // Include kernel log levels.
+#define __DEBUG_HEADER__ "[PIPE  ]"      ///< Change header.
+#define __DEBUG_LEVEL__  LOGLEVEL_NOTICE ///< Set log level.
+#include "io/debug.h"                    // Include debugging functions.
+
+#include "fcntl.h"
+#include "fs/pipe.h"
+#include "fs/poll.h"
+#include "fs/vfs.h"
+#include "klib/spinlock.h"
+#include "limits.h"
+#include "math.h"
+#include "mem/kheap.h"
+#include "mem/slab.h"
+#include "mem/zone_allocator.h"
+#include "poll.h"
+#include "process/scheduler.h"
+#include "process/wait.h"
+#include "stdio.h"
+#include "string.h"
+#include "sys/errno.h"
+#include "sys/splice.h"
+#include "system/signal.h"
+#include "system/syscall.h"
+
+/// @brief A pipe.
+typedef struct pipe_t {
+    /// The ring, in the kernel memory.
+    char *buffer;
+    /// The position after the last byte written, runs freely.
+    unsigned int head;
+    /// The position of the next byte to read, runs freely.
+    unsigned int tail;
+    /// The read end, NULL once it is closed.
+    vfs_file_t *reader;
+    /// The write end, NULL once it is closed.
+    vfs_file_t *writer;
+    /// The processes waiting for data.
+    wait_queue_head_t rd_wait;
+    /// The processes waiting for room.
+    wait_queue_head_t wr_wait;
+    /// Protects the ring and the ends.
+    spinlock_t lock;
+} pipe_t;
+
+/// The inode given to the next pipe.
+static uint32_t pipe_ino = 0;
+
+/// @brief Queues the calling process, which sleeps once it returns from the
+/// system call.
+/// @param head the queue.
+static inline void __pipe_sleep(wait_queue_head_t *head)
+{
+    // The entry is removed, and freed, by whoever wakes us up.
+    sleep_on(head)->func = autoremove_wake_function;
+}
+
+/// @brief Checks that a pipe holds data, otherwise queues the process.
+/// @param pipe the pipe, locked.
+/// @param nonblock if the process must not sleep.
+/// @return 1 if there is data, 0 at the end of the file, -EAGAIN, or
+/// -ERESTARTSYS if the process is going to sleep.
+static inline int __pipe_wait_data(pipe_t *pipe, int nonblock)
+{
+    if (pipe->head != pipe->tail) {
+        return 1;
+    }
+    // Nobody can write anymore, it is the end of the file.
+    if (pipe->writer == NULL) {
+        return 0;
+    }
+    if (nonblock) {
+        return -EAGAIN;
+    }
+    // Queue ourselves before unlocking, so that no write is missed.
+    __pipe_sleep(&pipe->rd_wait);
+    return -ERESTARTSYS;
+}
+
+/// @brief Checks that a pipe has room, otherwise queues the process.
+/// @param pipe the pipe, locked.
+/// @param needed the number of bytes which must fit.
+/// @param nonblock if the process must not sleep.
+/// @return 1 if there is room, -EPIPE if nobody can read, -EAGAIN, or
+/// -ERESTARTSYS if the process is going to sleep.
+static inline int __pipe_wait_room(pipe_t *pipe, size_t needed, int nonblock)
+{
+    if (pipe->reader == NULL) {
+        return -EPIPE;
+    }
+    if (PIPE_BUFFER_SIZE - (pipe->head - pipe->tail) >= needed) {
+        return 1;
+    }
+    if (nonblock) {
+        return -EAGAIN;
+    }
+    // Queue ourselves before unlocking, so that no read is missed.
+    __pipe_sleep(&pipe->wr_wait);
+    return -ERESTARTSYS;
+}
+
+/// @brief Returns the error of a write, sending SIGPIPE if the pipe is broken.
+/// @param ret the error.
+/// @return the error.
+static inline int __pipe_write_error(int ret)
+{
+    if (ret == -EPIPE) {
+        sys_kill(scheduler_get_current_process()->pid, SIGPIPE);
+    }
+    return ret;
+}
+
+/// @brief Copies data out of a pipe, without consuming it.
+/// @param pipe the pipe, locked.
+/// @param skip the bytes to skip, from the oldest one.
+/// @param buf where the data is copied.
+/// @param count the number of bytes, at most those held after the skipped ones.
+static inline void __pipe_peek(pipe_t *pipe, size_t skip, char *buf, size_t count)
+{
+    // In two pieces, if it wraps around the ring.
+    size_t start = (pipe->tail + skip) % PIPE_BUFFER_SIZE;
+    size_t first = min(count, PIPE_BUFFER_SIZE - start);
+    memcpy(buf, pipe->buffer + start, first);
+    memcpy(buf + first, pipe->buffer, count - first);
+}
+
+/// @brief Copies data inside a pipe.
+/// @param pipe the pipe, locked.
+/// @param buf the data.
+/// @param count the number of bytes, at most the room left.
+static inline void __pipe_push(pipe_t *pipe, const char *buf, size_t count)
+{
+    // In two pieces, if it wraps around the ring.
+    size_t start = pipe->head % PIPE_BUFFER_SIZE;
+    size_t first = min(count, PIPE_BUFFER_SIZE - start);
+    memcpy(pipe->buffer + start, buf, first);
+    memcpy(pipe->buffer, buf + first, count - first);
+    pipe->head += count;
+}
+
+static ssize_t __pipe_read(vfs_file_t *file, char *buf, off_t offset, size_t nbyte)
+{
+    pipe_t *pipe = (pipe_t *)file->device;
+    (void)offset;
+    if (nbyte == 0) {
+        return 0;
+    }
+    spinlock_lock(&pipe->lock);
+    int ret = __pipe_wait_data(pipe, bitmask_check(file->open_flags, O_NONBLOCK));
+    if (ret <= 0) {
+        spinlock_unlock(&pipe->lock);
+        return ret;
+    }
+    size_t count = min(nbyte, pipe->head - pipe->tail);
+    __pipe_peek(pipe, 0, buf, count);
+    pipe->tail += count;
+    spinlock_unlock(&pipe->lock);
+    // There is room, now.
+    wake_up(&pipe->wr_wait);
+    return count;
+}
+
+static ssize_t __pipe_write(vfs_file_t *file, const void *buf, off_t offset, size_t nbyte)
+{
+    pipe_t *pipe = (pipe_t *)file->device;
+    (void)offset;
+    if (nbyte == 0) {
+        return 0;
+    }
+    spinlock_lock(&pipe->lock);
+    // Writes of up to PIPE_BUF bytes are not mixed with the others, thus they
+    // wait for the room for all of them, the larger ones can be partial.
+    int ret = __pipe_wait_room(pipe, (nbyte <= PIPE_BUF) ? nbyte : 1, bitmask_check(file->open_flags, O_NONBLOCK));
+    if (ret <= 0) {
+        spinlock_unlock(&pipe->lock);
+        return __pipe_write_error(ret);
+    }
+    size_t count = min(nbyte, PIPE_BUFFER_SIZE - (pipe->head - pipe->tail));
+    __pipe_push(pipe, (const char *)buf, count);
+    spinlock_unlock(&pipe->lock);
+    // There is data, now.
+    wake_up(&pipe->rd_wait);
+    return count;
+}
+
+static off_t __pipe_lseek(vfs_file_t *file, off_t offset, int whence)
+{
+    (void)file, (void)offset, (void)whence;
+    return -ESPIPE;
+}
+
+static int __pipe_fstat(vfs_file_t *file, stat_t *stat)
+{
+    pipe_t *pipe = (pipe_t *)file->device;
+    memset(stat, 0, sizeof(stat_t));
+    // A FIFO.
+    stat->st_mode  = 0010000 | file->mask;
+    stat->st_uid   = file->uid;
+    stat->st_gid   = file->gid;
+    stat->st_ino   = file->ino;
+    stat->st_size  = pipe->head - pipe->tail;
+    stat->st_atime = file->atime;
+    stat->st_mtime = file->mtime;
+    stat->st_ctime = file->ctime;
+    return 0;
+}
+
+static int __pipe_close(vfs_file_t *file)
+{
+    pipe_t *pipe = (pipe_t *)file->device;
+    spinlock_lock(&pipe->lock);
+    if (file == pipe->reader) {
+        pipe->reader = NULL;
+    } else {
+        pipe->writer = NULL;
+    }
+    bool_t unused = (pipe->reader == NULL) && (pipe->writer == NULL);
+    spinlock_unlock(&pipe->lock);
+    // The readers see the end of the file, the writers a broken pipe.
+    wake_up(&pipe->rd_wait);
+    wake_up(&pipe->wr_wait);
+    kmem_cache_free(file);
+    if (unused) {
+        pr_debug("Freeing pipe 0x%p.\n", pipe);
+        free_pages_lowmem((uintptr_t)pipe->buffer);
+        kfree(pipe);
+    }
+    return 0;
+}
+
+/// @brief Returns the events ready on an end of a pipe.
+/// @param file the end.
+/// @param table the table of the polling process, NULL if it does not sleep.
+/// @return the events.
+static unsigned int __pipe_poll(vfs_file_t *file, struct poll_table_t *table)
+{
+    pipe_t *pipe      = (pipe_t *)file->device;
+    unsigned int mask = 0;
+    // Queue the process first, so that a change after the checks wakes it.
+    poll_wait(file, (file == pipe->reader) ? &pipe->rd_wait : &pipe->wr_wait, table);
+    spinlock_lock(&pipe->lock);
+    if (file == pipe->reader) {
+        if (pipe->head != pipe->tail) {
+            mask |= POLLIN | POLLRDNORM;
+        }
+        if (pipe->writer == NULL) {
+            mask |= POLLHUP;
+        }
+    } else {
+        // Writing does not block only if an atomic write fits.
+        if (PIPE_BUFFER_SIZE - (pipe->head - pipe->tail) >= PIPE_BUF) {
+            mask |= POLLOUT | POLLWRNORM;
+        }
+        if (pipe->reader == NULL) {
+            mask |= POLLERR;
+        }
+    }
+    spinlock_unlock(&pipe->lock);
+    return mask;
+}
+
+/// Filesystem general operations.
+static vfs_sys_operations_t pipe_sys_operations = {
+    .mkdir_f   = NULL,
+    .rmdir_f   = NULL,
+    .stat_f    = NULL,
+    .creat_f   = NULL,
+    .symlink_f = NULL,
+};
+
+/// Filesystem file operations.
+static vfs_file_operations_t pipe_fs_operations = {
+    .open_f     = NULL,
+    .unlink_f   = NULL,
+    .close_f    = __pipe_close,
+    .read_f     = __pipe_read,
+    .write_f    = __pipe_write,
+    .lseek_f    = __pipe_lseek,
+    .stat_f     = __pipe_fstat,
+    .ioctl_f    = NULL,
+    .getdents_f = NULL,
+    .readlink_f = NULL,
+    .poll_f     = __pipe_poll,
+};
+
+/// @brief Returns the pipe of a file.
+/// @param file the file.
+/// @return the pipe, NULL if the file is not an end of a pipe.
+static inline pipe_t *__pipe_of(vfs_file_t *file)
+{
+    return (file->fs_operations == &pipe_fs_operations) ? (pipe_t *)file->device : NULL;
+}
+
+/// @brief Locks two pipes, always in the same order.
+/// @param a the first pipe.
+/// @param b the second pipe.
+static inline void __pipe_lock_two(pipe_t *a, pipe_t *b)
+{
+    spinlock_lock((a < b) ? &a->lock : &b->lock);
+    spinlock_lock((a < b) ? &b->lock : &a->lock);
+}
+
+/// @brief Unlocks two pipes.
+/// @param a the first pipe.
+/// @param b the second pipe.
+static inline void __pipe_unlock_two(pipe_t *a, pipe_t *b)
+{
+    spinlock_unlock(&a->lock);
+    spinlock_unlock(&b->lock);
+}
+
+/// @brief Returns the file of a descriptor of the calling process.
+/// @param fd the descriptor.
+/// @param write if the file is going to be written, otherwise read.
+/// @param file where the file is placed.
+/// @return 0 on success, -EBADF otherwise.
+static inline int __splice_get_file(int fd, int write, vfs_file_t **file)
+{
+    task_struct *task = scheduler_get_current_process();
+    if ((fd < 0) || (fd >= task->files->max_fd) || (task->files->fd_list[fd].file_struct == NULL)) {
+        return -EBADF;
+    }
+    int mode = task->files->fd_list[fd].flags_mask & O_ACCMODE;
+    if ((write && (mode == O_RDONLY)) || (!write && (mode == O_WRONLY))) {
+        return -EBADF;
+    }
+    *file = task->files->fd_list[fd].file_struct;
+    return 0;
+}
+
+/// @brief Copies data from a pipe to another.
+/// @param in the pipe the data is taken from.
+/// @param out the pipe the data is copied to.
+/// @param len the maximum number of bytes.
+/// @param nonblock if the process must not sleep.
+/// @param consume if the data is removed from the first pipe.
+/// @return the number of bytes copied, -errno on failure.
+static ssize_t __splice_pipes(pipe_t *in, pipe_t *out, size_t len, int nonblock, int consume)
+{
+    __pipe_lock_two(in, out);
+    int ret = __pipe_wait_data(in, nonblock);
+    if (ret > 0) {
+        ret = __pipe_wait_room(out, 1, nonblock);
+    }
+    if (ret <= 0) {
+        __pipe_unlock_two(in, out);
+        return __pipe_write_error(ret);
+    }
+    size_t count = min(len, min(in->head - in->tail, PIPE_BUFFER_SIZE - (out->head - out->tail)));
+    // Copy from ring to ring, a contiguous piece of the source at a time.
+    for (size_t done = 0, chunk; done < count; done += chunk) {
+        size_t start = (in->tail + done) % PIPE_BUFFER_SIZE;
+        chunk        = min(count - done, PIPE_BUFFER_SIZE - start);
+        __pipe_push(out, in->buffer + start, chunk);
+    }
+    if (consume) {
+        in->tail += count;
+    }
+    __pipe_unlock_two(in, out);
+    if (consume) {
+        wake_up(&in->wr_wait);
+    }
+    wake_up(&out->rd_wait);
+    return count;
+}
+
+/// @brief Writes data from a pipe to a file, straight from the ring.
+/// @param pipe the pipe.
+/// @param file the file.
+/// @param offset the position inside the file, NULL to use its offset.
+/// @param len the maximum number of bytes.
+/// @param nonblock if the process must not sleep.
+/// @return the number of bytes moved, -errno on failure.
+static ssize_t __splice_to_file(pipe_t *pipe, vfs_file_t *file, off_t *offset, size_t len, int nonblock)
+{
+    off_t pos = offset ? *offset : (off_t)file->f_pos;
+    if (pos < 0) {
+        return -EINVAL;
+    }
+    spinlock_lock(&pipe->lock);
+    int ret = __pipe_wait_data(pipe, nonblock);
+    if (ret <= 0) {
+        spinlock_unlock(&pipe->lock);
+        return ret;
+    }
+    size_t count  = min(len, pipe->head - pipe->tail);
+    ssize_t total = 0;
+    while ((size_t)total < count) {
+        // A contiguous piece of the ring at a time.
+        size_t start    = pipe->tail % PIPE_BUFFER_SIZE;
+        size_t chunk    = min(count - total, PIPE_BUFFER_SIZE - start);
+        ssize_t written = vfs_write(file, pipe->buffer + start, pos, chunk);
+        if (written <= 0) {
+            if (total == 0) {
+                total = written;
+            }
+            break;
+        }
+        pipe->tail += written;
+        pos += written;
+        total += written;
+        if ((size_t)written < chunk) {
+            break;
+        }
+    }
+    spinlock_unlock(&pipe->lock);
+    if (total > 0) {
+        if (offset) {
+            *offset = pos;
+        } else {
+            file->f_pos = pos;
+        }
+        // There is room, now.
+        wake_up(&pipe->wr_wait);
+    }
+    return total;
+}
+
+/// @brief Reads data from a file to a pipe, straight into the ring.
+/// @param file the file.
+/// @param offset the position inside the file, NULL to use its offset.
+/// @param pipe the pipe.
+/// @param len the maximum number of bytes.
+/// @param nonblock if the process must not sleep.
+/// @return the number of bytes moved, -errno on failure.
+static ssize_t __splice_from_file(vfs_file_t *file, off_t *offset, pipe_t *pipe, size_t len, int nonblock)
+{
+    off_t pos = offset ? *offset : (off_t)file->f_pos;
+    if (pos < 0) {
+        return -EINVAL;
+    }
+    spinlock_lock(&pipe->lock);
+    int ret = __pipe_wait_room(pipe, 1, nonblock);
+    if (ret <= 0) {
+        spinlock_unlock(&pipe->lock);
+        return __pipe_write_error(ret);
+    }
+    size_t count  = min(len, PIPE_BUFFER_SIZE - (pipe->head - pipe->tail));
+    ssize_t total = 0;
+    while ((size_t)total < count) {
+        // A contiguous piece of the ring at a time.
+        size_t start  = pipe->head % PIPE_BUFFER_SIZE;
+        size_t chunk  = min(count - total, PIPE_BUFFER_SIZE - start);
+        ssize_t nread = vfs_read(file, pipe->buffer + start, pos, chunk);
+        if (nread <= 0) {
+            if (total == 0) {
+                total = nread;
+            }
+            break;
+        }
+        pipe->head += nread;
+        pos += nread;
+        total += nread;
+        if ((size_t)nread < chunk) {
+            break;
+        }
+    }
+    spinlock_unlock(&pipe->lock);
+    if (total > 0) {
+        if (offset) {
+            *offset = pos;
+        } else {
+            file->f_pos = pos;
+        }
+        // There is data, now.
+        wake_up(&pipe->rd_wait);
+    }
+    return total;
+}
+
+ssize_t sys_splice(int fd_in, off_t *off_in, int fd_out, off_t *off_out, size_t len, unsigned int flags)
+{
+    vfs_file_t *in, *out;
+    int ret;
+    if ((ret = __splice_get_file(fd_in, 0, &in)) < 0) {
+        return ret;
+    }
+    if ((ret = __splice_get_file(fd_out, 1, &out)) < 0) {
+        return ret;
+    }
+    pipe_t *in_pipe = __pipe_of(in), *out_pipe = __pipe_of(out);
+    // At least one of them must be a pipe, and a pipe has no position.
+    if ((in_pipe == NULL) && (out_pipe == NULL)) {
+        return -EINVAL;
+    }
+    if ((in_pipe && off_in) || (out_pipe && off_out)) {
+        return -ESPIPE;
+    }
+    if (in_pipe == out_pipe) {
+        return -EINVAL;
+    }
+    if (len == 0) {
+        return 0;
+    }
+    int nonblock = bitmask_check(flags, SPLICE_F_NONBLOCK);
+    if (in_pipe && out_pipe) {
+        return __splice_pipes(in_pipe, out_pipe, len, nonblock || bitmask_check(in->open_flags | out->open_flags, O_NONBLOCK), 1);
+    }
+    if (in_pipe) {
+        return __splice_to_file(in_pipe, out, off_out, len, nonblock || bitmask_check(in->open_flags, O_NONBLOCK));
+    }
+    return __splice_from_file(in, off_in, out_pipe, len, nonblock || bitmask_check(out->open_flags, O_NONBLOCK));
+}
+
+ssize_t sys_tee(int fd_in, int fd_out, size_t len, unsigned int flags)
+{
+    vfs_file_t *in, *out;
+    int ret;
+    if ((ret = __splice_get_file(fd_in, 0, &in)) < 0) {
+        return ret;
+    }
+    if ((ret = __splice_get_file(fd_out, 1, &out)) < 0) {
+        return ret;
+    }
+    pipe_t *in_pipe = __pipe_of(in), *out_pipe = __pipe_of(out);
+    if ((in_pipe == NULL) || (out_pipe == NULL) || (in_pipe == out_pipe)) {
+        return -EINVAL;
+    }
+    if (len == 0) {
+        return 0;
+    }
+    int nonblock = bitmask_check(flags, SPLICE_F_NONBLOCK) || bitmask_check(in->open_flags | out->open_flags, O_NONBLOCK);
+    return __splice_pipes(in_pipe, out_pipe, len, nonblock, 0);
+}
+
+/// @brief Creates the VFS file of an end of a pipe.
+/// @param pipe the pipe.
+/// @param ino the inode of the pipe.
+/// @param flags the flags of the end.
+/// @return the file, NULL on failure.
+static inline vfs_file_t *__pipe_create_end(pipe_t *pipe, uint32_t ino, int flags)
+{
+    task_struct *task = scheduler_get_current_process();
+    vfs_file_t *file  = kmem_cache_alloc(vfs_file_cache, GFP_KERNEL);
+    if (!file) {
+        return NULL;
+    }
+    memset(file, 0, sizeof(vfs_file_t));
+    sprintf(file->name, "pipe:[%u]", ino);
+    file->device         = pipe;
+    file->ino            = ino;
+    file->uid            = task->uid;
+    file->gid            = task->gid;
+    file->mask           = S_IRUSR | S_IWUSR;
+    file->flags          = DT_FIFO;
+    file->open_flags     = flags;
+    file->count          = 1;
+    file->nlink          = 1;
+    file->sys_operations = &pipe_sys_operations;
+    file->fs_operations  = &pipe_fs_operations;
+    list_head_init(&file->siblings);
+    return file;
+}
+
+/// @brief Frees a pipe which was never installed.
+/// @param pipe the pipe.
+static inline void __pipe_destroy(pipe_t *pipe)
+{
+    if (pipe->reader) {
+        kmem_cache_free(pipe->reader);
+    }
+    if (pipe->writer) {
+        kmem_cache_free(pipe->writer);
+    }
+    if (pipe->buffer) {
+        free_pages_lowmem((uintptr_t)pipe->buffer);
+    }
+    kfree(pipe);
+}
+
+int sys_pipe2(int fds[2], int flags)
+{
+    task_struct *task = scheduler_get_current_process();
+    if (fds == NULL) {
+        return -EFAULT;
+    }
+    if (flags & ~(O_NONBLOCK | O_CLOEXEC)) {
+        return -EINVAL;
+    }
+    pipe_t *pipe = (pipe_t *)kmalloc(sizeof(pipe_t));
+    if (!pipe) {
+        return -ENOMEM;
+    }
+    memset(pipe, 0, sizeof(pipe_t));
+    uint32_t ino = ++pipe_ino;
+    pipe->buffer = (char *)__alloc_pages_lowmem(GFP_KERNEL, PIPE_BUFFER_ORDER);
+    pipe->reader = __pipe_create_end(pipe, ino, O_RDONLY | (flags & O_NONBLOCK));
+    pipe->writer = __pipe_create_end(pipe, ino, O_WRONLY | (flags & O_NONBLOCK));
+    if (!pipe->buffer || !pipe->reader || !pipe->writer) {
+        __pipe_destroy(pipe);
+        return -ENOMEM;
+    }
+    init_waitqueue_head(&pipe->rd_wait);
+    init_waitqueue_head(&pipe->wr_wait);
+    spinlock_init(&pipe->lock);
+    // Install the read end, so that the write end gets another descriptor.
+    int rfd = get_unused_fd();
+    if (rfd < 0) {
+        __pipe_destroy(pipe);
+        return rfd;
+    }
+    vfs_install_fd(task->files, rfd, pipe->reader, O_RDONLY | flags);
+    int wfd = get_unused_fd();
+    if (wfd < 0) {
+        vfs_release_fd(task->files, rfd);
+        __pipe_destroy(pipe);
+        return wfd;
+    }
+    vfs_install_fd(task->files, wfd, pipe->writer, O_WRONLY | flags);
+    fds[0]                         = rfd;
+    fds[1]                         = wfd;
+    pr_debug("Created pipe %u (%d, %d) for process %d.\n", ino, rfd, wfd, task->pid);
+    return 0;
+}
+
+int sys_pipe(int fds[2])
+{
+    return sys_pipe2(fds, 0);
+}
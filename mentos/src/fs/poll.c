@@ -0,0 +1,324 @@
+/// @file poll.c
+/// @brief Waiting for events on a set of files.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// The processes cannot sleep inside the kernel: when none of the files is
+/// ready, the process is queued on each of them through their poll_f
+/// callback, and poll returns -ERESTARTSYS. Any queue being woken up, or the
+/// timer, puts the process back to run, and poll is executed again: the
+/// queues, with the deadline, survive between the two executions, and they
+/// are released once poll returns to the process.
+
+// Setup the logging for this file (do this before any other include).
+#include "sys/kernel_levels.h"           // Include kernel log levels.
+#define __DEBUG_HEADER__ "[POLL  ]"      ///< Change header.
+#define __DEBUG_LEVEL__  LOGLEVEL_NOTICE ///< Set log level.
+#include "io/debug.h"                    // Include debugging functions.
+
+#include "fs/poll.h"
+#include "fs/vfs.h"
+#include "hardware/hrtimer.h"
+#include "klib/irqflags.h"
+#include "mem/kheap.h"
+#include "poll.h"
+#include "process/scheduler.h"
+#include "string.h"
+#include "sys/errno.h"
+#include "sys/select.h"
+#include "system/syscall.h"
+
+/// The largest number of descriptors accepted by poll.
+#define POLL_MAX_FDS 1024
+
+/// The events which are always reported.
+#define POLL_ALWAYS (POLLERR | POLLHUP | POLLNVAL)
+
+/// @brief The queues where a process waits in poll.
+typedef struct poll_wqueues_t {
+    /// The table given to the files, queueing the process.
+    poll_table_t pt;
+    /// The process.
+    task_struct *task;
+    /// The entries, one for each queue.
+    list_head entries;
+    /// Wakes up the process when its time expires.
+    hrtimer_t timer;
+    /// Set by the timer once it expires.
+    volatile int timed_out;
+    /// If the timer was started.
+    int armed;
+} poll_wqueues_t;
+
+/// @brief The entry of a process on the queue of a file.
+typedef struct poll_table_entry_t {
+    /// The entry inside the queue.
+    wait_queue_entry_t wait;
+    /// The queue.
+    wait_queue_head_t *head;
+    /// The file, whose reference keeps the queue alive.
+    vfs_file_t *file;
+    /// Reference inside the table.
+    list_head list;
+} poll_table_entry_t;
+
+/// @brief Queues the process polling a file on one of the queues of the file.
+/// @param file the file, kept open until the process stops waiting.
+/// @param head the queue.
+/// @param table the table, inside the queues of the process.
+static void __poll_queue_proc(vfs_file_t *file, wait_queue_head_t *head, poll_table_t *table)
+{
+    poll_wqueues_t *pwq       = container_of(table, poll_wqueues_t, pt);
+    poll_table_entry_t *entry = (poll_table_entry_t *)kmalloc(sizeof(poll_table_entry_t));
+    if (entry == NULL) {
+        // The process is still woken up by the timer, or by the other files.
+        pr_warning("Cannot queue process %d on `%s`.\n", pwq->task->pid, file->name);
+        return;
+    }
+    // The entry stays on the queue until the process leaves poll, it is
+    // woken up by every event on the file.
+    init_waitqueue_entry(&entry->wait, pwq->task);
+    entry->head = head;
+    entry->file = file;
+    ++file->count;
+    list_head_insert_before(&entry->list, &pwq->entries);
+    add_wait_queue(head, &entry->wait);
+}
+
+/// @brief Removes the process from all the queues it is on.
+/// @param pwq the queues of the process.
+static inline void __poll_drop_entries(poll_wqueues_t *pwq)
+{
+    list_for_each_safe_decl(it, store, &pwq->entries)
+    {
+        poll_table_entry_t *entry = list_entry(it, poll_table_entry_t, list);
+        remove_wait_queue(entry->head, &entry->wait);
+        list_head_remove(&entry->list);
+        vfs_close(entry->file);
+        kfree(entry);
+    }
+}
+
+void poll_release(task_struct *task)
+{
+    poll_wqueues_t *pwq = task->poll_wqueues;
+    if (pwq == NULL) {
+        return;
+    }
+    hrtimer_cancel(&pwq->timer);
+    __poll_drop_entries(pwq);
+    task->poll_wqueues = NULL;
+    kfree(pwq);
+}
+
+/// @brief Wakes up a process whose time expired.
+/// @param timer the timer of the queues.
+static void __poll_timeout(hrtimer_t *timer)
+{
+    poll_wqueues_t *pwq = (poll_wqueues_t *)timer->data;
+    pwq->timed_out      = 1;
+    scheduler_set_task_state(pwq->task, TASK_RUNNING);
+}
+
+/// @brief Returns the events ready on a file.
+/// @param file the file.
+/// @param events the events we are interested in.
+/// @param table where the process is queued, NULL not to queue it.
+/// @return the ready events among those requested, and those always reported.
+static inline short __poll_file(vfs_file_t *file, short events, poll_table_t *table)
+{
+    unsigned int mask;
+    if (file->fs_operations->poll_f) {
+        mask = file->fs_operations->poll_f(file, table);
+    } else {
+        // Those which cannot tell never block.
+        mask = POLLIN | POLLRDNORM | POLLOUT | POLLWRNORM;
+    }
+    return (short)(mask & ((unsigned short)events | POLL_ALWAYS));
+}
+
+/// @brief Returns the events ready on a descriptor of the calling process.
+/// @param task the calling process.
+/// @param pfd the descriptor, whose revents are set.
+/// @param table where the process is queued, NULL not to queue it.
+/// @return 1 if some events are ready, 0 otherwise.
+static inline int __poll_one(task_struct *task, struct pollfd *pfd, poll_table_t *table)
+{
+    pfd->revents = 0;
+    // Negative descriptors are ignored.
+    if (pfd->fd < 0) {
+        return 0;
+    }
+    if ((pfd->fd >= task->files->max_fd) || (task->files->fd_list[pfd->fd].file_struct == NULL)) {
+        pfd->revents = POLLNVAL;
+    } else {
+        pfd->revents = __poll_file(task->files->fd_list[pfd->fd].file_struct, pfd->events, table);
+    }
+    return pfd->revents != 0;
+}
+
+/// @brief Prepares the calling process to check its files, allocating its
+/// queues the first time it might sleep.
+/// @param task the calling process.
+/// @param timeout the longest time to wait, in milliseconds.
+/// @param pwq where the queues are stored, NULL if the process never sleeps.
+/// @return 0 on success, -ENOMEM on failure.
+static inline int __poll_begin(task_struct *task, int timeout, poll_wqueues_t **pwq)
+{
+    *pwq = task->poll_wqueues;
+    if (*pwq) {
+        // We were woken up, queue ourselves again from scratch.
+        __poll_drop_entries(*pwq);
+    } else if (timeout != 0) {
+        *pwq = (poll_wqueues_t *)kmalloc(sizeof(poll_wqueues_t));
+        if (*pwq == NULL) {
+            return -ENOMEM;
+        }
+        memset(*pwq, 0, sizeof(poll_wqueues_t));
+        (*pwq)->pt.queue = __poll_queue_proc;
+        (*pwq)->task     = task;
+        list_head_init(&(*pwq)->entries);
+        hrtimer_init(&(*pwq)->timer, __poll_timeout, (unsigned long)*pwq);
+        task->poll_wqueues = *pwq;
+    }
+    // Mark ourselves as sleeping before the checks, so that an event after
+    // the check of its file puts us back to run.
+    scheduler_set_task_state(task, TASK_UNINTERRUPTIBLE);
+    return 0;
+}
+
+/// @brief Puts the calling process to sleep, unless something is ready or
+/// its time expired.
+/// @param task the calling process.
+/// @param pwq the queues of the process, NULL if it never sleeps.
+/// @param count the number of ready files.
+/// @param timeout the longest time to wait, in milliseconds.
+/// @return count, or -ERESTARTSYS if the process sleeps.
+static inline int __poll_end(task_struct *task, poll_wqueues_t *pwq, int count, int timeout)
+{
+    uint8_t flags = irq_disable();
+    if (count || !pwq || pwq->timed_out) {
+        scheduler_set_task_state(task, TASK_RUNNING);
+        irq_enable(flags);
+        poll_release(task);
+        return count;
+    }
+    if ((timeout > 0) && !pwq->armed) {
+        pwq->armed = 1;
+        hrtimer_start_range(&pwq->timer, hrtimer_get_time() + (ktime_t)timeout * NSEC_PER_MSEC, task->timer_slack_ns);
+    }
+    irq_enable(flags);
+    return -ERESTARTSYS;
+}
+
+int do_poll(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+    task_struct *task = scheduler_get_current_process();
+    poll_wqueues_t *pwq;
+    int count = __poll_begin(task, timeout, &pwq);
+    if (count < 0) {
+        return count;
+    }
+    for (nfds_t i = 0; i < nfds; ++i) {
+        // Once something is ready, there is no need to be queued.
+        count += __poll_one(task, &fds[i], (count || !pwq) ? NULL : &pwq->pt);
+    }
+    return __poll_end(task, pwq, count, timeout);
+}
+
+int do_poll_file(vfs_file_t *file, short events, int timeout)
+{
+    task_struct *task = scheduler_get_current_process();
+    poll_wqueues_t *pwq;
+    int ret = __poll_begin(task, timeout, &pwq);
+    if (ret < 0) {
+        return ret;
+    }
+    return __poll_end(task, pwq, __poll_file(file, events, pwq ? &pwq->pt : NULL) != 0, timeout);
+}
+
+int sys_poll(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+    if (nfds > POLL_MAX_FDS) {
+        return -EINVAL;
+    }
+    if ((fds == NULL) && (nfds > 0)) {
+        return -EFAULT;
+    }
+    return do_poll(fds, nfds, timeout);
+}
+
+int sys_select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, timeval *timeout)
+{
+    int msec = -1, count = 0;
+    if ((nfds < 0) || (nfds > FD_SETSIZE)) {
+        return -EINVAL;
+    }
+    if (timeout) {
+        if ((timeout->tv_sec < 0) || (timeout->tv_usec < 0)) {
+            return -EINVAL;
+        }
+        msec = (int)(timeout->tv_sec * 1000 + timeout->tv_usec / 1000);
+    }
+    // Turn the sets into descriptors for poll, in the kernel memory.
+    struct pollfd *fds = (struct pollfd *)kmalloc(sizeof(struct pollfd) * (nfds + 1));
+    if (fds == NULL) {
+        return -ENOMEM;
+    }
+    for (int fd = 0; fd < nfds; ++fd) {
+        fds[fd].fd     = -1;
+        fds[fd].events = 0;
+        if (readfds && FD_ISSET(fd, readfds)) {
+            fds[fd].events |= POLLIN;
+        }
+        if (writefds && FD_ISSET(fd, writefds)) {
+            fds[fd].events |= POLLOUT;
+        }
+        if (exceptfds && FD_ISSET(fd, exceptfds)) {
+            fds[fd].events |= POLLPRI;
+        }
+        if (fds[fd].events) {
+            fds[fd].fd = fd;
+        }
+    }
+    int ret = do_poll(fds, (nfds_t)nfds, msec);
+    if (ret < 0) {
+        kfree(fds);
+        return ret;
+    }
+    // The sets are changed only once we return to the process.
+    for (int fd = 0; fd < nfds; ++fd) {
+        if (fds[fd].revents & POLLNVAL) {
+            count = -EBADF;
+            break;
+        }
+    }
+    if (count == 0) {
+        for (int fd = 0; fd < nfds; ++fd) {
+            short revents = fds[fd].revents;
+            if (readfds && FD_ISSET(fd, readfds)) {
+                if (revents & (POLLIN | POLLHUP | POLLERR)) {
+                    ++count;
+                } else {
+                    FD_CLR(fd, readfds);
+                }
+            }
+            if (writefds && FD_ISSET(fd, writefds)) {
+                if (revents & (POLLOUT | POLLERR)) {
+                    ++count;
+                } else {
+                    FD_CLR(fd, writefds);
+                }
+            }
+            if (exceptfds && FD_ISSET(fd, exceptfds)) {
+                if (revents & POLLPRI) {
+                    ++count;
+                } else {
+                    FD_CLR(fd, exceptfds);
+                }
+            }
+        }
+    }
+    kfree(fds);
+    return count;
+}
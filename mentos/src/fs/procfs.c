@@ -13,7 +13,9 @@
 #include "fcntl.h"
 #include "fs/procfs.h"
 #include "fs/vfs.h"
+#include "klib/hashmap.h"
 #include "libgen.h"
+#include "poll.h"
 #include "stdio.h"
 #include "string.h"
 #include "sys/errno.h"
@@ -25,6 +27,8 @@
 #define PROCFS_MAX_FILES 1024U
 /// The magic number used to check if the procfs file is valid.
 #define PROCFS_MAGIC_NUMBER 0xBF
+/// Number of buckets of the tables indexing the files by path and by inode.
+#define PROCFS_HASH_BUCKETS 256U
 
 // ============================================================================
 // Data Structures
@@ -58,6 +62,12 @@ typedef struct procfs_file_t {
     list_head files;
     /// List of procfs siblings.
     list_head siblings;
+    /// The directory containing the file, NULL for the root.
+    struct procfs_file_t *parent;
+    /// The files inside the directory.
+    list_head children;
+    /// Link inside the children of the parent directory.
+    list_head child_link;
 } procfs_file_t;
 
 /// @brief The details regarding the filesystem.
@@ -67,6 +77,12 @@ typedef struct procfs_t {
     unsigned int nfiles;
     /// List of headers.
     list_head files;
+    /// The files, indexed by their path.
+    hashmap_t *paths;
+    /// The files, indexed by their inode.
+    hashmap_t *inodes;
+    /// Where the search for a free inode starts.
+    int next_inode;
     /// Cache for creating new `procfs_file_t`.
     kmem_cache_t *procfs_file_cache;
 } procfs_t;
@@ -89,8 +105,10 @@ static ssize_t procfs_read(vfs_file_t *file, char *buffer, off_t offset, size_t
 static ssize_t procfs_write(vfs_file_t *file, const void *buffer, off_t offset, size_t nbyte);
 static off_t procfs_lseek(vfs_file_t *file, off_t offset, int whence);
 static int procfs_fstat(vfs_file_t *file, stat_t *stat);
+static int procfs_statat(vfs_file_t *directory, const char *path, stat_t *stat, unsigned int mask);
 static int procfs_ioctl(vfs_file_t *file, int request, void *data);
 static ssize_t procfs_getdents(vfs_file_t *file, dirent_t *dirp, off_t doff, size_t count);
+static unsigned int procfs_poll(vfs_file_t *file, struct poll_table_t *table);
 
 // ============================================================================
 // Virtual FileSystem (VFS) Operaions
@@ -117,6 +135,8 @@ static vfs_file_operations_t procfs_fs_operations = {
     .ioctl_f    = procfs_ioctl,
     .getdents_f = procfs_getdents,
     .readlink_f = NULL,
+    .poll_f     = procfs_poll,
+    .statat_f   = procfs_statat,
 };
 
 // ============================================================================
@@ -153,19 +173,7 @@ static inline procfs_file_t *procfs_get_file(list_head *entry)
 /// @return a pointer to the PROCFS file, NULL otherwise.
 static inline procfs_file_t *procfs_find_entry_path(const char *path)
 {
-    procfs_file_t *procfs_file;
-    if (!list_head_empty(&fs.files)) {
-        list_for_each_decl(it, &fs.files)
-        {
-            // Get the file structure.
-            procfs_file = procfs_get_file(it);
-            // Check its name.
-            if (procfs_file && !strcmp(procfs_file->name, path)) {
-                return procfs_file;
-            }
-        }
-    }
-    return NULL;
+    return (procfs_file_t *)hashmap_get(fs.paths, path);
 }
 
 /// @brief Finds the PROCFS file with the given inode.
@@ -173,19 +181,7 @@ static inline procfs_file_t *procfs_find_entry_path(const char *path)
 /// @return a pointer to the PROCFS file, NULL otherwise.
 static inline procfs_file_t *procfs_find_entry_inode(uint32_t inode)
 {
-    procfs_file_t *procfs_file;
-    if (!list_head_empty(&fs.files)) {
-        list_for_each_decl(it, &fs.files)
-        {
-            // Get the file structure.
-            procfs_file = procfs_get_file(it);
-            // Check its inode.
-            if (procfs_file && (procfs_file->inode == inode)) {
-                return procfs_file;
-            }
-        }
-    }
-    return NULL;
+    return (procfs_file_t *)hashmap_get(fs.inodes, (void *)inode);
 }
 
 /// @brief Finds the inode associated with a PROCFS file at the given path.
@@ -200,46 +196,27 @@ static inline int procfs_find_inode(const char *path)
     return -1;
 }
 
+/// @brief Returns a free inode, searching from the one following the last
+/// inode given out.
+/// @return a free inode, or -1 if they are all in use.
 static inline int procfs_get_free_inode(void)
 {
-    for (int inode = 1; inode < PROCFS_MAX_FILES; ++inode) {
+    for (int i = 1; i < PROCFS_MAX_FILES; ++i) {
+        int inode = ((fs.next_inode + i - 1) % (PROCFS_MAX_FILES - 1)) + 1;
         if (procfs_find_entry_inode(inode) == NULL) {
+            fs.next_inode = inode + 1;
             return inode;
         }
     }
     return -1;
 }
 
-/// @brief Checks if the PROCFS directory at the given path is empty.
-/// @param path the path to the directory.
+/// @brief Checks if the PROCFS directory is empty.
+/// @param procfs_file the directory.
 /// @return 0 if empty, 1 if not.
-static inline int procfs_check_if_empty(const char *path)
+static inline int procfs_check_if_empty(procfs_file_t *procfs_file)
 {
-    procfs_file_t *procfs_file;
-    if (!list_head_empty(&fs.files)) {
-        char filedir[PATH_MAX];
-        list_for_each_decl(it, &fs.files)
-        {
-            // Get the file structure.
-            procfs_file = procfs_get_file(it);
-            // Check if it a valid pointer.
-            if (procfs_file) {
-                // It's the directory itself.
-                if (!strcmp(path, procfs_file->name)) {
-                    continue;
-                }
-                // Get the directory of the file.
-                if (!dirname(procfs_file->name, filedir, sizeof(filedir))) {
-                    continue;
-                }
-                // Check if directory path and file directory are the same.
-                if (!strcmp(path, filedir)) {
-                    return 1;
-                }
-            }
-        }
-    }
-    return 0;
+    return !list_head_empty(&procfs_file->children);
 }
 
 /// @brief Creates a new PROCFS file.
@@ -269,6 +246,21 @@ static inline procfs_file_t *procfs_create_file(const char *path, unsigned flags
     list_head_init(&procfs_file->siblings);
     // Add the file to the list of opened files.
     list_head_insert_before(&procfs_file->siblings, &fs.files);
+    // Index the file by path and by inode.
+    hashmap_set(fs.paths, procfs_file->name, procfs_file);
+    hashmap_set(fs.inodes, (void *)procfs_file->inode, procfs_file);
+    // Add the file to the children of its directory.
+    list_head_init(&procfs_file->children);
+    list_head_init(&procfs_file->child_link);
+    char parent_path[PATH_MAX];
+    if (dirname(path, parent_path, sizeof(parent_path))) {
+        procfs_file->parent = procfs_find_entry_path(parent_path);
+        if (procfs_file->parent && (procfs_file->parent != procfs_file)) {
+            list_head_insert_before(&procfs_file->child_link, &procfs_file->parent->children);
+        } else {
+            procfs_file->parent = NULL;
+        }
+    }
     // Time of last access.
     procfs_file->atime = sys_time(NULL);
     // Time of last data modification.
@@ -298,6 +290,10 @@ static inline int procfs_destroy_file(procfs_file_t *procfs_file)
     pr_debug("procfs_destroy_file(%p) `%s`\n", procfs_file, procfs_file->name);
     // Remove the file from the list of opened files.
     list_head_remove(&procfs_file->siblings);
+    // Remove the file from the indices, and from its directory.
+    hashmap_remove(fs.paths, procfs_file->name);
+    hashmap_remove(fs.inodes, (void *)procfs_file->inode);
+    list_head_remove(&procfs_file->child_link);
     // Free the cache.
     kmem_cache_free(procfs_file);
     // Decrease the number of files.
@@ -419,7 +415,7 @@ static int procfs_rmdir(const char *path)
         return -EBUSY;
     }
     // Check if its empty.
-    if (procfs_check_if_empty(procfs_file->name)) {
+    if (procfs_check_if_empty(procfs_file)) {
         pr_err("procfs_rmdir(%s): The directory is not empty.\n", path);
         return -ENOTEMPTY;
     }
@@ -538,6 +534,11 @@ static int procfs_close(vfs_file_t *file)
 {
     assert(file && "Received null file.");
     //pr_debug("procfs_close(%p): VFS file : %p\n", file, file);
+    // Let the entry release the data of the open file.
+    procfs_file_t *procfs_file = procfs_find_entry_inode(file->ino);
+    if (procfs_file && procfs_file->dir_entry.fs_operations && procfs_file->dir_entry.fs_operations->close_f) {
+        procfs_file->dir_entry.fs_operations->close_f(file);
+    }
     // Remove the file from the list of `files` inside its corresponding `procfs_file_t`.
     list_head_remove(&file->siblings);
     // Free the memory of the file.
@@ -712,6 +713,41 @@ static int procfs_stat(const char *path, stat_t *stat)
     return -1;
 }
 
+/// @brief Retrieves information concerning the file at a path relative to a directory.
+/// @param directory The directory from which the path is resolved.
+/// @param path The relative path.
+/// @param stat The structure where the information are stored.
+/// @param mask The STATX_* fields needed.
+/// @return 0 if success, -errno on failure.
+/// @details The entries are indexed by their full path, so the lookup is a
+/// single one. The stat callbacks of the entries run only when more than the
+/// type and the inode number are needed.
+static int procfs_statat(vfs_file_t *directory, const char *path, stat_t *stat, unsigned int mask)
+{
+    if (!directory || !path || !stat) {
+        return -EFAULT;
+    }
+    procfs_file_t *parent = procfs_find_entry_inode(directory->ino);
+    if (parent == NULL) {
+        return -ENOENT;
+    }
+    char absolute_path[PATH_MAX];
+    if (strcmp(path, ".") == 0) {
+        strcpy(absolute_path, parent->name);
+    } else if (snprintf(absolute_path, PATH_MAX, "%s/%s", parent->name, path) >= PATH_MAX) {
+        return -ENAMETOOLONG;
+    }
+    procfs_file_t *procfs_file = procfs_find_entry_path(absolute_path);
+    if (procfs_file == NULL) {
+        return -ENOENT;
+    }
+    if ((mask & ~(STATX_TYPE | STATX_INO)) && procfs_file->dir_entry.sys_operations &&
+        procfs_file->dir_entry.sys_operations->stat_f) {
+        return procfs_file->dir_entry.sys_operations->stat_f(absolute_path, stat);
+    }
+    return __procfs_stat(procfs_file, stat);
+}
+
 static int procfs_ioctl(vfs_file_t *file, int request, void *data)
 {
     if (file) {
@@ -725,6 +761,22 @@ static int procfs_ioctl(vfs_file_t *file, int request, void *data)
     return -1;
 }
 
+/// @brief Returns the events ready on the file.
+/// @param file The file.
+/// @param table The table of the polling process, forwarded to the entry.
+/// @return The events, those of the entry if it can tell.
+static unsigned int procfs_poll(vfs_file_t *file, struct poll_table_t *table)
+{
+    if (file) {
+        procfs_file_t *procfs_file = procfs_find_entry_inode(file->ino);
+        if (procfs_file && procfs_file->dir_entry.fs_operations && procfs_file->dir_entry.fs_operations->poll_f) {
+            return procfs_file->dir_entry.fs_operations->poll_f(file, table);
+        }
+    }
+    // The entries which cannot tell never block.
+    return POLLIN | POLLRDNORM | POLLOUT | POLLWRNORM;
+}
+
 /// @brief Reads contents of the directories to a dirent buffer, updating
 ///        the offset and returning the number of written bytes in the buffer,
 ///        it assumes that all paths are well-formed.
@@ -743,10 +795,6 @@ static inline ssize_t procfs_getdents(vfs_file_t *file, dirent_t *dirp, off_t do
     if (count < sizeof(dirent_t)) {
         return -1;
     }
-    // If there are no file, stop right here.
-    if (list_head_empty(&fs.files)) {
-        return 0;
-    }
     // Find the directory entry.
     procfs_file_t *direntry = procfs_find_entry_inode(file->ino);
     if (direntry == NULL) {
@@ -762,49 +810,30 @@ static inline ssize_t procfs_getdents(vfs_file_t *file, dirent_t *dirp, off_t do
     size_t len           = strlen(direntry->name);
     ssize_t written_size = 0;
     off_t iterated_size  = 0;
-    char parent_path[PATH_MAX];
-    // Iterate the filesystem files.
-    list_for_each_decl(it, &fs.files)
+    // Iterate the files inside the directory.
+    list_for_each_decl(it, &direntry->children)
     {
         // Get the file structure.
-        procfs_file_t *entry = procfs_get_file(it);
-        // Check if it a valid procfs file.
-        if (!entry) {
-            continue;
-        }
-        // If the entry is the directory itself, skip.
-        if (!strcmp(direntry->name, entry->name)) {
-            continue;
-        }
-        // Get the parent directory.
-        if (!dirname(entry->name, parent_path, sizeof(parent_path))) {
-            continue;
-        }
-        // Check if the parent of the entry is the directory we are iterating.
-        if (strcmp(direntry->name, parent_path) != 0) {
-            continue;
-        }
+        procfs_file_t *entry = list_entry(it, procfs_file_t, child_link);
         // Advance the size we just iterated.
         iterated_size += sizeof(dirent_t);
         // Check if the iterated size is still below the offset.
         if (iterated_size <= doff) {
             continue;
         }
-        // Check if the last character of the entry is a slash.
-        if (*(entry->name + len) == '/') {
-            ++len;
-        }
+        // Skip the slash separating the directory from the name.
+        size_t skip = len + (*(entry->name + len) == '/');
         // Write on current dirp.
         dirp->d_ino  = entry->inode;
         dirp->d_type = entry->flags;
-        strcpy(dirp->d_name, entry->name + len);
+        strcpy(dirp->d_name, entry->name + skip);
         dirp->d_off    = sizeof(dirent_t);
         dirp->d_reclen = sizeof(dirent_t);
         // Increment the written counter.
         written_size += sizeof(dirent_t);
         // Move to next writing position.
         ++dirp;
-        if (written_size >= count) {
+        if (written_size + sizeof(dirent_t) > count) {
             break;
         }
     }
@@ -857,6 +886,10 @@ int procfs_module_init(void)
     fs.procfs_file_cache = KMEM_CREATE(procfs_file_t);
     // Initialize the list of procfs files.
     list_head_init(&fs.files);
+    // Initialize the indices of the procfs files.
+    fs.paths      = hashmap_create(PROCFS_HASH_BUCKETS, hashmap_str_hash, hashmap_str_comp, hashmap_do_not_duplicate, hashmap_do_not_free);
+    fs.inodes     = hashmap_create(PROCFS_HASH_BUCKETS, hashmap_int_hash, hashmap_int_comp, hashmap_do_not_duplicate, hashmap_do_not_free);
+    fs.next_inode = 1;
     // Register the filesystem.
     vfs_register_filesystem(&procfs_file_system_type);
     return 0;
@@ -938,7 +971,7 @@ int proc_rmdir(const char *name, proc_dir_entry_t *parent)
         return -ENOTDIR;
     }
     // Check if its empty.
-    if (procfs_check_if_empty(procfs_file->name)) {
+    if (procfs_check_if_empty(procfs_file)) {
         pr_err("proc_rmdir(%s): The directory is not empty.\n", entry_path);
         return -ENOTEMPTY;
     }
@@ -7,22 +7,49 @@
 #include "fcntl.h"
 #include "fs/vfs.h"
 #include "fs/vfs_types.h"
+#include "math.h"
+#include "mem/kheap.h"
+#include "mem/paging.h"
 #include "stdio.h"
 #include "sys/errno.h"
+#include "sys/sendfile.h"
+#include "sys/uio.h"
 #include "system/panic.h"
 
+/// Size of the kernel buffer used by sendfile to move the data.
+#define SENDFILE_CHUNK_SIZE (4 * PAGE_SIZE)
+
+/// @brief Transfers data between the file of the descriptor and the buffer,
+/// bypassing the caches if the descriptor has been opened with O_DIRECT.
+/// @param vfd the file descriptor.
+/// @param write if the data is written to the file, or read from it.
+/// @param buf the buffer.
+/// @param offset the position inside the file.
+/// @param nbytes the number of bytes.
+/// @return the number of bytes transferred, -errno on failure.
+static inline ssize_t __fd_transfer(vfs_file_descriptor_t *vfd, int write, void *buf, size_t offset, size_t nbytes)
+{
+    if (bitmask_check(vfd->flags_mask, O_DIRECT)) {
+        return vfs_direct_io(vfd->file_struct, write, buf, offset, nbytes);
+    }
+    if (write) {
+        return vfs_write(vfd->file_struct, buf, offset, nbytes);
+    }
+    return vfs_read(vfd->file_struct, buf, offset, nbytes);
+}
+
 ssize_t sys_read(int fd, void *buf, size_t nbytes)
 {
     // Get the current task.
     task_struct *task = scheduler_get_current_process();
 
     // Check the current FD.
-    if (fd < 0 || fd >= task->max_fd) {
+    if (fd < 0 || fd >= task->files->max_fd) {
         return -EMFILE;
     }
 
     // Get the file descriptor.
-    vfs_file_descriptor_t *vfd = &task->fd_list[fd];
+    vfs_file_descriptor_t *vfd = &task->files->fd_list[fd];
 
     // Check the permissions.
 #if 0
@@ -37,7 +64,7 @@ ssize_t sys_read(int fd, void *buf, size_t nbytes)
     }
 
     // Perform the read.
-    int read = vfs_read(vfd->file_struct, buf, vfd->file_struct->f_pos, nbytes);
+    int read = __fd_transfer(vfd, 0, buf, vfd->file_struct->f_pos, nbytes);
 
     // Update the offset.
     if (read > 0) {
@@ -52,12 +79,12 @@ ssize_t sys_write(int fd, const void *buf, size_t nbytes)
     task_struct *task = scheduler_get_current_process();
 
     // Check the current FD.
-    if (fd < 0 || fd >= task->max_fd) {
+    if (fd < 0 || fd >= task->files->max_fd) {
         return -EMFILE;
     }
 
     // Get the file descriptor.
-    vfs_file_descriptor_t *vfd = &task->fd_list[fd];
+    vfs_file_descriptor_t *vfd = &task->files->fd_list[fd];
 
     // Check the permissions.
     if (!bitmask_check(vfd->flags_mask, O_WRONLY | O_RDWR)) {
@@ -70,7 +97,7 @@ ssize_t sys_write(int fd, const void *buf, size_t nbytes)
     }
 
     // Perform the write.
-    int written = vfs_write(vfd->file_struct, buf, vfd->file_struct->f_pos, nbytes);
+    int written = __fd_transfer(vfd, 1, (void *)buf, vfd->file_struct->f_pos, nbytes);
 
     // Update the offset.
     if (written > 0) {
@@ -82,11 +109,11 @@ ssize_t sys_write(int fd, const void *buf, size_t nbytes)
 off_t sys_lseek(int fd, off_t offset, int whence)
 {
     task_struct *task = scheduler_get_current_process();
-    if (fd < 0 || fd >= task->max_fd) {
+    if (fd < 0 || fd >= task->files->max_fd) {
         return -1;
     }
     // Get the file descriptor.
-    vfs_file_descriptor_t *vfd = &task->fd_list[fd];
+    vfs_file_descriptor_t *vfd = &task->files->fd_list[fd];
     // Check the file.
     if (vfd->file_struct == NULL) {
         return -ENOSYS;
@@ -94,3 +121,186 @@ off_t sys_lseek(int fd, off_t offset, int whence)
     // Perform the lseek.
     return vfs_lseek(vfd->file_struct, offset, whence);
 }
+
+int sys_fadvise64(int fd, off_t offset, off_t len, int advice)
+{
+    task_struct *task = scheduler_get_current_process();
+    if ((fd < 0) || (fd >= task->files->max_fd) || (task->files->fd_list[fd].file_struct == NULL)) {
+        return -EBADF;
+    }
+    if ((offset < 0) || (len < 0)) {
+        return -EINVAL;
+    }
+    return vfs_fadvise(task->files->fd_list[fd].file_struct, offset, len, advice);
+}
+
+/// @brief Returns the file descriptor, checking that it can be used for the
+/// requested transfer.
+/// @param fd the file descriptor number.
+/// @param write if the descriptor is going to be written.
+/// @param vfd where the file descriptor is placed.
+/// @return 0 on success, -errno on failure.
+static inline int __get_io_descriptor(int fd, int write, vfs_file_descriptor_t **vfd)
+{
+    // Get the current task.
+    task_struct *task = scheduler_get_current_process();
+    // Check the current FD.
+    if (fd < 0 || fd >= task->files->max_fd) {
+        return -EMFILE;
+    }
+    // Get the file descriptor.
+    *vfd = &task->files->fd_list[fd];
+    // Check the permissions.
+    if (write && !bitmask_check((*vfd)->flags_mask, O_WRONLY | O_RDWR)) {
+        return -EROFS;
+    }
+    // Check the file.
+    if ((*vfd)->file_struct == NULL) {
+        return -ENOSYS;
+    }
+    return 0;
+}
+
+ssize_t sys_pread(int fd, void *buf, size_t nbytes, off_t offset)
+{
+    vfs_file_descriptor_t *vfd;
+    int ret = __get_io_descriptor(fd, 0, &vfd);
+    if (ret < 0) {
+        return ret;
+    }
+    if (offset < 0) {
+        return -EINVAL;
+    }
+    // Perform the read, without touching the file offset.
+    return __fd_transfer(vfd, 0, buf, offset, nbytes);
+}
+
+ssize_t sys_pwrite(int fd, const void *buf, size_t nbytes, off_t offset)
+{
+    vfs_file_descriptor_t *vfd;
+    int ret = __get_io_descriptor(fd, 1, &vfd);
+    if (ret < 0) {
+        return ret;
+    }
+    if (offset < 0) {
+        return -EINVAL;
+    }
+    // Perform the write, without touching the file offset.
+    return __fd_transfer(vfd, 1, (void *)buf, offset, nbytes);
+}
+
+/// @brief Transfers the buffers in order, starting from the file offset.
+/// @param fd the file descriptor number.
+/// @param iov the buffers.
+/// @param iovcnt the number of buffers.
+/// @param write if the buffers are written to the file, or read from it.
+/// @return the number of bytes transferred, -errno on failure.
+static ssize_t __do_iovec(int fd, const struct iovec *iov, int iovcnt, int write)
+{
+    vfs_file_descriptor_t *vfd;
+    int ret = __get_io_descriptor(fd, write, &vfd);
+    if (ret < 0) {
+        return ret;
+    }
+    if ((iov == NULL) || (iovcnt < 0) || (iovcnt > IOV_MAX)) {
+        return -EINVAL;
+    }
+    vfs_file_t *file = vfd->file_struct;
+    ssize_t total    = 0;
+    for (int i = 0; i < iovcnt; ++i) {
+        if (iov[i].iov_len == 0) {
+            continue;
+        }
+        // Perform the transfer.
+        ssize_t done = __fd_transfer(vfd, write, iov[i].iov_base, file->f_pos, iov[i].iov_len);
+        // Report the error only if nothing has been transferred yet.
+        if (done < 0) {
+            return (total > 0) ? total : done;
+        }
+        // Update the offset.
+        file->f_pos += done;
+        total += done;
+        // Stop at the first short transfer (e.g., end of file).
+        if ((size_t)done < iov[i].iov_len) {
+            break;
+        }
+    }
+    return total;
+}
+
+ssize_t sys_readv(int fd, const struct iovec *iov, int iovcnt)
+{
+    return __do_iovec(fd, iov, iovcnt, 0);
+}
+
+ssize_t sys_writev(int fd, const struct iovec *iov, int iovcnt)
+{
+    return __do_iovec(fd, iov, iovcnt, 1);
+}
+
+ssize_t sys_sendfile(int out_fd, int in_fd, off_t *offset, size_t count)
+{
+    vfs_file_descriptor_t *in_vfd, *out_vfd;
+    int ret;
+    if ((ret = __get_io_descriptor(in_fd, 0, &in_vfd)) < 0) {
+        return ret;
+    }
+    if ((ret = __get_io_descriptor(out_fd, 1, &out_vfd)) < 0) {
+        return ret;
+    }
+    vfs_file_t *in = in_vfd->file_struct, *out = out_vfd->file_struct;
+    // Select where we read from.
+    off_t pos = (offset != NULL) ? *offset : (off_t)in->f_pos;
+    if (pos < 0) {
+        return -EINVAL;
+    }
+    if (count == 0) {
+        return 0;
+    }
+    // Allocate the buffer, never larger than the request.
+    size_t chunk_size = min(count, SENDFILE_CHUNK_SIZE);
+    char *chunk       = kmalloc(chunk_size);
+    if (chunk == NULL) {
+        return -ENOMEM;
+    }
+    ssize_t total = 0;
+    while ((size_t)total < count) {
+        // Read the next chunk.
+        ssize_t nread = vfs_read(in, chunk, pos, min(count - total, chunk_size));
+        if (nread <= 0) {
+            if ((nread < 0) && (total == 0)) {
+                total = nread;
+            }
+            break;
+        }
+        // Write it out, the whole chunk, unless the output is full.
+        ssize_t nwritten = 0;
+        while (nwritten < nread) {
+            ssize_t written = vfs_write(out, chunk + nwritten, out->f_pos, nread - nwritten);
+            if (written <= 0) {
+                if ((written < 0) && (total == 0) && (nwritten == 0)) {
+                    total = written;
+                }
+                break;
+            }
+            out->f_pos += written;
+            nwritten += written;
+        }
+        // Only the bytes which were written out count as consumed.
+        if (nwritten > 0) {
+            pos += nwritten;
+            total += nwritten;
+        }
+        if (nwritten < nread) {
+            break;
+        }
+    }
+    kfree(chunk);
+    // Update the input position.
+    if (offset != NULL) {
+        *offset = pos;
+    } else {
+        in->f_pos = pos;
+    }
+    return total;
+}
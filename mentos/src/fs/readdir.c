@@ -25,14 +25,14 @@ ssize_t sys_getdents(int fd, dirent_t *dirp, unsigned int count)
     // Check the current task.
     assert(current_process && "There is no current process!");
     // Check the current FD.
-    if ((fd < 0) || (fd >= current_process->max_fd)) {
+    if ((fd < 0) || (fd >= current_process->files->max_fd)) {
         return -EMFILE;
     }
     // Get the process-specific file descriptor.
-    vfs_file_descriptor_t *process_fd = &current_process->fd_list[fd];
+    vfs_file_descriptor_t *process_fd = &current_process->files->fd_list[fd];
 #if 0
     // Check the permissions.
-    if (!(current_process->fd_list[fd].flags_mask & O_RDONLY)) {
+    if (!(current_process->files->fd_list[fd].flags_mask & O_RDONLY)) {
         return -EROFS;
     }
 #endif
@@ -0,0 +1,184 @@
+/// @file seq_file.c
+/// @brief Sequential files, whose contents are generated one record at a time.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// The text of the records is appended to a buffer which belongs to the open
+/// file, and grows by doubling, so that generating a file costs linear time.
+/// A read only generates the records needed to cover its range, the next
+/// reads of the same pass resume from the following record instead of
+/// generating the file again.
+
+// Setup the logging for this file (do this before any other include).
+#include "sys/kernel_levels.h"           // Include kernel log levels.
+#define __DEBUG_HEADER__ "[SEQFIL]"      ///< Change header.
+#define __DEBUG_LEVEL__  LOGLEVEL_NOTICE ///< Set log level.
+#include "io/debug.h"                    // Include debugging functions.
+
+#include "fs/seq_file.h"
+#include "math.h"
+#include "mem/slab.h"
+#include "stdio.h"
+#include "string.h"
+#include "sys/errno.h"
+
+/// The initial size of the buffer of a sequential file.
+#define SEQ_BUF_INITIAL 512
+
+/// @brief Makes room for the given number of bytes, plus the terminator, at
+/// the end of the buffer.
+/// @param m the sequential file.
+/// @param len the number of bytes.
+/// @return 0 on success, -ENOMEM on failure, which sets the overflow flag.
+static int __seq_reserve(seq_file_t *m, size_t len)
+{
+    if (m->count + len < m->size) {
+        return 0;
+    }
+    size_t size = m->size ? m->size : SEQ_BUF_INITIAL;
+    while (m->count + len >= size) {
+        size *= 2;
+    }
+    char *buf = (char *)kmalloc(size);
+    if (!buf) {
+        m->overflow = 1;
+        return -ENOMEM;
+    }
+    if (m->buf) {
+        memcpy(buf, m->buf, m->count);
+        kfree(m->buf);
+    }
+    m->buf  = buf;
+    m->size = size;
+    return 0;
+}
+
+/// @brief Generates records until the text reaches the given length, or the
+/// records end.
+/// @param m the sequential file.
+/// @param length the length of text needed.
+/// @return 0 on success, -errno on failure.
+static int __seq_fill(seq_file_t *m, size_t length)
+{
+    if (m->done || (m->count >= length)) {
+        return 0;
+    }
+    int ret = 0;
+    void *v = m->op->start(m, &m->index);
+    while (v) {
+        size_t mark = m->count;
+        m->overflow = 0;
+        ret         = m->op->show(m, v);
+        if (m->overflow) {
+            ret = -ENOMEM;
+        }
+        if (ret < 0) {
+            // Drop the partial record, the next read tries it again.
+            m->count = mark;
+            break;
+        }
+        v = m->op->next(m, v, &m->index);
+        if (m->count >= length) {
+            break;
+        }
+    }
+    if (!v) {
+        m->done = 1;
+    }
+    m->op->stop(m, v);
+    return ret;
+}
+
+int seq_open(vfs_file_t *file, const seq_operations_t *op, void *private)
+{
+    seq_file_t *m = (seq_file_t *)kmalloc(sizeof(seq_file_t));
+    if (!m) {
+        return -ENOMEM;
+    }
+    memset(m, 0, sizeof(seq_file_t));
+    m->op              = op;
+    m->private         = private;
+    file->private_data = m;
+    return 0;
+}
+
+ssize_t seq_read(vfs_file_t *file, char *buffer, off_t offset, size_t nbyte)
+{
+    seq_file_t *m = (seq_file_t *)file->private_data;
+    if (!m) {
+        return -EFAULT;
+    }
+    if (offset < 0) {
+        return -EINVAL;
+    }
+    // Reading from the beginning generates fresh contents.
+    if (offset == 0) {
+        m->count = 0;
+        m->index = 0;
+        m->done  = 0;
+    }
+    int ret = __seq_fill(m, (size_t)offset + nbyte);
+    if ((ret < 0) && (m->count <= (size_t)offset)) {
+        return ret;
+    }
+    if ((size_t)offset >= m->count) {
+        return 0;
+    }
+    size_t bytes = min(m->count - (size_t)offset, nbyte);
+    memcpy(buffer, m->buf + offset, bytes);
+    return bytes;
+}
+
+int seq_release(vfs_file_t *file)
+{
+    seq_file_t *m = (seq_file_t *)file->private_data;
+    if (m) {
+        if (m->buf) {
+            kfree(m->buf);
+        }
+        kfree(m);
+        file->private_data = NULL;
+    }
+    return 0;
+}
+
+int seq_printf(seq_file_t *m, const char *fmt, ...)
+{
+    // Try in the space left, then grow the buffer to the length it needs.
+    size_t space = m->size - m->count;
+    va_list ap;
+    va_start(ap, fmt);
+    int len = vsnprintf(m->buf + m->count, space, fmt, ap);
+    va_end(ap);
+    if ((size_t)len >= space) {
+        if (__seq_reserve(m, len) < 0) {
+            return -ENOMEM;
+        }
+        va_start(ap, fmt);
+        vsnprintf(m->buf + m->count, len + 1, fmt, ap);
+        va_end(ap);
+    }
+    m->count += len;
+    return len;
+}
+
+int seq_puts(seq_file_t *m, const char *s)
+{
+    size_t len = strlen(s);
+    if (__seq_reserve(m, len) < 0) {
+        return -ENOMEM;
+    }
+    memcpy(m->buf + m->count, s, len + 1);
+    m->count += len;
+    return len;
+}
+
+int seq_write(seq_file_t *m, const void *data, size_t len)
+{
+    if (__seq_reserve(m, len) < 0) {
+        return -ENOMEM;
+    }
+    memcpy(m->buf + m->count, data, len);
+    m->count += len;
+    return len;
+}
@@ -0,0 +1,201 @@
+/// @file signalfd.c
+/// @brief Signals received by reading a file descriptor.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// A signalfd holds a set of signals: reading it takes the pending ones of
+/// the reading process, without running any handler, and polling it reports
+/// if one of them is pending. The signals are usually blocked, so that they
+/// are left pending instead of being delivered. The readers, and the pollers,
+/// sleep on the queue of the signal handlers, woken up by each signal sent.
+
+// Setup the logging for this file (do this before any other include).
+#include "sys/kernel_levels.h"           // Include kernel log levels.
+#define __DEBUG_HEADER__ "[SIGFD ]"      ///< Change header.
+#define __DEBUG_LEVEL__  LOGLEVEL_NOTICE ///< Set log level.
+#include "io/debug.h"                    // Include debugging functions.
+
+#include "fcntl.h"
+#include "fs/poll.h"
+#include "fs/vfs.h"
+#include "mem/kheap.h"
+#include "mem/slab.h"
+#include "poll.h"
+#include "process/scheduler.h"
+#include "string.h"
+#include "sys/errno.h"
+#include "sys/signalfd.h"
+
+/// @brief A signalfd.
+typedef struct signalfd_ctx_t {
+    /// The signals which are read.
+    sigset_t sigmask;
+} signalfd_ctx_t;
+
+static int __signalfd_close(vfs_file_t *file)
+{
+    kfree(file->device);
+    kmem_cache_free(file);
+    return 0;
+}
+
+/// @brief Fills the structure read by the process with the details of a signal.
+/// @param ssi the structure.
+/// @param info the details.
+static inline void __signalfd_copyinfo(struct signalfd_siginfo *ssi, siginfo_t *info)
+{
+    memset(ssi, 0, sizeof(struct signalfd_siginfo));
+    ssi->ssi_signo  = info->si_signo;
+    ssi->ssi_errno  = info->si_errno;
+    ssi->ssi_code   = info->si_code;
+    ssi->ssi_pid    = info->si_pid;
+    ssi->ssi_uid    = info->si_uid;
+    ssi->ssi_status = info->si_status;
+    ssi->ssi_int    = info->si_value.sival_int;
+    ssi->ssi_ptr    = (uintptr_t)info->si_value.sival_ptr;
+    ssi->ssi_addr   = (uintptr_t)info->si_addr;
+    ssi->ssi_band   = info->si_band;
+}
+
+/// @brief Reads the pending signals of the calling process, one structure each.
+/// @param file the signalfd.
+/// @param buf where the signalfd_siginfo structures are stored.
+/// @param offset ignored.
+/// @param nbyte the size of the buffer, which must hold one structure at least.
+/// @return the number of bytes read, -EINVAL, -EAGAIN, or -ERESTARTSYS if the
+/// process is going to sleep.
+static ssize_t __signalfd_read(vfs_file_t *file, char *buf, off_t offset, size_t nbyte)
+{
+    signalfd_ctx_t *ctx = (signalfd_ctx_t *)file->device;
+    task_struct *task   = scheduler_get_current_process();
+    siginfo_t info;
+    (void)offset;
+    if (nbyte < sizeof(struct signalfd_siginfo)) {
+        return -EINVAL;
+    }
+    // Only the first signal is waited for, the others are taken if pending.
+    ssize_t count = 0;
+    int nonblock  = bitmask_check(file->open_flags, O_NONBLOCK);
+    while (count + sizeof(struct signalfd_siginfo) <= nbyte) {
+        int sig = dequeue_signal(task, &ctx->sigmask, &info, nonblock || count);
+        if (sig < 0) {
+            return count ? count : sig;
+        }
+        __signalfd_copyinfo((struct signalfd_siginfo *)(buf + count), &info);
+        count += sizeof(struct signalfd_siginfo);
+    }
+    return count;
+}
+
+/// @brief Returns the events ready on a signalfd, which is readable when one
+/// of its signals is pending for the calling process.
+/// @param file the signalfd.
+/// @param table the table of the polling process, NULL if it does not sleep.
+/// @return the events.
+static unsigned int __signalfd_poll(vfs_file_t *file, poll_table_t *table)
+{
+    signalfd_ctx_t *ctx = (signalfd_ctx_t *)file->device;
+    task_struct *task   = scheduler_get_current_process();
+    poll_wait(file, &task->sighand->signalfd_wqh, table);
+    if ((task->pending.signal.sig[0] & ctx->sigmask.sig[0]) ||
+        (task->pending.signal.sig[1] & ctx->sigmask.sig[1])) {
+        return POLLIN | POLLRDNORM;
+    }
+    return 0;
+}
+
+/// Filesystem general operations.
+static vfs_sys_operations_t signalfd_sys_operations = {
+    .mkdir_f   = NULL,
+    .rmdir_f   = NULL,
+    .stat_f    = NULL,
+    .creat_f   = NULL,
+    .symlink_f = NULL,
+};
+
+/// Filesystem file operations.
+static vfs_file_operations_t signalfd_fs_operations = {
+    .open_f     = NULL,
+    .unlink_f   = NULL,
+    .close_f    = __signalfd_close,
+    .read_f     = __signalfd_read,
+    .write_f    = NULL,
+    .lseek_f    = NULL,
+    .stat_f     = NULL,
+    .ioctl_f    = NULL,
+    .getdents_f = NULL,
+    .readlink_f = NULL,
+    .poll_f     = __signalfd_poll,
+};
+
+/// @brief Returns the file of a descriptor of the calling process.
+/// @param fd the descriptor.
+/// @return the file, NULL if the descriptor is not open.
+static inline vfs_file_t *__signalfd_get_file(int fd)
+{
+    task_struct *task = scheduler_get_current_process();
+    if ((fd < 0) || (fd >= task->files->max_fd)) {
+        return NULL;
+    }
+    return task->files->fd_list[fd].file_struct;
+}
+
+int sys_signalfd(int fd, const sigset_t *mask, int flags)
+{
+    task_struct *task = scheduler_get_current_process();
+    if (mask == NULL) {
+        return -EFAULT;
+    }
+    if (flags & ~SFD_NONBLOCK) {
+        return -EINVAL;
+    }
+    // SIGKILL and SIGSTOP cannot be taken away from their default action.
+    sigset_t sigmask = *mask;
+    sigdelset(&sigmask, SIGKILL);
+    sigdelset(&sigmask, SIGSTOP);
+    // Change the signals of an existing descriptor.
+    if (fd != -1) {
+        vfs_file_t *file = __signalfd_get_file(fd);
+        if (!file) {
+            return -EBADF;
+        }
+        if (file->fs_operations != &signalfd_fs_operations) {
+            return -EINVAL;
+        }
+        ((signalfd_ctx_t *)file->device)->sigmask = sigmask;
+        // Some of the new signals might be pending already.
+        wake_up(&task->sighand->signalfd_wqh);
+        return fd;
+    }
+    signalfd_ctx_t *ctx = (signalfd_ctx_t *)kmalloc(sizeof(signalfd_ctx_t));
+    if (!ctx) {
+        return -ENOMEM;
+    }
+    ctx->sigmask     = sigmask;
+    vfs_file_t *file = kmem_cache_alloc(vfs_file_cache, GFP_KERNEL);
+    if (!file) {
+        kfree(ctx);
+        return -ENOMEM;
+    }
+    memset(file, 0, sizeof(vfs_file_t));
+    strcpy(file->name, "anon_inode:[signalfd]");
+    file->device         = ctx;
+    file->uid            = task->uid;
+    file->gid            = task->gid;
+    file->mask           = S_IRUSR | S_IWUSR;
+    file->open_flags     = O_RDONLY | flags;
+    file->count          = 1;
+    file->nlink          = 1;
+    file->sys_operations = &signalfd_sys_operations;
+    file->fs_operations  = &signalfd_fs_operations;
+    list_head_init(&file->siblings);
+    fd = get_unused_fd();
+    if (fd < 0) {
+        kfree(ctx);
+        kmem_cache_free(file);
+        return fd;
+    }
+    vfs_install_fd(task->files, fd, file, O_RDONLY | flags);
+    pr_debug("Created signalfd %d for process %d.\n", fd, task->pid);
+    return fd;
+}
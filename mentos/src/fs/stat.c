@@ -4,6 +4,7 @@
 /// See LICENSE.md for details.
 
 #include "io/debug.h"
+#include "fcntl.h"
 #include "fs/vfs.h"
 #include "limits.h"
 #include "mem/kheap.h"
@@ -22,12 +23,12 @@ int sys_fstat(int fd, stat_t *buf)
     task_struct *task = scheduler_get_current_process();
 
     // Check the current FD.
-    if (fd < 0 || fd >= task->max_fd) {
+    if (fd < 0 || fd >= task->files->max_fd) {
         return -EMFILE;
     }
 
     // Get the file descriptor.
-    vfs_file_descriptor_t *vfd = &task->fd_list[fd];
+    vfs_file_descriptor_t *vfd = &task->files->fd_list[fd];
 
     // Check the permissions.
 #if 0
@@ -43,3 +44,32 @@ int sys_fstat(int fd, stat_t *buf)
 
     return vfs_fstat(vfd->file_struct, buf);
 }
+
+int sys_statx(int dirfd, const char *path, int flags, unsigned int mask, stat_t *buf)
+{
+    if ((path == NULL) || (buf == NULL)) {
+        return -EFAULT;
+    }
+    if (flags != 0) {
+        return -EINVAL;
+    }
+    if (path[0] == 0) {
+        return -ENOENT;
+    }
+    // Absolute paths, and the ones relative to the working directory, are
+    // resolved from the root.
+    if ((path[0] == '/') || (dirfd == AT_FDCWD)) {
+        return vfs_stat(path, buf);
+    }
+    // Get the current task.
+    task_struct *task = scheduler_get_current_process();
+    // Check the directory.
+    if ((dirfd < 0) || (dirfd >= task->files->max_fd) || (task->files->fd_list[dirfd].file_struct == NULL)) {
+        return -EBADF;
+    }
+    vfs_file_t *directory = task->files->fd_list[dirfd].file_struct;
+    if ((directory->flags & DT_DIR) == 0) {
+        return -ENOTDIR;
+    }
+    return vfs_statat(directory, path, buf, mask);
+}
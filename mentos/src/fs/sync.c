@@ -0,0 +1,32 @@
+/// @file sync.c
+/// @brief Functions used to write back the modified filesystem data.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include "fs/vfs.h"
+#include "process/scheduler.h"
+#include "sys/errno.h"
+#include "system/syscall.h"
+
+int sys_sync(void)
+{
+    vfs_sync();
+    return 0;
+}
+
+int sys_fsync(int fd)
+{
+    // Get the current task.
+    task_struct *task = scheduler_get_current_process();
+    // Check the current FD.
+    if (fd < 0 || fd >= task->files->max_fd) {
+        return -EBADF;
+    }
+    // Get the file descriptor.
+    vfs_file_descriptor_t *vfd = &task->files->fd_list[fd];
+    // Check the file.
+    if (vfd->file_struct == NULL) {
+        return -EBADF;
+    }
+    return vfs_fsync(vfd->file_struct);
+}
@@ -0,0 +1,309 @@
+/// @file timerfd.c
+/// @brief Timers whose expirations are read from a file descriptor.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// A timerfd is a high-resolution timer counting its expirations, instead of
+/// sending a signal: reading it returns the counter, as 8 bytes, and resets
+/// it, while polling it reports if the counter is not zero. Both clocks are
+/// driven by the time since boot, CLOCK_REALTIME only differs for absolute
+/// expirations, which are converted with the current wall-clock time.
+
+// Setup the logging for this file (do this before any other include).
+#include "sys/kernel_levels.h"           // Include kernel log levels.
+#define __DEBUG_HEADER__ "[TIMEFD]"      ///< Change header.
+#define __DEBUG_LEVEL__  LOGLEVEL_NOTICE ///< Set log level.
+#include "io/debug.h"                    // Include debugging functions.
+
+#include "fcntl.h"
+#include "fs/poll.h"
+#include "fs/vfs.h"
+#include "hardware/hrtimer.h"
+#include "klib/irqflags.h"
+#include "klib/spinlock.h"
+#include "mem/kheap.h"
+#include "mem/slab.h"
+#include "poll.h"
+#include "process/scheduler.h"
+#include "process/wait.h"
+#include "string.h"
+#include "sys/errno.h"
+#include "sys/timerfd.h"
+#include "system/syscall.h"
+
+/// @brief A timerfd.
+typedef struct timerfd_ctx_t {
+    /// The timer.
+    hrtimer_t timer;
+    /// The clock of the timer.
+    clockid_t clockid;
+    /// The period, in nanoseconds, zero for a single expiration.
+    ktime_t interval;
+    /// The expirations which were not read yet.
+    unsigned long long ticks;
+    /// The processes waiting for an expiration.
+    wait_queue_head_t wqh;
+    /// Protects the counter, taken by the timer too.
+    spinlock_t lock;
+} timerfd_ctx_t;
+
+/// @brief Locks a timerfd, with the interrupts disabled, since the timer
+/// expires inside the interrupt handler.
+/// @param ctx the timerfd.
+/// @return the previous state of the interrupts.
+static inline uint8_t __timerfd_lock(timerfd_ctx_t *ctx)
+{
+    uint8_t flags = irq_disable();
+    spinlock_lock(&ctx->lock);
+    return flags;
+}
+
+/// @brief Unlocks a timerfd.
+/// @param ctx the timerfd.
+/// @param flags the previous state of the interrupts.
+static inline void __timerfd_unlock(timerfd_ctx_t *ctx, uint8_t flags)
+{
+    spinlock_unlock(&ctx->lock);
+    irq_enable(flags);
+}
+
+/// @brief Transforms a time specification to nanoseconds.
+/// @param ts the time specification.
+/// @return the nanoseconds.
+static inline ktime_t __timespec_to_ktime(const timespec *ts)
+{
+    return ((ktime_t)ts->tv_sec * NSEC_PER_SEC) + (ktime_t)ts->tv_nsec;
+}
+
+/// @brief Transforms nanoseconds to a time specification.
+/// @param ns the nanoseconds.
+/// @param ts where the time specification is stored.
+static inline void __ktime_to_timespec(ktime_t ns, timespec *ts)
+{
+    ts->tv_nsec = (long)div64_32(&ns, NSEC_PER_SEC);
+    ts->tv_sec  = (time_t)ns;
+}
+
+/// @brief Counts an expiration, and restarts the timer if it is periodic.
+/// @param timer the timer of the timerfd.
+static void __timerfd_timeout(hrtimer_t *timer)
+{
+    timerfd_ctx_t *ctx = (timerfd_ctx_t *)timer->data;
+    uint8_t flags      = __timerfd_lock(ctx);
+    ++ctx->ticks;
+    // Restart from the previous expiration, so that the period does not drift.
+    if (ctx->interval != 0) {
+        hrtimer_start(timer, timer->expires + ctx->interval);
+    }
+    __timerfd_unlock(ctx, flags);
+    wake_up(&ctx->wqh);
+}
+
+static int __timerfd_close(vfs_file_t *file)
+{
+    timerfd_ctx_t *ctx = (timerfd_ctx_t *)file->device;
+    hrtimer_cancel(&ctx->timer);
+    kfree(ctx);
+    kmem_cache_free(file);
+    return 0;
+}
+
+/// @brief Reads, and resets, the expirations of a timerfd.
+/// @param file the timerfd.
+/// @param buf where the counter is stored, as 8 bytes.
+/// @param offset ignored.
+/// @param nbyte the size of the buffer, 8 bytes at least.
+/// @return the number of bytes read, -EINVAL, -EAGAIN, or -ERESTARTSYS if the
+/// process is going to sleep.
+static ssize_t __timerfd_read(vfs_file_t *file, char *buf, off_t offset, size_t nbyte)
+{
+    timerfd_ctx_t *ctx = (timerfd_ctx_t *)file->device;
+    (void)offset;
+    if (nbyte < sizeof(unsigned long long)) {
+        return -EINVAL;
+    }
+    uint8_t flags = __timerfd_lock(ctx);
+    if (ctx->ticks == 0) {
+        if (bitmask_check(file->open_flags, O_NONBLOCK)) {
+            __timerfd_unlock(ctx, flags);
+            return -EAGAIN;
+        }
+        // Queue ourselves before unlocking, so that no expiration is missed.
+        sleep_on(&ctx->wqh)->func = autoremove_wake_function;
+        __timerfd_unlock(ctx, flags);
+        return -ERESTARTSYS;
+    }
+    unsigned long long ticks = ctx->ticks;
+    ctx->ticks               = 0;
+    __timerfd_unlock(ctx, flags);
+    memcpy(buf, &ticks, sizeof(unsigned long long));
+    return sizeof(unsigned long long);
+}
+
+/// @brief Returns the events ready on a timerfd, which is readable when it
+/// expired since the last read.
+/// @param file the timerfd.
+/// @param table the table of the polling process, NULL if it does not sleep.
+/// @return the events.
+static unsigned int __timerfd_poll(vfs_file_t *file, poll_table_t *table)
+{
+    timerfd_ctx_t *ctx = (timerfd_ctx_t *)file->device;
+    poll_wait(file, &ctx->wqh, table);
+    uint8_t flags = __timerfd_lock(ctx);
+    int expired   = (ctx->ticks != 0);
+    __timerfd_unlock(ctx, flags);
+    return expired ? (POLLIN | POLLRDNORM) : 0;
+}
+
+/// Filesystem general operations.
+static vfs_sys_operations_t timerfd_sys_operations = {
+    .mkdir_f   = NULL,
+    .rmdir_f   = NULL,
+    .stat_f    = NULL,
+    .creat_f   = NULL,
+    .symlink_f = NULL,
+};
+
+/// Filesystem file operations.
+static vfs_file_operations_t timerfd_fs_operations = {
+    .open_f     = NULL,
+    .unlink_f   = NULL,
+    .close_f    = __timerfd_close,
+    .read_f     = __timerfd_read,
+    .write_f    = NULL,
+    .lseek_f    = NULL,
+    .stat_f     = NULL,
+    .ioctl_f    = NULL,
+    .getdents_f = NULL,
+    .readlink_f = NULL,
+    .poll_f     = __timerfd_poll,
+};
+
+/// @brief Returns the timerfd of a descriptor of the calling process.
+/// @param fd the descriptor.
+/// @param ctx where the timerfd is stored.
+/// @return 0 on success, -EBADF if the descriptor is not open, -EINVAL if it
+/// is not a timerfd.
+static inline int __timerfd_get(int fd, timerfd_ctx_t **ctx)
+{
+    task_struct *task = scheduler_get_current_process();
+    if ((fd < 0) || (fd >= task->files->max_fd) || !task->files->fd_list[fd].file_struct) {
+        return -EBADF;
+    }
+    vfs_file_t *file = task->files->fd_list[fd].file_struct;
+    if (file->fs_operations != &timerfd_fs_operations) {
+        return -EINVAL;
+    }
+    *ctx = (timerfd_ctx_t *)file->device;
+    return 0;
+}
+
+int sys_timerfd_create(clockid_t clockid, int flags)
+{
+    task_struct *task = scheduler_get_current_process();
+    if ((clockid != CLOCK_REALTIME) && (clockid != CLOCK_MONOTONIC)) {
+        return -EINVAL;
+    }
+    if (flags & ~TFD_NONBLOCK) {
+        return -EINVAL;
+    }
+    timerfd_ctx_t *ctx = (timerfd_ctx_t *)kmalloc(sizeof(timerfd_ctx_t));
+    if (!ctx) {
+        return -ENOMEM;
+    }
+    memset(ctx, 0, sizeof(timerfd_ctx_t));
+    ctx->clockid = clockid;
+    hrtimer_init(&ctx->timer, __timerfd_timeout, (unsigned long)ctx);
+    init_waitqueue_head(&ctx->wqh);
+    spinlock_init(&ctx->lock);
+    vfs_file_t *file = kmem_cache_alloc(vfs_file_cache, GFP_KERNEL);
+    if (!file) {
+        kfree(ctx);
+        return -ENOMEM;
+    }
+    memset(file, 0, sizeof(vfs_file_t));
+    strcpy(file->name, "anon_inode:[timerfd]");
+    file->device         = ctx;
+    file->uid            = task->uid;
+    file->gid            = task->gid;
+    file->mask           = S_IRUSR | S_IWUSR;
+    file->open_flags     = O_RDONLY | flags;
+    file->count          = 1;
+    file->nlink          = 1;
+    file->sys_operations = &timerfd_sys_operations;
+    file->fs_operations  = &timerfd_fs_operations;
+    list_head_init(&file->siblings);
+    int fd = get_unused_fd();
+    if (fd < 0) {
+        kfree(ctx);
+        kmem_cache_free(file);
+        return fd;
+    }
+    vfs_install_fd(task->files, fd, file, O_RDONLY | flags);
+    pr_debug("Created timerfd %d for process %d.\n", fd, task->pid);
+    return fd;
+}
+
+int sys_timerfd_gettime(int fd, itimerspec *curr_value)
+{
+    timerfd_ctx_t *ctx;
+    int ret = __timerfd_get(fd, &ctx);
+    if (ret < 0) {
+        return ret;
+    }
+    if (curr_value == NULL) {
+        return -EFAULT;
+    }
+    ktime_t now = hrtimer_get_time(), remaining = 0;
+    uint8_t flags = __timerfd_lock(ctx);
+    if (ctx->timer.queued && (ctx->timer.expires > now)) {
+        remaining = ctx->timer.expires - now;
+    }
+    ktime_t interval = ctx->interval;
+    __timerfd_unlock(ctx, flags);
+    __ktime_to_timespec(interval, &curr_value->it_interval);
+    __ktime_to_timespec(remaining, &curr_value->it_value);
+    return 0;
+}
+
+int sys_timerfd_settime(int fd, int flags, const itimerspec *new_value, itimerspec *old_value)
+{
+    timerfd_ctx_t *ctx;
+    int ret = __timerfd_get(fd, &ctx);
+    if (ret < 0) {
+        return ret;
+    }
+    if (new_value == NULL) {
+        return -EFAULT;
+    }
+    if (flags & ~TFD_TIMER_ABSTIME) {
+        return -EINVAL;
+    }
+    if ((new_value->it_interval.tv_nsec < 0) || ((ktime_t)new_value->it_interval.tv_nsec >= NSEC_PER_SEC) ||
+        (new_value->it_value.tv_nsec < 0) || ((ktime_t)new_value->it_value.tv_nsec >= NSEC_PER_SEC)) {
+        return -EINVAL;
+    }
+    if (old_value != NULL) {
+        sys_timerfd_gettime(fd, old_value);
+    }
+    ktime_t now = hrtimer_get_time(), value = __timespec_to_ktime(&new_value->it_value);
+    // Convert the expiration to the time since boot, an absolute one in the
+    // past fires straight away.
+    if (value != 0) {
+        if (flags & TFD_TIMER_ABSTIME) {
+            ktime_t base = (ctx->clockid == CLOCK_REALTIME) ? (ktime_t)sys_time(NULL) * NSEC_PER_SEC : now;
+            value        = (value > base) ? (value - base) : 0;
+        }
+        value += now;
+    }
+    // Disarm the timer, and forget the expirations of the previous setting.
+    uint8_t irqflags = __timerfd_lock(ctx);
+    hrtimer_cancel(&ctx->timer);
+    ctx->ticks    = 0;
+    ctx->interval = __timespec_to_ktime(&new_value->it_interval);
+    if (value != 0) {
+        hrtimer_start(&ctx->timer, value);
+    }
+    __timerfd_unlock(ctx, irqflags);
+    return 0;
+}
@@ -0,0 +1,994 @@
+/// @file tmpfs.c
+/// @brief Memory-backed file system.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// The files live only in memory: their content is kept in pages taken
+/// directly from the zone allocator, one page per PAGE_SIZE bytes of data,
+/// allocated when first written. Pages never written read back as zeros.
+/// Shared mappings map these very pages, so the processes mapping a file (e.g.,
+/// a POSIX shared memory object, or a memfd) exchange data without copies.
+
+// Setup the logging for this file (do this before any other include).
+#include "sys/kernel_levels.h"           // Include kernel log levels.
+#define __DEBUG_HEADER__ "[TMPFS ]"      ///< Change header.
+#define __DEBUG_LEVEL__  LOGLEVEL_NOTICE ///< Set log level.
+#include "io/debug.h"                    // Include debugging functions.
+
+#include "assert.h"
+#include "fcntl.h"
+#include "fs/tmpfs.h"
+#include "fs/vfs.h"
+#include "klib/hashmap.h"
+#include "libgen.h"
+#include "math.h"
+#include "mem/kheap.h"
+#include "mem/paging.h"
+#include "mem/slab.h"
+#include "mem/zone_allocator.h"
+#include "process/scheduler.h"
+#include "stdio.h"
+#include "string.h"
+#include "sys/errno.h"
+#include "sys/mman.h"
+#include "time.h"
+
+/// Maximum length of the path of a TMPFS file.
+#define TMPFS_NAME_MAX 255U
+/// The magic number used to check if the tmpfs file is valid.
+#define TMPFS_MAGIC_NUMBER 0xC5
+/// Number of buckets of the table indexing the files by path.
+#define TMPFS_HASH_BUCKETS 256U
+/// Maximum length of the name of a memfd.
+#define MFD_NAME_MAX 249U
+
+// ============================================================================
+// Data Structures
+// ============================================================================
+
+/// @brief Information concerning a file.
+typedef struct tmpfs_file_t {
+    /// Number used as delimiter, it must be set to 0xC5.
+    int magic;
+    /// The file inode.
+    uint32_t inode;
+    /// Flags (DT_DIR or DT_REG).
+    unsigned flags;
+    /// The permissions of the file.
+    mode_t mask;
+    /// The absolute path of the file.
+    char name[TMPFS_NAME_MAX];
+    /// User id of the file.
+    uid_t uid;
+    /// Group id of the file.
+    gid_t gid;
+    /// Time of last access.
+    time_t atime;
+    /// Time of last data modification.
+    time_t mtime;
+    /// Time of last status change.
+    time_t ctime;
+    /// The size of the file, in bytes.
+    uint32_t size;
+    /// The pages holding the content, NULL where nothing was written yet.
+    page_t **pages;
+    /// The number of entries of pages.
+    uint32_t npages;
+    /// Set once the file is removed, it is freed when its last user closes it.
+    bool_t unlinked;
+    /// Set on the roots of the mount points, which cannot be removed.
+    bool_t mountpoint;
+    /// The VFS files opened on this file.
+    list_head files;
+    /// The number of areas mapping the file.
+    uint32_t nr_maps;
+    /// The directory containing the file, NULL for the root.
+    struct tmpfs_file_t *parent;
+    /// The files inside the directory.
+    list_head children;
+    /// Link inside the children of the parent directory.
+    list_head child_link;
+} tmpfs_file_t;
+
+/// @brief The state of the filesystem, shared by all its mount points.
+typedef struct tmpfs_t {
+    /// The files, indexed by their absolute path.
+    hashmap_t *paths;
+    /// The inode given to the next file.
+    uint32_t next_inode;
+    /// The number of pages holding file content.
+    uint32_t nr_pages;
+    /// Cache for creating new `tmpfs_file_t`.
+    kmem_cache_t *tmpfs_file_cache;
+} tmpfs_t;
+
+/// The tmpfs filesystem.
+static tmpfs_t tmpfs;
+
+// ============================================================================
+// Forward Declaration of Functions
+// ============================================================================
+
+static int tmpfs_mkdir(const char *path, mode_t mode);
+static int tmpfs_rmdir(const char *path);
+static int tmpfs_stat(const char *path, stat_t *stat);
+static vfs_file_t *tmpfs_creat(const char *path, mode_t mode);
+static int tmpfs_setattr(const char *path, struct iattr *attr);
+
+static vfs_file_t *tmpfs_open(const char *path, int flags, mode_t mode);
+static int tmpfs_unlink(const char *path);
+static int tmpfs_close(vfs_file_t *file);
+static ssize_t tmpfs_read(vfs_file_t *file, char *buffer, off_t offset, size_t nbyte);
+static ssize_t tmpfs_write(vfs_file_t *file, const void *buffer, off_t offset, size_t nbyte);
+static off_t tmpfs_lseek(vfs_file_t *file, off_t offset, int whence);
+static int tmpfs_fstat(vfs_file_t *file, stat_t *stat);
+static int tmpfs_statat(vfs_file_t *directory, const char *path, stat_t *stat, unsigned int mask);
+static ssize_t tmpfs_getdents(vfs_file_t *file, dirent_t *dirp, off_t doff, size_t count);
+static int tmpfs_fsetattr(vfs_file_t *file, struct iattr *attr);
+static int tmpfs_fsync(vfs_file_t *file);
+static int tmpfs_mmap(vfs_file_t *file, vm_area_struct_t *area);
+
+static void tmpfs_vm_open(vm_area_struct_t *area);
+static void tmpfs_vm_close(vm_area_struct_t *area);
+static page_t *tmpfs_vm_fault(vm_area_struct_t *area, uint32_t index);
+
+// ============================================================================
+// Virtual FileSystem (VFS) Operaions
+// ============================================================================
+
+/// Filesystem general operations.
+static vfs_sys_operations_t tmpfs_sys_operations = {
+    .mkdir_f   = tmpfs_mkdir,
+    .rmdir_f   = tmpfs_rmdir,
+    .stat_f    = tmpfs_stat,
+    .creat_f   = tmpfs_creat,
+    .symlink_f = NULL,
+    .setattr_f = tmpfs_setattr,
+};
+
+/// Filesystem file operations.
+static vfs_file_operations_t tmpfs_fs_operations = {
+    .open_f     = tmpfs_open,
+    .unlink_f   = tmpfs_unlink,
+    .close_f    = tmpfs_close,
+    .read_f     = tmpfs_read,
+    .write_f    = tmpfs_write,
+    .lseek_f    = tmpfs_lseek,
+    .stat_f     = tmpfs_fstat,
+    .ioctl_f    = NULL,
+    .getdents_f = tmpfs_getdents,
+    .readlink_f = NULL,
+    .setattr_f  = tmpfs_fsetattr,
+    .fsync_f    = tmpfs_fsync,
+    .statat_f   = tmpfs_statat,
+    .mmap_f     = tmpfs_mmap,
+};
+
+/// Operations of the shared mappings of the files.
+static const vm_operations_t tmpfs_vm_operations = {
+    .open  = tmpfs_vm_open,
+    .close = tmpfs_vm_close,
+    .fault = tmpfs_vm_fault,
+};
+
+// ============================================================================
+// TMPFS Core Functions
+// ============================================================================
+
+/// @brief Finds the TMPFS file at the given path.
+/// @param path the absolute path to the entry.
+/// @return a pointer to the TMPFS file, NULL otherwise.
+static inline tmpfs_file_t *__tmpfs_find(const char *path)
+{
+    return (tmpfs_file_t *)hashmap_get(tmpfs.paths, path);
+}
+
+/// @brief Returns the TMPFS file behind a VFS file.
+/// @param file the VFS file.
+/// @return a pointer to the TMPFS file, NULL if the VFS file is not ours.
+static inline tmpfs_file_t *__tmpfs_get_file(vfs_file_t *file)
+{
+    tmpfs_file_t *tmpfs_file = file ? (tmpfs_file_t *)file->device : NULL;
+    if (tmpfs_file && (tmpfs_file->magic == TMPFS_MAGIC_NUMBER)) {
+        return tmpfs_file;
+    }
+    return NULL;
+}
+
+/// @brief Finds the directory which would contain the file at the given path.
+/// @param path the absolute path of the file.
+/// @param parent where the directory is stored.
+/// @return 0 on success, -ENOENT if it does not exist, -ENOTDIR if it is not
+/// a directory.
+static inline int __tmpfs_find_parent(const char *path, tmpfs_file_t **parent)
+{
+    char parent_path[PATH_MAX];
+    if (!dirname(path, parent_path, sizeof(parent_path))) {
+        return -ENOENT;
+    }
+    if ((*parent = __tmpfs_find(parent_path)) == NULL) {
+        return -ENOENT;
+    }
+    if (!bitmask_check((*parent)->flags, DT_DIR)) {
+        return -ENOTDIR;
+    }
+    return 0;
+}
+
+/// @brief Creates a new TMPFS file.
+/// @param path the absolute path of the file.
+/// @param flags the type of the file.
+/// @param mode the permissions of the file.
+/// @param parent the directory containing the file, NULL for the root.
+/// @return a pointer to the new TMPFS file, NULL otherwise.
+static tmpfs_file_t *__tmpfs_create_file(const char *path, unsigned flags, mode_t mode, tmpfs_file_t *parent)
+{
+    if (strlen(path) >= TMPFS_NAME_MAX) {
+        errno = ENAMETOOLONG;
+        return NULL;
+    }
+    tmpfs_file_t *tmpfs_file = (tmpfs_file_t *)kmem_cache_alloc(tmpfs.tmpfs_file_cache, GFP_KERNEL);
+    if (!tmpfs_file) {
+        pr_err("Failed to allocate a new file for `%s`.\n", path);
+        errno = ENOSPC;
+        return NULL;
+    }
+    memset(tmpfs_file, 0, sizeof(tmpfs_file_t));
+    tmpfs_file->magic = TMPFS_MAGIC_NUMBER;
+    tmpfs_file->inode = tmpfs.next_inode++;
+    tmpfs_file->flags = flags;
+    tmpfs_file->mask  = mode & 0xFFF;
+    strcpy(tmpfs_file->name, path);
+    // The file belongs to whoever creates it.
+    task_struct *task = scheduler_get_current_process();
+    tmpfs_file->uid   = task ? task->uid : 0;
+    tmpfs_file->gid   = task ? task->gid : 0;
+    tmpfs_file->atime = sys_time(NULL);
+    tmpfs_file->mtime = tmpfs_file->atime;
+    tmpfs_file->ctime = tmpfs_file->atime;
+    list_head_init(&tmpfs_file->files);
+    list_head_init(&tmpfs_file->children);
+    list_head_init(&tmpfs_file->child_link);
+    // Add the file to its directory.
+    tmpfs_file->parent = parent;
+    if (parent) {
+        list_head_insert_before(&tmpfs_file->child_link, &parent->children);
+        parent->mtime = tmpfs_file->atime;
+    }
+    // Index the file by path.
+    hashmap_set(tmpfs.paths, tmpfs_file->name, tmpfs_file);
+    pr_debug("__tmpfs_create_file(%p) `%s`\n", tmpfs_file, path);
+    return tmpfs_file;
+}
+
+/// @brief Checks if the file is neither open nor mapped by anyone.
+/// @param tmpfs_file the file.
+/// @return true if nobody uses the file.
+static inline bool_t __tmpfs_unused(tmpfs_file_t *tmpfs_file)
+{
+    return list_head_empty(&tmpfs_file->files) && (tmpfs_file->nr_maps == 0);
+}
+
+/// @brief Frees the pages of the file starting from the given one.
+/// @param tmpfs_file the file.
+/// @param first the index of the first page to free.
+/// @details The pages still mapped by some process are freed by the last one
+/// unmapping them.
+static void __tmpfs_free_pages(tmpfs_file_t *tmpfs_file, uint32_t first)
+{
+    page_t *page;
+    for (uint32_t index = first; index < tmpfs_file->npages; ++index) {
+        if ((page = tmpfs_file->pages[index]) != NULL) {
+            if (page_count(page) > 1) {
+                page_dec(page);
+            } else {
+                __free_pages(page);
+            }
+            tmpfs_file->pages[index] = NULL;
+            --tmpfs.nr_pages;
+        }
+    }
+}
+
+/// @brief Shrinks the file to the given size.
+/// @param tmpfs_file the file.
+/// @param size the new size, not larger than the current one.
+static void __tmpfs_truncate(tmpfs_file_t *tmpfs_file, uint32_t size)
+{
+    uint32_t first = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+    __tmpfs_free_pages(tmpfs_file, first);
+    // Clear the tail of the last page, a later extension must read zeros.
+    if ((size % PAGE_SIZE) && (first <= tmpfs_file->npages) && tmpfs_file->pages[first - 1]) {
+        uint8_t *data = (uint8_t *)get_lowmem_address_from_page(tmpfs_file->pages[first - 1]);
+        memset(data + (size % PAGE_SIZE), 0, PAGE_SIZE - (size % PAGE_SIZE));
+    }
+    tmpfs_file->size  = size;
+    tmpfs_file->mtime = sys_time(NULL);
+    tmpfs_file->ctime = tmpfs_file->mtime;
+}
+
+/// @brief Destroys the given TMPFS file, and frees its content.
+/// @param tmpfs_file the file, which must not be reachable anymore.
+static void __tmpfs_destroy_file(tmpfs_file_t *tmpfs_file)
+{
+    pr_debug("__tmpfs_destroy_file(%p) `%s`\n", tmpfs_file, tmpfs_file->name);
+    __tmpfs_free_pages(tmpfs_file, 0);
+    if (tmpfs_file->pages) {
+        kfree(tmpfs_file->pages);
+    }
+    tmpfs_file->magic = 0;
+    kmem_cache_free(tmpfs_file);
+}
+
+/// @brief Makes the file unreachable, and destroys it if nobody uses it.
+/// @param tmpfs_file the file.
+static void __tmpfs_remove_file(tmpfs_file_t *tmpfs_file)
+{
+    hashmap_remove(tmpfs.paths, tmpfs_file->name);
+    list_head_remove(&tmpfs_file->child_link);
+    if (tmpfs_file->parent) {
+        tmpfs_file->parent->mtime = sys_time(NULL);
+        tmpfs_file->parent        = NULL;
+    }
+    tmpfs_file->unlinked = true;
+    if (__tmpfs_unused(tmpfs_file)) {
+        __tmpfs_destroy_file(tmpfs_file);
+    }
+}
+
+/// @brief Makes room in the table of the pages for the given number of pages.
+/// @param tmpfs_file the file.
+/// @param npages the number of pages.
+/// @return 0 on success, -ENOSPC if the table cannot grow.
+static int __tmpfs_reserve(tmpfs_file_t *tmpfs_file, uint32_t npages)
+{
+    if (npages <= tmpfs_file->npages) {
+        return 0;
+    }
+    // Grow geometrically, so that appending is not quadratic.
+    uint32_t capacity = max(max(npages, tmpfs_file->npages * 2), 8U);
+    page_t **pages    = (page_t **)kmalloc(capacity * sizeof(page_t *));
+    if (pages == NULL) {
+        return -ENOSPC;
+    }
+    memset(pages, 0, capacity * sizeof(page_t *));
+    if (tmpfs_file->pages) {
+        memcpy(pages, tmpfs_file->pages, tmpfs_file->npages * sizeof(page_t *));
+        kfree(tmpfs_file->pages);
+    }
+    tmpfs_file->pages  = pages;
+    tmpfs_file->npages = capacity;
+    return 0;
+}
+
+/// @brief Creates a VFS file, from a TMPFS file.
+/// @param tmpfs_file the TMPFS file.
+/// @return a pointer to the newly create VFS file, NULL on failure.
+static vfs_file_t *__tmpfs_create_file_struct(tmpfs_file_t *tmpfs_file)
+{
+    vfs_file_t *vfs_file = kmem_cache_alloc(vfs_file_cache, GFP_KERNEL);
+    if (!vfs_file) {
+        pr_err("Failed to allocate memory for the VFS file of `%s`.\n", tmpfs_file->name);
+        errno = ENFILE;
+        return NULL;
+    }
+    memset(vfs_file, 0, sizeof(vfs_file_t));
+    strcpy(vfs_file->name, basename(tmpfs_file->name));
+    vfs_file->device         = tmpfs_file;
+    vfs_file->ino            = tmpfs_file->inode;
+    vfs_file->uid            = tmpfs_file->uid;
+    vfs_file->gid            = tmpfs_file->gid;
+    vfs_file->mask           = tmpfs_file->mask;
+    vfs_file->length         = tmpfs_file->size;
+    vfs_file->flags          = tmpfs_file->flags;
+    vfs_file->nlink          = 1;
+    vfs_file->sys_operations = &tmpfs_sys_operations;
+    vfs_file->fs_operations  = &tmpfs_fs_operations;
+    list_head_init(&vfs_file->siblings);
+    // Add the vfs_file to the list of associated files.
+    list_head_insert_before(&vfs_file->siblings, &tmpfs_file->files);
+    return vfs_file;
+}
+
+/// @brief Saves the information concerning the file.
+/// @param tmpfs_file the file.
+/// @param stat the structure where the information are stored.
+/// @return 0.
+static int __tmpfs_stat(tmpfs_file_t *tmpfs_file, stat_t *stat)
+{
+    stat->st_mode  = (bitmask_check(tmpfs_file->flags, DT_DIR) ? 0040000 : 0100000) | tmpfs_file->mask;
+    stat->st_uid   = tmpfs_file->uid;
+    stat->st_gid   = tmpfs_file->gid;
+    stat->st_dev   = 0;
+    stat->st_ino   = tmpfs_file->inode;
+    stat->st_size  = tmpfs_file->size;
+    stat->st_atime = tmpfs_file->atime;
+    stat->st_mtime = tmpfs_file->mtime;
+    stat->st_ctime = tmpfs_file->ctime;
+    return 0;
+}
+
+/// @brief Modifies the attributes of the file.
+/// @param tmpfs_file the file.
+/// @param attr the attributes to change.
+/// @return 0 on success, -errno on failure.
+static int __tmpfs_setattr(tmpfs_file_t *tmpfs_file, struct iattr *attr)
+{
+    if (attr->ia_valid & ATTR_MODE) {
+        tmpfs_file->mask = attr->ia_mode & 0xFFF;
+    }
+    if (attr->ia_valid & ATTR_UID) {
+        tmpfs_file->uid = attr->ia_uid;
+    }
+    if (attr->ia_valid & ATTR_GID) {
+        tmpfs_file->gid = attr->ia_gid;
+    }
+    if (attr->ia_valid & ATTR_ATIME) {
+        tmpfs_file->atime = attr->ia_atime;
+    }
+    if (attr->ia_valid & ATTR_MTIME) {
+        tmpfs_file->mtime = attr->ia_mtime;
+    }
+    if (attr->ia_valid & ATTR_CTIME) {
+        tmpfs_file->ctime = attr->ia_ctime;
+    }
+    if (attr->ia_valid & ATTR_SIZE) {
+        if (attr->ia_size < 0) {
+            return -EINVAL;
+        }
+        if ((uint32_t)attr->ia_size < tmpfs_file->size) {
+            __tmpfs_truncate(tmpfs_file, attr->ia_size);
+        } else {
+            // The pages are allocated when written, holes read as zeros.
+            tmpfs_file->size  = attr->ia_size;
+            tmpfs_file->mtime = sys_time(NULL);
+            tmpfs_file->ctime = tmpfs_file->mtime;
+        }
+    }
+    // Keep the open files in sync.
+    list_for_each_decl(it, &tmpfs_file->files)
+    {
+        vfs_file_t *file = list_entry(it, vfs_file_t, siblings);
+        file->mask       = tmpfs_file->mask;
+        file->uid        = tmpfs_file->uid;
+        file->gid        = tmpfs_file->gid;
+        file->length     = tmpfs_file->size;
+    }
+    return 0;
+}
+
+// ============================================================================
+// Virtual FileSystem (VFS) Functions
+// ============================================================================
+
+/// @brief Creates a new directory.
+/// @param path The absolute path to the new directory.
+/// @param mode The permissions of the directory.
+/// @return 0 on success, -errno on failure.
+static int tmpfs_mkdir(const char *path, mode_t mode)
+{
+    if (__tmpfs_find(path) != NULL) {
+        return -EEXIST;
+    }
+    tmpfs_file_t *parent;
+    int ret = __tmpfs_find_parent(path, &parent);
+    if (ret < 0) {
+        return ret;
+    }
+    if (!__tmpfs_create_file(path, DT_DIR, mode, parent)) {
+        return -errno;
+    }
+    return 0;
+}
+
+/// @brief Removes a directory.
+/// @param path The absolute path to the directory.
+/// @return 0 on success, -errno on failure.
+static int tmpfs_rmdir(const char *path)
+{
+    tmpfs_file_t *tmpfs_file = __tmpfs_find(path);
+    if (tmpfs_file == NULL) {
+        return -ENOENT;
+    }
+    if (!bitmask_check(tmpfs_file->flags, DT_DIR)) {
+        return -ENOTDIR;
+    }
+    // The root of a mount point goes away with the mount point.
+    if (tmpfs_file->mountpoint) {
+        return -EBUSY;
+    }
+    if (!list_head_empty(&tmpfs_file->children)) {
+        return -ENOTEMPTY;
+    }
+    __tmpfs_remove_file(tmpfs_file);
+    return 0;
+}
+
+/// @brief Opens the file at the given path.
+/// @param path  The absolute path to the file.
+/// @param flags The flags used to determine the behavior of the function.
+/// @param mode  The permissions of the file, if it is created.
+/// @return The VFS file, NULL on failure and errno is set.
+static vfs_file_t *tmpfs_open(const char *path, int flags, mode_t mode)
+{
+    tmpfs_file_t *tmpfs_file = __tmpfs_find(path);
+    if (tmpfs_file != NULL) {
+        if (bitmask_check(flags, O_CREAT | O_EXCL)) {
+            errno = EEXIST;
+            return NULL;
+        }
+        bool_t writing = bitmask_check(flags, O_WRONLY) || bitmask_check(flags, O_RDWR);
+        if (bitmask_check(tmpfs_file->flags, DT_DIR)) {
+            if (writing) {
+                errno = EISDIR;
+                return NULL;
+            }
+        } else if (bitmask_check(flags, O_DIRECTORY)) {
+            errno = ENOTDIR;
+            return NULL;
+        }
+        if (!vfs_valid_open_permissions(flags, tmpfs_file->mask, tmpfs_file->uid, tmpfs_file->gid)) {
+            errno = EACCES;
+            return NULL;
+        }
+        if (writing && bitmask_check(flags, O_TRUNC) && tmpfs_file->size) {
+            __tmpfs_truncate(tmpfs_file, 0);
+        }
+        tmpfs_file->atime = sys_time(NULL);
+        return __tmpfs_create_file_struct(tmpfs_file);
+    }
+    if (!bitmask_check(flags, O_CREAT)) {
+        errno = ENOENT;
+        return NULL;
+    }
+    tmpfs_file_t *parent;
+    int ret = __tmpfs_find_parent(path, &parent);
+    if (ret < 0) {
+        errno = -ret;
+        return NULL;
+    }
+    //  When both O_CREAT and O_DIRECTORY are specified in flags and the file
+    //  specified by pathname does not exist, open() will create a regular file
+    //  (i.e., O_DIRECTORY is ignored).
+    if ((tmpfs_file = __tmpfs_create_file(path, DT_REG, mode, parent)) == NULL) {
+        return NULL;
+    }
+    return __tmpfs_create_file_struct(tmpfs_file);
+}
+
+/// @brief Creates a file, or truncates it if it exists.
+/// @param path The absolute path to the file.
+/// @param mode The permissions of the file.
+/// @return The VFS file, NULL on failure and errno is set.
+static vfs_file_t *tmpfs_creat(const char *path, mode_t mode)
+{
+    return tmpfs_open(path, O_WRONLY | O_CREAT | O_TRUNC, mode);
+}
+
+/// @brief Closes the given file.
+/// @param file The file structure.
+/// @return 0.
+static int tmpfs_close(vfs_file_t *file)
+{
+    assert(file && "Received null file.");
+    tmpfs_file_t *tmpfs_file = __tmpfs_get_file(file);
+    list_head_remove(&file->siblings);
+    kmem_cache_free(file);
+    // The last user of a removed file frees it.
+    if (tmpfs_file && tmpfs_file->unlinked && __tmpfs_unused(tmpfs_file)) {
+        __tmpfs_destroy_file(tmpfs_file);
+    }
+    return 0;
+}
+
+/// @brief Deletes the file at the given path.
+/// @param path The absolute path to the file.
+/// @return 0 on success, -errno on failure.
+/// @details The content stays available to those who have the file open,
+/// until they close it.
+static int tmpfs_unlink(const char *path)
+{
+    tmpfs_file_t *tmpfs_file = __tmpfs_find(path);
+    if (tmpfs_file == NULL) {
+        return -ENOENT;
+    }
+    if (bitmask_check(tmpfs_file->flags, DT_DIR)) {
+        return -EISDIR;
+    }
+    __tmpfs_remove_file(tmpfs_file);
+    return 0;
+}
+
+/// @brief Reads from the file.
+/// @param file The file.
+/// @param buffer Buffer where the read content must be placed.
+/// @param offset Offset from which we start reading from the file.
+/// @param nbyte The number of bytes to read.
+/// @return The number of read bytes, -errno on failure.
+static ssize_t tmpfs_read(vfs_file_t *file, char *buffer, off_t offset, size_t nbyte)
+{
+    tmpfs_file_t *tmpfs_file = __tmpfs_get_file(file);
+    if (tmpfs_file == NULL) {
+        return -EBADF;
+    }
+    if (bitmask_check(tmpfs_file->flags, DT_DIR)) {
+        return -EISDIR;
+    }
+    if ((offset < 0) || ((uint32_t)offset >= tmpfs_file->size)) {
+        return 0;
+    }
+    nbyte = min(nbyte, tmpfs_file->size - (uint32_t)offset);
+    for (size_t done = 0, chunk; done < nbyte; done += chunk) {
+        uint32_t position = offset + done;
+        uint32_t index    = position / PAGE_SIZE;
+        uint32_t in_page  = position % PAGE_SIZE;
+        chunk             = min(PAGE_SIZE - in_page, nbyte - done);
+        if ((index < tmpfs_file->npages) && tmpfs_file->pages[index]) {
+            memcpy(buffer + done, (uint8_t *)get_lowmem_address_from_page(tmpfs_file->pages[index]) + in_page, chunk);
+        } else {
+            memset(buffer + done, 0, chunk);
+        }
+    }
+    tmpfs_file->atime = sys_time(NULL);
+    return nbyte;
+}
+
+/// @brief Writes the given content inside the file.
+/// @param file The file.
+/// @param buffer The content to write.
+/// @param offset Offset from which we start writing in the file.
+/// @param nbyte The number of bytes to write.
+/// @return The number of written bytes, -errno on failure.
+static ssize_t tmpfs_write(vfs_file_t *file, const void *buffer, off_t offset, size_t nbyte)
+{
+    tmpfs_file_t *tmpfs_file = __tmpfs_get_file(file);
+    if (tmpfs_file == NULL) {
+        return -EBADF;
+    }
+    if (bitmask_check(tmpfs_file->flags, DT_DIR)) {
+        return -EISDIR;
+    }
+    if ((offset < 0) || ((uint32_t)offset > (0xFFFFFFFFU - nbyte))) {
+        return -EFBIG;
+    }
+    if (nbyte == 0) {
+        return 0;
+    }
+    if (__tmpfs_reserve(tmpfs_file, (offset + nbyte + PAGE_SIZE - 1) / PAGE_SIZE) < 0) {
+        return -ENOSPC;
+    }
+    size_t done = 0, chunk;
+    for (; done < nbyte; done += chunk) {
+        uint32_t position = offset + done;
+        uint32_t index    = position / PAGE_SIZE;
+        uint32_t in_page  = position % PAGE_SIZE;
+        chunk             = min(PAGE_SIZE - in_page, nbyte - done);
+        if (tmpfs_file->pages[index] == NULL) {
+            if ((tmpfs_file->pages[index] = _alloc_pages(GFP_KERNEL | __GFP_ZERO, 0)) == NULL) {
+                break;
+            }
+            ++tmpfs.nr_pages;
+        }
+        memcpy((uint8_t *)get_lowmem_address_from_page(tmpfs_file->pages[index]) + in_page, (const uint8_t *)buffer + done, chunk);
+    }
+    if (done == 0) {
+        return -ENOSPC;
+    }
+    if ((offset + done) > tmpfs_file->size) {
+        tmpfs_file->size = offset + done;
+        file->length     = tmpfs_file->size;
+    }
+    tmpfs_file->mtime = sys_time(NULL);
+    tmpfs_file->ctime = tmpfs_file->mtime;
+    return done;
+}
+
+/// @brief Repositions the file offset inside a file.
+/// @param file the file we are working with.
+/// @param offset the offest to use for the operation.
+/// @param whence the type of operation.
+/// @return the resulting offset, -errno on failure.
+static off_t tmpfs_lseek(vfs_file_t *file, off_t offset, int whence)
+{
+    tmpfs_file_t *tmpfs_file = __tmpfs_get_file(file);
+    if (tmpfs_file == NULL) {
+        return -EBADF;
+    }
+    switch (whence) {
+    case SEEK_END:
+        offset += tmpfs_file->size;
+        break;
+    case SEEK_CUR:
+        offset += file->f_pos;
+        break;
+    case SEEK_SET:
+        break;
+    default:
+        return -EINVAL;
+    }
+    if (offset < 0) {
+        return -EINVAL;
+    }
+    file->f_pos = offset;
+    return offset;
+}
+
+/// @brief Retrieves information concerning the file.
+/// @param file The file struct.
+/// @param stat The structure where the information are stored.
+/// @return 0 if success.
+static int tmpfs_fstat(vfs_file_t *file, stat_t *stat)
+{
+    tmpfs_file_t *tmpfs_file = __tmpfs_get_file(file);
+    if (tmpfs_file == NULL) {
+        return -EBADF;
+    }
+    return __tmpfs_stat(tmpfs_file, stat);
+}
+
+/// @brief Retrieves information concerning the file at the given position.
+/// @param path The absolute path to the file.
+/// @param stat The structure where the information are stored.
+/// @return 0 if success.
+static int tmpfs_stat(const char *path, stat_t *stat)
+{
+    tmpfs_file_t *tmpfs_file = __tmpfs_find(path);
+    if (tmpfs_file == NULL) {
+        return -ENOENT;
+    }
+    return __tmpfs_stat(tmpfs_file, stat);
+}
+
+/// @brief Retrieves information concerning the file at a path relative to a directory.
+/// @param directory The directory from which the path is resolved.
+/// @param path The relative path.
+/// @param stat The structure where the information are stored.
+/// @param mask The STATX_* fields needed, they are all cheap.
+/// @return 0 if success, -errno on failure.
+static int tmpfs_statat(vfs_file_t *directory, const char *path, stat_t *stat, unsigned int mask)
+{
+    tmpfs_file_t *parent = __tmpfs_get_file(directory);
+    if (parent == NULL) {
+        return -ENOENT;
+    }
+    if (strcmp(path, ".") == 0) {
+        return __tmpfs_stat(parent, stat);
+    }
+    char absolute_path[PATH_MAX];
+    if (snprintf(absolute_path, PATH_MAX, "%s/%s", parent->name, path) >= PATH_MAX) {
+        return -ENAMETOOLONG;
+    }
+    return tmpfs_stat(absolute_path, stat);
+}
+
+/// @brief Modifies the attributes of the file at the given path.
+/// @param path The absolute path to the file.
+/// @param attr The attributes to change.
+/// @return 0 if success.
+static int tmpfs_setattr(const char *path, struct iattr *attr)
+{
+    tmpfs_file_t *tmpfs_file = __tmpfs_find(path);
+    if (tmpfs_file == NULL) {
+        return -ENOENT;
+    }
+    return __tmpfs_setattr(tmpfs_file, attr);
+}
+
+/// @brief Modifies the attributes of the file.
+/// @param file The file.
+/// @param attr The attributes to change.
+/// @return 0 if success.
+static int tmpfs_fsetattr(vfs_file_t *file, struct iattr *attr)
+{
+    tmpfs_file_t *tmpfs_file = __tmpfs_get_file(file);
+    if (tmpfs_file == NULL) {
+        return -EBADF;
+    }
+    return __tmpfs_setattr(tmpfs_file, attr);
+}
+
+/// @brief There is nothing to write back.
+/// @param file The file.
+/// @return 0.
+static int tmpfs_fsync(vfs_file_t *file)
+{
+    return 0;
+}
+
+/// @brief Maps the pages of the file, shared with the file itself.
+/// @param file The file.
+/// @param area The area where the file is mapped.
+/// @return 0 on success, -errno on failure.
+static int tmpfs_mmap(vfs_file_t *file, vm_area_struct_t *area)
+{
+    tmpfs_file_t *tmpfs_file = __tmpfs_get_file(file);
+    if (tmpfs_file == NULL) {
+        return -EBADF;
+    }
+    if (bitmask_check(tmpfs_file->flags, DT_DIR)) {
+        return -ENODEV;
+    }
+    area->vm_ops          = &tmpfs_vm_operations;
+    area->vm_private_data = tmpfs_file;
+    ++tmpfs_file->nr_maps;
+    return 0;
+}
+
+/// @brief A process maps the file through a new area (e.g., fork).
+/// @param area The new area.
+static void tmpfs_vm_open(vm_area_struct_t *area)
+{
+    ++((tmpfs_file_t *)area->vm_private_data)->nr_maps;
+}
+
+/// @brief An area mapping the file went away.
+/// @param area The area, whose pages are already unmapped.
+static void tmpfs_vm_close(vm_area_struct_t *area)
+{
+    tmpfs_file_t *tmpfs_file = (tmpfs_file_t *)area->vm_private_data;
+    --tmpfs_file->nr_maps;
+    // The last user of a removed file frees it.
+    if (tmpfs_file->unlinked && __tmpfs_unused(tmpfs_file)) {
+        __tmpfs_destroy_file(tmpfs_file);
+    }
+}
+
+/// @brief Provides a page of the file to a mapping, allocating it if nothing
+/// was written there yet.
+/// @param area The area mapping the file.
+/// @param index The index of the page inside the file.
+/// @return The page, with a reference for the mapping, NULL past the end of
+/// the file, or when there is no memory.
+static page_t *tmpfs_vm_fault(vm_area_struct_t *area, uint32_t index)
+{
+    tmpfs_file_t *tmpfs_file = (tmpfs_file_t *)area->vm_private_data;
+    if (index >= (tmpfs_file->size + PAGE_SIZE - 1) / PAGE_SIZE) {
+        return NULL;
+    }
+    if (__tmpfs_reserve(tmpfs_file, index + 1) < 0) {
+        return NULL;
+    }
+    if (tmpfs_file->pages[index] == NULL) {
+        if ((tmpfs_file->pages[index] = _alloc_pages(GFP_KERNEL | __GFP_ZERO, 0)) == NULL) {
+            return NULL;
+        }
+        ++tmpfs.nr_pages;
+    }
+    page_inc(tmpfs_file->pages[index]);
+    return tmpfs_file->pages[index];
+}
+
+/// @brief Reads contents of the directories to a dirent buffer.
+/// @param file  The directory handler.
+/// @param dirp  The buffer where the data should be written.
+/// @param doff  The offset inside the directory where the read starts.
+/// @param count The maximum length of the buffer.
+/// @return The number of written bytes in the buffer.
+static ssize_t tmpfs_getdents(vfs_file_t *file, dirent_t *dirp, off_t doff, size_t count)
+{
+    tmpfs_file_t *direntry = __tmpfs_get_file(file);
+    if ((direntry == NULL) || (dirp == NULL)) {
+        return -EBADF;
+    }
+    if (!bitmask_check(direntry->flags, DT_DIR)) {
+        return -ENOTDIR;
+    }
+    if (count < sizeof(dirent_t)) {
+        return -EINVAL;
+    }
+    memset(dirp, 0, count);
+    size_t len           = strlen(direntry->name);
+    ssize_t written_size = 0;
+    off_t iterated_size  = 0;
+    list_for_each_decl(it, &direntry->children)
+    {
+        tmpfs_file_t *entry = list_entry(it, tmpfs_file_t, child_link);
+        // Skip the entries returned by the previous calls.
+        iterated_size += sizeof(dirent_t);
+        if (iterated_size <= doff) {
+            continue;
+        }
+        // Skip the slash separating the directory from the name.
+        size_t skip    = len + (*(entry->name + len) == '/');
+        dirp->d_ino    = entry->inode;
+        dirp->d_type   = entry->flags;
+        dirp->d_off    = sizeof(dirent_t);
+        dirp->d_reclen = sizeof(dirent_t);
+        strcpy(dirp->d_name, entry->name + skip);
+        written_size += sizeof(dirent_t);
+        ++dirp;
+        if (written_size + sizeof(dirent_t) > count) {
+            break;
+        }
+    }
+    direntry->atime = sys_time(NULL);
+    return written_size;
+}
+
+// ============================================================================
+// Initialization Functions
+// ============================================================================
+
+/// @brief Mounts a new, empty, filesystem at the given path.
+/// @param path the path where we want to mount a tmpfs.
+/// @param device we expect it to be NULL.
+/// @return a pointer to the root VFS file.
+static vfs_file_t *tmpfs_mount_callback(const char *path, const char *device)
+{
+    pr_debug("tmpfs_mount_callback(%s, %s)\n", path, device);
+    // All the mount points share the same files, indexed by absolute path, a
+    // directory inside another mount point (e.g., `/tmp` inside the
+    // initramfs) simply becomes the root of the new one.
+    tmpfs_file_t *root = __tmpfs_find(path);
+    if (root != NULL) {
+        if (root->mountpoint || !bitmask_check(root->flags, DT_DIR)) {
+            pr_err("Cannot mount a tmpfs at `%s`.\n", path);
+            return NULL;
+        }
+    } else if ((root = __tmpfs_create_file(path, DT_DIR, 0777, NULL)) == NULL) {
+        return NULL;
+    }
+    // The root is writable by everybody, as /tmp is expected to be.
+    root->mask       = 0777;
+    root->uid        = 0;
+    root->gid        = 0;
+    root->mountpoint = true;
+    return __tmpfs_create_file_struct(root);
+}
+
+/// Filesystem information.
+static file_system_type tmpfs_file_system_type = {
+    .name     = "tmpfs",
+    .fs_flags = 0,
+    .mount    = tmpfs_mount_callback
+};
+
+int tmpfs_module_init(void)
+{
+    memset(&tmpfs, 0, sizeof(tmpfs_t));
+    tmpfs.tmpfs_file_cache = KMEM_CREATE(tmpfs_file_t);
+    tmpfs.paths            = hashmap_create(TMPFS_HASH_BUCKETS, hashmap_str_hash, hashmap_str_comp, hashmap_do_not_duplicate, hashmap_do_not_free);
+    tmpfs.next_inode       = 1;
+    if (!vfs_register_filesystem(&tmpfs_file_system_type)) {
+        return 1;
+    }
+    return 0;
+}
+
+int sys_memfd_create(const char *name, unsigned int flags)
+{
+    char path[TMPFS_NAME_MAX];
+    if (flags & ~MFD_CLOEXEC) {
+        return -EINVAL;
+    }
+    if (strlen(name) > MFD_NAME_MAX) {
+        return -EINVAL;
+    }
+    int fd = get_unused_fd();
+    if (fd < 0) {
+        return fd;
+    }
+    // The name is only shown to the user, the file is never reachable.
+    snprintf(path, TMPFS_NAME_MAX, "memfd:%s", name);
+    tmpfs_file_t *tmpfs_file = __tmpfs_create_file(path, DT_REG, S_IRUSR | S_IWUSR, NULL);
+    if (tmpfs_file == NULL) {
+        return -errno;
+    }
+    vfs_file_t *file = __tmpfs_create_file_struct(tmpfs_file);
+    if (file == NULL) {
+        __tmpfs_remove_file(tmpfs_file);
+        return -errno;
+    }
+    // The file is removed right away, it goes away with its last user.
+    __tmpfs_remove_file(tmpfs_file);
+    file->open_flags = O_RDWR;
+    file->count      = 1;
+    vfs_install_fd(scheduler_get_current_process()->files, fd, file, O_RDWR | ((flags & MFD_CLOEXEC) ? O_CLOEXEC : 0));
+    return fd;
+}
+
+int tmpfs_cleanup_module(void)
+{
+    vfs_unregister_filesystem(&tmpfs_file_system_type);
+    return 0;
+}
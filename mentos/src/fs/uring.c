@@ -0,0 +1,130 @@
+/// @file uring.c
+/// @brief Rings of system calls, submitted in batches.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+// Setup the logging for this file (do this before any other include).
+#include "sys/kernel_levels.h"           // Include kernel log levels.
+#define __DEBUG_HEADER__ "[URING ]"      ///< Change header.
+#define __DEBUG_LEVEL__  LOGLEVEL_NOTICE ///< Set log level.
+#include "io/debug.h"                    // Include debugging functions.
+
+#include "klib/stdatomic.h"
+#include "mem/paging.h"
+#include "process/scheduler.h"
+#include "string.h"
+#include "sys/errno.h"
+#include "sys/uring.h"
+#include "system/syscall.h"
+
+/// @brief Checks that a ring lies inside a single area of the process.
+/// @param mm the memory of the process.
+/// @param ring the ring.
+/// @return 0 if the ring is valid, -EFAULT or -EINVAL otherwise.
+static inline int __uring_check(mm_struct_t *mm, uring_t *ring)
+{
+    vm_area_struct_t *segment = find_vm_area(mm, (uintptr_t)ring);
+    // The header must be there, before we read the number of entries.
+    if (!segment || ((uintptr_t)ring + sizeof(uring_t) > segment->vm_end)) {
+        return -EFAULT;
+    }
+    // The process might have scribbled on it.
+    unsigned int entries = ring->entries;
+    if (!entries || (entries > URING_MAX_ENTRIES) || (entries & (entries - 1))) {
+        return -EINVAL;
+    }
+    if ((uintptr_t)ring + URING_SIZE(entries) > segment->vm_end) {
+        return -EFAULT;
+    }
+    return 0;
+}
+
+/// @brief Executes a request.
+/// @param sqe the request, copied out of the ring.
+/// @return the value returned by the operation.
+static inline long __uring_execute(const uring_sqe_t *sqe)
+{
+    switch (sqe->opcode) {
+    case URING_OP_NOP:
+        return 0;
+    case URING_OP_READ:
+        return sys_read(sqe->fd, (void *)sqe->addr, sqe->len);
+    case URING_OP_WRITE:
+        return sys_write(sqe->fd, (const void *)sqe->addr, sqe->len);
+    case URING_OP_OPEN:
+        return sys_open((const char *)sqe->addr, (int)sqe->len, (mode_t)sqe->arg);
+    case URING_OP_CLOSE:
+        return sys_close(sqe->fd);
+    case URING_OP_STAT:
+        return sys_stat((const char *)sqe->addr, (stat_t *)sqe->arg);
+    default:
+        return -EINVAL;
+    }
+}
+
+long sys_uring_setup(unsigned int entries)
+{
+    uintptr_t vm_start;
+    // Get the current task.
+    task_struct *task = scheduler_get_current_process();
+    if ((entries == 0) || (entries > URING_MAX_ENTRIES)) {
+        return -EINVAL;
+    }
+    // Round the entries up to a power of two, so that positions are masked.
+    while (entries & (entries - 1)) {
+        entries = (entries | (entries - 1)) + 1;
+    }
+    size_t size = (URING_SIZE(entries) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    if (find_free_vm_area(task->mm, size, &vm_start)) {
+        pr_err("We failed to find a suitable spot for the ring.\n");
+        return -ENOMEM;
+    }
+    // The pages are allocated right away, since the kernel writes in them on
+    // behalf of the process.
+    if (!create_vm_area(task->mm, vm_start, size, MM_PRESENT | MM_RW | MM_USER, GFP_HIGHUSER)) {
+        return -ENOMEM;
+    }
+    uring_t *ring = (uring_t *)vm_start;
+    memset(ring, 0, size);
+    ring->entries = entries;
+    pr_debug("Created a ring of %u entries at 0x%p for process %d.\n", entries, ring, task->pid);
+    return (long)vm_start;
+}
+
+long sys_uring_enter(uring_t *ring)
+{
+    uring_sqe_t sqe;
+    long done = 0;
+    // Get the current task.
+    task_struct *task = scheduler_get_current_process();
+    int ret = __uring_check(task->mm, ring);
+    if (ret < 0) {
+        return ret;
+    }
+    unsigned int mask = ring->entries - 1;
+    unsigned int head = ring->sq_head, tail = ring->sq_tail;
+    // The process cannot make us run more than a queue of requests.
+    if (tail - head > ring->entries) {
+        return -EINVAL;
+    }
+    while ((head != tail) && (ring->cq_tail - ring->cq_head < ring->entries)) {
+        // Copy the request, so that the process cannot change it under us.
+        memcpy(&sqe, &URING_SQES(ring)[head & mask], sizeof(uring_sqe_t));
+        long res = __uring_execute(&sqe);
+        if (res == -ERESTARTSYS) {
+            // The request put the process to sleep, leave it in the queue. If
+            // others were executed, the process returns their number once
+            // woken up, otherwise it enters the ring again.
+            return done ? done : res;
+        }
+        // Post the completion, then make it visible.
+        uring_cqe_t *cqe = &URING_CQES(ring)[ring->cq_tail & mask];
+        cqe->user_data   = sqe.user_data;
+        cqe->res         = res;
+        barrier();
+        ++ring->cq_tail;
+        ring->sq_head = ++head;
+        ++done;
+    }
+    return done;
+}
@@ -11,10 +11,17 @@
 
 #include "fcntl.h"
 #include "assert.h"
+#include "elf/elf.h"
+#include "fs/aio.h"
+#include "fs/buffer_cache.h"
+#include "fs/dcache.h"
+#include "fs/eventpoll.h"
+#include "fs/page_cache.h"
 #include "fs/procfs.h"
 #include "fs/namei.h"
 #include "fs/vfs.h"
 #include "klib/hashmap.h"
+#include "klib/rcu.h"
 #include "klib/spinlock.h"
 #include "libgen.h"
 #include "process/scheduler.h"
@@ -28,6 +35,25 @@
 static hashmap_t *vfs_filesystems;
 /// The list of superblocks.
 static list_head vfs_super_blocks;
+
+/// @brief A node of the tree of mount points, one for each path component.
+/// @details The tree is read under RCU, without locks: nodes are linked only
+/// once initialized, and never removed.
+typedef struct vfs_mount_node_t {
+    /// The name of the path component.
+    char name[NAME_MAX];
+    /// The filesystem mounted here, NULL if it is just on the way to another mount point.
+    super_block_t *sb;
+    /// The nodes of the components below this one.
+    list_head children;
+    /// Position inside the list of children of the parent.
+    list_head siblings;
+} vfs_mount_node_t;
+
+/// The root of the tree of mount points, i.e., "/".
+static vfs_mount_node_t *vfs_mount_root;
+/// VFS memory cache for the nodes of the tree of mount points.
+static kmem_cache_t *vfs_mount_node_cache;
 /// The maximum number of filesystem types.
 static const unsigned vfs_filesystems_max = 10;
 /// Lock for refcount field.
@@ -47,6 +73,7 @@ void vfs_init(void)
     // Initialize the caches for superblocks and files.
     vfs_superblock_cache = KMEM_CREATE(super_block_t);
     vfs_file_cache       = KMEM_CREATE(vfs_file_t);
+    vfs_mount_node_cache = KMEM_CREATE(vfs_mount_node_t);
     // Allocate the hashmap for the different filesystems.
     vfs_filesystems = hashmap_create(
         vfs_filesystems_max,
@@ -57,6 +84,14 @@ void vfs_init(void)
     // Initialize the spinlock.
     spinlock_init(&vfs_spinlock);
     spinlock_init(&vfs_spinlock_refcount);
+    // Initialize the cache of the block devices.
+    buffer_cache_init();
+    // Initialize the cache of the directory entries.
+    dcache_init();
+    // Initialize the cache of the mapped file pages.
+    page_cache_init();
+    // Initialize the asynchronous requests.
+    aio_init();
 }
 
 int vfs_register_filesystem(file_system_type *fs)
@@ -78,33 +113,117 @@ int vfs_unregister_filesystem(file_system_type *fs)
     return 1;
 }
 
-super_block_t *vfs_get_superblock(const char *absolute_path)
+/// @brief Returns the next component of the path, skipping the slashes.
+/// @param path the path, moved past the component.
+/// @param length where we store the length of the component.
+/// @return the beginning of the component, NULL if there are no more.
+static inline const char *__vfs_next_component(const char **path, size_t *length)
 {
-    size_t last_sb_len     = 0;
-    super_block_t *last_sb = NULL, *superblock = NULL;
-    list_head *it;
-    list_for_each (it, &vfs_super_blocks) {
-        superblock = list_entry(it, super_block_t, mounts);
-#if 0
-        int len    = strlen(superblock->name);
-        pr_debug("`%s` vs `%s`\n", absolute_path, superblock->name);
-        if (!strncmp(absolute_path, superblock->name, len)) {
-            size_t sbl = strlen(superblock->name);
-            if (sbl > last_sb_len) {
-                last_sb_len = sbl;
-                last_sb     = superblock;
-            }
+    const char *component = *path;
+    while (*component == '/') {
+        ++component;
+    }
+    if (*component == 0) {
+        return NULL;
+    }
+    *path = component;
+    while ((**path != '/') && (**path != 0)) {
+        ++(*path);
+    }
+    *length = *path - component;
+    return component;
+}
+
+/// @brief Searches the child of the node with the given name.
+/// @param node the node.
+/// @param name the name of the child, not null-terminated.
+/// @param length the length of the name.
+/// @return the child, NULL if there is none.
+static inline vfs_mount_node_t *__vfs_mount_node_child(vfs_mount_node_t *node, const char *name, size_t length)
+{
+    for (list_head *it = rcu_dereference(node->children.next); it != &node->children; it = rcu_dereference(it->next)) {
+        vfs_mount_node_t *child = list_entry(it, vfs_mount_node_t, siblings);
+        if ((strncmp(child->name, name, length) == 0) && (child->name[length] == 0)) {
+            return child;
+        }
+    }
+    return NULL;
+}
+
+/// @brief Allocates a node of the tree of mount points.
+/// @param name the name of the path component, not null-terminated.
+/// @param length the length of the name.
+/// @return the node, NULL on failure.
+static inline vfs_mount_node_t *__vfs_mount_node_alloc(const char *name, size_t length)
+{
+    vfs_mount_node_t *node = kmem_cache_alloc(vfs_mount_node_cache, GFP_KERNEL);
+    if (node) {
+        length = min(length, NAME_MAX - 1);
+        strncpy(node->name, name, length);
+        node->name[length] = 0;
+        node->sb           = NULL;
+        list_head_init(&node->children);
+        list_head_init(&node->siblings);
+    }
+    return node;
+}
+
+/// @brief Records the superblock inside the tree of mount points.
+/// @param path the absolute path of the mount point.
+/// @param sb the superblock.
+/// @return 0 on success, -1 on failure.
+static int __vfs_mount_tree_insert(const char *path, super_block_t *sb)
+{
+    const char *component;
+    size_t length;
+    if (vfs_mount_root == NULL) {
+        vfs_mount_node_t *root = __vfs_mount_node_alloc("/", 1);
+        if (root == NULL) {
+            return -1;
         }
-#else
-        size_t len = strlen(superblock->path);
-        if (!strncmp(absolute_path, superblock->path, len)) {
-            if (len > last_sb_len) {
-                last_sb_len = len;
-                last_sb     = superblock;
+        rcu_assign_pointer(vfs_mount_root, root);
+    }
+    vfs_mount_node_t *node = vfs_mount_root, *child;
+    while ((component = __vfs_next_component(&path, &length)) != NULL) {
+        child = __vfs_mount_node_child(node, component, length);
+        if (child == NULL) {
+            if ((child = __vfs_mount_node_alloc(component, length)) == NULL) {
+                return -1;
             }
+            // Link it at the end, where the readers find it complete.
+            child->siblings.next = &node->children;
+            child->siblings.prev = node->children.prev;
+            rcu_assign_pointer(node->children.prev->next, &child->siblings);
+            node->children.prev = &child->siblings;
         }
-#endif
+        node = child;
     }
+    // The last filesystem mounted on a path hides the previous ones.
+    rcu_assign_pointer(node->sb, sb);
+    return 0;
+}
+
+super_block_t *vfs_get_superblock(const char *absolute_path)
+{
+    const char *component;
+    size_t length;
+    rcu_read_lock();
+    vfs_mount_node_t *node = rcu_dereference(vfs_mount_root);
+    if (node == NULL) {
+        rcu_read_unlock();
+        return NULL;
+    }
+    // Walk down the tree, remembering the deepest mount point on the path.
+    super_block_t *last_sb = rcu_dereference(node->sb), *sb;
+    while ((component = __vfs_next_component(&absolute_path, &length)) != NULL) {
+        if ((node = __vfs_mount_node_child(node, component, length)) == NULL) {
+            break;
+        }
+        if ((sb = rcu_dereference(node->sb)) != NULL) {
+            last_sb = sb;
+        }
+    }
+    rcu_read_unlock();
     return last_sb;
 }
 
@@ -174,6 +293,10 @@ int vfs_close(vfs_file_t *file)
         if (file->fs_operations->close_f == NULL) {
             return -ENOSYS;
         }
+        // Stop watching the file from the epoll instances.
+        eventpoll_release(file);
+        // Drop the cached pages of the file.
+        page_cache_release(file);
         file->fs_operations->close_f(file);
     }
     return 0;
@@ -194,7 +317,45 @@ ssize_t vfs_write(vfs_file_t *file, const void *buf, size_t offset, size_t nbyte
         pr_err("No WRITE function found for the current filesystem.\n");
         return -ENOSYS;
     }
-    return file->fs_operations->write_f(file, buf, offset, nbytes);
+    ssize_t written = file->fs_operations->write_f(file, buf, offset, nbytes);
+    if (written > 0) {
+        // Keep the pages mapped by processes up to date.
+        page_cache_update(file, buf, offset, written);
+        // The cached headers of an executable are not valid anymore.
+        elf_cache_invalidate(file);
+    }
+    return written;
+}
+
+ssize_t vfs_direct_io(vfs_file_t *file, int write, void *buf, size_t offset, size_t nbytes)
+{
+    if (file->fs_operations->direct_io_f == NULL) {
+        return -EINVAL;
+    }
+    ssize_t done = file->fs_operations->direct_io_f(file, write, buf, offset, nbytes);
+    if (write && (done > 0)) {
+        // Keep the pages mapped by processes up to date.
+        page_cache_update(file, buf, offset, done);
+        // The cached headers of an executable are not valid anymore.
+        elf_cache_invalidate(file);
+    }
+    return done;
+}
+
+int vfs_fadvise(vfs_file_t *file, off_t offset, off_t len, int advice)
+{
+    if ((advice < POSIX_FADV_NORMAL) || (advice > POSIX_FADV_NOREUSE)) {
+        return -EINVAL;
+    }
+    // The access pattern lasts, the other advices act once on the range.
+    if ((advice == POSIX_FADV_NORMAL) || (advice == POSIX_FADV_RANDOM) ||
+        (advice == POSIX_FADV_SEQUENTIAL) || (advice == POSIX_FADV_NOREUSE)) {
+        file->advice = advice;
+    }
+    if (file->fs_operations->fadvise_f) {
+        return file->fs_operations->fadvise_f(file, offset, len, advice);
+    }
+    return 0;
 }
 
 off_t vfs_lseek(vfs_file_t *file, off_t offset, int whence)
@@ -224,6 +385,35 @@ int vfs_ioctl(vfs_file_t *file, int request, void *data)
     return file->fs_operations->ioctl_f(file, request, data);
 }
 
+int vfs_fsync(vfs_file_t *file)
+{
+    // Files which do not support synchronization (e.g., procfs entries).
+    if (file->fs_operations->fsync_f == NULL) {
+        return -EINVAL;
+    }
+    return file->fs_operations->fsync_f(file);
+}
+
+int vfs_sync(void)
+{
+    int ret = 0;
+    // Let each filesystem write back what it keeps in memory (e.g., inodes).
+    list_for_each_decl(it, &vfs_super_blocks)
+    {
+        super_block_t *sb = list_entry(it, super_block_t, mounts);
+        if (sb->type && sb->type->sync_fs) {
+            if (sb->type->sync_fs(sb->root) < 0) {
+                ret = -EIO;
+            }
+        }
+    }
+    // Then write back the blocks.
+    if (buffer_sync(NULL) < 0) {
+        ret = -EIO;
+    }
+    return ret;
+}
+
 int vfs_unlink(const char *path)
 {
     // Allocate a variable for the path.
@@ -446,6 +636,25 @@ int vfs_fstat(vfs_file_t *file, stat_t *buf)
     return file->fs_operations->stat_f(file, buf);
 }
 
+int vfs_statat(vfs_file_t *directory, const char *path, stat_t *buf, unsigned int mask)
+{
+    if (directory->fs_operations->statat_f == NULL) {
+        pr_err("vfs_statat(%s): Function not supported in current filesystem.", path);
+        return -ENOSYS;
+    }
+    // Reset the structure.
+    buf->st_dev   = 0;
+    buf->st_ino   = 0;
+    buf->st_mode  = 0;
+    buf->st_uid   = 0;
+    buf->st_gid   = 0;
+    buf->st_size  = 0;
+    buf->st_atime = 0;
+    buf->st_mtime = 0;
+    buf->st_ctime = 0;
+    return directory->fs_operations->statat_f(directory, path, buf, mask);
+}
+
 int vfs_mount(const char *path, vfs_file_t *new_fs_root)
 {
     if (!path || path[0] != '/') {
@@ -470,8 +679,14 @@ int vfs_mount(const char *path, vfs_file_t *new_fs_root)
         strcpy(sb->path, path);
         // Set the pointer.
         sb->root = new_fs_root;
+        // The type is set by do_mount, if the mount goes through it.
+        sb->type = NULL;
         // Add to the list.
         list_head_insert_after(&sb->mounts, &vfs_super_blocks);
+        // Record the mount point, for resolving paths.
+        if (__vfs_mount_tree_insert(path, sb) < 0) {
+            pr_err("vfs_mount(%s): Cannot record the mount point.\n", path);
+        }
     }
     spinlock_unlock(&vfs_spinlock);
     pr_debug("Correctly mounted '%s' on '%s'...\n", new_fs_root->name, path);
@@ -516,6 +731,66 @@ void vfs_lock(vfs_file_t *file)
     spinlock_unlock(&vfs_spinlock_refcount);
 }
 
+/// The number of descriptors tracked by each word of the bitmaps.
+#define FD_BITS_PER_LONG (sizeof(unsigned long) * 8)
+
+/// @brief Computes the length of the bitmaps of a file descriptor list.
+/// @param max_fd the number of descriptors.
+/// @return the number of words.
+static inline size_t __fd_bitmap_words(int max_fd)
+{
+    return (max_fd + FD_BITS_PER_LONG - 1) / FD_BITS_PER_LONG;
+}
+
+/// @brief Finds the highest open descriptor.
+/// @param files the table of the open files.
+/// @return the descriptor, -1 if none is open.
+static inline int __fd_last_open(files_struct_t *files)
+{
+    for (size_t word = __fd_bitmap_words(files->max_fd); word > 0; --word) {
+        if (files->open_fds[word - 1]) {
+            return (word - 1) * FD_BITS_PER_LONG + (FD_BITS_PER_LONG - 1 - __builtin_clzl(files->open_fds[word - 1]));
+        }
+    }
+    return -1;
+}
+
+/// @brief Replaces the file descriptor list of a table with a new one.
+/// @param files the table of the open files.
+/// @param new_max_fd the size of the new list, above the highest open descriptor of source.
+/// @param source the table whose descriptors are copied, it can be files itself.
+/// @return 1 on success, 0 on failure.
+static int __files_resize(files_struct_t *files, int new_max_fd, files_struct_t *source)
+{
+    size_t words = __fd_bitmap_words(new_max_fd);
+    // The list and the two bitmaps share a single allocation.
+    size_t size  = new_max_fd * sizeof(vfs_file_descriptor_t) + 2 * words * sizeof(unsigned long);
+    char *memory = kmalloc(size);
+    if (!memory) {
+        return 0;
+    }
+    memset(memory, 0, size);
+    vfs_file_descriptor_t *fd_list = (vfs_file_descriptor_t *)memory;
+    unsigned long *open_fds        = (unsigned long *)(memory + new_max_fd * sizeof(vfs_file_descriptor_t));
+    unsigned long *close_on_exec   = open_fds + words;
+    if (source->fd_list) {
+        int count         = (source->max_fd < new_max_fd) ? source->max_fd : new_max_fd;
+        size_t same_words = __fd_bitmap_words(count);
+        memcpy(fd_list, source->fd_list, count * sizeof(vfs_file_descriptor_t));
+        memcpy(open_fds, source->open_fds, same_words * sizeof(unsigned long));
+        memcpy(close_on_exec, source->close_on_exec, same_words * sizeof(unsigned long));
+        files->next_fd = source->next_fd;
+    }
+    if (files->fd_list) {
+        kfree(files->fd_list);
+    }
+    files->fd_list       = fd_list;
+    files->open_fds      = open_fds;
+    files->close_on_exec = close_on_exec;
+    files->max_fd        = new_max_fd;
+    return 1;
+}
+
 int vfs_extend_task_fd_list(struct task_struct *task)
 {
     if (!task) {
@@ -523,32 +798,33 @@ int vfs_extend_task_fd_list(struct task_struct *task)
         errno = ESRCH;
         return 0;
     }
-    // Set the max number of file descriptors.
-    int new_max_fd = (task->fd_list) ? task->max_fd * 2 + 1 : MAX_OPEN_FD;
-    // Allocate the memory for the list.
-    void *new_fd_list = kmalloc(new_max_fd * sizeof(vfs_file_descriptor_t));
-    // Check the new list.
-    if (!new_fd_list) {
+    // Double the max number of file descriptors.
+    int new_max_fd = (task->files->fd_list) ? task->files->max_fd * 2 : NR_OPEN_DEFAULT;
+    if (new_max_fd > MAX_OPEN_FD) {
+        errno = EMFILE;
+        return 0;
+    }
+    // Move the entries to the new list.
+    if (!__files_resize(task->files, new_max_fd, task->files)) {
         pr_err("Failed to allocate memory for `fd_list`.\n");
         errno = EMFILE;
         return 0;
     }
-    // Clear the memory of the new list.
-    memset(new_fd_list, 0, task->max_fd * sizeof(vfs_file_descriptor_t));
-    // Deal with pre-existing list.
-    if (task->fd_list) {
-        // Copy the old entries.
-        memcpy(new_fd_list, task->fd_list, task->max_fd * sizeof(vfs_file_descriptor_t));
-        // Free the memory of the old list.
-        kfree(task->fd_list);
-    }
-    // Set the new maximum number of file descriptors.
-    task->max_fd = new_max_fd;
-    // Set the new list.
-    task->fd_list = new_fd_list;
     return 1;
 }
 
+/// @brief Allocates an empty table of the open files.
+/// @return the table, used only by the caller, NULL on failure.
+static inline files_struct_t *__files_alloc(void)
+{
+    files_struct_t *files = kmalloc(sizeof(files_struct_t));
+    if (files) {
+        memset(files, 0, sizeof(files_struct_t));
+        atomic_set(&files->count, 1);
+    }
+    return files;
+}
+
 int vfs_init_task(task_struct *task)
 {
     if (!task) {
@@ -556,6 +832,11 @@ int vfs_init_task(task_struct *task)
         errno = ESRCH;
         return 0;
     }
+    // Allocate the table of the open files.
+    if ((task->files = __files_alloc()) == NULL) {
+        pr_err("Failed to allocate the open files of process `%d`.\n", task->pid);
+        return 0;
+    }
     // Initialize the file descriptor list.
     if (!vfs_extend_task_fd_list(task)) {
         pr_err("Error while trying to initialize the `fd_list` for process `%d`: %s\n", task->pid, strerror(errno));
@@ -571,18 +852,27 @@ int vfs_init_task(task_struct *task)
 
 int vfs_dup_task(task_struct *task, task_struct *old_task)
 {
-    // Copy the maximum number of file descriptors.
-    task->max_fd = old_task->max_fd;
-    // Allocate the memory for the new list.
-    task->fd_list = kmalloc(task->max_fd * sizeof(vfs_file_descriptor_t));
-    // Copy the old list.
-    memcpy(task->fd_list, old_task->fd_list, task->max_fd * sizeof(vfs_file_descriptor_t));
+    // Allocate the table of the open files.
+    if ((task->files = __files_alloc()) == NULL) {
+        pr_err("Failed to allocate the open files of process `%d`.\n", task->pid);
+        return 0;
+    }
+    // Size the new list on the descriptors actually open, a parent which
+    // opened many files and closed them does not make the copy larger.
+    int last   = __fd_last_open(old_task->files);
+    int max_fd = NR_OPEN_DEFAULT;
+    while (max_fd <= last) {
+        max_fd *= 2;
+    }
+    if (!__files_resize(task->files, max_fd, old_task->files)) {
+        pr_err("Failed to allocate the `fd_list` of process `%d`.\n", task->pid);
+        return 0;
+    }
     // Increase the counters to the open files.
-    for (int fd = 0; fd < task->max_fd; fd++) {
-        // Check if the file descriptor is associated with a file.
-        if (task->fd_list[fd].file_struct) {
-            // Increase the counter.
-            ++task->fd_list[fd].file_struct->count;
+    for (size_t word = 0; word < __fd_bitmap_words(max_fd); ++word) {
+        for (unsigned long bits = task->files->open_fds[word]; bits; bits &= bits - 1) {
+            int fd = word * FD_BITS_PER_LONG + __builtin_ctzl(bits);
+            ++task->files->fd_list[fd].file_struct->count;
         }
     }
     // Create the proc entry.
@@ -593,26 +883,47 @@ int vfs_dup_task(task_struct *task, task_struct *old_task)
     return 1;
 }
 
-int vfs_destroy_task(task_struct *task)
+int vfs_share_task(task_struct *task, task_struct *old_task)
 {
-    // Decrease the counters to the open files.
-    for (int fd = 0; fd < task->max_fd; fd++) {
-        // Check if the file descriptor is associated with a file.
-        if (task->fd_list[fd].file_struct) {
-            // Decrease the counter.
-            --task->fd_list[fd].file_struct->count;
-            // If counter is zero, close the file.
-            if (task->fd_list[fd].file_struct->count == 0) {
-                task->fd_list[fd].file_struct->fs_operations->close_f(task->fd_list[fd].file_struct);
-            }
-            // Clear the pointer to the file structure.
-            task->fd_list[fd].file_struct = NULL;
+    // The files stay open as long as one of the tasks uses the table.
+    task->files = old_task->files;
+    atomic_inc(&task->files->count);
+    // Create the proc entry.
+    if (procr_create_entry_pid(task)) {
+        pr_err("Error while trying to create proc entry for '%d': %s\n", task->pid, strerror(errno));
+        return 0;
+    }
+    return 1;
+}
+
+void vfs_close_task_files(task_struct *task)
+{
+    files_struct_t *files = task->files;
+    if (files == NULL) {
+        return;
+    }
+    task->files = NULL;
+    // Other tasks still use the table, the value before the decrement is
+    // returned.
+    if (atomic_dec(&files->count) != 1) {
+        return;
+    }
+    // Decrease the counters to the open files, closing them with the last
+    // reference.
+    for (size_t word = 0; word < __fd_bitmap_words(files->max_fd); ++word) {
+        for (unsigned long bits = files->open_fds[word]; bits; bits &= bits - 1) {
+            vfs_close(files->fd_list[word * FD_BITS_PER_LONG + __builtin_ctzl(bits)].file_struct);
         }
     }
-    // Set the maximum file descriptors to 0.
-    task->max_fd = 0;
-    // Free the memory of the list.
-    kfree(task->fd_list);
+    // Free the memory of the list, and of the bitmaps which follow it.
+    kfree(files->fd_list);
+    kfree(files);
+}
+
+int vfs_destroy_task(task_struct *task)
+{
+    // Close the files still open, unless the task did it when it exited.
+    vfs_close_task_files(task);
     // Remove the proc entry.
     if (procr_destroy_entry_pid(task)) {
         pr_err("Error while trying to remove proc entry for '%d': %s\n", task->pid, strerror(errno));
@@ -624,14 +935,19 @@ int vfs_destroy_task(task_struct *task)
 int get_unused_fd(void)
 {
     // Get the current task.
-    task_struct *task = scheduler_get_current_process();
+    task_struct *task     = scheduler_get_current_process();
+    files_struct_t *files = task->files;
 
-    // Search for an unused fd.
-    int fd;
-    for (fd = 0; fd < task->max_fd; ++fd) {
-        if (!task->fd_list[fd].file_struct) {
-            break;
-        }
+    // Search for the first zero bit, starting from the word of the lowest
+    // descriptor which might be free.
+    size_t words = __fd_bitmap_words(files->max_fd);
+    size_t word  = files->next_fd / FD_BITS_PER_LONG;
+    while ((word < words) && (files->open_fds[word] == ~0UL)) {
+        ++word;
+    }
+    int fd = word * FD_BITS_PER_LONG;
+    if (word < words) {
+        fd += __builtin_ctzl(~files->open_fds[word]);
     }
 
     // Check if there is not fd available.
@@ -640,35 +956,76 @@ int get_unused_fd(void)
     }
 
     // If fd limit is reached, try to allocate more
-    if (fd == task->max_fd) {
+    while (fd >= files->max_fd) {
         if (!vfs_extend_task_fd_list(task)) {
             pr_err("Failed to extend the file descriptor list.\n");
             return -EMFILE;
         }
     }
 
+    files->next_fd = fd;
     return fd;
 }
 
+void vfs_install_fd(files_struct_t *files, int fd, vfs_file_t *file, int flags)
+{
+    unsigned long bit = 1UL << (fd % FD_BITS_PER_LONG);
+    files->fd_list[fd].file_struct = file;
+    files->fd_list[fd].flags_mask  = flags & ~O_CLOEXEC;
+    files->open_fds[fd / FD_BITS_PER_LONG] |= bit;
+    if (bitmask_check(flags, O_CLOEXEC)) {
+        files->close_on_exec[fd / FD_BITS_PER_LONG] |= bit;
+    } else {
+        files->close_on_exec[fd / FD_BITS_PER_LONG] &= ~bit;
+    }
+    if (fd == files->next_fd) {
+        files->next_fd = fd + 1;
+    }
+}
+
+vfs_file_t *vfs_release_fd(files_struct_t *files, int fd)
+{
+    unsigned long bit = 1UL << (fd % FD_BITS_PER_LONG);
+    vfs_file_t *file  = files->fd_list[fd].file_struct;
+    files->fd_list[fd].file_struct = NULL;
+    files->fd_list[fd].flags_mask  = 0;
+    files->open_fds[fd / FD_BITS_PER_LONG] &= ~bit;
+    files->close_on_exec[fd / FD_BITS_PER_LONG] &= ~bit;
+    if (fd < files->next_fd) {
+        files->next_fd = fd;
+    }
+    return file;
+}
+
+void vfs_close_on_exec(files_struct_t *files)
+{
+    for (size_t word = 0; word < __fd_bitmap_words(files->max_fd); ++word) {
+        for (unsigned long bits = files->close_on_exec[word]; bits; bits &= bits - 1) {
+            vfs_close(vfs_release_fd(files, word * FD_BITS_PER_LONG + __builtin_ctzl(bits)));
+        }
+    }
+}
+
 int sys_dup(int fd)
 {
     // Get the current task.
     task_struct *task = scheduler_get_current_process();
 
     // Check the current FD.
-    if (fd < 0 || fd >= task->max_fd) {
+    if (fd < 0 || fd >= task->files->max_fd) {
         return -EMFILE;
     }
 
     // Get the file descriptor.
-    vfs_file_descriptor_t *vfd = &task->fd_list[fd];
-    vfs_file_t *file           = vfd->file_struct;
+    vfs_file_t *file = task->files->fd_list[fd].file_struct;
+    int flags_mask   = task->files->fd_list[fd].flags_mask;
 
     // Check the file.
     if (file == NULL) {
         return -ENOSYS;
     }
 
+    // Search for an unused fd, which might move the list.
     fd = get_unused_fd();
     if (fd < 0)
         return fd;
@@ -676,13 +1033,45 @@ int sys_dup(int fd)
     // Increment file reference counter.
     file->count += 1;
 
-    // Install the new fd
-    task->fd_list[fd].file_struct = file;
-    task->fd_list[fd].flags_mask  = vfd->flags_mask;
+    // Install the new fd, the copy is not closed by execve.
+    vfs_install_fd(task->files, fd, file, flags_mask);
 
     return fd;
 }
 
+int sys_dup2(int oldfd, int newfd)
+{
+    // Get the current task.
+    task_struct *task = scheduler_get_current_process();
+
+    // Check the file descriptors.
+    if ((oldfd < 0) || (oldfd >= task->files->max_fd) || (task->files->fd_list[oldfd].file_struct == NULL)) {
+        return -EBADF;
+    }
+    if ((newfd < 0) || (newfd >= task->files->max_fd)) {
+        return -EBADF;
+    }
+
+    // Duplicating a descriptor on itself leaves it untouched.
+    if (oldfd == newfd) {
+        return newfd;
+    }
+
+    // Increment file reference counter.
+    vfs_file_t *file = task->files->fd_list[oldfd].file_struct;
+    file->count += 1;
+
+    // Close the file previously associated with the descriptor.
+    if (task->files->fd_list[newfd].file_struct) {
+        vfs_close(vfs_release_fd(task->files, newfd));
+    }
+
+    // Install the new fd, the copy is not closed by execve.
+    vfs_install_fd(task->files, newfd, file, task->files->fd_list[oldfd].flags_mask);
+
+    return newfd;
+}
+
 static inline int __valid_open_permissions(
     const mode_t mask,
     const int flags,
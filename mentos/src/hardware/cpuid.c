@@ -18,6 +18,45 @@ void get_cpuid(cpuinfo_t *cpuinfo)
     cpuid_write_proctype(cpuinfo, &ereg);
 }
 
+void cpuid_get_perfmon(cpuid_perfmon_t *perfmon)
+{
+    pt_regs ereg = { .eax = 0 };
+
+    perfmon->version = perfmon->counters = perfmon->width = perfmon->unavailable = 0;
+    // Leaf 0xA is defined only if the highest standard leaf reaches it.
+    call_cpuid(&ereg);
+    if (ereg.eax < 0xA) {
+        return;
+    }
+    ereg.eax = 0xA;
+    ereg.ebx = ereg.ecx = ereg.edx = 0;
+    call_cpuid(&ereg);
+
+    perfmon->version  = cpuid_get_byte(ereg.eax, 0x0, 0xFF);
+    perfmon->counters = cpuid_get_byte(ereg.eax, 0x8, 0xFF);
+    perfmon->width    = cpuid_get_byte(ereg.eax, 0x10, 0xFF);
+    // The length of the bit vector tells how many of its bits are valid, the
+    // events past it are not available either.
+    uint32_t length      = cpuid_get_byte(ereg.eax, 0x18, 0xFF);
+    perfmon->unavailable = ereg.ebx | ((length < 32) ? (0xFFFFFFFFu << length) : 0);
+}
+
+int cpuid_has_monitor(void)
+{
+    pt_regs ereg = { .eax = 1 };
+    call_cpuid(&ereg);
+    // MONITOR/MWAIT, in ecx.
+    return cpuid_get_byte(ereg.ecx, 0x3, 0x1);
+}
+
+int cpuid_has_rdrand(void)
+{
+    pt_regs ereg = { .eax = 1 };
+    call_cpuid(&ereg);
+    // RDRAND, in ecx.
+    return cpuid_get_byte(ereg.ecx, 0x1E, 0x1);
+}
+
 void call_cpuid(pt_regs *registers)
 {
     __asm__("cpuid\n\t"
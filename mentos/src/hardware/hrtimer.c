@@ -0,0 +1,289 @@
+/// @file hrtimer.c
+/// @brief High-resolution timers implementation.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+// Setup the logging for this file (do this before any other include).
+#include "sys/kernel_levels.h"           // Include kernel log levels.
+#define __DEBUG_HEADER__ "[HRTIME]"      ///< Change header.
+#define __DEBUG_LEVEL__  LOGLEVEL_NOTICE ///< Set log level.
+#include "io/debug.h"                    // Include debugging functions.
+
+#include "assert.h"
+#include "hardware/cpuid.h"
+#include "hardware/hrtimer.h"
+#include "hardware/timer.h"
+#include "io/port_io.h"
+#include "klib/irqflags.h"
+#include "klib/rbtree.h"
+
+/// @defgroup calibration TSC calibration
+/// @brief The registers used to measure the TSC frequency against channel 2 of the PIT.
+/// @{
+#define PIT_CH2_DATAREG     0x42u  ///< Channel 2 data port.
+#define PIT_CH2_COMREG      0x43u  ///< Mode/Command register.
+#define PIT_CH2_CONTROL     0x61u  ///< Gate and output of channel 2 (keyboard controller port B).
+#define PIT_CH2_GATE        0x01u  ///< Bit enabling the count of channel 2.
+#define PIT_CH2_SPEAKER     0x02u  ///< Bit connecting channel 2 to the speaker.
+#define PIT_CH2_OUTPUT      0x20u  ///< Bit holding the output of channel 2.
+#define PIT_CH2_ONESHOT     0xB0u  ///< Channel 2, lobyte/hibyte, Mode 0 (10|11|000|0).
+#define CALIBRATION_LATCH   11931u ///< PIT counts in the calibration interval.
+#define CALIBRATION_NSEC    10000000ULL ///< Nanoseconds in the calibration interval.
+/// @}
+
+/// @brief Bit of the EDX features reported by CPUID, which tells if there is a TSC.
+#define CPUID_EDX_TSC (1u << 4u)
+/// @brief Cycles converted at once, small enough to never overflow the product
+/// with the multiplier.
+#define TSC_CHUNK (1ULL << 31u)
+/// @brief Nanoseconds in a tick, used without a TSC.
+#define NSEC_PER_TICK (NSEC_PER_SEC / TICKS_PER_SECOND)
+
+/// If the clock source is the TSC.
+static bool_t tsc_available = false;
+/// Nanoseconds per cycle, with TSC_SHIFT fractional bits.
+static uint32_t tsc_mult = 0;
+/// The TSC value matching clock_base.
+static ktime_t tsc_base = 0;
+/// The time, in nanoseconds, when the TSC was tsc_base.
+static ktime_t clock_base = 0;
+/// The queued timers, ordered by expiration time.
+static rbtree_t *hrtimer_queue = NULL;
+
+/// @brief Checks if the CPU has a TSC.
+/// @return true if it is there, false otherwise.
+static inline bool_t __tsc_detect(void)
+{
+    pt_regs registers = { 0 };
+    // Step 1: check the highest basic leaf.
+    call_cpuid(&registers);
+    if (registers.eax < 1) {
+        return false;
+    }
+    // Step 2: check the features.
+    registers.eax = 1;
+    call_cpuid(&registers);
+    return (registers.edx & CPUID_EDX_TSC) != 0;
+}
+
+/// @brief Counts the TSC cycles in CALIBRATION_NSEC, measured with channel 2
+/// of the PIT, which is otherwise unused.
+/// @return the number of cycles.
+static inline ktime_t __tsc_calibrate(void)
+{
+    ktime_t start, end;
+    // Enable the count of channel 2, and keep the speaker off.
+    uint8_t control = inportb(PIT_CH2_CONTROL);
+    outportb(PIT_CH2_CONTROL, (control & ~PIT_CH2_SPEAKER) | PIT_CH2_GATE);
+    // Load the count, the output goes high when it reaches zero.
+    outportb(PIT_CH2_COMREG, PIT_CH2_ONESHOT);
+    outportb(PIT_CH2_DATAREG, CALIBRATION_LATCH & 0xFFu);
+    outportb(PIT_CH2_DATAREG, (CALIBRATION_LATCH >> 8u) & 0xFFu);
+    start = rdtsc();
+    while (!(inportb(PIT_CH2_CONTROL) & PIT_CH2_OUTPUT)) {
+        __asm__ __volatile__("pause");
+    }
+    end = rdtsc();
+    // Restore the previous state of the port.
+    outportb(PIT_CH2_CONTROL, control);
+    return end - start;
+}
+
+/// @brief Moves the clock base forward, to the current TSC value.
+/// @details Called with interrupts disabled.
+static inline void __clock_update(void)
+{
+    ktime_t delta = rdtsc() - tsc_base;
+    // Convert in chunks, big intervals would overflow the product.
+    while (delta >= TSC_CHUNK) {
+        clock_base += (TSC_CHUNK * tsc_mult) >> TSC_SHIFT;
+        tsc_base += TSC_CHUNK;
+        delta -= TSC_CHUNK;
+    }
+    clock_base += (delta * tsc_mult) >> TSC_SHIFT;
+    tsc_base += delta;
+}
+
+/// @brief Compares two timers, by expiration time and then by address.
+/// @param tree The queue.
+/// @param a The first node.
+/// @param b The second node.
+/// @return the sign of the difference between the two timers.
+static int __hrtimer_compare(rbtree_t *tree, rbtree_node_t *a, rbtree_node_t *b)
+{
+    (void)tree;
+    hrtimer_t *ta = rbtree_node_get_value(a);
+    hrtimer_t *tb = rbtree_node_get_value(b);
+    if (ta->expires != tb->expires) {
+        return (ta->expires > tb->expires) ? 1 : -1;
+    }
+    return (ta > tb) - (ta < tb);
+}
+
+/// @brief Returns the timer which expires first.
+/// @return the timer, NULL if the queue is empty.
+static inline hrtimer_t *__hrtimer_first(void)
+{
+    rbtree_node_t *node = rbtree_tree_get_root(hrtimer_queue);
+    if (node == NULL) {
+        return NULL;
+    }
+    while (rbtree_node_get_link(node, 0)) {
+        node = rbtree_node_get_link(node, 0);
+    }
+    return rbtree_node_get_value(node);
+}
+
+void hrtimer_install(void)
+{
+    uint8_t flags = irq_disable();
+    hrtimer_queue = rbtree_tree_create(__hrtimer_compare);
+    assert(hrtimer_queue && "Failed to create the queue of high-resolution timers.");
+    if (__tsc_detect()) {
+        ktime_t cycles = __tsc_calibrate();
+        // A frequency above 400 GHz would not fit the divisor.
+        if ((cycles > 0) && (cycles <= 0xFFFFFFFFULL)) {
+            ktime_t mult = CALIBRATION_NSEC << TSC_SHIFT;
+            div64_32(&mult, (uint32_t)cycles);
+            tsc_mult      = (uint32_t)mult;
+            tsc_available = tsc_mult > 0;
+            pr_notice("The TSC runs at about %u kHz.\n", (uint32_t)cycles / 10u);
+        }
+    }
+    if (tsc_available) {
+        tsc_base   = rdtsc();
+        clock_base = (ktime_t)timer_get_ticks() * NSEC_PER_TICK;
+    } else {
+        pr_notice("There is no TSC, the clock has the resolution of a tick.\n");
+    }
+    irq_enable(flags);
+}
+
+ktime_t hrtimer_get_time(void)
+{
+    ktime_t now;
+    if (!tsc_available) {
+        return (ktime_t)timer_get_ticks() * NSEC_PER_TICK;
+    }
+    uint8_t flags = irq_disable();
+    __clock_update();
+    now = clock_base;
+    irq_enable(flags);
+    return now;
+}
+
+bool_t hrtimer_tsc_available(void)
+{
+    return tsc_available;
+}
+
+ktime_t hrtimer_get_clock(ktime_t *tsc, uint32_t *mult)
+{
+    ktime_t now;
+    if (!tsc_available) {
+        *tsc  = 0;
+        *mult = 0;
+        return (ktime_t)timer_get_ticks() * NSEC_PER_TICK;
+    }
+    uint8_t flags = irq_disable();
+    __clock_update();
+    now   = clock_base;
+    *tsc  = tsc_base;
+    *mult = tsc_mult;
+    irq_enable(flags);
+    return now;
+}
+
+void hrtimer_init(hrtimer_t *timer, void (*function)(hrtimer_t *), unsigned long data)
+{
+    timer->expires  = 0;
+    timer->function = function;
+    timer->data     = data;
+    timer->queued   = false;
+}
+
+/// @brief Moves an expiry later, within the slack, to the time with the most
+/// trailing zero bits.
+/// @param expires the expiry.
+/// @param slack how late it can be.
+/// @return the new expiry, between expires and expires + slack.
+static inline ktime_t __hrtimer_apply_slack(ktime_t expires, ktime_t slack)
+{
+    ktime_t limit = expires + slack, mask = limit ^ expires;
+    uint32_t bit;
+    if (mask == 0) {
+        return expires;
+    }
+    // Find the highest bit where they differ, set in the limit: clearing the
+    // bits below it stays between the two.
+    if ((uint32_t)(mask >> 32)) {
+        bit = 63 - __builtin_clz((uint32_t)(mask >> 32));
+    } else {
+        bit = 31 - __builtin_clz((uint32_t)mask);
+    }
+    return limit & ~((1ULL << bit) - 1);
+}
+
+void hrtimer_start(hrtimer_t *timer, ktime_t expires)
+{
+    hrtimer_start_range(timer, expires, 0);
+}
+
+void hrtimer_start_range(hrtimer_t *timer, ktime_t expires, ktime_t slack)
+{
+    assert(timer->function && "The high-resolution timer has no function.");
+    uint8_t flags = irq_disable();
+    // The key changes, so the timer must leave the queue first.
+    if (timer->queued) {
+        rbtree_tree_remove(hrtimer_queue, timer);
+    }
+    timer->expires = slack ? __hrtimer_apply_slack(expires, slack) : expires;
+    timer->queued  = rbtree_tree_insert(hrtimer_queue, timer) == 1;
+    assert(timer->queued && "Failed to queue the high-resolution timer.");
+    irq_enable(flags);
+#ifdef ENABLE_DYNTICKS
+    // The timer might expire before the next interrupt.
+    timer_dynticks_kick();
+#endif
+}
+
+int hrtimer_cancel(hrtimer_t *timer)
+{
+    int was_queued;
+    uint8_t flags = irq_disable();
+    was_queued = timer->queued;
+    if (timer->queued) {
+        rbtree_tree_remove(hrtimer_queue, timer);
+        timer->queued = false;
+    }
+    irq_enable(flags);
+    return was_queued;
+}
+
+void hrtimer_run_queues(void)
+{
+    hrtimer_t *timer;
+    uint8_t flags = irq_disable();
+    // Keep the product of the conversion small.
+    if (tsc_available) {
+        __clock_update();
+    }
+    while ((timer = __hrtimer_first()) && (timer->expires <= hrtimer_get_time())) {
+        rbtree_tree_remove(hrtimer_queue, timer);
+        // The function is free to start the timer again, or to release it.
+        timer->queued = false;
+        timer->function(timer);
+    }
+    irq_enable(flags);
+}
+
+int hrtimer_get_next_expiry(ktime_t *expires)
+{
+    hrtimer_t *timer;
+    uint8_t flags = irq_disable();
+    if ((timer = __hrtimer_first())) {
+        *expires = timer->expires;
+    }
+    irq_enable(flags);
+    return timer != NULL;
+}
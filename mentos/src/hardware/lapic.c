@@ -0,0 +1,148 @@
+/// @file lapic.c
+/// @brief Local APIC implementation.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+// Setup the logging for this file (do this before any other include).
+#include "sys/kernel_levels.h"           // Include kernel log levels.
+#define __DEBUG_HEADER__ "[LAPIC ]"      ///< Change header.
+#define __DEBUG_LEVEL__  LOGLEVEL_NOTICE ///< Set log level.
+#include "io/debug.h"                    // Include debugging functions.
+
+#include "hardware/lapic.h"
+#include "hardware/cpuid.h"
+#include "hardware/msr.h"
+#include "mem/vmem_map.h"
+
+/// @defgroup lapic_registers Local APIC registers
+/// @brief Offsets of the registers, from the base of the local APIC.
+/// @{
+#define LAPIC_ID       0x020u ///< Local APIC ID.
+#define LAPIC_EOI      0x0B0u ///< End-of-interrupt register.
+#define LAPIC_SVR      0x0F0u ///< Spurious interrupt vector register.
+#define LAPIC_ESR      0x280u ///< Error status register.
+#define LAPIC_ICR_LOW  0x300u ///< Interrupt command register, low half.
+#define LAPIC_ICR_HIGH 0x310u ///< Interrupt command register, high half (destination).
+#define LAPIC_LVT_PERF 0x340u ///< Local vector table entry of the performance counters.
+/// @}
+
+/// @defgroup lapic_icr Interrupt command register
+/// @brief Fields of the low half of the interrupt command register.
+/// @{
+#define ICR_INIT    0x00000500u ///< INIT delivery mode.
+#define ICR_STARTUP 0x00000600u ///< STARTUP delivery mode.
+#define ICR_PENDING 0x00001000u ///< The interrupt has not been delivered yet.
+#define ICR_ASSERT  0x00004000u ///< Level assert.
+#define ICR_LEVEL   0x00008000u ///< Level triggered.
+/// @}
+
+/// Delivery mode of a local vector table entry, for non-maskable interrupts.
+#define LVT_NMI 0x00000400u
+
+/// The bit of the features reported by cpuid, in edx, telling that the CPU
+/// has a local APIC.
+#define CPUID_EDX_APIC (1U << 9U)
+
+/// Bit of the spurious interrupt vector register enabling the local APIC.
+#define SVR_ENABLE 0x100u
+
+/// The virtual address of the registers, 0 if they are not mapped.
+static volatile uint8_t *lapic_base = 0;
+
+/// @brief Reads a register.
+/// @param reg the offset of the register.
+/// @return the value.
+static inline uint32_t __lapic_read(uint32_t reg)
+{
+    return *(volatile uint32_t *)(lapic_base + reg);
+}
+
+/// @brief Writes a register.
+/// @param reg the offset of the register.
+/// @param value the value.
+static inline void __lapic_write(uint32_t reg, uint32_t value)
+{
+    *(volatile uint32_t *)(lapic_base + reg) = value;
+    // Read back the ID, so that the write has completed.
+    (void)__lapic_read(LAPIC_ID);
+}
+
+/// @brief Sends an inter-processor interrupt, and waits for its delivery.
+/// @param apic_id the destination.
+/// @param command the low half of the interrupt command register.
+static inline void __lapic_send_ipi(uint8_t apic_id, uint32_t command)
+{
+    // Clear the errors of the previous commands.
+    __lapic_write(LAPIC_ESR, 0);
+    // The write of the low half sends the interrupt.
+    __lapic_write(LAPIC_ICR_HIGH, (uint32_t)apic_id << 24u);
+    __lapic_write(LAPIC_ICR_LOW, command);
+    while (__lapic_read(LAPIC_ICR_LOW) & ICR_PENDING) {
+        __asm__ __volatile__("pause");
+    }
+}
+
+int lapic_install(uint32_t phy_address)
+{
+    uint32_t address = virt_map_io(phy_address, 1);
+    if (address == 0) {
+        pr_err("Failed to map the local APIC at 0x%p.\n", phy_address);
+        return -1;
+    }
+    lapic_base = (volatile uint8_t *)address;
+    lapic_enable();
+    pr_debug("Local APIC %u mapped at 0x%p.\n", lapic_get_id(), address);
+    return 0;
+}
+
+int lapic_install_default(void)
+{
+    if (lapic_available()) {
+        return 0;
+    }
+    // Without the APIC feature the MSR does not exist.
+    pt_regs regs = { .eax = 1 };
+    call_cpuid(&regs);
+    if (!(regs.edx & CPUID_EDX_APIC)) {
+        return -1;
+    }
+    return lapic_install((uint32_t)rdmsr(MSR_APIC_BASE) & 0xFFFFF000u);
+}
+
+void lapic_enable(void)
+{
+    __lapic_write(LAPIC_SVR, SVR_ENABLE | LAPIC_SPURIOUS_VECTOR);
+}
+
+int lapic_available(void)
+{
+    return lapic_base != 0;
+}
+
+uint8_t lapic_get_id(void)
+{
+    return (uint8_t)(__lapic_read(LAPIC_ID) >> 24u);
+}
+
+void lapic_send_init(uint8_t apic_id)
+{
+    __lapic_send_ipi(apic_id, ICR_INIT | ICR_LEVEL | ICR_ASSERT);
+    // Older CPUs also need the de-assert, the others ignore it.
+    __lapic_send_ipi(apic_id, ICR_INIT | ICR_LEVEL);
+}
+
+void lapic_send_startup(uint8_t apic_id, uint8_t page)
+{
+    __lapic_send_ipi(apic_id, ICR_STARTUP | page);
+}
+
+void lapic_set_perf_nmi(void)
+{
+    __lapic_write(LAPIC_LVT_PERF, LVT_NMI);
+}
+
+void lapic_eoi(void)
+{
+    // Any value works, and no read back is needed before returning.
+    *(volatile uint32_t *)(lapic_base + LAPIC_EOI) = 0;
+}
@@ -0,0 +1,232 @@
+/// @file pmu.c
+/// @brief Architectural performance counters, and the sampling profiler.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// The first general-purpose counters count the events of pmu_event_t, in
+/// both user and kernel mode, and never stop: at each context switch the
+/// difference from the previous switch is charged to the task leaving the CPU.
+/// The counter after them, if the CPU has it, counts cycles for the profiler:
+/// it starts from minus the period, and its overflow reaches the CPU as a
+/// non-maskable interrupt, which records the interrupted instruction and
+/// restarts it. Being non-maskable, samples land inside the sections which run
+/// with interrupts disabled too, like the scheduler.
+
+// Setup the logging for this file (do this before any other include).
+#include "sys/kernel_levels.h"           // Include kernel log levels.
+#define __DEBUG_HEADER__ "[PMU   ]"      ///< Change header.
+#define __DEBUG_LEVEL__  LOGLEVEL_NOTICE ///< Set log level.
+#include "io/debug.h"                    // Include debugging functions.
+
+#include "hardware/pmu.h"
+#include "descriptor_tables/isr.h"
+#include "hardware/cpuid.h"
+#include "hardware/lapic.h"
+#include "hardware/msr.h"
+#include "process/scheduler.h"
+#include "string.h"
+#include "sys/errno.h"
+
+/// @defgroup pmu_msr Performance monitoring MSRs
+/// @brief The registers of the architectural performance monitoring.
+/// @{
+#define MSR_PERFEVTSEL0          0x186 ///< Event select of the first counter.
+#define MSR_PMC0                 0x0C1 ///< The first counter.
+#define MSR_PERF_GLOBAL_CTRL     0x38F ///< Enables each counter, since version 2.
+#define MSR_PERF_GLOBAL_OVF_CTRL 0x390 ///< Clears the overflow of each counter, since version 2.
+/// @}
+
+/// @defgroup pmu_evtsel Event select
+/// @brief Fields of the event select registers.
+/// @{
+#define EVTSEL_USR 0x00010000u ///< Count in user mode.
+#define EVTSEL_OS  0x00020000u ///< Count in kernel mode.
+#define EVTSEL_INT 0x00100000u ///< Interrupt through the local APIC on overflow.
+#define EVTSEL_EN  0x00400000u ///< Enable the counter.
+/// @}
+
+/// The counter used by the profiler.
+#define PMU_SAMPLE_COUNTER PMU_EVENT_NUM
+
+/// @brief An architectural event.
+typedef struct pmu_arch_event_t {
+    /// The event select and unit mask.
+    uint32_t evtsel;
+    /// Its bit in the vector of the unavailable events of CPUID.
+    uint32_t cpuid_bit;
+} pmu_arch_event_t;
+
+/// The architectural events, in the order of pmu_event_t.
+static const pmu_arch_event_t pmu_arch_events[PMU_EVENT_NUM] = {
+    [PMU_CYCLES]       = { .evtsel = 0x003C, .cpuid_bit = 0 },
+    [PMU_INSTRUCTIONS] = { .evtsel = 0x00C0, .cpuid_bit = 1 },
+    [PMU_LLC_MISSES]   = { .evtsel = 0x412E, .cpuid_bit = 5 },
+};
+
+/// The performance monitoring of the CPU.
+static cpuid_perfmon_t pmu_perfmon;
+/// The events which are counted, one bit each.
+static uint32_t pmu_events;
+/// The mask of the valid bits of a counter.
+static unsigned long long pmu_mask;
+/// The value of each counter at the last context switch. Only the bootstrap
+/// processor runs tasks, so there is a single set.
+static unsigned long long pmu_last[PMU_EVENT_NUM];
+
+/// The sampling period, 0 when the profiler is stopped.
+static uint32_t pmu_period;
+/// The samples, written by the interrupt handler.
+static pmu_sample_t pmu_samples[PMU_PROFILE_SAMPLES];
+/// The number of samples taken since the profiler was started.
+static volatile unsigned long pmu_samples_total;
+
+/// @brief Reads a counter.
+/// @param counter the index of the counter.
+/// @return its value.
+static inline unsigned long long __pmu_read(unsigned counter)
+{
+    return rdmsr(MSR_PMC0 + counter) & pmu_mask;
+}
+
+/// @brief Loads the sampling counter, so that it overflows after a period.
+static inline void __pmu_reload_sampler(void)
+{
+    // Writes take the low 32 bits, and extend their sign to the rest.
+    wrmsr(MSR_PMC0 + PMU_SAMPLE_COUNTER, (uint32_t)-pmu_period);
+}
+
+/// @brief Starts or stops the sampling counter, which keeps its value.
+/// @param enable 1 to start it, 0 to stop it.
+static inline void __pmu_enable_sampler(int enable)
+{
+    uint32_t evtsel = pmu_arch_events[PMU_CYCLES].evtsel | EVTSEL_USR | EVTSEL_OS | EVTSEL_INT;
+    wrmsr(MSR_PERFEVTSEL0 + PMU_SAMPLE_COUNTER, enable ? (evtsel | EVTSEL_EN) : 0);
+}
+
+/// @brief Handles the overflow of the sampling counter.
+/// @param f the interrupted frame.
+static void __pmu_nmi_handler(pt_regs *f)
+{
+    // The counter starts negative, so it overflowed if its top bit is clear.
+    if (!pmu_period || (__pmu_read(PMU_SAMPLE_COUNTER) & ((pmu_mask >> 1) + 1))) {
+        pr_warning("Unexpected non-maskable interrupt at 0x%p.\n", f->eip);
+        return;
+    }
+    task_struct *curr   = scheduler_get_current_process();
+    pmu_sample_t *entry = &pmu_samples[pmu_samples_total % PMU_PROFILE_SAMPLES];
+    entry->eip          = f->eip;
+    entry->pid          = curr ? curr->pid : 0;
+    entry->user         = (f->cs & 3) == 3;
+    ++pmu_samples_total;
+    __pmu_reload_sampler();
+    if (pmu_perfmon.version >= 2) {
+        wrmsr(MSR_PERF_GLOBAL_OVF_CTRL, 1u << PMU_SAMPLE_COUNTER);
+    }
+    // The delivery masked the entry.
+    lapic_set_perf_nmi();
+}
+
+int pmu_init(void)
+{
+    cpuid_get_perfmon(&pmu_perfmon);
+    if ((pmu_perfmon.version == 0) || (pmu_perfmon.counters == 0)) {
+        pr_notice("The CPU has no architectural performance counters.\n");
+        return -1;
+    }
+    pmu_mask = (pmu_perfmon.width < 64) ? ((1ULL << pmu_perfmon.width) - 1) : ~0ULL;
+    for (unsigned event = 0; (event < PMU_EVENT_NUM) && (event < pmu_perfmon.counters); ++event) {
+        if (pmu_perfmon.unavailable & (1u << pmu_arch_events[event].cpuid_bit)) {
+            continue;
+        }
+        wrmsr(MSR_PMC0 + event, 0);
+        wrmsr(MSR_PERFEVTSEL0 + event, pmu_arch_events[event].evtsel | EVTSEL_USR | EVTSEL_OS | EVTSEL_EN);
+        pmu_events |= 1u << event;
+        pmu_last[event] = 0;
+    }
+    // Since version 2, the counters are enabled here too.
+    if (pmu_perfmon.version >= 2) {
+        wrmsr(MSR_PERF_GLOBAL_CTRL, (1ULL << pmu_perfmon.counters) - 1);
+    }
+    isr_install_handler(NMI_INTERRUPT, &__pmu_nmi_handler, "pmu");
+    pr_notice("Performance monitoring version %u, %u counters of %u bits.\n",
+              pmu_perfmon.version, pmu_perfmon.counters, pmu_perfmon.width);
+    return 0;
+}
+
+int pmu_event_available(pmu_event_t event)
+{
+    return (event < PMU_EVENT_NUM) && (pmu_events & (1u << event));
+}
+
+void pmu_switch(task_struct *prev)
+{
+    for (unsigned event = 0; event < PMU_EVENT_NUM; ++event) {
+        if (pmu_events & (1u << event)) {
+            unsigned long long value = __pmu_read(event);
+            prev->pmu_count[event] += (value - pmu_last[event]) & pmu_mask;
+            pmu_last[event] = value;
+        }
+    }
+}
+
+unsigned long long pmu_task_count(task_struct *task, pmu_event_t event)
+{
+    if (!pmu_event_available(event)) {
+        return 0;
+    }
+    unsigned long long count = task->pmu_count[event];
+    if (task == scheduler_get_current_process()) {
+        count += (__pmu_read(event) - pmu_last[event]) & pmu_mask;
+    }
+    return count;
+}
+
+int pmu_profile_start(uint32_t period)
+{
+    if (!pmu_events || (pmu_perfmon.counters <= PMU_SAMPLE_COUNTER) || (lapic_install_default() < 0)) {
+        return -ENODEV;
+    }
+    // The period must fit the 31 bits that a write to the counter keeps.
+    if ((period < PMU_PROFILE_MIN_PERIOD) || (period > 0x7FFFFFFFu)) {
+        return -EINVAL;
+    }
+    pmu_profile_stop();
+    pmu_samples_total = 0;
+    pmu_period        = period;
+    __pmu_reload_sampler();
+    lapic_set_perf_nmi();
+    __pmu_enable_sampler(1);
+    return 0;
+}
+
+void pmu_profile_stop(void)
+{
+    if (pmu_period) {
+        __pmu_enable_sampler(0);
+        pmu_period = 0;
+    }
+}
+
+uint32_t pmu_profile_period(void)
+{
+    return pmu_period;
+}
+
+size_t pmu_profile_snapshot(pmu_sample_t *samples, unsigned long *total)
+{
+    // Pause the counter, so that the handler does not overwrite the samples
+    // while they are copied.
+    uint32_t period = pmu_period;
+    if (period) {
+        __pmu_enable_sampler(0);
+    }
+    *total       = pmu_samples_total;
+    size_t count = (*total < PMU_PROFILE_SAMPLES) ? *total : PMU_PROFILE_SAMPLES;
+    for (size_t it = 0; it < count; ++it) {
+        samples[it] = pmu_samples[(*total - count + it) % PMU_PROFILE_SAMPLES];
+    }
+    if (period) {
+        __pmu_enable_sampler(1);
+    }
+    return count;
+}
@@ -0,0 +1,296 @@
+/// @file smp.c
+/// @brief Symmetric multiprocessing implementation.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+// Setup the logging for this file (do this before any other include).
+#include "sys/kernel_levels.h"           // Include kernel log levels.
+#define __DEBUG_HEADER__ "[SMP   ]"      ///< Change header.
+#define __DEBUG_LEVEL__  LOGLEVEL_NOTICE ///< Set log level.
+#include "io/debug.h"                    // Include debugging functions.
+
+#include "descriptor_tables/gdt.h"
+#include "descriptor_tables/idt.h"
+#include "descriptor_tables/tss.h"
+#include "hardware/lapic.h"
+#include "hardware/smp.h"
+#include "io/port_io.h"
+#include "mem/kheap.h"
+#include "mem/paging.h"
+#include "mem/zone_allocator.h"
+#include "string.h"
+#include "system/syscall.h"
+
+/// @defgroup mptable MultiProcessor table
+/// @brief The tables, defined by the MultiProcessor Specification, where the
+/// firmware lists the CPUs.
+/// @{
+#define MP_FLOATING_SIGNATURE "_MP_" ///< Signature of the floating pointer.
+#define MP_CONFIG_SIGNATURE   "PCMP" ///< Signature of the configuration table.
+#define MP_ENTRY_PROCESSOR    0      ///< Entry describing a processor.
+#define MP_PROCESSOR_ENABLED  0x01u  ///< The processor is usable.
+#define MP_PROCESSOR_BSP      0x02u  ///< The processor is the bootstrap one.
+#define MP_LOWMEM_LIMIT       0x100000u ///< The tables must be in the first MB, which is mapped.
+#define BDA_EBDA_SEGMENT      0x40Eu ///< Where the BIOS data area stores the segment of the EBDA.
+/// @}
+
+/// @brief Where the trampoline of the application processors is copied, it
+/// must match the one inside smp_trampoline.S.
+#define SMP_TRAMPOLINE_ADDR 0x8000u
+/// @brief How many microseconds we wait the CPU to come online, after the
+/// start-up interrupts.
+#define SMP_BOOT_TIMEOUT_US 100000u
+
+/// @brief The floating pointer, which points to the configuration table.
+typedef struct mp_floating_t {
+    char signature[4];   ///< "_MP_".
+    uint32_t config;     ///< Physical address of the configuration table.
+    uint8_t length;      ///< Length, in 16-byte units.
+    uint8_t revision;    ///< Revision of the specification.
+    uint8_t checksum;    ///< The bytes of the structure sum to zero.
+    uint8_t features[5]; ///< Feature bytes, a default configuration if the first is not zero.
+} __attribute__((packed)) mp_floating_t;
+
+/// @brief The header of the configuration table.
+typedef struct mp_config_t {
+    char signature[4];     ///< "PCMP".
+    uint16_t length;       ///< Length of the base table, with the header.
+    uint8_t revision;      ///< Revision of the specification.
+    uint8_t checksum;      ///< The bytes of the base table sum to zero.
+    char oem[8];           ///< OEM identifier.
+    char product[12];      ///< Product identifier.
+    uint32_t oem_table;    ///< Physical address of the OEM table.
+    uint16_t oem_length;   ///< Length of the OEM table.
+    uint16_t entries;      ///< Number of entries following the header.
+    uint32_t lapic;        ///< Physical address of the local APICs.
+    uint16_t ext_length;   ///< Length of the extended table.
+    uint8_t ext_checksum;  ///< Checksum of the extended table.
+    uint8_t reserved;      ///< Reserved.
+} __attribute__((packed)) mp_config_t;
+
+/// @brief The entry describing a processor.
+typedef struct mp_processor_t {
+    uint8_t type;        ///< MP_ENTRY_PROCESSOR.
+    uint8_t apic_id;     ///< ID of its local APIC.
+    uint8_t apic_ver;    ///< Version of its local APIC.
+    uint8_t flags;       ///< MP_PROCESSOR_ENABLED, MP_PROCESSOR_BSP.
+    uint32_t signature;  ///< Stepping, model and family.
+    uint32_t features;   ///< The features reported by CPUID.
+    uint32_t reserved[2]; ///< Reserved.
+} __attribute__((packed)) mp_processor_t;
+
+/// @brief The code of the trampoline, and the data it reads.
+/// @{
+extern uint8_t smp_trampoline_start[];
+extern uint8_t smp_trampoline_end[];
+extern uint32_t smp_trampoline_cr3[];
+extern uint32_t smp_trampoline_stack[];
+extern uint32_t smp_trampoline_entry[];
+/// @}
+
+cpu_t cpus[SMP_MAX_CPUS];
+unsigned smp_num_cpus = 1;
+
+/// The index of the CPU which is being started.
+static volatile unsigned smp_booting_cpu = 0;
+
+/// @brief Sums the bytes of a table.
+/// @param table the table.
+/// @param length its length.
+/// @return the sum, zero for a valid table.
+static inline uint8_t __mp_checksum(const void *table, size_t length)
+{
+    const uint8_t *bytes = (const uint8_t *)table;
+    uint8_t sum          = 0;
+    for (size_t i = 0; i < length; ++i) {
+        sum += bytes[i];
+    }
+    return sum;
+}
+
+/// @brief Searches the floating pointer inside an area of memory.
+/// @param start the physical address of the area, inside the first MB.
+/// @param length its length.
+/// @return the floating pointer, NULL if it is not there.
+static inline mp_floating_t *__mp_search_area(uint32_t start, uint32_t length)
+{
+    // The structure is aligned to 16 bytes.
+    for (uint32_t address = start; address + sizeof(mp_floating_t) <= start + length; address += 16) {
+        mp_floating_t *mpf = (mp_floating_t *)address;
+        if (!memcmp(mpf->signature, MP_FLOATING_SIGNATURE, 4) &&
+            !__mp_checksum(mpf, mpf->length * 16u)) {
+            return mpf;
+        }
+    }
+    return NULL;
+}
+
+/// @brief Searches the floating pointer where the firmware can put it.
+/// @return the floating pointer, NULL if there is none.
+static inline mp_floating_t *__mp_search(void)
+{
+    mp_floating_t *mpf;
+    uint16_t segment;
+    // Step 1: the first KB of the Extended BIOS Data Area, whose segment is
+    // stored inside the BIOS data area.
+    memcpy(&segment, (void *)BDA_EBDA_SEGMENT, sizeof(segment));
+    uint32_t ebda = (uint32_t)segment << 4u;
+    if (ebda && (mpf = __mp_search_area(ebda, 1024))) {
+        return mpf;
+    }
+    // Step 2: the last KB of the base memory.
+    if ((mpf = __mp_search_area(0x9FC00, 1024))) {
+        return mpf;
+    }
+    // Step 3: the BIOS ROM.
+    return __mp_search_area(0xF0000, 0x10000);
+}
+
+/// @brief Reads the CPUs from the configuration table.
+/// @return the physical address of the local APICs, 0 on failure.
+static inline uint32_t __mp_parse(void)
+{
+    mp_floating_t *mpf = __mp_search();
+    if (mpf == NULL) {
+        pr_notice("There is no MultiProcessor table.\n");
+        return 0;
+    }
+    // Default configurations are not described by a table.
+    if (mpf->features[0] || !mpf->config || (mpf->config >= MP_LOWMEM_LIMIT)) {
+        pr_notice("The MultiProcessor configuration is not supported.\n");
+        return 0;
+    }
+    mp_config_t *config = (mp_config_t *)mpf->config;
+    if (memcmp(config->signature, MP_CONFIG_SIGNATURE, 4) || __mp_checksum(config, config->length)) {
+        pr_err("The MultiProcessor configuration table is not valid.\n");
+        return 0;
+    }
+    // The BSP always gets index 0, the others follow in table order.
+    unsigned count = 1;
+    uint8_t *entry = (uint8_t *)(config + 1);
+    for (uint16_t it = 0; it < config->entries; ++it) {
+        if (*entry != MP_ENTRY_PROCESSOR) {
+            // All the other entries have the same size.
+            entry += 8;
+            continue;
+        }
+        mp_processor_t *processor = (mp_processor_t *)entry;
+        entry += sizeof(mp_processor_t);
+        if (!(processor->flags & MP_PROCESSOR_ENABLED)) {
+            continue;
+        }
+        if (processor->flags & MP_PROCESSOR_BSP) {
+            cpus[0].apic_id = processor->apic_id;
+        } else if (count < SMP_MAX_CPUS) {
+            cpus[count].id      = count;
+            cpus[count].apic_id = processor->apic_id;
+            ++count;
+        } else {
+            pr_warning("Ignoring CPU with APIC ID %u, the maximum is %u CPUs.\n", processor->apic_id, SMP_MAX_CPUS);
+        }
+    }
+    smp_num_cpus = count;
+    return config->lapic;
+}
+
+/// @brief Waits, without the timer interrupts which are still disabled.
+/// @param us the microseconds, each write to the POST port takes about one.
+static inline void __smp_udelay(uint32_t us)
+{
+    while (us--) {
+        outportb(0x80, 0);
+    }
+}
+
+/// @brief The first C function executed by the application processors.
+static void __smp_ap_start(void)
+{
+    unsigned cpu = smp_booting_cpu;
+    // Load the kernel tables, and the TSS of the CPU, which makes
+    // smp_processor_id() work.
+    gdt_load(cpu);
+    idt_load();
+    tss_set_stack(0x10, cpus[cpu].kernel_stack);
+    syscall_sysenter_init();
+    lapic_enable();
+    // Log before going online: until then, the bootstrap processor only
+    // polls, and the two never print at the same time. The boot check of
+    // qemu-smp looks for this line, once for each application processor.
+    pr_notice("CPU %u (APIC ID %u) is online, parked.\n", cpu, cpus[cpu].apic_id);
+    cpus[cpu].online = true;
+    // The kernel is not ready to run tasks on more than one CPU, yet: there
+    // is no tick on this CPU, no idle loop and no SMP-safe locking, so it
+    // stays parked with interrupts disabled.
+    for (;;) {
+        __asm__ __volatile__("cli; hlt");
+    }
+}
+
+/// @brief Starts an application processor.
+/// @param cpu the CPU.
+/// @return 0 on success, -1 on failure.
+static inline int __smp_boot_cpu(cpu_t *cpu)
+{
+    void *stack = kmalloc(SMP_STACK_SIZE);
+    if (stack == NULL) {
+        pr_err("Failed to allocate the stack for CPU %u.\n", cpu->id);
+        return -1;
+    }
+    cpu->kernel_stack = (uintptr_t)stack + SMP_STACK_SIZE;
+    // Tell the trampoline where to go.
+    *(uint32_t *)(SMP_TRAMPOLINE_ADDR + ((uint8_t *)smp_trampoline_stack - smp_trampoline_start)) = cpu->kernel_stack;
+    smp_booting_cpu = cpu->id;
+    // Send INIT, and two STARTUP, as the MultiProcessor Specification says.
+    lapic_send_init(cpu->apic_id);
+    __smp_udelay(10000);
+    for (int it = 0; (it < 2) && !cpu->online; ++it) {
+        lapic_send_startup(cpu->apic_id, SMP_TRAMPOLINE_ADDR >> 12u);
+        __smp_udelay(200);
+    }
+    // Wait for the CPU, before reusing the trampoline for the next one.
+    for (uint32_t waited = 0; !cpu->online && (waited < SMP_BOOT_TIMEOUT_US); waited += 100) {
+        __smp_udelay(100);
+    }
+    if (!cpu->online) {
+        pr_err("CPU %u (APIC ID %u) did not start.\n", cpu->id, cpu->apic_id);
+        kfree(stack);
+        return -1;
+    }
+    return 0;
+}
+
+void smp_init(void)
+{
+    // The bootstrap processor uses the stack it booted with.
+    cpus[0].id           = 0;
+    cpus[0].online       = true;
+    cpus[0].kernel_stack = initial_esp;
+    smp_num_cpus         = 1;
+    // Step 1: list the CPUs.
+    uint32_t lapic = __mp_parse();
+    if (!lapic || (smp_num_cpus == 1)) {
+        smp_num_cpus = 1;
+        pr_notice("Running on a single CPU.\n");
+        return;
+    }
+    if (lapic_install(lapic) < 0) {
+        smp_num_cpus = 1;
+        return;
+    }
+    cpus[0].apic_id = lapic_get_id();
+    // Step 2: copy the trampoline in low memory, with the page directory of
+    // the kernel and the entry point.
+    size_t size = smp_trampoline_end - smp_trampoline_start;
+    memcpy((void *)SMP_TRAMPOLINE_ADDR, smp_trampoline_start, size);
+    page_t *pgd_page = get_lowmem_page_from_address((uintptr_t)paging_get_main_directory());
+    *(uint32_t *)(SMP_TRAMPOLINE_ADDR + ((uint8_t *)smp_trampoline_cr3 - smp_trampoline_start))   = get_physical_address_from_page(pgd_page);
+    *(uint32_t *)(SMP_TRAMPOLINE_ADDR + ((uint8_t *)smp_trampoline_entry - smp_trampoline_start)) = (uintptr_t)__smp_ap_start;
+    // Step 3: start the other CPUs, one at a time.
+    unsigned online = 1;
+    for (unsigned it = 1; it < smp_num_cpus; ++it) {
+        if (__smp_boot_cpu(&cpus[it]) == 0) {
+            ++online;
+        }
+    }
+    pr_notice("%u of %u CPUs are online.\n", online, smp_num_cpus);
+}
@@ -13,19 +13,29 @@
 #include "descriptor_tables/isr.h"
 #include "devices/fpu.h"
 #include "drivers/rtc.h"
+#include "hardware/hrtimer.h"
 #include "hardware/pic8259.h"
+#include "hardware/smp.h"
 #include "hardware/timer.h"
 #include "io/port_io.h"
-#include "io/video.h"
 #include "klib/irqflags.h"
+#include "math.h"
 #include "mem/kheap.h"
+#include "mem/slab.h"
+#include "mem/zone_allocator.h"
+#include "process/prio.h"
 #include "process/scheduler.h"
 #include "process/wait.h"
 #include "stdint.h"
 #include "sys/errno.h"
 #include "system/signal.h"
+#include "system/softirq.h"
 #include "system/panic.h"
+#include "system/printk.h"
+#include "system/vdso.h"
 #include "string.h"
+#include "sys/prctl.h"
+#include "sys/resource.h"
 
 /// @defgroup picregs Programmable Interval Timer Registers
 /// @brief The list of registers used to set the PIT.
@@ -71,12 +81,49 @@
 /// Mask used to set the divisor.
 #define PIT_MASK 0xFFu
 
+#ifdef ENABLE_DYNTICKS
+/// @brief Command used to configure channel 0 as one-shot (Mode 0: interrupt
+/// on terminal count), 0x30 = 00|11|000|0.
+#define PIT_ONESHOT_CONFIGURATION 0x30u
+/// @brief Read-back command latching count and status of channel 0,
+/// 0xC2 = 11|0|0|001|0.
+#define PIT_READBACK_CHANNEL0 0xC2u
+/// @brief Bit of the status returned by the read-back command, holding the
+/// state of the output pin, which goes high on terminal count in Mode 0.
+#define PIT_STATUS_OUTPUT 0x80u
+/// @brief Number of PIT counts in a tick.
+#define PIT_COUNTS_PER_TICK (PIT_DIVISOR / TICKS_PER_SECOND)
+/// @brief Maximum number of PIT counts between two interrupts, bound by the
+/// 16-bit counter of the PIT.
+#define DYNTICKS_MAX_COUNTS 0xFFFFu
+/// @brief Maximum number of ticks between two interrupts.
+#define DYNTICKS_MAX_TICKS (DYNTICKS_MAX_COUNTS / PIT_COUNTS_PER_TICK)
+/// @brief Maximum number of nanoseconds between two interrupts (about 54.9 ms).
+#define DYNTICKS_MAX_NSEC 54900000u
+#endif
+
 /// The number of ticks since the system started its execution.
 static __volatile__ unsigned long timer_ticks = 0;
+/// Number of ticks per seconds.
+uint32_t timer_hz = TIMER_DEFAULT_HZ;
 /// Contains timer for each CPU (for now only one)
 static tvec_base_t cpu_base = { 0 };
 /// Contains all process waiting for a sleep.
 static wait_queue_head_t sleep_queue;
+/// The cache of the dynamic timers.
+static kmem_cache_t *timer_list_cache;
+#ifdef ENABLE_DYNTICKS
+/// The count loaded in the PIT for the pending interrupt, 0 before the timer
+/// is installed.
+static uint32_t pit_count = 0;
+/// The PIT counts, since the count was loaded, already added to the ticks.
+static uint32_t pit_accounted = 0;
+/// The PIT counts elapsed which did not make a whole tick yet.
+static uint32_t pit_remainder = 0;
+/// Set while the timer interrupt is handled, since it programs the next one
+/// once it is done.
+static bool_t dynticks_in_handler = false;
+#endif
 
 void timer_phase(const uint32_t hz)
 {
@@ -90,30 +137,224 @@ void timer_phase(const uint32_t hz)
     outportb(PIT_DATAREG0, (divisor >> 8u) & PIT_MASK);
 }
 
+#ifdef ENABLE_DYNTICKS
+/// @brief Returns the tick at which the first dynamic timer expires.
+/// @param base the vector base.
+/// @param expires where the tick is stored.
+/// @return 1 if there is a timer, 0 otherwise.
+static int __timer_next_expiry(tvec_base_t *base, unsigned long *expires)
+{
+    int found = 0;
+    struct timer_list *timer;
+    spinlock_lock(&base->lock);
+    // The timers of the outer vectors are not sorted, look at all of them.
+    for (int v = 0; v < TVR_SIZE + (TVN_COUNT * TVN_SIZE); ++v) {
+        list_head *vector = (v < TVR_SIZE) ? &base->tvr[v] : &base->tvn[(v - TVR_SIZE) / TVN_SIZE][(v - TVR_SIZE) % TVN_SIZE];
+        list_for_each_decl(it, vector)
+        {
+            timer = list_entry(it, struct timer_list, entry);
+            if (!found || (timer->expires < *expires)) {
+                *expires = timer->expires;
+                found    = 1;
+            }
+        }
+    }
+    spinlock_unlock(&base->lock);
+    return found;
+}
+
+/// @brief Converts nanoseconds to PIT counts, rounding up.
+/// @param nsec the nanoseconds, at most DYNTICKS_MAX_NSEC.
+/// @return the number of counts.
+static inline uint32_t __dynticks_nsec_to_counts(uint32_t nsec)
+{
+    // PIT_DIVISOR / NSEC_PER_SEC is about 1251 / 2^20.
+    return (uint32_t)((((ktime_t)nsec * 1251u) >> 20u) + 1u);
+}
+
+/// @brief Returns how many PIT counts can pass before the next interrupt.
+/// @return The number of counts, between 1 and DYNTICKS_MAX_COUNTS.
+/// @details Called right after __dynticks_sync, so pit_remainder holds the
+/// counts elapsed since the last whole tick.
+static uint32_t __dynticks_next_event(void)
+{
+    unsigned long expires;
+    ktime_t hrexpires, now;
+    uint32_t counts = DYNTICKS_MAX_COUNTS;
+    // Time-sharing between the ready processes needs the periodic tick.
+    if (scheduler_needs_tick()) {
+        return PIT_COUNTS_PER_TICK - pit_remainder;
+    }
+    // Otherwise, wake up for the first timer.
+    if (__timer_next_expiry(&cpu_base, &expires)) {
+        if (expires <= timer_ticks) {
+            return 1;
+        }
+        if ((expires - timer_ticks) <= DYNTICKS_MAX_TICKS) {
+            counts = min(counts, ((expires - timer_ticks) * PIT_COUNTS_PER_TICK) - pit_remainder);
+        }
+    }
+    // And for the first high-resolution timer.
+    if (hrtimer_get_next_expiry(&hrexpires)) {
+        if (hrexpires <= (now = hrtimer_get_time())) {
+            return 1;
+        }
+        if ((hrexpires - now) < DYNTICKS_MAX_NSEC) {
+            counts = min(counts, __dynticks_nsec_to_counts((uint32_t)(hrexpires - now)));
+        }
+    }
+    return counts;
+}
+
+/// @brief Adds to the ticks the PIT counts elapsed since they were last added.
+static inline void __dynticks_sync(void)
+{
+    uint32_t elapsed;
+    // Latch the status and the count of the channel.
+    outportb(PIT_COMREG, PIT_READBACK_CHANNEL0);
+    uint8_t status = inportb(PIT_DATAREG0);
+    uint32_t count = inportb(PIT_DATAREG0);
+    count |= (uint32_t)inportb(PIT_DATAREG0) << 8u;
+    if (status & PIT_STATUS_OUTPUT) {
+        // The count is over, and the counter keeps going down from 0xFFFF.
+        elapsed = pit_count + ((0x10000u - count) & 0xFFFFu);
+    } else {
+        elapsed = pit_count - count;
+    }
+    pit_remainder += elapsed - pit_accounted;
+    pit_accounted = elapsed;
+    timer_ticks += pit_remainder / PIT_COUNTS_PER_TICK;
+    pit_remainder %= PIT_COUNTS_PER_TICK;
+}
+
+/// @brief Programs the PIT to interrupt once, after the given number of counts.
+/// @param counts the number of counts, from now.
+static inline void __dynticks_program(uint32_t counts)
+{
+    pit_count     = counts;
+    pit_accounted = 0;
+    outportb(PIT_COMREG, PIT_ONESHOT_CONFIGURATION);
+    outportb(PIT_DATAREG0, pit_count & PIT_MASK);
+    outportb(PIT_DATAREG0, (pit_count >> 8u) & PIT_MASK);
+}
+
+void timer_dynticks_kick(void)
+{
+    // The handler programs the next interrupt on its own.
+    if ((pit_count == 0) || dynticks_in_handler) {
+        return;
+    }
+    uint8_t flags = irq_disable();
+    __dynticks_sync();
+    uint32_t counts = __dynticks_next_event();
+    // Reprogram only if the interrupt is needed sooner than planned.
+    if ((pit_accounted < pit_count) && (counts < (pit_count - pit_accounted))) {
+        __dynticks_program(counts);
+    }
+    irq_enable(flags);
+}
+#endif
+
+/// @brief Runs the expired timers, as bottom half of the timer interrupt.
+static void __timer_softirq(void)
+{
+    // Update all timers
+    run_timer_softirq();
+    // Update the high-resolution timers.
+    hrtimer_run_queues();
+}
+
+/// @brief Charges the ticks which passed to the interrupted task, as user or
+/// kernel time, depending on where it was interrupted, and to the CPU.
+/// @param reg the interrupted frame.
+/// @param ticks the ticks which passed.
+static inline void __account_process_ticks(pt_regs *reg, unsigned long ticks)
+{
+    cpu_t *cpu = this_cpu();
+    // The CPU was idle, or a task which is not running was waiting.
+    if (scheduler_cpu_idle()) {
+        cpu->idle_ticks += ticks;
+        return;
+    }
+    task_struct *task = scheduler_get_current_process();
+    if ((reg->cs & 3) == 3) {
+        task->rusage.utime += ticks;
+        if (task->se.prio > DEFAULT_PRIO) {
+            cpu->nice_ticks += ticks;
+        } else {
+            cpu->user_ticks += ticks;
+        }
+    } else {
+        task->rusage.stime += ticks;
+        cpu->system_ticks += ticks;
+    }
+}
+
 void timer_handler(pt_regs *reg)
 {
-    // Save current process fpu state.
+    // Protect the fpu state of the process from the kernel.
     switch_fpu();
+    unsigned long ticks = timer_ticks;
+#ifdef ENABLE_DYNTICKS
+    dynticks_in_handler = true;
+    // Count the ticks passed since the previous interrupt.
+    __dynticks_sync();
+#else
     // Check if a second has passed.
     ++timer_ticks;
-    // Update all timers
-    run_timer_softirq();
+#endif
+    // Charge the ticks which passed to the interrupted task.
+    __account_process_ticks(reg, timer_ticks - ticks);
+    // Let the processes read the new time without a system call.
+    vdso_update();
+    // Let klogd write the kernel messages.
+    printk_kick();
+    // The timers run in the bottom half, once the interrupt is acknowledged.
+    softirq_raise(SOFTIRQ_TIMER);
+    // Zero some free pages, ahead of the page faults which need them. Only when
+    // a process was interrupted, since the kernel might be using the allocator.
+    if ((reg->cs & 3) == 3) {
+        zone_refill_zeroed_pages();
+        // Spread the ready processes among the CPUs, from time to time. It
+        // pulls nothing while the application processors are parked.
+        scheduler_load_balance(false);
+    }
+    // The ack is sent to PIC only when all handlers terminated! The scheduler
+    // is the exception, since it might wait, with interrupts enabled, for a
+    // process to become ready.
+    pic8259_send_eoi(IRQ_TIMER);
+    // Run the bottom halves before scheduling, they might wake up processes.
+    softirq_run();
+#ifdef ENABLE_DYNTICKS
+    dynticks_in_handler = false;
+#endif
     // Perform the schedule.
     scheduler_run(reg);
-    // Update graphics.
-    video_update();
-    // Restore fpu state.
-    unswitch_fpu();
-    // The ack is sent to PIC only when all handlers terminated!
-    pic8259_send_eoi(IRQ_TIMER);
+#ifdef ENABLE_DYNTICKS
+    // Program the next interrupt, now that the next process is known, without
+    // losing the time spent handling this one.
+    __dynticks_sync();
+    __dynticks_program(__dynticks_next_event());
+#endif
+    // Hand the fpu back to the process, lazily.
+    unswitch_fpu(reg);
 }
 
 void timer_install(void)
 {
     dynamic_timers_install();
-
+    // Calibrate the clock of the high-resolution timers.
+    hrtimer_install();
+    // Install the bottom half which runs the timers.
+    softirq_install(SOFTIRQ_TIMER, __timer_softirq);
+
+#ifdef ENABLE_DYNTICKS
+    // The timer interrupts only when needed, starting from the next tick.
+    __dynticks_program(PIT_COUNTS_PER_TICK);
+#else
     // Set the timer phase.
     timer_phase(TICKS_PER_SECOND);
+#endif
     // Installs 'timer_handler' to IRQ0.
     irq_install_handler(IRQ_TIMER, timer_handler, "timer");
     // Enable the IRQ of the timer.
@@ -255,17 +496,20 @@ static inline void __timer_cascate_vector(tvec_base_t *base, list_head *current_
 /// @brief Move all timers from tv up one level.
 /// @param base the base for which we move the timers.
 /// @details
-/// Cascading means moving all dynamic timers in the base->tvn list into the
-/// proper lists of base->tvr; then, it returns a positive value, unless all base->tvn
-/// lists are now empty. If so, cascade() is invoked once more to replenish
-/// base->tvn with the timers included in a list of base->tvn, and so on.
+/// Cascading means moving the dynamic timers of the current list of
+/// base->tvn[0] into the proper lists of base->tvr. When base->tvn[0] wraps
+/// around, the current list of base->tvn[1] is moved down too, to replenish
+/// it, and so on. The outer vectors are left alone until then.
 static inline void __timer_cascate_base(tvec_base_t *base)
 {
-    for (int i = 3; i >= 0; i--) {
+    for (int i = 0; i < TVN_COUNT; ++i) {
+        uint32_t index = (base->timer_ticks >> TIMER_TICKS_BITS((size_t)i)) & TVN_MASK;
         // Cascate the vector.
-        __timer_cascate_vector(
-            base,
-            base->tvn[i] + ((base->timer_ticks >> TIMER_TICKS_BITS((size_t)i)) & TVN_MASK));
+        __timer_cascate_vector(base, base->tvn[i] + index);
+        // The next vector advances only when this one wraps around.
+        if (index) {
+            break;
+        }
     }
 }
 
@@ -273,15 +517,15 @@ static inline void __timer_cascate_base(tvec_base_t *base)
 // SUPPORT FUNCTIONS (timer_list)
 // ============================================================================
 
-/// @brief Allocates the memory for timer.
-/// @return a pointer to the allocated timer.
-static inline struct timer_list *__timer_list_alloc()
+struct timer_list *timer_list_alloc(void)
 {
     // Allocate the memory.
-    struct timer_list *timer = (struct timer_list *)kmalloc(sizeof(struct timer_list));
+    struct timer_list *timer = (struct timer_list *)kmem_cache_alloc(timer_list_cache, GFP_ATOMIC);
+    if (timer == NULL) {
+        pr_err("Failed to allocate memory for a timer.\n");
+        return NULL;
+    }
     pr_debug("ALLOCATE TIMER 0x%p (0x%p)\n", timer, &timer->entry);
-    // Check the allocated memory.
-    assert(timer && "Failed to allocate memory for a timer.");
     // Clean the memory.
     memset(timer, 0, sizeof(struct timer_list));
     // Initialize the timer.
@@ -290,6 +534,7 @@ static inline struct timer_list *__timer_list_alloc()
     timer->expires  = 0;
     timer->function = NULL;
     timer->data     = 0;
+    timer->slack    = TIMER_SLACK_DEFAULT;
     timer->base     = NULL;
     // Return the timer.
     return timer;
@@ -304,7 +549,36 @@ static inline void __timer_list_dealloc(struct timer_list *timer)
     // Remove the timer.
     remove_timer(timer);
     // Deallocate the timer memory.
-    kfree(timer);
+    kmem_cache_free(timer);
+}
+
+void set_timer_slack(struct timer_list *timer, long slack)
+{
+    timer->slack = slack;
+}
+
+/// @brief Moves the expiry of a timer later, within its slack, to the tick
+/// with the most trailing zero bits.
+/// @param timer the timer.
+/// @return the new expiry, between the expiry and the expiry plus the slack.
+/// @details Timers which expire close to each other end up on the same tick,
+/// and cascade together.
+static inline unsigned long __timer_apply_slack(struct timer_list *timer)
+{
+    unsigned long expires = timer->expires, now = timer_get_ticks(), limit, mask;
+    long slack = timer->slack;
+    if (slack < 0) {
+        slack = (expires > now) ? (long)((expires - now) >> 8) : 0;
+    }
+    if (slack == 0) {
+        return expires;
+    }
+    limit = expires + (unsigned long)slack;
+    // Clear the bits below the highest one where they differ, set in the limit.
+    if ((mask = limit ^ expires) == 0) {
+        return expires;
+    }
+    return limit & ~((1UL << (31 - __builtin_clz(mask))) - 1);
 }
 
 void init_timer(struct timer_list *timer)
@@ -320,6 +594,8 @@ void init_timer(struct timer_list *timer)
 
 void add_timer(struct timer_list *timer)
 {
+    // Coalesce the timer with those expiring around the same tick.
+    timer->expires = __timer_apply_slack(timer);
 #ifdef ENABLE_REAL_TIMER_SYSTEM
     // Get the vector.
     list_head *vector = __timer_get_target_vector(&cpu_base, timer);
@@ -331,6 +607,10 @@ void add_timer(struct timer_list *timer)
 #else
     list_head_insert_before(&timer->entry, &base->list);
 #endif
+#ifdef ENABLE_DYNTICKS
+    // The timer might expire before the next interrupt.
+    timer_dynticks_kick();
+#endif
 }
 
 void remove_timer(struct timer_list *timer)
@@ -345,72 +625,45 @@ void remove_timer(struct timer_list *timer)
 }
 
 // ============================================================================
-// SUPPORT FUNCTIONS (sleep_data)
+// SUPPORT FUNCTIONS (itimerval)
 // ============================================================================
 
-/// @brief Contains the entry of a wait queue and timespec which keeps trakc of
-/// the remaining time.
-typedef struct sleep_data_t {
-    /// POinter to the entry of a wait queue.
-    wait_queue_entry_t *wait_queue_entry;
-    /// Keeps track of the remaining time.
-    timespec *remaining;
-} sleep_data_t;
-
-/// @brief Allocates the memory for sleep_data.
-/// @return a pointer to the allocated sleep_data.
-static inline struct sleep_data_t *__sleep_data_alloc()
+/// @brief Transforms nanoseconds to a time value.
+/// @param nsec the nanoseconds.
+/// @param tv where the time value is stored.
+static inline void __nsec_to_timeval(ktime_t nsec, struct timeval *tv)
 {
-    // Allocate the memory.
-    sleep_data_t *sleep_data = (sleep_data_t *)kmalloc(sizeof(sleep_data_t));
-    pr_debug("ALLOCATE SLEEP_DATA 0x%p\n", sleep_data);
-    // Check the allocated memory.
-    assert(sleep_data && "Failed to allocate memory for a sleep_data.");
-    // Clean the memory.
-    memset(sleep_data, 0, sizeof(sleep_data_t));
-    // Initialize the sleep_data.
-    sleep_data->wait_queue_entry = NULL;
-    sleep_data->remaining        = NULL;
-    // Return the sleep_data.
-    return sleep_data;
+    uint32_t rem = div64_32(&nsec, NSEC_PER_SEC);
+    tv->tv_sec   = (time_t)nsec;
+    tv->tv_usec  = rem / (uint32_t)NSEC_PER_USEC;
 }
 
-/// @brief Frees the memory of a sleep_data.
-/// @param sleep_data pointer to the sleep_data.
-static inline void __sleep_data_dealloc(sleep_data_t *sleep_data)
+/// @brief Transforms a time value to nanoseconds.
+/// @param tv the time value.
+/// @return the nanoseconds.
+static inline ktime_t __timeval_to_nsec(const struct timeval *tv)
 {
-    assert(sleep_data && "Received a NULL pointer.");
-    pr_debug("FREE     SLEEP_DATA 0x%p\n", sleep_data);
-    // Deallocate the sleep_data memory.
-    kfree(sleep_data);
+    return ((ktime_t)tv->tv_sec * NSEC_PER_SEC) + ((ktime_t)tv->tv_usec * NSEC_PER_USEC);
 }
 
-// ============================================================================
-// SUPPORT FUNCTIONS (itimerval)
-// ============================================================================
-
 /// @brief Transforms interval and value to the timer.
-/// @param interval the interval for periodic timer.
-/// @param value the time until next expiration.
+/// @param interval the interval for periodic timer, in ticks.
+/// @param value the time until next expiration, in ticks.
 /// @param timer where the final values should be stored.
 static inline void __values_to_itimerval(time_t interval, time_t value, struct itimerval *timer)
 {
     timer->it_interval.tv_sec  = interval / TICKS_PER_SECOND;
-    timer->it_interval.tv_usec = (interval * 1000) / TICKS_PER_SECOND;
+    timer->it_interval.tv_usec = ((interval % TICKS_PER_SECOND) * 1000000u) / TICKS_PER_SECOND;
     timer->it_value.tv_sec     = value / TICKS_PER_SECOND;
-    timer->it_value.tv_usec    = (value * 1000) / TICKS_PER_SECOND;
+    timer->it_value.tv_usec    = ((value % TICKS_PER_SECOND) * 1000000u) / TICKS_PER_SECOND;
 }
 
-/// @brief Transforms an interval timer to values.
-/// @param interval the output variable where to store the interval for periodic timer.
-/// @param value the output variable where to store the time until next expiration.
-/// @param timer the timer used to initialize the values.
-static inline void __itimerval_to_values(time_t *interval, time_t *value, const struct itimerval *timer)
+/// @brief Transforms a time value to ticks.
+/// @param tv the time value.
+/// @return the ticks.
+static inline time_t __timeval_to_ticks(const struct timeval *tv)
 {
-    *interval = (timer->it_interval.tv_sec * TICKS_PER_SECOND) +
-                (timer->it_interval.tv_usec * TICKS_PER_SECOND) / 1000;
-    *value = (timer->it_value.tv_sec * TICKS_PER_SECOND) +
-             (timer->it_value.tv_usec * TICKS_PER_SECOND) / 1000;
+    return (tv->tv_sec * TICKS_PER_SECOND) + (tv->tv_usec * TICKS_PER_SECOND) / 1000000u;
 }
 
 /// @brief Updates the timer for the given task.
@@ -418,24 +671,21 @@ static inline void __itimerval_to_values(time_t *interval, time_t *value, const
 /// @param timer the timer to update.
 static void __update_task_itimerval(int which, const struct itimerval *timer)
 {
-    time_t interval, value;
     // Get the current task.
     struct task_struct *task = scheduler_get_current_process();
-    // Transform the timer to separate interval and value.
-    __itimerval_to_values(&interval, &value, timer);
     // Sets the values for the task.
     switch (which) {
     case ITIMER_REAL:
-        task->it_real_incr  = interval;
-        task->it_real_value = value;
+        task->it_real_incr  = __timeval_to_nsec(&timer->it_interval);
+        task->it_real_value = __timeval_to_nsec(&timer->it_value);
         break;
     case ITIMER_VIRTUAL:
-        task->it_virt_incr  = interval;
-        task->it_virt_value = value;
+        task->it_virt_incr  = __timeval_to_ticks(&timer->it_interval);
+        task->it_virt_value = __timeval_to_ticks(&timer->it_value);
         break;
     case ITIMER_PROF:
-        task->it_prof_incr  = interval;
-        task->it_prof_value = value;
+        task->it_prof_incr  = __timeval_to_ticks(&timer->it_interval);
+        task->it_prof_value = __timeval_to_ticks(&timer->it_value);
         break;
     }
 }
@@ -452,6 +702,9 @@ void dynamic_timers_install(void)
     list_head_init(&sleep_queue.task_list);
     // Initialize the sleep queue lock.
     spinlock_init(&sleep_queue.lock);
+    // Create the cache of the timers.
+    timer_list_cache = KMEM_CREATE(struct timer_list);
+    assert(timer_list_cache && "Failed to create the cache of the timers.");
 }
 
 void run_timer_softirq(void)
@@ -535,13 +788,11 @@ static inline void debug_timeout(unsigned long data)
 }
 
 /// @brief Callback for when a sleep timer expires.
-/// @param data Custom data stored in the timer.
-static inline void sleep_timeout(unsigned long data)
+/// @param timer The sleep timer of the process.
+static void sleep_timeout(hrtimer_t *timer)
 {
-    // Get the sleep data.
-    sleep_data_t *sleep_data = (sleep_data_t *)data;
     // Get the wait_queue_entry.
-    wait_queue_entry_t *wait_queue_entry = sleep_data->wait_queue_entry;
+    wait_queue_entry_t *wait_queue_entry = (wait_queue_entry_t *)timer->data;
     // Executed entry's wakeup test function
     if (wait_queue_entry->func(wait_queue_entry, 0, 0) == 1) {
         pr_debug("Process (pid: %d) restored from sleep\n", wait_queue_entry->task->pid);
@@ -549,44 +800,22 @@ static inline void sleep_timeout(unsigned long data)
         remove_wait_queue(&sleep_queue, wait_queue_entry);
         // Free the memory of the wait queue item.
         wait_queue_entry_dealloc(wait_queue_entry);
-        // Free the memory of the sleep_data.
-        __sleep_data_dealloc(sleep_data);
     }
 }
 
 /// @brief Function executed when the real_timer of a process expires, sends
-/// SIGALRM to process.
-/// @param pid PID of the process whos associated timer has expired.
-static inline void alarm_timeout(unsigned long task_ptr)
-{
-    // Get the task fromt the argument.
-    struct task_struct *task = (struct task_struct *)task_ptr;
-    // Send ALARM.
-    sys_kill(task->pid, SIGALRM);
-    // Remove the timer.
-    task->real_timer = NULL;
-}
-
-// Real timer interval timemout
-static inline void real_timer_timeout(unsigned long task_ptr)
+/// SIGALRM to the process, and restarts the timer if it is periodic.
+/// @param timer The real_timer of the process.
+static void real_timer_timeout(hrtimer_t *timer)
 {
     // Get the task fromt the argument.
-    struct task_struct *task = (struct task_struct *)task_ptr;
+    struct task_struct *task = (struct task_struct *)timer->data;
     // Send the signal.
     sys_kill(task->pid, SIGALRM);
-    // If the real incr is not 0 then restart.
+    // If the real incr is not 0 then restart, from the previous expiration so
+    // that the period does not drift.
     if (task->it_real_incr != 0) {
-        // Create new timer for process, the old one is going to be deleted.
-        task->real_timer = __timer_list_alloc();
-        // Setup the timer.
-        task->real_timer->expires  = timer_get_ticks() + task->it_real_incr;
-        task->real_timer->function = &real_timer_timeout;
-        task->real_timer->data     = (unsigned long)task;
-        // Add the timer.
-        add_timer(task->real_timer);
-    } else {
-        // Remove the timer.
-        task->real_timer = NULL;
+        hrtimer_start(timer, timer->expires + task->it_real_incr);
     }
 }
 
@@ -599,74 +828,103 @@ int sys_nanosleep(const timespec *req, timespec *rem)
     // We need to store rem somewhere, because it contains how much time left
     // until the timer expires, when the timer is stopped early by a signal.
     pr_debug("sys_nanosleep([s:%d; ns:%d],...)\n", req->tv_sec, req->tv_nsec);
-    // Create a dinamic timer to wake up the process after some time
-    struct timer_list *sleep_timer = __timer_list_alloc();
-    // First, we save the remaining time. Then, we remove the current process
-    // from runqueue and stores it in the waiting queue, this must be done at
-    // the end, because it changes the current active page and invalidates the
-    // req and rem pointers (?)
-    sleep_data_t *sleep_data     = __sleep_data_alloc();
-    sleep_data->remaining        = rem;
-    sleep_data->wait_queue_entry = sleep_on(&sleep_queue);
-    // Setup the timer.
-    sleep_timer->expires  = timer_get_ticks() + TICKS_PER_SECOND * req->tv_sec;
-    sleep_timer->function = &sleep_timeout;
-    sleep_timer->data     = (unsigned long)sleep_data;
-    // Add the timer.
-    add_timer(sleep_timer);
-    return -1;
+    if ((req->tv_nsec < 0) || ((ktime_t)req->tv_nsec >= NSEC_PER_SEC)) {
+        return -EINVAL;
+    }
+    // Compute the expiration before sleeping, since sleep_on invalidates req.
+    ktime_t expires = hrtimer_get_time() + ((ktime_t)req->tv_sec * NSEC_PER_SEC) + (ktime_t)req->tv_nsec;
+    // Remove the current process from runqueue and store it in the waiting
+    // queue, this must be done at the end, because it changes the current
+    // active page and invalidates the req and rem pointers (?)
+    task_struct *task = scheduler_get_current_process();
+    // Setup the sleep timer of the process, which wakes it up, late by at
+    // most its slack.
+    hrtimer_init(&task->sleep_timer, &sleep_timeout, (unsigned long)sleep_on(&sleep_queue));
+    hrtimer_start_range(&task->sleep_timer, expires, task->timer_slack_ns);
+    return 0;
 }
 
 unsigned sys_alarm(int seconds)
 {
     struct task_struct *task = scheduler_get_current_process();
+    ktime_t now              = hrtimer_get_time();
     // If there is already a timer running.
     unsigned remaining_time = 0;
-    if (task->real_timer) {
-        // First, we remove the timer.
-        remove_timer(task->real_timer);
-        // We compute the remaining time.
-        remaining_time = (task->real_timer->expires - timer_get_ticks()) / TICKS_PER_SECOND;
-        // Returns only the amount of seconds remaining.
-        if (seconds == 0) {
-            // Free the memory.
-            __timer_list_dealloc(task->real_timer);
-            // Remove the reference.
-            task->real_timer = NULL;
-            return remaining_time;
-        }
-    } else {
-        if (seconds == 0) {
-            return 0;
-        }
-        // Allocate new timer.
-        task->real_timer = __timer_list_alloc();
+    if (hrtimer_cancel(&task->real_timer) && (task->real_timer.expires > now)) {
+        // We compute the remaining time, rounded up to the second.
+        ktime_t remaining  = task->real_timer.expires - now;
+        remaining_time     = div64_32(&remaining, NSEC_PER_SEC) ? (unsigned)remaining + 1 : (unsigned)remaining;
+    }
+    // The alarm is not periodic.
+    task->it_real_incr = 0;
+    if (seconds > 0) {
+        task->real_timer.function = &real_timer_timeout;
+        hrtimer_start(&task->real_timer, now + ((ktime_t)seconds * NSEC_PER_SEC));
     }
-    // Initialize the timer.
-    init_timer(task->real_timer);
-    // Setup the timer.
-    task->real_timer->expires  = timer_get_ticks() + TICKS_PER_SECOND * seconds;
-    task->real_timer->function = &alarm_timeout;
-    task->real_timer->data     = (unsigned long)task;
-    // Add the timer.
-    add_timer(task->real_timer);
     return remaining_time;
 }
 
+/// @brief Transforms ticks to a time value.
+/// @param ticks the ticks.
+/// @param tv where the time value is stored.
+static inline void __ticks_to_timeval(unsigned long ticks, timeval *tv)
+{
+    tv->tv_sec  = ticks / TICKS_PER_SECOND;
+    tv->tv_usec = ((ticks % TICKS_PER_SECOND) * 1000000u) / TICKS_PER_SECOND;
+}
+
+void timer_rusage_to_user(struct rusage *usage, const task_rusage_t *rusage)
+{
+    memset(usage, 0, sizeof(struct rusage));
+    __ticks_to_timeval(rusage->utime, &usage->ru_utime);
+    __ticks_to_timeval(rusage->stime, &usage->ru_stime);
+    usage->ru_minflt = rusage->minflt;
+    usage->ru_majflt = rusage->majflt;
+    usage->ru_nvcsw  = rusage->nvcsw;
+    usage->ru_nivcsw = rusage->nivcsw;
+}
+
+int sys_getrusage(int who, struct rusage *usage)
+{
+    task_struct *task = scheduler_get_current_process();
+    const task_rusage_t *rusage;
+    if (who == RUSAGE_SELF) {
+        rusage = &task->rusage;
+    } else if (who == RUSAGE_CHILDREN) {
+        rusage = &task->crusage;
+    } else {
+        return -EINVAL;
+    }
+    if (usage == NULL) {
+        return -EFAULT;
+    }
+    timer_rusage_to_user(usage, rusage);
+    // The resident set is not tracked, it is counted when asked for.
+    if ((who == RUSAGE_SELF) && task->mm) {
+        usage->ru_maxrss = mem_count_resident_pages(task->mm) * (PAGE_SIZE / 1024);
+    }
+    return 0;
+}
+
 int sys_getitimer(int which, struct itimerval *curr_value)
 {
     struct task_struct *task = scheduler_get_current_process();
     // Transform the apropriate interval and store it in the given variable.
     if (which == ITIMER_REAL) {
-        // Extract remaining time in dynamic timer.
-        task->it_real_value = task->real_timer->expires - timer_get_ticks();
-        __values_to_itimerval(task->it_real_incr, task->it_real_value, curr_value);
+        // Extract remaining time in the timer.
+        ktime_t now         = hrtimer_get_time();
+        task->it_real_value = 0;
+        if (task->real_timer.queued && (task->real_timer.expires > now)) {
+            task->it_real_value = task->real_timer.expires - now;
+        }
+        __nsec_to_timeval(task->it_real_incr, &curr_value->it_interval);
+        __nsec_to_timeval(task->it_real_value, &curr_value->it_value);
     } else if (which == ITIMER_VIRTUAL) {
         __values_to_itimerval(task->it_virt_incr, task->it_virt_value, curr_value);
     } else if (which == ITIMER_PROF) {
         __values_to_itimerval(task->it_prof_incr, task->it_prof_value, curr_value);
     } else {
-        return EINVAL;
+        return -EINVAL;
     }
     return 0;
 }
@@ -674,54 +932,27 @@ int sys_getitimer(int which, struct itimerval *curr_value)
 int sys_setitimer(int which, const struct itimerval *new_value, struct itimerval *old_value)
 {
     // Invalid time domain
-    if (which < 0 || which > 3) {
-        return EINVAL;
+    if ((which != ITIMER_REAL) && (which != ITIMER_VIRTUAL) && (which != ITIMER_PROF)) {
+        return -EINVAL;
+    }
+    if ((new_value->it_interval.tv_usec >= 1000000u) || (new_value->it_value.tv_usec >= 1000000u)) {
+        return -EINVAL;
     }
     // Returns old timer interval
     if (old_value != NULL) {
         sys_getitimer(which, old_value);
     }
-    // Get ticks of interval.
-    time_t new_interval = (new_value->it_interval.tv_sec * TICKS_PER_SECOND) +
-                          (new_value->it_interval.tv_usec * TICKS_PER_SECOND) / 1000;
-    // If interval is 0 removes timer
     struct task_struct *task = scheduler_get_current_process();
-    if (new_interval == 0) {
-        // Removes real_timer.
-        if ((which == ITIMER_REAL) && (task->real_timer != NULL)) {
-            __timer_list_dealloc(task->real_timer);
-            task->real_timer = NULL;
-        }
-        __update_task_itimerval(which, new_value);
-        return -1;
-    }
-    switch (which) {
-    // Uses Dynamic Timers
-    case ITIMER_REAL: {
-        // Remove real_timer if already in use.
-        if (task->real_timer) {
-            remove_timer(task->real_timer);
-        } else {
-            // Alloc new timer
-            task->real_timer = __timer_list_alloc();
+    __update_task_itimerval(which, new_value);
+    // Uses the high-resolution timers, an expiration of 0 disarms the timer.
+    if (which == ITIMER_REAL) {
+        hrtimer_cancel(&task->real_timer);
+        if (task->it_real_value != 0) {
+            task->real_timer.function = &real_timer_timeout;
+            hrtimer_start(&task->real_timer, hrtimer_get_time() + task->it_real_value);
         }
-        // Initialize the timer.
-        init_timer(task->real_timer);
-        // Setup the timer.
-        task->real_timer->expires  = timer_get_ticks() + new_interval;
-        task->real_timer->function = &real_timer_timeout;
-        task->real_timer->data     = (unsigned long)task;
-        // Add the timer.
-        add_timer(task->real_timer);
-    } break;
-
-    case ITIMER_VIRTUAL:
-    case ITIMER_PROF:
-        break;
     }
-
-    __update_task_itimerval(which, new_value);
-    return -1;
+    return 0;
 }
 
 void update_process_profiling_timer(task_struct *proc)
@@ -735,3 +966,18 @@ void update_process_profiling_timer(task_struct *proc)
         }
     }
 }
+
+int sys_prctl(int option, unsigned long arg2)
+{
+    task_struct *task = scheduler_get_current_process();
+    switch (option) {
+    case PR_SET_TIMERSLACK:
+        // Zero goes back to the default slack.
+        task->timer_slack_ns = arg2 ? (ktime_t)arg2 : HRTIMER_DEFAULT_SLACK;
+        return 0;
+    case PR_GET_TIMERSLACK:
+        return (task->timer_slack_ns > 0x7FFFFFFFULL) ? 0x7FFFFFFF : (int)task->timer_slack_ns;
+    default:
+        return -EINVAL;
+    }
+}
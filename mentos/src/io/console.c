@@ -0,0 +1,133 @@
+/// @file console.c
+/// @brief The console, where the kernel and the terminal write.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// The output is mirrored on every device of the console. The serial ports
+/// and the virtio console queue it, and send it from their interrupt
+/// handlers, so that without the screen the writers never wait for the
+/// scrolling of the video memory. What they receive reaches the terminal
+/// through the keyboard buffer, and the same line discipline.
+
+// Setup the logging for this file (do this before any other include).
+#include "sys/kernel_levels.h"           // Include kernel log levels.
+#define __DEBUG_HEADER__ "[CONSOL]"      ///< Change header.
+#define __DEBUG_LEVEL__  LOGLEVEL_NOTICE ///< Set log level.
+#include "io/debug.h"                    // Include debugging functions.
+
+#include "io/console.h"
+
+#include "drivers/keyboard/keyboard.h"
+#include "drivers/serial.h"
+#include "drivers/virtio/virtio_console.h"
+#include "io/video.h"
+#include "string.h"
+
+/// @brief A device which can be part of the console.
+typedef struct console_device_t {
+    /// The name used on the command line.
+    const char *name;
+    /// The bit of the device.
+    unsigned mask;
+} console_device_t;
+
+/// @brief The devices which can be part of the console.
+static const console_device_t console_devices[] = {
+    { "tty0", CONSOLE_VGA },
+    { "vga", CONSOLE_VGA },
+    { "ttyS0", CONSOLE_SERIAL0 },
+    { "ttyS1", CONSOLE_SERIAL1 },
+    { "hvc0", CONSOLE_VIRTIO },
+};
+
+/// @brief The devices of the console.
+static unsigned console_mask = CONSOLE_VGA;
+
+void console_setup(const char *cmdline)
+{
+    const char *option;
+    unsigned mask = 0;
+    if ((cmdline == NULL) || ((option = strstr(cmdline, "console=")) == NULL)) {
+        return;
+    }
+    option += strlen("console=");
+    // Parse the list of devices, up to the end of the option.
+    while (*option && (*option != ' ')) {
+        size_t length = strcspn(option, ", ");
+        for (unsigned i = 0; i < count_of(console_devices); ++i) {
+            if ((strlen(console_devices[i].name) == length) && !strncmp(option, console_devices[i].name, length)) {
+                mask |= console_devices[i].mask;
+            }
+        }
+        option += length + (option[length] == ',');
+    }
+    if (mask == 0) {
+        pr_warning("No known device in the console option, using the screen.\n");
+        return;
+    }
+    console_mask = mask;
+    pr_notice("The console uses%s%s%s%s.\n",
+              (mask & CONSOLE_VGA) ? " tty0" : "",
+              (mask & CONSOLE_SERIAL0) ? " ttyS0" : "",
+              (mask & CONSOLE_SERIAL1) ? " ttyS1" : "",
+              (mask & CONSOLE_VIRTIO) ? " hvc0" : "");
+}
+
+unsigned console_get_devices(void)
+{
+    return console_mask;
+}
+
+void console_putc(int c)
+{
+    char ch = (char)c;
+    console_write(&ch, 1);
+}
+
+void console_puts(const char *str)
+{
+    console_write(str, strlen(str));
+}
+
+void console_write(const char *buffer, size_t count)
+{
+    if (console_mask & CONSOLE_VGA) {
+        video_write(buffer, count);
+    }
+    if (console_mask & CONSOLE_SERIAL0) {
+        serial_write(0, buffer, count);
+    }
+    if (console_mask & CONSOLE_SERIAL1) {
+        serial_write(1, buffer, count);
+    }
+    if (console_mask & CONSOLE_VIRTIO) {
+        virtio_console_write(buffer, count);
+    }
+}
+
+void console_print_result(const char *status)
+{
+    unsigned y, width;
+    if (console_mask & CONSOLE_VGA) {
+        video_get_cursor_position(NULL, &y);
+        video_get_screen_size(&width, NULL);
+        video_move_cursor(width - strlen(status) - 1, y);
+    }
+    console_puts(status);
+    console_putc('\n');
+}
+
+int console_input(unsigned device, int c)
+{
+    if (!(console_mask & device)) {
+        return 0;
+    }
+    // Terminals send a carriage return for enter, and delete for backspace.
+    if (c == '\r') {
+        c = '\n';
+    } else if (c == 0x7f) {
+        c = '\b';
+    }
+    keyboard_push_input(c);
+    return 1;
+}
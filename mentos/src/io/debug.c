@@ -4,22 +4,21 @@
 /// See LICENSE.md for details.
 
 #include "io/debug.h"
+#include "drivers/serial.h"
 #include "io/ansi_colors.h"
-#include "io/port_io.h"
 #include "kernel.h"
 #include "math.h"
 #include "stdio.h"
 #include "string.h"
 #include "sys/bitops.h"
+#include "system/printk.h"
 
-/// Serial port for QEMU.
-#define SERIAL_COM1 (0x03F8)
 /// Determines the log level.
 static int max_log_level = LOGLEVEL_DEBUG;
 
 void dbg_putchar(char c)
 {
-    outportb(SERIAL_COM1, (uint8_t)c);
+    serial_putc(c);
 }
 
 void dbg_puts(const char *s)
@@ -92,42 +91,40 @@ int get_log_level(void)
 
 void dbg_printf(const char *file, const char *fun, int line, char *header, short log_level, const char *format, ...)
 {
-    // Define a buffer for the formatted string.
-    static char formatted[BUFSIZ];
-    static short new_line = 1;
+    char formatted[BUFSIZ];
 
     // Stage 1: FORMAT
-    if (strlen(format) >= BUFSIZ) {
-        return;
-    }
-
     // Start variabile argument's list.
     va_list ap;
     va_start(ap, format);
-    // Format the message.
-    vsprintf(formatted, format, ap);
+    // Format the message, truncating it to the buffer.
+    int length = vsnprintf(formatted, BUFSIZ, format, ap);
     // End the list of arguments.
     va_end(ap);
+    if (length >= BUFSIZ) {
+        length = BUFSIZ - 1;
+    }
+
+    // Stage 2: STORE, klogd sends it later.
+    printk_store(file, line, header, log_level, formatted, length);
+}
 
-    // Stage 2: SEND
+int dbg_write_message(const char *file, int line, const char *header, short log_level, const char *text, int new_line)
+{
     if (new_line) {
-        __debug_print_header(file, fun, line, log_level, header);
-        new_line = 0;
+        __debug_print_header(file, NULL, line, log_level, (char *)header);
     }
-    for (int it = 0; (formatted[it] != 0) && (it < BUFSIZ); ++it) {
-        dbg_putchar(formatted[it]);
-        if (formatted[it] != '\n') {
-            continue;
-        }
-        if ((it + 1) >= BUFSIZ) {
+    for (int it = 0; text[it] != 0; ++it) {
+        dbg_putchar(text[it]);
+        if (text[it] != '\n') {
             continue;
         }
-        if (formatted[it + 1] == 0) {
-            new_line = 1;
-        } else {
-            __debug_print_header(file, fun, line, log_level, header);
+        if (text[it + 1] == 0) {
+            return 1;
         }
+        __debug_print_header(file, NULL, line, log_level, (char *)header);
     }
+    return 0;
 }
 
 const char *to_human_size(unsigned long bytes)
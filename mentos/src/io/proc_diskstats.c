@@ -0,0 +1,225 @@
+/// @file proc_diskstats.c
+/// @brief Contains callbacks for the procfs files with the I/O statistics of
+/// the block devices.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// Reading `/proc/diskstats` returns a line for each block device, with the
+/// completed and merged requests, the sectors moved, and the milliseconds
+/// spent waiting inside the queue and on the device, for reads and writes.
+/// Reading `/proc/<device>/latency` returns the histogram of the latencies of
+/// the requests of the device, from queue to completion.
+
+#include "drivers/diskstats.h"
+#include "fs/procfs.h"
+#include "fs/seq_file.h"
+#include "io/debug.h"
+#include "io/proc_modules.h"
+#include "stdio.h"
+#include "sys/errno.h"
+
+/// @brief Starts the iteration, the whole file is a single record.
+/// @param m the sequential file.
+/// @param pos the position of the record.
+/// @return a non-NULL token, or NULL past the record.
+static void *__procdisk_start(seq_file_t *m, size_t *pos)
+{
+    return (*pos == 0) ? m : NULL;
+}
+
+/// @brief Moves past the record.
+/// @param m the sequential file.
+/// @param v the current record.
+/// @param pos the position of the record.
+/// @return NULL.
+static void *__procdisk_next(seq_file_t *m, void *v, size_t *pos)
+{
+    ++(*pos);
+    return NULL;
+}
+
+/// @brief Ends the iteration.
+/// @param m the sequential file.
+/// @param v the record which was not shown.
+static void __procdisk_stop(seq_file_t *m, void *v)
+{
+}
+
+/// @brief Converts nanoseconds to milliseconds.
+/// @param ns the nanoseconds.
+/// @return the milliseconds.
+static inline unsigned long __procdisk_ms(ktime_t ns)
+{
+    div64_32(&ns, NSEC_PER_MSEC);
+    return (unsigned long)ns;
+}
+
+/// @brief Writes the line of a device.
+/// @param stats the statistics of the device.
+/// @param data the sequential file.
+static void __procdisk_show_device(disk_stats_t *stats, void *data)
+{
+    seq_file_t *m = (seq_file_t *)data;
+    seq_printf(m, "%-6s", stats->name);
+    for (int dir = 0; dir < DISK_STAT_DIRS; ++dir) {
+        seq_printf(m, " %10lu %8lu %12lu %10lu %10lu", stats->ios[dir], stats->merges[dir], stats->sectors[dir],
+                   __procdisk_ms(stats->queue_ns[dir]), __procdisk_ms(stats->device_ns[dir]));
+    }
+    seq_printf(m, " %8lu\n", stats->in_flight);
+}
+
+/// @brief Writes the line of each device.
+/// @param m the sequential file.
+/// @param v the token of the record.
+/// @return 0.
+static int __procdisk_show(seq_file_t *m, void *v)
+{
+    seq_printf(m, "%-6s %10s %8s %12s %10s %10s %10s %8s %12s %10s %10s %8s\n", "# dev", "reads", "merged",
+               "sectors", "queue-ms", "device-ms", "writes", "merged", "sectors", "queue-ms", "device-ms",
+               "inflight");
+    disk_stats_for_each(__procdisk_show_device, m);
+    return 0;
+}
+
+/// @brief Writes the latency histograms of a device.
+/// @param m the sequential file, its private data is the device.
+/// @param v the token of the record.
+/// @return 0.
+static int __procdisk_show_latency(seq_file_t *m, void *v)
+{
+    disk_stats_t *stats = (disk_stats_t *)m->private;
+    seq_printf(m, "%12s %10s %10s\n", "# usecs", "reads", "writes");
+    for (unsigned bucket = 0; bucket < DISK_STAT_BUCKETS; ++bucket) {
+        unsigned long bound = 1UL << (bucket + DISK_STAT_MIN_SHIFT);
+        if (bucket < DISK_STAT_BUCKETS - 1) {
+            seq_printf(m, "  < %8lu", bound);
+        } else {
+            seq_printf(m, " >= %8lu", bound >> 1);
+        }
+        seq_printf(m, " %10lu %10lu\n", stats->hist[DISK_STAT_READ][bucket], stats->hist[DISK_STAT_WRITE][bucket]);
+    }
+    return 0;
+}
+
+/// Iterator for `/proc/diskstats`.
+static const seq_operations_t procdisk_seq_operations = {
+    .start = __procdisk_start,
+    .next  = __procdisk_next,
+    .stop  = __procdisk_stop,
+    .show  = __procdisk_show,
+};
+
+/// Iterator for `/proc/<device>/latency`.
+static const seq_operations_t procdisk_latency_seq_operations = {
+    .start = __procdisk_start,
+    .next  = __procdisk_next,
+    .stop  = __procdisk_stop,
+    .show  = __procdisk_show_latency,
+};
+
+static ssize_t __procdisk_read(vfs_file_t *file, char *buf, off_t offset, size_t nbyte)
+{
+    if (!file) {
+        pr_err("We received a NULL file pointer.\n");
+        return -EFAULT;
+    }
+    if (file->private_data == NULL) {
+        int ret = seq_open(file, &procdisk_seq_operations, NULL);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    return seq_read(file, buf, offset, nbyte);
+}
+
+static ssize_t __procdisk_read_latency(vfs_file_t *file, char *buf, off_t offset, size_t nbyte)
+{
+    if (!file) {
+        pr_err("We received a NULL file pointer.\n");
+        return -EFAULT;
+    }
+    if (file->private_data == NULL) {
+        proc_dir_entry_t *entry = (proc_dir_entry_t *)file->device;
+        if ((entry == NULL) || (entry->data == NULL)) {
+            return -ENOENT;
+        }
+        int ret = seq_open(file, &procdisk_latency_seq_operations, entry->data);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    return seq_read(file, buf, offset, nbyte);
+}
+
+/// Filesystem general operations.
+static vfs_sys_operations_t procdisk_sys_operations = {
+    .mkdir_f   = NULL,
+    .rmdir_f   = NULL,
+    .stat_f    = NULL,
+    .creat_f   = NULL,
+    .symlink_f = NULL,
+};
+
+/// Filesystem file operations for `/proc/diskstats`.
+static vfs_file_operations_t procdisk_fs_operations = {
+    .open_f     = NULL,
+    .unlink_f   = NULL,
+    .close_f    = seq_release,
+    .read_f     = __procdisk_read,
+    .write_f    = NULL,
+    .lseek_f    = NULL,
+    .stat_f     = NULL,
+    .ioctl_f    = NULL,
+    .getdents_f = NULL,
+    .readlink_f = NULL,
+};
+
+/// Filesystem file operations for `/proc/<device>/latency`.
+static vfs_file_operations_t procdisk_latency_fs_operations = {
+    .open_f     = NULL,
+    .unlink_f   = NULL,
+    .close_f    = seq_release,
+    .read_f     = __procdisk_read_latency,
+    .write_f    = NULL,
+    .lseek_f    = NULL,
+    .stat_f     = NULL,
+    .ioctl_f    = NULL,
+    .getdents_f = NULL,
+    .readlink_f = NULL,
+};
+
+/// @brief Creates `/proc/<device>/latency` for a device.
+/// @param stats the statistics of the device.
+/// @param data ignored.
+static void __procdisk_create_latency(disk_stats_t *stats, void *data)
+{
+    proc_dir_entry_t *folder, *entry;
+    if ((folder = proc_mkdir(stats->name, NULL)) == NULL) {
+        pr_err("Cannot create the `/proc/%s` directory.\n", stats->name);
+        return;
+    }
+    if ((entry = proc_create_entry("latency", folder)) == NULL) {
+        pr_err("Cannot create the `/proc/%s/latency` file.\n", stats->name);
+        return;
+    }
+    // Set the specific operations.
+    entry->sys_operations = &procdisk_sys_operations;
+    entry->fs_operations  = &procdisk_latency_fs_operations;
+    entry->data           = stats;
+}
+
+int procdisk_module_init(void)
+{
+    proc_dir_entry_t *file = proc_create_entry("diskstats", NULL);
+    if (file == NULL) {
+        pr_err("Cannot create `/proc/diskstats`.\n");
+        return 1;
+    }
+    pr_debug("Created `/proc/diskstats` (%p)\n", file);
+    // Set the specific operations.
+    file->sys_operations = &procdisk_sys_operations;
+    file->fs_operations  = &procdisk_fs_operations;
+    // The devices have been detected by now, see INIT_LEVEL_DEVICES.
+    disk_stats_for_each(__procdisk_create_latency, NULL);
+    return 0;
+}
@@ -2,23 +2,96 @@
 /// @brief Contains callbacks for procfs system files.
 /// @copyright (c) 2014-2024 This file is distributed under the MIT License.
 /// See LICENSE.md for details.
+/// @details
+/// `/proc/feedback` returns the schedfb_record_t recorded by the scheduler
+/// feedback system, see sys/schedfb.h. It is empty unless the kernel is built
+/// with `ENABLE_SCHEDULER_FEEDBACK`.
 
 #include "fs/procfs.h"
+#include "fs/seq_file.h"
 #include "io/debug.h"
-#include "process/process.h"
+#include "io/proc_modules.h"
+#include "mem/kheap.h"
+#include "process/scheduler_feedback.h"
 #include "string.h"
 #include "sys/errno.h"
 
+/// The records overwritten before being read, since boot.
+static unsigned long procfb_lost = 0;
+
+/// @brief Starts the iteration over a file with a single record.
+/// @param m the sequential file.
+/// @param pos the position of the record.
+/// @return a non-NULL token, or NULL past the record.
+static void *__procfb_start(seq_file_t *m, size_t *pos)
+{
+    return (*pos == 0) ? m : NULL;
+}
+
+/// @brief Moves past the only record.
+/// @param m the sequential file.
+/// @param v the current record.
+/// @param pos the position of the record.
+/// @return NULL.
+static void *__procfb_next(seq_file_t *m, void *v, size_t *pos)
+{
+    ++(*pos);
+    return NULL;
+}
+
+/// @brief Ends the iteration.
+/// @param m the sequential file.
+/// @param v the record which was not shown.
+static void __procfb_stop(seq_file_t *m, void *v)
+{
+}
+
+/// @brief Moves the recorded statistics into the file.
+/// @param m the sequential file.
+/// @param v the token of the record.
+/// @return 0 on success, -ENOMEM on failure.
+static int __procfb_show(seq_file_t *m, void *v)
+{
+    schedfb_record_t *records = (schedfb_record_t *)kmalloc(SCHEDFB_RECORDS * sizeof(schedfb_record_t));
+    if (!records) {
+        return -ENOMEM;
+    }
+    int ret      = 0;
+    size_t count = scheduler_feedback_consume(records, &procfb_lost);
+    if (count) {
+        ret = seq_write(m, records, count * sizeof(schedfb_record_t));
+    }
+    kfree(records);
+    return (ret < 0) ? ret : 0;
+}
+
+/// Iterator for `/proc/feedback`.
+static const seq_operations_t procfb_seq_operations = {
+    .start = __procfb_start,
+    .next  = __procfb_next,
+    .stop  = __procfb_stop,
+    .show  = __procfb_show,
+};
+
+/// @brief Reads `/proc/feedback`, which consumes the records at offset zero.
+/// @param file the file.
+/// @param buf the buffer.
+/// @param offset the offset.
+/// @param nbyte the size of the buffer.
+/// @return the number of bytes read, or -errno.
 static ssize_t procfb_read(vfs_file_t *file, char *buf, off_t offset, size_t nbyte)
 {
     if (!file) {
         pr_err("Received a NULL file.\n");
         return -ENOENT;
     }
-    if (!strcmp(file->name, "/proc/feedback")) {
-        pr_alert("Return scheduling feedback information.\n");
+    if (file->private_data == NULL) {
+        int ret = seq_open(file, &procfb_seq_operations, NULL);
+        if (ret < 0) {
+            return ret;
+        }
     }
-    return 0;
+    return seq_read(file, buf, offset, nbyte);
 }
 
 /// Filesystem general operations.
@@ -34,7 +107,7 @@ static vfs_sys_operations_t procfb_sys_operations = {
 static vfs_file_operations_t procfb_fs_operations = {
     .open_f     = NULL,
     .unlink_f   = NULL,
-    .close_f    = NULL,
+    .close_f    = seq_release,
     .read_f     = procfb_read,
     .write_f    = NULL,
     .lseek_f    = NULL,
@@ -0,0 +1,266 @@
+/// @file proc_funcprof.c
+/// @brief Contains callbacks for the procfs file of the function profile.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// Reading `/proc/func_profile` returns a header line, then a line for each
+/// function which was called, the most expensive first: the calls, the TSC
+/// cycles spent inside the function and the ones it called, the cycles spent
+/// inside the function alone, and its name. Writing to it clears the profile.
+
+#include "elf/elf.h"
+#include "fs/procfs.h"
+#include "fs/seq_file.h"
+#include "io/debug.h"
+#include "io/proc_modules.h"
+#include "math.h"
+#include "mem/kheap.h"
+#include "stdio.h"
+#include "string.h"
+#include "sys/errno.h"
+#include "system/func_profile.h"
+
+#ifdef ENABLE_FUNC_PROFILE
+
+/// @brief The profile, copied when the file is read from the beginning.
+typedef struct procfunc_snapshot_t {
+    /// The number of functions copied.
+    unsigned count;
+    /// The functions, the most expensive first.
+    func_profile_entry_t *entries;
+} procfunc_snapshot_t;
+
+/// @brief Copies the profile, and sorts it by exclusive cycles.
+/// @param snapshot where the profile is copied.
+/// @return 0 on success, -ENOMEM on failure.
+static int __procfunc_take(procfunc_snapshot_t *snapshot)
+{
+    unsigned size = func_profile_snapshot(NULL, 0);
+    kfree(snapshot->entries);
+    snapshot->count   = 0;
+    snapshot->entries = NULL;
+    if (size == 0) {
+        return 0;
+    }
+    snapshot->entries = (func_profile_entry_t *)kmalloc(size * sizeof(func_profile_entry_t));
+    if (snapshot->entries == NULL) {
+        return -ENOMEM;
+    }
+    snapshot->count = func_profile_snapshot(snapshot->entries, size);
+    // Sort with a shell sort, there are thousands of functions.
+    func_profile_entry_t *entries = snapshot->entries;
+    for (unsigned gap = snapshot->count / 2; gap > 0; gap /= 2) {
+        for (unsigned i = gap; i < snapshot->count; ++i) {
+            func_profile_entry_t entry = entries[i];
+            unsigned j                 = i;
+            for (; (j >= gap) && (entries[j - gap].exclusive < entry.exclusive); j -= gap) {
+                entries[j] = entries[j - gap];
+            }
+            entries[j] = entry;
+        }
+    }
+    return 0;
+}
+
+/// @brief Formats a 64-bit counter, as there is no 64-bit conversion.
+/// @param buffer a buffer of at least 21 characters.
+/// @param value the counter.
+/// @return the buffer.
+static const char *__procfunc_u64(char *buffer, ktime_t value)
+{
+    // Print the billions apart.
+    uint32_t low = div64_32(&value, 1000000000u);
+    if (value) {
+        sprintf(buffer, "%u%09u", (uint32_t)value, low);
+    } else {
+        sprintf(buffer, "%u", low);
+    }
+    return buffer;
+}
+
+/// @brief Starts the iteration: the header is the record 0, then the functions.
+/// @param m the sequential file.
+/// @param pos the position of the record.
+/// @return the record, or NULL past the last one.
+static void *__procfunc_start(seq_file_t *m, size_t *pos)
+{
+    procfunc_snapshot_t *snapshot = (procfunc_snapshot_t *)m->private;
+    if (*pos == 0) {
+        return (__procfunc_take(snapshot) < 0) ? NULL : snapshot;
+    }
+    return (*pos <= snapshot->count) ? &snapshot->entries[*pos - 1] : NULL;
+}
+
+/// @brief Moves to the next function.
+/// @param m the sequential file.
+/// @param v the current record.
+/// @param pos the position of the record.
+/// @return the next record, or NULL past the last one.
+static void *__procfunc_next(seq_file_t *m, void *v, size_t *pos)
+{
+    procfunc_snapshot_t *snapshot = (procfunc_snapshot_t *)m->private;
+    ++(*pos);
+    return (*pos <= snapshot->count) ? &snapshot->entries[*pos - 1] : NULL;
+}
+
+/// @brief Ends the iteration over the functions.
+/// @param m the sequential file.
+/// @param v the record which was not shown.
+static void __procfunc_stop(seq_file_t *m, void *v)
+{
+}
+
+/// @brief Writes the header, or a function.
+/// @param m the sequential file.
+/// @param v the record.
+/// @return 0 on success, -ENOMEM on failure.
+static int __procfunc_show(seq_file_t *m, void *v)
+{
+    if (v == m->private) {
+        procfunc_snapshot_t *snapshot = (procfunc_snapshot_t *)v;
+        seq_printf(m, "# functions %u dropped %lu\n", snapshot->count, func_profile_dropped());
+        return seq_printf(m, "%10s %16s %16s %s\n", "# calls", "inclusive", "exclusive", "function") < 0 ? -ENOMEM : 0;
+    }
+    func_profile_entry_t *entry = (func_profile_entry_t *)v;
+    char inclusive[24], exclusive[24];
+    const char *name = elf_kernel_symbol(entry->function, NULL);
+    seq_printf(m, "%10lu %16s %16s ", entry->calls, __procfunc_u64(inclusive, entry->inclusive),
+               __procfunc_u64(exclusive, entry->exclusive));
+    if (name) {
+        return seq_printf(m, "%s\n", name) < 0 ? -ENOMEM : 0;
+    }
+    return seq_printf(m, "0x%08x\n", entry->function) < 0 ? -ENOMEM : 0;
+}
+
+/// Iterator for `/proc/func_profile`.
+static const seq_operations_t procfunc_seq_operations = {
+    .start = __procfunc_start,
+    .next  = __procfunc_next,
+    .stop  = __procfunc_stop,
+    .show  = __procfunc_show,
+};
+
+static ssize_t __procfunc_read(vfs_file_t *file, char *buf, off_t offset, size_t nbyte)
+{
+    if (!file) {
+        pr_err("We received a NULL file pointer.\n");
+        return -EFAULT;
+    }
+    if (file->private_data == NULL) {
+        procfunc_snapshot_t *snapshot = (procfunc_snapshot_t *)kmalloc(sizeof(procfunc_snapshot_t));
+        if (!snapshot) {
+            return -ENOMEM;
+        }
+        snapshot->count   = 0;
+        snapshot->entries = NULL;
+        int ret           = seq_open(file, &procfunc_seq_operations, snapshot);
+        if (ret < 0) {
+            kfree(snapshot);
+            return ret;
+        }
+    }
+    return seq_read(file, buf, offset, nbyte);
+}
+
+/// @brief Releases the profile copied by the reads.
+/// @param file the file.
+/// @return 0.
+static int __procfunc_close(vfs_file_t *file)
+{
+    seq_file_t *m = (seq_file_t *)file->private_data;
+    if (m) {
+        procfunc_snapshot_t *snapshot = (procfunc_snapshot_t *)m->private;
+        kfree(snapshot->entries);
+        kfree(snapshot);
+    }
+    return seq_release(file);
+}
+
+/// @brief Clears the profile, whatever is written.
+/// @param file the file.
+/// @param buf ignored.
+/// @param offset ignored.
+/// @param nbyte the length of the text.
+/// @return nbyte.
+static ssize_t __procfunc_write(vfs_file_t *file, const void *buf, off_t offset, size_t nbyte)
+{
+    func_profile_reset();
+    return nbyte;
+}
+
+#else
+
+/// @brief Tells that the functions are not profiled.
+/// @param file the file.
+/// @param buf the buffer.
+/// @param offset the offset inside the message.
+/// @param nbyte the room in the buffer.
+/// @return the number of bytes read.
+static ssize_t __procfunc_read(vfs_file_t *file, char *buf, off_t offset, size_t nbyte)
+{
+    static const char message[] = "The kernel was built without ENABLE_FUNC_PROFILE.\n";
+    if (offset >= (off_t)(sizeof(message) - 1)) {
+        return 0;
+    }
+    size_t length = min(nbyte, sizeof(message) - 1 - offset);
+    memcpy(buf, message + offset, length);
+    return length;
+}
+
+/// @brief Nothing to release.
+/// @param file the file.
+/// @return 0.
+static int __procfunc_close(vfs_file_t *file)
+{
+    return 0;
+}
+
+/// @brief Ignores what is written.
+/// @param file the file.
+/// @param buf ignored.
+/// @param offset ignored.
+/// @param nbyte the length of the text.
+/// @return nbyte.
+static ssize_t __procfunc_write(vfs_file_t *file, const void *buf, off_t offset, size_t nbyte)
+{
+    return nbyte;
+}
+
+#endif
+
+/// Filesystem general operations.
+static vfs_sys_operations_t procfunc_sys_operations = {
+    .mkdir_f   = NULL,
+    .rmdir_f   = NULL,
+    .stat_f    = NULL,
+    .creat_f   = NULL,
+    .symlink_f = NULL,
+};
+
+/// Filesystem file operations.
+static vfs_file_operations_t procfunc_fs_operations = {
+    .open_f     = NULL,
+    .unlink_f   = NULL,
+    .close_f    = __procfunc_close,
+    .read_f     = __procfunc_read,
+    .write_f    = __procfunc_write,
+    .lseek_f    = NULL,
+    .stat_f     = NULL,
+    .ioctl_f    = NULL,
+    .getdents_f = NULL,
+    .readlink_f = NULL,
+};
+
+int procfunc_module_init(void)
+{
+    proc_dir_entry_t *file = proc_create_entry("func_profile", NULL);
+    if (file == NULL) {
+        pr_err("Cannot create `/proc/func_profile`.\n");
+        return 1;
+    }
+    pr_debug("Created `/proc/func_profile` (%p)\n", file);
+    // Set the specific operations.
+    file->sys_operations = &procfunc_sys_operations;
+    file->fs_operations  = &procfunc_fs_operations;
+    return 0;
+}
@@ -0,0 +1,272 @@
+/// @file proc_latency.c
+/// @brief Contains callbacks for the procfs files of the latency tracer.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// Reading `/proc/latency/irqsoff` returns the worst sections with interrupts
+/// disabled, the worst first: the CPU, the TSC cycles and microseconds, the
+/// interrupt which opened the section (or `-`), and the addresses where the
+/// interrupts were disabled and enabled. Reading `/proc/latency/wakeup`
+/// returns the worst delays between the wake up of a task and the moment it
+/// ran. Writing to either file clears both.
+
+#include "fs/procfs.h"
+#include "fs/seq_file.h"
+#include "hardware/smp.h"
+#include "io/debug.h"
+#include "io/proc_modules.h"
+#include "mem/kheap.h"
+#include "stdio.h"
+#include "string.h"
+#include "sys/errno.h"
+#include "system/latency_trace.h"
+
+/// @brief Starts the iteration, the whole file is a single record.
+/// @param m the sequential file.
+/// @param pos the position of the record.
+/// @return a non-NULL token, or NULL past the record.
+static void *__proclat_start(seq_file_t *m, size_t *pos)
+{
+    return (*pos == 0) ? m : NULL;
+}
+
+/// @brief Moves past the record.
+/// @param m the sequential file.
+/// @param v the current record.
+/// @param pos the position of the record.
+/// @return NULL.
+static void *__proclat_next(seq_file_t *m, void *v, size_t *pos)
+{
+    ++(*pos);
+    return NULL;
+}
+
+/// @brief Ends the iteration.
+/// @param m the sequential file.
+/// @param v the record which was not shown.
+static void __proclat_stop(seq_file_t *m, void *v)
+{
+}
+
+#ifdef ENABLE_LATENCY_TRACE
+
+/// @brief Formats a 64-bit counter, as there is no 64-bit conversion.
+/// @param buffer a buffer of at least 21 characters.
+/// @param value the counter.
+/// @return the buffer.
+static const char *__proclat_u64(char *buffer, ktime_t value)
+{
+    // Print the billions apart.
+    uint32_t low = div64_32(&value, 1000000000u);
+    if (value) {
+        sprintf(buffer, "%u%09u", (uint32_t)value, low);
+    } else {
+        sprintf(buffer, "%u", low);
+    }
+    return buffer;
+}
+
+/// @brief Converts TSC cycles to microseconds.
+/// @param cycles the cycles.
+/// @return the microseconds.
+static unsigned long __proclat_us(ktime_t cycles)
+{
+    ktime_t ns = latency_cycles_to_ns(cycles);
+    div64_32(&ns, NSEC_PER_USEC);
+    return (unsigned long)ns;
+}
+
+/// @brief A record, with the CPU which took it.
+typedef struct proclat_entry_t {
+    /// The CPU.
+    unsigned cpu;
+    /// The duration, in TSC cycles, to sort the records.
+    ktime_t cycles;
+    /// The record.
+    const void *record;
+} proclat_entry_t;
+
+/// @brief Sorts the records, the worst first.
+/// @param entries the records.
+/// @param count the number of records.
+static void __proclat_sort(proclat_entry_t *entries, size_t count)
+{
+    for (size_t i = 1; i < count; ++i) {
+        proclat_entry_t entry = entries[i];
+        size_t j              = i;
+        for (; (j > 0) && (entries[j - 1].cycles < entry.cycles); --j) {
+            entries[j] = entries[j - 1];
+        }
+        entries[j] = entry;
+    }
+}
+
+/// @brief Writes the worst sections of all the CPUs.
+/// @param m the sequential file, its private data tells which tracer.
+/// @param v the token of the record.
+/// @return 0 on success, -ENOMEM on failure.
+static int __proclat_show(seq_file_t *m, void *v)
+{
+    bool_t wakeup          = m->private != NULL;
+    latency_stat_t *stats  = (latency_stat_t *)kmalloc(smp_num_cpus * sizeof(latency_stat_t));
+    proclat_entry_t *table = (proclat_entry_t *)kmalloc(smp_num_cpus * LATENCY_WORST * sizeof(proclat_entry_t));
+    size_t count           = 0;
+    unsigned long total    = 0;
+    char cycles[24];
+    if ((stats == NULL) || (table == NULL)) {
+        kfree(stats);
+        kfree(table);
+        return -ENOMEM;
+    }
+    for (unsigned cpu = 0; cpu < smp_num_cpus; ++cpu) {
+        latency_stat_get(cpu, &stats[cpu]);
+        total += wakeup ? stats[cpu].wakeup_count : stats[cpu].irqsoff_count;
+        for (unsigned i = 0; i < LATENCY_WORST; ++i) {
+            ktime_t duration = wakeup ? stats[cpu].wakeup[i].cycles : stats[cpu].irqsoff[i].cycles;
+            if (duration) {
+                table[count].cpu    = cpu;
+                table[count].cycles = duration;
+                table[count].record = wakeup ? (const void *)&stats[cpu].wakeup[i] : (const void *)&stats[cpu].irqsoff[i];
+                ++count;
+            }
+        }
+    }
+    __proclat_sort(table, count);
+    if (wakeup) {
+        seq_printf(m, "# %lu wake ups\n", total);
+        seq_printf(m, "%-4s %14s %10s %6s %6s %s\n", "#cpu", "cycles", "usecs", "pid", "policy", "name");
+    } else {
+        seq_printf(m, "# %lu sections with interrupts disabled\n", total);
+        seq_printf(m, "%-4s %14s %10s %6s %10s %10s\n", "#cpu", "cycles", "usecs", "vector", "start", "end");
+    }
+    for (size_t i = 0; i < count; ++i) {
+        __proclat_u64(cycles, table[i].cycles);
+        if (wakeup) {
+            const wakeup_record_t *record = (const wakeup_record_t *)table[i].record;
+            seq_printf(m, "%-4u %14s %10lu %6d %6d %s\n", table[i].cpu, cycles, __proclat_us(record->cycles),
+                       record->pid, record->policy, record->name);
+        } else {
+            const irqsoff_record_t *record = (const irqsoff_record_t *)table[i].record;
+            seq_printf(m, "%-4u %14s %10lu ", table[i].cpu, cycles, __proclat_us(record->cycles));
+            if (record->vector < 0) {
+                seq_printf(m, "%6s", "-");
+            } else {
+                seq_printf(m, "%6d", record->vector);
+            }
+            seq_printf(m, " 0x%08lx 0x%08lx\n", record->start, record->end);
+        }
+    }
+    kfree(stats);
+    kfree(table);
+    return 0;
+}
+
+#else
+
+/// @brief Tells that the latencies are not traced.
+/// @param m the sequential file.
+/// @param v the token of the record.
+/// @return 0.
+static int __proclat_show(seq_file_t *m, void *v)
+{
+    seq_printf(m, "The kernel was built without ENABLE_LATENCY_TRACE.\n");
+    return 0;
+}
+
+#endif
+
+/// Iterator for the files of the latency tracer.
+static const seq_operations_t proclat_seq_operations = {
+    .start = __proclat_start,
+    .next  = __proclat_next,
+    .stop  = __proclat_stop,
+    .show  = __proclat_show,
+};
+
+static ssize_t __proclat_read(vfs_file_t *file, char *buf, off_t offset, size_t nbyte)
+{
+    if (!file) {
+        pr_err("We received a NULL file pointer.\n");
+        return -EFAULT;
+    }
+    if (file->private_data == NULL) {
+        proc_dir_entry_t *entry = (proc_dir_entry_t *)file->device;
+        if (entry == NULL) {
+            return -ENOENT;
+        }
+        int ret = seq_open(file, &proclat_seq_operations, entry->data);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    return seq_read(file, buf, offset, nbyte);
+}
+
+/// @brief Clears the worst sections, whatever is written.
+/// @param file the file.
+/// @param buf ignored.
+/// @param offset ignored.
+/// @param nbyte the length of the text.
+/// @return nbyte.
+static ssize_t __proclat_write(vfs_file_t *file, const void *buf, off_t offset, size_t nbyte)
+{
+#ifdef ENABLE_LATENCY_TRACE
+    latency_reset();
+#endif
+    return nbyte;
+}
+
+/// Filesystem general operations.
+static vfs_sys_operations_t proclat_sys_operations = {
+    .mkdir_f   = NULL,
+    .rmdir_f   = NULL,
+    .stat_f    = NULL,
+    .creat_f   = NULL,
+    .symlink_f = NULL,
+};
+
+/// Filesystem file operations.
+static vfs_file_operations_t proclat_fs_operations = {
+    .open_f     = NULL,
+    .unlink_f   = NULL,
+    .close_f    = seq_release,
+    .read_f     = __proclat_read,
+    .write_f    = __proclat_write,
+    .lseek_f    = NULL,
+    .stat_f     = NULL,
+    .ioctl_f    = NULL,
+    .getdents_f = NULL,
+    .readlink_f = NULL,
+};
+
+int proclat_module_init(void)
+{
+    proc_dir_entry_t *folder = NULL, *entry = NULL;
+
+    // First, we need to create the `/proc/latency` folder.
+    if ((folder = proc_mkdir("latency", NULL)) == NULL) {
+        pr_err("Cannot create the `/proc/latency` directory.\n");
+        return 1;
+    }
+
+    // Create the `/proc/latency/irqsoff` entry.
+    if ((entry = proc_create_entry("irqsoff", folder)) == NULL) {
+        pr_err("Cannot create the `/proc/latency/irqsoff` file.\n");
+        return 1;
+    }
+    // Set the specific operations.
+    entry->sys_operations = &proclat_sys_operations;
+    entry->fs_operations  = &proclat_fs_operations;
+    entry->data           = NULL;
+
+    // Create the `/proc/latency/wakeup` entry, told apart by its data.
+    if ((entry = proc_create_entry("wakeup", folder)) == NULL) {
+        pr_err("Cannot create the `/proc/latency/wakeup` file.\n");
+        return 1;
+    }
+    // Set the specific operations.
+    entry->sys_operations = &proclat_sys_operations;
+    entry->fs_operations  = &proclat_fs_operations;
+    entry->data           = folder;
+    return 0;
+}
@@ -0,0 +1,235 @@
+/// @file proc_lockstat.c
+/// @brief Contains callbacks for the procfs file with the contention
+/// statistics of the locks.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// Reading `/proc/lock_stat` returns a line for each class of locks which was
+/// taken, the most contended first, with the waits and the holds in TSC
+/// cycles. Writing to it clears the statistics.
+
+#include "fs/procfs.h"
+#include "fs/seq_file.h"
+#include "io/debug.h"
+#include "io/proc_modules.h"
+#include "klib/lock_stat.h"
+#include "mem/kheap.h"
+#include "stdio.h"
+#include "string.h"
+#include "sys/errno.h"
+
+/// @brief Starts the iteration over `/proc/lock_stat`.
+/// @param m the sequential file.
+/// @param pos the position of the record.
+/// @return a non-NULL token, or NULL past the table.
+static void *__proclock_start(seq_file_t *m, size_t *pos)
+{
+    return (*pos == 0) ? m : NULL;
+}
+
+/// @brief Moves past the table.
+/// @param m the sequential file.
+/// @param v the current record.
+/// @param pos the position of the record.
+/// @return NULL.
+static void *__proclock_next(seq_file_t *m, void *v, size_t *pos)
+{
+    ++(*pos);
+    return NULL;
+}
+
+/// @brief Ends the iteration over `/proc/lock_stat`.
+/// @param m the sequential file.
+/// @param v the record which was not shown.
+static void __proclock_stop(seq_file_t *m, void *v)
+{
+}
+
+#ifdef ENABLE_LOCK_STAT
+
+/// @brief The statistics of a class, summed over the CPUs.
+typedef struct proclock_entry_t {
+    /// The class.
+    lock_class_t *class;
+    /// The sum of its statistics.
+    lock_stat_t stat;
+} proclock_entry_t;
+
+/// @brief The classes being listed.
+typedef struct proclock_table_t {
+    /// The number of entries.
+    size_t count;
+    /// The room in the entries.
+    size_t size;
+    /// The entries, NULL while counting the classes.
+    proclock_entry_t *entries;
+} proclock_table_t;
+
+/// @brief Counts a class, or adds it to the table.
+/// @param class the class.
+/// @param data the table.
+static void __proclock_collect(lock_class_t *class, void *data)
+{
+    proclock_table_t *table = (proclock_table_t *)data;
+    if (table->entries == NULL) {
+        ++table->size;
+        return;
+    }
+    // Classes registered after counting them are left out.
+    if (table->count == table->size) {
+        return;
+    }
+    proclock_entry_t *entry = &table->entries[table->count];
+    entry->class            = class;
+    lock_stat_sum(class, &entry->stat);
+    if (entry->stat.acquired) {
+        ++table->count;
+    }
+}
+
+/// @brief Formats a 64-bit counter, as there is no 64-bit conversion.
+/// @param buffer a buffer of at least 21 characters.
+/// @param value the counter.
+/// @return the buffer.
+static const char *__proclock_u64(char *buffer, ktime_t value)
+{
+    // Print the billions apart.
+    uint32_t low = div64_32(&value, 1000000000u);
+    if (value) {
+        sprintf(buffer, "%u%09u", (uint32_t)value, low);
+    } else {
+        sprintf(buffer, "%u", low);
+    }
+    return buffer;
+}
+
+/// @brief Writes the classes, the most contended first.
+/// @param m the sequential file.
+/// @param v the token of the table.
+/// @return 0 on success, -ENOMEM on failure.
+static int __proclock_show(seq_file_t *m, void *v)
+{
+    proclock_table_t table = { 0 };
+    lock_stat_for_each(__proclock_collect, &table);
+    if (table.size) {
+        table.entries = (proclock_entry_t *)kmalloc(table.size * sizeof(proclock_entry_t));
+        if (table.entries == NULL) {
+            return -ENOMEM;
+        }
+        lock_stat_for_each(__proclock_collect, &table);
+    }
+    // Sort by contended acquisitions, then by the time spent waiting.
+    for (size_t i = 1; i < table.count; ++i) {
+        proclock_entry_t entry = table.entries[i];
+        size_t j               = i;
+        for (; j > 0; --j) {
+            lock_stat_t *prev = &table.entries[j - 1].stat;
+            if ((prev->contended > entry.stat.contended) ||
+                ((prev->contended == entry.stat.contended) && (prev->wait_total >= entry.stat.wait_total))) {
+                break;
+            }
+            table.entries[j] = table.entries[j - 1];
+        }
+        table.entries[j] = entry;
+    }
+    char wait_total[24], wait_max[24], hold_total[24], hold_max[24];
+    seq_printf(m, "%-32s %-5s %10s %10s %14s %12s %14s %12s\n", "# class", "type", "acquired", "contended",
+               "wait-total", "wait-max", "hold-total", "hold-max");
+    for (size_t i = 0; i < table.count; ++i) {
+        proclock_entry_t *entry = &table.entries[i];
+        seq_printf(m, "%-32s %-5s %10lu %10lu %14s %12s %14s %12s\n", entry->class->name, entry->class->type,
+                   entry->stat.acquired, entry->stat.contended,
+                   __proclock_u64(wait_total, entry->stat.wait_total), __proclock_u64(wait_max, entry->stat.wait_max),
+                   __proclock_u64(hold_total, entry->stat.hold_total), __proclock_u64(hold_max, entry->stat.hold_max));
+    }
+    kfree(table.entries);
+    return 0;
+}
+
+#else
+
+/// @brief Tells that the statistics are not collected.
+/// @param m the sequential file.
+/// @param v the token of the table.
+/// @return 0.
+static int __proclock_show(seq_file_t *m, void *v)
+{
+    seq_printf(m, "The kernel was built without ENABLE_LOCK_STAT.\n");
+    return 0;
+}
+
+#endif
+
+/// Iterator for `/proc/lock_stat`.
+static const seq_operations_t proclock_seq_operations = {
+    .start = __proclock_start,
+    .next  = __proclock_next,
+    .stop  = __proclock_stop,
+    .show  = __proclock_show,
+};
+
+static ssize_t __proclock_read(vfs_file_t *file, char *buf, off_t offset, size_t nbyte)
+{
+    if (!file) {
+        pr_err("We received a NULL file pointer.\n");
+        return -EFAULT;
+    }
+    if (file->private_data == NULL) {
+        int ret = seq_open(file, &proclock_seq_operations, NULL);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    return seq_read(file, buf, offset, nbyte);
+}
+
+/// @brief Clears the statistics, whatever is written.
+/// @param file the file.
+/// @param buf ignored.
+/// @param offset ignored.
+/// @param nbyte the length of the text.
+/// @return nbyte.
+static ssize_t __proclock_write(vfs_file_t *file, const void *buf, off_t offset, size_t nbyte)
+{
+#ifdef ENABLE_LOCK_STAT
+    lock_stat_reset();
+#endif
+    return nbyte;
+}
+
+/// Filesystem general operations.
+static vfs_sys_operations_t proclock_sys_operations = {
+    .mkdir_f   = NULL,
+    .rmdir_f   = NULL,
+    .stat_f    = NULL,
+    .creat_f   = NULL,
+    .symlink_f = NULL,
+};
+
+/// Filesystem file operations.
+static vfs_file_operations_t proclock_fs_operations = {
+    .open_f     = NULL,
+    .unlink_f   = NULL,
+    .close_f    = seq_release,
+    .read_f     = __proclock_read,
+    .write_f    = __proclock_write,
+    .lseek_f    = NULL,
+    .stat_f     = NULL,
+    .ioctl_f    = NULL,
+    .getdents_f = NULL,
+    .readlink_f = NULL,
+};
+
+int proclock_module_init(void)
+{
+    proc_dir_entry_t *file = proc_create_entry("lock_stat", NULL);
+    if (file == NULL) {
+        pr_err("Cannot create `/proc/lock_stat`.\n");
+        return 1;
+    }
+    pr_debug("Created `/proc/lock_stat` (%p)\n", file);
+    // Set the specific operations.
+    file->sys_operations = &proclock_sys_operations;
+    file->fs_operations  = &proclock_fs_operations;
+    return 0;
+}
@@ -0,0 +1,184 @@
+/// @file proc_profile.c
+/// @brief Contains callbacks for the procfs file of the sampling profiler.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// Writing a number of cycles to `/proc/profile` starts sampling with that
+/// period, writing 0 stops it. Reading it returns a header line, then a line
+/// for each sample, from the oldest to the newest: the pid, the address of the
+/// interrupted instruction, and `u` or `k` for user or kernel mode.
+
+#include "fs/procfs.h"
+#include "fs/seq_file.h"
+#include "hardware/pmu.h"
+#include "io/debug.h"
+#include "io/proc_modules.h"
+#include "mem/kheap.h"
+#include "stdio.h"
+#include "string.h"
+#include "sys/errno.h"
+
+/// @brief The samples, copied when the file is read from the beginning.
+typedef struct procprof_snapshot_t {
+    /// The number of samples copied.
+    size_t count;
+    /// The number of samples taken since the profiler started.
+    unsigned long total;
+    /// The samples.
+    pmu_sample_t samples[PMU_PROFILE_SAMPLES];
+} procprof_snapshot_t;
+
+/// @brief Starts the iteration: the header is the record 0, then the samples.
+/// @param m the sequential file.
+/// @param pos the position of the record.
+/// @return the record, or NULL past the last one.
+static void *__procprof_start(seq_file_t *m, size_t *pos)
+{
+    procprof_snapshot_t *snapshot = (procprof_snapshot_t *)m->private;
+    if (*pos == 0) {
+        snapshot->count = pmu_profile_snapshot(snapshot->samples, &snapshot->total);
+        return snapshot;
+    }
+    return (*pos <= snapshot->count) ? &snapshot->samples[*pos - 1] : NULL;
+}
+
+/// @brief Moves to the next sample.
+/// @param m the sequential file.
+/// @param v the current record.
+/// @param pos the position of the record.
+/// @return the next record, or NULL past the last one.
+static void *__procprof_next(seq_file_t *m, void *v, size_t *pos)
+{
+    procprof_snapshot_t *snapshot = (procprof_snapshot_t *)m->private;
+    ++(*pos);
+    return (*pos <= snapshot->count) ? &snapshot->samples[*pos - 1] : NULL;
+}
+
+/// @brief Ends the iteration over the samples.
+/// @param m the sequential file.
+/// @param v the record which was not shown.
+static void __procprof_stop(seq_file_t *m, void *v)
+{
+}
+
+/// @brief Writes the header, or a sample.
+/// @param m the sequential file.
+/// @param v the record.
+/// @return 0 on success, -ENOMEM on failure.
+static int __procprof_show(seq_file_t *m, void *v)
+{
+    if (v == m->private) {
+        procprof_snapshot_t *snapshot = (procprof_snapshot_t *)v;
+        return seq_printf(m, "# period %u samples %lu lost %lu\n", pmu_profile_period(),
+                          snapshot->total, snapshot->total - snapshot->count) < 0 ? -ENOMEM : 0;
+    }
+    pmu_sample_t *sample = (pmu_sample_t *)v;
+    return seq_printf(m, "%d 0x%08x %c\n", sample->pid, sample->eip, sample->user ? 'u' : 'k') < 0 ? -ENOMEM : 0;
+}
+
+/// Iterator for `/proc/profile`.
+static const seq_operations_t procprof_seq_operations = {
+    .start = __procprof_start,
+    .next  = __procprof_next,
+    .stop  = __procprof_stop,
+    .show  = __procprof_show,
+};
+
+static ssize_t __procprof_read(vfs_file_t *file, char *buf, off_t offset, size_t nbyte)
+{
+    if (!file) {
+        pr_err("We received a NULL file pointer.\n");
+        return -EFAULT;
+    }
+    if (file->private_data == NULL) {
+        procprof_snapshot_t *snapshot = (procprof_snapshot_t *)kmalloc(sizeof(procprof_snapshot_t));
+        if (!snapshot) {
+            return -ENOMEM;
+        }
+        snapshot->count = 0;
+        int ret         = seq_open(file, &procprof_seq_operations, snapshot);
+        if (ret < 0) {
+            kfree(snapshot);
+            return ret;
+        }
+    }
+    return seq_read(file, buf, offset, nbyte);
+}
+
+/// @brief Starts the profiler with the written period, or stops it with 0.
+/// @param file the file.
+/// @param buf the decimal period.
+/// @param offset ignored.
+/// @param nbyte the length of the text.
+/// @return nbyte on success, -errno on failure.
+static ssize_t __procprof_write(vfs_file_t *file, const void *buf, off_t offset, size_t nbyte)
+{
+    const char *text = (const char *)buf;
+    uint32_t period  = 0;
+    size_t it        = 0;
+    for (; (it < nbyte) && (text[it] >= '0') && (text[it] <= '9'); ++it) {
+        if (period > (0xFFFFFFFFu - 9) / 10) {
+            return -EINVAL;
+        }
+        period = period * 10 + (text[it] - '0');
+    }
+    // Only a trailing newline may follow the number.
+    if ((it == 0) || ((it < nbyte) && ((text[it] != '\n') || (it + 1 != nbyte)))) {
+        return -EINVAL;
+    }
+    if (period == 0) {
+        pmu_profile_stop();
+        return nbyte;
+    }
+    int ret = pmu_profile_start(period);
+    return (ret < 0) ? ret : (ssize_t)nbyte;
+}
+
+/// @brief Releases the samples copied by the reads.
+/// @param file the file.
+/// @return 0.
+static int __procprof_close(vfs_file_t *file)
+{
+    seq_file_t *m = (seq_file_t *)file->private_data;
+    if (m) {
+        kfree(m->private);
+    }
+    return seq_release(file);
+}
+
+/// Filesystem general operations.
+static vfs_sys_operations_t procprof_sys_operations = {
+    .mkdir_f   = NULL,
+    .rmdir_f   = NULL,
+    .stat_f    = NULL,
+    .creat_f   = NULL,
+    .symlink_f = NULL,
+};
+
+/// Filesystem file operations.
+static vfs_file_operations_t procprof_fs_operations = {
+    .open_f     = NULL,
+    .unlink_f   = NULL,
+    .close_f    = __procprof_close,
+    .read_f     = __procprof_read,
+    .write_f    = __procprof_write,
+    .lseek_f    = NULL,
+    .stat_f     = NULL,
+    .ioctl_f    = NULL,
+    .getdents_f = NULL,
+    .readlink_f = NULL,
+};
+
+int procprof_module_init(void)
+{
+    proc_dir_entry_t *file = proc_create_entry("profile", NULL);
+    if (file == NULL) {
+        pr_err("Cannot create `/proc/profile`.\n");
+        return 1;
+    }
+    pr_debug("Created `/proc/profile` (%p)\n", file);
+    // Set the specific operations.
+    file->sys_operations = &procprof_sys_operations;
+    file->fs_operations  = &procprof_fs_operations;
+    return 0;
+}
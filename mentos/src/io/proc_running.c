@@ -4,7 +4,9 @@
 /// See LICENSE.md for details.
 
 #include "fs/procfs.h"
+#include "fs/seq_file.h"
 
+#include "hardware/pmu.h"
 #include "io/debug.h"
 #include "libgen.h"
 #include "process/prio.h"
@@ -12,50 +14,36 @@
 #include "stdio.h"
 #include "string.h"
 #include "sys/errno.h"
+#include "sys/mman.h"
+#include "sys/vdso.h"
 
-/// @brief Returns the character identifying the process state.
-/// @details
-///     R  Running
-///     S  Sleeping in an interruptible wait
-///     D  Waiting in uninterruptible disk sleep
-///     Z  Zombie
-///     T  Stopped
-///     t  Tracing stop
-///     X  Dead
-static inline char __procr_get_task_state_char(int state)
+/// @brief Writes the data for the `/proc/<PID>/cmdline` file.
+/// @param m the sequential file of the entry.
+/// @param v the task associated with the `/proc/<PID>` folder.
+/// @return 0 on success, -errno on failure.
+static int __procr_show_cmdline(seq_file_t *m, void *v)
 {
-    if (state == 0x00) { return 'R'; }     // TASK_RUNNING
-    if (state == (1 << 0)) { return 'S'; } // TASK_INTERRUPTIBLE
-    if (state == (1 << 1)) { return 'D'; } // TASK_UNINTERRUPTIBLE
-    if (state == (1 << 2)) { return 'T'; } // TASK_STOPPED
-    if (state == (1 << 3)) { return 't'; } // TASK_TRACED
-    if (state == (1 << 4)) { return 'Z'; } // EXIT_ZOMBIE
-    if (state == (1 << 5)) { return 'X'; } // EXIT_DEAD
-    return '?';
+    task_struct *task = (task_struct *)v;
+    return seq_puts(m, task->name) < 0 ? -ENOMEM : 0;
 }
 
-/// @brief Returns the data for the `/proc/<PID>/cmdline` file.
-/// @param buffer the buffer where the data should be placed.
-/// @param bufsize the size of the buffer.
-/// @param task the task associated with the `/proc/<PID>` folder.
-/// @return size of the written data in buffer.
-static inline ssize_t __procr_do_cmdline(char *buffer, size_t bufsize, task_struct *task)
-{
-    strcpy(buffer, task->name);
-    return 1;
-}
-
-/// @brief Returns the data for the `/proc/<PID>/stat` file.
-/// @param buffer the buffer where the data should be placed.
-/// @param bufsize the size of the buffer.
-/// @param task the task associated with the `/proc/<PID>` folder.
-/// @return size of the written data in buffer.
-static inline ssize_t __procr_do_stat(char *buffer, size_t bufsize, task_struct *task)
+/// @brief Writes the data for the `/proc/<PID>/stat` file.
+/// @param m the sequential file of the entry.
+/// @param v the task associated with the `/proc/<PID>` folder.
+/// @return 0 on success, -errno on failure, reported by seq_read through the
+/// overflow flag of the sequential file.
+static int __procr_show_stat(seq_file_t *m, void *v)
 {
+    task_struct *task = (task_struct *)v;
+    // Kernel threads have no memory, report it as empty.
+    static const mm_struct_t no_mm = { 0 };
+    const mm_struct_t *mm = task->mm ? task->mm : &no_mm;
+    // The resident set is not tracked, it is counted when asked for.
+    unsigned int rss = task->mm ? mem_count_resident_pages(task->mm) : 0;
     //(1) pid  %d
     //     The process ID.
     //
-    sprintf(buffer, "%d", task->pid);
+    seq_printf(m, "%d", task->pid);
     //(2) comm  %s
     //     The filename of the executable, in parentheses.
     //     Strings longer than TASK_COMM_LEN (16) characters (in‐
@@ -63,7 +51,7 @@ static inline ssize_t __procr_do_stat(char *buffer, size_t bufsize, task_struct
     //     cated.  This is visible whether or not the executable
     //     is swapped out.
     //
-    sprintf(buffer, "%s (%s)", buffer, basename(task->name));
+    seq_printf(m, " (%s)", basename(task->name));
     //(3) state  %c
     //     One of the following characters, indicating process state:
     //      R  Running
@@ -73,35 +61,35 @@ static inline ssize_t __procr_do_stat(char *buffer, size_t bufsize, task_struct
     //      T  Stopped
     //      t  Tracing stop
     //      X  Dead
-    sprintf(buffer, "%s %c", buffer, __procr_get_task_state_char(task->state));
+    seq_printf(m, " %c", proc_task_state_char(task->state));
     //(4) ppid  %d
     //     The PID of the parent of this process.
     //
     if (task->parent) {
-        sprintf(buffer, "%s %d", buffer, task->parent->pid);
+        seq_printf(m, " %d", task->parent->pid);
     } else {
-        strcat(buffer, " 0");
+        seq_puts(m, " 0");
     }
     //(5) TODO: pgrp  %d
     //      The process group ID of the process.
     //
-    strcat(buffer, " 0");
+    seq_puts(m, " 0");
     //(6) TODO: session  %d
     //      The session ID of the process.
     //
-    strcat(buffer, " 0");
+    seq_puts(m, " 0");
     //(7) TODO: tty_nr  %d
     //      The controlling terminal of the process.  (The minor
     //      device number is contained in the combination of bits
     //      31 to 20 and 7 to 0; the major device number is in bits
     //      15 to 8.)
     //
-    strcat(buffer, " 0");
+    seq_puts(m, " 0");
     //(8) TODO: tpgid  %d
     //      The ID of the foreground process group of the control‐
     //      ling terminal of the process.
     //
-    strcat(buffer, " 0");
+    seq_puts(m, " 0");
     //(9) TODO: flags  %u
     //      The kernel flags word of the process.  For bit mean‐
     //      ings, see the PF_* defines in the Linux kernel source
@@ -109,28 +97,28 @@ static inline ssize_t __procr_do_stat(char *buffer, size_t bufsize, task_struct
     //      nel version.
     //      The format for this field was %lu before Linux 2.6.
     //
-    strcat(buffer, " 0");
-    //(10) TODO: minflt  %lu
+    seq_puts(m, " 0");
+    //(10) minflt  %lu
     //      The number of minor faults the process has made which
     //      have not required loading a memory page from disk.
     //
-    strcat(buffer, " 0");
-    //(11) TODO: cminflt  %lu
+    seq_printf(m, " %lu", task->rusage.minflt);
+    //(11) cminflt  %lu
     //      The number of minor faults that the process's waited-
     //      for children have made.
     //
-    strcat(buffer, " 0");
-    //(12) TODO: majflt  %lu
+    seq_printf(m, " %lu", task->crusage.minflt);
+    //(12) majflt  %lu
     //      The number of major faults the process has made which
     //      have required loading a memory page from disk.
     //
-    strcat(buffer, " 0");
-    //(13) TODO: cmajflt  %lu
+    seq_printf(m, " %lu", task->rusage.majflt);
+    //(13) cmajflt  %lu
     //      The number of major faults that the process's waited-
     //      for children have made.
     //
-    strcat(buffer, " 0");
-    //(14) TODO: utime  %lu
+    seq_printf(m, " %lu", task->crusage.majflt);
+    //(14) utime  %lu
     //      Amount of time that this process has been scheduled in
     //      user mode, measured in clock ticks (divide by
     //      sysconf(_SC_CLK_TCK)).  This includes guest time,
@@ -139,27 +127,27 @@ static inline ssize_t __procr_do_stat(char *buffer, size_t bufsize, task_struct
     //      guest time field do not lose that time from their cal‐
     //      culations.
     //
-    strcat(buffer, " 0");
-    //(15) TODO: stime  %lu
+    seq_printf(m, " %lu", task->rusage.utime);
+    //(15) stime  %lu
     //      Amount of time that this process has been scheduled in
     //      kernel mode, measured in clock ticks (divide by
     //      sysconf(_SC_CLK_TCK)).
     //
-    strcat(buffer, " 0");
-    //(16) TODO: cutime  %ld
+    seq_printf(m, " %lu", task->rusage.stime);
+    //(16) cutime  %ld
     //      Amount of time that this process's waited-for children
     //      have been scheduled in user mode, measured in clock
     //      ticks (divide by sysconf(_SC_CLK_TCK)).  (See also
     //      times(2).)  This includes guest time, cguest_time (time
     //      spent running a virtual CPU, see below).
     //
-    strcat(buffer, " 0");
-    //(17) TODO: cstime  %ld
+    seq_printf(m, " %lu", task->crusage.utime);
+    //(17) cstime  %ld
     //      Amount of time that this process's waited-for children
     //      have been scheduled in kernel mode, measured in clock
     //      ticks (divide by sysconf(_SC_CLK_TCK)).
     //
-    strcat(buffer, " 0");
+    seq_printf(m, " %lu", task->crusage.stime);
     //(18) priority  %ld
     //      (Explanation for Linux 2.6) For processes running a
     //      real-time scheduling policy (policy below; see
@@ -175,25 +163,25 @@ static inline ssize_t __procr_do_stat(char *buffer, size_t bufsize, task_struct
     //      Before Linux 2.6, this was a scaled value based on the
     //      scheduler weighting given to this process.
     //
-    sprintf(buffer, "%s %ld", buffer, task->se.prio);
+    seq_printf(m, " %ld", task->se.prio);
     //(19) nice  %ld
     //      The nice value (see setpriority(2)), a value in the
     //      range 19 (low priority) to -20 (high priority).
     //
-    sprintf(buffer, "%s %ld", buffer, PRIO_TO_NICE(task->se.prio));
+    seq_printf(m, " %ld", PRIO_TO_NICE(task->se.prio));
     //(20) TODO: num_threads  %ld
     //      Number of threads in this process (since Linux 2.6).
     //      Before kernel 2.6, this field was hard coded to 0 as a
     //      placeholder for an earlier removed field.
     //
-    strcat(buffer, " 0");
+    seq_puts(m, " 0");
     //(21) TODO: itrealvalue  %ld
     //      The time in jiffies before the next SIGALRM is sent to
     //      the process due to an interval timer.  Since kernel
     //      2.6.17, this field is no longer maintained, and is hard
     //      coded as 0.
     //
-    strcat(buffer, " 0");
+    seq_puts(m, " 0");
     //(22) starttime  %llu
     //      The time the process started after system boot.  In
     //      kernels before Linux 2.6, this value was expressed in
@@ -202,12 +190,12 @@ static inline ssize_t __procr_do_stat(char *buffer, size_t bufsize, task_struct
     //
     //      The format for this field was %lu before Linux 2.6.
     //
-    sprintf(buffer, "%s %lu", buffer, task->se.exec_start);
+    seq_printf(m, " %lu", task->se.exec_start);
     //(23) vsize  %lu
     //      Virtual memory size in bytes.
     //
-    sprintf(buffer, "%s %lu", buffer, task->mm->total_vm);
-    //(24) TODO: rss  %ld
+    seq_printf(m, " %lu", mm->total_vm);
+    //(24) rss  %ld
     //      Resident Set Size: number of pages the process has in
     //      real memory.  This is just the pages which count toward
     //      text, data, or stack space.  This does not include
@@ -215,84 +203,84 @@ static inline ssize_t __procr_do_stat(char *buffer, size_t bufsize, task_struct
     //      are swapped out.  This value is inaccurate; see
     //      /proc/[pid]/statm below.
     //
-    strcat(buffer, " 0");
+    seq_printf(m, " %u", rss);
     //(25) TODO: rsslim  %lu
     //      Current soft limit in bytes on the rss of the process;
     //      see the description of RLIMIT_RSS in getrlimit(2).
     //
-    strcat(buffer, " 0");
+    seq_puts(m, " 0");
     //(26) startcode  %lu  [PT]
     //      The address above which program text can run.
     //
-    sprintf(buffer, "%s %lu", buffer, task->mm->start_code);
+    seq_printf(m, " %lu", mm->start_code);
     //(27) endcode  %lu  [PT]
     //      The address below which program text can run.
     //
-    sprintf(buffer, "%s %lu", buffer, task->mm->end_code);
+    seq_printf(m, " %lu", mm->end_code);
     //(28) startstack  %lu  [PT]
     //      The address of the start (i.e., bottom) of the stack.
     //
-    sprintf(buffer, "%s %lu", buffer, task->mm->start_stack);
+    seq_printf(m, " %lu", mm->start_stack);
     //(29) kstkesp  %lu  [PT]
     //      The current value of ESP (stack pointer), as found in
     //      the kernel stack page for the process.
     //
-    sprintf(buffer, "%s %lu", buffer, task->thread.regs.useresp);
+    seq_printf(m, " %lu", task->thread.regs.useresp);
     //(30) kstkeip  %lu  [PT]
     //      The current EIP (instruction pointer).
     //
-    sprintf(buffer, "%s %lu", buffer, task->thread.regs.eip);
+    seq_printf(m, " %lu", task->thread.regs.eip);
     //(31) TODO: signal  %lu
     //      The bitmap of pending signals, displayed as a decimal
     //      number.  Obsolete, because it does not provide informa‐
     //      tion on real-time signals; use /proc/[pid]/status in‐
     //      stead.
     //
-    strcat(buffer, " 0");
+    seq_puts(m, " 0");
     //(32) TODO: blocked  %lu
     //      The bitmap of blocked signals, displayed as a decimal
     //      number.  Obsolete, because it does not provide informa‐
     //      tion on real-time signals; use /proc/[pid]/status in‐
     //      stead.
     //
-    strcat(buffer, " 0");
+    seq_puts(m, " 0");
     //(33) TODO: sigignore  %lu
     //      The bitmap of ignored signals, displayed as a decimal
     //      number.  Obsolete, because it does not provide informa‐
     //      tion on real-time signals; use /proc/[pid]/status in‐
     //      stead.
     //
-    strcat(buffer, " 0");
+    seq_puts(m, " 0");
     //(34) TODO: sigcatch  %lu
     //      The bitmap of caught signals, displayed as a decimal
     //      number.  Obsolete, because it does not provide informa‐
     //      tion on real-time signals; use /proc/[pid]/status in‐
     //      stead.
     //
-    strcat(buffer, " 0");
+    seq_puts(m, " 0");
     //(35) TODO: wchan  %lu  [PT]
     //      This is the "channel" in which the process is waiting.
     //      It is the address of a location in the kernel where the
     //      process is sleeping.  The corresponding symbolic name
     //      can be found in /proc/[pid]/wchan.
     //
-    strcat(buffer, " 0");
+    seq_puts(m, " 0");
     //(36) TODO: nswap  %lu
     //      Number of pages swapped (not maintained).
     //
-    strcat(buffer, " 0");
+    seq_puts(m, " 0");
     //(37) TODO: cnswap  %lu
     //      Cumulative nswap for child processes (not maintained).
     //
-    strcat(buffer, " 0");
+    seq_puts(m, " 0");
     //(38) TODO: exit_signal  %d  (since Linux 2.1.22)
     //      Signal to be sent to parent when we die.
     //
-    strcat(buffer, " 0");
+    seq_puts(m, " 0");
     //(39) TODO: processor  %d  (since Linux 2.2.8)
     //      CPU number last executed on.
     //
-    strcat(buffer, " 0");
+    seq_puts(m, " 0");
     //(40) TODO: rt_priority  %u  (since Linux 2.5.19)
     //      Real-time scheduling priority, a number in the range 1
     //      to 99 for processes scheduled under a real-time policy,
@@ -300,72 +288,254 @@ static inline ssize_t __procr_do_stat(char *buffer, size_t bufsize, task_struct
     //      sched_setscheduler(2)).
     //
     if (task->se.prio >= 100) {
-        strcat(buffer, " 0");
+        seq_puts(m, " 0");
     } else {
-        sprintf(buffer, "%s %u", buffer, task->se.prio);
+        seq_printf(m, " %u", task->se.prio);
     }
-    //(41) TODO: policy  %u  (since Linux 2.5.19)
+    //(41) policy  %u  (since Linux 2.5.19)
     //      Scheduling policy (see sched_setscheduler(2)).  Decode
     //      using the SCHED_* constants in linux/sched.h.
     //      The format for this field was %lu before Linux 2.6.22.
     //
-    strcat(buffer, " 0");
+    seq_printf(m, " %u", task->se.policy);
     //(42) TODO: delayacct_blkio_ticks  %llu  (since Linux 2.6.18)
     //      Aggregated block I/O delays, measured in clock ticks
     //      (centiseconds).
     //
-    strcat(buffer, " 0");
+    seq_puts(m, " 0");
     //(43) TODO: guest_time  %lu  (since Linux 2.6.24)
     //      Guest time of the process (time spent running a virtual
     //      CPU for a guest operating system), measured in clock
     //      ticks (divide by sysconf(_SC_CLK_TCK)).
     //
-    strcat(buffer, " 0");
+    seq_puts(m, " 0");
     //(44) TODO: cguest_time  %ld  (since Linux 2.6.24)
     //      Guest time of the process's children, measured in clock
     //      ticks (divide by sysconf(_SC_CLK_TCK)).
     //
-    strcat(buffer, " 0");
+    seq_puts(m, " 0");
     //(45) start_data  %lu  (since Linux 3.3)  [PT]
     //      Address above which program initialized and uninitial‐
     //      ized (BSS) data are placed.
     //
-    sprintf(buffer, "%s %lu", buffer, task->mm->start_data);
+    seq_printf(m, " %lu", mm->start_data);
     //(46) end_data  %lu  (since Linux 3.3)  [PT]
     //      Address below which program initialized and uninitial‐
     //      ized (BSS) data are placed.
     //
-    sprintf(buffer, "%s %lu", buffer, task->mm->end_data);
+    seq_printf(m, " %lu", mm->end_data);
     //(47) start_brk  %lu  (since Linux 3.3)  [PT]
     //      Address above which program heap can be expanded with
     //      brk(2).
     //
-    sprintf(buffer, "%s %lu", buffer, task->mm->start_brk);
+    seq_printf(m, " %lu", mm->start_brk);
     //(48) arg_start  %lu  (since Linux 3.5)  [PT]
     //      Address above which program command-line arguments
     //      (argv) are placed.
     //
-    sprintf(buffer, "%s %lu", buffer, task->mm->arg_start);
+    seq_printf(m, " %lu", mm->arg_start);
     //(49) arg_end  %lu  (since Linux 3.5)  [PT]
     //      Address below program command-line arguments (argv) are
     //      placed.
     //
-    sprintf(buffer, "%s %lu", buffer, task->mm->arg_end);
+    seq_printf(m, " %lu", mm->arg_end);
     //(50) env_start  %lu  (since Linux 3.5)  [PT]
     //      Address above which program environment is placed.
     //
-    sprintf(buffer, "%s %lu", buffer, task->mm->env_start);
+    seq_printf(m, " %lu", mm->env_start);
     //(51) env_end  %lu  (since Linux 3.5)  [PT]
     //      Address below which program environment is placed.
     //
-    sprintf(buffer, "%s %lu", buffer, task->mm->env_end);
+    seq_printf(m, " %lu", mm->env_end);
     //(52) exit_code  %d  (since Linux 3.5)  [PT]
     //      The thread's exit status in the form reported by
     //      waitpid(2).
-    sprintf(buffer, "%s %d\n", buffer, task->exit_code);
-    return 1;
+    seq_printf(m, " %d\n", task->exit_code);
+    return 0;
+}
+
+/// @brief Writes the data for the `/proc/<PID>/pmu` file: a line for each
+/// event of the performance counters, with its name and count. The events the
+/// CPU cannot count are missing.
+/// @param m the sequential file of the entry.
+/// @param v the task associated with the `/proc/<PID>` folder.
+/// @return 0 on success, -errno on failure.
+static int __procr_show_pmu(seq_file_t *m, void *v)
+{
+    static const char *names[PMU_EVENT_NUM] = {
+        [PMU_CYCLES]       = "cycles",
+        [PMU_INSTRUCTIONS] = "instructions",
+        [PMU_LLC_MISSES]   = "llc_misses",
+    };
+    task_struct *task = (task_struct *)v;
+    for (unsigned event = 0; event < PMU_EVENT_NUM; ++event) {
+        if (!pmu_event_available(event)) {
+            continue;
+        }
+        // There is no 64-bit conversion, print the billions apart.
+        ktime_t count = pmu_task_count(task, event);
+        uint32_t low  = div64_32(&count, 1000000000u);
+        if (count) {
+            seq_printf(m, "%s %u%09u\n", names[event], (uint32_t)count, low);
+        } else {
+            seq_printf(m, "%s %u\n", names[event], low);
+        }
+    }
+    return 0;
+}
+
+/// @brief Writes the line describing a memory area, shared by `maps` and `smaps`.
+/// @param m the sequential file of the entry.
+/// @param area the memory area.
+static void __procr_show_area(seq_file_t *m, vm_area_struct_t *area)
+{
+    mm_struct_t *mm = area->vm_mm;
+    // Anonymous memory is always writable, and without PAE nothing can be
+    // made not executable.
+    int prot = (area->vm_file || area->vm_ops) ? area->vm_page_prot : (PROT_READ | PROT_WRITE | PROT_EXEC);
+    seq_printf(m, "%08x-%08x %c%c%c%c %08x 00:00 %-10u", area->vm_start, area->vm_end,
+               (prot & PROT_READ) ? 'r' : '-', (prot & PROT_WRITE) ? 'w' : '-',
+               (prot & PROT_EXEC) ? 'x' : '-', (area->vm_flags & MAP_SHARED) ? 's' : 'p',
+               area->vm_pgoff * PAGE_SIZE, area->vm_file ? area->vm_file->ino : 0);
+    if (area->vm_file) {
+        seq_printf(m, " %s", area->vm_file->name);
+    } else if (area->vm_ops) {
+        seq_puts(m, " [shm]");
+    } else if (area->vm_start == VDSO_ADDRESS) {
+        seq_puts(m, " [vdso]");
+    } else if ((mm->start_stack >= area->vm_start) && (mm->start_stack <= area->vm_end)) {
+        seq_puts(m, " [stack]");
+    } else if ((mm->start_brk >= area->vm_start) && (mm->start_brk < area->vm_end)) {
+        seq_puts(m, " [heap]");
+    }
+    seq_puts(m, "\n");
+}
+
+/// @brief Writes the data for the `/proc/<PID>/maps` file, a line for each
+/// memory area, sorted by address.
+/// @param m the sequential file of the entry.
+/// @param v the task associated with the `/proc/<PID>` folder.
+/// @return 0 on success, -errno on failure.
+static int __procr_show_maps(seq_file_t *m, void *v)
+{
+    task_struct *task = (task_struct *)v;
+    // Kernel threads have no memory.
+    if (task->mm == NULL) {
+        return 0;
+    }
+    list_for_each_decl(it, &task->mm->mmap_list)
+    {
+        __procr_show_area(m, list_entry(it, vm_area_struct_t, vm_list));
+    }
+    return 0;
 }
 
+/// @brief Writes the data for the `/proc/<PID>/smaps` file, the lines of
+/// `maps` each followed by the pages of the area present in memory.
+/// @param m the sequential file of the entry.
+/// @param v the task associated with the `/proc/<PID>` folder.
+/// @return 0 on success, -errno on failure.
+static int __procr_show_smaps(seq_file_t *m, void *v)
+{
+    task_struct *task = (task_struct *)v;
+    vm_area_usage_t usage;
+    // Kernel threads have no memory.
+    if (task->mm == NULL) {
+        return 0;
+    }
+    // The sizes are in kilobytes.
+    const unsigned int kb = PAGE_SIZE / K;
+    list_for_each_decl(it, &task->mm->mmap_list)
+    {
+        vm_area_struct_t *area = list_entry(it, vm_area_struct_t, vm_list);
+        mem_vm_area_usage(area, &usage);
+        __procr_show_area(m, area);
+        seq_printf(m,
+                   "Size:           %8u kB\n"
+                   "Rss:            %8u kB\n"
+                   "Shared_Clean:   %8u kB\n"
+                   "Shared_Dirty:   %8u kB\n"
+                   "Private_Clean:  %8u kB\n"
+                   "Private_Dirty:  %8u kB\n"
+                   "Cow_Shared:     %8u kB\n"
+                   "Swap:           %8u kB\n"
+                   "Locked:         %8u kB\n",
+                   (area->vm_end - area->vm_start) / K, usage.resident * kb,
+                   usage.shared_clean * kb, usage.shared_dirty * kb,
+                   usage.private_clean * kb, usage.private_dirty * kb,
+                   usage.cow * kb, usage.swap * kb, (area->vm_hints & VM_LOCKED) ? usage.resident * kb : 0);
+    }
+    return 0;
+}
+
+/// @brief Starts the iteration over the records of a `/proc/<PID>/` file,
+/// which has a single one: the task.
+/// @param m the sequential file.
+/// @param pos the position of the record.
+/// @return the task, or NULL past it.
+static void *__procr_seq_start(seq_file_t *m, size_t *pos)
+{
+    return (*pos == 0) ? m->private : NULL;
+}
+
+/// @brief Moves past the only record of a `/proc/<PID>/` file.
+/// @param m the sequential file.
+/// @param v the current record.
+/// @param pos the position of the record.
+/// @return NULL.
+static void *__procr_seq_next(seq_file_t *m, void *v, size_t *pos)
+{
+    ++(*pos);
+    return NULL;
+}
+
+/// @brief Ends the iteration over the records of a `/proc/<PID>/` file.
+/// @param m the sequential file.
+/// @param v the record which was not shown.
+static void __procr_seq_stop(seq_file_t *m, void *v)
+{
+}
+
+/// Iterator for `/proc/<PID>/cmdline`.
+static const seq_operations_t procr_cmdline_seq_operations = {
+    .start = __procr_seq_start,
+    .next  = __procr_seq_next,
+    .stop  = __procr_seq_stop,
+    .show  = __procr_show_cmdline,
+};
+
+/// Iterator for `/proc/<PID>/pmu`.
+static const seq_operations_t procr_pmu_seq_operations = {
+    .start = __procr_seq_start,
+    .next  = __procr_seq_next,
+    .stop  = __procr_seq_stop,
+    .show  = __procr_show_pmu,
+};
+
+/// Iterator for `/proc/<PID>/maps`.
+static const seq_operations_t procr_maps_seq_operations = {
+    .start = __procr_seq_start,
+    .next  = __procr_seq_next,
+    .stop  = __procr_seq_stop,
+    .show  = __procr_show_maps,
+};
+
+/// Iterator for `/proc/<PID>/smaps`.
+static const seq_operations_t procr_smaps_seq_operations = {
+    .start = __procr_seq_start,
+    .next  = __procr_seq_next,
+    .stop  = __procr_seq_stop,
+    .show  = __procr_show_smaps,
+};
+
+/// Iterator for `/proc/<PID>/stat`.
+static const seq_operations_t procr_stat_seq_operations = {
+    .start = __procr_seq_start,
+    .next  = __procr_seq_next,
+    .stop  = __procr_seq_stop,
+    .show  = __procr_show_stat,
+};
+
 /// @brief Performs a read of files inside the `/proc/<PID>/` folder.
 /// @param file is the `/proc/<PID>/` folder, thus, it should be a `proc_dir_entry_t` data.
 /// @param buffer buffer where the read content must be placed.
@@ -377,32 +547,33 @@ static inline ssize_t __procr_read(vfs_file_t *file, char *buffer, off_t offset,
     if (file == NULL) {
         return -EFAULT;
     }
-    // Get the entry.
-    proc_dir_entry_t *entry = (proc_dir_entry_t *)file->device;
-    if (entry == NULL) {
-        return -EFAULT;
-    }
-    // Get the task.
-    task_struct *task = (task_struct *)entry->data;
-    if (task == NULL) {
-        return -EFAULT;
-    }
-    // Prepare a support buffer.
-    char support[BUFSIZ];
-    memset(support, 0, BUFSIZ);
-    // Call the specific function.
-    if (strcmp(entry->name, "cmdline") == 0) {
-        __procr_do_cmdline(support, BUFSIZ, task);
-    } else if (strcmp(entry->name, "stat") == 0) {
-        __procr_do_stat(support, BUFSIZ, task);
-    }
-    // Copmute the amounts of bytes we want (and can) read.
-    ssize_t bytes_to_read = max(0, min(strlen(support) - offset, nbyte));
-    // Perform the read.
-    if (bytes_to_read > 0) {
-        memcpy(buffer, support + offset, bytes_to_read);
+    // The first read attaches the generator of the entry to the open file.
+    if (file->private_data == NULL) {
+        // Get the entry.
+        proc_dir_entry_t *entry = (proc_dir_entry_t *)file->device;
+        if ((entry == NULL) || (entry->data == NULL)) {
+            return -EFAULT;
+        }
+        const seq_operations_t *op;
+        if (strcmp(entry->name, "cmdline") == 0) {
+            op = &procr_cmdline_seq_operations;
+        } else if (strcmp(entry->name, "stat") == 0) {
+            op = &procr_stat_seq_operations;
+        } else if (strcmp(entry->name, "pmu") == 0) {
+            op = &procr_pmu_seq_operations;
+        } else if (strcmp(entry->name, "maps") == 0) {
+            op = &procr_maps_seq_operations;
+        } else if (strcmp(entry->name, "smaps") == 0) {
+            op = &procr_smaps_seq_operations;
+        } else {
+            return 0;
+        }
+        int ret = seq_open(file, op, entry->data);
+        if (ret < 0) {
+            return ret;
+        }
     }
-    return bytes_to_read;
+    return seq_read(file, buffer, offset, nbyte);
 }
 
 /// Filesystem general operations.
@@ -418,7 +589,7 @@ static vfs_sys_operations_t procr_sys_operations = {
 static vfs_file_operations_t procr_fs_operations = {
     .open_f     = NULL,
     .unlink_f   = NULL,
-    .close_f    = NULL,
+    .close_f    = seq_release,
     .read_f     = __procr_read,
     .write_f    = NULL,
     .lseek_f    = NULL,
@@ -462,6 +633,36 @@ int procr_create_entry_pid(task_struct *entry)
         proc_entry->fs_operations  = &procr_fs_operations;
         proc_entry->data           = entry;
     }
+    {
+        // Create `/proc/[PID]/pmu`.
+        if ((proc_entry = proc_create_entry("pmu", proc_dir)) == NULL) {
+            pr_err("[task: %d] Cannot create proc entry `%s`.\n", entry->pid, path);
+            return -ENOENT;
+        }
+        proc_entry->sys_operations = &procr_sys_operations;
+        proc_entry->fs_operations  = &procr_fs_operations;
+        proc_entry->data           = entry;
+    }
+    {
+        // Create `/proc/[PID]/maps`.
+        if ((proc_entry = proc_create_entry("maps", proc_dir)) == NULL) {
+            pr_err("[task: %d] Cannot create proc entry `%s`.\n", entry->pid, path);
+            return -ENOENT;
+        }
+        proc_entry->sys_operations = &procr_sys_operations;
+        proc_entry->fs_operations  = &procr_fs_operations;
+        proc_entry->data           = entry;
+    }
+    {
+        // Create `/proc/[PID]/smaps`.
+        if ((proc_entry = proc_create_entry("smaps", proc_dir)) == NULL) {
+            pr_err("[task: %d] Cannot create proc entry `%s`.\n", entry->pid, path);
+            return -ENOENT;
+        }
+        proc_entry->sys_operations = &procr_sys_operations;
+        proc_entry->fs_operations  = &procr_fs_operations;
+        proc_entry->data           = entry;
+    }
     return 0;
 }
 
@@ -486,6 +687,21 @@ int procr_destroy_entry_pid(task_struct *entry)
         pr_err("[task: %d] Cannot destroy proc stat.\n", entry->pid);
         return -ENOENT;
     }
+    // Destroy `/proc/[PID]/pmu`.
+    if (proc_destroy_entry("pmu", proc_dir)) {
+        pr_err("[task: %d] Cannot destroy proc pmu.\n", entry->pid);
+        return -ENOENT;
+    }
+    // Destroy `/proc/[PID]/maps`.
+    if (proc_destroy_entry("maps", proc_dir)) {
+        pr_err("[task: %d] Cannot destroy proc maps.\n", entry->pid);
+        return -ENOENT;
+    }
+    // Destroy `/proc/[PID]/smaps`.
+    if (proc_destroy_entry("smaps", proc_dir)) {
+        pr_err("[task: %d] Cannot destroy proc smaps.\n", entry->pid);
+        return -ENOENT;
+    }
     // Destroy `/proc/[PID]`.
     if (proc_rmdir(pid_str, NULL)) {
         pr_err("[task: %d] Cannot remove proc root directory `%s`.\n", entry->pid, pid_str);
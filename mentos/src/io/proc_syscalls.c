@@ -0,0 +1,130 @@
+/// @file proc_syscalls.c
+/// @brief Contains callbacks for the procfs file with the statistics of the
+/// system calls.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include "fs/procfs.h"
+#include "hardware/hrtimer.h"
+#include "io/debug.h"
+#include "io/proc_modules.h"
+#include "math.h"
+#include "mem/kheap.h"
+#include "stdio.h"
+#include "string.h"
+#include "sys/errno.h"
+#include "system/syscall.h"
+
+#ifdef ENABLE_SYSCALL_STAT
+
+/// The space needed by a line of the file.
+#define PROCSC_LINE_SIZE (32 + 12 * SYSCALL_STAT_BUCKETS)
+
+/// @brief Writes the statistics, a line for each system call which was called.
+/// @param buffer the buffer, of (SYSCALL_NUMBER + 1) * PROCSC_LINE_SIZE bytes.
+/// @return the length of the content.
+static size_t __procsc_do_syscalls(char *buffer)
+{
+    syscall_stat_t stat;
+    char label[16];
+    char *it = buffer;
+    // The header, with the upper bound, in cycles, of each bucket.
+    it += sprintf(it, "%-4s %10s %10s", "nr", "count", "avg");
+    for (unsigned int bucket = 0; bucket < SYSCALL_STAT_BUCKETS; ++bucket) {
+        if (bucket == SYSCALL_STAT_BUCKETS - 1) {
+            sprintf(label, ">=2^%u", bucket + SYSCALL_STAT_MIN_SHIFT - 1);
+        } else {
+            sprintf(label, "<2^%u", bucket + SYSCALL_STAT_MIN_SHIFT);
+        }
+        it += sprintf(it, " %11s", label);
+    }
+    it += sprintf(it, "\n");
+    for (unsigned int nr = 0; nr < SYSCALL_NUMBER; ++nr) {
+        syscall_stat_get(nr, &stat);
+        if (stat.count == 0) {
+            continue;
+        }
+        // The average fits 32 bits, as each sample does.
+        ktime_t avg = stat.cycles;
+        div64_32(&avg, stat.count);
+        it += sprintf(it, "%-4u %10lu %10u", nr, stat.count, (uint32_t)avg);
+        for (unsigned int bucket = 0; bucket < SYSCALL_STAT_BUCKETS; ++bucket) {
+            it += sprintf(it, " %11lu", stat.hist[bucket]);
+        }
+        it += sprintf(it, "\n");
+    }
+    return it - buffer;
+}
+
+#else
+
+/// The space needed by a line of the file.
+#define PROCSC_LINE_SIZE 2
+
+/// @brief Tells that the statistics are not collected.
+/// @param buffer the buffer, of (SYSCALL_NUMBER + 1) * PROCSC_LINE_SIZE bytes.
+/// @return the length of the content.
+static size_t __procsc_do_syscalls(char *buffer)
+{
+    return sprintf(buffer, "The kernel was built without ENABLE_SYSCALL_STAT.\n");
+}
+
+#endif
+
+static ssize_t __procsc_read(vfs_file_t *file, char *buf, off_t offset, size_t nbyte)
+{
+    if (!file) {
+        pr_err("We received a NULL file pointer.\n");
+        return -EFAULT;
+    }
+    // The file is too big for the stack.
+    char *buffer = kmalloc((SYSCALL_NUMBER + 1) * PROCSC_LINE_SIZE);
+    if (!buffer) {
+        return -ENOMEM;
+    }
+    size_t length = __procsc_do_syscalls(buffer);
+    ssize_t it    = 0;
+    if ((offset >= 0) && ((size_t)offset < length)) {
+        it = min(nbyte, length - offset);
+        memcpy(buf, buffer + offset, it);
+    }
+    kfree(buffer);
+    return it;
+}
+
+/// Filesystem general operations.
+static vfs_sys_operations_t procsc_sys_operations = {
+    .mkdir_f   = NULL,
+    .rmdir_f   = NULL,
+    .stat_f    = NULL,
+    .creat_f   = NULL,
+    .symlink_f = NULL,
+};
+
+/// Filesystem file operations.
+static vfs_file_operations_t procsc_fs_operations = {
+    .open_f     = NULL,
+    .unlink_f   = NULL,
+    .close_f    = NULL,
+    .read_f     = __procsc_read,
+    .write_f    = NULL,
+    .lseek_f    = NULL,
+    .stat_f     = NULL,
+    .ioctl_f    = NULL,
+    .getdents_f = NULL,
+    .readlink_f = NULL,
+};
+
+int procsc_module_init(void)
+{
+    proc_dir_entry_t *file = proc_create_entry("syscalls", NULL);
+    if (file == NULL) {
+        pr_err("Cannot create `/proc/syscalls`.\n");
+        return 1;
+    }
+    pr_debug("Created `/proc/syscalls` (%p)\n", file);
+    // Set the specific operations.
+    file->sys_operations = &procsc_sys_operations;
+    file->fs_operations  = &procsc_fs_operations;
+    return 0;
+}
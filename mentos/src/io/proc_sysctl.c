@@ -0,0 +1,209 @@
+/// @file proc_sysctl.c
+/// @brief Contains callbacks for the tunables under `/proc/sys`.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// Each file holds a single unsigned number: reading it returns the current
+/// value, writing a number changes it, provided it is inside the range of the
+/// tunable (-EINVAL otherwise). The changes take effect right away.
+
+#include "fs/buffer_cache.h"
+#include "fs/ext2.h"
+#include "fs/procfs.h"
+#include "io/debug.h"
+#include "io/proc_modules.h"
+#include "mem/slab.h"
+#include "mem/zone_allocator.h"
+#include "process/scheduler.h"
+#include "stdio.h"
+#include "string.h"
+#include "sys/errno.h"
+#include "sys/kernel_levels.h"
+
+/// @brief A tunable exposed under `/proc/sys`.
+typedef struct sysctl_t {
+    /// The directory, inside `/proc/sys`.
+    const char *dir;
+    /// The name of the file.
+    const char *name;
+    /// Where the value is stored, NULL if it is read with get.
+    unsigned *value;
+    /// The minimum value.
+    unsigned min;
+    /// The maximum value.
+    unsigned max;
+    /// Reads the value, when it is not stored in a variable.
+    unsigned (*get)(void);
+    /// Changes the value, when the subsystem must know, returns 0 on success,
+    /// -errno on failure.
+    int (*set)(unsigned value);
+} sysctl_t;
+
+/// @brief Reads the maximum level of the messages on the debug port.
+/// @return the level.
+static unsigned __procsysctl_get_loglevel(void)
+{
+    return (unsigned)get_log_level();
+}
+
+/// @brief Sets the maximum level of the messages on the debug port.
+/// @param value the level.
+/// @return 0.
+static int __procsysctl_set_loglevel(unsigned value)
+{
+    set_log_level((int)value);
+    return 0;
+}
+
+/// @brief Sets the high watermark of the page frame caches.
+/// @param value the number of pages.
+/// @return 0 on success, -EINVAL if it is lower than the batch.
+static int __procsysctl_set_pcp_high(unsigned value)
+{
+    return zone_set_pcp_watermarks(value, zone_pcp_batch);
+}
+
+/// @brief Sets the batch of the page frame caches.
+/// @param value the number of pages.
+/// @return 0 on success, -EINVAL if it is higher than the high watermark.
+static int __procsysctl_set_pcp_batch(unsigned value)
+{
+    return zone_set_pcp_watermarks(zone_pcp_high, value);
+}
+
+/// @brief The tunables.
+static const sysctl_t sysctl_table[] = {
+    { "kernel", "sched_rr_timeslice", &sched_rr_timeslice, 1, 1000, NULL, NULL },
+    { "kernel", "sched_latency", &sched_latency, 1, 1000, NULL, NULL },
+    { "kernel", "sched_min_granularity", &sched_min_granularity, 1, 1000, NULL, NULL },
+    { "kernel", "sched_wakeup_granularity", &sched_wakeup_granularity, 0, 1000, NULL, NULL },
+    { "kernel", "loglevel", NULL, LOGLEVEL_EMERG, LOGLEVEL_DEBUG, __procsysctl_get_loglevel, __procsysctl_set_loglevel },
+    { "vm", "dirty_writeback_centisecs", &buffer_dirty_writeback_centisecs, 1, 360000, NULL, NULL },
+    { "vm", "dirty_ratio", &buffer_dirty_ratio, 1, 100, NULL, NULL },
+    { "vm", "buffer_cache_max", &buffer_cache_max_buffers, 16, 65536, NULL, NULL },
+    { "vm", "slab_magazine", &kmem_magazine_limit, 1, KMEM_MAGAZINE_SIZE, NULL, NULL },
+    { "vm", "percpu_pagelist_high", &zone_pcp_high, 1, 4096, NULL, __procsysctl_set_pcp_high },
+    { "vm", "percpu_pagelist_batch", &zone_pcp_batch, 1, 4096, NULL, __procsysctl_set_pcp_batch },
+    { "fs", "read_ahead_max", &ext2_read_ahead_max, 0, 256, NULL, NULL },
+};
+
+/// @brief Returns the tunable of the file.
+/// @param file the file.
+/// @return the tunable, NULL if the file is not a tunable.
+static inline const sysctl_t *__procsysctl_get(vfs_file_t *file)
+{
+    proc_dir_entry_t *entry = (file) ? (proc_dir_entry_t *)file->device : NULL;
+    return (entry) ? (const sysctl_t *)entry->data : NULL;
+}
+
+/// @brief Reads the value of a tunable.
+/// @param file the file.
+/// @param buf the buffer.
+/// @param offset the offset.
+/// @param nbyte the size of the buffer.
+/// @return the number of bytes read, or -errno.
+static ssize_t procsysctl_read(vfs_file_t *file, char *buf, off_t offset, size_t nbyte)
+{
+    const sysctl_t *sysctl = __procsysctl_get(file);
+    if (sysctl == NULL) {
+        pr_err("The file is not a valid tunable.\n");
+        return -EFAULT;
+    }
+    char buffer[16];
+    unsigned value = sysctl->get ? sysctl->get() : *sysctl->value;
+    size_t length  = sprintf(buffer, "%u\n", value);
+    if ((offset < 0) || ((size_t)offset >= length)) {
+        return 0;
+    }
+    nbyte = (nbyte < length - offset) ? nbyte : length - offset;
+    memcpy(buf, buffer + offset, nbyte);
+    return nbyte;
+}
+
+/// @brief Changes the value of a tunable.
+/// @param file the file.
+/// @param buf the new value, in decimal, optionally followed by a newline.
+/// @param offset ignored.
+/// @param nbyte the length of the text.
+/// @return nbyte on success, -EINVAL if the value is not a number, or it is
+/// out of range.
+static ssize_t procsysctl_write(vfs_file_t *file, const void *buf, off_t offset, size_t nbyte)
+{
+    const sysctl_t *sysctl = __procsysctl_get(file);
+    if (sysctl == NULL) {
+        pr_err("The file is not a valid tunable.\n");
+        return -EFAULT;
+    }
+    const char *text = (const char *)buf;
+    unsigned value   = 0;
+    size_t it        = 0;
+    for (; (it < nbyte) && (text[it] >= '0') && (text[it] <= '9'); ++it) {
+        // Stop before it can overflow, the maximum is far from it.
+        if ((value = (value * 10) + (text[it] - '0')) > sysctl->max) {
+            return -EINVAL;
+        }
+    }
+    if ((it == 0) || ((it < nbyte) && (text[it] != '\n')) || (value < sysctl->min)) {
+        return -EINVAL;
+    }
+    if (sysctl->set) {
+        int ret = sysctl->set(value);
+        if (ret < 0) {
+            return ret;
+        }
+    } else {
+        *sysctl->value = value;
+    }
+    pr_notice("sys/%s/%s = %u\n", sysctl->dir, sysctl->name, value);
+    return nbyte;
+}
+
+/// Filesystem general operations.
+static vfs_sys_operations_t procsysctl_sys_operations = {
+    .mkdir_f   = NULL,
+    .rmdir_f   = NULL,
+    .stat_f    = NULL,
+    .creat_f   = NULL,
+    .symlink_f = NULL,
+};
+
+/// Filesystem file operations.
+static vfs_file_operations_t procsysctl_fs_operations = {
+    .open_f     = NULL,
+    .unlink_f   = NULL,
+    .close_f    = NULL,
+    .read_f     = procsysctl_read,
+    .write_f    = procsysctl_write,
+    .lseek_f    = NULL,
+    .stat_f     = NULL,
+    .ioctl_f    = NULL,
+    .getdents_f = NULL,
+    .readlink_f = NULL,
+};
+
+int procsysctl_module_init(void)
+{
+    proc_dir_entry_t *sys, *folder = NULL, *entry;
+    if ((sys = proc_mkdir("sys", NULL)) == NULL) {
+        pr_err("Cannot create the `/proc/sys` directory.\n");
+        return 1;
+    }
+    for (unsigned i = 0; i < count_of(sysctl_table); ++i) {
+        const sysctl_t *sysctl = &sysctl_table[i];
+        // The tunables of the same directory are next to each other.
+        if ((i == 0) || strcmp(sysctl->dir, sysctl_table[i - 1].dir)) {
+            if ((folder = proc_mkdir(sysctl->dir, sys)) == NULL) {
+                pr_err("Cannot create the `/proc/sys/%s` directory.\n", sysctl->dir);
+                return 1;
+            }
+        }
+        if ((entry = proc_create_entry(sysctl->name, folder)) == NULL) {
+            pr_err("Cannot create the `/proc/sys/%s/%s` file.\n", sysctl->dir, sysctl->name);
+            return 1;
+        }
+        entry->sys_operations = &procsysctl_sys_operations;
+        entry->fs_operations  = &procsysctl_fs_operations;
+        entry->data           = (void *)sysctl;
+    }
+    return 0;
+}
@@ -4,12 +4,20 @@
 /// See LICENSE.md for details.
 
 #include "fs/procfs.h"
+#include "fs/seq_file.h"
+#include "hardware/smp.h"
 #include "hardware/timer.h"
 #include "io/debug.h"
+#include "libgen.h"
+#include "mem/slab.h"
+#include "mem/zone_allocator.h"
 #include "process/process.h"
+#include "process/scheduler.h"
 #include "stdio.h"
 #include "string.h"
 #include "sys/errno.h"
+#include "sys/tasks.h"
+#include "system/printk.h"
 #include "version.h"
 
 static ssize_t procs_do_uptime(char *buffer, size_t bufsize);
@@ -24,6 +32,10 @@ static ssize_t procs_do_meminfo(char *buffer, size_t bufsize);
 
 static ssize_t procs_do_stat(char *buffer, size_t bufsize);
 
+static ssize_t procs_do_extfrag_index(char *buffer, size_t bufsize);
+
+static ssize_t procs_do_buddyinfo(char *buffer, size_t bufsize);
+
 static ssize_t __procs_read(vfs_file_t *file, char *buf, off_t offset, size_t nbyte)
 {
     if (!file) {
@@ -52,6 +64,10 @@ static ssize_t __procs_read(vfs_file_t *file, char *buf, off_t offset, size_t nb
         ret = procs_do_meminfo(buffer, BUFSIZ);
     } else if (strcmp(entry->name, "stat") == 0) {
         ret = procs_do_stat(buffer, BUFSIZ);
+    } else if (strcmp(entry->name, "extfrag_index") == 0) {
+        ret = procs_do_extfrag_index(buffer, BUFSIZ);
+    } else if (strcmp(entry->name, "buddyinfo") == 0) {
+        ret = procs_do_buddyinfo(buffer, BUFSIZ);
     }
     // Perform read.
     ssize_t it = 0;
@@ -69,6 +85,333 @@ static ssize_t __procs_read(vfs_file_t *file, char *buf, off_t offset, size_t nb
     return it;
 }
 
+/// @brief Reads the kernel messages, which do not fit the buffer of the
+/// other files.
+/// @param file the file.
+/// @param buf the buffer.
+/// @param offset the position inside the messages.
+/// @param nbyte the size of the buffer.
+/// @return the number of bytes read.
+static ssize_t __procs_kmsg_read(vfs_file_t *file, char *buf, off_t offset, size_t nbyte)
+{
+    if (!file) {
+        pr_err("We received a NULL file pointer.\n");
+        return -EFAULT;
+    }
+    return printk_read_history(buf, offset, nbyte);
+}
+
+/// @brief The records being filled by a snapshot of the tasks.
+typedef struct procs_tasks_snapshot_t {
+    /// The records.
+    task_record_t *records;
+    /// The number of records which fit the array.
+    size_t capacity;
+    /// The number of tasks met, which can exceed the capacity.
+    size_t count;
+} procs_tasks_snapshot_t;
+
+/// @brief Fills the record of a task, if there is room for it.
+/// @param process the task.
+/// @param data the snapshot.
+static void __procs_tasks_record(task_struct *process, void *data)
+{
+    procs_tasks_snapshot_t *snapshot = (procs_tasks_snapshot_t *)data;
+    if (snapshot->count < snapshot->capacity) {
+        task_record_t *record = &snapshot->records[snapshot->count];
+        memset(record, 0, sizeof(task_record_t));
+        record->pid        = process->pid;
+        record->ppid       = process->parent ? process->parent->pid : 0;
+        record->pgid       = process->pgid;
+        record->sid        = process->sid;
+        record->uid        = process->uid;
+        record->state      = proc_task_state_char(process->state);
+        record->prio       = process->se.prio;
+        record->cpu        = process->se.cpu;
+        record->vruntime   = process->se.vruntime;
+        record->runtime    = process->se.sum_exec_runtime;
+        record->utime      = process->rusage.utime;
+        record->stime      = process->rusage.stime;
+        record->start_time = process->se.start_runtime;
+        record->vm_pages   = process->mm ? process->mm->total_vm : 0;
+        strncpy(record->name, basename(process->name), TASK_RECORD_NAME_MAX - 1);
+    }
+    ++snapshot->count;
+}
+
+/// @brief Returns the only record of `/proc/tasks`, the whole snapshot.
+/// @param m the sequential file.
+/// @param pos the position of the record.
+/// @return a non-NULL token, or NULL past the snapshot.
+static void *__procs_tasks_start(seq_file_t *m, size_t *pos)
+{
+    return (*pos == 0) ? m : NULL;
+}
+
+/// @brief Moves past the snapshot.
+/// @param m the sequential file.
+/// @param v the current record.
+/// @param pos the position of the record.
+/// @return NULL.
+static void *__procs_tasks_next(seq_file_t *m, void *v, size_t *pos)
+{
+    ++(*pos);
+    return NULL;
+}
+
+/// @brief Ends the iteration over `/proc/tasks`.
+/// @param m the sequential file.
+/// @param v the record which was not shown.
+static void __procs_tasks_stop(seq_file_t *m, void *v)
+{
+}
+
+/// @brief Writes the records of all the tasks, taken at the same instant.
+/// @param m the sequential file.
+/// @param v the token of the snapshot.
+/// @return 0 on success, -ENOMEM on failure.
+static int __procs_tasks_show(seq_file_t *m, void *v)
+{
+    // The records cannot be allocated while the runqueues are locked: retry
+    // with a larger array, if tasks were created in the meantime.
+    procs_tasks_snapshot_t snapshot = { NULL, 32, 0 };
+    do {
+        if (snapshot.count > snapshot.capacity) {
+            snapshot.capacity = snapshot.count + 8;
+        }
+        if (snapshot.records) {
+            kfree(snapshot.records);
+        }
+        snapshot.records = (task_record_t *)kmalloc(snapshot.capacity * sizeof(task_record_t));
+        if (!snapshot.records) {
+            return -ENOMEM;
+        }
+        snapshot.count = 0;
+        scheduler_for_each_task(__procs_tasks_record, &snapshot);
+    } while (snapshot.count > snapshot.capacity);
+    int ret = seq_write(m, snapshot.records, snapshot.count * sizeof(task_record_t));
+    kfree(snapshot.records);
+    return (ret < 0) ? ret : 0;
+}
+
+/// Iterator for `/proc/tasks`.
+static const seq_operations_t procs_tasks_seq_operations = {
+    .start = __procs_tasks_start,
+    .next  = __procs_tasks_next,
+    .stop  = __procs_tasks_stop,
+    .show  = __procs_tasks_show,
+};
+
+/// @brief Reads the snapshot of the tasks.
+/// @param file the file.
+/// @param buf the buffer.
+/// @param offset the position inside the snapshot, zero takes a new one.
+/// @param nbyte the size of the buffer.
+/// @return the number of bytes read.
+static ssize_t __procs_tasks_read(vfs_file_t *file, char *buf, off_t offset, size_t nbyte)
+{
+    if (!file) {
+        pr_err("We received a NULL file pointer.\n");
+        return -EFAULT;
+    }
+    if (file->private_data == NULL) {
+        int ret = seq_open(file, &procs_tasks_seq_operations, NULL);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    return seq_read(file, buf, offset, nbyte);
+}
+
+/// @brief Starts the iteration over `/proc/slabinfo`.
+/// @param m the sequential file.
+/// @param pos the position of the record.
+/// @return a non-NULL token, or NULL past the table.
+static void *__procs_slabinfo_start(seq_file_t *m, size_t *pos)
+{
+    return (*pos == 0) ? m : NULL;
+}
+
+/// @brief Moves past the table.
+/// @param m the sequential file.
+/// @param v the current record.
+/// @param pos the position of the record.
+/// @return NULL.
+static void *__procs_slabinfo_next(seq_file_t *m, void *v, size_t *pos)
+{
+    ++(*pos);
+    return NULL;
+}
+
+/// @brief Ends the iteration over `/proc/slabinfo`.
+/// @param m the sequential file.
+/// @param v the record which was not shown.
+static void __procs_slabinfo_stop(seq_file_t *m, void *v)
+{
+}
+
+/// @brief Writes the line of a cache.
+/// @param cachep the cache.
+/// @param data the sequential file.
+static void __procs_slabinfo_cache(kmem_cache_t *cachep, void *data)
+{
+    seq_printf((seq_file_t *)data, "%-20s %7u %7u %7u %5u %7u %5u %5u %10lu %10lu\n",
+               cachep->name, cachep->object_size, kmem_cache_active_objects(cachep), cachep->total_num,
+               cachep->slabs_full_num, cachep->slabs_partial_num, cachep->slabs_free_num,
+               1U << cachep->gfp_order, cachep->alloc_count, cachep->free_count);
+}
+
+/// @brief Writes the counters of all the caches, kept up to date by the slab
+/// allocator, so that the lists of slabs are not walked.
+/// @param m the sequential file.
+/// @param v the token of the table.
+/// @return 0.
+static int __procs_slabinfo_show(seq_file_t *m, void *v)
+{
+    seq_printf(m, "%-20s %7s %7s %7s %5s %7s %5s %5s %10s %10s\n",
+               "# name", "objsize", "active", "total", "full", "partial", "free", "pages", "allocs", "frees");
+    kmem_cache_for_each(__procs_slabinfo_cache, m);
+    seq_printf(m, "# slab pages: %lu\n", kmem_cache_total_pages());
+    return 0;
+}
+
+/// Iterator for `/proc/slabinfo`.
+static const seq_operations_t procs_slabinfo_seq_operations = {
+    .start = __procs_slabinfo_start,
+    .next  = __procs_slabinfo_next,
+    .stop  = __procs_slabinfo_stop,
+    .show  = __procs_slabinfo_show,
+};
+
+/// @brief Reads the counters of the caches.
+/// @param file the file.
+/// @param buf the buffer.
+/// @param offset the position inside the table, zero takes a new one.
+/// @param nbyte the size of the buffer.
+/// @return the number of bytes read.
+static ssize_t __procs_slabinfo_read(vfs_file_t *file, char *buf, off_t offset, size_t nbyte)
+{
+    if (!file) {
+        pr_err("We received a NULL file pointer.\n");
+        return -EFAULT;
+    }
+    if (file->private_data == NULL) {
+        int ret = seq_open(file, &procs_slabinfo_seq_operations, NULL);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    return seq_read(file, buf, offset, nbyte);
+}
+
+/// @brief Starts the iteration over `/proc/allocinfo`.
+/// @param m the sequential file.
+/// @param pos the position of the record.
+/// @return a non-NULL token, or NULL past the table.
+static void *__procs_allocinfo_start(seq_file_t *m, size_t *pos)
+{
+    return (*pos == 0) ? m : NULL;
+}
+
+/// @brief Moves past the table.
+/// @param m the sequential file.
+/// @param v the current record.
+/// @param pos the position of the record.
+/// @return NULL.
+static void *__procs_allocinfo_next(seq_file_t *m, void *v, size_t *pos)
+{
+    ++(*pos);
+    return NULL;
+}
+
+/// @brief Ends the iteration over `/proc/allocinfo`.
+/// @param m the sequential file.
+/// @param v the record which was not shown.
+static void __procs_allocinfo_stop(seq_file_t *m, void *v)
+{
+}
+
+#if defined(ENABLE_ALLOC_TRACE) || defined(ENABLE_CACHE_TRACE)
+
+/// @brief Writes the line of a call site.
+/// @param site the call site.
+/// @param data the sequential file.
+static void __procs_allocinfo_site(const alloc_site_t *site, void *data)
+{
+    seq_printf((seq_file_t *)data, "%10lu %8lu %10lu %10lu %s:%d %s\n",
+               site->live_bytes, site->live_objects, site->allocs, site->peak_bytes,
+               site->file, site->line, site->fun);
+}
+
+/// @brief Writes the memory held by each call site.
+/// @param m the sequential file.
+/// @param v the token of the table.
+/// @return 0.
+static int __procs_allocinfo_show(seq_file_t *m, void *v)
+{
+    seq_printf(m, "%10s %8s %10s %10s %s\n", "# bytes", "objects", "allocs", "peak", "site");
+    alloc_site_for_each(__procs_allocinfo_site, m);
+    seq_printf(m, "# dropped: %lu\n", alloc_site_dropped());
+    return 0;
+}
+
+#else
+
+/// @brief Tells that the allocations are not accounted.
+/// @param m the sequential file.
+/// @param v the token of the table.
+/// @return 0.
+static int __procs_allocinfo_show(seq_file_t *m, void *v)
+{
+    seq_printf(m, "The kernel was built without ENABLE_ALLOC_TRACE.\n");
+    return 0;
+}
+
+#endif
+
+/// Iterator for `/proc/allocinfo`.
+static const seq_operations_t procs_allocinfo_seq_operations = {
+    .start = __procs_allocinfo_start,
+    .next  = __procs_allocinfo_next,
+    .stop  = __procs_allocinfo_stop,
+    .show  = __procs_allocinfo_show,
+};
+
+/// @brief Reads the memory held by each call site.
+/// @param file the file.
+/// @param buf the buffer.
+/// @param offset the position inside the table, zero takes a new one.
+/// @param nbyte the size of the buffer.
+/// @return the number of bytes read.
+static ssize_t __procs_allocinfo_read(vfs_file_t *file, char *buf, off_t offset, size_t nbyte)
+{
+    if (!file) {
+        pr_err("We received a NULL file pointer.\n");
+        return -EFAULT;
+    }
+    if (file->private_data == NULL) {
+        int ret = seq_open(file, &procs_allocinfo_seq_operations, NULL);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    return seq_read(file, buf, offset, nbyte);
+}
+
+/// @brief Restarts the counts of the allocations and the peaks, whatever is written.
+/// @param file the file.
+/// @param buf ignored.
+/// @param offset ignored.
+/// @param nbyte the length of the text.
+/// @return nbyte.
+static ssize_t __procs_allocinfo_write(vfs_file_t *file, const void *buf, off_t offset, size_t nbyte)
+{
+#if defined(ENABLE_ALLOC_TRACE) || defined(ENABLE_CACHE_TRACE)
+    alloc_site_reset();
+#endif
+    return nbyte;
+}
+
 /// Filesystem general operations.
 static vfs_sys_operations_t procs_sys_operations = {
     .mkdir_f   = NULL,
@@ -92,6 +435,62 @@ static vfs_file_operations_t procs_fs_operations = {
     .readlink_f = NULL,
 };
 
+/// Filesystem file operations of /proc/kmsg.
+static vfs_file_operations_t procs_kmsg_fs_operations = {
+    .open_f     = NULL,
+    .unlink_f   = NULL,
+    .close_f    = NULL,
+    .read_f     = __procs_kmsg_read,
+    .write_f    = NULL,
+    .lseek_f    = NULL,
+    .stat_f     = NULL,
+    .ioctl_f    = NULL,
+    .getdents_f = NULL,
+    .readlink_f = NULL,
+};
+
+/// Filesystem file operations of /proc/tasks.
+static vfs_file_operations_t procs_tasks_fs_operations = {
+    .open_f     = NULL,
+    .unlink_f   = NULL,
+    .close_f    = seq_release,
+    .read_f     = __procs_tasks_read,
+    .write_f    = NULL,
+    .lseek_f    = NULL,
+    .stat_f     = NULL,
+    .ioctl_f    = NULL,
+    .getdents_f = NULL,
+    .readlink_f = NULL,
+};
+
+/// Filesystem file operations of /proc/slabinfo.
+static vfs_file_operations_t procs_slabinfo_fs_operations = {
+    .open_f     = NULL,
+    .unlink_f   = NULL,
+    .close_f    = seq_release,
+    .read_f     = __procs_slabinfo_read,
+    .write_f    = NULL,
+    .lseek_f    = NULL,
+    .stat_f     = NULL,
+    .ioctl_f    = NULL,
+    .getdents_f = NULL,
+    .readlink_f = NULL,
+};
+
+/// Filesystem file operations of /proc/allocinfo.
+static vfs_file_operations_t procs_allocinfo_fs_operations = {
+    .open_f     = NULL,
+    .unlink_f   = NULL,
+    .close_f    = seq_release,
+    .read_f     = __procs_allocinfo_read,
+    .write_f    = __procs_allocinfo_write,
+    .lseek_f    = NULL,
+    .stat_f     = NULL,
+    .ioctl_f    = NULL,
+    .getdents_f = NULL,
+    .readlink_f = NULL,
+};
+
 int procs_module_init(void)
 {
     proc_dir_entry_t *system_entry;
@@ -154,6 +553,66 @@ int procs_module_init(void)
     // Set the specific operations.
     system_entry->sys_operations = &procs_sys_operations;
     system_entry->fs_operations  = &procs_fs_operations;
+
+    // == /proc/extfrag_index =================================================
+    if ((system_entry = proc_create_entry("extfrag_index", NULL)) == NULL) {
+        pr_err("Cannot create `/proc/extfrag_index`.\n");
+        return 1;
+    }
+    pr_debug("Created `/proc/extfrag_index` (%p)\n", system_entry);
+    // Set the specific operations.
+    system_entry->sys_operations = &procs_sys_operations;
+    system_entry->fs_operations  = &procs_fs_operations;
+
+    // == /proc/buddyinfo =====================================================
+    if ((system_entry = proc_create_entry("buddyinfo", NULL)) == NULL) {
+        pr_err("Cannot create `/proc/buddyinfo`.\n");
+        return 1;
+    }
+    pr_debug("Created `/proc/buddyinfo` (%p)\n", system_entry);
+    // Set the specific operations.
+    system_entry->sys_operations = &procs_sys_operations;
+    system_entry->fs_operations  = &procs_fs_operations;
+
+    // == /proc/slabinfo ======================================================
+    if ((system_entry = proc_create_entry("slabinfo", NULL)) == NULL) {
+        pr_err("Cannot create `/proc/slabinfo`.\n");
+        return 1;
+    }
+    pr_debug("Created `/proc/slabinfo` (%p)\n", system_entry);
+    // Set the specific operations.
+    system_entry->sys_operations = &procs_sys_operations;
+    system_entry->fs_operations  = &procs_slabinfo_fs_operations;
+
+    // == /proc/allocinfo =====================================================
+    if ((system_entry = proc_create_entry("allocinfo", NULL)) == NULL) {
+        pr_err("Cannot create `/proc/allocinfo`.\n");
+        return 1;
+    }
+    pr_debug("Created `/proc/allocinfo` (%p)\n", system_entry);
+    // Set the specific operations.
+    system_entry->sys_operations = &procs_sys_operations;
+    system_entry->fs_operations  = &procs_allocinfo_fs_operations;
+
+    // == /proc/kmsg ==========================================================
+    if ((system_entry = proc_create_entry("kmsg", NULL)) == NULL) {
+        pr_err("Cannot create `/proc/kmsg`.\n");
+        return 1;
+    }
+    pr_debug("Created `/proc/kmsg` (%p)\n", system_entry);
+    // Set the specific operations.
+    system_entry->sys_operations = &procs_sys_operations;
+    system_entry->fs_operations  = &procs_kmsg_fs_operations;
+
+    // == /proc/tasks =========================================================
+    if ((system_entry = proc_create_entry("tasks", NULL)) == NULL) {
+        pr_err("Cannot create `/proc/tasks`.\n");
+        return 1;
+    }
+    pr_debug("Created `/proc/tasks` (%p)\n", system_entry);
+    // Set the specific operations.
+    system_entry->sys_operations = &procs_sys_operations;
+    system_entry->fs_operations  = &procs_tasks_fs_operations;
     return 0;
 }
 
@@ -192,22 +651,70 @@ static ssize_t procs_do_meminfo(char *buffer, size_t bufsize)
                         get_zone_free_space(GFP_USER),
            cached_space = get_zone_cached_space(GFP_KERNEL) +
                           get_zone_cached_space(GFP_USER),
-           used_space = total_space - free_space;
+           used_space = total_space - free_space,
+           slab_space = (double)kmem_cache_total_pages() * PAGE_SIZE;
     total_space /= (double)K;
     free_space /= (double)K;
     cached_space /= (double)K;
     used_space /= (double)K;
+    slab_space /= (double)K;
     sprintf(
         buffer,
         "MemTotal : %12.2f Kb\n"
         "MemFree  : %12.2f Kb\n"
         "MemUsed  : %12.2f Kb\n"
-        "Cached   : %12.2f Kb\n",
-        total_space, free_space, used_space, cached_space);
+        "Cached   : %12.2f Kb\n"
+        "Slab     : %12.2f Kb\n",
+        total_space, free_space, used_space, cached_space, slab_space);
     return 0;
 }
 
 static ssize_t procs_do_stat(char *buffer, size_t bufsize)
 {
+    // The time spent by the CPUs, in ticks: user, nice, system, idle. The
+    // first line sums them up.
+    unsigned long user = 0, nice = 0, system = 0, idle = 0;
+    for (unsigned cpu = 0; cpu < smp_num_cpus; ++cpu) {
+        user += cpus[cpu].user_ticks;
+        nice += cpus[cpu].nice_ticks;
+        system += cpus[cpu].system_ticks;
+        idle += cpus[cpu].idle_ticks;
+    }
+    buffer += sprintf(buffer, "cpu  %lu %lu %lu %lu\n", user, nice, system, idle);
+    for (unsigned cpu = 0; cpu < smp_num_cpus; ++cpu) {
+        buffer += sprintf(buffer, "cpu%u %lu %lu %lu %lu\n", cpu,
+                          cpus[cpu].user_ticks, cpus[cpu].nice_ticks,
+                          cpus[cpu].system_ticks, cpus[cpu].idle_ticks);
+    }
+    return 0;
+}
+
+static ssize_t procs_do_extfrag_index(char *buffer, size_t bufsize)
+{
+    // One line for each zone, one column for each order.
+    gfp_t zones[] = { GFP_KERNEL, GFP_HIGHUSER };
+    const char *names[] = { "Normal", "HighMem" };
+    for (int zone = 0; zone < 2; ++zone) {
+        buffer += sprintf(buffer, "%-8s", names[zone]);
+        for (unsigned int order = 0; order < MAX_BUDDYSYSTEM_GFP_ORDER; ++order) {
+            buffer += sprintf(buffer, " %5d", get_zone_fragmentation_index(zones[zone], order));
+        }
+        buffer += sprintf(buffer, "\n");
+    }
+    return 0;
+}
+
+static ssize_t procs_do_buddyinfo(char *buffer, size_t bufsize)
+{
+    // One line for each zone, the free blocks of each order.
+    gfp_t zones[] = { GFP_KERNEL, GFP_HIGHUSER };
+    const char *names[] = { "Normal", "HighMem" };
+    for (int zone = 0; zone < 2; ++zone) {
+        buffer += sprintf(buffer, "zone %-8s", names[zone]);
+        for (unsigned int order = 0; order < MAX_BUDDYSYSTEM_GFP_ORDER; ++order) {
+            buffer += sprintf(buffer, " %6lu", get_zone_free_blocks(zones[zone], order));
+        }
+        buffer += sprintf(buffer, "\n");
+    }
     return 0;
 }
@@ -0,0 +1,247 @@
+/// @file proc_trace.c
+/// @brief Contains callbacks for the procfs files of the tracepoints.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// `/proc/trace_events` lists each event with 1 if it is enabled, 0 if not,
+/// followed by the number of records lost so far. Writing to it a list of
+/// names separated by spaces enables them, a name prefixed by `-` disables
+/// it, `all` and `none` enable and disable all the events.
+/// `/proc/trace` returns the recorded trace_record_t, see sys/trace.h.
+
+#include "fs/procfs.h"
+#include "fs/seq_file.h"
+#include "hardware/smp.h"
+#include "io/debug.h"
+#include "io/proc_modules.h"
+#include "mem/kheap.h"
+#include "stdio.h"
+#include "string.h"
+#include "sys/errno.h"
+#include "system/trace.h"
+
+/// The records overwritten before being read, since boot.
+static unsigned long proctrace_lost = 0;
+
+/// @brief Starts the iteration over a file with a single record.
+/// @param m the sequential file.
+/// @param pos the position of the record.
+/// @return a non-NULL token, or NULL past the record.
+static void *__proctrace_start(seq_file_t *m, size_t *pos)
+{
+    return (*pos == 0) ? m : NULL;
+}
+
+/// @brief Moves past the only record.
+/// @param m the sequential file.
+/// @param v the current record.
+/// @param pos the position of the record.
+/// @return NULL.
+static void *__proctrace_next(seq_file_t *m, void *v, size_t *pos)
+{
+    ++(*pos);
+    return NULL;
+}
+
+/// @brief Ends the iteration.
+/// @param m the sequential file.
+/// @param v the record which was not shown.
+static void __proctrace_stop(seq_file_t *m, void *v)
+{
+}
+
+/// @brief Moves the records of all the CPUs into the file.
+/// @param m the sequential file.
+/// @param v the token of the record.
+/// @return 0 on success, -ENOMEM on failure.
+static int __proctrace_show_trace(seq_file_t *m, void *v)
+{
+    trace_record_t *records = (trace_record_t *)kmalloc(TRACE_BUFFER_RECORDS * sizeof(trace_record_t));
+    if (!records) {
+        return -ENOMEM;
+    }
+    int ret = 0;
+    for (unsigned cpu = 0; (cpu < smp_num_cpus) && (ret >= 0); ++cpu) {
+        size_t count = trace_consume(cpu, records, &proctrace_lost);
+        if (count) {
+            ret = seq_write(m, records, count * sizeof(trace_record_t));
+        }
+    }
+    kfree(records);
+    return (ret < 0) ? ret : 0;
+}
+
+/// @brief Writes the state of the events.
+/// @param m the sequential file.
+/// @param v the token of the record.
+/// @return 0 on success, -ENOMEM on failure.
+static int __proctrace_show_events(seq_file_t *m, void *v)
+{
+    for (unsigned event = 0; event < TRACE_EVENT_NUM; ++event) {
+        seq_printf(m, "%s %d\n", trace_event_name(event), (trace_mask >> event) & 1);
+    }
+    seq_printf(m, "# lost %lu\n", proctrace_lost);
+    return 0;
+}
+
+/// Iterator for `/proc/trace`.
+static const seq_operations_t proctrace_trace_seq_operations = {
+    .start = __proctrace_start,
+    .next  = __proctrace_next,
+    .stop  = __proctrace_stop,
+    .show  = __proctrace_show_trace,
+};
+
+/// Iterator for `/proc/trace_events`.
+static const seq_operations_t proctrace_events_seq_operations = {
+    .start = __proctrace_start,
+    .next  = __proctrace_next,
+    .stop  = __proctrace_stop,
+    .show  = __proctrace_show_events,
+};
+
+/// @brief Reads `/proc/trace`, which consumes the records at offset zero.
+/// @param file the file.
+/// @param buf the buffer.
+/// @param offset the offset.
+/// @param nbyte the size of the buffer.
+/// @return the number of bytes read, or -errno.
+static ssize_t __proctrace_read_trace(vfs_file_t *file, char *buf, off_t offset, size_t nbyte)
+{
+    if (!file) {
+        pr_err("We received a NULL file pointer.\n");
+        return -EFAULT;
+    }
+    if (file->private_data == NULL) {
+        int ret = seq_open(file, &proctrace_trace_seq_operations, NULL);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    return seq_read(file, buf, offset, nbyte);
+}
+
+/// @brief Reads `/proc/trace_events`.
+/// @param file the file.
+/// @param buf the buffer.
+/// @param offset the offset.
+/// @param nbyte the size of the buffer.
+/// @return the number of bytes read, or -errno.
+static ssize_t __proctrace_read_events(vfs_file_t *file, char *buf, off_t offset, size_t nbyte)
+{
+    if (!file) {
+        pr_err("We received a NULL file pointer.\n");
+        return -EFAULT;
+    }
+    if (file->private_data == NULL) {
+        int ret = seq_open(file, &proctrace_events_seq_operations, NULL);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    return seq_read(file, buf, offset, nbyte);
+}
+
+/// @brief Enables and disables the events named in the text.
+/// @param file the file.
+/// @param buf the names, separated by spaces.
+/// @param offset ignored.
+/// @param nbyte the length of the text.
+/// @return nbyte on success, -EINVAL for an unknown name, -ENOMEM if the
+/// buffers could not be allocated.
+static ssize_t __proctrace_write_events(vfs_file_t *file, const void *buf, off_t offset, size_t nbyte)
+{
+    const char *text = (const char *)buf;
+    uint32_t mask    = trace_mask;
+    size_t it        = 0;
+    while (it < nbyte) {
+        // Skip the separators.
+        if ((text[it] == ' ') || (text[it] == '\t') || (text[it] == '\n')) {
+            ++it;
+            continue;
+        }
+        size_t start = it;
+        while ((it < nbyte) && (text[it] != ' ') && (text[it] != '\t') && (text[it] != '\n')) {
+            ++it;
+        }
+        int disable      = (text[start] == '-');
+        const char *name = text + start + disable;
+        size_t length    = it - start - disable;
+        uint32_t bits    = 0;
+        if ((length == 3) && !strncmp(name, "all", 3)) {
+            bits = (1u << TRACE_EVENT_NUM) - 1;
+        } else if ((length == 4) && !strncmp(name, "none", 4)) {
+            mask = 0;
+            continue;
+        } else {
+            for (unsigned event = 0; event < TRACE_EVENT_NUM; ++event) {
+                const char *event_name = trace_event_name(event);
+                if ((strlen(event_name) == length) && !strncmp(name, event_name, length)) {
+                    bits = 1u << event;
+                    break;
+                }
+            }
+        }
+        if (!bits) {
+            return -EINVAL;
+        }
+        mask = disable ? (mask & ~bits) : (mask | bits);
+    }
+    int ret = trace_set_mask(mask);
+    return (ret < 0) ? ret : (ssize_t)nbyte;
+}
+
+/// Filesystem general operations.
+static vfs_sys_operations_t proctrace_sys_operations = {
+    .mkdir_f   = NULL,
+    .rmdir_f   = NULL,
+    .stat_f    = NULL,
+    .creat_f   = NULL,
+    .symlink_f = NULL,
+};
+
+/// Filesystem file operations of `/proc/trace`.
+static vfs_file_operations_t proctrace_trace_fs_operations = {
+    .open_f     = NULL,
+    .unlink_f   = NULL,
+    .close_f    = seq_release,
+    .read_f     = __proctrace_read_trace,
+    .write_f    = NULL,
+    .lseek_f    = NULL,
+    .stat_f     = NULL,
+    .ioctl_f    = NULL,
+    .getdents_f = NULL,
+    .readlink_f = NULL,
+};
+
+/// Filesystem file operations of `/proc/trace_events`.
+static vfs_file_operations_t proctrace_events_fs_operations = {
+    .open_f     = NULL,
+    .unlink_f   = NULL,
+    .close_f    = seq_release,
+    .read_f     = __proctrace_read_events,
+    .write_f    = __proctrace_write_events,
+    .lseek_f    = NULL,
+    .stat_f     = NULL,
+    .ioctl_f    = NULL,
+    .getdents_f = NULL,
+    .readlink_f = NULL,
+};
+
+int proctrace_module_init(void)
+{
+    proc_dir_entry_t *file;
+    if ((file = proc_create_entry("trace", NULL)) == NULL) {
+        pr_err("Cannot create `/proc/trace`.\n");
+        return 1;
+    }
+    file->sys_operations = &proctrace_sys_operations;
+    file->fs_operations  = &proctrace_trace_fs_operations;
+    if ((file = proc_create_entry("trace_events", NULL)) == NULL) {
+        pr_err("Cannot create `/proc/trace_events`.\n");
+        return 1;
+    }
+    file->sys_operations = &proctrace_sys_operations;
+    file->fs_operations  = &proctrace_events_fs_operations;
+    return 0;
+}
@@ -15,177 +15,278 @@
 #include "drivers/keyboard/keyboard.h"
 #include "drivers/keyboard/keymap.h"
 #include "fcntl.h"
+#include "fs/poll.h"
 #include "fs/procfs.h"
 #include "fs/vfs.h"
-#include "io/video.h"
+#include "io/console.h"
+#include "math.h"
+#include "poll.h"
 #include "process/scheduler.h"
 #include "sys/bitops.h"
 #include "sys/errno.h"
 
-/// @brief Prints the ring-buffer.
-/// @param rb the ring-buffer to print.
-void print_rb(fs_rb_scancode_t *rb)
+/// Marks, inside the line, where the end-of-file character was typed.
+#define TTY_EOF 0x100
+
+/// @brief Checks if a character is one of the enabled control characters.
+/// @param termios the terminal options.
+/// @param index the index of the control character.
+/// @param c the character.
+/// @return true if it matches, a zero control character is disabled.
+static inline bool_t __procv_is_cc(const termios_t *termios, int index, int c)
 {
-    if (!fs_rb_scancode_empty(rb)) {
-        for (unsigned i = rb->read; (i < rb->write) && (i < rb->size); ++i) {
-            pr_debug("%c", rb->buffer[i]);
-        }
-        pr_debug("\n");
-    }
+    return (termios->c_cc[index] != 0) && (termios->c_cc[index] == c);
 }
 
-static ssize_t procv_read(vfs_file_t *file, char *buf, off_t offset, size_t nbyte)
+/// @brief Checks if a character ends a line in canonical mode.
+/// @param termios the terminal options.
+/// @param c the character, as stored in the ring-buffer.
+/// @return true if it ends the line.
+static inline bool_t __procv_is_eol(const termios_t *termios, int c)
 {
-    // Stop if the buffer is invalid.
-    if (buf == NULL) {
-        return -1;
-    }
+    return (c == '\n') || (c == TTY_EOF) || __procv_is_cc(termios, VEOL, c);
+}
 
-    // Get the currently running process.
-    task_struct *process = scheduler_get_current_process();
-    // Get a pointer to its ketboard ring-buffer.
-    fs_rb_scancode_t *rb = &process->keyboard_rb;
-    // Pre-check the flags.
-    bool_t flg_icanon = bitmask_check(process->termios.c_lflag, ICANON) == ICANON;
-    bool_t flg_echoe  = bitmask_check(process->termios.c_lflag, ECHOE) == ECHOE;
-    bool_t flg_echo   = bitmask_check(process->termios.c_lflag, ECHO) == ECHO;
-    bool_t flg_isig   = bitmask_check(process->termios.c_lflag, ISIG) == ISIG;
-
-    // If we are in canonical mode, and the last inserted element is a newline,
-    // we pop the buffer until it's empty.
-    if (!fs_rb_scancode_empty(rb) && (!flg_icanon || (flg_icanon && (fs_rb_scancode_front(rb) == '\n')))) {
-        *((char *)buf) = fs_rb_scancode_pop_back(rb) & 0x00FF;
-        return 1;
-    }
+/// @brief Returns the number of characters inside the ring-buffer.
+/// @param rb the ring-buffer.
+/// @return the number of characters.
+static inline unsigned __procv_count(fs_rb_scancode_t *rb)
+{
+    return (rb->write + rb->size - rb->read) % rb->size;
+}
 
-    // Once we have dealt with the canonical mode, get the character.
-    int c = keyboard_pop_back();
+/// @brief Checks if the last character typed can be erased, it must be part
+/// of the line being edited.
+/// @param process the process owning the terminal input.
+/// @return true if it can be erased.
+static inline bool_t __procv_can_erase(task_struct *process)
+{
+    fs_rb_scancode_t *rb = &process->keyboard_rb;
+    return !fs_rb_scancode_empty(rb) && !__procv_is_eol(&process->termios, fs_rb_scancode_front(rb));
+}
 
-    // Check that it's a valid caracter.
-    if (c < 0) {
-        return 0;
+/// @brief Echoes a character on video.
+/// @param c the character, control characters are shown as `^X`.
+static inline void __procv_echo(int c)
+{
+    if (iscntrl(c) && (isalpha('A' + (c - 1)) && (c != '\n') && (c != '\b'))) {
+        console_putc('^');
+        console_putc('A' + (c - 1));
+    } else {
+        console_putc(c);
     }
+}
 
-    // Keep only the character not the scancode.
-    c &= 0x00FF;
+/// @brief The line discipline, processes a character typed on the keyboard.
+/// @param process the process owning the terminal input.
+/// @param c the character.
+static void __procv_input(task_struct *process, int c)
+{
+    fs_rb_scancode_t *rb = &process->keyboard_rb;
+    termios_t *termios   = &process->termios;
+    // Pre-check the flags.
+    bool_t flg_icanon = bitmask_check(termios->c_lflag, ICANON) == ICANON;
+    bool_t flg_echoe  = bitmask_check(termios->c_lflag, ECHOE) == ECHOE;
+    bool_t flg_echok  = bitmask_check(termios->c_lflag, ECHOK) == ECHOK;
+    bool_t flg_echonl = bitmask_check(termios->c_lflag, ECHONL) == ECHONL;
+    bool_t flg_echo   = bitmask_check(termios->c_lflag, ECHO) == ECHO;
+    bool_t flg_isig   = bitmask_check(termios->c_lflag, ISIG) == ISIG;
 
-    // We just received backspace.
-    if (c == '\b') {
-        // If !ECHOE and ECHO, We need to show the the `^?` string.
-        if (!flg_echoe && flg_echo) {
-            video_puts("^?");
+    if (flg_icanon) {
+        // Erase the previous character, but never a line already completed.
+        if (__procv_is_cc(termios, VERASE, c)) {
+            // If !ECHOE and ECHO, We need to show the the `^?` string.
+            if (!flg_echoe && flg_echo) {
+                console_puts("^?");
+            }
+            if (__procv_can_erase(process)) {
+                fs_rb_scancode_pop_front(rb);
+                // Delete the previous character on video.
+                if (flg_echoe) {
+                    console_putc('\b');
+                }
+            }
+            return;
         }
-        // If we are in canonical mode, we pop the previous character.
-        if (flg_icanon) {
-            // Pop the previous character in buffer.
-            fs_rb_scancode_pop_front(rb);
-            // Delete the previous character on video.
-            if (flg_echoe) {
-                video_putc(c);
+        // Erase the whole line being edited.
+        if (__procv_is_cc(termios, VKILL, c)) {
+            while (__procv_can_erase(process)) {
+                fs_rb_scancode_pop_front(rb);
+                if (flg_echok) {
+                    console_putc('\b');
+                }
             }
-        } else {
-            // Add the character to the buffer.
-            fs_rb_scancode_push_front(rb, c);
-            // Return the character.
-            *((char *)buf) = fs_rb_scancode_pop_back(rb) & 0x00FF;
-            return 1;
+            return;
         }
-        return 0;
+        // End the line, without adding any character to it.
+        if (__procv_is_cc(termios, VEOF, c)) {
+            fs_rb_scancode_push_front(rb, TTY_EOF);
+            return;
+        }
+    } else if (c == '\b') {
+        // If !ECHOE and ECHO, We need to show the the `^?` string.
+        if (!flg_echoe && flg_echo) {
+            console_puts("^?");
+        }
+        fs_rb_scancode_push_front(rb, c);
+        return;
     }
     if (c == 0x7f) {
         if (flg_echo) {
-            video_puts("^[[3~");
+            console_puts("^[[3~");
         }
-        // Add the character to the buffer.
+        // Add the escape sequence of the delete key to the buffer.
         fs_rb_scancode_push_front(rb, '\033');
         fs_rb_scancode_push_front(rb, '[');
         fs_rb_scancode_push_front(rb, '3');
         fs_rb_scancode_push_front(rb, '~');
-        return 0;
+        return;
     }
     // Add the character to the buffer.
     fs_rb_scancode_push_front(rb, c);
 
     // If echo is activated, output the character to video.
     if (flg_echo) {
-        if (iscntrl(c) && (isalpha('A' + (c - 1)) && (c != '\n') && (c != '\b'))) {
-            video_putc('^');
-            video_putc('A' + (c - 1));
-        } else {
-            video_putc(c);
-        }
+        __procv_echo(c);
+    } else if (flg_icanon && flg_echonl && (c == '\n')) {
+        console_putc(c);
     }
 
+    // The character is still delivered, the shell handles it on its own.
     if (flg_isig) {
-        if (iscntrl(c)) {
-            if (c == 0x03) {
-                sys_kill(process->pid, SIGTERM);
-            } else if (c == 0x1A) {
-                sys_kill(process->pid, SIGSTOP);
-            }
+        if (__procv_is_cc(termios, VINTR, c)) {
+            sys_kill(process->pid, SIGTERM);
+        } else if (__procv_is_cc(termios, VSUSP, c)) {
+            sys_kill(process->pid, SIGSTOP);
         }
     }
+}
 
-    // If we are NOT in canonical mode, we can send the character back to user
-    // right away.
-    if (!flg_icanon) {
-        *((char *)buf) = fs_rb_scancode_pop_back(rb) & 0x00FF;
-        return 1;
+/// @brief Moves the characters typed on the keyboard through the line
+/// discipline, into the ring-buffer of the process.
+/// @param process the process owning the terminal input.
+static inline void __procv_drain_keyboard(task_struct *process)
+{
+    int batch[32];
+    unsigned count;
+    while ((count = keyboard_drain(batch, count_of(batch))) > 0) {
+        for (unsigned i = 0; i < count; ++i) {
+            // Keep only the character not the scancode.
+            __procv_input(process, batch[i] & 0x00FF);
+        }
     }
+}
 
-#if 0
-
-    // The last inserted character.
-    int back_c = keyboard_back();
-
-    if (back_c < 0)
-        return 0;
-
-    // The first inserted character.
-    int front_c = keyboard_front();
-
-    pr_debug("'%c' (%3d %04x) [F: '%c' (%04x)]\n", back_c, back_c, back_c, front_c, front_c);
+/// @brief Checks if a read would return right away.
+/// @param process the process owning the terminal input.
+/// @return true if a whole line, or VMIN characters in raw mode, are ready.
+static bool_t __procv_ready(task_struct *process)
+{
+    fs_rb_scancode_t *rb = &process->keyboard_rb;
+    termios_t *termios   = &process->termios;
+    if (bitmask_check(termios->c_lflag, ICANON) == ICANON) {
+        for (unsigned i = rb->read; i != rb->write; i = fs_rb_scancode_step(rb, i)) {
+            if (__procv_is_eol(termios, rb->buffer[i])) {
+                return true;
+            }
+        }
+        return false;
+    }
+    return __procv_count(rb) >= max(termios->c_cc[VMIN], 1);
+}
 
-    // Echo the character to video.
-    if (flg_echo) {
-        video_putc(back_c & 0x00FF);
+/// @brief Reads from the terminal, sleeping until the input is ready.
+/// @param file the terminal.
+/// @param buf the buffer where the characters are stored.
+/// @param offset ignored.
+/// @param nbyte the size of the buffer.
+/// @return the number of characters read, 0 on end-of-file or when the
+/// VTIME timeout expires, -ERESTARTSYS if the process sleeps, -errno on
+/// failure.
+/// @details In canonical mode a read returns at most one line, in raw mode
+/// it waits for VMIN characters, or for VTIME tenths of second: from the
+/// start of the read if VMIN is 0, from the first character otherwise.
+static ssize_t procv_read(vfs_file_t *file, char *buf, off_t offset, size_t nbyte)
+{
+    // Stop if the buffer is invalid.
+    if (buf == NULL) {
+        return -EFAULT;
     }
+    // Get the currently running process.
+    task_struct *process = scheduler_get_current_process();
+    // Get a pointer to its ketboard ring-buffer.
+    fs_rb_scancode_t *rb = &process->keyboard_rb;
+    termios_t *termios   = &process->termios;
+    bool_t flg_icanon    = bitmask_check(termios->c_lflag, ICANON) == ICANON;
 
-    // If we have the canonical input active, we should not return characters,
-    // until we receive a newline.
-    if ((flg_icanon && (front_c == '\n')) ||
-        !flg_icanon) {
-        *((char *)buf) = keyboard_pop_back() & 0x00FF;
-        return 1;
+    __procv_drain_keyboard(process);
+    if (!__procv_ready(process)) {
+        // In raw mode, without VMIN and VTIME, we return what we have.
+        bool_t polling = !flg_icanon && !termios->c_cc[VMIN] && !termios->c_cc[VTIME];
+        if (!polling) {
+            if (bitmask_check(file->open_flags, O_NONBLOCK)) {
+                return -EAGAIN;
+            }
+            // The timeout applies once there is a character, or right away
+            // without VMIN.
+            int timeout = -1;
+            if (!flg_icanon && termios->c_cc[VTIME] && (!termios->c_cc[VMIN] || !fs_rb_scancode_empty(rb))) {
+                timeout = termios->c_cc[VTIME] * 100;
+            }
+            // Sleep on the keyboard until procv_poll says we are ready.
+            int ret = do_poll_file(file, POLLIN, timeout);
+            if (ret < 0) {
+                return ret;
+            }
+        }
     }
-#endif
-
-#if 0
-    // Read the character from the keyboard.
-    int c = keyboard_getc(false) & 0x00FF;
-    if (c < 0)
-        return 0;
-    if (c == KEY_PAGE_UP) {
-        video_shift_one_page_down();
-        return 0;
-    } else if (c == KEY_PAGE_DOWN) {
-        video_shift_one_page_up();
-        return 0;
+    // We might have slept, leave the queue of the keyboard.
+    poll_release(process);
+
+    size_t count = 0;
+    if (flg_icanon) {
+        // Return the line, up to its newline, or up to the end-of-file
+        // character, which is consumed but not returned.
+        while ((count < nbyte) && !fs_rb_scancode_empty(rb)) {
+            int c = fs_rb_scancode_pop_back(rb);
+            if (c == TTY_EOF) {
+                break;
+            }
+            buf[count++] = c & 0x00FF;
+            if (__procv_is_eol(termios, c)) {
+                break;
+            }
+        }
     } else {
-        // Echo the character to video.
-        if (flg_echo) {
-            video_putc(c & 0x00FF);
+        while ((count < nbyte) && !fs_rb_scancode_empty(rb)) {
+            buf[count++] = fs_rb_scancode_pop_back(rb) & 0x00FF;
         }
     }
-#endif
-    return 0;
+    return count;
 }
 
-static ssize_t procv_write(vfs_file_t *file, const void *buf, off_t offset, size_t nbyte)
+/// @brief Returns the events ready on the terminal.
+/// @param file the terminal.
+/// @param table the table of the polling process, NULL if it does not sleep.
+/// @return the events, writing never blocks.
+static unsigned int procv_poll(vfs_file_t *file, struct poll_table_t *table)
 {
-    for (size_t i = 0; i < nbyte; ++i) {
-        video_putc(((char *)buf)[i]);
+    task_struct *process = scheduler_get_current_process();
+    unsigned int mask    = POLLOUT | POLLWRNORM;
+    // Queue the process first, so that a key pressed after the checks wakes it.
+    poll_wait(file, keyboard_get_wait_queue(), table);
+    // Either a line is ready, or enough characters in raw mode, as
+    // procv_read would return them.
+    __procv_drain_keyboard(process);
+    if (__procv_ready(process)) {
+        mask |= POLLIN | POLLRDNORM;
     }
+    return mask;
+}
+
+static ssize_t procv_write(vfs_file_t *file, const void *buf, off_t offset, size_t nbyte)
+{
+    console_write((const char *)buf, nbyte);
     return nbyte;
 }
 
@@ -237,6 +338,7 @@ static vfs_file_operations_t procv_fs_operations = {
     .ioctl_f    = procv_ioctl,
     .getdents_f = NULL,
     .readlink_f = NULL,
+    .poll_f     = procv_poll,
 };
 
 int procv_module_init(void)
@@ -9,7 +9,6 @@
 #define __DEBUG_LEVEL__  LOGLEVEL_NOTICE ///< Set log level.
 #include "io/debug.h"                    // Include debugging functions.
 
-#include "hardware/timer.h"
 #include "io/port_io.h"
 #include "io/vga/vga.h"
 #include "io/vga/vga_font.h"
@@ -53,12 +52,13 @@
 /// By reading this port it'll go to the index state.
 #define INPUT_STATUS_READ 0x03DA
 
+/// The number of pixels of the largest mode.
+#define VGA_MAX_PIXELS (720 * 480)
+
 /// VGA pointers for drawing operations.
 typedef struct {
-    /// Writes a pixel.
-    void (*write_pixel)(int x, int y, unsigned char c);
-    /// Reads a pixel.
-    unsigned (*read_pixel)(int x, int y);
+    /// Copies a rectangle of the back buffer to the video memory.
+    void (*blit)(int x0, int y0, int x1, int y1);
     /// Draws a rectangle.
     void (*draw_rect)(int x, int y, int wd, int ht, unsigned char c);
     /// Fills a rectangle.
@@ -90,6 +90,17 @@ palette_entry_t stored_palette[256];
 char vidmem[262144];
 /// Current driver.
 static vga_driver_t *driver = NULL;
+/// @brief The screen, one byte for each pixel, where everything is drawn
+/// before being copied to the video memory by vga_flush.
+static unsigned char backbuffer[VGA_MAX_PIXELS];
+/// @brief The area of the back buffer which differs from the video memory,
+/// empty when x0 >= x1.
+static struct {
+    int x0; ///< The left column.
+    int y0; ///< The top row.
+    int x1; ///< The column after the right one.
+    int y1; ///< The row after the bottom one.
+} dirty = { 0, 0, 0, 0 };
 
 // ============================================================================
 // == VGA MODEs ===============================================================
@@ -453,57 +464,101 @@ static inline unsigned __read_pixel_2(unsigned x, unsigned y)
     return __read_byte(off) & mask;
 }
 
-/// @brief Writes a pixel.
-/// @param x x coordinates.
-/// @param y y coordinates.
-/// @param c color.
-static inline void __write_pixel_4(int x, int y, unsigned char color)
-{
-    unsigned off, mask, plane, pmask;
-    off   = (driver->width / 8) * y + x / 8;
-    x     = (x & 7) * 1;
-    mask  = 0x80 >> x;
-    pmask = 1;
-    for (plane = 0; plane < 4; ++plane) {
+/// @brief Copies a rectangle of the back buffer to the 16 colors planar video
+/// memory, where each plane holds one bit of the color of 8 pixels per byte.
+/// @param x0 the left column.
+/// @param y0 the top row.
+/// @param x1 the column after the right one.
+/// @param y1 the row after the bottom one.
+static void __blit_4(int x0, int y0, int x1, int y1)
+{
+    // Whole bytes are written, so widen the area to multiples of 8 pixels.
+    unsigned first = x0 / 8, last = (x1 + 7) / 8, stride = driver->width / 8;
+    // Select each plane once, and write its part of the whole area.
+    for (unsigned plane = 0; plane < 4; ++plane) {
         __set_plane(plane);
-        if (pmask & color) {
-            __write_byte(off, __read_byte(off) | mask);
-        } else {
-            __write_byte(off, __read_byte(off) & ~mask);
+        for (int y = y0; y < y1; ++y) {
+            const unsigned char *src = backbuffer + (y * driver->width) + (first * 8);
+            char *dst                = driver->address + (y * stride) + first;
+            for (unsigned byte = first; byte < last; ++byte, src += 8) {
+                unsigned char bits = 0;
+                for (unsigned it = 0; it < 8; ++it) {
+                    bits |= ((src[it] >> plane) & 1u) << (7 - it);
+                }
+                *(dst++) = bits;
+            }
         }
-        pmask <<= 1;
     }
 }
 
-/// @brief Reads a pixel.
-/// @param x x coordinates.
-/// @param y y coordinates.
-/// @return the pixel value.
-static inline unsigned __read_pixel_4(int x, int y)
+/// @brief Copies a rectangle of the back buffer to the 256 colors unchained
+/// video memory, where the pixel x is in the plane x % 4.
+/// @param x0 the left column.
+/// @param y0 the top row.
+/// @param x1 the column after the right one.
+/// @param y1 the row after the bottom one.
+static void __blit_8(int x0, int y0, int x1, int y1)
 {
-    int off;
-    off = (driver->width / 8) * y + x / 8;
-    return __read_byte(off);
+    for (unsigned plane = 0; plane < 4; ++plane) {
+        __set_plane(plane);
+        // The first column of the area which is in this plane.
+        int first = x0 + ((plane - x0) & 3u);
+        for (int y = y0; y < y1; ++y) {
+            const unsigned char *src = backbuffer + (y * driver->width);
+            for (int x = first; x < x1; x += 4) {
+                __write_byte(((y * driver->width) + x) / 4, src[x]);
+            }
+        }
+    }
 }
 
-/// @brief Writes a pixel.
-/// @param x x coordinates.
-/// @param y y coordinates.
-/// @param c color.
-static inline void __write_pixel_8(int x, int y, unsigned char color)
+/// @brief Grows the dirty area to include the given rectangle.
+/// @param x0 the left column.
+/// @param y0 the top row.
+/// @param x1 the column after the right one.
+/// @param y1 the row after the bottom one.
+static inline void __mark_dirty(int x0, int y0, int x1, int y1)
 {
-    __set_plane(x);
-    __write_byte(((y * driver->width) + x) / 4, color);
+    x0 = max(x0, 0), y0 = max(y0, 0);
+    x1 = min(x1, driver->width), y1 = min(y1, driver->height);
+    if ((x0 >= x1) || (y0 >= y1)) {
+        return;
+    }
+    if (dirty.x0 >= dirty.x1) {
+        dirty.x0 = x0, dirty.y0 = y0, dirty.x1 = x1, dirty.y1 = y1;
+    } else {
+        dirty.x0 = min(dirty.x0, x0), dirty.x1 = max(dirty.x1, x1);
+        dirty.y0 = min(dirty.y0, y0), dirty.y1 = max(dirty.y1, y1);
+    }
 }
 
-/// @brief Reads a pixel.
+/// @brief Writes a pixel of the back buffer, if it is inside the screen,
+/// without growing the dirty area.
 /// @param x x coordinates.
 /// @param y y coordinates.
-/// @return the pixel value.
-static inline unsigned __read_pixel_8(int x, int y)
+/// @param color color.
+static inline void __put_pixel(int x, int y, unsigned char color)
+{
+    if ((x >= 0) && (y >= 0) && (x < driver->width) && (y < driver->height)) {
+        backbuffer[(y * driver->width) + x] = color;
+    }
+}
+
+/// @brief Fills a run of pixels of a row of the back buffer, without growing
+/// the dirty area.
+/// @param x0 the first column.
+/// @param x1 the column after the last one.
+/// @param y the row.
+/// @param color color.
+static inline void __fill_span(int x0, int x1, int y, unsigned char color)
 {
-    __set_plane(x);
-    return __read_byte(((y * driver->width) + x) / 4);
+    if ((y < 0) || (y >= driver->height)) {
+        return;
+    }
+    x0 = max(x0, 0), x1 = min(x1, driver->width);
+    if (x0 < x1) {
+        memset(backbuffer + (y * driver->width) + x0, color, x1 - x0);
+    }
 }
 
 // ============================================================================
@@ -533,33 +588,42 @@ int vga_height(void)
 
 void vga_draw_pixel(int x, int y, unsigned char color)
 {
-    driver->ops->write_pixel(x, y, color);
+    __put_pixel(x, y, color);
+    __mark_dirty(x, y, x + 1, y + 1);
 }
 
 unsigned int vga_read_pixel(int x, int y)
 {
-    return driver->ops->read_pixel(x, y);
+    if ((x < 0) || (y < 0) || (x >= driver->width) || (y >= driver->height)) {
+        return 0;
+    }
+    return backbuffer[(y * driver->width) + x];
+}
+
+void vga_flush(void)
+{
+    if (!vga_enable || (dirty.x0 >= dirty.x1)) {
+        return;
+    }
+    driver->ops->blit(dirty.x0, dirty.y0, dirty.x1, dirty.y1);
+    dirty.x0 = dirty.x1 = 0;
 }
 
 void vga_draw_char(int x, int y, unsigned char c, unsigned char color)
 {
-    static unsigned mask[] = {
-        1u << 0u, //            1
-        1u << 1u, //            2
-        1u << 2u, //            4
-        1u << 3u, //            8
-        1u << 4u, //           16
-        1u << 5u, //           32
-        1u << 6u, //           64
-        1u << 7u, //          128
-        1u << 8u, //          256
-    };
     const unsigned char *glyph = driver->font->font + c * driver->font->height;
-    for (unsigned cy = 0; cy < driver->font->height; ++cy) {
-        for (unsigned cx = 0; cx < driver->font->width; ++cx) {
-            vga_draw_pixel(x + (driver->font->width - cx), y + cy, glyph[cy] & mask[cx] ? color : 0x00u);
+    int width = driver->font->width, height = driver->font->height;
+    // The bit cx of a row of the glyph goes to the column x + width - cx, so
+    // the glyph covers the columns from x + 1 to x + width.
+    int first = max(x + 1, 0), last = min(x + width + 1, driver->width);
+    for (int cy = max(0, -y); (cy < height) && (y + cy < driver->height); ++cy) {
+        unsigned char *row = backbuffer + ((y + cy) * driver->width);
+        unsigned bits      = glyph[cy];
+        for (int col = first; col < last; ++col) {
+            row[col] = ((bits >> (x + width - col)) & 1u) ? color : 0x00u;
         }
     }
+    __mark_dirty(x + 1, y, x + width + 1, y + height);
 }
 
 void vga_draw_string(int x, int y, const char *str, unsigned char color)
@@ -574,38 +638,48 @@ void vga_draw_string(int x, int y, const char *str, unsigned char color)
 
 void vga_draw_line(int x0, int y0, int x1, int y1, unsigned char color)
 {
+    __mark_dirty(min(x0, x1), min(y0, y1), max(x0, x1) + 1, max(y0, y1) + 1);
+    // Horizontal lines are a single run of pixels.
+    if (y0 == y1) {
+        __fill_span(min(x0, x1), max(x0, x1) + 1, y0, color);
+        return;
+    }
     int dx = abs(x1 - x0), sx = sign(x1 - x0);
-    int dy = abs(y1 - y0), sy = sign(y1 - y0);
-    int err = (dx > dy ? dx : -dy) / 2;
+    int dy = -abs(y1 - y0), sy = sign(y1 - y0);
+    int err = dx + dy;
     while (true) {
-        vga_draw_pixel(x0, y0, color);
+        __put_pixel(x0, y0, color);
         if ((x0 == x1) && (y0 == y1)) {
             break;
         }
-        if (dx > dy) {
+        if (2 * err >= dy) {
+            err += dy;
             x0 += sx;
-            err -= dy;
-            if (err < 0) {
-                err += dx;
-            }
-            y0 += sy;
-        } else {
+        }
+        if (2 * err <= dx) {
+            err += dx;
             y0 += sy;
-            err -= dx;
-            if (err < 0) {
-                err += dy;
-            }
-            x0 += sx;
         }
     }
 }
 
 void vga_draw_rectangle(int sx, int sy, int w, int h, unsigned char color)
 {
-    vga_draw_line(sx, sy, sx + w, sy, color);
-    vga_draw_line(sx, sy, sx, sy + h, color);
-    vga_draw_line(sx, sy + h, sx + w, sy + h, color);
-    vga_draw_line(sx + w, sy, sx + w, sy + h, color);
+    __fill_span(sx, sx + w + 1, sy, color);
+    __fill_span(sx, sx + w + 1, sy + h, color);
+    for (int y = sy + 1; y < sy + h; ++y) {
+        __put_pixel(sx, y, color);
+        __put_pixel(sx + w, y, color);
+    }
+    __mark_dirty(sx, sy, sx + w + 1, sy + h + 1);
+}
+
+void vga_fill_rectangle(int sx, int sy, int w, int h, unsigned char color)
+{
+    for (int y = sy; y < sy + h; ++y) {
+        __fill_span(sx, sx + w, y, color);
+    }
+    __mark_dirty(sx, sy, sx + w, sy + h);
 }
 
 void vga_draw_circle(int xc, int yc, int r, unsigned char color)
@@ -618,19 +692,20 @@ void vga_draw_circle(int xc, int yc, int r, unsigned char color)
     }
     while (y >= x) // only formulate 1/8 of circle
     {
-        vga_draw_pixel(xc - x, yc - y, color); //upper left left
-        vga_draw_pixel(xc - y, yc - x, color); //upper upper left
-        vga_draw_pixel(xc + y, yc - x, color); //upper upper right
-        vga_draw_pixel(xc + x, yc - y, color); //upper right right
-        vga_draw_pixel(xc - x, yc + y, color); //lower left left
-        vga_draw_pixel(xc - y, yc + x, color); //lower lower left
-        vga_draw_pixel(xc + y, yc + x, color); //lower lower right
-        vga_draw_pixel(xc + x, yc + y, color); //lower right right
+        __put_pixel(xc - x, yc - y, color); //upper left left
+        __put_pixel(xc - y, yc - x, color); //upper upper left
+        __put_pixel(xc + y, yc - x, color); //upper upper right
+        __put_pixel(xc + x, yc - y, color); //upper right right
+        __put_pixel(xc - x, yc + y, color); //lower left left
+        __put_pixel(xc - y, yc + x, color); //lower lower left
+        __put_pixel(xc + y, yc + x, color); //lower lower right
+        __put_pixel(xc + x, yc + y, color); //lower right right
         if (p < 0)
             p += 4 * x++ + 6;
         else
             p += 4 * (x++ - y--) + 10;
     }
+    __mark_dirty(xc - r, yc - r, xc + r + 1, yc + r + 1);
 }
 
 void vga_draw_triangle(int x1, int y1, int x2, int y2, int x3, int y3, unsigned char color)
@@ -665,24 +740,21 @@ void vga_run_test(void)
 // == MODEs and DRIVERs =======================================================
 
 static vga_ops_t ops_720_480_16 = {
-    .write_pixel = __write_pixel_4,
-    .read_pixel  = __read_pixel_4,
-    .draw_rect   = NULL,
-    .fill_rect   = NULL,
+    .blit      = __blit_4,
+    .draw_rect = NULL,
+    .fill_rect = NULL,
 };
 
 static vga_ops_t ops_640_480_16 = {
-    .write_pixel = __write_pixel_4,
-    .read_pixel  = __read_pixel_4,
-    .draw_rect   = NULL,
-    .fill_rect   = NULL,
+    .blit      = __blit_4,
+    .draw_rect = NULL,
+    .fill_rect = NULL,
 };
 
 static vga_ops_t ops_320_200_256 = {
-    .write_pixel = __write_pixel_8,
-    .read_pixel  = __read_pixel_8,
-    .draw_rect   = NULL,
-    .fill_rect   = NULL,
+    .blit      = __blit_8,
+    .draw_rect = NULL,
+    .fill_rect = NULL,
 };
 
 static vga_font_t font_4x6 = {
@@ -803,21 +875,13 @@ static int _cursor_state    = 0;
 
 inline static void __vga_clear_cursor(void)
 {
-    for (unsigned cy = 0; cy < driver->font->height; ++cy) {
-        for (unsigned cx = 0; cx < driver->font->width; ++cx) {
-            vga_draw_pixel(_x + cx, _y + cy, 0);
-        }
-    }
+    vga_fill_rectangle(_x, _y, driver->font->width, driver->font->height, 0);
 }
 
 inline static void __vga_draw_cursor(void)
 {
     unsigned char color = (_cursor_state = (_cursor_state == 0)) * _color;
-    for (unsigned cy = 0; cy < driver->font->height; ++cy) {
-        for (unsigned cx = 0; cx < driver->font->width; ++cx) {
-            vga_draw_pixel(_x + cx, _y + cy, color);
-        }
-    }
+    vga_fill_rectangle(_x, _y, driver->font->width, driver->font->height, color);
 }
 
 void vga_putc(int c)
@@ -880,6 +944,9 @@ void vga_clear_screen(void)
         memset(driver->address, 0, 64 * 1024);
     }
     __set_plane(original_plane);
+    // The video memory is already clear, so nothing is left to copy.
+    memset(backbuffer, 0, driver->width * driver->height);
+    dirty.x0 = dirty.x1 = 0;
     _x = 0, _y = 0;
 }
 
@@ -897,9 +964,8 @@ void vga_new_line(void)
 
 void vga_update(void)
 {
-    if ((timer_get_ticks() % (TICKS_PER_SECOND / 2)) == 0) {
-        __vga_draw_cursor();
-    }
+    __vga_draw_cursor();
+    vga_flush();
 }
 
 void vga_set_color(unsigned int color)
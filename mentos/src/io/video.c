@@ -5,6 +5,7 @@
 
 #include "io/port_io.h"
 #include "ctype.h"
+#include "hardware/hrtimer.h"
 #include "io/vga/vga.h"
 #include "io/video.h"
 #include "stdbool.h"
@@ -15,8 +16,10 @@
 #define WIDTH        80                   ///< The width of the
 #define W2           (WIDTH * 2)          ///< The width of the
 #define TOTAL_SIZE   (HEIGHT * WIDTH * 2) ///< The total size of the screen.
-#define ADDR         (char *)0xB8000U     ///< The address of the
+#define ADDR         (char *)0xB8000U     ///< The address of the video memory.
 #define STORED_PAGES 3                    ///< The number of stored pages.
+/// The period of the screen refresh, in nanoseconds (the blink of the cursor).
+#define REFRESH_PERIOD (NSEC_PER_SEC / 2)
 
 /// @brief Stores the association between ANSI colors and pure VIDEO colors.
 struct ansi_color_map_t {
@@ -66,8 +69,19 @@ ansi_color_map[] = {
     { 0, 0 }
 };
 
+/// @brief The copy of the screen in memory, where the characters are written
+/// and scrolled, and which is copied to the uncached video memory row by row.
+/// The spare row is used by __draw_char when shifting the last characters.
+static char screen[TOTAL_SIZE + W2];
+/// The rows of the screen which differ from the video memory, one bit each.
+static uint32_t dirty_rows = 0;
+/// When non-zero, the screen is not copied to the video memory, since more
+/// characters are coming.
+static int flush_deferred = 0;
+/// The position of the hardware cursor, as an offset inside the screen.
+static long cursor_offset = -1;
 /// Pointer to a position of the screen writer.
-char *pointer = ADDR;
+char *pointer = screen;
 /// The current color.
 unsigned char color = 7;
 /// Used to write on the escape_buffer. If -1, we are not parsing an escape sequence.
@@ -80,33 +94,109 @@ char upper_buffer[STORED_PAGES * TOTAL_SIZE] = { 0 };
 char original_page[TOTAL_SIZE] = { 0 };
 /// Determines if the screen is currently scrolled.
 int scrolled_page = 0;
+/// Set by the refresh timer, when the screen has to be refreshed.
+static volatile bool_t update_pending = false;
+#ifndef VGA_TEXT_MODE
+/// Asks for a refresh of the screen, at most once every REFRESH_PERIOD.
+static hrtimer_t refresh_timer;
+#endif
 
 /// @brief Get the current column number.
 /// @return The column number.
 static inline unsigned __get_x(void)
 {
-    return ((pointer - ADDR) % (WIDTH * 2)) / 2;
+    return ((pointer - screen) % (WIDTH * 2)) / 2;
 }
 
 /// @brief Get the current row number.
 /// @return The row number.
 static inline unsigned __get_y(void)
 {
-    return (pointer - ADDR) / (WIDTH * 2);
+    return (pointer - screen) / (WIDTH * 2);
+}
+
+/// @brief Marks the rows from the one holding the given position to the last
+/// one as changed.
+/// @param ptr The position inside the screen.
+static inline void __mark_dirty_from(char *ptr)
+{
+    unsigned row = (ptr - screen) / W2;
+    if (row < HEIGHT) {
+        dirty_rows |= ((1U << HEIGHT) - 1) & ~((1U << row) - 1);
+    }
+}
+
+/// @brief Copies the changed rows to the video memory, and moves the hardware
+/// cursor if needed, unless the flush is deferred.
+static inline void __video_flush(void)
+{
+    if (flush_deferred) {
+        return;
+    }
+#ifndef VGA_TEXT_MODE
+    if (vga_is_enabled()) {
+        vga_flush();
+        return;
+    }
+#endif
+    // Copy each run of consecutive changed rows with a single copy.
+    for (unsigned row = 0; dirty_rows && (row < HEIGHT);) {
+        if (!(dirty_rows & (1U << row))) {
+            ++row;
+            continue;
+        }
+        unsigned first = row;
+        while ((row < HEIGHT) && (dirty_rows & (1U << row))) {
+            dirty_rows &= ~(1U << row++);
+        }
+        memcpy(ADDR + (W2 * first), screen + (W2 * first), W2 * (row - first));
+    }
+    if (cursor_offset != (pointer - screen)) {
+        video_set_cursor_auto();
+    }
 }
 
 /// @brief Draws the given character.
 /// @param c The character to draw.
 static inline void __draw_char(char c)
 {
-    for (char *ptr = (ADDR + TOTAL_SIZE + (WIDTH * 2)); ptr > pointer; ptr -= 2) {
-        *(ptr)     = *(ptr - 2);
-        *(ptr + 1) = *(ptr - 1);
+    if (pointer >= screen + TOTAL_SIZE + W2) {
+        return;
     }
+    // The characters after the cursor are shifted forward by one.
+    memmove(pointer + 2, pointer, (screen + TOTAL_SIZE + W2 - 2) - pointer);
+    __mark_dirty_from(pointer);
     *(pointer++) = c;
     *(pointer++) = color;
 }
 
+/// @brief Draws a run of printable characters, shifting the following ones
+/// forward once for the whole run.
+/// @param buffer The characters to draw.
+/// @param count The number of characters, which must not go past the end of
+/// the screen.
+static inline void __draw_run(const char *buffer, size_t count)
+{
+    memmove(pointer + (2 * count), pointer, (screen + TOTAL_SIZE + W2 - (2 * count)) - pointer);
+    __mark_dirty_from(pointer);
+    for (size_t i = 0; i < count; ++i) {
+        *(pointer++) = buffer[i];
+        *(pointer++) = color;
+    }
+}
+
+/// @brief Deletes the character under the cursor, shifting the following
+/// ones back by one.
+static inline void __erase_char(void)
+{
+    if (pointer >= screen + TOTAL_SIZE + W2) {
+        return;
+    }
+    memmove(pointer, pointer + 2, (screen + TOTAL_SIZE + W2 - 2) - pointer);
+    memset(screen + TOTAL_SIZE + W2 - 2, 0, 2);
+    __mark_dirty_from(pointer);
+}
+
 /// @brief Sets the provided ansi code.
 /// @param ansi_code The ansi code describing background and foreground color.
 static inline void __set_color(uint8_t ansi_code)
@@ -134,10 +224,9 @@ static inline void __move_cursor_backward(int erase, int amount)
         // Bring back the pointer.
         pointer -= 2;
         if (erase) {
-            strcpy(pointer, pointer + 2);
+            __erase_char();
         }
     }
-    video_set_cursor_auto();
 }
 
 /// @brief Moves the cursor forward.
@@ -153,7 +242,6 @@ static inline void __move_cursor_forward(int erase, int amount)
             pointer += 2;
         }
     }
-    video_set_cursor_auto();
 }
 
 /// @brief Issue the vide to move the cursor to the given position.
@@ -162,6 +250,7 @@ static inline void __move_cursor_forward(int erase, int amount)
 static inline void __video_set_cursor(unsigned int x, unsigned int y)
 {
     uint32_t position = x * WIDTH + y;
+    cursor_offset     = position * 2;
     // Cursor LOW port to vga INDEX register.
     outportb(0x3D4, 0x0F);
     outportb(0x3D5, (uint8_t)(position & 0xFFU));
@@ -175,15 +264,44 @@ void video_init(void)
     video_clear();
 }
 
+#ifndef VGA_TEXT_MODE
+/// @brief Asks for a refresh of the screen, and restarts the timer.
+/// @param timer the refresh timer.
+static void __video_refresh_timeout(hrtimer_t *timer)
+{
+    // The refresh is done later, outside of the timer interrupt.
+    update_pending = true;
+    hrtimer_start(timer, timer->expires + REFRESH_PERIOD);
+}
+#endif
+
+void video_start_refresh(void)
+{
+#ifndef VGA_TEXT_MODE
+    // The text mode is drawn by the hardware, there is nothing to refresh.
+    if (vga_is_enabled()) {
+        hrtimer_init(&refresh_timer, &__video_refresh_timeout, 0);
+        hrtimer_start(&refresh_timer, hrtimer_get_time() + REFRESH_PERIOD);
+    }
+#endif
+}
+
 void video_update(void)
 {
+    if (!update_pending) {
+        return;
+    }
+    update_pending = false;
 #ifndef VGA_TEXT_MODE
     if (vga_is_enabled())
         vga_update();
 #endif
 }
 
-void video_putc(int c)
+/// @brief Prints the given character on the screen memory, without copying
+/// it to the video memory.
+/// @param c The character to print.
+static void __video_putc(int c)
 {
     // ESCAPE SEQUENCES
     if (c == '\033') {
@@ -229,7 +347,7 @@ void video_putc(int c)
     } else if (c == '\r') {
         video_cartridge_return();
     } else if (c == 127) {
-        strcpy(pointer, pointer + 2);
+        __erase_char();
     } else if ((c >= 0x20) && (c <= 0x7E)) {
         __draw_char(c);
     } else {
@@ -237,7 +355,14 @@ void video_putc(int c)
     }
 
     video_shift_one_line_up();
-    video_set_cursor_auto();
+}
+
+void video_putc(int c)
+{
+    ++flush_deferred;
+    __video_putc(c);
+    --flush_deferred;
+    __video_flush();
 }
 
 void video_puts(const char *str)
@@ -245,12 +370,40 @@ void video_puts(const char *str)
 #ifndef VGA_TEXT_MODE
     if (vga_is_enabled()) {
         vga_puts(str);
+        __video_flush();
         return;
     }
 #endif
-    while ((*str) != 0) {
-        video_putc((*str++));
+    video_write(str, strlen(str));
+}
+
+void video_write(const char *buffer, size_t count)
+{
+    ++flush_deferred;
+    for (size_t i = 0; i < count;) {
+        // Escape sequences, control characters, and the graphic mode go
+        // through the parser one character at a time.
+        if ((escape_index >= 0) || (buffer[i] < 0x20) || (buffer[i] > 0x7E) || (pointer >= screen + TOTAL_SIZE)
+#ifndef VGA_TEXT_MODE
+            || vga_is_enabled()
+#endif
+        ) {
+            __video_putc(buffer[i++]);
+            continue;
+        }
+        // The run stops at the first special character, or where the screen
+        // has to scroll.
+        size_t run = 1, room = (screen + TOTAL_SIZE - pointer) / 2;
+        while ((i + run < count) && (run < room) && (buffer[i + run] >= 0x20) && (buffer[i + run] <= 0x7E)) {
+            ++run;
+        }
+        __draw_run(buffer + i, run);
+        video_shift_one_line_up();
+        i += run;
     }
+    --flush_deferred;
+    // The video memory and the hardware cursor are updated once per write.
+    __video_flush();
 }
 
 void video_set_cursor_auto(void)
@@ -259,7 +412,7 @@ void video_set_cursor_auto(void)
     if (vga_is_enabled())
         return;
 #endif
-    __video_set_cursor(((pointer - ADDR) / 2U) / WIDTH, ((pointer - ADDR) / 2U) % WIDTH);
+    __video_set_cursor(((pointer - screen) / 2U) / WIDTH, ((pointer - screen) / 2U) % WIDTH);
 }
 
 void video_move_cursor(unsigned int x, unsigned int y)
@@ -267,11 +420,12 @@ void video_move_cursor(unsigned int x, unsigned int y)
 #ifndef VGA_TEXT_MODE
     if (vga_is_enabled()) {
         vga_move_cursor(x, y);
+        __video_flush();
         return;
     }
 #endif
-    pointer = ADDR + ((y * WIDTH * 2) + (x * 2));
-    video_set_cursor_auto();
+    pointer = screen + ((y * WIDTH * 2) + (x * 2));
+    __video_flush();
 }
 
 void video_get_cursor_position(unsigned int *x, unsigned int *y)
@@ -315,7 +469,9 @@ void video_clear(void)
     }
 #endif
     memset(upper_buffer, 0, STORED_PAGES * TOTAL_SIZE);
-    memset(ADDR, 0, TOTAL_SIZE);
+    memset(screen, 0, sizeof(screen));
+    __mark_dirty_from(screen);
+    __video_flush();
 }
 
 void video_new_line(void)
@@ -326,9 +482,9 @@ void video_new_line(void)
         return;
     }
 #endif
-    pointer = ADDR + ((pointer - ADDR) / W2 + 1) * W2;
+    pointer = screen + ((pointer - screen) / W2 + 1) * W2;
     video_shift_one_line_up();
-    video_set_cursor_auto();
+    __video_flush();
 }
 
 void video_cartridge_return(void)
@@ -339,27 +495,26 @@ void video_cartridge_return(void)
         return;
     }
 #endif
-    pointer = ADDR + ((pointer - ADDR) / W2 - 1) * W2;
+    pointer = screen + ((pointer - screen) / W2 - 1) * W2;
     video_new_line();
     video_shift_one_line_up();
-    video_set_cursor_auto();
+    __video_flush();
 }
 
 void video_shift_one_line_up(void)
 {
-    if (pointer >= ADDR + TOTAL_SIZE) {
+    if (pointer >= screen + TOTAL_SIZE) {
         // Move the upper buffer up by one line.
-        for (int row = 0; row < (STORED_PAGES * HEIGHT); ++row) {
-            memcpy(upper_buffer + W2 * row, upper_buffer + W2 * (row + 1), 2 * WIDTH);
-        }
+        memmove(upper_buffer, upper_buffer + W2, (STORED_PAGES * TOTAL_SIZE) - W2);
         // Copy the first line on the screen inside the last line of the upper buffer.
-        memcpy(upper_buffer + (TOTAL_SIZE * STORED_PAGES - W2), ADDR, 2 * WIDTH);
-        // Move the screen up by one line.
-        for (int row = 0; row < HEIGHT; ++row) {
-            memcpy(ADDR + (W2 * row), ADDR + (W2 * (row + 1)), 2 * WIDTH);
-        }
+        memcpy(upper_buffer + (TOTAL_SIZE * STORED_PAGES - W2), screen, 2 * WIDTH);
+        // Move the screen up by one line, the spare row becomes the last one.
+        memmove(screen, screen + W2, TOTAL_SIZE);
+        memset(screen + TOTAL_SIZE, 0, W2);
+        __mark_dirty_from(screen);
         // Update the pointer.
-        pointer = ADDR + ((pointer - ADDR) / W2 - 1) * W2;
+        pointer = screen + ((pointer - screen) / W2 - 1) * W2;
+        __video_flush();
     }
 }
 
@@ -370,10 +525,12 @@ void video_shift_one_page_up(void)
         int page_to_load = (STORED_PAGES - (--scrolled_page));
         // If we have reached 0, restore the original page.
         if (scrolled_page == 0) {
-            memcpy(ADDR, original_page, TOTAL_SIZE);
+            memcpy(screen, original_page, TOTAL_SIZE);
         } else {
-            memcpy(ADDR, upper_buffer + (page_to_load * TOTAL_SIZE), TOTAL_SIZE);
+            memcpy(screen, upper_buffer + (page_to_load * TOTAL_SIZE), TOTAL_SIZE);
         }
+        __mark_dirty_from(screen);
+        __video_flush();
     }
 }
 
@@ -384,10 +541,12 @@ void video_shift_one_page_down(void)
         int page_to_load = (STORED_PAGES - (++scrolled_page));
         // If we are loading the first history page, save the original.
         if (scrolled_page == 1) {
-            memcpy(original_page, ADDR, TOTAL_SIZE);
+            memcpy(original_page, screen, TOTAL_SIZE);
         }
         // Load the specific page.
-        memcpy(ADDR, upper_buffer + (page_to_load * TOTAL_SIZE), TOTAL_SIZE);
+        memcpy(screen, upper_buffer + (page_to_load * TOTAL_SIZE), TOTAL_SIZE);
+        __mark_dirty_from(screen);
+        __video_flush();
     }
 }
 
@@ -85,3 +85,40 @@ struct ipc_perm register_ipc(key_t key, mode_t mode)
     ip.__seq = 0;
     return ip;
 }
+
+int ipc_ids_init(ipc_ids_t *ids)
+{
+    assert(ids && "Received a NULL pointer.");
+    // Both ids and keys are integers, stored in place of the keys pointers.
+    ids->by_id  = hashmap_create(IPC_IDS_BUCKETS, hashmap_int_hash, hashmap_int_comp, hashmap_do_not_duplicate, hashmap_do_not_free);
+    ids->by_key = hashmap_create(IPC_IDS_BUCKETS, hashmap_int_hash, hashmap_int_comp, hashmap_do_not_duplicate, hashmap_do_not_free);
+    if (!ids->by_id || !ids->by_key) {
+        pr_err("Failed to allocate the IPC tables.\n");
+        return -1;
+    }
+    return 0;
+}
+
+void ipc_ids_add(ipc_ids_t *ids, int id, key_t key, void *entry)
+{
+    assert(ids && entry && "Received a NULL pointer.");
+    hashmap_set(ids->by_id, (const void *)id, entry);
+    hashmap_set(ids->by_key, (const void *)key, entry);
+}
+
+void ipc_ids_remove(ipc_ids_t *ids, int id, key_t key)
+{
+    assert(ids && "Received a NULL pointer.");
+    hashmap_remove(ids->by_id, (const void *)id);
+    hashmap_remove(ids->by_key, (const void *)key);
+}
+
+void *ipc_ids_find_by_id(ipc_ids_t *ids, int id)
+{
+    return hashmap_get(ids->by_id, (const void *)id);
+}
+
+void *ipc_ids_find_by_key(ipc_ids_t *ids, key_t key)
+{
+    return hashmap_get(ids->by_key, (const void *)key);
+}
@@ -0,0 +1,643 @@
+/// @file mqueue.c
+/// @brief POSIX message queues.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// The room of a queue is allocated when it is created, together with the
+/// queue: mq_maxmsg slots of mq_msgsize bytes, a stack of the free slots, and
+/// a binary heap of the slots holding a message, ordered by priority and then
+/// by the order they were sent. Sending takes a free slot and pushes it on
+/// the heap, receiving pops the top of the heap and frees its slot, both in
+/// O(log n) and without allocating memory. The message is copied while the
+/// slot is owned by the caller alone, outside of the lock of the queue.
+
+// Setup the logging for this file (do this before any other include).
+#include "sys/kernel_levels.h"           // Include kernel log levels.
+#define __DEBUG_HEADER__ "[MQUEUE]"      ///< Change header.
+#define __DEBUG_LEVEL__  LOGLEVEL_NOTICE ///< Set log level.
+#include "io/debug.h"                    // Include debugging functions.
+
+#include "fcntl.h"
+#include "fs/poll.h"
+#include "fs/vfs.h"
+#include "ipc/ipc.h"
+#include "klib/irqflags.h"
+#include "klib/spinlock.h"
+#include "limits.h"
+#include "mem/kheap.h"
+#include "mem/slab.h"
+#include "mqueue.h"
+#include "poll.h"
+#include "process/process.h"
+#include "process/scheduler.h"
+#include "process/wait.h"
+#include "string.h"
+#include "sys/errno.h"
+
+/// @brief The state of a slot holding a message.
+typedef struct mq_slot_t {
+    /// The priority of the message.
+    unsigned int prio;
+    /// The order the message was sent in, among all those of the queue.
+    unsigned int seq;
+    /// The size of the message.
+    size_t size;
+} mq_slot_t;
+
+/// @brief A message queue, allocated together with its slots.
+typedef struct mq_queue_t {
+    /// The name of the queue, starting with a slash.
+    char name[NAME_MAX + 1];
+    /// The owner and the mode of the queue.
+    struct ipc_perm perm;
+    /// The number of slots.
+    long maxmsg;
+    /// The size of a slot.
+    long msgsize;
+    /// The state of the slots.
+    mq_slot_t *slots;
+    /// The slots holding a message, as a heap whose top is received first.
+    unsigned int *heap;
+    /// The number of messages in the heap.
+    unsigned int heap_count;
+    /// The free slots.
+    unsigned int *free;
+    /// The number of free slots.
+    unsigned int free_count;
+    /// The content of the slots.
+    char *data;
+    /// The order of the next message sent.
+    unsigned int seq;
+    /// The open descriptors, protected by the lock of the table.
+    int refcount;
+    /// If the name is still in the table, protected by the lock of the table.
+    int linked;
+    /// The process registered for the notification, 0 if there is none.
+    pid_t notify_pid;
+    /// The descriptor used to register, whose closing removes the registration.
+    vfs_file_t *notify_file;
+    /// How the registered process is notified.
+    struct sigevent notify;
+    /// The processes waiting for a message.
+    wait_queue_head_t receivers;
+    /// The processes waiting for a free slot.
+    wait_queue_head_t senders;
+    /// Protects the slots, the heap, and the notification.
+    spinlock_t lock;
+    /// Reference inside the table of the queues.
+    list_head list;
+} mq_queue_t;
+
+/// The queues which have a name.
+static list_head mq_table = { &mq_table, &mq_table };
+/// Protects the table of the queues, and their counters of descriptors.
+static spinlock_t mq_table_lock;
+
+/// @brief Locks a queue, with the interrupts disabled.
+/// @param mq the queue.
+/// @return the previous state of the interrupts.
+static inline uint8_t __mq_lock(mq_queue_t *mq)
+{
+    uint8_t flags = irq_disable();
+    spinlock_lock(&mq->lock);
+    return flags;
+}
+
+/// @brief Unlocks a queue.
+/// @param mq the queue.
+/// @param flags the previous state of the interrupts.
+static inline void __mq_unlock(mq_queue_t *mq, uint8_t flags)
+{
+    spinlock_unlock(&mq->lock);
+    irq_enable(flags);
+}
+
+/// @brief Locks the table of the queues, with the interrupts disabled.
+/// @return the previous state of the interrupts.
+static inline uint8_t __mq_table_lock(void)
+{
+    uint8_t flags = irq_disable();
+    spinlock_lock(&mq_table_lock);
+    return flags;
+}
+
+/// @brief Unlocks the table of the queues.
+/// @param flags the previous state of the interrupts.
+static inline void __mq_table_unlock(uint8_t flags)
+{
+    spinlock_unlock(&mq_table_lock);
+    irq_enable(flags);
+}
+
+/// @brief Checks if a message is received before another one.
+/// @param mq the queue.
+/// @param a the slot of the first message.
+/// @param b the slot of the second message.
+/// @return 1 if the first message has a higher priority, or the same one and
+/// was sent before, 0 otherwise.
+static inline int __mq_before(mq_queue_t *mq, unsigned int a, unsigned int b)
+{
+    if (mq->slots[a].prio != mq->slots[b].prio) {
+        return mq->slots[a].prio > mq->slots[b].prio;
+    }
+    // The difference survives the wrap around of the counter.
+    return (int)(mq->slots[a].seq - mq->slots[b].seq) < 0;
+}
+
+/// @brief Pushes a message on the heap.
+/// @param mq the queue, which is locked.
+/// @param slot the slot of the message.
+static void __mq_heap_push(mq_queue_t *mq, unsigned int slot)
+{
+    unsigned int i = mq->heap_count++;
+    while (i > 0) {
+        unsigned int parent = (i - 1) / 2;
+        if (!__mq_before(mq, slot, mq->heap[parent])) {
+            break;
+        }
+        mq->heap[i] = mq->heap[parent];
+        i           = parent;
+    }
+    mq->heap[i] = slot;
+}
+
+/// @brief Pops the message received first from the heap.
+/// @param mq the queue, which is locked and not empty.
+/// @return the slot of the message.
+static unsigned int __mq_heap_pop(mq_queue_t *mq)
+{
+    unsigned int top = mq->heap[0], last = mq->heap[--mq->heap_count], i = 0;
+    for (unsigned int child = 1; child < mq->heap_count; child = (2 * i) + 1) {
+        if ((child + 1 < mq->heap_count) && __mq_before(mq, mq->heap[child + 1], mq->heap[child])) {
+            ++child;
+        }
+        if (!__mq_before(mq, mq->heap[child], last)) {
+            break;
+        }
+        mq->heap[i] = mq->heap[child];
+        i           = child;
+    }
+    mq->heap[i] = last;
+    return top;
+}
+
+/// @brief Checks the name of a queue.
+/// @param name the name.
+/// @return 0 if it is valid, -EINVAL, -ENAMETOOLONG or -EFAULT otherwise.
+static int __mq_check_name(const char *name)
+{
+    if (name == NULL) {
+        return -EFAULT;
+    }
+    // A slash, followed by at least one character, and no other slash.
+    if ((name[0] != '/') || (name[1] == 0) || strchr(name + 1, '/')) {
+        return -EINVAL;
+    }
+    if (strlen(name) > NAME_MAX) {
+        return -ENAMETOOLONG;
+    }
+    return 0;
+}
+
+/// @brief Searches the table for a queue.
+/// @param name the name of the queue.
+/// @return the queue, NULL if there is none.
+static mq_queue_t *__mq_find(const char *name)
+{
+    list_for_each_decl(it, &mq_table)
+    {
+        mq_queue_t *mq = list_entry(it, mq_queue_t, list);
+        if (strcmp(mq->name, name) == 0) {
+            return mq;
+        }
+    }
+    return NULL;
+}
+
+/// @brief Allocates a queue, with the room of its messages.
+/// @param name the name of the queue.
+/// @param mode the mode of the queue.
+/// @param attr the attributes, NULL for the default ones.
+/// @param mq where the queue is stored.
+/// @return 0 on success, -EINVAL if the attributes are not valid, -ENOMEM.
+static int __mq_alloc(const char *name, mode_t mode, const struct mq_attr *attr, mq_queue_t **mq)
+{
+    long maxmsg = MQ_MAXMSG_DEFAULT, msgsize = MQ_MSGSIZE_DEFAULT;
+    if (attr) {
+        maxmsg  = attr->mq_maxmsg;
+        msgsize = attr->mq_msgsize;
+        if ((maxmsg <= 0) || (maxmsg > MQ_MAXMSG_MAX) || (msgsize <= 0) || (msgsize > MQ_MSGSIZE_MAX) ||
+            (maxmsg * msgsize > MQ_BYTES_MAX)) {
+            return -EINVAL;
+        }
+    }
+    // The queue, the state of the slots, the heap, the free slots, and the
+    // content of the slots, in this order.
+    size_t size = sizeof(mq_queue_t) + (maxmsg * (sizeof(mq_slot_t) + 2 * sizeof(unsigned int))) + (maxmsg * msgsize);
+    mq_queue_t *queue = (mq_queue_t *)kmalloc(size);
+    if (queue == NULL) {
+        return -ENOMEM;
+    }
+    memset(queue, 0, sizeof(mq_queue_t));
+    strcpy(queue->name, name);
+    queue->perm       = register_ipc(IPC_PRIVATE, mode & 0777);
+    queue->maxmsg     = maxmsg;
+    queue->msgsize    = msgsize;
+    queue->slots      = (mq_slot_t *)(queue + 1);
+    queue->heap       = (unsigned int *)(queue->slots + maxmsg);
+    queue->free       = queue->heap + maxmsg;
+    queue->data       = (char *)(queue->free + maxmsg);
+    queue->free_count = maxmsg;
+    // Hand out the first slots first.
+    for (unsigned int slot = 0; slot < maxmsg; ++slot) {
+        queue->free[slot] = maxmsg - 1 - slot;
+    }
+    queue->refcount = 1;
+    queue->linked   = 1;
+    init_waitqueue_head(&queue->receivers);
+    init_waitqueue_head(&queue->senders);
+    spinlock_init(&queue->lock);
+    list_head_init(&queue->list);
+    *mq = queue;
+    return 0;
+}
+
+/// @brief Releases a descriptor of a queue, and destroys the queue once it has
+/// neither descriptors nor name.
+/// @param mq the queue.
+static void __mq_put(mq_queue_t *mq)
+{
+    uint8_t flags = __mq_table_lock();
+    int destroy   = (--mq->refcount == 0) && !mq->linked;
+    __mq_table_unlock(flags);
+    if (destroy) {
+        pr_debug("Destroying the queue `%s`.\n", mq->name);
+        kfree(mq);
+    }
+}
+
+/// @brief Sends the notification of a queue.
+/// @param mq the queue.
+/// @param pid the registered process.
+/// @param notify how it is notified.
+static void __mq_notify_send(mq_queue_t *mq, pid_t pid, struct sigevent *notify)
+{
+    if (notify->sigev_notify != SIGEV_SIGNAL) {
+        return;
+    }
+    task_struct *process = scheduler_get_running_process(pid);
+    if (process == NULL) {
+        return;
+    }
+    task_struct *task = scheduler_get_current_process();
+    siginfo_t info;
+    memset(&info, 0, sizeof(siginfo_t));
+    info.si_signo = notify->sigev_signo;
+    info.si_code  = SI_MESGQ;
+    info.si_value = notify->sigev_value;
+    info.si_pid   = task->pid;
+    info.si_uid   = task->uid;
+    __send_sig_info(notify->sigev_signo, &info, process);
+}
+
+static int __mq_close(vfs_file_t *file)
+{
+    mq_queue_t *mq = (mq_queue_t *)file->device;
+    uint8_t flags  = __mq_lock(mq);
+    if (mq->notify_file == file) {
+        mq->notify_pid  = 0;
+        mq->notify_file = NULL;
+    }
+    __mq_unlock(mq, flags);
+    __mq_put(mq);
+    kmem_cache_free(file);
+    return 0;
+}
+
+/// @brief Returns the events ready on a queue, which is readable when it holds
+/// a message, and writable when it has a free slot.
+/// @param file the descriptor of the queue.
+/// @param table the table of the polling process, NULL if it does not sleep.
+/// @return the events.
+static unsigned int __mq_poll(vfs_file_t *file, poll_table_t *table)
+{
+    mq_queue_t *mq = (mq_queue_t *)file->device;
+    poll_wait(file, &mq->receivers, table);
+    poll_wait(file, &mq->senders, table);
+    uint8_t flags       = __mq_lock(mq);
+    unsigned int events = 0;
+    if (mq->heap_count) {
+        events |= POLLIN | POLLRDNORM;
+    }
+    if (mq->free_count) {
+        events |= POLLOUT | POLLWRNORM;
+    }
+    __mq_unlock(mq, flags);
+    return events;
+}
+
+/// Filesystem general operations.
+static vfs_sys_operations_t mq_sys_operations = {
+    .mkdir_f   = NULL,
+    .rmdir_f   = NULL,
+    .stat_f    = NULL,
+    .creat_f   = NULL,
+    .symlink_f = NULL,
+};
+
+/// Filesystem file operations.
+static vfs_file_operations_t mq_fs_operations = {
+    .open_f     = NULL,
+    .unlink_f   = NULL,
+    .close_f    = __mq_close,
+    .read_f     = NULL,
+    .write_f    = NULL,
+    .lseek_f    = NULL,
+    .stat_f     = NULL,
+    .ioctl_f    = NULL,
+    .getdents_f = NULL,
+    .readlink_f = NULL,
+    .poll_f     = __mq_poll,
+};
+
+/// @brief Returns the queue of a descriptor of the calling process.
+/// @param mqdes the descriptor.
+/// @param file where the file of the descriptor is stored.
+/// @param mq where the queue is stored.
+/// @return 0 on success, -EBADF if the descriptor is not an open queue.
+static inline int __mq_get(mqd_t mqdes, vfs_file_t **file, mq_queue_t **mq)
+{
+    task_struct *task = scheduler_get_current_process();
+    if ((mqdes < 0) || (mqdes >= task->files->max_fd) || !task->files->fd_list[mqdes].file_struct) {
+        return -EBADF;
+    }
+    *file = task->files->fd_list[mqdes].file_struct;
+    if ((*file)->fs_operations != &mq_fs_operations) {
+        return -EBADF;
+    }
+    *mq = (mq_queue_t *)(*file)->device;
+    return 0;
+}
+
+int sys_mq_open(const char *name, int oflag, mode_t mode, struct mq_attr *attr)
+{
+    task_struct *task = scheduler_get_current_process();
+    mq_queue_t *mq = NULL, *created = NULL;
+    int ret = __mq_check_name(name);
+    if (ret < 0) {
+        return ret;
+    }
+    if ((oflag & ~(O_ACCMODE | O_CREAT | O_EXCL | O_NONBLOCK)) || ((oflag & O_ACCMODE) == O_ACCMODE)) {
+        return -EINVAL;
+    }
+    // Allocate the queue up front, the table is locked with the interrupts
+    // disabled.
+    if (oflag & O_CREAT) {
+        ret = __mq_alloc(name, mode, attr, &created);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    uint8_t flags = __mq_table_lock();
+    mq            = __mq_find(name);
+    if (mq) {
+        if ((oflag & O_CREAT) && (oflag & O_EXCL)) {
+            ret = -EEXIST;
+        } else if (!ipc_valid_permissions(oflag & O_ACCMODE, &mq->perm)) {
+            ret = -EACCES;
+        } else {
+            ++mq->refcount;
+        }
+    } else if (created) {
+        mq      = created;
+        created = NULL;
+        list_head_insert_before(&mq->list, &mq_table);
+    } else {
+        ret = -ENOENT;
+    }
+    __mq_table_unlock(flags);
+    if (created) {
+        kfree(created);
+    }
+    if (ret < 0) {
+        return ret;
+    }
+    vfs_file_t *file = kmem_cache_alloc(vfs_file_cache, GFP_KERNEL);
+    if (!file) {
+        __mq_put(mq);
+        return -ENOMEM;
+    }
+    memset(file, 0, sizeof(vfs_file_t));
+    strcpy(file->name, "anon_inode:[mqueue]");
+    file->device         = mq;
+    file->uid            = mq->perm.uid;
+    file->gid            = mq->perm.gid;
+    file->mask           = mq->perm.mode;
+    file->open_flags     = oflag & (O_ACCMODE | O_NONBLOCK);
+    file->count          = 1;
+    file->nlink          = 1;
+    file->sys_operations = &mq_sys_operations;
+    file->fs_operations  = &mq_fs_operations;
+    list_head_init(&file->siblings);
+    int fd = get_unused_fd();
+    if (fd < 0) {
+        __mq_put(mq);
+        kmem_cache_free(file);
+        return fd;
+    }
+    vfs_install_fd(task->files, fd, file, file->open_flags);
+    pr_debug("Opened queue `%s` as %d for process %d.\n", name, fd, task->pid);
+    return fd;
+}
+
+int sys_mq_unlink(const char *name)
+{
+    int ret = __mq_check_name(name);
+    if (ret < 0) {
+        return ret;
+    }
+    uint8_t flags  = __mq_table_lock();
+    mq_queue_t *mq = __mq_find(name);
+    int destroy    = 0;
+    if (mq == NULL) {
+        ret = -ENOENT;
+    } else if (!ipc_valid_permissions(O_WRONLY, &mq->perm)) {
+        ret = -EACCES;
+    } else {
+        list_head_remove(&mq->list);
+        mq->linked = 0;
+        destroy    = (mq->refcount == 0);
+    }
+    __mq_table_unlock(flags);
+    if (destroy) {
+        kfree(mq);
+    }
+    return ret;
+}
+
+int sys_mq_send(mqd_t mqdes, const char *msg_ptr, size_t msg_len, unsigned int msg_prio)
+{
+    vfs_file_t *file;
+    mq_queue_t *mq;
+    int ret = __mq_get(mqdes, &file, &mq);
+    if (ret < 0) {
+        return ret;
+    }
+    if ((file->open_flags & O_ACCMODE) == O_RDONLY) {
+        return -EBADF;
+    }
+    if (msg_len > (size_t)mq->msgsize) {
+        return -EMSGSIZE;
+    }
+    if (msg_prio >= MQ_PRIO_MAX) {
+        return -EINVAL;
+    }
+    if ((msg_ptr == NULL) && (msg_len != 0)) {
+        return -EFAULT;
+    }
+    uint8_t flags = __mq_lock(mq);
+    if (mq->free_count == 0) {
+        if (bitmask_check(file->open_flags, O_NONBLOCK)) {
+            __mq_unlock(mq, flags);
+            return -EAGAIN;
+        }
+        // Queue ourselves before unlocking, so that no free slot is missed.
+        sleep_on(&mq->senders)->func = autoremove_wake_function;
+        __mq_unlock(mq, flags);
+        return -ERESTARTSYS;
+    }
+    unsigned int slot = mq->free[--mq->free_count];
+    __mq_unlock(mq, flags);
+    // The slot is ours alone, copy the message without the lock.
+    memcpy(mq->data + (slot * mq->msgsize), msg_ptr, msg_len);
+    flags                = __mq_lock(mq);
+    mq->slots[slot].prio = msg_prio;
+    mq->slots[slot].seq  = mq->seq++;
+    mq->slots[slot].size = msg_len;
+    __mq_heap_push(mq, slot);
+    // Notify the arrival on the empty queue, unless somebody is already
+    // waiting to receive the message.
+    pid_t notify_pid = 0;
+    struct sigevent notify;
+    if ((mq->heap_count == 1) && mq->notify_pid && list_head_empty(&mq->receivers.task_list)) {
+        notify_pid      = mq->notify_pid;
+        notify          = mq->notify;
+        mq->notify_pid  = 0;
+        mq->notify_file = NULL;
+    }
+    __mq_unlock(mq, flags);
+    wake_up(&mq->receivers);
+    if (notify_pid) {
+        __mq_notify_send(mq, notify_pid, &notify);
+    }
+    return 0;
+}
+
+ssize_t sys_mq_receive(mqd_t mqdes, char *msg_ptr, size_t msg_len, unsigned int *msg_prio)
+{
+    vfs_file_t *file;
+    mq_queue_t *mq;
+    int ret = __mq_get(mqdes, &file, &mq);
+    if (ret < 0) {
+        return ret;
+    }
+    if ((file->open_flags & O_ACCMODE) == O_WRONLY) {
+        return -EBADF;
+    }
+    if (msg_len < (size_t)mq->msgsize) {
+        return -EMSGSIZE;
+    }
+    if (msg_ptr == NULL) {
+        return -EFAULT;
+    }
+    uint8_t flags = __mq_lock(mq);
+    if (mq->heap_count == 0) {
+        if (bitmask_check(file->open_flags, O_NONBLOCK)) {
+            __mq_unlock(mq, flags);
+            return -EAGAIN;
+        }
+        // Queue ourselves before unlocking, so that no message is missed.
+        sleep_on(&mq->receivers)->func = autoremove_wake_function;
+        __mq_unlock(mq, flags);
+        return -ERESTARTSYS;
+    }
+    unsigned int slot = __mq_heap_pop(mq);
+    unsigned int prio = mq->slots[slot].prio;
+    size_t size       = mq->slots[slot].size;
+    __mq_unlock(mq, flags);
+    // The slot is ours alone until it is freed.
+    memcpy(msg_ptr, mq->data + (slot * mq->msgsize), size);
+    flags                      = __mq_lock(mq);
+    mq->free[mq->free_count++] = slot;
+    __mq_unlock(mq, flags);
+    wake_up(&mq->senders);
+    if (msg_prio) {
+        *msg_prio = prio;
+    }
+    return size;
+}
+
+int sys_mq_notify(mqd_t mqdes, const struct sigevent *notification)
+{
+    task_struct *task = scheduler_get_current_process();
+    vfs_file_t *file;
+    mq_queue_t *mq;
+    int ret = __mq_get(mqdes, &file, &mq);
+    if (ret < 0) {
+        return ret;
+    }
+    if (notification) {
+        if ((notification->sigev_notify != SIGEV_SIGNAL) && (notification->sigev_notify != SIGEV_NONE)) {
+            return -EINVAL;
+        }
+        if ((notification->sigev_notify == SIGEV_SIGNAL) &&
+            ((notification->sigev_signo <= 0) || (notification->sigev_signo >= NSIG))) {
+            return -EINVAL;
+        }
+    }
+    uint8_t flags = __mq_lock(mq);
+    // Forget the registration of a process which is gone.
+    if (mq->notify_pid && !scheduler_get_running_process(mq->notify_pid)) {
+        mq->notify_pid  = 0;
+        mq->notify_file = NULL;
+    }
+    if (notification == NULL) {
+        if (mq->notify_pid == task->pid) {
+            mq->notify_pid  = 0;
+            mq->notify_file = NULL;
+        }
+    } else if (mq->notify_pid) {
+        ret = -EBUSY;
+    } else {
+        mq->notify_pid  = task->pid;
+        mq->notify_file = file;
+        mq->notify      = *notification;
+    }
+    __mq_unlock(mq, flags);
+    return ret;
+}
+
+int sys_mq_getsetattr(mqd_t mqdes, const struct mq_attr *mqstat, struct mq_attr *omqstat)
+{
+    vfs_file_t *file;
+    mq_queue_t *mq;
+    int ret = __mq_get(mqdes, &file, &mq);
+    if (ret < 0) {
+        return ret;
+    }
+    if (mqstat && (mqstat->mq_flags & ~O_NONBLOCK)) {
+        return -EINVAL;
+    }
+    if (omqstat) {
+        uint8_t flags       = __mq_lock(mq);
+        omqstat->mq_curmsgs = mq->heap_count;
+        __mq_unlock(mq, flags);
+        omqstat->mq_flags   = file->open_flags & O_NONBLOCK;
+        omqstat->mq_maxmsg  = mq->maxmsg;
+        omqstat->mq_msgsize = mq->msgsize;
+    }
+    if (mqstat) {
+        file->open_flags = (file->open_flags & ~O_NONBLOCK) | mqstat->mq_flags;
+    }
+    return 0;
+}
@@ -27,16 +27,45 @@
 ///@brief A value to compute the message queue ID.
 static int __msq_id = 0;
 
+/// The number of buckets of the table of the types of a queue.
+#define MSQ_TYPE_BUCKETS 16
+
+/// @brief A message, stored with its text in a single allocation.
+typedef struct msq_message_t {
+    /// The type of message.
+    long type;
+    /// The length of the message.
+    size_t size;
+    /// Reference inside the queue.
+    list_head list;
+    /// Reference inside the queue of its type.
+    list_head type_list;
+    /// The text of the message.
+    char text[];
+} msq_message_t;
+
+/// @brief The messages of a queue which have the same type.
+typedef struct msq_type_t {
+    /// The type of the messages.
+    long type;
+    /// The messages, in the order they were sent.
+    list_head messages;
+    /// Reference inside the list of types of the queue, sorted by type.
+    list_head list;
+} msq_type_t;
+
 /// @brief Message queue management structure.
 typedef struct {
     /// @brief ID associated to the message queue.
     int id;
     /// @brief The message queue data strcutre.
     struct msqid_ds msqid;
-    /// Pointer to the first message in the queue.
-    struct msg *msg_first;
-    /// Pointer to the last message in the queue.
-    struct msg *msg_last;
+    /// The messages, in the order they were sent.
+    list_head messages;
+    /// The types which have messages, sorted by type.
+    list_head types;
+    /// The types which have messages, by type.
+    hashmap_t *types_map;
     /// Reference inside the list of message queue management structures.
     list_head list;
 } msq_info_t;
@@ -44,6 +73,9 @@ typedef struct {
 /// @brief List of all current active Message queues.
 list_head msq_list;
 
+/// @brief Indexes of the message queues, by id and by key.
+static ipc_ids_t msq_ids;
+
 // ============================================================================
 // MEMORY MANAGEMENT (Private)
 // ============================================================================
@@ -62,8 +94,10 @@ static inline msq_info_t *__msq_info_alloc(key_t key, int msqflg)
     memset(msq_info, 0, sizeof(msq_info_t));
     // Initialize it.
     msq_info->id        = ++__msq_id;
-    msq_info->msg_first = NULL;
-    msq_info->msg_last  = NULL;
+    msq_info->types_map = hashmap_create(MSQ_TYPE_BUCKETS, hashmap_int_hash, hashmap_int_comp, hashmap_do_not_duplicate, hashmap_do_not_free);
+    assert(msq_info->types_map && "Failed to allocate memory for the types of a message queue.");
+    list_head_init(&msq_info->messages);
+    list_head_init(&msq_info->types);
     list_head_init(&msq_info->list);
     // Initialize the internal data structure.
     msq_info->msqid.msg_perm   = register_ipc(key, msqflg & 0x1FF);
@@ -85,16 +119,16 @@ static inline void __msq_info_dealloc(msq_info_t *msq_info)
 {
     assert(msq_info && "Received a NULL pointer.");
     // Free the memory of all the messages.
-    struct msg *message = msq_info->msg_first, *next = NULL;
-    while (message) {
-        next = message->msg_next;
-        // Free the memory of the message.
-        kfree(message->msg_ptr);
-        // Fre the memory of the msg structure.
-        kfree(message);
-        // Move to the next.
-        message = next;
+    list_for_each_safe_decl(it, store, &msq_info->messages)
+    {
+        kfree(list_entry(it, msq_message_t, list));
     }
+    // Free the memory of all the types.
+    list_for_each_safe_decl(it, store, &msq_info->types)
+    {
+        kfree(list_entry(it, msq_type_t, list));
+    }
+    hashmap_free(msq_info->types_map);
     // Deallocate the memory.
     kfree(msq_info);
 }
@@ -108,18 +142,7 @@ static inline void __msq_info_dealloc(msq_info_t *msq_info)
 /// @return the message queue with the given id.
 static inline msq_info_t *__list_find_msq_info_by_id(int msqid)
 {
-    msq_info_t *msq_info;
-    // Iterate through the list of message queue set.
-    list_for_each_decl(it, &msq_list)
-    {
-        // Get the current entry.
-        msq_info = list_entry(it, msq_info_t, list);
-        // If message queue set is valid, check the id.
-        if (msq_info && (msq_info->id == msqid)) {
-            return msq_info;
-        }
-    }
-    return NULL;
+    return ipc_ids_find_by_id(&msq_ids, msqid);
 }
 
 /// @brief Searches for the message queue with the given key.
@@ -127,18 +150,7 @@ static inline msq_info_t *__list_find_msq_info_by_id(int msqid)
 /// @return the message queue with the given key.
 static inline msq_info_t *__list_find_msq_info_by_key(key_t key)
 {
-    msq_info_t *msq_info;
-    // Iterate through the list of message queue set.
-    list_for_each_decl(it, &msq_list)
-    {
-        // Get the current entry.
-        msq_info = list_entry(it, msq_info_t, list);
-        // If message queue set is valid, check the id.
-        if (msq_info && (msq_info->msqid.msg_perm.key == key)) {
-            return msq_info;
-        }
-    }
-    return NULL;
+    return ipc_ids_find_by_key(&msq_ids, key);
 }
 
 static inline void __list_add_msq_info(msq_info_t *msq_info)
@@ -146,6 +158,8 @@ static inline void __list_add_msq_info(msq_info_t *msq_info)
     assert(msq_info && "Received a NULL pointer.");
     // Add the new msq_info at the end.
     list_head_insert_before(&msq_info->list, &msq_list);
+    // Index it by id and by key.
+    ipc_ids_add(&msq_ids, msq_info->id, msq_info->msqid.msg_perm.key, msq_info);
 }
 
 static inline void __list_remove_msq_info(msq_info_t *msq_info)
@@ -153,48 +167,89 @@ static inline void __list_remove_msq_info(msq_info_t *msq_info)
     assert(msq_info && "Received a NULL pointer.");
     // Delete the msq_info from the list.
     list_head_remove(&msq_info->list);
+    // Remove it from the indexes.
+    ipc_ids_remove(&msq_ids, msq_info->id, msq_info->msqid.msg_perm.key);
 }
 
-static inline void __msq_info_push_message(msq_info_t *msq_info, struct msg *message)
+static inline void __msq_info_push_message(msq_info_t *msq_info, msq_message_t *message)
 {
     assert(msq_info && "Received a NULL pointer.");
     assert(message && "Received a NULL pointer.");
-    // If there is no first message set, set it.
-    if (msq_info->msg_first == NULL) {
-        msq_info->msg_first = message;
-    }
-    // If there is no last message set, set it.
-    if (msq_info->msg_last == NULL) {
-        msq_info->msg_last = message;
-    } else { // Otherwise, append after the last.
-        msq_info->msg_last->msg_next = message;
-        msq_info->msg_last           = message;
+    // Get the queue of its type, or create it.
+    msq_type_t *type = hashmap_get(msq_info->types_map, (const void *)message->type);
+    if (type == NULL) {
+        type = (msq_type_t *)kmalloc(sizeof(msq_type_t));
+        assert(type && "Failed to allocate memory for the type of a message.");
+        type->type = message->type;
+        list_head_init(&type->messages);
+        // Keep the types sorted, insert it before the first bigger one.
+        list_head *next = &msq_info->types;
+        list_for_each_decl(it, &msq_info->types)
+        {
+            if (list_entry(it, msq_type_t, list)->type > type->type) {
+                next = it;
+                break;
+            }
+        }
+        list_head_insert_before(&type->list, next);
+        hashmap_set(msq_info->types_map, (const void *)type->type, type);
     }
+    // Append it to both queues.
+    list_head_insert_before(&message->list, &msq_info->messages);
+    list_head_insert_before(&message->type_list, &type->messages);
 }
 
-static inline void __msq_info_remove_message(msq_info_t *msq_info, struct msg *message)
+static inline void __msq_info_remove_message(msq_info_t *msq_info, msq_message_t *message)
 {
     assert(msq_info && "Received a NULL pointer.");
     assert(message && "Received a NULL pointer.");
-    // If the message is the first of the queue, next will become the first.
-    if (msq_info->msg_first == message) {
-        msq_info->msg_first = message->msg_next;
-    } else {
-        // Otherwise, we need to find the element before it, and connect the
-        // previous one with the next one.
-        for (struct msg *it = msq_info->msg_first; it; it = it->msg_next) {
-            if (it->msg_next == message) {
-                it->msg_next = message->msg_next;
-                break;
-            }
+    list_head_remove(&message->list);
+    list_head_remove(&message->type_list);
+    // Drop the type, once it has no messages.
+    msq_type_t *type = hashmap_get(msq_info->types_map, (const void *)message->type);
+    if (list_head_empty(&type->messages)) {
+        hashmap_remove(msq_info->types_map, (const void *)type->type);
+        list_head_remove(&type->list);
+        kfree(type);
+    }
+}
+
+/// @brief Searches for the message to receive.
+/// @param msq_info the message queue.
+/// @param msgtyp the type requested by the receiver.
+/// @return the message, NULL if there is none.
+static inline msq_message_t *__msq_info_find_message(msq_info_t *msq_info, long msgtyp)
+{
+    msq_type_t *type;
+    // If msgtyp is 0, then the first message in the queue is read.
+    if (msgtyp == 0) {
+        if (list_head_empty(&msq_info->messages)) {
+            return NULL;
+        }
+        return list_entry(msq_info->messages.next, msq_message_t, list);
+    }
+    // If msgtyp is greater than 0, then the first message in the queue of type
+    // msgtyp is read.
+    if (msgtyp > 0) {
+        type = hashmap_get(msq_info->types_map, (const void *)msgtyp);
+    }
+    // If msgtyp is less than 0, then the first message in the queue with the
+    // lowest type less than or equal to the absolute value of msgtyp will be
+    // read, the types are sorted thus it is the first type.
+    else {
+        if (list_head_empty(&msq_info->types)) {
+            return NULL;
+        }
+        type = list_entry(msq_info->types.next, msq_type_t, list);
+        if (type->type > -msgtyp) {
+            return NULL;
         }
     }
-    // If the message is the last of the queue, set the last to NULL.
-    if (msq_info->msg_last == message) {
-        msq_info->msg_last = NULL;
+    // The types have messages as long as they exist.
+    if (type == NULL) {
+        return NULL;
     }
-    // Clear the pointer in message.
-    message->msg_next = NULL;
+    return list_entry(type->messages.next, msq_message_t, type_list);
 }
 
 // ============================================================================
@@ -204,6 +259,9 @@ static inline void __msq_info_remove_message(msq_info_t *msq_info, struct msg *m
 int msq_init(void)
 {
     list_head_init(&msq_list);
+    if (ipc_ids_init(&msq_ids)) {
+        return 1;
+    }
     return 0;
 }
 
@@ -304,27 +362,24 @@ int sys_msgsnd(int msqid, const void *msgp, size_t msgsz, int msgflg)
     if (((msq_info->msqid.msg_cbytes + msgsz) >= msq_info->msqid.msg_qbytes)) {
         return -EAGAIN;
     }
-    // Allocate the memory for the message.
-    struct msg *message = (struct msg *)kmalloc(sizeof(struct msg));
+    // The type of the message must be positive.
+    if (_msgp->mtype <= 0) {
+        pr_err("The type of the message is not positive.\n");
+        return -EINVAL;
+    }
+    // Allocate the memory for the message, and its content, from the cache of
+    // the right size.
+    msq_message_t *message = (msq_message_t *)kmalloc(sizeof(msq_message_t) + msgsz);
     if (message == NULL) {
         pr_err("We failed to allocate the memory for the message.\n");
         return -ENOMEM;
     }
-    // Initialize the pointer to the next.
-    message->msg_next = NULL;
     // Copy the type of message.
-    message->msg_type = _msgp->mtype;
-    // Allocate the memory for the content of the message.
-    message->msg_ptr = (char *)kmalloc(msgsz);
-    if (message->msg_ptr == NULL) {
-        pr_err("We failed to allocate the memory for the message.\n");
-        kfree(message);
-        return -ENOMEM;
-    }
+    message->type = _msgp->mtype;
     // Copy the content of the message.
-    memcpy(message->msg_ptr, _msgp->mtext, msgsz);
+    memcpy(message->text, _msgp->mtext, msgsz);
     // The length of the message.
-    message->msg_size = msgsz;
+    message->size = msgsz;
     // Add the message to the queue.
     __msq_info_push_message(msq_info, message);
 
@@ -337,19 +392,25 @@ int sys_msgsnd(int msqid, const void *msgp, size_t msgsz, int msgflg)
     // Increment the number of messages in the message queue.
     msq_info->msqid.msg_qnum += 1;
 
-    pr_debug("[%2d] msg_lspid: %2d, msg_lrpid: %2d, msg_qnum: %2d, msg_cbytes: %4d (%s)\n",
+    pr_debug("[%2d] msg_lspid: %2d, msg_lrpid: %2d, msg_qnum: %2d, msg_cbytes: %4d (%.*s)\n",
              msq_info->id,
              msq_info->msqid.msg_lspid,
              msq_info->msqid.msg_lrpid,
              msq_info->msqid.msg_qnum,
              msq_info->msqid.msg_cbytes,
-             message->msg_ptr);
-    for (struct msg *it = msq_info->msg_first; it; it = it->msg_next) {
-        pr_debug("    type: %3ld, size: %3d, msg: `%s`\n",
-                 it->msg_type,
-                 it->msg_size,
-                 it->msg_ptr);
-    }
+             message->size,
+             message->text);
+#if __DEBUG_LEVEL__ == LOGLEVEL_DEBUG
+    list_for_each_decl(it, &msq_info->messages)
+    {
+        msq_message_t *entry = list_entry(it, msq_message_t, list);
+        pr_debug("    type: %3ld, size: %3d, msg: `%.*s`\n",
+                 entry->type,
+                 entry->size,
+                 entry->size,
+                 entry->text);
+    }
+#endif
     return 0;
 }
 
@@ -393,46 +454,14 @@ ssize_t sys_msgrcv(int msqid, void *msgp, size_t msgsz, long msgtyp, int msgflg)
                "calling process does not have read permission to access the set.\n");
         return -EACCES;
     }
-    // Prepare a structure for the message.
-    struct msg *message = NULL;
-    // If msgtyp is 0, then the first message in the queue is read.
-    if (msgtyp == 0) {
-        // Get the first message.
-        message = msq_info->msg_first;
-    }
-    // If msgtyp is greater than 0, then the first message in the queue of type
-    // msgtyp is read.
-    else if (msgtyp > 0) {
-        for (struct msg *it = msq_info->msg_first; it; it = it->msg_next) {
-            if (it->msg_type == msgtyp) {
-                message = it;
-                break;
-            }
-        }
-    }
-    // If msgtyp is less than 0, then the first message in the queue with the
-    // lowest type less than or equal to the absolute value of msgtyp will be
-    // read.
-    else {
-        long lowest_type = LONG_MAX;
-        for (struct msg *it = msq_info->msg_first; it; it = it->msg_next) {
-            if ((it->msg_type < abs(msgtyp)) && (it->msg_type < lowest_type)) {
-                lowest_type = it->msg_type;
-            }
-        }
-        for (struct msg *it = msq_info->msg_first; it; it = it->msg_next) {
-            if (it->msg_type == lowest_type) {
-                message = it;
-                break;
-            }
-        }
-    }
+    // Search for the message.
+    msq_message_t *message = __msq_info_find_message(msq_info, msgtyp);
     if (message == NULL) {
         // pr_err("There are no messages to read.\n");
         return -ENOMSG;
     }
     // Check if the message is longer than msgsz.
-    if (message->msg_size > msgsz) {
+    if (message->size > msgsz) {
         // If we have the MSG_NOERROR flag, we return E2BIG and leave the
         // message on the queue.
         if (!(msgflg & MSG_NOERROR)) {
@@ -442,39 +471,43 @@ ssize_t sys_msgrcv(int msqid, void *msgp, size_t msgsz, long msgtyp, int msgflg)
         // Otherwise, we truncate the message to msgsz.
     }
     // The number of bytes actually copied.
-    ssize_t actual_size = min(message->msg_size, msgsz);
+    ssize_t actual_size = min(message->size, msgsz);
     // Copy the content of the message (we might truncate).
-    memcpy(_msgp->mtext, message->msg_ptr, actual_size);
+    memcpy(_msgp->mtext, message->text, actual_size);
 
     // Update last receive time.
     msq_info->msqid.msg_rtime = sys_time(NULL);
     // Update pid of last process who issued a receive.
     msq_info->msqid.msg_lrpid = sys_getpid();
     // Update the total consumed space of the message queue.
-    msq_info->msqid.msg_cbytes -= message->msg_size;
+    msq_info->msqid.msg_cbytes -= message->size;
     // Decrement the number of messages in the message queue.
     msq_info->msqid.msg_qnum -= 1;
 
     // Remove the message to the queue.
     __msq_info_remove_message(msq_info, message);
 
-    pr_debug("[%2d] msg_lspid: %2d, msg_lrpid: %2d, msg_qnum: %2d, msg_cbytes: %4d (%s)\n",
+    pr_debug("[%2d] msg_lspid: %2d, msg_lrpid: %2d, msg_qnum: %2d, msg_cbytes: %4d (%.*s)\n",
              msq_info->id,
              msq_info->msqid.msg_lspid,
              msq_info->msqid.msg_lrpid,
              msq_info->msqid.msg_qnum,
              msq_info->msqid.msg_cbytes,
-             message->msg_ptr);
-    for (struct msg *it = msq_info->msg_first; it; it = it->msg_next) {
-        pr_debug("    type: %3ld, size: %3d, msg: `%s`\n",
-                 it->msg_type,
-                 it->msg_size,
-                 it->msg_ptr);
+             message->size,
+             message->text);
+#if __DEBUG_LEVEL__ == LOGLEVEL_DEBUG
+    list_for_each_decl(it, &msq_info->messages)
+    {
+        msq_message_t *entry = list_entry(it, msq_message_t, list);
+        pr_debug("    type: %3ld, size: %3d, msg: `%.*s`\n",
+                 entry->type,
+                 entry->size,
+                 entry->size,
+                 entry->text);
     }
+#endif
 
     // Free the memory of the message.
-    kfree(message->msg_ptr);
-    // Free the memory of the data structure.
     kfree(message);
 
     return actual_size;
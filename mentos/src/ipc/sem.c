@@ -29,6 +29,14 @@
 /// For testing purposes -> you can try the t_semget and the t_sem1 tests. They
 /// both use semaphores and blocking / non blocking operations. t_sem1 is also
 /// an exercise that was assingned by Professor Drago in the OS course.
+///
+/// # Blocking operations
+/// The processes share the kernel stack, thus they cannot sleep inside
+/// semop. An array of operations which cannot complete is queued on the set,
+/// and the process is put to sleep when it returns from the system call.
+/// Whoever changes the semaphores then retries the queued arrays, in order,
+/// completes those which can now complete on behalf of their processes,
+/// stores the result as their return value, and only then wakes them up.
 
 // ============================================================================
 // Setup the logging for this file (do this before any other include).
@@ -43,13 +51,15 @@
 
 #include "assert.h"
 #include "fcntl.h"
-#include "klib/list.h"
+#include "math.h"
 #include "process/process.h"
 #include "process/scheduler.h"
+#include "process/wait.h"
 #include "stdio.h"
 #include "stdlib.h"
 #include "string.h"
 #include "sys/errno.h"
+#include "sys/list_head.h"
 
 ///@brief A value to compute the semid value.
 int __sem_id = 0;
@@ -62,6 +72,11 @@ typedef struct {
     struct semid_ds semid;
     /// @brief List of all the semaphores.
     struct sem *sem_base;
+    /// @brief The arrays waiting on each semaphore, whose operations all
+    /// target that semaphore.
+    list_head *sem_pending;
+    /// @brief The arrays waiting on more than one semaphore.
+    list_head pending;
     /// Reference inside the list of semaphore management structures.
     list_head list;
 } sem_info_t;
@@ -69,6 +84,41 @@ typedef struct {
 /// @brief List of all current active semaphores.
 list_head semaphores_list;
 
+/// @brief Indexes of the semaphore sets, by id and by key.
+static ipc_ids_t sem_ids;
+
+/// @brief An array of operations waiting to be completed.
+typedef struct sem_queue_t {
+    /// The process which called semop.
+    task_struct *task;
+    /// The operations, copied from the process.
+    struct sembuf *sops;
+    /// The number of operations.
+    unsigned nsops;
+    /// The operation which blocked the array.
+    unsigned blocked;
+    /// The adjustments of the process, if an operation has SEM_UNDO.
+    struct sem_undo_t *undo;
+    /// Reference inside the pending list.
+    list_head list;
+} sem_queue_t;
+
+/// @brief The adjustments applied when a process exits, to undo the
+/// operations it did with SEM_UNDO.
+typedef struct sem_undo_t {
+    /// The process.
+    pid_t pid;
+    /// The semaphore set.
+    int semid;
+    /// The adjustment of each semaphore of the set.
+    short *adj;
+    /// Reference inside the list of adjustments.
+    list_head list;
+} sem_undo_t;
+
+/// @brief List of all the adjustments.
+static list_head sem_undo_list;
+
 // ============================================================================
 // MEMORY MANAGEMENT (Private)
 // ============================================================================
@@ -92,6 +142,14 @@ static inline sem_info_t *__sem_info_alloc(key_t key, int nsems, int semflg)
     assert(sem_info->sem_base && "Failed to allocate memory for a set of semaphores.");
     // Clean the memory.
     memset(sem_info->sem_base, 0, sizeof(struct sem) * nsems);
+    // Allocate the memory for the pending lists.
+    sem_info->sem_pending = (list_head *)kmalloc(sizeof(list_head) * nsems);
+    // Check the allocated memory.
+    assert(sem_info->sem_pending && "Failed to allocate memory for the pending lists.");
+    for (int i = 0; i < nsems; i++) {
+        list_head_init(&sem_info->sem_pending[i]);
+    }
+    list_head_init(&sem_info->pending);
     // Initialize its values.
     sem_info->id              = ++__sem_id;
     sem_info->semid.sem_perm  = register_ipc(key, semflg & 0x1FF);
@@ -115,6 +173,8 @@ static inline void __sem_info_dealloc(sem_info_t *sem_info)
     assert(sem_info && "Received a NULL pointer.");
     // Deallocate the array of semaphores.
     kfree(sem_info->sem_base);
+    // Deallocate the pending lists, which are empty by now.
+    kfree(sem_info->sem_pending);
     // Deallocate the semid memory.
     kfree(sem_info);
 }
@@ -128,18 +188,7 @@ static inline void __sem_info_dealloc(sem_info_t *sem_info)
 /// @return the semaphore with the given id.
 static inline sem_info_t *__list_find_sem_info_by_id(int semid)
 {
-    sem_info_t *sem_info;
-    // Iterate through the list of semaphore set.
-    list_for_each_decl(it, &semaphores_list)
-    {
-        // Get the current entry.
-        sem_info = list_entry(it, sem_info_t, list);
-        // If semaphore set is valid, check the id.
-        if (sem_info && (sem_info->id == semid)) {
-            return sem_info;
-        }
-    }
-    return NULL;
+    return ipc_ids_find_by_id(&sem_ids, semid);
 }
 
 /// @brief Searches for the semaphore with the given key.
@@ -147,18 +196,7 @@ static inline sem_info_t *__list_find_sem_info_by_id(int semid)
 /// @return the semaphore with the given key.
 static inline sem_info_t *__list_find_sem_info_by_key(key_t key)
 {
-    sem_info_t *sem_info;
-    // Iterate through the list of semaphore set.
-    list_for_each_decl(it, &semaphores_list)
-    {
-        // Get the current entry.
-        sem_info = list_entry(it, sem_info_t, list);
-        // If semaphore set is valid, check the id.
-        if (sem_info && (sem_info->semid.sem_perm.key == key)) {
-            return sem_info;
-        }
-    }
-    return NULL;
+    return ipc_ids_find_by_key(&sem_ids, key);
 }
 
 static inline void __list_add_sem_info(sem_info_t *sem_info)
@@ -166,6 +204,8 @@ static inline void __list_add_sem_info(sem_info_t *sem_info)
     assert(sem_info && "Received a NULL pointer.");
     // Add the new sem_info at the end.
     list_head_insert_before(&sem_info->list, &semaphores_list);
+    // Index it by id and by key.
+    ipc_ids_add(&sem_ids, sem_info->id, sem_info->semid.sem_perm.key, sem_info);
 }
 
 static inline void __list_remove_sem_info(sem_info_t *sem_info)
@@ -173,6 +213,238 @@ static inline void __list_remove_sem_info(sem_info_t *sem_info)
     assert(sem_info && "Received a NULL pointer.");
     // Delete the sem_info from the list.
     list_head_remove(&sem_info->list);
+    // Remove it from the indexes.
+    ipc_ids_remove(&sem_ids, sem_info->id, sem_info->semid.sem_perm.key);
+}
+
+// ============================================================================
+// OPERATIONS MANAGEMENT (Private)
+// ============================================================================
+
+/// @brief Searches for the adjustments of a process on a set, and creates
+/// them if needed.
+/// @param sem_info the semaphore set.
+/// @param pid the process.
+/// @return the adjustments.
+static inline sem_undo_t *__sem_undo_get(sem_info_t *sem_info, pid_t pid)
+{
+    sem_undo_t *undo;
+    list_for_each_decl(it, &sem_undo_list)
+    {
+        undo = list_entry(it, sem_undo_t, list);
+        if ((undo->pid == pid) && (undo->semid == sem_info->id)) {
+            return undo;
+        }
+    }
+    // Allocate the memory.
+    undo = (sem_undo_t *)kmalloc(sizeof(sem_undo_t));
+    assert(undo && "Failed to allocate memory for the adjustments.");
+    undo->adj = (short *)kmalloc(sizeof(short) * sem_info->semid.sem_nsems);
+    assert(undo->adj && "Failed to allocate memory for the adjustments.");
+    memset(undo->adj, 0, sizeof(short) * sem_info->semid.sem_nsems);
+    undo->pid   = pid;
+    undo->semid = sem_info->id;
+    list_head_insert_before(&undo->list, &sem_undo_list);
+    return undo;
+}
+
+/// @brief Frees the adjustments.
+/// @param undo the adjustments.
+static inline void __sem_undo_free(sem_undo_t *undo)
+{
+    list_head_remove(&undo->list);
+    kfree(undo->adj);
+    kfree(undo);
+}
+
+/// @brief Tries to perform an array of operations, either all of them or
+/// none.
+/// @param sem_info the semaphore set.
+/// @param sops the operations.
+/// @param nsops the number of operations.
+/// @param pid the process performing them.
+/// @param undo the adjustments of the process, if an operation has SEM_UNDO.
+/// @param blocked where the operation which would block is stored.
+/// @return 0 on success, -EAGAIN if the operations would block, -ERANGE if a
+/// semaphore would exceed SEMVMX.
+static int __sem_try_ops(sem_info_t *sem_info, struct sembuf *sops, unsigned nsops, pid_t pid, sem_undo_t *undo, unsigned *blocked)
+{
+    int ret = 0;
+    unsigned i;
+    for (i = 0; i < nsops; ++i) {
+        struct sem *sem = &sem_info->sem_base[sops[i].sem_num];
+        int value       = (int)sem->sem_val + sops[i].sem_op;
+        // Wait for zero, or for the value to be big enough.
+        if (((sops[i].sem_op == 0) && (sem->sem_val != 0)) || (value < 0)) {
+            *blocked = i;
+            ret      = -EAGAIN;
+            break;
+        }
+        if (value > SEMVMX) {
+            ret = -ERANGE;
+            break;
+        }
+        sem->sem_val = value;
+    }
+    if (ret < 0) {
+        // Revert the operations performed so far.
+        while (i--) {
+            sem_info->sem_base[sops[i].sem_num].sem_val -= sops[i].sem_op;
+        }
+        return ret;
+    }
+    for (i = 0; i < nsops; ++i) {
+        sem_info->sem_base[sops[i].sem_num].sem_pid = pid;
+        if (sops[i].sem_flg & SEM_UNDO) {
+            undo->adj[sops[i].sem_num] -= sops[i].sem_op;
+        }
+    }
+    // Update semop time.
+    sem_info->semid.sem_otime = sys_time(NULL);
+    return 0;
+}
+
+/// @brief Completes a queued array, and wakes up its process.
+/// @param sem_info the semaphore set.
+/// @param queue the queued array.
+/// @param ret the value returned by semop to the process.
+static inline void __sem_queue_complete(sem_info_t *sem_info, sem_queue_t *queue, int ret)
+{
+    struct sembuf *sop = &queue->sops[queue->blocked];
+    // The process is no longer waiting.
+    if (sop->sem_op == 0) {
+        --sem_info->sem_base[sop->sem_num].sem_zcnt;
+    } else {
+        --sem_info->sem_base[sop->sem_num].sem_ncnt;
+    }
+    list_head_remove(&queue->list);
+    // The process returns from semop with the result.
+    queue->task->thread.regs.eax = ret;
+    scheduler_set_task_state(queue->task, TASK_RUNNING);
+    kfree(queue->sops);
+    kfree(queue);
+}
+
+/// @brief Retries the arrays of a pending list, in order.
+/// @param sem_info the semaphore set.
+/// @param pending the pending list.
+/// @return 1 if an array was completed, 0 otherwise.
+static inline int __sem_update_list(sem_info_t *sem_info, list_head *pending)
+{
+    int done = 0;
+    list_for_each_safe_decl(it, store, pending)
+    {
+        sem_queue_t *queue = list_entry(it, sem_queue_t, list);
+        int ret            = __sem_try_ops(sem_info, queue->sops, queue->nsops, queue->task->pid, queue->undo, &queue->blocked);
+        if (ret != -EAGAIN) {
+            __sem_queue_complete(sem_info, queue, ret);
+            done = 1;
+        }
+    }
+    return done;
+}
+
+/// @brief Completes the queued arrays which can now complete.
+/// @param sem_info the semaphore set.
+/// @param semnum the semaphore which changed, -1 if any might have.
+static void __sem_update_queue(sem_info_t *sem_info, int semnum)
+{
+    int done;
+    do {
+        done = 0;
+        if (semnum < 0) {
+            for (unsigned i = 0; i < sem_info->semid.sem_nsems; ++i) {
+                done |= __sem_update_list(sem_info, &sem_info->sem_pending[i]);
+            }
+        } else {
+            done |= __sem_update_list(sem_info, &sem_info->sem_pending[semnum]);
+        }
+        // A completed array can change any semaphore.
+        if (__sem_update_list(sem_info, &sem_info->pending)) {
+            done   = 1;
+            semnum = -1;
+        }
+    } while (done);
+}
+
+/// @brief Queues an array of operations, and puts the process to sleep.
+/// @param sem_info the semaphore set.
+/// @param sops the operations.
+/// @param nsops the number of operations.
+/// @param undo the adjustments of the process, if an operation has SEM_UNDO.
+/// @param blocked the operation which blocked the array.
+static inline void __sem_queue_sleep(sem_info_t *sem_info, struct sembuf *sops, unsigned nsops, sem_undo_t *undo, unsigned blocked)
+{
+    // Allocate the memory.
+    sem_queue_t *queue = (sem_queue_t *)kmalloc(sizeof(sem_queue_t));
+    assert(queue && "Failed to allocate memory for a pending operation.");
+    queue->sops = (struct sembuf *)kmalloc(sizeof(struct sembuf) * nsops);
+    assert(queue->sops && "Failed to allocate memory for a pending operation.");
+    // The process memory is not reachable from whoever completes it.
+    memcpy(queue->sops, sops, sizeof(struct sembuf) * nsops);
+    queue->task    = scheduler_get_current_process();
+    queue->nsops   = nsops;
+    queue->blocked = blocked;
+    queue->undo    = undo;
+    // Queue it on the semaphore, if it is the only one involved.
+    list_head *pending = &sem_info->sem_pending[sops[0].sem_num];
+    for (unsigned i = 1; i < nsops; ++i) {
+        if (sops[i].sem_num != sops[0].sem_num) {
+            pending = &sem_info->pending;
+            break;
+        }
+    }
+    list_head_insert_before(&queue->list, pending);
+    if (sops[blocked].sem_op == 0) {
+        ++sem_info->sem_base[sops[blocked].sem_num].sem_zcnt;
+    } else {
+        ++sem_info->sem_base[sops[blocked].sem_num].sem_ncnt;
+    }
+    // The process sleeps once it returns from the system call.
+    scheduler_set_task_state(queue->task, TASK_UNINTERRUPTIBLE);
+}
+
+/// @brief Fails all the queued arrays of a set which is being removed.
+/// @param sem_info the semaphore set.
+static inline void __sem_queue_remove_all(sem_info_t *sem_info)
+{
+    for (unsigned i = 0; i < sem_info->semid.sem_nsems; ++i) {
+        list_for_each_safe_decl(it, store, &sem_info->sem_pending[i])
+        {
+            __sem_queue_complete(sem_info, list_entry(it, sem_queue_t, list), -EIDRM);
+        }
+    }
+    list_for_each_safe_decl(it, store, &sem_info->pending)
+    {
+        __sem_queue_complete(sem_info, list_entry(it, sem_queue_t, list), -EIDRM);
+    }
+    // Nobody can undo the operations anymore.
+    list_for_each_safe_decl(it, store, &sem_undo_list)
+    {
+        sem_undo_t *undo = list_entry(it, sem_undo_t, list);
+        if (undo->semid == sem_info->id) {
+            __sem_undo_free(undo);
+        }
+    }
+}
+
+/// @brief Drops the adjustments of a semaphore, whose value was set.
+/// @param sem_info the semaphore set.
+/// @param semnum the semaphore, -1 for all of them.
+static inline void __sem_undo_clear(sem_info_t *sem_info, int semnum)
+{
+    list_for_each_decl(it, &sem_undo_list)
+    {
+        sem_undo_t *undo = list_entry(it, sem_undo_t, list);
+        if (undo->semid != sem_info->id) {
+            continue;
+        }
+        if (semnum < 0) {
+            memset(undo->adj, 0, sizeof(short) * sem_info->semid.sem_nsems);
+        } else {
+            undo->adj[semnum] = 0;
+        }
+    }
 }
 
 // ============================================================================
@@ -182,6 +454,10 @@ static inline void __list_remove_sem_info(sem_info_t *sem_info)
 int sem_init(void)
 {
     list_head_init(&semaphores_list);
+    list_head_init(&sem_undo_list);
+    if (ipc_ids_init(&sem_ids)) {
+        return 1;
+    }
     return 0;
 }
 
@@ -250,6 +526,8 @@ long sys_semget(key_t key, int nsems, int semflg)
 long sys_semop(int semid, struct sembuf *sops, unsigned nsops)
 {
     sem_info_t *sem_info = NULL;
+    sem_undo_t *undo     = NULL;
+    unsigned blocked     = 0;
     // The semid is less than zero.
     if (semid < 0) {
         pr_err("The semid is less than zero.\n");
@@ -265,6 +543,11 @@ long sys_semop(int semid, struct sembuf *sops, unsigned nsops)
         pr_err("The value of nsops is negative.\n");
         return -EINVAL;
     }
+    // There are too many operations.
+    if (nsops > SEMOPM) {
+        pr_err("The value of nsops is greater than %d.\n", SEMOPM);
+        return -E2BIG;
+    }
     // Search for the semaphore.
     sem_info = __list_find_sem_info_by_id(semid);
     // The semaphore set doesn't exist.
@@ -272,33 +555,45 @@ long sys_semop(int semid, struct sembuf *sops, unsigned nsops)
         pr_err("The semaphore set doesn't exist.\n");
         return -EINVAL;
     }
-    // The value of sem_num is less than 0 or greater than or equal to the number of semaphores in the set.
-    if ((sops->sem_num < 0) || (sops->sem_num >= sem_info->semid.sem_nsems)) {
-        pr_err("The value of sem_num is less than 0 or greater than or equal to the number of semaphores in the set.\n");
-        return -EFBIG;
+    for (unsigned i = 0; i < nsops; ++i) {
+        // The value of sem_num is less than 0 or greater than or equal to the number of semaphores in the set.
+        if (sops[i].sem_num >= sem_info->semid.sem_nsems) {
+            pr_err("The value of sem_num is less than 0 or greater than or equal to the number of semaphores in the set.\n");
+            return -EFBIG;
+        }
     }
     // Check if the semaphore set exists for the given key, but the calling
     // process does not have permission to access the set.
-    if (sem_info && !ipc_valid_permissions(O_RDWR, &sem_info->semid.sem_perm)) {
+    if (!ipc_valid_permissions(O_RDWR, &sem_info->semid.sem_perm)) {
         pr_err("The semaphore set exists for the given key, but the calling process does not have permission to access the set.\n");
         return -EACCES;
     }
-    // Update semop time.
-    sem_info->semid.sem_otime = sys_time(NULL);
-    // If the operation is negative then we need to check for possible blocking
-    // operation. If the value of the sem were to become negative then we return
-    // a special value.
-    if (((int)sem_info->sem_base[sops->sem_num].sem_val + (int)sops->sem_op) < 0) {
-        // The value would become negative, we cannot perform the operation.
-        return -EAGAIN;
-    }
-    // Update the semaphore value.
-    sem_info->sem_base[sops->sem_num].sem_val += sops->sem_op;
-    // Update the pid of the process that did last op.
-    sem_info->sem_base[sops->sem_num].sem_pid = sys_getpid();
-    // Update the time.
-    sem_info->semid.sem_ctime = sys_time(NULL);
-    return 0;
+    // Get the adjustments now, so that they are there once the operations
+    // complete.
+    for (unsigned i = 0; i < nsops; ++i) {
+        if (sops[i].sem_flg & SEM_UNDO) {
+            undo = __sem_undo_get(sem_info, sys_getpid());
+            break;
+        }
+    }
+    // Perform all the operations, or none of them.
+    int ret = __sem_try_ops(sem_info, sops, nsops, sys_getpid(), undo, &blocked);
+    if (ret == -EAGAIN) {
+        // The operation cannot be performed, and the process does not want to
+        // wait.
+        if (sops[blocked].sem_flg & IPC_NOWAIT) {
+            return -EAGAIN;
+        }
+        // Wait until someone completes the operations for us, who also sets
+        // the value we return.
+        __sem_queue_sleep(sem_info, sops, nsops, undo, blocked);
+        return 0;
+    }
+    if (ret == 0) {
+        // The changes might complete the arrays waiting on the set.
+        __sem_update_queue(sem_info, (nsops == 1) ? sops[0].sem_num : -1);
+    }
+    return ret;
 }
 
 long sys_semctl(int semid, int semnum, int cmd, union semun *arg)
@@ -324,6 +619,8 @@ long sys_semctl(int semid, int semnum, int cmd, union semun *arg)
             pr_err("The calling process is not the creator or the owner of the semaphore set.\n");
             return -EPERM;
         }
+        // Wake up the processes waiting on the set.
+        __sem_queue_remove_all(sem_info);
         // Remove the set from the list.
         __list_remove_sem_info(sem_info);
         // Delete the set.
@@ -356,6 +653,10 @@ long sys_semctl(int semid, int semnum, int cmd, union semun *arg)
         sem_info->sem_base[semnum].sem_val = arg->val;
         // Update the last change time.
         sem_info->semid.sem_ctime = sys_time(NULL);
+        // The value is no longer the result of the operations to undo.
+        __sem_undo_clear(sem_info, semnum);
+        // Complete the arrays waiting for the new value.
+        __sem_update_queue(sem_info, semnum);
     } else if (cmd == SETALL) {
         // Initialize all semaphore in the set referred to by semid, using the
         // values supplied in the array pointed to by arg.array.
@@ -381,6 +682,10 @@ long sys_semctl(int semid, int semnum, int cmd, union semun *arg)
         }
         // Update the last change time.
         sem_info->semid.sem_ctime = sys_time(NULL);
+        // The values are no longer the result of the operations to undo.
+        __sem_undo_clear(sem_info, -1);
+        // Complete the arrays waiting for the new values.
+        __sem_update_queue(sem_info, -1);
     } else if (cmd == IPC_STAT) {
         // Place a copy of the semid_ds data structure in the buffer pointed to by
         // arg.buf.
@@ -491,6 +796,33 @@ long sys_semctl(int semid, int semnum, int cmd, union semun *arg)
     return 0;
 }
 
+void sem_exit(pid_t pid)
+{
+    list_for_each_safe_decl(it, store, &sem_undo_list)
+    {
+        sem_undo_t *undo = list_entry(it, sem_undo_t, list);
+        if (undo->pid != pid) {
+            continue;
+        }
+        sem_info_t *sem_info = __list_find_sem_info_by_id(undo->semid);
+        if (sem_info) {
+            // Apply the adjustments, without going below zero or above SEMVMX.
+            for (unsigned i = 0; i < sem_info->semid.sem_nsems; ++i) {
+                int value = (int)sem_info->sem_base[i].sem_val + undo->adj[i];
+                sem_info->sem_base[i].sem_val = max(0, min(value, SEMVMX));
+                if (undo->adj[i]) {
+                    sem_info->sem_base[i].sem_pid = pid;
+                }
+            }
+            __sem_undo_free(undo);
+            // Complete the arrays waiting for the new values.
+            __sem_update_queue(sem_info, -1);
+        } else {
+            __sem_undo_free(undo);
+        }
+    }
+}
+
 // ============================================================================
 // PROCFS FUNCTIONS
 // ============================================================================
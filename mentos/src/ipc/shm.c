@@ -18,13 +18,15 @@
 #include "assert.h"
 #include "fcntl.h"
 #include "mem/kheap.h"
+#include "mem/paging.h"
+#include "process/scheduler.h"
 #include "stdio.h"
 #include "stdlib.h"
 #include "string.h"
 #include "sys/errno.h"
 #include "sys/list_head.h"
-
-// #include "process/process.h"
+#include "sys/mman.h"
+#include "system/syscall.h"
 
 ///@brief A value to compute the shmid value.
 int __shm_id = 0;
@@ -35,8 +37,12 @@ typedef struct {
     int id;
     /// @brief The shared memory data strcutre.
     struct shmid_ds shmid;
-    /// Where shm created is memorized.
-    page_t *shm_location;
+    /// The pages of the segment, allocated on the first touch, NULL until then.
+    page_t **pages;
+    /// The number of pages of the segment.
+    uint32_t nr_pages;
+    /// Set by IPC_RMID, the segment goes away with its last attachment.
+    bool_t removed;
     /// Reference inside the list of shared memory management structures.
     list_head list;
 } shm_info_t;
@@ -44,50 +50,129 @@ typedef struct {
 /// @brief List of all current active shared memorys.
 list_head shm_list;
 
+/// @brief Indexes of the shared memories, by id and by key.
+static ipc_ids_t shm_ids;
+
+static void __shm_vm_open(vm_area_struct_t *area);
+static void __shm_vm_close(vm_area_struct_t *area);
+static page_t *__shm_vm_fault(vm_area_struct_t *area, uint32_t index);
+
+/// @brief The operations of the areas where a shared memory is attached.
+static const vm_operations_t shm_vm_ops = {
+    .open  = __shm_vm_open,
+    .close = __shm_vm_close,
+    .fault = __shm_vm_fault,
+};
+
 // ============================================================================
 // MEMORY MANAGEMENT (Private)
 // ============================================================================
 
 /// @brief Allocates the memory for shared memory structure.
 /// @param key IPC_KEY associated with the shared memory.
+/// @param size the size of the shared memory.
 /// @param shmflg flags used to create the shared memory.
-/// @return a pointer to the allocated shared memory structure.
+/// @return a pointer to the allocated shared memory structure, NULL if
+/// there is no memory for it.
+/// @details No page is allocated here, each one is allocated the first time
+/// it is touched, so the pages need not be contiguous.
 static inline shm_info_t *__shm_info_alloc(key_t key, size_t size, int shmflg)
 {
     // Allocate the memory.
     shm_info_t *shm_info = (shm_info_t *)kmalloc(sizeof(shm_info_t));
-    // Check the allocated memory.
-    assert(shm_info && "Failed to allocate memory for a shared memory structure.");
+    if (shm_info == NULL) {
+        return NULL;
+    }
     // Clean the memory.
     memset(shm_info, 0, sizeof(shm_info_t));
+    // Allocate the table of the pages.
+    shm_info->nr_pages = round_up(size, PAGE_SIZE) / PAGE_SIZE;
+    shm_info->pages    = (page_t **)kmalloc(shm_info->nr_pages * sizeof(page_t *));
+    if (shm_info->pages == NULL) {
+        kfree(shm_info);
+        return NULL;
+    }
+    memset(shm_info->pages, 0, shm_info->nr_pages * sizeof(page_t *));
     // Initialize its values.
     shm_info->id               = ++__shm_id;
     shm_info->shmid.shm_perm   = register_ipc(key, shmflg & 0x1FF);
     shm_info->shmid.shm_segsz  = size;
     shm_info->shmid.shm_atime  = 0;
     shm_info->shmid.shm_dtime  = 0;
-    shm_info->shmid.shm_ctime  = 0;
-    shm_info->shmid.shm_cpid   = 0;
+    shm_info->shmid.shm_ctime  = sys_time(NULL);
+    shm_info->shmid.shm_cpid   = sys_getpid();
     shm_info->shmid.shm_lpid   = 0;
     shm_info->shmid.shm_nattch = 0;
-    // Allocate the memory.
-    uint32_t order         = find_nearest_order_greater(0, size);
-    shm_info->shm_location = _alloc_pages(GFP_KERNEL, order);
     // Return the shared memory structure.
     return shm_info;
 }
 
 /// @brief Frees the memory of a shared memory structure.
 /// @param shm_info pointer to the shared memory structure.
+/// @details The pages still mapped by someone stay around, until unmapped.
 static inline void __shm_info_dealloc(shm_info_t *shm_info)
 {
     assert(shm_info && "Received a NULL pointer.");
-    // Free the shared memory.
-    __free_pages(shm_info->shm_location);
+    // Drop the references of the segment to its pages.
+    for (uint32_t index = 0; index < shm_info->nr_pages; ++index) {
+        page_t *page = shm_info->pages[index];
+        if (page == NULL) {
+            continue;
+        }
+        if (page_count(page) > 1) {
+            page_dec(page);
+        } else {
+            __free_pages(page);
+        }
+    }
+    kfree(shm_info->pages);
     // Deallocate the shmid memory.
     kfree(shm_info);
 }
 
+/// @brief A process attached the segment through a new area (e.g., fork).
+/// @param area the new area.
+static void __shm_vm_open(vm_area_struct_t *area)
+{
+    shm_info_t *shm_info = (shm_info_t *)area->vm_private_data;
+    ++shm_info->shmid.shm_nattch;
+}
+
+/// @brief An area of the segment went away, its pages are already unmapped.
+/// @param area the area.
+static void __shm_vm_close(vm_area_struct_t *area)
+{
+    shm_info_t *shm_info = (shm_info_t *)area->vm_private_data;
+    --shm_info->shmid.shm_nattch;
+    shm_info->shmid.shm_dtime = sys_time(NULL);
+    shm_info->shmid.shm_lpid  = sys_getpid();
+    // The segment was removed while attached, this was the last attachment.
+    if (shm_info->removed && (shm_info->shmid.shm_nattch == 0)) {
+        __shm_info_dealloc(shm_info);
+    }
+}
+
+/// @brief Provides a page of the segment, allocating it on the first touch.
+/// @param area the area where the page is being mapped.
+/// @param index the index of the page inside the segment.
+/// @return the page, with a reference for the mapping, NULL on failure.
+static page_t *__shm_vm_fault(vm_area_struct_t *area, uint32_t index)
+{
+    shm_info_t *shm_info = (shm_info_t *)area->vm_private_data;
+    if (index >= shm_info->nr_pages) {
+        return NULL;
+    }
+    if (shm_info->pages[index] == NULL) {
+        // The segment holds one reference to the page.
+        shm_info->pages[index] = _alloc_pages(GFP_HIGHUSER | __GFP_ZERO, 0);
+        if (shm_info->pages[index] == NULL) {
+            return NULL;
+        }
+    }
+    page_inc(shm_info->pages[index]);
+    return shm_info->pages[index];
+}
+
 // ============================================================================
 // LIST MANAGEMENT/SEARCH FUNCTIONS (Private)
 // ============================================================================
@@ -97,18 +182,7 @@ static inline void __shm_info_dealloc(shm_info_t *shm_info)
 /// @return the shared memory with the given id.
 static inline shm_info_t *__list_find_shm_info_by_id(int shmid)
 {
-    shm_info_t *shm_info;
-    // Iterate through the list of shared memories.
-    list_for_each_decl(it, &shm_list)
-    {
-        // Get the current entry.
-        shm_info = list_entry(it, shm_info_t, list);
-        // If shared memories is valid, check the id.
-        if (shm_info && (shm_info->id == shmid)) {
-            return shm_info;
-        }
-    }
-    return NULL;
+    return ipc_ids_find_by_id(&shm_ids, shmid);
 }
 
 /// @brief Searches for the shared memory with the given key.
@@ -116,37 +190,7 @@ static inline shm_info_t *__list_find_shm_info_by_id(int shmid)
 /// @return the shared memory with the given key.
 static inline shm_info_t *__list_find_shm_info_by_key(key_t key)
 {
-    shm_info_t *shm_info;
-    // Iterate through the list of shared memories.
-    list_for_each_decl(it, &shm_list)
-    {
-        // Get the current entry.
-        shm_info = list_entry(it, shm_info_t, list);
-        // If shared memories is valid, check the id.
-        if (shm_info && (shm_info->shmid.shm_perm.key == key)) {
-            return shm_info;
-        }
-    }
-    return NULL;
-}
-
-/// @brief Searches for the shared memory with the given page.
-/// @param page the page we are searching.
-/// @return the shared memory with the given page.
-static inline shm_info_t *__list_find_shm_info_by_page(page_t *page)
-{
-    shm_info_t *shm_info;
-    // Iterate through the list of shared memories.
-    list_for_each_decl(it, &shm_list)
-    {
-        // Get the current entry.
-        shm_info = list_entry(it, shm_info_t, list);
-        // If shared memories is valid, check the id.
-        if (shm_info && (shm_info->shm_location == page)) {
-            return shm_info;
-        }
-    }
-    return NULL;
+    return ipc_ids_find_by_key(&shm_ids, key);
 }
 
 static inline void __list_add_shm_info(shm_info_t *shm_info)
@@ -154,6 +198,8 @@ static inline void __list_add_shm_info(shm_info_t *shm_info)
     assert(shm_info && "Received a NULL pointer.");
     // Add the new item at the end.
     list_head_insert_before(&shm_info->list, &shm_list);
+    // Index it by id and by key.
+    ipc_ids_add(&shm_ids, shm_info->id, shm_info->shmid.shm_perm.key, shm_info);
 }
 
 static inline void __list_remove_shm_info(shm_info_t *shm_info)
@@ -161,6 +207,8 @@ static inline void __list_remove_shm_info(shm_info_t *shm_info)
     assert(shm_info && "Received a NULL pointer.");
     // Delete the item from the list.
     list_head_remove(&shm_info->list);
+    // Remove it from the indexes.
+    ipc_ids_remove(&shm_ids, shm_info->id, shm_info->shmid.shm_perm.key);
 }
 
 // ============================================================================
@@ -170,6 +218,9 @@ static inline void __list_remove_shm_info(shm_info_t *shm_info)
 int shm_init(void)
 {
     list_head_init(&shm_list);
+    if (ipc_ids_init(&shm_ids)) {
+        return 1;
+    }
     return 0;
 }
 
@@ -178,12 +229,17 @@ long sys_shmget(key_t key, size_t size, int shmflg)
     shm_info_t *shm_info = NULL;
     // Need to find a unique key.
     if (key == IPC_PRIVATE) {
+        if (size == 0) {
+            return -EINVAL;
+        }
         // Exit when i find a unique key.
         do {
             key = (int)-rand();
         } while (__list_find_shm_info_by_key(key));
         // We have a unique key, create the shared memory.
-        shm_info = __shm_info_alloc(key, size, shmflg);
+        if ((shm_info = __shm_info_alloc(key, size, shmflg)) == NULL) {
+            return -ENOMEM;
+        }
         // Add the shared memory to the list.
         __list_add_shm_info(shm_info);
     } else {
@@ -205,10 +261,19 @@ long sys_shmget(key_t key, size_t size, int shmflg)
             pr_err("The shared memory exists for the given key, but the calling process does not have permission to access the set.\n");
             return -EACCES;
         }
+        // The existing shared memory is smaller than requested.
+        if (shm_info && (size > shm_info->shmid.shm_segsz)) {
+            return -EINVAL;
+        }
         // If the shared memory does not exist we need to create a new one.
         if (shm_info == NULL) {
+            if (size == 0) {
+                return -EINVAL;
+            }
             // Create the shared memory.
-            shm_info = __shm_info_alloc(key, size, shmflg);
+            if ((shm_info = __shm_info_alloc(key, size, shmflg)) == NULL) {
+                return -ENOMEM;
+            }
             // Add the shared memory to the list.
             __list_add_shm_info(shm_info);
         }
@@ -221,8 +286,9 @@ void *sys_shmat(int shmid, const void *shmaddr, int shmflg)
 {
     shm_info_t *shm_info = NULL;
     task_struct *task    = NULL;
-    uint32_t vm_start, phy_start;
-    uint32_t flags = MM_RW | MM_PRESENT | MM_USER | MM_UPDADDR;
+    vm_area_struct_t *area;
+    uint32_t vm_start, length;
+    int prot = PROT_READ | PROT_WRITE;
 
     // The id is less than zero.
     if (shmid < 0) {
@@ -243,8 +309,8 @@ void *sys_shmat(int shmid, const void *shmaddr, int shmflg)
             pr_err("The shared memory exists for the given key, but the calling process does not have permission to access the set.\n");
             return (void *)-EACCES;
         }
-        // Remove the read-write flag.
-        flags = bitmask_clear(flags, MM_RW);
+        // Remove the write permission.
+        prot = PROT_READ;
     } else if (!ipc_valid_permissions(O_RDWR, &shm_info->shmid.shm_perm)) {
         pr_err("The shared memory exists for the given key, but the calling process does not have permission to access the set.\n");
         return (void *)-EACCES;
@@ -252,55 +318,55 @@ void *sys_shmat(int shmid, const void *shmaddr, int shmflg)
     // Get the calling task.
     task = scheduler_get_current_process();
     assert(task && "Failed to get the current running process.");
-    // Get the phyisical address from the allocated pages.
-    phy_start = get_physical_address_from_page(shm_info->shm_location);
-    // Find the virtual address for the new area.
-    if (find_free_vm_area(task->mm, shm_info->shmid.shm_segsz, &vm_start)) {
+    length = shm_info->nr_pages * PAGE_SIZE;
+    // Place the area where requested, or find the space for it.
+    if (shmaddr) {
+        vm_start = (uintptr_t)shmaddr;
+        if (shmflg & SHM_RND) {
+            vm_start &= ~(PAGE_SIZE - 1);
+        }
+        if ((vm_start & (PAGE_SIZE - 1)) || (is_valid_vm_area(task->mm, vm_start, vm_start + length) != 1)) {
+            return (void *)-EINVAL;
+        }
+    } else if (find_free_vm_area(task->mm, length, &vm_start)) {
         pr_err("We failed to find space for the new virtual memory area.\n");
-        return (void *)-EACCES;
+        return (void *)-ENOMEM;
     }
-    mem_upd_vm_area(
-        task->mm->pgd,
-        vm_start,
-        phy_start,
-        shm_info->shmid.shm_segsz,
-        flags);
+    // The pages are mapped on the first touch.
+    area = create_vm_area(task->mm, vm_start, length, MM_PRESENT | MM_RW | MM_COW | MM_USER, GFP_HIGHUSER);
+    if (area == NULL) {
+        return (void *)-ENOMEM;
+    }
+    area->vm_ops          = &shm_vm_ops;
+    area->vm_private_data = shm_info;
+    area->vm_flags        = MAP_SHARED;
+    area->vm_page_prot    = prot;
+    area->vm_pgoff        = 0;
+    // Update the statistics.
+    ++shm_info->shmid.shm_nattch;
+    shm_info->shmid.shm_atime = sys_time(NULL);
+    shm_info->shmid.shm_lpid  = task->pid;
     return (void *)vm_start;
 }
 
 long sys_shmdt(const void *shmaddr)
 {
-    shm_info_t *shm_info = NULL;
-    task_struct *task    = NULL;
-    uint32_t phy_start;
-    size_t size;
-    page_t *page;
+    task_struct *task = NULL;
+    vm_area_struct_t *area;
 
     // Get the calling task.
     task = scheduler_get_current_process();
     assert(task && "Failed to get the current running process.");
-    // Get the page.
-    page = mem_virtual_to_page(task->mm->pgd, (uint32_t)shmaddr, &size);
-    // Check if we can find the page.
-    if (page == NULL) {
-        pr_err("Cannot retrieve the page from the give address.\n");
-        return -ENOENT;
-    }
-    shm_info = __list_find_shm_info_by_page(page);
-    // Check if no shared memory exists for the given address.
-    if (!shm_info) {
+    // Get the area where the segment is attached.
+    area = find_vm_area(task->mm, (uintptr_t)shmaddr);
+    if ((area == NULL) || (area->vm_ops != &shm_vm_ops)) {
         pr_err("No shared memory exists for the given address.\n");
-        return -ENOENT;
+        return -EINVAL;
+    }
+    // Unmapping the area drops the attachment.
+    if (destroy_vm_area(task->mm, area)) {
+        return -EINVAL;
     }
-    // Get the phyisical address from the allocated pages.
-    phy_start = get_physical_address_from_page(shm_info->shm_location);
-    // Set all virtual pages as not present.
-    mem_upd_vm_area(
-        task->mm->pgd,
-        (uint32_t)shmaddr,
-        phy_start,
-        shm_info->shmid.shm_segsz,
-        MM_GLOBAL);
     return 0;
 }
 
@@ -327,10 +393,13 @@ long sys_shmctl(int shmid, int cmd, struct shmid_ds *buf)
             pr_err("The calling process is not the creator or the owner of the shared memory.\n");
             return -EPERM;
         }
-        // Remove the set from the list.
+        // Remove the set from the list, nobody can find it anymore.
         __list_remove_shm_info(shm_info);
-        // Delete the set.
-        __shm_info_dealloc(shm_info);
+        shm_info->removed = true;
+        // Delete the set, unless someone still has it attached.
+        if (shm_info->shmid.shm_nattch == 0) {
+            __shm_info_dealloc(shm_info);
+        }
     }
     return 0;
 }
@@ -13,31 +13,50 @@
 
 #include "descriptor_tables/gdt.h"
 #include "descriptor_tables/idt.h"
+#include "drivers/ata/ahci.h"
 #include "drivers/ata/ata.h"
 #include "drivers/keyboard/keyboard.h"
 #include "drivers/keyboard/keymap.h"
+#include "drivers/mouse.h"
 #include "drivers/ps2.h"
+#include "drivers/ramdisk.h"
 #include "drivers/rtc.h"
+#include "drivers/serial.h"
 #include "drivers/mem.h"
+#include "drivers/virtio/virtio_blk.h"
+#include "drivers/virtio/virtio_console.h"
+#include "elf/elf.h"
+#include "fs/buffer_cache.h"
 #include "fs/ext2.h"
+#include "fs/initramfs.h"
 #include "fs/procfs.h"
+#include "fs/tmpfs.h"
 #include "fs/vfs.h"
 #include "hardware/pic8259.h"
+#include "hardware/pmu.h"
+#include "hardware/smp.h"
 #include "hardware/timer.h"
+#include "io/console.h"
 #include "io/proc_modules.h"
 #include "io/vga/vga.h"
 #include "io/video.h"
+#include "mem/shrinker.h"
 #include "mem/vmem_map.h"
 #include "mem/zone_allocator.h"
 #include "process/scheduler.h"
 #include "process/scheduler_feedback.h"
 #include "stdio.h"
 #include "string.h"
+#include "sys/futex.h"
 #include "sys/module.h"
 #include "sys/msg.h"
 #include "sys/sem.h"
 #include "sys/shm.h"
+#include "system/cmdline.h"
+#include "system/initcall.h"
+#include "system/printk.h"
 #include "system/syscall.h"
+#include "system/vdso.h"
 #include "version.h"
 
 /// Describe start address of grub multiboot modules.
@@ -82,26 +101,128 @@ boot_info_t boot_info;
 /// Flag indicating if we are running tests instead of an interactive session
 int runtests = 0;
 
-/// @brief Prints [OK] at the current row and column 60.
+/// @brief Prints [OK] at the end of the current row.
 static inline void print_ok(void)
 {
-    unsigned y, width;
-    video_get_cursor_position(NULL, &y);
-    video_get_screen_size(&width, NULL);
-    video_move_cursor(width - 5, y);
-    video_puts("[OK]\n");
+    console_print_result("[OK]");
 }
 
-/// @brief Prints [FAIL] at the current row and column 60.
+/// @brief Prints [FAIL] at the end of the current row.
 static inline void print_fail(void)
 {
-    unsigned y, width;
-    video_get_cursor_position(NULL, &y);
-    video_get_screen_size(&width, NULL);
-    video_move_cursor(width - 7, y);
-    video_puts("[FAIL]\n");
+    console_print_result("[FAIL]");
 }
 
+/// @brief Initializes the virtual filesystem.
+/// @return 0.
+static int __init_vfs(void)
+{
+    vfs_init();
+    return 0;
+}
+
+/// @brief Mounts the root filesystem, hiding the initramfs if there is one.
+/// @return 0 on success, non-zero on failure.
+static int __init_mount_root(void)
+{
+    return do_mount("ext2", "/", "/dev/hda");
+}
+
+/// @brief Mounts procfs on `/proc`.
+/// @return 0 on success, non-zero on failure.
+static int __init_mount_procfs(void)
+{
+    return do_mount("procfs", "/proc", NULL);
+}
+
+/// @brief Mounts tmpfs on `/tmp`.
+/// @return 0 on success, non-zero on failure.
+static int __init_mount_tmpfs(void)
+{
+    return do_mount("tmpfs", "/tmp", NULL);
+}
+
+/// @brief Mounts tmpfs on `/dev/shm`, where the POSIX shared memory objects live.
+/// @return 0 on success, non-zero on failure.
+static int __init_mount_shm(void)
+{
+    return do_mount("tmpfs", "/dev/shm", NULL);
+}
+
+/// @brief Sets up the PS/2 controller.
+/// @return 0 on success, non-zero on failure.
+static int __init_ps2(void)
+{
+    // First, disable the keyboard, otherwise the PS/2 initialization does not
+    // work properly.
+    keyboard_disable();
+    return ps2_initialize();
+}
+
+/// @brief Sets up the buffers of the keyboard, and its keymap.
+/// @return 0.
+static int __init_keyboard_buffers(void)
+{
+    keyboard_initialize_buffers();
+    // Set the keymap type.
+#ifdef USE_KEYMAP_US
+    set_keymap_type(KEYMAP_US);
+#elif USE_KEYMAP_DE
+    set_keymap_type(KEYMAP_DE);
+#else
+    set_keymap_type(KEYMAP_IT);
+#endif
+    return 0;
+}
+
+/// @brief Installs the IRQ of the keyboard, and enables it.
+/// @return 0 on success, non-zero on failure.
+static int __init_keyboard(void)
+{
+    int ret = keyboard_initialize();
+    keyboard_enable();
+    return ret;
+}
+
+/// @brief The subsystems initialized at boot, see system/initcall.h.
+static const initcall_t boot_initcalls[] = {
+    { "the filesystem", __init_vfs, INIT_LEVEL_CORE, NULL, 0 },
+    { "tmpfs", tmpfs_module_init, INIT_LEVEL_CORE, NULL, 0 },
+    { "ATA devices", ata_initialize, INIT_LEVEL_DEVICES, NULL, INITCALL_DISK },
+    { "AHCI devices", ahci_initialize, INIT_LEVEL_DEVICES, NULL, INITCALL_DEFERRED },
+    { "virtio block devices", virtio_blk_initialize, INIT_LEVEL_DEVICES, NULL, INITCALL_DEFERRED },
+    { "virtio console", virtio_console_initialize, INIT_LEVEL_DEVICES, NULL, 0 },
+    { "RAM disks", ramdisk_initialize, INIT_LEVEL_DEVICES, NULL, INITCALL_DEFERRED },
+    { "the initramfs", initramfs_mount, INIT_LEVEL_FS, "tmpfs", 0 },
+    { "EXT2 filesystem", ext2_initialize, INIT_LEVEL_FS, NULL, 0 },
+    { "the root filesystem", __init_mount_root, INIT_LEVEL_FS, "EXT2 filesystem", INITCALL_DISK },
+    { "memory devices", mem_devs_initialize, INIT_LEVEL_FS, NULL, 0 },
+    { "serial devices", serial_devices_initialize, INIT_LEVEL_FS, NULL, 0 },
+    { "procfs", procfs_module_init, INIT_LEVEL_FS, NULL, 0 },
+    { "procfs on /proc", __init_mount_procfs, INIT_LEVEL_FS, "procfs", 0 },
+    { "tmpfs on /tmp", __init_mount_tmpfs, INIT_LEVEL_FS, "tmpfs", 0 },
+    { "tmpfs on /dev/shm", __init_mount_shm, INIT_LEVEL_FS, "tmpfs", 0 },
+    { "/proc/video", procv_module_init, INIT_LEVEL_PROCFS, "procfs on /proc", 0 },
+    { "system procfs files", procs_module_init, INIT_LEVEL_PROCFS, "procfs on /proc", INITCALL_DEFERRED },
+    { "/proc/syscalls", procsc_module_init, INIT_LEVEL_PROCFS, "procfs on /proc", INITCALL_DEFERRED },
+    { "/proc/lock_stat", proclock_module_init, INIT_LEVEL_PROCFS, "procfs on /proc", INITCALL_DEFERRED },
+    { "/proc/diskstats", procdisk_module_init, INIT_LEVEL_PROCFS, "procfs on /proc", INITCALL_DEFERRED },
+    { "/proc/latency", proclat_module_init, INIT_LEVEL_PROCFS, "procfs on /proc", INITCALL_DEFERRED },
+    { "/proc/func_profile", procfunc_module_init, INIT_LEVEL_PROCFS, "procfs on /proc", INITCALL_DEFERRED },
+    { "/proc/profile", procprof_module_init, INIT_LEVEL_PROCFS, "procfs on /proc", INITCALL_DEFERRED },
+    { "/proc/trace", proctrace_module_init, INIT_LEVEL_PROCFS, "procfs on /proc", INITCALL_DEFERRED },
+    { "/proc/ipc", procipc_module_init, INIT_LEVEL_PROCFS, "procfs on /proc", INITCALL_DEFERRED },
+    { "/proc/sys", procsysctl_module_init, INIT_LEVEL_PROCFS, "procfs on /proc", INITCALL_DEFERRED },
+    { "IPC/SEM system", sem_init, INIT_LEVEL_IPC, NULL, 0 },
+    { "IPC/MSQ system", msq_init, INIT_LEVEL_IPC, NULL, 0 },
+    { "IPC/SHM system", shm_init, INIT_LEVEL_IPC, NULL, 0 },
+    { "futexes", futex_init, INIT_LEVEL_IPC, NULL, 0 },
+    { "keyboard buffers", __init_keyboard_buffers, INIT_LEVEL_INPUT, NULL, 0 },
+    { "PS/2 controller", __init_ps2, INIT_LEVEL_INPUT, NULL, INITCALL_DEFERRED },
+    { "keyboard", __init_keyboard, INIT_LEVEL_INPUT, "PS/2 controller", INITCALL_DEFERRED },
+    { "mouse", mouse_initialize, INIT_LEVEL_INPUT, "PS/2 controller", INITCALL_DEFERRED },
+};
+
 /// @brief Entry point of the kernel.
 /// @param boot_informations Information concerning the boot.
 /// @return The exit status of the kernel.
@@ -119,6 +240,10 @@ int kmain(boot_info_t *boot_informations)
     initial_esp = boot_info.stack_base;
     // Dump the multiboot structure.
     dump_multiboot(boot_info.multiboot_header);
+    // Set the tunables, before the subsystems using them start.
+    if (bitmask_check(boot_info.multiboot_header->flags, MULTIBOOT_FLAG_CMDLINE)) {
+        cmdline_parse((const char *)boot_info.multiboot_header->cmdline);
+    }
 
     //==========================================================================
     pr_notice("Initialize the video...\n");
@@ -179,12 +304,33 @@ int kmain(boot_info_t *boot_informations)
     pic8259_init_irq();
     print_ok();
 
+    //==========================================================================
+    pr_notice("Initialize serial ports...\n");
+    printf("Initialize serial ports...");
+    if (serial_initialize()) {
+        print_fail();
+        pr_emerg("Failed to initialize serial ports!\n");
+        return 1;
+    }
+    print_ok();
+    // Now that the ports work, the console can move on them.
+    console_setup(cmdline_get());
+
     //==========================================================================
     pr_notice("Relocate modules.\n");
     printf("Relocate modules...");
     relocate_modules();
     print_ok();
 
+#ifdef ENABLE_FUNC_PROFILE
+    //==========================================================================
+    // The image of the kernel is reachable until paging is initialized, keep
+    // the names of its functions for the profile.
+    if (elf_load_kernel_symbols((elf_header_t *)boot_info.kernel_elf_phy) < 0) {
+        pr_warning("The profile of the functions will not have their names.\n");
+    }
+#endif
+
     //==========================================================================
     pr_notice("Initialize paging.\n");
     printf("Initialize paging...");
@@ -201,228 +347,160 @@ int kmain(boot_info_t *boot_informations)
     pr_notice("Install the timer.\n");
     printf("Setting up timer...");
     timer_install();
+    // Refresh the screen periodically, now that there are timers.
+    video_start_refresh();
     print_ok();
 
     //==========================================================================
-    pr_notice("Install RTC.\n");
-    printf("Setting up RTC...");
-    rtc_initialize();
+    pr_notice("Start the other CPUs.\n");
+    printf("Setting up the CPUs...");
+    smp_init();
     print_ok();
 
     //==========================================================================
-    pr_notice("Initialize the filesystem.\n");
-    printf("Initialize the filesystem...");
-    vfs_init();
+    pr_notice("Initialize the performance counters.\n");
+    printf("Setting up the performance counters...");
+    // Without them, the tasks count no events and the profiler is off.
+    pmu_init();
     print_ok();
 
     //==========================================================================
-    // Scan for ata devices.
-    pr_notice("Initialize ATA devices...\n");
-    printf("Initialize ATA devices...");
-    if (ata_initialize()) {
-        pr_emerg("Failed to initialize ATA devices!\n");
-        return 1;
-    }
+    pr_notice("Install RTC.\n");
+    printf("Setting up RTC...");
+    rtc_initialize();
     print_ok();
 
     //==========================================================================
-    pr_notice("Initialize EXT2 filesystem...\n");
-    printf("Initialize EXT2 filesystem...");
-    if (ext2_initialize()) {
-        pr_emerg("Failed to initialize EXT2 filesystem!\n");
+    pr_notice("Setting up the vDSO and the fast system calls.\n");
+    printf("Setting up the vDSO...");
+    if (vdso_init() < 0) {
+        print_fail();
         return 1;
     }
-    print_ok();
-
-    //==========================================================================
-    pr_notice("Mount EXT2 filesystem...\n");
-    printf("Mount EXT2 filesystem...");
-    if (do_mount("ext2", "/", "/dev/hda")) {
-        pr_emerg("Failed to mount EXT2 filesystem...\n");
-        return 1;
+    // Without SYSENTER, the processes keep using `int 0x80`.
+    if (syscall_sysenter_init() < 0) {
+        pr_notice("The CPU does not support SYSENTER.\n");
+    } else {
+        vdso_enable_sysenter();
     }
     print_ok();
 
     //==========================================================================
-    pr_notice("    Initialize memory devices...\n");
-    printf("    Initialize memory devices...");
-    if (mem_devs_initialize()) {
-        print_fail();
-        pr_emerg("Failed to initialize memory devices!\n");
-        return 1;
+    // The subsystems are initialized level by level, those init does not need
+    // are left to kinitd, except when running the tests. With an initramfs,
+    // init does not need the disks either.
+    pr_notice("Initialize the subsystems...\n");
+    unsigned defer = 0;
+    if (!runtests) {
+        defer = INITCALL_DEFERRED | (initramfs_available() ? INITCALL_DISK : 0);
     }
-    print_ok();
-
-    //==========================================================================
-    pr_notice("    Initialize 'procfs'...\n");
-    printf("    Initialize 'procfs'...");
-    if (procfs_module_init()) {
-        print_fail();
-        pr_emerg("Failed to register `procfs`!\n");
+    if (initcall_run(boot_initcalls, count_of(boot_initcalls), defer) < 0) {
         return 1;
     }
-    print_ok();
 
     //==========================================================================
-    pr_notice("    Mounting 'procfs'...\n");
-    printf("    Mounting 'procfs'...");
-    if (do_mount("procfs", "/proc", NULL)) {
-        pr_emerg("Failed to mount procfs at `/proc`!\n");
-        return 1;
-    }
+    pr_notice("Initialize the scheduler.\n");
+    printf("Initialize the scheduler...");
+    scheduler_initialize();
     print_ok();
 
     //==========================================================================
-    pr_notice("Initialize video procfs file...\n");
-    printf("Initialize video procfs file...");
-    if (procv_module_init()) {
+    pr_notice("Init process management...\n");
+    printf("Init process management...");
+    if (!init_tasking()) {
         print_fail();
-        pr_emerg("Failed to initialize `/proc/video`!\n");
         return 1;
     }
     print_ok();
 
     //==========================================================================
-    pr_notice("Initialize system procfs file...\n");
-    printf("Initialize system procfs file...");
-    if (procs_module_init()) {
+#ifdef ENABLE_SCHEDULER_FEEDBACK
+    pr_notice("Initialize scheduler feedback system...\n");
+    printf("Initialize scheduler feedback system...");
+    if (!scheduler_feedback_init()) {
         print_fail();
-        pr_emerg("Failed to initialize proc system entries!\n");
         return 1;
     }
     print_ok();
+#endif
 
     //==========================================================================
-    pr_notice("Initialize IPC information system...\n");
-    printf("Initialize IPC information system...");
-    if (procipc_module_init()) {
+    pr_notice("Initialize scheduler feedback system (2)...\n");
+    printf("Initialize scheduler feedback system (2)...");
+    if (procfb_module_init()) {
         print_fail();
-        pr_emerg("Failed to initialize the IPC information system!\n");
         return 1;
     }
     print_ok();
 
     //==========================================================================
-    pr_notice("Initialize IPC/SEM system...\n");
-    printf("Initialize IPC/SEM system...");
-    if (sem_init()) {
-        print_fail();
-        pr_emerg("Failed to initialize the IPC/SEM system!\n");
-        return 1;
+    task_struct *init_p;
+    if (runtests) {
+        pr_notice("Creating runtests process...\n");
+        printf("Creating runtests process...");
+        init_p = process_create_init("/bin/runtests");
+    } else {
+        pr_notice("Creating init process (%s)...\n", cmdline_init);
+        printf("Creating init process...");
+        init_p = process_create_init(cmdline_init);
     }
-    print_ok();
-
-    //==========================================================================
-    pr_notice("Initialize IPC/MSQ system...\n");
-    printf("Initialize IPC/MSQ system...");
-    if (msq_init()) {
+    if (!init_p) {
         print_fail();
-        pr_emerg("Failed to initialize the IPC/MSQ system!\n");
         return 1;
     }
     print_ok();
 
     //==========================================================================
-    pr_notice("Initialize IPC/SHM system...\n");
-    printf("Initialize IPC/SHM system...");
-    if (shm_init()) {
+    // The kernel threads are created once init is there, which is the first
+    // task to run.
+    pr_notice("Start the buffer flusher...\n");
+    printf("Start the buffer flusher...");
+    if (!buffer_cache_start_flusher()) {
         print_fail();
-        pr_emerg("Failed to initialize the IPC/SHM system!\n");
         return 1;
     }
     print_ok();
 
     //==========================================================================
-    // First, disable the keyboard, otherwise the PS/2 initialization does not
-    // work properly.
-    keyboard_disable();
-
-    //==========================================================================
-    pr_notice("Setting up PS/2 driver...\n");
-    printf("Setting up PS/2 driver...");
-    if (ps2_initialize()) {
+    pr_notice("Start the memory reclaimer...\n");
+    printf("Start the memory reclaimer...");
+    if (!kswapd_start()) {
         print_fail();
-        pr_emerg("Failed to initialize proc system entries!\n");
         return 1;
     }
     print_ok();
 
     //==========================================================================
-    pr_notice("Setting up keyboard driver...\n");
-    printf("Setting up keyboard driver...");
-    keyboard_initialize();
-    print_ok();
-    // Set the keymap type.
-#ifdef USE_KEYMAP_US
-    set_keymap_type(KEYMAP_US);
-#elif USE_KEYMAP_DE
-    set_keymap_type(KEYMAP_DE);
-#else
-    set_keymap_type(KEYMAP_IT);
-#endif
-
-    keyboard_enable();
-
-    //==========================================================================
-#if 0
-     pr_notice("Install the mouse.\n");
-     printf(" * Setting up mouse driver...");
-     mouse_install();     // Install the mouse.
-     print_ok();
-#endif
-
-    //==========================================================================
-    pr_notice("Initialize the scheduler.\n");
-    printf("Initialize the scheduler...");
-    scheduler_initialize();
-    print_ok();
-
-    //==========================================================================
-    pr_notice("Init process management...\n");
-    printf("Init process management...");
-    if (!init_tasking()) {
+    pr_notice("Start the process image reaper...\n");
+    printf("Start the process image reaper...");
+    if (!mm_reaper_start()) {
         print_fail();
         return 1;
     }
     print_ok();
 
     //==========================================================================
-#ifdef ENABLE_SCHEDULER_FEEDBACK
-    pr_notice("Initialize scheduler feedback system...\n");
-    printf("Initialize scheduler feedback system...");
-    if (!scheduler_feedback_init()) {
+    pr_notice("Start the kernel logger...\n");
+    printf("Start the kernel logger...");
+    if (printk_start_daemon() < 0) {
         print_fail();
         return 1;
     }
     print_ok();
-#endif
 
     //==========================================================================
-    pr_notice("Initialize scheduler feedback system (2)...\n");
-    printf("Initialize scheduler feedback system (2)...");
-    if (procfb_module_init()) {
+    pr_notice("Start the idle tasks...\n");
+    printf("Start the idle tasks...");
+    if (!scheduler_start_idle()) {
         print_fail();
         return 1;
     }
     print_ok();
 
     //==========================================================================
-    // TODO: fix the hardcoded check for the flags set by GRUB
-    runtests = boot_info.multiboot_header->flags == 0x1a67 &&
-        bitmask_check(boot_info.multiboot_header->flags, MULTIBOOT_FLAG_CMDLINE) &&
-        strcmp((char *)boot_info.multiboot_header->cmdline, "runtests") == 0;
-
-    task_struct *init_p;
-    if (runtests) {
-        pr_notice("Creating runtests process...\n");
-        printf("Creating runtests process...");
-        init_p = process_create_init("/bin/runtests");
-    } else {
-        pr_notice("Creating init process...\n");
-        printf("Creating init process...");
-        init_p = process_create_init("/bin/init");
-    }
-    if (!init_p) {
+    pr_notice("Start the deferred initialization...\n");
+    printf("Start the deferred initialization...");
+    if (initcall_start_deferred() < 0) {
         print_fail();
         return 1;
     }
@@ -4,6 +4,7 @@
 /// See LICENSE.md for details.
 
 #include "stdio.h"
+#include "fs/vfs.h"
 #include "klib/mutex.h"
 #include "klib/stdatomic.h"
 #include "sys/errno.h"
@@ -33,7 +34,7 @@ static void kernel_power_off(void)
 
 int sys_reboot(int magic1, int magic2, unsigned int cmd, void *arg)
 {
-    static mutex_t reboot_mutex;
+    static mutex_t reboot_mutex = MUTEX_INIT(reboot_mutex);
 
     // For safety, we require "magic" arguments.
     if (magic1 != LINUX_REBOOT_MAGIC1 ||
@@ -42,7 +43,7 @@ int sys_reboot(int magic1, int magic2, unsigned int cmd, void *arg)
         return -EINVAL;
     }
 
-    mutex_lock(&reboot_mutex, 0);
+    mutex_lock(&reboot_mutex);
 
     switch (cmd) {
     case LINUX_REBOOT_CMD_RESTART:
@@ -54,6 +55,8 @@ int sys_reboot(int magic1, int magic2, unsigned int cmd, void *arg)
     case LINUX_REBOOT_CMD_HALT:
         break;
     case LINUX_REBOOT_CMD_POWER_OFF:
+        // Do not lose the data still waiting to be written back.
+        vfs_sync();
         kernel_power_off();
         break;
     case LINUX_REBOOT_CMD_RESTART2:
@@ -63,6 +66,7 @@ int sys_reboot(int magic1, int magic2, unsigned int cmd, void *arg)
     case LINUX_REBOOT_CMD_SW_SUSPEND:
         break;
     default:
+        mutex_unlock(&reboot_mutex);
         return -EINVAL;
     }
     mutex_unlock(&reboot_mutex);
@@ -1,5 +1,5 @@
 /// @file hashmap.c
-/// @brief
+/// @brief Hashmap with open addressing, which grows incrementally.
 /// @copyright (c) 2014-2024 This file is distributed under the MIT License.
 /// See LICENSE.md for details.
 
@@ -8,14 +8,30 @@
 #include "mem/slab.h"
 #include "string.h"
 
+/// The smallest number of slots of a table.
+#define HASHMAP_MIN_SIZE 8
+/// The slots of the old table visited by each update, while growing. Growth
+/// starts at 3/4 of the old size, and must end before the new table, twice
+/// as big, reaches 3/4 too: visiting 2 slots per insertion would be enough.
+#define HASHMAP_MOVE_STEPS 4
+/// Marks the entries of the old table which were moved, or removed, while
+/// growing: they keep their place, or the lookups would stop before the
+/// entries after them.
+#define HASHMAP_REMOVED ((void *)&hashmap_removed)
+
+/// The address used by HASHMAP_REMOVED.
+static const char hashmap_removed;
+
 /// @brief Stores information of an entry of the hashmap.
 struct hashmap_entry_t {
     /// Key of the entry.
-    char *key;
+    void *key;
     /// Value of the entry.
     void *value;
-    /// Pointer to the next entry.
-    struct hashmap_entry_t *next;
+    /// The mixed hash of the key.
+    unsigned int hash;
+    /// The distance from the slot of the hash, plus one; 0 if the slot is free.
+    unsigned int dist;
 };
 
 /// @brief Stores information of a hashmap.
@@ -28,10 +44,18 @@ struct hashmap_t {
     hashmap_dupe_t hash_key_dup;
     /// Key deallocation function, used to free the memory occupied by hash keys.
     hashmap_free_t hash_key_free;
-    /// Size of the hashmap.
+    /// The number of entries, in both tables.
+    unsigned int count;
+    /// The number of slots, a power of two.
     unsigned int size;
-    /// List of entries.
-    hashmap_entry_t **entries;
+    /// The slots.
+    hashmap_entry_t *entries;
+    /// The number of slots of the table being emptied, while growing.
+    unsigned int old_size;
+    /// The slots of the old table which were already moved.
+    unsigned int old_moved;
+    /// The table being emptied, NULL when not growing.
+    hashmap_entry_t *old_entries;
 };
 
 static inline hashmap_t *__alloc_hashmap(void)
@@ -41,51 +65,152 @@ static inline hashmap_t *__alloc_hashmap(void)
     return hashmap;
 }
 
-static inline hashmap_entry_t *__alloc_entry(void)
+static inline hashmap_entry_t *__alloc_entries(unsigned int size)
 {
-    hashmap_entry_t *entry = kmalloc(sizeof(hashmap_entry_t));
-    memset(entry, 0, sizeof(hashmap_entry_t));
-    return entry;
+    hashmap_entry_t *entries = kmalloc(sizeof(hashmap_entry_t) * size);
+    if (entries) {
+        memset(entries, 0, sizeof(hashmap_entry_t) * size);
+    }
+    return entries;
 }
 
-static inline void __dealloc_entry(hashmap_entry_t *entry)
+static inline void __dealloc_entries(hashmap_entry_t *entries)
 {
-    assert(entry && "Invalid pointer to an entry.");
-    kfree(entry);
+    assert(entries && "Invalid pointer to entries.");
+    kfree(entries);
 }
 
-static inline hashmap_entry_t **__alloc_entries(unsigned int size)
+/// @brief Scrambles the bits of a hash, so that the low ones, which pick the
+/// slot, depend on all of them.
+/// @param hash the hash returned by the hashing function.
+/// @return the mixed hash.
+static inline unsigned int __hashmap_mix(unsigned int hash)
 {
-    hashmap_entry_t **entries = kmalloc(sizeof(hashmap_entry_t *) * size);
-    memset(entries, 0, sizeof(hashmap_entry_t *) * size);
-    return entries;
+    // The finalizer of MurmurHash3.
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6Bu;
+    hash ^= hash >> 13;
+    hash *= 0xC2B2AE35u;
+    hash ^= hash >> 16;
+    return hash;
 }
 
-static inline void __dealloc_entries(hashmap_entry_t **entries)
+/// @brief Places an entry which is not in the table, moving the entries
+/// closer to their slot than it is to its own (Robin Hood hashing).
+/// @param entries the table.
+/// @param size the number of slots of the table.
+/// @param entry the entry.
+static void __hashmap_place(hashmap_entry_t *entries, unsigned int size, hashmap_entry_t entry)
 {
-    assert(entries && "Invalid pointer to entries.");
-    kfree(entries);
+    unsigned int mask = size - 1;
+    entry.dist        = 1;
+    for (unsigned int i = entry.hash & mask;; i = (i + 1) & mask, ++entry.dist) {
+        if (entries[i].dist == 0) {
+            entries[i] = entry;
+            return;
+        }
+        if (entries[i].dist < entry.dist) {
+            hashmap_entry_t poorer = entries[i];
+            entries[i]             = entry;
+            entry                  = poorer;
+        }
+    }
+}
+
+/// @brief Searches a key in a table.
+/// @param map the hashmap.
+/// @param entries the table.
+/// @param size the number of slots of the table.
+/// @param key the key.
+/// @param hash the mixed hash of the key.
+/// @return the entry, or NULL if the key is not in the table.
+static hashmap_entry_t *__hashmap_find(hashmap_t *map, hashmap_entry_t *entries, unsigned int size, const void *key, unsigned int hash)
+{
+    unsigned int mask = size - 1;
+    for (unsigned int i = hash & mask, dist = 1; dist <= size; i = (i + 1) & mask, ++dist) {
+        // An entry closer to its slot means the key would have taken its place.
+        if ((entries[i].dist == 0) || (entries[i].dist < dist)) {
+            break;
+        }
+        if ((entries[i].hash == hash) && (entries[i].key != HASHMAP_REMOVED) && map->hash_comp(entries[i].key, key)) {
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
+
+/// @brief Removes an entry from the current table, moving back the entries
+/// after it which are not in their slot.
+/// @param map the hashmap.
+/// @param entry the entry.
+static void __hashmap_erase(hashmap_t *map, hashmap_entry_t *entry)
+{
+    unsigned int mask = map->size - 1;
+    unsigned int i    = entry - map->entries;
+    for (unsigned int next = (i + 1) & mask; map->entries[next].dist > 1; i = next, next = (next + 1) & mask) {
+        map->entries[i] = map->entries[next];
+        --map->entries[i].dist;
+    }
+    memset(&map->entries[i], 0, sizeof(hashmap_entry_t));
+}
+
+/// @brief Moves some entries of the old table to the current one, and frees
+/// the old table once it is empty.
+/// @param map the hashmap.
+/// @param steps the number of slots of the old table to visit.
+static void __hashmap_move(hashmap_t *map, unsigned int steps)
+{
+    for (; map->old_entries && steps; --steps) {
+        hashmap_entry_t *entry = &map->old_entries[map->old_moved];
+        if (entry->dist && (entry->key != HASHMAP_REMOVED)) {
+            __hashmap_place(map->entries, map->size, *entry);
+            // The lookups still walk over it, to reach the entries after it.
+            entry->key = HASHMAP_REMOVED;
+        }
+        if (++map->old_moved == map->old_size) {
+            __dealloc_entries(map->old_entries);
+            map->old_entries = NULL;
+        }
+    }
+}
+
+/// @brief Doubles the table. Its entries are moved a few at a time by the
+/// later updates, so that no single update pays for all of them.
+/// @param map the hashmap.
+static void __hashmap_grow(hashmap_t *map)
+{
+    // The previous growth must be over before the current table is replaced.
+    __hashmap_move(map, map->old_size);
+    hashmap_entry_t *entries = __alloc_entries(map->size * 2);
+    if (entries == NULL) {
+        // Keep filling the current table, which gets slower but still works.
+        return;
+    }
+    map->old_entries = map->entries;
+    map->old_size    = map->size;
+    map->old_moved   = 0;
+    map->entries     = entries;
+    map->size        = map->size * 2;
 }
 
 unsigned int hashmap_int_hash(const void *key)
 {
-    return (unsigned int)key;
+    return (uintptr_t)key;
 }
 
 int hashmap_int_comp(const void *a, const void *b)
 {
-    return (int)a == (int)b;
+    return (uintptr_t)a == (uintptr_t)b;
 }
 
 unsigned int hashmap_str_hash(const void *_key)
 {
-    unsigned int hash = 0;
-    const char *key   = (const char *)_key;
-    char c;
-    // This is the so-called "sdbm" hash. It comes from a piece of public
-    // domain code from a clone of ndbm.
-    while ((c = *key++)) {
-        hash = c + (hash << 6) + (hash << 16) - hash;
+    const unsigned char *key = (const unsigned char *)_key;
+    // This is the 32-bit FNV-1a hash.
+    unsigned int hash = 2166136261u;
+    while (*key) {
+        hash ^= *key++;
+        hash *= 16777619u;
     }
     return hash;
 }
@@ -114,9 +239,12 @@ hashmap_t *hashmap_create(
 {
     // Allocate the map.
     hashmap_t *map = __alloc_hashmap();
-    // Initialize the entries.
-    map->size    = size;
-    map->entries = __alloc_entries(size);
+    // Initialize the entries, with room for the expected number of entries.
+    map->size = HASHMAP_MIN_SIZE;
+    while ((map->size < (1u << 30)) && (map->size * 3 < size * 4)) {
+        map->size *= 2;
+    }
+    map->entries = __alloc_entries(map->size);
     // Initialize its functions.
     map->hash_func     = hash_fun;
     map->hash_comp     = comp_fun;
@@ -128,139 +256,130 @@ hashmap_t *hashmap_create(
 void hashmap_free(hashmap_t *map)
 {
     for (unsigned int i = 0; i < map->size; ++i) {
-        hashmap_entry_t *x = map->entries[i], *p;
-        while (x) {
-            p = x;
-            x = x->next;
-            map->hash_key_free(p->key);
-            __dealloc_entry(p);
+        if (map->entries[i].dist) {
+            map->hash_key_free(map->entries[i].key);
         }
     }
     __dealloc_entries(map->entries);
+    if (map->old_entries) {
+        for (unsigned int i = map->old_moved; i < map->old_size; ++i) {
+            if (map->old_entries[i].dist && (map->old_entries[i].key != HASHMAP_REMOVED)) {
+                map->hash_key_free(map->old_entries[i].key);
+            }
+        }
+        __dealloc_entries(map->old_entries);
+    }
+    kfree(map);
 }
 
 void *hashmap_set(hashmap_t *map, const void *key, void *value)
 {
-    unsigned int hash  = map->hash_func(key) % map->size;
-    hashmap_entry_t *x = map->entries[hash];
-
-    if (x == NULL) {
-        hashmap_entry_t *e = __alloc_entry();
-        e->key             = map->hash_key_dup(key);
-        e->value           = value;
-        e->next            = NULL;
-        map->entries[hash] = e;
-
-        return NULL;
+    __hashmap_move(map, HASHMAP_MOVE_STEPS);
+    unsigned int hash      = __hashmap_mix(map->hash_func(key));
+    hashmap_entry_t *entry = __hashmap_find(map, map->entries, map->size, key, hash);
+    if (entry) {
+        void *out    = entry->value;
+        entry->value = value;
+        return out;
     }
-
-    hashmap_entry_t *p = NULL;
-
-    do {
-        if (map->hash_comp(x->key, key)) {
-            void *out = x->value;
-            x->value  = value;
-
-            return out;
-        }
-        p = x;
-        x = x->next;
-    } while (x);
-
-    hashmap_entry_t *e = __alloc_entry();
-    e->key             = map->hash_key_dup(key);
-    e->value           = value;
-    e->next            = NULL;
-    p->next            = e;
-
+    if (map->old_entries && (entry = __hashmap_find(map, map->old_entries, map->old_size, key, hash))) {
+        // Move it to the current table, where the lookups search first.
+        hashmap_entry_t moved = *entry;
+        entry->key            = HASHMAP_REMOVED;
+        moved.value           = value;
+        __hashmap_place(map->entries, map->size, moved);
+        return entry->value;
+    }
+    if ((map->count + 1) * 4 > map->size * 3) {
+        __hashmap_grow(map);
+    }
+    assert((map->count + 1 < map->size) && "The hashmap is full.");
+    hashmap_entry_t added = {
+        .key   = map->hash_key_dup(key),
+        .value = value,
+        .hash  = hash,
+    };
+    __hashmap_place(map->entries, map->size, added);
+    ++map->count;
     return NULL;
 }
 
 void *hashmap_get(hashmap_t *map, const void *key)
 {
-    unsigned int hash = map->hash_func(key) % map->size;
-    for (hashmap_entry_t *x = map->entries[hash]; x; x = x->next) {
-        if (map->hash_comp(x->key, key)) {
-            {
-                return x->value;
-            }
-        }
+    unsigned int hash      = __hashmap_mix(map->hash_func(key));
+    hashmap_entry_t *entry = __hashmap_find(map, map->entries, map->size, key, hash);
+    if (!entry && map->old_entries) {
+        entry = __hashmap_find(map, map->old_entries, map->old_size, key, hash);
     }
-    return NULL;
+    return entry ? entry->value : NULL;
 }
 
 void *hashmap_remove(hashmap_t *map, const void *key)
 {
-    unsigned int hash  = map->hash_func(key) % map->size;
-    hashmap_entry_t *x = map->entries[hash];
-
-    if (x == NULL) {
+    __hashmap_move(map, HASHMAP_MOVE_STEPS);
+    unsigned int hash      = __hashmap_mix(map->hash_func(key));
+    hashmap_entry_t *entry = __hashmap_find(map, map->entries, map->size, key, hash);
+    void *out;
+    if (entry) {
+        out = entry->value;
+        map->hash_key_free(entry->key);
+        __hashmap_erase(map, entry);
+    } else if (map->old_entries && (entry = __hashmap_find(map, map->old_entries, map->old_size, key, hash))) {
+        out = entry->value;
+        map->hash_key_free(entry->key);
+        entry->key = HASHMAP_REMOVED;
+    } else {
         return NULL;
     }
-    if (map->hash_comp(x->key, key)) {
-        void *out          = x->value;
-        map->entries[hash] = x->next;
-        map->hash_key_free(x->key);
-        __dealloc_entry(x);
-        return out;
-    }
-
-    hashmap_entry_t *p = x;
-    x                  = x->next;
-    do {
-        if (map->hash_comp(x->key, key)) {
-            void *out = x->value;
-            p->next   = x->next;
-            map->hash_key_free(x->key);
-            __dealloc_entry(x);
-            return out;
-        }
-        p = x;
-        x = x->next;
-    } while (x);
-
-    return NULL;
+    --map->count;
+    return out;
 }
 
 int hashmap_is_empty(hashmap_t *map)
 {
-    for (unsigned int i = 0; i < map->size; ++i) {
-        if (map->entries[i]) {
-            return 0;
-        }
-    }
-    return 1;
+    return map->count == 0;
 }
 
 int hashmap_has(hashmap_t *map, const void *key)
 {
-    unsigned int hash = map->hash_func(key) % map->size;
-    for (hashmap_entry_t *x = map->entries[hash]; x; x = x->next) {
-        if (map->hash_comp(x->key, key)) {
-            return 1;
-        }
+    unsigned int hash = __hashmap_mix(map->hash_func(key));
+    if (__hashmap_find(map, map->entries, map->size, key, hash)) {
+        return 1;
     }
-    return 0;
+    return map->old_entries && __hashmap_find(map, map->old_entries, map->old_size, key, hash);
 }
 
-list_t *hashmap_keys(hashmap_t *map)
+void hashmap_iter_init(hashmap_iter_t *it, hashmap_t *map)
 {
-    list_t *l = list_create();
-    for (unsigned int i = 0; i < map->size; ++i) {
-        for (hashmap_entry_t *x = map->entries[i]; x; x = x->next) {
-            list_insert_back(l, x->key);
-        }
-    }
-    return l;
+    it->map   = map;
+    it->index = 0;
+    it->old   = 0;
 }
 
-list_t *hashmap_values(hashmap_t *map)
+int hashmap_iter_next(hashmap_iter_t *it, void **key, void **value)
 {
-    list_t *l = list_create();
-    for (unsigned int i = 0; i < map->size; ++i) {
-        for (hashmap_entry_t *x = map->entries[i]; x; x = x->next) {
-            list_insert_back(l, x->value);
+    hashmap_t *map = it->map;
+    while (1) {
+        hashmap_entry_t *entries = it->old ? map->old_entries : map->entries;
+        unsigned int size        = it->old ? map->old_size : map->size;
+        if (it->index >= size) {
+            if (it->old || !map->old_entries) {
+                return 0;
+            }
+            // The slots before old_moved were all moved already.
+            it->old   = 1;
+            it->index = map->old_moved;
+            continue;
+        }
+        hashmap_entry_t *entry = &entries[it->index++];
+        if (entry->dist && (entry->key != HASHMAP_REMOVED)) {
+            if (key) {
+                *key = entry->key;
+            }
+            if (value) {
+                *value = entry->value;
+            }
+            return 1;
         }
     }
-    return l;
 }
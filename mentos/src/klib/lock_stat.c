@@ -0,0 +1,85 @@
+/// @file lock_stat.c
+/// @brief Contention statistics of the spinlocks and of the mutexes.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// Only built with ENABLE_LOCK_STAT.
+
+#include "klib/lock_stat.h"
+#include "string.h"
+
+/// The list of the classes, new ones are pushed at the head.
+static lock_class_t *lock_classes;
+
+void lock_stat_register(lock_class_t *class)
+{
+    if (atomic_cmpxchg(&class->registered, 0, 1) != 0) {
+        return;
+    }
+    // Push the class without a lock, the classes are never removed.
+    lock_class_t *head;
+    do {
+        head        = lock_classes;
+        class->next = head;
+    } while ((lock_class_t *)atomic_cmpxchg((atomic_t *)&lock_classes, (int)head, (int)class) != head);
+}
+
+void lock_stat_acquired(lock_class_t *class, ktime_t wait)
+{
+    if (class == NULL) {
+        return;
+    }
+    lock_stat_t *stat = &class->stat[smp_processor_id()];
+    ++stat->acquired;
+    if (wait) {
+        ++stat->contended;
+        stat->wait_total += wait;
+        if (wait > stat->wait_max) {
+            stat->wait_max = wait;
+        }
+    }
+}
+
+void lock_stat_released(lock_class_t *class, ktime_t hold)
+{
+    if (class == NULL) {
+        return;
+    }
+    lock_stat_t *stat = &class->stat[smp_processor_id()];
+    stat->hold_total += hold;
+    if (hold > stat->hold_max) {
+        stat->hold_max = hold;
+    }
+}
+
+void lock_stat_sum(const lock_class_t *class, lock_stat_t *total)
+{
+    memset(total, 0, sizeof(lock_stat_t));
+    for (unsigned cpu = 0; cpu < SMP_MAX_CPUS; ++cpu) {
+        const lock_stat_t *stat = &class->stat[cpu];
+        total->acquired += stat->acquired;
+        total->contended += stat->contended;
+        total->wait_total += stat->wait_total;
+        total->hold_total += stat->hold_total;
+        if (stat->wait_max > total->wait_max) {
+            total->wait_max = stat->wait_max;
+        }
+        if (stat->hold_max > total->hold_max) {
+            total->hold_max = stat->hold_max;
+        }
+    }
+}
+
+void lock_stat_for_each(void (*fn)(lock_class_t *class, void *data), void *data)
+{
+    for (lock_class_t *class = lock_classes; class; class = class->next) {
+        fn(class, data);
+    }
+}
+
+void lock_stat_reset(void)
+{
+    for (lock_class_t *class = lock_classes; class; class = class->next) {
+        memset(class->stat, 0, sizeof(class->stat));
+    }
+}
@@ -1,33 +1,128 @@
 /// @file mutex.c
-/// @brief
+/// @brief Sleeping mutex.
 /// @copyright (c) 2014-2024 This file is distributed under the MIT License.
 /// See LICENSE.md for details.
 
 #include "klib/mutex.h"
-#include "io/debug.h"
+#include "hardware/smp.h"
+#include "klib/irqflags.h"
+#include "process/process.h"
+#include "process/scheduler.h"
 
-void mutex_lock(mutex_t *mutex, uint32_t owner)
+/// @brief How many times we check the mutex, before sleeping, in the hope that
+/// the owner running on another CPU releases it soon.
+#define MUTEX_SPIN_COUNT 100
+
+#ifdef ENABLE_LOCK_STAT
+void __mutex_init(mutex_t *mutex, lock_class_t *class)
+{
+    atomic_set(&mutex->state, 0);
+    mutex->owner = NULL;
+    init_waitqueue_head(&mutex->wait);
+    mutex->class      = class;
+    mutex->hold_start = 0;
+    lock_stat_register(class);
+}
+#else
+void mutex_init(mutex_t *mutex)
+{
+    atomic_set(&mutex->state, 0);
+    mutex->owner = NULL;
+    init_waitqueue_head(&mutex->wait);
+}
+#endif
+
+/// @brief Records the new owner of the mutex.
+/// @param mutex The mutex just taken.
+static inline void __mutex_set_owner(mutex_t *mutex)
 {
-    pr_debug("[%d] Trying to lock mutex...\n", owner);
-    int failure = 1;
-
-    while (mutex->state == 0 || failure || mutex->owner != owner) {
-        failure = 1;
-        if (mutex->state == 0) {
-            __asm__ __volatile__("movl $0x01,%%eax\n\t" // move 1 to eax
-                                 "xchg    %%eax,%0\n\t" // try to set the lock bit
-                                 "mov     %%eax,%1\n\t" // export our result to a test var
-                                 : "=m"(mutex->state), "=r"(failure)
-                                 : "m"(mutex->state)
-                                 : "%eax");
+    mutex->owner = scheduler_get_current_process();
+    if (mutex->owner) {
+        ++mutex->owner->lock_depth;
+    }
+}
+
+int mutex_trylock(mutex_t *mutex)
+{
+    if (atomic_cmpxchg(&mutex->state, 0, 1) != 0) {
+        return 0;
+    }
+    __mutex_set_owner(mutex);
+#ifdef ENABLE_LOCK_STAT
+    mutex->hold_start = rdtsc();
+    lock_stat_acquired(mutex->class, 0);
+#endif
+    return 1;
+}
+
+/// @brief Waits for the mutex to be released, and takes it.
+/// @param mutex The mutex to lock.
+static void __mutex_lock_slowpath(mutex_t *mutex)
+{
+    // The owner might be about to release it, from another CPU.
+    if (smp_num_cpus > 1) {
+        for (int spin = 0; spin < MUTEX_SPIN_COUNT; ++spin) {
+            if ((atomic_read(&mutex->state) == 0) && (atomic_cmpxchg(&mutex->state, 0, 1) == 0)) {
+                return;
+            }
+            cpu_relax();
         }
-        if (failure == 0) {
-            mutex->owner = owner; //test to see if we got the lock bit
+    }
+    task_struct *task = scheduler_get_current_process();
+    wait_queue_entry_t wait;
+    init_waitqueue_entry(&wait, task);
+    // Sleep with interrupts disabled, so that the wake up cannot get lost.
+    uint8_t flags = irq_disable();
+    // Wait in line, each unlock wakes only the first waiter, which keeps its
+    // place if somebody else takes the mutex first.
+    add_wait_queue_exclusive(&mutex->wait, &wait);
+    // Mark the mutex as contended, so that the unlock wakes us up, and take it
+    // if it was released meanwhile.
+    while (atomic_set_and_test(&mutex->state, 2) != 0) {
+        scheduler_set_task_state(task, TASK_UNINTERRUPTIBLE);
+        if (is_kthread(task)) {
+            kthread_yield();
+        } else {
+            // The processes share the kernel stack, and cannot be switched
+            // inside the kernel: halt until an interrupt releases the mutex.
+            __asm__ __volatile__("sti; hlt; cli" ::: "memory");
         }
+        scheduler_set_task_state(task, TASK_RUNNING);
+    }
+    remove_wait_queue(&mutex->wait, &wait);
+    irq_enable(flags);
+}
+
+void mutex_lock(mutex_t *mutex)
+{
+#ifdef ENABLE_LOCK_STAT
+    ktime_t wait_start = 0;
+#endif
+    // Fast path, the mutex is free.
+    if (atomic_cmpxchg(&mutex->state, 0, 1) != 0) {
+#ifdef ENABLE_LOCK_STAT
+        wait_start = rdtsc();
+#endif
+        __mutex_lock_slowpath(mutex);
     }
+    __mutex_set_owner(mutex);
+#ifdef ENABLE_LOCK_STAT
+    mutex->hold_start = rdtsc();
+    lock_stat_acquired(mutex->class, wait_start ? mutex->hold_start - wait_start : 0);
+#endif
 }
 
 void mutex_unlock(mutex_t *mutex)
 {
-    mutex->state = 0;
+#ifdef ENABLE_LOCK_STAT
+    lock_stat_released(mutex->class, rdtsc() - mutex->hold_start);
+#endif
+    if (mutex->owner) {
+        --mutex->owner->lock_depth;
+    }
+    mutex->owner = NULL;
+    // Wake up the waiters only if there might be some.
+    if (atomic_set_and_test(&mutex->state, 0) == 2) {
+        wake_up(&mutex->wait);
+    }
 }
@@ -0,0 +1,377 @@
+/// @file radix_tree.c
+/// @brief Radix tree, mapping sparse integer indices to pointers.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include "klib/radix_tree.h"
+
+#include "mem/slab.h"
+#include "string.h"
+#include "sys/errno.h"
+
+/// The number of bits of an index.
+#define RADIX_TREE_INDEX_BITS (sizeof(unsigned long) * 8)
+/// The tallest tree, enough for any index.
+#define RADIX_TREE_MAX_HEIGHT ((RADIX_TREE_INDEX_BITS + RADIX_TREE_MAP_SHIFT - 1) / RADIX_TREE_MAP_SHIFT)
+/// The mask of the index bits consumed by a level.
+#define RADIX_TREE_MAP_MASK (RADIX_TREE_MAP_SIZE - 1)
+/// The number of words holding the bits of a tag.
+#define RADIX_TREE_TAG_WORDS (RADIX_TREE_MAP_SIZE / 32)
+/// Used to walk the whole tree, instead of the items with a tag.
+#define RADIX_TREE_NO_TAG (-1)
+
+/// @brief Stores information of a node.
+struct radix_tree_node_t {
+    /// The children, or the items in the lowest level.
+    void *slots[RADIX_TREE_MAP_SIZE];
+    /// For each tag, the slots leading to items with the tag.
+    uint32_t tags[RADIX_TREE_MAX_TAGS][RADIX_TREE_TAG_WORDS];
+    /// The number of slots in use.
+    unsigned int count;
+};
+
+/// @brief Returns the largest index a tree of the given height can hold.
+/// @param height the height.
+/// @return the largest index.
+static inline unsigned long __radix_tree_maxindex(unsigned int height)
+{
+    unsigned int bits = height * RADIX_TREE_MAP_SHIFT;
+    return (bits >= RADIX_TREE_INDEX_BITS) ? ~0UL : ((1UL << bits) - 1);
+}
+
+/// @brief Returns the bits of the index below and at a level.
+/// @param shift the shift of the level.
+/// @return the mask.
+static inline unsigned long __radix_tree_span_mask(unsigned int shift)
+{
+    unsigned int bits = shift + RADIX_TREE_MAP_SHIFT;
+    return (bits >= RADIX_TREE_INDEX_BITS) ? ~0UL : ((1UL << bits) - 1);
+}
+
+static inline int __tag_get(radix_tree_node_t *node, int tag, unsigned int offset)
+{
+    return (node->tags[tag][offset / 32] >> (offset % 32)) & 1;
+}
+
+static inline void __tag_set(radix_tree_node_t *node, int tag, unsigned int offset)
+{
+    node->tags[tag][offset / 32] |= 1U << (offset % 32);
+}
+
+static inline void __tag_clear(radix_tree_node_t *node, int tag, unsigned int offset)
+{
+    node->tags[tag][offset / 32] &= ~(1U << (offset % 32));
+}
+
+static inline int __tag_any(radix_tree_node_t *node, int tag)
+{
+    for (unsigned int word = 0; word < RADIX_TREE_TAG_WORDS; ++word) {
+        if (node->tags[tag][word]) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static inline radix_tree_node_t *__radix_tree_node_alloc(void)
+{
+    radix_tree_node_t *node = kmalloc(sizeof(radix_tree_node_t));
+    if (node) {
+        memset(node, 0, sizeof(radix_tree_node_t));
+    }
+    return node;
+}
+
+/// @brief Frees a node and the nodes below it.
+/// @param node the node.
+/// @param height the height of the node, 1 for the lowest level.
+static void __radix_tree_free(radix_tree_node_t *node, unsigned int height)
+{
+    if (height > 1) {
+        for (unsigned int offset = 0; offset < RADIX_TREE_MAP_SIZE; ++offset) {
+            if (node->slots[offset]) {
+                __radix_tree_free(node->slots[offset], height - 1);
+            }
+        }
+    }
+    kfree(node);
+}
+
+/// @brief Adds levels on top of the root, until the index fits.
+/// @param tree the tree.
+/// @param index the index.
+/// @return 0 on success, -ENOMEM on failure.
+static int __radix_tree_extend(radix_tree_t *tree, unsigned long index)
+{
+    unsigned int height = tree->height ? tree->height : 1;
+    while (index > __radix_tree_maxindex(height)) {
+        ++height;
+    }
+    // An empty tree just starts taller.
+    if (tree->rnode == NULL) {
+        tree->height = height;
+        return 0;
+    }
+    while (tree->height < height) {
+        radix_tree_node_t *node = __radix_tree_node_alloc();
+        if (node == NULL) {
+            return -ENOMEM;
+        }
+        // The old root becomes the first child, with its tags.
+        node->slots[0] = tree->rnode;
+        node->count    = 1;
+        for (int tag = 0; tag < RADIX_TREE_MAX_TAGS; ++tag) {
+            if (__tag_any(tree->rnode, tag)) {
+                __tag_set(node, tag, 0);
+            }
+        }
+        tree->rnode = node;
+        ++tree->height;
+    }
+    return 0;
+}
+
+/// @brief Removes the levels on top of the root which only have one child on
+/// the left, so that the lookups do not walk through them.
+/// @param tree the tree.
+static void __radix_tree_shrink(radix_tree_t *tree)
+{
+    while ((tree->height > 1) && (tree->rnode->count == 1) && tree->rnode->slots[0]) {
+        radix_tree_node_t *node = tree->rnode;
+        tree->rnode             = node->slots[0];
+        --tree->height;
+        kfree(node);
+    }
+}
+
+void radix_tree_init(radix_tree_t *tree)
+{
+    tree->rnode  = NULL;
+    tree->height = 0;
+    tree->count  = 0;
+}
+
+void radix_tree_destroy(radix_tree_t *tree)
+{
+    if (tree->rnode) {
+        __radix_tree_free(tree->rnode, tree->height);
+    }
+    radix_tree_init(tree);
+}
+
+int radix_tree_insert(radix_tree_t *tree, unsigned long index, void *item)
+{
+    if (item == NULL) {
+        return -EINVAL;
+    }
+    if (__radix_tree_extend(tree, index) < 0) {
+        return -ENOMEM;
+    }
+    if (tree->rnode == NULL) {
+        if ((tree->rnode = __radix_tree_node_alloc()) == NULL) {
+            return -ENOMEM;
+        }
+    }
+    radix_tree_node_t *node = tree->rnode;
+    unsigned int shift      = (tree->height - 1) * RADIX_TREE_MAP_SHIFT;
+    for (; shift > 0; shift -= RADIX_TREE_MAP_SHIFT) {
+        unsigned int offset = (index >> shift) & RADIX_TREE_MAP_MASK;
+        if (node->slots[offset] == NULL) {
+            // The empty node left by a failure is harmless, and reused.
+            if ((node->slots[offset] = __radix_tree_node_alloc()) == NULL) {
+                return -ENOMEM;
+            }
+            ++node->count;
+        }
+        node = node->slots[offset];
+    }
+    unsigned int offset = index & RADIX_TREE_MAP_MASK;
+    if (node->slots[offset]) {
+        return -EEXIST;
+    }
+    node->slots[offset] = item;
+    ++node->count;
+    ++tree->count;
+    return 0;
+}
+
+/// @brief Walks down to the lowest node holding an index.
+/// @param tree the tree.
+/// @param index the index.
+/// @param path if not NULL, where the nodes along the way are stored.
+/// @return the lowest node, or NULL if some level is missing.
+static radix_tree_node_t *__radix_tree_walk(radix_tree_t *tree, unsigned long index, radix_tree_node_t **path)
+{
+    if ((tree->rnode == NULL) || (index > __radix_tree_maxindex(tree->height))) {
+        return NULL;
+    }
+    radix_tree_node_t *node = tree->rnode;
+    unsigned int shift      = (tree->height - 1) * RADIX_TREE_MAP_SHIFT;
+    for (unsigned int level = 0;; ++level, shift -= RADIX_TREE_MAP_SHIFT) {
+        if (path) {
+            path[level] = node;
+        }
+        if ((shift == 0) || (node == NULL)) {
+            return node;
+        }
+        node = node->slots[(index >> shift) & RADIX_TREE_MAP_MASK];
+    }
+}
+
+void *radix_tree_lookup(radix_tree_t *tree, unsigned long index)
+{
+    radix_tree_node_t *node = __radix_tree_walk(tree, index, NULL);
+    return node ? node->slots[index & RADIX_TREE_MAP_MASK] : NULL;
+}
+
+/// @brief Clears the bit of a tag in the nodes above a node which has no
+/// item with the tag left, as long as their other children do not have it.
+/// @param tree the tree.
+/// @param path the nodes from the root.
+/// @param level the level of the node without the tag.
+/// @param index the index used to walk down.
+/// @param tag the tag.
+static void __radix_tree_propagate_clear(radix_tree_t *tree, radix_tree_node_t **path, unsigned int level, unsigned long index, int tag)
+{
+    for (unsigned int it = level; (it > 0) && !__tag_any(path[it], tag); --it) {
+        // The slot of the node inside its parent.
+        unsigned int shift = (tree->height - it) * RADIX_TREE_MAP_SHIFT;
+        __tag_clear(path[it - 1], tag, (index >> shift) & RADIX_TREE_MAP_MASK);
+    }
+}
+
+void *radix_tree_delete(radix_tree_t *tree, unsigned long index)
+{
+    radix_tree_node_t *path[RADIX_TREE_MAX_HEIGHT];
+    radix_tree_node_t *node = __radix_tree_walk(tree, index, path);
+    unsigned int offset     = index & RADIX_TREE_MAP_MASK;
+    if ((node == NULL) || (node->slots[offset] == NULL)) {
+        return NULL;
+    }
+    void *item          = node->slots[offset];
+    node->slots[offset] = NULL;
+    --tree->count;
+    // Free the nodes left empty, from the bottom.
+    unsigned int level = tree->height - 1, shift = 0;
+    while (1) {
+        for (int tag = 0; tag < RADIX_TREE_MAX_TAGS; ++tag) {
+            __tag_clear(path[level], tag, offset);
+        }
+        if (--path[level]->count > 0) {
+            break;
+        }
+        kfree(path[level]);
+        if (level == 0) {
+            radix_tree_init(tree);
+            return item;
+        }
+        --level;
+        shift += RADIX_TREE_MAP_SHIFT;
+        offset                    = (index >> shift) & RADIX_TREE_MAP_MASK;
+        path[level]->slots[offset] = NULL;
+    }
+    for (int tag = 0; tag < RADIX_TREE_MAX_TAGS; ++tag) {
+        __radix_tree_propagate_clear(tree, path, level, index, tag);
+    }
+    __radix_tree_shrink(tree);
+    return item;
+}
+
+int radix_tree_tag_set(radix_tree_t *tree, unsigned long index, radix_tree_tag_t tag)
+{
+    radix_tree_node_t *path[RADIX_TREE_MAX_HEIGHT];
+    radix_tree_node_t *node = __radix_tree_walk(tree, index, path);
+    if ((node == NULL) || (node->slots[index & RADIX_TREE_MAP_MASK] == NULL)) {
+        return -ENOENT;
+    }
+    for (unsigned int level = 0, shift = (tree->height - 1) * RADIX_TREE_MAP_SHIFT; level < tree->height; ++level, shift -= RADIX_TREE_MAP_SHIFT) {
+        __tag_set(path[level], tag, (index >> shift) & RADIX_TREE_MAP_MASK);
+    }
+    return 0;
+}
+
+void radix_tree_tag_clear(radix_tree_t *tree, unsigned long index, radix_tree_tag_t tag)
+{
+    radix_tree_node_t *path[RADIX_TREE_MAX_HEIGHT];
+    radix_tree_node_t *node = __radix_tree_walk(tree, index, path);
+    if (node) {
+        __tag_clear(node, tag, index & RADIX_TREE_MAP_MASK);
+        __radix_tree_propagate_clear(tree, path, tree->height - 1, index, tag);
+    }
+}
+
+int radix_tree_tag_get(radix_tree_t *tree, unsigned long index, radix_tree_tag_t tag)
+{
+    radix_tree_node_t *node = __radix_tree_walk(tree, index, NULL);
+    return node && __tag_get(node, tag, index & RADIX_TREE_MAP_MASK);
+}
+
+int radix_tree_tagged(radix_tree_t *tree, radix_tree_tag_t tag)
+{
+    return tree->rnode && __tag_any(tree->rnode, tag);
+}
+
+/// @brief Collects the items from an index on, optionally only those with a
+/// tag.
+/// @param tree the tree.
+/// @param results where the items are stored.
+/// @param indices where their indices are stored, can be NULL.
+/// @param index the smallest index to collect.
+/// @param max the size of the arrays.
+/// @param tag the tag, or RADIX_TREE_NO_TAG.
+/// @return the number of items collected.
+static unsigned int __radix_tree_gang(radix_tree_t *tree, void **results, unsigned long *indices, unsigned long index, unsigned int max, int tag)
+{
+    unsigned int found = 0;
+    if ((tree->rnode == NULL) || (index > __radix_tree_maxindex(tree->height))) {
+        return 0;
+    }
+    while (found < max) {
+        // Walk down to the first item at or after the index.
+        radix_tree_node_t *node = tree->rnode;
+        unsigned int shift      = (tree->height - 1) * RADIX_TREE_MAP_SHIFT;
+        int hit                 = 0;
+        while (1) {
+            unsigned int offset = (index >> shift) & RADIX_TREE_MAP_MASK;
+            while ((offset < RADIX_TREE_MAP_SIZE) &&
+                   ((node->slots[offset] == NULL) || ((tag != RADIX_TREE_NO_TAG) && !__tag_get(node, tag, offset)))) {
+                ++offset;
+            }
+            if (offset == RADIX_TREE_MAP_SIZE) {
+                break;
+            }
+            // Skipping slots moves to the start of the next one.
+            if (offset != ((index >> shift) & RADIX_TREE_MAP_MASK)) {
+                index = (index & ~__radix_tree_span_mask(shift)) | ((unsigned long)offset << shift);
+            }
+            if (shift == 0) {
+                results[found] = node->slots[offset];
+                if (indices) {
+                    indices[found] = index;
+                }
+                ++found;
+                hit = 1;
+                break;
+            }
+            node = node->slots[offset];
+            shift -= RADIX_TREE_MAP_SHIFT;
+        }
+        // Move past the item found, or past the node with nothing left.
+        unsigned long last = hit ? index : (index | __radix_tree_span_mask(shift));
+        if (last >= __radix_tree_maxindex(tree->height)) {
+            break;
+        }
+        index = last + 1;
+    }
+    return found;
+}
+
+unsigned int radix_tree_gang_lookup(radix_tree_t *tree, void **results, unsigned long *indices, unsigned long first, unsigned int max)
+{
+    return __radix_tree_gang(tree, results, indices, first, max, RADIX_TREE_NO_TAG);
+}
+
+unsigned int radix_tree_gang_lookup_tag(radix_tree_t *tree, void **results, unsigned long *indices, unsigned long first, unsigned int max, radix_tree_tag_t tag)
+{
+    return __radix_tree_gang(tree, results, indices, first, max, tag);
+}
@@ -25,6 +25,8 @@ struct rbtree_t {
     rbtree_node_t *root;
     /// Comparison function for insertion.
     rbtree_tree_node_cmp_f cmp;
+    /// Optional function updating the data a node keeps about its subtree.
+    rbtree_tree_node_f augment;
     /// Size of the tree.
     unsigned int size;
 };
@@ -76,12 +78,27 @@ void rbtree_node_dealloc(rbtree_node_t *node)
     }
 }
 
+rbtree_node_t *rbtree_node_get_link(rbtree_node_t *node, int dir)
+{
+    if (node) {
+        return node->link[dir != 0];
+    }
+    return NULL;
+}
+
 static int rbtree_node_is_red(const rbtree_node_t *node)
 {
     return node ? node->red : 0;
 }
 
-static rbtree_node_t *rbtree_node_rotate(rbtree_node_t *node, int dir)
+static void rbtree_node_augment(rbtree_t *tree, rbtree_node_t *node)
+{
+    if (tree->augment && node) {
+        tree->augment(tree, node);
+    }
+}
+
+static rbtree_node_t *rbtree_node_rotate(rbtree_t *tree, rbtree_node_t *node, int dir)
 {
     rbtree_node_t *result = NULL;
     if (node) {
@@ -90,20 +107,53 @@ static rbtree_node_t *rbtree_node_rotate(rbtree_node_t *node, int dir)
         result->link[dir] = node;
         node->red         = 1;
         result->red       = 0;
+        // The node is now below the result, update it first.
+        rbtree_node_augment(tree, node);
+        rbtree_node_augment(tree, result);
     }
     return result;
 }
 
-static rbtree_node_t *rbtree_node_rotate2(rbtree_node_t *node, int dir)
+static rbtree_node_t *rbtree_node_rotate2(rbtree_t *tree, rbtree_node_t *node, int dir)
 {
     rbtree_node_t *result = NULL;
     if (node) {
-        node->link[!dir] = rbtree_node_rotate(node->link[!dir], !dir);
-        result           = rbtree_node_rotate(node, dir);
+        node->link[!dir] = rbtree_node_rotate(tree, node->link[!dir], !dir);
+        result           = rbtree_node_rotate(tree, node, dir);
     }
     return result;
 }
 
+// Updates, bottom-up, the nodes along the search path of the value. If
+// predecessor is set, the path continues from the node holding the value
+// down to its predecessor.
+static void rbtree_tree_augment_path(rbtree_t *tree, void *value, int predecessor)
+{
+    rbtree_node_t *path[RBTREE_ITER_MAX_HEIGHT];
+    rbtree_node_t node = { .value = value };
+    rbtree_node_t *it  = tree->root;
+    unsigned int top   = 0;
+    int cmp            = 0;
+    if (tree->augment == NULL) {
+        return;
+    }
+    while (it && (top < RBTREE_ITER_MAX_HEIGHT)) {
+        path[top++] = it;
+        if ((cmp = tree->cmp(tree, it, &node)) == 0) {
+            break;
+        }
+        it = it->link[cmp < 0];
+    }
+    if (it && predecessor) {
+        for (it = it->link[0]; it && (top < RBTREE_ITER_MAX_HEIGHT); it = it->link[1]) {
+            path[top++] = it;
+        }
+    }
+    while (top > 0) {
+        tree->augment(tree, path[--top]);
+    }
+}
+
 // rbtree_t - default callbacks
 
 static int rbtree_tree_node_cmp_ptr_cb(
@@ -134,13 +184,36 @@ rbtree_t *rbtree_tree_alloc(void)
 rbtree_t *rbtree_tree_init(rbtree_t *tree, rbtree_tree_node_cmp_f node_cmp_cb)
 {
     if (tree) {
-        tree->root = NULL;
-        tree->size = 0;
-        tree->cmp  = node_cmp_cb ? node_cmp_cb : rbtree_tree_node_cmp_ptr_cb;
+        tree->root    = NULL;
+        tree->size    = 0;
+        tree->cmp     = node_cmp_cb ? node_cmp_cb : rbtree_tree_node_cmp_ptr_cb;
+        tree->augment = NULL;
     }
     return tree;
 }
 
+void rbtree_tree_set_augment(rbtree_t *tree, rbtree_tree_node_f augment)
+{
+    if (tree) {
+        tree->augment = augment;
+    }
+}
+
+rbtree_node_t *rbtree_tree_get_root(rbtree_t *tree)
+{
+    if (tree) {
+        return tree->root;
+    }
+    return NULL;
+}
+
+void rbtree_tree_update(rbtree_t *tree, void *value)
+{
+    if (tree) {
+        rbtree_tree_augment_path(tree, value, 0);
+    }
+}
+
 rbtree_t *rbtree_tree_create(rbtree_tree_node_cmp_f node_cb)
 {
     return rbtree_tree_init(rbtree_tree_alloc(), node_cb);
@@ -258,9 +331,9 @@ int rbtree_tree_insert_node(rbtree_t *tree, rbtree_node_t *node)
                     // Hard red violation: rotations necessary
                     int dir2 = t->link[1] == g;
                     if (q == p->link[last]) {
-                        t->link[dir2] = rbtree_node_rotate(g, !last);
+                        t->link[dir2] = rbtree_node_rotate(tree, g, !last);
                     } else {
-                        t->link[dir2] = rbtree_node_rotate2(g, !last);
+                        t->link[dir2] = rbtree_node_rotate2(tree, g, !last);
                     }
                 }
 
@@ -289,6 +362,9 @@ int rbtree_tree_insert_node(rbtree_t *tree, rbtree_node_t *node)
         // Make the root black for simplified logic
         tree->root->red = 0;
         ++tree->size;
+
+        // Update the nodes above the new one.
+        rbtree_tree_augment_path(tree, node->value, 0);
     }
 
     return 1;
@@ -307,6 +383,7 @@ int rbtree_tree_remove_with_cb(rbtree_t *tree,
         rbtree_node_t *q, *p, *g;                // Helpers
         rbtree_node_t *f = NULL;                 // Found item
         int dir          = 1;
+        int moved        = 0;                    // The value changed node
 
         // Set up our helpers
         q = &head;
@@ -332,7 +409,7 @@ int rbtree_tree_remove_with_cb(rbtree_t *tree,
             // Push the red node down with rotations and color flips
             if (!rbtree_node_is_red(q) && !rbtree_node_is_red(q->link[dir])) {
                 if (rbtree_node_is_red(q->link[!dir])) {
-                    p = p->link[last] = rbtree_node_rotate(q, dir);
+                    p = p->link[last] = rbtree_node_rotate(tree, q, dir);
                 } else if (!rbtree_node_is_red(q->link[!dir])) {
                     rbtree_node_t *s = p->link[!last];
                     if (s) {
@@ -345,9 +422,9 @@ int rbtree_tree_remove_with_cb(rbtree_t *tree,
                         } else {
                             int dir2 = g->link[1] == p;
                             if (rbtree_node_is_red(s->link[last])) {
-                                g->link[dir2] = rbtree_node_rotate2(p, last);
+                                g->link[dir2] = rbtree_node_rotate2(tree, p, last);
                             } else if (rbtree_node_is_red(s->link[!last])) {
-                                g->link[dir2] = rbtree_node_rotate(p, last);
+                                g->link[dir2] = rbtree_node_rotate(tree, p, last);
                             }
 
                             // Ensure correct coloring
@@ -362,6 +439,7 @@ int rbtree_tree_remove_with_cb(rbtree_t *tree,
 
         // Replace and remove the saved node
         if (f) {
+            moved     = (f != q);
             void *tmp = f->value;
             f->value  = q->value;
             q->value  = tmp;
@@ -377,6 +455,14 @@ int rbtree_tree_remove_with_cb(rbtree_t *tree,
         // Update the root (it may be different)
         tree->root = head.link[1];
 
+        // Update the nodes above the removed one. When the value was moved
+        // inside the found node, the removed one was its predecessor.
+        if (moved) {
+            rbtree_tree_augment_path(tree, f->value, 1);
+        } else {
+            rbtree_tree_augment_path(tree, value, 0);
+        }
+
         // Make the root black for simplified logic
         if (tree->root != NULL) {
             tree->root->red = 0;
@@ -0,0 +1,173 @@
+/// @file rcu.c
+/// @brief Read-copy-update, for data read much more often than written.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// There is a single grace period at a time. It starts when callbacks are
+/// waiting, and ends when each CPU which has been running tasks noted a
+/// quiescent state after the start. The callbacks registered meanwhile wait
+/// for the next one.
+
+// Setup the logging for this file (do this before any other include).
+#include "sys/kernel_levels.h"           // Include kernel log levels.
+#define __DEBUG_HEADER__ "[RCU   ]"      ///< Change header.
+#define __DEBUG_LEVEL__  LOGLEVEL_NOTICE ///< Set log level.
+#include "io/debug.h"                    // Include debugging functions.
+
+#include "klib/rcu.h"
+#include "assert.h"
+#include "klib/irqflags.h"
+#include "klib/spinlock.h"
+#include "process/process.h"
+#include "process/scheduler.h"
+#include "system/softirq.h"
+
+volatile unsigned rcu_nesting[SMP_MAX_CPUS];
+
+/// @brief A list of callbacks.
+typedef struct rcu_list_t {
+    /// The first callback.
+    rcu_head_t *head;
+    /// Where the next callback is linked.
+    rcu_head_t **tail;
+} rcu_list_t;
+
+/// @brief Waits for synchronize_rcu to be done.
+typedef struct rcu_synchronize_t {
+    /// The callback.
+    rcu_head_t head;
+    /// Set once the grace period is over.
+    volatile int done;
+} rcu_synchronize_t;
+
+/// Runs the callbacks whose grace period is over.
+static void __rcu_do_batch(unsigned long data);
+
+/// @brief The state of the grace periods.
+static struct {
+    /// Protects the state, taken with the interrupts disabled.
+    spinlock_t lock;
+    /// The CPUs which run tasks, one bit each.
+    uint32_t cpus;
+    /// The CPUs which have not been quiescent since the grace period started.
+    uint32_t pending;
+    /// Set while a grace period is running.
+    int active;
+    /// The callbacks registered after the grace period started.
+    rcu_list_t next;
+    /// The callbacks waiting for the running grace period.
+    rcu_list_t wait;
+    /// The callbacks which can be called.
+    rcu_list_t done;
+} rcu_state = {
+    .next = { NULL, &rcu_state.next.head },
+    .wait = { NULL, &rcu_state.wait.head },
+    .done = { NULL, &rcu_state.done.head },
+};
+
+/// Calls the callbacks, with the interrupts enabled.
+static tasklet_t rcu_tasklet = TASKLET_INIT(__rcu_do_batch, 0);
+
+/// @brief Moves all the callbacks of a list at the end of another one.
+/// @param to the destination.
+/// @param from the source, left empty.
+static inline void __rcu_list_splice(rcu_list_t *to, rcu_list_t *from)
+{
+    if (from->head) {
+        *to->tail  = from->head;
+        to->tail   = from->tail;
+        from->head = NULL;
+        from->tail = &from->head;
+    }
+}
+
+/// @brief Ends the running grace period, and starts the next one if some
+/// callbacks wait for it. Called with the state locked.
+static void __rcu_advance(void)
+{
+    while (1) {
+        if (rcu_state.active) {
+            if (rcu_state.pending) {
+                return;
+            }
+            rcu_state.active = 0;
+            __rcu_list_splice(&rcu_state.done, &rcu_state.wait);
+            tasklet_schedule(&rcu_tasklet);
+        }
+        if (rcu_state.next.head == NULL) {
+            return;
+        }
+        // Start a new grace period for the callbacks registered so far. With
+        // no CPU running tasks yet, there are no readers to wait for.
+        __rcu_list_splice(&rcu_state.wait, &rcu_state.next);
+        rcu_state.pending = rcu_state.cpus;
+        rcu_state.active  = 1;
+    }
+}
+
+static void __rcu_do_batch(unsigned long data)
+{
+    uint8_t flags = irq_disable();
+    spinlock_lock(&rcu_state.lock);
+    rcu_head_t *head = rcu_state.done.head;
+    rcu_state.done.head = NULL;
+    rcu_state.done.tail = &rcu_state.done.head;
+    spinlock_unlock(&rcu_state.lock);
+    irq_enable(flags);
+    while (head) {
+        rcu_head_t *next = head->next;
+        head->func(head);
+        head = next;
+    }
+}
+
+void call_rcu(rcu_head_t *head, void (*func)(rcu_head_t *head))
+{
+    head->next     = NULL;
+    head->func     = func;
+    uint8_t flags  = irq_disable();
+    spinlock_lock(&rcu_state.lock);
+    *rcu_state.next.tail = head;
+    rcu_state.next.tail  = &head->next;
+    __rcu_advance();
+    spinlock_unlock(&rcu_state.lock);
+    irq_enable(flags);
+}
+
+/// @brief Wakes up synchronize_rcu.
+/// @param head the callback, inside rcu_synchronize_t.
+static void __rcu_wakeme(rcu_head_t *head)
+{
+    ((rcu_synchronize_t *)head)->done = 1;
+}
+
+void synchronize_rcu(void)
+{
+    task_struct *curr = scheduler_get_current_process();
+    assert(!rcu_read_lock_held() && "synchronize_rcu inside a read-side section.");
+    assert((!curr || is_kthread(curr)) && "Only kernel threads can wait for a grace period.");
+    rcu_synchronize_t sync = { .done = 0 };
+    call_rcu(&sync.head, __rcu_wakeme);
+    // Before the scheduler starts, the grace period is already over.
+    while (curr && !sync.done) {
+        kthread_yield();
+    }
+    if (!curr) {
+        __rcu_do_batch(0);
+    }
+}
+
+void rcu_note_context_switch(void)
+{
+    unsigned cpu = smp_processor_id();
+    if (rcu_nesting[cpu]) {
+        pr_warning("Context switch inside a read-side section, on CPU %u.\n", cpu);
+    }
+    spinlock_lock(&rcu_state.lock);
+    rcu_state.cpus |= 1u << cpu;
+    if (rcu_state.pending & (1u << cpu)) {
+        rcu_state.pending &= ~(1u << cpu);
+        __rcu_advance();
+    }
+    spinlock_unlock(&rcu_state.lock);
+}
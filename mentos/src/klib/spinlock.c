@@ -1,34 +1,155 @@
 /// @file spinlock.c
-/// @brief
+/// @brief Ticket spinlocks and MCS queued locks.
 /// @copyright (c) 2014-2024 This file is distributed under the MIT License.
 /// See LICENSE.md for details.
 
 #include "klib/spinlock.h"
+#include "process/preempt.h"
+#include "stdint.h"
 
+/// The increment of the next ticket, in the high half of the word.
+#define TICKET_NEXT 0x10000u
+
+/// @brief Returns the ticket being served.
+/// @param tickets the value of the lock.
+/// @return the ticket.
+#define TICKET_OWNER(tickets) ((uint16_t)(tickets))
+
+/// @brief Returns the next ticket to hand out.
+/// @param tickets the value of the lock.
+/// @return the ticket.
+#define TICKET_TAIL(tickets) ((uint16_t)((tickets) >> 16u))
+
+#ifdef ENABLE_LOCK_STAT
+void __spinlock_init(spinlock_t *spinlock, lock_class_t *class)
+{
+    spinlock->tickets    = 0;
+    spinlock->class      = class;
+    spinlock->hold_start = 0;
+    lock_stat_register(class);
+}
+#else
 void spinlock_init(spinlock_t *spinlock)
 {
-    (*spinlock) = SPINLOCK_FREE;
+    spinlock->tickets = 0;
 }
+#endif
 
 void spinlock_lock(spinlock_t *spinlock)
 {
-    while (1) {
-        if (atomic_set_and_test(spinlock, SPINLOCK_BUSY) == 0) {
-            break;
-        }
-        while (*spinlock) {
-            cpu_relax();
-        }
+    preempt_disable();
+    // Take the next ticket, the previous value tells whose turn it is.
+    unsigned tickets = (unsigned)atomic_add(&spinlock->tickets, TICKET_NEXT);
+    uint16_t ticket  = TICKET_TAIL(tickets);
+#ifdef ENABLE_LOCK_STAT
+    ktime_t wait_start = (TICKET_OWNER(tickets) != ticket) ? rdtsc() : 0;
+#endif
+    while (TICKET_OWNER(tickets) != ticket) {
+        cpu_relax();
+        tickets = (unsigned)atomic_read(&spinlock->tickets);
     }
+    barrier();
+#ifdef ENABLE_LOCK_STAT
+    // We hold the lock, so the time it was taken is ours to update.
+    spinlock->hold_start = rdtsc();
+    lock_stat_acquired(spinlock->class, wait_start ? spinlock->hold_start - wait_start : 0);
+#endif
 }
 
 void spinlock_unlock(spinlock_t *spinlock)
 {
+#ifdef ENABLE_LOCK_STAT
+    lock_stat_released(spinlock->class, rdtsc() - spinlock->hold_start);
+#endif
     barrier();
-    atomic_set(spinlock, SPINLOCK_FREE);
+    // Serve the next ticket. Only the owner changes the low half, but the
+    // increment must not carry into the next ticket, which other CPUs are
+    // taking meanwhile, thus only the low 16 bits of the word are incremented.
+    __asm__ __volatile__(LOCK_PREFIX "incw %0"
+                         : "+m"(spinlock->tickets)
+                         :
+                         : "memory");
+    preempt_enable();
 }
 
 int spinlock_trylock(spinlock_t *spinlock)
 {
-    return atomic_set_and_test(spinlock, SPINLOCK_BUSY) == 0;
+    unsigned tickets = (unsigned)atomic_read(&spinlock->tickets);
+    if (TICKET_OWNER(tickets) != TICKET_TAIL(tickets)) {
+        return 0;
+    }
+    preempt_disable();
+    // Take the next ticket, only if nobody took it meanwhile.
+    if ((unsigned)atomic_cmpxchg(&spinlock->tickets, (int)tickets, (int)(tickets + TICKET_NEXT)) != tickets) {
+        preempt_enable();
+        return 0;
+    }
+#ifdef ENABLE_LOCK_STAT
+    spinlock->hold_start = rdtsc();
+    lock_stat_acquired(spinlock->class, 0);
+#endif
+    return 1;
+}
+
+int spinlock_is_locked(spinlock_t *spinlock)
+{
+    unsigned tickets = (unsigned)atomic_read(&spinlock->tickets);
+    return TICKET_OWNER(tickets) != TICKET_TAIL(tickets);
+}
+
+uint8_t spinlock_lock_irqsave(spinlock_t *spinlock)
+{
+    // Disable the interrupts first, so that a handler taking the same lock
+    // cannot interrupt us while we hold it.
+    uint8_t flags = irq_disable();
+    spinlock_lock(spinlock);
+    return flags;
+}
+
+void spinlock_unlock_irqrestore(spinlock_t *spinlock, uint8_t flags)
+{
+    spinlock_unlock(spinlock);
+    irq_enable(flags);
+}
+
+void mcs_lock_init(mcs_lock_t *lock)
+{
+    lock->tail = NULL;
+}
+
+void mcs_lock(mcs_lock_t *lock, mcs_node_t *node)
+{
+    preempt_disable();
+    node->next   = NULL;
+    node->locked = 0;
+    // Append our node to the queue.
+    mcs_node_t *prev = (mcs_node_t *)atomic_set_and_test((atomic_t *)&lock->tail, (int)node);
+    if (prev == NULL) {
+        // The lock was free.
+        return;
+    }
+    // Tell the previous node we are next, and wait for it to hand the lock over.
+    prev->next = node;
+    while (!node->locked) {
+        cpu_relax();
+    }
+    barrier();
+}
+
+void mcs_unlock(mcs_lock_t *lock, mcs_node_t *node)
+{
+    barrier();
+    if (node->next == NULL) {
+        // If we are still the last node, the lock becomes free.
+        if ((mcs_node_t *)atomic_cmpxchg((atomic_t *)&lock->tail, (int)node, 0) == node) {
+            preempt_enable();
+            return;
+        }
+        // Another CPU is appending its node, wait until it is linked.
+        while (node->next == NULL) {
+            cpu_relax();
+        }
+    }
+    node->next->locked = 1;
+    preempt_enable();
 }
@@ -5,10 +5,12 @@
 
 #include "io/debug.h"
 #include "drivers/rtc.h"
+#include "hardware/hrtimer.h"
 #include "hardware/timer.h"
 #include "io/port_io.h"
 #include "stddef.h"
 #include "stdio.h"
+#include "sys/errno.h"
 #include "time.h"
 
 static const char *str_weekdays[] = { "Sunday", "Monday", "Tuesday", "Wednesday",
@@ -20,31 +22,34 @@ static const char *str_months[] = { "January", "February", "March", "April",
 
 time_t sys_time(time_t *time)
 {
-    tm_t curr_time;
-    gettime(&curr_time);
-    // January and February are counted as months 13 and 14 of the previous year.
-    if (curr_time.tm_mon <= 2) {
-        curr_time.tm_mon += 12;
-        curr_time.tm_year -= 1;
-    }
-    time_t t;
-    // Convert years to days
-    t = (365 * curr_time.tm_year) + (curr_time.tm_year / 4) - (curr_time.tm_year / 100) +
-        (curr_time.tm_year / 400);
-    // Convert months to days
-    t += (30 * curr_time.tm_mon) + (3 * (curr_time.tm_mon + 1) / 5) + curr_time.tm_mday;
-    // Unix time starts on January 1st, 1970
-    t -= 719561;
-    // Convert days to seconds
-    t *= 86400;
-    // Add hours, minutes and seconds
-    t += (3600 * curr_time.tm_hour) + (60 * curr_time.tm_min) + curr_time.tm_sec;
+    rtc_resync();
+    ktime_t now = hrtimer_get_time();
+    div64_32(&now, NSEC_PER_SEC);
+    time_t t = rtc_get_boot_time() + (time_t)now;
     if (time) {
         (*time) = t;
     }
     return t;
 }
 
+int sys_clock_gettime(clockid_t clockid, timespec *tp)
+{
+    if (tp == NULL) {
+        return -EFAULT;
+    }
+    ktime_t now   = hrtimer_get_time();
+    uint32_t nsec = div64_32(&now, NSEC_PER_SEC);
+    if (clockid == CLOCK_REALTIME) {
+        rtc_resync();
+        now += rtc_get_boot_time();
+    } else if (clockid != CLOCK_MONOTONIC) {
+        return -EINVAL;
+    }
+    tp->tv_sec  = (time_t)now;
+    tp->tv_nsec = (long)nsec;
+    return 0;
+}
+
 time_t difftime(time_t time1, time_t time2)
 {
     return time1 - time2;
@@ -6,7 +6,8 @@
 #include "math.h"
 #include "ctype.h"
 #include "fcvt.h"
-#include "io/video.h"
+#include "limits.h"
+#include "io/console.h"
 #include "stdarg.h"
 #include "stdbool.h"
 #include "stdint.h"
@@ -30,6 +31,55 @@ static char *_digits = "0123456789abcdefghijklmnopqrstuvwxyz";
 /// The list of uppercase digits.
 static char *_upper_digits = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
 
+/// The size of the chunks passed to the callback of vcbprintf.
+#define PRINTF_CHUNK 256
+
+/// @brief The destination of the formatted text: a buffer, which is either
+/// the output itself or passed to a callback each time it fills up.
+typedef struct format_out_t {
+    /// Receives the full buffer, NULL if the buffer is the output.
+    printf_write_t write;
+    /// The argument of the callback.
+    void *data;
+    /// The buffer.
+    char *buf;
+    /// The size of the buffer.
+    size_t size;
+    /// The number of characters in the buffer.
+    size_t used;
+    /// The number of characters produced, including the ones dropped.
+    size_t total;
+    /// Set when the callback fails.
+    int error;
+} format_out_t;
+
+/// @brief Passes the buffered characters to the callback.
+/// @param out the output.
+static void __out_flush(format_out_t *out)
+{
+    if (out->write && out->used) {
+        if (!out->error && (out->write(out->data, out->buf, out->used) < 0)) {
+            out->error = 1;
+        }
+        out->used = 0;
+    }
+}
+
+/// @brief Appends a character to the output. Without a callback, the
+/// characters which do not fit are only counted.
+/// @param out the output.
+/// @param c the character.
+static inline void __out_putc(format_out_t *out, char c)
+{
+    if (out->used == out->size) {
+        __out_flush(out);
+    }
+    if (out->used < out->size) {
+        out->buf[out->used++] = c;
+    }
+    ++out->total;
+}
+
 /// @brief Returns the index of the first non-integer character.
 static inline int skip_atoi(const char **s)
 {
@@ -40,7 +90,7 @@ static inline int skip_atoi(const char **s)
     return i;
 }
 
-static char *number(char *str, long num, int base, int size, int32_t precision, unsigned flags)
+static void number(format_out_t *out, long num, int base, int size, int32_t precision, unsigned flags)
 {
     char c, tmp[66] = { 0 };
     char *dig = _digits;
@@ -52,7 +102,7 @@ static char *number(char *str, long num, int base, int size, int32_t precision,
         flags &= ~FLAGS_ZEROPAD;
     }
     if (base < 2 || base > 36) {
-        return 0;
+        return;
     }
 
     c = (flags & FLAGS_ZEROPAD) ? '0' : ' ';
@@ -99,38 +149,37 @@ static char *number(char *str, long num, int base, int size, int32_t precision,
     size -= precision;
     if (!(flags & (FLAGS_ZEROPAD | FLAGS_LEFT))) {
         while (size-- > 0) {
-            *str++ = ' ';
+            __out_putc(out, ' ');
         }
     }
     if (sign) {
-        *str++ = sign;
+        __out_putc(out, sign);
     }
     if (flags & FLAGS_HASH) {
         if (base == 8) {
-            *str++ = '0';
+            __out_putc(out, '0');
         } else if (base == 16) {
-            *str++ = '0';
-            *str++ = _digits[33];
+            __out_putc(out, '0');
+            __out_putc(out, _digits[33]);
         }
     }
     if (!(flags & FLAGS_LEFT)) {
         while (size-- > 0) {
-            *str++ = c;
+            __out_putc(out, c);
         }
     }
     while (i < precision--) {
-        *str++ = '0';
+        __out_putc(out, '0');
     }
     while (i-- > 0) {
-        *str++ = tmp[i];
+        __out_putc(out, tmp[i]);
     }
     while (size-- > 0) {
-        *str++ = ' ';
+        __out_putc(out, ' ');
     }
-    return str;
 }
 
-static char *eaddr(char *str, unsigned char *addr, int size, int precision, unsigned flags)
+static void eaddr(format_out_t *out, unsigned char *addr, int size, int precision, unsigned flags)
 {
     (void)precision;
     char tmp[24];
@@ -152,22 +201,21 @@ static char *eaddr(char *str, unsigned char *addr, int size, int precision, unsi
 
     if (!(flags & FLAGS_LEFT)) {
         while (len < size--) {
-            *str++ = ' ';
+            __out_putc(out, ' ');
         }
     }
 
     for (i = 0; i < len; ++i) {
-        *str++ = tmp[i];
+        __out_putc(out, tmp[i]);
     }
 
     while (len < size--) {
-        *str++ = ' ';
+        __out_putc(out, ' ');
     }
 
-    return str;
 }
 
-static char *iaddr(char *str, unsigned char *addr, int size, int precision, unsigned flags)
+static void iaddr(format_out_t *out, unsigned char *addr, int size, int precision, unsigned flags)
 {
     (void)precision;
     char tmp[24];
@@ -199,19 +247,18 @@ static char *iaddr(char *str, unsigned char *addr, int size, int precision, unsi
 
     if (!(flags & FLAGS_LEFT)) {
         while (len < size--) {
-            *str++ = ' ';
+            __out_putc(out, ' ');
         }
     }
 
     for (i = 0; i < len; ++i) {
-        *str++ = tmp[i];
+        __out_putc(out, tmp[i]);
     }
 
     while (len < size--) {
-        *str++ = ' ';
+        __out_putc(out, ' ');
     }
 
-    return str;
 }
 
 static void cfltcvt(double value, char *buffer, char fmt, int precision)
@@ -363,7 +410,7 @@ static void cropzeros(char *buffer)
     }
 }
 
-static char *flt(char *str, double num, int size, int precision, char fmt, unsigned flags)
+static void flt(format_out_t *out, double num, int size, int precision, char fmt, unsigned flags)
 {
     char tmp[80];
     char c, sign;
@@ -419,35 +466,37 @@ static char *flt(char *str, double num, int size, int precision, char fmt, unsig
     size -= n;
     if (!(flags & (FLAGS_ZEROPAD | FLAGS_LEFT))) {
         while (size-- > 0) {
-            *str++ = ' ';
+            __out_putc(out, ' ');
         }
     }
 
     if (sign) {
-        *str++ = sign;
+        __out_putc(out, sign);
     }
 
     if (!(flags & FLAGS_LEFT)) {
         while (size-- > 0) {
-            *str++ = c;
+            __out_putc(out, c);
         }
     }
 
     for (i = 0; i < n; i++) {
-        *str++ = tmp[i];
+        __out_putc(out, tmp[i]);
     }
 
     while (size-- > 0) {
-        *str++ = ' ';
+        __out_putc(out, ' ');
     }
 
-    return str;
 }
 
-int vsprintf(char *str, const char *fmt, va_list args)
+/// @brief Formats the arguments into the output.
+/// @param out the output.
+/// @param fmt the format.
+/// @param args the arguments.
+static void __vformat(format_out_t *out, const char *fmt, va_list args)
 {
     int base;
-    char *tmp;
     char *s;
 
     // Flags to number().
@@ -456,9 +505,9 @@ int vsprintf(char *str, const char *fmt, va_list args)
     // 'h', 'l', or 'L' for integer fields.
     char qualifier;
 
-    for (tmp = str; *fmt; fmt++) {
+    for (; *fmt; fmt++) {
         if (*fmt != '%') {
-            *tmp++ = *fmt;
+            __out_putc(out, *fmt);
 
             continue;
         }
@@ -532,12 +581,12 @@ int vsprintf(char *str, const char *fmt, va_list args)
         case 'c':
             if (!(flags & FLAGS_LEFT)) {
                 while (--field_width > 0) {
-                    *tmp++ = ' ';
+                    __out_putc(out, ' ');
                 }
             }
-            *tmp++ = va_arg(args, char);
+            __out_putc(out, va_arg(args, char));
             while (--field_width > 0) {
-                *tmp++ = ' ';
+                __out_putc(out, ' ');
             }
             continue;
 
@@ -550,16 +599,16 @@ int vsprintf(char *str, const char *fmt, va_list args)
             int32_t len = (int32_t)strnlen(s, (uint32_t)precision);
             if (!(flags & FLAGS_LEFT)) {
                 while (len < field_width--) {
-                    *tmp++ = ' ';
+                    __out_putc(out, ' ');
                 }
             }
 
             int32_t it;
             for (it = 0; it < len; ++it) {
-                *tmp++ = *s++;
+                __out_putc(out, *s++);
             }
             while (len < field_width--) {
-                *tmp++ = ' ';
+                __out_putc(out, ' ');
             }
             continue;
 
@@ -568,15 +617,15 @@ int vsprintf(char *str, const char *fmt, va_list args)
                 field_width = 2 * sizeof(void *);
                 flags |= FLAGS_ZEROPAD;
             }
-            tmp = number(tmp, (unsigned long)va_arg(args, void *), 16, field_width, precision, flags);
+            number(out, (unsigned long)va_arg(args, void *), 16, field_width, precision, flags);
             continue;
         case 'n':
             if (qualifier == 'l') {
                 long *ip = va_arg(args, long *);
-                *ip      = (tmp - str);
+                *ip      = (long)out->total;
             } else {
                 int *ip = va_arg(args, int *);
-                *ip     = (tmp - str);
+                *ip     = (int)out->total;
             }
             continue;
         case 'A':
@@ -584,9 +633,9 @@ int vsprintf(char *str, const char *fmt, va_list args)
             break;
         case 'a':
             if (qualifier == 'l') {
-                tmp = eaddr(tmp, va_arg(args, unsigned char *), field_width, precision, flags);
+                eaddr(out, va_arg(args, unsigned char *), field_width, precision, flags);
             } else {
-                tmp = iaddr(tmp, va_arg(args, unsigned char *), field_width, precision, flags);
+                iaddr(out, va_arg(args, unsigned char *), field_width, precision, flags);
             }
             continue;
             // Integer number formats - set up the flags and "break".
@@ -613,14 +662,14 @@ int vsprintf(char *str, const char *fmt, va_list args)
         case 'e':
         case 'f':
         case 'g':
-            tmp = flt(tmp, va_arg(args, double), field_width, precision, *fmt, flags | FLAGS_SIGN);
+            flt(out, va_arg(args, double), field_width, precision, *fmt, flags | FLAGS_SIGN);
             continue;
         default:
             if (*fmt != '%') {
-                *tmp++ = '%';
+                __out_putc(out, '%');
             }
             if (*fmt) {
-                *tmp++ = *fmt;
+                __out_putc(out, *fmt);
             } else {
                 --fmt;
             }
@@ -636,7 +685,7 @@ int vsprintf(char *str, const char *fmt, va_list args)
             } else {
                 num = va_arg(args, int);
             }
-            tmp = number(tmp, num, base, field_width, precision, flags);
+            number(out, num, base, field_width, precision, flags);
         } else {
             unsigned long num;
             if (qualifier == 'l') {
@@ -646,24 +695,64 @@ int vsprintf(char *str, const char *fmt, va_list args)
             } else {
                 num = va_arg(args, unsigned int);
             }
-            tmp = number(tmp, num, base, field_width, precision, flags);
+            number(out, num, base, field_width, precision, flags);
         }
     }
 
-    *tmp = '\0';
-    return tmp - str;
+}
+
+int vcbprintf(printf_write_t callback, void *data, const char *fmt, va_list args)
+{
+    char chunk[PRINTF_CHUNK];
+    format_out_t out = { .write = callback, .data = data, .buf = chunk, .size = sizeof(chunk) };
+    __vformat(&out, fmt, args);
+    __out_flush(&out);
+    return out.error ? -1 : (int)out.total;
+}
+
+int vsnprintf(char *str, size_t size, const char *fmt, va_list args)
+{
+    // Keep the last byte for the terminator.
+    format_out_t out = { .buf = str, .size = size ? size - 1 : 0 };
+    __vformat(&out, fmt, args);
+    if (size) {
+        str[out.used] = '\0';
+    }
+    return (int)out.total;
+}
+
+int vsprintf(char *str, const char *fmt, va_list args)
+{
+    return vsnprintf(str, (size_t)INT_MAX, fmt, args);
+}
+
+int snprintf(char *str, size_t size, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    int len = vsnprintf(str, size, fmt, ap);
+    va_end(ap);
+    return len;
+}
+
+/// @brief Writes a chunk of formatted text on the screen.
+/// @param data unused.
+/// @param chunk the text.
+/// @param length the length of the text.
+/// @return 0.
+static int __printf_write(void *data, const char *chunk, size_t length)
+{
+    console_write(chunk, length);
+    return 0;
 }
 
 int printf(const char *format, ...)
 {
-    char buffer[4096];
     va_list ap;
-    int len;
     // Start variabile argument's list.
     va_start(ap, format);
-    len = vsprintf(buffer, format, ap);
+    int len = vcbprintf(__printf_write, NULL, format, ap);
     va_end(ap);
-    video_puts(buffer);
     return len;
 }
 
@@ -59,7 +59,7 @@ static inline int __bb_test_flag(bb_page_t *page, int flag)
 /// @return The page we found.
 static inline bb_page_t *__get_page_from_base(bb_instance_t *instance, bb_page_t *base, unsigned int index)
 {
-    return (bb_page_t *)(((uint32_t)base) + instance->pgs_size * index);
+    return (bb_page_t *)(((uintptr_t)base) + instance->pgs_size * index);
 }
 
 /// @brief Returns the page at the given index, starting from the first page of the BB system.
@@ -293,7 +293,7 @@ void buddy_system_init(bb_instance_t *instance,
                        uint32_t pages_count)
 {
     // Compute the base base page of the buddysystem instance.
-    instance->base_page = ((bb_page_t *)(((uint32_t)pages_start) + bbpage_offset));
+    instance->base_page = ((bb_page_t *)(((uintptr_t)pages_start) + bbpage_offset));
     // Save all needed page info.
     instance->bbpg_offset = bbpage_offset;
     instance->pgs_size    = pages_stride;
@@ -23,8 +23,10 @@
 #include "sys/bitops.h"
 #include "sys/list_head.h"
 
-/// The heap size.
-#define HEAP_SIZE (4 * M)
+/// The heap area is created, and grows, in multiples of this size.
+#define HEAP_GROW_SIZE (128 * K)
+/// Free space at the top of the heap above which it is given back.
+#define HEAP_TRIM_THRESHOLD (128 * K)
 /// The lower bound address, when randomly placing the virtual memory area.
 #define HEAP_VM_LB 0x40000000
 /// The upper bound address, when randomly placing the virtual memory area.
@@ -33,9 +35,16 @@
 /// Overhead given by the block_t itself.
 #define OVERHEAD sizeof(block_t)
 /// Align the given address.
-#define ADDR_ALIGN(addr) ((((uint32_t)(addr)) & 0xFFFFF000) + 0x1000)
+#define ADDR_ALIGN(addr) ((((uintptr_t)(addr)) & 0xFFFFF000) + 0x1000)
 /// Checks if the given address is aligned.
-#define IS_ALIGN(addr) ((((uint32_t)(addr)) & 0x00000FFF) == 0)
+#define IS_ALIGN(addr) ((((uintptr_t)(addr)) & 0x00000FFF) == 0)
+
+/// Number of free lists, must not exceed the bits of the bin map.
+#define KHEAP_NUM_BINS 32
+/// Number of bins covering a 16 bytes range each, the others cover a power of two.
+#define KHEAP_SMALL_BINS 16
+/// Largest size handled by the small bins.
+#define KHEAP_SMALL_MAX (KHEAP_SMALL_BINS * 16)
 
 /// @brief Identifies a block of memory.
 typedef struct block_t {
@@ -53,8 +62,10 @@ typedef struct block_t {
 typedef struct {
     /// @brief List of blocks.
     list_head list;
-    /// @brief List of free blocks.
-    list_head free;
+    /// @brief Bitmap of the non-empty free lists.
+    uint32_t binmap;
+    /// @brief Free blocks segregated by size, each list is sorted by size.
+    list_head bins[KHEAP_NUM_BINS];
 } heap_header_t;
 
 /// @brief Returns the given size, rounded in multiples of 16.
@@ -92,6 +103,50 @@ static inline const char *__block_to_string(block_t *block)
     return buffer;
 }
 
+/// @brief Returns the free list that holds blocks of the given size.
+/// @param size the size of the block.
+/// @return the index of the free list.
+static inline unsigned int __blkmngr_get_bin(uint32_t size)
+{
+    unsigned int index;
+    if (size <= KHEAP_SMALL_MAX) {
+        return (size > 0) ? (size - 1) / 16 : 0;
+    }
+    // Bin KHEAP_SMALL_BINS starts right after KHEAP_SMALL_MAX (2^8).
+    index = KHEAP_SMALL_BINS + (31 - __builtin_clz(size)) - 8;
+    return min(index, KHEAP_NUM_BINS - 1);
+}
+
+/// @brief Adds the block to its free list, keeping the list sorted by size.
+/// @param header header describing the heap.
+/// @param block the block to add.
+static inline void __blkmngr_add_free(heap_header_t *header, block_t *block)
+{
+    unsigned int index = __blkmngr_get_bin(block->size);
+    list_head *bin     = &header->bins[index];
+    list_head *it;
+    // Find the first block which is not smaller than this one.
+    for (it = bin->next; it != bin; it = it->next) {
+        if (list_entry(it, block_t, free)->size >= block->size) {
+            break;
+        }
+    }
+    list_head_insert_before(&block->free, it);
+    bit_set_assign(header->binmap, index);
+}
+
+/// @brief Removes the block from its free list.
+/// @param header header describing the heap.
+/// @param block the block to remove.
+static inline void __blkmngr_remove_free(heap_header_t *header, block_t *block)
+{
+    unsigned int index = __blkmngr_get_bin(block->size);
+    list_head_remove(&block->free);
+    if (list_head_empty(&header->bins[index])) {
+        bit_clear_assign(header->binmap, index);
+    }
+}
+
 static inline void __blkmngr_dump(heap_header_t *header)
 {
 #if __DEBUG_LEVEL__ == LOGLEVEL_DEBUG
@@ -117,21 +172,16 @@ static inline void __blkmngr_dump(heap_header_t *header)
             pr_debug("   HEAD   ");
         pr_debug("}\n");
     }
-    pr_debug("[%s] FREE (0x%p):\n", task->name, &header->free);
-    list_for_each_decl(it, &header->free)
-    {
-        block = list_entry(it, block_t, free);
-        pr_debug("[%s]     %s{", task->name, __block_to_string(block));
-        if (it->prev != &header->free)
-            pr_debug("0x%p", list_entry(it->prev, block_t, free));
-        else
-            pr_debug("   HEAD   ");
-        pr_debug(", ");
-        if (it->next != &header->free)
-            pr_debug("0x%p", list_entry(it->next, block_t, free));
-        else
-            pr_debug("   HEAD   ");
-        pr_debug("}\n");
+    for (unsigned int index = 0; index < KHEAP_NUM_BINS; ++index) {
+        if (list_head_empty(&header->bins[index])) {
+            continue;
+        }
+        pr_debug("[%s] FREE %2u (0x%p):\n", task->name, index, &header->bins[index]);
+        list_for_each_decl(it, &header->bins[index])
+        {
+            block = list_entry(it, block_t, free);
+            pr_debug("[%s]     %s\n", task->name, __block_to_string(block));
+        }
     }
     pr_debug("\n");
 #endif
@@ -141,24 +191,32 @@ static inline void __blkmngr_dump(heap_header_t *header)
 /// @param header header describing the heap.
 /// @param size the size we want.
 /// @return a block that should fit our needs.
+/// @details The bin of the size is the only one which might hold blocks that
+/// are too small, every block of the following bins fits, and since the lists
+/// are sorted the first one is the best fitting.
 static inline block_t *__blkmngr_find_best_fitting(heap_header_t *header, uint32_t size)
 {
     assert(header && "Received a NULL heap header.");
-    block_t *best_fitting = NULL, *block;
-    list_for_each_decl(it, &header->free)
+    unsigned int index = __blkmngr_get_bin(size);
+    block_t *block;
+    // Look inside the bin of the size.
+    list_for_each_decl(it, &header->bins[index])
     {
         block = list_entry(it, block_t, free);
-        if (!block->is_free) {
-            continue;
-        }
-        if (!__blkmngr_does_it_fit(block, size)) {
-            continue;
-        }
-        if (!best_fitting || (block->size < best_fitting->size)) {
-            best_fitting = block;
+        if (__blkmngr_does_it_fit(block, size)) {
+            return block;
         }
     }
-    return best_fitting;
+    // Take the smallest block of the first non-empty larger bin.
+    if (index + 1 >= KHEAP_NUM_BINS) {
+        return NULL;
+    }
+    uint32_t larger = header->binmap & ~((2U << index) - 1);
+    if (larger == 0) {
+        return NULL;
+    }
+    index = find_first_non_zero(larger);
+    return list_entry(header->bins[index].next, block_t, free);
 }
 
 /// @brief Given a block, finds its previous block.
@@ -218,8 +276,6 @@ static inline void __blkmngr_split_block(heap_header_t *header, block_t *block,
     block_t *split = (block_t *)((char *)block + OVERHEAD + size);
     // Insert the block in the list.
     list_head_insert_after(&split->list, &block->list);
-    // Insert the block in the free list.
-    list_head_insert_after(&split->free, &block->free);
     // Update the size of the new block.
     split->size = block->size - OVERHEAD - size;
     // Update the size of the base block.
@@ -227,6 +283,8 @@ static inline void __blkmngr_split_block(heap_header_t *header, block_t *block,
     // Set the blocks as free.
     block->is_free = 1;
     split->is_free = 1;
+    // Insert the new block in the free lists.
+    __blkmngr_add_free(header, split);
 
     pr_debug("Into      %s\n", __block_to_string(block));
     pr_debug("And       %s\n", __block_to_string(split));
@@ -243,14 +301,18 @@ static inline void __blkmngr_merge_blocks(heap_header_t *header, block_t *block,
     pr_debug("Merging %s\n", __block_to_string(block));
     pr_debug("And     %s\n", __block_to_string(other));
 
+    // The size changes, so the block has to move to another free list.
+    __blkmngr_remove_free(header, block);
     // Remove the other block from the free list.
-    list_head_remove(&other->free);
+    __blkmngr_remove_free(header, other);
     // Remove the other block from the list.
     list_head_remove(&other->list);
     // Update the size.
     block->size = block->size + other->size + OVERHEAD;
     // Set the splitted block as free.
     block->is_free = 1;
+    // Insert the block back, inside the free list of its new size.
+    __blkmngr_add_free(header, block);
 
     pr_debug("Into    %s\n", __block_to_string(block));
 }
@@ -272,11 +334,18 @@ static void *__do_brk(vm_area_struct_t *heap, uint32_t increment)
     uint32_t new_heap_top = mm->brk + increment;
     // Debugging message.
     pr_notice("Expanding heap from 0x%p to 0x%p.\n", mm->brk, new_heap_top);
-    // If new boundary is larger than the end, we fail.
-    if (new_heap_top > heap->vm_end) {
-        pr_err("The new boundary is larger than the end!");
+    if (new_heap_top < mm->brk) {
+        pr_err("The heap cannot grow of %u bytes!\n", increment);
         return NULL;
     }
+    // The pages of the area are allocated on demand, so it simply grows when
+    // the new top is past its end, unless another area lies right above it.
+    if (new_heap_top > heap->vm_end) {
+        if (expand_vm_area(mm, heap, round_up(new_heap_top, HEAP_GROW_SIZE)) < 0) {
+            pr_err("The heap cannot grow past 0x%p!\n", heap->vm_end);
+            return NULL;
+        }
+    }
     // Overwrite the top of the heap.
     mm->brk = new_heap_top;
     // Return the old top of the heap.
@@ -303,23 +372,24 @@ static void *__do_malloc(vm_area_struct_t *heap, size_t size)
     block_t *block = __blkmngr_find_best_fitting(header, rounded_size);
     // If we were able to find a suitable block, either split it, or return it.
     if (block) {
+        // Remove the block from the free lists.
+        __blkmngr_remove_free(header, block);
         if (block->size > actual_size) {
             // Split the block, provide the rounded size to the function.
             __blkmngr_split_block(header, block, rounded_size);
         } else {
             pr_debug("Found perfect block: %s\n", __block_to_string(block));
         }
-        // Remove the block from the free list.
-        list_head_remove(&block->free);
     } else {
         pr_debug("Failed to find suitable block, we need to create a new one.\n");
         // We need more space, specifically the size of the block plus the size
         // of the block_t structure.
         block = __do_brk(heap, actual_size);
+        if (block == NULL) {
+            return NULL;
+        }
         // Set the size.
         block->size = rounded_size;
-        // Check the block.
-        assert(block && "Failed to create a new block!");
         // Setup the new block.
         list_head_init(&block->list);
         list_head_init(&block->free);
@@ -331,6 +401,33 @@ static void *__do_malloc(vm_area_struct_t *heap, size_t size)
     return (void *)((char *)block + OVERHEAD);
 }
 
+/// @brief Gives back the top of the heap, when it is a large free block.
+/// @param heap   The heap.
+/// @param header The header of the heap.
+/// @param block  The free block, which has already been merged with its
+/// neighbours.
+static void __do_trim(vm_area_struct_t *heap, heap_header_t *header, block_t *block)
+{
+    // Only the last block can be given back, since the heap only shrinks from the top.
+    if ((block->size < HEAP_TRIM_THRESHOLD) || __blkmngr_get_next_block(header, block)) {
+        return;
+    }
+    mm_struct_t *mm = scheduler_get_current_process()->mm;
+    uint32_t old_top = mm->brk;
+    // The block disappears, and the top of the heap goes back to its start.
+    __blkmngr_remove_free(header, block);
+    list_head_remove(&block->list);
+    mm->brk = (uintptr_t)block;
+    // The area keeps its size, but the pages above the top go back to the
+    // system, and read as zeros if the heap grows again. Locked pages stay.
+    uint32_t start = round_up(mm->brk, PAGE_SIZE);
+    uint32_t end   = round_up(old_top, PAGE_SIZE);
+    if ((start < end) && !(heap->vm_hints & VM_LOCKED)) {
+        int discarded = mem_discard_range(mm, heap, start, end);
+        pr_debug("Trimmed the heap to 0x%p, %d pages given back.\n", mm->brk, discarded);
+    }
+}
+
 /// @brief Deallocates previously allocated space.
 /// @param heap Heap to which we return the allocated memory.
 /// @param ptr  Pointer to the allocated memory.
@@ -357,15 +454,16 @@ static void __do_free(vm_area_struct_t *heap, void *ptr)
         __blkmngr_merge_blocks(header, prev, block);
     } else if (next && next->is_free) {
         pr_debug("Merging with next.\n");
-        // Merge the blocks.
+        // Add the block to the free lists, then merge the blocks.
+        __blkmngr_add_free(header, block);
         __blkmngr_merge_blocks(header, block, next);
-        // Add the block to the free list.
-        list_head_insert_before(&block->free, &header->free);
     } else {
         pr_debug("No merging required.\n");
-        // Add the block to the free list.
-        list_head_insert_before(&block->free, &header->free);
+        // Add the block to the free lists.
+        __blkmngr_add_free(header, block);
     }
+    // The block might have been merged into the previous one.
+    __do_trim(heap, header, (prev && prev->is_free) ? prev : block);
     __blkmngr_dump(header);
 }
 
@@ -382,41 +480,43 @@ void *sys_brk(void *addr)
     // Allocate the segment if don't exist.
     if (heap == NULL) {
         pr_debug("Allocating heap!\n");
-        // Set the heap to 4 Mb.
-        size_t heap_size = HEAP_SIZE;
-        // Add to that the space required to store the header, and the first block.
-        size_t segment_size = heap_size + sizeof(heap_header_t) + sizeof(block_t);
         // Create the virtual memory area, we are goin to place the area between
         // 0x40000000 and 0x50000000, which surely is below the stack. The VM
-        // code will check if it is a valid area anyway.
+        // code will check if it is a valid area anyway. Its pages are
+        // allocated, already cleared, the first time they are touched, and
+        // the area grows when the heap needs more space.
         heap = create_vm_area(
             task->mm,
-            randuint(HEAP_VM_LB, HEAP_VM_UB),
-            segment_size,
-            MM_RW | MM_PRESENT | MM_USER | MM_UPDADDR,
+            randuint(HEAP_VM_LB, HEAP_VM_UB) & ~(PAGE_SIZE - 1),
+            HEAP_GROW_SIZE,
+            MM_PRESENT | MM_RW | MM_COW | MM_USER,
             GFP_HIGHUSER);
-        pr_debug("Heap size  : %s.\n", to_human_size(heap_size));
         pr_debug("Heap start : 0x%p.\n", heap->vm_start);
         pr_debug("Heap end   : 0x%p.\n", heap->vm_end);
-        // Initialize the memory.
-        memset((char *)heap->vm_start, 0, segment_size);
+        // After mlockall(MCL_FUTURE), the pages of the heap are always there.
+        if (heap->vm_hints & VM_LOCKED) {
+            mem_populate_range(task->mm, heap, heap->vm_start, heap->vm_end, 1);
+        }
         // Save where the original heap starts.
         task->mm->start_brk = heap->vm_start;
         // Initialize the header.
         heap_header_t *header = (heap_header_t *)heap->vm_start;
         list_head_init(&header->list);
-        list_head_init(&header->free);
-        // Preare the first block.
-        block_t *block = (block_t *)(header + sizeof(heap_header_t));
+        header->binmap = 0;
+        for (unsigned int index = 0; index < KHEAP_NUM_BINS; ++index) {
+            list_head_init(&header->bins[index]);
+        }
+        // Preare the first block, right after the header.
+        block_t *block = (block_t *)(header + 1);
         // Let us start with a block of 1 Kb.
         block->size = K;
         list_head_init(&block->list);
         list_head_init(&block->free);
         // Insert the block inside the heap.
         list_head_insert_before(&block->list, &header->list);
-        list_head_insert_before(&block->free, &header->free);
+        __blkmngr_add_free(header, block);
         // Save where the heap actually start.
-        task->mm->brk = (uint32_t)((char *)block + OVERHEAD + block->size);
+        task->mm->brk = (uintptr_t)((char *)block + OVERHEAD + block->size);
         // Set the block as free.
         block->is_free = 1;
         __blkmngr_dump(header);
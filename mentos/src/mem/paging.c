@@ -11,17 +11,30 @@
 
 #include "assert.h"
 #include "descriptor_tables/isr.h"
+#include "fcntl.h"
+#include "fs/page_cache.h"
+#include "fs/vfs.h"
+#include "klib/irqflags.h"
 #include "mem/kheap.h"
 #include "mem/paging.h"
+#include "mem/shrinker.h"
+#include "mem/swap.h"
 #include "mem/vmem_map.h"
 #include "mem/zone_allocator.h"
+#include "process/preempt.h"
+#include "process/process.h"
+#include "process/scheduler.h"
+#include "process/wait.h"
 #include "stddef.h"
 #include "stdint.h"
 #include "string.h"
+#include "sys/dirent.h"
+#include "sys/errno.h"
+#include "sys/futex.h"
 #include "sys/list_head.h"
-#include "sys/list_head_algorithm.h"
 #include "sys/mman.h"
 #include "system/panic.h"
+#include "system/trace.h"
 
 /// Cache for storing mm_struct.
 kmem_cache_t *mm_cache;
@@ -35,6 +48,21 @@ kmem_cache_t *pgtbl_cache;
 /// The mm_struct of the kernel.
 static mm_struct_t *main_mm;
 
+/// The number of pages above which flushing the whole TLB is cheaper than
+/// invalidating each page.
+#define TLB_FLUSH_THRESHOLD 32U
+
+/// The number of pages, aligned to a block of the same size, which are mapped
+/// at once when a process touches one of them for the first time.
+#define FAULT_AROUND_PAGES 8U
+
+/// The number of pages mapped at once inside the areas read in sequential
+/// order (MADV_SEQUENTIAL).
+#define FAULT_AROUND_SEQ_PAGES 64U
+
+/// The number of pages sent to the swap by a fault which finds no free memory.
+#define SWAP_CLUSTER_PAGES 32U
+
 /// @brief Structure for iterating page directory entries.
 typedef struct page_iterator_s {
     /// Pointer to the entry.
@@ -75,13 +103,990 @@ void paging_flush_tlb_single(unsigned long addr)
                          : "memory");
 }
 
+void paging_flush_tlb_all(void)
+{
+    uint32_t cr4 = get_cr4();
+    if (bitmask_check(cr4, CR4_PGE)) {
+        // Toggling the PGE bit flushes the global entries too.
+        set_cr4(bitmask_clear(cr4, CR4_PGE));
+        set_cr4(cr4);
+    } else {
+        set_cr3(get_cr3());
+    }
+}
+
+void paging_flush_tlb_range(page_directory_t *pgd, uint32_t start, uint32_t end)
+{
+    start = start & ~(PAGE_SIZE - 1);
+    // The user mappings of the other page directories are not inside the TLB.
+    if ((start < PROCAREA_END_ADDR) &&
+        ((uintptr_t)paging_get_current_directory() != get_physical_address_from_page(get_lowmem_page_from_address((uintptr_t)pgd)))) {
+        if (end <= PROCAREA_END_ADDR) {
+            return;
+        }
+        start = PROCAREA_END_ADDR;
+    }
+    if (start >= end) {
+        return;
+    }
+    if (((end - start) / PAGE_SIZE) > TLB_FLUSH_THRESHOLD) {
+        // Reloading cr3 keeps the global entries, which are only kernel ones.
+        if (end <= PROCAREA_END_ADDR) {
+            set_cr3(get_cr3());
+        } else {
+            paging_flush_tlb_all();
+        }
+        return;
+    }
+    for (uint32_t addr = start; addr < end; addr += PAGE_SIZE) {
+        paging_flush_tlb_single(addr);
+    }
+}
+
+/// @brief Returns the page table entry of the address, without allocating the page table.
+/// @param pgd the page directory.
+/// @param addr the virtual address.
+/// @return the entry, NULL if there is no page table for the address.
+static page_table_entry_t *__mem_get_pg_entry(page_directory_t *pgd, uint32_t addr)
+{
+    page_dir_entry_t *direntry = &pgd->entries[addr / LARGE_PAGE_SIZE];
+    if (!direntry->present || direntry->page_size) {
+        return NULL;
+    }
+    page_table_t *table = (page_table_t *)get_lowmem_address_from_page(
+        get_page_from_physical_address(((uint32_t)direntry->frame) << 12U));
+    return &table->pages[(addr / PAGE_SIZE) % 1024U];
+}
+
+/// @brief Clears the content of a physical page, from the given offset to its end.
+/// @param page the page.
+/// @param offset the offset inside the page.
+static void __mem_clear_page(page_t *page, uint32_t offset)
+{
+    uint32_t vaddr = virt_kmap(page);
+    memset((void *)(vaddr + offset), 0, PAGE_SIZE - offset);
+    virt_kunmap(vaddr);
+}
+
+/// @brief Copies the content of a physical page into another.
+/// @param dst the destination page.
+/// @param src the source page.
+static void __mem_copy_page(page_t *dst, page_t *src)
+{
+    virt_copy_pages(dst, src, 1);
+}
+
+/// @brief Returns the index of the page of the file mapped at the address.
+/// @param area the file mapping.
+/// @param addr the virtual address.
+/// @return the index of the page inside the file.
+static inline uint32_t __file_area_page_index(vm_area_struct_t *area, uint32_t addr)
+{
+    return area->vm_pgoff + ((addr - area->vm_start) / PAGE_SIZE);
+}
+
+/// @brief Checks if the pages of the area cover the given range.
+/// @param area the area.
+/// @param start the start of the range, aligned to a page.
+/// @param end the end of the range, exclusive, aligned to a page.
+/// @return 1 if the area contains the range, 0 otherwise.
+static inline int __vm_area_contains(vm_area_struct_t *area, uint32_t start, uint32_t end)
+{
+    return (start <= end) && (start >= (area->vm_start & ~(PAGE_SIZE - 1))) &&
+           (end <= ((area->vm_end + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1)));
+}
+
+/// @brief Drops a reference to a page mapped by a process, collecting it when
+/// nobody else is using it.
+/// @param page the page.
+/// @param freed the list collecting the pages to free, once the TLB has been
+/// flushed.
+static inline void __mem_put_page(page_t *page, list_head *freed)
+{
+    if (page_count(page) > 1) {
+        page_dec(page);
+    } else {
+        list_head_insert_before(&page->bbpage.location.cache, freed);
+    }
+}
+
+/// @brief Shares a page between two processes, write-protecting it if it is
+/// writable, so that the first process writing it gets its own copy.
+/// @param src_entry the entry of the process which owns the page.
+/// @param dst_entry the entry of the process which receives the page.
+/// @details The caller flushes the TLB for the source entries.
+static void __mem_share_page(page_table_entry_t *src_entry, page_table_entry_t *dst_entry)
+{
+    if (src_entry->rw || src_entry->kernel_cow) {
+        src_entry->rw         = 0;
+        src_entry->kernel_cow = 1;
+    }
+    page_inc(get_page_from_physical_address(((uint32_t)src_entry->frame) << 12U));
+    *dst_entry = *src_entry;
+}
+
+/// @brief Brings back the page of an entry from the swap.
+/// @param entry the entry, whose page is inside the swap.
+/// @return 0 on success, 1 if there is no memory, or the slot cannot be read.
+/// @details The entry is not present, thus no TLB flush is needed.
+static int __page_handle_swap(page_table_entry_t *entry)
+{
+    uint32_t slot = entry->frame;
+    page_t *page  = _alloc_pages(GFP_HIGHUSER, 0);
+    if (page == NULL) {
+        return 1;
+    }
+    if (swap_load(slot, page) < 0) {
+        __free_pages(page);
+        return 1;
+    }
+    swap_put(slot);
+    entry->frame     = get_physical_address_from_page(page) >> 12U;
+    entry->available = 1;
+    entry->accessed  = 0;
+    entry->dirty     = 0;
+    entry->present   = 1;
+    return 0;
+}
+
+/// Number of zeroed page tables kept aside, ready for the next fork or fault.
+#define PGT_QUICKLIST_MAX 64
+
+/// @brief The page tables given back by the processes, already zeroed. There
+/// is a single CPU, thus a single list.
+static struct {
+    /// The pages, linked through `bbpage.location.cache`.
+    list_head pages;
+    /// The number of pages.
+    unsigned long count;
+} pgt_quicklist = { { &pgt_quicklist.pages, &pgt_quicklist.pages }, 0 };
+
+/// @brief Allocates a zeroed page table, from the quicklist if possible.
+/// @return the page table, inside the low memory.
+static page_table_t *__pgt_alloc(void)
+{
+    page_t *page;
+    if (pgt_quicklist.count) {
+        page = list_entry(list_head_pop(&pgt_quicklist.pages), page_t, bbpage.location.cache);
+        --pgt_quicklist.count;
+        set_page_count(page, 1);
+        return (page_table_t *)get_lowmem_address_from_page(page);
+    }
+    if ((page = _alloc_pages(GFP_KERNEL, 0)) == NULL) {
+        return NULL;
+    }
+    page_table_t *table = (page_table_t *)get_lowmem_address_from_page(page);
+    memset(table, 0, sizeof(page_table_t));
+    return table;
+}
+
+/// @brief Drops a reference to a page table, which goes back to the
+/// quicklist, zeroed, with the last one.
+/// @param page the page holding the table.
+/// @details The zeroing happens on the teardown, which runs inside the reaper,
+/// instead of on the fork or on the fault which needs a table.
+static void __pgt_put(page_t *page)
+{
+    if (page_count(page) > 1) {
+        page_dec(page);
+        return;
+    }
+    if (pgt_quicklist.count >= PGT_QUICKLIST_MAX) {
+        __free_pages(page);
+        return;
+    }
+    memset((void *)get_lowmem_address_from_page(page), 0, sizeof(page_table_t));
+    list_head_insert_after(&page->bbpage.location.cache, &pgt_quicklist.pages);
+    ++pgt_quicklist.count;
+}
+
+/// @brief Returns the number of page tables inside the quicklist.
+/// @return the number of page tables.
+static unsigned long __pgt_quicklist_count(void)
+{
+    return pgt_quicklist.count;
+}
+
+/// @brief Gives the page tables of the quicklist back to the zones.
+/// @param nr_to_scan the number of page tables to free.
+/// @return the number of page tables freed.
+static unsigned long __pgt_quicklist_scan(unsigned long nr_to_scan)
+{
+    unsigned long freed = 0;
+    while (pgt_quicklist.count && (freed < nr_to_scan)) {
+        __free_pages(list_entry(list_head_pop(&pgt_quicklist.pages), page_t, bbpage.location.cache));
+        --pgt_quicklist.count;
+        ++freed;
+    }
+    return freed;
+}
+
+/// @brief Empties the quicklist under memory pressure.
+static shrinker_t pgt_quicklist_shrinker = {
+    .name          = "pgt_quicklist",
+    .count_objects = __pgt_quicklist_count,
+    .scan_objects  = __pgt_quicklist_scan,
+};
+
+/// @brief Checks if a page directory entry points to a page table shared
+/// with other processes since a fork. Shared tables are mapped read-only by
+/// the page directory, which is never the case otherwise.
+/// @param direntry the page directory entry.
+/// @param addr an address covered by the entry.
+/// @return 1 if the table is shared, 0 otherwise.
+static inline int __pgt_is_shared(page_dir_entry_t *direntry, uint32_t addr)
+{
+    return (addr < PROCAREA_END_ADDR) && direntry->present && !direntry->page_size && !direntry->rw;
+}
+
+/// @brief Gives a private copy of a shared page table to a process.
+/// @param direntry the page directory entry of the process.
+/// @details The pages are shared copy-on-write, as an eager fork would have
+/// done. The last process using the table takes it back without a copy.
+/// The caller flushes the TLB for the range of the entry.
+static void __pgt_unshare(page_dir_entry_t *direntry)
+{
+    page_t *table_page = get_page_from_physical_address(((uint32_t)direntry->frame) << 12U);
+    if (page_count(table_page) > 1) {
+        page_table_t *table = (page_table_t *)get_lowmem_address_from_page(table_page);
+        page_table_t *copy  = __pgt_alloc();
+        assert(copy && "Cannot copy a shared page table.");
+        for (uint32_t i = 0; i < 1024; ++i) {
+            page_table_entry_t *entry = &table->pages[i];
+            if (pte_is_swapped(entry)) {
+                // Both processes refer to the slot, until each one swaps it in.
+                if (swap_get(entry->frame) == 0) {
+                    copy->pages[i] = *entry;
+                    continue;
+                }
+                // The slot is shared by too many processes, bring the page back.
+                if (__page_handle_swap(entry)) {
+                    pr_err("Cannot swap in a page of a shared page table, the copy loses it.\n");
+                    continue;
+                }
+            }
+            if (entry->present) {
+                __mem_share_page(entry, &copy->pages[i]);
+            } else {
+                copy->pages[i] = *entry;
+            }
+        }
+        page_dec(table_page);
+        direntry->frame = get_physical_address_from_page(get_lowmem_page_from_address((uintptr_t)copy)) >> 12U;
+    }
+    direntry->rw = 1;
+}
+
+/// @brief Gives a private copy of the shared page tables covering a range.
+/// @param pgd the page directory.
+/// @param start the start of the range.
+/// @param end the end of the range.
+static void __pgt_unshare_range(page_directory_t *pgd, uint32_t start, uint32_t end)
+{
+    for (uint32_t addr = start & ~(LARGE_PAGE_SIZE - 1); addr && (addr < end); addr += LARGE_PAGE_SIZE) {
+        page_dir_entry_t *direntry = &pgd->entries[addr / LARGE_PAGE_SIZE];
+        if (__pgt_is_shared(direntry, addr)) {
+            __pgt_unshare(direntry);
+            paging_flush_tlb_range(pgd, addr, addr + LARGE_PAGE_SIZE);
+        }
+        if (addr + LARGE_PAGE_SIZE < addr) {
+            break;
+        }
+    }
+}
+
+/// @brief Shares with the child the page tables of the parent which cover
+/// only private memory, instead of copying their entries.
+/// @param parent the memory descriptor of the parent.
+/// @param child the memory descriptor of the child, without areas yet.
+/// @details The tables covering a shared mapping are copied eagerly, since
+/// the copy of their entries depends on the area.
+static void __pgt_share_tables(mm_struct_t *parent, mm_struct_t *child)
+{
+    bool_t shared = false;
+    for (uint32_t word = 0; word < count_of(parent->pgt_map); ++word) {
+        for (uint32_t bits = parent->pgt_map[word]; bits; bits &= bits - 1) {
+            uint32_t index             = word * 32 + __builtin_ctz(bits);
+            page_dir_entry_t *direntry = &parent->pgd->entries[index];
+            if (!direntry->present || direntry->page_size || direntry->global) {
+                continue;
+            }
+            uint32_t start = index * LARGE_PAGE_SIZE, end = start + LARGE_PAGE_SIZE;
+            bool_t private = true;
+            list_for_each_decl(it, &parent->mmap_list)
+            {
+                vm_area_struct_t *area = list_entry(it, vm_area_struct_t, vm_list);
+                if ((area->vm_start < end) && (area->vm_end > start) && (area->vm_flags & MAP_SHARED)) {
+                    private = false;
+                    break;
+                }
+            }
+            if (!private) {
+                continue;
+            }
+            direntry->rw = 0;
+            page_inc(get_page_from_physical_address(((uint32_t)direntry->frame) << 12U));
+            child->pgd->entries[index] = *direntry;
+            shared                     = true;
+        }
+    }
+    if (shared) {
+        // The parent cannot write through the shared tables anymore.
+        paging_flush_tlb_range(parent->pgd, 0, PROCAREA_END_ADDR);
+    }
+}
+
+/// @brief Prepares the page tables of a cloned area, pages are mapped on
+/// demand, except where the child shares the tables of the parent.
+/// @param mm the destination memory descriptor.
+/// @param segment the destination area.
+static void __clone_prepare_tables(mm_struct_t *mm, vm_area_struct_t *segment)
+{
+    uint32_t addr = segment->vm_start, end;
+    while (addr < segment->vm_end) {
+        end = min(segment->vm_end, (addr & ~(LARGE_PAGE_SIZE - 1)) + LARGE_PAGE_SIZE);
+        if (!__pgt_is_shared(&mm->pgd->entries[addr / LARGE_PAGE_SIZE], addr)) {
+            mem_upd_vm_area(mm->pgd, addr, 0, end - addr, MM_COW | MM_RW | MM_USER);
+        }
+        addr = end;
+    }
+}
+
+/// @brief Clones a file mapping, sharing the pages which come from the page
+/// cache and the private ones, which become copy-on-write.
+/// @param mm the destination memory descriptor.
+/// @param area the source area.
+/// @param new_segment the destination area, already initialized.
+static void __clone_file_vm_area(mm_struct_t *mm, vm_area_struct_t *area, vm_area_struct_t *new_segment)
+{
+    page_table_entry_t *src_entry, *dst_entry;
+    page_t *page;
+    // The new area holds its own reference to the file.
+    ++area->vm_file->count;
+    // Prepare the page tables, pages are mapped on demand.
+    __clone_prepare_tables(mm, new_segment);
+    for (uint32_t addr = area->vm_start; addr < area->vm_end; addr += PAGE_SIZE) {
+        // The entries of a shared table are already there.
+        if (__pgt_is_shared(&mm->pgd->entries[addr / LARGE_PAGE_SIZE], addr)) {
+            addr = (addr & ~(LARGE_PAGE_SIZE - 1)) + LARGE_PAGE_SIZE - PAGE_SIZE;
+            continue;
+        }
+        src_entry = __mem_get_pg_entry(area->vm_mm->pgd, addr);
+        dst_entry = __mem_get_pg_entry(mm->pgd, addr);
+        if (!src_entry || !dst_entry || !src_entry->present) {
+            continue;
+        }
+        if (area->vm_flags & MAP_PRIVATE) {
+            // Writable private pages belong to the process, they are copied
+            // on the first write.
+            __mem_share_page(src_entry, dst_entry);
+        } else {
+            // Pages of the page cache are shared.
+            page = get_page_from_physical_address(((uint32_t)src_entry->frame) << 12U);
+            page_inc(page);
+            *dst_entry = *src_entry;
+        }
+    }
+    // The private pages of the source are now write-protected.
+    paging_flush_tlb_range(area->vm_mm->pgd, area->vm_start, area->vm_end);
+}
+
+/// @brief Clones an area whose pages belong to a kernel object, the pages are
+/// shared with the source.
+/// @param mm the destination memory descriptor.
+/// @param area the source area.
+/// @param new_segment the destination area, already initialized.
+static void __clone_ops_vm_area(mm_struct_t *mm, vm_area_struct_t *area, vm_area_struct_t *new_segment)
+{
+    page_table_entry_t *src_entry, *dst_entry;
+    // Prepare the page tables, pages are mapped on demand.
+    __clone_prepare_tables(mm, new_segment);
+    for (uint32_t addr = area->vm_start; addr < area->vm_end; addr += PAGE_SIZE) {
+        src_entry = __mem_get_pg_entry(area->vm_mm->pgd, addr);
+        dst_entry = __mem_get_pg_entry(mm->pgd, addr);
+        if (!src_entry || !dst_entry || !src_entry->present) {
+            continue;
+        }
+        page_inc(get_page_from_physical_address(((uint32_t)src_entry->frame) << 12U));
+        *dst_entry = *src_entry;
+    }
+    // The object gains a user.
+    if (new_segment->vm_ops->open) {
+        new_segment->vm_ops->open(new_segment);
+    }
+}
+
+/// @brief Clones an anonymous area, the pages which are not there yet are
+/// allocated on demand by each process.
+/// @param mm the destination memory descriptor.
+/// @param area the source area.
+/// @param new_segment the destination area, already initialized.
+/// @param cow if the pages are shared copy-on-write, or copied right away.
+/// @param gfpflags the Get Free Pages flags, used when copying.
+static void __clone_anon_vm_area(mm_struct_t *mm, vm_area_struct_t *area, vm_area_struct_t *new_segment,
+                                 int cow, uint32_t gfpflags)
+{
+    page_table_entry_t *src_entry, *dst_entry;
+    page_t *copy;
+    // Prepare the page tables.
+    __clone_prepare_tables(mm, new_segment);
+    for (uint32_t addr = area->vm_start & ~(PAGE_SIZE - 1); addr < area->vm_end; addr += PAGE_SIZE) {
+        // The entries of a shared table are already there.
+        if (__pgt_is_shared(&mm->pgd->entries[addr / LARGE_PAGE_SIZE], addr)) {
+            addr = (addr & ~(LARGE_PAGE_SIZE - 1)) + LARGE_PAGE_SIZE - PAGE_SIZE;
+            continue;
+        }
+        src_entry = __mem_get_pg_entry(area->vm_mm->pgd, addr);
+        dst_entry = __mem_get_pg_entry(mm->pgd, addr);
+        if (!src_entry || !dst_entry) {
+            continue;
+        }
+        if (pte_is_swapped(src_entry)) {
+            // Both processes refer to the slot, until each one swaps it in.
+            if (swap_get(src_entry->frame) == 0) {
+                *dst_entry = *src_entry;
+                continue;
+            }
+            // The slot is shared by too many processes, bring the page back.
+            if (__page_handle_swap(src_entry)) {
+                pr_err("Cannot swap in the page at 0x%p, the copy loses it.\n", addr);
+                continue;
+            }
+        }
+        if (!src_entry->present) {
+            continue;
+        }
+        if (cow) {
+            __mem_share_page(src_entry, dst_entry);
+        } else {
+            copy = _alloc_pages(gfpflags, 0);
+            __mem_copy_page(copy, get_page_from_physical_address(((uint32_t)src_entry->frame) << 12U));
+            *dst_entry       = *src_entry;
+            dst_entry->frame = get_physical_address_from_page(copy) >> 12U;
+        }
+    }
+    if (cow) {
+        // The pages of the source are now write-protected.
+        paging_flush_tlb_range(area->vm_mm->pgd, area->vm_start, area->vm_end);
+    }
+}
+
+/// @brief Unmaps an anonymous area, dropping the references to its pages.
+/// @param mm the memory descriptor.
+/// @param area the area.
+/// @param freed the list collecting the pages to free.
+static void __destroy_anon_vm_area(mm_struct_t *mm, vm_area_struct_t *area, list_head *freed)
+{
+    page_table_entry_t *entry;
+    for (uint32_t addr = area->vm_start & ~(PAGE_SIZE - 1); addr < area->vm_end; addr += PAGE_SIZE) {
+        entry = __mem_get_pg_entry(mm->pgd, addr);
+        if (entry && pte_is_swapped(entry)) {
+            swap_put(entry->frame);
+            entry->available = 1;
+            entry->frame     = 0;
+            continue;
+        }
+        if (!entry || !entry->present) {
+            continue;
+        }
+        __mem_put_page(get_page_from_physical_address(((uint32_t)entry->frame) << 12U), freed);
+        entry->present    = 0;
+        entry->kernel_cow = 0;
+        entry->frame      = 0;
+    }
+}
+
+/// @brief Unmaps the pages of a file mapping inside the given range, the
+/// pages modified through shared mappings are marked dirty inside the cache.
+/// @param mm the memory descriptor.
+/// @param area the area.
+/// @param start the start of the range.
+/// @param end the end of the range, exclusive.
+/// @return the number of pages unmapped.
+static int __unmap_file_range(mm_struct_t *mm, vm_area_struct_t *area, uint32_t start, uint32_t end)
+{
+    page_table_entry_t *entry;
+    int unmapped = 0;
+    for (uint32_t addr = start; addr < end; addr += PAGE_SIZE) {
+        entry = __mem_get_pg_entry(mm->pgd, addr);
+        if (!entry || !entry->present) {
+            continue;
+        }
+        if ((area->vm_flags & MAP_SHARED) && entry->dirty) {
+            page_cache_mark_dirty(area->vm_file, __file_area_page_index(area, addr));
+        }
+        page_cache_put(get_page_from_physical_address(((uint32_t)entry->frame) << 12U));
+        entry->present    = 0;
+        entry->kernel_cow = 0;
+        entry->frame      = 0;
+        ++unmapped;
+    }
+    return unmapped;
+}
+
+/// @brief Unmaps the pages of an area owned by a kernel object inside the
+/// given range, dropping the references of the mapping.
+/// @param mm the memory descriptor.
+/// @param start the start of the range.
+/// @param end the end of the range, exclusive.
+/// @param freed the list collecting the pages to free.
+/// @return the number of pages unmapped.
+static int __unmap_ops_range(mm_struct_t *mm, uint32_t start, uint32_t end, list_head *freed)
+{
+    page_table_entry_t *entry;
+    int unmapped = 0;
+    for (uint32_t addr = start; addr < end; addr += PAGE_SIZE) {
+        entry = __mem_get_pg_entry(mm->pgd, addr);
+        if (!entry || !entry->present) {
+            continue;
+        }
+        __mem_put_page(get_page_from_physical_address(((uint32_t)entry->frame) << 12U), freed);
+        entry->present = 0;
+        entry->frame   = 0;
+        ++unmapped;
+    }
+    return unmapped;
+}
+
+/// @brief Unmaps a file mapping, writing back the pages modified through
+/// shared mappings.
+/// @param mm the memory descriptor.
+/// @param area the area.
+static void __destroy_file_vm_area(mm_struct_t *mm, vm_area_struct_t *area)
+{
+    __unmap_file_range(mm, area, area->vm_start, area->vm_end);
+    if (area->vm_flags & MAP_SHARED) {
+        page_cache_sync(area->vm_file);
+    }
+    vfs_close(area->vm_file);
+}
+
+/// @brief Finds the page table entries which can be moved by mem_evacuate_pages.
+/// @param mm the memory descriptor.
+/// @param first the first page of the block.
+/// @param count the number of pages of the block.
+/// @param entries the entries found, indexed by page inside the block.
+/// @param addrs the virtual addresses of the entries.
+static void __mem_find_movable_entries(mm_struct_t *mm, page_t *first, uint32_t count,
+                                       page_table_entry_t **entries, uint32_t *addrs)
+{
+    vm_area_struct_t *area;
+    page_table_entry_t *entry;
+    page_t *page;
+    uint32_t addr, npages;
+    list_for_each_decl(it, &mm->mmap_list)
+    {
+        area = list_entry(it, vm_area_struct_t, vm_list);
+        // Pages of file mappings and of objects are owned by someone else.
+        if (area->vm_file || area->vm_ops) {
+            continue;
+        }
+        // Walk the area the way destroy_vm_area frees it, block by block.
+        for (addr = area->vm_start; addr < area->vm_end; addr += npages * PAGE_SIZE) {
+            npages = 1;
+            entry  = __mem_get_pg_entry(mm->pgd, addr);
+            if (!entry) {
+                continue;
+            }
+            page   = get_page_from_physical_address(((uint32_t)entry->frame) << 12U);
+            npages = 1U << page->bbpage.order;
+            if (!entry->present || (page < first) || (page >= first + count)) {
+                continue;
+            }
+            // Only single pages, used by nobody else, can be moved.
+            if ((page->bbpage.order == 0) && (page_count(page) == 1)) {
+                entries[page - first] = entry;
+                addrs[page - first]   = addr;
+            }
+        }
+    }
+}
+
+int mem_evacuate_pages(page_t *first, unsigned int order)
+{
+    uint32_t count = 1U << order;
+    page_table_entry_t **entries;
+    uint32_t *addrs;
+    page_t *page, *copy;
+    list_head aside;
+    int ret = 0;
+    // Prepare the reverse mapping of the block.
+    entries = kmalloc(count * sizeof(page_table_entry_t *));
+    addrs   = kmalloc(count * sizeof(uint32_t));
+    if (!entries || !addrs) {
+        ret = -1;
+        goto free_maps;
+    }
+    memset(entries, 0, count * sizeof(page_table_entry_t *));
+    list_for_each_decl(it, scheduler_get_runqueue())
+    {
+        task_struct *task = list_entry(it, task_struct, run_list);
+        if (task->mm) {
+            __mem_find_movable_entries(task->mm, first, count, entries, addrs);
+        }
+    }
+    // Every used page must be movable.
+    for (uint32_t i = 0; i < count; ++i) {
+        if (page_count(first + i) && !entries[i]) {
+            ret = -1;
+            goto free_maps;
+        }
+    }
+    // The pages we get inside the block are kept aside until the end.
+    list_head_init(&aside);
+    for (uint32_t i = 0; (i < count) && (ret == 0); ++i) {
+        if (!entries[i]) {
+            continue;
+        }
+        page = first + i;
+        while (1) {
+            copy = _alloc_pages(GFP_HIGHUSER, 0);
+            if (!copy) {
+                ret = -1;
+                break;
+            }
+            if ((copy < first) || (copy >= first + count)) {
+                break;
+            }
+            list_head_insert_before(&copy->bbpage.location.cache, &aside);
+        }
+        if (ret == 0) {
+            // Move the content and update the mapping.
+            __mem_copy_page(copy, page);
+            entries[i]->frame = get_physical_address_from_page(copy) >> 12U;
+            paging_flush_tlb_single(addrs[i]);
+            __free_pages(page);
+        }
+    }
+    // Give back the pages we kept aside.
+    list_for_each_safe_decl(it, store, &aside)
+    {
+        page = list_entry(it, page_t, bbpage.location.cache);
+        list_head_remove(it);
+        __free_pages(page);
+    }
+free_maps:
+    if (entries) {
+        kfree(entries);
+    }
+    if (addrs) {
+        kfree(addrs);
+    }
+    return ret;
+}
+
+/// @brief Checks if the page of an entry can be sent to the swap.
+/// @param zone the zone which needs memory.
+/// @param entry the entry.
+/// @return 1 if the page can go, 0 otherwise.
+static inline int __mem_can_swap_out(zone_t *zone, page_table_entry_t *entry)
+{
+    if (!entry->present || !entry->user || entry->global) {
+        return 0;
+    }
+    page_t *page = get_page_from_physical_address(((uint32_t)entry->frame) << 12U);
+    // Shared pages would come back as one copy for each process. The pages
+    // with futex waiters must not move, the futexes are physical addresses.
+    return (page >= zone->zone_mem_map) && (page < zone->zone_mem_map + zone->size) &&
+           (page->bbpage.order == 0) && (page_count(page) == 1) &&
+           !futex_page_has_waiters(((uint32_t)entry->frame) << 12U);
+}
+
+/// @brief Sends a page of a process to the swap.
+/// @param mm the memory descriptor.
+/// @param entry the entry of the page.
+/// @param addr the virtual address of the page.
+/// @return 0 on success, -errno if the page stays in memory.
+static int __mem_swap_out_page(mm_struct_t *mm, page_table_entry_t *entry, uint32_t addr)
+{
+    uint32_t frame = entry->frame;
+    page_t *page   = get_page_from_physical_address(frame << 12U);
+    // A write hitting the page while it is being written out sets the bit.
+    entry->dirty = 0;
+    paging_flush_tlb_range(mm->pgd, addr, addr + PAGE_SIZE);
+    int slot = swap_store(page);
+    if (slot < 0) {
+        return slot;
+    }
+    if (!entry->present || entry->dirty || (entry->frame != frame)) {
+        swap_put(slot);
+        return -EAGAIN;
+    }
+    // Nobody else uses the page, it comes back writable.
+    if (entry->kernel_cow) {
+        entry->kernel_cow = 0;
+        entry->rw         = 1;
+    }
+    entry->present   = 0;
+    entry->available = PTE_SWAPPED;
+    entry->frame     = slot;
+    paging_flush_tlb_range(mm->pgd, addr, addr + PAGE_SIZE);
+    __free_pages(page);
+    return 0;
+}
+
+/// @brief Moves the hand of the clock through the anonymous areas of a process.
+/// @param mm the memory descriptor.
+/// @param zone the zone which needs memory.
+/// @param addr where the hand starts, updated with where it stopped.
+/// @param nr_pages the number of pages to free.
+/// @param freed the number of pages freed so far, updated.
+/// @return 1 if the hand must stop, 0 if it went through the whole process.
+static int __mem_swap_out_mm(mm_struct_t *mm, zone_t *zone, uint32_t *addr, unsigned long nr_pages, unsigned long *freed)
+{
+    page_table_entry_t *entry;
+    vm_area_struct_t *area;
+    int ret;
+    list_for_each_decl(it, &mm->mmap_list)
+    {
+        area = list_entry(it, vm_area_struct_t, vm_list);
+        // Pages of file mappings and of objects are owned by someone else,
+        // locked ones stay.
+        if (area->vm_file || area->vm_ops || (area->vm_hints & VM_LOCKED) || (area->vm_end <= *addr)) {
+            continue;
+        }
+        for (uint32_t page_addr = max(*addr, area->vm_start & ~(PAGE_SIZE - 1)); page_addr < area->vm_end; page_addr += PAGE_SIZE) {
+            entry = __mem_get_pg_entry(mm->pgd, page_addr);
+            if (entry == NULL) {
+                // Skip the rest of the missing page table.
+                page_addr = (page_addr & ~(LARGE_PAGE_SIZE - 1)) + LARGE_PAGE_SIZE - PAGE_SIZE;
+                continue;
+            }
+            if (!__mem_can_swap_out(zone, entry)) {
+                continue;
+            }
+            // The page was used since the hand went by, give it another chance.
+            if (entry->accessed) {
+                entry->accessed = 0;
+                paging_flush_tlb_range(mm->pgd, page_addr, page_addr + PAGE_SIZE);
+                continue;
+            }
+            ret = __mem_swap_out_page(mm, entry, page_addr);
+            if ((ret == 0) && (++(*freed) < nr_pages)) {
+                continue;
+            }
+            if ((ret == 0) || (ret != -EAGAIN)) {
+                *addr = page_addr + PAGE_SIZE;
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/// The process where the hand of the clock stopped, 0 to start from the first.
+static pid_t swap_hand_pid = 0;
+/// The address, inside the process, where the hand of the clock stopped.
+static uint32_t swap_hand_addr = 0;
+/// Set while pages are being sent to the swap.
+static bool_t swapping = false;
+
+unsigned long mem_swap_out(zone_t *zone, unsigned long nr_pages)
+{
+    unsigned long freed = 0;
+    uint32_t addr;
+    if (swapping || !swap_available()) {
+        return 0;
+    }
+    swapping   = true;
+    bool_t found = (swap_hand_pid == 0);
+    // The hand goes round at most three times: the second time it clears the
+    // accessed bits, which are still clear the third time for the idle pages.
+    for (int pass = 0; pass < 3; ++pass) {
+        list_for_each_decl(it, scheduler_get_runqueue())
+        {
+            task_struct *task = list_entry(it, task_struct, run_list);
+            if (task->mm == NULL) {
+                continue;
+            }
+            addr = 0;
+            if (!found) {
+                if (task->pid != swap_hand_pid) {
+                    continue;
+                }
+                found = true;
+                addr  = swap_hand_addr;
+            }
+            if (__mem_swap_out_mm(task->mm, zone, &addr, nr_pages, &freed)) {
+                swap_hand_pid  = task->pid;
+                swap_hand_addr = addr;
+                goto done;
+            }
+        }
+        // The process where the hand stopped is gone.
+        found = true;
+    }
+    swap_hand_pid = 0;
+done:
+    swapping = false;
+    pr_debug("Sent %lu pages to the swap.\n", freed);
+    return freed;
+}
+
+int mem_swap_in_all(void)
+{
+    page_table_entry_t *entry;
+    vm_area_struct_t *area;
+    list_for_each_decl(it, scheduler_get_runqueue())
+    {
+        task_struct *task = list_entry(it, task_struct, run_list);
+        if (task->mm == NULL) {
+            continue;
+        }
+        list_for_each_decl(area_it, &task->mm->mmap_list)
+        {
+            area = list_entry(area_it, vm_area_struct_t, vm_list);
+            if (area->vm_file) {
+                continue;
+            }
+            for (uint32_t addr = area->vm_start & ~(PAGE_SIZE - 1); addr < area->vm_end; addr += PAGE_SIZE) {
+                entry = __mem_get_pg_entry(task->mm->pgd, addr);
+                if (entry && pte_is_swapped(entry) && __page_handle_swap(entry)) {
+                    return -ENOMEM;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+/// @brief Compares two memory areas by start address.
+/// @param tree the tree.
+/// @param a the node of the first area.
+/// @param b the node of the second area.
+/// @return the sign of the difference between the start addresses.
+static int __vm_area_node_compare(rbtree_t *tree, rbtree_node_t *a, rbtree_node_t *b)
+{
+    (void)tree;
+    vm_area_struct_t *area0 = rbtree_node_get_value(a);
+    vm_area_struct_t *area1 = rbtree_node_get_value(b);
+    return (area0->vm_start > area1->vm_start) - (area0->vm_start < area1->vm_start);
+}
+
+/// @brief Compares a memory area with a range, an area overlapping the range
+/// compares equal.
+/// @param tree the tree.
+/// @param node the node of the area.
+/// @param arg the range, an array with the start and the end.
+/// @return negative if the area is below the range, positive if above, 0 otherwise.
+static int __vm_area_range_compare(rbtree_t *tree, rbtree_node_t *node, void *arg)
+{
+    (void)tree;
+    vm_area_struct_t *area = rbtree_node_get_value(node);
+    uint32_t *range        = (uint32_t *)arg;
+    if (area->vm_end <= range[0]) {
+        return -1;
+    }
+    if (area->vm_start >= range[1]) {
+        return 1;
+    }
+    return 0;
+}
+
+/// @brief Updates the largest gap of the subtree rooted at the node.
+/// @param tree the tree.
+/// @param node the node of the area.
+static void __vm_area_augment(rbtree_t *tree, rbtree_node_t *node)
+{
+    (void)tree;
+    vm_area_struct_t *area = rbtree_node_get_value(node), *child;
+    area->vm_gap_max       = area->vm_gap;
+    for (int dir = 0; dir < 2; ++dir) {
+        child = rbtree_node_get_value(rbtree_node_get_link(node, dir));
+        if (child && (child->vm_gap_max > area->vm_gap_max)) {
+            area->vm_gap_max = child->vm_gap_max;
+        }
+    }
+}
+
+/// @brief Creates the tree used to index the memory areas of a process.
+/// @return the tree.
+static rbtree_t *__vm_area_tree_create(void)
+{
+    rbtree_t *tree = rbtree_tree_create(__vm_area_node_compare);
+    rbtree_tree_set_augment(tree, __vm_area_augment);
+    return tree;
+}
+
+/// @brief Searches the memory area overlapping the given range.
+/// @param mm the memory descriptor.
+/// @param vm_start the start of the range, inclusive.
+/// @param vm_end the end of the range, exclusive.
+/// @return the area, NULL if the range is free.
+static inline vm_area_struct_t *__vm_area_lookup(mm_struct_t *mm, uint32_t vm_start, uint32_t vm_end)
+{
+    uint32_t range[2] = { vm_start, vm_end };
+    return rbtree_tree_find_by_value(mm->mm_rb, __vm_area_range_compare, range);
+}
+
+/// @brief Adds the area to the list and to the tree of the memory descriptor.
+/// @param mm the memory descriptor.
+/// @param area the area.
+static void __vm_area_link(mm_struct_t *mm, vm_area_struct_t *area)
+{
+    vm_area_struct_t *prev = NULL, *next;
+    list_head *it;
+    // Find the last area starting before this one, the list is sorted.
+    for (it = mm->mmap_list.prev; it != &mm->mmap_list; it = it->prev) {
+        prev = list_entry(it, vm_area_struct_t, vm_list);
+        if (prev->vm_start < area->vm_start) {
+            break;
+        }
+        prev = NULL;
+    }
+    list_head_insert_after(&area->vm_list, it);
+    // Remember which page tables the area might get.
+    for (uint32_t index = area->vm_start / LARGE_PAGE_SIZE; index <= (area->vm_end - 1) / LARGE_PAGE_SIZE; ++index) {
+        if (index < PROCAREA_END_ADDR / LARGE_PAGE_SIZE) {
+            mm->pgt_map[index / 32] |= 1U << (index % 32);
+        }
+    }
+    // There is no gap below the lowest area.
+    area->vm_gap     = prev ? (area->vm_start - prev->vm_end) : 0;
+    area->vm_gap_max = area->vm_gap;
+    rbtree_tree_insert(mm->mm_rb, area);
+    // The gap below the next area shrinks.
+    if (area->vm_list.next != &mm->mmap_list) {
+        next         = list_entry(area->vm_list.next, vm_area_struct_t, vm_list);
+        next->vm_gap = next->vm_start - area->vm_end;
+        rbtree_tree_update(mm->mm_rb, next);
+    }
+    mm->mmap_cache = area;
+    mm->map_count++;
+}
+
+/// @brief Removes the area from the list and from the tree of the memory descriptor.
+/// @param mm the memory descriptor.
+/// @param area the area.
+static void __vm_area_unlink(mm_struct_t *mm, vm_area_struct_t *area)
+{
+    vm_area_struct_t *prev = NULL, *next = NULL;
+    if (area->vm_list.prev != &mm->mmap_list) {
+        prev = list_entry(area->vm_list.prev, vm_area_struct_t, vm_list);
+    }
+    if (area->vm_list.next != &mm->mmap_list) {
+        next = list_entry(area->vm_list.next, vm_area_struct_t, vm_list);
+    }
+    rbtree_tree_remove(mm->mm_rb, area);
+    list_head_remove(&area->vm_list);
+    // The gap below the next area grows.
+    if (next) {
+        next->vm_gap = prev ? (next->vm_start - prev->vm_end) : 0;
+        rbtree_tree_update(mm->mm_rb, next);
+    }
+    if (mm->mmap_cache == area) {
+        mm->mmap_cache = NULL;
+    }
+    --mm->map_count;
+}
+
 vm_area_struct_t *create_vm_area(mm_struct_t *mm,
                                  uint32_t vm_start,
                                  size_t size,
                                  uint32_t pgflags,
                                  uint32_t gfpflags)
 {
-    uint32_t vm_end, phy_start, order;
+    uint32_t vm_end, order;
     vm_area_struct_t *segment;
 
     // Compute the end of the virtual memory area.
@@ -97,130 +1102,217 @@ vm_area_struct_t *create_vm_area(mm_struct_t *mm,
     order = find_nearest_order_greater(vm_start, size);
 
     if (pgflags & MM_COW) {
-        pgflags   = pgflags & ~(MM_PRESENT | MM_UPDADDR);
-        phy_start = 0;
+        // The pages are allocated on demand.
+        mem_upd_vm_area(mm->pgd, vm_start, 0, size, pgflags & ~(MM_PRESENT | MM_UPDADDR));
     } else {
-        pgflags      = pgflags | MM_UPDADDR;
-        page_t *page = _alloc_pages(gfpflags, order);
-        phy_start    = get_physical_address_from_page(page);
+        // Map one page at a time, so that each page can be shared and freed
+        // on its own.
+        for (uint32_t addr = vm_start & ~(PAGE_SIZE - 1); addr < vm_end; addr += PAGE_SIZE) {
+            page_t *page = _alloc_pages(gfpflags, 0);
+            mem_upd_vm_area(mm->pgd, addr, get_physical_address_from_page(page), PAGE_SIZE, pgflags | MM_UPDADDR);
+        }
     }
 
-    mem_upd_vm_area(mm->pgd, vm_start, phy_start, size, pgflags);
-
     // Update vm_area_struct info.
     segment->vm_start = vm_start;
     segment->vm_end   = vm_end;
     segment->vm_mm    = mm;
-
-    // Update memory descriptor list of vm_area_struct.
-    list_head_insert_after(&segment->vm_list, &mm->mmap_list);
-    mm->mmap_cache = segment;
-
-    // Sort the mmap_list.
-    list_head_sort(&mm->mmap_list, vm_area_compare);
-
-    // Update memory descriptor info.
-    mm->map_count++;
+    segment->vm_file     = NULL;
+    segment->vm_pgoff    = 0;
+    segment->vm_file_end = 0;
+    // Neither shared nor private, until mmap tells.
+    segment->vm_flags     = 0;
+    segment->vm_page_prot = 0;
+    segment->vm_hints    = mm->def_hints;
+    segment->vm_ops      = NULL;
+    segment->vm_private_data = NULL;
+
+    // Update memory descriptor list and tree of vm_area_struct.
+    __vm_area_link(mm, segment);
 
     mm->total_vm += (1U << order);
 
     return segment;
 }
 
+vm_area_struct_t *create_file_vm_area(mm_struct_t *mm,
+                                      uint32_t vm_start,
+                                      size_t size,
+                                      vfs_file_t *file,
+                                      uint32_t pgoff,
+                                      uint32_t file_size,
+                                      int prot,
+                                      int flags)
+{
+    // Pages are allocated on demand.
+    vm_area_struct_t *segment = create_vm_area(mm, vm_start, size, MM_PRESENT | MM_RW | MM_COW | MM_USER, GFP_HIGHUSER);
+    // The area keeps the file open, even after the file is closed.
+    ++file->count;
+    segment->vm_file      = file;
+    segment->vm_pgoff     = pgoff;
+    segment->vm_file_end  = vm_start + min(file_size, size);
+    segment->vm_page_prot = prot;
+    segment->vm_flags     = flags;
+    return segment;
+}
+
 uint32_t clone_vm_area(mm_struct_t *mm, vm_area_struct_t *area, int cow, uint32_t gfpflags)
 {
     vm_area_struct_t *new_segment = kmem_cache_alloc(vm_area_cache, GFP_KERNEL);
     memcpy(new_segment, area, sizeof(vm_area_struct_t));
 
     new_segment->vm_mm = mm;
+    // Locks are not inherited by the child.
+    new_segment->vm_hints &= ~VM_LOCKED;
 
     uint32_t size  = new_segment->vm_end - new_segment->vm_start;
     uint32_t order = find_nearest_order_greater(area->vm_start, size);
 
-    if (!cow) {
-        // If not copy-on-write, allocate directly the physical pages
-        page_t *dst_page      = _alloc_pages(gfpflags, order);
-        uint32_t phy_vm_start = get_physical_address_from_page(dst_page);
-
-        // Then update the virtual memory map
-        mem_upd_vm_area(mm->pgd, new_segment->vm_start, phy_vm_start, size,
-                        MM_RW | MM_PRESENT | MM_UPDADDR | MM_USER);
-
-        // Copy virtual memory of source area into dest area by using a virtual mapping
-        virt_memcpy(mm, area->vm_start, area->vm_mm, area->vm_start, size);
+    if (area->vm_file) {
+        __clone_file_vm_area(mm, area, new_segment);
+    } else if (area->vm_ops) {
+        __clone_ops_vm_area(mm, area, new_segment);
     } else {
-        // If copy-on-write, set the original pages as read-only
-        mem_upd_vm_area(area->vm_mm->pgd, area->vm_start, 0, size,
-                        MM_COW | MM_PRESENT | MM_USER);
-
-        // Do a cow of the whole virtual memory area, handling fragmented physical memory
-        // and set it as read-only
-        mem_clone_vm_area(area->vm_mm->pgd,
-                          mm->pgd,
-                          area->vm_start,
-                          new_segment->vm_start,
-                          size,
-                          MM_COW | MM_PRESENT | MM_UPDADDR | MM_USER);
+        __clone_anon_vm_area(mm, area, new_segment, cow, gfpflags);
     }
 
-    // Update memory descriptor list of vm_area_struct.
-    list_head_insert_after(&new_segment->vm_list, &mm->mmap_list);
-    mm->mmap_cache = new_segment;
-
-    // Update memory descriptor info.
-    mm->map_count++;
+    // Update memory descriptor list and tree of vm_area_struct.
+    __vm_area_link(mm, new_segment);
 
     mm->total_vm += (1U << order);
 
     return 0;
 }
 
-int destroy_vm_area(mm_struct_t *mm, vm_area_struct_t *area)
+/// @brief Unmaps an area, without flushing the TLB.
+/// @param mm the memory descriptor.
+/// @param area the area.
+/// @param freed the list collecting the pages to free.
+static inline void __unmap_vm_area(mm_struct_t *mm, vm_area_struct_t *area, list_head *freed)
 {
-    size_t area_total_size, area_size, area_start;
-    uint32_t order, block_size;
-    page_t *phy_page;
-    // Get the total area size.
-    area_total_size = area->vm_end - area->vm_start;
-    // Get the starting location.
-    area_start = area->vm_start;
-    // Free all the memory.
-    while (area_total_size > 0) {
-        area_size = area_total_size;
-        phy_page  = mem_virtual_to_page(mm->pgd, area_start, &area_size);
-        // If the pages are marked as copy-on-write, do not deallocate them!
-        if (page_count(phy_page) > 1) {
-            order      = phy_page->bbpage.order;
-            block_size = 1UL << order;
-            for (int i = 0; i < block_size; i++) {
-                page_dec(phy_page + i);
-            }
-        } else {
-            __free_pages(phy_page);
+    // File mappings are made of single pages, coming from the page cache,
+    // anonymous ones of single pages, which might be shared after a fork.
+    if (area->vm_file) {
+        __destroy_file_vm_area(mm, area);
+    } else if (area->vm_ops) {
+        __unmap_ops_range(mm, area->vm_start, area->vm_end, freed);
+        if (area->vm_ops->close) {
+            area->vm_ops->close(area);
         }
-        area_total_size -= area_size;
-        area_start += area_size;
+    } else {
+        __destroy_anon_vm_area(mm, area, freed);
     }
+}
+
+int destroy_vm_area(mm_struct_t *mm, vm_area_struct_t *area)
+{
+    list_head freed;
+    list_head_init(&freed);
+    // The other processes keep their pages.
+    __pgt_unshare_range(mm->pgd, area->vm_start, area->vm_end);
+    __unmap_vm_area(mm, area, &freed);
+    // Flush the unmapped pages, at once, before their frames are reused.
+    paging_flush_tlb_range(mm->pgd, area->vm_start, area->vm_end);
+    free_page_list(&freed);
     // Delete segment from the mmap.
-    list_head_remove(&area->vm_list);
+    __vm_area_unlink(mm, area);
     // Free the memory.
     kmem_cache_free(area);
-    // Reduce the counter for memory mapped areas.
-    --mm->map_count;
     return 0;
 }
 
-inline vm_area_struct_t *find_vm_area(mm_struct_t *mm, uint32_t vm_start)
+int expand_vm_area(mm_struct_t *mm, vm_area_struct_t *area, uint32_t vm_end)
 {
-    vm_area_struct_t *segment;
-    // Find the area.
-    list_for_each_prev_decl(it, &mm->mmap_list)
-    {
-        segment = list_entry(it, vm_area_struct_t, vm_list);
-        assert(segment && "There is a NULL area in the list.");
-        if (segment->vm_start == vm_start) {
-            return segment;
+    if (area->vm_file || (vm_end < area->vm_end)) {
+        return -EINVAL;
+    }
+    if (vm_end == area->vm_end) {
+        return 0;
+    }
+    if ((vm_end > PROCAREA_END_ADDR) || (is_valid_vm_area(mm, area->vm_end, vm_end) <= 0)) {
+        return -ENOMEM;
+    }
+    // The page holding the old end is already part of the area.
+    uint32_t start     = (area->vm_end + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    uint32_t old_order = find_nearest_order_greater(area->vm_start, area->vm_end - area->vm_start);
+    if (start < vm_end) {
+        mem_upd_vm_area(mm->pgd, start, 0, vm_end - start, MM_RW | MM_COW | MM_USER);
+    }
+    // Remember which page tables the area might get.
+    for (uint32_t index = area->vm_end / LARGE_PAGE_SIZE; index <= (vm_end - 1) / LARGE_PAGE_SIZE; ++index) {
+        mm->pgt_map[index / 32] |= 1U << (index % 32);
+    }
+    area->vm_end = vm_end;
+    // The areas are sorted by start, only the gap below the next one shrinks.
+    if (area->vm_list.next != &mm->mmap_list) {
+        vm_area_struct_t *next = list_entry(area->vm_list.next, vm_area_struct_t, vm_list);
+        next->vm_gap           = next->vm_start - area->vm_end;
+        rbtree_tree_update(mm->mm_rb, next);
+    }
+    mm->total_vm += (1U << find_nearest_order_greater(area->vm_start, vm_end - area->vm_start)) - (1U << old_order);
+    // The pages of a locked area are always there.
+    if ((area->vm_hints & VM_LOCKED) && (start < vm_end)) {
+        mem_populate_range(mm, area, start, (vm_end + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1), 1);
+    }
+    return 0;
+}
+
+int mem_discard_range(mm_struct_t *mm, vm_area_struct_t *area, uint32_t start, uint32_t end)
+{
+    if (!__vm_area_contains(area, start, end)) {
+        return -EINVAL;
+    }
+    list_head freed;
+    list_head_init(&freed);
+    int discarded = 0;
+    // The other processes keep their pages.
+    __pgt_unshare_range(mm->pgd, start, end);
+    // The pages of a file are read again from the cache, those of an object
+    // are mapped again on the next fault.
+    if (area->vm_file || area->vm_ops) {
+        if (area->vm_file) {
+            discarded = __unmap_file_range(mm, area, start, end);
+        } else {
+            discarded = __unmap_ops_range(mm, start, end, &freed);
+        }
+        paging_flush_tlb_range(mm->pgd, start, end);
+        free_page_list(&freed);
+        return discarded;
+    }
+    for (uint32_t addr = start; addr < end; addr += PAGE_SIZE) {
+        page_table_entry_t *entry = __mem_get_pg_entry(mm->pgd, addr);
+        if (!entry) {
+            continue;
+        }
+        if (pte_is_swapped(entry)) {
+            swap_put(entry->frame);
+        } else if (entry->present) {
+            __mem_put_page(get_page_from_physical_address(((uint32_t)entry->frame) << 12U), &freed);
+            ++discarded;
+        } else {
+            continue;
         }
+        // Back to a demand-zero page.
+        entry->present    = 0;
+        entry->rw         = 1;
+        entry->kernel_cow = 1;
+        entry->available  = 1;
+        entry->frame      = 0;
+    }
+    paging_flush_tlb_range(mm->pgd, start, end);
+    free_page_list(&freed);
+    return discarded;
+}
+
+inline vm_area_struct_t *find_vm_area(mm_struct_t *mm, uint32_t vm_start)
+{
+    vm_area_struct_t *segment = mm->mmap_cache;
+    // Check the last area used, first.
+    if (!segment || (segment->vm_start != vm_start)) {
+        segment = __vm_area_lookup(mm, vm_start, vm_start + 1);
+    }
+    if (segment && (segment->vm_start == vm_start)) {
+        return segment;
     }
     return NULL;
 }
@@ -230,47 +1322,33 @@ inline int is_valid_vm_area(mm_struct_t *mm, uintptr_t vm_start, uintptr_t vm_en
     if (vm_end <= vm_start) {
         return -1;
     }
-    // Get the stack.
-    vm_area_struct_t *area;
-    list_for_each_prev_decl(it, &mm->mmap_list)
-    {
-        area = list_entry(it, vm_area_struct_t, vm_list);
-        assert(area && "There is a NULL area in the list.");
-        if ((vm_start > area->vm_start) && (vm_start < area->vm_end)) {
-            pr_crit("INSIDE(START): %p <= %p <= %p", area->vm_start, vm_start, area->vm_end);
-            return 0;
-        }
-        if ((vm_end > area->vm_start) && (vm_end < area->vm_end)) {
-            pr_crit("INSIDE(END): %p <= %p <= %p", area->vm_start, vm_end, area->vm_end);
-            return 0;
-        }
-        if ((vm_start < area->vm_start) && (vm_end > area->vm_end)) {
-            pr_crit("WRAPS: %p <= (%p, %p) <= %p", vm_start, area->vm_start, area->vm_end, vm_end);
-            return 0;
-        }
+    vm_area_struct_t *area = __vm_area_lookup(mm, vm_start, vm_end);
+    if (area) {
+        pr_crit("OVERLAPS: (%p, %p) and (%p, %p)", vm_start, vm_end, area->vm_start, area->vm_end);
+        return 0;
     }
     return 1;
 }
 
 inline int find_free_vm_area(mm_struct_t *mm, size_t length, uintptr_t *vm_start)
 {
-    // Get the stack.
-    vm_area_struct_t *area, *prev_area;
-    list_for_each_prev_decl(it, &mm->mmap_list)
-    {
-        area = list_entry(it, vm_area_struct_t, vm_list);
-        assert(area && "There is a NULL area in the list.");
-        // Check the previous segment.
-        if (area->vm_list.prev != &mm->mmap_list) {
-            prev_area = list_entry(area->vm_list.prev, vm_area_struct_t, vm_list);
-            assert(prev_area && "There is a NULL area in the list.");
-            // Compute the available space.
-            unsigned available_space = area->vm_start - prev_area->vm_end;
-            // If the space is enough, return the address.
-            if (available_space >= length) {
-                *vm_start = area->vm_start - length;
-                return 0;
-            }
+    rbtree_node_t *node = rbtree_tree_get_root(mm->mm_rb);
+    vm_area_struct_t *area, *right;
+    // Look for the highest gap which is large enough, following the subtrees
+    // whose largest gap can hold the area.
+    while (node) {
+        area = rbtree_node_get_value(node);
+        if (area->vm_gap_max < length) {
+            break;
+        }
+        right = rbtree_node_get_value(rbtree_node_get_link(node, 1));
+        if (right && (right->vm_gap_max >= length)) {
+            node = rbtree_node_get_link(node, 1);
+        } else if (area->vm_gap >= length) {
+            *vm_start = area->vm_start - length;
+            return 0;
+        } else {
+            node = rbtree_node_get_link(node, 0);
         }
     }
     return 1;
@@ -293,6 +1371,8 @@ void paging_init(boot_info_t *info)
 
     pgdir_cache = KMEM_CREATE_CTOR(page_directory_t, __init_pagedir);
     pgtbl_cache = KMEM_CREATE_CTOR(page_table_t, __init_pagetable);
+    // The quicklist of the page tables gives them back under pressure.
+    register_shrinker(&pgt_quicklist_shrinker);
 
     main_mm = kmem_cache_alloc(mm_cache, GFP_KERNEL);
 
@@ -303,8 +1383,10 @@ void paging_init(boot_info_t *info)
     // Map the first 1MB of memory with physical mapping to access video memory and other bios stuff
     mem_upd_vm_area(main_mm->pgd, 0, 0, 1024 * 1024, MM_RW | MM_PRESENT | MM_GLOBAL | MM_UPDADDR);
 
+    // Map the kernel and the lowmem, using large pages to avoid hundreds of
+    // page tables and to reduce the misses in the TLB.
     mem_upd_vm_area(main_mm->pgd, info->kernel_start, info->kernel_phy_start, lowkmem_size,
-                    MM_RW | MM_PRESENT | MM_GLOBAL | MM_UPDADDR);
+                    MM_RW | MM_PRESENT | MM_GLOBAL | MM_UPDADDR | MM_LARGE);
 
     isr_install_handler(PAGE_FAULT, page_fault_handler, "page_fault_handler");
 
@@ -371,34 +1453,283 @@ static void __page_fault_panic(pt_regs *f, uint32_t addr)
     __asm__ __volatile__("cli");
 }
 
+/// @brief Allocates a zeroed page for a process.
+/// @return the page, NULL if there is no free memory.
+/// @details The page usually comes from the pool of pages zeroed in background,
+/// so that the fault does not pay for the zeroing.
+static inline page_t *__alloc_zeroed_user_page(void)
+{
+    return _alloc_pages(GFP_HIGHUSER | __GFP_ZERO, 0);
+}
+
 static int __page_handle_cow(page_table_entry_t *entry)
 {
     // Check if the page is Copy On Write (COW).
     if (entry->kernel_cow) {
         // Set the entry is no longer COW.
         entry->kernel_cow = 0;
-        // Check if the entry is not present (allocated).
-        if (!entry->present) {
-            // Allocate a new page.
-            page_t *page = _alloc_pages(GFP_HIGHUSER, 0);
-            // Clear the new page.
-            uint32_t vaddr = virt_map_physical_pages(page, 1);
-            memset((void *)vaddr, 0, PAGE_SIZE);
-            // Unmap the virtual address.
-            virt_unmap(vaddr);
-            // Set it as current table entry frame.
-            entry->frame = get_physical_address_from_page(page) >> 12U;
-            // Set it as allocated.
-            entry->present = 1;
+        // The page is shared with another process, and it is being written.
+        if (entry->present) {
+            page_t *page = get_page_from_physical_address(((uint32_t)entry->frame) << 12U);
+            // Copy it, unless the other processes have already dropped it.
+            if (page_count(page) > 1) {
+                page_t *copy = _alloc_pages(GFP_HIGHUSER, 0);
+                if (copy == NULL) {
+                    entry->kernel_cow = 1;
+                    return 1;
+                }
+                __mem_copy_page(copy, page);
+                page_dec(page);
+                entry->frame = get_physical_address_from_page(copy) >> 12U;
+            }
+            entry->rw = 1;
             return 0;
         }
+        // Otherwise, the entry is not present (allocated) yet.
+        // Allocate a new, cleared, page.
+        page_t *page = __alloc_zeroed_user_page();
+        if (page == NULL) {
+            entry->kernel_cow = 1;
+            return 1;
+        }
+        // Set it as current table entry frame.
+        entry->frame = get_physical_address_from_page(page) >> 12U;
+        // Set it as allocated.
+        entry->present = 1;
+        return 0;
     }
     pr_err("Page not cow!\n");
     return 1;
 }
 
+/// @brief Handles a fault on a file mapping, mapping the page from the page cache.
+/// @param area the file mapping.
+/// @param entry the page table entry of the faulting address.
+/// @param addr the faulting address.
+/// @param err_rw if the fault was caused by a write.
+/// @return 0 if the fault was handled, 1 if the access is not allowed.
+/// @details Shared mappings, and read-only private ones, map the cached page
+/// itself. Writable private mappings get their own copy right away, so that
+/// writes done by the kernel on behalf of the process do not reach the cache.
+/// Pages past the part backed by the file (e.g., the bss of an executable)
+/// are zero-filled.
+/// @param major set when the page had to be read from the file.
+static int __page_handle_file(vm_area_struct_t *area, page_table_entry_t *entry, uint32_t addr, bool_t err_rw, bool_t *major)
+{
+    bool_t writable     = (area->vm_page_prot & PROT_WRITE) != 0;
+    uint32_t page_start = addr & ~(PAGE_SIZE - 1);
+    page_t *page;
+    // The page is already there, so it is a forbidden write, unless it is a
+    // private page shared with another process.
+    if (entry->present) {
+        if (err_rw && writable && entry->kernel_cow) {
+            return __page_handle_cow(entry);
+        }
+        return 1;
+    }
+    if (err_rw && !writable) {
+        return 1;
+    }
+    if (page_start >= area->vm_file_end) {
+        // Nothing comes from the file.
+        if ((page = __alloc_zeroed_user_page()) == NULL) {
+            return 1;
+        }
+    } else {
+        // Get the page from the page cache.
+        *major = !page_cache_contains(area->vm_file, __file_area_page_index(area, addr));
+        page = page_cache_get(area->vm_file, __file_area_page_index(area, addr));
+        if (page == NULL) {
+            return 1;
+        }
+        // The page is only partially backed by the file, or it is private.
+        if ((page_start + PAGE_SIZE > area->vm_file_end) || (!(area->vm_flags & MAP_SHARED) && writable)) {
+            page_t *copy = _alloc_pages(GFP_HIGHUSER, 0);
+            __mem_copy_page(copy, page);
+            page_cache_put(page);
+            page = copy;
+            if (page_start + PAGE_SIZE > area->vm_file_end) {
+                __mem_clear_page(page, area->vm_file_end - page_start);
+            }
+        }
+    }
+    entry->frame = get_physical_address_from_page(page) >> 12U;
+    entry->dirty = 0;
+    __set_pg_table_flags(entry, MM_PRESENT | MM_USER | (writable ? MM_RW : 0));
+    return 0;
+}
+
+/// @brief Handles the fault of an area whose pages belong to a kernel object.
+/// @param area the area.
+/// @param entry the page table entry of the faulting address.
+/// @param addr the faulting address.
+/// @param err_rw if the fault was caused by a write.
+/// @return 0 if the fault was handled, 1 if the access is not allowed.
+/// @details The pages are shared by everyone mapping the object, so they are
+/// never copied, the object provides them already referenced for the mapping.
+static int __page_handle_ops(vm_area_struct_t *area, page_table_entry_t *entry, uint32_t addr, bool_t err_rw)
+{
+    bool_t writable = (area->vm_page_prot & PROT_WRITE) != 0;
+    if (entry->present || (err_rw && !writable)) {
+        return 1;
+    }
+    page_t *page = area->vm_ops->fault(area, __file_area_page_index(area, addr));
+    if (page == NULL) {
+        return 1;
+    }
+    entry->frame = get_physical_address_from_page(page) >> 12U;
+    entry->dirty = 0;
+    __set_pg_table_flags(entry, MM_PRESENT | MM_USER | (writable ? MM_RW : 0));
+    return 0;
+}
+
+/// @brief Handles the fault of a mapping, either of a file or of an object.
+/// @param area the mapping.
+/// @param entry the page table entry of the faulting address.
+/// @param addr the faulting address.
+/// @param err_rw if the fault was caused by a write.
+/// @param major set when the page had to be read from the file.
+/// @return 0 if the fault was handled, 1 if the access is not allowed.
+static inline int __page_handle_mapping(vm_area_struct_t *area, page_table_entry_t *entry, uint32_t addr, bool_t err_rw, bool_t *major)
+{
+    if (area->vm_ops) {
+        return __page_handle_ops(area, entry, addr, err_rw);
+    }
+    return __page_handle_file(area, entry, addr, err_rw, major);
+}
+
+/// @brief Maps the pages around a faulting address, which the process is likely
+/// to touch soon, so that a sequential first touch takes a fraction of the faults.
+/// @param area the area containing the faulting address.
+/// @param table the page table containing the faulting address.
+/// @param addr the faulting address, whose page is already mapped.
+/// @details Only the entries which would be populated by a read fault are
+/// touched: demand-zero pages of anonymous areas, and non-present pages of
+/// file and object mappings. The entries were not present, so no TLB flush is
+/// needed.
+static void __page_fault_around(vm_area_struct_t *area, page_table_t *table, uint32_t addr)
+{
+    // The pages of an area read in random order would be mapped for nothing.
+    if (area->vm_hints & VM_RAND_READ) {
+        return;
+    }
+    uint32_t pages = (area->vm_hints & VM_SEQ_READ) ? FAULT_AROUND_SEQ_PAGES : FAULT_AROUND_PAGES;
+    uint32_t start = addr & ~(pages * PAGE_SIZE - 1);
+    uint32_t end   = start + pages * PAGE_SIZE;
+    // Stay inside the area, the block never crosses a page table.
+    start = max(start, area->vm_start);
+    end   = min(end, area->vm_end);
+    // The pages mapped ahead are not charged as faults.
+    bool_t major;
+    for (uint32_t page_addr = start; page_addr < end; page_addr += PAGE_SIZE) {
+        page_table_entry_t *entry = &table->pages[(page_addr / PAGE_SIZE) % 1024U];
+        if (entry->present) {
+            continue;
+        }
+        if (area->vm_file || area->vm_ops) {
+            if (__page_handle_mapping(area, entry, page_addr, false, &major)) {
+                break;
+            }
+        } else if (entry->kernel_cow) {
+            page_t *page = __alloc_zeroed_user_page();
+            if (page == NULL) {
+                break;
+            }
+            entry->frame      = get_physical_address_from_page(page) >> 12U;
+            entry->kernel_cow = 0;
+            entry->present    = 1;
+        }
+    }
+}
+
+/// @brief Returns the file or object mapping of the current process containing
+/// the address.
+/// @param addr the address.
+/// @return the area, NULL if the address is not part of such a mapping.
+static vm_area_struct_t *__find_file_vm_area(uint32_t addr)
+{
+    task_struct *task = scheduler_get_current_process();
+    if ((task == NULL) || (task->mm == NULL)) {
+        return NULL;
+    }
+    vm_area_struct_t *area = __vm_area_lookup(task->mm, addr, addr + 1);
+    if (area && (area->vm_file || area->vm_ops)) {
+        return area;
+    }
+    return NULL;
+}
+
+int mem_populate_range(mm_struct_t *mm, vm_area_struct_t *area, uint32_t start, uint32_t end, int write)
+{
+    if (!__vm_area_contains(area, start, end)) {
+        return -EINVAL;
+    }
+    page_table_entry_t *entry;
+    unsigned int needed = 0;
+    list_head pages;
+    list_head_init(&pages);
+    bool_t major;
+    int ret = 0;
+    // Read-only mappings are never written.
+    write = write && ((!area->vm_file && !area->vm_ops) || (area->vm_page_prot & PROT_WRITE));
+    // The entries are going to change.
+    __pgt_unshare_range(mm->pgd, start, end);
+    // The demand-zero pages are allocated all at once.
+    if (!area->vm_file && !area->vm_ops) {
+        for (uint32_t addr = start; addr < end; addr += PAGE_SIZE) {
+            entry = __mem_get_pg_entry(mm->pgd, addr);
+            if (entry && !entry->present && entry->kernel_cow) {
+                ++needed;
+            }
+        }
+        if (needed && (alloc_pages_bulk(GFP_HIGHUSER | __GFP_ZERO, needed, &pages) < needed)) {
+            ret = -ENOMEM;
+        }
+    }
+    for (uint32_t addr = start; addr < end; addr += PAGE_SIZE) {
+        entry = __mem_get_pg_entry(mm->pgd, addr);
+        if (entry == NULL) {
+            continue;
+        }
+        if (area->vm_ops) {
+            if (!entry->present && __page_handle_ops(area, entry, addr, write)) {
+                ret = -ENOMEM;
+            }
+        } else if (area->vm_file) {
+            if ((!entry->present || (write && entry->kernel_cow)) &&
+                __page_handle_file(area, entry, addr, write, &major)) {
+                ret = -ENOMEM;
+            }
+        } else if (pte_is_swapped(entry)) {
+            if (__page_handle_swap(entry)) {
+                ret = -ENOMEM;
+            }
+        } else if (!entry->present && entry->kernel_cow) {
+            if (list_head_empty(&pages)) {
+                continue;
+            }
+            page_t *page = list_entry(pages.next, page_t, bbpage.location.cache);
+            list_head_remove(&page->bbpage.location.cache);
+            entry->frame      = get_physical_address_from_page(page) >> 12U;
+            entry->kernel_cow = 0;
+            entry->present    = 1;
+        } else if (write && entry->present && entry->kernel_cow) {
+            // The copy the first write would make.
+            if (__page_handle_cow(entry)) {
+                ret = -ENOMEM;
+            }
+        }
+    }
+    // Give back what was not used.
+    free_page_list(&pages);
+    paging_flush_tlb_range(mm->pgd, start, end);
+    return ret;
+}
+
 static page_table_t *__mem_pg_entry_alloc(page_dir_entry_t *entry, uint32_t flags)
 {
+    // Large pages are never split into page tables.
+    assert(!entry->page_size && "The entry maps a large page.");
     if (!entry->present) {
         // Alloc page table if not present
         // Present should be always 1, to indicate that the page tables
@@ -409,7 +1740,11 @@ static page_table_t *__mem_pg_entry_alloc(page_dir_entry_t *entry, uint32_t flag
         entry->user      = (flags & MM_USER) != 0;
         entry->accessed  = 0;
         entry->available = 1;
-        return kmem_cache_alloc(pgtbl_cache, GFP_KERNEL);
+        return __pgt_alloc();
+    }
+    // A table shared since a fork is going to change, it becomes private.
+    if (!entry->page_size && !entry->global && !entry->rw) {
+        __pgt_unshare(entry);
     }
     entry->present |= (flags & MM_PRESENT) != 0;
     entry->rw |= (flags & MM_RW) != 0;
@@ -426,11 +1761,29 @@ static page_table_t *__mem_pg_entry_alloc(page_dir_entry_t *entry, uint32_t flag
 
 static inline void __set_pg_entry_frame(page_dir_entry_t *entry, page_table_t *table)
 {
-    page_t *table_page = get_lowmem_page_from_address((uint32_t)table);
+    page_t *table_page = get_lowmem_page_from_address((uintptr_t)table);
     uint32_t phy_addr  = get_physical_address_from_page(table_page);
     entry->frame       = phy_addr >> 12u;
 }
 
+/// @brief Sets a page directory entry to map a large page.
+/// @param entry the page directory entry, which must not map a page table.
+/// @param phy_addr the physical address of the large page, aligned to LARGE_PAGE_SIZE.
+/// @param flags the flags for the large page.
+static inline void __set_pg_entry_large(page_dir_entry_t *entry, uint32_t phy_addr, uint32_t flags)
+{
+    assert((!entry->present || entry->page_size) && "The entry maps a page table.");
+    assert(!(phy_addr & (LARGE_PAGE_SIZE - 1)) && "The large page is not aligned.");
+    entry->present   = (flags & MM_PRESENT) != 0;
+    entry->rw        = (flags & MM_RW) != 0;
+    entry->global    = (flags & MM_GLOBAL) != 0;
+    entry->user      = (flags & MM_USER) != 0;
+    entry->accessed  = 0;
+    entry->page_size = 1;
+    entry->available = 1;
+    entry->frame     = phy_addr >> 12u;
+}
+
 void page_fault_handler(pt_regs *f)
 {
     // Here you will find the `Demand Paging` mechanism.
@@ -456,18 +1809,20 @@ void page_fault_handler(pt_regs *f)
     uint32_t faulting_addr;
     __asm__ __volatile__("mov %%cr2, %0"
                          : "=r"(faulting_addr));
+    trace_event(TRACE_PAGE_FAULT, faulting_addr, f->err_code, f->eip, 0);
     // Get the physical address of the current page directory.
-    uint32_t phy_dir = (uint32_t)paging_get_current_directory();
+    uintptr_t phy_dir = (uintptr_t)paging_get_current_directory();
     // Get the page directory.
     page_directory_t *lowmem_dir = (page_directory_t *)get_lowmem_address_from_page(get_page_from_physical_address(phy_dir));
     // Get the directory entry.
-    page_dir_entry_t *direntry = &lowmem_dir->entries[faulting_addr / (1024U * PAGE_SIZE)];
+    page_dir_entry_t *direntry = &lowmem_dir->entries[faulting_addr / LARGE_PAGE_SIZE];
     // Extract the error
     bool_t err_user    = bit_check(f->err_code, 2) != 0;
     bool_t err_rw      = bit_check(f->err_code, 1) != 0;
     bool_t err_present = bit_check(f->err_code, 0) != 0;
     // Panic only if page is in kernel memory, else abort process with SIGSEGV.
-    if (!direntry->present) {
+    // Large pages only map kernel memory, which is never paged on demand.
+    if (!direntry->present || direntry->page_size) {
         pr_crit("ERR(0): %d%d%d\n", err_user, err_rw, err_present);
         if (err_user) {
             // Get the current process.
@@ -486,6 +1841,13 @@ void page_fault_handler(pt_regs *f)
         pr_crit("ERR(0): So, it is not present, and it was not the user.\n");
         __page_fault_panic(f, faulting_addr);
     }
+    // A page table shared since a fork becomes private on the first fault
+    // inside it, whatever the fault is.
+    if (__pgt_is_shared(direntry, faulting_addr)) {
+        __pgt_unshare(direntry);
+        paging_flush_tlb_range(lowmem_dir, faulting_addr & ~(LARGE_PAGE_SIZE - 1),
+                               (faulting_addr & ~(LARGE_PAGE_SIZE - 1)) + LARGE_PAGE_SIZE);
+    }
     // Get the physical address of the page table.
     uint32_t phy_table = direntry->frame << 12U;
     // Get the page table.
@@ -494,6 +1856,14 @@ void page_fault_handler(pt_regs *f)
     uint32_t table_index = (faulting_addr / PAGE_SIZE) % 1024U;
     // Get the corresponding page table entry.
     page_table_entry_t *entry = &lowmem_table->pages[table_index];
+    // The file or object mapping containing the address, if any.
+    vm_area_struct_t *file_area;
+    // If the neighbouring pages are mapped too.
+    bool_t fault_around = false;
+    // If the page had to be read from a file.
+    bool_t major = false;
+    // The task which faulted, charged with the fault.
+    task_struct *task = scheduler_get_current_process();
     // There was a page fault on a virtual mapped address,
     // so we must first update the original mapped page
     if (virtual_check_address(faulting_addr)) {
@@ -508,13 +1878,38 @@ void page_fault_handler(pt_regs *f)
         entry->frame = orig_entry->frame;
         // Update the entry flags.
         __set_pg_table_flags(entry, MM_PRESENT | MM_RW | MM_GLOBAL | MM_COW | MM_UPDADDR);
+    } else if ((file_area = __find_file_vm_area(faulting_addr)) != NULL) {
+        // The page belongs to a file, or to an object.
+        fault_around = !entry->present;
+        if (__page_handle_mapping(file_area, entry, faulting_addr, err_rw, &major)) {
+            pr_crit("ERR(3): %d%d%d\n", err_user, err_rw, err_present);
+            if (err_user && task) {
+                // Notifies current process, and let the scheduler handle the signal.
+                sys_kill(task->pid, SIGSEGV);
+                scheduler_run(f);
+                return;
+            }
+            __page_fault_panic(f, faulting_addr);
+        }
+        if (fault_around) {
+            __page_fault_around(file_area, lowmem_table, faulting_addr);
+        }
     } else {
-        // Check if the page is Copy on Write (CoW).
-        if (__page_handle_cow(entry)) {
+        // A demand-zero page is being populated.
+        fault_around = !entry->present && entry->kernel_cow;
+        // The page is either inside the swap, or Copy on Write (CoW).
+        bool_t swapped = pte_is_swapped(entry);
+        int failed     = swapped ? __page_handle_swap(entry) : __page_handle_cow(entry);
+        // Out of memory, the user pages used least recently go to the swap.
+        // Faults of the kernel might hold the locks of the swap file.
+        if (failed && err_user &&
+            mem_swap_out(&contig_page_data->node_zones[ZONE_HIGHMEM], SWAP_CLUSTER_PAGES)) {
+            failed = pte_is_swapped(entry) ? __page_handle_swap(entry) : __page_handle_cow(entry);
+        }
+        major = swapped;
+        if (failed) {
             pr_crit("ERR(2): %d%d%d\n", err_user, err_rw, err_present);
             if (err_user && err_rw && err_present) {
-                // Get the current process.
-                task_struct *task = scheduler_get_current_process();
                 if (task) {
                     // Notifies current process.
                     sys_kill(task->pid, SIGSEGV);
@@ -530,6 +1925,20 @@ void page_fault_handler(pt_regs *f)
             pr_crit("ERR(2): We continued...\n");
             __page_fault_panic(f, faulting_addr);
         }
+        if (fault_around && task && task->mm) {
+            vm_area_struct_t *area = __vm_area_lookup(task->mm, faulting_addr, faulting_addr + 1);
+            if (area) {
+                __page_fault_around(area, lowmem_table, faulting_addr);
+            }
+        }
+    }
+    // The faults on the kernel virtual mappings are not charged to the task.
+    if (task && !virtual_check_address(faulting_addr)) {
+        if (major) {
+            ++task->rusage.majflt;
+        } else {
+            ++task->rusage.minflt;
+        }
     }
     // Invalidate the page table entry.
     paging_flush_tlb_single(faulting_addr);
@@ -584,7 +1993,7 @@ static pg_iter_entry_t __pg_iter_next(page_iterator_t *iter)
         // The page directory is always aligned to page boundaries,
         // so we can easily know when we've skipped the last page by checking
         // if the address % PAGE_SIZE is equal to zero.
-        if (iter->pfn != iter->last_pfn && ((uint32_t)++iter->entry) % 4096 != 0) {
+        if (iter->pfn != iter->last_pfn && ((uintptr_t)++iter->entry) % 4096 != 0) {
             iter->table = __mem_pg_entry_alloc(iter->entry, iter->flags);
             __set_pg_entry_frame(iter->entry, iter->table);
         }
@@ -599,11 +2008,22 @@ page_t *mem_virtual_to_page(page_directory_t *pgdir, uint32_t virt_start, size_t
     uint32_t virt_pgt        = virt_pfn / 1024;
     uint32_t virt_pgt_offset = virt_pfn % 1024;
 
-    page_t *pgd_page = mem_map + pgdir->entries[virt_pgt].frame;
+    uint32_t pfn;
+    if (pgdir->entries[virt_pgt].page_size) {
+        // The pages of a large page are contiguous.
+        pfn = pgdir->entries[virt_pgt].frame + virt_pgt_offset;
+    } else {
+        page_t *pgd_page = mem_map + pgdir->entries[virt_pgt].frame;
 
-    page_table_t *pgt_address = (page_table_t *)get_lowmem_address_from_page(pgd_page);
+        page_table_t *pgt_address = (page_table_t *)get_lowmem_address_from_page(pgd_page);
 
-    uint32_t pfn = pgt_address->pages[virt_pgt_offset].frame;
+        // Whoever asks for the page is going to use it, bring it back.
+        page_table_entry_t *entry = &pgt_address->pages[virt_pgt_offset];
+        if (pte_is_swapped(entry) && __page_handle_swap(entry)) {
+            return NULL;
+        }
+        pfn = entry->frame;
+    }
 
     page_t *page = mem_map + pfn;
 
@@ -619,12 +2039,107 @@ page_t *mem_virtual_to_page(page_directory_t *pgdir, uint32_t virt_start, size_t
     return page;
 }
 
+unsigned int mem_count_resident_pages(mm_struct_t *mm)
+{
+    unsigned int resident = 0;
+    list_for_each_decl(it, &mm->mmap_list)
+    {
+        vm_area_struct_t *area = list_entry(it, vm_area_struct_t, vm_list);
+        uint32_t addr          = area->vm_start;
+        while (addr < area->vm_end) {
+            page_dir_entry_t *direntry = &mm->pgd->entries[addr / LARGE_PAGE_SIZE];
+            // The end of the area, or of the page table holding the address.
+            uint32_t table_end = (addr & ~(LARGE_PAGE_SIZE - 1)) + LARGE_PAGE_SIZE;
+            uint32_t end       = (table_end && (table_end < area->vm_end)) ? table_end : area->vm_end;
+            // Skip the whole table, if it is missing.
+            if (direntry->present && !direntry->page_size) {
+                page_table_t *table = (page_table_t *)get_lowmem_address_from_page(mem_map + direntry->frame);
+                for (; addr < end; addr += PAGE_SIZE) {
+                    resident += table->pages[(addr / PAGE_SIZE) % 1024U].present;
+                }
+            }
+            addr = end;
+        }
+    }
+    return resident;
+}
+
+void mem_vm_area_usage(vm_area_struct_t *area, vm_area_usage_t *usage)
+{
+    memset(usage, 0, sizeof(vm_area_usage_t));
+    page_directory_t *pgd = area->vm_mm->pgd;
+    uint32_t addr         = area->vm_start & ~(PAGE_SIZE - 1);
+    while (addr < area->vm_end) {
+        page_dir_entry_t *direntry = &pgd->entries[addr / LARGE_PAGE_SIZE];
+        // The end of the area, or of the page table holding the address.
+        uint32_t table_end = (addr & ~(LARGE_PAGE_SIZE - 1)) + LARGE_PAGE_SIZE;
+        uint32_t end       = (table_end && (table_end < area->vm_end)) ? table_end : area->vm_end;
+        // Skip the whole table, if it is missing.
+        if (direntry->present && !direntry->page_size) {
+            page_t *table_page  = mem_map + direntry->frame;
+            page_table_t *table = (page_table_t *)get_lowmem_address_from_page(table_page);
+            // A table shared since the fork shares all its pages.
+            int table_shared = page_count(table_page) > 1;
+            for (; addr < end; addr += PAGE_SIZE) {
+                page_table_entry_t *entry = &table->pages[(addr / PAGE_SIZE) % 1024U];
+                if (pte_is_swapped(entry)) {
+                    ++usage->swap;
+                }
+                if (!entry->present) {
+                    continue;
+                }
+                ++usage->resident;
+                page_t *page = get_page_from_physical_address(((uint32_t)entry->frame) << 12U);
+                if (table_shared || (page_count(page) > 1)) {
+                    if (entry->dirty) {
+                        ++usage->shared_dirty;
+                    } else {
+                        ++usage->shared_clean;
+                    }
+                    // The writable pages of a shared table are copied when
+                    // the table is.
+                    if (entry->kernel_cow || (table_shared && entry->rw)) {
+                        ++usage->cow;
+                    }
+                } else if (entry->dirty) {
+                    ++usage->private_dirty;
+                } else {
+                    ++usage->private_clean;
+                }
+            }
+        }
+        addr = end;
+    }
+}
+
 void mem_upd_vm_area(page_directory_t *pgd,
                      uint32_t virt_start,
                      uint32_t phy_start,
                      size_t size,
                      uint32_t flags)
 {
+    if ((flags & MM_LARGE) && (flags & MM_UPDADDR) && !((virt_start ^ phy_start) & (LARGE_PAGE_SIZE - 1))) {
+        // Find the part of the range made of whole large pages.
+        uint32_t large_start = (virt_start + LARGE_PAGE_SIZE - 1) & ~(LARGE_PAGE_SIZE - 1);
+        uint32_t large_end   = (virt_start + size) & ~(LARGE_PAGE_SIZE - 1);
+        if ((large_start >= virt_start) && (large_start < large_end)) {
+            flags = bitmask_clear(flags, MM_LARGE);
+            // Map the head and the tail of the range with page tables.
+            if (large_start > virt_start) {
+                mem_upd_vm_area(pgd, virt_start, phy_start, large_start - virt_start, flags);
+            }
+            if (virt_start + size > large_end) {
+                mem_upd_vm_area(pgd, large_end, phy_start + (large_end - virt_start), virt_start + size - large_end, flags);
+            }
+            // Map the rest with the page directory entries.
+            for (uint32_t addr = large_start; addr < large_end; addr += LARGE_PAGE_SIZE) {
+                __set_pg_entry_large(&pgd->entries[addr / LARGE_PAGE_SIZE], phy_start + (addr - virt_start), flags);
+            }
+            paging_flush_tlb_range(pgd, large_start, large_end);
+            return;
+        }
+    }
+
     page_iterator_t virt_iter;
     __pg_iter_init(&virt_iter, pgd, virt_start, size, flags);
 
@@ -634,12 +2149,11 @@ void mem_upd_vm_area(page_directory_t *pgd,
         pg_iter_entry_t it = __pg_iter_next(&virt_iter);
         if (flags & MM_UPDADDR) {
             it.entry->frame = phy_pfn++;
-            // Flush the tlb to allow address update
-            // TODO(enrico): Check if it's always needed (ex. when the pgdir is not the current one)
-            paging_flush_tlb_single(it.pfn * PAGE_SIZE);
         }
         __set_pg_table_flags(it.entry, flags);
     }
+    // Flush the tlb to allow address and flags update.
+    paging_flush_tlb_range(pgd, virt_start, virt_start + size);
 }
 
 void mem_clone_vm_area(page_directory_t *src_pgd,
@@ -659,8 +2173,13 @@ void mem_clone_vm_area(page_directory_t *src_pgd,
         pg_iter_entry_t src_it = __pg_iter_next(&src_iter);
         pg_iter_entry_t dst_it = __pg_iter_next(&dst_iter);
 
+        // The page is going to be used through the mapping, bring it back.
+        if (pte_is_swapped(src_it.entry) && __page_handle_swap(src_it.entry)) {
+            pr_err("Cannot swap in the page at 0x%p.\n", src_it.pfn * PAGE_SIZE);
+        }
+
         if (src_it.entry->kernel_cow) {
-            *(uint32_t *)dst_it.entry = (uint32_t)src_it.entry;
+            *(uint32_t *)dst_it.entry = (uintptr_t)src_it.entry;
             // This is to make it clear that the page is not present,
             // can be omitted because the .entry address is aligned to 4 bytes boundary
             // so it's first two bytes are always zero
@@ -669,11 +2188,9 @@ void mem_clone_vm_area(page_directory_t *src_pgd,
             dst_it.entry->frame = src_it.entry->frame;
             __set_pg_table_flags(dst_it.entry, flags);
         }
-
-        // Flush the tlb to allow address update
-        // TODO(enrico): Check if it's always needed (ex. when the pgdir is not the current one)
-        paging_flush_tlb_single(dst_it.pfn * PAGE_SIZE);
     }
+    // Flush the tlb to allow address update.
+    paging_flush_tlb_range(dst_pgd, dst_start, dst_start + size);
 }
 
 mm_struct_t *create_blank_process_image(size_t stack_size)
@@ -690,14 +2207,17 @@ mm_struct_t *create_blank_process_image(size_t stack_size)
 
     mm->pgd = pdir_cpy;
 
-    // Initialize vm areas list
+    // Initialize vm areas list and tree.
     list_head_init(&mm->mmap_list);
+    mm->mm_rb = __vm_area_tree_create();
 
     // Allocate the stack segment.
     vm_area_struct_t *segment = create_vm_area(mm, PROCAREA_END_ADDR - stack_size, stack_size,
                                                MM_PRESENT | MM_RW | MM_USER | MM_COW, GFP_HIGHUSER);
     //    Update the start of the stack.
     mm->start_stack = segment->vm_start;
+    // The task creating it is the only user.
+    atomic_set(&mm->mm_users, 1);
     return mm;
 }
 
@@ -718,14 +2238,23 @@ mm_struct_t *clone_process_image(mm_struct_t *mmp)
 
     // Reset vm areas to allow easy clone
     list_head_init(&mm->mmap_list);
+    mm->mm_rb      = __vm_area_tree_create();
+    mm->mmap_cache = NULL;
     mm->map_count = 0;
     mm->total_vm  = 0;
+    mm->def_hints = 0;
+    // The copy belongs only to the new task.
+    atomic_set(&mm->mm_users, 1);
+
+    // Share the page tables covering only private memory, their entries are
+    // copied on the first fault inside them.
+    __pgt_share_tables(mmp, mm);
 
     // Clone each memory area to the new process!
     list_head *it;
     list_for_each (it, &mmp->mmap_list) {
         vm_area = list_entry(it, vm_area_struct_t, vm_list);
-        clone_vm_area(mm, vm_area, 0, GFP_HIGHUSER);
+        clone_vm_area(mm, vm_area, 1, GFP_HIGHUSER);
     }
 
     //
@@ -735,37 +2264,66 @@ mm_struct_t *clone_process_image(mm_struct_t *mmp)
     return mm;
 }
 
-void destroy_process_image(mm_struct_t *mm)
+/// The process images waiting for the reaper, linked through mm_list.
+static list_head mm_reap_list = { &mm_reap_list, &mm_reap_list };
+/// Where the reaper waits for work.
+static wait_queue_head_t mm_reap_wait;
+/// Set once the reaper has been started.
+static bool_t mm_reaper_running = false;
+
+/// @brief Stops using the page directory of a process image, if it is the
+/// current one.
+/// @param mm the memory descriptor.
+static inline void __mm_switch_away(mm_struct_t *mm)
 {
-    assert(mm != NULL);
-
-    if ((uint32_t)paging_get_current_directory() == get_physical_address_from_page(get_lowmem_page_from_address((uint32_t)mm->pgd))) {
+    if ((uintptr_t)paging_get_current_directory() == get_physical_address_from_page(get_lowmem_page_from_address((uintptr_t)mm->pgd))) {
         paging_switch_directory_va(paging_get_main_directory());
     }
+}
+
+void destroy_process_image(mm_struct_t *mm)
+{
+    assert(mm != NULL);
 
-    // Free each segment inside mm.
-    vm_area_struct_t *segment = NULL;
-    // Iterate the list.
-    list_head *it = mm->mmap_list.next, *next;
-    while (!list_head_empty(it)) {
-        segment = list_entry(it, vm_area_struct_t, vm_list);
-        // Save the pointer to the next element in the list.
-        next = segment->vm_list.next;
-        if (destroy_vm_area(mm, segment)) {
-            // Destroy the area.
-            kernel_panic("We failed to destroy the virtual memory area.");
+    __mm_switch_away(mm);
+
+    // The page directory is not in use, the TLB holds none of its entries,
+    // and the frames can be given back all together at the end.
+    list_head freed;
+    list_head_init(&freed);
+    // The tables shared with other processes are simply left to them.
+    for (uint32_t word = 0; word < count_of(mm->pgt_map); ++word) {
+        for (uint32_t bits = mm->pgt_map[word]; bits; bits &= bits - 1) {
+            page_dir_entry_t *entry = &mm->pgd->entries[word * 32 + __builtin_ctz(bits)];
+            if (entry->present && !entry->global && !entry->page_size && !entry->rw) {
+                page_t *pgt_page = get_page_from_physical_address(entry->frame * PAGE_SIZE);
+                if (page_count(pgt_page) > 1) {
+                    page_dec(pgt_page);
+                    entry->present = 0;
+                }
+            }
         }
-        // Move to the next element.
-        it = next;
     }
-
-    // Free all the page tables
-    for (int i = 0; i < 1024; i++) {
-        page_dir_entry_t *entry = &mm->pgd->entries[i];
-        if (entry->present && !entry->global) {
-            page_t *pgt_page  = get_page_from_physical_address(entry->frame * PAGE_SIZE);
-            uint32_t pgt_addr = get_lowmem_address_from_page(pgt_page);
-            kmem_cache_free((void *)pgt_addr);
+    // Free each segment inside mm, the tree is thrown away as a whole.
+    list_for_each_safe_decl(it, store, &mm->mmap_list)
+    {
+        vm_area_struct_t *segment = list_entry(it, vm_area_struct_t, vm_list);
+        __unmap_vm_area(mm, segment, &freed);
+        list_head_remove(it);
+        kmem_cache_free(segment);
+        // Large images take long to tear down.
+        cond_resched();
+    }
+    rbtree_tree_dealloc(mm->mm_rb, NULL);
+    free_page_list(&freed);
+
+    // Free the page tables, only where areas have been.
+    for (uint32_t word = 0; word < count_of(mm->pgt_map); ++word) {
+        for (uint32_t bits = mm->pgt_map[word]; bits; bits &= bits - 1) {
+            page_dir_entry_t *entry = &mm->pgd->entries[word * 32 + __builtin_ctz(bits)];
+            if (entry->present && !entry->global && !entry->page_size) {
+                __pgt_put(get_page_from_physical_address(entry->frame * PAGE_SIZE));
+            }
         }
     }
     kmem_cache_free((void *)mm->pgd);
@@ -774,11 +2332,90 @@ void destroy_process_image(mm_struct_t *mm)
     kmem_cache_free(mm);
 }
 
+mm_struct_t *share_process_image(mm_struct_t *mm)
+{
+    assert(mm != NULL);
+    atomic_inc(&mm->mm_users);
+    return mm;
+}
+
+void release_process_image(mm_struct_t *mm)
+{
+    assert(mm != NULL);
+    // The value before the decrement is returned, 1 means we were the last.
+    if (atomic_dec(&mm->mm_users) == 1) {
+        if (!mm_reaper_running) {
+            destroy_process_image(mm);
+            return;
+        }
+        // Nobody runs on it anymore, the reaper does the rest.
+        __mm_switch_away(mm);
+        uint8_t flags = irq_disable();
+        list_head_insert_before(&mm->mm_list, &mm_reap_list);
+        irq_enable(flags);
+        wake_up(&mm_reap_wait);
+    }
+}
+
+/// @brief The reaper thread, which destroys the released process images.
+/// @param data unused.
+/// @return never returns.
+static int __mm_reaper(void *data)
+{
+    (void)data;
+    task_struct *task = scheduler_get_current_process();
+    wait_queue_entry_t wait;
+    init_waitqueue_entry(&wait, task);
+    while (true) {
+        // Sleep until an image is released, with interrupts disabled so that
+        // its wake up cannot get lost.
+        uint8_t flags = irq_disable();
+        while (list_head_empty(&mm_reap_list)) {
+            add_wait_queue(&mm_reap_wait, &wait);
+            scheduler_set_task_state(task, TASK_UNINTERRUPTIBLE);
+            kthread_yield();
+            remove_wait_queue(&mm_reap_wait, &wait);
+        }
+        list_head *it = list_head_pop(&mm_reap_list);
+        irq_enable(flags);
+        destroy_process_image(list_entry(it, mm_struct_t, mm_list));
+    }
+    return 0;
+}
+
+int mm_reaper_start(void)
+{
+    init_waitqueue_head(&mm_reap_wait);
+    if (kthread_create(__mm_reaper, NULL, "kreaper") == NULL) {
+        return 0;
+    }
+    mm_reaper_running = true;
+    return 1;
+}
+
 void *sys_mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset)
 {
     uintptr_t vm_start;
+    vfs_file_t *file = NULL;
     // Get the current task.
     task_struct *task = scheduler_get_current_process();
+    // Check if the memory is backed by a file.
+    if (!(flags & MAP_ANONYMOUS) && (fd >= 0)) {
+        if ((fd >= task->files->max_fd) || (task->files->fd_list[fd].file_struct == NULL)) {
+            pr_err("The file descriptor %d is not valid.\n", fd);
+            return NULL;
+        }
+        if ((offset < 0) || (offset % PAGE_SIZE)) {
+            pr_err("The offset %d is not aligned to a page.\n", offset);
+            return NULL;
+        }
+        file = task->files->fd_list[fd].file_struct;
+        // File mappings are made of whole pages.
+        length = (length + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+        if (addr && ((uintptr_t)addr % PAGE_SIZE)) {
+            addr = NULL;
+        }
+    }
     // Check if we were asked for a specific spot.
     if (addr && is_valid_vm_area(task->mm, (uintptr_t)addr, (uintptr_t)addr + length)) {
         vm_start = (uintptr_t)addr;
@@ -789,14 +2426,44 @@ void *sys_mmap(void *addr, size_t length, int prot, int flags, int fd, off_t off
             return NULL;
         }
     }
-    // Allocate the segment.
-    vm_area_struct_t *segment = create_vm_area(
-        task->mm,
-        vm_start,
-        length,
-        MM_PRESENT | MM_RW | MM_COW | MM_USER,
-        GFP_HIGHUSER);
-    task->mm->mmap_cache->vm_flags = flags;
+    vm_area_struct_t *segment;
+    if (file && file->fs_operations->mmap_f && ((flags & MAP_SHARED) || (file->flags == DT_CHR))) {
+        // The filesystem maps its own pages, which are faulted in on demand.
+        // Character devices, which have no page cache, map private areas too.
+        if ((flags & MAP_SHARED) && (prot & PROT_WRITE) &&
+            !(task->files->fd_list[fd].flags_mask & (O_WRONLY | O_RDWR))) {
+            return NULL;
+        }
+        segment = create_vm_area(task->mm, vm_start, length, MM_PRESENT | MM_RW | MM_COW | MM_USER, GFP_HIGHUSER);
+        if (segment == NULL) {
+            return NULL;
+        }
+        segment->vm_flags     = flags;
+        segment->vm_page_prot = prot;
+        segment->vm_pgoff     = offset / PAGE_SIZE;
+        if (file->fs_operations->mmap_f(file, segment) < 0) {
+            destroy_vm_area(task->mm, segment);
+            return NULL;
+        }
+    } else if (file) {
+        // Map the file, pages are read on demand.
+        segment = create_file_vm_area(task->mm, vm_start, length, file, offset / PAGE_SIZE, length, prot, flags);
+    } else {
+        // Allocate the segment, pages are allocated on demand.
+        segment = create_vm_area(
+            task->mm,
+            vm_start,
+            length,
+            MM_PRESENT | MM_RW | MM_COW | MM_USER,
+            GFP_HIGHUSER);
+        task->mm->mmap_cache->vm_flags = flags;
+    }
+    // Unless they are wanted right away, or locked by mlockall(MCL_FUTURE).
+    // Like a fault, failing to populate the area is not an error.
+    if ((flags & MAP_POPULATE) || (segment->vm_hints & VM_LOCKED)) {
+        mem_populate_range(task->mm, segment, segment->vm_start & ~(PAGE_SIZE - 1),
+                           (segment->vm_end + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1), !file || (prot & PROT_WRITE));
+    }
     return (void *)segment->vm_start;
 }
 
@@ -809,18 +2476,228 @@ int sys_munmap(void *addr, size_t length)
     //
     unsigned vm_start = (uintptr_t)addr, size;
     // Find the area.
-    list_for_each_prev_decl(it, &task->mm->mmap_list)
+    segment = find_vm_area(task->mm, vm_start);
+    if (segment == NULL) {
+        return 1;
+    }
+    // Compute the size of the segment.
+    size = segment->vm_end - segment->vm_start;
+    // File mappings are made of whole pages.
+    if (segment->vm_file) {
+        length = (length + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    }
+    // Check the segment.
+    if (length == size) {
+        pr_warning("[0x%p:0x%p] Found it, destroying it.\n", segment->vm_start, segment->vm_end);
+        destroy_vm_area(task->mm, segment);
+        return 0;
+    }
+    return 1;
+}
+
+/// @brief Applies a hint to a part of an area.
+/// @param mm the memory descriptor.
+/// @param area the area.
+/// @param start the start of the part, aligned to a page.
+/// @param end the end of the part, exclusive, aligned to a page.
+/// @param arg the argument of the hint.
+/// @return 0 on success, -errno on failure.
+typedef int (*vm_range_fn_t)(mm_struct_t *mm, vm_area_struct_t *area, uint32_t start, uint32_t end, int arg);
+
+/// @brief Applies a hint to the areas covering the given range.
+/// @param mm the memory descriptor.
+/// @param start the start of the range, aligned to a page.
+/// @param end the end of the range, exclusive, aligned to a page.
+/// @param fn the function applying the hint to each area.
+/// @param arg the argument of the hint.
+/// @return 0 on success, -ENOMEM if part of the range is not mapped, -errno
+/// if the hint failed.
+static int __vm_range_apply(mm_struct_t *mm, uint32_t start, uint32_t end, vm_range_fn_t fn, int arg)
+{
+    uint32_t addr = start, area_start, area_end;
+    vm_area_struct_t *area;
+    int ret;
+    if (start == end) {
+        return 0;
+    }
+    list_for_each_decl(it, &mm->mmap_list)
     {
-        segment = list_entry(it, vm_area_struct_t, vm_list);
-        assert(segment && "There is a NULL area in the list.");
-        // Compute the size of the segment.
-        size = segment->vm_end - segment->vm_start;
-        // Check the segment.
-        if ((vm_start == segment->vm_start) && (length == size)) {
-            pr_warning("[0x%p:0x%p] Found it, destroying it.\n", segment->vm_start, segment->vm_end);
-            destroy_vm_area(task->mm, segment);
+        area       = list_entry(it, vm_area_struct_t, vm_list);
+        area_start = area->vm_start & ~(PAGE_SIZE - 1);
+        area_end   = (area->vm_end + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+        if (area_end <= addr) {
+            continue;
+        }
+        // There is a hole inside the range.
+        if (area_start > addr) {
+            return -ENOMEM;
+        }
+        if ((ret = fn(mm, area, addr, min(end, area_end), arg)) < 0) {
+            return ret;
+        }
+        if ((addr = min(end, area_end)) == end) {
             return 0;
         }
     }
-    return 1;
+    return -ENOMEM;
+}
+
+/// @brief Computes the range of pages covering the given bytes.
+/// @param addr the start of the bytes.
+/// @param length the number of bytes.
+/// @param start the start of the pages.
+/// @param end the end of the pages, exclusive.
+/// @return 0 on success, -ENOMEM if the range is outside the user space.
+static inline int __vm_range_pages(uintptr_t addr, size_t length, uint32_t *start, uint32_t *end)
+{
+    *start = addr & ~(PAGE_SIZE - 1);
+    *end   = (addr + length + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    if ((addr + length < addr) || (*end > PROCAREA_END_ADDR) || (*end < *start)) {
+        return -ENOMEM;
+    }
+    return 0;
+}
+
+/// @brief Applies the advice of madvise to a part of an area.
+/// @param mm the memory descriptor.
+/// @param area the area.
+/// @param start the start of the part.
+/// @param end the end of the part, exclusive.
+/// @param advice the advice.
+/// @return 0 on success, -errno on failure.
+/// @details The areas are never split, so the access pattern is applied to
+/// the whole area containing the range.
+static int __madvise_area(mm_struct_t *mm, vm_area_struct_t *area, uint32_t start, uint32_t end, int advice)
+{
+    page_table_entry_t *entry;
+    switch (advice) {
+    case MADV_NORMAL:
+        area->vm_hints &= ~(VM_SEQ_READ | VM_RAND_READ);
+        return 0;
+    case MADV_RANDOM:
+        area->vm_hints = (area->vm_hints & ~VM_SEQ_READ) | VM_RAND_READ;
+        return 0;
+    case MADV_SEQUENTIAL:
+        area->vm_hints = (area->vm_hints & ~VM_RAND_READ) | VM_SEQ_READ;
+        return 0;
+    case MADV_WILLNEED:
+        if (area->vm_file) {
+            // Read the pages inside the page cache, they are mapped on fault.
+            for (uint32_t addr = max(start, area->vm_start); (addr < end) && (addr < area->vm_file_end); addr += PAGE_SIZE) {
+                page_t *page = page_cache_get(area->vm_file, __file_area_page_index(area, addr));
+                if (page == NULL) {
+                    break;
+                }
+                page_cache_put(page);
+            }
+            return 0;
+        }
+        // Bring back the pages which went to the swap.
+        __pgt_unshare_range(mm->pgd, start, end);
+        for (uint32_t addr = start; addr < end; addr += PAGE_SIZE) {
+            entry = __mem_get_pg_entry(mm->pgd, addr);
+            if (entry && pte_is_swapped(entry) && __page_handle_swap(entry)) {
+                break;
+            }
+        }
+        return 0;
+    case MADV_DONTNEED:
+        // Locked pages must stay where they are.
+        if (area->vm_hints & VM_LOCKED) {
+            return -EINVAL;
+        }
+        return (mem_discard_range(mm, area, start, end) < 0) ? -EINVAL : 0;
+    default:
+        return -EINVAL;
+    }
+}
+
+int sys_madvise(void *addr, size_t length, int advice)
+{
+    task_struct *task = scheduler_get_current_process();
+    uint32_t start, end;
+    if ((uintptr_t)addr & (PAGE_SIZE - 1)) {
+        return -EINVAL;
+    }
+    if (__vm_range_pages((uintptr_t)addr, length, &start, &end) < 0) {
+        return -ENOMEM;
+    }
+    return __vm_range_apply(task->mm, start, end, __madvise_area, advice);
+}
+
+/// @brief Locks, or unlocks, an area.
+/// @param mm the memory descriptor.
+/// @param area the area.
+/// @param start the start of the part which has to be mapped.
+/// @param end the end of the part, exclusive.
+/// @param lock 1 to lock the area, 0 to unlock it.
+/// @return 0 on success, -ENOMEM if the pages could not be mapped.
+/// @details The areas are never split, so the lock applies to the whole area
+/// containing the range.
+static int __mlock_area(mm_struct_t *mm, vm_area_struct_t *area, uint32_t start, uint32_t end, int lock)
+{
+    if (!lock) {
+        area->vm_hints &= ~VM_LOCKED;
+        return 0;
+    }
+    area->vm_hints |= VM_LOCKED;
+    // The pages are mapped writable, so that not even a write faults.
+    return (mem_populate_range(mm, area, start, end, 1) < 0) ? -ENOMEM : 0;
+}
+
+int sys_mlock(const void *addr, size_t length)
+{
+    task_struct *task = scheduler_get_current_process();
+    uint32_t start, end;
+    if (__vm_range_pages((uintptr_t)addr, length, &start, &end) < 0) {
+        return -ENOMEM;
+    }
+    return __vm_range_apply(task->mm, start, end, __mlock_area, 1);
+}
+
+int sys_munlock(const void *addr, size_t length)
+{
+    task_struct *task = scheduler_get_current_process();
+    uint32_t start, end;
+    if (__vm_range_pages((uintptr_t)addr, length, &start, &end) < 0) {
+        return -ENOMEM;
+    }
+    return __vm_range_apply(task->mm, start, end, __mlock_area, 0);
+}
+
+int sys_mlockall(int flags)
+{
+    task_struct *task = scheduler_get_current_process();
+    vm_area_struct_t *area;
+    int ret = 0;
+    if ((flags == 0) || (flags & ~(MCL_CURRENT | MCL_FUTURE))) {
+        return -EINVAL;
+    }
+    if (flags & MCL_CURRENT) {
+        list_for_each_decl(it, &task->mm->mmap_list)
+        {
+            area = list_entry(it, vm_area_struct_t, vm_list);
+            if (__mlock_area(task->mm, area, area->vm_start & ~(PAGE_SIZE - 1),
+                             (area->vm_end + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1), 1) < 0) {
+                ret = -ENOMEM;
+            }
+        }
+    }
+    if (flags & MCL_FUTURE) {
+        task->mm->def_hints |= VM_LOCKED;
+    } else {
+        task->mm->def_hints &= ~VM_LOCKED;
+    }
+    return ret;
+}
+
+int sys_munlockall(void)
+{
+    task_struct *task = scheduler_get_current_process();
+    list_for_each_decl(it, &task->mm->mmap_list)
+    {
+        list_entry(it, vm_area_struct_t, vm_list)->vm_hints &= ~VM_LOCKED;
+    }
+    task->mm->def_hints &= ~VM_LOCKED;
+    return 0;
 }
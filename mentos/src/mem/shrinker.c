@@ -0,0 +1,128 @@
+/// @file shrinker.c
+/// @brief Reclaim of the memory held by the caches, under memory pressure.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+// Setup the logging for this file (do this before any other include).
+#include "sys/kernel_levels.h"           // Include kernel log levels.
+#define __DEBUG_HEADER__ "[KSWAPD]"      ///< Change header.
+#define __DEBUG_LEVEL__  LOGLEVEL_NOTICE ///< Set log level.
+#include "io/debug.h"                    // Include debugging functions.
+
+#include "mem/shrinker.h"
+
+#include "klib/irqflags.h"
+#include "mem/paging.h"
+#include "mem/slab.h"
+#include "process/process.h"
+#include "process/scheduler.h"
+#include "process/wait.h"
+
+/// Number of objects each shrinker is asked to free at once.
+#define SHRINK_BATCH 32
+
+/// The registered shrinkers.
+static list_head shrinker_list = { &shrinker_list, &shrinker_list };
+/// Set while the caches are being shrunk, the shrinkers free memory, and must
+/// not end up shrinking the caches again.
+static bool_t reclaiming = false;
+/// Set when a zone went below its low watermark.
+static volatile bool_t kswapd_pending = false;
+/// Where kswapd waits for work.
+static wait_queue_head_t kswapd_wait;
+/// Set once kswapd has been started.
+static bool_t kswapd_running = false;
+
+void register_shrinker(shrinker_t *shrinker)
+{
+    list_head_insert_before(&shrinker->list, &shrinker_list);
+}
+
+void unregister_shrinker(shrinker_t *shrinker)
+{
+    list_head_remove(&shrinker->list);
+}
+
+unsigned long shrink_caches(zone_t *zone, unsigned long nr_pages)
+{
+    if (reclaiming) {
+        return 0;
+    }
+    reclaiming = true;
+    unsigned long start = zone->free_pages;
+    bool_t progress     = true;
+    while (progress && (zone->free_pages < start + nr_pages)) {
+        progress = false;
+        list_for_each_decl(it, &shrinker_list)
+        {
+            shrinker_t *shrinker = list_entry(it, shrinker_t, list);
+            if (shrinker->count_objects() && shrinker->scan_objects(SHRINK_BATCH)) {
+                progress = true;
+            }
+        }
+        // The objects freed went back to their slabs, give back the empty ones.
+        if (kmem_cache_reap()) {
+            progress = true;
+        }
+    }
+    reclaiming = false;
+    return (zone->free_pages > start) ? (zone->free_pages - start) : 0;
+}
+
+void kswapd_wakeup(gfp_t gfp_mask)
+{
+    if (!(gfp_mask & __GFP_KSWAPD_RECLAIM) || kswapd_pending) {
+        return;
+    }
+    kswapd_pending = true;
+    if (kswapd_running) {
+        wake_up(&kswapd_wait);
+    }
+}
+
+/// @brief The kswapd thread, which brings the zones back above their high
+/// watermark every time one of them goes below its low watermark.
+/// @param data unused.
+/// @return never returns.
+static int __kswapd(void *data)
+{
+    (void)data;
+    task_struct *task = scheduler_get_current_process();
+    wait_queue_entry_t wait;
+    init_waitqueue_entry(&wait, task);
+    while (true) {
+        // Sleep until an allocation asks for reclaim, with interrupts disabled
+        // so that its wake up cannot get lost.
+        uint8_t flags = irq_disable();
+        while (!kswapd_pending) {
+            add_wait_queue(&kswapd_wait, &wait);
+            scheduler_set_task_state(task, TASK_UNINTERRUPTIBLE);
+            kthread_yield();
+            remove_wait_queue(&kswapd_wait, &wait);
+        }
+        kswapd_pending = false;
+        irq_enable(flags);
+        for (int zone_index = 0; zone_index < contig_page_data->nr_zones; ++zone_index) {
+            zone_t *zone = &contig_page_data->node_zones[zone_index];
+            if (zone->free_pages < zone->watermark_high) {
+                unsigned long freed = shrink_caches(zone, zone->watermark_high - zone->free_pages);
+                // The caches are not enough, the idle pages of the processes go.
+                if (zone->free_pages < zone->watermark_high) {
+                    freed += mem_swap_out(zone, zone->watermark_high - zone->free_pages);
+                }
+                pr_debug("Reclaimed %lu pages from zone %s, %lu free.\n", freed, zone->name, zone->free_pages);
+            }
+        }
+    }
+    return 0;
+}
+
+int kswapd_start(void)
+{
+    init_waitqueue_head(&kswapd_wait);
+    if (kthread_create(__kswapd, NULL, "kswapd") == NULL) {
+        return 0;
+    }
+    kswapd_running = true;
+    return 1;
+}
@@ -10,9 +10,12 @@
 #include "io/debug.h"                    // Include debugging functions.
 
 #include "assert.h"
+#include "klib/irqflags.h"
 #include "mem/paging.h"
 #include "mem/slab.h"
 #include "mem/zone_allocator.h"
+#include "string.h"
+#include "system/trace.h"
 
 /// @brief Use it to manage cached pages.
 typedef struct kmem_obj {
@@ -20,8 +23,15 @@ typedef struct kmem_obj {
     list_head objlist;
 } kmem_obj;
 
-/// Max order of kmalloc cache allocations, if greater raw page allocation is done.
-#define MAX_KMALLOC_CACHE_ORDER 12
+/// Number of kmalloc size classes.
+#define KMALLOC_NUM_CLASSES 15
+/// Largest size served by a kmalloc cache, above it raw pages are allocated.
+#define KMALLOC_MAX_CACHE_SIZE 3072
+/// Granularity of the table mapping sizes to kmalloc caches.
+#define KMALLOC_LOOKUP_STEP 8
+
+/// Granularity of the slab colors, the size of a cache line.
+#define KMEM_COLOR_ALIGN 64
 
 #define KMEM_OBJ_OVERHEAD                    sizeof(kmem_obj)
 #define KMEM_START_OBJ_COUNT                 8
@@ -31,10 +41,41 @@ typedef struct kmem_obj {
 
 // The list of caches.
 static list_head kmem_caches_list;
+/// Number of free objects kept by each magazine.
+unsigned kmem_magazine_limit = KMEM_MAGAZINE_DEFAULT;
 // Cache where we will store the data about caches.
 static kmem_cache_t kmem_cache;
-// Caches for each order of the malloc.
-static kmem_cache_t *malloc_blocks[MAX_KMALLOC_CACHE_ORDER];
+/// Sizes of the kmalloc caches, powers of two and the values halfway.
+static const unsigned int kmalloc_sizes[KMALLOC_NUM_CLASSES] = {
+    8, 16, 32, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048, 3072
+};
+/// Names of the kmalloc caches.
+static const char *kmalloc_names[KMALLOC_NUM_CLASSES] = {
+    "kmalloc-8", "kmalloc-16", "kmalloc-32", "kmalloc-64", "kmalloc-96",
+    "kmalloc-128", "kmalloc-192", "kmalloc-256", "kmalloc-384", "kmalloc-512",
+    "kmalloc-768", "kmalloc-1024", "kmalloc-1536", "kmalloc-2048", "kmalloc-3072"
+};
+/// Number of pages held by the slabs of all the caches.
+static unsigned long kmem_slab_pages;
+// Caches for each size class of the malloc.
+static kmem_cache_t *malloc_blocks[KMALLOC_NUM_CLASSES];
+/// Maps (size + 7) / 8 to the index of the smallest fitting kmalloc cache.
+static uint8_t malloc_size_index[KMALLOC_MAX_CACHE_SIZE / KMALLOC_LOOKUP_STEP + 1];
+
+/// @brief Returns the counter of the slabs in the same state as the given one.
+/// @param cachep the cache.
+/// @param slab_page the root page of the slab.
+/// @return the counter of the free, partial, or full slabs.
+static inline unsigned int *__kmem_slab_counter(kmem_cache_t *cachep, page_t *slab_page)
+{
+    if (slab_page->slab_objfree == slab_page->slab_objcnt) {
+        return &cachep->slabs_free_num;
+    }
+    if (slab_page->slab_objfree == 0) {
+        return &cachep->slabs_full_num;
+    }
+    return &cachep->slabs_partial_num;
+}
 
 static int __alloc_slab_page(kmem_cache_t *cachep, gfp_t flags)
 {
@@ -60,8 +101,12 @@ static int __alloc_slab_page(kmem_cache_t *cachep, gfp_t flags)
     // Update the page objects counters.
     page->slab_objcnt  = slab_size / cachep->size;
     page->slab_objfree = page->slab_objcnt;
-    // Get the page address.
-    unsigned int pg_addr = get_lowmem_address_from_page(page);
+    // Get the page address, moved by the color of the slab, so that objects
+    // of different slabs do not always fall in the same cache sets.
+    unsigned int pg_addr = get_lowmem_address_from_page(page) + cachep->color_next * cachep->color_off;
+    if (++cachep->color_next == cachep->colors) {
+        cachep->color_next = 0;
+    }
     // Build the objects structures
     for (unsigned int i = 0; i < page->slab_objcnt; i++) {
         kmem_obj *obj = KMEM_OBJ(cachep, pg_addr + cachep->size * i);
@@ -71,6 +116,8 @@ static int __alloc_slab_page(kmem_cache_t *cachep, gfp_t flags)
     list_head_insert_after(&page->slabs, &cachep->slabs_free);
     cachep->total_num += page->slab_objcnt;
     cachep->free_num += page->slab_objcnt;
+    ++*__kmem_slab_counter(cachep, page);
+    kmem_slab_pages += 1UL << cachep->gfp_order;
     return 0;
 }
 
@@ -86,15 +133,26 @@ static void __kmem_cache_refill(kmem_cache_t *cachep, unsigned int free_num, gfp
 
 static void __compute_size_and_order(kmem_cache_t *cachep)
 {
-    // Align the whole object to the required padding.
-    cachep->size = round_up(
-        max(cachep->object_size, KMEM_OBJ_OVERHEAD),
-        max(8, cachep->align));
-    // Compute the gfp order
-    unsigned int size = round_up(cachep->size, PAGE_SIZE) / PAGE_SIZE;
-    while ((size /= 2) > 0) {
+    // The alignment must be a power of two, and at least 8 bytes.
+    unsigned int align = 8;
+    while (align < cachep->align) {
+        align <<= 1;
+    }
+    cachep->align = align;
+    // Align the whole object to the required padding, slabs start on page
+    // boundaries, so every object ends up aligned.
+    cachep->size = round_up(max(cachep->object_size, KMEM_OBJ_OVERHEAD), align);
+    // Compute the gfp order, so that a slab holds at least one object.
+    unsigned int pages = round_up(cachep->size, PAGE_SIZE) / PAGE_SIZE;
+    while ((1U << cachep->gfp_order) < pages) {
         cachep->gfp_order++;
     }
+    // The space left at the end of the slab gives the number of colors.
+    unsigned int slab_size = PAGE_SIZE * (1U << cachep->gfp_order);
+    unsigned int left_over = slab_size - (slab_size / cachep->size) * cachep->size;
+    cachep->color_off      = max(align, KMEM_COLOR_ALIGN);
+    cachep->colors         = (left_over / cachep->color_off) + 1;
+    cachep->color_next     = 0;
 }
 
 static void __kmem_cache_create(
@@ -136,8 +194,10 @@ static inline void *__kmem_cache_alloc_slab(kmem_cache_t *cachep, page_t *slab_p
         pr_warning("There are no FREE element inside the slab_freelist\n");
         return NULL;
     }
+    --*__kmem_slab_counter(cachep, slab_page);
     slab_page->slab_objfree--;
     cachep->free_num--;
+    ++*__kmem_slab_counter(cachep, slab_page);
 
     kmem_obj *obj = list_entry(elem_listp, kmem_obj, objlist);
 
@@ -155,6 +215,8 @@ static inline void __kmem_cache_free_slab(kmem_cache_t *cachep, page_t *slab_pag
 {
     cachep->free_num -= slab_page->slab_objfree;
     cachep->total_num -= slab_page->slab_objcnt;
+    --*__kmem_slab_counter(cachep, slab_page);
+    kmem_slab_pages -= 1UL << cachep->gfp_order;
     // Clear objcnt, used as a flag to check if the page belongs to the slab
     slab_page->slab_objcnt              = 0;
     slab_page->container.slab_main_page = NULL;
@@ -167,6 +229,75 @@ static inline void __kmem_cache_free_slab(kmem_cache_t *cachep, page_t *slab_pag
     __free_pages(slab_page);
 }
 
+/// @brief Returns the root page of the slab containing the object.
+/// @param ptr the object.
+/// @return the root page of the slab.
+static inline page_t *__kmem_slab_page_of(void *ptr)
+{
+    page_t *slab_page = get_lowmem_page_from_address((uintptr_t)ptr);
+    // If the slab main page is a lowmem page, change to it as it's the root page
+    if (is_lowmem_page_struct(slab_page->container.slab_main_page)) {
+        slab_page = slab_page->container.slab_main_page;
+    }
+    return slab_page;
+}
+
+/// @brief Gives an object back to its slab, moving the slab between lists.
+/// @param cachep the cache.
+/// @param slab_page the root page of the slab containing the object.
+/// @param ptr the object.
+static inline void __kmem_cache_put_object(kmem_cache_t *cachep, page_t *slab_page, void *ptr)
+{
+    kmem_obj *obj = KMEM_OBJ(cachep, ptr);
+
+    // Add object to the free list
+    list_head_insert_after(&obj->objlist, &slab_page->slab_freelist);
+    --*__kmem_slab_counter(cachep, slab_page);
+    slab_page->slab_objfree++;
+    cachep->free_num++;
+    ++*__kmem_slab_counter(cachep, slab_page);
+
+    // Now page is completely free
+    if (slab_page->slab_objfree == slab_page->slab_objcnt) {
+        // Remove page from partial list
+        list_head_remove(&slab_page->slabs);
+        // Add page to free list
+        list_head_insert_after(&slab_page->slabs, &cachep->slabs_free);
+    }
+    // Now page is not full, so change its list
+    else if (slab_page->slab_objfree == 1) {
+        // Remove page from full list
+        list_head_remove(&slab_page->slabs);
+        // Add page to partial list
+        list_head_insert_after(&slab_page->slabs, &cachep->slabs_partial);
+    }
+}
+
+/// @brief Returns the magazine of the current processor.
+/// @param cachep the cache.
+/// @return the magazine.
+static inline kmem_magazine_t *__kmem_cache_magazine(kmem_cache_t *cachep)
+{
+    // We only run on one processor.
+    return &cachep->magazine[0];
+}
+
+/// @brief Gives back to the slabs the oldest objects of the magazine.
+/// @param cachep the cache.
+/// @param magazine the magazine.
+/// @param count the number of objects.
+static void __kmem_magazine_flush(kmem_cache_t *cachep, kmem_magazine_t *magazine, unsigned int count)
+{
+    count = min(count, magazine->count);
+    for (unsigned int i = 0; i < count; ++i) {
+        void *ptr = magazine->objects[i];
+        __kmem_cache_put_object(cachep, __kmem_slab_page_of(ptr), ptr);
+    }
+    // Keep the most recently freed objects, they are the hottest.
+    magazine->count -= count;
+    memmove(magazine->objects, magazine->objects + count, magazine->count * sizeof(void *));
+}
+
 void kmem_cache_init(void)
 {
     // Initialize the list of caches.
@@ -180,15 +311,23 @@ void kmem_cache_init(void)
         GFP_KERNEL,
         NULL,
         NULL, 32);
-    for (unsigned int i = 0; i < MAX_KMALLOC_CACHE_ORDER; i++) {
+    for (unsigned int i = 0; i < KMALLOC_NUM_CLASSES; i++) {
+        // Align each class to the largest power of two dividing its size.
         malloc_blocks[i] = kmem_cache_create(
-            "kmalloc",
-            1u << i,
-            1u << i,
+            kmalloc_names[i],
+            kmalloc_sizes[i],
+            kmalloc_sizes[i] & -kmalloc_sizes[i],
             GFP_KERNEL,
             NULL,
             NULL);
     }
+    // Build the table mapping the sizes to the caches.
+    for (unsigned int i = 0, class = 0; i < count_of(malloc_size_index); ++i) {
+        while (kmalloc_sizes[class] < i * KMALLOC_LOOKUP_STEP) {
+            ++class;
+        }
+        malloc_size_index[i] = class;
+    }
 }
 
 kmem_cache_t *kmem_cache_create(
@@ -211,6 +350,10 @@ kmem_cache_t *kmem_cache_create(
 
 void kmem_cache_destroy(kmem_cache_t *cachep)
 {
+    for (int cpu = 0; cpu < NR_CPUS; ++cpu) {
+        __kmem_magazine_flush(cachep, &cachep->magazine[cpu], KMEM_MAGAZINE_SIZE);
+    }
+
     while (!list_head_empty(&cachep->slabs_free)) {
         list_head *slab_list = list_head_pop(&cachep->slabs_free);
         __kmem_cache_free_slab(cachep, list_entry(slab_list, page_t, slabs));
@@ -230,12 +373,221 @@ void kmem_cache_destroy(kmem_cache_t *cachep)
     list_head_remove(&cachep->cache_list);
 }
 
-#ifdef ENABLE_CACHE_TRACE
-void *pr_kmem_cache_alloc(const char *file, const char *fun, int line, kmem_cache_t *cachep, gfp_t flags)
-#else
-void *kmem_cache_alloc(kmem_cache_t *cachep, gfp_t flags)
+void kmem_cache_for_each(void (*fn)(kmem_cache_t *cachep, void *data), void *data)
+{
+    list_for_each_decl(it, &kmem_caches_list)
+    {
+        fn(list_entry(it, kmem_cache_t, cache_list), data);
+    }
+}
+
+unsigned int kmem_cache_active_objects(kmem_cache_t *cachep)
+{
+    unsigned int active = cachep->total_num - cachep->free_num;
+    for (int cpu = 0; cpu < NR_CPUS; ++cpu) {
+        active -= cachep->magazine[cpu].count;
+    }
+    return active;
+}
+
+unsigned long kmem_cache_total_pages(void)
+{
+    return kmem_slab_pages;
+}
+
+unsigned long kmem_cache_reap(void)
+{
+    unsigned long freed = 0;
+    list_for_each_decl(it, &kmem_caches_list)
+    {
+        kmem_cache_t *cachep = list_entry(it, kmem_cache_t, cache_list);
+        for (int cpu = 0; cpu < NR_CPUS; ++cpu) {
+            __kmem_magazine_flush(cachep, &cachep->magazine[cpu], KMEM_MAGAZINE_SIZE);
+        }
+        while (!list_head_empty(&cachep->slabs_free)) {
+            list_head *slab_list = list_head_pop(&cachep->slabs_free);
+            __kmem_cache_free_slab(cachep, list_entry(slab_list, page_t, slabs));
+            freed += 1UL << cachep->gfp_order;
+        }
+    }
+    return freed;
+}
+
+#if defined(ENABLE_ALLOC_TRACE) || defined(ENABLE_CACHE_TRACE)
+
+/// Number of call sites the profiler tells apart, a power of two.
+#define ALLOC_SITE_SLOTS 1024
+/// Number of live objects the profiler follows, a power of two.
+#define ALLOC_OBJ_SLOTS 16384
+
+/// @brief A live object, and the call site which allocated it.
+typedef struct alloc_obj_t {
+    /// The object, NULL if the slot is empty.
+    void *ptr;
+    /// The size of the object.
+    unsigned int size;
+    /// The index of the call site inside alloc_sites.
+    unsigned int site;
+} alloc_obj_t;
+
+/// The call sites, an open addressing table keyed by file and line.
+static alloc_site_t alloc_sites[ALLOC_SITE_SLOTS];
+/// The live objects, an open addressing table keyed by address.
+static alloc_obj_t alloc_objs[ALLOC_OBJ_SLOTS];
+/// The allocations which did not fit the tables.
+static unsigned long alloc_dropped;
+
+/// @brief Hashes a word with Fibonacci hashing.
+/// @param key the word.
+/// @param slots the size of the table, a power of two.
+/// @return the first slot to probe.
+static inline unsigned int __alloc_hash(uint32_t key, unsigned int slots)
+{
+    return (key * 0x9E3779B1u) & (slots - 1);
+}
+
+/// @brief Finds the call site, adding it if it is new.
+/// @param file the file where the object is allocated.
+/// @param fun the function where the object is allocated.
+/// @param line the line inside the file.
+/// @return the index of the site, or -1 if the table is full.
+static int __alloc_site_find(const char *file, const char *fun, int line)
+{
+    // The names are string literals, thus comparing the pointers is enough.
+    unsigned int slot = __alloc_hash((uintptr_t)file ^ ((uint32_t)line << 16), ALLOC_SITE_SLOTS);
+    for (unsigned int probe = 0; probe < ALLOC_SITE_SLOTS; ++probe) {
+        alloc_site_t *site = &alloc_sites[slot];
+        if (site->file == NULL) {
+            site->file = file;
+            site->fun  = fun;
+            site->line = line;
+            return slot;
+        }
+        if ((site->file == file) && (site->line == line)) {
+            return slot;
+        }
+        slot = (slot + 1) & (ALLOC_SITE_SLOTS - 1);
+    }
+    return -1;
+}
+
+/// @brief Accounts a new object to the call site which allocated it.
+/// @param file the file where the object is allocated.
+/// @param fun the function where the object is allocated.
+/// @param line the line inside the file.
+/// @param ptr the object.
+/// @param size the size of the object.
+static void __alloc_site_charge(const char *file, const char *fun, int line, void *ptr, unsigned int size)
+{
+    if (ptr == NULL) {
+        return;
+    }
+    uint8_t flags = irq_disable();
+    int index     = __alloc_site_find(file, fun, line);
+    if (index < 0) {
+        ++alloc_dropped;
+        irq_enable(flags);
+        return;
+    }
+    // Remember the object, to find its call site when it is freed.
+    unsigned int slot = __alloc_hash((uintptr_t)ptr >> 3, ALLOC_OBJ_SLOTS);
+    for (unsigned int probe = 0; alloc_objs[slot].ptr != NULL; ++probe) {
+        if (probe == ALLOC_OBJ_SLOTS) {
+            ++alloc_dropped;
+            irq_enable(flags);
+            return;
+        }
+        slot = (slot + 1) & (ALLOC_OBJ_SLOTS - 1);
+    }
+    alloc_objs[slot] = (alloc_obj_t){ .ptr = ptr, .size = size, .site = index };
+    alloc_site_t *site = &alloc_sites[index];
+    site->live_bytes += size;
+    site->live_objects++;
+    site->allocs++;
+    site->peak_bytes = max(site->peak_bytes, site->live_bytes);
+    irq_enable(flags);
+}
+
+/// @brief Takes an object freed back from the call site which allocated it.
+/// @param ptr the object.
+static void __alloc_site_uncharge(void *ptr)
+{
+    if (ptr == NULL) {
+        return;
+    }
+    uint8_t flags     = irq_disable();
+    unsigned int slot = __alloc_hash((uintptr_t)ptr >> 3, ALLOC_OBJ_SLOTS);
+    for (unsigned int probe = 0; alloc_objs[slot].ptr != ptr; ++probe) {
+        // Objects which did not fit the table are not found.
+        if ((alloc_objs[slot].ptr == NULL) || (probe == ALLOC_OBJ_SLOTS)) {
+            irq_enable(flags);
+            return;
+        }
+        slot = (slot + 1) & (ALLOC_OBJ_SLOTS - 1);
+    }
+    alloc_site_t *site = &alloc_sites[alloc_objs[slot].site];
+    site->live_bytes -= alloc_objs[slot].size;
+    site->live_objects--;
+    // Shift back the objects which probed past the slot, so that the lookups
+    // still stop at the first empty slot.
+    for (unsigned int next = (slot + 1) & (ALLOC_OBJ_SLOTS - 1); alloc_objs[next].ptr != NULL;
+         next = (next + 1) & (ALLOC_OBJ_SLOTS - 1)) {
+        unsigned int home = __alloc_hash((uintptr_t)alloc_objs[next].ptr >> 3, ALLOC_OBJ_SLOTS);
+        // Leave the object if its home lies cyclically in (slot, next].
+        if ((slot < next) ? ((slot < home) && (home <= next)) : ((slot < home) || (home <= next))) {
+            continue;
+        }
+        alloc_objs[slot] = alloc_objs[next];
+        slot             = next;
+    }
+    alloc_objs[slot].ptr = NULL;
+    irq_enable(flags);
+}
+
+void alloc_site_for_each(void (*fn)(const alloc_site_t *site, void *data), void *data)
+{
+    for (unsigned int slot = 0; slot < ALLOC_SITE_SLOTS; ++slot) {
+        if (alloc_sites[slot].file != NULL) {
+            fn(&alloc_sites[slot], data);
+        }
+    }
+}
+
+unsigned long alloc_site_dropped(void)
+{
+    return alloc_dropped;
+}
+
+void alloc_site_reset(void)
+{
+    uint8_t flags = irq_disable();
+    for (unsigned int slot = 0; slot < ALLOC_SITE_SLOTS; ++slot) {
+        alloc_sites[slot].allocs     = 0;
+        alloc_sites[slot].peak_bytes = alloc_sites[slot].live_bytes;
+    }
+    alloc_dropped = 0;
+    irq_enable(flags);
+}
+
 #endif
+
+/// @brief Allocates an object from the cache, the magazine first.
+/// @param cachep the cache.
+/// @param flags the GFP flags used if the cache needs new slabs.
+/// @return the object, NULL on failure.
+static void *__kmem_cache_alloc(kmem_cache_t *cachep, gfp_t flags)
 {
+    // Take the most recently freed object, if there is one.
+    kmem_magazine_t *magazine = __kmem_cache_magazine(cachep);
+    if (magazine->count > 0) {
+        void *ptr = magazine->objects[--magazine->count];
+        cachep->alloc_count++;
+        if (cachep->ctor) {
+            cachep->ctor(ptr);
+        }
+        return ptr;
+    }
+
     if (list_head_empty(&cachep->slabs_partial)) {
         if (list_head_empty(&cachep->slabs_free)) {
             if (flags == 0) {
@@ -259,62 +611,64 @@ void *kmem_cache_alloc(kmem_cache_t *cachep, gfp_t flags)
 
     page_t *slab_page = list_entry(cachep->slabs_partial.next, page_t, slabs);
     void *ptr         = __kmem_cache_alloc_slab(cachep, slab_page);
+    if (ptr) {
+        cachep->alloc_count++;
+    }
 
     // If the slab is now full, add it to the full slabs list
     if (slab_page->slab_objfree == 0) {
         list_head *slab_full_elem = list_head_pop(&cachep->slabs_partial);
         list_head_insert_after(slab_full_elem, &cachep->slabs_full);
     }
-#ifdef ENABLE_CACHE_TRACE
-    pr_notice("CHACE-ALLOC 0x%p in %-20s at %s:%d\n", ptr, cachep->name, file, line);
-#endif
     return ptr;
 }
 
-#ifdef ENABLE_CACHE_TRACE
-void pr_kmem_cache_free(const char *file, const char *fun, int line, void *ptr)
-#else
-void kmem_cache_free(void *ptr)
-#endif
+/// @brief Frees an object into the magazine, which gives the oldest objects
+/// back to the slabs when full.
+/// @param ptr the object.
+static void __kmem_cache_free(void *ptr)
 {
-    page_t *slab_page = get_lowmem_page_from_address((uint32_t)ptr);
-
-    // If the slab main page is a lowmem page, change to it as it's the root page
-    if (is_lowmem_page_struct(slab_page->container.slab_main_page)) {
-        slab_page = slab_page->container.slab_main_page;
-    }
+    page_t *slab_page = __kmem_slab_page_of(ptr);
 
     kmem_cache_t *cachep = slab_page->container.slab_cache;
 
-#ifdef ENABLE_CACHE_TRACE
-    pr_notice("CHACE-FREE  0x%p in %-20s at %s:%d\n", ptr, cachep->name, file, line);
-#endif
     if (cachep->dtor) {
         cachep->dtor(ptr);
     }
+    cachep->free_count++;
 
-    kmem_obj *obj = KMEM_OBJ(cachep, ptr);
+    // Keep the object in the magazine, making room for it if needed.
+    kmem_magazine_t *magazine = __kmem_cache_magazine(cachep);
+    if (magazine->count >= kmem_magazine_limit) {
+        __kmem_magazine_flush(cachep, magazine, magazine->count - kmem_magazine_limit / 2);
+    }
+    magazine->objects[magazine->count++] = ptr;
+}
 
-    // Add object to the free list
-    list_head_insert_after(&obj->objlist, &slab_page->slab_freelist);
-    slab_page->slab_objfree++;
-    cachep->free_num++;
+#ifdef ENABLE_CACHE_TRACE
+void *pr_kmem_cache_alloc(const char *file, const char *fun, int line, kmem_cache_t *cachep, gfp_t flags)
+{
+    void *ptr = __kmem_cache_alloc(cachep, flags);
+    __alloc_site_charge(file, fun, line, ptr, cachep->object_size);
+    return ptr;
+}
 
-    // Now page is completely free
-    if (slab_page->slab_objfree == slab_page->slab_objcnt) {
-        // Remove page from partial list
-        list_head_remove(&slab_page->slabs);
-        // Add page to free list
-        list_head_insert_after(&slab_page->slabs, &cachep->slabs_free);
-    }
-    // Now page is not full, so change its list
-    else if (slab_page->slab_objfree == 1) {
-        // Remove page from full list
-        list_head_remove(&slab_page->slabs);
-        // Add page to partial list
-        list_head_insert_after(&slab_page->slabs, &cachep->slabs_partial);
-    }
+void pr_kmem_cache_free(const char *file, const char *fun, int line, void *ptr)
+{
+    __alloc_site_uncharge(ptr);
+    __kmem_cache_free(ptr);
 }
+#else
+void *kmem_cache_alloc(kmem_cache_t *cachep, gfp_t flags)
+{
+    return __kmem_cache_alloc(cachep, flags);
+}
+
+void kmem_cache_free(void *ptr)
+{
+    __kmem_cache_free(ptr);
+}
+#endif
 
 #ifdef ENABLE_ALLOC_TRACE
 void *pr_kmalloc(const char *file, const char *fun, int line, unsigned int size)
@@ -322,21 +676,21 @@ void *pr_kmalloc(const char *file, const char *fun, int line, unsigned int size)
 void *kmalloc(unsigned int size)
 #endif
 {
-    unsigned int order = 0;
-    while (size != 0) {
-        order++;
-        size /= 2;
-    }
-
-    // If size does not fit in the maximum cache order, allocate raw pages
+    // If size does not fit in the largest cache, allocate raw pages
     void *ptr;
-    if (order >= MAX_KMALLOC_CACHE_ORDER) {
-        ptr = (void *)__alloc_pages_lowmem(GFP_KERNEL, order - 12);
+    if (size > KMALLOC_MAX_CACHE_SIZE) {
+        unsigned int order = 0;
+        while ((PAGE_SIZE << order) < size) {
+            order++;
+        }
+        ptr = (void *)__alloc_pages_lowmem(GFP_KERNEL, order);
     } else {
-        ptr = kmem_cache_alloc(malloc_blocks[order], GFP_KERNEL);
+        unsigned int index = (size + KMALLOC_LOOKUP_STEP - 1) / KMALLOC_LOOKUP_STEP;
+        ptr = __kmem_cache_alloc(malloc_blocks[malloc_size_index[index]], GFP_KERNEL);
     }
+    trace_event(TRACE_KMALLOC, ptr, size, __builtin_return_address(0), 0);
 #ifdef ENABLE_ALLOC_TRACE
-    pr_notice("KMALLOC 0x%p at %s:%d\n", ptr, file, line);
+    __alloc_site_charge(file, fun, line, ptr, size);
 #endif
     return ptr;
 }
@@ -348,14 +702,15 @@ void kfree(void *ptr)
 #endif
 {
 #ifdef ENABLE_ALLOC_TRACE
-    pr_notice("KFREE   0x%p at %s:%d\n", ptr, file, line);
+    __alloc_site_uncharge(ptr);
 #endif
-    page_t *page = get_lowmem_page_from_address((uint32_t)ptr);
+    trace_event(TRACE_KFREE, ptr, __builtin_return_address(0), 0, 0);
+    page_t *page = get_lowmem_page_from_address((uintptr_t)ptr);
 
     // If the address is part of the cache
     if (page->container.slab_main_page) {
-        kmem_cache_free(ptr);
+        __kmem_cache_free(ptr);
     } else {
-        free_pages_lowmem((uint32_t)ptr);
+        free_pages_lowmem((uintptr_t)ptr);
     }
 }
@@ -0,0 +1,272 @@
+/// @file swap.c
+/// @brief Swapping of the anonymous pages of the processes to a swap area.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+// Setup the logging for this file (do this before any other include).
+#include "sys/kernel_levels.h"           // Include kernel log levels.
+#define __DEBUG_HEADER__ "[SWAP  ]"      ///< Change header.
+#define __DEBUG_LEVEL__  LOGLEVEL_NOTICE ///< Set log level.
+#include "io/debug.h"                    // Include debugging functions.
+
+#include "mem/swap.h"
+
+#include "fcntl.h"
+#include "fs/vfs.h"
+#include "math.h"
+#include "mem/slab.h"
+#include "mem/vmem_map.h"
+#include "process/scheduler.h"
+#include "string.h"
+#include "sys/errno.h"
+#include "sys/swap.h"
+
+/// The signature at the end of the header, written by `mkswap`.
+#define SWAP_MAGIC "SWAPSPACE2"
+/// The length of the signature.
+#define SWAP_MAGIC_LEN 10
+/// The only version of the header we know.
+#define SWAP_VERSION 1
+/// The entries keep the slot where the frame is, slots must fit in 20 bits.
+#define SWAP_MAX_SLOTS ((1U << 20) - 1)
+/// The references of a slot which is never used (the header, bad blocks).
+#define SWAP_MAP_BAD 0xFFFFU
+/// The highest number of references of a slot.
+#define SWAP_MAP_MAX 0xFFFEU
+
+/// @brief The header of a swap area, inside its first page.
+typedef struct swap_header_t {
+    char bootbits[1024];   ///< Space for a boot loader.
+    uint32_t version;      ///< The version of the header.
+    uint32_t last_page;    ///< The last page of the area.
+    uint32_t nr_badpages;  ///< The number of bad pages.
+    uint8_t uuid[16];      ///< The identifier of the area.
+    char volume_name[16];  ///< The label of the area.
+    uint32_t padding[117]; ///< Unused.
+    uint32_t badpages[1];  ///< The bad pages, followed by the others.
+} swap_header_t;
+
+/// @brief The swap area.
+static struct {
+    /// The device or the file, NULL if there is no swap area.
+    vfs_file_t *file;
+    /// The device and the inode of the area, to recognize it on swapoff.
+    dev_t dev;
+    /// The inode of the area.
+    ino_t ino;
+    /// The references to each slot, 0 if the slot is free.
+    uint16_t *map;
+    /// The number of slots, including the header.
+    uint32_t slots;
+    /// The number of slots in use.
+    uint32_t used;
+    /// Where the search for a free slot starts, so that pages swapped out
+    /// together end up close to each other.
+    uint32_t next;
+    /// Set while the area is being emptied by swapoff.
+    bool_t closing;
+} swap_area;
+
+int swap_available(void)
+{
+    return swap_area.file && !swap_area.closing && (swap_area.used < swap_area.slots);
+}
+
+/// @brief Takes a free slot.
+/// @return the slot, 0 if the swap is full.
+static uint32_t __swap_alloc_slot(void)
+{
+    for (uint32_t i = 0; i < swap_area.slots; ++i) {
+        uint32_t slot = swap_area.next;
+        if (++swap_area.next == swap_area.slots) {
+            swap_area.next = 1;
+        }
+        if (swap_area.map[slot] == 0) {
+            swap_area.map[slot] = 1;
+            ++swap_area.used;
+            return slot;
+        }
+    }
+    return 0;
+}
+
+int swap_store(page_t *page)
+{
+    if (!swap_available()) {
+        return -ENOSPC;
+    }
+    uint32_t slot = __swap_alloc_slot();
+    if (slot == 0) {
+        return -ENOSPC;
+    }
+    uint32_t vaddr  = virt_kmap(page);
+    ssize_t written = vfs_write(swap_area.file, (void *)vaddr, slot * PAGE_SIZE, PAGE_SIZE);
+    virt_kunmap(vaddr);
+    if (written != PAGE_SIZE) {
+        pr_err("Failed to write slot %u (%d).\n", slot, written);
+        swap_put(slot);
+        return -EIO;
+    }
+    return (int)slot;
+}
+
+int swap_load(uint32_t slot, page_t *page)
+{
+    if (!swap_area.file || (slot == 0) || (slot >= swap_area.slots) || !swap_area.map[slot]) {
+        pr_err("Reading slot %u, which is not in use.\n", slot);
+        return -EIO;
+    }
+    uint32_t vaddr = virt_kmap(page);
+    ssize_t read   = vfs_read(swap_area.file, (void *)vaddr, slot * PAGE_SIZE, PAGE_SIZE);
+    virt_kunmap(vaddr);
+    if (read != PAGE_SIZE) {
+        pr_err("Failed to read slot %u (%d).\n", slot, read);
+        return -EIO;
+    }
+    return 0;
+}
+
+int swap_get(uint32_t slot)
+{
+    if (swap_area.map[slot] >= SWAP_MAP_MAX) {
+        return -ENOMEM;
+    }
+    ++swap_area.map[slot];
+    return 0;
+}
+
+void swap_put(uint32_t slot)
+{
+    if ((slot == 0) || (slot >= swap_area.slots) || (swap_area.map[slot] == 0) || (swap_area.map[slot] == SWAP_MAP_BAD)) {
+        pr_err("Freeing slot %u, which is not in use.\n", slot);
+        return;
+    }
+    if (--swap_area.map[slot] == 0) {
+        --swap_area.used;
+    }
+}
+
+/// @brief Reads and checks the header of a swap area.
+/// @param file the area.
+/// @param size the size of the area, 0 if unknown.
+/// @return 0 on success, -errno on failure.
+static int __swap_read_header(vfs_file_t *file, uint32_t size)
+{
+    swap_header_t *header = kmalloc(PAGE_SIZE);
+    if (header == NULL) {
+        return -ENOMEM;
+    }
+    int ret = 0;
+    if (vfs_read(file, header, 0, PAGE_SIZE) != PAGE_SIZE) {
+        ret = -EIO;
+        goto free_header;
+    }
+    if (memcmp((char *)header + PAGE_SIZE - SWAP_MAGIC_LEN, SWAP_MAGIC, SWAP_MAGIC_LEN) ||
+        (header->version != SWAP_VERSION)) {
+        pr_err("The area was not prepared with mkswap.\n");
+        ret = -EINVAL;
+        goto free_header;
+    }
+    // The area might be larger than what mkswap was told to use.
+    swap_area.slots = min(header->last_page + 1, SWAP_MAX_SLOTS);
+    if (size) {
+        swap_area.slots = min(swap_area.slots, size / PAGE_SIZE);
+    }
+    if (swap_area.slots < 2) {
+        ret = -EINVAL;
+        goto free_header;
+    }
+    swap_area.map = kmalloc(swap_area.slots * sizeof(uint16_t));
+    if (swap_area.map == NULL) {
+        ret = -ENOMEM;
+        goto free_header;
+    }
+    memset(swap_area.map, 0, swap_area.slots * sizeof(uint16_t));
+    // The header is never used as a slot.
+    swap_area.map[0] = SWAP_MAP_BAD;
+    swap_area.used   = 1;
+    // The list of bad pages ends before the signature.
+    uint32_t max_badpages = (PAGE_SIZE - SWAP_MAGIC_LEN - offsetof(swap_header_t, badpages)) / sizeof(uint32_t);
+    for (uint32_t i = 0; i < min(header->nr_badpages, max_badpages); ++i) {
+        if ((header->badpages[i] > 0) && (header->badpages[i] < swap_area.slots)) {
+            swap_area.map[header->badpages[i]] = SWAP_MAP_BAD;
+            ++swap_area.used;
+        }
+    }
+free_header:
+    kfree(header);
+    return ret;
+}
+
+int sys_swapon(const char *path, int swapflags)
+{
+    (void)swapflags;
+    // Only the superuser can choose where the memory of the others goes.
+    task_struct *task = scheduler_get_current_process();
+    if (task && (task->uid != 0)) {
+        return -EPERM;
+    }
+    if (path == NULL) {
+        return -EFAULT;
+    }
+    if (swap_area.file) {
+        return -EBUSY;
+    }
+    vfs_file_t *file = vfs_open(path, O_RDWR, 0);
+    if (file == NULL) {
+        return -errno;
+    }
+    stat_t stat;
+    int ret = vfs_fstat(file, &stat);
+    if (ret < 0) {
+        goto close_file;
+    }
+    // Both block devices and regular files can hold a swap area.
+    if (((stat.st_mode & 0170000) != 0060000) && ((stat.st_mode & 0170000) != 0100000)) {
+        ret = -EINVAL;
+        goto close_file;
+    }
+    if ((ret = __swap_read_header(file, stat.st_size)) < 0) {
+        goto close_file;
+    }
+    swap_area.file    = file;
+    swap_area.dev     = stat.st_dev;
+    swap_area.ino     = stat.st_ino;
+    swap_area.next    = 1;
+    swap_area.closing = false;
+    pr_notice("Swapping to `%s`, %u KB.\n", path, (swap_area.slots - 1) * (PAGE_SIZE / 1024));
+    return 0;
+close_file:
+    vfs_close(file);
+    return ret;
+}
+
+int sys_swapoff(const char *path)
+{
+    task_struct *task = scheduler_get_current_process();
+    if (task && (task->uid != 0)) {
+        return -EPERM;
+    }
+    if (path == NULL) {
+        return -EFAULT;
+    }
+    stat_t stat;
+    int ret = vfs_stat(path, &stat);
+    if (ret < 0) {
+        return ret;
+    }
+    if (!swap_area.file || (stat.st_dev != swap_area.dev) || (stat.st_ino != swap_area.ino)) {
+        return -EINVAL;
+    }
+    // Nothing goes to the swap anymore, bring back what is there.
+    swap_area.closing = true;
+    if ((ret = mem_swap_in_all()) < 0) {
+        swap_area.closing = false;
+        return ret;
+    }
+    vfs_close(swap_area.file);
+    kfree(swap_area.map);
+    memset(&swap_area, 0, sizeof(swap_area));
+    pr_notice("Stopped swapping to `%s`.\n", path);
+    return 0;
+}
@@ -28,6 +28,23 @@ static virt_map_page_manager_t virt_default_mapping;
 /// Array of virtual pages.
 virt_map_page_t virt_pages[VIRTUAL_MEMORY_PAGES_COUNT];
 
+/// Number of slots used to temporarily map single pages.
+#define KMAP_SLOTS 16
+
+/// The virtual pages of the kmap slots.
+static virt_map_page_t *kmap_pages;
+/// The page table entries of the kmap slots.
+static page_table_entry_t *kmap_entries[KMAP_SLOTS];
+/// The slots in use, one bit each.
+static uint32_t kmap_used;
+
+static virt_map_page_t *_alloc_virt_pages(uint32_t pfn_count)
+{
+    unsigned order         = find_nearest_order_greater(0, pfn_count << 12);
+    virt_map_page_t *vpage = PG_FROM_BBSTRUCT(bb_alloc_pages(&virt_default_mapping.bb_instance, order), virt_map_page_t, bbpage);
+    return vpage;
+}
+
 void virt_init(void)
 {
     buddy_system_init(
@@ -72,17 +89,23 @@ void virt_init(void)
             table->pages[j].user    = 0;
         }
 
-        page_t *table_page = get_lowmem_page_from_address((uint32_t)table);
+        page_t *table_page = get_lowmem_page_from_address((uintptr_t)table);
         uint32_t phy_addr  = get_physical_address_from_page(table_page);
         entry->frame       = phy_addr >> 12u;
     }
-}
 
-static virt_map_page_t *_alloc_virt_pages(uint32_t pfn_count)
-{
-    unsigned order         = find_nearest_order_greater(0, pfn_count << 12);
-    virt_map_page_t *vpage = PG_FROM_BBSTRUCT(bb_alloc_pages(&virt_default_mapping.bb_instance, order), virt_map_page_t, bbpage);
-    return vpage;
+    // Reserve the kmap slots, and keep track of their page table entries.
+    kmap_pages = _alloc_virt_pages(KMAP_SLOTS);
+    if (!kmap_pages) {
+        kernel_panic("Cannot reserve the kmap slots!");
+    }
+    for (uint32_t slot = 0; slot < KMAP_SLOTS; ++slot) {
+        uint32_t vpfn       = (VIRT_PAGE_TO_ADDRESS(kmap_pages) / PAGE_SIZE) + slot;
+        page_t *table_page  = get_page_from_physical_address(mainpgd->entries[vpfn / 1024].frame << 12u);
+        page_table_t *table = (page_table_t *)get_lowmem_address_from_page(table_page);
+        kmap_entries[slot]  = &table->pages[vpfn % 1024];
+    }
+    kmap_used = 0;
 }
 
 uint32_t virt_map_physical_pages(page_t *page, int pfn_count)
@@ -100,6 +123,105 @@ uint32_t virt_map_physical_pages(page_t *page, int pfn_count)
     return virt_address;
 }
 
+uint32_t virt_map_io(uint32_t phy_address, int pfn_count)
+{
+    virt_map_page_t *vpage = _alloc_virt_pages(pfn_count);
+    if (!vpage) {
+        return 0;
+    }
+
+    uint32_t virt_address = VIRT_PAGE_TO_ADDRESS(vpage);
+
+    mem_upd_vm_area(paging_get_main_directory(), virt_address, phy_address & ~(PAGE_SIZE - 1),
+                    pfn_count * PAGE_SIZE, MM_PRESENT | MM_RW | MM_GLOBAL | MM_UPDADDR);
+    return virt_address + (phy_address & (PAGE_SIZE - 1));
+}
+
+/// @brief Maps a page on a kmap slot.
+/// @param slot The slot.
+/// @param page The page.
+/// @return The virtual address of the slot.
+static inline uint32_t __kmap_slot_set(uint32_t slot, page_t *page)
+{
+    uint32_t addr             = VIRT_PAGE_TO_ADDRESS(kmap_pages) + slot * PAGE_SIZE;
+    uint32_t frame            = get_physical_address_from_page(page) >> 12u;
+    page_table_entry_t *entry = kmap_entries[slot];
+    // A slot still mapping the same frame is reused as it is.
+    if (!entry->present || (entry->frame != frame)) {
+        entry->frame   = frame;
+        entry->rw      = 1;
+        entry->present = 1;
+        paging_flush_tlb_single(addr);
+    }
+    return addr;
+}
+
+/// @brief Returns the kmap slot of an address.
+/// @param addr The address.
+/// @return The slot, -1 if the address does not belong to a slot.
+static inline int __kmap_slot(uint32_t addr)
+{
+    uint32_t base = VIRT_PAGE_TO_ADDRESS(kmap_pages);
+    if ((addr >= base) && (addr < base + KMAP_SLOTS * PAGE_SIZE)) {
+        return (addr - base) / PAGE_SIZE;
+    }
+    return -1;
+}
+
+/// @brief Moves a mapping done with virt_kmap to another page.
+/// @param addr The virtual address of the mapping.
+/// @param page The new page.
+/// @return The virtual address of the new mapping.
+static inline uint32_t __kmap_move(uint32_t addr, page_t *page)
+{
+    int slot = __kmap_slot(addr);
+    if (slot >= 0) {
+        return __kmap_slot_set(slot, page);
+    }
+    virt_unmap(addr);
+    return virt_map_physical_pages(page, 1);
+}
+
+uint32_t virt_kmap(page_t *page)
+{
+    for (uint32_t slot = 0; slot < KMAP_SLOTS; ++slot) {
+        if (!(kmap_used & (1U << slot))) {
+            kmap_used |= (1U << slot);
+            return __kmap_slot_set(slot, page);
+        }
+    }
+    // All the slots are in use.
+    return virt_map_physical_pages(page, 1);
+}
+
+void virt_kunmap(uint32_t addr)
+{
+    int slot = __kmap_slot(addr);
+    if (slot >= 0) {
+        // The entry is left in place, and flushed only when the slot maps
+        // another page.
+        kmap_used &= ~(1U << slot);
+    } else {
+        virt_unmap(addr);
+    }
+}
+
+void virt_copy_pages(page_t *dst, page_t *src, uint32_t count)
+{
+    uint32_t dst_addr = virt_kmap(dst);
+    uint32_t src_addr = virt_kmap(src);
+    for (uint32_t i = 0; i < count; ++i) {
+        if (i > 0) {
+            // Keep the same slots, pointing them to the next pages.
+            dst_addr = __kmap_move(dst_addr, dst + i);
+            src_addr = __kmap_move(src_addr, src + i);
+        }
+        memcpy((void *)dst_addr, (void *)src_addr, PAGE_SIZE);
+    }
+    virt_kunmap(src_addr);
+    virt_kunmap(dst_addr);
+}
+
 virt_map_page_t *virt_map_alloc(uint32_t size)
 {
     uint32_t pages_count = (size + PAGE_SIZE - 1) / PAGE_SIZE;
@@ -13,10 +13,22 @@
 #include "kernel.h"
 #include "mem/buddysystem.h"
 #include "mem/paging.h"
+#include "mem/shrinker.h"
+#include "mem/vmem_map.h"
 #include "mem/zone_allocator.h"
 #include "string.h"
+#include "sys/errno.h"
 #include "sys/list_head.h"
 
+/// @brief Highest order for which the memory is compacted.
+#define COMPACT_MAX_ORDER 10
+/// @brief Number of blocks we try to evacuate before giving up.
+#define COMPACT_MAX_ATTEMPTS 8
+/// @brief The low watermark of a zone is its size divided by this.
+#define WATERMARK_LOW_RATIO 64
+/// @brief The high watermark of a zone is its size divided by this.
+#define WATERMARK_HIGH_RATIO 32
+
 /// TODO: Comment.
 #define MIN_PAGE_ALIGN(addr) ((addr) & (~(PAGE_SIZE - 1)))
 /// TODO: Comment.
@@ -32,6 +44,10 @@
 page_t *mem_map = NULL;
 /// Memory node.
 pg_data_t *contig_page_data = NULL;
+/// Number of pages above which a page frame cache is drained.
+unsigned int zone_pcp_high = PCP_HIGH;
+/// Number of pages moved at once between a page frame cache and the buddy system.
+unsigned int zone_pcp_batch = PCP_BATCH;
 /// Low memory virtual base address.
 uint32_t lowmem_virt_base = 0;
 /// Low memory base address.
@@ -83,12 +99,141 @@ static zone_t *get_zone_from_page(page_t *page)
     return (zone_t *)NULL;
 }
 
+/// @brief Returns the page frame cache of the current processor.
+/// @param zone The zone owning the cache.
+/// @return Pointer to the cache.
+static inline per_cpu_pages_t *__get_cpu_pages(zone_t *zone)
+{
+    // We only run on one processor.
+    return &zone->pageset[0];
+}
+
+/// @brief Moves up to count pages from the buddy system to the cache.
+/// @param zone The zone owning the cache.
+/// @param pcp  The cache.
+/// @param count The number of pages.
+/// @return The number of pages actually moved.
+static unsigned int __pcp_refill(zone_t *zone, per_cpu_pages_t *pcp, unsigned int count)
+{
+    unsigned int moved;
+    for (moved = 0; moved < count; ++moved) {
+        bb_page_t *bbpage = bb_alloc_pages(&zone->buddy_system, 0);
+        if (bbpage == NULL) {
+            break;
+        }
+        // Pages coming from the buddy system are cold, queue them at the tail.
+        list_head_insert_before(&bbpage->location.cache, &pcp->list);
+    }
+    pcp->count += moved;
+    zone->free_pages -= moved;
+    return moved;
+}
+
+/// @brief Gives back up to count pages from the cache to the buddy system,
+/// starting from the coldest ones.
+/// @param zone The zone owning the cache.
+/// @param pcp  The cache.
+/// @param count The number of pages.
+static void __pcp_drain(zone_t *zone, per_cpu_pages_t *pcp, unsigned int count)
+{
+    while (count-- && !list_head_empty(&pcp->list)) {
+        bb_page_t *bbpage = list_entry(pcp->list.prev, bb_page_t, location.cache);
+        list_head_remove(&bbpage->location.cache);
+        bb_free_pages(&zone->buddy_system, bbpage);
+        pcp->count--;
+        zone->free_pages++;
+    }
+}
+
+/// @brief Zeroes a page frame.
+/// @param zone The zone owning the page.
+/// @param page The page.
+/// @details Pages of the high memory are temporarily mapped. Whole words are
+/// stored with `rep stosl`, which is way faster than memset.
+static void __zero_page(zone_t *zone, page_t *page)
+{
+    int highmem    = zone == &contig_page_data->node_zones[ZONE_HIGHMEM];
+    uint32_t vaddr = highmem ? virt_kmap(page) : get_lowmem_address_from_page(page);
+    uint32_t count = PAGE_SIZE / sizeof(uint32_t);
+    __asm__ __volatile__("cld; rep stosl"
+                         : "+D"(vaddr), "+c"(count)
+                         : "a"(0)
+                         : "memory");
+    if (highmem) {
+        virt_kunmap(vaddr - PAGE_SIZE);
+    }
+}
+
+/// @brief Gives back all the zeroed pages of a zone to the buddy system.
+/// @param zone The zone.
+static void __zero_pool_drain(zone_t *zone)
+{
+    while (!list_head_empty(&zone->zeroed_list)) {
+        bb_page_t *bbpage = list_entry(zone->zeroed_list.next, bb_page_t, location.cache);
+        list_head_remove(&bbpage->location.cache);
+        bb_free_pages(&zone->buddy_system, bbpage);
+        zone->zeroed_count--;
+        zone->free_pages++;
+    }
+}
+
+/// @brief Tries to build a free block of the given order, by moving the pages
+/// of the processes out of a partially used block.
+/// @param zone  The zone.
+/// @param order The logarithm of the size of the block.
+/// @return 1 if a block has been freed, 0 otherwise.
+/// @details Only the pages of the processes can be moved, so only the high
+/// memory is compacted. Blocks are tried in order, skipping those holding
+/// shared pages, or which are more than half used.
+static int __zone_compact(zone_t *zone, unsigned int order)
+{
+    uint32_t block_size = 1UL << order;
+    unsigned int attempts = 0, used;
+    page_t *first;
+    if ((order == 0) || (order > COMPACT_MAX_ORDER) || (zone != &contig_page_data->node_zones[ZONE_HIGHMEM])) {
+        return 0;
+    }
+    // Give back the pages held by the caches, they might complete a block.
+    for (int cpu = 0; cpu < NR_CPUS; ++cpu) {
+        __pcp_drain(zone, &zone->pageset[cpu], zone->pageset[cpu].count);
+    }
+    __zero_pool_drain(zone);
+    if (zone->buddy_system.free_area[order].nr_free > 0) {
+        return 1;
+    }
+    for (uint32_t start = 0; (start + block_size) <= zone->size; start += block_size) {
+        first = zone->zone_mem_map + start;
+        used  = 0;
+        for (uint32_t i = 0; (i < block_size) && (used <= block_size / 2); ++i) {
+            int count = page_count(first + i);
+            // Shared pages cannot be moved.
+            if (count > 1) {
+                used = block_size;
+                break;
+            }
+            used += count;
+        }
+        if ((used == 0) || (used > block_size / 2)) {
+            continue;
+        }
+        if (mem_evacuate_pages(first, order) == 0) {
+            pr_debug("Compacted a block of 2^%u pages in zone %s (%u pages moved).\n", order, zone->name, used);
+            return 1;
+        }
+        if (++attempts == COMPACT_MAX_ATTEMPTS) {
+            break;
+        }
+    }
+    return 0;
+}
+
 /// @brief Get a zone from gfp_mask
 /// @param gfp_mask GFP_FLAG see gfp.h.
 /// @return The zone requested.
 static zone_t *get_zone_from_flags(gfp_t gfp_mask)
 {
-    switch (gfp_mask) {
+    // The action modifiers do not change the zone.
+    switch (gfp_mask & ~__GFP_ZERO) {
     case GFP_KERNEL:
     case GFP_ATOMIC:
     case GFP_NOFS:
@@ -107,6 +252,11 @@ static int is_memory_clean(gfp_t gfp_mask)
     // Get the corresponding zone.
     zone_t *zone = get_zone_from_flags(gfp_mask);
     assert(zone && "Failed to retrieve the zone given the gfp_mask!");
+    // Give back the pages held by the caches.
+    for (int cpu = 0; cpu < NR_CPUS; ++cpu) {
+        __pcp_drain(zone, &zone->pageset[cpu], zone->pageset[cpu].count);
+    }
+    __zero_pool_drain(zone);
     // Get the last free area list of the buddy system.
     bb_free_area_t *area = zone->buddy_system.free_area + (MAX_BUDDYSYSTEM_GFP_ORDER - 1);
     assert(area && "Failed to retrieve the last free_area for the given zone!");
@@ -189,10 +339,10 @@ static int pmm_check(void)
 
     int j = 0;
     for (; j < 5; ++j) {
-        free_page_lowmem((uint32_t)ptr[j]);
+        free_page_lowmem((uintptr_t)ptr[j]);
     }
     for (; j < 20; ++j) {
-        free_pages_lowmem((uint32_t)ptr[j]);
+        free_pages_lowmem((uintptr_t)ptr[j]);
     }
     free_page_lowmem(ptr1);
 
@@ -229,6 +379,19 @@ static void zone_init(char *name, int zone_index, uint32_t adr_from, uint32_t ad
     zone->zone_start_pfn = first_page_frame;
     // Set to zero all page structures.
     memset(zone->zone_mem_map, 0, zone->size * sizeof(page_t));
+    // Initialize the page frame caches.
+    for (int cpu = 0; cpu < NR_CPUS; ++cpu) {
+        zone->pageset[cpu].count = 0;
+        zone->pageset[cpu].high  = zone_pcp_high;
+        zone->pageset[cpu].batch = zone_pcp_batch;
+        list_head_init(&zone->pageset[cpu].list);
+    }
+    // Initialize the pool of zeroed pages.
+    zone->zeroed_count = 0;
+    list_head_init(&zone->zeroed_list);
+    // Keep some memory free, so that allocations rarely need direct reclaim.
+    zone->watermark_low  = num_page_frames / WATERMARK_LOW_RATIO;
+    zone->watermark_high = num_page_frames / WATERMARK_HIGH_RATIO;
     // Initialize the buddy system for the new zone.
     buddy_system_init(&zone->buddy_system,
                       name,
@@ -245,6 +408,26 @@ static void zone_init(char *name, int zone_index, uint32_t adr_from, uint32_t ad
  *
  * */
 
+/// @brief Computes the RAM the kernel does not manage: the one above 4 GB,
+/// which needs PAE, the one beyond the first hole of the memory map, and the
+/// one cut to fit the highmem into blocks of the buddy system.
+/// @param header the multiboot information.
+/// @param managed_end the end of the memory managed by the zones.
+/// @return the unmanaged RAM, in MB.
+static uint32_t __unmanaged_memory_mb(multiboot_info_t *header, uint32_t managed_end)
+{
+    unsigned long long unmanaged = 0, base, end;
+    for (multiboot_memory_map_t *entry = mmap_first_entry_of_type(header, MULTIBOOT_MEMORY_AVAILABLE); entry;
+         entry = mmap_next_entry_of_type(header, entry, MULTIBOOT_MEMORY_AVAILABLE)) {
+        base = ((unsigned long long)entry->base_addr_high << 32) | entry->base_addr_low;
+        end  = base + (((unsigned long long)entry->length_high << 32) | entry->length_low);
+        if (end > managed_end) {
+            unmanaged += end - ((base > managed_end) ? base : managed_end);
+        }
+    }
+    return (uint32_t)(unmanaged >> 20);
+}
+
 unsigned int find_nearest_order_greater(uint32_t base_addr, uint32_t amount)
 {
     uint32_t start_pfn = base_addr / PAGE_SIZE;
@@ -337,6 +520,13 @@ int pmmngr_init(boot_info_t *boot_info)
     zone_init("Normal", ZONE_NORMAL, normal_start_addr, normal_end_addr);
     zone_init("HighMem", ZONE_HIGHMEM, high_start_addr, high_end_addr);
 
+    pr_notice("Memory: %u MB lowmem, %u MB highmem, memory map of %u KB.\n",
+              normal_size >> 20, high_size >> 20, (sizeof(page_t) * mem_num_frames) >> 10);
+    uint32_t unmanaged = __unmanaged_memory_mb(boot_info->multiboot_header, high_end_addr);
+    if (unmanaged) {
+        pr_warning("Ignoring %u MB of RAM, above 4 GB, past a hole, or unaligned.\n", unmanaged);
+    }
+
     pr_debug("Memory addresses:\n");
     pr_debug("    LowMem  (phy): 0x%p to 0x%p\n", boot_info->lowmem_phy_start, boot_info->lowmem_phy_end);
     pr_debug("    HighMem (phy): 0x%p to 0x%p\n", boot_info->highmem_phy_start, boot_info->highmem_phy_end);
@@ -359,13 +549,71 @@ int pmmngr_init(boot_info_t *boot_info)
 page_t *alloc_page_cached(gfp_t gfp_mask)
 {
     zone_t *zone = get_zone_from_flags(gfp_mask);
-    return PG_FROM_BBSTRUCT(bb_alloc_page_cached(&zone->buddy_system), page_t, bbpage);
+    assert(zone && "Failed to retrieve the zone given the gfp_mask!");
+    per_cpu_pages_t *pcp = __get_cpu_pages(zone);
+    // When the cache is empty, refill it with a whole batch.
+    if (list_head_empty(&pcp->list) && (__pcp_refill(zone, pcp, pcp->batch) == 0)) {
+        // Ask the caches to give back some memory, if the caller can wait.
+        if (!(gfp_mask & __GFP_DIRECT_RECLAIM) || !shrink_caches(zone, pcp->batch) ||
+            (__pcp_refill(zone, pcp, pcp->batch) == 0)) {
+            pr_emerg("Cannot allocate a page from zone %s.\n", zone->name);
+            return NULL;
+        }
+    }
+    if (zone->free_pages < zone->watermark_low) {
+        kswapd_wakeup(gfp_mask);
+    }
+    // Take the hottest page.
+    bb_page_t *bbpage = list_entry(pcp->list.next, bb_page_t, location.cache);
+    list_head_remove(&bbpage->location.cache);
+    pcp->count--;
+    return PG_FROM_BBSTRUCT(bbpage, page_t, bbpage);
 }
 
 void free_page_cached(page_t *page)
 {
     zone_t *zone = get_zone_from_page(page);
-    bb_free_page_cached(&zone->buddy_system, &page->bbpage);
+    assert(zone && "Page is over memory size.");
+    per_cpu_pages_t *pcp = __get_cpu_pages(zone);
+    // The page was just used, keep it at the head.
+    list_head_insert_after(&page->bbpage.location.cache, &pcp->list);
+    pcp->count++;
+    // Above the high watermark, give back a whole batch.
+    if (pcp->count > pcp->high) {
+        __pcp_drain(zone, pcp, pcp->batch);
+    }
+}
+
+int zone_set_pcp_watermarks(unsigned int high, unsigned int batch)
+{
+    if ((batch == 0) || (batch > high)) {
+        return -EINVAL;
+    }
+    zone_pcp_high  = high;
+    zone_pcp_batch = batch;
+    for (int zone_index = 0; zone_index < __MAX_NR_ZONES; ++zone_index) {
+        zone_t *zone = &contig_page_data->node_zones[zone_index];
+        for (int cpu = 0; cpu < NR_CPUS; ++cpu) {
+            zone->pageset[cpu].high  = high;
+            zone->pageset[cpu].batch = batch;
+        }
+    }
+    return 0;
+}
+
+void zone_refill_zeroed_pages(void)
+{
+    zone_t *zone = &contig_page_data->node_zones[ZONE_HIGHMEM];
+    for (unsigned int i = 0; (i < ZERO_POOL_BATCH) && (zone->zeroed_count < ZERO_POOL_HIGH); ++i) {
+        bb_page_t *bbpage = bb_alloc_pages(&zone->buddy_system, 0);
+        if (bbpage == NULL) {
+            break;
+        }
+        zone->free_pages--;
+        __zero_page(zone, PG_FROM_BBSTRUCT(bbpage, page_t, bbpage));
+        list_head_insert_before(&bbpage->location.cache, &zone->zeroed_list);
+        zone->zeroed_count++;
+    }
 }
 
 uint32_t __alloc_page_lowmem(gfp_t gfp_mask)
@@ -405,19 +653,53 @@ page_t *_alloc_pages(gfp_t gfp_mask, uint32_t order)
     zone_t *zone = get_zone_from_flags(gfp_mask);
     page_t *page = NULL;
 
+    // Single zeroed pages come from the pool, when there are some ready.
+    if ((gfp_mask & __GFP_ZERO) && (order == 0) && !list_head_empty(&zone->zeroed_list)) {
+        bb_page_t *zeroed = list_entry(zone->zeroed_list.next, bb_page_t, location.cache);
+        list_head_remove(&zeroed->location.cache);
+        zone->zeroed_count--;
+        page = PG_FROM_BBSTRUCT(zeroed, page_t, bbpage);
+        set_page_count(page, 1);
+        return page;
+    }
+
     // Search for a block of page frames by using the BuddySystem.
-    page = PG_FROM_BBSTRUCT(bb_alloc_pages(&zone->buddy_system, order), page_t, bbpage);
+    bb_page_t *bbpage = bb_alloc_pages(&zone->buddy_system, order);
+
+    // The memory might be there, but too fragmented, try to compact it.
+    if ((bbpage == NULL) && __zone_compact(zone, order)) {
+        bbpage = bb_alloc_pages(&zone->buddy_system, order);
+    }
+    // The last free pages might be waiting inside the pool of zeroed pages.
+    if ((bbpage == NULL) && (zone->zeroed_count > 0)) {
+        __zero_pool_drain(zone);
+        bbpage = bb_alloc_pages(&zone->buddy_system, order);
+    }
+    // Ask the caches to give back some memory, if the caller can wait.
+    if ((bbpage == NULL) && (gfp_mask & __GFP_DIRECT_RECLAIM) && shrink_caches(zone, block_size)) {
+        bbpage = bb_alloc_pages(&zone->buddy_system, order);
+        if ((bbpage == NULL) && __zone_compact(zone, order)) {
+            bbpage = bb_alloc_pages(&zone->buddy_system, order);
+        }
+    }
+    if (bbpage == NULL) {
+        pr_emerg("Cannot allocate 2^%u pages from zone %s.\n", order, zone->name);
+        return NULL;
+    }
+    page = PG_FROM_BBSTRUCT(bbpage, page_t, bbpage);
 
     // Set page counters
     for (int i = 0; i < block_size; i++) {
         set_page_count(&page[i], 1);
+        if (gfp_mask & __GFP_ZERO) {
+            __zero_page(zone, &page[i]);
+        }
     }
 
-    assert(page && "Cannot allocate pages.");
-
     // Decrement the number of pages in the zone.
-    if (page) {
-        zone->free_pages -= block_size;
+    zone->free_pages -= block_size;
+    if (zone->free_pages < zone->watermark_low) {
+        kswapd_wakeup(gfp_mask);
     }
 
 #if 0
@@ -426,6 +708,46 @@ page_t *_alloc_pages(gfp_t gfp_mask, uint32_t order)
     return page;
 }
 
+unsigned int alloc_pages_bulk(gfp_t gfp_mask, unsigned int nr_pages, list_head *pages)
+{
+    zone_t *zone = get_zone_from_flags(gfp_mask);
+    assert(zone && "Failed to retrieve the zone given the gfp_mask!");
+    unsigned int allocated = 0, taken = 0;
+    page_t *page;
+    while (allocated < nr_pages) {
+        bb_page_t *bbpage = NULL;
+        // Zeroed pages come from the pool first, they need no work.
+        if ((gfp_mask & __GFP_ZERO) && !list_head_empty(&zone->zeroed_list)) {
+            bbpage = list_entry(zone->zeroed_list.next, bb_page_t, location.cache);
+            list_head_remove(&bbpage->location.cache);
+            zone->zeroed_count--;
+            page = PG_FROM_BBSTRUCT(bbpage, page_t, bbpage);
+        } else if ((bbpage = bb_alloc_pages(&zone->buddy_system, 0)) != NULL) {
+            page = PG_FROM_BBSTRUCT(bbpage, page_t, bbpage);
+            if (gfp_mask & __GFP_ZERO) {
+                __zero_page(zone, page);
+            }
+            ++taken;
+        } else {
+            // The buddy system is empty, let the allocator reclaim some memory.
+            zone->free_pages -= taken;
+            taken = 0;
+            if ((page = _alloc_pages(gfp_mask, 0)) == NULL) {
+                break;
+            }
+        }
+        set_page_count(page, 1);
+        list_head_insert_before(&page->bbpage.location.cache, pages);
+        ++allocated;
+    }
+    // The pages taken from the buddy system are accounted at once.
+    zone->free_pages -= taken;
+    if (zone->free_pages < zone->watermark_low) {
+        kswapd_wakeup(gfp_mask);
+    }
+    return allocated;
+}
+
 void free_pages_lowmem(uint32_t addr)
 {
     page_t *page = get_lowmem_page_from_address(addr);
@@ -456,6 +778,36 @@ void __free_pages(page_t *page)
     //buddy_system_dump(&zone->buddy_system);
 }
 
+void free_page_list(list_head *pages)
+{
+    zone_t *zone        = NULL;
+    unsigned long freed = 0;
+    list_for_each_safe_decl(it, store, pages)
+    {
+        page_t *page = list_entry(it, page_t, bbpage.location.cache);
+        list_head_remove(it);
+        // The counters of a zone are updated once for all its pages.
+        zone_t *page_zone = get_zone_from_page(page);
+        assert(page_zone && "Page is over memory size.");
+        if (page_zone != zone) {
+            if (zone) {
+                zone->free_pages += freed;
+            }
+            zone  = page_zone;
+            freed = 0;
+        }
+        uint32_t block_size = 1UL << page->bbpage.order;
+        for (int i = 0; i < block_size; i++) {
+            set_page_count(&page[i], 0);
+        }
+        bb_free_pages(&zone->buddy_system, &page->bbpage);
+        freed += block_size;
+    }
+    if (zone) {
+        zone->free_pages += freed;
+    }
+}
+
 unsigned long get_zone_total_space(gfp_t gfp_mask)
 {
     zone_t *zone = get_zone_from_flags(gfp_mask);
@@ -467,12 +819,48 @@ unsigned long get_zone_free_space(gfp_t gfp_mask)
 {
     zone_t *zone = get_zone_from_flags(gfp_mask);
     assert(zone && "Cannot retrieve the correct zone.");
-    return buddy_system_get_free_space(&zone->buddy_system);
+    // The zone keeps track of the pages held by the buddy system.
+    return zone->free_pages * PAGE_SIZE;
 }
 
 unsigned long get_zone_cached_space(gfp_t gfp_mask)
 {
     zone_t *zone = get_zone_from_flags(gfp_mask);
     assert(zone && "Cannot retrieve the correct zone.");
-    return buddy_system_get_cached_space(&zone->buddy_system);
+    unsigned long cached = 0;
+    for (int cpu = 0; cpu < NR_CPUS; ++cpu) {
+        cached += zone->pageset[cpu].count;
+    }
+    cached += zone->zeroed_count;
+    return cached * PAGE_SIZE;
+}
+
+unsigned long get_zone_free_blocks(gfp_t gfp_mask, unsigned int order)
+{
+    zone_t *zone = get_zone_from_flags(gfp_mask);
+    assert(zone && "Cannot retrieve the correct zone.");
+    assert((order < MAX_BUDDYSYSTEM_GFP_ORDER) && "The order is too large.");
+    return zone->buddy_system.free_area[order].nr_free;
+}
+
+int get_zone_fragmentation_index(gfp_t gfp_mask, unsigned int order)
+{
+    zone_t *zone = get_zone_from_flags(gfp_mask);
+    assert(zone && "Cannot retrieve the correct zone.");
+    unsigned long free_blocks = 0, free_pages = 0;
+    for (unsigned int o = 0; o < MAX_BUDDYSYSTEM_GFP_ORDER; ++o) {
+        unsigned long nr_free = zone->buddy_system.free_area[o].nr_free;
+        // The allocation would succeed.
+        if ((o >= order) && nr_free) {
+            return -1000;
+        }
+        free_blocks += nr_free;
+        free_pages += nr_free << o;
+    }
+    // There is no free memory at all.
+    if (free_blocks == 0) {
+        return 0;
+    }
+    // Close to 0 when the memory is lacking, to 1000 when it is fragmented.
+    return 1000 - (1000 + (free_pages * 1000) / (1UL << order)) / free_blocks;
 }
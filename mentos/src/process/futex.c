@@ -0,0 +1,266 @@
+/// @file futex.c
+/// @brief Fast userspace locks, which enter the kernel only to sleep.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// The processes share the kernel stack, thus they cannot sleep inside
+/// sys_futex: a waiter is queued, and the process is put to sleep when it
+/// returns from the system call. Whoever wakes it up, or its timer, stores
+/// the value it returns.
+
+// Setup the logging for this file (do this before any other include).
+#include "sys/kernel_levels.h"           // Include kernel log levels.
+#define __DEBUG_HEADER__ "[FUTEX ]"      ///< Change header.
+#define __DEBUG_LEVEL__  LOGLEVEL_NOTICE ///< Set log level.
+#include "io/debug.h"                    // Include debugging functions.
+
+#include "assert.h"
+#include "hardware/hrtimer.h"
+#include "klib/spinlock.h"
+#include "mem/kheap.h"
+#include "mem/paging.h"
+#include "mem/zone_allocator.h"
+#include "process/scheduler.h"
+#include "process/wait.h"
+#include "sys/errno.h"
+#include "sys/futex.h"
+#include "sys/list_head.h"
+
+/// The number of buckets of the table of the waiters, a power of two.
+#define FUTEX_BUCKETS 64
+
+/// @brief A process sleeping on a futex.
+typedef struct futex_waiter_t {
+    /// The process.
+    task_struct *task;
+    /// The physical address of the futex.
+    uint32_t key;
+    /// Wakes up the process when its time expires.
+    hrtimer_t timer;
+    /// Reference inside the bucket.
+    list_head list;
+} futex_waiter_t;
+
+/// @brief The waiters whose futexes have the same hash.
+typedef struct futex_bucket_t {
+    /// The waiters, in the order they went to sleep.
+    list_head waiters;
+    /// Protects the waiters.
+    spinlock_t lock;
+} futex_bucket_t;
+
+/// The table of the waiters.
+static futex_bucket_t futex_buckets[FUTEX_BUCKETS];
+
+/// @brief Returns the bucket of a futex.
+/// @param key the physical address of the futex.
+/// @return the bucket.
+static inline futex_bucket_t *__futex_bucket(uint32_t key)
+{
+    // The futexes are aligned ints, drop the bits which are always zero.
+    return &futex_buckets[(key >> 2) & (FUTEX_BUCKETS - 1)];
+}
+
+/// @brief Computes the key of a futex of the calling process.
+/// @param uaddr the futex.
+/// @param key where the physical address of the futex is stored.
+/// @return 0 on success, -EINVAL if the futex is not aligned, -EFAULT if it
+/// is not mapped.
+static inline int __futex_key(int *uaddr, uint32_t *key)
+{
+    task_struct *task = scheduler_get_current_process();
+    size_t size       = sizeof(int);
+    if ((uintptr_t)uaddr & (sizeof(int) - 1)) {
+        return -EINVAL;
+    }
+    page_t *page = mem_virtual_to_page(task->mm->pgd, (uintptr_t)uaddr, &size);
+    if (page == NULL) {
+        return -EFAULT;
+    }
+    *key = get_physical_address_from_page(page) + ((uintptr_t)uaddr & (PAGE_SIZE - 1));
+    return 0;
+}
+
+/// @brief Removes a waiter, and wakes up its process.
+/// @param waiter the waiter, whose bucket is locked.
+/// @param ret the value returned by sys_futex to the process.
+static inline void __futex_wake_waiter(futex_waiter_t *waiter, int ret)
+{
+    list_head_remove(&waiter->list);
+    // The process returns from sys_futex with the result.
+    waiter->task->thread.regs.eax = ret;
+    scheduler_set_task_state(waiter->task, TASK_RUNNING);
+    kfree(waiter);
+}
+
+/// @brief Wakes up a waiter whose time expired.
+/// @param timer the timer of the waiter.
+static void __futex_timeout(hrtimer_t *timer)
+{
+    futex_waiter_t *waiter = (futex_waiter_t *)timer->data;
+    futex_bucket_t *bucket = __futex_bucket(waiter->key);
+    spinlock_lock(&bucket->lock);
+    __futex_wake_waiter(waiter, -ETIMEDOUT);
+    spinlock_unlock(&bucket->lock);
+}
+
+/// @brief Puts the calling process to sleep, if the futex holds a value.
+/// @param uaddr the futex.
+/// @param val the value.
+/// @param timeout the longest time to sleep, NULL to sleep until woken up.
+/// @return 0, the actual result is stored by whoever wakes the process up,
+/// -EAGAIN if the futex did not hold the value.
+static inline long __futex_wait(int *uaddr, int val, const struct timespec *timeout)
+{
+    uint32_t key;
+    ktime_t expires = 0;
+    if (timeout) {
+        if ((timeout->tv_sec < 0) || (timeout->tv_nsec < 0) || ((ktime_t)timeout->tv_nsec >= NSEC_PER_SEC)) {
+            return -EINVAL;
+        }
+        expires = hrtimer_get_time() + ((ktime_t)timeout->tv_sec * NSEC_PER_SEC) + (ktime_t)timeout->tv_nsec;
+    }
+    // Read the futex, which also brings its page in.
+    int value = *(volatile int *)uaddr;
+    int ret   = __futex_key(uaddr, &key);
+    if (ret < 0) {
+        return ret;
+    }
+    futex_bucket_t *bucket = __futex_bucket(key);
+    spinlock_lock(&bucket->lock);
+    // Read it again with the bucket locked, so that a wake up issued after
+    // the change of the value finds us queued.
+    value = *(volatile int *)uaddr;
+    if (value != val) {
+        spinlock_unlock(&bucket->lock);
+        return -EAGAIN;
+    }
+    futex_waiter_t *waiter = (futex_waiter_t *)kmalloc(sizeof(futex_waiter_t));
+    if (waiter == NULL) {
+        spinlock_unlock(&bucket->lock);
+        return -ENOMEM;
+    }
+    waiter->task = scheduler_get_current_process();
+    waiter->key  = key;
+    hrtimer_init(&waiter->timer, __futex_timeout, (unsigned long)waiter);
+    list_head_insert_before(&waiter->list, &bucket->waiters);
+    // The process sleeps once it returns from the system call.
+    scheduler_set_task_state(waiter->task, TASK_UNINTERRUPTIBLE);
+    if (timeout) {
+        hrtimer_start_range(&waiter->timer, expires, waiter->task->timer_slack_ns);
+    }
+    spinlock_unlock(&bucket->lock);
+    return 0;
+}
+
+/// @brief Wakes up the waiters of a futex, and moves some others on a second
+/// futex.
+/// @param uaddr the futex.
+/// @param nr_wake the number of waiters to wake up.
+/// @param uaddr2 the second futex, NULL not to move any waiter.
+/// @param nr_requeue the number of waiters to move.
+/// @return the number of waiters woken up plus those moved, -errno on failure.
+static inline long __futex_wake(int *uaddr, int nr_wake, int *uaddr2, int nr_requeue)
+{
+    uint32_t key, key2 = 0;
+    long done = 0;
+    int ret   = __futex_key(uaddr, &key);
+    // Nobody can sleep on a page which is not there.
+    if (ret == -EFAULT) {
+        return 0;
+    }
+    if (ret < 0) {
+        return ret;
+    }
+    if (uaddr2) {
+        ret = __futex_key(uaddr2, &key2);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    futex_bucket_t *bucket = __futex_bucket(key);
+    spinlock_lock(&bucket->lock);
+    list_for_each_safe_decl(it, store, &bucket->waiters)
+    {
+        futex_waiter_t *waiter = list_entry(it, futex_waiter_t, list);
+        if (waiter->key != key) {
+            continue;
+        }
+        if (nr_wake > 0) {
+            // Its timer can no longer fire, we are freeing it.
+            hrtimer_cancel(&waiter->timer);
+            __futex_wake_waiter(waiter, 0);
+            --nr_wake;
+            ++done;
+        } else if (uaddr2 && (nr_requeue > 0) && (key2 != key)) {
+            // Move it at the end of the other bucket, the buckets are not
+            // locked together, thus take it out first.
+            list_head_remove(&waiter->list);
+            waiter->key = key2;
+            spinlock_unlock(&bucket->lock);
+            futex_bucket_t *bucket2 = __futex_bucket(key2);
+            spinlock_lock(&bucket2->lock);
+            list_head_insert_before(&waiter->list, &bucket2->waiters);
+            spinlock_unlock(&bucket2->lock);
+            spinlock_lock(&bucket->lock);
+            --nr_requeue;
+            ++done;
+            // The list might have changed while it was unlocked.
+            store = bucket->waiters.next;
+        } else {
+            break;
+        }
+    }
+    spinlock_unlock(&bucket->lock);
+    return done;
+}
+
+int futex_init(void)
+{
+    for (unsigned int i = 0; i < FUTEX_BUCKETS; ++i) {
+        list_head_init(&futex_buckets[i].waiters);
+        spinlock_init(&futex_buckets[i].lock);
+    }
+    return 0;
+}
+
+int futex_page_has_waiters(uint32_t phy_page)
+{
+    for (unsigned int i = 0; i < FUTEX_BUCKETS; ++i) {
+        futex_bucket_t *bucket = &futex_buckets[i];
+        // Someone is changing the bucket, assume the worst.
+        if (!spinlock_trylock(&bucket->lock)) {
+            return 1;
+        }
+        list_for_each_decl(it, &bucket->waiters)
+        {
+            futex_waiter_t *waiter = list_entry(it, futex_waiter_t, list);
+            if ((waiter->key & ~(PAGE_SIZE - 1)) == phy_page) {
+                spinlock_unlock(&bucket->lock);
+                return 1;
+            }
+        }
+        spinlock_unlock(&bucket->lock);
+    }
+    return 0;
+}
+
+long sys_futex(int *uaddr, int op, int val, const struct timespec *timeout, int *uaddr2)
+{
+    if (uaddr == NULL) {
+        return -EFAULT;
+    }
+    switch (op) {
+    case FUTEX_WAIT:
+        return __futex_wait(uaddr, val, timeout);
+    case FUTEX_WAKE:
+        return __futex_wake(uaddr, val, NULL, 0);
+    case FUTEX_REQUEUE:
+        if (uaddr2 == NULL) {
+            return -EFAULT;
+        }
+        return __futex_wake(uaddr, val, uaddr2, (int)(uintptr_t)timeout);
+    default:
+        return -ENOSYS;
+    }
+}
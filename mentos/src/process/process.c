@@ -10,75 +10,228 @@
 #include "io/debug.h"                    // Include debugging functions.
 
 #include "assert.h"
+#include "bits/sched.h"
+#include "descriptor_tables/gdt.h"
+#include "devices/fpu.h"
 #include "elf/elf.h"
 #include "fcntl.h"
+#include "fs/aio.h"
 #include "fs/vfs.h"
 #include "hardware/timer.h"
 #include "klib/stack_helper.h"
 #include "libgen.h"
+#include "spawn.h"
 #include "process/prio.h"
 #include "process/process.h"
 #include "process/scheduler.h"
 #include "process/wait.h"
 #include "string.h"
 #include "sys/errno.h"
+#include "sys/futex.h"
+#include "system/syscall_types.h"
 #include "system/panic.h"
+#include "system/vdso.h"
 
 /// Cache for creating the task structs.
 static kmem_cache_t *task_struct_cache;
+/// Maximum number of exited tasks, and of stacks of kernel threads, kept for
+/// the next ones.
+#define TASK_RESERVE_MAX 16
+/// @brief The exited tasks kept for the next ones, still holding their
+/// signal handlers and their reserve of signal queue entries, and the stacks
+/// of the exited kernel threads.
+static struct {
+    /// The tasks, linked by their run_list.
+    list_head tasks;
+    /// The number of tasks.
+    unsigned int ntasks;
+    /// The stacks.
+    void *kstacks[TASK_RESERVE_MAX];
+    /// The number of stacks.
+    unsigned int nkstacks;
+    /// Protects the reserve.
+    spinlock_t lock;
+} task_reserve;
 /// @brief The task_struct of the init process.
 static task_struct *init_proc;
+/// @brief The parents waiting for their vfork children to exec or exit.
+static wait_queue_head_t vfork_queue;
 
-/// @brief Counts the number of arguments.
+/// Maximum number of bytes taken by the arguments and the environment of a
+/// program, a quarter of its stack.
+#define EXEC_ARGS_MAX (DEFAULT_STACK_SIZE / 4)
+
+/// @brief The arguments and the environment of a program, kept in kernel
+/// memory while its image is replaced.
+typedef struct exec_args_t {
+    /// Where each string starts, from the beginning of the strings, the
+    /// arguments first. The strings follow, inside the same allocation.
+    uint32_t *offsets;
+    /// The strings, packed one after the other, the arguments first.
+    char *strings;
+    /// The number of arguments.
+    int argc;
+    /// The number of environment variables.
+    int envc;
+    /// The bytes taken by the strings of the arguments.
+    size_t arg_bytes;
+    /// The bytes taken by all the strings.
+    size_t bytes;
+} exec_args_t;
+
+/// @brief Counts the arguments, and the bytes taken by their strings.
 /// @param args the array of arguments, it must be NULL terminated.
-/// @return the number of arguments.
-static inline int __count_args(char **args)
+/// @param count where the number of arguments is stored.
+/// @param bytes the bytes counted so far, which are increased.
+/// @return 0 on success, -E2BIG if the strings do not fit on the stack.
+static inline int __measure_args(char **args, int *count, size_t *bytes)
 {
-    int argc = 0;
-    while (args[argc] != NULL) {
-        ++argc;
+    for (*count = 0; args[*count] != NULL; ++(*count)) {
+        *bytes += strlen(args[*count]) + 1;
+        if (*bytes > EXEC_ARGS_MAX) {
+            return -E2BIG;
+        }
     }
-    return argc;
+    return 0;
 }
 
-/// @brief Counts the bytes occupied by the arguments.
-/// @param args the array of arguments, it must be NULL terminated.
-/// @return the bytes occupied by the arguments.
-static inline int __count_args_bytes(char **args)
+/// @brief Copies the strings of the arguments one after the other.
+/// @param args the array of arguments.
+/// @param count the number of arguments.
+/// @param strings the beginning of the strings.
+/// @param position where the first string goes.
+/// @param end the end of the space for the strings.
+/// @param offsets where the offset of each string is stored.
+/// @return the position following the last string.
+static inline char *__pack_args(char **args, int count, char *strings, char *position, char *end, uint32_t *offsets)
 {
-    // Count the number of arguments.
-    int argc = __count_args(args);
-    // Count the number of characters.
-    int nchar = 0;
-    for (int i = 0; i < argc; i++) {
-        nchar += strlen(args[i]) + 1;
+    for (int i = 0; i < count; ++i) {
+        offsets[i]         = position - strings;
+        const char *source = args[i];
+        // Bounded, the strings might have changed since they were measured.
+        while ((position < end) && ((*position++ = *source++) != 0)) {}
     }
-    return nchar + (argc + 1 /* The NULL terminator */) * sizeof(char *);
+    return position;
 }
 
-/// @brief Pushes the arguments on the stack.
+/// @brief Copies the arguments and the environment to kernel memory.
+/// @param argv the arguments.
+/// @param envp the environment.
+/// @param args where the copy is described, it must be freed with kfree(args->offsets).
+/// @return 0 on success, -errno on failure.
+/// @details The strings are measured once, and copied once in a single
+/// buffer, with the layout they have on the stack of the new program.
+static int __save_args(char **argv, char **envp, exec_args_t *args)
+{
+    size_t bytes = 0;
+    int ret;
+    memset(args, 0, sizeof(exec_args_t));
+    if ((ret = __measure_args(argv, &args->argc, &bytes)) < 0) {
+        return ret;
+    }
+    args->arg_bytes = bytes;
+    if ((ret = __measure_args(envp, &args->envc, &bytes)) < 0) {
+        return ret;
+    }
+    args->bytes            = bytes;
+    size_t offsets_size    = (args->argc + args->envc) * sizeof(uint32_t);
+    if ((args->offsets = kmalloc(offsets_size + bytes)) == NULL) {
+        pr_err("Failed to allocate memory for arguments and environment %d (%d + %d).\n",
+               offsets_size + bytes, args->arg_bytes, bytes - args->arg_bytes);
+        return -ENOMEM;
+    }
+    args->strings  = (char *)args->offsets + offsets_size;
+    char *end      = args->strings + bytes;
+    char *position = __pack_args(argv, args->argc, args->strings, args->strings, end, args->offsets);
+    __pack_args(envp, args->envc, args->strings, position, end, args->offsets + args->argc);
+    if (bytes) {
+        end[-1] = 0;
+    }
+    return 0;
+}
+
+/// @brief Lays the arguments and the environment out on the stack, in one
+/// pass: the strings, then the NULL terminated arrays of pointers.
 /// @param stack pointer to the stack location.
-/// @param args the list of arguments.
-/// @return the final position of the stack, where the list of pushed arguments is stored.
-static inline char **__push_args_on_stack(uintptr_t *stack, char *args[])
-{
-    // Count the number of arguments.
-    int argc = __count_args(args);
-    // Prepare args with space for the terminating NULL.
-    char *args_location[256];
-    for (int i = argc - 1; i >= 0; --i) {
-        for (int j = strlen(args[i]); j >= 0; --j) {
-            PUSH_VALUE_ON_STACK(*stack, args[i][j]);
-        }
-        args_location[i] = (char *)(*stack);
+/// @param task the task, whose page directory is the current one.
+/// @param args the arguments and the environment.
+/// @param argv where the position of the arguments is stored.
+/// @param envp where the position of the environment is stored.
+static inline void __push_args_on_stack(uintptr_t *stack, task_struct *task, const exec_args_t *args, char ***argv, char ***envp)
+{
+    // The strings, in a single copy.
+    *stack -= args->bytes;
+    memcpy((void *)*stack, args->strings, args->bytes);
+    uintptr_t strings   = *stack;
+    task->mm->arg_start = strings;
+    task->mm->arg_end   = strings + args->arg_bytes;
+    task->mm->env_start = strings + args->arg_bytes;
+    task->mm->env_end   = strings + args->bytes;
+    // The arrays of pointers, aligned so that the frame of `main` is too.
+    *stack = (*stack - (args->argc + args->envc + 2) * sizeof(char *)) & ~0xFU;
+    *argv  = (char **)*stack;
+    *envp  = *argv + args->argc + 1;
+    for (int i = 0; i < args->argc; ++i) {
+        (*argv)[i] = (char *)(strings + args->offsets[i]);
+    }
+    (*argv)[args->argc] = NULL;
+    for (int i = 0; i < args->envc; ++i) {
+        (*envp)[i] = (char *)(strings + args->offsets[args->argc + i]);
     }
-    // Push terminating NULL.
-    PUSH_VALUE_ON_STACK(*stack, (char *)NULL);
-    // Push array of pointers to the arguments.
-    for (int i = argc - 1; i >= 0; --i) {
-        PUSH_VALUE_ON_STACK(*stack, args_location[i]);
+    (*envp)[args->envc] = NULL;
+}
+
+/// @brief Pushes the auxiliary vector on the stack, which tells the dynamic
+/// loader where the executable has been loaded.
+/// @param stack pointer to the stack location.
+/// @param image where the executable has been loaded.
+/// @return the position of the vector on the stack.
+static inline uint32_t *__push_auxv_on_stack(uintptr_t *stack, const elf_image_t *image)
+{
+    uint32_t auxv[] = {
+        AT_PHDR, image->phdr,
+        AT_PHENT, sizeof(elf_program_header_t),
+        AT_PHNUM, image->phnum,
+        AT_PAGESZ, PAGE_SIZE,
+        AT_BASE, image->interp_base,
+        AT_ENTRY, image->exec_entry,
+        AT_NULL, 0
+    };
+    for (int i = count_of(auxv) - 1; i >= 0; --i) {
+        PUSH_VALUE_ON_STACK(*stack, auxv[i]);
     }
-    return (char **)(*stack);
+    return (uint32_t *)(*stack);
+}
+
+/// @brief Pushes the arguments, the environment, and the arguments of `main`
+/// on the stack of a freshly loaded task.
+/// @param task the task.
+/// @param args the arguments and the environment, inside kernel memory.
+/// @param image where the executable has been loaded.
+static void __setup_args(task_struct *task, const exec_args_t *args, const elf_image_t *image)
+{
+    char **final_argv, **final_envp;
+    uint32_t *final_auxv;
+
+    // Save the current page directory.
+    page_directory_t *crtdir = paging_get_current_directory();
+
+    // Change the page directory to point to the newly created process
+    paging_switch_directory_va(task->mm->pgd);
+
+    // Push the auxiliary vector, above everything else.
+    final_auxv = __push_auxv_on_stack(&task->thread.regs.useresp, image);
+    // Push the arguments and the environment.
+    __push_args_on_stack(&task->thread.regs.useresp, task, args, &final_argv, &final_envp);
+    // Push the `main` arguments on the stack (argc, argv, envp), followed by
+    // the auxiliary vector, which only the dynamic loader uses.
+    PUSH_VALUE_ON_STACK(task->thread.regs.useresp, final_auxv);
+    PUSH_VALUE_ON_STACK(task->thread.regs.useresp, final_envp);
+    PUSH_VALUE_ON_STACK(task->thread.regs.useresp, final_argv);
+    PUSH_VALUE_ON_STACK(task->thread.regs.useresp, (int)args->argc);
+
+    // Restore previous pgdir
+    paging_switch_directory(crtdir);
 }
 
 static int __reset_process(task_struct *task)
@@ -90,6 +243,11 @@ static int __reset_process(task_struct *task)
         pr_err("Failed to initialize process mm structure.\n");
         return 0;
     }
+    // Map the code shared with the kernel, right below the stack.
+    if (vdso_map(task->mm) < 0) {
+        pr_err("Failed to map the vDSO.\n");
+        return 0;
+    }
 
     // Save the current page directory.
     page_directory_t *crtdir = paging_get_current_directory();
@@ -120,15 +278,17 @@ static int __has_shebang(vfs_file_t *file) {
 /// @brief Replace the current process with a loaded exectuable
 /// @param path the path to the executable to load.
 /// @param task the task to laod the exectuable.
-/// @param entry
+/// @param image where the executable has been loaded, the task starts from
+/// its entry.
 /// @return -errno or 0 on failure, 1 on success
-static int __load_executable(const char *path, task_struct *task, uint32_t *entry)
+static int __load_executable(const char *path, task_struct *task, elf_image_t *image)
 {
     // Return code variable.
     int ret = 0;
     int interpreter_loop = 0;
+    int is_elf, shebang;
 start:
-    pr_debug("__load_executable(`%s`, %p `%s`, %p)\n", path, task, task->name, entry);
+    pr_debug("__load_executable(`%s`, %p `%s`, %p)\n", path, task, task->name, image);
     vfs_file_t *file = vfs_open(path, O_RDONLY, 0);
     if (file == NULL) {
         pr_err("Cannot find executable!\n");
@@ -141,7 +301,10 @@ start:
         goto close_and_return;
     }
     // Check that the file is actually an executable before destroying the `mm`.
-    if (!(elf_check_file_type(file, ET_EXEC) || __has_shebang(file))) {
+    // The headers of an ELF executed before are cached, and nothing is read.
+    is_elf  = elf_check_executable(file);
+    shebang = !is_elf && __has_shebang(file);
+    if (!is_elf && !shebang) {
         pr_debug("This is not a valid executable `%s`!\n", path);
         ret = -ENOEXEC;
         goto close_and_return;
@@ -154,12 +317,12 @@ start:
     if (bitmask_check(file->mask, S_ISGID)) {
         task->gid = file->gid;
     }
-    // FIXME: When threads will be implemented
-    // they should share the mm, so the destroy_process_image must be called
-    // only when all the threads are terminated. This can be accomplished by using
-    // an internal counter on the mm.
+    // Give back the `mm` borrowed with vfork, and drop our reference, the
+    // other threads sharing it keep it alive.
     if (task->mm) {
-        destroy_process_image(task->mm);
+        process_clear_child_tid(task);
+        process_release_vfork_mm(task);
+        release_process_image(task->mm);
     }
     // Recreate the memory of the process.
     if (!__reset_process(task)) {
@@ -168,7 +331,7 @@ start:
     }
 
     // Load potential interpreter specified by a shebang line
-    if (__has_shebang(file)) {
+    if (shebang) {
         // Disallow interpreter loops
         if (interpreter_loop) {
             ret = -ELOOP;
@@ -197,8 +360,10 @@ start:
     }
 
     // Load the elf file, check if 0 is returned and print the error.
-    if (!(ret = elf_load_file(task, file, entry))) {
+    if (!(ret = elf_load_file(task, file, image))) {
         pr_err("Failed to load ELF file `%s`!\n", path);
+    } else {
+        task->thread.regs.eip = image->entry;
     }
 
     // Free potential interpreter path
@@ -213,18 +378,122 @@ close_and_return:
     return ret;
 }
 
-static inline task_struct *__alloc_task(task_struct *source, task_struct *parent, const char *name)
+/// @brief Initializes the signal handlers of a task, all set to the default action.
+/// @param sighand the signal handlers, used only by the caller.
+/// @return the signal handlers.
+static inline sighand_t *__init_sighand(sighand_t *sighand)
+{
+    memset(sighand, 0x00, sizeof(sighand_t));
+    spinlock_init(&sighand->siglock);
+    init_waitqueue_head(&sighand->signalfd_wqh);
+    atomic_set(&sighand->count, 1);
+    for (int i = 0; i < NSIG; ++i) {
+        sighand->action[i].sa_handler = SIG_DFL;
+        sigemptyset(&sighand->action[i].sa_mask);
+        sighand->action[i].sa_flags = 0;
+    }
+    return sighand;
+}
+
+/// @brief Takes an exited task from the reserve, or a new one from the cache.
+/// @return the task, cleared, but for its signal handlers (NULL if it has
+/// none) and its pending signals, which are initialized.
+static inline task_struct *__task_reserve_get(void)
 {
-    // Create a new task_struct.
-    task_struct *proc = kmem_cache_alloc(task_struct_cache, GFP_KERNEL);
-    // Clear the memory.
+    task_struct *proc = NULL;
+    uint8_t flags     = spinlock_lock_irqsave(&task_reserve.lock);
+    if (task_reserve.ntasks > 0) {
+        proc = list_entry(list_head_pop(&task_reserve.tasks), task_struct, run_list);
+        --task_reserve.ntasks;
+    }
+    spinlock_unlock_irqrestore(&task_reserve.lock, flags);
+    if (proc) {
+        // The reserve of signal queue entries stays where it is, inside the
+        // task, and so does the head of its list.
+        sighand_t *sighand   = proc->sighand;
+        sigpending_t pending = proc->pending;
+        memset(proc, 0, sizeof(task_struct));
+        proc->sighand = sighand;
+        proc->pending = pending;
+        return proc;
+    }
+    proc = kmem_cache_alloc(task_struct_cache, GFP_KERNEL);
     memset(proc, 0, sizeof(task_struct));
+    // Initialzie the data structure storing the pending signals, and its
+    // reserve of queue entries.
+    sigpending_init(&proc->pending);
+    return proc;
+}
+
+/// @brief Keeps an exited task in the reserve, or frees it if it is full.
+/// @param task the task, holding only its private signal handlers (or NULL)
+/// and its reserve of signal queue entries.
+static inline void __task_reserve_put(task_struct *task)
+{
+    uint8_t flags = spinlock_lock_irqsave(&task_reserve.lock);
+    if (task_reserve.ntasks < TASK_RESERVE_MAX) {
+        list_head_insert_after(&task->run_list, &task_reserve.tasks);
+        ++task_reserve.ntasks;
+        task = NULL;
+    }
+    spinlock_unlock_irqrestore(&task_reserve.lock, flags);
+    if (task) {
+        if (task->sighand) {
+            kfree(task->sighand);
+        }
+        sigpending_release(&task->pending);
+        kmem_cache_free(task);
+    }
+}
+
+/// @brief Takes the stack of an exited kernel thread, or allocates one.
+/// @return the stack, NULL if there is no memory.
+static inline void *__kstack_reserve_get(void)
+{
+    void *kstack  = NULL;
+    uint8_t flags = spinlock_lock_irqsave(&task_reserve.lock);
+    if (task_reserve.nkstacks > 0) {
+        kstack = task_reserve.kstacks[--task_reserve.nkstacks];
+    }
+    spinlock_unlock_irqrestore(&task_reserve.lock, flags);
+    return kstack ? kstack : kmalloc(KTHREAD_STACK_SIZE);
+}
+
+/// @brief Keeps the stack of an exited kernel thread, or frees it if the
+/// reserve is full.
+/// @param kstack the stack.
+static inline void __kstack_reserve_put(void *kstack)
+{
+    uint8_t flags = spinlock_lock_irqsave(&task_reserve.lock);
+    if (task_reserve.nkstacks < TASK_RESERVE_MAX) {
+        task_reserve.kstacks[task_reserve.nkstacks++] = kstack;
+        kstack                                         = NULL;
+    }
+    spinlock_unlock_irqrestore(&task_reserve.lock, flags);
+    if (kstack) {
+        kfree(kstack);
+    }
+}
+
+/// @brief Allocates a task.
+/// @param source the task whose files and context are copied, NULL for none.
+/// @param parent the parent of the task, NULL for none.
+/// @param name the name of the task.
+/// @param clone_flags the resources of source shared with the task
+/// (CLONE_FILES, CLONE_SIGHAND), instead of being copied or reset.
+/// @return the task.
+static inline task_struct *__alloc_task(task_struct *source, task_struct *parent, const char *name, unsigned long clone_flags)
+{
+    // Take an exited task, or create a new task_struct, cleared.
+    task_struct *proc = __task_reserve_get();
     // Set the id of the process.
     proc->pid = scheduler_getpid();
     // Set the state of the process as running.
     proc->state = TASK_RUNNING;
     // Set the current opened file descriptors and the maximum number of file descriptors.
-    if (source) {
+    if (source && (clone_flags & CLONE_FILES)) {
+        vfs_share_task(proc, source);
+    } else if (source) {
         vfs_dup_task(proc, source);
     } else {
         vfs_init_task(proc);
@@ -233,17 +502,32 @@ static inline task_struct *__alloc_task(task_struct *source, task_struct *parent
     proc->parent = parent;
     // Initialize the list_head.
     list_head_init(&proc->run_list);
-    // Initialize the children list_head.
+    // Initialize the list_head of the processes ready to run.
+    list_head_init(&proc->ready_list);
+    // Initialize the children list_head, and the ones which exited.
     list_head_init(&proc->children);
+    list_head_init(&proc->zombies);
+    init_waitqueue_head(&proc->wait_chldexit);
     // Initialize the sibling list_head.
     list_head_init(&proc->sibling);
+    // Initialize the links to the process group and to the session.
+    list_head_init(&proc->pgrp_link);
+    list_head_init(&proc->session_link);
     // If we have a parent, set the sibling child relation.
     if (parent) {
         // Set the new_process as child of current.
         list_head_insert_before(&proc->sibling, &parent->children);
     }
     if (source) {
+        // The FPU registers of the source may be live, put them in its storage.
+        fpu_save_task(source);
         memcpy(&proc->thread, &source->thread, sizeof(thread_struct_t));
+        // The thread-local storage segment belongs to the source, give the
+        // task its own, starting at the same address.
+        if (source->thread.tls_selector) {
+            proc->thread.tls_selector = gdt_tls_alloc(source->thread.tls_base);
+            proc->thread.regs.gs      = proc->thread.tls_selector ? proc->thread.tls_selector : source->thread.regs.ds;
+        }
     }
     // Set the statistics of the process.
     proc->uid                   = 0;
@@ -253,6 +537,7 @@ static inline task_struct *__alloc_task(task_struct *source, task_struct *parent
     proc->sid                   = 0;
     proc->pgid                  = 0;
     proc->se.prio               = DEFAULT_PRIO;
+    proc->se.policy             = sched_default_policy;
     proc->se.start_runtime      = timer_get_ticks();
     proc->se.exec_start         = timer_get_ticks();
     proc->se.exec_runtime       = 0;
@@ -267,8 +552,16 @@ static inline task_struct *__alloc_task(task_struct *source, task_struct *parent
     proc->se.next_period        = 0;
     proc->se.worst_case_exec    = 0;
     proc->se.utilization_factor = 0;
+    // The CPUs allowed are inherited.
+    proc->cpus_allowed = source ? source->cpus_allowed : ~0U;
+    // The policy is inherited, except for the periodic one.
+    if (source && (source->se.policy != SCHED_DEADLINE)) {
+        proc->se.policy = source->se.policy;
+    }
     // Initialize the exit code of the process.
     proc->exit_code = 0;
+    // The parent is notified when the task exits.
+    proc->exit_signal = SIGCHLD;
     // Copy the name.
     if (name) {
         strcpy(proc->name, name);
@@ -283,25 +576,27 @@ static inline task_struct *__alloc_task(task_struct *source, task_struct *parent
     } else {
         strcpy(proc->cwd, "/");
     }
-    // Clear the signal handler.
-    memset(&proc->sighand, 0x00, sizeof(sighand_t));
-    spinlock_init(&proc->sighand.siglock);
-    atomic_set(&proc->sighand.count, 0);
-    for (int i = 0; i < NSIG; ++i) {
-        proc->sighand.action[i].sa_handler = SIG_DFL;
-        sigemptyset(&proc->sighand.action[i].sa_mask);
-        proc->sighand.action[i].sa_flags = 0;
+    // Share the signal handlers, or start with the default ones, in those
+    // kept by the task if it exited before.
+    if (source && (clone_flags & CLONE_SIGHAND)) {
+        if (proc->sighand) {
+            kfree(proc->sighand);
+        }
+        proc->sighand = source->sighand;
+        atomic_inc(&proc->sighand->count);
+    } else {
+        proc->sighand = __init_sighand(proc->sighand ? proc->sighand : kmalloc(sizeof(sighand_t)));
     }
     // Clear the masks.
     sigemptyset(&proc->blocked);
     sigemptyset(&proc->real_blocked);
     sigemptyset(&proc->saved_sigmask);
-    // Initialzie the data structure storing the pending signals.
-    list_head_init(&proc->pending.list);
-    sigemptyset(&proc->pending.signal);
 
     // Initalize real_timer for intervals
-    proc->real_timer = NULL;
+    hrtimer_init(&proc->real_timer, NULL, (unsigned long)proc);
+    // Initialize the sleep timer, and inherit the slack of the timers.
+    hrtimer_init(&proc->sleep_timer, NULL, 0);
+    proc->timer_slack_ns = source ? source->timer_slack_ns : HRTIMER_DEFAULT_SLACK;
 
     // Set the default terminal options.
     proc->termios = (termios_t){
@@ -310,6 +605,13 @@ static inline task_struct *__alloc_task(task_struct *source, task_struct *parent
         .c_oflag = 0,
         .c_iflag = 0
     };
+    proc->termios.c_cc[VINTR]  = CTRL('c');
+    proc->termios.c_cc[VERASE] = '\b';
+    proc->termios.c_cc[VKILL]  = CTRL('u');
+    proc->termios.c_cc[VEOF]   = CTRL('d');
+    proc->termios.c_cc[VSUSP]  = CTRL('z');
+    proc->termios.c_cc[VMIN]   = 1;
+    proc->termios.c_cc[VTIME]  = 0;
     // Initialize the ringbuffer.
     fs_rb_scancode_init(&proc->keyboard_rb);
 
@@ -321,6 +623,9 @@ int init_tasking(void)
     if ((task_struct_cache = KMEM_CREATE(task_struct)) == NULL) {
         return 0;
     }
+    list_head_init(&task_reserve.tasks);
+    spinlock_init(&task_reserve.lock);
+    init_waitqueue_head(&vfork_queue);
     return 1;
 }
 
@@ -328,52 +633,43 @@ task_struct *process_create_init(const char *path)
 {
     pr_debug("Building init process...\n");
     // Allocate the memory for the process.
-    init_proc = __alloc_task(NULL, NULL, "init");
+    init_proc = __alloc_task(NULL, NULL, "init", 0);
 
     // == INITIALIZE `/proc/video` ============================================
     // Check that the fd_list is initialized.
-    assert(init_proc->fd_list && "File descriptor list not initialized.");
-    assert((init_proc->max_fd > 3) && "File descriptor list cannot contain the standard IOs.");
+    assert(init_proc->files->fd_list && "File descriptor list not initialized.");
+    assert((init_proc->files->max_fd > 3) && "File descriptor list cannot contain the standard IOs.");
 
     // Create STDIN descriptor.
     vfs_file_t *stdin = vfs_open("/proc/video", O_RDONLY, 0);
     stdin->count++;
-    init_proc->fd_list[STDIN_FILENO].file_struct = stdin;
-    init_proc->fd_list[STDIN_FILENO].flags_mask  = O_RDONLY;
+    vfs_install_fd(init_proc->files, STDIN_FILENO, stdin, O_RDONLY);
     pr_debug("`/proc/video` stdin  : %p\n", stdin);
 
     // Create STDOUT descriptor.
     vfs_file_t *stdout = vfs_open("/proc/video", O_WRONLY, 0);
     stdout->count++;
-    init_proc->fd_list[STDOUT_FILENO].file_struct = stdout;
-    init_proc->fd_list[STDOUT_FILENO].flags_mask  = O_WRONLY;
+    vfs_install_fd(init_proc->files, STDOUT_FILENO, stdout, O_WRONLY);
     pr_debug("`/proc/video` stdout : %p\n", stdout);
 
     // Create STDERR descriptor.
     vfs_file_t *stderr = vfs_open("/proc/video", O_WRONLY, 0);
     stderr->count++;
-    init_proc->fd_list[STDERR_FILENO].file_struct = stderr;
-    init_proc->fd_list[STDERR_FILENO].flags_mask  = O_WRONLY;
+    vfs_install_fd(init_proc->files, STDERR_FILENO, stderr, O_WRONLY);
     pr_debug("`/proc/video` stderr : %p\n", stderr);
     // ------------------------------------------------------------------------
 
     // == INITIALIZE TASK MEMORY ==============================================
     // Load the executable.
-    if (__load_executable(path, init_proc, &init_proc->thread.regs.eip) <= 0) {
+    elf_image_t image;
+    if (__load_executable(path, init_proc, &image) <= 0) {
         pr_err("Entry for init: %d\n", init_proc->thread.regs.eip);
         kernel_panic("Init not valid (%d)!");
     }
     // ------------------------------------------------------------------------
 
     // == INITIALIZE PROGRAM ARGUMENTS ========================================
-    // Save the current page directory.
-    page_directory_t *crtdir = paging_get_current_directory();
-    // Switch to init page directory.
-    paging_switch_directory_va(init_proc->mm->pgd);
-
     // Prepare argv and envp for the init process.
-    char **argv_ptr, **envp_ptr;
-    int argc            = 1;
     static char *argv[] = {
         "/bin/init",
         (char *)NULL
@@ -381,25 +677,12 @@ task_struct *process_create_init(const char *path)
     static char *envp[] = {
         (char *)NULL
     };
-    // Save where the arguments start.
-    init_proc->mm->arg_start = init_proc->thread.regs.useresp;
-    // Push the arguments on the stack.
-    argv_ptr = __push_args_on_stack(&init_proc->thread.regs.useresp, argv);
-    // Save where the arguments end.
-    init_proc->mm->arg_end = init_proc->thread.regs.useresp;
-    // Save where the environmental variables start.
-    init_proc->mm->env_start = init_proc->thread.regs.useresp;
-    // Push the environment on the stack.
-    envp_ptr = __push_args_on_stack(&init_proc->thread.regs.useresp, envp);
-    // Save where the environmental variables end.
-    init_proc->mm->env_end = init_proc->thread.regs.useresp;
-    // Push the `main` arguments on the stack (argc, argv, envp).
-    PUSH_VALUE_ON_STACK(init_proc->thread.regs.useresp, envp_ptr);
-    PUSH_VALUE_ON_STACK(init_proc->thread.regs.useresp, argv_ptr);
-    PUSH_VALUE_ON_STACK(init_proc->thread.regs.useresp, argc);
-
-    // Restore previous pgdir
-    paging_switch_directory(crtdir);
+    exec_args_t args;
+    if (__save_args(argv, envp, &args) < 0) {
+        kernel_panic("Cannot prepare the arguments of init!");
+    }
+    __setup_args(init_proc, &args, &image);
+    kfree(args.offsets);
     // ------------------------------------------------------------------------
 
     // Active the current process.
@@ -410,6 +693,78 @@ task_struct *process_create_init(const char *path)
     return init_proc;
 }
 
+/// @brief The first function executed by a kernel thread.
+/// @details Entered with an `iret`, not called, thus it has no arguments and
+/// never returns.
+static void __kthread_start(void)
+{
+    task_struct *task = scheduler_get_current_process();
+    kthread_exit(task->thread.kthread_fn(task->thread.kthread_data));
+}
+
+task_struct *kthread_alloc(int (*threadfn)(void *data), void *data, const char *name)
+{
+    assert(threadfn && "Received a NULL function.");
+    // Allocate the stack, or reuse the one of an exited kernel thread.
+    void *kstack = __kstack_reserve_get();
+    if (kstack == NULL) {
+        pr_err("Failed to allocate the stack of kernel thread `%s`.\n", name);
+        return NULL;
+    }
+    // Create the task, a kernel thread has no parent and no memory.
+    task_struct *task = __alloc_task(NULL, NULL, name, 0);
+    task->thread.kstack       = kstack;
+    task->thread.kthread_fn   = threadfn;
+    task->thread.kthread_data = data;
+    // Build the frame the thread starts from, at the top of its stack. The
+    // `iret` towards ring 0 does not pop `useresp` and `ss`, which take the
+    // place of the return address of __kthread_start.
+    pt_regs *frame = (pt_regs *)((uintptr_t)kstack + KTHREAD_STACK_SIZE - sizeof(pt_regs));
+    memset(frame, 0, sizeof(pt_regs));
+    frame->eip    = (uintptr_t)__kthread_start;
+    frame->cs     = 0x08;
+    frame->ds     = 0x10;
+    frame->es     = 0x10;
+    frame->fs     = 0x10;
+    frame->gs     = 0x10;
+    frame->eflags = EFLAG_IF;
+    task->thread.kframe = frame;
+    return task;
+}
+
+task_struct *kthread_create(int (*threadfn)(void *data), void *data, const char *name)
+{
+    task_struct *task = kthread_alloc(threadfn, data, name);
+    if (task == NULL) {
+        return NULL;
+    }
+    // Make it ready to run.
+    scheduler_enqueue_task(task);
+    pr_debug("Created kernel thread '%s' (pid: %d).\n", task->name, task->pid);
+    return task;
+}
+
+void kthread_yield(void)
+{
+    assert(is_kthread(scheduler_get_current_process()) && "Only kernel threads can yield.");
+    // The scheduler switches kernel threads only on the way out of a system
+    // call, see scheduler_run.
+    __asm__ __volatile__("int $0x80" : : "a"(__NR_sched_yield) : "memory");
+}
+
+void kthread_exit(int exit_code)
+{
+    task_struct *task = scheduler_get_current_process();
+    assert(is_kthread(task) && "Only kernel threads can call kthread_exit.");
+    pr_debug("Kernel thread %d exited with value %d\n", task->pid, exit_code);
+    task->exit_code = exit_code;
+    // The scheduler frees the zombie, once it runs on another stack.
+    scheduler_set_task_state(task, EXIT_ZOMBIE);
+    kthread_yield();
+    kernel_panic("A dead kernel thread was scheduled!");
+    for (;;) {}
+}
+
 char *sys_getcwd(char *buf, size_t size)
 {
     task_struct *current = scheduler_get_current_process();
@@ -448,11 +803,11 @@ int sys_fchdir(int fd)
     task_struct *current = scheduler_get_current_process();
     assert(current && "There is no running process.");
     // Check if it is a valid file descriptor.
-    if ((fd < 0) || (fd >= current->max_fd)) {
+    if ((fd < 0) || (fd >= current->files->max_fd)) {
         return -EBADF;
     }
     // Get the file descriptor.
-    vfs_file_descriptor_t *vfd = &current->fd_list[fd];
+    vfs_file_descriptor_t *vfd = &current->files->fd_list[fd];
     // Check if the file descriptor file is set.
     if (vfd->file_struct == NULL) {
         return -ENOENT;
@@ -470,6 +825,149 @@ int sys_fchdir(int fd)
     return 0;
 }
 
+/// @brief Copies the identifiers of the parent inside the child.
+/// @param proc the child.
+/// @param parent the parent.
+static inline void __inherit_ids(task_struct *proc, task_struct *parent)
+{
+    // Copy session and group id of the parent into the child
+    proc->sid  = parent->sid;
+    proc->pgid = parent->pgid;
+    proc->uid  = parent->uid;
+    proc->ruid = parent->ruid;
+    proc->gid  = parent->gid;
+    proc->rgid = parent->rgid;
+}
+
+void process_free_task(task_struct *task)
+{
+    // The pid can be given to another task from now on.
+    scheduler_unhash_task(task);
+    // Finalize the VFS structures.
+    vfs_destroy_task(task);
+    // Keep the signal handlers with their last user, the value before the
+    // decrement is returned.
+    if (atomic_dec(&task->sighand->count) != 1) {
+        task->sighand = NULL;
+    }
+    // Free the queued signals, but not the reserve.
+    sigpending_flush(&task->pending);
+    // Give the thread-local storage segment back.
+    if (task->thread.tls_selector) {
+        gdt_tls_free(task->thread.tls_selector);
+    }
+    // Keep the stack of a kernel thread for the next one.
+    if (is_kthread(task)) {
+        __kstack_reserve_put(task->thread.kstack);
+        task->thread.kstack = NULL;
+    }
+    // Keep the task_struct for the next one, or delete it.
+    __task_reserve_put(task);
+}
+
+/// @brief Frees a task which has never been scheduled.
+/// @param proc the task.
+static inline void __free_task(task_struct *proc)
+{
+    if (proc->mm) {
+        release_process_image(proc->mm);
+    }
+    // Remove the task from the children of its parent.
+    list_head_remove(&proc->sibling);
+    process_free_task(proc);
+}
+
+/// @brief Performs the operations on the file descriptors of a spawned task.
+/// @param task the spawned task.
+/// @param file_actions the operations, inside the memory of the caller.
+/// @return 0 on success, -errno on failure.
+static int __spawn_file_actions(task_struct *task, const posix_spawn_file_actions_t *file_actions)
+{
+    if ((file_actions->count < 0) || (file_actions->count > POSIX_SPAWN_MAX_ACTIONS)) {
+        return -EINVAL;
+    }
+    for (int i = 0; i < file_actions->count; ++i) {
+        const posix_spawn_file_action_t *action = &file_actions->actions[i];
+        // Check the file descriptor affected by the action.
+        if ((action->fd < 0) || (action->fd >= task->files->max_fd)) {
+            return -EBADF;
+        }
+        vfs_file_t *file = NULL;
+        int flags_mask   = 0;
+        if (action->type == POSIX_SPAWN_ACTION_OPEN) {
+            if ((file = vfs_open(action->path, action->oflag, action->mode)) == NULL) {
+                return -errno;
+            }
+            if (!bitmask_check(action->oflag, O_APPEND)) {
+                // Reset the offset.
+                file->f_pos = 0;
+            } else {
+                stat_t stat;
+                // Point at the last character.
+                file->fs_operations->stat_f(file, &stat);
+                file->f_pos = stat.st_size;
+            }
+            flags_mask = action->oflag;
+        } else if (action->type == POSIX_SPAWN_ACTION_DUP2) {
+            if ((action->oldfd < 0) || (action->oldfd >= task->files->max_fd) ||
+                (task->files->fd_list[action->oldfd].file_struct == NULL)) {
+                return -EBADF;
+            }
+            // Duplicating a descriptor on itself leaves it untouched.
+            if (action->oldfd == action->fd) {
+                continue;
+            }
+            file = task->files->fd_list[action->oldfd].file_struct;
+            // Increment file reference counter.
+            ++file->count;
+            flags_mask = task->files->fd_list[action->oldfd].flags_mask;
+        } else if (action->type != POSIX_SPAWN_ACTION_CLOSE) {
+            return -EINVAL;
+        }
+        // Close the file previously associated with the descriptor.
+        if (task->files->fd_list[action->fd].file_struct) {
+            vfs_close(vfs_release_fd(task->files, action->fd));
+        }
+        if (file) {
+            vfs_install_fd(task->files, action->fd, file, flags_mask);
+        }
+    }
+    return 0;
+}
+
+int process_release_vfork_mm(task_struct *task)
+{
+    wait_queue_entry_t *wait_queue_entry = task->vfork_wait;
+    if (wait_queue_entry == NULL) {
+        return 0;
+    }
+    task->vfork_wait = NULL;
+    // Wake up the parent, and remove it from the queue.
+    wait_queue_entry->func(wait_queue_entry, TASK_UNINTERRUPTIBLE, 0);
+    remove_wait_queue(&vfork_queue, wait_queue_entry);
+    // Free the memory of the wait queue item.
+    wait_queue_entry_dealloc(wait_queue_entry);
+    return 1;
+}
+
+void process_clear_child_tid(task_struct *task)
+{
+    pid_t *tidptr = task->clear_child_tid;
+    if (tidptr == NULL) {
+        return;
+    }
+    task->clear_child_tid = NULL;
+    // Only the memory of the running task can be written.
+    assert((task == scheduler_get_current_process()) && "Clearing the tid of another task.");
+    size_t size = sizeof(pid_t);
+    if (mem_virtual_to_page(task->mm->pgd, (uintptr_t)tidptr, &size) == NULL) {
+        return;
+    }
+    *tidptr = 0;
+    // Wake up whoever waits for the task, e.g., pthread_join.
+    sys_futex((int *)tidptr, FUTEX_WAKE, 1, NULL, NULL);
+}
+
 pid_t sys_fork(pt_regs *f)
 {
     task_struct *current = scheduler_get_current_process();
@@ -483,7 +981,7 @@ pid_t sys_fork(pt_regs *f)
     // to the ones of the child process, except for eax.
     scheduler_store_context(f, current);
     // Allocate the memory for the process.
-    task_struct *proc = __alloc_task(current, current, current->name);
+    task_struct *proc = __alloc_task(current, current, current->name, 0);
     // Copy the father's stack, memory, heap etc... to the child process
     proc->mm = clone_process_image(current->mm);
     // Set the eax as 0, to indicate the child process
@@ -492,12 +990,7 @@ pid_t sys_fork(pt_regs *f)
     proc->thread.regs.eflags = proc->thread.regs.eflags | EFLAG_IF;
 
     // Copy session and group id of the parent into the child
-    proc->sid  = current->sid;
-    proc->pgid = current->pgid;
-    proc->uid  = current->uid;
-    proc->ruid  = current->ruid;
-    proc->gid  = current->gid;
-    proc->rgid  = current->rgid;
+    __inherit_ids(proc, current);
 
     // Active the new process.
     scheduler_enqueue_task(proc);
@@ -508,6 +1001,131 @@ pid_t sys_fork(pt_regs *f)
     return proc->pid;
 }
 
+pid_t sys_vfork(pt_regs *f)
+{
+    task_struct *current = scheduler_get_current_process();
+    if (current == NULL) {
+        kernel_panic("There is no current process!");
+    }
+
+    pr_debug("VForking  '%s' (pid: %d)...\n", current->name, current->pid);
+
+    // Update current process registers, they should be equal
+    // to the ones of the child process, except for eax.
+    scheduler_store_context(f, current);
+    // Allocate the memory for the process.
+    task_struct *proc = __alloc_task(current, current, current->name, 0);
+    // Lend the father's memory to the child process, nothing is copied.
+    proc->mm = share_process_image(current->mm);
+    // Set the eax as 0, to indicate the child process
+    proc->thread.regs.eax = 0;
+    // Enable the interrupts.
+    proc->thread.regs.eflags = proc->thread.regs.eflags | EFLAG_IF;
+
+    // Copy session and group id of the parent into the child
+    __inherit_ids(proc, current);
+
+    // Active the new process.
+    scheduler_enqueue_task(proc);
+
+    // The parent sleeps until the child gives the memory back, either by
+    // calling execve or by exiting (see process_release_vfork_mm).
+    proc->vfork_wait = sleep_on(&vfork_queue);
+
+    pr_debug("VForked   '%s' (pid: %d, gid: %d, sid: %d, pgid: %d)...\n", proc->name, proc->pid, proc->gid, proc->sid, proc->pgid);
+
+    // Return PID of child process to parent.
+    return proc->pid;
+}
+
+pid_t sys_clone(pt_regs *f)
+{
+    task_struct *current = scheduler_get_current_process();
+    if (current == NULL) {
+        kernel_panic("There is no current process!");
+    }
+    // Get the arguments, in the same registers as Linux.
+    unsigned long flags = f->ebx;
+    uint32_t stack      = f->ecx;
+    pid_t *ptid         = (pid_t *)f->edx;
+    uint32_t tls        = f->esi;
+    pid_t *ctid         = (pid_t *)f->edi;
+    int exit_signal     = (int)(flags & CSIGNAL);
+    // Thread groups are not supported, each thread is a process of its own.
+    if (flags & ~(CSIGNAL | CLONE_VM | CLONE_FILES | CLONE_SIGHAND | CLONE_SETTLS |
+                  CLONE_PARENT_SETTID | CLONE_CHILD_CLEARTID | CLONE_CHILD_SETTID)) {
+        return -EINVAL;
+    }
+    // The handlers point inside the memory, which must be shared as well.
+    if ((flags & CLONE_SIGHAND) && !(flags & CLONE_VM)) {
+        return -EINVAL;
+    }
+    if (exit_signal >= NSIG) {
+        return -EINVAL;
+    }
+
+    pr_debug("Cloning   '%s' (pid: %d, flags: 0x%x)...\n", current->name, current->pid, flags);
+
+    // Update current process registers, they should be equal
+    // to the ones of the child process, except for eax and the stack.
+    scheduler_store_context(f, current);
+    // Allocate the memory for the process.
+    task_struct *proc = __alloc_task(current, current, current->name, flags);
+    // Share the memory of the father, or copy it.
+    if (flags & CLONE_VM) {
+        proc->mm = share_process_image(current->mm);
+    } else {
+        proc->mm = clone_process_image(current->mm);
+    }
+    // Give the child its own thread-local storage segment.
+    if (flags & CLONE_SETTLS) {
+        if (proc->thread.tls_selector) {
+            gdt_tls_free(proc->thread.tls_selector);
+        }
+        proc->thread.tls_base     = tls;
+        proc->thread.tls_selector = gdt_tls_alloc(tls);
+        if (proc->thread.tls_selector == 0) {
+            __free_task(proc);
+            return -EAGAIN;
+        }
+        proc->thread.regs.gs = proc->thread.tls_selector;
+    }
+    // The child starts on its own stack.
+    if (stack) {
+        proc->thread.regs.useresp = stack;
+    }
+    // Set the eax as 0, to indicate the child process
+    proc->thread.regs.eax = 0;
+    // Enable the interrupts.
+    proc->thread.regs.eflags = proc->thread.regs.eflags | EFLAG_IF;
+    // Nobody waits for a child without exit signal, it is freed once it exits.
+    proc->exit_signal = exit_signal;
+    if (flags & CLONE_CHILD_CLEARTID) {
+        proc->clear_child_tid = ctid;
+    }
+    if ((flags & CLONE_PARENT_SETTID) && ptid) {
+        *ptid = proc->pid;
+    }
+    if ((flags & CLONE_CHILD_SETTID) && ctid) {
+        // Without CLONE_VM, the pid goes inside the copy of the memory.
+        page_directory_t *crtdir = paging_get_current_directory();
+        paging_switch_directory_va(proc->mm->pgd);
+        *ctid = proc->pid;
+        paging_switch_directory(crtdir);
+    }
+
+    // Copy session and group id of the parent into the child
+    __inherit_ids(proc, current);
+
+    // Active the new process.
+    scheduler_enqueue_task(proc);
+
+    pr_debug("Cloned    '%s' (pid: %d, gid: %d, sid: %d, pgid: %d)...\n", proc->name, proc->pid, proc->gid, proc->sid, proc->pgid);
+
+    // Return PID of child process to parent.
+    return proc->pid;
+}
+
 int sys_execve(pt_regs *f)
 {
     // Check the current process.
@@ -516,8 +1134,8 @@ int sys_execve(pt_regs *f)
         kernel_panic("There is no current process!");
     }
 
-    char **origin_argv, **saved_argv, **final_argv;
-    char **origin_envp, **saved_envp, **final_envp;
+    char **origin_argv, **origin_envp;
+    exec_args_t args;
     char name_buffer[NAME_MAX];
 
     // Get the filename.
@@ -549,70 +1167,47 @@ int sys_execve(pt_regs *f)
 
     // == COPY PROGRAM ARGUMENTS ==============================================
     // Copy argv and envp to kernel memory, because all the old process memory will be discarded.
-    int argc       = __count_args(origin_argv);
-    int argv_bytes = __count_args_bytes(origin_argv);
-    int envc       = __count_args(origin_envp);
-    int envp_bytes = __count_args_bytes(origin_envp);
-    if ((argv_bytes < 0) || (envp_bytes < 0)) {
-        pr_err("Failed to count required memory to store arguments and environment (%d + %d).\n",
-               argv_bytes, envp_bytes);
-        return -1;
-    }
-    void *args_mem = kmalloc(argv_bytes + envp_bytes);
-    if (!args_mem) {
-        pr_err("Failed to allocate memory for arguments and environment %d (%d + %d).\n",
-               argv_bytes + envp_bytes, argv_bytes, envp_bytes);
-        return -1;
+    int ret = __save_args(origin_argv, origin_envp, &args);
+    if (ret < 0) {
+        return ret;
     }
-    // Copy the arguments.
-    uint32_t args_mem_ptr = (uint32_t)args_mem + (argv_bytes + envp_bytes);
-    saved_argv            = __push_args_on_stack(&args_mem_ptr, origin_argv);
-    saved_envp            = __push_args_on_stack(&args_mem_ptr, origin_envp);
-    // Check the memory pointer.
-    assert(args_mem_ptr == (uint32_t)args_mem);
     // ------------------------------------------------------------------------
 
     // == INITIALIZE TASK MEMORY ==============================================
-    int ret = __load_executable(filename, current, &current->thread.regs.eip);
+    elf_image_t image;
+    ret = __load_executable(filename, current, &image);
     if (ret <= 0) {
         pr_err("Failed to load executable!\n");
         // Free the temporary args memory.
-        kfree(args_mem);
+        kfree(args.offsets);
         return ret;
     }
     // ------------------------------------------------------------------------
 
     // == INITIALIZE PROGRAM ARGUMENTS ========================================
-    // Save the current page directory.
-    page_directory_t *crtdir = paging_get_current_directory();
-
-    // Change the page directory to point to the newly created process
-    paging_switch_directory_va(current->mm->pgd);
-
-    // Save where the arguments start.
-    current->mm->arg_start = current->thread.regs.useresp;
-    // Push the arguments on the stack.
-    final_argv = __push_args_on_stack(&current->thread.regs.useresp, saved_argv);
-    // Save where the arguments end, and the env starts.
-    current->mm->env_start = current->mm->arg_end = current->thread.regs.useresp;
-    // Push the environment on the stack.
-    final_envp = __push_args_on_stack(&current->thread.regs.useresp, saved_envp);
-    // Save where the environmental variables end.
-    current->mm->env_end = current->thread.regs.useresp;
-    // Push the `main` arguments on the stack (argc, argv, envp).
-    PUSH_VALUE_ON_STACK(current->thread.regs.useresp, final_envp);
-    PUSH_VALUE_ON_STACK(current->thread.regs.useresp, final_argv);
-    PUSH_VALUE_ON_STACK(current->thread.regs.useresp, argc);
-
-    // Restore previous pgdir
-    paging_switch_directory(crtdir);
+    __setup_args(current, &args, &image);
     // ------------------------------------------------------------------------
 
     // Change the name of the process.
     strcpy(current->name, name_buffer);
 
+    // Close the files opened with O_CLOEXEC, the old program is gone.
+    vfs_close_on_exec(current->files);
+    // Its asynchronous requests refer to the memory of the old program.
+    aio_exit(current);
+
+    // The new program starts without thread-local storage.
+    if (current->thread.tls_selector) {
+        gdt_tls_free(current->thread.tls_selector);
+        current->thread.tls_selector = 0;
+        current->thread.regs.gs      = current->thread.regs.ds;
+    }
+
+    // The new program starts with a clean FPU.
+    fpu_release_task(current);
+
     // Free the temporary args memory.
-    kfree(args_mem);
+    kfree(args.offsets);
 
     // Perform the switch to the new process.
     scheduler_restore_context(current, f);
@@ -620,3 +1215,99 @@ int sys_execve(pt_regs *f)
     pr_debug("Executing '%s' (pid: %d)...\n", current->name, current->pid);
     return 0;
 }
+
+pid_t sys_posix_spawn(const char *path, char *argv[], char *envp[],
+                      const posix_spawn_file_actions_t *file_actions, const posix_spawnattr_t *attrp)
+{
+    // Check the current process.
+    task_struct *current = scheduler_get_current_process();
+    if (current == NULL) {
+        kernel_panic("There is no current process!");
+    }
+
+    exec_args_t args;
+    char name_buffer[NAME_MAX];
+
+    // Check the path, the arguments, the environment, and that at least the name is provided.
+    if ((path == NULL) || (argv == NULL) || (argv[0] == NULL) || (envp == NULL)) {
+        pr_err("sys_posix_spawn failed: must provide the path, argv, and the environment.\n");
+        return -EINVAL;
+    }
+    if (attrp && (attrp->flags & ~(POSIX_SPAWN_RESETIDS | POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK))) {
+        return -EINVAL;
+    }
+
+    // Save the name of the process.
+    strcpy(name_buffer, argv[0]);
+
+    pr_debug("Spawning  '%s' from '%s' (pid: %d)...\n", path, current->name, current->pid);
+
+    // == COPY PROGRAM ARGUMENTS ==============================================
+    // Copy argv and envp to kernel memory, the memory of the caller is not
+    // reachable once we work on the page directory of the new process.
+    int ret = __save_args(argv, envp, &args);
+    if (ret < 0) {
+        return ret;
+    }
+    // ------------------------------------------------------------------------
+
+    // == CREATE THE TASK =====================================================
+    // Update current process registers, the segments of the child are taken
+    // from them, the rest is set by the loader.
+    scheduler_store_context(get_current_interrupt_stack_frame(), current);
+    // Allocate the process, it shares the open files of the caller, but none
+    // of its memory, there is no image to copy and then throw away.
+    task_struct *proc = __alloc_task(current, current, name_buffer, 0);
+    // Copy session and group id of the parent into the child
+    __inherit_ids(proc, current);
+    // Apply the attributes.
+    if (attrp) {
+        if (attrp->flags & POSIX_SPAWN_RESETIDS) {
+            proc->uid = proc->ruid;
+            proc->gid = proc->rgid;
+        }
+        if (attrp->flags & POSIX_SPAWN_SETPGROUP) {
+            proc->pgid = attrp->pgroup ? attrp->pgroup : proc->pid;
+        }
+        if (attrp->flags & POSIX_SPAWN_SETSIGMASK) {
+            proc->blocked = attrp->sigmask;
+        }
+    }
+    // Operate on the file descriptors.
+    if (file_actions && ((ret = __spawn_file_actions(proc, file_actions)) < 0)) {
+        goto free_and_return;
+    }
+    // The new program does not see the files opened with O_CLOEXEC.
+    vfs_close_on_exec(proc->files);
+    // ------------------------------------------------------------------------
+
+    // == INITIALIZE TASK MEMORY ==============================================
+    elf_image_t image;
+    if ((ret = __load_executable(path, proc, &image)) <= 0) {
+        pr_err("Failed to load executable!\n");
+        ret = ret ? ret : -ENOEXEC;
+        goto free_and_return;
+    }
+    // ------------------------------------------------------------------------
+
+    // == INITIALIZE PROGRAM ARGUMENTS ========================================
+    __setup_args(proc, &args, &image);
+    // ------------------------------------------------------------------------
+
+    // Free the temporary args memory.
+    kfree(args.offsets);
+
+    // Active the new process.
+    scheduler_enqueue_task(proc);
+
+    pr_debug("Spawned   '%s' (pid: %d, gid: %d, sid: %d, pgid: %d)...\n", proc->name, proc->pid, proc->gid, proc->sid, proc->pgid);
+
+    // Return PID of child process to parent.
+    return proc->pid;
+
+free_and_return:
+    __free_task(proc);
+    // Free the temporary args memory.
+    kfree(args.offsets);
+    return ret;
+}
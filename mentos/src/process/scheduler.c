@@ -10,16 +10,33 @@
 #include "io/debug.h"                    // Include debugging functions.
 
 #include "assert.h"
+#include "descriptor_tables/isr.h"
 #include "descriptor_tables/tss.h"
+#include "devices/fpu.h"
+#include "fs/aio.h"
+#include "fs/poll.h"
 #include "fs/vfs.h"
+#include "io/video.h"
+#include "hardware/cpuid.h"
+#include "hardware/pic8259.h"
+#include "hardware/smp.h"
 #include "hardware/timer.h"
+#include "klib/hashmap.h"
+#include "klib/irqflags.h"
+#include "klib/rcu.h"
+#include "math.h"
+#include "mem/kheap.h"
+#include "process/preempt.h"
 #include "process/prio.h"
 #include "process/scheduler.h"
 #include "process/scheduler_feedback.h"
 #include "process/wait.h"
 #include "strerror.h"
+#include "string.h"
 #include "sys/errno.h"
+#include "sys/sem.h"
 #include "system/panic.h"
+#include "system/trace.h"
 
 /// @brief          Assembly function setting the kernel stack to jump into
 ///                 location in Ring 3 mode (USER mode).
@@ -27,17 +44,246 @@
 /// @param stack    The stack to use.
 extern void enter_userspace(uintptr_t location, uintptr_t stack);
 
-/// The list of processes.
-runqueue_t runqueue;
+/// Number of buckets of the tables indexing the tasks.
+#define PID_HASH_BUCKETS 256
+/// Ticks between two periodic balancing of the runqueues.
+#define BALANCE_INTERVAL (TICKS_PER_SECOND / 10)
+/// @brief A task which stopped running less than these ticks ago is
+/// cache-hot: its data is likely still in the caches of its CPU, and moving
+/// it costs more than waiting.
+#define CACHE_HOT_TICKS 5
+
+/// The processes of each CPU.
+static runqueue_t runqueues[SMP_MAX_CPUS];
+/// @brief The frame the interrupt stubs return from, when it is not the one
+/// they pushed, because the next task lives on another stack.
+pt_regs *scheduler_switch_frame = NULL;
+/// The policy given to the first process, and inherited by the others.
+int sched_default_policy = SCHED_DEFAULT_POLICY;
+/// Ticks a SCHED_RR task runs before the scheduler picks again.
+unsigned sched_rr_timeslice = SCHED_DEFAULT_TIMESLICE;
+/// Ticks within which every ready SCHED_OTHER task should run once.
+unsigned sched_latency = SCHED_DEFAULT_LATENCY;
+/// Ticks a SCHED_OTHER task runs at least.
+unsigned sched_min_granularity = SCHED_DEFAULT_MIN_GRANULARITY;
+/// Ticks of vruntime a waking SCHED_OTHER task must be behind the current one.
+unsigned sched_wakeup_granularity = SCHED_DEFAULT_WAKEUP_GRANULARITY;
+/// The kernel threads which exited, and whose stack can be freed once the CPU
+/// is running on another one, and the tasks which exited without exit signal.
+static list_head dead_tasks = { &dead_tasks, &dead_tasks };
+
+/// @brief The tasks sharing a process group, or a session.
+typedef struct pid_chain_t {
+    /// The tasks, linked through their pgrp_link, or session_link.
+    list_head tasks;
+} pid_chain_t;
+
+/// The tasks, by pid, from their creation until they are freed.
+static hashmap_t *pid_hash;
+/// The process groups, by pgid.
+static hashmap_t *pgrp_hash;
+/// The sessions, by sid.
+static hashmap_t *session_hash;
+
+/// @brief Returns the runqueue of the calling CPU.
+/// @return a pointer to the runqueue.
+static inline runqueue_t *this_rq(void)
+{
+    return &runqueues[smp_processor_id()];
+}
 
-void scheduler_initialize(void)
+/// @brief Returns the runqueue holding a task.
+/// @param process the task.
+/// @return a pointer to the runqueue.
+static inline runqueue_t *task_rq(task_struct *process)
+{
+    return &runqueues[process->se.cpu];
+}
+
+/// @brief Initializes the runqueue of a CPU.
+/// @param rq the runqueue.
+static inline void __runqueue_init(runqueue_t *rq)
 {
     // Initialize the runqueue list of tasks.
-    list_head_init(&runqueue.queue);
+    list_head_init(&rq->queue);
     // Reset the current task.
-    runqueue.curr = NULL;
+    rq->curr = NULL;
     // Reset the number of active tasks.
-    runqueue.num_active = 0;
+    rq->num_active = 0;
+    // Initialize the structures holding the tasks ready to run.
+    for (const sched_class_t *class = &dl_sched_class; class; class = class->next) {
+        class->initialize(rq);
+    }
+    rq->num_ready = 0;
+    spinlock_init(&rq->lock);
+    rq->next_balance = 0;
+}
+
+void scheduler_initialize(void)
+{
+    for (unsigned cpu = 0; cpu < SMP_MAX_CPUS; ++cpu) {
+        __runqueue_init(&runqueues[cpu]);
+    }
+    // The ids are stored in place of the keys pointers.
+    pid_hash     = hashmap_create(PID_HASH_BUCKETS, hashmap_int_hash, hashmap_int_comp, hashmap_do_not_duplicate, hashmap_do_not_free);
+    pgrp_hash    = hashmap_create(PID_HASH_BUCKETS, hashmap_int_hash, hashmap_int_comp, hashmap_do_not_duplicate, hashmap_do_not_free);
+    session_hash = hashmap_create(PID_HASH_BUCKETS, hashmap_int_hash, hashmap_int_comp, hashmap_do_not_duplicate, hashmap_do_not_free);
+    if (!pid_hash || !pgrp_hash || !session_hash) {
+        kernel_panic("Failed to allocate the tables of the tasks.");
+    }
+}
+
+/// @brief Links a task to the chain of the tasks sharing an id.
+/// @param map the table of the chains.
+/// @param id the process group, or the session.
+/// @param link the link of the task.
+static inline void __pid_chain_attach(hashmap_t *map, pid_t id, list_head *link)
+{
+    pid_chain_t *chain = (pid_chain_t *)hashmap_get(map, (void *)id);
+    if (chain == NULL) {
+        if ((chain = (pid_chain_t *)kmalloc(sizeof(pid_chain_t))) == NULL) {
+            pr_err("Failed to allocate the chain of %d.\n", id);
+            return;
+        }
+        list_head_init(&chain->tasks);
+        hashmap_set(map, (void *)id, chain);
+    }
+    list_head_insert_before(link, &chain->tasks);
+}
+
+/// @brief Unlinks a task from the chain of the tasks sharing an id, freeing
+/// the chain once it is empty.
+/// @param map the table of the chains.
+/// @param id the process group, or the session.
+/// @param link the link of the task.
+static inline void __pid_chain_detach(hashmap_t *map, pid_t id, list_head *link)
+{
+    if (list_head_empty(link)) {
+        return;
+    }
+    list_head_remove(link);
+    pid_chain_t *chain = (pid_chain_t *)hashmap_get(map, (void *)id);
+    if (chain && list_head_empty(&chain->tasks)) {
+        hashmap_remove(map, (void *)id);
+        kfree(chain);
+    }
+}
+
+/// @brief Moves a task to another process group, and session.
+/// @param process the task.
+/// @param pgid the process group.
+/// @param sid the session.
+static inline void __set_pgrp_session(task_struct *process, pid_t pgid, pid_t sid)
+{
+    __pid_chain_detach(pgrp_hash, process->pgid, &process->pgrp_link);
+    __pid_chain_detach(session_hash, process->sid, &process->session_link);
+    process->pgid = pgid;
+    process->sid  = sid;
+    __pid_chain_attach(pgrp_hash, pgid, &process->pgrp_link);
+    __pid_chain_attach(session_hash, sid, &process->session_link);
+}
+
+void scheduler_unhash_task(task_struct *process)
+{
+    // Tasks which failed before being enqueued were never hashed.
+    if (hashmap_get(pid_hash, (void *)process->pid) == process) {
+        hashmap_remove(pid_hash, (void *)process->pid);
+    }
+    __pid_chain_detach(pgrp_hash, process->pgid, &process->pgrp_link);
+    __pid_chain_detach(session_hash, process->sid, &process->session_link);
+}
+
+/// @brief Hands a task which became ready to the class matching its policy.
+/// @param process The task.
+static inline void __ready_insert(task_struct *process)
+{
+    process->se.sched_class = scheduler_get_class(process);
+    process->se.sched_class->enqueue_task(task_rq(process), process);
+    ++task_rq(process)->num_ready;
+}
+
+/// @brief Takes a task which is no longer ready away from its class.
+/// @param process The task.
+static inline void __ready_remove(task_struct *process)
+{
+    process->se.sched_class->dequeue_task(task_rq(process), process);
+    process->se.sched_class = NULL;
+    --task_rq(process)->num_ready;
+}
+
+/// @brief Checks if a class comes before another one, inside the chain of
+/// the classes, so that its tasks preempt the tasks of the other one.
+/// @param class the first class.
+/// @param other the second class.
+/// @return true if the first class comes before the second one.
+static inline bool_t __class_precedes(const sched_class_t *class, const sched_class_t *other)
+{
+    for (const sched_class_t *it = class->next; it; it = it->next) {
+        if (it == other) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/// @brief Asks the current task of the runqueue of a task which became ready
+/// to give the CPU away, if the task is more urgent.
+/// @param process the task.
+static inline void __check_preempt_curr(task_struct *process)
+{
+    runqueue_t *rq             = task_rq(process);
+    task_struct *curr          = rq->curr;
+    const sched_class_t *class = process->se.sched_class;
+    if (!curr || (curr == process) || !curr->se.sched_class) {
+        return;
+    }
+    if (class == curr->se.sched_class) {
+        if (class->check_preempt_curr && class->check_preempt_curr(rq, process)) {
+            rq->need_resched = true;
+        }
+    } else if (__class_precedes(class, curr->se.sched_class)) {
+        rq->need_resched = true;
+    }
+}
+
+void scheduler_set_task_state(task_struct *process, long state)
+{
+    bool_t was_ready = process->state == TASK_RUNNING;
+    bool_t ready     = state == TASK_RUNNING;
+    // Only the tasks inside the runqueue can sit inside the ready lists.
+    if (!list_head_empty(&process->run_list)) {
+        if (was_ready && !ready) {
+            __ready_remove(process);
+        } else if (!was_ready && ready) {
+            __ready_insert(process);
+#ifdef ENABLE_LATENCY_TRACE
+            // Time how long it waits for the CPU, unless it never left it.
+            if (process != task_rq(process)->curr) {
+                latency_task_woken(process);
+            }
+#endif
+            // A more urgent task should not wait for the end of the time
+            // slice of the current one.
+            __check_preempt_curr(process);
+#ifdef ENABLE_DYNTICKS
+            // The processes might need to share the CPU again.
+            timer_dynticks_kick();
+#endif
+        }
+    }
+    process->state = state;
+}
+
+void scheduler_set_task_prio(task_struct *process, int prio)
+{
+    bool_t queued = process->se.sched_class != NULL;
+    if (queued) {
+        __ready_remove(process);
+    }
+    process->se.prio = prio;
+    if (queued) {
+        __ready_insert(process);
+    }
 }
 
 uint32_t scheduler_getpid(void)
@@ -51,63 +297,167 @@ uint32_t scheduler_getpid(void)
 
 task_struct *scheduler_get_current_process(void)
 {
-    return runqueue.curr;
+    return this_rq()->curr;
 }
 
 time_t scheduler_get_maximum_vruntime(void)
 {
     time_t vruntime = 0;
-    task_struct *entry;
-    list_for_each_decl(it, &runqueue.queue)
-    {
-        // Check if we reached the head of list_head, and skip it.
-        if (it == &runqueue.queue) {
-            continue;
-        }
-        // Get the current entry.
-        entry = list_entry(it, task_struct, run_list);
-        // Skip the process if it is a periodic one, we are issued to skip
-        // periodic tasks, and the entry is not a periodic task under
-        // analysis.
-        if (entry->se.is_periodic && !entry->se.is_under_analysis) {
-            continue;
-        }
-        if (entry->se.vruntime > vruntime) {
-            vruntime = entry->se.vruntime;
-        }
+    // The timeline holds the ready SCHED_OTHER tasks, except for the current
+    // one, and its rightmost node has the largest vruntime.
+    rbtree_node_t *node = rbtree_tree_get_root(this_rq()->timeline);
+    while (node && rbtree_node_get_link(node, 1)) {
+        node = rbtree_node_get_link(node, 1);
+    }
+    if (node) {
+        vruntime = ((task_struct *)rbtree_node_get_value(node))->se.vruntime;
+    }
+    if (this_rq()->curr && (this_rq()->curr->se.sched_class == &fair_sched_class)) {
+        vruntime = max(vruntime, this_rq()->curr->se.vruntime);
     }
     return vruntime;
 }
 
+bool_t scheduler_needs_tick(void)
+{
+    task_struct *curr = this_rq()->curr;
+    if ((this_rq()->num_ready > 1) || (this_rq()->num_periodic > 0)) {
+        return true;
+    }
+    // The profiling timer counts the time spent running.
+    return curr && (curr->it_prof_incr != 0);
+}
+
 size_t scheduler_get_active_processes(void)
 {
-    return runqueue.num_active;
+    return this_rq()->num_active;
 }
 
 task_struct *scheduler_get_running_process(pid_t pid)
 {
-    task_struct *entry;
-    list_for_each_decl(it, &runqueue.queue)
-    {
-        entry = list_entry(it, task_struct, run_list);
-        if (entry->pid == pid) {
-            return entry;
+    // The table does not depend on the CPU running the task.
+    task_struct *entry = (task_struct *)hashmap_get(pid_hash, (void *)pid);
+    // The tasks which exited keep their pid until they are freed.
+    if (entry && ((entry->state == EXIT_ZOMBIE) || (entry->state == EXIT_DEAD))) {
+        return NULL;
+    }
+    return entry;
+}
+
+size_t scheduler_for_each_task(void (*fn)(task_struct *process, void *data), void *data)
+{
+    size_t count  = 0;
+    uint8_t flags = irq_disable();
+    // Take the locks in the order of the CPUs, as the balancer does.
+    for (unsigned cpu = 0; cpu < smp_num_cpus; ++cpu) {
+        spinlock_lock(&runqueues[cpu].lock);
+    }
+    for (unsigned cpu = 0; cpu < smp_num_cpus; ++cpu) {
+        list_for_each_decl(it, &runqueues[cpu].queue)
+        {
+            fn(list_entry(it, task_struct, run_list), data);
+            ++count;
+        }
+    }
+    for (unsigned cpu = smp_num_cpus; cpu > 0; --cpu) {
+        spinlock_unlock(&runqueues[cpu - 1].lock);
+    }
+    irq_enable(flags);
+    return count;
+}
+
+/// @brief Waits for an interrupt or, when the CPU has MONITOR/MWAIT, for a
+/// write to the number of ready tasks (e.g., another CPU waking one up).
+/// @param rq the runqueue of the CPU.
+/// @param mwait true if the CPU has MONITOR/MWAIT.
+/// @details Entered and left with interrupts disabled, `sti` delays them
+/// until after the following instruction, so that no wake up is lost.
+static inline void __idle_wait(runqueue_t *rq, bool_t mwait)
+{
+    if (mwait) {
+        // Arm the monitor before the last check.
+        __asm__ __volatile__("monitor" : : "a"(&rq->num_ready), "c"(0), "d"(0));
+        if (rq->num_ready) {
+            return;
+        }
+        __asm__ __volatile__("sti; mwait; cli" : : "a"(0), "c"(0) : "memory");
+    } else {
+        __asm__ __volatile__("sti; hlt; cli" ::: "memory");
+    }
+}
+
+/// @brief The idle task of a CPU, which runs when no other task is ready, and
+/// keeps the CPU halted until one is.
+/// @param data the runqueue of the CPU.
+/// @return never returns.
+static int __idle_task(void *data)
+{
+    runqueue_t *rq = (runqueue_t *)data;
+    bool_t mwait   = cpuid_has_monitor();
+    while (true) {
+        // Check with interrupts disabled, so that a wake up between the check
+        // and the halt cannot get lost.
+        uint8_t flags = irq_disable();
+        // Try to steal some work from the other CPUs first, there is none
+        // while the application processors are parked.
+        while (!rq->num_ready && !scheduler_load_balance(true)) {
+            __idle_wait(rq, mwait);
+            // Use the idle time to refresh the screen.
+            video_update();
         }
+        kthread_yield();
+        irq_enable(flags);
     }
-    return NULL;
+    return 0;
+}
+
+int scheduler_start_idle(void)
+{
+    for (unsigned cpu = 0; cpu < smp_num_cpus; ++cpu) {
+        task_struct *task = kthread_alloc(__idle_task, &runqueues[cpu], "idle");
+        if (task == NULL) {
+            return 0;
+        }
+        // It has no pid, it is not a task the others can see.
+        task->pid                = 0;
+        task->se.cpu             = cpu;
+        runqueues[cpu].idle_task = task;
+    }
+    return 1;
+}
+
+int scheduler_cpu_idle(void)
+{
+    task_struct *curr = this_rq()->curr;
+    return !curr || (curr == this_rq()->idle_task) || (curr->state != TASK_RUNNING);
+}
+
+list_head *scheduler_get_runqueue(void)
+{
+    return &this_rq()->queue;
 }
 
 void scheduler_enqueue_task(task_struct *process)
 {
     assert(process && "Received a NULL process.");
     // If current_process is NULL, then process is the current process.
-    if (runqueue.curr == NULL) {
-        runqueue.curr = process;
+    if (this_rq()->curr == NULL) {
+        this_rq()->curr = process;
     }
+    // New processes start on the CPU which created them.
+    process->se.cpu = smp_processor_id();
     // Add the new process at the end.
-    list_head_insert_before(&process->run_list, &runqueue.queue);
+    list_head_insert_before(&process->run_list, &this_rq()->queue);
+    // Index it by pid, process group and session.
+    hashmap_set(pid_hash, (void *)process->pid, process);
+    __pid_chain_attach(pgrp_hash, process->pgid, &process->pgrp_link);
+    __pid_chain_attach(session_hash, process->sid, &process->session_link);
     // Increment the number of active processes.
-    ++runqueue.num_active;
+    ++this_rq()->num_active;
+    // Make it ready to run.
+    if (process->state == TASK_RUNNING) {
+        __ready_insert(process);
+    }
 
 #ifdef ENABLE_SCHEDULER_FEEDBACK
     scheduler_feedback_task_add(process);
@@ -119,10 +469,19 @@ void scheduler_dequeue_task(task_struct *process)
     assert(process && "Received a NULL process.");
     // Delete the process from the list of running processes.
     list_head_remove(&process->run_list);
+    if (process->se.sched_class) {
+        __ready_remove(process);
+    }
     // Decrement the number of active processes.
-    --runqueue.num_active;
+    runqueue_t *rq = task_rq(process);
+    --rq->num_active;
     if (process->se.is_periodic) {
-        runqueue.num_periodic--;
+        rq->num_periodic--;
+        rq->utilization -= process->se.utilization_factor;
+        // Do not let rounding errors accumulate.
+        if (rq->num_periodic == 0) {
+            rq->utilization = 0;
+        }
     }
 
 #ifdef ENABLE_SCHEDULER_FEEDBACK
@@ -130,35 +489,240 @@ void scheduler_dequeue_task(task_struct *process)
 #endif
 }
 
+/// @brief Checks if a task can be moved to another CPU.
+/// @param rq the runqueue holding the task.
+/// @param process the task.
+/// @param now the current tick.
+/// @return true if it can be moved.
+static inline bool_t __can_migrate_task(runqueue_t *rq, runqueue_t *dst, task_struct *process, unsigned long now)
+{
+    // The task is not allowed to run there.
+    if (!(process->cpus_allowed & (1U << (dst - runqueues)))) {
+        return false;
+    }
+    // Only the ready tasks which are not running.
+    if ((process == rq->curr) || (process->se.sched_class == NULL)) {
+        return false;
+    }
+    // The periodic tasks were admitted by the utilization of their CPU, and
+    // the kernel threads keep running where they were started.
+    if (process->se.is_periodic || is_kthread(process)) {
+        return false;
+    }
+    // Leave the cache-hot tasks where their data is.
+    return (now - (process->se.exec_start + process->se.exec_runtime)) >= CACHE_HOT_TICKS;
+}
+
+/// @brief Moves a task, which is not running, between two runqueues.
+/// @param src the runqueue holding the task.
+/// @param dst the runqueue receiving the task.
+/// @param process the task.
+static inline void __migrate_task(runqueue_t *src, runqueue_t *dst, task_struct *process)
+{
+    bool_t ready = process->se.sched_class != NULL;
+    if (ready) {
+        __ready_remove(process);
+    }
+    list_head_remove(&process->run_list);
+    --src->num_active;
+    // The vruntime is relative to the timeline holding the task.
+    process->se.vruntime = process->se.vruntime - src->min_vruntime + dst->min_vruntime;
+    process->se.cpu      = dst - runqueues;
+    list_head_insert_before(&process->run_list, &dst->queue);
+    ++dst->num_active;
+    if (ready) {
+        __ready_insert(process);
+    }
+}
+
+/// @brief Checks if a CPU runs tasks, and not only its own loop.
+/// @param cpu the CPU.
+/// @return true if it runs tasks.
+static inline bool_t __cpu_runs_tasks(unsigned cpu)
+{
+    return cpus[cpu].online && (runqueues[cpu].curr != NULL);
+}
+
+/// @brief Moves a task which is not running to another runqueue, taking the
+/// locks of both in the order of the CPUs, as the balancer does.
+/// @param process the task.
+/// @param cpu the CPU receiving the task.
+static inline void __move_task(task_struct *process, unsigned cpu)
+{
+    runqueue_t *src = task_rq(process), *dst = &runqueues[cpu];
+    if (src == dst) {
+        return;
+    }
+    uint8_t flags      = irq_disable();
+    runqueue_t *first  = (src < dst) ? src : dst;
+    runqueue_t *second = (first == src) ? dst : src;
+    spinlock_lock(&first->lock);
+    spinlock_lock(&second->lock);
+    __migrate_task(src, dst, process);
+    spinlock_unlock(&second->lock);
+    spinlock_unlock(&first->lock);
+    irq_enable(flags);
+}
+
+/// @brief Chooses the CPU where a waking task runs.
+/// @param process the task.
+/// @param sync true if the waker is about to sleep.
+/// @return the CPU.
+/// @details The task prefers the CPU of the waker, if it is idle (or about to
+/// be), so that the data they share is still in its caches; otherwise, the
+/// CPU it ran on last.
+static inline unsigned __select_task_cpu(task_struct *process, int sync)
+{
+    unsigned prev = process->se.cpu, this = smp_processor_id();
+    // Wake affine.
+    if ((this != prev) && (process->cpus_allowed & (1U << this)) &&
+        (runqueues[this].num_ready <= (sync ? 1U : 0U)) && !is_kthread(process) && !process->se.is_periodic) {
+        return this;
+    }
+    if ((process->cpus_allowed & (1U << prev)) || is_kthread(process)) {
+        return prev;
+    }
+    for (unsigned cpu = 0; cpu < smp_num_cpus; ++cpu) {
+        if ((process->cpus_allowed & (1U << cpu)) && __cpu_runs_tasks(cpu)) {
+            return cpu;
+        }
+    }
+    return prev;
+}
+
+int scheduler_load_balance(bool_t idle)
+{
+    runqueue_t *rq = this_rq(), *busiest = NULL;
+    unsigned long now = timer_get_ticks();
+    int moved = 0;
+    if (!idle) {
+        if (now < rq->next_balance) {
+            return 0;
+        }
+        rq->next_balance = now + BALANCE_INTERVAL;
+    }
+    // Find the runqueue with the largest number of ready tasks.
+    for (unsigned cpu = 0; cpu < smp_num_cpus; ++cpu) {
+        if (cpus[cpu].online && (&runqueues[cpu] != rq) &&
+            (!busiest || (runqueues[cpu].num_ready > busiest->num_ready))) {
+            busiest = &runqueues[cpu];
+        }
+    }
+    // Moving a single task only moves the imbalance, unless we are idle.
+    if (!busiest || (busiest->num_ready < rq->num_ready + (idle ? 1 : 2))) {
+        return 0;
+    }
+    uint8_t flags = irq_disable();
+    // Take the locks in the order of the CPUs, so that two balancers do not
+    // wait for each other.
+    runqueue_t *first = (rq < busiest) ? rq : busiest;
+    spinlock_lock(&first->lock);
+    spinlock_lock(&((first == rq) ? busiest : rq)->lock);
+    // Pull half of the difference, one task if we are idle.
+    int imbalance = idle ? 1 : (int)(busiest->num_ready - rq->num_ready) / 2;
+    list_for_each_safe_decl(it, store, &busiest->queue)
+    {
+        if (moved >= imbalance) {
+            break;
+        }
+        task_struct *entry = list_entry(it, task_struct, run_list);
+        if (__can_migrate_task(busiest, rq, entry, now)) {
+            pr_debug("Moving process %d from CPU %u to CPU %u.\n", entry->pid, (unsigned)(busiest - runqueues), (unsigned)(rq - runqueues));
+            __migrate_task(busiest, rq, entry);
+            ++moved;
+        }
+    }
+    spinlock_unlock(&((first == rq) ? busiest : rq)->lock);
+    spinlock_unlock(&first->lock);
+    irq_enable(flags);
+    return moved;
+}
+
+/// @brief Frees the kernel threads, and the tasks nobody waits for, which exited.
+/// @details Called on the stack of a running task, thus not on theirs.
+static inline void __reap_dead_tasks(void)
+{
+    list_for_each_safe_decl(it, store, &dead_tasks)
+    {
+        task_struct *entry = list_entry(it, task_struct, run_list);
+        list_head_remove(&entry->run_list);
+        process_free_task(entry);
+    }
+}
+
+/// @brief Checks if the current task can keep the CPU, because it has not
+/// used its whole time slice yet.
+/// @param task the current task.
+/// @return true if the task is still inside its time slice.
+static inline bool_t __scheduler_in_timeslice(task_struct *task)
+{
+    unsigned timeslice;
+    if (task->state != TASK_RUNNING) {
+        return false;
+    }
+    if (task->se.sched_class == &rr_sched_class) {
+        timeslice = sched_rr_timeslice;
+    } else if (task->se.sched_class == &fair_sched_class) {
+        // The latency is split among the ready tasks, by weight.
+        unsigned long weight = GET_WEIGHT(task->se.prio);
+        unsigned long load   = max(task_rq(task)->fair_load, weight);
+        timeslice            = max((unsigned)((sched_latency * weight) / load), sched_min_granularity);
+    } else {
+        return false;
+    }
+    // The task was picked at exec_start.
+    return (timer_get_ticks() - task->se.exec_start) < timeslice;
+}
+
 void scheduler_run(pt_regs *f)
 {
     // Check if there is a running process.
-    if (runqueue.curr == NULL) {
+    if (this_rq()->curr == NULL) {
         return;
     }
+    // All processes share the same kernel stack, thus we cannot switch
+    // process if the interrupt preempted the kernel (e.g., a driver waiting
+    // for its IRQ with interrupts enabled). Kernel threads have their own
+    // stack, but they are switched only when they ask for it, with a system
+    // call, so that they can hold the same locks as the rest of the kernel.
+    if ((f->cs & 3) != 3) {
+        if (!is_kthread(this_rq()->curr) || (f->int_no != SYSTEM_CALL)) {
+            // Switch at the next chance, see cond_resched.
+            if ((f->int_no == (32 + IRQ_TIMER)) && !__scheduler_in_timeslice(this_rq()->curr)) {
+                this_rq()->need_resched = true;
+            }
+            return;
+        }
+    }
+    // No code of the current task is running inside the kernel, so none of
+    // it is inside a read-side section.
+    rcu_note_context_switch();
+    // We are not running on the stack of a dead kernel thread.
+    __reap_dead_tasks();
 
     task_struct *next = NULL;
 
     // Update the context of the current process.
-    scheduler_store_context(f, runqueue.curr);
+    scheduler_store_context(f, this_rq()->curr);
 
     // We check the existence of pending signals every time we finish
-    // handling an interrupt or an exception.
-    if (!do_signal(f)) {
+    // handling an interrupt or an exception, kernel threads do not handle
+    // signals. The flag keeps do_signal, and its lock, out of the common path.
+    if (is_kthread(this_rq()->curr) || !signal_pending(this_rq()->curr) || !do_signal(f)) {
 #if 1
-        if (runqueue.curr->state == EXIT_ZOMBIE) {
+        if (this_rq()->curr->state == EXIT_ZOMBIE) {
             //==== Handle Zombies =================================================
-            //pr_debug("Handle zombie %d\n", runqueue.curr->pid);
-            // get the next process after the current one
-            list_head *nNode = runqueue.curr->run_list.next;
-            // check if we reached the head of list_head
-            if (nNode == &runqueue.queue) {
-                nNode = nNode->next;
-            }
-            // get the task_struct
-            next = list_entry(nNode, task_struct, run_list);
+            //pr_debug("Handle zombie %d\n", this_rq()->curr->pid);
             // Remove the zombie task.
-            scheduler_dequeue_task(runqueue.curr);
+            scheduler_dequeue_task(this_rq()->curr);
+            // Nobody waits for kernel threads, they are freed from the next
+            // task, since we are still running on their stack. The same goes
+            // for the tasks without exit signal.
+            if (is_kthread(this_rq()->curr) || (this_rq()->curr->exit_signal == 0)) {
+                list_head_insert_before(&this_rq()->curr->run_list, &dead_tasks);
+            }
+            // The zombie is no longer ready, so another task is picked.
+            next = scheduler_pick_next_task(this_rq());
             assert(next && "No valid task selected after removing ZOMBIE.");
             //=====================================================================
         } else {
@@ -166,17 +730,35 @@ void scheduler_run(pt_regs *f)
             //==== Scheduling =====================================================
             // If we are currently executing a periodic process, and this process
             //  has yet to complete, keep executing it.
-#ifdef SCHEDULER_EDF
-            if (runqueue.curr->se.is_periodic)
-                if (!runqueue.curr->se.executed)
+#if !defined(SCHEDULER_RM) && !defined(SCHEDULER_AEDF)
+            if (this_rq()->curr->se.sched_class == &dl_sched_class)
+                if (!this_rq()->curr->se.executed)
                     return;
 #endif
+            // The ticks do not take the CPU away from a task which has not
+            // used its time slice yet, unless a more urgent one is waiting.
+            if ((f->int_no == (32 + IRQ_TIMER)) && !this_rq()->need_resched &&
+                __scheduler_in_timeslice(this_rq()->curr)) {
+                return;
+            }
             // Pointer to the next process to be executed.
-            next = scheduler_pick_next_task(&runqueue);
+            next = scheduler_pick_next_task(this_rq());
             //=====================================================================
         }
+        this_rq()->need_resched = false;
         // Check if the next and current processes are different.
-        if (next != runqueue.curr) {
+        if (next != this_rq()->curr) {
+            // Tell apart the tasks which went to sleep from the preempted ones.
+            if (this_rq()->curr->state == TASK_RUNNING) {
+                ++this_rq()->curr->rusage.nivcsw;
+            } else if (this_rq()->curr->state != EXIT_ZOMBIE) {
+                ++this_rq()->curr->rusage.nvcsw;
+            }
+            pmu_switch(this_rq()->curr);
+#ifdef ENABLE_LATENCY_TRACE
+            latency_task_running(next);
+#endif
+            trace_event(TRACE_SCHED_SWITCH, this_rq()->curr->pid, next->pid, this_rq()->curr->state, 0);
             // Copy into Kernel stack the next process's context.
             scheduler_restore_context(next, f);
         }
@@ -184,18 +766,82 @@ void scheduler_run(pt_regs *f)
     //==========================================================================
 }
 
+int preemptible(void)
+{
+    task_struct *curr = this_rq()->curr;
+    return (this_cpu()->preempt_count == 0) && (!curr || (curr->lock_depth == 0));
+}
+
+void set_need_resched(void)
+{
+    this_rq()->need_resched = true;
+}
+
+int need_resched(void)
+{
+    return this_rq()->need_resched;
+}
+
+void cond_resched(void)
+{
+    // The interrupts cannot be served while holding a spinlock.
+    if (this_cpu()->preempt_count) {
+        return;
+    }
+    // The system calls run with interrupts disabled: let the pending ones
+    // (e.g., the tick, a completed transfer) in.
+    if (!is_irq_enabled()) {
+        __asm__ __volatile__("sti; nop; cli" ::: "memory");
+    }
+    task_struct *curr = this_rq()->curr;
+    // Processes are switched on their way back to user mode.
+    if (curr && is_kthread(curr) && (curr->lock_depth == 0) && this_rq()->need_resched) {
+        kthread_yield();
+    }
+}
+
 void scheduler_store_context(pt_regs *f, task_struct *process)
 {
-    // Store the registers.
-    process->thread.regs = *f;
+    if (is_kthread(process)) {
+        // The frame stays on the stack of the thread.
+        process->thread.kframe = f;
+    } else {
+        // Store the registers.
+        process->thread.regs = *f;
+    }
 }
 
 void scheduler_restore_context(task_struct *process, pt_regs *f)
 {
+    if (process != this_rq()->curr) {
+        // Tell the classes which task stops running, if still ready, and
+        // which one starts.
+        task_struct *prev = this_rq()->curr;
+        this_rq()->curr     = process;
+        if (prev && prev->se.sched_class && prev->se.sched_class->put_prev_task) {
+            prev->se.sched_class->put_prev_task(this_rq(), prev);
+        }
+        if (process->se.sched_class && process->se.sched_class->set_next_task) {
+            process->se.sched_class->set_next_task(this_rq(), process);
+        }
+    }
     // Switch to the next process.
-    runqueue.curr = process;
+    this_rq()->curr = process;
+    if (is_kthread(process)) {
+        // Return from the frame on the stack of the thread.
+        scheduler_switch_frame = process->thread.kframe;
+        // Kernel threads only use the kernel mappings.
+        paging_switch_directory_va(paging_get_main_directory());
+        return;
+    }
+    // The processes return from the top of the kernel stack of the CPU,
+    // which is not where `f` is if we are leaving a kernel thread.
+    pt_regs *frame = (pt_regs *)(this_cpu()->kernel_stack - sizeof(pt_regs));
+    if (frame != f) {
+        scheduler_switch_frame = frame;
+    }
     // Restore the registers.
-    *f = process->thread.regs;
+    *frame = process->thread.regs;
     // TODO(enrico): Explain paging switch (ring 0 doesn't need page switching)
     // Switch to process page directory
     paging_switch_directory_va(process->mm->pgd);
@@ -204,13 +850,13 @@ void scheduler_restore_context(task_struct *process, pt_regs *f)
 void scheduler_enter_user_jmp(uintptr_t location, uintptr_t stack)
 {
     // Reset stack pointer for kernel.
-    tss_set_stack(0x10, initial_esp);
+    tss_set_stack(0x10, this_cpu()->kernel_stack);
 
     // update start execution time.
-    runqueue.curr->se.start_runtime = timer_get_ticks();
+    this_rq()->curr->se.start_runtime = timer_get_ticks();
 
     // last context switch time.
-    runqueue.curr->se.exec_start = timer_get_ticks();
+    this_rq()->curr->se.exec_start = timer_get_ticks();
 
     // Jump in location.
     enter_userspace(location, stack);
@@ -226,7 +872,11 @@ static inline int try_to_wake_up(task_struct *process, unsigned mode, int sync)
     // Only tasks in the state TASK_UNINTERRUPTIBLE can be woke up
     if (process->state == TASK_UNINTERRUPTIBLE || process->state == TASK_STOPPED) {
         // TODO(enrico): Recalc task priority
-        process->state = TASK_RUNNING;
+        // The task is not running anywhere, it can wake up on another CPU.
+        if ((smp_num_cpus > 1) && (process != task_rq(process)->curr)) {
+            __move_task(process, __select_task_cpu(process, sync));
+        }
+        scheduler_set_task_state(process, TASK_RUNNING);
         return 1;
     }
     return 0;
@@ -243,7 +893,7 @@ wait_queue_entry_t *sleep_on(wait_queue_head_t *wq)
     // Save the sleeping process registers state
     task_struct *sleeping_task = scheduler_get_current_process();
     // Stops task from runqueue making it unrunnable.
-    sleeping_task->state = TASK_UNINTERRUPTIBLE;
+    scheduler_set_task_state(sleeping_task, TASK_UNINTERRUPTIBLE);
 #if 0
     // Get the interrupt registers.
     pt_regs *f = get_current_interrupt_stack_frame();
@@ -252,7 +902,7 @@ wait_queue_entry_t *sleep_on(wait_queue_head_t *wq)
     // Select next process in the runqueue as the current, restore it's context,
     // we assume that the first process is init wich does not sleep (I hope).
     // This is necessary to make the scheduler_run() in syscall_handler work.
-    task_struct *next = scheduler_pick_next_task(&runqueue);
+    task_struct *next = scheduler_pick_next_task(this_rq());
     assert((next != sleeping_task) && "The next selected process in the runqueue is the sleeping process");
     scheduler_restore_context(next, f);
 #endif
@@ -270,67 +920,50 @@ int is_orphaned_pgrp(pid_t pgid)
     pid_t sid = 0;
 
     // Obtain SID of the group from a member
-    list_head *it;
-    list_for_each (it, &runqueue.queue) {
-        task_struct *task = list_entry(it, task_struct, run_list);
-        if (task->pgid == pgid) {
-            sid = task->sid;
-            break;
-        }
+    pid_chain_t *pgrp = (pid_chain_t *)hashmap_get(pgrp_hash, (void *)pgid);
+    if (pgrp && !list_head_empty(&pgrp->tasks)) {
+        sid = list_entry(pgrp->tasks.next, task_struct, pgrp_link)->sid;
     }
 
     // Check if the process leader of the session is alive
-    list_for_each (it, &runqueue.queue) {
-        task_struct *task = list_entry(it, task_struct, run_list);
-        if (task->pid == sid) {
-            return 0;
-        }
-    }
-
-    return 1;
+    return scheduler_get_running_process(sid) == NULL;
 }
 
 pid_t sys_getpid(void)
 {
     // Get the current task.
-    if (runqueue.curr == NULL) {
+    if (this_rq()->curr == NULL) {
         kernel_panic("There is no current process!");
     }
 
     // Return the process identifer of the process.
-    return runqueue.curr->pid;
+    return this_rq()->curr->pid;
 }
 
 pid_t sys_getsid(pid_t pid)
 {
     //If pid == 0 return SID of the calling process
     if (pid == 0) {
-        if (runqueue.curr == NULL) {
+        if (this_rq()->curr == NULL) {
             kernel_panic("There is no current process!");
         }
         // Return the session identifer of the process.
-        return runqueue.curr->sid;
+        return this_rq()->curr->sid;
     }
     //If != 0 get SID of the specified process
-    list_head *it;
-    list_for_each (it, &runqueue.queue) {
-        task_struct *task = list_entry(it, task_struct, run_list);
-        if (task->pid == pid) {
-            if (runqueue.curr->sid != task->sid) {
-                {
-                    return -EPERM;
-                }
-            }
-
-            return task->sid;
-        }
+    task_struct *task = scheduler_get_running_process(pid);
+    if (task == NULL) {
+        return -ESRCH;
+    }
+    if (this_rq()->curr->sid != task->sid) {
+        return -EPERM;
     }
-    return -ESRCH;
+    return task->sid;
 }
 
 pid_t sys_setsid(void)
 {
-    task_struct *task = runqueue.curr;
+    task_struct *task = this_rq()->curr;
     if (task == NULL) {
         kernel_panic("There is no current process!");
     }
@@ -339,8 +972,7 @@ pid_t sys_setsid(void)
         return -EPERM;
     }
 
-    task->sid  = task->pid;
-    task->pgid = task->pid;
+    __set_pgrp_session(task, task->pid, task->pid);
 
     return task->sid;
 }
@@ -349,7 +981,7 @@ pid_t sys_getpgid(pid_t pid)
 {
     task_struct *task = NULL;
     if (pid == 0) {
-        task = runqueue.curr;
+        task = this_rq()->curr;
     } else {
         task = scheduler_get_running_process(pid);
     }
@@ -363,7 +995,7 @@ int sys_setpgid(pid_t pid, pid_t pgid)
 {
     task_struct *task = NULL;
     if (pid == 0) {
-        task = runqueue.curr;
+        task = this_rq()->curr;
     } else {
         task = scheduler_get_running_process(pid);
     }
@@ -371,13 +1003,13 @@ int sys_setpgid(pid_t pid, pid_t pgid)
         if (task->pgid == task->pid) {
             pr_debug("Process %d is already a session leader.", task->pid);
         }
-        task->pgid = pgid;
+        __set_pgrp_session(task, pgid, task->sid);
     }
     return 0;
 }
 
 #define RETURN_PROCESS_ATTR_OR_EPERM(attr)             \
-    if (runqueue.curr) { return runqueue.curr->attr; } \
+    if (this_rq()->curr) { return this_rq()->curr->attr; } \
     return -EPERM;
 
 uid_t sys_getuid(void)
@@ -403,23 +1035,23 @@ gid_t sys_getegid(void)
 
 #define FAIL_ON_INV_ID_OR_PROC(id) \
     FAIL_ON_INV_ID(id)             \
-    if (!runqueue.curr) { return -EPERM; }
+    if (!this_rq()->curr) { return -EPERM; }
 
 #define IF_PRIVILEGED_SET_ALL_AND_RETURN(attr)               \
-    if (runqueue.curr->uid == 0) {                           \
-        runqueue.curr->r##attr = runqueue.curr->attr = attr; \
+    if (this_rq()->curr->uid == 0) {                           \
+        this_rq()->curr->r##attr = this_rq()->curr->attr = attr; \
         return 0;                                            \
     }
 
 #define IF_RESET_SET_AND_RETURN(attr)     \
-    if (runqueue.curr->r##attr == attr) { \
-        runqueue.curr->attr = attr;       \
+    if (this_rq()->curr->r##attr == attr) { \
+        this_rq()->curr->attr = attr;       \
         return 0;                         \
     }
 
 #define SET_IF_PRIVILEGED_OR_FAIL(attr) \
-    if (runqueue.curr->uid == 0) {      \
-        runqueue.curr->attr = attr;     \
+    if (this_rq()->curr->uid == 0) {      \
+        this_rq()->curr->attr = attr;     \
     } else {                            \
         return -EPERM;                  \
     }
@@ -442,13 +1074,13 @@ int sys_setgid(gid_t gid)
 
 int sys_setreuid(uid_t ruid, uid_t euid)
 {
-    if (!runqueue.curr) { return -EPERM; }
+    if (!this_rq()->curr) { return -EPERM; }
 
     if (euid != -1) {
         FAIL_ON_INV_ID(euid);
         // Privileged or reset?
-        if ((runqueue.curr->uid == 0) || (runqueue.curr->ruid == euid)) {
-            runqueue.curr->uid = euid;
+        if ((this_rq()->curr->uid == 0) || (this_rq()->curr->ruid == euid)) {
+            this_rq()->curr->uid = euid;
         } else {
             return -EPERM;
         }
@@ -463,13 +1095,13 @@ int sys_setreuid(uid_t ruid, uid_t euid)
 
 int sys_setregid(gid_t rgid, gid_t egid)
 {
-    if (!runqueue.curr) { return -EPERM; }
+    if (!this_rq()->curr) { return -EPERM; }
 
     if (egid != -1) {
         FAIL_ON_INV_ID(rgid);
         // Privileged or reset?
-        if ((runqueue.curr->uid == 0) || (runqueue.curr->rgid == egid)) {
-            runqueue.curr->gid = egid;
+        if ((this_rq()->curr->uid == 0) || (this_rq()->curr->rgid == egid)) {
+            this_rq()->curr->gid = egid;
         } else {
             return -EPERM;
         }
@@ -485,8 +1117,8 @@ int sys_setregid(gid_t rgid, gid_t egid)
 pid_t sys_getppid(void)
 {
     // Get the current task.
-    if (runqueue.curr && runqueue.curr->parent) {
-        return runqueue.curr->parent->pid;
+    if (this_rq()->curr && this_rq()->curr->parent) {
+        return this_rq()->curr->parent->pid;
     }
     return -EPERM;
 }
@@ -494,7 +1126,7 @@ pid_t sys_getppid(void)
 int sys_nice(int increment)
 {
     // Get the current task.
-    if (runqueue.curr == NULL) {
+    if (this_rq()->curr == NULL) {
         kernel_panic("There is no current process!");
     }
 
@@ -505,7 +1137,7 @@ int sys_nice(int increment)
         increment = 40;
     }
 
-    int newNice = PRIO_TO_NICE(runqueue.curr->se.prio) + increment;
+    int newNice = PRIO_TO_NICE(this_rq()->curr->se.prio) + increment;
     pr_debug("New nice value would be : %d\n", newNice);
 
     if (newNice < MIN_NICE) {
@@ -515,17 +1147,57 @@ int sys_nice(int increment)
         newNice = MAX_NICE;
     }
 
-    if (PRIO_TO_NICE(runqueue.curr->se.prio) != newNice && newNice >= MIN_NICE && newNice <= MAX_NICE) {
-        runqueue.curr->se.prio = NICE_TO_PRIO(newNice);
+    if (PRIO_TO_NICE(this_rq()->curr->se.prio) != newNice && newNice >= MIN_NICE && newNice <= MAX_NICE) {
+        scheduler_set_task_prio(this_rq()->curr, NICE_TO_PRIO(newNice));
     }
-    int actualNice = PRIO_TO_NICE(runqueue.curr->se.prio);
+    int actualNice = PRIO_TO_NICE(this_rq()->curr->se.prio);
 
     pr_debug("Actual new nice value is: %d\n", actualNice);
 
     return actualNice;
 }
 
-pid_t sys_waitpid(pid_t pid, int *status, int options)
+/// @brief Checks if a child is among the ones a waitpid is waiting for.
+/// @param child the child.
+/// @param pid the pid given to waitpid.
+/// @param pgid the process group of the waiting process.
+/// @return 1 if it is, 0 otherwise.
+static inline int __waitpid_match(task_struct *child, pid_t pid, pid_t pgid)
+{
+    if (pid > 0) {
+        return child->pid == pid;
+    }
+    if (pid == 0) {
+        return child->pgid == pgid;
+    }
+    if (pid < -1) {
+        return child->pgid == -pid;
+    }
+    return 1;
+}
+
+/// @brief Adds the resources used by a task to a total.
+/// @param total the total.
+/// @param rusage the resources used by the task.
+static inline void __rusage_add(task_rusage_t *total, const task_rusage_t *rusage)
+{
+    total->utime += rusage->utime;
+    total->stime += rusage->stime;
+    total->nvcsw += rusage->nvcsw;
+    total->nivcsw += rusage->nivcsw;
+    total->minflt += rusage->minflt;
+    total->majflt += rusage->majflt;
+}
+
+/// @brief Reaps a child which exited.
+/// @param pid the children to wait for, as for waitpid.
+/// @param status where the exit status is stored, if not NULL.
+/// @param options WNOHANG, WUNTRACED.
+/// @param rusage where the resources used by the child, and by its children,
+/// are stored, if not NULL.
+/// @return the pid of the child, 0 if none exited and WNOHANG is set, -errno
+/// on failure.
+static pid_t __do_wait(pid_t pid, int *status, int options, task_rusage_t *rusage)
 {
     task_struct *current_process, *entry;
     // Get the current process.
@@ -534,11 +1206,6 @@ pid_t sys_waitpid(pid_t pid, int *status, int options)
     if (current_process == NULL) {
         kernel_panic("There is no current process!");
     }
-    // For now we do not support waiting for processes inside the given process
-    // group (pid < -1).
-    if ((pid < -1) || (pid == 0)) {
-        return -ESRCH;
-    }
     // Check if the pid we are waiting for is the process itself.
     if (pid == current_process->pid) {
         return -ECHILD;
@@ -547,26 +1214,12 @@ pid_t sys_waitpid(pid_t pid, int *status, int options)
     if ((options != 0) && !bit_check(options, WNOHANG) && !bit_check(options, WUNTRACED)) {
         return -EINVAL;
     }
-    // Check if there are children to wait.
-    if (list_head_empty(&current_process->children)) {
-        return -ECHILD;
-    }
-    // Iterate the children.
-    list_for_each_decl(it, &current_process->children)
+    // The children which exited are kept apart, waiting for any of them
+    // takes the first one.
+    list_for_each_decl(it, &current_process->zombies)
     {
-        // Get the entry.
         entry = list_entry(it, task_struct, sibling);
-        // Check the entry.
-        if (entry == NULL) {
-            continue;
-        }
-        // If the entry is not in a zombie state, keep searching.
-        if (entry->state != EXIT_ZOMBIE) {
-            continue;
-        }
-        // If a pid was provided, and is different from the pid we are
-        // exhamining, skip it.
-        if ((pid > 1) && (entry->pid != pid)) {
+        if (!__waitpid_match(entry, pid, current_process->pgid)) {
             continue;
         }
         // Save the pid to return.
@@ -575,74 +1228,143 @@ pid_t sys_waitpid(pid_t pid, int *status, int options)
         if (status) {
             (*status) = entry->exit_code;
         }
-        // Finalize the VFS structures.
-        vfs_destroy_task(entry);
-        // Remove entry from children of parent.
+        // Remove entry from the zombie children of parent.
         list_head_remove(&entry->sibling);
-        // Remove entry from the scheduling queue.
-        scheduler_dequeue_task(entry);
-        // Delete the task_struct.
-        kmem_cache_free(entry);
+        // The parent collects the resources used by the child, and by its
+        // own waited-for children.
+        __rusage_add(&current_process->crusage, &entry->rusage);
+        __rusage_add(&current_process->crusage, &entry->crusage);
+        if (rusage) {
+            *rusage = entry->rusage;
+            __rusage_add(rusage, &entry->crusage);
+        }
+        // The scheduler usually removed it once it stopped running.
+        if (!list_head_empty(&entry->run_list)) {
+            scheduler_dequeue_task(entry);
+        }
+        // Finalize the VFS structures, and delete the task_struct.
+        process_free_task(entry);
         pr_debug("Process %d is freeing memory of process %d.\n", current_process->pid, ppid);
         return ppid;
     }
-    return 0;
+    // Check if there are children which might exit.
+    int found = 0;
+    list_for_each_decl(it, &current_process->children)
+    {
+        if (__waitpid_match(list_entry(it, task_struct, sibling), pid, current_process->pgid)) {
+            found = 1;
+            break;
+        }
+    }
+    if (!found) {
+        return -ECHILD;
+    }
+    if (bit_check(options, WNOHANG)) {
+        return 0;
+    }
+    // Sleep until a child exits, then look again.
+    sleep_on(&current_process->wait_chldexit)->func = autoremove_wake_function;
+    return -ERESTARTSYS;
+}
+
+pid_t sys_waitpid(pid_t pid, int *status, int options)
+{
+    return __do_wait(pid, status, options, NULL);
+}
+
+pid_t sys_wait4(pid_t pid, int *status, int options, struct rusage *usage)
+{
+    task_rusage_t rusage;
+    pid_t ret = __do_wait(pid, status, options, usage ? &rusage : NULL);
+    if (usage && (ret > 0)) {
+        timer_rusage_to_user(usage, &rusage);
+    }
+    return ret;
+}
+
+/// @brief Gives the children of an exiting process to init.
+/// @param from the list of children, emptied.
+/// @param to the list of children of init.
+/// @param init_proc the init process.
+static inline void __reparent_children(list_head *from, list_head *to, task_struct *init_proc)
+{
+    list_head *it;
+    while ((it = list_head_pop(from))) {
+        task_struct *entry = list_entry(it, task_struct, sibling);
+        pr_debug("    [%d] %s\n", entry->pid, entry->name);
+        entry->parent = init_proc;
+        list_head_insert_before(it, to);
+    }
 }
 
 void do_exit(int exit_code)
 {
     // Get the current task.
-    if (runqueue.curr == NULL) {
+    if (this_rq()->curr == NULL) {
         kernel_panic("There is no current process!");
     }
 
     // Get the process.
     task_struct *init_proc = scheduler_get_running_process(1);
-    if (runqueue.curr == init_proc) {
+    if (this_rq()->curr == init_proc) {
         kernel_panic("Init process cannot call sys_exit!");
     }
 
+    // Stop the real and sleep timers, which refer to the process.
+    hrtimer_cancel(&this_rq()->curr->real_timer);
+    hrtimer_cancel(&this_rq()->curr->sleep_timer);
     // Set the termination code of the process.
-    runqueue.curr->exit_code = exit_code;
+    this_rq()->curr->exit_code = exit_code;
+    // The FPU registers of the process are no longer needed.
+    fpu_release_task(this_rq()->curr);
+    // Undo the semaphore operations, as the process asked.
+    sem_exit(this_rq()->curr->pid);
+    // Leave the queues of the files it was polling.
+    poll_release(this_rq()->curr);
+    // Abandon its asynchronous requests, the devices still fill their buffers.
+    aio_exit(this_rq()->curr);
+    // Close its files now, the readers of its pipes must not wait for the
+    // parent to reap it before seeing the end of file.
+    vfs_close_task_files(this_rq()->curr);
+    // Tell the threads waiting for it, while its memory is still there.
+    process_clear_child_tid(this_rq()->curr);
     // Set the state of the process to zombie.
-    runqueue.curr->state = EXIT_ZOMBIE;
-    // Send a SIGCHLD to the parent process.
-    if (runqueue.curr->parent) {
-        int ret = sys_kill(runqueue.curr->parent->pid, SIGCHLD);
+    scheduler_set_task_state(this_rq()->curr, EXIT_ZOMBIE);
+    if (this_rq()->curr->exit_signal == 0) {
+        // Nobody waits for it, the scheduler frees it.
+        list_head_remove(&this_rq()->curr->sibling);
+    } else if (this_rq()->curr->parent) {
+        // Move to the children which exited, and wake up the parent if it
+        // is waiting for them.
+        list_head_remove(&this_rq()->curr->sibling);
+        list_head_insert_before(&this_rq()->curr->sibling, &this_rq()->curr->parent->zombies);
+        wake_up(&this_rq()->curr->parent->wait_chldexit);
+        // Send the exit signal, usually SIGCHLD, to the parent process.
+        int ret = sys_kill(this_rq()->curr->parent->pid, this_rq()->curr->exit_signal);
         if (ret == -1) {
-            pr_err("[%d] %5d failed sending signal %d : %s\n", ret, runqueue.curr->parent->pid,
-                   SIGCHLD, strerror(errno));
+            pr_err("[%d] %5d failed sending signal %d : %s\n", ret, this_rq()->curr->parent->pid,
+                   this_rq()->curr->exit_signal, strerror(errno));
         }
     }
 
     // If it has children, then init process has to take care of them.
-    if (!list_head_empty(&runqueue.curr->children)) {
+    if (!list_head_empty(&this_rq()->curr->children) || !list_head_empty(&this_rq()->curr->zombies)) {
         pr_debug("Moving children of %s(%d) to init(%d): {\n",
-                 runqueue.curr->name, runqueue.curr->pid, init_proc->pid);
-        // Change the parent.
-        pr_debug("Moving children (%d): {\n", init_proc->pid);
-        list_for_each_decl(it, &runqueue.curr->children)
-        {
-            task_struct *entry = list_entry(it, task_struct, sibling);
-            pr_debug("    [%d] %s\n", entry->pid, entry->name);
-            entry->parent = init_proc;
-        }
+                 this_rq()->curr->name, this_rq()->curr->pid, init_proc->pid);
+        __reparent_children(&this_rq()->curr->children, &init_proc->children, init_proc);
+        __reparent_children(&this_rq()->curr->zombies, &init_proc->zombies, init_proc);
         pr_debug("}\n");
-        // Plug the list of children.
-        list_head_append(&init_proc->children, &runqueue.curr->children);
-        // Print the list of children.
-        pr_debug("New list of init children (%d): {\n", init_proc->pid);
-        list_for_each_decl(it, &init_proc->children)
-        {
-            task_struct *entry = list_entry(it, task_struct, sibling);
-            pr_debug("    [%d] %s\n", entry->pid, entry->name);
+        // Some of them might be waiting already.
+        if (!list_head_empty(&init_proc->zombies)) {
+            wake_up(&init_proc->wait_chldexit);
         }
-        pr_debug("}\n");
     }
-    // Free the space occupied by the stack.
-    destroy_process_image(runqueue.curr->mm);
+    // Give the memory borrowed with vfork back, and drop our reference, the
+    // memory is freed with the last task using it.
+    process_release_vfork_mm(this_rq()->curr);
+    release_process_image(this_rq()->curr->mm);
     // Debugging message.
-    pr_debug("Process %d exited with value %d\n", runqueue.curr->pid, exit_code);
+    pr_debug("Process %d exited with value %d\n", this_rq()->curr->pid, exit_code);
 }
 
 void sys_exit(int exit_code)
@@ -650,39 +1372,98 @@ void sys_exit(int exit_code)
     do_exit(exit_code << 8);
 }
 
+/// @brief Sets the scheduling policy, and the parameters, of a process.
+/// @param entry The process.
+/// @param policy The new policy.
+/// @param param The new parameters.
+/// @return 0 on success, a negative value on error.
+static int __sched_setscheduler(task_struct *entry, int policy, const sched_param_t *param)
+{
+    if ((param->sched_priority < MAX_RT_PRIO) || (param->sched_priority >= MAX_PRIO)) {
+        return -EINVAL;
+    }
+    bool_t is_periodic = policy == SCHED_DEADLINE;
+    if (!entry->se.is_periodic && is_periodic) {
+        this_rq()->num_periodic++;
+        this_rq()->utilization += entry->se.utilization_factor;
+    } else if (entry->se.is_periodic && !is_periodic) {
+        this_rq()->num_periodic--;
+        this_rq()->utilization -= entry->se.utilization_factor;
+    }
+    // The task might move to another class, and the keys used to order it
+    // are changing, so take it out of its class first.
+    bool_t ready = entry->se.sched_class != NULL;
+    if (ready) {
+        __ready_remove(entry);
+    }
+    // Sets the parameters from param to the "se" struct parameters.
+    entry->se.policy      = policy;
+    entry->se.prio        = param->sched_priority;
+    entry->se.period      = param->period;
+    entry->se.arrivaltime = param->arrivaltime;
+    entry->se.is_periodic = is_periodic;
+    entry->se.deadline    = timer_get_ticks() + param->deadline;
+    entry->se.next_period = timer_get_ticks();
+
+    entry->se.is_under_analysis = true;
+    entry->se.executed          = false;
+    if (ready) {
+        __ready_insert(entry);
+    }
+    return 0;
+}
+
 int sys_sched_setparam(pid_t pid, const sched_param_t *param)
 {
     list_head *it;
     // Iter over the runqueue to find the task
-    list_for_each (it, &runqueue.queue) {
+    list_for_each (it, &this_rq()->queue) {
         task_struct *entry = list_entry(it, task_struct, run_list);
         if (entry->pid == pid) {
-            if (!entry->se.is_periodic && param->is_periodic) {
-                runqueue.num_periodic++;
-            } else if (entry->se.is_periodic && !param->is_periodic) {
-                runqueue.num_periodic--;
+            // Periodic tasks are handled by SCHED_DEADLINE, aperiodic ones keep
+            // their policy, or go back to the default one.
+            int policy = entry->se.policy;
+            if (param->is_periodic) {
+                policy = SCHED_DEADLINE;
+            } else if (policy == SCHED_DEADLINE) {
+                policy = sched_default_policy;
             }
-            // Sets the parameters from param to the "se" struct parameters.
-            entry->se.prio        = param->sched_priority;
-            entry->se.period      = param->period;
-            entry->se.arrivaltime = param->arrivaltime;
-            entry->se.is_periodic = param->is_periodic;
-            entry->se.deadline    = timer_get_ticks() + param->deadline;
-            entry->se.next_period = timer_get_ticks();
-
-            entry->se.is_under_analysis = true;
-            entry->se.executed          = false;
-            return 1;
+            int ret = __sched_setscheduler(entry, policy, param);
+            return (ret < 0) ? ret : 1;
         }
     }
     return -1;
 }
 
+int sys_sched_setscheduler(pid_t pid, int policy, const sched_param_t *param)
+{
+    if ((policy != SCHED_OTHER) && (policy != SCHED_RR) && (policy != SCHED_IDLE) && (policy != SCHED_DEADLINE)) {
+        return -EINVAL;
+    }
+    if (param == NULL) {
+        return -EINVAL;
+    }
+    task_struct *entry = (pid == 0) ? this_rq()->curr : scheduler_get_running_process(pid);
+    if (entry == NULL) {
+        return -ESRCH;
+    }
+    return __sched_setscheduler(entry, policy, param);
+}
+
+int sys_sched_getscheduler(pid_t pid)
+{
+    task_struct *entry = (pid == 0) ? this_rq()->curr : scheduler_get_running_process(pid);
+    if (entry == NULL) {
+        return -ESRCH;
+    }
+    return entry->se.policy;
+}
+
 int sys_sched_getparam(pid_t pid, sched_param_t *param)
 {
     list_head *it;
     // Iter over the runqueue to find the task
-    list_for_each (it, &runqueue.queue) {
+    list_for_each (it, &this_rq()->queue) {
         task_struct *entry = list_entry(it, task_struct, run_list);
         if (entry->pid == pid) {
             //Sets the parameters from the "se" struct to param
@@ -696,14 +1477,133 @@ int sys_sched_getparam(pid_t pid, sched_param_t *param)
     return -1;
 }
 
+/// @brief Moves the current task behind the other ready ones of its class.
+static inline void __yield_task(void)
+{
+    task_struct *curr = this_rq()->curr;
+    if (curr->se.sched_class && curr->se.sched_class->yield_task) {
+        curr->se.sched_class->yield_task(this_rq());
+    }
+}
+
+int sys_sched_yield(void)
+{
+    __yield_task();
+    return 0;
+}
+
+int sys_sched_setaffinity(pid_t pid, size_t len, const uint32_t *mask)
+{
+    if (mask == NULL) {
+        return -EFAULT;
+    }
+    if (len < sizeof(uint32_t)) {
+        return -EINVAL;
+    }
+    task_struct *task = pid ? scheduler_get_running_process(pid) : this_rq()->curr;
+    if (task == NULL) {
+        return -ESRCH;
+    }
+    // Only the CPUs which are there count.
+    uint32_t allowed = *mask & ((smp_num_cpus < 32) ? ((1U << smp_num_cpus) - 1) : ~0U);
+    unsigned target  = smp_num_cpus;
+    for (unsigned cpu = 0; cpu < smp_num_cpus; ++cpu) {
+        if ((allowed & (1U << cpu)) && __cpu_runs_tasks(cpu)) {
+            target = cpu;
+            break;
+        }
+    }
+    if (target == smp_num_cpus) {
+        return -EINVAL;
+    }
+    task->cpus_allowed = allowed;
+    // The kernel threads stay where they are, the running tasks move when
+    // they next wake up.
+    if (!(allowed & (1U << task->se.cpu)) && !is_kthread(task) && (task != task_rq(task)->curr)) {
+        __move_task(task, target);
+    }
+    return 0;
+}
+
+int sys_sched_getaffinity(pid_t pid, size_t len, uint32_t *mask)
+{
+    if (mask == NULL) {
+        return -EFAULT;
+    }
+    if (len < sizeof(uint32_t)) {
+        return -EINVAL;
+    }
+    task_struct *task = pid ? scheduler_get_running_process(pid) : this_rq()->curr;
+    if (task == NULL) {
+        return -ESRCH;
+    }
+    *mask = task->cpus_allowed & ((smp_num_cpus < 32) ? ((1U << smp_num_cpus) - 1) : ~0U);
+    return sizeof(uint32_t);
+}
+
+int sys_sched_yield_to(pid_t pid)
+{
+    task_struct *target = scheduler_get_running_process(pid);
+    if (target == NULL) {
+        return -ESRCH;
+    }
+    __yield_task();
+    // The scheduler checks the target when it picks, on the way out.
+    if (target != this_rq()->curr) {
+        this_rq()->yield_to = pid;
+    }
+    return 0;
+}
+
+/// @brief Computes the worst case response time of a periodic process, given
+/// the interference of the periodic processes with a shorter period.
+/// @param entry The process.
+/// @return The response time, it stops growing once it passes the deadline.
+static time_t __response_time(task_struct *entry)
+{
+    task_struct *previous;
+    // Put r equal to worst case exec because is the first point in time
+    // that the task could possibly complete.
+    time_t r = entry->se.worst_case_exec, previous_r = 0;
+    // The analysis can be completed either missing the deadline or reaching
+    // a fixed point.
+    while ((r < entry->se.deadline) && (r != previous_r)) {
+        // Save the previous response time.
+        previous_r = r;
+        // Initialize response time.
+        r = entry->se.worst_case_exec;
+        list_for_each_decl(it, &this_rq()->queue)
+        {
+            previous = list_entry(it, task_struct, run_list);
+            // Check the interferences of higher priority processes.
+            if (previous->se.is_periodic && (previous->se.period < entry->se.period)) {
+                pr_debug("%d += (%.2f / %.2f) * %d\n",
+                         r,
+                         (double)previous_r,
+                         (double)previous->se.period,
+                         previous->se.worst_case_exec);
+
+                // Update the response time.
+                r += (int)ceil((double)previous_r / (double)previous->se.period) * previous->se.worst_case_exec;
+
+                pr_debug("Response Time Analysis -> [%s] vs [%s] R = %d\n\n", entry->name, previous->name, r);
+            }
+        }
+    }
+    return r;
+}
+
 /// @brief Performs the response time analysis for the current list of periodic
-/// processes.
-/// @return 1 if scheduling periodic processes is feasible, 0 otherwise.
-static int __response_time_analysis(void)
+/// processes, after the worst case execution time of one of them has changed.
+/// @param changed The process whose worst case execution time has changed.
+/// @return 1 if scheduling periodic processes is not feasible, 0 otherwise.
+/// @details A process only interferes with the processes with a longer, or
+/// equal, period; the response times of the others are still valid, and are
+/// taken from the previous analysis.
+static int __response_time_analysis(task_struct *changed)
 {
-    task_struct *entry, *previous;
-    time_t r, previous_r = 0;
-    list_for_each_decl(it, &runqueue.queue)
+    task_struct *entry;
+    list_for_each_decl(it, &this_rq()->queue)
     {
         // Get the curent entry in the list.
         entry = list_entry(it, task_struct, run_list);
@@ -711,59 +1611,29 @@ static int __response_time_analysis(void)
         if (!entry->se.is_periodic) {
             continue;
         }
-        // Put r equal to worst case exec because is the first point in time
-        // that the task could possibly complete.
-        r = entry->se.worst_case_exec, previous_r = 0;
-        // The analysis can be completed either missing the deadline or reaching
-        // a fixed point.
-        while ((r < entry->se.deadline) && (r != previous_r)) {
-            // Save the previous response time.
-            previous_r = r;
-            // Initialize response time.
-            r = entry->se.worst_case_exec;
-            list_for_each_decl(it2, &runqueue.queue)
-            {
-                previous = list_entry(it2, task_struct, run_list);
-                // Check the interferences of higher priority processes.
-                if (previous->se.is_periodic && (previous->se.period < entry->se.period)) {
-                    pr_debug("%d += (%.2f / %.2f) * %d\n",
-                             r,
-                             (double)previous_r,
-                             (double)previous->se.period,
-                             previous->se.worst_case_exec);
-
-                    // Update the response time.
-                    r += (int)ceil((double)previous_r / (double)previous->se.period) * previous->se.worst_case_exec;
-
-                    pr_debug("Response Time Analysis -> [%s] vs [%s] R = %d\n\n", entry->name, previous->name, r);
-                }
-            }
+        // Update the response time of the affected processes.
+        if ((entry == changed) || (entry->se.period >= changed->se.period)) {
+            entry->se.response_time = __response_time(entry);
         }
         // Feasibility of scheduler is guaranteed if and only if response time
         // analysis is lower than deadline.
-        if (r > entry->se.deadline) {
+        if (entry->se.response_time > entry->se.deadline) {
             return 1;
         }
     }
     return 0;
 }
 
-/// @brief Computes the total utilization factor.
-/// @return the utilization factor.
-static inline double __compute_utilization_factor(void)
+/// @brief Sets the utilization factor of a process, keeping the total
+/// utilization factor up to date.
+/// @param task The process.
+/// @param factor The new utilization factor.
+static inline void __set_utilization_factor(task_struct *task, double factor)
 {
-    task_struct *entry;
-    double U = 0;
-    list_for_each_decl(it, &runqueue.queue)
-    {
-        // Get the entry.
-        entry = list_entry(it, task_struct, run_list);
-        // Sum the utilization factor of all periodic tasks.
-        if (entry->se.is_periodic) {
-            U += entry->se.utilization_factor;
-        }
+    if (task->se.is_periodic) {
+        this_rq()->utilization += factor - task->se.utilization_factor;
     }
-    return U;
+    task->se.utilization_factor = factor;
 }
 
 int sys_waitperiod(void)
@@ -782,6 +1652,12 @@ int sys_waitperiod(void)
     }
     // Get the current time.
     time_t current_time = timer_get_ticks();
+    // The keys of the queues of periodic tasks are changing, and the task can
+    // move to SCHED_DEADLINE once its analysis is completed.
+    bool_t ready = current->se.sched_class != NULL;
+    if (ready) {
+        __ready_remove(current);
+    }
 
     // Update the Worst Case Execution Time (WCET).
     time_t wcet = current_time - current->se.exec_start;
@@ -789,7 +1665,7 @@ int sys_waitperiod(void)
         current->se.worst_case_exec = wcet;
     }
     // Update the utilization factor.
-    current->se.utilization_factor = ((double)current->se.worst_case_exec / (double)current->se.period);
+    __set_utilization_factor(current, (double)current->se.worst_case_exec / (double)current->se.period);
     // If the task is under analysis, we need to test if the process can be
     // placed with the other periodic tasks.
     if (current->se.is_under_analysis) {
@@ -797,9 +1673,9 @@ int sys_waitperiod(void)
         current->se.worst_case_exec = current->se.sum_exec_runtime;
         // This will keep track if the process can be scheduled.
         bool_t is_not_schedulable = false;
-#if defined(SCHEDULER_EDF)
-        // Compute the total utilization factor.
-        double u = __compute_utilization_factor();
+#if !defined(SCHEDULER_RM) && !defined(SCHEDULER_AEDF)
+        // The total utilization factor is kept up to date.
+        double u = this_rq()->utilization;
         // If the utilization factor is above 1, the process cannot be placed
         // with the other periodic processes.
         if (u > 1) {
@@ -807,11 +1683,11 @@ int sys_waitperiod(void)
         }
         pr_warning("Utilization factor is : %.2f\n", u);
 #elif defined(SCHEDULER_RM)
-        // Compute the total utilization factor.
-        double u = __compute_utilization_factor();
+        // The total utilization factor is kept up to date.
+        double u = this_rq()->utilization;
         // Calculating Least Upper Bound of utilization factor. For large amount
         // of processes ulub asymptotically should reach ln(2).
-        double ulub = (runqueue.num_periodic * (pow(2, (1.0 / runqueue.num_periodic)) - 1));
+        double ulub = (this_rq()->num_periodic * (pow(2, (1.0 / this_rq()->num_periodic)) - 1));
         // If the sum of utilization factor is bounded between ulub and 1 we
         // need to calculate the response time analysis for each process.
         if (u > 1) {
@@ -819,12 +1695,16 @@ int sys_waitperiod(void)
         } else if (u <= ulub) {
             is_not_schedulable = false;
         } else {
-            is_not_schedulable = __response_time_analysis();
+            is_not_schedulable = __response_time_analysis(current);
         }
         pr_warning("Utilization factor is : %.2f, Least Upper Bound: %.2f\n", u, ulub);
 #endif
-        // If it is not schedulable, we need to tell it to the process.
+        // If it is not schedulable, we need to tell it to the process, which
+        // is still under analysis, and thus keeps running as an aperiodic one.
         if (is_not_schedulable) {
+            if (ready) {
+                __ready_insert(current);
+            }
             return -ENOTSCHEDULABLE;
         }
         // Otherwise, it is schedulable and thus it is not under analysis
@@ -842,5 +1722,9 @@ int sys_waitperiod(void)
     }
     // Tell the scheduler that we have executed the periodic process.
     current->se.executed = true;
+    // Wait for the next period.
+    if (ready) {
+        __ready_insert(current);
+    }
     return 0;
 }
@@ -1,5 +1,5 @@
 /// @file scheduler_algorithm.c
-/// @brief Round Robin algorithm.
+/// @brief Scheduling classes and algorithms.
 /// @copyright (c) 2014-2024 This file is distributed under the MIT License.
 /// See LICENSE.md for details.
 
@@ -10,125 +10,366 @@
 #include "io/debug.h"                    // Include debugging functions.
 
 #include "assert.h"
+#include "hardware/smp.h"
 #include "hardware/timer.h"
+#include "io/video.h"
 #include "process/prio.h"
 #include "process/scheduler.h"
 #include "process/scheduler_feedback.h"
 #include "process/wait.h"
+#include "string.h"
 #include "sys/list_head.h"
 
 /// @brief Updates task execution statistics.
 /// @param task the task to update.
 static void __update_task_statistics(task_struct *task);
 
-/// @brief Checks if the given task is actually a periodic task.
-/// @param task the task to check.
-/// @return true if the task is periodic, false otherwise.
-static inline bool_t __is_periodic_task(task_struct *task)
+/// @brief Returns the task with the smallest, or the largest, key of a tree.
+/// @param tree The tree.
+/// @param dir 0 for the smallest key, 1 for the largest.
+/// @return The task, NULL if the tree is empty.
+static inline task_struct *__rbtree_first(rbtree_t *tree, int dir)
 {
-    // Check if the task is a periodic one and it is not under analysis.
-    return task->se.is_periodic && !task->se.is_under_analysis;
+    rbtree_node_t *node = rbtree_tree_get_root(tree);
+    if (node == NULL) {
+        return NULL;
+    }
+    while (rbtree_node_get_link(node, dir)) {
+        node = rbtree_node_get_link(node, dir);
+    }
+    return rbtree_node_get_value(node);
+}
+
+/// @brief Orders two tasks by the given keys, and then by pid.
+/// @param a The first task.
+/// @param b The second task.
+/// @param key_a The key of the first task.
+/// @param key_b The key of the second task.
+/// @return the sign of the difference between the two tasks.
+static inline int __compare_keys(task_struct *a, task_struct *b, time_t key_a, time_t key_b)
+{
+    if (key_a != key_b) {
+        return (key_a > key_b) ? 1 : -1;
+    }
+    return (a->pid > b->pid) - (a->pid < b->pid);
+}
+
+// ============================================================================
+// SCHED_DEADLINE
+// ============================================================================
+
+/// @brief Compares two tasks of the queue of executable periodic tasks.
+/// @param tree The queue.
+/// @param a The node of the first task.
+/// @param b The node of the second task.
+/// @return the sign of the difference between the two tasks.
+static int __dl_ready_compare(rbtree_t *tree, rbtree_node_t *a, rbtree_node_t *b)
+{
+    (void)tree;
+    task_struct *task_a = rbtree_node_get_value(a), *task_b = rbtree_node_get_value(b);
+#ifdef SCHEDULER_RM
+    // Rate Monotonic: the shorter the period, the higher the priority.
+    return __compare_keys(task_a, task_b, task_a->se.period, task_b->se.period);
+#else
+    // Earliest Deadline First.
+    return __compare_keys(task_a, task_b, task_a->se.deadline, task_b->se.deadline);
+#endif
+}
+
+/// @brief Compares two tasks of the queue of periodic tasks waiting for their period.
+/// @param tree The queue.
+/// @param a The node of the first task.
+/// @param b The node of the second task.
+/// @return the sign of the difference between the two tasks.
+static int __dl_waiting_compare(rbtree_t *tree, rbtree_node_t *a, rbtree_node_t *b)
+{
+    (void)tree;
+    task_struct *task_a = rbtree_node_get_value(a), *task_b = rbtree_node_get_value(b);
+    return __compare_keys(task_a, task_b, task_a->se.next_period, task_b->se.next_period);
+}
+
+/// @brief Initializes the queues of periodic tasks.
+/// @param runqueue the runqueue.
+static void __dl_initialize(runqueue_t *runqueue)
+{
+    runqueue->rt_ready   = rbtree_tree_create(__dl_ready_compare);
+    runqueue->rt_waiting = rbtree_tree_create(__dl_waiting_compare);
+}
+
+/// @brief Adds a ready periodic task to the queue matching its state.
+/// @param runqueue the runqueue.
+/// @param process the task.
+static void __dl_enqueue_task(runqueue_t *runqueue, task_struct *process)
+{
+    assert(!process->se.rt_queue && "The task is already queued.");
+#ifdef SCHEDULER_AEDF
+    // Periods are not enforced, the task can always execute.
+    process->se.rt_queue = runqueue->rt_ready;
+#else
+    process->se.rt_queue = process->se.executed ? runqueue->rt_waiting : runqueue->rt_ready;
+#endif
+    rbtree_tree_insert(process->se.rt_queue, process);
+}
+
+/// @brief Removes a task from the queues of periodic tasks.
+/// @param runqueue the runqueue.
+/// @param process the task.
+static void __dl_dequeue_task(runqueue_t *runqueue, task_struct *process)
+{
+    if (process->se.rt_queue) {
+        rbtree_tree_remove(process->se.rt_queue, process);
+        process->se.rt_queue = NULL;
+    }
+}
+
+/// @brief Starts the new period of the tasks waiting for it, making them
+/// executable again, and propagating their deadline and next period.
+/// @param runqueue the runqueue.
+/// @param now the current time.
+static inline void __dl_activate(runqueue_t *runqueue, time_t now)
+{
+    task_struct *entry;
+    while ((entry = __rbtree_first(runqueue->rt_waiting, 0)) && (entry->se.next_period <= now)) {
+        // The keys are changing, take it out of the queue first.
+        __dl_dequeue_task(runqueue, entry);
+        entry->se.executed = false;
+        entry->se.deadline += entry->se.period;
+        entry->se.next_period += entry->se.period;
+        pr_debug("[%9d] Activating task '%16s' [period:%d], deadline:%5d; next_period:%5d, WCET:%6d\t\n",
+                 now,
+                 entry->name,
+                 entry->se.period,
+                 entry->se.deadline,
+                 entry->se.next_period,
+                 entry->se.worst_case_exec);
+        __dl_enqueue_task(runqueue, entry);
+    }
+}
+
+/// @brief Executes the periodic task with the earliest absolute deadline (EDF,
+/// AEDF), or with the shortest period (RM), among the ones which did not
+/// execute in their current period. When a task was executed, and its period
+/// is starting again, it is set as 'executable again', and its deadline and
+/// next_period are updated.
+/// @param runqueue the runqueue.
+/// @return the next task, NULL if no periodic task can execute.
+static task_struct *__dl_pick_next_task(runqueue_t *runqueue)
+{
+#ifdef SCHEDULER_AEDF
+    // The ready periodic tasks are kept ordered by absolute deadline.
+    task_struct *next = __rbtree_first(runqueue->rt_ready, 0);
+    // If the task has passed its deadline, we output a warning but it is
+    // still selected as next task.
+    if (next && (next->se.deadline < timer_get_ticks())) {
+        pr_warning("Process %d passed its deadline %d < %d \n",
+                   next->pid,
+                   next->se.deadline,
+                   timer_get_ticks());
+    }
+#else
+    // Make executable again the tasks whose period is starting again.
+    __dl_activate(runqueue, timer_get_ticks());
+    // The executable periodic tasks are kept ordered by deadline, or period.
+    task_struct *next = __rbtree_first(runqueue->rt_ready, 0);
+#endif
+    if (next) {
+        pr_debug("[%9d] Activating task '%16s', deadline: %5d \t\n",
+                 next->pid,
+                 next->name,
+                 next->se.deadline);
+    }
+    return next;
+}
+
+const sched_class_t dl_sched_class = {
+    .name               = "deadline",
+    .next               = &rr_sched_class,
+    .initialize         = __dl_initialize,
+    .enqueue_task       = __dl_enqueue_task,
+    .dequeue_task       = __dl_dequeue_task,
+    .put_prev_task      = NULL,
+    .set_next_task      = NULL,
+    .pick_next_task     = __dl_pick_next_task,
+    .check_preempt_curr = NULL,
+    .yield_task         = NULL,
+};
+
+// ============================================================================
+// SCHED_RR
+// ============================================================================
+
+/// @brief Initializes the lists of the ready tasks.
+/// @param runqueue the runqueue.
+static void __rr_initialize(runqueue_t *runqueue)
+{
+    for (int prio = 0; prio < MAX_PRIO; ++prio) {
+        list_head_init(&runqueue->ready[prio]);
+    }
+    memset(runqueue->ready_bitmap, 0, sizeof(runqueue->ready_bitmap));
+}
+
+/// @brief Adds a task at the end of the list of ready tasks of its priority.
+/// @param runqueue the runqueue.
+/// @param process the task.
+static void __rr_enqueue_task(runqueue_t *runqueue, task_struct *process)
+{
+    int level = process->se.prio;
+    list_head_insert_before(&process->ready_list, &runqueue->ready[level]);
+    runqueue->ready_bitmap[level / 32] |= (1U << (level % 32));
+}
+
+/// @brief Removes a task from the list of ready tasks of its priority.
+/// @param runqueue the runqueue.
+/// @param process the task.
+static void __rr_dequeue_task(runqueue_t *runqueue, task_struct *process)
+{
+    int level = process->se.prio;
+    list_head_remove(&process->ready_list);
+    if (list_head_empty(&runqueue->ready[level])) {
+        runqueue->ready_bitmap[level / 32] &= ~(1U << (level % 32));
+    }
 }
 
 /// @brief Employs time-sharing, giving each job a time-slot, and is also
 /// preemptive since the scheduler forces the task out of the CPU once
 /// the time-slot expires.
-/// @param runqueue list of all processes.
-/// @param skip_periodic tells the algorithm that periodic processes in the list
-/// should be skipped.
-/// @return the next task on success, NULL on failure.
-static inline task_struct *__scheduler_rr(runqueue_t *runqueue, bool_t skip_periodic)
+/// @param runqueue the runqueue.
+/// @return the next task, NULL if the class has no ready task.
+/// @details The ready tasks are queued by priority, and the bitmap of the
+/// non-empty levels gives the highest priority in constant time. Tasks with the
+/// same priority take turns.
+static task_struct *__rr_pick_next_task(runqueue_t *runqueue)
 {
-    // If there is just one task, return it; no need to do anything.
-    if (list_head_size(&runqueue->curr->run_list) <= 1) {
-        return runqueue->curr;
-    }
-    // This will hold a given entry, while iterating the list of tasks.
-    task_struct *entry = NULL;
-    // Search for the next task (we do not start from the head, so INSIDE, skip the head).
-    list_for_each_decl(it, &runqueue->curr->run_list)
-    {
-        // Check if we reached the head of list_head, and skip it.
-        if (it == &runqueue->queue) {
-            continue;
-        }
-        // Get the current entry.
-        entry = list_entry(it, task_struct, run_list);
-        // We consider only runnable processes
-        if (entry->state != TASK_RUNNING) {
+    task_struct *curr = runqueue->curr;
+    // The level of the current task, if it is still ready to run.
+    int curr_level = (curr->se.sched_class == &rr_sched_class) ? curr->se.prio : -1;
+    // Visit the highest priority (lowest value) non-empty level.
+    for (int word = 0; word < RUNQUEUE_BITMAP_SIZE; ++word) {
+        if (runqueue->ready_bitmap[word] == 0) {
             continue;
         }
-        // If entry is a periodic task, and we were asked to skip periodic tasks, skip it.
-        if (__is_periodic_task(entry) && skip_periodic) {
-            continue;
+        int level       = word * 32 + __builtin_ctz(runqueue->ready_bitmap[word]);
+        list_head *head = &runqueue->ready[level];
+        // Inside the level of the current task, start right after it, so
+        // that the tasks take turns; otherwise, start from the first one.
+        list_head *next = (level == curr_level) ? curr->ready_list.next : head->next;
+        // Skip the head of the list.
+        if (next == head) {
+            next = head->next;
         }
-        // We have our next entry.
-        return entry;
+        return list_entry(next, task_struct, ready_list);
     }
-
     return NULL;
 }
 
-/// @brief Is a non-preemptive algorithm, where each task is assigned a
-/// priority. Processes with highest priority are executed first, while
-/// processes with same priority are executed on first-come/first-served basis.
-/// Priority can be decided based on memory requirements, time requirements or
-/// any other resource requirement.
-/// @param runqueue list of all processes.
-/// @param skip_periodic tells the algorithm if there are periodic processes in
-/// the list, and in that case it needs to skip them.
-/// @return the next task on success, NULL on failure.
-/// @details
-/// When implementing this algorithm, beware of the following pitfal. If you
-/// have the following runqueue (reports task position in the runqueue, priority
-/// and name):
-///      Position | Priority | Name
-///          1    |    120   | init
-///          2    |    120   | shell
-///          3    |    122   | echo
-///          4    |    128   | ps
-/// If you pick the first task every time (i.e., init), and use its prio (i.e.,
-/// 120), what would happen if inside the for-loop when you check "if the entry
-/// has a lower priority", you use a lesser-than sign?
-/// First, it will check against init itself, so 120 < 120 is false.
-/// Then, it will check against shell, again, 120 < 120 is false.
-/// As such, shell or the other processes will never be selected. There are
-/// different ways of solving this problem, each of which requires changes only
-/// inside this same function. Good luck.
-static inline task_struct *__scheduler_priority(runqueue_t *runqueue, bool_t skip_periodic)
-{
-#ifdef SCHEDULER_PRIORITY
-    // Get the first element of the list.
-    task_struct *next = list_entry(runqueue->queue.next, struct task_struct, run_list);
-    // This will hold a given entry, while iterating the list of tasks.
-    task_struct *entry = NULL;
-    // Get the  static priority of the first element of the list we just extracted.
-    time_t min = /*...*/;
-
-    // Search for the task with the smallest static priority.
-    list_for_each_decl(it, &runqueue->queue)
-    {
-        // Check if we reached the head of list_head, and skip it.
-        if (it == &runqueue->queue)
-            continue;
-        // Get the current entry.
-        entry = list_entry(it, task_struct, run_list);
-        // We consider only runnable processes
-        if (entry->state != TASK_RUNNING)
-            continue;
-        // If entry is a periodic task, and we were asked to skip periodic tasks, skip it.
-        if (__is_periodic_task(entry) && skip_periodic)
-            continue;
-        // Check if the entry has a lower priority.
-        if (/*...*/) {
-            // Chose the `entry` as the `next` task.
-            /*...*/
-        }
+const sched_class_t rr_sched_class = {
+    .name               = "rr",
+    .next               = &fair_sched_class,
+    .initialize         = __rr_initialize,
+    .enqueue_task       = __rr_enqueue_task,
+    .dequeue_task       = __rr_dequeue_task,
+    .put_prev_task      = NULL,
+    .set_next_task      = NULL,
+    .pick_next_task     = __rr_pick_next_task,
+    .check_preempt_curr = NULL,
+    .yield_task         = NULL,
+};
+
+// ============================================================================
+// SCHED_OTHER
+// ============================================================================
+
+/// @brief Compares the tasks of two nodes of the timeline, by vruntime.
+/// @param tree The timeline.
+/// @param a The node of the first task.
+/// @param b The node of the second task.
+/// @return the sign of the difference between the two tasks.
+static int __fair_compare(rbtree_t *tree, rbtree_node_t *a, rbtree_node_t *b)
+{
+    (void)tree;
+    task_struct *task_a = rbtree_node_get_value(a), *task_b = rbtree_node_get_value(b);
+    return __compare_keys(task_a, task_b, task_a->se.vruntime, task_b->se.vruntime);
+}
+
+/// @brief Initializes the timeline.
+/// @param runqueue the runqueue.
+static void __fair_initialize(runqueue_t *runqueue)
+{
+    runqueue->timeline     = rbtree_tree_create(__fair_compare);
+    runqueue->leftmost     = NULL;
+    runqueue->min_vruntime = 0;
+    runqueue->fair_load    = 0;
+}
+
+/// @brief Adds a ready task to the timeline.
+/// @param runqueue the runqueue.
+/// @param process the task.
+/// @details A task waking up, or just created, does not get the whole time it
+/// did not run: it starts from the smallest vruntime of the ready tasks.
+static inline void __timeline_insert(runqueue_t *runqueue, task_struct *process)
+{
+    process->se.vruntime = max(process->se.vruntime, runqueue->min_vruntime);
+    rbtree_tree_insert(runqueue->timeline, process);
+    process->se.on_timeline = true;
+    if (!runqueue->leftmost || (__compare_keys(process, runqueue->leftmost, process->se.vruntime, runqueue->leftmost->se.vruntime) < 0)) {
+        runqueue->leftmost = process;
+    }
+}
+
+/// @brief Removes a task from the timeline.
+/// @param runqueue the runqueue.
+/// @param process the task.
+static inline void __timeline_remove(runqueue_t *runqueue, task_struct *process)
+{
+    rbtree_tree_remove(runqueue->timeline, process);
+    process->se.on_timeline = false;
+    if (runqueue->leftmost == process) {
+        runqueue->leftmost = __rbtree_first(runqueue->timeline, 0);
+    }
+}
+
+/// @brief Adds a ready task to the timeline, unless it is the current one.
+/// @param runqueue the runqueue.
+/// @param process the task.
+static void __fair_enqueue_task(runqueue_t *runqueue, task_struct *process)
+{
+    runqueue->fair_load += GET_WEIGHT(process->se.prio);
+    // The vruntime of the current task changes while it runs, so it is kept
+    // out of the timeline.
+    if (process != runqueue->curr) {
+        __timeline_insert(runqueue, process);
+    }
+}
+
+/// @brief Removes a task from the timeline.
+/// @param runqueue the runqueue.
+/// @param process the task.
+static void __fair_dequeue_task(runqueue_t *runqueue, task_struct *process)
+{
+    runqueue->fair_load -= GET_WEIGHT(process->se.prio);
+    if (process->se.on_timeline) {
+        __timeline_remove(runqueue, process);
+    }
+}
+
+/// @brief Puts back into the timeline the task which stops running.
+/// @param runqueue the runqueue.
+/// @param process the task.
+static void __fair_put_prev_task(runqueue_t *runqueue, task_struct *process)
+{
+    if (!process->se.on_timeline) {
+        __timeline_insert(runqueue, process);
+    }
+}
+
+/// @brief Takes out of the timeline the task which starts running.
+/// @param runqueue the runqueue.
+/// @param process the task.
+static void __fair_set_next_task(runqueue_t *runqueue, task_struct *process)
+{
+    if (process->se.on_timeline) {
+        __timeline_remove(runqueue, process);
     }
-    return next;
-#else
-    return __scheduler_rr(runqueue, skip_periodic);
-#endif
 }
 
 /// @brief It aims at giving a fair share of CPU time to processes, and achieves
@@ -136,231 +377,157 @@ static inline task_struct *__scheduler_priority(runqueue_t *runqueue, bool_t ski
 /// run the task with the smallest vruntime (i.e., the task which executed least
 /// so far). It always tries to split up CPU time between runnable tasks as
 /// close to "ideal multitasking hardware" as possible.
-/// @param runqueue list of all processes.
-/// @param skip_periodic tells the algorithm if there are periodic processes in
-/// the list, and in that case it needs to skip them.
-/// @return the next task on success, NULL on failure.
-static inline task_struct *__scheduler_cfs(runqueue_t *runqueue, bool_t skip_periodic)
-{
-#ifdef SCHEDULER_CFS
-    // Get the first element of the list.
-    task_struct *next = list_entry(runqueue->queue.next, struct task_struct, run_list);
-    // This will hold a given entry, while iterating the list of tasks.
-    task_struct *entry = NULL;
-    // Get the virtual runtime of the first element of the list we just extracted.
-    time_t min = /*...*/;
-
-    // Search for the task with the smallest vruntime value.
-    list_for_each_decl(it, &runqueue->queue)
-    {
-        // Check if we reached the head of list_head, and skip it.
-        if (it == &runqueue->queue)
-            continue;
-        // Get the current entry.
-        entry = list_entry(it, task_struct, run_list);
-        // We consider only runnable processes
-        if (entry->state != TASK_RUNNING)
-            continue;
-        // If entry is a periodic task, and we were asked to skip periodic tasks, skip it.
-        if (__is_periodic_task(entry) && skip_periodic)
-            continue;
-
-        // Check if the element in the list has a smaller vruntime value.
-        /* ... */
+/// @param runqueue the runqueue.
+/// @return the next task, NULL if the class has no ready task.
+static task_struct *__fair_pick_next_task(runqueue_t *runqueue)
+{
+    task_struct *curr = runqueue->curr;
+    // The timeline keeps the ready tasks ordered by vruntime, and caches the
+    // one with the smallest vruntime.
+    task_struct *next = runqueue->leftmost;
+    // The current task is not inside the timeline, keep running it if it is
+    // still ready and it has the smallest vruntime.
+    if (curr->se.sched_class == &fair_sched_class) {
+        if (!next || (curr->se.vruntime <= next->se.vruntime)) {
+            next = curr;
+        }
+    }
+    if (next) {
+        // Keep track of the smallest vruntime, which never goes back.
+        runqueue->min_vruntime = max(runqueue->min_vruntime, next->se.vruntime);
     }
-
     return next;
-#else
-    return __scheduler_rr(runqueue, skip_periodic);
-#endif
 }
 
-/// @brief Executes the task with the earliest absolute deadline among all the
-/// ready tasks.
-/// @param runqueue list of all processes.
-/// @return the next task on success, NULL on failure.
-static inline task_struct *__scheduler_aedf(runqueue_t *runqueue)
+/// @brief Tells if a task which became ready should take the CPU away from the
+/// current one, because it ran less than it by more than the granularity.
+/// @param runqueue the runqueue.
+/// @param process the task.
+/// @return true if the current task should give the CPU away.
+static bool_t __fair_check_preempt_curr(runqueue_t *runqueue, task_struct *process)
 {
-#ifdef SCHEDULER_AEDF
-    // This will hold the pointer to the next task to schedule.
-    task_struct *next = list_entry(runqueue->queue.next, struct task_struct, run_list);
-    // This will hold a given entry, while iterating the list of tasks.
-    task_struct *entry = NULL;
-    // Initialize the nearest "next deadline".
-    time_t min = UINT_MAX;
-
-    // Iter over the runqueue to find the task with the earliest absolute deadline.
-    list_for_each_decl(it, &runqueue->queue)
-    {
-        // Check if we reached the head of list_head, and skip it.
-        if (it == &runqueue->queue)
-            continue;
-        // Get the current entry.
-        entry = list_entry(it, task_struct, run_list);
-        // We consider only runnable processes
-        if (entry->state != TASK_RUNNING)
-            continue;
-        // If entry is not a periodic task, skip it.
-        if (!__is_periodic_task(entry))
-            continue;
-        // If the entry has passed its deadline, we output a warning but it
-        // might still be selected as next task.
-        if (/*...*/) {
-            pr_warning("Process %d passed its deadline %d < %d \n",
-                       entry->pid,
-                       /*...*/,
-                       /*...*/);
-        }
-        // Now, select the task if it has the minimum absolute deadline.
-        if (/*...*/ < /*...*/) {
-            // Set it as next task.
-            next = entry;
-            // Update the minimum absolute deadline.
-            min = /*...*/;
-        }
-    }
-    if (next) {
-        pr_debug("[%9d] Activating task '%16s', deadline: %5d \t\n",
-                 next->pid,
-                 next->name,
-                 /*...*/);
-        return next;
+    task_struct *curr = runqueue->curr;
+    // The vruntime of the current task is brought up to date only when the
+    // scheduler picks again, account the ticks it ran meanwhile.
+    time_t delta    = timer_get_ticks() - curr->se.exec_start;
+    time_t vruntime = curr->se.vruntime + (delta * NICE_0_LOAD) / GET_WEIGHT(curr->se.prio);
+    return (vruntime - process->se.vruntime) > (time_t)sched_wakeup_granularity;
+}
+
+/// @brief Moves the current task behind the other ready ones, by giving it
+/// the largest vruntime.
+/// @param runqueue the runqueue.
+static void __fair_yield_task(runqueue_t *runqueue)
+{
+    task_struct *curr = runqueue->curr;
+    task_struct *last = __rbtree_first(runqueue->timeline, 1);
+    if (last && (curr->se.vruntime <= last->se.vruntime)) {
+        curr->se.vruntime = last->se.vruntime + 1;
     }
-#endif
-    // If there are no tasks with deadline != 0 to execute, just pick another
-    // task by using Round-Robin.
-    return __scheduler_rr(runqueue, false);
 }
 
-/// @brief Executes the task with the earliest absolute DEADLINE among all the
-/// ready tasks. When a task was executed, and its period is starting again, it
-/// must be set as 'executable again', and its deadline and next_period must be
-/// updated.
-/// @param runqueue list of all processes.
-/// @return the next task on success, NULL on failure.
-static inline task_struct *__scheduler_edf(runqueue_t *runqueue)
+const sched_class_t fair_sched_class = {
+    .name               = "fair",
+    .next               = &idle_sched_class,
+    .initialize         = __fair_initialize,
+    .enqueue_task       = __fair_enqueue_task,
+    .dequeue_task       = __fair_dequeue_task,
+    .put_prev_task      = __fair_put_prev_task,
+    .set_next_task      = __fair_set_next_task,
+    .pick_next_task     = __fair_pick_next_task,
+    .check_preempt_curr = __fair_check_preempt_curr,
+    .yield_task         = __fair_yield_task,
+};
+
+// ============================================================================
+// SCHED_IDLE
+// ============================================================================
+
+/// @brief Initializes the list of the idle tasks.
+/// @param runqueue the runqueue.
+static void __idle_initialize(runqueue_t *runqueue)
 {
-#ifdef SCHEDULER_EDF
-    // This will hold the pointer to the next task to schedule.
-    task_struct *next = NULL;
-    // This will hold a given entry, while iterating the list of tasks.
-    task_struct *entry = NULL;
-    // Initialize the nearest "next deadline".
-    time_t min = UINT_MAX;
-
-    // Iter over the runqueue to find the task with the earliest absolute deadline.
-    list_for_each_decl(it, &runqueue->queue)
-    {
-        // Check if we reached the head of list_head, and skip it.
-        if (it == &runqueue->queue)
-            continue;
-        // Get the current entry.
-        entry = list_entry(it, task_struct, run_list);
-        // We consider only runnable processes
-        if (entry->state != TASK_RUNNING)
-            continue;
-        // If entry is not a periodic task, skip it.
-        if (!__is_periodic_task(entry))
-            continue;
+    list_head_init(&runqueue->idle);
+}
 
-        if (entry->se.executed) {
-            // If the period for the entry is starting again and it has already
-            //  executed, set it as 'executable again'. Deadline and next_period
-            //  are propagated.
-            if (/*...*/ <= /*...*/) {
-                entry->se.executed = /*...*/;
-                entry->se.deadline += /*...*/;
-                entry->se.next_period += /*...*/;
-                pr_debug("[%9d] Activating task '%16s' [period:%d], deadline:%5d; next_period:%5d, WCET:%6d\t\n",
-                         timer_get_ticks(),
-                         entry->name,
-                         /*...*/,
-                         /*...*/,
-                         /*...*/,
-                         /*...*/);
-            } else {
-                // If the deadline of the process is less than the minimum value, pick it.
-                if (/*...*/ < /*...*/) {
-                    // Set it as next task.
-                    next = entry;
-                    // Update the minimum value.
-                    min = /*...*/;
-                }
-            }
-        }
+/// @brief Adds a task at the end of the list of idle tasks.
+/// @param runqueue the runqueue.
+/// @param process the task.
+static void __idle_enqueue_task(runqueue_t *runqueue, task_struct *process)
+{
+    list_head_insert_before(&process->ready_list, &runqueue->idle);
+}
+
+/// @brief Removes a task from the list of idle tasks.
+/// @param runqueue the runqueue.
+/// @param process the task.
+static void __idle_dequeue_task(runqueue_t *runqueue, task_struct *process)
+{
+    list_head_remove(&process->ready_list);
+}
+
+/// @brief The idle tasks take turns, when no other task is ready.
+/// @param runqueue the runqueue.
+/// @return the next task, NULL if the class has no ready task.
+static task_struct *__idle_pick_next_task(runqueue_t *runqueue)
+{
+    task_struct *curr = runqueue->curr;
+    if (list_head_empty(&runqueue->idle)) {
+        return NULL;
     }
-    if (next)
-        return next;
-#endif
-    // If there are no periodic task to execute, just pick an aperiodic task by
-    // using Round-Robin.
-    return __scheduler_rr(runqueue, false);
+    list_head *next = (curr->se.sched_class == &idle_sched_class) ? curr->ready_list.next : runqueue->idle.next;
+    // Skip the head of the list.
+    if (next == &runqueue->idle) {
+        next = runqueue->idle.next;
+    }
+    return list_entry(next, task_struct, ready_list);
 }
 
-/// @brief Executes the task with the earliest next PERIOD among all the ready
-/// tasks.
-/// @details When a task was executed, and its period is starting again, it must
-/// be set as 'executable again', and its deadline and next_period must be
-/// updated.
-/// @param runqueue list of all processes.
-/// @return the next task on success, NULL on failure.
-static inline task_struct *__scheduler_rm(runqueue_t *runqueue)
+const sched_class_t idle_sched_class = {
+    .name               = "idle",
+    .next               = NULL,
+    .initialize         = __idle_initialize,
+    .enqueue_task       = __idle_enqueue_task,
+    .dequeue_task       = __idle_dequeue_task,
+    .put_prev_task      = NULL,
+    .set_next_task      = NULL,
+    .pick_next_task     = __idle_pick_next_task,
+    .check_preempt_curr = NULL,
+    .yield_task         = NULL,
+};
+
+// ============================================================================
+
+/// @brief Asks the classes, by precedence, until one of them has a task to run.
+/// @param runqueue the runqueue.
+/// @return the next task, NULL if no task is ready.
+static inline task_struct *__pick_next_task(runqueue_t *runqueue)
 {
-#ifdef SCHEDULER_RM
-    // This will hold the pointer to the next task to schedule.
     task_struct *next = NULL;
-    // This will hold a given entry, while iterating the list of tasks.
-    task_struct *entry = NULL;
-    // Initialize the nearest "next deadline".
-    time_t min = UINT_MAX;
-
-    // Iter over the runqueue to find the task with the earliest absolute deadline.
-    list_for_each_decl(it, &runqueue->queue)
-    {
-        // Check if we reached the head of list_head, and skip it.
-        if (it == &runqueue->queue)
-            continue;
-        // Get the current entry.
-        entry = list_entry(it, task_struct, run_list);
-        // We consider only runnable processes
-        if (entry->state != TASK_RUNNING)
-            continue;
-        // If entry is not a periodic task, skip it.
-        if (!__is_periodic_task(entry))
-            continue;
+    for (const sched_class_t *class = &dl_sched_class; class && !next; class = class->next) {
+        next = class->pick_next_task(runqueue);
+    }
+    return next;
+}
 
-        if (entry->se.executed) {
-            // If the period for the entry is starting again and it has already
-            //  executed, set it as 'executable again'. Deadline and next_period
-            //  are propagated.
-            if (/*...*/ <= /*...*/) {
-                entry->se.executed = /*...*/;
-                entry->se.deadline += /*...*/;
-                entry->se.next_period += /*...*/;
-                pr_debug("[%9d] Activating task '%16s' [period:%d], deadline:%5d; next_period:%5d, WCET:%6d\t\n",
-                         timer_get_ticks(),
-                         entry->name,
-                         /*...*/,
-                         /*...*/,
-                         /*...*/,
-                         /*...*/);
-            } else {
-                // If the next period of the process is less than the minimum value, pick it.
-                if (/*...*/ < /*...*/) {
-                    // Set it as next task.
-                    next = entry;
-                    // Update the minimum value.
-                    min = /*...*/;
-                }
-            }
-        }
+const sched_class_t *scheduler_get_class(task_struct *process)
+{
+    int policy = process->se.policy;
+    // While its worst case execution time is measured, a periodic task is
+    // scheduled like the aperiodic ones.
+    if ((policy == SCHED_DEADLINE) && process->se.is_under_analysis) {
+        policy = sched_default_policy;
+    }
+    switch (policy) {
+    case SCHED_DEADLINE:
+        return &dl_sched_class;
+    case SCHED_RR:
+        return &rr_sched_class;
+    case SCHED_IDLE:
+        return &idle_sched_class;
+    default:
+        return &fair_sched_class;
     }
-    if (next)
-        return next;
-#endif
-    // If there are no periodic task to execute, just pick an aperiodic task by
-    // using Round-Robin.
-    return __scheduler_rr(runqueue, false);
 }
 
 task_struct *scheduler_pick_next_task(runqueue_t *runqueue)
@@ -369,22 +536,37 @@ task_struct *scheduler_pick_next_task(runqueue_t *runqueue)
     __update_task_statistics(runqueue->curr);
 
     // Pointer to the next task to schedule.
-    task_struct *next = NULL;
-#if defined(SCHEDULER_RR)
-    next = __scheduler_rr(runqueue, false);
-#elif defined(SCHEDULER_PRIORITY)
-    next = __scheduler_priority(runqueue, false);
-#elif defined(SCHEDULER_CFS)
-    next = __scheduler_cfs(runqueue, false);
-#elif defined(SCHEDULER_EDF)
-    next = __scheduler_edf(runqueue);
-#elif defined(SCHEDULER_RM)
-    next = __scheduler_rm(runqueue);
-#elif defined(SCHEDULER_AEDF)
-    next = __scheduler_aedf(runqueue);
-#else
-#error "You should enable a scheduling algorithm!"
-#endif
+    task_struct *next = __pick_next_task(runqueue);
+    // The current task gave its time slice to another one, which runs next if
+    // it is ready here, and as urgent as the one picked.
+    if (runqueue->yield_to) {
+        task_struct *target = scheduler_get_running_process(runqueue->yield_to);
+        if (next && target && (target->se.cpu == smp_processor_id()) && (target->se.sched_class == next->se.sched_class)) {
+            next = target;
+        }
+        runqueue->yield_to = 0;
+    }
+    // Every task is sleeping: the idle task halts the CPU until one wakes up.
+    if (!next && runqueue->idle_task) {
+        next = runqueue->idle_task;
+    }
+    // If there is just one task, return it; no need to do anything.
+    if (!next && (runqueue->num_active <= 1)) {
+        next = runqueue->curr;
+    }
+    // The idle task is not there yet: halt until an interrupt wakes one up.
+    // The `sti` delays the interrupts until after the `hlt`, so that no wake
+    // up is lost in between.
+    while (!next) {
+        // Try to steal some work from the other CPUs first.
+        if (scheduler_load_balance(true) && (next = __pick_next_task(runqueue))) {
+            break;
+        }
+        __asm__ __volatile__("sti; hlt; cli" ::: "memory");
+        // Use the idle time to refresh the screen.
+        video_update();
+        next = __pick_next_task(runqueue);
+    }
 
     assert(next && "No valid task selected by the scheduling algorithm.");
 
@@ -403,7 +585,6 @@ task_struct *scheduler_pick_next_task(runqueue_t *runqueue)
 static void __update_task_statistics(task_struct *task)
 {
     // See `prio.h` for more support functions.
-#if defined(SCHEDULER_CFS) || defined(SCHEDULER_EDF) || defined(SCHEDULER_RM) || defined(SCHEDULER_AEDF)
     assert(task && "Current task is not valid.");
 
     // While periodic task is under analysis is executed with aperiodic
@@ -422,18 +603,15 @@ static void __update_task_statistics(task_struct *task)
     // If the task is not a periodic task we have to update the virtual runtime.
     if (!task->se.is_periodic) {
         // Get the weight of the current task.
-        time_t weight = GET_WEIGHT((task)->se.prio); /* ... */
-        ;
+        time_t weight = GET_WEIGHT((task)->se.prio);
         // If the weight is different from the default load, compute it.
         if (weight != NICE_0_LOAD) {
             // Get the multiplicative factor for its delta_exec.
-            double factor = ((double)NICE_0_LOAD / (double)weight); /* ... */
-            ;
+            double factor = ((double)NICE_0_LOAD / (double)weight);
             // Weight the delta_exec with the multiplicative factor.
-            task->se.exec_runtime = ((int)(((double)task->se.exec_runtime) * factor)); /* ... */
+            task->se.exec_runtime = ((int)(((double)task->se.exec_runtime) * factor));
         }
         // Update vruntime of the current task.
         task->se.vruntime += task->se.exec_runtime;
     }
-#endif
 }
@@ -2,14 +2,16 @@
 /// @brief Manage the current PID for the scheduler feedback session
 /// @copyright (c) 2014-2024 This file is distributed under the MIT License.
 /// See LICENSE.md for details.
+/// @details
+/// The statistics are recorded in binary form, into a ring buffer which is
+/// drained through `/proc/feedback`, so that the scheduler does no formatting.
+/// A full buffer overwrites its oldest records, which are counted as lost when
+/// the buffer is consumed.
 
 #include "process/scheduler_feedback.h"
 #include "assert.h"
-#include "fcntl.h"
-#include "fs/vfs.h"
 #include "hardware/timer.h"
-#include "stdio.h"
-#include "strerror.h"
+#include "klib/irqflags.h"
 #include "string.h"
 
 // Include the kernel log levels.
@@ -20,39 +22,10 @@
 #define __DEBUG_LEVEL__ LOGLEVEL_INFO
 #include "io/debug.h"
 
-/// @brief How often the feedback is shown.
+/// @brief How often the statistics are recorded.
 #define LOG_INTERVAL_SEC 0.5
 
-/// @brief The name of the scheduling policy.
-#if defined(SCHEDULER_RR)
-#define POLICY_NAME "RR   "
-#elif defined(SCHEDULER_PRIORITY)
-#define POLICY_NAME "PRIO "
-#elif defined(SCHEDULER_CFS)
-#define POLICY_NAME "CFS  "
-#elif defined(SCHEDULER_EDF)
-#define POLICY_NAME "EDF  "
-#elif defined(SCHEDULER_RM)
-#define POLICY_NAME "RM   "
-#elif defined(SCHEDULER_AEDF)
-#define POLICY_NAME "AEDF "
-#else
-#error "You should enable a scheduling algorithm!"
-#endif
-
-/// @brief If uncommented, it writes the logging on file.
-// #define WRITE_ON_FILE
-
-#ifdef WRITE_ON_FILE
-/// @brief Name of the file where the feedback statistics are saved.
-#define FEEDBACK_FILENAME "/var/schedfb"
-/// @brief
-ssize_t offset;
-/// @brief
-vfs_file_t *feedback = NULL;
-#endif
-
-/// @brief When the next log should be displayed/saved, in CPU ticks.
+/// @brief When the next log should be recorded, in CPU ticks.
 unsigned long next_log;
 /// @brief The total number of context-switches since the starting of the log
 /// session.
@@ -64,6 +37,13 @@ struct statistic {
     unsigned long occur;
 } arr_stats[PID_MAX_LIMIT];
 
+/// The recorded statistics.
+static schedfb_record_t feedback_records[SCHEDFB_RECORDS];
+/// The number of records written since the session started.
+static unsigned long feedback_head;
+/// The number of records consumed, or overwritten.
+static unsigned long feedback_tail;
+
 /// @brief Updates when the logging should happen.
 static inline void __scheduler_feedback_deadline_advance(void)
 {
@@ -77,77 +57,31 @@ static inline int __scheduler_feedback_deadline_check(void)
     return (next_log < timer_get_ticks());
 }
 
-/// @brief Logs the scheduling statistics either on file or on the terminal.
+/// @brief Records the scheduling statistics of each task in the ring buffer.
 static inline void __scheduler_feedback_log(void)
 {
-    pr_info("Scheduling Statistics (%s)\n", POLICY_NAME);
-#ifdef WRITE_ON_FILE
-    // Open the feedback file.
-    if (feedback == NULL) {
-        pr_err("Failed to create the feedback file.\n");
-        pr_err("Error: %s\n", strerror(errno));
-        return;
-    }
-    char buffer[BUFSIZ];
-    int written = 0;
-#endif
-#ifdef WRITE_ON_FILE
-    written = sprintf(buffer, "TIME : %ds\n", timer_get_seconds());
-    vfs_write(feedback, buffer, offset, written);
-    offset += written;
-#endif
+    uint32_t now = timer_get_ticks();
     for (size_t i = 0; i < PID_MAX_LIMIT; ++i) {
         if (arr_stats[i].task) {
-            float tcpu = ((float)arr_stats[i].occur * 100.0) / total_occurrences;
-            pr_info("[%3d] | %-18s | -> TCPU: %.2f%% \n",
-                    arr_stats[i].task->pid,
-                    arr_stats[i].task->name,
-                    tcpu);
-#ifdef WRITE_ON_FILE
-            written = sprintf(buffer, "[%3d] | %-18s | -> TCPU: %.2f%% \n",
-                              arr_stats[i].task->pid,
-                              arr_stats[i].task->name,
-                              tcpu);
-            vfs_write(feedback, buffer, offset, written);
-            offset += written;
-#endif
+            schedfb_record_t *record = &feedback_records[feedback_head % SCHEDFB_RECORDS];
+            record->time             = now;
+            record->pid              = arr_stats[i].task->pid;
+            record->occur            = arr_stats[i].occur;
+            record->total            = total_occurrences;
+            ++feedback_head;
         }
     }
-#ifdef WRITE_ON_FILE
-    vfs_write(feedback, "\n", offset, 1);
-    offset++;
-#endif
 }
 
 int scheduler_feedback_init(void)
 {
-#ifdef WRITE_ON_FILE
-    // Create the feedback file, if necessary.
-    int ret = vfs_mkdir("/var", 0644);
-    if ((ret < 0) && (-ret != EEXIST)) {
-        pr_err("Failed to create the `/var` directory.\n");
-        pr_err("Error: %s\n", strerror(errno));
-        return 0;
-    }
-    // First close the file.
-    if (feedback != NULL) {
-        vfs_close(feedback);
-    }
-    // Create the feedback file, if necessary.
-    feedback = vfs_open(FEEDBACK_FILENAME, O_WRONLY | O_TRUNC | O_CREAT, 0644);
-    if (feedback == NULL) {
-        pr_err("Failed to create the feedback file.\n");
-        pr_err("Error: %s\n", strerror(errno));
-        return 0;
-    }
-    // Reset the offset.
-    offset = 0;
-#endif
     // Initialize the stat array.
     for (size_t i = 0; i < PID_MAX_LIMIT; ++i) {
         arr_stats[i].task  = NULL;
         arr_stats[i].occur = 0;
     }
+    // Empty the ring buffer.
+    feedback_head = feedback_tail = 0;
     // Update when in the future, the logging should happen.
     __scheduler_feedback_deadline_advance();
     // Initialize the number of occurrences.
@@ -158,7 +92,7 @@ int scheduler_feedback_init(void)
 void scheduler_feedback_task_add(task_struct *task)
 {
     assert(task && "Received a NULL task.");
-    arr_stats[task->pid].occur = 1;
+    arr_stats[task->pid].occur = 0;
     arr_stats[task->pid].task  = task;
 }
 
@@ -183,7 +117,7 @@ void scheduler_feedback_update(void)
     if (!__scheduler_feedback_deadline_check()) {
         return;
     }
-    // Dump on the feedback before reset.
+    // Record the statistics before reset.
     __scheduler_feedback_log();
     // Reset the occurences.
     for (size_t i = 0; i < PID_MAX_LIMIT; ++i) {
@@ -196,3 +130,21 @@ void scheduler_feedback_update(void)
     // Reset the number of occurrences.
     total_occurrences = 0;
 }
+
+size_t scheduler_feedback_consume(schedfb_record_t *records, unsigned long *lost)
+{
+    // The scheduler writes the records with interrupts disabled, keep it out
+    // while they are copied.
+    uint8_t flags = irq_disable();
+    if ((feedback_head - feedback_tail) > SCHEDFB_RECORDS) {
+        *lost += (feedback_head - feedback_tail) - SCHEDFB_RECORDS;
+        feedback_tail = feedback_head - SCHEDFB_RECORDS;
+    }
+    size_t count = feedback_head - feedback_tail;
+    for (size_t it = 0; it < count; ++it) {
+        records[it] = feedback_records[(feedback_tail + it) % SCHEDFB_RECORDS];
+    }
+    feedback_tail = feedback_head;
+    irq_enable(flags);
+    return count;
+}
@@ -14,7 +14,24 @@
 #include "assert.h"
 #include "string.h"
 
+/// @brief Adds a non-exclusive entry after the other non-exclusive ones, and
+/// before the exclusive ones, so that a wake up reaches all of them.
+/// @param head The head of the waiting queue.
+/// @param wq The entry.
 static inline void __add_wait_queue(wait_queue_head_t *head, wait_queue_entry_t *wq)
+{
+    list_head *position = head->task_list.prev;
+    while ((position != &head->task_list) &&
+           (list_entry(position, wait_queue_entry_t, task_list)->flags & WQ_FLAG_EXCLUSIVE)) {
+        position = position->prev;
+    }
+    list_head_insert_after(&wq->task_list, position);
+}
+
+/// @brief Adds an exclusive entry at the end of the queue.
+/// @param head The head of the waiting queue.
+/// @param wq The entry.
+static inline void __add_wait_queue_exclusive(wait_queue_head_t *head, wait_queue_entry_t *wq)
 {
     list_head_insert_before(&wq->task_list, &head->task_list);
 }
@@ -50,6 +67,12 @@ void wait_queue_entry_dealloc(wait_queue_entry_t *wait_queue_entry)
     kfree(wait_queue_entry);
 }
 
+void init_waitqueue_head(wait_queue_head_t *head)
+{
+    spinlock_init(&head->lock);
+    list_head_init(&head->task_list);
+}
+
 void init_waitqueue_entry(wait_queue_entry_t *wq, struct task_struct *task)
 {
     wq->flags = 0;
@@ -65,9 +88,61 @@ void add_wait_queue(wait_queue_head_t *head, wait_queue_entry_t *wq)
     spinlock_unlock(&head->lock);
 }
 
+void add_wait_queue_exclusive(wait_queue_head_t *head, wait_queue_entry_t *wq)
+{
+    wq->flags |= WQ_FLAG_EXCLUSIVE;
+    spinlock_lock(&head->lock);
+    __add_wait_queue_exclusive(head, wq);
+    spinlock_unlock(&head->lock);
+}
+
 void remove_wait_queue(wait_queue_head_t *head, wait_queue_entry_t *wq)
 {
     spinlock_lock(&head->lock);
     __remove_wait_queue(head, wq);
     spinlock_unlock(&head->lock);
 }
+
+int wake_up_nr(wait_queue_head_t *head, int nr_exclusive)
+{
+    int woken = 0, exclusive;
+    spinlock_lock(&head->lock);
+    // The wake function might remove the entry.
+    list_for_each_safe_decl(it, store, &head->task_list)
+    {
+        wait_queue_entry_t *entry = list_entry(it, wait_queue_entry_t, task_list);
+        // The entry might be freed by its wake function.
+        exclusive = entry->flags & WQ_FLAG_EXCLUSIVE;
+        if (!entry->func || !entry->func(entry, TASK_UNINTERRUPTIBLE, 0)) {
+            // A task which is already awake does not take the place of the
+            // exclusive ones still sleeping.
+            continue;
+        }
+        ++woken;
+        // The exclusive entries come last, the others have all been woken.
+        if (exclusive && (--nr_exclusive == 0)) {
+            break;
+        }
+    }
+    spinlock_unlock(&head->lock);
+    return woken;
+}
+
+void wake_up(wait_queue_head_t *head)
+{
+    wake_up_nr(head, 1);
+}
+
+void wake_up_all(wait_queue_head_t *head)
+{
+    wake_up_nr(head, 0);
+}
+
+int autoremove_wake_function(wait_queue_entry_t *wait, unsigned mode, int sync)
+{
+    int ret = default_wake_function(wait, mode, sync);
+    // The queue is locked by wake_up.
+    list_head_remove(&wait->task_list);
+    wait_queue_entry_dealloc(wait);
+    return ret;
+}
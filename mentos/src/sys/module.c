@@ -51,7 +51,7 @@ int relocate_modules(void)
         uint32_t cmdline_size = strlen((const char *)modules[i].cmdline) + 1;
 
         // Allocate needed memory, to copy both module and command line
-        uint32_t memory = (uint32_t)kmalloc(mod_size + cmdline_size);
+        uintptr_t memory = (uintptr_t)kmalloc(mod_size + cmdline_size);
 
         if (!memory) {
             return 0;
@@ -0,0 +1,174 @@
+/// @file cmdline.c
+/// @brief Parses the kernel command line into the boot-time tunables.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+// Setup the logging for this file (do this before any other include).
+#include "sys/kernel_levels.h"           // Include kernel log levels.
+#define __DEBUG_HEADER__ "[CMDLIN]"      ///< Change header.
+#define __DEBUG_LEVEL__  LOGLEVEL_NOTICE ///< Set log level.
+#include "io/debug.h"                    // Include debugging functions.
+
+#include "system/cmdline.h"
+
+#include "drivers/ata/ata.h"
+#include "fs/buffer_cache.h"
+#include "hardware/timer.h"
+#include "limits.h"
+#include "mem/slab.h"
+#include "process/scheduler.h"
+#include "stdio.h"
+#include "string.h"
+#include "sys/errno.h"
+
+/// The longest command line we keep.
+#define CMDLINE_MAX 512
+
+/// Flag indicating if we are running tests instead of an interactive session.
+extern int runtests;
+
+/// The program started as first process.
+char cmdline_init[PATH_MAX] = "/bin/init";
+
+/// A copy of the command line.
+static char cmdline[CMDLINE_MAX];
+
+/// @brief Parses an unsigned number, in decimal, or hexadecimal with `0x`.
+/// @param str the string.
+/// @param value where the number is stored.
+/// @return 0 on success, -EINVAL if the string is not a number.
+static int __cmdline_parse_uint(const char *str, unsigned *value)
+{
+    char *end;
+    long number = strtol(str, &end, 0);
+    if ((*str == '\0') || (*str == '-') || (*end != '\0') || (number < 0)) {
+        return -EINVAL;
+    }
+    *value = (unsigned)number;
+    return 0;
+}
+
+/// @brief Sets the scheduling policy of the first process.
+/// @param value `rr`, or `cfs` (also `other`).
+/// @return 0 on success, -EINVAL if the policy is unknown.
+static int __cmdline_set_sched_policy(const char *value)
+{
+    if (!strcmp(value, "rr")) {
+        sched_default_policy = SCHED_RR;
+    } else if (!strcmp(value, "cfs") || !strcmp(value, "other")) {
+        sched_default_policy = SCHED_OTHER;
+    } else {
+        return -EINVAL;
+    }
+    return 0;
+}
+
+/// @brief Sets the maximum level of the messages sent on the debug port.
+/// @param value a level, from 0 (emergencies only) to 7 (debug).
+/// @return 0 on success, -EINVAL if the level is invalid.
+static int __cmdline_set_loglevel(const char *value)
+{
+    unsigned level;
+    if ((__cmdline_parse_uint(value, &level) < 0) || (level > LOGLEVEL_DEBUG)) {
+        return -EINVAL;
+    }
+    set_log_level((int)level);
+    return 0;
+}
+
+/// @brief The tunables which can be set from the command line.
+static const kernel_param_t kernel_params[] = {
+    { "hz", KPARAM_UINT, &timer_hz, 19, 10000, NULL, "ticks per second of the timer" },
+    { "sched_policy", KPARAM_CUSTOM, NULL, 0, 0, __cmdline_set_sched_policy, "policy of the first process (rr, cfs)" },
+    { "bcache_buffers", KPARAM_UINT, &buffer_cache_max_buffers, 16, 65536, NULL, "blocks kept by the buffer cache" },
+    { "ata_delay_us", KPARAM_UINT, &ata_request_delay_us, 0, 1000000, NULL, "microseconds added to every ATA command" },
+    { "slab_magazine", KPARAM_UINT, &kmem_magazine_limit, 1, KMEM_MAGAZINE_SIZE, NULL, "free objects kept by each slab magazine" },
+    { "loglevel", KPARAM_CUSTOM, NULL, 0, 0, __cmdline_set_loglevel, "maximum level of the debug messages" },
+    { "init", KPARAM_STRING, cmdline_init, 0, PATH_MAX, NULL, "program started as first process" },
+    { "runtests", KPARAM_BOOL, &runtests, 0, 1, NULL, "start the test suite instead of init" },
+    { "console", KPARAM_CUSTOM, NULL, 0, 0, NULL, "devices of the console (tty0, ttyS0, ttyS1, hvc0)" },
+};
+
+/// @brief Sets a tunable.
+/// @param param the tunable.
+/// @param value the value, NULL if the option has no value.
+/// @return 0 on success, -EINVAL if the value is invalid.
+static int __cmdline_set(const kernel_param_t *param, const char *value)
+{
+    unsigned number;
+    switch (param->type) {
+    case KPARAM_UINT:
+        if (!value || (__cmdline_parse_uint(value, &number) < 0) || (number < param->min) || (number > param->max)) {
+            return -EINVAL;
+        }
+        *(unsigned *)param->value = number;
+        return 0;
+    case KPARAM_BOOL:
+        if (!value) {
+            number = 1;
+        } else if ((__cmdline_parse_uint(value, &number) < 0) || (number > 1)) {
+            return -EINVAL;
+        }
+        *(int *)param->value = (int)number;
+        return 0;
+    case KPARAM_STRING:
+        if (!value || (*value == '\0') || (strlen(value) >= param->max)) {
+            return -EINVAL;
+        }
+        strcpy((char *)param->value, value);
+        return 0;
+    case KPARAM_CUSTOM:
+        if (!param->set) {
+            return 0;
+        }
+        return value ? param->set(value) : -EINVAL;
+    }
+    return -EINVAL;
+}
+
+/// @brief Handles a single option of the command line.
+/// @param option the option, `name=value` or `name`.
+static void __cmdline_option(char *option)
+{
+    char *value = strchr(option, '=');
+    if (value) {
+        *value++ = '\0';
+    }
+    for (unsigned i = 0; i < count_of(kernel_params); ++i) {
+        if (!strcmp(option, kernel_params[i].name)) {
+            if (__cmdline_set(&kernel_params[i], value) < 0) {
+                pr_warning("Invalid value `%s` for `%s` (%s), ignored.\n",
+                           value ? value : "", option, kernel_params[i].description);
+            } else {
+                pr_notice("%s = %s\n", option, value ? value : "1");
+            }
+            return;
+        }
+    }
+    pr_warning("Unknown option `%s`, ignored.\n", option);
+}
+
+void cmdline_parse(const char *str)
+{
+    char option[CMDLINE_MAX];
+    if (str == NULL) {
+        return;
+    }
+    strncpy(cmdline, str, CMDLINE_MAX - 1);
+    cmdline[CMDLINE_MAX - 1] = '\0';
+    for (const char *it = cmdline; *it;) {
+        size_t length = strcspn(it, " ");
+        // Some boot loaders put the path of the kernel image first.
+        if ((length > 0) && ((it != cmdline) || (*it != '/'))) {
+            memcpy(option, it, length);
+            option[length] = '\0';
+            __cmdline_option(option);
+        }
+        it += length + (it[length] == ' ');
+    }
+}
+
+const char *cmdline_get(void)
+{
+    return cmdline;
+}
@@ -0,0 +1,150 @@
+/// @file func_profile.c
+/// @brief Flat profile of the functions of the kernel, built with
+/// `-finstrument-functions`.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// Only built with ENABLE_FUNC_PROFILE, and without the instrumentation, so
+/// that the hooks, and the inline functions they use, do not call themselves.
+
+#include "system/func_profile.h"
+#include "hardware/smp.h"
+#include "klib/irqflags.h"
+#include "klib/stdatomic.h"
+#include "string.h"
+
+/// @brief A call in progress.
+typedef struct func_profile_frame_t {
+    /// The address of the function.
+    uint32_t function;
+    /// The TSC when the function was entered.
+    ktime_t start;
+    /// The cycles spent inside the functions it called.
+    ktime_t children;
+} func_profile_frame_t;
+
+/// @brief The calls in progress on a CPU.
+typedef struct func_profile_stack_t {
+    /// The number of calls in progress, even past the deepest accounted one.
+    unsigned depth;
+    /// The calls in progress, the innermost last.
+    func_profile_frame_t frames[FUNC_PROFILE_DEPTH];
+} func_profile_stack_t;
+
+/// The profile of the functions, shared by the CPUs.
+static func_profile_entry_t func_profile_table[FUNC_PROFILE_SIZE];
+/// The functions left out because the table was full.
+static unsigned long func_profile_lost;
+/// The calls in progress on each CPU, which only touches its own with
+/// interrupts disabled.
+static func_profile_stack_t func_profile_stacks[SMP_MAX_CPUS];
+
+/// @brief Finds the profile of a function, adding it if it is new.
+/// @param function the address of the function.
+/// @return the profile, NULL if the table is full.
+static inline func_profile_entry_t *__func_profile_find(uint32_t function)
+{
+    unsigned slot = (function * 0x9E3779B1u) & (FUNC_PROFILE_SIZE - 1);
+    for (unsigned probe = 0; probe < FUNC_PROFILE_SIZE; ++probe, slot = (slot + 1) & (FUNC_PROFILE_SIZE - 1)) {
+        func_profile_entry_t *entry = &func_profile_table[slot];
+        if (entry->function == function) {
+            return entry;
+        }
+        // Claim the empty slot, another CPU might be claiming it too.
+        if ((entry->function == 0) && (atomic_cmpxchg((atomic_t *)&entry->function, 0, (int)function) == 0)) {
+            return entry;
+        }
+        if (entry->function == function) {
+            return entry;
+        }
+    }
+    ++func_profile_lost;
+    return NULL;
+}
+
+/// @brief Called at the entry of every instrumented function.
+/// @param function the address of the function.
+/// @param call_site where it was called from.
+void __attribute__((no_instrument_function)) __cyg_profile_func_enter(void *function, void *call_site)
+{
+    uint8_t flags               = __irq_disable();
+    func_profile_stack_t *stack = &func_profile_stacks[smp_processor_id()];
+    if (stack->depth < FUNC_PROFILE_DEPTH) {
+        func_profile_frame_t *frame = &stack->frames[stack->depth];
+        frame->function             = (uintptr_t)function;
+        frame->children             = 0;
+        frame->start                = rdtsc();
+    }
+    ++stack->depth;
+    __irq_enable(flags);
+}
+
+/// @brief Called at the exit of every instrumented function.
+/// @param function the address of the function.
+/// @param call_site where it was called from.
+void __attribute__((no_instrument_function)) __cyg_profile_func_exit(void *function, void *call_site)
+{
+    ktime_t now                 = rdtsc();
+    uint8_t flags               = __irq_disable();
+    func_profile_stack_t *stack = &func_profile_stacks[smp_processor_id()];
+    if (stack->depth > FUNC_PROFILE_DEPTH) {
+        --stack->depth;
+        __irq_enable(flags);
+        return;
+    }
+    // Kernel threads switch stacks in the middle of their calls, which leaves
+    // the calls of another thread on top: drop them.
+    unsigned depth = stack->depth;
+    while ((depth > 0) && (stack->frames[depth - 1].function != (uintptr_t)function)) {
+        --depth;
+    }
+    if (depth == 0) {
+        // Entered before the profile was cleared, or on another stack.
+        __irq_enable(flags);
+        return;
+    }
+    stack->depth                = depth - 1;
+    func_profile_frame_t *frame = &stack->frames[depth - 1];
+    ktime_t elapsed             = now - frame->start;
+    func_profile_entry_t *entry = __func_profile_find(frame->function);
+    if (entry) {
+        ++entry->calls;
+        entry->inclusive += elapsed;
+        entry->exclusive += elapsed - frame->children;
+    }
+    if (stack->depth > 0) {
+        stack->frames[stack->depth - 1].children += elapsed;
+    }
+    __irq_enable(flags);
+}
+
+unsigned func_profile_snapshot(func_profile_entry_t *entries, unsigned size)
+{
+    unsigned count = 0;
+    for (unsigned slot = 0; slot < FUNC_PROFILE_SIZE; ++slot) {
+        func_profile_entry_t *entry = &func_profile_table[slot];
+        if (entry->function && entry->calls) {
+            if (entries && (count < size)) {
+                entries[count] = *entry;
+            }
+            ++count;
+        }
+    }
+    return (entries && (count > size)) ? size : count;
+}
+
+unsigned long func_profile_dropped(void)
+{
+    return func_profile_lost;
+}
+
+void func_profile_reset(void)
+{
+    // Keep the functions in their slots, so that the probes stay valid.
+    for (unsigned slot = 0; slot < FUNC_PROFILE_SIZE; ++slot) {
+        func_profile_table[slot].calls     = 0;
+        func_profile_table[slot].inclusive = 0;
+        func_profile_table[slot].exclusive = 0;
+    }
+    func_profile_lost = 0;
+}
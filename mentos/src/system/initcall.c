@@ -0,0 +1,146 @@
+/// @file initcall.c
+/// @brief Initializers of the kernel subsystems, run by level at boot.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+// Setup the logging for this file (do this before any other include).
+#include "sys/kernel_levels.h"           // Include kernel log levels.
+#define __DEBUG_HEADER__ "[INITCL]"      ///< Change header.
+#define __DEBUG_LEVEL__  LOGLEVEL_NOTICE ///< Set log level.
+#include "io/debug.h"                    // Include debugging functions.
+
+#include "system/initcall.h"
+
+#include "assert.h"
+#include "hardware/hrtimer.h"
+#include "io/console.h"
+#include "process/process.h"
+#include "stdio.h"
+#include "string.h"
+
+/// The maximum number of initializers.
+#define INITCALL_MAX 64
+
+/// @brief The state of an initializer.
+typedef enum {
+    INITCALL_PENDING, ///< It did not run yet.
+    INITCALL_QUEUED,  ///< It waits for `kinitd`.
+    INITCALL_DONE,    ///< It succeeded.
+    INITCALL_FAILED,  ///< It failed, or it was skipped.
+} initcall_state_t;
+
+/// The initializers.
+static const initcall_t *initcalls = NULL;
+/// The number of initializers.
+static size_t initcall_count = 0;
+/// The state of each initializer.
+static initcall_state_t initcall_states[INITCALL_MAX];
+
+/// @brief Returns the microseconds elapsed since the given time.
+/// @param start the time, from hrtimer_get_time.
+/// @return the microseconds.
+static inline uint32_t __initcall_usec_since(ktime_t start)
+{
+    ktime_t elapsed = hrtimer_get_time() - start;
+    div64_32(&elapsed, 1000);
+    return (uint32_t)elapsed;
+}
+
+/// @brief Checks if the initializer a call depends on has succeeded.
+/// @param call the initializer.
+/// @return true if it can run, false otherwise.
+static bool_t __initcall_can_run(const initcall_t *call)
+{
+    if (call->depends == NULL) {
+        return true;
+    }
+    for (size_t i = 0; i < initcall_count; ++i) {
+        if (!strcmp(initcalls[i].name, call->depends)) {
+            return initcall_states[i] == INITCALL_DONE;
+        }
+    }
+    return false;
+}
+
+/// @brief Runs an initializer, and logs how long it took.
+/// @param index the index of the initializer.
+/// @param verbose if the result is printed on the console too.
+/// @return 0 on success, -1 on failure.
+static int __initcall_do(size_t index, bool_t verbose)
+{
+    const initcall_t *call = &initcalls[index];
+    if (verbose) {
+        printf("Initialize %s...", call->name);
+    }
+    if (!__initcall_can_run(call)) {
+        pr_err("Skipping %s, which needs %s.\n", call->name, call->depends);
+        initcall_states[index] = INITCALL_FAILED;
+        if (verbose) {
+            console_print_result("[SKIP]");
+        }
+        return -1;
+    }
+    ktime_t start          = hrtimer_get_time();
+    int ret                = call->fn();
+    uint32_t usec          = __initcall_usec_since(start);
+    initcall_states[index] = (ret == 0) ? INITCALL_DONE : INITCALL_FAILED;
+    pr_notice("%-32s %7u us%s%s\n", call->name, usec, verbose ? "" : " (deferred)", ret ? " FAILED" : "");
+    if (verbose) {
+        printf(" %u.%03u ms", usec / 1000, usec % 1000);
+        console_print_result(ret ? "[FAIL]" : "[OK]");
+    }
+    return ret ? -1 : 0;
+}
+
+int initcall_run(const initcall_t *calls, size_t count, unsigned defer)
+{
+    assert((count <= INITCALL_MAX) && "Too many initializers.");
+    initcalls      = calls;
+    initcall_count = count;
+    for (init_level_t level = 0; level < INIT_LEVEL_NUM; ++level) {
+        for (size_t i = 0; i < count; ++i) {
+            if (calls[i].level != level) {
+                continue;
+            }
+            if (calls[i].flags & defer) {
+                initcall_states[i] = INITCALL_QUEUED;
+                continue;
+            }
+            if ((__initcall_do(i, true) < 0) && !(calls[i].flags & INITCALL_OPTIONAL)) {
+                pr_emerg("Failed to initialize %s!\n", calls[i].name);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+/// @brief The body of `kinitd`, which runs the deferred initializers.
+/// @param data unused.
+/// @return 0.
+static int __initcall_kinitd(void *data)
+{
+    (void)data;
+    ktime_t start = hrtimer_get_time();
+    for (init_level_t level = 0; level < INIT_LEVEL_NUM; ++level) {
+        for (size_t i = 0; i < initcall_count; ++i) {
+            if ((initcalls[i].level == level) && (initcall_states[i] == INITCALL_QUEUED)) {
+                __initcall_do(i, false);
+                // Let init go on between two initializers.
+                kthread_yield();
+            }
+        }
+    }
+    pr_notice("Deferred initialization done in %u us.\n", __initcall_usec_since(start));
+    return 0;
+}
+
+int initcall_start_deferred(void)
+{
+    for (size_t i = 0; i < initcall_count; ++i) {
+        if (initcall_states[i] == INITCALL_QUEUED) {
+            return (kthread_create(__initcall_kinitd, NULL, "kinitd") != NULL) ? 0 : -1;
+        }
+    }
+    return 0;
+}
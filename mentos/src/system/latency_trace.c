@@ -0,0 +1,173 @@
+/// @file latency_trace.c
+/// @brief Tracer of the sections with interrupts disabled, and of the delays
+/// between the wake up of a task and the moment it runs.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// Only built with ENABLE_LATENCY_TRACE.
+
+#include "system/latency_trace.h"
+#include "hardware/smp.h"
+#include "process/process.h"
+#include "string.h"
+
+/// The interrupt flag of EFLAGS.
+#define LATENCY_EFLAGS_IF (1 << 9)
+
+/// @brief The state of the tracer on a CPU.
+typedef struct latency_cpu_t {
+    /// The TSC when the interrupts were disabled, 0 while they are enabled.
+    ktime_t off_since;
+    /// Where the interrupts were disabled.
+    unsigned long off_ip;
+    /// The interrupt which disabled them, -1 if it was irq_disable.
+    int off_vector;
+    /// The worst sections.
+    latency_stat_t stat;
+} latency_cpu_t;
+
+/// The state of each CPU, which only touches its own with interrupts disabled.
+static latency_cpu_t latency_cpus[SMP_MAX_CPUS];
+
+/// The frame the interrupt returns to, when the scheduler switches it.
+extern pt_regs *scheduler_switch_frame;
+
+/// @brief Inserts a section among the worst ones, once for each call site.
+/// @param stat the worst sections of the CPU.
+/// @param record the section.
+static inline void __latency_irqsoff_insert(latency_stat_t *stat, const irqsoff_record_t *record)
+{
+    irqsoff_record_t *worst = stat->irqsoff;
+    int i;
+    // Look for the same section, or else start from the last one.
+    for (i = 0; i < LATENCY_WORST - 1; ++i) {
+        if ((worst[i].start == record->start) && (worst[i].end == record->end) && (worst[i].vector == record->vector)) {
+            break;
+        }
+    }
+    if (record->cycles <= worst[i].cycles) {
+        return;
+    }
+    for (; (i > 0) && (worst[i - 1].cycles < record->cycles); --i) {
+        worst[i] = worst[i - 1];
+    }
+    worst[i] = *record;
+}
+
+/// @brief Inserts a wake up among the worst ones, once for each task.
+/// @param stat the worst sections of the CPU.
+/// @param record the wake up.
+static inline void __latency_wakeup_insert(latency_stat_t *stat, const wakeup_record_t *record)
+{
+    wakeup_record_t *worst = stat->wakeup;
+    int i;
+    // Look for the same task, or else start from the last one.
+    for (i = 0; i < LATENCY_WORST - 1; ++i) {
+        if (worst[i].cycles && (worst[i].pid == record->pid)) {
+            break;
+        }
+    }
+    if (record->cycles <= worst[i].cycles) {
+        return;
+    }
+    for (; (i > 0) && (worst[i - 1].cycles < record->cycles); --i) {
+        worst[i] = worst[i - 1];
+    }
+    worst[i] = *record;
+}
+
+/// @brief Starts a section on the CPU.
+/// @param ip where the interrupts were disabled.
+/// @param vector the interrupt which disabled them, -1 if none.
+static inline void __latency_start(unsigned long ip, int vector)
+{
+    if (!hrtimer_tsc_available()) {
+        return;
+    }
+    latency_cpu_t *cpu = &latency_cpus[smp_processor_id()];
+    cpu->off_since     = rdtsc();
+    cpu->off_ip        = ip;
+    cpu->off_vector    = vector;
+}
+
+void latency_irqs_off(unsigned long ip)
+{
+    __latency_start(ip, -1);
+}
+
+void latency_irqs_on(unsigned long ip)
+{
+    latency_cpu_t *cpu = &latency_cpus[smp_processor_id()];
+    if (cpu->off_since == 0) {
+        return;
+    }
+    irqsoff_record_t record = {
+        .cycles = rdtsc() - cpu->off_since,
+        .start  = cpu->off_ip,
+        .end    = ip,
+        .vector = cpu->off_vector,
+    };
+    cpu->off_since = 0;
+    ++cpu->stat.irqsoff_count;
+    __latency_irqsoff_insert(&cpu->stat, &record);
+}
+
+void latency_irq_enter(pt_regs *f)
+{
+    // A section left open by a path we do not see (e.g., `sti; hlt`) ended
+    // when the interrupted code enabled the interrupts.
+    if (f->eflags & LATENCY_EFLAGS_IF) {
+        __latency_start((unsigned long)__builtin_return_address(0), (int)f->int_no);
+    }
+}
+
+void latency_irq_exit(pt_regs *f)
+{
+    pt_regs *frame = scheduler_switch_frame ? scheduler_switch_frame : f;
+    if (frame->eflags & LATENCY_EFLAGS_IF) {
+        latency_irqs_on((unsigned long)__builtin_return_address(0));
+    }
+}
+
+void latency_task_woken(task_struct *task)
+{
+    task->wakeup_stamp = hrtimer_tsc_available() ? rdtsc() : 0;
+}
+
+void latency_task_running(task_struct *task)
+{
+    if (task->wakeup_stamp == 0) {
+        return;
+    }
+    latency_cpu_t *cpu     = &latency_cpus[smp_processor_id()];
+    wakeup_record_t record = {
+        .cycles = rdtsc() - task->wakeup_stamp,
+        .pid    = task->pid,
+        .policy = task->se.policy,
+    };
+    strncpy(record.name, task->name, sizeof(record.name) - 1);
+    task->wakeup_stamp = 0;
+    ++cpu->stat.wakeup_count;
+    __latency_wakeup_insert(&cpu->stat, &record);
+}
+
+void latency_stat_get(unsigned cpu, latency_stat_t *stat)
+{
+    memcpy(stat, &latency_cpus[cpu].stat, sizeof(latency_stat_t));
+}
+
+ktime_t latency_cycles_to_ns(ktime_t cycles)
+{
+    ktime_t tsc;
+    uint32_t mult;
+    hrtimer_get_clock(&tsc, &mult);
+    // Multiply the two halves apart, so that the product fits 64 bits.
+    return (((cycles >> 32) * mult) << (32 - TSC_SHIFT)) + (((cycles & 0xFFFFFFFFu) * mult) >> TSC_SHIFT);
+}
+
+void latency_reset(void)
+{
+    for (unsigned cpu = 0; cpu < SMP_MAX_CPUS; ++cpu) {
+        memset(&latency_cpus[cpu].stat, 0, sizeof(latency_stat_t));
+    }
+}
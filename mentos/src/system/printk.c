@@ -4,18 +4,291 @@
 /// See LICENSE.md for details.
 
 #include "system/printk.h"
-#include "io/video.h"
+#include "hardware/hrtimer.h"
+#include "hardware/smp.h"
+#include "io/debug.h"
+#include "io/console.h"
+#include "klib/spinlock.h"
+#include "klib/stdatomic.h"
+#include "math.h"
+#include "process/process.h"
+#include "process/scheduler.h"
+#include "process/wait.h"
 #include "stdarg.h"
 #include "stdio.h"
+#include "string.h"
+
+/// @brief A message, or part of it, waiting to be written.
+typedef struct log_record_t {
+    /// The sequence number of the message plus one, once the record is
+    /// committed, zero while it is free or being filled.
+    volatile unsigned long seq;
+    /// When the message was logged, in nanoseconds since boot.
+    ktime_t time;
+    /// The file which logged the message.
+    const char *file;
+    /// The header of the file.
+    const char *header;
+    /// The line which logged the message.
+    int line;
+    /// The log level.
+    short level;
+    /// The length of the text.
+    unsigned short length;
+    /// The text, not terminated.
+    char text[LOG_TEXT_SIZE];
+} log_record_t;
+
+/// @brief The records logged by a CPU.
+typedef struct log_ring_t {
+    /// The next slot to reserve, advanced by the CPU.
+    atomic_t head;
+    /// The next slot to write on the serial port, advanced by the drain.
+    volatile unsigned int tail;
+    /// The number of records dropped because the ring was full.
+    atomic_t dropped;
+    /// The records.
+    log_record_t records[LOG_RING_SIZE];
+} log_ring_t;
+
+/// The rings, one for each CPU.
+static log_ring_t log_rings[SMP_MAX_CPUS];
+/// The next sequence number.
+static atomic_t log_seq;
+/// Held by whoever drains the rings.
+static spinlock_t log_drain_lock;
+/// The history of the written messages, read through /proc/kmsg.
+static char log_history[LOG_HISTORY_SIZE];
+/// The amount of bytes ever written in the history.
+static unsigned long log_history_end;
+/// The task writing the messages, NULL until it starts.
+static task_struct *klogd = NULL;
+/// Where klogd waits for messages.
+static wait_queue_head_t klogd_wait;
+/// Tells klogd that there are messages.
+static volatile bool_t klogd_pending = false;
+
+/// @brief Writes a chunk of a formatted message on the screen.
+/// @param data unused.
+/// @param chunk the text.
+/// @param length the length of the text.
+/// @return 0.
+static int __syslog_write(void *data, const char *chunk, size_t length)
+{
+    console_write(chunk, length);
+    return 0;
+}
 
 int sys_syslog(const char *format, ...)
 {
-    char buffer[4096];
     va_list ap;
     // Start variabile argument's list.
     va_start(ap, format);
-    int len = vsprintf(buffer, format, ap);
+    int len = vcbprintf(__syslog_write, NULL, format, ap);
     va_end(ap);
-    video_puts(buffer);
     return len;
 }
+
+/// @brief Appends a string to the history.
+/// @param str the string.
+static inline void __history_puts(const char *str)
+{
+    while (*str) {
+        log_history[log_history_end++ % LOG_HISTORY_SIZE] = *str++;
+    }
+}
+
+/// @brief Appends a record to the history.
+/// @param record the record.
+/// @param new_line if the record starts a line.
+static inline void __history_append(const log_record_t *record, bool_t new_line)
+{
+    char prefix[64];
+    if (new_line) {
+        ktime_t time = record->time;
+        uint32_t nsec = div64_32(&time, NSEC_PER_SEC);
+        sprintf(prefix, "<%d>[%5u.%06u] ", record->level, (uint32_t)time, nsec / 1000U);
+        __history_puts(prefix);
+    }
+    for (unsigned int it = 0; it < record->length; ++it) {
+        log_history[log_history_end++ % LOG_HISTORY_SIZE] = record->text[it];
+    }
+}
+
+/// @brief Takes the oldest committed record among the heads of the rings.
+/// @param record where the record is copied.
+/// @return 1 if there was a record, 0 otherwise.
+static inline int __log_take(log_record_t *record)
+{
+    log_ring_t *oldest = NULL;
+    log_record_t *slot;
+    for (unsigned int cpu = 0; cpu < SMP_MAX_CPUS; ++cpu) {
+        log_ring_t *ring = &log_rings[cpu];
+        if ((unsigned int)atomic_read(&ring->head) == ring->tail) {
+            continue;
+        }
+        slot = &ring->records[ring->tail % LOG_RING_SIZE];
+        // The CPU is still filling the record.
+        if (slot->seq == 0) {
+            continue;
+        }
+        if (!oldest || ((long)(slot->seq - oldest->records[oldest->tail % LOG_RING_SIZE].seq) < 0)) {
+            oldest = ring;
+        }
+    }
+    if (!oldest) {
+        return 0;
+    }
+    slot = &oldest->records[oldest->tail % LOG_RING_SIZE];
+    memcpy(record, (const void *)slot, sizeof(log_record_t));
+    // Free the slot, only after reading it.
+    barrier();
+    slot->seq = 0;
+    barrier();
+    ++oldest->tail;
+    return 1;
+}
+
+void printk_store(const char *file, int line, const char *header, short level, const char *text, size_t length)
+{
+    log_ring_t *ring = &log_rings[smp_processor_id()];
+    ktime_t time     = hrtimer_get_time();
+    // We interrupted the drain, and the message might be the last one (e.g.,
+    // a panic), thus write it right away.
+    if ((level <= LOGLEVEL_CRIT) && spinlock_is_locked(&log_drain_lock)) {
+        dbg_write_message(file, line, header, level, text, 1);
+        return;
+    }
+    do {
+        size_t chunk = min(length, (size_t)LOG_TEXT_SIZE);
+        // Reserve a slot, the only contention is with the interrupts of this
+        // CPU, and with the drain freeing slots.
+        int head;
+        do {
+            head = atomic_read(&ring->head);
+            if ((unsigned int)head - ring->tail >= LOG_RING_SIZE) {
+                atomic_inc(&ring->dropped);
+                return;
+            }
+        } while (atomic_cmpxchg(&ring->head, head, head + 1) != head);
+        // Fill it.
+        log_record_t *record = &ring->records[(unsigned int)head % LOG_RING_SIZE];
+        record->time         = time;
+        record->file         = file;
+        record->header       = header;
+        record->line         = line;
+        record->level        = level;
+        record->length       = (unsigned short)chunk;
+        memcpy(record->text, text, chunk);
+        // Commit it.
+        barrier();
+        record->seq = (unsigned long)atomic_inc(&log_seq) + 1;
+        text += chunk;
+        length -= chunk;
+    } while (length);
+    klogd_pending = true;
+    // Until klogd starts, and for the messages which might be the last ones,
+    // write them right away.
+    if (!klogd || (level <= LOGLEVEL_CRIT)) {
+        printk_flush();
+    }
+}
+
+void printk_flush(void)
+{
+    static bool_t new_line = true;
+    static char text[LOG_TEXT_SIZE + 1];
+    log_record_t record;
+    char dropped[48];
+    // The drain is the only consumer, if someone is already draining it
+    // writes our messages too. Interrupts stay enabled, those logging while
+    // we hold the lock leave their messages to us.
+    if (!spinlock_trylock(&log_drain_lock)) {
+        return;
+    }
+    // Tell about the lost messages.
+    for (unsigned int cpu = 0; cpu < SMP_MAX_CPUS; ++cpu) {
+        int count = atomic_set_and_test(&log_rings[cpu].dropped, 0);
+        if (count) {
+            sprintf(dropped, "[printk: %d messages dropped on CPU %u]\n", count, cpu);
+            dbg_puts(dropped);
+            __history_puts(dropped);
+        }
+    }
+    while (__log_take(&record)) {
+        memcpy(text, record.text, record.length);
+        text[record.length] = 0;
+        __history_append(&record, new_line);
+        new_line = dbg_write_message(record.file, record.line, record.header, record.level, text, new_line);
+    }
+    spinlock_unlock(&log_drain_lock);
+}
+
+void printk_kick(void)
+{
+    if (klogd && klogd_pending) {
+        wake_up(&klogd_wait);
+    }
+}
+
+/// @brief The thread writing the messages on the serial port.
+/// @param data unused.
+/// @return never returns.
+static int __printk_daemon(void *data)
+{
+    (void)data;
+    task_struct *task = scheduler_get_current_process();
+    wait_queue_entry_t wait;
+    init_waitqueue_entry(&wait, task);
+    while (true) {
+        // Sleep until there are messages, with interrupts disabled so that
+        // the wake up cannot get lost.
+        uint8_t flags = irq_disable();
+        while (!klogd_pending) {
+            add_wait_queue(&klogd_wait, &wait);
+            scheduler_set_task_state(task, TASK_UNINTERRUPTIBLE);
+            kthread_yield();
+            remove_wait_queue(&klogd_wait, &wait);
+        }
+        klogd_pending = false;
+        irq_enable(flags);
+        printk_flush();
+    }
+    return 0;
+}
+
+int printk_start_daemon(void)
+{
+    init_waitqueue_head(&klogd_wait);
+    task_struct *task = kthread_create(__printk_daemon, NULL, "klogd");
+    if (task == NULL) {
+        return -1;
+    }
+    // Write what was logged so far, then let klogd do it.
+    printk_flush();
+    klogd = task;
+    return 0;
+}
+
+ssize_t printk_read_history(char *buffer, off_t offset, size_t nbyte)
+{
+    size_t copied = 0;
+    spinlock_lock(&log_drain_lock);
+    // The history holds the last LOG_HISTORY_SIZE bytes.
+    unsigned long start = (log_history_end > LOG_HISTORY_SIZE) ? log_history_end - LOG_HISTORY_SIZE : 0;
+    // Once it wrapped, start from the first whole line.
+    if (start) {
+        while ((start < log_history_end) && (log_history[start % LOG_HISTORY_SIZE] != '\n')) {
+            ++start;
+        }
+        ++start;
+    }
+    unsigned long length = (start < log_history_end) ? log_history_end - start : 0;
+    if ((offset >= 0) && ((unsigned long)offset < length)) {
+        for (unsigned long it = start + offset; (copied < nbyte) && (it < log_history_end); ++it) {
+            buffer[copied++] = log_history[it % LOG_HISTORY_SIZE];
+        }
+    }
+    spinlock_unlock(&log_drain_lock);
+    return copied;
+}
@@ -85,19 +85,19 @@ static inline void __clear_siginfo(siginfo_t *info)
 static inline void __lock_task_sighand(struct task_struct *t)
 {
     assert(t && "Null task struct.");
-    spinlock_lock(&t->sighand.siglock);
+    spinlock_lock(&t->sighand->siglock);
 }
 
 static inline void __unlock_task_sighand(struct task_struct *t)
 {
     assert(t && "Null task struct.");
-    spinlock_unlock(&t->sighand.siglock);
+    spinlock_unlock(&t->sighand->siglock);
 }
 
 static sighandler_t __get_handler(struct task_struct *t, int sig)
 {
     assert(t && "Null task struct.");
-    return t->sighand.action[sig - 1].sa_handler;
+    return t->sighand->action[sig - 1].sa_handler;
 }
 
 static int __sig_is_ignored(struct task_struct *t, int sig)
@@ -117,13 +117,21 @@ static int __sig_is_ignored(struct task_struct *t, int sig)
     //        here I'm also accepting as not-ignored a SIG_IGN which is a SIGCHLD.
 }
 
-/// @brief Allocate a new signal queue record.
-/// @param t     The task to which the signal belongs.
-/// @param sig   The signal to set.
+/// @brief Allocate a new signal queue record, from the reserve of the task
+/// when possible.
+/// @param pending The pending signals of the task to which the signal belongs.
 /// @param flags Flags identifying from where we are going to take the memory.
-static inline sigqueue_t *__sigqueue_alloc(struct task_struct *t, int sig, gfp_t flags)
-{
-    sigqueue_t *sigqueue = kmem_cache_alloc(sigqueue_cachep, flags);
+/// @return the record, NULL if the reserve is empty and the cache failed.
+static inline sigqueue_t *__sigqueue_alloc(sigpending_t *pending, gfp_t flags)
+{
+    sigqueue_t *sigqueue = NULL;
+    if (pending->reserve_count > 0) {
+        sigqueue = list_entry(pending->reserve.next, sigqueue_t, list);
+        list_head_remove(&sigqueue->list);
+        --pending->reserve_count;
+    } else {
+        sigqueue = kmem_cache_alloc(sigqueue_cachep, flags);
+    }
     // If we successfully allocated the signal queue, initiliaze the values.
     if (sigqueue) {
         sigqueue->flags = 0;
@@ -132,18 +140,41 @@ static inline sigqueue_t *__sigqueue_alloc(struct task_struct *t, int sig, gfp_t
     return sigqueue;
 }
 
-static inline void __sigqueue_free(sigqueue_t *sigqueue)
+/// @brief Frees a signal queue record, refilling the reserve of the task first.
+/// @param pending The pending signals of the task to which the signal belonged.
+/// @param sigqueue The record, already out of the pending list.
+static inline void __sigqueue_free(sigpending_t *pending, sigqueue_t *sigqueue)
 {
-    if (sigqueue) {
+    if (sigqueue == NULL) {
+        return;
+    }
+    if (pending->reserve_count < SIGQUEUE_RESERVE) {
+        list_head_insert_before(&sigqueue->list, &pending->reserve);
+        ++pending->reserve_count;
+    } else {
         kmem_cache_free(sigqueue);
     }
 }
 
-/// @brief
+static inline int __next_signal(sigpending_t *pending, sigset_t *mask);
+
+/// @brief Updates the flag telling if the task has pending signals which are
+/// not blocked, the only thing checked before entering do_signal.
+/// @param t the task, whose signal handling is locked.
+static inline void __recalc_sigpending(struct task_struct *t)
+{
+    t->sigpending = (__next_signal(&t->pending, &t->blocked) != 0);
+}
+
+/// @brief Makes a signal pending for a task.
+/// @details The signals are not queued: each one is a bit of the pending set,
+/// and sending one which is already pending has no effect. Only a handler
+/// asking for the details (SA_SIGINFO) gets them queued, for the others they
+/// are rebuilt on delivery.
 /// @param sig  Signal to be sent.
 /// @param info The signal info
 /// @param t    The process to which we send the signal.
-/// @return
+/// @return 0 on success, -EINVAL if the process is dead.
 static int __send_signal(int sig, siginfo_t *info, struct task_struct *t)
 {
     // Lock the signal handling for the given task.
@@ -164,20 +195,32 @@ static int __send_signal(int sig, siginfo_t *info, struct task_struct *t)
         __unlock_task_sighand(t);
         return -EINVAL;
     }
-    sigqueue_t *q = __sigqueue_alloc(t, sig, GFP_KERNEL);
-    if (q == NULL) {
+    // Another occurrence of a pending signal is merged with it.
+    if (sigismember(&t->pending.signal, sig)) {
         __unlock_task_sighand(t);
-        return -EAGAIN;
+        return 0;
     }
-    list_head_insert_before(&q->list, &t->pending.list);
-    if (info != SEND_SIG_NOINFO) {
-        __copy_siginfo(&q->info, info);
+    // Keep the details only for a handler which receives them, or for a
+    // blocked signal, which might be read from a signalfd; without them the
+    // signal is still delivered.
+    if ((info != SEND_SIG_NOINFO) &&
+        (bitmask_check(t->sighand->action[sig - 1].sa_flags, SA_SIGINFO) || sigismember(&t->blocked, sig))) {
+        sigqueue_t *q = __sigqueue_alloc(&t->pending, GFP_ATOMIC);
+        if (q) {
+            __copy_siginfo(&q->info, info);
+            list_head_insert_before(&q->list, &t->pending.list);
+        }
     }
     // Set that there is a signal pending.
     sigaddset(&t->pending.signal, sig);
+    __recalc_sigpending(t);
     pr_debug("Added pending signal (%2d:%s) to task (%2d:%s), pending `%d, %d`.\n",
              sig, strsignal(sig), t->pid, t->name, t->pending.signal.sig[0], t->pending.signal.sig[1]);
     __unlock_task_sighand(t);
+    // Wake up the readers of a signalfd, if any.
+    if (!list_head_empty(&t->sighand->signalfd_wqh.task_list)) {
+        wake_up(&t->sighand->signalfd_wqh);
+    }
     return 0;
 }
 
@@ -205,33 +248,22 @@ static inline void __collect_signal(int sig, sigpending_t *list, siginfo_t *info
     assert(info && "Null `info` structure.");
 
     sigqueue_t *queue_entry = NULL;
-    bool_t still_pending    = false;
-    // Collect the siginfo appropriate to this signal. Check if
-    // there is another siginfo for the same signal.
+    // Collect the siginfo appropriate to this signal, there is at most one,
+    // and only if the handler asked for it.
     list_for_each_decl(it, &list->list)
     {
         sigqueue_t *q = list_entry(it, sigqueue_t, list);
         pr_debug("__collect_signal(%2d:%s, %p, %p) : Signal in queue : %p(%d : %s).\n", sig, strsignal(sig), list, info,
                  q, q->info.si_signo, strsignal(q->info.si_signo));
         if (q->info.si_signo == sig) {
-            // If the entry is already set, this means that there are several handlers
-            // pending for this particular signal.
-            if (queue_entry) {
-                pr_debug("__collect_signal(%2d:%s, %p, %p) : Still pending, do not remove from set.\n", sig, strsignal(sig), list, info);
-                still_pending = true;
-                break;
-            }
-            // Store the entry we encounter.
             queue_entry = q;
+            break;
         }
     }
-    // If there are no other signals pending of the same type,
-    // remove the signal from the set.
-    if (!still_pending) {
-        sigdelset(&list->signal, sig);
-        pr_debug("__collect_signal(%2d:%s, %p, %p) : Remove signal from set: %d.\n", sig, strsignal(sig), list, info,
-                 list->signal.sig[0]);
-    }
+    // The signal is no longer pending.
+    sigdelset(&list->signal, sig);
+    pr_debug("__collect_signal(%2d:%s, %p, %p) : Remove signal from set: %d.\n", sig, strsignal(sig), list, info,
+             list->signal.sig[0]);
     // If we have found an entry.
     if (queue_entry) {
         pr_debug("__collect_signal(%2d:%s, %p, %p) : Remove and delete sigqueue entry : %p.\n", sig, strsignal(sig), list, info, queue_entry);
@@ -239,8 +271,8 @@ static inline void __collect_signal(int sig, sigpending_t *list, siginfo_t *info
         list_head_remove(&queue_entry->list);
         // Copy the details about the entry inside the info structure.
         __copy_siginfo(info, &queue_entry->info);
-        // Free the memory for the queue entry.
-        __sigqueue_free(queue_entry);
+        // Give the queue entry back.
+        __sigqueue_free(list, queue_entry);
     } else {
         pr_debug("__collect_signal(%2d:%s, %p, %p) : Cannot find the signal in the queue.\n", sig, strsignal(sig), list, info);
         // Ok, it wasn't in the queue, zero out the info.
@@ -332,8 +364,11 @@ long sys_sigreturn(struct pt_regs *f)
     assert(current_process && "There is no current process!");
     // Restore the registers before the signal handling.
     *f = current_process->thread.signal_regs;
-    // Restore the previous signal mask.
+    // Restore the previous signal mask, which might unblock pending signals.
+    __lock_task_sighand(current_process);
     __copy_sigset(&current_process->blocked, &current_process->saved_sigmask);
+    __recalc_sigpending(current_process);
+    __unlock_task_sighand(current_process);
     // Switch to process page directory
     paging_switch_directory_va(current_process->mm->pgd);
     pr_debug("sys_sigreturn(%p) : done!\n", f);
@@ -364,13 +399,16 @@ static void __rm_from_queue(sigset_t *mask, sigpending_t *q)
 {
     struct sigqueue_t *entry;
     list_head *it, *tmp;
+    // The signals are no longer pending.
+    q->signal.sig[0] &= ~mask->sig[0];
+    q->signal.sig[1] &= ~mask->sig[1];
     list_for_each_safe (it, tmp, &q->list) {
         // Get the entry.
         entry = list_entry(it, struct sigqueue_t, list);
         // Remove the signal.
         if (sigismember(mask, entry->info.si_signo)) {
             list_head_remove(it);
-            kfree(entry);
+            __sigqueue_free(q, entry);
         }
     }
 }
@@ -384,14 +422,14 @@ static void __do_signal_stop(struct task_struct *current, struct pt_regs *f, int
     // The do_signal( ) function also sends a SIGCHLD signal to
     // the parent process of current, unless the parent has set
     // the SA_NOCLDSTOP flag of SIGCHLD.
-    if (!(SA_NOCLDSTOP & current->parent->sighand.action[SIGCHLD - 1].sa_flags)) {
+    if (!(SA_NOCLDSTOP & current->parent->sighand->action[SIGCHLD - 1].sa_flags)) {
         if (__notify_parent(current, SIGCHLD) != 0) {
             pr_warning("Failed to notify parent with signal: %d", signr);
         }
     }
     // The state is now TASK_UNINTERRUPTABLE
     sleep_on(&stopped_queue);
-    current->state     = TASK_STOPPED;
+    scheduler_set_task_state(current, TASK_STOPPED);
     current->exit_code = signr;
     scheduler_run(f);
 }
@@ -423,7 +461,7 @@ int do_signal(struct pt_regs *f)
     // The heart of the do_signal( ) function consists of a loop that
     // repeatedly invokes the __dequeue_signal( ) function until no
     // non-blocked pending signals are left.
-    while (!list_head_empty(&current_process->pending.list)) {
+    for (;;) {
         // Get the signal to deliver.
         signr = exit_code = __dequeue_signal(&current_process->pending, &current_process->blocked, &info);
 
@@ -437,12 +475,14 @@ int do_signal(struct pt_regs *f)
         // handled and do_signal( ) can finish.
         if (signr == 0) {
             pr_debug("There are no more signals to handle.\n");
+            // Skip do_signal until a new signal arrives, or one is unblocked.
+            current_process->sigpending = 0;
             __unlock_task_sighand(current_process);
             return 0;
         }
 
         // Get the associated signal action.
-        sigaction_t *ka = &current_process->sighand.action[signr - 1];
+        sigaction_t *ka = &current_process->sighand->action[signr - 1];
 
         // The only exception comes when the receiving process is init, in
         // which case the signal is discarded.
@@ -539,6 +579,7 @@ int do_signal(struct pt_regs *f)
         }
         pr_emerg("Failed to handle signal.\n");
     }
+    __recalc_sigpending(current_process);
     __unlock_task_sighand(current_process);
     return 0;
 }
@@ -554,6 +595,49 @@ int signals_init(void)
     return 1;
 }
 
+void sigpending_init(sigpending_t *pending)
+{
+    list_head_init(&pending->list);
+    sigemptyset(&pending->signal);
+    list_head_init(&pending->reserve);
+    pending->reserve_count = 0;
+    // A storm of signals is served by the reserve, refilled at each delivery.
+    for (int i = 0; i < SIGQUEUE_RESERVE; ++i) {
+        sigqueue_t *sigqueue = kmem_cache_alloc(sigqueue_cachep, GFP_KERNEL);
+        if (sigqueue == NULL) {
+            break;
+        }
+        list_head_insert_before(&sigqueue->list, &pending->reserve);
+        ++pending->reserve_count;
+    }
+}
+
+void sigpending_release(sigpending_t *pending)
+{
+    list_for_each_safe_decl(it, store, &pending->list)
+    {
+        list_head_remove(it);
+        kmem_cache_free(list_entry(it, sigqueue_t, list));
+    }
+    list_for_each_safe_decl(it, store, &pending->reserve)
+    {
+        list_head_remove(it);
+        kmem_cache_free(list_entry(it, sigqueue_t, list));
+    }
+    sigemptyset(&pending->signal);
+    pending->reserve_count = 0;
+}
+
+void sigpending_flush(sigpending_t *pending)
+{
+    list_for_each_safe_decl(it, store, &pending->list)
+    {
+        list_head_remove(it);
+        kmem_cache_free(list_entry(it, sigqueue_t, list));
+    }
+    sigemptyset(&pending->signal);
+}
+
 /// @brief Checks for some types of signals that might nullify other pending
 /// signals for the destination thread group
 /// @param sig Signal number
@@ -651,6 +735,25 @@ int __send_sig_info(int sig, siginfo_t *info, struct task_struct *p)
     return 0;
 }
 
+int dequeue_signal(struct task_struct *t, sigset_t *mask, siginfo_t *info, int nonblock)
+{
+    // __dequeue_signal skips the signals of the mask, give it the others.
+    sigset_t excluded = { { ~mask->sig[0], ~mask->sig[1] } };
+    __lock_task_sighand(t);
+    int sig = __dequeue_signal(&t->pending, &excluded, info);
+    if (sig > 0) {
+        __recalc_sigpending(t);
+    } else if (nonblock) {
+        sig = -EAGAIN;
+    } else {
+        // Queue ourselves before unlocking, so that no signal is missed.
+        sleep_on(&t->sighand->signalfd_wqh)->func = autoremove_wake_function;
+        sig = -ERESTARTSYS;
+    }
+    __unlock_task_sighand(t);
+    return sig;
+}
+
 int sys_kill(pid_t pid, int sig)
 {
     pr_debug("sys_kill(%d, %2d:%s)\n", pid, sig, strsignal(sig));
@@ -706,11 +809,11 @@ sighandler_t sys_signal(int signum, sighandler_t handler, uint32_t sigreturn_add
     // Set the address of the sigreturn.
     current_process->sigreturn_addr = sigreturn_addr;
     // Get the old sigaction.
-    sigaction_t *old_sigaction = &current_process->sighand.action[signum - 1];
+    sigaction_t *old_sigaction = &current_process->sighand->action[signum - 1];
     pr_err("sys_signal(%d, %p): Signal action ptr %p\n", signum, handler, old_sigaction);
     pr_err("sys_signal(%d, %p): Old signal handler %p\n", signum, handler, old_sigaction->sa_handler);
     // Get the old handler (to return).
-    sighandler_t old_handler = current_process->sighand.action[signum - 1].sa_handler;
+    sighandler_t old_handler = current_process->sighand->action[signum - 1].sa_handler;
     // Set the new action.
     __copy_sigaction(old_sigaction, &new_sigaction);
     // Unlock the signal handling for the given task.
@@ -740,8 +843,8 @@ int sys_sigaction(int signum, const sigaction_t *act, sigaction_t *oldact, uint3
     __lock_task_sighand(current_process);
     // Set the address of the sigreturn.
     current_process->sigreturn_addr = sigreturn_addr;
-    // Get a pointer to the entry in the sighand.action array.
-    sigaction_t *current_process_sigaction = &current_process->sighand.action[signum - 1];
+    // Get a pointer to the entry in the sighand->action array.
+    sigaction_t *current_process_sigaction = &current_process->sighand->action[signum - 1];
     pr_debug("sys_sigaction(%d, %p, %p): : Signal old action ptr %p\n", signum, act, oldact, current_process_sigaction);
     // If requested, get the old sigaction.
     if (oldact) {
@@ -773,6 +876,8 @@ int sys_sigprocmask(int how, const sigset_t *set, sigset_t *oldset)
         pr_warning("sys_sigprocmask(%d, %p, %p): Cannot set signal for init!\n", how, set, oldset);
         return -EINVAL;
     }
+    // Lock the signal handling, the senders check the mask.
+    __lock_task_sighand(current_process);
     // If `oldset` is not, return the old set.
     if (oldset) {
         oldset->sig[0] = current_process->blocked.sig[0];
@@ -796,7 +901,10 @@ int sys_sigprocmask(int how, const sigset_t *set, sigset_t *oldset)
             current_process->blocked.sig[0] = set->sig[0];
             current_process->blocked.sig[1] = set->sig[1];
         }
+        // Unblocked signals might be pending.
+        __recalc_sigpending(current_process);
     }
+    __unlock_task_sighand(current_process);
     return 0;
 }
 
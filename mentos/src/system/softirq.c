@@ -0,0 +1,111 @@
+/// @file softirq.c
+/// @brief Deferred interrupt work (softirqs and tasklets).
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+// Setup the logging for this file (do this before any other include).
+#include "sys/kernel_levels.h"           // Include kernel log levels.
+#define __DEBUG_HEADER__ "[SOFIRQ]"      ///< Change header.
+#define __DEBUG_LEVEL__  LOGLEVEL_NOTICE ///< Set log level.
+#include "io/debug.h"                    // Include debugging functions.
+
+#include "assert.h"
+#include "klib/irqflags.h"
+#include "system/softirq.h"
+
+/// @brief How many times the pending softirqs are checked again, before
+/// leaving the rest for the next call, so that a flood of interrupts cannot
+/// keep the CPU in the bottom halves forever.
+#define SOFTIRQ_MAX_RESTART 10
+
+/// @brief Runs the scheduled tasklets.
+static void __tasklet_action(void);
+
+/// The function executed for each vector.
+static void (*softirq_vector[SOFTIRQ_NUM])(void) = {
+    [SOFTIRQ_TASKLET] = __tasklet_action,
+};
+/// The pending vectors, one bit each.
+static volatile unsigned softirq_pending = 0;
+/// Set while the softirqs are running.
+static bool_t softirq_running = false;
+/// The first scheduled tasklet.
+static tasklet_t *tasklet_head = NULL;
+/// The last scheduled tasklet.
+static tasklet_t *tasklet_tail = NULL;
+
+void softirq_install(softirq_nr_t nr, void (*action)(void))
+{
+    assert((nr < SOFTIRQ_NUM) && "Invalid softirq vector.");
+    softirq_vector[nr] = action;
+}
+
+void softirq_raise(softirq_nr_t nr)
+{
+    uint8_t flags = irq_disable();
+    softirq_pending |= (1u << nr);
+    irq_enable(flags);
+}
+
+void softirq_run(void)
+{
+    unsigned pending;
+    uint8_t flags = irq_disable();
+    // Softirqs do not nest: an interrupt arriving while they run only raises
+    // its own, which are handled before returning.
+    if (softirq_running || !softirq_pending) {
+        irq_enable(flags);
+        return;
+    }
+    softirq_running = true;
+    for (int restart = 0; (restart < SOFTIRQ_MAX_RESTART) && softirq_pending; ++restart) {
+        // Take the pending vectors, new ones can be raised while we run these.
+        pending         = softirq_pending;
+        softirq_pending = 0;
+        // Run the bottom halves with interrupts enabled.
+        irq_enable(true);
+        for (unsigned nr = 0; nr < SOFTIRQ_NUM; ++nr) {
+            if ((pending & (1u << nr)) && softirq_vector[nr]) {
+                softirq_vector[nr]();
+            }
+        }
+        irq_disable();
+    }
+    softirq_running = false;
+    irq_enable(flags);
+}
+
+void tasklet_schedule(tasklet_t *tasklet)
+{
+    uint8_t flags = irq_disable();
+    if (!tasklet->scheduled) {
+        tasklet->scheduled = true;
+        tasklet->next      = NULL;
+        if (tasklet_tail) {
+            tasklet_tail->next = tasklet;
+        } else {
+            tasklet_head = tasklet;
+        }
+        tasklet_tail = tasklet;
+        softirq_pending |= (1u << SOFTIRQ_TASKLET);
+    }
+    irq_enable(flags);
+}
+
+static void __tasklet_action(void)
+{
+    tasklet_t *tasklet, *next;
+    // Detach the list, tasklets scheduled from now on run on the next round.
+    uint8_t flags = irq_disable();
+    tasklet       = tasklet_head;
+    tasklet_head = tasklet_tail = NULL;
+    irq_enable(flags);
+    while (tasklet) {
+        next = tasklet->next;
+        // Clear the flag first, so the tasklet can be scheduled again while
+        // it runs.
+        tasklet->scheduled = false;
+        tasklet->function(tasklet->data);
+        tasklet = next;
+    }
+}
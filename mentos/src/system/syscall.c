@@ -11,23 +11,49 @@
 #define __DEBUG_LEVEL__  LOGLEVEL_NOTICE ///< Set log level.
 #include "io/debug.h"                    // Include debugging functions.
 
+#include "aio.h"
 #include "descriptor_tables/isr.h"
 #include "devices/fpu.h"
 #include "fs/attr.h"
 #include "fs/vfs.h"
 #include "fs/ioctl.h"
+#include "fs/pipe.h"
+#include "hardware/cpuid.h"
+#include "hardware/hrtimer.h"
+#include "hardware/msr.h"
+#include "hardware/smp.h"
 #include "hardware/timer.h"
+#include "io/video.h"
 #include "kernel.h"
+#include "mqueue.h"
+#include "poll.h"
 #include "mem/kheap.h"
 #include "process/process.h"
 #include "process/scheduler.h"
+#include "string.h"
+#include "sys/epoll.h"
 #include "sys/errno.h"
 #include "sys/mman.h"
+#include "sys/mount.h"
 #include "sys/msg.h"
+#include "sys/prctl.h"
+#include "sys/resource.h"
+#include "sys/sendfile.h"
+#include "sys/select.h"
 #include "sys/sem.h"
+#include "sys/swap.h"
 #include "sys/shm.h"
+#include "sys/signalfd.h"
+#include "sys/splice.h"
+#include "sys/timerfd.h"
+#include "sys/uio.h"
+#include "sys/uring.h"
+#include "sys/futex.h"
 #include "sys/utsname.h"
+#include "system/softirq.h"
 #include "system/syscall.h"
+#include "system/trace.h"
+#include "system/vdso.h"
 
 /// The signature of a function call.
 typedef int (*SystemCall)(void);
@@ -42,6 +68,60 @@ SystemCall sys_call_table[SYSCALL_NUMBER];
 /// Last interupt stack frame
 static pt_regs *current_interrupt_stack_frame;
 
+#ifdef ENABLE_SYSCALL_STAT
+/// The statistics of the system calls, each CPU updates its own, without locks.
+static syscall_stat_t syscall_stats[SMP_MAX_CPUS][SYSCALL_NUMBER];
+
+/// @brief Accounts a system call.
+/// @param nr the number of the system call.
+/// @param cycles the cycles it took.
+static inline void __syscall_stat_account(unsigned int nr, uint32_t cycles)
+{
+    syscall_stat_t *stat = &syscall_stats[smp_processor_id()][nr];
+    unsigned int bucket  = 0;
+    if (cycles >> SYSCALL_STAT_MIN_SHIFT) {
+        bucket = (31 - __builtin_clz(cycles)) - SYSCALL_STAT_MIN_SHIFT + 1;
+        if (bucket >= SYSCALL_STAT_BUCKETS) {
+            bucket = SYSCALL_STAT_BUCKETS - 1;
+        }
+    }
+    ++stat->count;
+    stat->cycles += cycles;
+    ++stat->hist[bucket];
+}
+
+void syscall_stat_get(unsigned int nr, syscall_stat_t *stat)
+{
+    memset(stat, 0, sizeof(syscall_stat_t));
+    if (nr >= SYSCALL_NUMBER) {
+        return;
+    }
+    for (unsigned int cpu = 0; cpu < SMP_MAX_CPUS; ++cpu) {
+        syscall_stat_t *it = &syscall_stats[cpu][nr];
+        stat->count += it->count;
+        stat->cycles += it->cycles;
+        for (unsigned int bucket = 0; bucket < SYSCALL_STAT_BUCKETS; ++bucket) {
+            stat->hist[bucket] += it->hist[bucket];
+        }
+    }
+}
+#endif
+
+/// @defgroup sysenter_msr SYSENTER MSRs
+/// @brief The registers read by SYSENTER.
+/// @{
+#define MSR_SYSENTER_CS  0x174 ///< The kernel code segment, followed by the data one.
+#define MSR_SYSENTER_ESP 0x175 ///< The kernel stack.
+#define MSR_SYSENTER_EIP 0x176 ///< The kernel entry point.
+/// @}
+
+/// The bit of the features reported by cpuid, in edx, telling that the CPU
+/// supports SYSENTER and SYSEXIT.
+#define CPUID_EDX_SEP (1U << 11U)
+
+/// @brief The entry of SYSENTER, in exception.S.
+extern void sysenter_entry(void);
+
 /// @brief A Not Implemented (NI) system-call.
 /// @return Always returns -ENOSYS.
 /// @details
@@ -76,7 +156,7 @@ void syscall_init(void)
     sys_call_table[__NR_stat]                   = (SystemCall)sys_stat;
     sys_call_table[__NR_lseek]                  = (SystemCall)sys_lseek;
     sys_call_table[__NR_getpid]                 = (SystemCall)sys_getpid;
-    sys_call_table[__NR_mount]                  = (SystemCall)sys_ni_syscall;
+    sys_call_table[__NR_mount]                  = (SystemCall)sys_mount;
     sys_call_table[__NR_oldumount]              = (SystemCall)sys_ni_syscall;
     sys_call_table[__NR_setuid]                 = (SystemCall)sys_setuid;
     sys_call_table[__NR_getuid]                 = (SystemCall)sys_getuid;
@@ -88,13 +168,13 @@ void syscall_init(void)
     sys_call_table[__NR_utime]                  = (SystemCall)sys_ni_syscall;
     sys_call_table[__NR_access]                 = (SystemCall)sys_ni_syscall;
     sys_call_table[__NR_nice]                   = (SystemCall)sys_nice;
-    sys_call_table[__NR_sync]                   = (SystemCall)sys_ni_syscall;
+    sys_call_table[__NR_sync]                   = (SystemCall)sys_sync;
     sys_call_table[__NR_kill]                   = (SystemCall)sys_kill;
     sys_call_table[__NR_rename]                 = (SystemCall)sys_ni_syscall;
     sys_call_table[__NR_mkdir]                  = (SystemCall)sys_mkdir;
     sys_call_table[__NR_rmdir]                  = (SystemCall)sys_rmdir;
     sys_call_table[__NR_dup]                    = (SystemCall)sys_dup;
-    sys_call_table[__NR_pipe]                   = (SystemCall)sys_ni_syscall;
+    sys_call_table[__NR_pipe]                   = (SystemCall)sys_pipe;
     sys_call_table[__NR_times]                  = (SystemCall)sys_ni_syscall;
     sys_call_table[__NR_brk]                    = (SystemCall)sys_brk;
     sys_call_table[__NR_setgid]                 = (SystemCall)sys_setgid;
@@ -111,7 +191,7 @@ void syscall_init(void)
     sys_call_table[__NR_umask]                  = (SystemCall)sys_ni_syscall;
     sys_call_table[__NR_chroot]                 = (SystemCall)sys_ni_syscall;
     sys_call_table[__NR_ustat]                  = (SystemCall)sys_ni_syscall;
-    sys_call_table[__NR_dup2]                   = (SystemCall)sys_ni_syscall;
+    sys_call_table[__NR_dup2]                   = (SystemCall)sys_dup2;
     sys_call_table[__NR_getppid]                = (SystemCall)sys_getppid;
     sys_call_table[__NR_getpgrp]                = (SystemCall)sys_ni_syscall;
     sys_call_table[__NR_setsid]                 = (SystemCall)sys_setsid;
@@ -125,7 +205,7 @@ void syscall_init(void)
     sys_call_table[__NR_sethostname]            = (SystemCall)sys_ni_syscall;
     sys_call_table[__NR_setrlimit]              = (SystemCall)sys_ni_syscall;
     sys_call_table[__NR_getrlimit]              = (SystemCall)sys_ni_syscall;
-    sys_call_table[__NR_getrusage]              = (SystemCall)sys_ni_syscall;
+    sys_call_table[__NR_getrusage]              = (SystemCall)sys_getrusage;
     sys_call_table[__NR_gettimeofday]           = (SystemCall)sys_ni_syscall;
     sys_call_table[__NR_settimeofday]           = (SystemCall)sys_ni_syscall;
     sys_call_table[__NR_getgroups]              = (SystemCall)sys_ni_syscall;
@@ -134,13 +214,13 @@ void syscall_init(void)
     sys_call_table[__NR_lstat]                  = (SystemCall)sys_ni_syscall;
     sys_call_table[__NR_readlink]               = (SystemCall)sys_readlink;
     sys_call_table[__NR_uselib]                 = (SystemCall)sys_ni_syscall;
-    sys_call_table[__NR_swapon]                 = (SystemCall)sys_ni_syscall;
+    sys_call_table[__NR_swapon]                 = (SystemCall)sys_swapon;
     sys_call_table[__NR_reboot]                 = (SystemCall)sys_reboot;
     sys_call_table[__NR_readdir]                = (SystemCall)sys_ni_syscall;
     sys_call_table[__NR_mmap]                   = (SystemCall)sys_mmap;
     sys_call_table[__NR_munmap]                 = (SystemCall)sys_munmap;
-    sys_call_table[__NR_truncate]               = (SystemCall)sys_ni_syscall;
-    sys_call_table[__NR_ftruncate]              = (SystemCall)sys_ni_syscall;
+    sys_call_table[__NR_truncate]               = (SystemCall)sys_truncate;
+    sys_call_table[__NR_ftruncate]              = (SystemCall)sys_ftruncate;
     sys_call_table[__NR_fchmod]                 = (SystemCall)sys_fchmod;
     sys_call_table[__NR_fchown]                 = (SystemCall)sys_fchown;
     sys_call_table[__NR_getpriority]            = (SystemCall)sys_ni_syscall;
@@ -160,13 +240,13 @@ void syscall_init(void)
     sys_call_table[__NR_vhangup]                = (SystemCall)sys_ni_syscall;
     sys_call_table[__NR_idle]                   = (SystemCall)sys_ni_syscall;
     sys_call_table[__NR_vm86old]                = (SystemCall)sys_ni_syscall;
-    sys_call_table[__NR_wait4]                  = (SystemCall)sys_ni_syscall;
-    sys_call_table[__NR_swapoff]                = (SystemCall)sys_ni_syscall;
+    sys_call_table[__NR_wait4]                  = (SystemCall)sys_wait4;
+    sys_call_table[__NR_swapoff]                = (SystemCall)sys_swapoff;
     sys_call_table[__NR_sysinfo]                = (SystemCall)sys_ni_syscall;
     sys_call_table[__NR_ipc]                    = (SystemCall)sys_ni_syscall;
-    sys_call_table[__NR_fsync]                  = (SystemCall)sys_ni_syscall;
+    sys_call_table[__NR_fsync]                  = (SystemCall)sys_fsync;
     sys_call_table[__NR_sigreturn]              = (SystemCall)sys_sigreturn;
-    sys_call_table[__NR_clone]                  = (SystemCall)sys_ni_syscall;
+    sys_call_table[__NR_clone]                  = (SystemCall)sys_clone;
     sys_call_table[__NR_setdomainname]          = (SystemCall)sys_ni_syscall;
     sys_call_table[__NR_newuname]               = (SystemCall)sys_ni_syscall;
     sys_call_table[__NR_modify_ldt]             = (SystemCall)sys_ni_syscall;
@@ -187,23 +267,23 @@ void syscall_init(void)
     sys_call_table[__NR_setfsgid]               = (SystemCall)sys_ni_syscall;
     sys_call_table[__NR_llseek]                 = (SystemCall)sys_ni_syscall;
     sys_call_table[__NR_getdents]               = (SystemCall)sys_getdents;
-    sys_call_table[__NR_select]                 = (SystemCall)sys_ni_syscall;
+    sys_call_table[__NR_select]                 = (SystemCall)sys_select;
     sys_call_table[__NR_flock]                  = (SystemCall)sys_ni_syscall;
     sys_call_table[__NR_msync]                  = (SystemCall)sys_ni_syscall;
-    sys_call_table[__NR_readv]                  = (SystemCall)sys_ni_syscall;
-    sys_call_table[__NR_writev]                 = (SystemCall)sys_ni_syscall;
+    sys_call_table[__NR_readv]                  = (SystemCall)sys_readv;
+    sys_call_table[__NR_writev]                 = (SystemCall)sys_writev;
     sys_call_table[__NR_getsid]                 = (SystemCall)sys_getsid;
     sys_call_table[__NR_fdatasync]              = (SystemCall)sys_ni_syscall;
     sys_call_table[__NR_sysctl]                 = (SystemCall)sys_ni_syscall;
-    sys_call_table[__NR_mlock]                  = (SystemCall)sys_ni_syscall;
-    sys_call_table[__NR_munlock]                = (SystemCall)sys_ni_syscall;
-    sys_call_table[__NR_mlockall]               = (SystemCall)sys_ni_syscall;
-    sys_call_table[__NR_munlockall]             = (SystemCall)sys_ni_syscall;
+    sys_call_table[__NR_mlock]                  = (SystemCall)sys_mlock;
+    sys_call_table[__NR_munlock]                = (SystemCall)sys_munlock;
+    sys_call_table[__NR_mlockall]               = (SystemCall)sys_mlockall;
+    sys_call_table[__NR_munlockall]             = (SystemCall)sys_munlockall;
     sys_call_table[__NR_sched_setparam]         = (SystemCall)sys_sched_setparam;
     sys_call_table[__NR_sched_getparam]         = (SystemCall)sys_sched_getparam;
-    sys_call_table[__NR_sched_setscheduler]     = (SystemCall)sys_ni_syscall;
-    sys_call_table[__NR_sched_getscheduler]     = (SystemCall)sys_ni_syscall;
-    sys_call_table[__NR_sched_yield]            = (SystemCall)sys_ni_syscall;
+    sys_call_table[__NR_sched_setscheduler]     = (SystemCall)sys_sched_setscheduler;
+    sys_call_table[__NR_sched_getscheduler]     = (SystemCall)sys_sched_getscheduler;
+    sys_call_table[__NR_sched_yield]            = (SystemCall)sys_sched_yield;
     sys_call_table[__NR_sched_get_priority_max] = (SystemCall)sys_ni_syscall;
     sys_call_table[__NR_sched_get_priority_min] = (SystemCall)sys_ni_syscall;
     sys_call_table[__NR_sched_rr_get_interval]  = (SystemCall)sys_ni_syscall;
@@ -213,11 +293,11 @@ void syscall_init(void)
     sys_call_table[__NR_getresuid]              = (SystemCall)sys_ni_syscall;
     sys_call_table[__NR_vm86]                   = (SystemCall)sys_ni_syscall;
     sys_call_table[__NR_query_module]           = (SystemCall)sys_ni_syscall;
-    sys_call_table[__NR_poll]                   = (SystemCall)sys_ni_syscall;
+    sys_call_table[__NR_poll]                   = (SystemCall)sys_poll;
     sys_call_table[__NR_nfsservctl]             = (SystemCall)sys_ni_syscall;
     sys_call_table[__NR_setresgid]              = (SystemCall)sys_ni_syscall;
     sys_call_table[__NR_getresgid]              = (SystemCall)sys_ni_syscall;
-    sys_call_table[__NR_prctl]                  = (SystemCall)sys_ni_syscall;
+    sys_call_table[__NR_prctl]                  = (SystemCall)sys_prctl;
     sys_call_table[__NR_rt_sigreturn]           = (SystemCall)sys_ni_syscall;
     sys_call_table[__NR_rt_sigaction]           = (SystemCall)sys_ni_syscall;
     sys_call_table[__NR_rt_sigprocmask]         = (SystemCall)sys_ni_syscall;
@@ -225,14 +305,14 @@ void syscall_init(void)
     sys_call_table[__NR_rt_sigtimedwait]        = (SystemCall)sys_ni_syscall;
     sys_call_table[__NR_rt_sigqueueinfo]        = (SystemCall)sys_ni_syscall;
     sys_call_table[__NR_rt_sigsuspend]          = (SystemCall)sys_ni_syscall;
-    sys_call_table[__NR_pread]                  = (SystemCall)sys_ni_syscall;
-    sys_call_table[__NR_pwrite]                 = (SystemCall)sys_ni_syscall;
+    sys_call_table[__NR_pread]                  = (SystemCall)sys_pread;
+    sys_call_table[__NR_pwrite]                 = (SystemCall)sys_pwrite;
     sys_call_table[__NR_chown]                  = (SystemCall)sys_chown;
     sys_call_table[__NR_getcwd]                 = (SystemCall)sys_getcwd;
     sys_call_table[__NR_capget]                 = (SystemCall)sys_ni_syscall;
     sys_call_table[__NR_capset]                 = (SystemCall)sys_ni_syscall;
     sys_call_table[__NR_sigaltstack]            = (SystemCall)sys_ni_syscall;
-    sys_call_table[__NR_sendfile]               = (SystemCall)sys_ni_syscall;
+    sys_call_table[__NR_sendfile]               = (SystemCall)sys_sendfile;
     sys_call_table[__NR_waitperiod]             = (SystemCall)sys_waitperiod;
     sys_call_table[__NR_msgctl]                 = (SystemCall)sys_msgctl;
     sys_call_table[__NR_msgget]                 = (SystemCall)sys_msgget;
@@ -245,22 +325,88 @@ void syscall_init(void)
     sys_call_table[__NR_shmctl]                 = (SystemCall)sys_shmctl;
     sys_call_table[__NR_shmdt]                  = (SystemCall)sys_shmdt;
     sys_call_table[__NR_shmget]                 = (SystemCall)sys_shmget;
+    sys_call_table[__NR_vfork]                  = (SystemCall)sys_vfork;
+    sys_call_table[__NR_posix_spawn]            = (SystemCall)sys_posix_spawn;
+    sys_call_table[__NR_uring_setup]            = (SystemCall)sys_uring_setup;
+    sys_call_table[__NR_uring_enter]            = (SystemCall)sys_uring_enter;
+    sys_call_table[__NR_futex]                  = (SystemCall)sys_futex;
+    sys_call_table[__NR_pipe2]                  = (SystemCall)sys_pipe2;
+    sys_call_table[__NR_splice]                 = (SystemCall)sys_splice;
+    sys_call_table[__NR_tee]                    = (SystemCall)sys_tee;
+    sys_call_table[__NR_epoll_create]           = (SystemCall)sys_epoll_create;
+    sys_call_table[__NR_epoll_create1]          = (SystemCall)sys_epoll_create1;
+    sys_call_table[__NR_epoll_ctl]              = (SystemCall)sys_epoll_ctl;
+    sys_call_table[__NR_epoll_wait]             = (SystemCall)sys_epoll_wait;
+    sys_call_table[__NR_signalfd]               = (SystemCall)sys_signalfd;
+    sys_call_table[__NR_timerfd_create]         = (SystemCall)sys_timerfd_create;
+    sys_call_table[__NR_timerfd_settime]        = (SystemCall)sys_timerfd_settime;
+    sys_call_table[__NR_timerfd_gettime]        = (SystemCall)sys_timerfd_gettime;
+    sys_call_table[__NR_statx]                  = (SystemCall)sys_statx;
+    sys_call_table[__NR_clock_gettime]          = (SystemCall)sys_clock_gettime;
+    sys_call_table[__NR_madvise]                = (SystemCall)sys_madvise;
+    sys_call_table[__NR_memfd_create]           = (SystemCall)sys_memfd_create;
+    sys_call_table[__NR_sched_yield_to]         = (SystemCall)sys_sched_yield_to;
+    sys_call_table[__NR_sched_setaffinity]      = (SystemCall)sys_sched_setaffinity;
+    sys_call_table[__NR_sched_getaffinity]      = (SystemCall)sys_sched_getaffinity;
+    sys_call_table[__NR_fadvise64]              = (SystemCall)sys_fadvise64;
+    sys_call_table[__NR_aio_submit]             = (SystemCall)sys_aio_submit;
+    sys_call_table[__NR_aio_suspend]            = (SystemCall)sys_aio_suspend;
+    sys_call_table[__NR_aio_cancel]             = (SystemCall)sys_aio_cancel;
+    sys_call_table[__NR_mq_open]                = (SystemCall)sys_mq_open;
+    sys_call_table[__NR_mq_unlink]              = (SystemCall)sys_mq_unlink;
+    sys_call_table[__NR_mq_send]                = (SystemCall)sys_mq_send;
+    sys_call_table[__NR_mq_receive]             = (SystemCall)sys_mq_receive;
+    sys_call_table[__NR_mq_notify]              = (SystemCall)sys_mq_notify;
+    sys_call_table[__NR_mq_getsetattr]          = (SystemCall)sys_mq_getsetattr;
 
     isr_install_handler(SYSTEM_CALL, &syscall_handler, "syscall_handler");
 }
 
+int syscall_sysenter_init(void)
+{
+    pt_regs regs = { .eax = 1 };
+    call_cpuid(&regs);
+    if (!(regs.edx & CPUID_EDX_SEP)) {
+        return -1;
+    }
+    // Kernel code segment, the data one follows, and the user ones after it.
+    wrmsr(MSR_SYSENTER_CS, 0x08);
+    // The same stack used by the interrupts coming from user mode.
+    wrmsr(MSR_SYSENTER_ESP, this_cpu()->kernel_stack);
+    wrmsr(MSR_SYSENTER_EIP, (uintptr_t)sysenter_entry);
+    return 0;
+}
+
 pt_regs *get_current_interrupt_stack_frame(void)
 {
     return current_interrupt_stack_frame;
 }
 
+/// @brief Makes the process execute again the system call, once it resumes.
+/// @param f the interrupt stack frame.
+/// @param sc_index the number of the system call.
+static inline void __syscall_restart(pt_regs *f, uint32_t sc_index)
+{
+    f->eax = sc_index;
+    if (f->eip == vdso_sysenter_return) {
+        // Go back to the entry of the vDSO, popping what it pushed (ebp, edx
+        // and ecx), the registers holding the arguments are untouched.
+        f->ebp = *(uint32_t *)f->useresp;
+        f->useresp += 3 * sizeof(uint32_t);
+        f->eip = VDSO_ADDRESS + VDSO_SYSCALL_OFFSET;
+    } else {
+        // Go back to the `int 0x80`, two bytes long.
+        f->eip -= 2;
+    }
+}
+
 void syscall_handler(pt_regs *f)
 {
     // Saves current interrupt stack frame
     current_interrupt_stack_frame = f;
 
     // dbg_print_regs(f);
-    // Save current process fpu state.
+    // Protect the fpu state of the process from the kernel.
     switch_fpu();
 
     // The index of the requested system call.
@@ -278,13 +424,19 @@ void syscall_handler(pt_regs *f)
         uint32_t arg2 = f->edx;
         uint32_t arg3 = f->esi;
         uint32_t arg4 = f->edi;
+        trace_event(TRACE_SYSCALL_ENTER, sc_index, arg0, arg1, arg2);
+#ifdef ENABLE_SYSCALL_STAT
+        // Without a TSC, the statistics are left empty.
+        ktime_t start = hrtimer_tsc_available() ? rdtsc() : 0;
+#endif
         if ((sc_index == __NR_fork) ||
+            (sc_index == __NR_vfork) ||
             (sc_index == __NR_clone) ||
             (sc_index == __NR_execve) ||
             (sc_index == __NR_sigreturn)) {
             arg0 = (uintptr_t)f;
         }
-        if (sc_index == __NR_mmap) {
+        if ((sc_index == __NR_mmap) || (sc_index == __NR_splice)) {
             SystemCall6 func = (SystemCall6)ptr;
             // Get the arguments.
             unsigned *args = (unsigned *)arg0;
@@ -294,11 +446,28 @@ void syscall_handler(pt_regs *f)
             SystemCall5 func = (SystemCall5)ptr;
             ret = func(arg0, arg1, arg2, arg3, arg4);
         }
+#ifdef ENABLE_SYSCALL_STAT
+        if (start) {
+            ktime_t cycles = rdtsc() - start;
+            __syscall_stat_account(sc_index, (cycles >> 32) ? 0xFFFFFFFFu : (uint32_t)cycles);
+        }
+#endif
+        trace_event(TRACE_SYSCALL_EXIT, sc_index, ret, 0, 0);
     }
-    f->eax = ret;
+    if (ret == -ERESTARTSYS) {
+        // The process sleeps, and executes the call again once woken up.
+        __syscall_restart(f, sc_index);
+    } else {
+        f->eax = ret;
+    }
+
+    // Run the bottom halves raised during the system call.
+    softirq_run();
+    // Refresh the screen, if the refresh timer asked for it.
+    video_update();
 
     // Schedule next process.
     scheduler_run(f);
-    // Restore fpu state.
-    unswitch_fpu();
+    // Hand the fpu back to the process, lazily.
+    unswitch_fpu(f);
 }
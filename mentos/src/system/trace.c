@@ -0,0 +1,117 @@
+/// @file trace.c
+/// @brief Static tracepoints, recorded into per-CPU binary ring buffers.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// Each CPU writes only its own buffer, with interrupts disabled, so recording
+/// takes no lock. A full buffer overwrites its oldest records, which are
+/// counted as lost when the buffer is consumed.
+
+// Setup the logging for this file (do this before any other include).
+#include "sys/kernel_levels.h"           // Include kernel log levels.
+#define __DEBUG_HEADER__ "[TRACE ]"      ///< Change header.
+#define __DEBUG_LEVEL__  LOGLEVEL_NOTICE ///< Set log level.
+#include "io/debug.h"                    // Include debugging functions.
+
+#include "system/trace.h"
+#include "hardware/hrtimer.h"
+#include "hardware/smp.h"
+#include "hardware/timer.h"
+#include "klib/irqflags.h"
+#include "mem/kheap.h"
+#include "process/scheduler.h"
+#include "string.h"
+#include "sys/errno.h"
+
+/// @brief The ring buffer of a CPU.
+typedef struct trace_buffer_t {
+    /// The number of records written since boot.
+    unsigned long head;
+    /// The number of records consumed, or overwritten.
+    unsigned long tail;
+    /// The records.
+    trace_record_t records[TRACE_BUFFER_RECORDS];
+} trace_buffer_t;
+
+volatile uint32_t trace_mask = 0;
+
+/// The buffers, allocated when the first event is enabled.
+static trace_buffer_t *trace_buffers[SMP_MAX_CPUS];
+
+/// The names of the events.
+static const char *trace_event_names[TRACE_EVENT_NUM] = {
+    [TRACE_SCHED_SWITCH]   = "sched_switch",
+    [TRACE_PAGE_FAULT]     = "page_fault",
+    [TRACE_KMALLOC]        = "kmalloc",
+    [TRACE_KFREE]          = "kfree",
+    [TRACE_BLOCK_ISSUE]    = "block_issue",
+    [TRACE_BLOCK_COMPLETE] = "block_complete",
+    [TRACE_SYSCALL_ENTER]  = "syscall_enter",
+    [TRACE_SYSCALL_EXIT]   = "syscall_exit",
+};
+
+void trace_record(trace_event_t event, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3)
+{
+    uint8_t flags          = irq_disable();
+    unsigned cpu           = smp_processor_id();
+    trace_buffer_t *buffer = trace_buffers[cpu];
+    if (buffer) {
+        task_struct *curr      = scheduler_get_current_process();
+        trace_record_t *record = &buffer->records[buffer->head % TRACE_BUFFER_RECORDS];
+        record->timestamp      = hrtimer_tsc_available() ? rdtsc() : timer_get_ticks();
+        record->event          = event;
+        record->cpu            = cpu;
+        record->pid            = curr ? curr->pid : 0;
+        record->args[0]        = a0;
+        record->args[1]        = a1;
+        record->args[2]        = a2;
+        record->args[3]        = a3;
+        ++buffer->head;
+    }
+    irq_enable(flags);
+}
+
+const char *trace_event_name(trace_event_t event)
+{
+    return (event < TRACE_EVENT_NUM) ? trace_event_names[event] : NULL;
+}
+
+int trace_set_mask(uint32_t mask)
+{
+    mask &= (1u << TRACE_EVENT_NUM) - 1;
+    for (unsigned cpu = 0; mask && (cpu < smp_num_cpus); ++cpu) {
+        if (trace_buffers[cpu] == NULL) {
+            trace_buffer_t *buffer = (trace_buffer_t *)kmalloc(sizeof(trace_buffer_t));
+            if (buffer == NULL) {
+                pr_err("Failed to allocate the trace buffer of CPU %u.\n", cpu);
+                return -ENOMEM;
+            }
+            buffer->head = buffer->tail = 0;
+            trace_buffers[cpu]          = buffer;
+        }
+    }
+    trace_mask = mask;
+    return 0;
+}
+
+size_t trace_consume(unsigned cpu, trace_record_t *records, unsigned long *lost)
+{
+    if ((cpu >= smp_num_cpus) || (trace_buffers[cpu] == NULL)) {
+        return 0;
+    }
+    trace_buffer_t *buffer = trace_buffers[cpu];
+    // Only the bootstrap processor runs the code with the tracepoints, so
+    // disabling its interrupts is enough to stop the writers.
+    uint8_t flags = irq_disable();
+    if ((buffer->head - buffer->tail) > TRACE_BUFFER_RECORDS) {
+        *lost += (buffer->head - buffer->tail) - TRACE_BUFFER_RECORDS;
+        buffer->tail = buffer->head - TRACE_BUFFER_RECORDS;
+    }
+    size_t count = buffer->head - buffer->tail;
+    for (size_t it = 0; it < count; ++it) {
+        records[it] = buffer->records[(buffer->tail + it) % TRACE_BUFFER_RECORDS];
+    }
+    buffer->tail = buffer->head;
+    irq_enable(flags);
+    return count;
+}
@@ -0,0 +1,110 @@
+/// @file vdso.c
+/// @brief The page mapped by the kernel, read-only, in every process.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+// Setup the logging for this file (do this before any other include).
+#include "sys/kernel_levels.h"           // Include kernel log levels.
+#define __DEBUG_HEADER__ "[VDSO  ]"      ///< Change header.
+#define __DEBUG_LEVEL__  LOGLEVEL_NOTICE ///< Set log level.
+#include "io/debug.h"                    // Include debugging functions.
+
+#include "system/vdso.h"
+#include "assert.h"
+#include "drivers/rtc.h"
+#include "hardware/hrtimer.h"
+#include "hardware/timer.h"
+#include "klib/stdatomic.h"
+#include "mem/zone_allocator.h"
+#include "string.h"
+#include "system/syscall.h"
+
+/// @defgroup vdso_code Code of the vDSO
+/// @brief Symbols of vdso_entry.S, whose code is copied inside the page.
+/// @{
+extern char vdso_start[];            ///< The start of the code.
+extern char vdso_sysenter_landing[]; ///< Where SYSEXIT returns.
+extern char vdso_int80[];            ///< The entry using `int 0x80`.
+extern char vdso_end[];              ///< The end of the code.
+/// @}
+
+uint32_t vdso_sysenter_return = 0;
+
+/// The physical page, NULL until vdso_init.
+static page_t *vdso_page = NULL;
+/// The data inside the page, as the kernel sees it.
+static vdso_data_t *vdso_data = NULL;
+
+int vdso_init(void)
+{
+    assert((vdso_end - vdso_start) <= PAGE_SIZE && "The vDSO does not fit in a page.");
+    uint32_t vaddr = __alloc_pages_lowmem(GFP_KERNEL, 0);
+    if (!vaddr) {
+        pr_err("Failed to allocate the vDSO page.\n");
+        return -1;
+    }
+    memset((void *)vaddr, 0, PAGE_SIZE);
+    memcpy((char *)vaddr + VDSO_SYSCALL_OFFSET, vdso_start, vdso_end - vdso_start);
+    // The reference of the allocation is never dropped, the processes only
+    // add and remove their own.
+    vdso_page            = get_lowmem_page_from_address(vaddr);
+    vdso_sysenter_return = VDSO_ADDRESS + VDSO_SYSCALL_OFFSET + (vdso_sysenter_landing - vdso_start);
+    // Fill the clock, the wall time is the boot time plus the time since boot.
+    vdso_data                   = (vdso_data_t *)(vaddr + VDSO_DATA_OFFSET);
+    vdso_data->ticks_per_second = TICKS_PER_SECOND;
+    vdso_data->tsc_shift        = TSC_SHIFT;
+    // Until SYSENTER is enabled, the processes enter with the interrupt.
+    assert((VDSO_ADDRESS + VDSO_DATA_OFFSET + offsetof(vdso_data_t, syscall_entry) == VDSO_SYSCALL_ENTRY_ADDRESS) &&
+           "VDSO_SYSCALL_ENTRY_ADDRESS does not match vdso_data_t.");
+    vdso_data->syscall_entry = VDSO_ADDRESS + VDSO_SYSCALL_OFFSET + (vdso_int80 - vdso_start);
+    vdso_update();
+    pr_debug("vDSO page at 0x%p, SYSEXIT returns to 0x%p.\n", get_physical_address_from_page(vdso_page), vdso_sysenter_return);
+    return 0;
+}
+
+int vdso_map(mm_struct_t *mm)
+{
+    if (!vdso_page) {
+        return -1;
+    }
+    // Create the area with its page table entries, but without pages, then
+    // map the shared page, read-only. The area is anonymous, thus fork shares
+    // the page, and the exit drops the reference.
+    create_vm_area(mm, VDSO_ADDRESS, PAGE_SIZE, MM_USER | MM_COW, GFP_HIGHUSER);
+    mem_upd_vm_area(mm->pgd, VDSO_ADDRESS, get_physical_address_from_page(vdso_page), PAGE_SIZE,
+                    MM_PRESENT | MM_USER | MM_UPDADDR);
+    page_inc(vdso_page);
+    return 0;
+}
+
+void vdso_enable_sysenter(void)
+{
+    if (vdso_data) {
+        vdso_data->syscall_entry = VDSO_ADDRESS + VDSO_SYSCALL_OFFSET;
+    }
+}
+
+void vdso_update(void)
+{
+    ktime_t tsc;
+    uint32_t mult;
+    if (!vdso_data) {
+        return;
+    }
+    ktime_t now   = hrtimer_get_clock(&tsc, &mult);
+    uint32_t nsec = div64_32(&now, NSEC_PER_SEC);
+    // Step 1: make the counter odd, the readers wait for us.
+    ++vdso_data->seq;
+    barrier();
+    // Step 2: update the clock.
+    vdso_data->ticks       = timer_get_ticks();
+    vdso_data->boot_time   = rtc_get_boot_time();
+    vdso_data->uptime_sec  = (uint32_t)now;
+    vdso_data->uptime_nsec = nsec;
+    vdso_data->tsc         = tsc;
+    vdso_data->tsc_mult    = mult;
+    // Step 3: make the counter even again, the readers which saw it odd, or
+    // saw an older value, read again.
+    barrier();
+    ++vdso_data->seq;
+}
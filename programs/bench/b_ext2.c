@@ -0,0 +1,191 @@
+/// @file b_ext2.c
+/// @brief Measures the algorithms of ext2: path lookup, directories growing
+/// large, and the allocation and release of blocks.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// The directory is filled in batches measured apart, so that a lookup that
+/// gets slower with the size of the directory shows up as a growing cost per
+/// operation. Each measurement also prints the commands that reached the
+/// disk; booting with `ata_delay_us=` makes each of them more expensive. The
+/// sequential and random accesses to a file are measured by b_fs.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strerror.h>
+#include <sys/errno.h>
+#include <sys/stat.h>
+#include <sys/unistd.h>
+
+#include "bench.h"
+
+/// The directory holding everything, on the ext2 root.
+#define ROOT_PATH "/home/user/b_ext2"
+/// The depth of the nested directories of the lookups.
+#define LOOKUP_DEPTH 8
+/// The number of lookups of the deepest path.
+#define LOOKUP_COUNT 2000
+/// The number of files created in a batch.
+#define BATCH_SIZE 256
+/// The number of batches, the directory ends up with all their files.
+#define BATCH_COUNT 4
+/// The size of the writes growing a file.
+#define APPEND_SIZE 1024
+/// The size the file grows to, past the double indirect blocks of 1 KiB
+/// blocks.
+#define APPEND_TOTAL (4 * 1024 * 1024)
+
+/// The buffer of the writes.
+static char buffer[APPEND_SIZE];
+
+/// @brief Builds the path of a file of the large directory.
+/// @param path where the path is stored.
+/// @param index the index of the file.
+static void file_path(char *path, unsigned index)
+{
+    sprintf(path, "%s/big/file_%05u", ROOT_PATH, index);
+}
+
+/// @brief Looks up a deep path many times.
+/// @return 0 on success, -1 on failure.
+static int bench_lookup(void)
+{
+    char path[256] = ROOT_PATH;
+    stat_t st;
+    bench_t bench;
+    bench_io_t io;
+    for (unsigned depth = 0; depth < LOOKUP_DEPTH; ++depth) {
+        sprintf(path + strlen(path), "/d%u", depth);
+        if (mkdir(path, 0755) < 0) {
+            printf("mkdir %s: %s\n", path, strerror(errno));
+            return -1;
+        }
+    }
+    bench_io_read(&io);
+    bench_start(&bench, "ext2_lookup_deep");
+    for (unsigned i = 0; i < LOOKUP_COUNT; ++i) {
+        if (stat(path, &st) < 0) {
+            printf("stat %s: %s\n", path, strerror(errno));
+            return -1;
+        }
+    }
+    bench_stop(&bench, LOOKUP_COUNT, 0);
+    bench_io_stop("ext2_lookup_deep", &io);
+    for (unsigned depth = LOOKUP_DEPTH; depth > 0; --depth) {
+        rmdir(path);
+        *strrchr(path, '/') = 0;
+    }
+    return 0;
+}
+
+/// @brief Fills a directory in batches, then looks up and removes its files.
+/// @return 0 on success, -1 on failure.
+static int bench_directory(void)
+{
+    char path[256], name[32];
+    stat_t st;
+    bench_t bench;
+    bench_io_t io;
+    sprintf(path, "%s/big", ROOT_PATH);
+    if (mkdir(path, 0755) < 0) {
+        printf("mkdir %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    for (unsigned batch = 0; batch < BATCH_COUNT; ++batch) {
+        sprintf(name, "ext2_create_%u", batch);
+        bench_io_read(&io);
+        bench_start(&bench, name);
+        for (unsigned i = batch * BATCH_SIZE; i < (batch + 1) * BATCH_SIZE; ++i) {
+            file_path(path, i);
+            int fd = creat(path, 0644);
+            if (fd < 0) {
+                printf("creat %s: %s\n", path, strerror(errno));
+                return -1;
+            }
+            close(fd);
+        }
+        bench_stop(&bench, BATCH_SIZE, 0);
+        bench_io_stop(name, &io);
+    }
+    bench_io_read(&io);
+    bench_start(&bench, "ext2_lookup_wide");
+    for (unsigned i = 0; i < BATCH_COUNT * BATCH_SIZE; ++i) {
+        file_path(path, i);
+        if (stat(path, &st) < 0) {
+            printf("stat %s: %s\n", path, strerror(errno));
+            return -1;
+        }
+    }
+    bench_stop(&bench, BATCH_COUNT * BATCH_SIZE, 0);
+    bench_io_stop("ext2_lookup_wide", &io);
+    bench_io_read(&io);
+    bench_start(&bench, "ext2_unlink");
+    for (unsigned i = 0; i < BATCH_COUNT * BATCH_SIZE; ++i) {
+        file_path(path, i);
+        if (unlink(path) < 0) {
+            printf("unlink %s: %s\n", path, strerror(errno));
+            return -1;
+        }
+    }
+    bench_stop(&bench, BATCH_COUNT * BATCH_SIZE, 0);
+    bench_io_stop("ext2_unlink", &io);
+    sprintf(path, "%s/big", ROOT_PATH);
+    rmdir(path);
+    return 0;
+}
+
+/// @brief Grows a file with small writes, then releases its blocks.
+/// @return 0 on success, -1 on failure.
+static int bench_allocation(void)
+{
+    char path[256];
+    bench_t bench;
+    bench_io_t io;
+    sprintf(path, "%s/grow", ROOT_PATH);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        printf("open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    bench_io_read(&io);
+    bench_start(&bench, "ext2_append");
+    for (unsigned i = 0; i < APPEND_TOTAL / APPEND_SIZE; ++i) {
+        if (write(fd, buffer, APPEND_SIZE) != APPEND_SIZE) {
+            printf("write %s: %s\n", path, strerror(errno));
+            close(fd);
+            return -1;
+        }
+    }
+    bench_stop(&bench, APPEND_TOTAL / APPEND_SIZE, APPEND_TOTAL);
+    bench_io_stop("ext2_append", &io);
+    close(fd);
+    bench_io_read(&io);
+    bench_start(&bench, "ext2_release");
+    if (unlink(path) < 0) {
+        printf("unlink %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    bench_stop(&bench, 1, APPEND_TOTAL);
+    bench_io_stop("ext2_release", &io);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    memset(buffer, 0x5A, sizeof(buffer));
+    if ((mkdir(ROOT_PATH, 0755) < 0) && (errno != EEXIST)) {
+        printf("mkdir %s: %s\n", ROOT_PATH, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    int ret = bench_lookup();
+    if (!ret) {
+        ret = bench_directory();
+    }
+    if (!ret) {
+        ret = bench_allocation();
+    }
+    rmdir(ROOT_PATH);
+    return ret ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,97 @@
+/// @file b_fs.c
+/// @brief Measures the throughput of sequential and random accesses to an
+/// ext2 file.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strerror.h>
+#include <sys/errno.h>
+#include <sys/unistd.h>
+
+#include "bench.h"
+
+/// The file, on the ext2 root.
+#define FILE_PATH "/home/user/b_fs.dat"
+/// The size of each access.
+#define BLOCK_SIZE 4096
+/// The number of blocks in the file.
+#define FILE_BLOCKS 512
+
+/// The buffer of the accesses.
+static char buffer[BLOCK_SIZE];
+
+/// @brief Returns the blocks in a shuffled order.
+/// @param order where the order is stored.
+static void shuffle(unsigned *order)
+{
+    // A fixed seed, so that every run does the same accesses.
+    unsigned state = 12345;
+    for (unsigned i = 0; i < FILE_BLOCKS; ++i) {
+        order[i] = i;
+    }
+    for (unsigned i = FILE_BLOCKS - 1; i > 0; --i) {
+        state      = state * 1103515245 + 12345;
+        unsigned j = (state >> 16) % (i + 1), tmp = order[i];
+        order[i]   = order[j];
+        order[j]   = tmp;
+    }
+}
+
+/// @brief Reads or writes every block of the file once.
+/// @param fd the file.
+/// @param name the name of the measurement.
+/// @param order the order of the blocks, NULL for sequential accesses.
+/// @param writing 1 to write, 0 to read.
+/// @return 0 on success, -1 on failure.
+static int run(int fd, const char *name, const unsigned *order, int writing)
+{
+    bench_t bench;
+    if (lseek(fd, 0, SEEK_SET) < 0) {
+        printf("lseek: %s\n", strerror(errno));
+        return -1;
+    }
+    bench_start(&bench, name);
+    for (unsigned i = 0; i < FILE_BLOCKS; ++i) {
+        if (order && (lseek(fd, (off_t)order[i] * BLOCK_SIZE, SEEK_SET) < 0)) {
+            printf("lseek: %s\n", strerror(errno));
+            return -1;
+        }
+        ssize_t ret = writing ? write(fd, buffer, BLOCK_SIZE) : read(fd, buffer, BLOCK_SIZE);
+        if (ret != BLOCK_SIZE) {
+            printf("%s: %s\n", writing ? "write" : "read", (ret < 0) ? strerror(errno) : "short transfer");
+            return -1;
+        }
+    }
+    bench_stop(&bench, FILE_BLOCKS, FILE_BLOCKS * BLOCK_SIZE);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    static unsigned order[FILE_BLOCKS];
+    memset(buffer, 0xA5, sizeof(buffer));
+    shuffle(order);
+    int fd = open(FILE_PATH, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        printf("Failed to create %s: %s\n", FILE_PATH, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    // The first pass allocates the blocks, the others find them.
+    int ret = run(fd, "ext2_write_seq", NULL, 1);
+    if (!ret) {
+        ret = run(fd, "ext2_write_rand", order, 1);
+    }
+    if (!ret) {
+        ret = run(fd, "ext2_read_seq", NULL, 0);
+    }
+    if (!ret) {
+        ret = run(fd, "ext2_read_rand", order, 0);
+    }
+    close(fd);
+    unlink(FILE_PATH);
+    return ret ? EXIT_FAILURE : EXIT_SUCCESS;
+}
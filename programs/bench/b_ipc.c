@@ -0,0 +1,113 @@
+/// @file b_ipc.c
+/// @brief Measures the latency of the message queues, and the bandwidth of
+/// the shared memory.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strerror.h>
+#include <sys/errno.h>
+#include <sys/ipc.h>
+#include <sys/msg.h>
+#include <sys/shm.h>
+#include <sys/unistd.h>
+#include <sys/wait.h>
+#include <signal.h>
+
+#include "bench.h"
+
+/// Round trips of a message.
+#define MSG_ITERATIONS 5000
+/// The size of the shared memory.
+#define SHM_SIZE (64 * 1024)
+/// Copies into the shared memory.
+#define SHM_ITERATIONS 256
+
+/// @brief A message.
+typedef struct message_t {
+    /// The type: 1 towards the child, 2 towards the parent.
+    long mtype;
+    /// The payload.
+    char mtext[8];
+} message_t;
+
+/// @brief Sends a message to a child, which sends it back.
+/// @return 0 on success, -1 on failure.
+static int bench_msg(void)
+{
+    bench_t bench;
+    message_t message = { 0 };
+    int msqid         = msgget(IPC_PRIVATE, IPC_CREAT | 0600);
+    if (msqid < 0) {
+        printf("msgget: %s\n", strerror(errno));
+        return -1;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        printf("fork: %s\n", strerror(errno));
+        msgctl(msqid, IPC_RMID, NULL);
+        return -1;
+    }
+    if (pid == 0) {
+        for (unsigned long i = 0; i < MSG_ITERATIONS; ++i) {
+            msgrcv(msqid, &message, sizeof(message.mtext), 1, 0);
+            message.mtype = 2;
+            msgsnd(msqid, &message, sizeof(message.mtext), 0);
+        }
+        exit(0);
+    }
+    bench_start(&bench, "msg_round_trip");
+    for (unsigned long i = 0; i < MSG_ITERATIONS; ++i) {
+        message.mtype = 1;
+        if ((msgsnd(msqid, &message, sizeof(message.mtext), 0) < 0) ||
+            (msgrcv(msqid, &message, sizeof(message.mtext), 2, 0) < 0)) {
+            printf("msg: %s\n", strerror(errno));
+            kill(pid, SIGKILL);
+            break;
+        }
+    }
+    bench_stop(&bench, MSG_ITERATIONS, 0);
+    waitpid(pid, NULL, 0);
+    msgctl(msqid, IPC_RMID, NULL);
+    return 0;
+}
+
+/// @brief Copies a buffer into a shared segment.
+/// @return 0 on success, -1 on failure.
+static int bench_shm(void)
+{
+    static char source[SHM_SIZE];
+    bench_t bench;
+    int shmid = shmget(IPC_PRIVATE, SHM_SIZE, IPC_CREAT | 0600);
+    if (shmid < 0) {
+        printf("shmget: %s\n", strerror(errno));
+        return -1;
+    }
+    char *shared = (char *)shmat(shmid, NULL, 0);
+    if (shared == (char *)-1) {
+        printf("shmat: %s\n", strerror(errno));
+        shmctl(shmid, IPC_RMID, NULL);
+        return -1;
+    }
+    memset(source, 0x5A, sizeof(source));
+    // Fault the pages in first, so that only the copies are measured.
+    memset(shared, 0, SHM_SIZE);
+    bench_start(&bench, "shm_copy");
+    for (unsigned long i = 0; i < SHM_ITERATIONS; ++i) {
+        memcpy(shared, source, SHM_SIZE);
+    }
+    bench_stop(&bench, SHM_ITERATIONS, SHM_ITERATIONS * SHM_SIZE);
+    shmdt(shared);
+    shmctl(shmid, IPC_RMID, NULL);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if ((bench_msg() < 0) || (bench_shm() < 0)) {
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,158 @@
+/// @file b_process.c
+/// @brief Measures the creation of processes, the context switches between
+/// them, and the handling of page faults.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strerror.h>
+#include <sys/errno.h>
+#include <sys/ipc.h>
+#include <sys/mman.h>
+#include <sys/sem.h>
+#include <sys/unistd.h>
+#include <sys/wait.h>
+
+#include "bench.h"
+
+/// Processes created by each measurement.
+#define SPAWN_ITERATIONS 200
+/// Round trips between the two processes.
+#define SWITCH_ITERATIONS 5000
+/// Pages touched for the first time.
+#define FAULT_PAGES 1024
+/// The size of a page.
+#define PAGE_SIZE 4096
+
+/// @brief Changes the value of a semaphore.
+/// @param semid the set of semaphores.
+/// @param num the semaphore.
+/// @param op the change.
+/// @return 0 on success, -1 on failure.
+static int sem_change(int semid, unsigned short num, short op)
+{
+    struct sembuf sop = { .sem_num = num, .sem_op = op, .sem_flg = 0 };
+    return semop(semid, &sop, 1);
+}
+
+/// @brief Forks a child which exits at once, and waits for it.
+/// @return 0 on success, -1 on failure.
+static int bench_fork(void)
+{
+    bench_t bench;
+    bench_start(&bench, "fork_exit_wait");
+    for (unsigned long i = 0; i < SPAWN_ITERATIONS; ++i) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            printf("fork: %s\n", strerror(errno));
+            return -1;
+        }
+        if (pid == 0) {
+            exit(0);
+        }
+        waitpid(pid, NULL, 0);
+    }
+    bench_stop(&bench, SPAWN_ITERATIONS, 0);
+    return 0;
+}
+
+/// @brief Forks a child which executes this program, and waits for it.
+/// @param path the path of this program.
+/// @return 0 on success, -1 on failure.
+static int bench_exec(const char *path)
+{
+    bench_t bench;
+    char *argv[] = { (char *)path, "exit", NULL };
+    bench_start(&bench, "fork_exec_wait");
+    for (unsigned long i = 0; i < SPAWN_ITERATIONS; ++i) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            printf("fork: %s\n", strerror(errno));
+            return -1;
+        }
+        if (pid == 0) {
+            execv(path, argv);
+            exit(1);
+        }
+        int status;
+        waitpid(pid, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+            printf("Failed to execute %s.\n", path);
+            return -1;
+        }
+    }
+    bench_stop(&bench, SPAWN_ITERATIONS, 0);
+    return 0;
+}
+
+/// @brief Passes the CPU back and forth between two processes, through a
+/// pair of semaphores.
+/// @return 0 on success, -1 on failure.
+static int bench_switch(void)
+{
+    bench_t bench;
+    int semid = semget(IPC_PRIVATE, 2, IPC_CREAT | 0600);
+    if (semid < 0) {
+        printf("semget: %s\n", strerror(errno));
+        return -1;
+    }
+    union semun arg = { .val = 0 };
+    semctl(semid, 0, SETVAL, &arg);
+    semctl(semid, 1, SETVAL, &arg);
+    pid_t pid = fork();
+    if (pid < 0) {
+        printf("fork: %s\n", strerror(errno));
+        semctl(semid, 0, IPC_RMID, NULL);
+        return -1;
+    }
+    if (pid == 0) {
+        for (unsigned long i = 0; i < SWITCH_ITERATIONS; ++i) {
+            sem_change(semid, 0, -1);
+            sem_change(semid, 1, 1);
+        }
+        exit(0);
+    }
+    // Each round trip takes two switches.
+    bench_start(&bench, "context_switch");
+    for (unsigned long i = 0; i < SWITCH_ITERATIONS; ++i) {
+        sem_change(semid, 0, 1);
+        sem_change(semid, 1, -1);
+    }
+    bench_stop(&bench, 2 * SWITCH_ITERATIONS, 0);
+    waitpid(pid, NULL, 0);
+    semctl(semid, 0, IPC_RMID, NULL);
+    return 0;
+}
+
+/// @brief Touches anonymous pages for the first time.
+/// @return 0 on success, -1 on failure.
+static int bench_fault(void)
+{
+    bench_t bench;
+    char *area = (char *)mmap(NULL, FAULT_PAGES * PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (area == (char *)-1) {
+        printf("mmap: %s\n", strerror(errno));
+        return -1;
+    }
+    bench_start(&bench, "page_fault");
+    for (unsigned long i = 0; i < FAULT_PAGES; ++i) {
+        area[i * PAGE_SIZE] = 1;
+    }
+    bench_stop(&bench, FAULT_PAGES, FAULT_PAGES * PAGE_SIZE);
+    munmap(area, FAULT_PAGES * PAGE_SIZE);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    // The image executed by bench_exec.
+    if ((argc > 1) && !strcmp(argv[1], "exit")) {
+        return EXIT_SUCCESS;
+    }
+    if ((bench_fork() < 0) || (bench_exec(argv[0]) < 0) || (bench_switch() < 0) || (bench_fault() < 0)) {
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
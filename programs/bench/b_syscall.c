@@ -0,0 +1,57 @@
+/// @file b_syscall.c
+/// @brief Measures the cost of entering the kernel, with and without
+/// allocations on the way.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strerror.h>
+#include <sys/errno.h>
+#include <sys/unistd.h>
+
+#include "bench.h"
+
+/// Iterations of the system call which does nothing.
+#define NULL_ITERATIONS 100000
+/// Iterations of the system calls which allocate.
+#define ALLOC_ITERATIONS 10000
+
+int main(int argc, char *argv[])
+{
+    bench_t bench;
+    int fds[2];
+
+    // A round trip which does no work inside the kernel.
+    bench_start(&bench, "syscall_null");
+    for (unsigned long i = 0; i < NULL_ITERATIONS; ++i) {
+        getppid();
+    }
+    bench_stop(&bench, NULL_ITERATIONS, 0);
+
+    // A pipe allocates two files and its buffer, closing them frees them.
+    bench_start(&bench, "syscall_pipe_close");
+    for (unsigned long i = 0; i < ALLOC_ITERATIONS; ++i) {
+        if (pipe(fds) < 0) {
+            printf("pipe: %s\n", strerror(errno));
+            return EXIT_FAILURE;
+        }
+        close(fds[0]);
+        close(fds[1]);
+    }
+    bench_stop(&bench, ALLOC_ITERATIONS, 0);
+
+    // Opening a file resolves its path, and allocates its descriptor.
+    bench_start(&bench, "syscall_open_close");
+    for (unsigned long i = 0; i < ALLOC_ITERATIONS; ++i) {
+        int fd = open("/etc/passwd", O_RDONLY, 0);
+        if (fd < 0) {
+            printf("open: %s\n", strerror(errno));
+            return EXIT_FAILURE;
+        }
+        close(fd);
+    }
+    bench_stop(&bench, ALLOC_ITERATIONS, 0);
+    return EXIT_SUCCESS;
+}
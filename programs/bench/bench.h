@@ -0,0 +1,164 @@
+/// @file bench.h
+/// @brief Timing and reporting shared by the kernel micro-benchmarks.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// Each measurement prints a single line, so that the results of a run can
+/// be collected with grep and compared across kernel versions:
+///
+///     bench <name> ops=<n> bytes=<n> cycles=<n> cycles_per_op=<n> usec=<n>
+///
+/// The cycles come from the time-stamp counter, the microseconds from
+/// gettimeofday. The programs link without libgcc, so the 64-bit divisions
+/// are done with divl, like div64_32 in the kernel.
+///
+/// The measurements of the filesystem can also count the commands reaching
+/// the disks, from /proc/diskstats, which do not depend on the speed of the
+/// machine running the emulator:
+///
+///     io <name> reads=<n> writes=<n>
+
+#pragma once
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/unistd.h>
+#include <time.h>
+
+/// @brief A measurement in progress.
+typedef struct bench_t {
+    /// The name of the measurement.
+    const char *name;
+    /// The time-stamp counter when it started.
+    unsigned long long tsc;
+    /// The time when it started.
+    timeval tv;
+} bench_t;
+
+/// @brief Reads the time-stamp counter.
+/// @return the number of cycles since the CPU was reset.
+static inline unsigned long long bench_rdtsc(void)
+{
+    unsigned long long value;
+    __asm__ __volatile__("rdtsc" : "=A"(value));
+    return value;
+}
+
+/// @brief Divides a 64-bit value by a 32-bit one, in place.
+/// @param n the dividend, replaced by the quotient.
+/// @param base the divisor.
+/// @return the remainder.
+static inline uint32_t bench_div64_32(unsigned long long *n, uint32_t base)
+{
+    uint32_t high = (uint32_t)(*n >> 32), low = (uint32_t)*n, rem = 0, quot_high = 0;
+    if (high >= base) {
+        quot_high = high / base;
+        high      = high % base;
+    }
+    __asm__("divl %4" : "=a"(low), "=d"(rem) : "a"(low), "d"(high), "rm"(base));
+    *n = ((unsigned long long)quot_high << 32) | low;
+    return rem;
+}
+
+/// @brief Writes a 64-bit value in decimal, since printf cannot.
+/// @param value the value.
+/// @param buffer a buffer of at least 21 characters.
+/// @return the text, inside the buffer.
+static inline const char *bench_u64_to_string(unsigned long long value, char *buffer)
+{
+    char *it = buffer + 20;
+    *it      = 0;
+    do {
+        *(--it) = (char)('0' + bench_div64_32(&value, 10));
+    } while (value);
+    return it;
+}
+
+/// @brief Starts a measurement.
+/// @param bench the measurement.
+/// @param name its name, as printed in the results.
+static inline void bench_start(bench_t *bench, const char *name)
+{
+    bench->name = name;
+    gettimeofday(&bench->tv, NULL);
+    bench->tsc = bench_rdtsc();
+}
+
+/// @brief Ends a measurement, and prints its result.
+/// @param bench the measurement.
+/// @param ops the number of operations performed.
+/// @param bytes the number of bytes moved, 0 if it does not apply.
+static inline void bench_stop(bench_t *bench, unsigned long ops, unsigned long bytes)
+{
+    unsigned long long cycles = bench_rdtsc() - bench->tsc;
+    timeval now;
+    gettimeofday(&now, NULL);
+    unsigned long usec = (now.tv_sec - bench->tv.tv_sec) * 1000000UL + now.tv_usec - bench->tv.tv_usec;
+    unsigned long long per_op = cycles;
+    bench_div64_32(&per_op, ops ? ops : 1);
+    char total[21], average[21];
+    printf("bench %s ops=%lu bytes=%lu cycles=%s cycles_per_op=%s usec=%lu\n",
+           bench->name, ops, bytes,
+           bench_u64_to_string(cycles, total),
+           bench_u64_to_string(per_op, average),
+           usec);
+}
+
+/// @brief The commands completed by the disks.
+typedef struct bench_io_t {
+    /// The reads.
+    unsigned long reads;
+    /// The writes.
+    unsigned long writes;
+} bench_io_t;
+
+/// @brief Sums the commands completed by all the disks.
+/// @param io where the sums are stored, zero if /proc/diskstats is missing.
+static inline void bench_io_read(bench_io_t *io)
+{
+    static char text[1024];
+    ssize_t size = 0, ret;
+    io->reads = io->writes = 0;
+    int fd = open("/proc/diskstats", O_RDONLY, 0);
+    if (fd < 0) {
+        return;
+    }
+    while ((size < (ssize_t)sizeof(text) - 1) && ((ret = read(fd, text + size, sizeof(text) - 1 - size)) > 0)) {
+        size += ret;
+    }
+    text[size] = 0;
+    close(fd);
+    // Each line is: name, then five columns for the reads, then five for the
+    // writes, the completed commands first.
+    for (char *line = text; *line; ++line) {
+        if (*line != '#') {
+            char *it = line;
+            while (*it && (*it != ' ')) {
+                ++it;
+            }
+            io->reads += strtol(it, &it, 10);
+            for (int column = 0; column < 4; ++column) {
+                strtol(it, &it, 10);
+            }
+            io->writes += strtol(it, &it, 10);
+        }
+        while (*line && (*line != '\n')) {
+            ++line;
+        }
+        if (!*line) {
+            break;
+        }
+    }
+}
+
+/// @brief Prints the commands completed by the disks since a reading.
+/// @param name the name of the measurement.
+/// @param start the reading taken when it started.
+static inline void bench_io_stop(const char *name, const bench_io_t *start)
+{
+    bench_io_t now;
+    bench_io_read(&now);
+    printf("io %s reads=%lu writes=%lu\n", name, now.reads - start->reads, now.writes - start->writes);
+}
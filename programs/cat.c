@@ -9,6 +9,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/sendfile.h>
+#include <sys/splice.h>
 #include <sys/unistd.h>
 #include <strerror.h>
 #include <sys/stat.h>
@@ -31,8 +33,9 @@ int main(int argc, char **argv)
     }
     int ret = 0;
     int fd;
-    // Prepare the buffer for reading.
-    char buffer[BUFSIZ];
+    // Into a pipe, the kernel reads the files straight inside its buffer.
+    stat_t st;
+    int to_pipe = (fstat(STDOUT_FILENO, &st) == 0) && S_ISFIFO(st.st_mode);
     // Iterate the arguments.
     for (int i = 1; i < argc; ++i) {
         // Initialize the file path.
@@ -45,9 +48,11 @@ int main(int argc, char **argv)
             continue;
         }
         ssize_t bytes_read = 0;
-        // Put on the standard output the characters.
-        while ((bytes_read = read(fd, buffer, BUFSIZ)) > 0) {
-            write(STDOUT_FILENO, buffer, bytes_read);
+        // Let the kernel move the characters to the standard output.
+        if (to_pipe) {
+            while ((bytes_read = splice(fd, NULL, STDOUT_FILENO, NULL, 16 * BUFSIZ, 0)) > 0) {}
+        } else {
+            while ((bytes_read = sendfile(STDOUT_FILENO, fd, NULL, 16 * BUFSIZ)) > 0) {}
         }
         close(fd);
         if (bytes_read < 0) {
@@ -17,18 +17,18 @@ int main(int argc, char *argv[])
    gid_t gid = -1;
 
    if (argc != 3) {
-       fprintf(STDERR_FILENO, "%s: MODE FILE\n", argv[0]);
+       fprintf(stderr, "%s: MODE FILE\n", argv[0]);
        exit(EXIT_FAILURE);
    }
 
    mode = strtol(argv[1], &endptr, 8);
    if (*endptr != '\0') {
-       fprintf(STDERR_FILENO, "%s: invalid mode: '%s'\n", argv[0], argv[1]);
+       fprintf(stderr, "%s: invalid mode: '%s'\n", argv[0], argv[1]);
        exit(EXIT_FAILURE);
    }
 
    if (chmod(argv[2], mode) == -1) {
-       fprintf(STDERR_FILENO, "%s: changing permissions of %s: %s\n",
+       fprintf(stderr, "%s: changing permissions of %s: %s\n",
                argv[0], argv[2], strerror(errno));
        exit(EXIT_FAILURE);
    }
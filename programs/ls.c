@@ -3,7 +3,7 @@
 /// @copyright (c) 2014-2024 This file is distributed under the MIT License.
 /// See LICENSE.md for details.
 
-#include <sys/dirent.h>
+#include <dirent.h>
 #include <stdint.h>
 #include <string.h>
 #include <stdio.h>
@@ -26,13 +26,11 @@
 #define FG_BRIGHT_WHITE  "\033[97m"
 #define FG_BRIGHT_YELLOW "\033[93m"
 
-#define DENTS_NUM 12
-
-static inline void print_dir_entry(dirent_t *dirent, const char *path, unsigned int flags, size_t *total_size)
+static inline void print_dir_entry(DIR *dir, dirent_t *dirent, unsigned int flags, size_t *total_size)
 {
-    static char relative_path[PATH_MAX];
     tm_t *timeinfo;
     stat_t dstat;
+    unsigned int mask = 0;
 
     // Check if the file starts with a dot (hidden), and we did not receive
     // the `a` flag.
@@ -40,14 +38,17 @@ static inline void print_dir_entry(dirent_t *dirent, const char *path, unsigned
         return;
     }
 
-    // Prepare the relative path.
-    strcpy(relative_path, path);
-    if (strcmp(path, "/") != 0)
-        strcat(relative_path, "/");
-    strcat(relative_path, dirent->d_name);
+    // The type comes with the entry, the mode is needed only to color the
+    // executables, unless we print everything.
+    if (bitmask_check(flags, FLAG_L)) {
+        mask = STATX_BASIC_STATS;
+    } else if (dirent->d_type == DT_REG) {
+        mask = STATX_MODE;
+    }
 
-    // Stat the file.
-    if (stat(relative_path, &dstat) == -1) {
+    // Stat the file, starting from the directory.
+    memset(&dstat, 0, sizeof(stat_t));
+    if (mask && (statx(dirfd(dir), dirent->d_name, 0, mask, &dstat) == -1)) {
         return;
     }
 
@@ -111,17 +112,13 @@ static inline void print_dir_entry(dirent_t *dirent, const char *path, unsigned
     puts(FG_BRIGHT_WHITE);
 }
 
-static void print_ls(int fd, const char *path, unsigned int flags)
+static void print_ls(DIR *dir, unsigned int flags)
 {
-    dirent_t dents[DENTS_NUM];
-    memset(&dents, 0, DENTS_NUM * sizeof(dirent_t));
-
+    dirent_t *dent;
     size_t total_size = 0;
-    while (getdents(fd, dents, sizeof(dents))) {
-        for (size_t i = 0; i < DENTS_NUM; ++i) {
-            if (dents[i].d_ino != 0) {
-                print_dir_entry(&dents[i], path, flags, &total_size);
-            }
+    while ((dent = readdir(dir)) != NULL) {
+        if (dent->d_ino != 0) {
+            print_dir_entry(dir, dent, flags, &total_size);
         }
     }
     printf("\n");
@@ -168,24 +165,24 @@ int main(int argc, char *argv[])
         if (argv[i][0] == '-')
             continue;
         no_directory = false;
-        int fd       = open(argv[i], O_RDONLY | O_DIRECTORY, 0);
-        if (fd == -1) {
+        DIR *dir     = opendir(argv[i]);
+        if (dir == NULL) {
             printf("ls: cannot access '%s': %s\n", argv[i], strerror(errno));
         } else {
             printf("%s:\n", argv[i]);
-            print_ls(fd, argv[i], flags);
-            close(fd);
+            print_ls(dir, flags);
+            closedir(dir);
         }
     }
     if (no_directory) {
         char cwd[PATH_MAX];
         getcwd(cwd, PATH_MAX);
-        int fd = open(cwd, O_RDONLY | O_DIRECTORY, 0);
-        if (fd == -1) {
+        DIR *dir = opendir(cwd);
+        if (dir == NULL) {
             printf("ls: cannot access '%s': %s\n", cwd, strerror(errno));
         } else {
-            print_ls(fd, cwd, flags);
-            close(fd);
+            print_ls(dir, flags);
+            closedir(dir);
         }
     }
     return 0;
@@ -3,31 +3,31 @@
 /// @copyright (c) 2014-2024 This file is distributed under the MIT License.
 /// See LICENSE.md for details.
 
+#include <dirent.h>
 #include <fcntl.h>
 #include <stdio.h>
 #include <strerror.h>
 #include <string.h>
-#include <sys/dirent.h>
 #include <sys/unistd.h>
 
 int main(int argc, char *argv[])
 {
     if (argc == 1)
     {
-        int fd = open("/bin", O_RDONLY | O_DIRECTORY, 0);
-        if (fd == -1)
+        DIR *dir = opendir("/bin");
+        if (dir == NULL)
         {
             printf("%s: cannot access '/bin': %s\n", argv[0], strerror(errno));
             return 1;
         }
-        dirent_t dent;
+        dirent_t *dent;
         int per_line = 0;
-        while (getdents(fd, &dent, sizeof(dirent_t)) == sizeof(dirent_t))
+        while ((dent = readdir(dir)) != NULL)
         {
             // Shows only regular files
-            if (dent.d_type == DT_REG)
+            if (dent->d_type == DT_REG)
             {
-                printf("%10s ", dent.d_name);
+                printf("%10s ", dent->d_name);
                 if (++per_line == 6)
                 {
                     per_line = 0;
@@ -36,7 +36,7 @@ int main(int argc, char *argv[])
             }
         }
         putchar('\n');
-        close(fd);
+        closedir(dir);
     }
     else if (argc == 2)
     {
@@ -5,91 +5,59 @@
 
 #include <sys/unistd.h>
 #include <sys/stat.h>
+#include <sys/tasks.h>
 #include <fcntl.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 
 #define FORMAT_S "%5s %5s %6s %s\n"
-#define FORMAT   "%5d %5d %6c %s\n"
+#define FORMAT   "%5d %5d %6c (%s)\n"
 
-static inline void __iterate_proc_dirs(int proc_fd)
+/// @brief Reads the whole snapshot of the tasks.
+/// @param fd the descriptor of `/proc/tasks`.
+/// @param count where the number of records is stored.
+/// @return the records, which must be freed, or NULL on failure.
+static inline task_record_t *__read_tasks(int fd, size_t *count)
 {
-    char absolute_path[PATH_MAX] = "/proc/";
-    // Holds the file descriptor of the stat file.
-    int stat_fd;
-    // Buffer used to read the stat file.
-    char stat_buffer[BUFSIZ] = { 0 };
-    // Variables used to read the stat file.
-    // (1) pid   %d
-    // (2) comm  %s
-    // (3) state %c
-    // (4) ppid  %d
-    pid_t pid;
-    char comm[BUFSIZ] = { 0 };
-    char state;
-    pid_t ppid;
-    // The directory entry.
-    dirent_t dent;
-    // Holds the number of bytes read.
+    size_t size = 64 * sizeof(task_record_t), length = 0;
+    char *buffer = malloc(size);
     ssize_t read_bytes;
-    do {
-        // Read an entry.
-        read_bytes = getdents(proc_fd, &dent, sizeof(dirent_t));
-        // We reached the end of the folder.
-        if (read_bytes == 0) {
-            break;
+    while (buffer && ((read_bytes = read(fd, buffer + length, size - length)) > 0)) {
+        length += read_bytes;
+        // The snapshot is taken by the first read, the next ones continue it.
+        if (length == size) {
+            size *= 2;
+            buffer = realloc(buffer, size);
         }
-        // We encountered an error.
-        if (read_bytes == -1) {
-            perror("Failed to read entry in `/proc` folder");
-            exit(EXIT_FAILURE);
-        }
-        // Skip non-directories.
-        if (dent.d_type != DT_DIR) {
-            continue;
-        }
-        // Build the path to the stat file (i.e., `/proc/<pid>/stat`).
-        strcpy(absolute_path + 6, dent.d_name);
-        strcat(absolute_path, "/stat");
-        // Open the `/proc/<pid>/stat` file.
-        stat_fd = open(absolute_path, O_RDONLY, 0);
-        if (stat_fd == -1) {
-            continue;
-        }
-        // Reset the stat buffer.
-        memset(stat_buffer, 0, BUFSIZ);
-        // Read the content of the stat file.
-        read_bytes = read(stat_fd, stat_buffer, BUFSIZ);
-        // Check if the read failed.
-        if (read_bytes <= 0) {
-            printf("Cannot read `%s`", absolute_path);
-            perror(NULL);
-            putchar('\n');
-            close(stat_fd);
-            continue;
-        }
-        // Reset the comm buffer.
-        memset(comm, 0, BUFSIZ);
-        // Parse the content of the stat file.
-        sscanf(stat_buffer, "%d %s %c %d", &pid, comm, &state, &ppid);
-        // Print the stats concerning the process.
-        printf(FORMAT, pid, ppid, state, comm);
-        // Closing stat FD.
-        close(stat_fd);
-    } while (1);
+    }
+    if (buffer && (read_bytes < 0)) {
+        free(buffer);
+        return NULL;
+    }
+    *count = length / sizeof(task_record_t);
+    return (task_record_t *)buffer;
 }
 
 int main(int argc, char **argv)
 {
-    int fd = open("/proc", O_RDONLY | O_DIRECTORY, 0);
+    int fd = open("/proc/tasks", O_RDONLY, 0);
     if (fd == -1) {
-        perror("ps: cannot access '/proc' folder");
+        perror("ps: cannot access '/proc/tasks'");
         return EXIT_FAILURE;
     }
-    printf(FORMAT_S, "PID", "PPID", "STATUS", "CMD");
-    __iterate_proc_dirs(fd);
+    size_t count;
+    task_record_t *tasks = __read_tasks(fd, &count);
     close(fd);
+    if (tasks == NULL) {
+        perror("ps: cannot read '/proc/tasks'");
+        return EXIT_FAILURE;
+    }
+    printf(FORMAT_S, "PID", "PPID", "STATUS", "CMD");
+    for (size_t i = 0; i < count; ++i) {
+        printf(FORMAT, tasks[i].pid, tasks[i].ppid, tasks[i].state, tasks[i].name);
+    }
+    free(tasks);
     putchar('\n');
     return EXIT_SUCCESS;
 }
@@ -11,8 +11,10 @@
 #include <strerror.h>
 #include <string.h>
 #include <sys/errno.h>
+#include <sys/resource.h>
 #include <sys/unistd.h>
 #include <sys/wait.h>
+#include <time.h>
 
 // Setup the logging for this file (do this before any other include).
 #include "sys/kernel_levels.h"         // Include kernel log levels.
@@ -23,13 +25,32 @@
 #define SHUTDOWN_PORT 0x604
 /// Second serial port for QEMU.
 #define SERIAL_COM2 0x02F8
+/// Maximum number of tests running at the same time.
+#define MAX_JOBS 16
+
+/// @brief A test which is running.
+typedef struct running_test_t {
+    /// The process running the test, 0 if the slot is free.
+    pid_t pid;
+    /// The number of the test.
+    int n;
+    /// When the test started.
+    timeval start;
+} running_test_t;
 
 static char *all_tests[] = {
     "t_abort",
     "t_alarm",
     /* "t_big_write", */
+    "t_bigdir",
+    "t_mmap_file",
+    "t_iovec",
     "t_creat",
+    "t_cow",
+    "t_heap",
+    "t_spawn",
     "t_dup",
+    "t_fdtable",
     "t_exec execl",
     "t_exec execlp",
     "t_exec execle",
@@ -39,19 +60,58 @@ static char *all_tests[] = {
     "t_exec execve",
     "t_exec execvpe",
     "t_fork 10",
+    "t_fsync",
+    "t_futex",
+    "t_gettimeofday",
     "t_gid",
     "t_groups",
     "t_itimer",
     "t_kill",
+    "t_kmsg",
+    "t_madvise",
+    "t_shm_lazy",
+    "t_shm_open",
+    "t_proc_stat",
+    "t_yield",
+    "t_affinity",
+    "t_truncate",
+    "t_sparse",
+    "t_direct",
+    "t_aio",
+    "t_memdev",
+    "t_timerslack",
+    "t_taskreuse",
+    "t_allocstats",
+    "t_procmaps",
+    "t_diskstats",
+    "t_latency",
+    "t_funcprof",
+    "t_mqueue",
     /* "t_mem", */
+    "t_mouse",
     "t_msgget",
     /* "t_periodic1", */
     /* "t_periodic2", */
     /* "t_periodic3", */
+    "t_pipe",
+    "t_poll",
+    "t_epoll",
+    "t_pthread",
+    "t_signalfd",
+    "t_timerfd",
+    "t_waitpid",
+    "t_proc_tasks",
+    "t_getrusage",
+    "t_profile",
+    "t_trace",
+    "t_stdio",
+    "t_string",
+    "t_sched",
     "t_schedfb",
     "t_semflg",
     "t_semget",
     "t_semop",
+    "t_semundo",
     "t_setenv",
     "t_shmget",
     /* "t_shm_read", */
@@ -62,7 +122,13 @@ static char *all_tests[] = {
     "t_sigmask",
     "t_sigusr",
     "t_sleep",
+    "t_splice",
     "t_stopcont",
+    "t_swap",
+    "t_sysctl",
+    "t_sysenter",
+    "t_tmpfs",
+    "t_uring",
     "t_write_read",
 };
 
@@ -163,8 +229,21 @@ static void exec_test(char *test_cmd_line)
     execvp(test_abspath, test_argv);
 }
 
-static void run_test(int n, char *test_cmd_line)
+/// @brief Returns the milliseconds of a time value.
+/// @param tv the time value.
+/// @return the milliseconds.
+static inline unsigned long to_msec(const timeval *tv)
 {
+    return (tv->tv_sec * 1000UL) + (tv->tv_usec / 1000);
+}
+
+/// @brief Starts a test.
+/// @param slot where the running test is recorded.
+/// @param n the number of the test.
+/// @param test_cmd_line the test, with its arguments.
+static void start_test(running_test_t *slot, int n, char *test_cmd_line)
+{
+    gettimeofday(&slot->start, NULL);
     int child = fork();
     if (child == 0) {
         exec_test(test_cmd_line);
@@ -173,40 +252,93 @@ static void run_test(int n, char *test_cmd_line)
     }
 
     if (child < 0) {
-        fprintf(STDERR_FILENO, "fork: %s\n", strerror(errno));
+        fprintf(stderr, "fork: %s\n", strerror(errno));
         exit(EXIT_FAILURE);
     }
+    slot->pid = child;
+    slot->n   = n;
+}
 
-    int status;
-    waitpid(child, &status, 0);
+/// @brief Reports a test which terminated, with its timings.
+/// @param slot the running test, freed.
+/// @param status the status returned by the wait.
+/// @param usage the resources used by the test.
+static void finish_test(running_test_t *slot, int status, const struct rusage *usage)
+{
+    timeval now;
+    gettimeofday(&now, NULL);
 
     int success = WIFEXITED(status) && WEXITSTATUS(status) == 0;
     if (success) {
-        test_ok(n, success, NULL);
+        test_ok(slot->n, success, NULL);
     } else {
         if (WIFSIGNALED(status)) {
-            test_ok(n, success, "Signal: %d", WSTOPSIG(status));
+            test_ok(slot->n, success, "Signal: %d", WSTOPSIG(status));
         } else {
-            test_ok(n, success, "Exit: %d", WEXITSTATUS(status));
+            test_ok(slot->n, success, "Exit: %d", WEXITSTATUS(status));
+        }
+    }
+    // The timings are comments, which the TAP consumers skip.
+    test_out("# time %d - %s: wall %lu ms, user %lu ms, system %lu ms", slot->n, tests[slot->n - 1],
+             to_msec(&now) - to_msec(&slot->start), to_msec(&usage->ru_utime), to_msec(&usage->ru_stime));
+    slot->pid = 0;
+}
+
+/// @brief Waits for one of the running tests, and reports it.
+/// @param slots the running tests.
+/// @param jobs the number of slots.
+static void wait_test(running_test_t *slots, int jobs)
+{
+    struct rusage usage;
+    int status;
+    while (1) {
+        pid_t child = wait4(-1, &status, 0, &usage);
+        if (child < 0) {
+            fprintf(stderr, "wait4: %s\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        for (int i = 0; i < jobs; ++i) {
+            if (slots[i].pid == child) {
+                finish_test(&slots[i], status, &usage);
+                return;
+            }
         }
     }
 }
 
 int runtests_main(int argc, char **argv)
 {
+    int jobs = 1;
     for (int i = 1; i < argc; i++) {
         if (strncmp(argv[i], "--help", 6) == 0) {
-            printf("Usage: %s [--help] [TEST]...\n", argv[0]);
+            printf("Usage: %s [--help] [-j JOBS] [TEST]...\n", argv[0]);
             printf("Run one, more, or all available tests\n");
             printf("      --help   display this help and exit\n");
+            printf("      -j JOBS  run up to JOBS tests at the same time (max %d)\n", MAX_JOBS);
             exit(EXIT_SUCCESS);
         }
     }
+    // Take the number of jobs out of the arguments.
+    if ((argc > 1) && (strncmp(argv[1], "-j", 2) == 0)) {
+        int skip = 1;
+        if ((argv[1][2] == 0) && (argc > 2)) {
+            jobs = atoi(argv[2]);
+            skip = 2;
+        } else {
+            jobs = atoi(argv[1] + 2);
+        }
+        if ((jobs < 1) || (jobs > MAX_JOBS)) {
+            fprintf(stderr, "%s: the jobs must be between 1 and %d\n", argv[0], MAX_JOBS);
+            exit(EXIT_FAILURE);
+        }
+        argv += skip;
+        argc -= skip;
+    }
 
     // TODO: capture test output
     int devnull = open("/dev/null", O_RDONLY, 0);
     if (devnull < 0) {
-        fprintf(STDERR_FILENO, "open: /dev/null: %s\n", strerror(errno));
+        fprintf(stderr, "open: /dev/null: %s\n", strerror(errno));
         exit(EXIT_FAILURE);
     }
     test_out_fd = test_err_fd = devnull;
@@ -218,10 +350,27 @@ int runtests_main(int argc, char **argv)
 
     test_out("1..%d", testsc);
 
-    char *test_argv[32];
+    running_test_t slots[MAX_JOBS];
+    memset(slots, 0, sizeof(slots));
+    int running = 0;
     for (int i = 0; i < testsc; i++) {
-        pr_info("Running test (%2d/%2d): %s\n", i, testsc, tests[i]);
-        run_test(i + 1, tests[i]);
+        // Wait for a free slot.
+        if (running == jobs) {
+            wait_test(slots, jobs);
+            --running;
+        }
+        for (int j = 0; j < jobs; ++j) {
+            if (slots[j].pid == 0) {
+                pr_info("Running test (%2d/%2d): %s\n", i, testsc, tests[i]);
+                start_test(&slots[j], i + 1, tests[i]);
+                ++running;
+                break;
+            }
+        }
+    }
+    while (running > 0) {
+        wait_test(slots, jobs);
+        --running;
     }
 
     // We are running as init
@@ -0,0 +1,82 @@
+/// @file schedfb.c
+/// @brief Formats the scheduling statistics recorded in `/proc/feedback`.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <sys/unistd.h>
+#include <sys/schedfb.h>
+#include <sys/tasks.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+/// @brief Reads a whole binary file.
+/// @param path the file.
+/// @param size the size of a record.
+/// @param count where the number of records is stored.
+/// @return the records, which must be freed, or NULL on failure.
+static inline void *__read_records(const char *path, size_t size, size_t *count)
+{
+    int fd = open(path, O_RDONLY, 0);
+    if (fd == -1) {
+        return NULL;
+    }
+    size_t capacity = 64 * size, length = 0;
+    char *buffer = malloc(capacity);
+    ssize_t read_bytes;
+    while (buffer && ((read_bytes = read(fd, buffer + length, capacity - length)) > 0)) {
+        length += read_bytes;
+        if (length == capacity) {
+            capacity *= 2;
+            buffer = realloc(buffer, capacity);
+        }
+    }
+    close(fd);
+    if (buffer && (read_bytes < 0)) {
+        free(buffer);
+        return NULL;
+    }
+    *count = length / size;
+    return buffer;
+}
+
+/// @brief Finds the name of a task.
+/// @param tasks the snapshot of the tasks.
+/// @param count the number of tasks.
+/// @param pid the pid of the task.
+/// @return its name, or an empty string if it has exited.
+static inline const char *__task_name(task_record_t *tasks, size_t count, pid_t pid)
+{
+    for (size_t i = 0; i < count; ++i) {
+        if (tasks[i].pid == pid) {
+            return tasks[i].name;
+        }
+    }
+    return "";
+}
+
+int main(int argc, char **argv)
+{
+    size_t count, ntasks = 0;
+    // Consume the statistics first, the tasks are only needed for the names.
+    schedfb_record_t *records = __read_records("/proc/feedback", sizeof(schedfb_record_t), &count);
+    if (records == NULL) {
+        perror("schedfb: cannot read '/proc/feedback'");
+        return EXIT_FAILURE;
+    }
+    task_record_t *tasks = __read_records("/proc/tasks", sizeof(task_record_t), &ntasks);
+    for (size_t i = 0; i < count; ++i) {
+        if ((i == 0) || (records[i].time != records[i - 1].time)) {
+            printf("TIME : %u ticks\n", records[i].time);
+        }
+        // The share of the CPU, in hundredths of a percent.
+        unsigned share = records[i].total ? (records[i].occur * 10000U) / records[i].total : 0;
+        printf("[%3d] | %-18s | -> TCPU: %u.%02u%%\n", records[i].pid,
+               tasks ? __task_name(tasks, ntasks, records[i].pid) : "",
+               share / 100, share % 100);
+    }
+    free(records);
+    free(tasks);
+    return EXIT_SUCCESS;
+}
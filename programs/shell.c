@@ -5,10 +5,12 @@
 
 #include <sys/unistd.h>
 #include <sys/wait.h>
+#include <dirent.h>
 #include <fcntl.h>
 #include <libgen.h>
 #include <sys/stat.h>
 #include <signal.h>
+#include <spawn.h>
 #include <io/debug.h>
 #include <io/ansi_colors.h>
 #include <sys/bitops.h>
@@ -23,11 +25,19 @@
 #include <sys/utsname.h>
 #include <ctype.h>
 
+extern char **environ;
+
 /// Maximum length of commands.
 #define CMD_LEN 64
 /// Maximum lenght of the history.
 #define HISTORY_MAX 10
 
+/// Maximum number of commands in a pipeline.
+#define PIPELINE_MAX 8
+
+/// Maximum number of commands remembered by `hash`.
+#define HASH_MAX 32
+
 // Required by `export`
 #define ENV_NORM 1
 #define ENV_BRAK 2
@@ -52,6 +62,25 @@ static char status_buf[4] = { 0 };
 
 static sigset_t oldmask;
 
+/// @brief A command found inside PATH.
+typedef struct hash_entry_t {
+    /// The name of the command.
+    char name[NAME_MAX + 1];
+    /// Its absolute path.
+    char *path;
+    /// The modification time of its directory, when it was found.
+    time_t dir_mtime;
+    /// The number of times it was executed.
+    unsigned hits;
+} hash_entry_t;
+
+// The commands found inside PATH.
+static hash_entry_t hash_table[HASH_MAX];
+// The number of commands inside the table.
+static size_t hash_count = 0;
+// The PATH the commands were found in.
+static char *hash_path_var = NULL;
+
 static void __block_sigchld(void) {
     sigset_t mask;
     //sigmask functions only fail on invalid inputs -> no exception handling needed
@@ -105,25 +134,25 @@ static inline int __folder_contains(
     int accepted_type,
     dirent_t *result)
 {
-    int fd = open(folder, O_RDONLY | O_DIRECTORY, 0);
-    if (fd == -1) {
+    DIR *dir = opendir(folder);
+    if (dir == NULL) {
         return 0;
     }
     // Prepare the variables for the search.
-    dirent_t dent;
+    dirent_t *dent;
     size_t entry_len = strlen(entry);
     int found        = 0;
-    while (getdents(fd, &dent, sizeof(dirent_t)) == sizeof(dirent_t)) {
-        if (accepted_type && (accepted_type != dent.d_type)) {
+    while ((dent = readdir(dir)) != NULL) {
+        if (accepted_type && (accepted_type != dent->d_type)) {
             continue;
         }
-        if (strncmp(entry, dent.d_name, entry_len) == 0) {
-            *result = dent;
+        if (strncmp(entry, dent->d_name, entry_len) == 0) {
+            *result = *dent;
             found   = 1;
             break;
         }
     }
-    close(fd);
+    closedir(dir);
     return found;
 }
 
@@ -149,6 +178,211 @@ static inline int __search_in_path(const char *entry, dirent_t *result)
     return 0;
 }
 
+/// @brief Forgets all the commands found inside PATH.
+static void __hash_clear(void)
+{
+    for (size_t i = 0; i < hash_count; ++i) {
+        free(hash_table[i].path);
+    }
+    hash_count = 0;
+}
+
+/// @brief Forgets a command.
+/// @param entry the entry of the command.
+static void __hash_remove(hash_entry_t *entry)
+{
+    free(entry->path);
+    *entry = hash_table[--hash_count];
+}
+
+/// @brief Gets the modification time of the directory containing a file.
+/// @param path the path to the file.
+/// @param mtime where the time is stored.
+/// @return 0 on success, -1 on failure.
+static int __hash_dir_mtime(const char *path, time_t *mtime)
+{
+    char directory[PATH_MAX];
+    stat_t buf;
+    if (!dirname(path, directory, sizeof(directory)) || (stat(directory, &buf) < 0)) {
+        return -1;
+    }
+    *mtime = buf.st_mtime;
+    return 0;
+}
+
+/// @brief Finds a command inside the table.
+/// @param name the name of the command.
+/// @return its entry, NULL if it is not there, or if its directory changed.
+static hash_entry_t *__hash_find(const char *name)
+{
+    // The commands were found in another PATH.
+    const char *PATH_VAR = getenv("PATH");
+    if (!hash_path_var || !PATH_VAR || strcmp(hash_path_var, PATH_VAR)) {
+        __hash_clear();
+        free(hash_path_var);
+        hash_path_var = PATH_VAR ? strdup(PATH_VAR) : NULL;
+        return NULL;
+    }
+    for (size_t i = 0; i < hash_count; ++i) {
+        if (strcmp(hash_table[i].name, name) == 0) {
+            time_t mtime;
+            if ((__hash_dir_mtime(hash_table[i].path, &mtime) < 0) || (mtime != hash_table[i].dir_mtime)) {
+                __hash_remove(&hash_table[i]);
+                return NULL;
+            }
+            return &hash_table[i];
+        }
+    }
+    return NULL;
+}
+
+/// @brief Remembers where a command was found, replacing the least used one
+/// if the table is full.
+/// @param name the name of the command.
+/// @param path its absolute path.
+/// @return its entry, NULL on failure.
+static hash_entry_t *__hash_insert(const char *name, const char *path)
+{
+    if (hash_count == HASH_MAX) {
+        hash_entry_t *victim = &hash_table[0];
+        for (size_t i = 1; i < hash_count; ++i) {
+            if (hash_table[i].hits < victim->hits) {
+                victim = &hash_table[i];
+            }
+        }
+        __hash_remove(victim);
+    }
+    // The relative entries of PATH depend on the working directory.
+    hash_entry_t *entry = &hash_table[hash_count];
+    if ((path[0] != '/') || (strlen(name) > NAME_MAX) || (__hash_dir_mtime(path, &entry->dir_mtime) < 0)) {
+        return NULL;
+    }
+    if ((entry->path = strdup(path)) == NULL) {
+        return NULL;
+    }
+    strcpy(entry->name, name);
+    entry->hits = 0;
+    ++hash_count;
+    return entry;
+}
+
+/// @brief Finds the executable of a command, remembering the ones found
+/// inside PATH.
+/// @param name the name of the command.
+/// @param buf the buffer where the path is stored.
+/// @param buflen the length of the buffer.
+/// @return 0 on success, -1 if the command does not exist.
+static int __find_command(const char *name, char *buf, size_t buflen)
+{
+    // Paths are used as they are.
+    if (strchr(name, '/')) {
+        strncpy(buf, name, buflen - 1);
+        buf[buflen - 1] = 0;
+        return 0;
+    }
+    hash_entry_t *entry = __hash_find(name);
+    if (entry == NULL) {
+        const char *PATH_VAR = getenv("PATH");
+        if (PATH_VAR == NULL) {
+            PATH_VAR = "/bin:/usr/bin";
+        }
+        stat_t stat_buf;
+        for (const char *it = PATH_VAR; *it; it += (*it == ':')) {
+            size_t length = strcspn(it, ":");
+            if (length + strlen(name) + 2 <= buflen) {
+                memcpy(buf, it, length);
+                buf[length] = '/';
+                strcpy(buf + length + 1, name);
+                if ((stat(buf, &stat_buf) == 0) && S_ISREG(stat_buf.st_mode) && (stat_buf.st_mode & S_IXUSR)) {
+                    if ((entry = __hash_insert(name, buf)) == NULL) {
+                        return 0;
+                    }
+                    break;
+                }
+            }
+            it += length;
+        }
+        if (entry == NULL) {
+            return -1;
+        }
+    }
+    if (strlen(entry->path) >= buflen) {
+        return -1;
+    }
+    strcpy(buf, entry->path);
+    ++entry->hits;
+    return 0;
+}
+
+/// @brief Spawns a command, without searching PATH for the ones it already found.
+/// @param pid where the pid of the new process is stored.
+/// @param file_actions the actions on the files of the new process.
+/// @param attrp the attributes of the new process.
+/// @param argv the arguments, starting from the command.
+/// @return 0 on success, an error number on failure.
+static int __spawn_command(pid_t *pid, const posix_spawn_file_actions_t *file_actions,
+                           const posix_spawnattr_t *attrp, char *const argv[])
+{
+    char path[PATH_MAX];
+    if (__find_command(argv[0], path, sizeof(path)) < 0) {
+        return ENOENT;
+    }
+    int error = posix_spawn(pid, path, file_actions, attrp, argv, environ);
+    // The executable went away within the resolution of the directory time,
+    // search it again.
+    if ((error == ENOENT) && !strchr(argv[0], '/')) {
+        hash_entry_t *entry = __hash_find(argv[0]);
+        if (entry) {
+            __hash_remove(entry);
+            if (__find_command(argv[0], path, sizeof(path)) < 0) {
+                return ENOENT;
+            }
+            error = posix_spawn(pid, path, file_actions, attrp, argv, environ);
+        }
+    }
+    return error;
+}
+
+/// @brief Prints the remembered commands, forgets them with `-r`, or
+/// searches the given ones.
+/// @param argc the number of arguments.
+/// @param argv the arguments.
+/// @return 0 on success, 1 if a command was not found.
+static int __hash(int argc, char *argv[])
+{
+    char path[PATH_MAX];
+    int ret = 0;
+    if (argc == 1) {
+        if (hash_count == 0) {
+            printf("hash: hash table empty\n");
+        } else {
+            printf("hits    command\n");
+            for (size_t i = 0; i < hash_count; ++i) {
+                printf("%4u    %s\n", hash_table[i].hits, hash_table[i].path);
+            }
+        }
+        return 0;
+    }
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-r") == 0) {
+            __hash_clear();
+        } else if (strchr(argv[i], '/') == NULL) {
+            hash_entry_t *entry = __hash_find(argv[i]);
+            if (entry) {
+                __hash_remove(entry);
+            }
+            if (__find_command(argv[i], path, sizeof(path)) < 0) {
+                printf("hash: %s: not found\n", argv[i]);
+                ret = 1;
+            } else if ((entry = __hash_find(argv[i])) != NULL) {
+                // Searching is not executing.
+                --entry->hits;
+            }
+        }
+    }
+    return ret;
+}
+
 /// @brief Prints the prompt.
 static inline void __prompt_print(void)
 {
@@ -364,6 +598,215 @@ static int __cd(int argc, char *argv[])
     return 0;
 }
 
+/// @brief Prints the arguments, like the `echo` program.
+/// @param argc the number of arguments.
+/// @param argv the arguments.
+/// @return 0.
+static int __echo(int argc, char *argv[])
+{
+    int newline = 1, escapes = 0, i = 1;
+    // Parse the options.
+    for (; (i < argc) && (argv[i][0] == '-') && argv[i][1]; ++i) {
+        const char *it = argv[i] + 1;
+        while ((*it == 'n') || (*it == 'e')) {
+            newline &= (*it != 'n');
+            escapes |= (*it == 'e');
+            ++it;
+        }
+        if (*it) {
+            break;
+        }
+    }
+    for (int first = i; i < argc; ++i) {
+        if (i > first) {
+            putchar(' ');
+        }
+        for (const char *it = argv[i]; *it; ++it) {
+            if (escapes && (it[0] == '\\') && (it[1] == 'n')) {
+                putchar('\n');
+                ++it;
+            } else {
+                putchar(*it);
+            }
+        }
+    }
+    if (newline) {
+        putchar('\n');
+    }
+    return 0;
+}
+
+/// @brief Prints the working directory.
+/// @param argc the number of arguments.
+/// @param argv the arguments.
+/// @return 0 on success, 1 on failure.
+static int __pwd(int argc, char *argv[])
+{
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, PATH_MAX) == NULL) {
+        printf("pwd: %s\n", strerror(errno));
+        return 1;
+    }
+    printf("%s\n", cwd);
+    return 0;
+}
+
+/// @brief Succeeds.
+/// @param argc the number of arguments.
+/// @param argv the arguments.
+/// @return 0.
+static int __true(int argc, char *argv[])
+{
+    return 0;
+}
+
+/// @brief Fails.
+/// @param argc the number of arguments.
+/// @param argv the arguments.
+/// @return 1.
+static int __false(int argc, char *argv[])
+{
+    return 1;
+}
+
+/// @brief Evaluates a unary or binary expression of `test`.
+/// @param argc the number of words of the expression.
+/// @param argv the words.
+/// @return 0 if it is true, 1 if it is false, 2 if it is malformed.
+static int __test_expression(int argc, char *argv[])
+{
+    // A single word is true if it is not empty.
+    if (argc == 1) {
+        return argv[0][0] == 0;
+    }
+    if (argc == 2) {
+        const char *op = argv[0], *arg = argv[1];
+        stat_t buf;
+        if (!strcmp(op, "-n")) {
+            return arg[0] == 0;
+        }
+        if (!strcmp(op, "-z")) {
+            return arg[0] != 0;
+        }
+        if ((op[0] != '-') || (op[1] == 0) || op[2] || !strchr("edfsrwx", op[1])) {
+            return 2;
+        }
+        if (stat(arg, &buf) < 0) {
+            return 1;
+        }
+        switch (op[1]) {
+        case 'd':
+            return !S_ISDIR(buf.st_mode);
+        case 'f':
+            return !S_ISREG(buf.st_mode);
+        case 's':
+            return buf.st_size == 0;
+        case 'r':
+            return !(buf.st_mode & S_IRUSR);
+        case 'w':
+            return !(buf.st_mode & S_IWUSR);
+        case 'x':
+            return !(buf.st_mode & S_IXUSR);
+        default:
+            return 0;
+        }
+    }
+    if (argc == 3) {
+        const char *left = argv[0], *op = argv[1], *right = argv[2];
+        if (!strcmp(op, "=")) {
+            return strcmp(left, right) != 0;
+        }
+        if (!strcmp(op, "!=")) {
+            return strcmp(left, right) == 0;
+        }
+        long l = strtol(left, NULL, 10), r = strtol(right, NULL, 10);
+        if (!strcmp(op, "-eq")) {
+            return !(l == r);
+        }
+        if (!strcmp(op, "-ne")) {
+            return !(l != r);
+        }
+        if (!strcmp(op, "-lt")) {
+            return !(l < r);
+        }
+        if (!strcmp(op, "-le")) {
+            return !(l <= r);
+        }
+        if (!strcmp(op, "-gt")) {
+            return !(l > r);
+        }
+        if (!strcmp(op, "-ge")) {
+            return !(l >= r);
+        }
+    }
+    return 2;
+}
+
+/// @brief Evaluates an expression, written as `test expr` or `[ expr ]`.
+/// @param argc the number of arguments.
+/// @param argv the arguments.
+/// @return 0 if it is true, 1 if it is false, 2 if it is malformed.
+static int __test(int argc, char *argv[])
+{
+    if (!strcmp(argv[0], "[")) {
+        if (strcmp(argv[argc - 1], "]")) {
+            printf("[: missing `]'\n");
+            return 2;
+        }
+        --argc;
+    }
+    // Skip the command, and handle the negation.
+    int negate = (argc > 2) && !strcmp(argv[1], "!");
+    if (argc - 1 - negate == 0) {
+        return !negate;
+    }
+    int ret = __test_expression(argc - 1 - negate, argv + 1 + negate);
+    if (ret == 2) {
+        printf("%s: malformed expression\n", argv[0]);
+        return 2;
+    }
+    return negate ? !ret : ret;
+}
+
+/// @brief A command executed by the shell itself.
+typedef struct builtin_t {
+    /// The name of the command.
+    const char *name;
+    /// The function executing it.
+    int (*function)(int argc, char *argv[]);
+} builtin_t;
+
+/// The commands executed without spawning a process, when their output is
+/// not redirected.
+static const builtin_t builtins[] = {
+    { "echo", __echo },
+    { "pwd", __pwd },
+    { "true", __true },
+    { "false", __false },
+    { "test", __test },
+    { "[", __test },
+};
+
+/// @brief Finds the built-in implementing a command.
+/// @param argc the number of arguments.
+/// @param argv the arguments.
+/// @return the built-in, or NULL if the command has to be spawned.
+static const builtin_t *__find_builtin(int argc, char *argv[])
+{
+    // Redirections and background jobs need a process.
+    for (int i = 1; i < argc; ++i) {
+        if (strchr(argv[i], '>') || !strcmp(argv[i], "&")) {
+            return NULL;
+        }
+    }
+    for (size_t i = 0; i < sizeof(builtins) / sizeof(builtins[0]); ++i) {
+        if (!strcmp(argv[0], builtins[i].name)) {
+            return &builtins[i];
+        }
+    }
+    return NULL;
+}
+
 /// @brief Push the command inside the history.
 static inline void __hst_push(char *_cmd)
 {
@@ -738,8 +1181,7 @@ static inline void __free_argv(int argc, char **argv)
     free(argv);
 }
 
-static void __setup_redirects(int *argcp, char ***argvp) {
-    char **argv = *argvp;
+static void __setup_redirects(int *argcp, char **argv, posix_spawn_file_actions_t *file_actions) {
     int argc = *argcp;
 
     char* path;
@@ -778,36 +1220,152 @@ static void __setup_redirects(int *argcp, char ***argvp) {
             flags |= O_TRUNC;
         }
 
+        // The file is opened by the kernel, directly on the redirected stream.
+        if (rd_stdout) {
+            posix_spawn_file_actions_addopen(file_actions, STDOUT_FILENO, path, flags, mode);
+            if (rd_stderr) {
+                posix_spawn_file_actions_adddup2(file_actions, STDOUT_FILENO, STDERR_FILENO);
+            }
+        } else {
+            posix_spawn_file_actions_addopen(file_actions, STDERR_FILENO, path, flags, mode);
+        }
+
         // Remove redirects from argv
-        *argcp -= 2;
         free(argv[i]);
-        (*argvp)[i] = 0;
-        free(argv[i+1]);
-        (*argvp)[i+1] = 0;
+        free(argv[i + 1]);
+        memmove(&argv[i], &argv[i + 2], (argc - i - 1) * sizeof(char *));
+        *argcp -= 2;
+        break;
+    }
+}
 
-        int fd = open(path, flags, mode);
-        if (fd < 0) {
-            printf("%s: Failed to open file\n", path);
-            exit(1);
+/// @brief Tells how a command terminated, unless it succeeded.
+/// @param _status The status returned by waitpid.
+static void __print_exit_status(int _status)
+{
+    if (WIFSIGNALED(_status)) {
+        printf(FG_RED "\nExit status %d, killed by signal %d\n" FG_RESET,
+               WEXITSTATUS(_status), WTERMSIG(_status));
+    } else if (WIFSTOPPED(_status)) {
+        printf(FG_YELLOW "\nExit status %d, stopped by signal %d\n" FG_RESET,
+               WEXITSTATUS(_status), WSTOPSIG(_status));
+    } else if (WEXITSTATUS(_status) != 0) {
+        printf(FG_RED "\nExit status %d\n" FG_RESET, WEXITSTATUS(_status));
+    }
+}
+
+/// @brief Executes the commands separated by `|`, each reading the output
+/// of the previous one through a pipe.
+/// @param command The pipeline, split in place.
+/// @return The status of the last command.
+static int __execute_pipeline(char *command)
+{
+    char *stages[PIPELINE_MAX];
+    pid_t cpids[PIPELINE_MAX];
+    int nstages = 0, nspawned = 0;
+    int _status = 0;
+    // Split the commands.
+    stages[nstages++] = command;
+    for (char *it = command; (it = strchr(it, '|')) != NULL;) {
+        if (nstages == PIPELINE_MAX) {
+            printf("\nToo many commands in the pipeline (max %d).\n", PIPELINE_MAX);
+            return 2 << 8;
         }
+        *it++             = 0;
+        stages[nstages++] = it;
+    }
 
-        if (rd_stdout) {
-            close(STDOUT_FILENO);
-            dup(fd);
+    __block_sigchld();
+
+    // The read end of the previous pipe, the input of the next command.
+    int input = -1, fds[2];
+    pid_t pgid = 0;
+    for (int i = 0; i < nstages; ++i) {
+        int _argc;
+        char **_argv;
+        __alloc_argv(stages[i], &_argc, &_argv);
+        if (_argc == 0) {
+            printf("\nMissing command in the pipeline.\n");
+            _status = 2 << 8;
+            break;
+        }
+        bool_t last = (i == nstages - 1);
+        if (!last && (pipe(fds) < 0)) {
+            printf("\npipe: %s\n", strerror(errno));
+            __free_argv(_argc, _argv);
+            _status = 1 << 8;
+            break;
         }
 
-        if (rd_stderr) {
-            close(STDERR_FILENO);
-            dup(fd);
+        // Connect the command to its neighbours, the child keeps no other
+        // end, otherwise the readers would never see the end of file.
+        posix_spawn_file_actions_t file_actions;
+        posix_spawn_file_actions_init(&file_actions);
+        if (input >= 0) {
+            posix_spawn_file_actions_adddup2(&file_actions, input, STDIN_FILENO);
+            posix_spawn_file_actions_addclose(&file_actions, input);
+        }
+        if (!last) {
+            posix_spawn_file_actions_adddup2(&file_actions, fds[1], STDOUT_FILENO);
+            posix_spawn_file_actions_addclose(&file_actions, fds[1]);
+            posix_spawn_file_actions_addclose(&file_actions, fds[0]);
+        }
+        __setup_redirects(&_argc, _argv, &file_actions);
+
+        // All the commands join the group of the first one.
+        posix_spawnattr_t attr;
+        posix_spawnattr_init(&attr);
+        posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK);
+        posix_spawnattr_setpgroup(&attr, pgid);
+        posix_spawnattr_setsigmask(&attr, &oldmask);
+
+        pid_t cpid;
+        int error = __spawn_command(&cpid, &file_actions, &attr, _argv);
+        posix_spawn_file_actions_destroy(&file_actions);
+        posix_spawnattr_destroy(&attr);
+        if (error == ENOENT) {
+            printf("\nUnknown command: %s\n", _argv[0]);
+            _status = 127 << 8;
+        } else if (error) {
+            printf("\n%s: %s\n", _argv[0], strerror(error));
+            _status = 126 << 8;
+        } else {
+            cpids[nspawned++] = cpid;
+            if (pgid == 0) {
+                pgid = cpid;
+            }
+        }
+        __free_argv(_argc, _argv);
+
+        // The ends now belong to the children.
+        if (input >= 0) {
+            close(input);
+            input = -1;
+        }
+        if (!last) {
+            close(fds[1]);
+            input = fds[0];
         }
-        close(fd);
-        break;
     }
+    if (input >= 0) {
+        close(input);
+    }
+
+    // Wait for all of them, the status is the one of the last.
+    for (int i = 0; i < nspawned; ++i) {
+        waitpid(cpids[i], &_status, 0);
+    }
+    if (nspawned) {
+        __print_exit_status(_status);
+    }
+    __unblock_sigchld();
+    return _status;
 }
 
 static int __execute_cmd(char* command, bool_t add_to_history)
 {
     int _status = 0;
+    const builtin_t *builtin;
     // Retrieve the options from the command.
     // The current number of arguments.
     int _argc = 1;
@@ -825,6 +1383,8 @@ static int __execute_cmd(char* command, bool_t add_to_history)
     }
 
     if (!strcmp(_argv[0], "init")) {
+    } else if (strchr(command, '|')) {
+        _status = __execute_pipeline(command);
     } else if (!strcmp(_argv[0], "cd")) {
         __cd(_argc, _argv);
     } else if (!strcmp(_argv[0], "..")) {
@@ -832,6 +1392,12 @@ static int __execute_cmd(char* command, bool_t add_to_history)
         __cd(2, (char **)__argv);
     } else if (!strcmp(_argv[0], "export")) {
         __export(_argc, _argv);
+    } else if (!strcmp(_argv[0], "hash")) {
+        _status = __hash(_argc, _argv) << 8;
+    } else if ((builtin = __find_builtin(_argc, _argv)) != NULL) {
+        _status = builtin->function(_argc, _argv) << 8;
+        // The output must precede the one of the next command.
+        fflush(stdout);
     } else {
         bool_t blocking = true;
         if (strcmp(_argv[_argc - 1], "&") == 0) {
@@ -843,33 +1409,33 @@ static int __execute_cmd(char* command, bool_t add_to_history)
 
         __block_sigchld();
 
-        // Is a shell path, execute it!
-        pid_t cpid = fork();
-        if (cpid == 0) {
-            // Makes the new process a group leader
-            pid_t pid = getpid();
-            setpgid(cpid, pid);
-
-            __unblock_sigchld();
-
-            __setup_redirects(&_argc, &_argv);
-
-            if (execvp(_argv[0], _argv) == -1) {
-                printf("\nUnknown command: %s\n", _argv[0]);
-                exit(127);
-            }
-        }
-        if (blocking) {
+        posix_spawn_file_actions_t file_actions;
+        posix_spawn_file_actions_init(&file_actions);
+        __setup_redirects(&_argc, _argv, &file_actions);
+
+        // Makes the new process a group leader, with SIGCHLD unblocked.
+        posix_spawnattr_t attr;
+        posix_spawnattr_init(&attr);
+        posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK);
+        posix_spawnattr_setpgroup(&attr, 0);
+        posix_spawnattr_setsigmask(&attr, &oldmask);
+
+        // Is a shell path, execute it! The kernel builds the new process from
+        // the executable, instead of copying the shell just to replace it.
+        // The commands already found inside PATH are not searched again.
+        pid_t cpid;
+        int error = __spawn_command(&cpid, &file_actions, &attr, _argv);
+        posix_spawn_file_actions_destroy(&file_actions);
+        posix_spawnattr_destroy(&attr);
+        if (error == ENOENT) {
+            printf("\nUnknown command: %s\n", _argv[0]);
+            _status = 127 << 8;
+        } else if (error) {
+            printf("\n%s: %s\n", _argv[0], strerror(error));
+            _status = 126 << 8;
+        } else if (blocking) {
             waitpid(cpid, &_status, 0);
-            if (WIFSIGNALED(_status)) {
-                printf(FG_RED "\nExit status %d, killed by signal %d\n" FG_RESET,
-                       WEXITSTATUS(_status), WTERMSIG(_status));
-            } else if (WIFSTOPPED(_status)) {
-                printf(FG_YELLOW "\nExit status %d, stopped by signal %d\n" FG_RESET,
-                       WEXITSTATUS(_status), WSTOPSIG(_status));
-            } else if (WEXITSTATUS(_status) != 0) {
-                printf(FG_RED "\nExit status %d\n" FG_RESET, WEXITSTATUS(_status));
-            }
+            __print_exit_status(_status);
         }
         __unblock_sigchld();
     }
@@ -881,12 +1447,12 @@ static int __execute_cmd(char* command, bool_t add_to_history)
 
 static int __execute_file(char *path)
 {
-    int fd;
-    if ((fd = open(path, O_RDONLY, 0)) == -1) {
+    FILE *file;
+    if ((file = fopen(path, "r")) == NULL) {
         printf("%s: %s\n", path, strerror(errno));
         return -errno;
     }
-    while (fgets(cmd, sizeof(cmd), fd)) {
+    while (fgets(cmd, sizeof(cmd), file)) {
         if (cmd[0] == '#') {
             continue;
         }
@@ -895,7 +1461,7 @@ static int __execute_file(char *path)
             printf("\n%s: exited with %d\n", cmd, status);
         }
     }
-
+    fclose(file);
     return status;
 }
 
@@ -0,0 +1,56 @@
+/// @file t_affinity.c
+/// @brief Tests sched_setaffinity and sched_getaffinity.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/errno.h>
+#include <sys/unistd.h>
+#include <sys/wait.h>
+
+int main(int argc, char *argv[])
+{
+    cpu_set_t set, empty;
+    int status;
+    // Every process can run on the first CPU.
+    if (sched_getaffinity(0, sizeof(set), &set) < 0) {
+        perror("sched_getaffinity");
+        return EXIT_FAILURE;
+    }
+    if (!CPU_ISSET(0, &set)) {
+        printf("The first CPU is not allowed.\n");
+        return EXIT_FAILURE;
+    }
+    // A set without CPUs is refused.
+    CPU_ZERO(&empty);
+    if ((sched_setaffinity(0, sizeof(empty), &empty) != -1) || (errno != EINVAL)) {
+        printf("An empty set was not refused with EINVAL.\n");
+        return EXIT_FAILURE;
+    }
+    // Pin the process to the first CPU, the children inherit the set.
+    CPU_ZERO(&set);
+    CPU_SET(0, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) < 0) {
+        perror("sched_setaffinity");
+        return EXIT_FAILURE;
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        cpu_set_t inherited;
+        if ((sched_getaffinity(0, sizeof(inherited), &inherited) < 0) || (CPU_COUNT(&inherited) != 1) || !CPU_ISSET(0, &inherited)) {
+            printf("The child did not inherit the set.\n");
+            exit(EXIT_FAILURE);
+        }
+        exit(EXIT_SUCCESS);
+    }
+    if ((waitpid(pid, &status, 0) != pid) || !WIFEXITED(status) || (WEXITSTATUS(status) != EXIT_SUCCESS)) {
+        return EXIT_FAILURE;
+    }
+    if ((sched_getaffinity(-1, sizeof(set), &set) != -1) || (errno != ESRCH)) {
+        printf("A missing process did not fail with ESRCH.\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,123 @@
+/// @file t_aio.c
+/// @brief Tests the asynchronous reads and writes.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <aio.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strerror.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/unistd.h>
+
+/// Number of requests in flight at the same time.
+#define REQUESTS 8
+/// Size of each request, not a multiple of the block size.
+#define CHUNK 3000
+
+int main(int argc, char *argv[])
+{
+    char *filename = "/home/user/test_aio.txt";
+    static char data[REQUESTS * CHUNK];
+    static char buffers[REQUESTS][CHUNK];
+    struct aiocb requests[REQUESTS];
+    struct aiocb *list[REQUESTS];
+    int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd < 0) {
+        printf("Failed to create file %s: %s\n", filename, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < sizeof(data); ++i) {
+        data[i] = (char)('a' + (i % 26));
+    }
+    // Write the file with a single asynchronous write.
+    memset(&requests[0], 0, sizeof(struct aiocb));
+    requests[0].aio_fildes = fd;
+    requests[0].aio_buf    = data;
+    requests[0].aio_nbytes = sizeof(data);
+    if (aio_write(&requests[0]) < 0) {
+        printf("Failed to submit the write: %s\n", strerror(errno));
+        goto close_and_fail;
+    }
+    list[0] = &requests[0];
+    while (aio_error(&requests[0]) == EINPROGRESS) {
+        aio_suspend((const struct aiocb *const *)list, 1, NULL);
+    }
+    if ((aio_error(&requests[0]) != 0) || (aio_return(&requests[0]) != sizeof(data))) {
+        printf("The write failed: %s\n", strerror(aio_error(&requests[0])));
+        goto close_and_fail;
+    }
+    // Keep many reads in flight, in reverse order.
+    for (int i = 0; i < REQUESTS; ++i) {
+        memset(&requests[i], 0, sizeof(struct aiocb));
+        requests[i].aio_fildes     = fd;
+        requests[i].aio_offset     = (REQUESTS - 1 - i) * CHUNK;
+        requests[i].aio_buf        = buffers[i];
+        requests[i].aio_nbytes     = CHUNK;
+        requests[i].aio_lio_opcode = LIO_READ;
+        list[i]                    = &requests[i];
+    }
+    if (lio_listio(LIO_NOWAIT, list, REQUESTS, NULL) < 0) {
+        printf("Failed to submit the reads: %s\n", strerror(errno));
+        goto close_and_fail;
+    }
+    for (int done = 0; done < REQUESTS;) {
+        if (aio_suspend((const struct aiocb *const *)list, REQUESTS, NULL) < 0) {
+            printf("Failed to wait for the reads: %s\n", strerror(errno));
+            goto close_and_fail;
+        }
+        for (int i = 0; i < REQUESTS; ++i) {
+            if (!list[i] || (aio_error(list[i]) == EINPROGRESS)) {
+                continue;
+            }
+            if ((aio_return(list[i]) != CHUNK) ||
+                memcmp(buffers[i], data + (REQUESTS - 1 - i) * CHUNK, CHUNK)) {
+                printf("Read %d returned wrong data.\n", i);
+                goto close_and_fail;
+            }
+            // Completed requests are not waited for anymore.
+            list[i] = NULL;
+            ++done;
+        }
+    }
+    // A read past the end of the file reads nothing, a short one stops there.
+    requests[0].aio_offset = sizeof(data);
+    requests[1].aio_offset = sizeof(data) - 10;
+    list[0]                = &requests[0];
+    list[1]                = &requests[1];
+    if (lio_listio(LIO_WAIT, list, 2, NULL) < 0) {
+        printf("Failed to read at the end of the file: %s\n", strerror(errno));
+        goto close_and_fail;
+    }
+    if ((aio_return(&requests[0]) != 0) || (aio_return(&requests[1]) != 10) ||
+        memcmp(buffers[1], data + sizeof(data) - 10, 10)) {
+        printf("Wrong results at the end of the file.\n");
+        goto close_and_fail;
+    }
+    // Wrong requests.
+    requests[0].aio_fildes = -1;
+    if ((aio_read(&requests[0]) != -1) || (errno != EBADF)) {
+        printf("A read on a wrong descriptor must fail with EBADF.\n");
+        goto close_and_fail;
+    }
+    requests[0].aio_fildes = fd;
+    requests[0].aio_offset = -1;
+    if ((aio_read(&requests[0]) != -1) || (errno != EINVAL)) {
+        printf("A read at a negative offset must fail with EINVAL.\n");
+        goto close_and_fail;
+    }
+    if (aio_cancel(fd, NULL) != AIO_ALLDONE) {
+        printf("All the requests should be done.\n");
+        goto close_and_fail;
+    }
+    close(fd);
+    unlink(filename);
+    return EXIT_SUCCESS;
+
+close_and_fail:
+    close(fd);
+    unlink(filename);
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,101 @@
+/// @file t_allocstats.c
+/// @brief Tests the statistics of the allocators in /proc.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strerror.h>
+#include <string.h>
+#include <sys/unistd.h>
+
+/// Size of the buffer holding a file.
+#define SIZE 8192
+
+/// @brief Reads a whole file of /proc.
+/// @param path the path of the file.
+/// @param buffer the buffer.
+/// @return the number of bytes read, -1 on failure.
+static ssize_t read_file(const char *path, char *buffer)
+{
+    ssize_t total = 0, ret;
+    int fd        = open(path, O_RDONLY, 0);
+    if (fd < 0) {
+        printf("Failed to open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    while ((total < SIZE - 1) && ((ret = read(fd, buffer + total, SIZE - 1 - total)) > 0)) {
+        total += ret;
+    }
+    buffer[total] = 0;
+    close(fd);
+    return total;
+}
+
+/// @brief Finds the number of allocations of a cache in /proc/slabinfo.
+/// @param buffer the content of /proc/slabinfo.
+/// @param name the name of the cache.
+/// @return the number of allocations, or -1 if the cache is missing.
+static long cache_allocs(const char *buffer, const char *name)
+{
+    char cache[64];
+    unsigned objsize, active, total, full, partial, free, pages;
+    unsigned long allocs, frees;
+    for (const char *line = buffer; line && *line; line = strchr(line, '\n')) {
+        if (*line == '\n') {
+            ++line;
+        }
+        if (sscanf(line, "%s %u %u %u %u %u %u %u %lu %lu", cache, &objsize, &active, &total, &full, &partial,
+                   &free, &pages, &allocs, &frees) == 10) {
+            if (!strcmp(cache, name)) {
+                if ((active > total) || (allocs < frees)) {
+                    printf("The counters of %s are not consistent.\n", name);
+                    return -1;
+                }
+                return (long)allocs;
+            }
+        }
+    }
+    return -1;
+}
+
+int main(int argc, char *argv[])
+{
+    static char buffer[SIZE];
+    if ((read_file("/proc/meminfo", buffer) <= 0) || !strstr(buffer, "Slab")) {
+        printf("/proc/meminfo must report the memory of the slabs.\n");
+        return EXIT_FAILURE;
+    }
+    if ((read_file("/proc/buddyinfo", buffer) <= 0) || !strstr(buffer, "Normal") || !strstr(buffer, "HighMem")) {
+        printf("/proc/buddyinfo must report both zones.\n");
+        return EXIT_FAILURE;
+    }
+    if ((read_file("/proc/slabinfo", buffer) <= 0) || strncmp(buffer, "# name", 6)) {
+        printf("/proc/slabinfo must start with its header.\n");
+        return EXIT_FAILURE;
+    }
+    long before = cache_allocs(buffer, "task_struct");
+    if (before < 0) {
+        printf("/proc/slabinfo must report the task_struct cache.\n");
+        return EXIT_FAILURE;
+    }
+    // Opening a file allocates from the slab caches, the counters only grow.
+    if ((read_file("/proc/slabinfo", buffer) <= 0) || (cache_allocs(buffer, "task_struct") < before)) {
+        printf("The allocations of a cache must never decrease.\n");
+        return EXIT_FAILURE;
+    }
+    // The call sites are only accounted with ENABLE_ALLOC_TRACE, but the file
+    // is always there, and writing to it resets the counts.
+    if (read_file("/proc/allocinfo", buffer) <= 0) {
+        printf("/proc/allocinfo must not be empty.\n");
+        return EXIT_FAILURE;
+    }
+    int fd = open("/proc/allocinfo", O_WRONLY, 0);
+    if ((fd < 0) || (write(fd, "0\n", 2) != 2)) {
+        printf("Failed to reset /proc/allocinfo: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    close(fd);
+    return EXIT_SUCCESS;
+}
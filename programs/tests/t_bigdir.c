@@ -0,0 +1,166 @@
+/// @file t_bigdir.c
+/// @brief Test the lookup and the listing of the entries of a directory
+/// spanning many blocks.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strerror.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/unistd.h>
+
+/// The directory we fill.
+#define DIRECTORY "/home/user/t_bigdir"
+/// The prefix of the names of the entries.
+#define PREFIX "entry_with_a_long_name_"
+/// Number of entries, enough to span several directory blocks.
+#define ENTRIES 256
+
+/// @brief Stats an entry relative to the directory, both with only its type
+/// and with all the fields, and compares it with the listing.
+/// @param dir the directory.
+/// @param dent the entry.
+/// @return 0 on success, -1 on failure.
+static int check_statat(DIR *dir, dirent_t *dent)
+{
+    stat_t st;
+    if ((statx(dirfd(dir), dent->d_name, 0, STATX_TYPE | STATX_INO, &st) < 0) ||
+        !S_ISREG(st.st_mode) || (st.st_ino != dent->d_ino)) {
+        printf("Failed to get the type of %s: %s\n", dent->d_name, strerror(errno));
+        return -1;
+    }
+    if ((fstatat(dirfd(dir), dent->d_name, &st, 0) < 0) || !S_ISREG(st.st_mode) ||
+        ((st.st_mode & (S_IRUSR | S_IWUSR)) != (S_IRUSR | S_IWUSR)) || (st.st_ino != dent->d_ino)) {
+        printf("Failed to stat %s from the directory: %s\n", dent->d_name, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/// @brief Lists the directory, and checks that it returns each entry once.
+/// @param first the index of the first entry which exists.
+/// @param step the distance between the indices of the entries which exist.
+/// @return 0 on success, -1 on failure.
+static int check_listing(int first, int step)
+{
+    static char seen[ENTRIES];
+    DIR *dir = opendir(DIRECTORY);
+    if (dir == NULL) {
+        printf("Failed to open directory %s: %s\n", DIRECTORY, strerror(errno));
+        return -1;
+    }
+    // List it twice, the second time after rewinding.
+    for (int pass = 0; pass < 2; ++pass) {
+        memset(seen, 0, sizeof(seen));
+        int count = 0, index;
+        dirent_t *dent;
+        while ((dent = readdir(dir)) != NULL) {
+            if (!strcmp(dent->d_name, ".") || !strcmp(dent->d_name, "..")) {
+                continue;
+            }
+            index = strncmp(dent->d_name, PREFIX, strlen(PREFIX)) ? -1 : atoi(dent->d_name + strlen(PREFIX));
+            if ((index < first) || (index >= ENTRIES) || ((index - first) % step) || seen[index]) {
+                printf("Unexpected entry %s.\n", dent->d_name);
+                closedir(dir);
+                return -1;
+            }
+            if ((pass == 0) && (check_statat(dir, dent) < 0)) {
+                closedir(dir);
+                return -1;
+            }
+            seen[index] = 1;
+            ++count;
+        }
+        if (count != (ENTRIES - first + step - 1) / step) {
+            printf("Listed %d entries instead of %d.\n", count, (ENTRIES - first + step - 1) / step);
+            closedir(dir);
+            return -1;
+        }
+        rewinddir(dir);
+    }
+    closedir(dir);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    char path[256];
+    stat_t st;
+    int fd, created;
+    if (mkdir(DIRECTORY, 0777) < 0) {
+        printf("Failed to create directory %s: %s\n", DIRECTORY, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    // Fill the directory.
+    for (created = 0; created < ENTRIES; ++created) {
+        sprintf(path, "%s/entry_with_a_long_name_%d", DIRECTORY, created);
+        fd = open(path, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+        if (fd < 0) {
+            printf("Failed to create file %s: %s\n", path, strerror(errno));
+            goto cleanup_and_fail;
+        }
+        close(fd);
+    }
+    // Every entry must be found.
+    for (int i = 0; i < ENTRIES; ++i) {
+        sprintf(path, "%s/entry_with_a_long_name_%d", DIRECTORY, i);
+        if (stat(path, &st) < 0) {
+            printf("Failed to stat file %s: %s\n", path, strerror(errno));
+            goto cleanup_and_fail;
+        }
+    }
+    // And listed, exactly once.
+    if (check_listing(0, 1) < 0) {
+        goto cleanup_and_fail;
+    }
+    // While missing ones must not.
+    sprintf(path, "%s/entry_with_a_long_name_%d", DIRECTORY, ENTRIES);
+    if (stat(path, &st) == 0) {
+        printf("Found file %s, which was never created.\n", path);
+        goto cleanup_and_fail;
+    }
+    if (fstatat(AT_FDCWD, path, &st, 0) == 0) {
+        printf("Found file %s from the working directory, which was never created.\n", path);
+        goto cleanup_and_fail;
+    }
+    // Remove half of the entries, and check they are gone.
+    for (int i = 0; i < ENTRIES; i += 2) {
+        sprintf(path, "%s/entry_with_a_long_name_%d", DIRECTORY, i);
+        if (unlink(path) < 0) {
+            printf("Failed to unlink file %s: %s\n", path, strerror(errno));
+            goto cleanup_and_fail;
+        }
+        if (stat(path, &st) == 0) {
+            printf("Found file %s, after removing it.\n", path);
+            goto cleanup_and_fail;
+        }
+    }
+    // The listing skips the freed entries.
+    if (check_listing(1, 2) < 0) {
+        goto cleanup_and_fail;
+    }
+    for (int i = 1; i < ENTRIES; i += 2) {
+        sprintf(path, "%s/entry_with_a_long_name_%d", DIRECTORY, i);
+        if (unlink(path) < 0) {
+            printf("Failed to unlink file %s: %s\n", path, strerror(errno));
+            goto cleanup_and_fail;
+        }
+    }
+    if (rmdir(DIRECTORY) < 0) {
+        printf("Failed to remove directory %s: %s\n", DIRECTORY, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+
+cleanup_and_fail:
+    for (int i = 0; i < created; ++i) {
+        sprintf(path, "%s/entry_with_a_long_name_%d", DIRECTORY, i);
+        unlink(path);
+    }
+    rmdir(DIRECTORY);
+    return EXIT_FAILURE;
+}
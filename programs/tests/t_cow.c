@@ -0,0 +1,81 @@
+/// @file t_cow.c
+/// @brief Test that the memory shared after a fork is copied on write.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/unistd.h>
+#include <sys/wait.h>
+
+/// Size of the buffers we check.
+#define BUFFER_SIZE 8192
+
+/// A buffer inside the data segment, it is initialized so that it is not part of the bss.
+static char data_buffer[BUFFER_SIZE] = "parent";
+
+/// @brief Checks that the buffer is filled with the given value.
+/// @param buffer the buffer.
+/// @param value the value.
+/// @return 1 if the whole buffer holds the value, 0 otherwise.
+static int check_buffer(const char *buffer, char value)
+{
+    for (int i = 0; i < BUFFER_SIZE; ++i) {
+        if (buffer[i] != value) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    char stack_buffer[BUFFER_SIZE];
+    char *heap_buffer = malloc(BUFFER_SIZE);
+    int status;
+    pid_t cpid;
+    if (heap_buffer == NULL) {
+        printf("Failed to allocate the buffer.\n");
+        return EXIT_FAILURE;
+    }
+    memset(data_buffer, 'p', BUFFER_SIZE);
+    memset(stack_buffer, 'p', BUFFER_SIZE);
+    memset(heap_buffer, 'p', BUFFER_SIZE);
+    if ((cpid = fork()) == 0) {
+        // The child sees the memory of the parent, then gets its own copy.
+        if (!check_buffer(data_buffer, 'p') || !check_buffer(stack_buffer, 'p') || !check_buffer(heap_buffer, 'p')) {
+            printf("The child does not see the memory of the parent.\n");
+            exit(EXIT_FAILURE);
+        }
+        memset(data_buffer, 'c', BUFFER_SIZE);
+        memset(stack_buffer, 'c', BUFFER_SIZE);
+        memset(heap_buffer, 'c', BUFFER_SIZE);
+        if (!check_buffer(data_buffer, 'c') || !check_buffer(stack_buffer, 'c') || !check_buffer(heap_buffer, 'c')) {
+            printf("The child failed to write its memory.\n");
+            exit(EXIT_FAILURE);
+        }
+        exit(EXIT_SUCCESS);
+    }
+    if (cpid < 0) {
+        printf("Failed to fork.\n");
+        return EXIT_FAILURE;
+    }
+    if ((waitpid(cpid, &status, 0) != cpid) || !WIFEXITED(status) || (WEXITSTATUS(status) != EXIT_SUCCESS)) {
+        printf("The child failed.\n");
+        return EXIT_FAILURE;
+    }
+    // The writes of the child must not be visible to the parent.
+    if (!check_buffer(data_buffer, 'p') || !check_buffer(stack_buffer, 'p') || !check_buffer(heap_buffer, 'p')) {
+        printf("The parent sees the writes of the child.\n");
+        return EXIT_FAILURE;
+    }
+    // Now the pages belong only to the parent again.
+    memset(heap_buffer, 'q', BUFFER_SIZE);
+    if (!check_buffer(heap_buffer, 'q')) {
+        printf("The parent failed to write its memory.\n");
+        return EXIT_FAILURE;
+    }
+    free(heap_buffer);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,118 @@
+/// @file t_direct.c
+/// @brief Tests O_DIRECT transfers and posix_fadvise.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strerror.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/unistd.h>
+
+/// Size of the blocks of the filesystem, the unit of the direct transfers.
+#define BLOCK_SIZE 4096
+/// Number of blocks moved by the test.
+#define BLOCKS 4
+
+/// @brief Checks that the buffer contains only the given byte.
+/// @param buffer the buffer.
+/// @param length the length of the buffer.
+/// @param value the expected byte.
+/// @return 0 if the content matches, 1 otherwise.
+static int check_buffer(const char *buffer, size_t length, char value)
+{
+    for (size_t i = 0; i < length; ++i) {
+        if (buffer[i] != value) {
+            printf("Unexpected byte %d at %u, expecting %d.\n", buffer[i], i, value);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    char *filename = "/home/user/test_direct.txt";
+    static char buffer[BLOCKS * BLOCK_SIZE] __attribute__((aligned(BLOCK_SIZE)));
+    int cached = -1;
+    int fd     = open(filename, O_RDWR | O_CREAT | O_TRUNC | O_DIRECT, S_IRUSR | S_IWUSR);
+    if (fd < 0) {
+        printf("Failed to create file %s with O_DIRECT: %s\n", filename, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    // Write whole blocks, bypassing the cache.
+    memset(buffer, 'd', sizeof(buffer));
+    if (write(fd, buffer, sizeof(buffer)) != sizeof(buffer)) {
+        printf("Failed to write on file %s: %s\n", filename, strerror(errno));
+        goto close_and_fail;
+    }
+    // Transfers which are not aligned on blocks are refused.
+    if ((pwrite(fd, buffer, 100, 0) != -1) || (errno != EINVAL) ||
+        (pread(fd, buffer + 1, BLOCK_SIZE, 0) != -1) || (errno != EINVAL)) {
+        printf("Unaligned direct transfers must fail with EINVAL.\n");
+        goto close_and_fail;
+    }
+    // The cached reads see the direct writes.
+    cached = open(filename, O_RDWR, 0);
+    if (cached < 0) {
+        printf("Failed to open file %s: %s\n", filename, strerror(errno));
+        goto close_and_fail;
+    }
+    memset(buffer, 0, sizeof(buffer));
+    if ((pread(cached, buffer, sizeof(buffer), 0) != sizeof(buffer)) || check_buffer(buffer, sizeof(buffer), 'd')) {
+        printf("The cached read does not match the direct write.\n");
+        goto close_and_fail;
+    }
+    // The direct reads see the cached writes, still dirty.
+    memset(buffer, 'c', BLOCK_SIZE);
+    if (pwrite(cached, buffer, BLOCK_SIZE, BLOCK_SIZE) != BLOCK_SIZE) {
+        printf("Failed to write on file %s: %s\n", filename, strerror(errno));
+        goto close_and_fail;
+    }
+    memset(buffer, 0, sizeof(buffer));
+    if ((pread(fd, buffer, sizeof(buffer), 0) != sizeof(buffer)) ||
+        check_buffer(buffer, BLOCK_SIZE, 'd') ||
+        check_buffer(buffer + BLOCK_SIZE, BLOCK_SIZE, 'c') ||
+        check_buffer(buffer + 2 * BLOCK_SIZE, 2 * BLOCK_SIZE, 'd')) {
+        printf("The direct read does not match the cached write.\n");
+        goto close_and_fail;
+    }
+    // Direct reads stop at the end of the file.
+    if (pread(fd, buffer, BLOCK_SIZE, BLOCKS * BLOCK_SIZE) != 0) {
+        printf("The direct read past the end of file %s must return 0.\n", filename);
+        goto close_and_fail;
+    }
+    // Advice.
+    if (posix_fadvise(cached, 0, 0, POSIX_FADV_SEQUENTIAL) ||
+        posix_fadvise(cached, 0, BLOCK_SIZE, POSIX_FADV_WILLNEED) ||
+        posix_fadvise(cached, 0, 0, POSIX_FADV_DONTNEED) ||
+        posix_fadvise(cached, 0, 0, POSIX_FADV_NOREUSE) ||
+        posix_fadvise(cached, 0, 0, POSIX_FADV_NORMAL)) {
+        printf("Failed to advise on file %s.\n", filename);
+        goto close_and_fail;
+    }
+    if ((posix_fadvise(cached, 0, 0, 42) != EINVAL) || (posix_fadvise(-1, 0, 0, POSIX_FADV_NORMAL) != EBADF)) {
+        printf("Wrong errors from posix_fadvise.\n");
+        goto close_and_fail;
+    }
+    // The data survives being dropped from the cache.
+    memset(buffer, 0, sizeof(buffer));
+    if ((pread(cached, buffer, BLOCK_SIZE, BLOCK_SIZE) != BLOCK_SIZE) || check_buffer(buffer, BLOCK_SIZE, 'c')) {
+        printf("The content of file %s has been lost.\n", filename);
+        goto close_and_fail;
+    }
+    close(cached);
+    close(fd);
+    unlink(filename);
+    return EXIT_SUCCESS;
+
+close_and_fail:
+    if (cached >= 0) {
+        close(cached);
+    }
+    close(fd);
+    unlink(filename);
+    return EXIT_FAILURE;
+}
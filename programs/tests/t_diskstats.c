@@ -0,0 +1,98 @@
+/// @file t_diskstats.c
+/// @brief Tests the I/O statistics of the block devices, in /proc/diskstats.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/unistd.h>
+
+/// Size of the buffer holding a file.
+#define SIZE 4096
+
+/// @brief Reads a whole file.
+/// @param path the path of the file.
+/// @param buffer the buffer.
+/// @return the number of bytes read, -1 on failure.
+static ssize_t read_file(const char *path, char *buffer)
+{
+    ssize_t total = 0, ret;
+    int fd        = open(path, O_RDONLY, 0);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    while ((total < SIZE - 1) && ((ret = read(fd, buffer + total, SIZE - 1 - total)) > 0)) {
+        total += ret;
+    }
+    buffer[total] = 0;
+    close(fd);
+    return total;
+}
+
+/// @brief Sums the reads of all the devices listed by /proc/diskstats.
+/// @param buffer a buffer for the file.
+/// @param device where the name of the first device with reads is stored.
+/// @return the sum, -1 on failure.
+static long total_reads(char *buffer, char *device)
+{
+    long total = 0;
+    if (read_file("/proc/diskstats", buffer) <= 0) {
+        return -1;
+    }
+    for (char *line = strtok(buffer, "\n"); line; line = strtok(NULL, "\n")) {
+        char name[16];
+        long reads;
+        if ((line[0] == '#') || (sscanf(line, "%15s %ld", name, &reads) != 2)) {
+            continue;
+        }
+        if (reads && (device[0] == 0)) {
+            strcpy(device, name);
+        }
+        total += reads;
+    }
+    return total;
+}
+
+int main(int argc, char *argv[])
+{
+    static char buffer[SIZE], data[SIZE];
+    char device[16] = { 0 }, path[32];
+    long before = total_reads(buffer, device);
+    if (before < 0) {
+        printf("Failed to read /proc/diskstats.\n");
+        return EXIT_FAILURE;
+    }
+    // The root filesystem is on disk, reading a file must not lower the count.
+    read_file("/bin/init", data);
+    long after = total_reads(buffer, device);
+    if (after < before) {
+        printf("The reads went from %ld to %ld.\n", before, after);
+        return EXIT_FAILURE;
+    }
+    // Without reads there is no latency to check.
+    if (device[0] == 0) {
+        return EXIT_SUCCESS;
+    }
+    // Each completed read falls in a bucket of the histogram.
+    sprintf(path, "/proc/%s/latency", device);
+    if (read_file(path, buffer) <= 0) {
+        printf("Failed to read %s.\n", path);
+        return EXIT_FAILURE;
+    }
+    long bucketed = 0;
+    for (char *line = strtok(buffer, "\n"); line; line = strtok(NULL, "\n")) {
+        char bound[8];
+        long limit, reads;
+        if ((line[0] != '#') && (sscanf(line, "%7s %ld %ld", bound, &limit, &reads) == 3)) {
+            bucketed += reads;
+        }
+    }
+    if (bucketed == 0) {
+        printf("The reads of %s are missing from its latency histogram.\n", device);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
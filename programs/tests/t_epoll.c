@@ -0,0 +1,179 @@
+/// @file t_epoll.c
+/// @brief Tests epoll on pipes.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <sys/unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strerror.h>
+#include <sys/epoll.h>
+#include <sys/errno.h>
+#include <sys/wait.h>
+#include <time.h>
+
+/// @brief Checks the control operations, and the level-triggered mode.
+/// @return 0 on success, 1 on failure.
+static int test_level(void)
+{
+    struct epoll_event ev, out[2];
+    char c = 'x';
+    int fds[2], epfd;
+    if (((epfd = epoll_create1(0)) < 0) || (pipe(fds) < 0)) {
+        printf("Failed to create the instance or the pipe: %s\n", strerror(errno));
+        return 1;
+    }
+    ev.events  = EPOLLIN;
+    ev.data.fd = fds[0];
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fds[0], &ev) < 0) {
+        printf("Failed to watch the read end: %s\n", strerror(errno));
+        return 1;
+    }
+    if ((epoll_ctl(epfd, EPOLL_CTL_ADD, fds[0], &ev) != -1) || (errno != EEXIST)) {
+        printf("Watching a descriptor twice should fail with EEXIST.\n");
+        return 1;
+    }
+    if ((epoll_ctl(epfd, EPOLL_CTL_ADD, epfd, &ev) != -1) || (errno != EINVAL)) {
+        printf("An instance should not watch itself.\n");
+        return 1;
+    }
+    if (epoll_wait(epfd, out, 2, 0) != 0) {
+        printf("An empty pipe should not be ready.\n");
+        return 1;
+    }
+    write(fds[1], &c, 1);
+    // Until the data is read, it is reported by every call.
+    for (int i = 0; i < 2; ++i) {
+        if ((epoll_wait(epfd, out, 2, 0) != 1) || (out[0].events != EPOLLIN) || (out[0].data.fd != fds[0])) {
+            printf("A pipe with data should be readable.\n");
+            return 1;
+        }
+    }
+    read(fds[0], &c, 1);
+    if (epoll_wait(epfd, out, 2, 0) != 0) {
+        printf("A drained pipe should not be ready.\n");
+        return 1;
+    }
+    // Once removed, the descriptor is not reported anymore.
+    write(fds[1], &c, 1);
+    if (epoll_ctl(epfd, EPOLL_CTL_DEL, fds[0], NULL) < 0) {
+        printf("Failed to stop watching the read end: %s\n", strerror(errno));
+        return 1;
+    }
+    if ((epoll_ctl(epfd, EPOLL_CTL_DEL, fds[0], NULL) != -1) || (errno != ENOENT)) {
+        printf("Removing a descriptor twice should fail with ENOENT.\n");
+        return 1;
+    }
+    if (epoll_wait(epfd, out, 2, 0) != 0) {
+        printf("A removed descriptor should not be reported.\n");
+        return 1;
+    }
+    close(fds[0]);
+    close(fds[1]);
+    close(epfd);
+    return 0;
+}
+
+/// @brief Checks the edge-triggered and the one-shot modes.
+/// @return 0 on success, 1 on failure.
+static int test_edge(void)
+{
+    struct epoll_event ev, out;
+    char c = 'x';
+    int fds[2], epfd;
+    if (((epfd = epoll_create(1)) < 0) || (pipe(fds) < 0)) {
+        printf("Failed to create the instance or the pipe: %s\n", strerror(errno));
+        return 1;
+    }
+    ev.events  = EPOLLIN | EPOLLET;
+    ev.data.fd = fds[0];
+    epoll_ctl(epfd, EPOLL_CTL_ADD, fds[0], &ev);
+    write(fds[1], &c, 1);
+    if (epoll_wait(epfd, &out, 1, 0) != 1) {
+        printf("The first write should be reported.\n");
+        return 1;
+    }
+    // The data is still there, but nothing changed.
+    if (epoll_wait(epfd, &out, 1, 0) != 0) {
+        printf("An edge-triggered descriptor should be reported once.\n");
+        return 1;
+    }
+    write(fds[1], &c, 1);
+    if (epoll_wait(epfd, &out, 1, 0) != 1) {
+        printf("A new write should be reported again.\n");
+        return 1;
+    }
+    // A one-shot descriptor is disabled until it is modified.
+    ev.events = EPOLLIN | EPOLLONESHOT;
+    epoll_ctl(epfd, EPOLL_CTL_MOD, fds[0], &ev);
+    if ((epoll_wait(epfd, &out, 1, 0) != 1) || (epoll_wait(epfd, &out, 1, 0) != 0)) {
+        printf("A one-shot descriptor should be reported once.\n");
+        return 1;
+    }
+    write(fds[1], &c, 1);
+    if (epoll_wait(epfd, &out, 1, 0) != 0) {
+        printf("A fired one-shot descriptor should stay disabled.\n");
+        return 1;
+    }
+    epoll_ctl(epfd, EPOLL_CTL_MOD, fds[0], &ev);
+    if (epoll_wait(epfd, &out, 1, 0) != 1) {
+        printf("Modifying a one-shot descriptor should enable it again.\n");
+        return 1;
+    }
+    close(fds[0]);
+    close(fds[1]);
+    close(epfd);
+    return 0;
+}
+
+/// @brief Waits for a child writing a pipe, then for a timeout.
+/// @return 0 on success, 1 on failure.
+static int test_wait(void)
+{
+    struct epoll_event ev, out;
+    char c = 'x';
+    int fds[2], epfd;
+    if (((epfd = epoll_create1(0)) < 0) || (pipe(fds) < 0)) {
+        printf("Failed to create the instance or the pipe: %s\n", strerror(errno));
+        return 1;
+    }
+    if (!fork()) {
+        close(fds[0]);
+        sleep(1);
+        write(fds[1], &c, 1);
+        exit(EXIT_SUCCESS);
+    }
+    close(fds[1]);
+    ev.events  = EPOLLIN;
+    ev.data.fd = fds[0];
+    epoll_ctl(epfd, EPOLL_CTL_ADD, fds[0], &ev);
+    // Sleep until the child writes.
+    if ((epoll_wait(epfd, &out, 1, -1) != 1) || !(out.events & EPOLLIN)) {
+        printf("Failed to wait for the data: %s\n", strerror(errno));
+        return 1;
+    }
+    read(fds[0], &c, 1);
+    wait(NULL);
+    // The child exited, leaving only the hang up.
+    if ((epoll_wait(epfd, &out, 1, 100) != 1) || (out.events != EPOLLHUP)) {
+        printf("A pipe without writers should report EPOLLHUP.\n");
+        return 1;
+    }
+    // Closing the last descriptor of the file stops watching it.
+    close(fds[0]);
+    if (epoll_wait(epfd, &out, 1, 50) != 0) {
+        printf("A closed descriptor should not be reported, the time should expire.\n");
+        return 1;
+    }
+    close(epfd);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if (test_level() || test_edge() || test_wait()) {
+        return EXIT_FAILURE;
+    }
+    printf("Epoll works.\n");
+    return EXIT_SUCCESS;
+}
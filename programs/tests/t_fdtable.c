@@ -0,0 +1,99 @@
+/// @file t_fdtable.c
+/// @brief Tests the growth of the file descriptor table, the allocation of
+/// the lowest free descriptor, and O_CLOEXEC.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strerror.h>
+#include <sys/errno.h>
+#include <sys/unistd.h>
+#include <sys/wait.h>
+
+/// The number of descriptors opened, more than the initial size of the table.
+#define NUM_FDS 200
+
+/// @brief Checks, after the execve, which descriptors survived.
+/// @param kept the descriptor opened without O_CLOEXEC.
+/// @param closed the descriptor opened with O_CLOEXEC.
+/// @return EXIT_SUCCESS if only the first is open.
+static int check_after_exec(int kept, int closed)
+{
+    char c;
+    if (read(kept, &c, 1) != 1) {
+        printf("Descriptor %d was closed by execve: %s\n", kept, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    if (read(closed, &c, 1) >= 0) {
+        printf("Descriptor %d survived execve despite O_CLOEXEC.\n", closed);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[])
+{
+    if ((argc == 4) && !strcmp(argv[1], "check")) {
+        return check_after_exec(atoi(argv[2]), atoi(argv[3]));
+    }
+
+    // Fill the table well past its initial size, each duplicate must take
+    // the lowest free descriptor.
+    int fds[NUM_FDS];
+    for (int i = 0; i < NUM_FDS; ++i) {
+        if ((fds[i] = dup(STDOUT_FILENO)) < 0) {
+            printf("Failed to dup the descriptor %d: %s\n", i, strerror(errno));
+            return EXIT_FAILURE;
+        }
+        if ((i > 0) && (fds[i] != fds[i - 1] + 1)) {
+            printf("Expected descriptor %d, got %d.\n", fds[i - 1] + 1, fds[i]);
+            return EXIT_FAILURE;
+        }
+    }
+    // A hole is filled before the end of the table.
+    close(fds[NUM_FDS / 2]);
+    int fd = dup(STDOUT_FILENO);
+    if (fd != fds[NUM_FDS / 2]) {
+        printf("Expected the freed descriptor %d, got %d.\n", fds[NUM_FDS / 2], fd);
+        return EXIT_FAILURE;
+    }
+    for (int i = 0; i < NUM_FDS; ++i) {
+        close(fds[i]);
+    }
+
+    int kept   = open("/etc/passwd", O_RDONLY, 0);
+    int closed = open("/etc/passwd", O_RDONLY | O_CLOEXEC, 0);
+    if ((kept < 0) || (closed < 0)) {
+        printf("Failed to open /etc/passwd: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    // A duplicate does not inherit O_CLOEXEC.
+    int copy = dup(closed);
+    char c;
+    if ((copy < 0) || (read(copy, &c, 1) != 1)) {
+        printf("Failed to read the duplicate %d: %s\n", copy, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    close(copy);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        char kept_str[16], closed_str[16];
+        sprintf(kept_str, "%d", kept);
+        sprintf(closed_str, "%d", closed);
+        execl("/bin/tests/t_fdtable", "t_fdtable", "check", kept_str, closed_str, NULL);
+        printf("Failed to exec: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    int status;
+    if ((pid < 0) || (waitpid(pid, &status, 0) != pid) || !WIFEXITED(status) || (WEXITSTATUS(status) != 0)) {
+        printf("The check after execve failed.\n");
+        return EXIT_FAILURE;
+    }
+    close(kept);
+    close(closed);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,65 @@
+/// @file t_fsync.c
+/// @brief Test the write-back of the modified data with sync and fsync.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strerror.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/unistd.h>
+
+int main(int argc, char *argv[])
+{
+    char *filename = "/home/user/test_fsync.txt";
+    char buffer[16];
+    memset(buffer, 0, sizeof(buffer));
+    // Create the file.
+    int fd = open(filename, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+    if (fd < 0) {
+        printf("Failed to create file %s: %s\n", filename, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    if (write(fd, "fusrodah", 8) != 8) {
+        printf("Failed to write on file %s: %s\n", filename, strerror(errno));
+        goto close_and_fail;
+    }
+    // Force the write-back of the file.
+    if (fsync(fd) < 0) {
+        printf("Failed to fsync file %s: %s\n", filename, strerror(errno));
+        goto close_and_fail;
+    }
+    close(fd);
+    // Force the write-back of everything else.
+    sync();
+    // Check that the content is still there.
+    fd = open(filename, O_RDONLY, 0);
+    if (fd < 0) {
+        printf("Failed to open file %s: %s\n", filename, strerror(errno));
+        goto unlink_and_fail;
+    }
+    if (read(fd, buffer, 8) != 8) {
+        printf("Failed to read from file %s: %s\n", filename, strerror(errno));
+        goto close_and_fail;
+    }
+    if (strcmp(buffer, "fusrodah") != 0) {
+        printf("Unexpected file content `%s`, expecting `fusrodah`.\n", buffer);
+        goto close_and_fail;
+    }
+    close(fd);
+    // An invalid file descriptor must be rejected.
+    if ((fsync(-1) != -1) || (errno != EBADF)) {
+        printf("The fsync of an invalid file descriptor did not fail with EBADF.\n");
+        goto unlink_and_fail;
+    }
+    unlink(filename);
+    return EXIT_SUCCESS;
+
+close_and_fail:
+    close(fd);
+unlink_and_fail:
+    unlink(filename);
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,52 @@
+/// @file t_funcprof.c
+/// @brief Tests the profile of the functions of the kernel, in /proc/func_profile.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strerror.h>
+#include <sys/unistd.h>
+
+/// Size of the buffer holding the beginning of the file.
+#define SIZE 4096
+
+int main(int argc, char *argv[])
+{
+    static char buffer[SIZE];
+    ssize_t total = 0, ret;
+    int fd        = open("/proc/func_profile", O_RDONLY, 0);
+    if (fd < 0) {
+        perror("/proc/func_profile");
+        return EXIT_FAILURE;
+    }
+    while ((total < SIZE - 1) && ((ret = read(fd, buffer + total, SIZE - 1 - total)) > 0)) {
+        total += ret;
+    }
+    buffer[total] = 0;
+    close(fd);
+    // The functions are only profiled with ENABLE_FUNC_PROFILE, but the file
+    // is always there.
+    if (strstr(buffer, "without")) {
+        return EXIT_SUCCESS;
+    }
+    if (strncmp(buffer, "# functions ", 12) != 0) {
+        printf("Unexpected header: %.40s\n", buffer);
+        return EXIT_FAILURE;
+    }
+    // Reading the file called plenty of functions.
+    if (strtol(buffer + 12, NULL, 10) <= 0) {
+        printf("No function was profiled.\n");
+        return EXIT_FAILURE;
+    }
+    // Writing to the file clears the profile.
+    fd = open("/proc/func_profile", O_WRONLY, 0);
+    if ((fd < 0) || (write(fd, "0\n", 2) != 2)) {
+        printf("Failed to reset /proc/func_profile: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    close(fd);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,85 @@
+/// @file t_futex.c
+/// @brief Tests the futexes, and the locks built on them, between processes.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <strerror.h>
+#include <sys/errno.h>
+#include <sys/futex.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <sys/unistd.h>
+#include <sys/wait.h>
+
+/// The number of processes incrementing the counter.
+#define WORKERS 3
+/// The number of increments of each process.
+#define ROUNDS 500
+
+/// @brief The memory shared by the processes.
+typedef struct shared_t {
+    /// Protects the counter.
+    futex_mutex_t mutex;
+    /// The counter.
+    int counter;
+} shared_t;
+
+int main(int argc, char *argv[])
+{
+    int word = 0;
+    struct timespec timeout = { .tv_sec = 0, .tv_nsec = 10000000 };
+    // The futex does not hold the value, we must not sleep.
+    if ((futex(&word, FUTEX_WAIT, 1, NULL, NULL) != -1) || (errno != EAGAIN)) {
+        printf("FUTEX_WAIT slept on a wrong value.\n");
+        return EXIT_FAILURE;
+    }
+    // Nobody wakes us up, the time must expire.
+    if ((futex(&word, FUTEX_WAIT, 0, &timeout, NULL) != -1) || (errno != ETIMEDOUT)) {
+        printf("FUTEX_WAIT did not time out: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    int shmid = shmget(IPC_PRIVATE, sizeof(shared_t), IPC_CREAT | 0600);
+    if (shmid < 0) {
+        printf("Failed to create the shared memory: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    shared_t *shared = (shared_t *)shmat(shmid, NULL, 0);
+    if (shared == NULL) {
+        printf("Failed to attach the shared memory: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    futex_mutex_init(&shared->mutex);
+    shared->counter = 0;
+    for (int i = 0; i < WORKERS; ++i) {
+        if (!fork()) {
+            // Attach it again, the memory inherited from the parent might be
+            // copied on write.
+            shared = (shared_t *)shmat(shmid, NULL, 0);
+            if (shared == NULL) {
+                exit(EXIT_FAILURE);
+            }
+            for (int round = 0; round < ROUNDS; ++round) {
+                futex_mutex_lock(&shared->mutex);
+                int value = shared->counter;
+                // Give the others a chance to find the lock taken.
+                if ((round % 50) == 0) {
+                    sleep(0);
+                }
+                shared->counter = value + 1;
+                futex_mutex_unlock(&shared->mutex);
+            }
+            exit(EXIT_SUCCESS);
+        }
+    }
+    while (wait(NULL) != -1) continue;
+    int counter = shared->counter;
+    shmdt(shared);
+    shmctl(shmid, IPC_RMID, NULL);
+    if (counter != WORKERS * ROUNDS) {
+        printf("Wrong counter: %d instead of %d.\n", counter, WORKERS * ROUNDS);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,93 @@
+/// @file t_getrusage.c
+/// @brief Tests the resources reported by getrusage.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <sys/unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strerror.h>
+#include <sys/errno.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+
+/// @brief Keeps the CPU busy in user mode.
+/// @param iterations the number of iterations.
+/// @return a value which depends on every iteration.
+static unsigned burn_cpu(unsigned iterations)
+{
+    volatile unsigned value = 0;
+    for (unsigned i = 0; i < iterations; ++i) {
+        value += i * i;
+    }
+    return value;
+}
+
+/// @brief Returns the time, in microseconds.
+/// @param tv the time value.
+/// @return the microseconds.
+static unsigned long long to_usec(const timeval *tv)
+{
+    return ((unsigned long long)tv->tv_sec * 1000000u) + tv->tv_usec;
+}
+
+int main(int argc, char *argv[])
+{
+    struct rusage before, after;
+    if ((getrusage(2, &before) != -1) || (errno != EINVAL)) {
+        printf("An unknown target should fail with EINVAL.\n");
+        return EXIT_FAILURE;
+    }
+    if (getrusage(RUSAGE_SELF, &before) < 0) {
+        printf("Failed to read the resources: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    // Touching fresh anonymous pages causes minor faults, fewer than the
+    // pages since the neighbours are mapped too, and grows the resident set.
+    const size_t pages = 16;
+    char *area         = mmap(NULL, pages * 4096, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (area == NULL) {
+        printf("Failed to map the area: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < pages; ++i) {
+        area[i * 4096] = 1;
+    }
+    // Sleeping gives up the CPU voluntarily.
+    sleep(1);
+    burn_cpu(50000000);
+    getrusage(RUSAGE_SELF, &after);
+    if (after.ru_minflt <= before.ru_minflt) {
+        printf("The faults were not counted: %ld, %ld.\n", before.ru_minflt, after.ru_minflt);
+        return EXIT_FAILURE;
+    }
+    if (after.ru_maxrss < (long)(pages * 4)) {
+        printf("The resident set is too small: %ld kB.\n", after.ru_maxrss);
+        return EXIT_FAILURE;
+    }
+    if (after.ru_nvcsw <= before.ru_nvcsw) {
+        printf("Sleeping should count as a voluntary context switch.\n");
+        return EXIT_FAILURE;
+    }
+    if (to_usec(&after.ru_utime) <= to_usec(&before.ru_utime)) {
+        printf("The time spent in user mode was not counted.\n");
+        return EXIT_FAILURE;
+    }
+    munmap(area, pages * 4096);
+    // The resources of a child are collected once it is waited for.
+    getrusage(RUSAGE_CHILDREN, &before);
+    if (fork() == 0) {
+        burn_cpu(50000000);
+        exit(EXIT_SUCCESS);
+    }
+    wait(NULL);
+    getrusage(RUSAGE_CHILDREN, &after);
+    if (to_usec(&after.ru_utime) <= to_usec(&before.ru_utime)) {
+        printf("The time spent by the child was not collected.\n");
+        return EXIT_FAILURE;
+    }
+    printf("Getrusage works.\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,66 @@
+/// @file t_gettimeofday.c
+/// @brief Test the clock read from the vDSO.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/unistd.h>
+#include <sys/vdso.h>
+#include <system/syscall_types.h>
+#include <time.h>
+
+int main(int argc, char *argv[])
+{
+    timeval before, after;
+    timespec uptime, mono, real;
+    long now;
+
+    if (__vdso_uptime(&uptime, NULL) < 0) {
+        printf("The kernel does not provide the clock in the vDSO.\n");
+        return EXIT_FAILURE;
+    }
+    // The time read without a system call agrees with the one of the kernel.
+    __inline_syscall1(now, time, NULL);
+    if ((time(NULL) < (time_t)now) || (time(NULL) > (time_t)now + 1)) {
+        printf("time returned %u, the kernel %ld.\n", time(NULL), now);
+        return EXIT_FAILURE;
+    }
+    if (gettimeofday(&before, NULL) < 0) {
+        printf("gettimeofday failed.\n");
+        return EXIT_FAILURE;
+    }
+    if (before.tv_usec >= 1000000) {
+        printf("gettimeofday returned %u microseconds.\n", before.tv_usec);
+        return EXIT_FAILURE;
+    }
+    // The clocks of the vDSO agree with the ones of the kernel.
+    if ((clock_gettime(CLOCK_MONOTONIC, &mono) < 0) || (clock_gettime(CLOCK_REALTIME, &real) < 0)) {
+        printf("clock_gettime failed.\n");
+        return EXIT_FAILURE;
+    }
+    __inline_syscall2(now, clock_gettime, CLOCK_REALTIME, &uptime);
+    if ((now < 0) || (uptime.tv_sec < real.tv_sec) || (uptime.tv_sec > real.tv_sec + 1)) {
+        printf("clock_gettime returned %u, the kernel %u.\n", real.tv_sec, uptime.tv_sec);
+        return EXIT_FAILURE;
+    }
+    __inline_syscall2(now, clock_gettime, CLOCK_MONOTONIC, &uptime);
+    if ((now < 0) || (uptime.tv_sec < mono.tv_sec) ||
+        ((uptime.tv_sec == mono.tv_sec) && (uptime.tv_nsec < mono.tv_nsec))) {
+        printf("The monotonic clock went back, from %u.%09ld to %u.%09ld.\n", mono.tv_sec, mono.tv_nsec,
+               uptime.tv_sec, uptime.tv_nsec);
+        return EXIT_FAILURE;
+    }
+    // The clock goes forward.
+    sleep(1);
+    if (gettimeofday(&after, NULL) < 0) {
+        printf("gettimeofday failed.\n");
+        return EXIT_FAILURE;
+    }
+    if ((after.tv_sec < before.tv_sec + 1) || (after.tv_sec > before.tv_sec + 2)) {
+        printf("Slept one second, from %u.%06u to %u.%06u.\n", before.tv_sec, before.tv_usec, after.tv_sec,
+               after.tv_usec);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
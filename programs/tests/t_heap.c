@@ -0,0 +1,83 @@
+/// @file t_heap.c
+/// @brief Tests that the heap is populated on demand, and grows past its
+/// initial size.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+/// Number of blocks we allocate.
+#define NUM_BLOCKS 24
+/// Size of each block, all together they take more than the old fixed heap.
+#define BLOCK_SIZE (256 * 1024)
+/// Number of page faults a small allocation is allowed to cause.
+#define SMALL_ALLOC_FAULTS 16
+
+/// @brief Checks that the block is filled with the given value.
+/// @param block the block.
+/// @param value the value.
+/// @return 1 if the whole block holds the value, 0 otherwise.
+static int check_block(const char *block, char value)
+{
+    for (int i = 0; i < BLOCK_SIZE; ++i) {
+        if (block[i] != value) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    char *blocks[NUM_BLOCKS];
+    struct rusage before, after;
+    // A small allocation touches only the pages it uses.
+    getrusage(RUSAGE_SELF, &before);
+    char *small = malloc(64);
+    getrusage(RUSAGE_SELF, &after);
+    if (small == NULL) {
+        printf("Failed to allocate a small block.\n");
+        return EXIT_FAILURE;
+    }
+    if (after.ru_minflt - before.ru_minflt > SMALL_ALLOC_FAULTS) {
+        printf("A small allocation caused %ld page faults.\n", after.ru_minflt - before.ru_minflt);
+        return EXIT_FAILURE;
+    }
+    // The heap grows as needed.
+    for (int i = 0; i < NUM_BLOCKS; ++i) {
+        if ((blocks[i] = malloc(BLOCK_SIZE)) == NULL) {
+            printf("Failed to allocate block %d.\n", i);
+            return EXIT_FAILURE;
+        }
+        memset(blocks[i], 'a' + i, BLOCK_SIZE);
+    }
+    for (int i = 0; i < NUM_BLOCKS; ++i) {
+        if (!check_block(blocks[i], 'a' + i)) {
+            printf("Block %d was overwritten.\n", i);
+            return EXIT_FAILURE;
+        }
+    }
+    // The top of the heap is given back, then it grows again.
+    for (int i = NUM_BLOCKS - 1; i >= 0; --i) {
+        free(blocks[i]);
+    }
+    for (int i = 0; i < NUM_BLOCKS; ++i) {
+        if ((blocks[i] = malloc(BLOCK_SIZE)) == NULL) {
+            printf("Failed to allocate block %d again.\n", i);
+            return EXIT_FAILURE;
+        }
+        memset(blocks[i], 'A' + i, BLOCK_SIZE);
+    }
+    for (int i = 0; i < NUM_BLOCKS; ++i) {
+        if (!check_block(blocks[i], 'A' + i)) {
+            printf("Block %d was overwritten.\n", i);
+            return EXIT_FAILURE;
+        }
+        free(blocks[i]);
+    }
+    free(small);
+    return EXIT_SUCCESS;
+}
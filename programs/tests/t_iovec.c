@@ -0,0 +1,71 @@
+/// @file t_iovec.c
+/// @brief Test vectored and positional reads and writes.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strerror.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/unistd.h>
+
+/// The file we use.
+#define FILENAME "/home/user/t_iovec.txt"
+
+int main(int argc, char *argv[])
+{
+    char head[6] = "Hello ", tail[6] = "world!", check[12], part[5];
+    struct iovec iov[2];
+    int fd;
+    fd = open(FILENAME, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd < 0) {
+        printf("Failed to create file %s: %s\n", FILENAME, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    // Write both buffers with a single call.
+    iov[0].iov_base = head;
+    iov[0].iov_len  = sizeof(head);
+    iov[1].iov_base = tail;
+    iov[1].iov_len  = sizeof(tail);
+    if (writev(fd, iov, 2) != sizeof(head) + sizeof(tail)) {
+        printf("Failed to writev file %s: %s\n", FILENAME, strerror(errno));
+        goto close_and_fail;
+    }
+    // Positional reads and writes do not move the offset.
+    if (pwrite(fd, "W", 1, 6) != 1) {
+        printf("Failed to pwrite file %s: %s\n", FILENAME, strerror(errno));
+        goto close_and_fail;
+    }
+    if ((pread(fd, part, sizeof(part), 6) != sizeof(part)) || (memcmp(part, "World", 5) != 0)) {
+        printf("Failed to pread file %s: %s\n", FILENAME, strerror(errno));
+        goto close_and_fail;
+    }
+    if (lseek(fd, 0, SEEK_CUR) != sizeof(head) + sizeof(tail)) {
+        printf("The positional operations moved the file offset.\n");
+        goto close_and_fail;
+    }
+    // Read the file back, splitting it differently.
+    lseek(fd, 0, SEEK_SET);
+    iov[0].iov_base = check;
+    iov[0].iov_len  = 4;
+    iov[1].iov_base = check + 4;
+    iov[1].iov_len  = sizeof(check) - 4;
+    if (readv(fd, iov, 2) != sizeof(check)) {
+        printf("Failed to readv file %s: %s\n", FILENAME, strerror(errno));
+        goto close_and_fail;
+    }
+    if (memcmp(check, "Hello World!", sizeof(check)) != 0) {
+        printf("The content read back does not match.\n");
+        goto close_and_fail;
+    }
+    close(fd);
+    unlink(FILENAME);
+    return EXIT_SUCCESS;
+close_and_fail:
+    close(fd);
+    unlink(FILENAME);
+    return EXIT_FAILURE;
+}
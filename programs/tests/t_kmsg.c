@@ -0,0 +1,34 @@
+/// @file t_kmsg.c
+/// @brief Test the history of the kernel messages.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strerror.h>
+#include <string.h>
+#include <sys/unistd.h>
+
+int main(int argc, char *argv[])
+{
+    char buffer[256];
+    memset(buffer, 0, sizeof(buffer));
+    int fd = open("/proc/kmsg", O_RDONLY, 0);
+    if (fd < 0) {
+        printf("Failed to open /proc/kmsg: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    // The boot logged something, each line starts with its level.
+    ssize_t length = read(fd, buffer, sizeof(buffer) - 1);
+    close(fd);
+    if (length <= 0) {
+        printf("The history of the kernel messages is empty.\n");
+        return EXIT_FAILURE;
+    }
+    if ((buffer[0] != '<') || (strchr(buffer, ']') == NULL)) {
+        printf("The history does not start with a record: %s\n", buffer);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
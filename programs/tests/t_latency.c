@@ -0,0 +1,69 @@
+/// @file t_latency.c
+/// @brief Tests the files of the latency tracer, in /proc/latency.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strerror.h>
+#include <sys/unistd.h>
+#include <time.h>
+
+/// Size of the buffer holding a file.
+#define SIZE 4096
+
+/// @brief Reads a whole file.
+/// @param path the path of the file.
+/// @param buffer the buffer.
+/// @return the number of bytes read, -1 on failure.
+static ssize_t read_file(const char *path, char *buffer)
+{
+    ssize_t total = 0, ret;
+    int fd        = open(path, O_RDONLY, 0);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    while ((total < SIZE - 1) && ((ret = read(fd, buffer + total, SIZE - 1 - total)) > 0)) {
+        total += ret;
+    }
+    buffer[total] = 0;
+    close(fd);
+    return total;
+}
+
+int main(int argc, char *argv[])
+{
+    static char buffer[SIZE];
+    // The sections are only traced with ENABLE_LATENCY_TRACE, but the files
+    // are always there.
+    if (read_file("/proc/latency/irqsoff", buffer) <= 0) {
+        printf("/proc/latency/irqsoff must not be empty.\n");
+        return EXIT_FAILURE;
+    }
+    if (strstr(buffer, "without")) {
+        return EXIT_SUCCESS;
+    }
+    // Reading the file disabled the interrupts more than once.
+    if (strtol(buffer + 2, NULL, 10) <= 0) {
+        printf("No section with interrupts disabled was traced.\n");
+        return EXIT_FAILURE;
+    }
+    // Waking up from a sleep is a traced wake up.
+    timespec req = { .tv_sec = 0, .tv_nsec = 10000000 };
+    nanosleep(&req, NULL);
+    if ((read_file("/proc/latency/wakeup", buffer) <= 0) || (strtol(buffer + 2, NULL, 10) <= 0)) {
+        printf("The wake up from the sleep was not traced.\n");
+        return EXIT_FAILURE;
+    }
+    // Writing to the files clears the worst sections.
+    int fd = open("/proc/latency/irqsoff", O_WRONLY, 0);
+    if ((fd < 0) || (write(fd, "0\n", 2) != 2)) {
+        printf("Failed to reset /proc/latency/irqsoff: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    close(fd);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,99 @@
+/// @file t_madvise.c
+/// @brief Tests the memory hints: MAP_POPULATE, madvise and mlock.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strerror.h>
+#include <sys/errno.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+/// Number of pages of each mapping.
+#define NUM_PAGES 64
+/// Size of each mapping.
+#define MAP_SIZE (NUM_PAGES * 4096)
+/// Page faults allowed while touching memory which should be already mapped.
+#define FAULTS_SLACK 4
+
+/// @brief Writes every page of the buffer, and counts the page faults.
+/// @param buffer the buffer.
+/// @param value the value written.
+/// @return the number of page faults.
+static long touch_pages(char *buffer, char value)
+{
+    struct rusage before, after;
+    getrusage(RUSAGE_SELF, &before);
+    for (int i = 0; i < MAP_SIZE; i += 4096) {
+        buffer[i] = value;
+    }
+    getrusage(RUSAGE_SELF, &after);
+    return after.ru_minflt - before.ru_minflt;
+}
+
+int main(int argc, char *argv[])
+{
+    long faults;
+    // The pages of a populated mapping are already there.
+    char *populated = mmap(NULL, MAP_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (populated == NULL) {
+        printf("Failed to map the populated buffer.\n");
+        return EXIT_FAILURE;
+    }
+    if ((faults = touch_pages(populated, 'p')) > FAULTS_SLACK) {
+        printf("Touching a populated mapping caused %ld faults.\n", faults);
+        return EXIT_FAILURE;
+    }
+    // The pages given back read as zeros.
+    if (madvise(populated, MAP_SIZE, MADV_DONTNEED) < 0) {
+        printf("madvise(MADV_DONTNEED) failed: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    for (int i = 0; i < MAP_SIZE; ++i) {
+        if (populated[i] != 0) {
+            printf("A discarded page was not cleared.\n");
+            return EXIT_FAILURE;
+        }
+    }
+    // The access patterns are accepted, bad requests are not.
+    if ((madvise(populated, MAP_SIZE, MADV_SEQUENTIAL) < 0) || (madvise(populated, MAP_SIZE, MADV_WILLNEED) < 0) ||
+        (madvise(populated, MAP_SIZE, MADV_NORMAL) < 0)) {
+        printf("madvise failed: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    if ((madvise(populated + 1, 4096, MADV_NORMAL) != -1) || (errno != EINVAL)) {
+        printf("madvise on an unaligned address should fail with EINVAL.\n");
+        return EXIT_FAILURE;
+    }
+    if ((madvise(populated, MAP_SIZE, 42) != -1) || (errno != EINVAL)) {
+        printf("madvise with an unknown advice should fail with EINVAL.\n");
+        return EXIT_FAILURE;
+    }
+    // The pages of a locked mapping are there, and stay there.
+    char *locked = mmap(NULL, MAP_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (locked == NULL) {
+        printf("Failed to map the locked buffer.\n");
+        return EXIT_FAILURE;
+    }
+    if (mlock(locked, MAP_SIZE) < 0) {
+        printf("mlock failed: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    if ((faults = touch_pages(locked, 'l')) > FAULTS_SLACK) {
+        printf("Touching a locked mapping caused %ld faults.\n", faults);
+        return EXIT_FAILURE;
+    }
+    if ((madvise(locked, MAP_SIZE, MADV_DONTNEED) != -1) || (errno != EINVAL)) {
+        printf("Discarding locked pages should fail with EINVAL.\n");
+        return EXIT_FAILURE;
+    }
+    if (munlock(locked, MAP_SIZE) < 0) {
+        printf("munlock failed: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    munmap(locked, MAP_SIZE);
+    munmap(populated, MAP_SIZE);
+    return EXIT_SUCCESS;
+}
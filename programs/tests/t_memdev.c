@@ -0,0 +1,168 @@
+/// @file t_memdev.c
+/// @brief Tests the memory devices.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strerror.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/unistd.h>
+#include <sys/wait.h>
+
+/// Size of the buffers, not a multiple of a word.
+#define SIZE 4099
+
+/// @brief Checks that a buffer is all zeros.
+/// @param buffer the buffer.
+/// @param size the size of the buffer.
+/// @return 1 if it is all zeros, 0 otherwise.
+static int is_zero(const char *buffer, size_t size)
+{
+    for (size_t i = 0; i < size; ++i) {
+        if (buffer[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/// @brief Tests /dev/zero.
+/// @return 0 on success, 1 on failure.
+static int test_zero(void)
+{
+    static char buffer[SIZE + 1];
+    int fd = open("/dev/zero", O_RDWR, 0);
+    if (fd < 0) {
+        printf("Failed to open /dev/zero: %s\n", strerror(errno));
+        return 1;
+    }
+    // Reads at an unaligned address.
+    memset(buffer, 'x', sizeof(buffer));
+    if ((read(fd, buffer + 1, SIZE) != SIZE) || !is_zero(buffer + 1, SIZE) || (buffer[0] != 'x')) {
+        printf("Reading /dev/zero must return zeros.\n");
+        goto close_and_fail;
+    }
+    if (write(fd, buffer, SIZE) != SIZE) {
+        printf("Writing /dev/zero must succeed.\n");
+        goto close_and_fail;
+    }
+    // A private mapping is anonymous memory.
+    char *area = mmap(NULL, 2 * 4096, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (area == NULL) {
+        printf("Failed to map /dev/zero privately.\n");
+        goto close_and_fail;
+    }
+    if (!is_zero(area, 2 * 4096)) {
+        printf("A mapping of /dev/zero must read as zeros.\n");
+        goto close_and_fail;
+    }
+    area[4096] = 'a';
+    munmap(area, 2 * 4096);
+    // A shared mapping is seen by the children.
+    area = mmap(NULL, 4096, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (area == NULL) {
+        printf("Failed to map /dev/zero shared.\n");
+        goto close_and_fail;
+    }
+    if (!is_zero(area, 4096)) {
+        printf("A shared mapping of /dev/zero must read as zeros.\n");
+        goto close_and_fail;
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        area[0] = 'c';
+        exit(EXIT_SUCCESS);
+    }
+    waitpid(pid, NULL, 0);
+    if (area[0] != 'c') {
+        printf("A shared mapping of /dev/zero must be shared with the children.\n");
+        goto close_and_fail;
+    }
+    munmap(area, 4096);
+    close(fd);
+    return 0;
+
+close_and_fail:
+    close(fd);
+    return 1;
+}
+
+/// @brief Tests /dev/full.
+/// @return 0 on success, 1 on failure.
+static int test_full(void)
+{
+    static char buffer[SIZE];
+    int fd = open("/dev/full", O_RDWR, 0);
+    if (fd < 0) {
+        printf("Failed to open /dev/full: %s\n", strerror(errno));
+        return 1;
+    }
+    memset(buffer, 'x', sizeof(buffer));
+    if ((read(fd, buffer, SIZE) != SIZE) || !is_zero(buffer, SIZE)) {
+        printf("Reading /dev/full must return zeros.\n");
+        goto close_and_fail;
+    }
+    if ((write(fd, buffer, SIZE) != -1) || (errno != ENOSPC)) {
+        printf("Writing /dev/full must fail with ENOSPC.\n");
+        goto close_and_fail;
+    }
+    close(fd);
+    return 0;
+
+close_and_fail:
+    close(fd);
+    return 1;
+}
+
+/// @brief Tests /dev/urandom.
+/// @return 0 on success, 1 on failure.
+static int test_urandom(void)
+{
+    static unsigned char first[SIZE], second[SIZE];
+    unsigned counts[256] = { 0 };
+    int fd = open("/dev/urandom", O_RDWR, 0);
+    if (fd < 0) {
+        printf("Failed to open /dev/urandom: %s\n", strerror(errno));
+        return 1;
+    }
+    if ((read(fd, first, SIZE) != SIZE) || (read(fd, second, SIZE) != SIZE)) {
+        printf("Failed to read /dev/urandom: %s\n", strerror(errno));
+        goto close_and_fail;
+    }
+    if (!memcmp(first, second, SIZE)) {
+        printf("Two reads of /dev/urandom must differ.\n");
+        goto close_and_fail;
+    }
+    // Every value should show up, roughly SIZE / 256 times.
+    for (size_t i = 0; i < SIZE; ++i) {
+        ++counts[first[i]];
+    }
+    for (int i = 0; i < 256; ++i) {
+        if (counts[i] > SIZE / 32) {
+            printf("The value %d shows up %u times out of %d.\n", i, counts[i], SIZE);
+            goto close_and_fail;
+        }
+    }
+    // Writing mixes the data in, without making the output predictable.
+    if (write(fd, first, SIZE) != SIZE) {
+        printf("Writing /dev/urandom must succeed.\n");
+        goto close_and_fail;
+    }
+    close(fd);
+    return 0;
+
+close_and_fail:
+    close(fd);
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    if (test_zero() || test_full() || test_urandom()) {
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
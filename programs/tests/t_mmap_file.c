@@ -0,0 +1,80 @@
+/// @file t_mmap_file.c
+/// @brief Test mapping a file in memory.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strerror.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/unistd.h>
+
+/// The file we map.
+#define FILENAME "/home/user/t_mmap_file.txt"
+/// Size of the file, spanning more than one page.
+#define FILE_SIZE 6000
+
+int main(int argc, char *argv[])
+{
+    static char buffer[FILE_SIZE], content[FILE_SIZE];
+    char *map;
+    int fd;
+    // Create the file.
+    for (int i = 0; i < FILE_SIZE; ++i) {
+        buffer[i] = 'a' + (i % 26);
+    }
+    fd = open(FILENAME, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd < 0) {
+        printf("Failed to create file %s: %s\n", FILENAME, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    if (write(fd, buffer, FILE_SIZE) != FILE_SIZE) {
+        printf("Failed to write file %s: %s\n", FILENAME, strerror(errno));
+        goto close_and_fail;
+    }
+    // A read-only private mapping shows the content of the file.
+    map = mmap(NULL, FILE_SIZE, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == NULL) {
+        printf("Failed to map file %s: %s\n", FILENAME, strerror(errno));
+        goto close_and_fail;
+    }
+    if (memcmp(map, buffer, FILE_SIZE) != 0) {
+        printf("The private mapping does not match the file.\n");
+        goto close_and_fail;
+    }
+    // The rest of the last page reads as zeros.
+    for (int i = FILE_SIZE; i < 8192; ++i) {
+        if (map[i] != 0) {
+            printf("The mapping past the end of the file is not zeroed.\n");
+            goto close_and_fail;
+        }
+    }
+    munmap(map, FILE_SIZE);
+    // Writes through a shared mapping reach the file.
+    map = mmap(NULL, FILE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == NULL) {
+        printf("Failed to map file %s: %s\n", FILENAME, strerror(errno));
+        goto close_and_fail;
+    }
+    memset(map + 4090, 'Z', 10);
+    munmap(map, FILE_SIZE);
+    memset(buffer + 4090, 'Z', 10);
+    if ((lseek(fd, 0, SEEK_SET) != 0) || (read(fd, content, FILE_SIZE) != FILE_SIZE)) {
+        printf("Failed to read file %s: %s\n", FILENAME, strerror(errno));
+        goto close_and_fail;
+    }
+    if (memcmp(content, buffer, FILE_SIZE) != 0) {
+        printf("The writes through the shared mapping did not reach the file.\n");
+        goto close_and_fail;
+    }
+    close(fd);
+    unlink(FILENAME);
+    return EXIT_SUCCESS;
+close_and_fail:
+    close(fd);
+    unlink(FILENAME);
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,43 @@
+/// @file t_mouse.c
+/// @brief Tests the interface of the mouse device.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strerror.h>
+#include <sys/errno.h>
+#include <sys/mouse.h>
+#include <sys/unistd.h>
+
+int main(int argc, char *argv[])
+{
+    int fd = open(MOUSE_DEVICE, O_RDONLY | O_NONBLOCK, 0);
+    if (fd < 0) {
+        printf("open(%s): %s\n", MOUSE_DEVICE, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    mouse_event_t events[4];
+    int status = EXIT_FAILURE;
+    // Nobody moves the mouse while the tests run.
+    if ((read(fd, events, sizeof(events)) != -1) || (errno != EAGAIN)) {
+        printf("An empty device must fail with EAGAIN.\n");
+        goto close_device;
+    }
+    // Events are never split.
+    if ((read(fd, events, sizeof(mouse_event_t) - 1) != -1) || (errno != EINVAL)) {
+        printf("A buffer smaller than an event must fail with EINVAL.\n");
+        goto close_device;
+    }
+    struct pollfd pfd = { .fd = fd, .events = POLLIN, .revents = 0 };
+    if (poll(&pfd, 1, 0) != 0) {
+        printf("An empty device must not be readable.\n");
+        goto close_device;
+    }
+    status = EXIT_SUCCESS;
+close_device:
+    close(fd);
+    return status;
+}
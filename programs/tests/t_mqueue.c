@@ -0,0 +1,127 @@
+/// @file t_mqueue.c
+/// @brief Tests the priority order of POSIX message queues, and their
+/// notification.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <mqueue.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strerror.h>
+#include <string.h>
+#include <sys/errno.h>
+#include <sys/unistd.h>
+
+/// The name of the queue.
+#define QUEUE_NAME "/t_mqueue"
+/// The number of slots of the queue.
+#define QUEUE_MAXMSG 4
+/// The size of the slots of the queue.
+#define QUEUE_MSGSIZE 64
+
+/// The value sent with the notification, zero until it arrives.
+static volatile int notified;
+
+/// @brief Records the notification.
+/// @param sig the signal.
+/// @param info the details of the signal.
+static void notify_handler(int sig, siginfo_t *info)
+{
+    if ((info->si_code == SI_MESGQ) && (info->si_value.sival_int == 42)) {
+        notified = 1;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    // Sent in this order, received by priority and then in the same order.
+    static const struct {
+        const char *text;
+        unsigned int prio;
+    } sent[] = { { "low", 1 }, { "high-a", 5 }, { "mid", 3 }, { "high-b", 5 } };
+    static const int order[] = { 1, 3, 2, 0 };
+    struct mq_attr attr      = { 0, QUEUE_MAXMSG, QUEUE_MSGSIZE, 0 };
+    char buffer[QUEUE_MSGSIZE];
+    unsigned int prio;
+    mqd_t mqd;
+    mq_unlink(QUEUE_NAME);
+    if ((mqd = mq_open(QUEUE_NAME, O_RDWR | O_CREAT | O_EXCL | O_NONBLOCK, 0600, &attr)) < 0) {
+        printf("Failed to create the queue: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    // An empty queue has nothing to receive.
+    if ((mq_receive(mqd, buffer, sizeof(buffer), &prio) != -1) || (errno != EAGAIN)) {
+        printf("Receiving from the empty queue should fail with EAGAIN.\n");
+        goto unlink_and_fail;
+    }
+    for (int i = 0; i < QUEUE_MAXMSG; ++i) {
+        if (mq_send(mqd, sent[i].text, strlen(sent[i].text) + 1, sent[i].prio) < 0) {
+            printf("Failed to send `%s`: %s\n", sent[i].text, strerror(errno));
+            goto unlink_and_fail;
+        }
+    }
+    // A full queue has no room left.
+    if ((mq_send(mqd, "extra", 6, 0) != -1) || (errno != EAGAIN)) {
+        printf("Sending to the full queue should fail with EAGAIN.\n");
+        goto unlink_and_fail;
+    }
+    if ((mq_getattr(mqd, &attr) < 0) || (attr.mq_curmsgs != QUEUE_MAXMSG) || (attr.mq_flags != O_NONBLOCK)) {
+        printf("The attributes should report a full, non-blocking queue.\n");
+        goto unlink_and_fail;
+    }
+    for (int i = 0; i < QUEUE_MAXMSG; ++i) {
+        ssize_t size = mq_receive(mqd, buffer, sizeof(buffer), &prio);
+        if ((size != (ssize_t)strlen(sent[order[i]].text) + 1) || strcmp(buffer, sent[order[i]].text) ||
+            (prio != sent[order[i]].prio)) {
+            printf("Received `%s` (%u), expected `%s` (%u).\n", (size > 0) ? buffer : "", prio,
+                   sent[order[i]].text, sent[order[i]].prio);
+            goto unlink_and_fail;
+        }
+    }
+    // A message arriving on the empty queue is notified once.
+    sigaction_t action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = (sighandler_t)notify_handler;
+    action.sa_flags   = SA_SIGINFO;
+    if (sigaction(SIGUSR1, &action, NULL) < 0) {
+        printf("Failed to set the signal handler: %s\n", strerror(errno));
+        goto unlink_and_fail;
+    }
+    struct sigevent sev;
+    sev.sigev_notify          = SIGEV_SIGNAL;
+    sev.sigev_signo           = SIGUSR1;
+    sev.sigev_value.sival_int = 42;
+    if (mq_notify(mqd, &sev) < 0) {
+        printf("Failed to register for the notification: %s\n", strerror(errno));
+        goto unlink_and_fail;
+    }
+    if ((mq_notify(mqd, &sev) != -1) || (errno != EBUSY)) {
+        printf("Registering twice should fail with EBUSY.\n");
+        goto unlink_and_fail;
+    }
+    mq_send(mqd, "wake", 5, 0);
+    if (!notified) {
+        printf("The arrival of the message was not notified.\n");
+        goto unlink_and_fail;
+    }
+    // The registration was removed by the notification.
+    if (mq_notify(mqd, &sev) < 0) {
+        printf("The notification should be free again: %s\n", strerror(errno));
+        goto unlink_and_fail;
+    }
+    mq_close(mqd);
+    if (mq_unlink(QUEUE_NAME) < 0) {
+        printf("Failed to remove the queue: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    if ((mq_open(QUEUE_NAME, O_RDWR) != -1) || (errno != ENOENT)) {
+        printf("The removed queue should not be found.\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+unlink_and_fail:
+    mq_close(mqd);
+    mq_unlink(QUEUE_NAME);
+    return EXIT_FAILURE;
+}
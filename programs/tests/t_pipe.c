@@ -0,0 +1,155 @@
+/// @file t_pipe.c
+/// @brief Tests the pipes, between processes and on the standard streams.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <sys/unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strerror.h>
+#include <sys/errno.h>
+#include <sys/wait.h>
+
+/// The amount of bytes streamed, more than the buffer of a pipe holds.
+#define STREAM_SIZE (64 * 1024)
+/// The size of the chunks written by the child.
+#define CHUNK_SIZE 1000
+
+/// @brief Returns the byte expected at a position of the stream.
+/// @param pos the position.
+/// @return the byte.
+static inline char __stream_byte(int pos)
+{
+    return (char)('a' + (pos % 26));
+}
+
+/// @brief Streams bytes from a child, and checks the end of file.
+/// @return 0 on success, 1 on failure.
+static int test_stream(void)
+{
+    char buffer[CHUNK_SIZE];
+    int fds[2];
+    if (pipe(fds) < 0) {
+        printf("Failed to create the pipe: %s\n", strerror(errno));
+        return 1;
+    }
+    if (!fork()) {
+        close(fds[0]);
+        for (int pos = 0; pos < STREAM_SIZE;) {
+            int size = (STREAM_SIZE - pos < CHUNK_SIZE) ? STREAM_SIZE - pos : CHUNK_SIZE;
+            for (int i = 0; i < size; ++i) {
+                buffer[i] = __stream_byte(pos + i);
+            }
+            // The chunks fit PIPE_BUF, thus they are written whole.
+            if (write(fds[1], buffer, size) != size) {
+                exit(EXIT_FAILURE);
+            }
+            pos += size;
+        }
+        // Exiting closes the write end.
+        exit(EXIT_SUCCESS);
+    }
+    close(fds[1]);
+    int pos = 0;
+    ssize_t nread;
+    while ((nread = read(fds[0], buffer, sizeof(buffer))) > 0) {
+        for (ssize_t i = 0; i < nread; ++i, ++pos) {
+            if (buffer[i] != __stream_byte(pos)) {
+                printf("Wrong byte at %d.\n", pos);
+                return 1;
+            }
+        }
+    }
+    if (nread < 0) {
+        printf("Failed to read the pipe: %s\n", strerror(errno));
+        return 1;
+    }
+    if (pos != STREAM_SIZE) {
+        printf("Read %d bytes instead of %d.\n", pos, STREAM_SIZE);
+        return 1;
+    }
+    close(fds[0]);
+    int status;
+    wait(&status);
+    if (WEXITSTATUS(status) != EXIT_SUCCESS) {
+        printf("The writer failed.\n");
+        return 1;
+    }
+    return 0;
+}
+
+/// @brief Makes a child write on its standard output, redirected on a pipe.
+/// @return 0 on success, 1 on failure.
+static int test_dup2(void)
+{
+    const char message[] = "through the standard output";
+    char buffer[sizeof(message)];
+    int fds[2];
+    if (pipe(fds) < 0) {
+        printf("Failed to create the pipe: %s\n", strerror(errno));
+        return 1;
+    }
+    if (!fork()) {
+        if (dup2(fds[1], STDOUT_FILENO) != STDOUT_FILENO) {
+            exit(EXIT_FAILURE);
+        }
+        close(fds[0]);
+        close(fds[1]);
+        write(STDOUT_FILENO, message, sizeof(message));
+        exit(EXIT_SUCCESS);
+    }
+    close(fds[1]);
+    size_t got = 0;
+    ssize_t nread;
+    while ((got < sizeof(buffer)) && ((nread = read(fds[0], buffer + got, sizeof(buffer) - got)) > 0)) {
+        got += nread;
+    }
+    close(fds[0]);
+    wait(NULL);
+    if ((got != sizeof(message)) || strcmp(buffer, message)) {
+        printf("The redirected output was not received.\n");
+        return 1;
+    }
+    return 0;
+}
+
+/// @brief Checks the errors, without readers and on a non-blocking pipe.
+/// @return 0 on success, 1 on failure.
+static int test_errors(void)
+{
+    char c = 'x';
+    int fds[2];
+    if (pipe2(fds, O_NONBLOCK) < 0) {
+        printf("Failed to create the pipe: %s\n", strerror(errno));
+        return 1;
+    }
+    if ((read(fds[0], &c, 1) != -1) || (errno != EAGAIN)) {
+        printf("Reading an empty non-blocking pipe did not fail with EAGAIN.\n");
+        return 1;
+    }
+    if (lseek(fds[0], 0, SEEK_SET) != -1) {
+        printf("Seeking a pipe did not fail.\n");
+        return 1;
+    }
+    close(fds[0]);
+    // Without readers, the writer gets SIGPIPE, which we ignore, and EPIPE.
+    signal(SIGPIPE, SIG_IGN);
+    if ((write(fds[1], &c, 1) != -1) || (errno != EPIPE)) {
+        printf("Writing a pipe without readers did not fail with EPIPE.\n");
+        return 1;
+    }
+    close(fds[1]);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if (test_stream() || test_dup2() || test_errors()) {
+        return EXIT_FAILURE;
+    }
+    printf("Pipes work.\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,150 @@
+/// @file t_poll.c
+/// @brief Tests poll and select on pipes.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <sys/unistd.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strerror.h>
+#include <sys/errno.h>
+#include <sys/select.h>
+#include <sys/wait.h>
+#include <time.h>
+
+/// @brief Checks the readiness of the ends of a pipe, without waiting.
+/// @return 0 on success, 1 on failure.
+static int test_ready(void)
+{
+    struct pollfd pfds[2];
+    char c = 'x';
+    int fds[2];
+    if (pipe(fds) < 0) {
+        printf("Failed to create the pipe: %s\n", strerror(errno));
+        return 1;
+    }
+    pfds[0].fd     = fds[0];
+    pfds[0].events = POLLIN;
+    pfds[1].fd     = fds[1];
+    pfds[1].events = POLLOUT;
+    // Only the write end is ready.
+    if ((poll(pfds, 2, 0) != 1) || (pfds[0].revents != 0) || (pfds[1].revents != POLLOUT)) {
+        printf("An empty pipe should only be writable.\n");
+        return 1;
+    }
+    write(fds[1], &c, 1);
+    if ((poll(pfds, 2, 0) != 2) || (pfds[0].revents != POLLIN)) {
+        printf("A pipe with data should be readable.\n");
+        return 1;
+    }
+    read(fds[0], &c, 1);
+    // Once the writer is gone, the reader sees the hang up.
+    close(fds[1]);
+    if ((poll(pfds, 1, 0) != 1) || (pfds[0].revents != POLLHUP)) {
+        printf("A pipe without writers should report POLLHUP.\n");
+        return 1;
+    }
+    close(fds[0]);
+    // A closed descriptor is reported as invalid.
+    if ((poll(pfds, 1, 0) != 1) || (pfds[0].revents != POLLNVAL)) {
+        printf("A closed descriptor should report POLLNVAL.\n");
+        return 1;
+    }
+    return 0;
+}
+
+/// @brief Waits for a child writing a pipe, then for a timeout.
+/// @return 0 on success, 1 on failure.
+static int test_wait(void)
+{
+    struct pollfd pfd;
+    char c = 'x';
+    int fds[2];
+    if (pipe(fds) < 0) {
+        printf("Failed to create the pipe: %s\n", strerror(errno));
+        return 1;
+    }
+    if (!fork()) {
+        close(fds[0]);
+        sleep(1);
+        write(fds[1], &c, 1);
+        exit(EXIT_SUCCESS);
+    }
+    close(fds[1]);
+    pfd.fd     = fds[0];
+    pfd.events = POLLIN;
+    // Sleep until the child writes.
+    if ((poll(&pfd, 1, -1) != 1) || !(pfd.revents & POLLIN)) {
+        printf("Failed to wait for the data: %s\n", strerror(errno));
+        return 1;
+    }
+    read(fds[0], &c, 1);
+    wait(NULL);
+    // The child exited, leaving only the hang up.
+    if ((poll(&pfd, 1, 100) != 1) || (pfd.revents != POLLHUP)) {
+        printf("A pipe without writers should report POLLHUP.\n");
+        return 1;
+    }
+    close(fds[0]);
+    // Nothing ever happens on a fresh empty pipe, the time expires.
+    pipe(fds);
+    pfd.fd = fds[0];
+    if (poll(&pfd, 1, 50) != 0) {
+        printf("Polling an empty pipe should time out.\n");
+        return 1;
+    }
+    close(fds[0]);
+    close(fds[1]);
+    return 0;
+}
+
+/// @brief Checks select on the ends of a pipe.
+/// @return 0 on success, 1 on failure.
+static int test_select(void)
+{
+    fd_set rfds, wfds;
+    timeval timeout;
+    char c = 'x';
+    int fds[2];
+    if (pipe(fds) < 0) {
+        printf("Failed to create the pipe: %s\n", strerror(errno));
+        return 1;
+    }
+    FD_ZERO(&rfds);
+    FD_ZERO(&wfds);
+    FD_SET(fds[0], &rfds);
+    timeout.tv_sec  = 0;
+    timeout.tv_usec = 50000;
+    // Nothing to read, the time expires and the set is emptied.
+    if ((select(fds[1] + 1, &rfds, NULL, NULL, &timeout) != 0) || FD_ISSET(fds[0], &rfds)) {
+        printf("Selecting an empty pipe should time out.\n");
+        return 1;
+    }
+    write(fds[1], &c, 1);
+    FD_SET(fds[0], &rfds);
+    FD_SET(fds[1], &wfds);
+    if ((select(fds[1] + 1, &rfds, &wfds, NULL, NULL) != 2) || !FD_ISSET(fds[0], &rfds) || !FD_ISSET(fds[1], &wfds)) {
+        printf("Both ends should be ready.\n");
+        return 1;
+    }
+    close(fds[0]);
+    close(fds[1]);
+    // A closed descriptor fails.
+    FD_ZERO(&rfds);
+    FD_SET(fds[0], &rfds);
+    if ((select(fds[0] + 1, &rfds, NULL, NULL, NULL) != -1) || (errno != EBADF)) {
+        printf("Selecting a closed descriptor should fail with EBADF.\n");
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if (test_ready() || test_wait() || test_select()) {
+        return EXIT_FAILURE;
+    }
+    printf("Poll and select work.\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,67 @@
+/// @file t_proc_stat.c
+/// @brief Tests that the CPU counts its idle time, inside /proc/stat.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/unistd.h>
+#include <time.h>
+
+/// @brief Reads the times of all the CPUs, from the first line of /proc/stat.
+/// @param user where to store the ticks spent in user mode.
+/// @param system where to store the ticks spent in the kernel.
+/// @param idle where to store the ticks spent idle.
+/// @return 0 on success, 1 on failure.
+static int read_stat(unsigned long *user, unsigned long *system, unsigned long *idle)
+{
+    char buffer[256], *it;
+    unsigned long times[4];
+    int fd = open("/proc/stat", O_RDONLY, 0);
+    if (fd < 0) {
+        perror("open");
+        return 1;
+    }
+    ssize_t length = read(fd, buffer, sizeof(buffer) - 1);
+    close(fd);
+    if (length <= 0) {
+        printf("Failed to read /proc/stat.\n");
+        return 1;
+    }
+    buffer[length] = 0;
+    if (strncmp(buffer, "cpu ", 4)) {
+        printf("Unexpected /proc/stat: %s\n", buffer);
+        return 1;
+    }
+    // user, nice, system, idle.
+    it = buffer + 4;
+    for (int i = 0; i < 4; ++i) {
+        times[i] = (unsigned long)strtol(it, &it, 10);
+    }
+    *user   = times[0];
+    *system = times[2];
+    *idle   = times[3];
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned long user[2], system[2], idle[2];
+    if (read_stat(&user[0], &system[0], &idle[0])) {
+        return EXIT_FAILURE;
+    }
+    // Nothing runs while we sleep, the CPU idles.
+    sleep(1);
+    if (read_stat(&user[1], &system[1], &idle[1])) {
+        return EXIT_FAILURE;
+    }
+    if ((idle[1] <= idle[0]) || (user[1] < user[0]) || (system[1] < system[0])) {
+        printf("The idle time did not grow: %lu -> %lu.\n", idle[0], idle[1]);
+        return EXIT_FAILURE;
+    }
+    printf("Idle for %lu ticks out of %lu.\n", idle[1] - idle[0],
+           (user[1] + system[1] + idle[1]) - (user[0] + system[0] + idle[0]));
+    return EXIT_SUCCESS;
+}
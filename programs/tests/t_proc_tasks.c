@@ -0,0 +1,67 @@
+/// @file t_proc_tasks.c
+/// @brief Tests reading the snapshot of the tasks from `/proc/tasks`.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <sys/unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strerror.h>
+#include <sys/errno.h>
+#include <sys/tasks.h>
+#include <sys/wait.h>
+#include <time.h>
+
+/// @brief Reads the snapshot, one record at a time, and searches a task.
+/// @param pid the task to search.
+/// @param record where the record of the task is stored.
+/// @return 1 if the task is in the snapshot, 0 if not, -1 on failure.
+static int find_task(pid_t pid, task_record_t *record)
+{
+    int fd = open("/proc/tasks", O_RDONLY, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    int found = 0;
+    ssize_t ret;
+    // Reads after the first one continue the same snapshot.
+    while ((ret = read(fd, record, sizeof(task_record_t))) == sizeof(task_record_t)) {
+        if (record->pid == pid) {
+            found = 1;
+            break;
+        }
+    }
+    close(fd);
+    return (ret < 0) ? -1 : found;
+}
+
+int main(int argc, char *argv[])
+{
+    task_record_t record;
+    if (find_task(getpid(), &record) != 1) {
+        printf("Failed to find ourselves: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    if ((record.state != 'R') || (record.ppid != getppid()) || (record.sid != getsid(0))) {
+        printf("Wrong record for ourselves: state %c, ppid %d.\n", record.state, record.ppid);
+        return EXIT_FAILURE;
+    }
+    // A sleeping child is in the snapshot, until it is reaped.
+    pid_t cpid = fork();
+    if (cpid == 0) {
+        sleep(1);
+        exit(EXIT_SUCCESS);
+    }
+    if ((find_task(cpid, &record) != 1) || (record.ppid != getpid())) {
+        printf("Failed to find the child.\n");
+        return EXIT_FAILURE;
+    }
+    waitpid(cpid, NULL, 0);
+    if (find_task(cpid, &record) != 0) {
+        printf("The child should be gone once reaped.\n");
+        return EXIT_FAILURE;
+    }
+    printf("Reading /proc/tasks works.\n");
+    return EXIT_SUCCESS;
+}
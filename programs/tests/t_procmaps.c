@@ -0,0 +1,111 @@
+/// @file t_procmaps.c
+/// @brief Tests the memory areas listed by /proc/<PID>/maps and /proc/<PID>/smaps.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/unistd.h>
+#include <sys/wait.h>
+
+/// Number of pages of the mapping.
+#define NUM_PAGES 4
+/// Number of pages written.
+#define NUM_DIRTY 2
+/// Size of the buffer holding a file.
+#define SIZE 8192
+
+/// @brief Reads a file of the calling process, inside /proc/<PID>.
+/// @param name the name of the file.
+/// @param buffer the buffer.
+/// @return the number of bytes read, -1 on failure.
+static ssize_t read_file(const char *name, char *buffer)
+{
+    char path[64];
+    ssize_t total = 0, ret;
+    sprintf(path, "/proc/%d/%s", getpid(), name);
+    int fd = open(path, O_RDONLY, 0);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    while ((total < SIZE - 1) && ((ret = read(fd, buffer + total, SIZE - 1 - total)) > 0)) {
+        total += ret;
+    }
+    buffer[total] = 0;
+    close(fd);
+    return total;
+}
+
+/// @brief Finds a field of the area starting at the given address, inside smaps.
+/// @param buffer the content of smaps.
+/// @param start the start of the area.
+/// @param field the name of the field, with its colon.
+/// @return the value in kilobytes, -1 if missing.
+static long smaps_field(const char *buffer, void *start, const char *field)
+{
+    char key[16];
+    sprintf(key, "%08x-", (unsigned)start);
+    const char *area = strstr(buffer, key);
+    if (area == NULL) {
+        return -1;
+    }
+    const char *line = strstr(area, field);
+    return line ? strtol(line + strlen(field), NULL, 10) : -1;
+}
+
+int main(int argc, char *argv[])
+{
+    static char buffer[SIZE];
+    char key[16];
+    char *area = mmap(NULL, NUM_PAGES * 4096, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (area == NULL) {
+        printf("Failed to map the area.\n");
+        return EXIT_FAILURE;
+    }
+    for (int i = 0; i < NUM_DIRTY; ++i) {
+        area[i * 4096] = 'd';
+    }
+    // The area is listed, readable, writable and private.
+    sprintf(key, "%08x-", (unsigned)area);
+    if ((read_file("maps", buffer) <= 0) || !strstr(buffer, key) || strncmp(strstr(buffer, key) + 18, "rw", 2) ||
+        (strstr(buffer, key)[21] != 'p')) {
+        printf("The area is missing from maps, or has the wrong permissions.\n");
+        return EXIT_FAILURE;
+    }
+    // Only the written pages are there, and they are ours.
+    if ((read_file("smaps", buffer) <= 0) ||
+        (smaps_field(buffer, area, "Rss:") != NUM_DIRTY * 4) ||
+        (smaps_field(buffer, area, "Private_Dirty:") != NUM_DIRTY * 4)) {
+        printf("The written pages must be resident and private.\n");
+        return EXIT_FAILURE;
+    }
+    // After a fork, the pages are shared with the child, until written.
+    int fds[2];
+    if (pipe(fds) < 0) {
+        perror("pipe");
+        return EXIT_FAILURE;
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        char c;
+        close(fds[1]);
+        read(fds[0], &c, 1);
+        exit(EXIT_SUCCESS);
+    }
+    close(fds[0]);
+    int status = EXIT_SUCCESS;
+    if ((read_file("smaps", buffer) <= 0) ||
+        (smaps_field(buffer, area, "Shared_Dirty:") != NUM_DIRTY * 4) ||
+        (smaps_field(buffer, area, "Cow_Shared:") != NUM_DIRTY * 4)) {
+        printf("The pages must be shared with the child, copy on write.\n");
+        status = EXIT_FAILURE;
+    }
+    write(fds[1], "x", 1);
+    close(fds[1]);
+    waitpid(pid, NULL, 0);
+    return status;
+}
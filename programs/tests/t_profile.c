@@ -0,0 +1,114 @@
+/// @file t_profile.c
+/// @brief Tests the performance counters of the tasks, and the sampling
+/// profiler of `/proc/profile`.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <sys/unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strerror.h>
+#include <sys/errno.h>
+
+/// @brief Keeps the CPU busy in user mode.
+static void burn_cpu(void)
+{
+    volatile unsigned counter = 0;
+    for (unsigned i = 0; i < 50000000; ++i) {
+        ++counter;
+    }
+}
+
+/// @brief Writes a command to the profiler.
+/// @param command the text.
+/// @return 0 on success, -1 on failure with errno set.
+static int profiler_write(const char *command)
+{
+    int fd = open("/proc/profile", O_WRONLY, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    ssize_t ret = write(fd, command, strlen(command));
+    close(fd);
+    return (ret < 0) ? -1 : 0;
+}
+
+/// @brief Reads a whole file in a static buffer.
+/// @param path the file.
+/// @return the text, or NULL on failure.
+static char *read_file(const char *path)
+{
+    static char buffer[128 * 1024];
+    int fd = open(path, O_RDONLY, 0);
+    if (fd < 0) {
+        return NULL;
+    }
+    size_t length = 0;
+    ssize_t ret;
+    while ((length < sizeof(buffer) - 1) && ((ret = read(fd, buffer + length, sizeof(buffer) - 1 - length)) > 0)) {
+        length += ret;
+    }
+    close(fd);
+    buffer[length] = 0;
+    return buffer;
+}
+
+int main(int argc, char *argv[])
+{
+    char path[32], line[32];
+    if ((profiler_write("10x\n") != -1) || (errno != EINVAL)) {
+        printf("A malformed period should fail with EINVAL.\n");
+        return EXIT_FAILURE;
+    }
+    if (profiler_write("100000\n") < 0) {
+        // Emulators often lack the counters.
+        if (errno == ENODEV) {
+            printf("The CPU has no performance counters, skipping.\n");
+            return EXIT_SUCCESS;
+        }
+        printf("Failed to start the profiler: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    burn_cpu();
+    if (profiler_write("0\n") < 0) {
+        printf("Failed to stop the profiler: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    char *text = read_file("/proc/profile");
+    unsigned period, samples;
+    if (!text || (sscanf(text, "# period %u samples %u", &period, &samples) != 2) || (period != 0) || (samples == 0)) {
+        printf("The profiler took no samples.\n");
+        return EXIT_FAILURE;
+    }
+    // The loop ran in user mode, some samples must point into it.
+    sprintf(line, "\n%d 0x", getpid());
+    char *it = text;
+    while ((it = strstr(it, line)) != NULL) {
+        it += strlen(line) + 8;
+        if (*(++it) == 'u') {
+            break;
+        }
+    }
+    if (it == NULL) {
+        printf("No sample of ourselves in user mode.\n");
+        return EXIT_FAILURE;
+    }
+    // The same loop retired at least one instruction per iteration, if the
+    // CPU counts them.
+    sprintf(path, "/proc/%d/pmu", getpid());
+    if ((text = read_file(path)) == NULL) {
+        printf("Failed to read %s: %s\n", path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    unsigned instructions = 0;
+    if ((it = strstr(text, "instructions ")) != NULL) {
+        if ((sscanf(it, "instructions %u", &instructions) != 1) || (instructions < 50000000)) {
+            printf("Too few instructions counted: %u.\n", instructions);
+            return EXIT_FAILURE;
+        }
+    }
+    printf("The profiler works.\n");
+    return EXIT_SUCCESS;
+}
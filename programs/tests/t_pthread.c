@@ -0,0 +1,82 @@
+/// @file t_pthread.c
+/// @brief Tests the threads sharing the memory and the open files.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <sys/unistd.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// The number of threads.
+#define THREADS 4
+/// The increments done by each thread.
+#define INCREMENTS 1000
+
+/// The counter incremented by the threads.
+static volatile int counter;
+/// Protects the counter.
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+/// The pipe created by a thread.
+static int fds[2];
+
+/// @brief Increments the counter, and returns its own identifier.
+/// @param arg unused.
+/// @return the identifier of the thread.
+static void *increment(void *arg)
+{
+    for (int i = 0; i < INCREMENTS; ++i) {
+        pthread_mutex_lock(&lock);
+        counter = counter + 1;
+        pthread_mutex_unlock(&lock);
+    }
+    return pthread_self();
+}
+
+/// @brief Creates a pipe, and exits from the middle of the function.
+/// @param arg unused.
+/// @return never returns.
+static void *open_pipe(void *arg)
+{
+    pipe(fds);
+    pthread_exit(arg);
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    pthread_t threads[THREADS];
+    void *retval;
+    char buffer[4] = { 0 };
+    for (int i = 0; i < THREADS; ++i) {
+        if (pthread_create(&threads[i], NULL, increment, NULL)) {
+            printf("Failed to create thread %d.\n", i);
+            return EXIT_FAILURE;
+        }
+    }
+    for (int i = 0; i < THREADS; ++i) {
+        pthread_join(threads[i], &retval);
+        // Each thread sees its own descriptor through its segment.
+        if (retval != threads[i]) {
+            printf("Thread %d has the wrong identifier.\n", i);
+            return EXIT_FAILURE;
+        }
+    }
+    if (counter != THREADS * INCREMENTS) {
+        printf("The counter is %d instead of %d.\n", counter, THREADS * INCREMENTS);
+        return EXIT_FAILURE;
+    }
+    // The descriptors opened by a thread belong to everybody.
+    pthread_create(&threads[0], NULL, open_pipe, (void *)fds);
+    pthread_join(threads[0], &retval);
+    if ((retval != (void *)fds) || (write(fds[1], "abc", 3) != 3) || (read(fds[0], buffer, 3) != 3) ||
+        strcmp(buffer, "abc")) {
+        printf("The pipe created by the thread is not shared.\n");
+        return EXIT_FAILURE;
+    }
+    close(fds[0]);
+    close(fds[1]);
+    printf("Threads work.\n");
+    return EXIT_SUCCESS;
+}
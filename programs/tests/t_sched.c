@@ -0,0 +1,61 @@
+/// @file t_sched.c
+/// @brief Test the scheduling policies.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strerror.h>
+#include <sys/unistd.h>
+#include <sys/wait.h>
+
+int main(int argc, char *argv[])
+{
+    sched_param_t param;
+    pid_t cpid;
+
+    sched_getparam(getpid(), &param);
+    // Unknown policies are refused.
+    if ((sched_setscheduler(0, 42, &param) != -1) || (errno != EINVAL)) {
+        printf("Setting an unknown policy did not fail with EINVAL.\n");
+        return EXIT_FAILURE;
+    }
+    if (sched_setscheduler(0, SCHED_OTHER, &param) < 0) {
+        printf("Failed to set SCHED_OTHER: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    if (sched_getscheduler(0) != SCHED_OTHER) {
+        printf("The policy is %d instead of SCHED_OTHER.\n", sched_getscheduler(0));
+        return EXIT_FAILURE;
+    }
+
+    // The child keeps the CPU busy.
+    if ((cpid = fork()) == 0) {
+        while (1) {}
+    }
+    if (cpid < 0) {
+        printf("Failed to fork: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    // The policy is inherited.
+    if (sched_getscheduler(cpid) != SCHED_OTHER) {
+        printf("The child did not inherit SCHED_OTHER.\n");
+        kill(cpid, SIGTERM);
+        return EXIT_FAILURE;
+    }
+    // Once idle, the child runs only while we sleep.
+    if ((sched_setscheduler(cpid, SCHED_IDLE, &param) < 0) || (sched_getscheduler(cpid) != SCHED_IDLE)) {
+        printf("Failed to set SCHED_IDLE: %s\n", strerror(errno));
+        kill(cpid, SIGTERM);
+        return EXIT_FAILURE;
+    }
+    sleep(1);
+    kill(cpid, SIGTERM);
+    if (waitpid(cpid, NULL, 0) != cpid) {
+        printf("Failed to wait the child: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -4,8 +4,11 @@
 /// See LICENSE.md for details.
 
 #include <sys/unistd.h>
+#include <sys/schedfb.h>
 #include <sys/wait.h>
+#include <fcntl.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 int main(int argc, char *argv[])
 {
@@ -18,5 +21,27 @@ int main(int argc, char *argv[])
         }
     }
     while (wait(NULL) != -1) continue;
-    return 0;
+    // The statistics are recorded only if the kernel was built with them, but
+    // the file must always hold whole records.
+    int fd = open("/proc/feedback", O_RDONLY, 0);
+    if (fd < 0) {
+        perror("Failed to open /proc/feedback");
+        return EXIT_FAILURE;
+    }
+    schedfb_record_t records[64];
+    ssize_t length;
+    while ((length = read(fd, records, sizeof(records))) > 0) {
+        if (length % sizeof(schedfb_record_t)) {
+            printf("Read a partial record from /proc/feedback.\n");
+            return EXIT_FAILURE;
+        }
+        for (size_t i = 0; i < length / sizeof(schedfb_record_t); ++i) {
+            if (records[i].occur > records[i].total) {
+                printf("Task %d picked %u times out of %u.\n", records[i].pid, records[i].occur, records[i].total);
+                return EXIT_FAILURE;
+            }
+        }
+    }
+    close(fd);
+    return (length < 0) ? EXIT_FAILURE : EXIT_SUCCESS;
 }
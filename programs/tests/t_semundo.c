@@ -0,0 +1,81 @@
+/// @file t_semundo.c
+/// @brief Tests arrays of semaphore operations, and SEM_UNDO.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strerror.h>
+#include <sys/errno.h>
+#include <sys/ipc.h>
+#include <sys/sem.h>
+#include <sys/unistd.h>
+#include <sys/wait.h>
+#include <time.h>
+
+int main(int argc, char *argv[])
+{
+    struct sembuf both[2] = {
+        { .sem_num = 0, .sem_op = -1, .sem_flg = 0 },
+        { .sem_num = 1, .sem_op = -1, .sem_flg = 0 },
+    };
+    struct sembuf post = { .sem_num = 1, .sem_op = 2, .sem_flg = SEM_UNDO };
+    int status;
+    int semid = semget(IPC_PRIVATE, 2, IPC_CREAT | S_IRUSR | S_IWUSR);
+    if (semid < 0) {
+        printf("Failed to create the semaphore set: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    union semun arg = { .val = 1 };
+    if (semctl(semid, 0, SETVAL, &arg) < 0) {
+        printf("Failed to set the semaphore: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    // Only the first semaphore is available, the array cannot complete, and
+    // must not take it.
+    both[0].sem_flg = IPC_NOWAIT;
+    if ((semop(semid, both, 2) != -1) || (errno != EAGAIN)) {
+        printf("The array completed without the second semaphore.\n");
+        return EXIT_FAILURE;
+    }
+    if (semctl(semid, 0, GETVAL, NULL) != 1) {
+        printf("The failed array changed the first semaphore.\n");
+        return EXIT_FAILURE;
+    }
+    both[0].sem_flg = 0;
+    if (!fork()) {
+        // Sleep until the parent posts the second semaphore.
+        if (semop(semid, both, 2) < 0) {
+            exit(EXIT_FAILURE);
+        }
+        exit(EXIT_SUCCESS);
+    }
+    // Wait for the child to sleep on the second semaphore.
+    while (semctl(semid, 1, GETNCNT, NULL) != 1) {
+        sleep(0);
+    }
+    if (!fork()) {
+        // Post it, and let the exit undo what is left of the post.
+        semop(semid, &post, 1);
+        exit(EXIT_SUCCESS);
+    }
+    for (int n = 0; n < 2; n++) {
+        wait(&status);
+        if (WEXITSTATUS(status) != EXIT_SUCCESS) {
+            printf("The waiting array failed.\n");
+            return EXIT_FAILURE;
+        }
+    }
+    // The array took one of the two posted, the exit took back both, and the
+    // value does not go below zero.
+    if ((semctl(semid, 0, GETVAL, NULL) != 0) || (semctl(semid, 1, GETVAL, NULL) != 0)) {
+        printf("Wrong values after the exit: %ld %ld\n", semctl(semid, 0, GETVAL, NULL), semctl(semid, 1, GETVAL, NULL));
+        return EXIT_FAILURE;
+    }
+    if (semctl(semid, 0, IPC_RMID, NULL) < 0) {
+        printf("Failed to remove the semaphore set: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
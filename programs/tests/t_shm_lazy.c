@@ -0,0 +1,79 @@
+/// @file t_shm_lazy.c
+/// @brief Tests a large shared memory segment, shared with a child process.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <sys/unistd.h>
+#include <sys/wait.h>
+
+/// Size of the segment, larger than any block of contiguous pages.
+#define SEGMENT_SIZE (8 * 1024 * 1024)
+/// Distance between the bytes written by the child.
+#define STRIDE (256 * 1024)
+
+int main(int argc, char *argv[])
+{
+    int shmid, status;
+    char *segment;
+    // Create the segment, no page is allocated yet.
+    shmid = shmget(IPC_PRIVATE, SEGMENT_SIZE, IPC_CREAT | 0600);
+    if (shmid < 0) {
+        perror("shmget");
+        return EXIT_FAILURE;
+    }
+    segment = (char *)shmat(shmid, NULL, 0);
+    if (segment == (char *)-1) {
+        perror("shmat");
+        return EXIT_FAILURE;
+    }
+    // The pages never touched read as zeros.
+    if (segment[SEGMENT_SIZE / 2] != 0) {
+        printf("A fresh page of the segment is not zeroed.\n");
+        return EXIT_FAILURE;
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        // The child inherits the attachment, and writes through it.
+        for (int offset = 0; offset < SEGMENT_SIZE; offset += STRIDE) {
+            segment[offset] = (char)(offset / STRIDE + 1);
+        }
+        segment[SEGMENT_SIZE - 1] = 'z';
+        shmdt(segment);
+        exit(EXIT_SUCCESS);
+    }
+    if (waitpid(pid, &status, 0) < 0) {
+        perror("waitpid");
+        return EXIT_FAILURE;
+    }
+    // The parent sees what the child wrote.
+    for (int offset = 0; offset < SEGMENT_SIZE; offset += STRIDE) {
+        if (segment[offset] != (char)(offset / STRIDE + 1)) {
+            printf("Wrong value at offset %d of the segment.\n", offset);
+            return EXIT_FAILURE;
+        }
+    }
+    if (segment[SEGMENT_SIZE - 1] != 'z') {
+        printf("Wrong value at the end of the segment.\n");
+        return EXIT_FAILURE;
+    }
+    // The segment goes away with its last attachment.
+    if (shmctl(shmid, IPC_RMID, NULL) < 0) {
+        perror("shmctl");
+        return EXIT_FAILURE;
+    }
+    segment[0] = 'a';
+    if (shmdt(segment) < 0) {
+        perror("shmdt");
+        return EXIT_FAILURE;
+    }
+    if (shmat(shmid, NULL, 0) != (void *)-1) {
+        printf("A removed segment can still be attached.\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,103 @@
+/// @file t_shm_open.c
+/// @brief Tests POSIX shared memory objects and memfds, mapped by two processes.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/unistd.h>
+#include <sys/wait.h>
+
+/// Size of the shared objects.
+#define OBJECT_SIZE (4 * 4096)
+
+/// @brief Sizes the object, maps it, and checks that a child writing through
+/// the mapping is seen both through the mapping and through read.
+/// @param fd the descriptor of the object.
+/// @return 0 on success, 1 on failure.
+static int check_shared(int fd)
+{
+    char buffer[16];
+    int status;
+    // Writing the last byte sizes the object.
+    if ((lseek(fd, OBJECT_SIZE - 1, SEEK_SET) < 0) || (write(fd, "", 1) != 1)) {
+        perror("write");
+        return 1;
+    }
+    char *shared = mmap(NULL, OBJECT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (shared == NULL) {
+        printf("Failed to map the object.\n");
+        return 1;
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        strcpy(shared, "first");
+        strcpy(shared + OBJECT_SIZE - 4096, "last");
+        exit(EXIT_SUCCESS);
+    }
+    if (waitpid(pid, &status, 0) < 0) {
+        perror("waitpid");
+        return 1;
+    }
+    // The parent maps the same pages.
+    if (strcmp(shared, "first") || strcmp(shared + OBJECT_SIZE - 4096, "last")) {
+        printf("The writes of the child are not visible through the mapping.\n");
+        return 1;
+    }
+    // The file is the mapping.
+    if ((lseek(fd, OBJECT_SIZE - 4096, SEEK_SET) < 0) || (read(fd, buffer, 5) != 5) || strcmp(buffer, "last")) {
+        printf("The writes of the child are not visible through read.\n");
+        return 1;
+    }
+    if ((lseek(fd, 0, SEEK_SET) < 0) || (write(fd, "again", 6) != 6) || strcmp(shared, "again")) {
+        printf("The writes through the file are not visible through the mapping.\n");
+        return 1;
+    }
+    munmap(shared, OBJECT_SIZE);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int fd;
+    // A named object, found again by name.
+    fd = shm_open("/t_shm_open", O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        perror("shm_open");
+        return EXIT_FAILURE;
+    }
+    if (check_shared(fd)) {
+        return EXIT_FAILURE;
+    }
+    close(fd);
+    if (shm_open("/t_shm_open", O_CREAT | O_EXCL | O_RDWR, 0600) >= 0) {
+        printf("The object was created twice.\n");
+        return EXIT_FAILURE;
+    }
+    if (shm_unlink("/t_shm_open") < 0) {
+        perror("shm_unlink");
+        return EXIT_FAILURE;
+    }
+    if (shm_open("/t_shm_open", O_RDWR, 0) >= 0) {
+        printf("The object is still there after shm_unlink.\n");
+        return EXIT_FAILURE;
+    }
+    if (shm_open("no_slash", O_CREAT | O_RDWR, 0600) >= 0) {
+        printf("A name without the leading slash was accepted.\n");
+        return EXIT_FAILURE;
+    }
+    // An anonymous object, shared by descriptor.
+    fd = memfd_create("t_shm_open", 0);
+    if (fd < 0) {
+        perror("memfd_create");
+        return EXIT_FAILURE;
+    }
+    if (check_shared(fd)) {
+        return EXIT_FAILURE;
+    }
+    close(fd);
+    return EXIT_SUCCESS;
+}
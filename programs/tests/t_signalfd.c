@@ -0,0 +1,77 @@
+/// @file t_signalfd.c
+/// @brief Tests reading blocked signals from a signalfd.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <sys/unistd.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strerror.h>
+#include <sys/epoll.h>
+#include <sys/errno.h>
+#include <sys/signalfd.h>
+#include <sys/wait.h>
+#include <time.h>
+
+int main(int argc, char *argv[])
+{
+    struct signalfd_siginfo ssi[2];
+    struct epoll_event ev, out;
+    sigset_t mask;
+    int sfd, epfd;
+    // Leave the signals pending, instead of delivering them.
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGUSR1);
+    sigaddset(&mask, SIGUSR2);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+    if ((sfd = signalfd(-1, &mask, SFD_NONBLOCK)) < 0) {
+        printf("Failed to create the signalfd: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    if ((read(sfd, ssi, sizeof(ssi)) != -1) || (errno != EAGAIN)) {
+        printf("Reading without pending signals should fail with EAGAIN.\n");
+        return EXIT_FAILURE;
+    }
+    // Both pending signals are read at once, the lowest first.
+    kill(getpid(), SIGUSR2);
+    kill(getpid(), SIGUSR1);
+    if (read(sfd, ssi, sizeof(ssi)) != 2 * sizeof(struct signalfd_siginfo)) {
+        printf("Failed to read the pending signals: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    if ((ssi[0].ssi_signo != SIGUSR1) || (ssi[1].ssi_signo != SIGUSR2)) {
+        printf("Read the wrong signals: %u, %u.\n", ssi[0].ssi_signo, ssi[1].ssi_signo);
+        return EXIT_FAILURE;
+    }
+    // A signal sent by a child wakes up an epoll instance watching the signalfd.
+    if ((epfd = epoll_create1(0)) < 0) {
+        printf("Failed to create the epoll instance: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    ev.events  = EPOLLIN;
+    ev.data.fd = sfd;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, sfd, &ev) < 0) {
+        printf("Failed to watch the signalfd: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    pid_t ppid = getpid();
+    if (!fork()) {
+        sleep(1);
+        kill(ppid, SIGUSR1);
+        exit(EXIT_SUCCESS);
+    }
+    if ((epoll_wait(epfd, &out, 1, -1) != 1) || (out.data.fd != sfd)) {
+        printf("Failed to wait for the signal: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    if ((read(sfd, ssi, sizeof(ssi)) != sizeof(struct signalfd_siginfo)) || (ssi[0].ssi_signo != SIGUSR1)) {
+        printf("Failed to read the signal of the child.\n");
+        return EXIT_FAILURE;
+    }
+    wait(NULL);
+    close(epfd);
+    close(sfd);
+    printf("Signalfd works.\n");
+    return EXIT_SUCCESS;
+}
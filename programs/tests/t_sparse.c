@@ -0,0 +1,94 @@
+/// @file t_sparse.c
+/// @brief Tests the reads and writes of files with holes.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strerror.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/unistd.h>
+
+/// Offset of the data written past the hole, inside the doubly indirect blocks.
+#define FAR_OFFSET (1024 * 1024)
+
+/// @brief Checks that a portion of the file contains only the given byte.
+/// @param fd the file.
+/// @param offset the start of the portion.
+/// @param length the length of the portion.
+/// @param value the expected byte.
+/// @return 0 if the content matches, 1 otherwise.
+static int check_content(int fd, off_t offset, size_t length, char value)
+{
+    static char buffer[4096];
+    while (length > 0) {
+        size_t chunk = (length < sizeof(buffer)) ? length : sizeof(buffer);
+        if (pread(fd, buffer, chunk, offset) != (ssize_t)chunk) {
+            printf("Failed to read %u bytes at offset %ld: %s\n", chunk, offset, strerror(errno));
+            return 1;
+        }
+        for (size_t i = 0; i < chunk; ++i) {
+            if (buffer[i] != value) {
+                printf("Unexpected byte 0x%02x at offset %ld.\n", (unsigned char)buffer[i], offset + i);
+                return 1;
+            }
+        }
+        offset += chunk;
+        length -= chunk;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    char *filename = "/home/user/test_sparse.txt";
+    int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd < 0) {
+        printf("Failed to create file %s: %s\n", filename, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    // Write at the beginning, and far past the end.
+    if (pwrite(fd, "head", 4, 0) != 4) {
+        printf("Failed to write on file %s: %s\n", filename, strerror(errno));
+        goto close_and_fail;
+    }
+    if (pwrite(fd, "tail", 4, FAR_OFFSET) != 4) {
+        printf("Failed to write past the end of file %s: %s\n", filename, strerror(errno));
+        goto close_and_fail;
+    }
+    stat_t st;
+    if ((fstat(fd, &st) < 0) || (st.st_size != FAR_OFFSET + 4)) {
+        printf("Unexpected size of file %s.\n", filename);
+        goto close_and_fail;
+    }
+    // The hole in between reads as zeros.
+    if (check_content(fd, 4, FAR_OFFSET - 4, 0)) {
+        goto close_and_fail;
+    }
+    // Fill a block inside the hole, the rest of it stays a hole.
+    if (pwrite(fd, "middle", 6, FAR_OFFSET / 2) != 6) {
+        printf("Failed to write inside the hole of file %s: %s\n", filename, strerror(errno));
+        goto close_and_fail;
+    }
+    if (check_content(fd, 4, FAR_OFFSET / 2 - 4, 0) ||
+        check_content(fd, FAR_OFFSET / 2 + 6, FAR_OFFSET / 2 - 6, 0)) {
+        goto close_and_fail;
+    }
+    char buffer[8] = { 0 };
+    if ((pread(fd, buffer, 4, 0) != 4) || strcmp(buffer, "head") ||
+        (pread(fd, buffer, 6, FAR_OFFSET / 2) != 6) || strcmp(buffer, "middle") ||
+        (pread(fd, buffer, 6, FAR_OFFSET) != 4) || strncmp(buffer, "tail", 4)) {
+        printf("The data around the hole of file %s has been lost.\n", filename);
+        goto close_and_fail;
+    }
+    close(fd);
+    unlink(filename);
+    return EXIT_SUCCESS;
+
+close_and_fail:
+    close(fd);
+    unlink(filename);
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,81 @@
+/// @file t_spawn.c
+/// @brief Test vfork and posix_spawn.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strerror.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/unistd.h>
+#include <sys/wait.h>
+
+extern char **environ;
+
+/// Written by the vfork child, which runs on the memory of the parent.
+static volatile int shared_value = 0;
+
+int main(int argc, char *argv[])
+{
+    char *filename     = "/home/user/test_spawn.txt";
+    char *spawn_argv[] = { "echo", "fusrodah", NULL };
+    posix_spawn_file_actions_t file_actions;
+    char buffer[16];
+    int status, error, fd;
+    pid_t cpid;
+
+    // The child borrows the memory of the parent, which sleeps until the child exits.
+    if ((cpid = vfork()) == 0) {
+        shared_value = 42;
+        exit(3);
+    }
+    if (cpid < 0) {
+        printf("Failed to vfork: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    if (shared_value != 42) {
+        printf("The parent does not see the writes of the vfork child.\n");
+        return EXIT_FAILURE;
+    }
+    if ((waitpid(cpid, &status, 0) != cpid) || !WIFEXITED(status) || (WEXITSTATUS(status) != 3)) {
+        printf("The vfork child failed.\n");
+        return EXIT_FAILURE;
+    }
+
+    // Spawn a program with its output redirected on a file.
+    posix_spawn_file_actions_init(&file_actions);
+    posix_spawn_file_actions_addopen(&file_actions, STDOUT_FILENO, filename, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    error = posix_spawn(&cpid, "/bin/echo", &file_actions, NULL, spawn_argv, environ);
+    posix_spawn_file_actions_destroy(&file_actions);
+    if (error) {
+        printf("Failed to spawn: %s\n", strerror(error));
+        return EXIT_FAILURE;
+    }
+    if ((waitpid(cpid, &status, 0) != cpid) || !WIFEXITED(status) || (WEXITSTATUS(status) != EXIT_SUCCESS)) {
+        printf("The spawned process failed.\n");
+        return EXIT_FAILURE;
+    }
+    // The output of the child must be inside the file, not on our stdout.
+    if ((fd = open(filename, O_RDONLY, 0)) < 0) {
+        printf("Failed to open file %s: %s\n", filename, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    memset(buffer, 0, sizeof(buffer));
+    read(fd, buffer, sizeof(buffer) - 1);
+    close(fd);
+    unlink(filename);
+    if (strncmp(buffer, "fusrodah", 8) != 0) {
+        printf("The spawned process wrote `%s` instead of `fusrodah`.\n", buffer);
+        return EXIT_FAILURE;
+    }
+
+    // A missing program is reported to the caller.
+    if (posix_spawn(&cpid, "/bin/not_a_program", NULL, NULL, spawn_argv, environ) != ENOENT) {
+        printf("Spawning a missing program did not fail with ENOENT.\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,87 @@
+/// @file t_splice.c
+/// @brief Tests splice and tee, between files and pipes.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strerror.h>
+#include <string.h>
+#include <sys/errno.h>
+#include <sys/splice.h>
+#include <sys/stat.h>
+#include <sys/unistd.h>
+
+/// The file we read.
+#define SOURCE "/home/user/t_splice_in.txt"
+/// The file we write.
+#define TARGET "/home/user/t_splice_out.txt"
+
+/// @brief Tells what failed, and removes the files.
+/// @param what the failed step.
+/// @return EXIT_FAILURE.
+static int fail(const char *what)
+{
+    printf("%s: %s\n", what, strerror(errno));
+    unlink(SOURCE);
+    unlink(TARGET);
+    return EXIT_FAILURE;
+}
+
+int main(int argc, char *argv[])
+{
+    const char text[] = "Moved by the kernel, never copied in user space.";
+    char check[sizeof(text)];
+    int in[2], out[2];
+    off_t offset = 0;
+    int src      = open(SOURCE, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    int dst      = open(TARGET, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if ((src < 0) || (dst < 0)) {
+        return fail("open");
+    }
+    if (write(src, text, sizeof(text)) != sizeof(text)) {
+        return fail("write");
+    }
+    if ((pipe(in) < 0) || (pipe(out) < 0)) {
+        return fail("pipe");
+    }
+    // Two files, or a position on a pipe, are refused.
+    if ((splice(src, NULL, dst, NULL, 1, 0) != -1) || (errno != EINVAL)) {
+        return fail("splice between files");
+    }
+    if ((splice(in[0], &offset, dst, NULL, 1, 0) != -1) || (errno != ESPIPE)) {
+        return fail("splice with a position on a pipe");
+    }
+    // From the file to the first pipe, at the given position.
+    if (splice(src, &offset, in[1], NULL, sizeof(text), 0) != sizeof(text)) {
+        return fail("splice from the file");
+    }
+    if (offset != sizeof(text)) {
+        return fail("splice did not update the position");
+    }
+    // Duplicate it on the second pipe, then move it to the other file.
+    if (tee(in[0], out[1], sizeof(text), 0) != sizeof(text)) {
+        return fail("tee");
+    }
+    if (splice(in[0], NULL, dst, NULL, sizeof(text), 0) != sizeof(text)) {
+        return fail("splice to the file");
+    }
+    // The first pipe is empty, now.
+    if ((splice(in[0], NULL, dst, NULL, 1, SPLICE_F_NONBLOCK) != -1) || (errno != EAGAIN)) {
+        return fail("splice from an empty pipe");
+    }
+    if ((read(out[0], check, sizeof(check)) != sizeof(check)) || strcmp(check, text)) {
+        return fail("tee copied wrong data");
+    }
+    memset(check, 0, sizeof(check));
+    if ((pread(dst, check, sizeof(check), 0) != sizeof(check)) || strcmp(check, text)) {
+        return fail("splice wrote wrong data");
+    }
+    close(in[0]), close(in[1]), close(out[0]), close(out[1]);
+    close(src), close(dst);
+    unlink(SOURCE);
+    unlink(TARGET);
+    printf("Splice and tee work.\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,115 @@
+/// @file t_stdio.c
+/// @brief Test the buffered streams of stdio.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <strerror.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/unistd.h>
+
+/// The file we use.
+#define FILENAME "/home/user/t_stdio.txt"
+/// The number of lines written.
+#define LINES 1000
+/// The length of a line longer than any buffer of the formatter.
+#define LONG_LINE 10000
+
+int main(int argc, char *argv[])
+{
+    static char long_line[LONG_LINE + 1];
+    char line[64], expected[64];
+    stat_t st;
+    // Truncated formatting still counts the whole output.
+    if ((snprintf(line, 6, "%s %d", "line", 1234) != 9) || strcmp(line, "line ") ||
+        (snprintf(NULL, 0, "%d", -1234) != 5)) {
+        printf("snprintf does not truncate correctly.\n");
+        return EXIT_FAILURE;
+    }
+    // Write many short lines, which fit the buffer many times over.
+    FILE *file = fopen(FILENAME, "w");
+    if (file == NULL) {
+        printf("Failed to create file %s: %s\n", FILENAME, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    long size = 0;
+    for (int i = 0; i < LINES; ++i) {
+        size += fprintf(file, "line %d\n", i);
+    }
+    if (ftell(file) != size) {
+        printf("ftell returned %ld instead of %ld.\n", ftell(file), size);
+        goto close_and_fail;
+    }
+    if (fclose(file) != 0) {
+        printf("Failed to close file %s: %s\n", FILENAME, strerror(errno));
+        goto unlink_and_fail;
+    }
+    if ((stat(FILENAME, &st) < 0) || (st.st_size != size)) {
+        printf("The file holds %ld bytes instead of %ld.\n", (long)st.st_size, size);
+        goto unlink_and_fail;
+    }
+    // Append a line, without buffering.
+    if ((file = fopen(FILENAME, "a")) == NULL) {
+        printf("Failed to open file %s: %s\n", FILENAME, strerror(errno));
+        goto unlink_and_fail;
+    }
+    setvbuf(file, NULL, _IONBF, 0);
+    if ((fputs("last\n", file) == EOF) || (fclose(file) != 0)) {
+        printf("Failed to append to file %s: %s\n", FILENAME, strerror(errno));
+        goto unlink_and_fail;
+    }
+    // Read it back line by line.
+    if ((file = fopen(FILENAME, "r")) == NULL) {
+        printf("Failed to open file %s: %s\n", FILENAME, strerror(errno));
+        goto unlink_and_fail;
+    }
+    for (int i = 0; i < LINES; ++i) {
+        sprintf(expected, "line %d\n", i);
+        if (!fgets(line, sizeof(line), file) || strcmp(line, expected)) {
+            printf("Line %d is wrong.\n", i);
+            goto close_and_fail;
+        }
+    }
+    if (!fgets(line, sizeof(line), file) || strcmp(line, "last\n")) {
+        printf("The appended line is missing.\n");
+        goto close_and_fail;
+    }
+    if (fgets(line, sizeof(line), file) || !feof(file)) {
+        printf("The end of the file was not detected.\n");
+        goto close_and_fail;
+    }
+    // Seek inside the buffered data, and read across the buffer boundary.
+    if ((fseek(file, 5, SEEK_SET) != 0) || (fgetc(file) != '0') || (fgetc(file) != '\n')) {
+        printf("Failed to seek inside file %s.\n", FILENAME);
+        goto close_and_fail;
+    }
+    if ((fread(line, 1, 6, file) != 6) || strncmp(line, "line 1", 6) || (ftell(file) != 13)) {
+        printf("Failed to read from file %s.\n", FILENAME);
+        goto close_and_fail;
+    }
+    fclose(file);
+    // Format a line longer than the buffers of the formatter.
+    if ((file = fopen(FILENAME, "w")) == NULL) {
+        printf("Failed to open file %s: %s\n", FILENAME, strerror(errno));
+        goto unlink_and_fail;
+    }
+    memset(long_line, 'x', LONG_LINE);
+    if ((fprintf(file, "%s%d\n", long_line, 7) != LONG_LINE + 2) || (fclose(file) != 0)) {
+        printf("Failed to write a long line to file %s.\n", FILENAME);
+        goto unlink_and_fail;
+    }
+    if ((stat(FILENAME, &st) < 0) || (st.st_size != LONG_LINE + 2)) {
+        printf("The long line holds %ld bytes instead of %d.\n", (long)st.st_size, LONG_LINE + 2);
+        goto unlink_and_fail;
+    }
+    unlink(FILENAME);
+    return EXIT_SUCCESS;
+
+close_and_fail:
+    fclose(file);
+unlink_and_fail:
+    unlink(FILENAME);
+    return EXIT_FAILURE;
+}
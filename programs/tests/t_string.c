@@ -0,0 +1,147 @@
+/// @file t_string.c
+/// @brief Tests memcpy, memmove, memset, memcmp and the string scanning
+/// functions on every alignment.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// The size of the buffers.
+#define SIZE 512
+
+/// The buffers, and the expected content.
+static unsigned char buffer[SIZE], expected[SIZE];
+
+/// @brief Fills a buffer with a pattern which differs at each position.
+/// @param ptr the buffer.
+static void fill(unsigned char *ptr)
+{
+    for (unsigned i = 0; i < SIZE; ++i) {
+        ptr[i] = (unsigned char)(i * 7 + 3);
+    }
+}
+
+/// @brief Compares the buffer with the expected content, byte by byte.
+/// @param what the function being tested.
+/// @param dst the offset of the destination.
+/// @param src the offset of the source.
+/// @param n the number of bytes.
+/// @return 0 if they are equal, -1 otherwise.
+static int check(const char *what, unsigned dst, unsigned src, unsigned n)
+{
+    for (unsigned i = 0; i < SIZE; ++i) {
+        if (buffer[i] != expected[i]) {
+            printf("%s(%u, %u, %u) is wrong at byte %u.\n", what, dst, src, n, i);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/// @brief Tests the scanning functions on a string at each alignment.
+/// @return 0 on success, -1 on failure.
+static int test_scanning(void)
+{
+    static char text[64], copy[64];
+    for (unsigned offset = 0; offset < 8; ++offset) {
+        for (unsigned length = 0; length < 40; ++length) {
+            char *s = text + offset;
+            for (unsigned i = 0; i < length; ++i) {
+                s[i] = (char)('a' + i % 20);
+            }
+            s[length] = 0;
+            if (strlen(s) != length) {
+                printf("strlen(%u, %u) returned %u.\n", offset, length, strlen(s));
+                return -1;
+            }
+            if ((strchr(s, 0) != s + length) || (strchr(s, 'z') != NULL) ||
+                ((length > 0) && (strchr(s, s[length - 1]) != s + (length - 1) % 20))) {
+                printf("strchr(%u, %u) is wrong.\n", offset, length);
+                return -1;
+            }
+            if ((memchr(s, 0, length + 1) != s + length) || (memchr(s, 0, length) != NULL)) {
+                printf("memchr(%u, %u) is wrong.\n", offset, length);
+                return -1;
+            }
+            if ((length > 2) && (strstr(s, s + length - 2) != s + (length - 2) % 20)) {
+                printf("strstr(%u, %u) is wrong.\n", offset, length);
+                return -1;
+            }
+            // Compare with copies at another alignment, equal and not.
+            char *c = copy + (offset * 3) % 8;
+            strcpy(c, s);
+            if (strcmp(s, c) != 0) {
+                printf("strcmp(%u, %u) found a difference in equal strings.\n", offset, length);
+                return -1;
+            }
+            if (length > 0) {
+                c[length - 1] = 'A';
+                if ((strcmp(s, c) <= 0) || (strcmp(c, s) >= 0)) {
+                    printf("strcmp(%u, %u) has the wrong sign.\n", offset, length);
+                    return -1;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    static const unsigned sizes[] = { 0, 1, 3, 4, 7, 15, 16, 63, 64, 65, 200 };
+    for (unsigned s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        unsigned n = sizes[s];
+        for (unsigned dst = 0; dst < 8; ++dst) {
+            for (unsigned src = 0; src < 8; ++src) {
+                // Overlapping moves, in both directions.
+                fill(buffer), fill(expected);
+                for (unsigned i = 0; i < n; ++i) {
+                    expected[dst * 9 + i] = (unsigned char)((src * 5 + i) * 7 + 3);
+                }
+                memmove(buffer + dst * 9, buffer + src * 5, n);
+                if (check("memmove", dst * 9, src * 5, n) < 0) {
+                    return EXIT_FAILURE;
+                }
+                // Copies between distinct buffers.
+                fill(buffer), fill(expected);
+                for (unsigned i = 0; i < n; ++i) {
+                    expected[dst + i] = expected[SIZE / 2 + src + i];
+                }
+                memcpy(buffer + dst, buffer + SIZE / 2 + src, n);
+                if (check("memcpy", dst, SIZE / 2 + src, n) < 0) {
+                    return EXIT_FAILURE;
+                }
+                // The order of the first different byte decides the result.
+                if ((n > 0) && (memcmp(buffer + dst, expected + dst, n) != 0)) {
+                    printf("memcmp(%u, %u) found a difference in equal buffers.\n", dst, n);
+                    return EXIT_FAILURE;
+                }
+                if (n > 1) {
+                    buffer[dst + n - 1] = 0xFF;
+                    expected[dst + n - 1] = 0x01;
+                    buffer[dst + n / 2] ^= src + 1;
+                    if (memcmp(buffer + dst, expected + dst, n) * (buffer[dst + n / 2] - expected[dst + n / 2]) <= 0) {
+                        printf("memcmp(%u, %u) has the wrong sign.\n", dst, n);
+                        return EXIT_FAILURE;
+                    }
+                }
+            }
+            // Fillings.
+            fill(buffer), fill(expected);
+            for (unsigned i = 0; i < n; ++i) {
+                expected[dst + i] = 0xA5;
+            }
+            memset(buffer + dst, 0xA5, n);
+            if (check("memset", dst, 0, n) < 0) {
+                return EXIT_FAILURE;
+            }
+        }
+    }
+    if (test_scanning() < 0) {
+        return EXIT_FAILURE;
+    }
+    printf("The memory and string functions work.\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,87 @@
+/// @file t_swap.c
+/// @brief Tests enabling and disabling a swap file.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strerror.h>
+#include <string.h>
+#include <sys/errno.h>
+#include <sys/stat.h>
+#include <sys/swap.h>
+#include <sys/unistd.h>
+
+/// The swap file.
+#define FILENAME "/tmp/t_swap"
+/// The number of pages of the swap file.
+#define SWAP_PAGES 16
+
+/// @brief Tells what failed, and removes the swap file.
+/// @param what the failed step.
+/// @return EXIT_FAILURE.
+static int fail(const char *what)
+{
+    printf("%s: %s\n", what, strerror(errno));
+    swapoff(FILENAME);
+    unlink(FILENAME);
+    return EXIT_FAILURE;
+}
+
+/// @brief Creates the swap file, as mkswap does.
+/// @param signature whether to write the signature of the header.
+/// @return 0 on success, -1 on failure.
+static int create_swap_file(int signature)
+{
+    static char page[4096];
+    memset(page, 0, sizeof(page));
+    if (signature) {
+        // The version, and the last page.
+        *(unsigned int *)(page + 1024) = 1;
+        *(unsigned int *)(page + 1028) = SWAP_PAGES - 1;
+        memcpy(page + sizeof(page) - 10, "SWAPSPACE2", 10);
+    }
+    int fd = open(FILENAME, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd < 0) {
+        return -1;
+    }
+    for (int i = 0; i < SWAP_PAGES; ++i) {
+        if (write(fd, page, sizeof(page)) != sizeof(page)) {
+            close(fd);
+            return -1;
+        }
+        memset(page, 0, sizeof(page));
+    }
+    close(fd);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    // A file without the signature is refused.
+    if (create_swap_file(0) < 0) {
+        return fail("create");
+    }
+    if ((swapon(FILENAME, 0) == 0) || (errno != EINVAL)) {
+        return fail("swapon without signature");
+    }
+    if (create_swap_file(1) < 0) {
+        return fail("create with signature");
+    }
+    if (swapon(FILENAME, 0) < 0) {
+        return fail("swapon");
+    }
+    // There is a single swap area.
+    if ((swapon(FILENAME, 0) == 0) || (errno != EBUSY)) {
+        return fail("second swapon");
+    }
+    if (swapoff(FILENAME) < 0) {
+        return fail("swapoff");
+    }
+    if ((swapoff(FILENAME) == 0) || (errno != EINVAL)) {
+        return fail("second swapoff");
+    }
+    unlink(FILENAME);
+    return EXIT_SUCCESS;
+}
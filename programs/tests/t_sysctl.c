@@ -0,0 +1,72 @@
+/// @file t_sysctl.c
+/// @brief Tests the tunables under `/proc/sys`.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strerror.h>
+#include <string.h>
+#include <sys/errno.h>
+#include <sys/unistd.h>
+
+/// The tunable we change.
+#define TUNABLE "/proc/sys/vm/dirty_ratio"
+
+/// @brief Reads the value of the tunable.
+/// @return the value, or -1 on failure.
+static int tunable_read(void)
+{
+    char buffer[16] = { 0 };
+    int fd          = open(TUNABLE, O_RDONLY, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    ssize_t ret = read(fd, buffer, sizeof(buffer) - 1);
+    close(fd);
+    return (ret > 0) ? atoi(buffer) : -1;
+}
+
+/// @brief Writes the tunable.
+/// @param text the new value.
+/// @return 0 on success, -1 on failure with errno set.
+static int tunable_write(const char *text)
+{
+    int fd = open(TUNABLE, O_WRONLY, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    ssize_t ret = write(fd, text, strlen(text));
+    close(fd);
+    return (ret < 0) ? -1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+    char saved[16];
+    int value = tunable_read();
+    if (value < 0) {
+        printf("read: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    sprintf(saved, "%d\n", value);
+    // A valid value is kept.
+    if ((tunable_write("42\n") < 0) || (tunable_read() != 42)) {
+        printf("write of a valid value: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    // Out of range, or not a number, the value does not change.
+    if ((tunable_write("101") != -1) || (errno != EINVAL) ||
+        (tunable_write("ten") != -1) || (errno != EINVAL) ||
+        (tunable_read() != 42)) {
+        printf("write of an invalid value was accepted\n");
+        tunable_write(saved);
+        return EXIT_FAILURE;
+    }
+    if ((tunable_write(saved) < 0) || (tunable_read() != value)) {
+        printf("restore: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
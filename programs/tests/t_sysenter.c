@@ -0,0 +1,51 @@
+/// @file t_sysenter.c
+/// @brief Test the system calls made through the vDSO.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <strerror.h>
+#include <sys/unistd.h>
+#include <sys/vdso.h>
+#include <sys/wait.h>
+#include <system/syscall_types.h>
+
+int main(int argc, char *argv[])
+{
+    long pid_int80, pid_entry;
+    unsigned ecx = 0x11111111, edx = 0x22222222, esi = 0x33333333, edi = 0x44444444;
+    int status;
+    pid_t cpid;
+
+    // The interrupt and the entry chosen by the C library agree.
+    __asm__ __volatile__("int $0x80"
+                         : "=a"(pid_int80)
+                         : "0"(__NR_getpid));
+    // The entry preserves every register but eax.
+    __asm__ __volatile__("call *__syscall_entry"
+                         : "=a"(pid_entry), "+c"(ecx), "+d"(edx), "+S"(esi), "+D"(edi)
+                         : "0"(__NR_getpid)
+                         : "memory");
+    if (pid_int80 != pid_entry) {
+        printf("getpid returned %ld with int 0x80, and %ld with the entry.\n", pid_int80, pid_entry);
+        return EXIT_FAILURE;
+    }
+    if ((ecx != 0x11111111) || (edx != 0x22222222) || (esi != 0x33333333) || (edi != 0x44444444)) {
+        printf("The entry did not preserve the registers.\n");
+        return EXIT_FAILURE;
+    }
+    // The child returns from fork on a copy of the stack of the parent.
+    if ((cpid = fork()) == 0) {
+        exit(getppid() == pid_entry ? 42 : 1);
+    }
+    if (cpid < 0) {
+        printf("Failed to fork: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    if ((waitpid(cpid, &status, 0) != cpid) || !WIFEXITED(status) || (WEXITSTATUS(status) != 42)) {
+        printf("The child did not exit correctly.\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,76 @@
+/// @file t_taskreuse.c
+/// @brief Tests that the tasks kept after they exit are reused clean.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <sys/unistd.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strerror.h>
+#include <sys/wait.h>
+
+/// The number of children, more than the tasks kept by the kernel.
+#define CHILDREN 40
+
+/// Set when SIGUSR1 is delivered.
+static volatile int delivered;
+
+/// @brief Handles SIGUSR1.
+/// @param sig the signal.
+static void sigusr1_handler(int sig)
+{
+    delivered = 1;
+}
+
+/// @brief Checks that the child starts clean, then leaves behind a handler
+/// and a pending signal.
+/// @return EXIT_SUCCESS if it started clean, EXIT_FAILURE otherwise.
+static int child(void)
+{
+    sigaction_t action, old;
+    sigset_t mask;
+    if ((sigaction(SIGUSR1, NULL, &old) < 0) || (old.sa_handler != SIG_DFL)) {
+        printf("The child does not start with the default handler.\n");
+        return EXIT_FAILURE;
+    }
+    action.sa_handler = sigusr1_handler;
+    action.sa_flags   = 0;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGUSR1, &action, NULL) < 0) {
+        printf("Failed to set the handler: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    // A signal pending from a previous task would be delivered by now.
+    sigemptyset(&mask);
+    sigprocmask(SIG_SETMASK, &mask, NULL);
+    if (delivered) {
+        printf("The child received a signal sent to another one.\n");
+        return EXIT_FAILURE;
+    }
+    // Leave a signal pending, blocked, on the way out.
+    sigaddset(&mask, SIGUSR1);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+    kill(getpid(), SIGUSR1);
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[])
+{
+    int status;
+    for (int i = 0; i < CHILDREN; ++i) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            printf("Failed to fork: %s\n", strerror(errno));
+            return EXIT_FAILURE;
+        }
+        if (pid == 0) {
+            exit(child());
+        }
+        if ((waitpid(pid, &status, 0) != pid) || !WIFEXITED(status) || (WEXITSTATUS(status) != EXIT_SUCCESS)) {
+            printf("Child %d failed.\n", i);
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
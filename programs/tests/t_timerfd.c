@@ -0,0 +1,78 @@
+/// @file t_timerfd.c
+/// @brief Tests reading the expirations of a timerfd.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <sys/unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strerror.h>
+#include <sys/epoll.h>
+#include <sys/errno.h>
+#include <sys/timerfd.h>
+#include <time.h>
+
+int main(int argc, char *argv[])
+{
+    struct epoll_event ev, out;
+    unsigned long long ticks = 0;
+    itimerspec its, cur;
+    int tfd, epfd;
+    if ((tfd = timerfd_create(CLOCK_MONOTONIC, 0)) < 0) {
+        printf("Failed to create the timerfd: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    // Expire after 100 ms, then every 50 ms.
+    its.it_value.tv_sec     = 0;
+    its.it_value.tv_nsec    = 100000000;
+    its.it_interval.tv_sec  = 0;
+    its.it_interval.tv_nsec = 50000000;
+    if (timerfd_settime(tfd, 0, &its, NULL) < 0) {
+        printf("Failed to arm the timerfd: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    if ((timerfd_gettime(tfd, &cur) < 0) || (cur.it_interval.tv_nsec != 50000000) ||
+        (cur.it_value.tv_sec != 0) || (cur.it_value.tv_nsec == 0)) {
+        printf("The timerfd should be armed with the given period.\n");
+        return EXIT_FAILURE;
+    }
+    // Sleep until the first expiration.
+    if ((read(tfd, &ticks, sizeof(ticks)) != sizeof(ticks)) || (ticks == 0)) {
+        printf("Failed to read the expirations: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    // The next expirations are reported by an epoll instance.
+    if ((epfd = epoll_create1(0)) < 0) {
+        printf("Failed to create the epoll instance: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    ev.events  = EPOLLIN;
+    ev.data.fd = tfd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, tfd, &ev);
+    if ((epoll_wait(epfd, &out, 1, 1000) != 1) || (out.data.fd != tfd)) {
+        printf("The periodic timerfd should expire again.\n");
+        return EXIT_FAILURE;
+    }
+    // Once disarmed, it does not expire anymore.
+    its.it_value.tv_nsec    = 0;
+    its.it_interval.tv_nsec = 0;
+    timerfd_settime(tfd, 0, &its, NULL);
+    if (epoll_wait(epfd, &out, 1, 200) != 0) {
+        printf("A disarmed timerfd should not expire.\n");
+        return EXIT_FAILURE;
+    }
+    close(epfd);
+    close(tfd);
+    // Reading a timerfd which did not expire does not block, if asked so.
+    if ((tfd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK)) < 0) {
+        printf("Failed to create the timerfd: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    if ((read(tfd, &ticks, sizeof(ticks)) != -1) || (errno != EAGAIN)) {
+        printf("Reading a timerfd which did not expire should fail with EAGAIN.\n");
+        return EXIT_FAILURE;
+    }
+    close(tfd);
+    printf("Timerfd works.\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,92 @@
+/// @file t_timerslack.c
+/// @brief Tests the slack of the timers of a process.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <strerror.h>
+#include <sys/prctl.h>
+#include <sys/unistd.h>
+#include <sys/wait.h>
+#include <time.h>
+
+/// The number of children sleeping at the same time.
+#define SLEEPERS 16
+/// How long each sleep lasts, in nanoseconds.
+#define SLEEP_NSEC 20000000L
+
+/// @brief Returns the nanoseconds elapsed between two times.
+/// @param start the first time.
+/// @param end the second time.
+/// @return the nanoseconds.
+static long long elapsed_nsec(const timespec *start, const timespec *end)
+{
+    return ((long long)(end->tv_sec - start->tv_sec) * 1000000000LL) + (end->tv_nsec - start->tv_nsec);
+}
+
+/// @brief Sleeps, and checks that the sleep was not cut short.
+/// @return 0 on success, 1 on failure.
+static int sleep_at_least(void)
+{
+    timespec start, end, req = { 0, SLEEP_NSEC };
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (nanosleep(&req, NULL) < 0) {
+        printf("nanosleep failed: %s\n", strerror(errno));
+        return 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (elapsed_nsec(&start, &end) < SLEEP_NSEC) {
+        printf("The sleep lasted %lld ns, less than %ld ns.\n", elapsed_nsec(&start, &end), SLEEP_NSEC);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int status;
+    if (prctl(PR_GET_TIMERSLACK) != 50000) {
+        printf("The default slack should be 50000 ns, not %d.\n", prctl(PR_GET_TIMERSLACK));
+        return EXIT_FAILURE;
+    }
+    // The slack only makes the timers late, never early.
+    if ((prctl(PR_SET_TIMERSLACK, 5000000UL) < 0) || (prctl(PR_GET_TIMERSLACK) != 5000000)) {
+        printf("Failed to set the slack: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    if (sleep_at_least()) {
+        return EXIT_FAILURE;
+    }
+    // Many children sleeping together inherit the slack, and wake up together.
+    for (int i = 0; i < SLEEPERS; ++i) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            printf("Failed to fork: %s\n", strerror(errno));
+            return EXIT_FAILURE;
+        }
+        if (pid == 0) {
+            if (prctl(PR_GET_TIMERSLACK) != 5000000) {
+                printf("The child did not inherit the slack.\n");
+                exit(EXIT_FAILURE);
+            }
+            exit(sleep_at_least() ? EXIT_FAILURE : EXIT_SUCCESS);
+        }
+    }
+    for (int i = 0; i < SLEEPERS; ++i) {
+        if ((wait(&status) < 0) || !WIFEXITED(status) || (WEXITSTATUS(status) != EXIT_SUCCESS)) {
+            printf("A sleeping child failed.\n");
+            return EXIT_FAILURE;
+        }
+    }
+    // Zero restores the default slack.
+    if ((prctl(PR_SET_TIMERSLACK, 0UL) < 0) || (prctl(PR_GET_TIMERSLACK) != 50000)) {
+        printf("Failed to restore the default slack.\n");
+        return EXIT_FAILURE;
+    }
+    if ((prctl(-1, 0UL) != -1) || (errno != EINVAL)) {
+        printf("An unknown option must fail with EINVAL.\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
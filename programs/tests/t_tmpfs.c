@@ -0,0 +1,112 @@
+/// @file t_tmpfs.c
+/// @brief Tests the files kept in memory under /tmp.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strerror.h>
+#include <string.h>
+#include <sys/errno.h>
+#include <sys/stat.h>
+#include <sys/unistd.h>
+
+/// The directory we work in.
+#define DIRECTORY "/tmp/t_tmpfs"
+/// The file we write.
+#define FILENAME DIRECTORY "/data"
+
+/// @brief Tells what failed, and removes the files.
+/// @param what the failed step.
+/// @return EXIT_FAILURE.
+static int fail(const char *what)
+{
+    printf("%s: %s\n", what, strerror(errno));
+    unlink(FILENAME);
+    rmdir(DIRECTORY);
+    return EXIT_FAILURE;
+}
+
+int main(int argc, char *argv[])
+{
+    const char text[] = "Scratch data, never on the disk.";
+    char check[sizeof(text)];
+    stat_t st;
+
+    if (mkdir(DIRECTORY, 0755) < 0) {
+        return fail("mkdir");
+    }
+    int fd = open(FILENAME, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd < 0) {
+        return fail("open");
+    }
+    // Write past a hole spanning more than a page.
+    if (lseek(fd, 5000, SEEK_SET) != 5000) {
+        return fail("lseek");
+    }
+    if (write(fd, text, sizeof(text)) != sizeof(text)) {
+        return fail("write");
+    }
+    if ((stat(FILENAME, &st) < 0) || (st.st_size != 5000 + sizeof(text))) {
+        return fail("stat after write");
+    }
+    // The hole reads back as zeros, the data as written.
+    if (lseek(fd, 4090, SEEK_SET) != 4090) {
+        return fail("lseek back");
+    }
+    if ((read(fd, check, 10) != 10) || memcmp(check, "\0\0\0\0\0\0\0\0\0\0", 10)) {
+        return fail("read of the hole");
+    }
+    if ((lseek(fd, 5000, SEEK_SET) != 5000) || (read(fd, check, sizeof(check)) != sizeof(check)) ||
+        memcmp(check, text, sizeof(text))) {
+        return fail("read of the data");
+    }
+    // The directory lists the file.
+    DIR *dir = opendir(DIRECTORY);
+    if (dir == NULL) {
+        return fail("opendir");
+    }
+    dirent_t *entry = readdir(dir);
+    if ((entry == NULL) || strcmp(entry->d_name, "data") || (readdir(dir) != NULL)) {
+        closedir(dir);
+        return fail("readdir");
+    }
+    closedir(dir);
+    // A non-empty directory cannot be removed.
+    if ((rmdir(DIRECTORY) != -1) || (errno != ENOTEMPTY)) {
+        return fail("rmdir of a non-empty directory");
+    }
+    // The content of a removed file stays readable while it is open.
+    if (unlink(FILENAME) < 0) {
+        return fail("unlink");
+    }
+    if ((open(FILENAME, O_RDONLY, 0) != -1) || (errno != ENOENT)) {
+        return fail("open of the removed file");
+    }
+    if ((lseek(fd, 5000, SEEK_SET) != 5000) || (read(fd, check, sizeof(check)) != sizeof(check)) ||
+        memcmp(check, text, sizeof(text))) {
+        return fail("read of the removed file");
+    }
+    close(fd);
+    // Truncation on open drops the content.
+    if ((fd = open(FILENAME, O_WRONLY | O_CREAT, S_IRUSR | S_IWUSR)) < 0) {
+        return fail("open again");
+    }
+    if (write(fd, text, sizeof(text)) != sizeof(text)) {
+        return fail("write again");
+    }
+    close(fd);
+    if ((fd = open(FILENAME, O_WRONLY | O_TRUNC, 0)) < 0) {
+        return fail("open with O_TRUNC");
+    }
+    close(fd);
+    if ((stat(FILENAME, &st) < 0) || (st.st_size != 0)) {
+        return fail("stat after O_TRUNC");
+    }
+    if ((unlink(FILENAME) < 0) || (rmdir(DIRECTORY) < 0)) {
+        return fail("cleanup");
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,112 @@
+/// @file t_trace.c
+/// @brief Tests the static tracepoints, through `/proc/trace_events` and
+/// `/proc/trace`.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <sys/unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strerror.h>
+#include <sys/errno.h>
+#include <sys/trace.h>
+#include <system/syscall_types.h>
+
+/// The records read from `/proc/trace`.
+static trace_record_t records[4096];
+
+/// @brief Writes a command to `/proc/trace_events`.
+/// @param command the text.
+/// @return 0 on success, -1 on failure with errno set.
+static int events_write(const char *command)
+{
+    int fd = open("/proc/trace_events", O_WRONLY, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    ssize_t ret = write(fd, command, strlen(command));
+    close(fd);
+    return (ret < 0) ? -1 : 0;
+}
+
+/// @brief Reads `/proc/trace`, which consumes the records.
+/// @return the number of records read, or -1 on failure.
+static int trace_read(void)
+{
+    int fd = open("/proc/trace", O_RDONLY, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    size_t length = 0;
+    ssize_t ret;
+    while ((length < sizeof(records)) && ((ret = read(fd, (char *)records + length, sizeof(records) - length)) > 0)) {
+        length += ret;
+    }
+    close(fd);
+    return length / sizeof(trace_record_t);
+}
+
+int main(int argc, char *argv[])
+{
+    char text[512];
+    if ((events_write("bogus\n") != -1) || (errno != EINVAL)) {
+        printf("An unknown event should fail with EINVAL.\n");
+        return EXIT_FAILURE;
+    }
+    if (events_write("syscall_enter syscall_exit\n") < 0) {
+        printf("Failed to enable the events: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    int fd = open("/proc/trace_events", O_RDONLY, 0);
+    ssize_t length = (fd < 0) ? -1 : read(fd, text, sizeof(text) - 1);
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (length <= 0) {
+        printf("Failed to read the events: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    text[length] = 0;
+    if (!strstr(text, "syscall_enter 1") || !strstr(text, "syscall_exit 1") || !strstr(text, "kmalloc 0")) {
+        printf("The events are not listed as expected:\n%s", text);
+        return EXIT_FAILURE;
+    }
+    // Drop what was recorded so far.
+    trace_read();
+    pid_t pid = getpid();
+    for (int i = 0; i < 10; ++i) {
+        getpid();
+    }
+    if (events_write("none\n") < 0) {
+        printf("Failed to disable the events: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    int count = trace_read();
+    if (count < 0) {
+        printf("Failed to read the trace: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    int enters = 0, exits = 0;
+    for (int i = 0; i < count; ++i) {
+        if ((i > 0) && (records[i].cpu == records[i - 1].cpu) && (records[i].timestamp < records[i - 1].timestamp)) {
+            printf("The timestamps of CPU %u go backwards.\n", records[i].cpu);
+            return EXIT_FAILURE;
+        }
+        if ((records[i].pid != pid) || (records[i].args[0] != __NR_getpid)) {
+            continue;
+        }
+        if (records[i].event == TRACE_SYSCALL_ENTER) {
+            ++enters;
+        } else if ((records[i].event == TRACE_SYSCALL_EXIT) && (records[i].args[1] == (uint32_t)pid)) {
+            ++exits;
+        }
+    }
+    if ((enters < 10) || (exits < 10)) {
+        printf("Expected 10 traced calls to getpid, got %d entries and %d exits.\n", enters, exits);
+        return EXIT_FAILURE;
+    }
+    printf("The tracepoints work.\n");
+    return EXIT_SUCCESS;
+}
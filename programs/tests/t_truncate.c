@@ -0,0 +1,119 @@
+/// @file t_truncate.c
+/// @brief Tests truncate, ftruncate and O_TRUNC.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strerror.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/unistd.h>
+
+/// @brief Checks the size of the file.
+/// @param filename the file.
+/// @param expected the expected size.
+/// @return 0 if the size matches, 1 otherwise.
+static int check_size(const char *filename, off_t expected)
+{
+    stat_t st;
+    if (stat(filename, &st) < 0) {
+        printf("Failed to stat file %s: %s\n", filename, strerror(errno));
+        return 1;
+    }
+    if (st.st_size != expected) {
+        printf("Unexpected size %ld, expecting %ld.\n", st.st_size, expected);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    char *filename = "/home/user/test_truncate.txt";
+    static char buffer[4096];
+    // Create a file spanning the indirect blocks.
+    int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd < 0) {
+        printf("Failed to create file %s: %s\n", filename, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    memset(buffer, 'a', sizeof(buffer));
+    for (int i = 0; i < 64; ++i) {
+        if (write(fd, buffer, sizeof(buffer)) != sizeof(buffer)) {
+            printf("Failed to write on file %s: %s\n", filename, strerror(errno));
+            goto close_and_fail;
+        }
+    }
+    // Shrink it, the data before the new end must survive.
+    if (ftruncate(fd, 1000) < 0) {
+        printf("Failed to ftruncate file %s: %s\n", filename, strerror(errno));
+        goto close_and_fail;
+    }
+    if (check_size(filename, 1000)) {
+        goto close_and_fail;
+    }
+    // Extend it again, the extension must read as zeros.
+    if (ftruncate(fd, 5000) < 0) {
+        printf("Failed to ftruncate file %s: %s\n", filename, strerror(errno));
+        goto close_and_fail;
+    }
+    if (check_size(filename, 5000)) {
+        goto close_and_fail;
+    }
+    memset(buffer, 0xff, sizeof(buffer));
+    if (pread(fd, buffer, 1200, 0) != 1200) {
+        printf("Failed to read from file %s: %s\n", filename, strerror(errno));
+        goto close_and_fail;
+    }
+    for (int i = 0; i < 1200; ++i) {
+        if (buffer[i] != ((i < 1000) ? 'a' : 0)) {
+            printf("Unexpected byte 0x%02x at offset %d.\n", (unsigned char)buffer[i], i);
+            goto close_and_fail;
+        }
+    }
+    close(fd);
+    // Truncate it by path.
+    if (truncate(filename, 0) < 0) {
+        printf("Failed to truncate file %s: %s\n", filename, strerror(errno));
+        goto unlink_and_fail;
+    }
+    if (check_size(filename, 0)) {
+        goto unlink_and_fail;
+    }
+    // Opening it with O_TRUNC must empty it.
+    fd = open(filename, O_WRONLY, 0);
+    if ((fd < 0) || (write(fd, "fusrodah", 8) != 8)) {
+        printf("Failed to write on file %s: %s\n", filename, strerror(errno));
+        goto close_and_fail;
+    }
+    close(fd);
+    fd = open(filename, O_RDONLY | O_TRUNC, 0);
+    if (fd < 0) {
+        printf("Failed to open file %s: %s\n", filename, strerror(errno));
+        goto unlink_and_fail;
+    }
+    if (check_size(filename, 0)) {
+        goto close_and_fail;
+    }
+    // A file open for reading only cannot be truncated.
+    if ((ftruncate(fd, 10) != -1) || (errno != EINVAL)) {
+        printf("The ftruncate of a read-only file did not fail with EINVAL.\n");
+        goto close_and_fail;
+    }
+    close(fd);
+    // Neither can a negative size be set.
+    if ((truncate(filename, -1) != -1) || (errno != EINVAL)) {
+        printf("The truncate to a negative size did not fail with EINVAL.\n");
+        goto unlink_and_fail;
+    }
+    unlink(filename);
+    return EXIT_SUCCESS;
+
+close_and_fail:
+    close(fd);
+unlink_and_fail:
+    unlink(filename);
+    return EXIT_FAILURE;
+}
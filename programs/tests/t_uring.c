@@ -0,0 +1,109 @@
+/// @file t_uring.c
+/// @brief Test the system calls submitted in batches through a ring.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strerror.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/unistd.h>
+#include <sys/uring.h>
+
+/// The number of writes submitted in a single batch.
+#define WRITES 6
+
+/// @brief Queues a request.
+/// @param ring the ring.
+/// @param opcode the operation.
+/// @param fd the file descriptor.
+/// @param addr the buffer, or the path.
+/// @param len the length, or the flags.
+/// @param arg the extra argument.
+/// @return 0 on success, -1 if the queue is full.
+static int queue(uring_t *ring, unsigned int opcode, int fd, const void *addr, unsigned long len, unsigned long arg)
+{
+    uring_sqe_t *sqe = uring_get_sqe(ring);
+    if (sqe == NULL) {
+        return -1;
+    }
+    sqe->opcode    = opcode;
+    sqe->fd        = fd;
+    sqe->addr      = (unsigned long)addr;
+    sqe->len       = len;
+    sqe->arg       = arg;
+    sqe->user_data = ring->sq_tail;
+    uring_submit(ring);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    char *filename = "/home/user/test_uring.txt";
+    char buffer[WRITES * 4 + 1];
+    uring_cqe_t cqe;
+    stat_t st;
+    int fd, i;
+
+    uring_t *ring = uring_setup(6);
+    if (ring == NULL) {
+        printf("Failed to create the ring: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    if (ring->entries != 8) {
+        printf("The ring has %u entries, instead of 8.\n", ring->entries);
+        return EXIT_FAILURE;
+    }
+    // Open the file.
+    queue(ring, URING_OP_OPEN, -1, filename, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if ((uring_enter(ring) != 1) || !uring_peek_cqe(ring, &cqe) || (cqe.res < 0)) {
+        printf("Failed to open file %s.\n", filename);
+        return EXIT_FAILURE;
+    }
+    fd = (int)cqe.res;
+    // Write in a single batch, then check the size.
+    for (i = 0; i < WRITES; ++i) {
+        queue(ring, URING_OP_WRITE, fd, "abcd", 4, 0);
+    }
+    queue(ring, URING_OP_STAT, -1, filename, 0, (unsigned long)&st);
+    queue(ring, URING_OP_CLOSE, fd, NULL, 0, 0);
+    // The queue is full.
+    if (queue(ring, URING_OP_NOP, -1, NULL, 0, 0) == 0) {
+        printf("A full queue accepted a request.\n");
+        return EXIT_FAILURE;
+    }
+    if (uring_enter(ring) != WRITES + 2) {
+        printf("The kernel did not take the whole batch.\n");
+        return EXIT_FAILURE;
+    }
+    for (i = 0; i < WRITES + 2; ++i) {
+        long expected = (i < WRITES) ? 4 : 0;
+        if (!uring_peek_cqe(ring, &cqe) || (cqe.res != expected) || (cqe.user_data != (unsigned long)(i + 2))) {
+            printf("Request %d completed with %ld.\n", i, cqe.res);
+            goto unlink_and_fail;
+        }
+    }
+    if (uring_peek_cqe(ring, &cqe)) {
+        printf("There are more completions than requests.\n");
+        goto unlink_and_fail;
+    }
+    if (st.st_size != WRITES * 4) {
+        printf("The file is %ld bytes long, instead of %d.\n", (long)st.st_size, WRITES * 4);
+        goto unlink_and_fail;
+    }
+    // Check the content, with the usual system calls.
+    memset(buffer, 0, sizeof(buffer));
+    fd = open(filename, O_RDONLY, 0);
+    if ((fd < 0) || (read(fd, buffer, sizeof(buffer)) != WRITES * 4) || strncmp(buffer, "abcdabcd", 8)) {
+        printf("The file does not hold what was written.\n");
+        goto unlink_and_fail;
+    }
+    close(fd);
+    unlink(filename);
+    return EXIT_SUCCESS;
+unlink_and_fail:
+    unlink(filename);
+    return EXIT_FAILURE;
+}
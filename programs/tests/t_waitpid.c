@@ -0,0 +1,69 @@
+/// @file t_waitpid.c
+/// @brief Tests waiting for children, by pid and by process group.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <sys/unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strerror.h>
+#include <sys/errno.h>
+#include <sys/wait.h>
+#include <time.h>
+
+/// @brief Creates a child which sleeps, then exits with the given value.
+/// @param seconds how long the child sleeps.
+/// @param pgid the process group of the child, 0 for its own.
+/// @param code the exit value.
+/// @return the pid of the child.
+static pid_t spawn_child(unsigned seconds, pid_t pgid, int code)
+{
+    pid_t cpid = fork();
+    if (cpid == 0) {
+        sleep(seconds);
+        exit(code);
+    }
+    // The child sleeps, it is moved to the group long before it exits.
+    setpgid(cpid, pgid ? pgid : cpid);
+    return cpid;
+}
+
+int main(int argc, char *argv[])
+{
+    int status;
+    if ((waitpid(-1, &status, 0) != -1) || (errno != ECHILD)) {
+        printf("Waiting without children should fail with ECHILD.\n");
+        return EXIT_FAILURE;
+    }
+    pid_t first = spawn_child(1, 0, 1);
+    if (waitpid(first, &status, WNOHANG) != 0) {
+        printf("A running child should not be reaped with WNOHANG.\n");
+        return EXIT_FAILURE;
+    }
+    // Sleep until the child exits.
+    if ((waitpid(first, &status, 0) != first) || !WIFEXITED(status) || (WEXITSTATUS(status) != 1)) {
+        printf("Failed to wait for the child: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    // Two children in the same group, and one outside it.
+    pid_t leader = spawn_child(1, 0, 2);
+    pid_t member = spawn_child(1, leader, 3);
+    pid_t other  = spawn_child(2, 0, 4);
+    for (int i = 0; i < 2; ++i) {
+        pid_t cpid = waitpid(-leader, &status, 0);
+        if (((cpid != leader) && (cpid != member)) || !WIFEXITED(status)) {
+            printf("Failed to wait for the group: %s\n", strerror(errno));
+            return EXIT_FAILURE;
+        }
+    }
+    if ((waitpid(-leader, &status, 0) != -1) || (errno != ECHILD)) {
+        printf("The group should be empty.\n");
+        return EXIT_FAILURE;
+    }
+    if ((wait(&status) != other) || (WEXITSTATUS(status) != 4)) {
+        printf("Failed to wait for the last child: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    printf("Waitpid works.\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,74 @@
+/// @file t_yield.c
+/// @brief Tests sched_yield and sched_yield_to, with two processes taking
+/// turns on a shared counter.
+/// @copyright (c) 2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/errno.h>
+#include <sys/mman.h>
+#include <sys/unistd.h>
+#include <sys/wait.h>
+
+/// Number of times each process gets its turn.
+#define ROUNDS 200
+
+/// @brief Waits for the counter to become even (parent) or odd (child), and
+/// increments it, each time handing the CPU to the other process.
+/// @param counter the shared counter.
+/// @param parity the parity of the turns of the caller.
+/// @param other the other process.
+static void take_turns(volatile int *counter, int parity, pid_t other)
+{
+    for (int round = 0; round < ROUNDS; ++round) {
+        while ((*counter % 2) != parity) {
+            sched_yield_to(other);
+        }
+        ++(*counter);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int status;
+    if (sched_yield() < 0) {
+        perror("sched_yield");
+        return EXIT_FAILURE;
+    }
+    if ((sched_yield_to(-1) != -1) || (errno != ESRCH)) {
+        printf("Yielding to a missing process did not fail with ESRCH.\n");
+        return EXIT_FAILURE;
+    }
+    int fd = memfd_create("yield", 0);
+    if ((fd < 0) || (lseek(fd, 4095, SEEK_SET) < 0) || (write(fd, "", 1) != 1)) {
+        perror("memfd_create");
+        return EXIT_FAILURE;
+    }
+    volatile int *counter = mmap(NULL, 4096, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (counter == NULL) {
+        printf("Failed to map the counter.\n");
+        return EXIT_FAILURE;
+    }
+    *counter = 0;
+    pid_t parent = getpid();
+    pid_t child  = fork();
+    if (child == 0) {
+        take_turns(counter, 1, parent);
+        exit(EXIT_SUCCESS);
+    }
+    take_turns(counter, 0, child);
+    if ((waitpid(child, &status, 0) != child) || !WIFEXITED(status) || (WEXITSTATUS(status) != EXIT_SUCCESS)) {
+        printf("The child failed.\n");
+        return EXIT_FAILURE;
+    }
+    if (*counter != 2 * ROUNDS) {
+        printf("The counter is %d instead of %d.\n", *counter, 2 * ROUNDS);
+        return EXIT_FAILURE;
+    }
+    munmap((void *)counter, 4096);
+    close(fd);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,487 @@
+/// @file ext2_host.c
+/// @brief Checks and measures the ext2 driver on the host, on an image file.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// Usage: ext2_host [-v] [-d delay_us] image
+///
+/// The image must be a fresh ext2 filesystem, it is modified in place. Each
+/// step checks what it did: the lookups find the inodes, the directory lists
+/// every file it holds, the data reads back as it was written, and the free
+/// blocks and inodes of the superblock come back to their values once the
+/// files are removed. Each step also prints a measurement, in the format of
+/// the benchmarks of programs/bench:
+///
+///     bench <name> ops=<n> bytes=<n> usec=<n> nsec_per_op=<n>
+///     io <name> reads=<n> writes=<n>
+///
+/// The commands of the disk do not depend on the speed of the host, so a
+/// growing count exposes an algorithm that got worse. With -d, each command
+/// is held back to emulate a slower disk.
+
+#include "fcntl.h"
+#include "fs/vfs.h"
+#include "host.h"
+#include "shim.h"
+#include "stdio.h"
+#include "string.h"
+#include "sys/dirent.h"
+#include "sys/errno.h"
+
+/// The directory holding everything, on the ext2 root.
+#define ROOT_PATH "/ext2_host"
+/// The depth of the nested directories of the lookups.
+#define LOOKUP_DEPTH 8
+/// The number of lookups of the deepest path.
+#define LOOKUP_COUNT 2000
+/// The number of files created in a batch.
+#define BATCH_SIZE 256
+/// The number of batches, the directory ends up with all their files.
+#define BATCH_COUNT 4
+/// The size of the reads and the writes of the data.
+#define CHUNK_SIZE 4096
+/// The size of the files, past the double indirect blocks of 1 KiB blocks.
+#define FILE_SIZE (4 * 1024 * 1024)
+/// The number of chunks of a file.
+#define FILE_CHUNKS (FILE_SIZE / CHUNK_SIZE)
+/// The number of random reads and writes.
+#define RANDOM_COUNT 2048
+/// The size of the buffer of getdents.
+#define DIRENT_COUNT 32
+
+/// @brief A measurement in progress.
+typedef struct host_bench_t {
+    /// The name of the measurement.
+    const char *name;
+    /// The clock when it started.
+    uint32_t start_us;
+    /// The commands of the disk when it started.
+    host_disk_stats_t io;
+} host_bench_t;
+
+/// The data written, and read back.
+static char buffer[CHUNK_SIZE];
+/// The data expected from a read.
+static char expected[CHUNK_SIZE];
+/// The entries returned by getdents.
+static dirent_t dirents[DIRENT_COUNT];
+/// The files of the large directory seen by getdents.
+static char seen[BATCH_COUNT * BATCH_SIZE];
+
+/// @brief Starts a measurement.
+/// @param bench the measurement.
+/// @param name the name of the measurement.
+static void bench_start(host_bench_t *bench, const char *name)
+{
+    bench->name = name;
+    host_disk_stats(&bench->io);
+    bench->start_us = host_clock_us();
+}
+
+/// @brief Stops a measurement, and prints it.
+/// @param bench the measurement.
+/// @param ops the number of operations done.
+/// @param bytes the number of bytes transferred.
+static void bench_stop(host_bench_t *bench, uint32_t ops, uint32_t bytes)
+{
+    uint32_t usec = host_clock_us() - bench->start_us;
+    host_disk_stats_t io;
+    host_disk_stats(&io);
+    // Split the division, usec * 1000 does not fit 32 bits.
+    uint32_t nsec_per_op = (usec / ops) * 1000U + ((usec % ops) * 1000U) / ops;
+    printf("bench %s ops=%u bytes=%u usec=%u nsec_per_op=%u\n", bench->name, ops, bytes, usec, nsec_per_op);
+    printf("io %s reads=%u writes=%u\n", bench->name, io.reads - bench->io.reads, io.writes - bench->io.writes);
+}
+
+/// @brief Reads the free blocks and inodes from the superblock on the disk.
+/// @param free_blocks where the free blocks are stored.
+/// @param free_inodes where the free inodes are stored.
+/// @return 0 on success, -1 on failure.
+static int read_free_counts(uint32_t *free_blocks, uint32_t *free_inodes)
+{
+    uint32_t superblock[256];
+    if (vfs_sync() < 0) {
+        printf("sync failed\n");
+        return -1;
+    }
+    if (vfs_read(host_disk(), superblock, 1024, sizeof(superblock)) != sizeof(superblock)) {
+        printf("failed to read the superblock\n");
+        return -1;
+    }
+    *free_blocks = superblock[3];
+    *free_inodes = superblock[4];
+    return 0;
+}
+
+/// @brief Fills a chunk with data depending on its index.
+/// @param data the chunk.
+/// @param index the index of the chunk inside the file.
+/// @param generation changes the data of a chunk written again.
+static void fill_chunk(char *data, uint32_t index, uint32_t generation)
+{
+    memset(data, (int)((index * 37U + generation * 101U + 11U) & 0xFFU), CHUNK_SIZE);
+    memcpy(data, &index, sizeof(index));
+    memcpy(data + CHUNK_SIZE - sizeof(generation), &generation, sizeof(generation));
+}
+
+/// @brief Returns a pseudo-random number.
+/// @param state the state of the generator.
+/// @return the number.
+static uint32_t next_random(uint32_t *state)
+{
+    *state = *state * 1103515245U + 12345U;
+    return *state >> 16;
+}
+
+/// @brief Builds the path of a file of the large directory.
+/// @param path where the path is stored.
+/// @param index the index of the file.
+static void file_path(char *path, unsigned index)
+{
+    sprintf(path, "%s/big/file_%05u", ROOT_PATH, index);
+}
+
+/// @brief Looks up a deep path many times.
+/// @return 0 on success, -1 on failure.
+static int test_lookup(void)
+{
+    char path[256] = ROOT_PATH;
+    host_bench_t bench;
+    stat_t st;
+    int ret;
+    for (unsigned depth = 0; depth < LOOKUP_DEPTH; ++depth) {
+        sprintf(path + strlen(path), "/d%u", depth);
+        if ((ret = vfs_mkdir(path, 0755)) < 0) {
+            printf("mkdir %s: %d\n", path, ret);
+            return -1;
+        }
+    }
+    bench_start(&bench, "ext2_lookup_deep");
+    for (unsigned i = 0; i < LOOKUP_COUNT; ++i) {
+        if ((ret = vfs_stat(path, &st)) < 0) {
+            printf("stat %s: %d\n", path, ret);
+            return -1;
+        }
+    }
+    bench_stop(&bench, LOOKUP_COUNT, 0);
+    if (!S_ISDIR(st.st_mode) || (st.st_ino == 0)) {
+        printf("stat %s: not a directory (mode %o, inode %u)\n", path, st.st_mode, st.st_ino);
+        return -1;
+    }
+    for (unsigned depth = LOOKUP_DEPTH; depth > 0; --depth) {
+        if ((ret = vfs_rmdir(path)) < 0) {
+            printf("rmdir %s: %d\n", path, ret);
+            return -1;
+        }
+        *strrchr(path, '/') = 0;
+    }
+    if (vfs_stat(ROOT_PATH "/d0", &st) >= 0) {
+        printf("stat %s/d0: found after rmdir\n", ROOT_PATH);
+        return -1;
+    }
+    return 0;
+}
+
+/// @brief Lists the large directory.
+/// @param count the number of files it should hold.
+/// @return 0 on success, -1 on failure.
+static int list_directory(unsigned count)
+{
+    char path[256];
+    unsigned found = 0;
+    off_t offset   = 0;
+    ssize_t size;
+    sprintf(path, "%s/big", ROOT_PATH);
+    vfs_file_t *directory = vfs_open(path, O_RDONLY | O_DIRECTORY, 0);
+    if (directory == NULL) {
+        printf("open %s: %d\n", path, errno);
+        return -1;
+    }
+    memset(seen, 0, sizeof(seen));
+    while ((size = vfs_getdents(directory, dirents, offset, sizeof(dirents))) > 0) {
+        for (ssize_t it = 0; it < size; it += sizeof(dirent_t)) {
+            dirent_t *entry = &dirents[it / sizeof(dirent_t)];
+            if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, "..")) {
+                continue;
+            }
+            unsigned index = (unsigned)atoi(entry->d_name + 5);
+            if (strncmp(entry->d_name, "file_", 5) || (index >= count) || seen[index]) {
+                printf("getdents %s: unexpected entry `%s`\n", path, entry->d_name);
+                vfs_close(directory);
+                return -1;
+            }
+            seen[index] = 1;
+            ++found;
+        }
+        // Like sys_getdents, the offset counts the bytes returned.
+        offset += size;
+    }
+    vfs_close(directory);
+    if ((size < 0) || (found != count)) {
+        printf("getdents %s: %u entries instead of %u (%d)\n", path, found, count, size);
+        return -1;
+    }
+    return 0;
+}
+
+/// @brief Fills a directory in batches, then lists it, looks up and removes
+/// its files.
+/// @return 0 on success, -1 on failure.
+static int test_directory(void)
+{
+    char path[256], name[32];
+    host_bench_t bench;
+    stat_t st;
+    int ret;
+    sprintf(path, "%s/big", ROOT_PATH);
+    if ((ret = vfs_mkdir(path, 0755)) < 0) {
+        printf("mkdir %s: %d\n", path, ret);
+        return -1;
+    }
+    for (unsigned batch = 0; batch < BATCH_COUNT; ++batch) {
+        sprintf(name, "ext2_create_%u", batch);
+        bench_start(&bench, name);
+        for (unsigned i = batch * BATCH_SIZE; i < (batch + 1) * BATCH_SIZE; ++i) {
+            file_path(path, i);
+            vfs_file_t *file = vfs_creat(path, 0644);
+            if (file == NULL) {
+                printf("creat %s: %d\n", path, errno);
+                return -1;
+            }
+            vfs_close(file);
+        }
+        bench_stop(&bench, BATCH_SIZE, 0);
+    }
+    bench_start(&bench, "ext2_lookup_wide");
+    for (unsigned i = 0; i < BATCH_COUNT * BATCH_SIZE; ++i) {
+        file_path(path, i);
+        if ((ret = vfs_stat(path, &st)) < 0) {
+            printf("stat %s: %d\n", path, ret);
+            return -1;
+        }
+    }
+    bench_stop(&bench, BATCH_COUNT * BATCH_SIZE, 0);
+    bench_start(&bench, "ext2_readdir");
+    if (list_directory(BATCH_COUNT * BATCH_SIZE) < 0) {
+        return -1;
+    }
+    bench_stop(&bench, BATCH_COUNT * BATCH_SIZE, 0);
+    bench_start(&bench, "ext2_unlink");
+    for (unsigned i = 0; i < BATCH_COUNT * BATCH_SIZE; ++i) {
+        file_path(path, i);
+        if ((ret = vfs_unlink(path)) < 0) {
+            printf("unlink %s: %d\n", path, ret);
+            return -1;
+        }
+    }
+    bench_stop(&bench, BATCH_COUNT * BATCH_SIZE, 0);
+    if (list_directory(0) < 0) {
+        return -1;
+    }
+    sprintf(path, "%s/big", ROOT_PATH);
+    if ((ret = vfs_rmdir(path)) < 0) {
+        printf("rmdir %s: %d\n", path, ret);
+        return -1;
+    }
+    return 0;
+}
+
+/// @brief Checks the content of a chunk of a file.
+/// @param file the file.
+/// @param index the index of the chunk.
+/// @param generation the generation it was last written with.
+/// @return 0 on success, -1 on failure.
+static int check_chunk(vfs_file_t *file, uint32_t index, uint32_t generation)
+{
+    fill_chunk(expected, index, generation);
+    if (vfs_read(file, buffer, index * CHUNK_SIZE, CHUNK_SIZE) != CHUNK_SIZE) {
+        printf("read %s: failed at chunk %u\n", file->name, index);
+        return -1;
+    }
+    if (memcmp(buffer, expected, CHUNK_SIZE)) {
+        printf("read %s: wrong data at chunk %u\n", file->name, index);
+        return -1;
+    }
+    return 0;
+}
+
+/// @brief Writes a file sequentially then randomly, and reads it back the
+/// same ways.
+/// @return 0 on success, -1 on failure.
+static int test_data(void)
+{
+    static uint32_t generations[FILE_CHUNKS];
+    const char *path = ROOT_PATH "/data";
+    host_bench_t bench;
+    uint32_t state = 42;
+    vfs_file_t *file = vfs_open(path, O_RDWR | O_CREAT, 0644);
+    if (file == NULL) {
+        printf("open %s: %d\n", path, errno);
+        return -1;
+    }
+    bench_start(&bench, "ext2_write_seq");
+    for (uint32_t i = 0; i < FILE_CHUNKS; ++i) {
+        fill_chunk(buffer, i, 0);
+        if (vfs_write(file, buffer, i * CHUNK_SIZE, CHUNK_SIZE) != CHUNK_SIZE) {
+            printf("write %s: failed at chunk %u\n", path, i);
+            goto close_and_fail;
+        }
+    }
+    bench_stop(&bench, FILE_CHUNKS, FILE_SIZE);
+    bench_start(&bench, "ext2_read_seq");
+    for (uint32_t i = 0; i < FILE_CHUNKS; ++i) {
+        if (check_chunk(file, i, 0) < 0) {
+            goto close_and_fail;
+        }
+    }
+    bench_stop(&bench, FILE_CHUNKS, FILE_SIZE);
+    bench_start(&bench, "ext2_write_random");
+    for (uint32_t i = 0; i < RANDOM_COUNT; ++i) {
+        uint32_t index = next_random(&state) % FILE_CHUNKS;
+        fill_chunk(buffer, index, ++generations[index]);
+        if (vfs_write(file, buffer, index * CHUNK_SIZE, CHUNK_SIZE) != CHUNK_SIZE) {
+            printf("write %s: failed at chunk %u\n", path, index);
+            goto close_and_fail;
+        }
+    }
+    bench_stop(&bench, RANDOM_COUNT, RANDOM_COUNT * CHUNK_SIZE);
+    bench_start(&bench, "ext2_read_random");
+    for (uint32_t i = 0; i < RANDOM_COUNT; ++i) {
+        uint32_t index = next_random(&state) % FILE_CHUNKS;
+        if (check_chunk(file, index, generations[index]) < 0) {
+            goto close_and_fail;
+        }
+    }
+    bench_stop(&bench, RANDOM_COUNT, RANDOM_COUNT * CHUNK_SIZE);
+    vfs_close(file);
+    // Read it again once it is back on the disk.
+    if (vfs_sync() < 0) {
+        printf("sync failed\n");
+        return -1;
+    }
+    if ((file = vfs_open(path, O_RDONLY, 0)) == NULL) {
+        printf("open %s: %d\n", path, errno);
+        return -1;
+    }
+    for (uint32_t i = 0; i < FILE_CHUNKS; ++i) {
+        if (check_chunk(file, i, generations[i]) < 0) {
+            goto close_and_fail;
+        }
+    }
+    vfs_close(file);
+    int ret = vfs_unlink(path);
+    if (ret < 0) {
+        printf("unlink %s: %d\n", path, ret);
+        return -1;
+    }
+    return 0;
+close_and_fail:
+    vfs_close(file);
+    return -1;
+}
+
+/// @brief Grows a file with small writes, then releases its blocks, and
+/// checks that the superblock gets back its free blocks and inodes.
+/// @return 0 on success, -1 on failure.
+static int test_allocation(void)
+{
+    const char *path = ROOT_PATH "/grow";
+    uint32_t free_blocks, free_inodes, blocks, inodes;
+    host_bench_t bench;
+    if (read_free_counts(&free_blocks, &free_inodes) < 0) {
+        return -1;
+    }
+    vfs_file_t *file = vfs_open(path, O_RDWR | O_CREAT, 0644);
+    if (file == NULL) {
+        printf("open %s: %d\n", path, errno);
+        return -1;
+    }
+    memset(buffer, 0x5A, sizeof(buffer));
+    bench_start(&bench, "ext2_append");
+    for (uint32_t offset = 0; offset < FILE_SIZE; offset += 1024) {
+        if (vfs_write(file, buffer, offset, 1024) != 1024) {
+            printf("write %s: failed at %u\n", path, offset);
+            vfs_close(file);
+            return -1;
+        }
+    }
+    bench_stop(&bench, FILE_SIZE / 1024, FILE_SIZE);
+    vfs_close(file);
+    if (read_free_counts(&blocks, &inodes) < 0) {
+        return -1;
+    }
+    if ((inodes != free_inodes - 1) || (free_blocks - blocks < FILE_SIZE / CHUNK_SIZE)) {
+        printf("allocation: %u blocks and %u inodes used\n", free_blocks - blocks, free_inodes - inodes);
+        return -1;
+    }
+    bench_start(&bench, "ext2_release");
+    int ret = vfs_unlink(path);
+    if (ret < 0) {
+        printf("unlink %s: %d\n", path, ret);
+        return -1;
+    }
+    bench_stop(&bench, 1, FILE_SIZE);
+    if (read_free_counts(&blocks, &inodes) < 0) {
+        return -1;
+    }
+    if ((blocks != free_blocks) || (inodes != free_inodes)) {
+        printf("release: %d blocks and %d inodes leaked\n", free_blocks - blocks, free_inodes - inodes);
+        return -1;
+    }
+    return 0;
+}
+
+/// @brief Prints how to use the harness.
+/// @return the exit status.
+static int usage(void)
+{
+    printf("usage: ext2_host [-v] [-d delay_us] image\n");
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *image = NULL;
+    uint32_t delay_us = 0;
+    int ret;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-v")) {
+            host_verbose = 1;
+        } else if (!strcmp(argv[i], "-d") && (i + 1 < argc)) {
+            delay_us = (uint32_t)atoi(argv[++i]);
+        } else if ((argv[i][0] != '-') && (image == NULL)) {
+            image = argv[i];
+        } else {
+            return usage();
+        }
+    }
+    if (image == NULL) {
+        return usage();
+    }
+    if (host_vfs_init(image, delay_us) < 0) {
+        printf("Failed to mount `%s`.\n", image);
+        return 1;
+    }
+    if ((ret = vfs_mkdir(ROOT_PATH, 0755)) < 0) {
+        printf("mkdir %s: %d\n", ROOT_PATH, ret);
+        return 1;
+    }
+    ret = test_lookup();
+    if (!ret) {
+        ret = test_directory();
+    }
+    if (!ret) {
+        ret = test_data();
+    }
+    if (!ret) {
+        ret = test_allocation();
+    }
+    if (!ret && ((ret = vfs_rmdir(ROOT_PATH)) < 0)) {
+        printf("rmdir %s: %d\n", ROOT_PATH, ret);
+    }
+    if (vfs_sync() < 0) {
+        printf("sync failed\n");
+        ret = -1;
+    }
+    return ret ? 1 : 0;
+}
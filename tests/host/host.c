@@ -0,0 +1,138 @@
+/// @file host.c
+/// @brief The few Linux system calls used by the host-side harness.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include "host.h"
+
+/// @defgroup host_syscalls Numbers of the i386 system calls of Linux.
+/// @{
+#define HOST_NR_EXIT_GROUP     252
+#define HOST_NR_WRITE          4
+#define HOST_NR_OPEN           5
+#define HOST_NR_CLOSE          6
+#define HOST_NR_TIME           13
+#define HOST_NR_BRK            45
+#define HOST_NR_PREAD64        180
+#define HOST_NR_PWRITE64       181
+#define HOST_NR_CLOCK_GETTIME64 403
+/// @}
+
+/// O_RDWR of the host.
+#define HOST_O_RDWR 2
+/// CLOCK_MONOTONIC of the host.
+#define HOST_CLOCK_MONOTONIC 1
+
+/// @brief The time returned by clock_gettime64, whose fields have 64 bits
+/// (int64_t of the libc is 32 bits wide).
+struct host_timespec {
+    /// The seconds.
+    long long tv_sec;
+    /// The nanoseconds.
+    long long tv_nsec;
+};
+
+/// @brief Calls the host with up to five arguments.
+/// @param nr the number of the system call.
+/// @param a the first argument.
+/// @param b the second argument.
+/// @param c the third argument.
+/// @param d the fourth argument.
+/// @param e the fifth argument.
+/// @return the value returned by the host, a negative error number on failure.
+static inline long host_syscall(long nr, long a, long b, long c, long d, long e)
+{
+    long ret;
+    __asm__ __volatile__("int $0x80"
+                         : "=a"(ret)
+                         : "a"(nr), "b"(a), "c"(b), "d"(c), "S"(d), "D"(e)
+                         : "memory");
+    return ret;
+}
+
+int host_open(const char *path)
+{
+    return (int)host_syscall(HOST_NR_OPEN, (long)path, HOST_O_RDWR, 0, 0, 0);
+}
+
+void host_close(int fd)
+{
+    host_syscall(HOST_NR_CLOSE, fd, 0, 0, 0, 0);
+}
+
+ssize_t host_pread(int fd, void *buffer, size_t size, uint32_t offset)
+{
+    return host_syscall(HOST_NR_PREAD64, fd, (long)buffer, (long)size, (long)offset, 0);
+}
+
+ssize_t host_pwrite(int fd, const void *buffer, size_t size, uint32_t offset)
+{
+    return host_syscall(HOST_NR_PWRITE64, fd, (long)buffer, (long)size, (long)offset, 0);
+}
+
+void host_write(int fd, const void *buffer, size_t size)
+{
+    const char *it = buffer;
+    while (size > 0) {
+        long written = host_syscall(HOST_NR_WRITE, fd, (long)it, (long)size, 0, 0);
+        if (written <= 0) {
+            return;
+        }
+        it += written;
+        size -= written;
+    }
+}
+
+void *host_sbrk(size_t size)
+{
+    static uintptr_t end = 0;
+    if (end == 0) {
+        end = (uintptr_t)host_syscall(HOST_NR_BRK, 0, 0, 0, 0, 0);
+    }
+    uintptr_t start = end, new_end = end + size;
+    if ((uintptr_t)host_syscall(HOST_NR_BRK, (long)new_end, 0, 0, 0, 0) != new_end) {
+        return NULL;
+    }
+    end = new_end;
+    return (void *)start;
+}
+
+time_t host_time(void)
+{
+    return (time_t)host_syscall(HOST_NR_TIME, 0, 0, 0, 0, 0);
+}
+
+uint32_t host_clock_us(void)
+{
+    struct host_timespec ts;
+    host_syscall(HOST_NR_CLOCK_GETTIME64, HOST_CLOCK_MONOTONIC, (long)&ts, 0, 0, 0);
+    // Only 32-bit divisions, there is no libgcc for i386 on the host.
+    return (uint32_t)ts.tv_sec * 1000000U + (uint32_t)ts.tv_nsec / 1000U;
+}
+
+void host_exit(int status)
+{
+    for (;;) {
+        host_syscall(HOST_NR_EXIT_GROUP, status, 0, 0, 0, 0);
+    }
+}
+
+/// @brief Collects the arguments left on the stack by the host.
+/// @param stack the stack when the process started.
+void host_start(uint32_t *stack) __attribute__((noreturn, used));
+
+void host_start(uint32_t *stack)
+{
+    host_exit(main((int)stack[0], (char **)(stack + 1)));
+}
+
+// The stack holds argc, then argv; keep it aligned to 16 bytes for the calls.
+__asm__(".globl _start\n"
+        "_start:\n"
+        "    xorl %ebp, %ebp\n"
+        "    movl %esp, %eax\n"
+        "    andl $-16, %esp\n"
+        "    subl $12, %esp\n"
+        "    pushl %eax\n"
+        "    call host_start\n"
+        "    hlt\n");
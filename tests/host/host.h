@@ -0,0 +1,70 @@
+/// @file host.h
+/// @brief The few Linux system calls used by the host-side harness.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// The kernel sources are built with -nostdinc, against the headers of the
+/// libc of MentOS, so the harness cannot link the C library of the host.
+/// It is a static i386 binary with its own entry point, which talks to the
+/// host through `int $0x80`.
+
+#pragma once
+
+#include "stddef.h"
+#include "stdint.h"
+#include "sys/types.h"
+#include "time.h"
+
+/// @brief Opens a file of the host for reading and writing.
+/// @param path the path of the file.
+/// @return the descriptor, a negative error number on failure.
+int host_open(const char *path);
+
+/// @brief Closes a descriptor of the host.
+/// @param fd the descriptor.
+void host_close(int fd);
+
+/// @brief Reads from a file of the host at the given offset.
+/// @param fd the descriptor.
+/// @param buffer where the data is stored.
+/// @param size the number of bytes.
+/// @param offset the offset inside the file.
+/// @return the number of bytes read, a negative error number on failure.
+ssize_t host_pread(int fd, void *buffer, size_t size, uint32_t offset);
+
+/// @brief Writes to a file of the host at the given offset.
+/// @param fd the descriptor.
+/// @param buffer the data.
+/// @param size the number of bytes.
+/// @param offset the offset inside the file.
+/// @return the number of bytes written, a negative error number on failure.
+ssize_t host_pwrite(int fd, const void *buffer, size_t size, uint32_t offset);
+
+/// @brief Writes to the standard output, or to the standard error.
+/// @param fd 1 or 2.
+/// @param buffer the data.
+/// @param size the number of bytes.
+void host_write(int fd, const void *buffer, size_t size);
+
+/// @brief Moves the end of the heap of the process.
+/// @param size the number of bytes to add.
+/// @return the start of the new memory, NULL if the host refused.
+void *host_sbrk(size_t size);
+
+/// @brief Returns the time of the host, in seconds since the epoch.
+/// @return the time.
+time_t host_time(void);
+
+/// @brief Returns the monotonic clock of the host, in microseconds.
+/// @return the microseconds, wrapping after about 71 minutes.
+uint32_t host_clock_us(void);
+
+/// @brief Terminates the process.
+/// @param status the exit status.
+void host_exit(int status) __attribute__((noreturn));
+
+/// @brief The entry point of the harness, called by _start.
+/// @param argc the number of arguments.
+/// @param argv the arguments.
+/// @return the exit status.
+int main(int argc, char *argv[]);
@@ -0,0 +1,204 @@
+/// @file sched_host.c
+/// @brief Checks the load balancer of the scheduler on the host.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// Usage: sched_host [-v]
+///
+/// While the application processors are parked, only the runqueue of the
+/// bootstrap processor ever holds tasks, and scheduler_load_balance has
+/// nothing to pull. The harness builds the scheduler around its runqueues,
+/// fills the one of a second CPU by hand, and checks that the balancer pulls
+/// the tasks it should into the runqueue of the calling CPU, and leaves the
+/// others where they are.
+
+// The harness runs in user space, where cli faults: the interrupts stay as
+// they are, there are none to mask.
+#include "klib/irqflags.h"
+#undef irq_enable
+#undef irq_disable
+/// @brief Leaves the interrupts as they are.
+#define irq_enable(flags) ((void)(flags))
+/// @brief Leaves the interrupts as they are.
+#define irq_disable() ((uint8_t)0)
+
+// The scheduler is built inside the harness, so that its runqueues can be
+// filled directly.
+#include "process/scheduler.c"
+
+#include "host.h"
+#include "stdio.h"
+#include "string.h"
+
+/// The number of tasks queued on the busy CPU.
+#define TASK_COUNT 8
+
+/// Set by -v, prints all the messages of the kernel instead of the errors.
+extern int host_verbose;
+/// The tick returned by timer_get_ticks.
+extern unsigned long host_ticks;
+
+/// The task running the harness, the current one of the calling CPU.
+static task_struct harness_task;
+/// The tasks of the test.
+static task_struct tasks[TASK_COUNT];
+/// The CPU running the harness, as the scheduler sees it.
+static unsigned this_cpu_id;
+/// The CPU whose runqueue is filled.
+static unsigned busy_cpu_id;
+
+/// @brief Creates a task, and queues it on the calling CPU.
+/// @param task the task.
+/// @param pid its pid.
+/// @param state its state.
+static void task_setup(task_struct *task, pid_t pid, long state)
+{
+    memset(task, 0, sizeof(task_struct));
+    task->pid          = pid;
+    task->pgid         = pid;
+    task->sid          = pid;
+    task->state        = state;
+    task->se.prio      = DEFAULT_PRIO;
+    task->se.policy    = SCHED_OTHER;
+    task->cpus_allowed = ~0U;
+    list_head_init(&task->run_list);
+    list_head_init(&task->pgrp_link);
+    list_head_init(&task->session_link);
+    scheduler_enqueue_task(task);
+}
+
+/// @brief Counts the tasks of the test held by a runqueue.
+/// @param cpu the CPU of the runqueue.
+/// @return the number of tasks.
+static unsigned count_on(unsigned cpu)
+{
+    unsigned count = 0;
+    for (unsigned i = 0; i < TASK_COUNT; ++i) {
+        count += tasks[i].se.cpu == cpu;
+    }
+    return count;
+}
+
+/// @brief Checks that the runqueues agree with the tasks they hold.
+/// @return 0 on success, -1 on failure.
+static int check_runqueues(void)
+{
+    for (unsigned cpu = 0; cpu < smp_num_cpus; ++cpu) {
+        if (runqueues[cpu].num_ready != count_on(cpu)) {
+            printf("CPU %u holds %u tasks, but counts %u ready.\n", cpu, count_on(cpu), runqueues[cpu].num_ready);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/// @brief An idle CPU pulls a single task, the cache-hot and pinned ones
+/// stay where they are.
+/// @return 0 on success, -1 on failure.
+static int test_idle_pull(void)
+{
+    // Every task but the last two ran long ago.
+    host_ticks = 1000;
+    for (unsigned i = 0; i < TASK_COUNT; ++i) {
+        tasks[i].se.exec_start = (i < TASK_COUNT - 2) ? 0 : host_ticks;
+    }
+    // The first one can only run on the busy CPU.
+    tasks[0].cpus_allowed = 1U << busy_cpu_id;
+    if (scheduler_load_balance(true) != 1) {
+        printf("The idle balance did not pull a task.\n");
+        return -1;
+    }
+    if ((count_on(this_cpu_id) != 1) || (tasks[0].se.cpu != busy_cpu_id)) {
+        printf("The idle balance pulled the wrong task.\n");
+        return -1;
+    }
+    if ((tasks[TASK_COUNT - 1].se.cpu != busy_cpu_id) || (tasks[TASK_COUNT - 2].se.cpu != busy_cpu_id)) {
+        printf("The idle balance pulled a cache-hot task.\n");
+        return -1;
+    }
+    return check_runqueues();
+}
+
+/// @brief The periodic balance pulls half of the imbalance, once every
+/// BALANCE_INTERVAL ticks.
+/// @return 0 on success, -1 on failure.
+static int test_periodic_pull(void)
+{
+    // The busy CPU holds 7 tasks, this one 1: pull (7 - 1) / 2 = 3, of the 4
+    // which can move.
+    int moved = scheduler_load_balance(false);
+    if (moved != 3) {
+        printf("The periodic balance pulled %d tasks instead of 3.\n", moved);
+        return -1;
+    }
+    if (count_on(this_cpu_id) != 4) {
+        printf("This CPU holds %u tasks instead of 4.\n", count_on(this_cpu_id));
+        return -1;
+    }
+    // Not again before the interval elapsed.
+    if (scheduler_load_balance(false) != 0) {
+        printf("The periodic balance ran before its interval.\n");
+        return -1;
+    }
+    return check_runqueues();
+}
+
+/// @brief A balanced pair of CPUs is left alone.
+/// @return 0 on success, -1 on failure.
+static int test_balanced(void)
+{
+    host_ticks += BALANCE_INTERVAL;
+    if (scheduler_load_balance(false) != 0) {
+        printf("The periodic balance moved tasks between balanced CPUs.\n");
+        return -1;
+    }
+    return check_runqueues();
+}
+
+int main(int argc, char *argv[])
+{
+    int ret;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-v")) {
+            printf("usage: sched_host [-v]\n");
+            return 1;
+        }
+        host_verbose = 1;
+    }
+    // The scheduler finds its CPU through the task register.
+    this_cpu_id = smp_processor_id();
+    if (this_cpu_id >= SMP_MAX_CPUS) {
+        printf("The host reports CPU %u, skipping.\n", this_cpu_id);
+        return 77;
+    }
+    busy_cpu_id  = (this_cpu_id + 1) % SMP_MAX_CPUS;
+    smp_num_cpus = SMP_MAX_CPUS;
+    cpus[this_cpu_id].online = true;
+    cpus[busy_cpu_id].online = true;
+    scheduler_initialize();
+    // The harness is the current task of its CPU, and it is not ready.
+    task_setup(&harness_task, 1, TASK_UNINTERRUPTIBLE);
+    // New tasks start on the calling CPU, move them like the affinity does.
+    for (unsigned i = 0; i < TASK_COUNT; ++i) {
+        task_setup(&tasks[i], (pid_t)(i + 2), TASK_RUNNING);
+        __move_task(&tasks[i], busy_cpu_id);
+    }
+    if (count_on(busy_cpu_id) != TASK_COUNT) {
+        printf("The tasks did not reach CPU %u.\n", busy_cpu_id);
+        return 1;
+    }
+    ret = check_runqueues();
+    if (!ret) {
+        ret = test_idle_pull();
+    }
+    if (!ret) {
+        ret = test_periodic_pull();
+    }
+    if (!ret) {
+        ret = test_balanced();
+    }
+    if (!ret) {
+        printf("CPU %u pulled %u of %u tasks from CPU %u.\n", this_cpu_id, count_on(this_cpu_id), TASK_COUNT, busy_cpu_id);
+    }
+    return ret ? 1 : 0;
+}
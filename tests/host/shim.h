@@ -0,0 +1,44 @@
+/// @file shim.h
+/// @brief The virtual filesystem and the block device of the host-side
+/// harness.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// The harness mounts an image file as the ext2 root, and reaches it through
+/// the vfs_* functions of fs/vfs.h, like the system calls do. The disk is a
+/// file of the host: every command reaching it is counted, and can be held
+/// back to emulate a slower disk.
+
+#pragma once
+
+#include "fs/vfs.h"
+
+/// @brief The commands which reached the disk.
+typedef struct host_disk_stats_t {
+    /// The number of reads.
+    uint32_t reads;
+    /// The number of writes.
+    uint32_t writes;
+    /// The number of bytes read.
+    uint32_t read_bytes;
+    /// The number of bytes written.
+    uint32_t written_bytes;
+} host_disk_stats_t;
+
+/// Set by -v, prints all the messages of the kernel instead of the errors.
+extern int host_verbose;
+
+/// @brief Initializes the caches and ext2, then mounts the image as the root.
+/// @param image the path of the image, on the host.
+/// @param delay_us the time each command of the disk is held back, in
+/// microseconds.
+/// @return 0 on success, -1 on failure.
+int host_vfs_init(const char *image, uint32_t delay_us);
+
+/// @brief Returns the commands which reached the disk so far.
+/// @param stats where the counters are stored.
+void host_disk_stats(host_disk_stats_t *stats);
+
+/// @brief Returns the device holding the image.
+/// @return the block device.
+vfs_file_t *host_disk(void);
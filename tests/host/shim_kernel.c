@@ -0,0 +1,365 @@
+/// @file shim_kernel.c
+/// @brief The services of the kernel used by ext2, on top of the host.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// The harness runs on a single thread, so the locks only record their
+/// owner, the wait queues are never slept on, and there is no flusher
+/// thread: the dirty buffers are written back by vfs_sync, or when the
+/// buffer cache evicts them. The memory comes from power-of-two free lists
+/// carved out of the heap of the process.
+
+#include "assert.h"
+#include "drivers/rtc.h"
+#include "fs/aio.h"
+#include "fs/bio.h"
+#include "hardware/hrtimer.h"
+#include "hardware/timer.h"
+#include "host.h"
+#include "io/console.h"
+#include "io/debug.h"
+#include "klib/mutex.h"
+#include "klib/spinlock.h"
+#include "mem/shrinker.h"
+#include "mem/slab.h"
+#include "process/process.h"
+#include "process/scheduler.h"
+#include "process/wait.h"
+#include "stdio.h"
+#include "string.h"
+#include "sys/errno.h"
+#include "system/syscall.h"
+
+/// Set by -v, prints all the messages of the kernel instead of the errors.
+int host_verbose = 0;
+
+// ============================================================================
+// Memory
+// ============================================================================
+
+/// The smallest allocation, 16 bytes.
+#define HEAP_MIN_ORDER 4
+/// The largest allocation, 64 MiB.
+#define HEAP_MAX_ORDER 26
+
+/// @brief Placed right before each allocation.
+typedef struct heap_header_t {
+    /// The start of the chunk holding the allocation.
+    void *chunk;
+    /// The chunk holds 1 << order bytes.
+    uint32_t order;
+    /// Keeps the allocations aligned to 16 bytes.
+    uint32_t padding[2];
+} heap_header_t;
+
+/// The free chunks, by order, linked through their first word.
+static void *heap_free[HEAP_MAX_ORDER + 1];
+
+/// @brief Allocates memory with the given alignment.
+/// @param size the size of the allocation.
+/// @param align the alignment, a power of two.
+/// @return the memory, NULL if the host has none left.
+static void *heap_alloc(size_t size, size_t align)
+{
+    size_t total   = size + sizeof(heap_header_t) + ((align > sizeof(heap_header_t)) ? align : 0);
+    uint32_t order = HEAP_MIN_ORDER;
+    while ((1U << order) < total) {
+        if (++order > HEAP_MAX_ORDER) {
+            return NULL;
+        }
+    }
+    void *chunk = heap_free[order];
+    if (chunk) {
+        heap_free[order] = *(void **)chunk;
+    } else if ((chunk = host_sbrk(1U << order)) == NULL) {
+        return NULL;
+    }
+    uintptr_t address = (uintptr_t)chunk + sizeof(heap_header_t);
+    if (align > sizeof(heap_header_t)) {
+        address = (address + align - 1) & ~(uintptr_t)(align - 1);
+    }
+    heap_header_t *header = (heap_header_t *)address - 1;
+    header->chunk         = chunk;
+    header->order         = order;
+    return (void *)address;
+}
+
+/// @brief Gives back memory returned by heap_alloc.
+/// @param address the memory, can be NULL.
+static void heap_release(void *address)
+{
+    if (address) {
+        heap_header_t *header  = (heap_header_t *)address - 1;
+        void *chunk            = header->chunk;
+        *(void **)chunk        = heap_free[header->order];
+        heap_free[header->order] = chunk;
+    }
+}
+
+void *kmalloc(unsigned int size)
+{
+    return heap_alloc(size, sizeof(heap_header_t));
+}
+
+void kfree(void *ptr)
+{
+    heap_release(ptr);
+}
+
+kmem_cache_t *kmem_cache_create(
+    const char *name,
+    unsigned int size,
+    unsigned int align,
+    slab_flags_t flags,
+    kmem_fun_t ctor,
+    kmem_fun_t dtor)
+{
+    kmem_cache_t *cachep = heap_alloc(sizeof(kmem_cache_t), sizeof(heap_header_t));
+    if (cachep == NULL) {
+        return NULL;
+    }
+    memset(cachep, 0, sizeof(kmem_cache_t));
+    cachep->name        = name;
+    cachep->size        = size;
+    cachep->object_size = size;
+    cachep->align       = align;
+    cachep->flags       = flags;
+    cachep->ctor        = ctor;
+    cachep->dtor        = dtor;
+    return cachep;
+}
+
+void kmem_cache_destroy(kmem_cache_t *cachep)
+{
+    heap_release(cachep);
+}
+
+void *kmem_cache_alloc(kmem_cache_t *cachep, gfp_t flags)
+{
+    void *object = heap_alloc(cachep->object_size, cachep->align);
+    if (object) {
+        ++cachep->alloc_count;
+        if (cachep->ctor) {
+            cachep->ctor(object);
+        }
+    }
+    return object;
+}
+
+void kmem_cache_free(void *addr)
+{
+    heap_release(addr);
+}
+
+void register_shrinker(shrinker_t *shrinker)
+{
+    // There is no memory pressure to react to.
+}
+
+// ============================================================================
+// Memory of the pages, and the block layer
+// ============================================================================
+
+uint32_t virt_kmap(page_t *page)
+{
+    return 0;
+}
+
+void virt_kunmap(uint32_t addr)
+{
+}
+
+void page_cache_invalidate(const void *owner, uint32_t ino)
+{
+    // The harness maps no file, there are no cached pages.
+}
+
+int bio_transfer_pages(vfs_file_t *device, int write, uint32_t sector, page_t **pages, size_t offset, size_t size)
+{
+    return -EIO;
+}
+
+void *aio_alloc_buffer(kiocb_t *iocb, size_t size, size_t skip)
+{
+    return NULL;
+}
+
+int aio_submit_sectors(kiocb_t *iocb, vfs_file_t *device, void *buffer, uint32_t sector, uint32_t count)
+{
+    return -EIO;
+}
+
+// ============================================================================
+// Scheduling and locking
+// ============================================================================
+
+/// The only task, running as root.
+static task_struct host_task;
+
+task_struct *scheduler_get_current_process(void)
+{
+    return &host_task;
+}
+
+void scheduler_set_task_state(task_struct *process, long state)
+{
+}
+
+task_struct *kthread_create(int (*threadfn)(void *data), void *data, const char *name)
+{
+    return NULL;
+}
+
+void kthread_yield(void)
+{
+}
+
+void cond_resched(void)
+{
+}
+
+void spinlock_init(spinlock_t *spinlock)
+{
+    spinlock->tickets = 0;
+}
+
+void spinlock_lock(spinlock_t *spinlock)
+{
+}
+
+void spinlock_unlock(spinlock_t *spinlock)
+{
+}
+
+int spinlock_trylock(spinlock_t *spinlock)
+{
+    return 1;
+}
+
+void mutex_init(mutex_t *mutex)
+{
+    mutex->state = 0;
+    mutex->owner = NULL;
+    init_waitqueue_head(&mutex->wait);
+}
+
+void mutex_lock(mutex_t *mutex)
+{
+    // Taking it twice would hang the kernel.
+    assert((mutex->state == 0) && "The mutex is already locked.");
+    mutex->state = 1;
+    mutex->owner = &host_task;
+}
+
+void mutex_unlock(mutex_t *mutex)
+{
+    mutex->state = 0;
+    mutex->owner = NULL;
+}
+
+void init_waitqueue_head(wait_queue_head_t *head)
+{
+    spinlock_init(&head->lock);
+    list_head_init(&head->task_list);
+}
+
+void init_waitqueue_entry(wait_queue_entry_t *wq, struct task_struct *task)
+{
+    memset(wq, 0, sizeof(wait_queue_entry_t));
+    wq->task = task;
+    list_head_init(&wq->task_list);
+}
+
+void add_wait_queue(wait_queue_head_t *head, wait_queue_entry_t *wq)
+{
+    list_head_insert_before(&wq->task_list, &head->task_list);
+}
+
+void remove_wait_queue(wait_queue_head_t *head, wait_queue_entry_t *wq)
+{
+    list_head_remove(&wq->task_list);
+}
+
+void wake_up(wait_queue_head_t *head)
+{
+}
+
+// ============================================================================
+// Time
+// ============================================================================
+
+uint32_t timer_hz = 100;
+
+unsigned long timer_get_ticks(void)
+{
+    return host_clock_us() / (1000000U / timer_hz);
+}
+
+struct timer_list *timer_list_alloc(void)
+{
+    struct timer_list *timer = kmalloc(sizeof(struct timer_list));
+    if (timer) {
+        memset(timer, 0, sizeof(struct timer_list));
+    }
+    return timer;
+}
+
+void add_timer(struct timer_list *timer)
+{
+    // Nothing expires, the harness writes back with vfs_sync.
+    kfree(timer);
+}
+
+void rtc_resync(void)
+{
+}
+
+time_t rtc_get_boot_time(void)
+{
+    // With no time elapsed since the boot, sys_time returns the host time.
+    return host_time();
+}
+
+ktime_t hrtimer_get_time(void)
+{
+    return 0;
+}
+
+// ============================================================================
+// Output and errors
+// ============================================================================
+
+int *__geterrno(void)
+{
+    return &host_task.error_no;
+}
+
+void console_write(const char *buffer, size_t count)
+{
+    host_write(1, buffer, count);
+}
+
+void dbg_printf(const char *file, const char *fun, int line, char *header, short log_level, const char *format, ...)
+{
+    char buffer[1024];
+    va_list ap;
+    if (!host_verbose && (log_level > LOGLEVEL_ERR)) {
+        return;
+    }
+    int length = snprintf(buffer, sizeof(buffer), "%s %s:%d %s: ", header, file, line, fun);
+    va_start(ap, format);
+    length += vsnprintf(buffer + length, sizeof(buffer) - length, format, ap);
+    va_end(ap);
+    if (length > (int)sizeof(buffer) - 1) {
+        length = sizeof(buffer) - 1;
+    }
+    host_write(2, buffer, length);
+}
+
+void __assert_fail(const char *assertion, const char *file, const char *function, unsigned int line)
+{
+    char buffer[512];
+    int length = snprintf(buffer, sizeof(buffer), "%s:%u: %s: Assertion `%s' failed.\n", file, line, function, assertion);
+    host_write(2, buffer, length);
+    host_exit(134);
+}
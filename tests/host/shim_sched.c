@@ -0,0 +1,291 @@
+/// @file shim_sched.c
+/// @brief The services of the kernel used by the scheduler, on top of the host.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// The harness never switches task nor returns to user space: it only moves
+/// tasks between the runqueues. The locks do nothing, the time is the tick
+/// set by the harness, and the services a task needs to run or to exit are
+/// empty. The memory comes from the heap of the process, and is never given
+/// back.
+
+#include "assert.h"
+#include "descriptor_tables/tss.h"
+#include "devices/fpu.h"
+#include "fs/aio.h"
+#include "fs/poll.h"
+#include "fs/vfs.h"
+#include "hardware/hrtimer.h"
+#include "hardware/pmu.h"
+#include "hardware/smp.h"
+#include "hardware/timer.h"
+#include "host.h"
+#include "io/console.h"
+#include "io/debug.h"
+#include "io/video.h"
+#include "klib/rcu.h"
+#include "klib/spinlock.h"
+#include "mem/paging.h"
+#include "process/process.h"
+#include "process/wait.h"
+#include "stdio.h"
+#include "strerror.h"
+#include "string.h"
+#include "sys/resource.h"
+#include "sys/sem.h"
+#include "system/panic.h"
+#include "system/signal.h"
+#include "system/trace.h"
+
+/// Set by -v, prints all the messages of the kernel instead of the errors.
+int host_verbose = 0;
+
+// ============================================================================
+// Memory
+// ============================================================================
+
+void *kmalloc(unsigned int size)
+{
+    // Keeps the allocations aligned to 16 bytes.
+    return host_sbrk((size + 15U) & ~15U);
+}
+
+void kfree(void *ptr)
+{
+}
+
+wait_queue_entry_t *wait_queue_entry_alloc(void)
+{
+    return kmalloc(sizeof(wait_queue_entry_t));
+}
+
+page_directory_t *paging_get_main_directory(void)
+{
+    return NULL;
+}
+
+void paging_switch_directory_va(page_directory_t *dir)
+{
+}
+
+void release_process_image(mm_struct_t *mm)
+{
+}
+
+// ============================================================================
+// CPUs
+// ============================================================================
+
+/// The CPUs, brought online by the harness.
+cpu_t cpus[SMP_MAX_CPUS];
+/// The CPUs, set by the harness.
+unsigned smp_num_cpus = 1;
+
+int cpuid_has_monitor(void)
+{
+    return 0;
+}
+
+void tss_set_stack(uint32_t kss, uint32_t kesp)
+{
+}
+
+void fpu_release_task(struct task_struct *task)
+{
+}
+
+void pmu_switch(struct task_struct *prev)
+{
+}
+
+void enter_userspace(uintptr_t location, uintptr_t stack)
+{
+    assert(0 && "The harness never enters user space.");
+}
+
+// ============================================================================
+// Tasks
+// ============================================================================
+
+task_struct *kthread_alloc(int (*threadfn)(void *data), void *data, const char *name)
+{
+    return NULL;
+}
+
+void kthread_yield(void)
+{
+}
+
+int process_release_vfork_mm(task_struct *task)
+{
+    return 0;
+}
+
+void process_clear_child_tid(task_struct *task)
+{
+}
+
+void process_free_task(task_struct *task)
+{
+}
+
+void vfs_close_task_files(struct task_struct *task)
+{
+}
+
+void aio_exit(task_struct *task)
+{
+}
+
+void poll_release(struct task_struct *task)
+{
+}
+
+void sem_exit(pid_t pid)
+{
+}
+
+int do_signal(struct pt_regs *f)
+{
+    return 0;
+}
+
+int sys_kill(pid_t pid, int sig)
+{
+    return -ESRCH;
+}
+
+void rcu_note_context_switch(void)
+{
+}
+
+// ============================================================================
+// Locking and waiting
+// ============================================================================
+
+void spinlock_init(spinlock_t *spinlock)
+{
+    spinlock->tickets = 0;
+}
+
+void spinlock_lock(spinlock_t *spinlock)
+{
+}
+
+void spinlock_unlock(spinlock_t *spinlock)
+{
+}
+
+void init_waitqueue_entry(wait_queue_entry_t *wq, struct task_struct *task)
+{
+    memset(wq, 0, sizeof(wait_queue_entry_t));
+    wq->task = task;
+    list_head_init(&wq->task_list);
+}
+
+void add_wait_queue(wait_queue_head_t *head, wait_queue_entry_t *wq)
+{
+    list_head_insert_before(&wq->task_list, &head->task_list);
+}
+
+int autoremove_wake_function(wait_queue_entry_t *wait, unsigned mode, int sync)
+{
+    return 0;
+}
+
+void wake_up(wait_queue_head_t *head)
+{
+}
+
+// ============================================================================
+// Time
+// ============================================================================
+
+/// The tick returned by timer_get_ticks, set by the harness.
+unsigned long host_ticks = 0;
+
+uint32_t timer_hz = 100;
+
+unsigned long timer_get_ticks(void)
+{
+    return host_ticks;
+}
+
+void timer_rusage_to_user(struct rusage *usage, const task_rusage_t *rusage)
+{
+    memset(usage, 0, sizeof(struct rusage));
+}
+
+void update_process_profiling_timer(task_struct *proc)
+{
+}
+
+int hrtimer_cancel(hrtimer_t *timer)
+{
+    return 0;
+}
+
+// ============================================================================
+// Output and errors
+// ============================================================================
+
+/// No event is traced.
+volatile uint32_t trace_mask = 0;
+
+void trace_record(trace_event_t event, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3)
+{
+}
+
+/// Where the errors of the harness go.
+static int host_errno;
+
+int *__geterrno(void)
+{
+    return &host_errno;
+}
+
+char *strerror(int errnum)
+{
+    return "error";
+}
+
+void console_write(const char *buffer, size_t count)
+{
+    host_write(1, buffer, count);
+}
+
+void video_update(void)
+{
+}
+
+void dbg_printf(const char *file, const char *fun, int line, char *header, short log_level, const char *format, ...)
+{
+    char buffer[1024];
+    va_list ap;
+    if (!host_verbose && (log_level > LOGLEVEL_ERR)) {
+        return;
+    }
+    int length = snprintf(buffer, sizeof(buffer), "%s %s:%d %s: ", header, file, line, fun);
+    va_start(ap, format);
+    length += vsnprintf(buffer + length, sizeof(buffer) - length, format, ap);
+    va_end(ap);
+    if (length > (int)sizeof(buffer) - 1) {
+        length = sizeof(buffer) - 1;
+    }
+    host_write(2, buffer, length);
+}
+
+void kernel_panic(const char *msg)
+{
+    host_write(2, msg, strlen(msg));
+    host_write(2, "\n", 1);
+    host_exit(134);
+}
+
+void __assert_fail(const char *assertion, const char *file, const char *function, unsigned int line)
+{
+    char buffer[512];
+    int length = snprintf(buffer, sizeof(buffer), "%s:%u: %s: Assertion `%s' failed.\n", file, line, function, assertion);
+    host_write(2, buffer, length);
+    host_exit(134);
+}
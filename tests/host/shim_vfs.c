@@ -0,0 +1,341 @@
+/// @file shim_vfs.c
+/// @brief The virtual filesystem and the block device of the host-side
+/// harness.
+/// @copyright (c) 2014-2024 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+/// @details
+/// There are two superblocks: /dev/hda, whose root is the disk, and /, the
+/// ext2 filesystem mounted from it. The vfs_* functions resolve the path and
+/// call the operations of the filesystem, like their counterparts of
+/// fs/vfs.c, without the mount points, the page cache and the epoll hooks.
+
+#include "shim.h"
+
+#include "assert.h"
+#include "fs/buffer_cache.h"
+#include "fs/dcache.h"
+#include "fs/ext2.h"
+#include "host.h"
+#include "limits.h"
+#include "mem/slab.h"
+#include "string.h"
+#include "sys/errno.h"
+
+/// The path of the disk, as given to the mount of ext2.
+#define HOST_DISK_PATH "/dev/hda"
+
+kmem_cache_t *vfs_file_cache;
+
+/// The only filesystem, registered by ext2_initialize.
+static file_system_type *host_fs_type;
+/// The superblock of the disk.
+static super_block_t host_disk_sb;
+/// The superblock of the ext2 root.
+static super_block_t host_root_sb;
+
+/// @brief The disk, a file of the host.
+static struct {
+    /// The descriptor of the image.
+    int fd;
+    /// The time each command is held back, in microseconds.
+    uint32_t delay_us;
+    /// The commands which reached the disk.
+    host_disk_stats_t stats;
+} host_disk_state;
+
+// ============================================================================
+// Block device
+// ============================================================================
+
+/// @brief Holds back a command of the disk, to emulate a slower one.
+static void host_disk_delay(void)
+{
+    if (host_disk_state.delay_us) {
+        uint32_t start = host_clock_us();
+        while ((host_clock_us() - start) < host_disk_state.delay_us) {
+        }
+    }
+}
+
+/// @brief Reads from the disk.
+/// @param file the disk.
+/// @param buffer where the data is stored.
+/// @param offset the offset, in bytes.
+/// @param nbyte the number of bytes.
+/// @return the number of bytes read, -EIO on failure.
+static ssize_t host_disk_read(vfs_file_t *file, char *buffer, off_t offset, size_t nbyte)
+{
+    host_disk_delay();
+    ++host_disk_state.stats.reads;
+    host_disk_state.stats.read_bytes += nbyte;
+    ssize_t ret = host_pread(host_disk_state.fd, buffer, nbyte, (uint32_t)offset);
+    return (ret == (ssize_t)nbyte) ? ret : -EIO;
+}
+
+/// @brief Writes to the disk.
+/// @param file the disk.
+/// @param buffer the data.
+/// @param offset the offset, in bytes.
+/// @param nbyte the number of bytes.
+/// @return the number of bytes written, -EIO on failure.
+static ssize_t host_disk_write(vfs_file_t *file, const void *buffer, off_t offset, size_t nbyte)
+{
+    host_disk_delay();
+    ++host_disk_state.stats.writes;
+    host_disk_state.stats.written_bytes += nbyte;
+    ssize_t ret = host_pwrite(host_disk_state.fd, buffer, nbyte, (uint32_t)offset);
+    return (ret == (ssize_t)nbyte) ? ret : -EIO;
+}
+
+/// The operations of the disk.
+static vfs_file_operations_t host_disk_fs_operations = {
+    .read_f  = host_disk_read,
+    .write_f = host_disk_write,
+};
+
+/// The disk.
+static vfs_file_t host_disk_file = {
+    .name          = "hda",
+    .flags         = DT_BLK,
+    .mask          = 0660,
+    .count         = 1,
+    .fs_operations = &host_disk_fs_operations,
+};
+
+void host_disk_stats(host_disk_stats_t *stats)
+{
+    *stats = host_disk_state.stats;
+}
+
+vfs_file_t *host_disk(void)
+{
+    return &host_disk_file;
+}
+
+// ============================================================================
+// Virtual filesystem
+// ============================================================================
+
+char *realpath(const char *path, char *buffer, size_t buflen)
+{
+    // There is no working directory, and no symbolic link is followed.
+    if ((path[0] != '/') || (strlen(path) >= buflen)) {
+        errno = EINVAL;
+        return NULL;
+    }
+    size_t length = 0;
+    while (*path) {
+        while (*path == '/') {
+            ++path;
+        }
+        const char *end = path;
+        while (*end && (*end != '/')) {
+            ++end;
+        }
+        size_t size = end - path;
+        if ((size == 0) || ((size == 1) && (path[0] == '.'))) {
+            // Nothing to append.
+        } else if ((size == 2) && (path[0] == '.') && (path[1] == '.')) {
+            while ((length > 0) && (buffer[--length] != '/')) {
+            }
+        } else {
+            buffer[length++] = '/';
+            memcpy(buffer + length, path, size);
+            length += size;
+        }
+        path = end;
+    }
+    if (length == 0) {
+        buffer[length++] = '/';
+    }
+    buffer[length] = 0;
+    return buffer;
+}
+
+int vfs_register_filesystem(file_system_type *fs)
+{
+    host_fs_type = fs;
+    return 1;
+}
+
+int vfs_unregister_filesystem(file_system_type *fs)
+{
+    host_fs_type = NULL;
+    return 1;
+}
+
+super_block_t *vfs_get_superblock(const char *absolute_path)
+{
+    if (!strncmp(absolute_path, "/dev/", 5)) {
+        return &host_disk_sb;
+    }
+    return &host_root_sb;
+}
+
+int vfs_valid_open_permissions(int flags, mode_t mask, uid_t uid, gid_t gid)
+{
+    // The harness runs as root.
+    return 1;
+}
+
+vfs_file_t *vfs_open(const char *pathname, int flags, mode_t mode)
+{
+    char absolute_path[PATH_MAX];
+    if (!realpath(pathname, absolute_path, sizeof(absolute_path))) {
+        return NULL;
+    }
+    vfs_file_t *sb_root = vfs_get_superblock(absolute_path)->root;
+    if ((sb_root == NULL) || (sb_root->fs_operations->open_f == NULL)) {
+        errno = ENOENT;
+        return NULL;
+    }
+    vfs_file_t *file = sb_root->fs_operations->open_f(absolute_path, flags, mode);
+    if (file) {
+        file->count += 1;
+    }
+    return file;
+}
+
+int vfs_close(vfs_file_t *file)
+{
+    assert(file->count > 0);
+    if ((--file->count == 0) && file->fs_operations->close_f) {
+        file->fs_operations->close_f(file);
+    }
+    return 0;
+}
+
+ssize_t vfs_read(vfs_file_t *file, void *buf, size_t offset, size_t nbytes)
+{
+    if (file->fs_operations->read_f == NULL) {
+        return -ENOSYS;
+    }
+    return file->fs_operations->read_f(file, buf, offset, nbytes);
+}
+
+ssize_t vfs_write(vfs_file_t *file, const void *buf, size_t offset, size_t nbytes)
+{
+    if (file->fs_operations->write_f == NULL) {
+        return -ENOSYS;
+    }
+    return file->fs_operations->write_f(file, buf, offset, nbytes);
+}
+
+ssize_t vfs_getdents(vfs_file_t *file, dirent_t *dirp, off_t off, size_t count)
+{
+    if (file->fs_operations->getdents_f == NULL) {
+        return -ENOSYS;
+    }
+    return file->fs_operations->getdents_f(file, dirp, off, count);
+}
+
+int vfs_sync(void)
+{
+    int ret = 0;
+    if (host_fs_type && host_fs_type->sync_fs && host_root_sb.root) {
+        if (host_fs_type->sync_fs(host_root_sb.root) < 0) {
+            ret = -EIO;
+        }
+    }
+    if (buffer_sync(NULL) < 0) {
+        ret = -EIO;
+    }
+    return ret;
+}
+
+/// @brief Resolves the path of an entry of the ext2 root.
+/// @param path the path.
+/// @param absolute_path where the absolute path is stored, PATH_MAX bytes.
+/// @return the root of ext2, NULL if the path is not valid.
+static vfs_file_t *host_resolve(const char *path, char *absolute_path)
+{
+    if (!realpath(path, absolute_path, PATH_MAX) || (host_root_sb.root == NULL)) {
+        return NULL;
+    }
+    return host_root_sb.root;
+}
+
+int vfs_unlink(const char *path)
+{
+    char absolute_path[PATH_MAX];
+    vfs_file_t *sb_root = host_resolve(path, absolute_path);
+    if (sb_root == NULL) {
+        return -ENODEV;
+    }
+    return sb_root->fs_operations->unlink_f(absolute_path);
+}
+
+int vfs_mkdir(const char *path, mode_t mode)
+{
+    char absolute_path[PATH_MAX];
+    vfs_file_t *sb_root = host_resolve(path, absolute_path);
+    if (sb_root == NULL) {
+        return -ENODEV;
+    }
+    return sb_root->sys_operations->mkdir_f(absolute_path, mode);
+}
+
+int vfs_rmdir(const char *path)
+{
+    char absolute_path[PATH_MAX];
+    vfs_file_t *sb_root = host_resolve(path, absolute_path);
+    if (sb_root == NULL) {
+        return -ENODEV;
+    }
+    return sb_root->sys_operations->rmdir_f(absolute_path);
+}
+
+vfs_file_t *vfs_creat(const char *path, mode_t mode)
+{
+    char absolute_path[PATH_MAX];
+    vfs_file_t *sb_root = host_resolve(path, absolute_path);
+    if (sb_root == NULL) {
+        errno = ENODEV;
+        return NULL;
+    }
+    vfs_file_t *file = sb_root->sys_operations->creat_f(absolute_path, mode);
+    if (file) {
+        file->count += 1;
+    }
+    return file;
+}
+
+int vfs_stat(const char *path, stat_t *buf)
+{
+    char absolute_path[PATH_MAX];
+    vfs_file_t *sb_root = host_resolve(path, absolute_path);
+    if (sb_root == NULL) {
+        return -ENODEV;
+    }
+    memset(buf, 0, sizeof(stat_t));
+    return sb_root->sys_operations->stat_f(absolute_path, buf);
+}
+
+int host_vfs_init(const char *image, uint32_t delay_us)
+{
+    host_disk_state.fd = host_open(image);
+    if (host_disk_state.fd < 0) {
+        return -1;
+    }
+    host_disk_state.delay_us = delay_us;
+    strcpy(host_disk_sb.name, "hda");
+    strcpy(host_disk_sb.path, HOST_DISK_PATH);
+    host_disk_sb.root = &host_disk_file;
+    // The same order as vfs_init, then the initcall of ext2.
+    vfs_file_cache = KMEM_CREATE(vfs_file_t);
+    buffer_cache_init();
+    dcache_init();
+    ext2_initialize();
+    if (host_fs_type == NULL) {
+        return -1;
+    }
+    vfs_file_t *root = host_fs_type->mount("/", HOST_DISK_PATH);
+    if (root == NULL) {
+        return -1;
+    }
+    strcpy(host_root_sb.name, "/");
+    strcpy(host_root_sb.path, "/");
+    host_root_sb.root = root;
+    host_root_sb.type = host_fs_type;
+    return 0;
+}